@@ -40,6 +40,7 @@ static ulong arm64_processor_speed(void);
 static void arm64_init_kernel_pgd(void);
 static int arm64_kvtop(struct task_context *, ulong, physaddr_t *, int);
 static int arm64_uvtop(struct task_context *, ulong, physaddr_t *, int);
+static int arm64_vtop_extent(struct task_context *, ulong, int, physaddr_t *, ulong *);
 static int arm64_vtop_2level_64k(ulong, ulong, physaddr_t *, int);
 static int arm64_vtop_3level_64k(ulong, ulong, physaddr_t *, int);
 static int arm64_vtop_3level_4k(ulong, ulong, physaddr_t *, int);
@@ -390,6 +391,7 @@ arm64_init(int when)
 		machdep->flags |= VMEMMAP;
 
 		machdep->uvtop = arm64_uvtop;
+		machdep->vtop_extent = arm64_vtop_extent;
 		machdep->is_uvaddr = arm64_is_uvaddr;
 		machdep->eframe_search = arm64_eframe_search;
 		machdep->back_trace = arm64_back_trace_cmd;
@@ -1022,6 +1024,7 @@ arm64_dump_machdep_table(ulong arg)
 		"arm64_vtop_4level_4k" :
 		machdep->flags & VM_L3_64K ?
 		"arm64_vtop_3level_64k" : "arm64_vtop_2level_64k");
+	fprintf(fp, "         vtop_extent: arm64_vtop_extent()\n");
 	fprintf(fp, "        get_task_pgd: arm64_get_task_pgd()\n");
 	fprintf(fp, "            dump_irq: generic_dump_irq()\n");
 	fprintf(fp, "     get_stack_frame: arm64_get_stack_frame()\n");
@@ -1761,6 +1764,44 @@ arm64_uvtop(struct task_context *tc, ulong uvaddr, physaddr_t *paddr, int verbos
 #define SECTION_PAGE_MASK_512MB  ((long)(~((MEGABYTES(512))-1)))
 #define SECTION_PAGE_MASK_1GB    ((long)(~((GIGABYTES(1))-1)))
 
+/*
+ *  The size of the region translated by the last table entry read by one
+ *  of the page table walkers below, which is that of its block or page
+ *  mapping if the translation succeeded, or that of the region left
+ *  unmapped by an empty entry.  The contiguous bit marks an aligned run
+ *  of ARM64_CONT_PTES pages, or ARM64_CONT_PMDS blocks, that are
+ *  physically contiguous as well.
+ */
+static ulong arm64_vtop_mapsize = 0;
+
+#define ARM64_CONT_PTES  (PAGESIZE() == 4096 ? 16 : 32)
+#define ARM64_CONT_PMDS  (PAGESIZE() == 4096 ? 16 : 32)
+
+/*
+ *  Translate a kernel or user virtual address quietly, and also return
+ *  the number of bytes from it to the end of its block, contiguous or
+ *  page mapping, or, if it is not mapped, to the end of the region that
+ *  is left unmapped by the table entry that stopped the walk.  The
+ *  linear map is translated without a walk, one page at a time.
+ */
+static int
+arm64_vtop_extent(struct task_context *tc, ulong vaddr, int memtype,
+		  physaddr_t *paddr, ulong *length)
+{
+	int ret;
+
+	arm64_vtop_mapsize = PAGESIZE();
+
+	if (memtype == UVADDR)
+		ret = arm64_uvtop(tc, vaddr, paddr, 0);
+	else
+		ret = arm64_kvtop(tc, vaddr, paddr, 0);
+
+	*length = arm64_vtop_mapsize - (vaddr & (arm64_vtop_mapsize - 1));
+
+	return ret;
+}
+
 static int 
 arm64_vtop_2level_64k(ulong pgd, ulong vaddr, physaddr_t *paddr, int verbose)
 {
@@ -1776,6 +1817,7 @@ arm64_vtop_2level_64k(ulong pgd, ulong vaddr, physaddr_t *paddr, int verbose)
         pgd_val = ULONG(machdep->pgd + PAGEOFFSET(pgd_ptr));
         if (verbose) 
                 fprintf(fp, "   PGD: %lx => %lx\n", (ulong)pgd_ptr, pgd_val);
+	arm64_vtop_mapsize = PGDIR_SIZE_L2_64K;
 	if (!pgd_val)
 		goto no_page;
 
@@ -1786,6 +1828,8 @@ arm64_vtop_2level_64k(ulong pgd, ulong vaddr, physaddr_t *paddr, int verbose)
 
 	if ((pgd_val & PMD_TYPE_MASK) == PMD_TYPE_SECT) {
 		ulong sectionbase = (pgd_val & SECTION_PAGE_MASK_512MB) & PHYS_MASK;
+		if (pgd_val & PTE_CONT)
+			arm64_vtop_mapsize *= ARM64_CONT_PMDS;
 		if (verbose) {
 			fprintf(fp, "  PAGE: %lx  (512MB)\n\n", sectionbase);
 			arm64_translate_pte(pgd_val, 0, 0);
@@ -1800,10 +1844,13 @@ arm64_vtop_2level_64k(ulong pgd, ulong vaddr, physaddr_t *paddr, int verbose)
         pte_val = ULONG(machdep->ptbl + PAGEOFFSET(pte_ptr));
         if (verbose) 
                 fprintf(fp, "   PTE: %lx => %lx\n", (ulong)pte_ptr, pte_val);
+	arm64_vtop_mapsize = PAGESIZE();
 	if (!pte_val)
 		goto no_page;
 
 	if (pte_val & PTE_VALID) {
+		if (pte_val & PTE_CONT)
+			arm64_vtop_mapsize *= ARM64_CONT_PTES;
 		*paddr = (PAGEBASE(pte_val) & PHYS_MASK) + PAGEOFFSET(vaddr);
 		if (verbose) {
 			fprintf(fp, "  PAGE: %lx\n\n", PAGEBASE(*paddr));
@@ -1840,6 +1887,7 @@ arm64_vtop_3level_64k(ulong pgd, ulong vaddr, physaddr_t *paddr, int verbose)
         pgd_val = ULONG(machdep->pgd + PGDIR_OFFSET_L3_64K(pgd_ptr));
         if (verbose)
                 fprintf(fp, "   PGD: %lx => %lx\n", (ulong)pgd_ptr, pgd_val);
+	arm64_vtop_mapsize = PGDIR_SIZE_L3_64K;
 	if (!pgd_val)
 		goto no_page;
 
@@ -1853,11 +1901,14 @@ arm64_vtop_3level_64k(ulong pgd, ulong vaddr, physaddr_t *paddr, int verbose)
         pmd_val = ULONG(machdep->pmd + PAGEOFFSET(pmd_ptr));
         if (verbose)
                 fprintf(fp, "   PMD: %lx => %lx\n", (ulong)pmd_ptr, pmd_val);
+	arm64_vtop_mapsize = PMD_SIZE_L3_64K;
 	if (!pmd_val)
 		goto no_page;
 
 	if ((pmd_val & PMD_TYPE_MASK) == PMD_TYPE_SECT) {
 		ulong sectionbase = PTE_TO_PHYS(pmd_val) & SECTION_PAGE_MASK_512MB;
+		if (pmd_val & PTE_CONT)
+			arm64_vtop_mapsize *= ARM64_CONT_PMDS;
 		if (verbose) {
 			fprintf(fp, "  PAGE: %lx  (512MB)\n\n", sectionbase);
 			arm64_translate_pte(pmd_val, 0, 0);
@@ -1872,10 +1923,13 @@ arm64_vtop_3level_64k(ulong pgd, ulong vaddr, physaddr_t *paddr, int verbose)
         pte_val = ULONG(machdep->ptbl + PAGEOFFSET(pte_ptr));
         if (verbose)
                 fprintf(fp, "   PTE: %lx => %lx\n", (ulong)pte_ptr, pte_val);
+	arm64_vtop_mapsize = PAGESIZE();
 	if (!pte_val)
 		goto no_page;
 
 	if (pte_val & PTE_VALID) {
+		if (pte_val & PTE_CONT)
+			arm64_vtop_mapsize *= ARM64_CONT_PTES;
 		*paddr = PTE_TO_PHYS(pte_val) + PAGEOFFSET(vaddr);
 		if (verbose) {
 			fprintf(fp, "  PAGE: %lx\n\n", PAGEBASE(*paddr));
@@ -1912,6 +1966,7 @@ arm64_vtop_3level_4k(ulong pgd, ulong vaddr, physaddr_t *paddr, int verbose)
         pgd_val = ULONG(machdep->pgd + PAGEOFFSET(pgd_ptr));
         if (verbose) 
                 fprintf(fp, "   PGD: %lx => %lx\n", (ulong)pgd_ptr, pgd_val);
+	arm64_vtop_mapsize = PGDIR_SIZE_L3_4K;
 	if (!pgd_val)
 		goto no_page;
 
@@ -1934,11 +1989,14 @@ arm64_vtop_3level_4k(ulong pgd, ulong vaddr, physaddr_t *paddr, int verbose)
         pmd_val = ULONG(machdep->pmd + PAGEOFFSET(pmd_ptr));
         if (verbose) 
                 fprintf(fp, "   PMD: %lx => %lx\n", (ulong)pmd_ptr, pmd_val);
+	arm64_vtop_mapsize = PMD_SIZE_L3_4K;
 	if (!pmd_val)
 		goto no_page;
 
 	if ((pmd_val & PMD_TYPE_MASK) == PMD_TYPE_SECT) {
 		ulong sectionbase = (pmd_val & SECTION_PAGE_MASK_2MB) & PHYS_MASK;
+		if (pmd_val & PTE_CONT)
+			arm64_vtop_mapsize *= ARM64_CONT_PMDS;
 		if (verbose) {
 			fprintf(fp, "  PAGE: %lx  (2MB)\n\n", sectionbase);
 			arm64_translate_pte(pmd_val, 0, 0);
@@ -1953,10 +2011,13 @@ arm64_vtop_3level_4k(ulong pgd, ulong vaddr, physaddr_t *paddr, int verbose)
         pte_val = ULONG(machdep->ptbl + PAGEOFFSET(pte_ptr));
         if (verbose) 
                 fprintf(fp, "   PTE: %lx => %lx\n", (ulong)pte_ptr, pte_val);
+	arm64_vtop_mapsize = PAGESIZE();
 	if (!pte_val)
 		goto no_page;
 
 	if (pte_val & PTE_VALID) {
+		if (pte_val & PTE_CONT)
+			arm64_vtop_mapsize *= ARM64_CONT_PTES;
 		*paddr = (PAGEBASE(pte_val) & PHYS_MASK) + PAGEOFFSET(vaddr);
 		if (verbose) {
 			fprintf(fp, "  PAGE: %lx\n\n", PAGEBASE(*paddr));
@@ -1994,6 +2055,7 @@ arm64_vtop_4level_4k(ulong pgd, ulong vaddr, physaddr_t *paddr, int verbose)
         pgd_val = ULONG(machdep->pgd + PGDIR_OFFSET_48VA(pgd_ptr));
         if (verbose)
                 fprintf(fp, "   PGD: %lx => %lx\n", (ulong)pgd_ptr, pgd_val);
+	arm64_vtop_mapsize = PGDIR_SIZE_L4_4K;
 	if (!pgd_val)
 		goto no_page;
 
@@ -2004,6 +2066,7 @@ arm64_vtop_4level_4k(ulong pgd, ulong vaddr, physaddr_t *paddr, int verbose)
         pud_val = ULONG(machdep->pud + PAGEOFFSET(pud_ptr));
         if (verbose)
                 fprintf(fp, "   PUD: %lx => %lx\n", (ulong)pud_ptr, pud_val);
+	arm64_vtop_mapsize = PUD_SIZE_L4_4K;
 	if (!pud_val)
 		goto no_page;
 
@@ -2023,11 +2086,14 @@ arm64_vtop_4level_4k(ulong pgd, ulong vaddr, physaddr_t *paddr, int verbose)
         pmd_val = ULONG(machdep->pmd + PAGEOFFSET(pmd_ptr));
         if (verbose)
                 fprintf(fp, "   PMD: %lx => %lx\n", (ulong)pmd_ptr, pmd_val);
+	arm64_vtop_mapsize = PMD_SIZE_L4_4K;
 	if (!pmd_val)
 		goto no_page;
 
 	if ((pmd_val & PMD_TYPE_MASK) == PMD_TYPE_SECT) {
 		ulong sectionbase = (pmd_val & SECTION_PAGE_MASK_2MB) & PHYS_MASK;
+		if (pmd_val & PTE_CONT)
+			arm64_vtop_mapsize *= ARM64_CONT_PMDS;
 		if (verbose) {
 			fprintf(fp, "  PAGE: %lx  (2MB)\n\n", sectionbase);
 			arm64_translate_pte(pmd_val, 0, 0);
@@ -2042,10 +2108,13 @@ arm64_vtop_4level_4k(ulong pgd, ulong vaddr, physaddr_t *paddr, int verbose)
         pte_val = ULONG(machdep->ptbl + PAGEOFFSET(pte_ptr));
         if (verbose)
                 fprintf(fp, "   PTE: %lx => %lx\n", (ulong)pte_ptr, pte_val);
+	arm64_vtop_mapsize = PAGESIZE();
 	if (!pte_val)
 		goto no_page;
 
 	if (pte_val & PTE_VALID) {
+		if (pte_val & PTE_CONT)
+			arm64_vtop_mapsize *= ARM64_CONT_PTES;
 		*paddr = (PAGEBASE(pte_val) & PHYS_MASK) + PAGEOFFSET(vaddr);
 		if (verbose) {
 			fprintf(fp, "  PAGE: %lx\n\n", PAGEBASE(*paddr));
@@ -0,0 +1,249 @@
+/* batch.c - core analysis suite
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "defs.h"
+
+struct batch_dumpfile {
+	char *path;
+	char *output;
+	pid_t pid;
+	int status;
+	ulonglong usecs;
+	struct timespec start;
+};
+
+static void batch_output_file(struct batch_dumpfile *);
+static int batch_start(struct batch_dumpfile *, char **, char **, int);
+static struct batch_dumpfile *batch_wait(struct batch_dumpfile *, int);
+static int batch_show_result(struct batch_dumpfile *);
+
+#define BATCH_USECS(start, end) \
+	((ulonglong)((end).tv_sec - (start).tv_sec) * 1000000 + \
+	 ((end).tv_nsec - (start).tv_nsec) / 1000)
+
+/*
+ *  Run the -i input file against each of the dumpfile arguments, with
+ *  each dumpfile brought up in its own session by a child process, and
+ *  up to pc->batch_jobs sessions running at a time.  The namelist and
+ *  System.map arguments are shared by all of them, and the output of
+ *  each session is written to its own file in pc->batch_output.
+ *
+ *  The session of the first dumpfile is run by itself, so that the
+ *  datatype cache, and the gdb index cache if --index_cache is used,
+ *  are written once for a shared vmlinux file, and are then read by the
+ *  sessions that follow instead of each of them doing that work.
+ *
+ *  This returns only in the child processes, with argv[] rewritten to
+ *  contain just the shared arguments and its dumpfile.
+ */
+void
+batch_dumpfiles(char **argv)
+{
+	int i, cnt, nshared, ndumps, next, running, failed;
+	char **shared;
+	struct batch_dumpfile *dumps, *bd;
+
+	if (!pc->input_file)
+		error(FATAL, "--batch requires an input file (-i option)\n");
+
+	if (!pc->batch_output)
+		pc->batch_output = ".";
+
+	for (cnt = 0; argv[optind + cnt]; cnt++)
+		;
+
+	if (!(shared = calloc(cnt + 1, sizeof(char *))) ||
+	    !(dumps = calloc(cnt + 1, sizeof(struct batch_dumpfile))))
+		error(FATAL, "cannot allocate batch arguments\n");
+
+	for (i = nshared = ndumps = 0; i < cnt; i++) {
+		if (is_kernel(argv[optind + i]) ||
+		    is_system_map(argv[optind + i]))
+			shared[nshared++] = argv[optind + i];
+		else {
+			dumps[ndumps].path = argv[optind + i];
+			batch_output_file(&dumps[ndumps]);
+			ndumps++;
+		}
+	}
+
+	if (!ndumps)
+		error(FATAL, "--batch requires one or more dumpfile arguments\n");
+
+	fprintf(fp, "batch: %d dumpfile%s, %d at a time, output in %s\n",
+		ndumps, ndumps > 1 ? "s" : "", pc->batch_jobs, pc->batch_output);
+
+	failed = 0;
+
+	for (next = running = 0; (next < ndumps) || running; ) {
+		/*
+		 *  The first session runs by itself.
+		 */
+		if ((next < ndumps) && (running < (next ? pc->batch_jobs : 1))) {
+			bd = &dumps[next++];
+			if (batch_start(bd, argv, shared, nshared))
+				return;
+			if (bd->pid > 0)
+				running++;
+			else
+				failed += batch_show_result(bd);
+			continue;
+		}
+
+		if ((bd = batch_wait(dumps, ndumps))) {
+			running--;
+			failed += batch_show_result(bd);
+		} else
+			running = 0;
+	}
+
+	fprintf(fp, "batch: %d dumpfile%s, %d failed\n",
+		ndumps, ndumps > 1 ? "s" : "", failed);
+
+	clean_exit(failed ? 1 : 0);
+}
+
+/*
+ *  Name the output file of a dumpfile after its path, with the slashes
+ *  replaced, since the dumpfiles of different systems are commonly all
+ *  named "vmcore" in per-crash directories.
+ */
+static void
+batch_output_file(struct batch_dumpfile *bd)
+{
+	char buf[BUFSIZE];
+	char *p;
+
+	p = bd->path;
+	while ((*p == '/') || STRNEQ(p, "./"))
+		p += (*p == '/') ? 1 : 2;
+
+	snprintf(buf, BUFSIZE, "%s", strlen(p) ? p : "dumpfile");
+	for (p = buf; *p; p++) {
+		if (*p == '/')
+			*p = '_';
+	}
+
+	if (!(bd->output = malloc(strlen(pc->batch_output) + strlen(buf) + 6)))
+		error(FATAL, "cannot allocate output file name of %s\n",
+			bd->path);
+	sprintf(bd->output, "%s/%s.out", pc->batch_output, buf);
+}
+
+/*
+ *  Fork the session of a dumpfile, returning TRUE in the child, which
+ *  has its stdout and stderr sent to the output file, its stdin reading
+ *  from /dev/null, and the remaining command line arguments replaced by
+ *  the shared arguments and its dumpfile.
+ */
+static int
+batch_start(struct batch_dumpfile *bd, char **argv, char **shared,
+	    int nshared)
+{
+	int i, fd, nullfd;
+
+	if ((fd = open(bd->output, O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0) {
+		error(INFO, "%s: %s\n", bd->output, strerror(errno));
+		bd->pid = -1;
+		return FALSE;
+	}
+
+	fflush(NULL);
+	clock_gettime(CLOCK_MONOTONIC, &bd->start);
+
+	if ((bd->pid = fork()) < 0) {
+		error(INFO, "cannot fork session for %s: %s\n",
+			bd->path, strerror(errno));
+		close(fd);
+		return FALSE;
+	}
+
+	if (bd->pid) {
+		close(fd);
+		return FALSE;
+	}
+
+	if ((nullfd = open("/dev/null", O_RDONLY)) >= 0) {
+		dup2(nullfd, fileno(stdin));
+		close(nullfd);
+	}
+	dup2(fd, fileno(stdout));
+	dup2(fd, fileno(stderr));
+	close(fd);
+
+	for (i = 0; i < nshared; i++)
+		argv[optind + i] = shared[i];
+	argv[optind + i++] = bd->path;
+	argv[optind + i] = NULL;
+
+	pc->flags2 |= BATCH_SESSION;
+	pc->flags &= ~SCROLL;
+
+	return TRUE;
+}
+
+/*
+ *  Wait for the next session to finish, returning NULL if there are none.
+ */
+static struct batch_dumpfile *
+batch_wait(struct batch_dumpfile *dumps, int ndumps)
+{
+	int i, status;
+	pid_t pid;
+	struct timespec end;
+
+	while ((pid = wait(&status)) > 0) {
+		for (i = 0; i < ndumps; i++) {
+			if (dumps[i].pid == pid) {
+				clock_gettime(CLOCK_MONOTONIC, &end);
+				dumps[i].usecs = BATCH_USECS(dumps[i].start, end);
+				dumps[i].status = status;
+				dumps[i].pid = 0;
+				return &dumps[i];
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ *  Display the result of a session, returning 1 if it failed.
+ */
+static int
+batch_show_result(struct batch_dumpfile *bd)
+{
+	if (!bd)
+		return 0;
+
+	fprintf(fp, "%s: ", bd->path);
+
+	if (bd->pid < 0) {
+		fprintf(fp, "not started\n");
+		return 1;
+	}
+
+	if (WIFEXITED(bd->status) && !WEXITSTATUS(bd->status))
+		fprintf(fp, "done");
+	else if (WIFEXITED(bd->status))
+		fprintf(fp, "failed (exit status %d)", WEXITSTATUS(bd->status));
+	else if (WIFSIGNALED(bd->status))
+		fprintf(fp, "failed (signal %d)", WTERMSIG(bd->status));
+	else
+		fprintf(fp, "failed");
+
+	fprintf(fp, " in %lld.%02lld seconds, output in %s\n",
+		bd->usecs / 1000000, (bd->usecs % 1000000) / 10000, bd->output);
+
+	return (WIFEXITED(bd->status) && !WEXITSTATUS(bd->status)) ? 0 : 1;
+}
@@ -0,0 +1,258 @@
+/* bench.c - core analysis suite
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "defs.h"
+#include <sys/resource.h>
+
+/*
+ *  The default workloads, which exercise the task list, slab, memory
+ *  search, list, log, file and data type display paths.
+ */
+static char *bench_default_workloads[] = {
+	"foreach bt",
+	"kmem -s",
+	"search -k -l 0x10000000 0xdeadbeefdeadbeef",
+	"list task_struct.tasks -s task_struct.pid -h init_task",
+	"log",
+	"foreach files",
+	"foreach task -R pid,comm",
+	NULL
+};
+
+struct bench_result {
+	char *status;
+	ulonglong wall_usecs;
+	ulonglong cpu_usecs;
+	long maxrss_kb;
+	struct readmem_profile_totals totals;
+};
+
+static void bench_run(char *, struct bench_result *);
+static void bench_show_string(char *);
+static void bench_show_result(char *, int, struct bench_result *);
+static void bench_show_startup(void);
+
+/*
+ *  State that has to survive a longjmp() out of a failing workload.
+ */
+static FILE *bench_saved_fp;
+static jmp_buf bench_saved_env;
+static ulonglong bench_saved_flags2;
+static char *bench_saved_curcmd;
+
+#define BENCH_USECS(start, end) \
+	((ulonglong)((end).tv_sec - (start).tv_sec) * 1000000 + \
+	 ((end).tv_nsec - (start).tv_nsec) / 1000)
+
+#define RUSAGE_USECS(ru) \
+	((ulonglong)((ru).ru_utime.tv_sec + (ru).ru_stime.tv_sec) * 1000000 + \
+	 (ru).ru_utime.tv_usec + (ru).ru_stime.tv_usec)
+
+/*
+ *  Run a set of workloads against the current session, discarding their
+ *  output, and display one JSON object per line for each startup phase
+ *  and each workload run.
+ */
+void
+cmd_bench(void)
+{
+	int c, i, r, count, startup;
+	char **workloads, *p;
+	char *saved[MAXARGS];
+	char savebuf[BUFSIZE];
+	struct bench_result result;
+
+	count = 1;
+	startup = TRUE;
+
+	while ((c = getopt(argcnt, args, "n:S")) != EOF) {
+		switch(c)
+		{
+		case 'n':
+			count = dtoi(optarg, FAULT_ON_ERROR, NULL);
+			if (count < 1)
+				error(FATAL, "invalid count: %s\n", optarg);
+			break;
+
+		case 'S':
+			startup = FALSE;
+			break;
+
+		default:
+			argerrs++;
+			break;
+		}
+	}
+
+	if (argerrs)
+		cmd_usage(pc->curcmd, SYNOPSIS);
+
+	if (pc->flags & MINIMAL_MODE)
+		error(FATAL, "not available in minimal mode\n");
+
+	/*
+	 *  The workloads overwrite args[], so keep a copy of the workload
+	 *  arguments.
+	 */
+	workloads = bench_default_workloads;
+	if (args[optind]) {
+		for (i = 0, p = savebuf; args[optind]; optind++) {
+			if (((p - savebuf) + strlen(args[optind]) + 1) > BUFSIZE)
+				error(FATAL, "workload arguments too long\n");
+			saved[i++] = strcpy(p, args[optind]);
+			p += strlen(p) + 1;
+		}
+		saved[i] = NULL;
+		workloads = saved;
+	}
+
+	if (startup)
+		bench_show_startup();
+
+	for (i = 0; workloads[i]; i++) {
+		for (r = 1; r <= count; r++) {
+			bench_run(workloads[i], &result);
+			bench_show_result(workloads[i], r, &result);
+		}
+	}
+}
+
+/*
+ *  Run one workload command line with its output sent to pc->nullfp,
+ *  and readmem() profiling enabled for its counters.  An error in the
+ *  workload returns here by way of pc->foreach_loop_env, the same way
+ *  that commands redirected from an argument input file recover.
+ */
+static void
+bench_run(char *cmdline, struct bench_result *result)
+{
+	char buf[BUFSIZE];
+	struct command_table_entry *ct;
+	struct timespec start, end;
+	struct rusage ru_start, ru_end;
+
+	BZERO(result, sizeof(struct bench_result));
+
+	strncpy(buf, cmdline, BUFSIZE-1);
+	buf[BUFSIZE-1] = NULLCHAR;
+	clean_line(buf);
+
+	if (!(argcnt = parse_line(buf, args)) ||
+	    !(ct = get_command_table_entry(args[0]))) {
+		result->status = "unknown";
+		return;
+	}
+
+	if ((ct->flags & REFRESH_TASK_TABLE) && !XEN_HYPER_MODE()) {
+		tt->refresh_task_table();
+		sort_context_array();
+		sort_tgid_array();
+	}
+
+	bench_saved_fp = fp;
+	bench_saved_flags2 = pc->flags2;
+	bench_saved_curcmd = pc->curcmd;
+	BCOPY(pc->foreach_loop_env, bench_saved_env, sizeof(jmp_buf));
+
+	pc->flags2 |= READMEM_PROFILE;
+	readmem_profile_start();
+
+	getrusage(RUSAGE_SELF, &ru_start);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if (setjmp(pc->foreach_loop_env))
+		result->status = "error";
+	else {
+		fp = pc->nullfp;
+		pc->flags |= IN_FOREACH;
+		optind = argerrs = 0;
+		pc->curcmd = ct->name;
+		pc->cmdgencur++;
+		(*ct->func)();
+		result->status = "ok";
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	getrusage(RUSAGE_SELF, &ru_end);
+
+	pc->flags &= ~IN_FOREACH;
+	fp = bench_saved_fp;
+	BCOPY(bench_saved_env, pc->foreach_loop_env, sizeof(jmp_buf));
+	readmem_profile_stop(&result->totals);
+	pc->flags2 = (pc->flags2 & ~READMEM_PROFILE) |
+		(bench_saved_flags2 & READMEM_PROFILE);
+	pc->curcmd = bench_saved_curcmd;
+
+	result->wall_usecs = BENCH_USECS(start, end);
+	result->cpu_usecs = RUSAGE_USECS(ru_end) - RUSAGE_USECS(ru_start);
+	result->maxrss_kb = ru_end.ru_maxrss;
+}
+
+/*
+ *  Display a JSON string value.
+ */
+static void
+bench_show_string(char *s)
+{
+	fputc('"', fp);
+	for ( ; *s; s++) {
+		if ((*s == '"') || (*s == '\\'))
+			fputc('\\', fp);
+		fputc(*s, fp);
+	}
+	fputc('"', fp);
+}
+
+static void
+bench_show_result(char *workload, int run, struct bench_result *result)
+{
+	fprintf(fp, "{\"workload\": ");
+	bench_show_string(workload);
+	fprintf(fp, ", \"run\": %d, \"status\": \"%s\"", run, result->status);
+	fprintf(fp, ", \"wall_secs\": %lld.%06lld",
+		result->wall_usecs / 1000000, result->wall_usecs % 1000000);
+	fprintf(fp, ", \"cpu_secs\": %lld.%06lld",
+		result->cpu_usecs / 1000000, result->cpu_usecs % 1000000);
+	fprintf(fp, ", \"readmem_calls\": %ld, \"readmem_bytes\": %lld",
+		result->totals.reads, result->totals.bytes);
+	fprintf(fp, ", \"readmem_failures\": %ld", result->totals.failures);
+	fprintf(fp, ", \"backend_calls\": %ld, \"backend_secs\": %lld.%06lld",
+		result->totals.backend_calls,
+		result->totals.backend_usecs / 1000000,
+		result->totals.backend_usecs % 1000000);
+	fprintf(fp, ", \"maxrss_kb\": %ld}\n", result->maxrss_kb);
+}
+
+static void
+bench_show_startup(void)
+{
+	int i, cnt;
+	struct startup_phase *phases;
+
+	cnt = get_startup_phases(&phases);
+
+	for (i = 0; i < cnt; i++) {
+		fprintf(fp, "{\"startup_phase\": ");
+		bench_show_string(phases[i].name);
+		fprintf(fp, ", \"wall_secs\": %lld.%06lld",
+			phases[i].usecs / 1000000, phases[i].usecs % 1000000);
+		fprintf(fp, ", \"cpu_secs\": %lld.%06lld",
+			phases[i].cpu_usecs / 1000000,
+			phases[i].cpu_usecs % 1000000);
+		if (pc->flags2 & STARTUP_TIMING)
+			fprintf(fp, ", \"readmem_calls\": %ld, "
+				"\"readmem_bytes\": %lld",
+				phases[i].reads, phases[i].bytes);
+		fprintf(fp, "}\n");
+	}
+}
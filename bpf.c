@@ -50,6 +50,7 @@ static void dump_xlated_plain(void *, unsigned int, int);
 static void print_boot_time(unsigned long long, char *, unsigned int);
 
 static int do_old_idr(int, ulong, struct list_pair *);
+static void bpf_map_contents(ulong, int, uint, uint, uint, ulong);
 #define IDR_ORIG_INIT   (1)
 #define IDR_ORIG_COUNT  (2)
 #define IDR_ORIG_GATHER (3)
@@ -62,6 +63,8 @@ static int do_old_idr(int, ulong, struct list_pair *);
 #define OPCODES       (0x20)
 #define PROG_VERBOSE  (0x40)
 #define MAP_VERBOSE   (0x80)
+#define MAP_ENTRIES  (0x100)
+#define MAP_STATS    (0x200)
 
 static int map_is_per_cpu(int type)
 {
@@ -129,7 +132,7 @@ cmd_bpf(void)
 
 	flags = prog_id = map_id = radix = 0;
 
-	while ((c = getopt(argcnt, args, "PMtTjsxdm:p:")) != EOF) {
+	while ((c = getopt(argcnt, args, "PMtTjsxdecm:p:")) != EOF) {
 		switch(c)
 		{
 		case 'j':
@@ -158,6 +161,12 @@ cmd_bpf(void)
 		case 'M':
 			flags |= MAP_VERBOSE;
 			break;
+		case 'e':
+			flags |= MAP_ENTRIES;
+			break;
+		case 'c':
+			flags |= MAP_STATS;
+			break;
 		case 'x':
 			if (radix == 10)
 				error(FATAL, "-d and -x are mutually exclusive\n");
@@ -181,6 +190,10 @@ cmd_bpf(void)
 		error(FATAL, "-j option only applicable with -p or -P\n");
 	if ((flags & XLATED) && !(flags & (PROG_ID|PROG_VERBOSE)))
 		error(FATAL, "-t option only applicable with -p or -P\n");
+	if ((flags & MAP_ENTRIES) && !(flags & (MAP_ID|MAP_VERBOSE)))
+		error(FATAL, "-e option only applicable with -m or -M\n");
+	if ((flags & MAP_STATS) && !(flags & (MAP_ID|MAP_VERBOSE)))
+		error(FATAL, "-c option only applicable with -m or -M\n");
 	if ((flags & DUMP_STRUCT) && !(flags & (PROG_ID|PROG_VERBOSE|MAP_ID|MAP_VERBOSE)))
 		error(FATAL, "-s option requires either -p, -P, -m or -M\n");
 
@@ -268,6 +281,19 @@ bpf_init(struct bpf_info *bpf)
 			MEMBER_OFFSET_INIT(bpf_map_memory_user, "bpf_map_memory", "user");
 		}
 
+		/* map contents */
+		MEMBER_OFFSET_INIT(bpf_array_elem_size, "bpf_array", "elem_size");
+		MEMBER_OFFSET_INIT(bpf_array_value, "bpf_array", "value");
+		MEMBER_OFFSET_INIT(bpf_array_pptrs, "bpf_array", "pptrs");
+		MEMBER_OFFSET_INIT(bpf_htab_buckets, "bpf_htab", "buckets");
+		MEMBER_OFFSET_INIT(bpf_htab_n_buckets, "bpf_htab", "n_buckets");
+		MEMBER_OFFSET_INIT(bpf_htab_elem_size, "bpf_htab", "elem_size");
+		MEMBER_OFFSET_INIT(htab_elem_hash_node, "htab_elem", "hash_node");
+		MEMBER_OFFSET_INIT(htab_elem_key, "htab_elem", "key");
+		MEMBER_OFFSET_INIT(hlist_nulls_head_first, "hlist_nulls_head", "first");
+		MEMBER_OFFSET_INIT(hlist_nulls_node_next, "hlist_nulls_node", "next");
+		STRUCT_SIZE_INIT(bucket, "bucket");
+
 		if (!bpf_type_size_init()) {
 			bpf->status = FALSE;
 			command_not_supported();
@@ -697,6 +723,10 @@ do_map_only:
 				fprintf(fp, "(unused)\n");
 		}
 
+		if (flags & (MAP_ENTRIES|MAP_STATS))
+			bpf_map_contents((ulong)bpf->maplist[i].value, type,
+				key_size, value_size, max_entries, flags);
+
 		if (flags & DUMP_STRUCT) {
 			fprintf(fp, "\n");
 			dump_struct("bpf_map", (ulong)bpf->maplist[i].value, radix);
@@ -1471,3 +1501,333 @@ do_old_idr(int cmd, ulong idr, struct list_pair *lp)
 
 	return total;
 }
+
+/*
+ *  Map contents, for "bpf -m ID -e" or "bpf -M -e", and the statistics
+ *  of "-c".  The value arrays of array maps, the bucket arrays of hash
+ *  maps and the per-cpu pointer arrays are read BPF_MAP_CHUNK entries at
+ *  a time, and each hash element is read whole with one readmem(), so the
+ *  keys and values are displayed in hexadecimal without going through
+ *  gdb.  For per-cpu maps with 4 or 8 byte values, the sum of the values
+ *  of all cpus is shown as well, which is how counters are commonly kept.
+ */
+#define BPF_MAP_TYPE_HASH     (1UL)
+#define BPF_MAP_TYPE_ARRAY    (2UL)
+#define BPF_MAP_TYPE_LRU_HASH (9UL)
+
+#define BPF_MAP_CHUNK (1024)
+
+struct bpf_map_walk {
+	ulong flags;
+	int type;
+	uint key_size;
+	uint value_size;
+	uint max_entries;
+	int percpu;
+	int summable;
+	char *valbuf;
+	ulong entries;
+	ulonglong memory;
+	ulong buckets;
+	ulong used_buckets;
+	ulong max_chain;
+	ulonglong total;
+};
+
+static void bpf_map_show_key(struct bpf_map_walk *, ulong, char *);
+static void bpf_map_show_value(struct bpf_map_walk *, char *, ulong);
+static int bpf_map_walk_array(struct bpf_map_walk *, ulong);
+static int bpf_map_walk_hash(struct bpf_map_walk *, ulong);
+
+static void
+bpf_map_contents(ulong map, int type, uint key_size, uint value_size,
+		 uint max_entries, ulong flags)
+{
+	struct bpf_map_walk walk, *w;
+	char buf[BUFSIZE];
+	int ok;
+
+	w = &walk;
+	BZERO(w, sizeof(struct bpf_map_walk));
+	w->flags = flags;
+	w->type = type;
+	w->key_size = key_size;
+	w->value_size = value_size;
+	w->max_entries = max_entries;
+	w->percpu = map_is_per_cpu(type);
+	w->summable = w->percpu && ((value_size == 4) || (value_size == 8));
+
+	if (!VALID_MEMBER(bpf_map_key_size) || !VALID_MEMBER(bpf_map_value_size) ||
+	    !VALID_MEMBER(bpf_map_max_entries)) {
+		error(INFO, "bpf_map key and value sizes are not available\n");
+		return;
+	}
+
+	if (w->percpu && !(kt->flags & PER_CPU_OFF)) {
+		error(INFO, "per-cpu map values are not available\n");
+		return;
+	}
+
+	fprintf(fp, "\n");
+
+	w->valbuf = GETBUF(value_size + sizeof(ulong));
+
+	switch (type)
+	{
+	case BPF_MAP_TYPE_ARRAY:
+	case BPF_MAP_TYPE_PERCPU_ARRAY:
+		ok = bpf_map_walk_array(w, map);
+		break;
+	case BPF_MAP_TYPE_HASH:
+	case BPF_MAP_TYPE_PERCPU_HASH:
+	case BPF_MAP_TYPE_LRU_HASH:
+	case BPF_MAP_TYPE_LRU_PERCPU_HASH:
+		ok = bpf_map_walk_hash(w, map);
+		break;
+	default:
+		error(INFO, "%s map contents are not supported\n",
+			bpf_map_map_type_string(type, buf));
+		ok = FALSE;
+		break;
+	}
+
+	FREEBUF(w->valbuf);
+
+	if (!ok || !(flags & MAP_STATS))
+		return;
+
+	if (flags & MAP_ENTRIES)
+		fprintf(fp, "\n");
+	fprintf(fp, "     ENTRIES: %ld  MEMORY: %lld", w->entries, w->memory);
+	if (w->buckets)
+		fprintf(fp, "  BUCKETS: %ld  USED: %ld  MAX_CHAIN: %ld",
+			w->buckets, w->used_buckets, w->max_chain);
+	if (w->summable)
+		fprintf(fp, "  PERCPU_TOTAL: %lld", w->total);
+	fprintf(fp, "\n");
+}
+
+/*
+ *  The address is that of the hash element, or of the array value.
+ */
+static void
+bpf_map_show_key(struct bpf_map_walk *w, ulong addr, char *key)
+{
+	w->entries++;
+
+	if (!(w->flags & MAP_ENTRIES))
+		return;
+
+	fprintf(fp, "  %lx  KEY: ", addr);
+	fprint_hex(fp, key, w->key_size, " ");
+}
+
+/*
+ *  Display a value, or with per-cpu maps, read and display the value of
+ *  each possible cpu at pptr.
+ */
+static void
+bpf_map_show_value(struct bpf_map_walk *w, char *value, ulong pptr)
+{
+	int cpu;
+	ulonglong sum;
+
+	if (!w->percpu) {
+		if (w->flags & MAP_ENTRIES) {
+			fprintf(fp, "  VALUE: ");
+			fprint_hex(fp, value, w->value_size, " ");
+			fprintf(fp, "\n");
+		}
+		return;
+	}
+
+	if (w->flags & MAP_ENTRIES)
+		fprintf(fp, "\n");
+	if (!(w->flags & MAP_ENTRIES) && !w->summable)
+		return;
+
+	for (cpu = sum = 0; cpu < kt->cpus; cpu++) {
+		if (!in_cpu_map(POSSIBLE, cpu))
+			continue;
+		if (!readmem(pptr + kt->__per_cpu_offset[cpu], KVADDR,
+		    w->valbuf, w->value_size, "bpf map per-cpu value",
+		    RETURN_ON_ERROR|QUIET)) {
+			if (w->flags & MAP_ENTRIES)
+				fprintf(fp, "    CPU %d: (unavailable)\n", cpu);
+			continue;
+		}
+		if (w->summable)
+			sum += (w->value_size == 4) ?
+				UINT(w->valbuf) : ULONGLONG(w->valbuf);
+		if (w->flags & MAP_ENTRIES) {
+			fprintf(fp, "    CPU %d: ", cpu);
+			fprint_hex(fp, w->valbuf, w->value_size, " ");
+			fprintf(fp, "\n");
+		}
+	}
+
+	if (w->summable) {
+		w->total += sum;
+		if (w->flags & MAP_ENTRIES)
+			fprintf(fp, "    TOTAL: %lld\n", sum);
+	}
+}
+
+/*
+ *  The values of a struct bpf_array follow it in its value[] array, each
+ *  padded to elem_size, and those of a per-cpu array are pointed to by
+ *  its pptrs[] array instead.  The key of an entry is its u32 index.
+ */
+static int
+bpf_map_walk_array(struct bpf_map_walk *w, ulong map)
+{
+	uint idx, n, i, elem_size, key;
+	char *buf;
+	ulong addr, size;
+
+	if (INVALID_MEMBER(bpf_array_elem_size) ||
+	    INVALID_MEMBER(bpf_array_value) || INVALID_MEMBER(bpf_array_pptrs)) {
+		error(INFO, "bpf_array structure is not available\n");
+		return FALSE;
+	}
+
+	if (!readmem(map + OFFSET(bpf_array_elem_size), KVADDR, &elem_size,
+	    sizeof(uint), "bpf_array.elem_size", RETURN_ON_ERROR))
+		return FALSE;
+
+	size = w->percpu ? sizeof(ulong) : elem_size;
+	if (!size) {
+		error(INFO, "invalid bpf_array.elem_size: 0\n");
+		return FALSE;
+	}
+	buf = GETBUF(size * BPF_MAP_CHUNK);
+
+	for (idx = 0; idx < w->max_entries; idx += n) {
+		n = MIN(BPF_MAP_CHUNK, w->max_entries - idx);
+		addr = map + (w->percpu ? OFFSET(bpf_array_pptrs) :
+			OFFSET(bpf_array_value)) + (ulong)idx * size;
+		if (!readmem(addr, KVADDR, buf, n * size, w->percpu ?
+		    "bpf_array.pptrs" : "bpf_array.value", RETURN_ON_ERROR)) {
+			FREEBUF(buf);
+			return FALSE;
+		}
+
+		for (i = 0; i < n; i++) {
+			key = idx + i;
+			bpf_map_show_key(w, w->percpu ? ULONG(buf + i * size) :
+				addr + i * size, (char *)&key);
+			bpf_map_show_value(w, buf + i * size, w->percpu ?
+				ULONG(buf + i * size) : 0);
+		}
+	}
+
+	FREEBUF(buf);
+
+	w->memory = (ulonglong)w->max_entries * size;
+	if (w->percpu)
+		w->memory += (ulonglong)w->max_entries *
+			roundup(w->value_size, 8) * get_cpus_possible();
+
+	return TRUE;
+}
+
+/*
+ *  The buckets of a struct bpf_htab head hlist_nulls chains of struct
+ *  htab_elem, which end with an odd "nulls" pointer.  The key of an
+ *  element follows its header, and is followed by its value at the next
+ *  8-byte boundary, or with per-cpu maps, by a pointer to its values.
+ */
+static int
+bpf_map_walk_hash(struct bpf_map_walk *w, ulong map)
+{
+	uint b, n, i, n_buckets, elem_size;
+	ulong buckets, node, pptr, chain, maxchain;
+	char *bbuf, *ebuf, *key;
+	int ok;
+
+	if (INVALID_MEMBER(bpf_htab_buckets) ||
+	    INVALID_MEMBER(bpf_htab_n_buckets) ||
+	    INVALID_MEMBER(bpf_htab_elem_size) || !VALID_STRUCT(bucket) ||
+	    INVALID_MEMBER(htab_elem_key) || INVALID_MEMBER(htab_elem_hash_node) ||
+	    INVALID_MEMBER(hlist_nulls_head_first) ||
+	    INVALID_MEMBER(hlist_nulls_node_next)) {
+		error(INFO, "bpf_htab structure is not available\n");
+		return FALSE;
+	}
+
+	if (!readmem(map + OFFSET(bpf_htab_buckets), KVADDR, &buckets,
+	    sizeof(ulong), "bpf_htab.buckets", RETURN_ON_ERROR) ||
+	    !readmem(map + OFFSET(bpf_htab_n_buckets), KVADDR, &n_buckets,
+	    sizeof(uint), "bpf_htab.n_buckets", RETURN_ON_ERROR) ||
+	    !readmem(map + OFFSET(bpf_htab_elem_size), KVADDR, &elem_size,
+	    sizeof(uint), "bpf_htab.elem_size", RETURN_ON_ERROR))
+		return FALSE;
+
+	if (elem_size < OFFSET(htab_elem_key) + roundup(w->key_size, 8) +
+	    (w->percpu ? sizeof(ulong) : w->value_size)) {
+		error(INFO, "invalid bpf_htab.elem_size: %d\n", elem_size);
+		return FALSE;
+	}
+
+	/*
+	 *  Guard against chains that loop in a corrupted map.
+	 */
+	maxchain = w->max_entries + get_cpus_possible() + 1;
+
+	bbuf = GETBUF(SIZE(bucket) * BPF_MAP_CHUNK);
+	ebuf = GETBUF(elem_size);
+	ok = TRUE;
+
+	for (b = 0; ok && (b < n_buckets); b += n) {
+		n = MIN(BPF_MAP_CHUNK, n_buckets - b);
+		if (!readmem(buckets + (ulong)b * SIZE(bucket), KVADDR, bbuf,
+		    n * SIZE(bucket), "bpf_htab.buckets", RETURN_ON_ERROR)) {
+			ok = FALSE;
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			node = ULONG(bbuf + i * SIZE(bucket) +
+				OFFSET(hlist_nulls_head_first));
+			for (chain = 0; node && !(node & 1); chain++) {
+				if ((chain == maxchain) ||
+				    !readmem(node - OFFSET(htab_elem_hash_node),
+				    KVADDR, ebuf, elem_size, "htab_elem",
+				    RETURN_ON_ERROR)) {
+					error(INFO, "bucket %d: chain "
+						"abandoned at %lx\n", b + i,
+						node);
+					break;
+				}
+				key = ebuf + OFFSET(htab_elem_key);
+				bpf_map_show_key(w, node -
+					OFFSET(htab_elem_hash_node), key);
+				if (w->percpu)
+					BCOPY(key + w->key_size, &pptr,
+						sizeof(ulong));
+				else
+					pptr = 0;
+				bpf_map_show_value(w, key +
+					roundup(w->key_size, 8), pptr);
+				node = ULONG(ebuf + OFFSET(htab_elem_hash_node) +
+					OFFSET(hlist_nulls_node_next));
+			}
+			if (chain)
+				w->used_buckets++;
+			if (chain > w->max_chain)
+				w->max_chain = chain;
+		}
+	}
+
+	FREEBUF(ebuf);
+	FREEBUF(bbuf);
+
+	w->buckets = n_buckets;
+	w->memory = (ulonglong)n_buckets * SIZE(bucket) +
+		(ulonglong)w->entries * elem_size;
+	if (w->percpu)
+		w->memory += (ulonglong)w->entries *
+			roundup(w->value_size, 8) * get_cpus_possible();
+
+	return ok;
+}
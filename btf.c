@@ -0,0 +1,1513 @@
+/* btf.c - core analysis suite
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "defs.h"
+#include <elf.h>
+#include <ctype.h>
+
+/*
+ *  With "set btf on", datatype_info() first looks for structure, union,
+ *  enum, typedef and base types in the kernel's BTF type information,
+ *  which kernels built with CONFIG_DEBUG_INFO_BTF carry in their .BTF
+ *  section, and only asks gdb when the answer cannot be found there.
+ *  The .BTF section is read from the vmlinux file, or failing that, from
+ *  the kernel memory between __start_BTF and __stop_BTF.
+ *
+ *  The answers are made to match what gdb would return from the DWARF
+ *  data: a plain name is looked up as a structure, union or enum tag
+ *  first, then as a typedef or base type name, member offsets are in
+ *  bits, and the members of anonymous structures and unions are found
+ *  as if they were members of the enclosing type.  Anything that BTF
+ *  cannot answer in the same way, such as enumerators, variables, type
+ *  expressions and names with more than one definition, is left to gdb.
+ */
+
+#define BTF_MAGIC	(0xeB9F)
+#define BTF_VERSION	(1)
+
+struct btf_header {
+	uint16_t magic;
+	uint8_t version;
+	uint8_t flags;
+	uint32_t hdr_len;
+	uint32_t type_off;
+	uint32_t type_len;
+	uint32_t str_off;
+	uint32_t str_len;
+};
+
+struct btf_type {
+	uint32_t name_off;
+	uint32_t info;
+	uint32_t size_type;	/* size, or the referenced type */
+};
+
+#define BTF_INFO_KIND(info)	(((info) >> 24) & 0x1f)
+#define BTF_INFO_VLEN(info)	((info) & 0xffff)
+#define BTF_INFO_KFLAG(info)	((info) >> 31)
+
+#define BTF_KIND_UNKN		(0)
+#define BTF_KIND_INT		(1)
+#define BTF_KIND_PTR		(2)
+#define BTF_KIND_ARRAY		(3)
+#define BTF_KIND_STRUCT		(4)
+#define BTF_KIND_UNION		(5)
+#define BTF_KIND_ENUM		(6)
+#define BTF_KIND_FWD		(7)
+#define BTF_KIND_TYPEDEF	(8)
+#define BTF_KIND_VOLATILE	(9)
+#define BTF_KIND_CONST		(10)
+#define BTF_KIND_RESTRICT	(11)
+#define BTF_KIND_FUNC		(12)
+#define BTF_KIND_FUNC_PROTO	(13)
+#define BTF_KIND_VAR		(14)
+#define BTF_KIND_DATASEC	(15)
+#define BTF_KIND_FLOAT		(16)
+#define BTF_KIND_DECL_TAG	(17)
+#define BTF_KIND_TYPE_TAG	(18)
+#define BTF_KIND_ENUM64		(19)
+
+#define BTF_INT_ENCODING(x)	(((x) & 0x0f000000) >> 24)
+#define BTF_INT_OFFSET(x)	(((x) & 0x00ff0000) >> 16)
+#define BTF_INT_BITS(x)		((x) & 0x000000ff)
+#define BTF_INT_SIGNED		(0x1)
+#define BTF_INT_BOOL		(0x4)
+
+struct btf_array {
+	uint32_t type;
+	uint32_t index_type;
+	uint32_t nelems;
+};
+
+struct btf_member {
+	uint32_t name_off;
+	uint32_t type;
+	uint32_t offset;	/* bits, or bitfield size << 24 | bits */
+};
+
+#define BTF_MEMBER_BIT_OFFSET(kflag, offset) \
+	((kflag) ? ((offset) & 0xffffff) : (offset))
+#define BTF_MEMBER_BITFIELD_SIZE(kflag, offset) \
+	((kflag) ? ((offset) >> 24) : 0)
+
+/*
+ *  The enumerators of BTF_KIND_ENUM are a name and a 32-bit value, and
+ *  those of BTF_KIND_ENUM64 a name and the low and high 32 bits.  These
+ *  expect an "is64" that tells which kind is being walked.
+ */
+#define BTF_ENUMVAL(e)	(is64 ? (((ulonglong)(e)[2] << 32) | (e)[1]) : \
+			 (ulonglong)(long long)(int32_t)(e)[1])
+#define BTF_ENUM_NEXT(e) ((e) + (is64 ? 3 : 2))
+
+#define BTF_SIZE_MASK(size) \
+	((size) >= sizeof(ulonglong) ? (ulonglong)-1 : \
+	 (1ULL << ((size) * BITS_PER_BYTE)) - 1)
+
+/*
+ *  gdb's TYPE_CODE_TYPEDEF, which is beyond the type codes in defs.h.
+ */
+#ifdef GDB_10_2
+#define BTF_TYPE_CODE_TYPEDEF	(23)
+#endif
+
+#define BTF_NAME_HASH		(16384)
+#define BTF_MAX_DEPTH		(32)
+
+#define BTF_UNLOADED		(0)
+#define BTF_LOADED		(1)
+#define BTF_UNAVAILABLE		(2)
+
+static struct btf_data {
+	int state;
+	int files_searched;
+	char *source;			/* file name or "kernel memory" */
+	char *data;
+	ulong size;
+	char *strings;
+	uint32_t str_len;
+	struct btf_type **types;	/* indexed by type id */
+	uint32_t nr_types;		/* including the void type 0 */
+	uint32_t *hash;			/* name hash heads */
+	uint32_t *next;			/* name hash chains */
+	ulong hits;
+	ulong fallbacks;
+	char *printable;		/* BTF_PRINT_* by type id */
+	ulong prints;
+	ulong print_fallbacks;
+} btf_data = { 0 };
+
+static int btf_load(void);
+static char *btf_read_elf_section(char *, char *, ulong *);
+static int btf_parse(char *, ulong, char *);
+static uint32_t btf_type_datalen(struct btf_type *);
+static char *btf_name(uint32_t);
+static ulong btf_name_hash(char *);
+static uint32_t btf_find_type(char *, ulong);
+static uint32_t btf_skip_modifiers(uint32_t);
+static uint32_t btf_resolve_type(uint32_t, int *);
+static long btf_type_size(uint32_t);
+static int btf_typecode(uint32_t);
+static int btf_find_member(uint32_t, char *, long, struct gnu_request *);
+
+#define BTF_KINDMASK(kind)	(1UL << (kind))
+#define BTF_TAG_KINDS		(BTF_KINDMASK(BTF_KIND_STRUCT) | \
+				 BTF_KINDMASK(BTF_KIND_UNION) | \
+				 BTF_KINDMASK(BTF_KIND_ENUM) | \
+				 BTF_KINDMASK(BTF_KIND_ENUM64))
+#define BTF_TYPE_NAME_KINDS	(BTF_KINDMASK(BTF_KIND_TYPEDEF) | \
+				 BTF_KINDMASK(BTF_KIND_INT) | \
+				 BTF_KINDMASK(BTF_KIND_FLOAT))
+#define BTF_HASHED_KINDS	(BTF_TAG_KINDS | BTF_TYPE_NAME_KINDS)
+struct btf_print {
+	FILE *ofp;
+	int memtype;
+	int hex;
+	uint print_max;
+};
+
+#define BTF_PRINT_UNKNOWN	(0)
+#define BTF_PRINT_OK		(1)
+#define BTF_PRINT_NOT_OK	(2)
+
+static int btf_printable(uint32_t, int);
+static void btf_print_value(struct btf_print *, uint32_t, char *, ulong, int);
+static void btf_print_struct(struct btf_print *, uint32_t, char *, ulong,
+	int);
+static void btf_print_array(struct btf_print *, uint32_t, char *, ulong, int);
+static void btf_print_scalar(struct btf_print *, uint32_t, ulonglong);
+static void btf_print_enum(struct btf_print *, uint32_t, ulonglong);
+static void btf_print_pointer(struct btf_print *, uint32_t, ulong);
+static void btf_print_address(struct btf_print *, ulong);
+static void btf_print_char(FILE *, unsigned char, int, int *);
+static void btf_print_string(struct btf_print *, unsigned char *, long, int);
+static int btf_is_textual(uint32_t);
+static int btf_enum_is_signed(uint32_t);
+static ulonglong btf_extract(char *, long, int);
+static ulonglong btf_extract_bits(char *, long, long, int);
+
+/*
+ *  Answer a GNU_GET_DATATYPE query for datatype_info() from the BTF data,
+ *  filling in the same request fields that gdb would.  Returns FALSE if
+ *  the query has to be passed on to gdb.
+ */
+int
+btf_datatype_info(char *name, char *member, struct gnu_request *req)
+{
+	uint32_t id, resolved;
+	ulong kinds;
+	int is_typedef;
+	long size;
+
+	if ((btf_data.state == BTF_UNAVAILABLE) ||
+	    ((btf_data.state == BTF_UNLOADED) && !btf_load()))
+		return FALSE;
+
+	if (STRNEQ(name, "struct ")) {
+		kinds = BTF_KINDMASK(BTF_KIND_STRUCT);
+		name += strlen("struct ");
+	} else if (STRNEQ(name, "union ")) {
+		kinds = BTF_KINDMASK(BTF_KIND_UNION);
+		name += strlen("union ");
+	} else if (STRNEQ(name, "enum ")) {
+		kinds = BTF_KINDMASK(BTF_KIND_ENUM) |
+			BTF_KINDMASK(BTF_KIND_ENUM64);
+		name += strlen("enum ");
+	} else
+		kinds = 0;
+
+	if (!strlen(name) || strpbrk(name, "*[]().,&:"))
+		goto fallback;
+
+	if (kinds)
+		id = btf_find_type(name, kinds);
+	else if (!(id = btf_find_type(name, BTF_TAG_KINDS)))
+		id = btf_find_type(name, BTF_TYPE_NAME_KINDS);
+	if (!id)
+		goto fallback;
+
+	is_typedef = FALSE;
+	if (!(resolved = btf_resolve_type(id, &is_typedef)) ||
+	    ((size = btf_type_size(resolved)) < 0))
+		goto fallback;
+
+	BZERO(req, sizeof(struct gnu_request));
+	req->command = GNU_GET_DATATYPE;
+	req->name = name;
+	req->member = member;
+	req->typecode = btf_typecode(resolved);
+	req->length = size;
+	req->is_typedef = is_typedef;
+	req->member_offset = -1;
+
+	if (req->typecode < 0)
+		goto fallback;
+
+	if (member && ((req->typecode == TYPE_CODE_STRUCT) ||
+	    (req->typecode == TYPE_CODE_UNION))) {
+		if (btf_find_member(resolved, member, 0, req) < 0)
+			goto fallback;
+	}
+
+	btf_data.hits++;
+	return TRUE;
+
+fallback:
+	btf_data.fallbacks++;
+	return FALSE;
+}
+
+/*
+ *  Search a structure or union for member, descending into anonymous
+ *  members like gdb's get_member_data().  Returns TRUE if it was found,
+ *  FALSE if it was not, and -1 if the member's type cannot be expressed
+ *  the way that gdb would.
+ */
+static int
+btf_find_member(uint32_t id, char *member, long offset,
+	struct gnu_request *req)
+{
+	struct btf_type *t;
+	struct btf_member *m;
+	uint32_t i, vlen, anon;
+	long bitpos, size;
+	int kflag, typecode, found;
+
+	t = btf_data.types[id];
+	vlen = BTF_INFO_VLEN(t->info);
+	kflag = BTF_INFO_KFLAG(t->info);
+	m = (struct btf_member *)(t + 1);
+
+	for (i = 0; i < vlen; i++, m++) {
+		bitpos = offset + BTF_MEMBER_BIT_OFFSET(kflag, m->offset);
+		if (STREQ(btf_name(m->name_off), member)) {
+			if ((m->type >= btf_data.nr_types) ||
+			    ((size = btf_type_size(m->type)) < 0) ||
+			    ((typecode = btf_typecode(m->type)) < 0))
+				return -1;
+			req->member_offset = bitpos;
+			req->member_length = size;
+			req->member_typecode = typecode;
+			return TRUE;
+		} else if (!strlen(btf_name(m->name_off))) {
+			if (!(anon = btf_skip_modifiers(m->type)))
+				continue;
+			switch (BTF_INFO_KIND(btf_data.types[anon]->info))
+			{
+			case BTF_KIND_STRUCT:
+			case BTF_KIND_UNION:
+				if ((found = btf_find_member(anon, member,
+				    bitpos, req)))
+					return found;
+				break;
+			}
+		}
+	}
+
+	return FALSE;
+}
+
+/*
+ *  Type qualifiers are instance flags of the same type in gdb.
+ */
+static uint32_t
+btf_skip_modifiers(uint32_t id)
+{
+	struct btf_type *t;
+	int depth;
+
+	for (depth = 0; id && (id < btf_data.nr_types) &&
+	     (depth < BTF_MAX_DEPTH); depth++) {
+		t = btf_data.types[id];
+		switch (BTF_INFO_KIND(t->info))
+		{
+		case BTF_KIND_VOLATILE:
+		case BTF_KIND_CONST:
+		case BTF_KIND_RESTRICT:
+		case BTF_KIND_TYPE_TAG:
+			id = t->size_type;
+			break;
+		default:
+			return id;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ *  Follow qualifiers and typedefs to the underlying type, as gdb's
+ *  check_typedef() does.
+ */
+static uint32_t
+btf_resolve_type(uint32_t id, int *is_typedef)
+{
+	struct btf_type *t;
+	int depth;
+
+	for (depth = 0; depth < BTF_MAX_DEPTH; depth++) {
+		if (!(id = btf_skip_modifiers(id)))
+			return 0;
+		t = btf_data.types[id];
+		if (BTF_INFO_KIND(t->info) != BTF_KIND_TYPEDEF)
+			return id;
+		*is_typedef = TRUE;
+		id = t->size_type;
+	}
+
+	return 0;
+}
+
+static long
+btf_type_size(uint32_t id)
+{
+	struct btf_type *t;
+	struct btf_array *a;
+	long size;
+	int depth, is_typedef;
+
+	for (depth = 0; depth < BTF_MAX_DEPTH; depth++) {
+		if (!id)
+			return 1;		/* void */
+		if (!(id = btf_resolve_type(id, &is_typedef)))
+			return -1;
+		t = btf_data.types[id];
+
+		switch (BTF_INFO_KIND(t->info))
+		{
+		case BTF_KIND_INT:
+		case BTF_KIND_STRUCT:
+		case BTF_KIND_UNION:
+		case BTF_KIND_ENUM:
+		case BTF_KIND_ENUM64:
+		case BTF_KIND_FLOAT:
+			return t->size_type;
+		case BTF_KIND_PTR:
+			return sizeof(void *);
+		case BTF_KIND_FUNC_PROTO:
+			return 1;
+		case BTF_KIND_ARRAY:
+			a = (struct btf_array *)(t + 1);
+			if ((size = btf_type_size(a->type)) < 0)
+				return -1;
+			return size * a->nelems;
+		default:
+			return -1;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ *  The gdb type code of a type, or -1 if there is no equivalent here.
+ */
+static int
+btf_typecode(uint32_t id)
+{
+	struct btf_type *t;
+
+	if (!id)
+		return TYPE_CODE_VOID;
+	if (!(id = btf_skip_modifiers(id)))
+		return -1;
+	t = btf_data.types[id];
+
+	switch (BTF_INFO_KIND(t->info))
+	{
+	case BTF_KIND_INT:
+		if (BTF_INT_ENCODING(*(uint32_t *)(t + 1)) & BTF_INT_BOOL)
+			return -1;
+		return TYPE_CODE_INT;
+	case BTF_KIND_PTR:
+		return TYPE_CODE_PTR;
+	case BTF_KIND_ARRAY:
+		return TYPE_CODE_ARRAY;
+	case BTF_KIND_STRUCT:
+		return TYPE_CODE_STRUCT;
+	case BTF_KIND_UNION:
+		return TYPE_CODE_UNION;
+	case BTF_KIND_ENUM:
+	case BTF_KIND_ENUM64:
+		return TYPE_CODE_ENUM;
+	case BTF_KIND_FUNC_PROTO:
+		return TYPE_CODE_FUNC;
+	case BTF_KIND_FLOAT:
+		return TYPE_CODE_FLT;
+#ifdef BTF_TYPE_CODE_TYPEDEF
+	case BTF_KIND_TYPEDEF:
+		return BTF_TYPE_CODE_TYPEDEF;
+#endif
+	default:
+		return -1;
+	}
+}
+
+/*
+ *  The struct and union display of print_struct() and print_union().
+ *
+ *  With "set btf on", a structure or union at an address is formatted
+ *  here from one read of its memory instead of by gdb's "output"
+ *  command, reproducing gdb's pretty-printed format: the members of
+ *  each nesting level are indented two more spaces, integers follow the
+ *  current output radix, 1-byte integer arrays are shown as strings,
+ *  and pointers are followed by the kernel symbol they point to, or for
+ *  character pointers, by the string.  Types that contain anything that
+ *  could not be shown the same way, such as floating point members, are
+ *  left to gdb, as are reads of the structure itself that fail, so that
+ *  gdb reports the error.
+ */
+int
+btf_print_datatype(char *name, ulong addr)
+{
+	struct btf_print btf_print, *bp;
+	uint32_t id, resolved;
+	ulong kinds;
+	int kind, is_typedef;
+	long size;
+	char *buf;
+
+	if ((btf_data.state == BTF_UNAVAILABLE) ||
+	    ((btf_data.state == BTF_UNLOADED) && !btf_load()))
+		return FALSE;
+
+	if ((pc->curcmd_flags & (MEMTYPE_FILEADDR|PARTIAL_READ_OK)) ||
+	    ((*gdb_output_format != 'x') && (*gdb_output_format != 0)))
+		return FALSE;
+
+	if (STRNEQ(name, "struct ")) {
+		kinds = BTF_KINDMASK(BTF_KIND_STRUCT);
+		name += strlen("struct ");
+	} else if (STRNEQ(name, "union ")) {
+		kinds = BTF_KINDMASK(BTF_KIND_UNION);
+		name += strlen("union ");
+	} else
+		kinds = BTF_KINDMASK(BTF_KIND_TYPEDEF);
+
+	is_typedef = FALSE;
+	if (!(id = btf_find_type(name, kinds)) ||
+	    !(resolved = btf_resolve_type(id, &is_typedef)))
+		goto fallback;
+	kind = BTF_INFO_KIND(btf_data.types[resolved]->info);
+	if (((kind != BTF_KIND_STRUCT) && (kind != BTF_KIND_UNION)) ||
+	    ((size = btf_type_size(resolved)) <= 0))
+		goto fallback;
+
+	if (!btf_data.printable &&
+	    !(btf_data.printable = calloc(btf_data.nr_types, sizeof(char))))
+		goto fallback;
+	if (!btf_printable(resolved, 0))
+		goto fallback;
+
+	bp = &btf_print;
+	bp->ofp = fp;
+	bp->memtype = pc->curcmd_flags & MEMTYPE_UVADDR ? UVADDR : KVADDR;
+	bp->hex = (*gdb_output_format == 'x');
+	bp->print_max = *gdb_print_max;
+
+	if ((bp->memtype == KVADDR) && !IS_KVADDR(addr))
+		goto fallback;
+
+	buf = GETBUF(size);
+	if (!readmem(addr, bp->memtype, buf, size, "btf_print_datatype",
+	    RETURN_ON_ERROR|QUIET)) {
+		FREEBUF(buf);
+		goto fallback;
+	}
+
+	btf_print_value(bp, resolved, buf, addr, 0);
+	FREEBUF(buf);
+
+	btf_data.prints++;
+	return TRUE;
+
+fallback:
+	btf_data.print_fallbacks++;
+	return FALSE;
+}
+
+/*
+ *  Determine whether all values of a type can be formatted here; the
+ *  result is remembered for each type.
+ */
+static int
+btf_printable(uint32_t id, int depth)
+{
+	struct btf_type *t;
+	struct btf_member *m;
+	uint32_t i, vlen, encoding;
+	int is_typedef, kflag, ok;
+	long size;
+
+	is_typedef = FALSE;
+	if ((depth > BTF_MAX_DEPTH) || !(id = btf_resolve_type(id, &is_typedef)))
+		return FALSE;
+
+	if (btf_data.printable[id] != BTF_PRINT_UNKNOWN)
+		return (btf_data.printable[id] == BTF_PRINT_OK);
+
+	t = btf_data.types[id];
+	ok = FALSE;
+
+	switch (BTF_INFO_KIND(t->info))
+	{
+	case BTF_KIND_INT:
+		encoding = *(uint32_t *)(t + 1);
+		size = t->size_type;
+		ok = ((size == 1) || (size == 2) || (size == 4) ||
+		    (size == 8)) && (BTF_INT_BITS(encoding) <= size * 8);
+		break;
+
+	case BTF_KIND_ENUM:
+	case BTF_KIND_ENUM64:
+		size = t->size_type;
+		ok = (size == 1) || (size == 2) || (size == 4) || (size == 8);
+		break;
+
+	case BTF_KIND_PTR:
+		ok = (btf_type_size(id) == sizeof(ulong));
+		break;
+
+	case BTF_KIND_ARRAY:
+		ok = btf_printable(((struct btf_array *)(t + 1))->type,
+			depth+1) && (btf_type_size(id) >= 0);
+		break;
+
+	case BTF_KIND_STRUCT:
+	case BTF_KIND_UNION:
+		vlen = BTF_INFO_VLEN(t->info);
+		kflag = BTF_INFO_KFLAG(t->info);
+		m = (struct btf_member *)(t + 1);
+		for (i = 0, ok = TRUE; ok && (i < vlen); i++, m++) {
+			if ((m->type >= btf_data.nr_types) ||
+			    !btf_printable(m->type, depth+1))
+				ok = FALSE;
+			else if (BTF_MEMBER_BITFIELD_SIZE(kflag, m->offset)) {
+				is_typedef = FALSE;
+				switch (BTF_INFO_KIND(btf_data.types[btf_resolve_type(m->type,
+				    &is_typedef)]->info))
+				{
+				case BTF_KIND_INT:
+				case BTF_KIND_ENUM:
+				case BTF_KIND_ENUM64:
+					break;
+				default:
+					ok = FALSE;
+				}
+			}
+		}
+		break;
+	}
+
+	btf_data.printable[id] = ok ? BTF_PRINT_OK : BTF_PRINT_NOT_OK;
+	return ok;
+}
+
+static void
+btf_print_value(struct btf_print *bp, uint32_t id, char *data, ulong addr,
+	int recurse)
+{
+	struct btf_type *t;
+	uint32_t encoding;
+	int is_typedef;
+
+	is_typedef = FALSE;
+	id = btf_resolve_type(id, &is_typedef);
+	t = btf_data.types[id];
+
+	switch (BTF_INFO_KIND(t->info))
+	{
+	case BTF_KIND_INT:
+		encoding = *(uint32_t *)(t + 1);
+		btf_print_scalar(bp, id, btf_extract(data, t->size_type,
+			BTF_INT_ENCODING(encoding) & BTF_INT_SIGNED));
+		break;
+
+	case BTF_KIND_ENUM:
+	case BTF_KIND_ENUM64:
+		btf_print_scalar(bp, id, btf_extract(data, t->size_type,
+			btf_enum_is_signed(id)));
+		break;
+
+	case BTF_KIND_PTR:
+		btf_print_pointer(bp, t->size_type,
+			(ulong)btf_extract(data, sizeof(ulong), FALSE));
+		break;
+
+	case BTF_KIND_ARRAY:
+		btf_print_array(bp, id, data, addr, recurse);
+		break;
+
+	case BTF_KIND_STRUCT:
+	case BTF_KIND_UNION:
+		btf_print_struct(bp, id, data, addr, recurse);
+		break;
+	}
+}
+
+/*
+ *  gdb's cp_print_value_fields() with "set print pretty on".  Anonymous
+ *  members are shown without a "name = ".
+ */
+static void
+btf_print_struct(struct btf_print *bp, uint32_t id, char *data, ulong addr,
+	int recurse)
+{
+	struct btf_type *t, *mt;
+	struct btf_member *m;
+	uint32_t i, vlen, mid, encoding;
+	long bitpos, bits;
+	int kflag, is_typedef, is_signed;
+	char *name;
+
+	t = btf_data.types[id];
+	vlen = BTF_INFO_VLEN(t->info);
+	kflag = BTF_INFO_KFLAG(t->info);
+	m = (struct btf_member *)(t + 1);
+
+	if (!vlen) {
+		fprintf(bp->ofp, "{<No data fields>}");
+		return;
+	}
+
+	fprintf(bp->ofp, "{");
+
+	for (i = 0; i < vlen; i++, m++) {
+		if (i)
+			fprintf(bp->ofp, ",");
+		fprintf(bp->ofp, "\n%*s", 2 + 2 * recurse, "");
+		name = btf_name(m->name_off);
+		if (strlen(name))
+			fprintf(bp->ofp, "%s = ", name);
+
+		bitpos = BTF_MEMBER_BIT_OFFSET(kflag, m->offset);
+		bits = BTF_MEMBER_BITFIELD_SIZE(kflag, m->offset);
+
+		is_typedef = FALSE;
+		mid = btf_resolve_type(m->type, &is_typedef);
+		mt = btf_data.types[mid];
+		is_signed = FALSE;
+		if (BTF_INFO_KIND(mt->info) == BTF_KIND_INT) {
+			encoding = *(uint32_t *)(mt + 1);
+			is_signed = BTF_INT_ENCODING(encoding) & BTF_INT_SIGNED;
+			if (!kflag && ((BTF_INT_BITS(encoding) != mt->size_type * 8) ||
+			    BTF_INT_OFFSET(encoding))) {
+				bitpos += BTF_INT_OFFSET(encoding);
+				bits = BTF_INT_BITS(encoding);
+			}
+		} else if ((BTF_INFO_KIND(mt->info) == BTF_KIND_ENUM) ||
+			   (BTF_INFO_KIND(mt->info) == BTF_KIND_ENUM64))
+			is_signed = btf_enum_is_signed(mid);
+
+		if (bits)
+			btf_print_scalar(bp, mid, btf_extract_bits(data,
+				bitpos, bits, is_signed));
+		else
+			btf_print_value(bp, m->type, data + bitpos/BITS_PER_BYTE,
+				addr + bitpos/BITS_PER_BYTE, recurse+1);
+	}
+
+	fprintf(bp->ofp, "\n%*s}", 2 * recurse, "");
+}
+
+/*
+ *  gdb's c_value_print_array().  An array of unknown length is shown
+ *  like a pointer to its first element.
+ */
+static void
+btf_print_array(struct btf_print *bp, uint32_t id, char *data, ulong addr,
+	int recurse)
+{
+	struct btf_array *a;
+	long i, nelems, esize, len;
+	int force_ellipses;
+
+	a = (struct btf_array *)(btf_data.types[id] + 1);
+	nelems = a->nelems;
+	esize = btf_type_size(a->type);
+
+	if (!nelems || (esize <= 0)) {
+		btf_print_pointer(bp, a->type, addr);
+		return;
+	}
+
+	if (btf_is_textual(a->type)) {
+		force_ellipses = FALSE;
+		len = nelems;
+		if (*gdb_stop_print_at_null) {
+			for (len = 0; (len < nelems) && (len < bp->print_max) &&
+			     data[len]; len++)
+				;
+			if ((len == bp->print_max) && (len < nelems) &&
+			    data[len])
+				force_ellipses = TRUE;
+		}
+		btf_print_string(bp, (unsigned char *)data, len,
+			force_ellipses);
+		return;
+	}
+
+	fprintf(bp->ofp, "{");
+	for (i = 0; (i < nelems) && (i < bp->print_max); i++) {
+		if (i)
+			fprintf(bp->ofp, ", ");
+		btf_print_value(bp, a->type, data + (i * esize),
+			addr + (i * esize), recurse+1);
+	}
+	if (i < nelems)
+		fprintf(bp->ofp, "...");
+	fprintf(bp->ofp, "}");
+}
+
+/*
+ *  Integer, boolean and enum values, which follow the output radix as
+ *  gdb's c_value_print_int() does, except that enums are always shown
+ *  by name.  In decimal, 1-byte integers are followed by the character.
+ */
+static void
+btf_print_scalar(struct btf_print *bp, uint32_t id, ulonglong value)
+{
+	struct btf_type *t;
+	uint32_t encoding;
+	long size;
+
+	t = btf_data.types[id];
+	size = t->size_type;
+
+	if (BTF_INFO_KIND(t->info) != BTF_KIND_INT) {
+		btf_print_enum(bp, id, value);
+		return;
+	}
+
+	encoding = BTF_INT_ENCODING(*(uint32_t *)(t + 1));
+
+	if (bp->hex)
+		fprintf(bp->ofp, "0x%llx", value & BTF_SIZE_MASK(size));
+	else if ((encoding & BTF_INT_BOOL) && (value <= 1))
+		fprintf(bp->ofp, "%s", value ? "true" : "false");
+	else if (encoding & BTF_INT_SIGNED)
+		fprintf(bp->ofp, "%lld", (long long)value);
+	else
+		fprintf(bp->ofp, "%llu", value);
+
+	if (!bp->hex && (size == 1) && !(encoding & BTF_INT_BOOL)) {
+		int need_escape = FALSE;
+
+		fprintf(bp->ofp, " '");
+		btf_print_char(bp->ofp, (unsigned char)value, '\'',
+			&need_escape);
+		fprintf(bp->ofp, "'");
+	}
+}
+
+/*
+ *  An enum value is shown as its enumerator, or if it has none, as gdb
+ *  does for a "flag" enum whose enumerators have no bits in common, or
+ *  otherwise in decimal.
+ */
+static void
+btf_print_enum(struct btf_print *bp, uint32_t id, ulonglong value)
+{
+	struct btf_type *t;
+	uint32_t i, vlen;
+	ulonglong enumval, mask, sizemask;
+	int is64, is_signed, flag_enum, first;
+	uint32_t *e;
+
+	t = btf_data.types[id];
+	vlen = BTF_INFO_VLEN(t->info);
+	is64 = (BTF_INFO_KIND(t->info) == BTF_KIND_ENUM64);
+	is_signed = btf_enum_is_signed(id);
+	sizemask = BTF_SIZE_MASK(t->size_type);
+
+	for (i = 0, e = (uint32_t *)(t + 1); i < vlen; i++, e = BTF_ENUM_NEXT(e)) {
+		if ((BTF_ENUMVAL(e) & sizemask) == (value & sizemask)) {
+			fprintf(bp->ofp, "%s", btf_name(e[0]));
+			return;
+		}
+	}
+
+	flag_enum = !is_signed;
+	for (i = 0, mask = 0, e = (uint32_t *)(t + 1);
+	     flag_enum && (i < vlen); i++, e = BTF_ENUM_NEXT(e)) {
+		enumval = BTF_ENUMVAL(e) & sizemask;
+		if (mask & enumval)
+			flag_enum = FALSE;
+		mask |= enumval;
+	}
+
+	if (!flag_enum) {
+		if (is_signed)
+			fprintf(bp->ofp, "%lld", (long long)value);
+		else
+			fprintf(bp->ofp, "%llu", value & sizemask);
+		return;
+	}
+
+	value &= sizemask;
+
+	for (i = 0, first = TRUE, e = (uint32_t *)(t + 1); i < vlen;
+	     i++, e = BTF_ENUM_NEXT(e)) {
+		enumval = BTF_ENUMVAL(e) & sizemask;
+		if (enumval && ((value & enumval) == enumval)) {
+			fprintf(bp->ofp, "%s%s", first ? "(" : " | ",
+				btf_name(e[0]));
+			first = FALSE;
+			value &= ~enumval;
+		}
+	}
+
+	if (value)
+		fprintf(bp->ofp, "%sunknown: 0x%llx)", first ? "(" : " | ",
+			value);
+	else if (first)
+		fprintf(bp->ofp, "0");
+	else
+		fprintf(bp->ofp, ")");
+}
+
+/*
+ *  gdb's print_unpacked_pointer(): the address and its symbol, and for a
+ *  pointer to a 1-byte integer type, the string that it points to.
+ */
+static void
+btf_print_pointer(struct btf_print *bp, uint32_t target, ulong ptr)
+{
+	unsigned char *buf;
+	ulong addr, cnt;
+	long bytes_read;
+	int found_nul, force_ellipses, error;
+	char peek;
+
+	btf_print_address(bp, ptr);
+
+	if (!ptr || !btf_is_textual(target))
+		return;
+
+	fprintf(bp->ofp, " ");
+
+	buf = (unsigned char *)GETBUF(bp->print_max + 1);
+	found_nul = error = FALSE;
+	for (addr = ptr, bytes_read = 0;
+	     !found_nul && (bytes_read < bp->print_max); ) {
+		cnt = MIN(bp->print_max - bytes_read,
+			PAGESIZE() - PAGEOFFSET(addr));
+		if (((bp->memtype == KVADDR) && !IS_KVADDR(addr)) ||
+		    !readmem(addr, bp->memtype, buf + bytes_read, cnt,
+		    "btf_print_pointer", RETURN_ON_ERROR|QUIET)) {
+			error = TRUE;
+			break;
+		}
+		for ( ; cnt; cnt--, addr++) {
+			if (!buf[bytes_read++]) {
+				found_nul = TRUE;
+				addr++;
+				break;
+			}
+		}
+	}
+
+	force_ellipses = FALSE;
+	if (!found_nul && !error &&
+	    (((bp->memtype != KVADDR) || IS_KVADDR(addr)) &&
+	    readmem(addr, bp->memtype, &peek, sizeof(char),
+	    "btf_print_pointer", RETURN_ON_ERROR|QUIET) && peek))
+		force_ellipses = TRUE;
+
+	if (!error || bytes_read)
+		btf_print_string(bp, buf, bytes_read, force_ellipses);
+	if (error)
+		fprintf(bp->ofp, "<error: Cannot access memory at address 0x%lx>",
+			addr);
+
+	FREEBUF(buf);
+}
+
+/*
+ *  gdb prints the symbol that an address falls within, as long as the
+ *  symbols of the kernel or module are known to it.
+ */
+static void
+btf_print_address(struct btf_print *bp, ulong addr)
+{
+	struct load_module *lm;
+	struct syment *sp;
+	ulong offset;
+
+	fprintf(bp->ofp, "0x%lx", addr);
+
+	if (!addr)
+		return;
+
+	if (module_symbol(addr, NULL, &lm, NULL, 0)) {
+		if (!(lm->mod_flags & MOD_LOAD_SYMS))
+			return;
+	} else if (!in_ksymbol_range(addr))
+		return;
+
+	if (!(sp = value_search(addr, &offset)))
+		return;
+
+	if (offset)
+		fprintf(bp->ofp, " <%s+%ld>", sp->name, offset);
+	else
+		fprintf(bp->ofp, " <%s>", sp->name);
+}
+
+/*
+ *  gdb's print_wchar(): non-printable characters are shown as octal
+ *  escapes, and so is a digit that follows one.
+ */
+static void
+btf_print_char(FILE *ofp, unsigned char c, int quoter, int *need_escape)
+{
+	int escaped;
+
+	escaped = *need_escape;
+	*need_escape = FALSE;
+
+	switch (c)
+	{
+	case '\a':
+		fprintf(ofp, "\\a");
+		break;
+	case '\b':
+		fprintf(ofp, "\\b");
+		break;
+	case '\f':
+		fprintf(ofp, "\\f");
+		break;
+	case '\n':
+		fprintf(ofp, "\\n");
+		break;
+	case '\r':
+		fprintf(ofp, "\\r");
+		break;
+	case '\t':
+		fprintf(ofp, "\\t");
+		break;
+	case '\v':
+		fprintf(ofp, "\\v");
+		break;
+	default:
+		if ((c >= ' ') && (c <= '~') && !(escaped && isdigit(c))) {
+			if ((c == quoter) || (c == '\\'))
+				fputc('\\', ofp);
+			fputc(c, ofp);
+		} else {
+			fprintf(ofp, "\\%.3o", c);
+			*need_escape = TRUE;
+		}
+		break;
+	}
+}
+
+/*
+ *  gdb's generic_printstr() with repeat elision disabled, as crash sets
+ *  it: a trailing NUL is not shown, and once print_max characters have
+ *  been shown, the rest of the run of identical characters that
+ *  reached the limit is shown before the "...".
+ */
+static void
+btf_print_string(struct btf_print *bp, unsigned char *s, long len,
+	int force_ellipses)
+{
+	long i, j, run, printed;
+	int need_escape;
+
+	if (!force_ellipses && (len > 0) && !s[len-1])
+		len--;
+
+	if (!len) {
+		fprintf(bp->ofp, "\"\"");
+		return;
+	}
+
+	fprintf(bp->ofp, "\"");
+	for (i = printed = 0, need_escape = FALSE;
+	     (i < len) && (printed < bp->print_max); i += run) {
+		for (run = 1; (i + run < len) && (s[i+run] == s[i]); run++)
+			;
+		for (j = 0; j < run; j++)
+			btf_print_char(bp->ofp, s[i], '"', &need_escape);
+		printed += run;
+	}
+	fprintf(bp->ofp, "\"");
+
+	if (force_ellipses || (i < len))
+		fprintf(bp->ofp, "...");
+}
+
+/*
+ *  gdb treats any 1-byte integer type as characters.
+ */
+static int
+btf_is_textual(uint32_t id)
+{
+	struct btf_type *t;
+	int is_typedef;
+
+	is_typedef = FALSE;
+	if (!id || !(id = btf_resolve_type(id, &is_typedef)))
+		return FALSE;
+	t = btf_data.types[id];
+
+	return ((BTF_INFO_KIND(t->info) == BTF_KIND_INT) &&
+	    (t->size_type == 1) &&
+	    !(BTF_INT_ENCODING(*(uint32_t *)(t + 1)) & BTF_INT_BOOL));
+}
+
+/*
+ *  Like gdb, consider an enum signed if it has a negative enumerator.
+ */
+static int
+btf_enum_is_signed(uint32_t id)
+{
+	struct btf_type *t;
+	uint32_t i, vlen, *e;
+	int is64;
+
+	t = btf_data.types[id];
+	vlen = BTF_INFO_VLEN(t->info);
+	is64 = (BTF_INFO_KIND(t->info) == BTF_KIND_ENUM64);
+
+	for (i = 0, e = (uint32_t *)(t + 1); i < vlen; i++, e = BTF_ENUM_NEXT(e)) {
+		if ((long long)BTF_ENUMVAL(e) < 0)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static ulonglong
+btf_extract(char *data, long size, int is_signed)
+{
+	uint8_t v8;
+	uint16_t v16;
+	uint32_t v32;
+	uint64_t v64;
+
+	switch (size)
+	{
+	case 1:
+		memcpy(&v8, data, size);
+		return is_signed ? (ulonglong)(int8_t)v8 : v8;
+	case 2:
+		memcpy(&v16, data, size);
+		return is_signed ? (ulonglong)(int16_t)v16 : v16;
+	case 4:
+		memcpy(&v32, data, size);
+		return is_signed ? (ulonglong)(int32_t)v32 : v32;
+	default:
+		memcpy(&v64, data, sizeof(uint64_t));
+		return v64;
+	}
+}
+
+/*
+ *  Extract a bitfield, counting bit positions as gdb's
+ *  unpack_bits_as_long() does for the byte order.
+ */
+static ulonglong
+btf_extract_bits(char *data, long bitpos, long bits, int is_signed)
+{
+	unsigned char *p;
+	ulonglong value;
+	long i, nbytes, shift;
+
+	p = (unsigned char *)data + bitpos/BITS_PER_BYTE;
+	nbytes = ((bitpos % BITS_PER_BYTE) + bits + BITS_PER_BYTE - 1) /
+		BITS_PER_BYTE;
+	if ((bits <= 0) || (bits > 64) || (nbytes > sizeof(ulonglong)))
+		return 0;
+
+	for (i = 0, value = 0; i < nbytes; i++) {
+		if (__BYTE_ORDER == __BIG_ENDIAN)
+			value = (value << BITS_PER_BYTE) | p[i];
+		else
+			value |= (ulonglong)p[i] << (i * BITS_PER_BYTE);
+	}
+
+	if (__BYTE_ORDER == __BIG_ENDIAN)
+		shift = (nbytes * BITS_PER_BYTE) - (bitpos % BITS_PER_BYTE) - bits;
+	else
+		shift = bitpos % BITS_PER_BYTE;
+
+	value >>= shift;
+	if (bits < 64) {
+		value &= (1ULL << bits) - 1;
+		if (is_signed && (value & (1ULL << (bits - 1))))
+			value |= ~((1ULL << bits) - 1);
+	}
+
+	return value;
+}
+
+/*
+ *  Find the one complete type of one of the kinds in the mask with the
+ *  given name.  Forward declarations are skipped, and a name that has
+ *  more than one definition is left to gdb.
+ */
+static uint32_t
+btf_find_type(char *name, ulong kinds)
+{
+	uint32_t id, found;
+	struct btf_type *t;
+
+	found = 0;
+	for (id = btf_data.hash[btf_name_hash(name)]; id;
+	     id = btf_data.next[id]) {
+		t = btf_data.types[id];
+		if (!(BTF_KINDMASK(BTF_INFO_KIND(t->info)) & kinds) ||
+		    !STREQ(btf_name(t->name_off), name))
+			continue;
+		if (found)
+			return 0;
+		found = id;
+	}
+
+	return found;
+}
+
+static char *
+btf_name(uint32_t offset)
+{
+	return (offset < btf_data.str_len) ? btf_data.strings + offset : "";
+}
+
+static ulong
+btf_name_hash(char *name)
+{
+	ulong hash = 5381;
+
+	while (*name)
+		hash = ((hash << 5) + hash) + (unsigned char)*name++;
+
+	return hash % BTF_NAME_HASH;
+}
+
+/*
+ *  The number of bytes of kind-specific data that follow a type.
+ */
+static uint32_t
+btf_type_datalen(struct btf_type *t)
+{
+	uint32_t vlen = BTF_INFO_VLEN(t->info);
+
+	switch (BTF_INFO_KIND(t->info))
+	{
+	case BTF_KIND_INT:
+	case BTF_KIND_VAR:
+	case BTF_KIND_DECL_TAG:
+		return sizeof(uint32_t);
+	case BTF_KIND_ARRAY:
+		return sizeof(struct btf_array);
+	case BTF_KIND_STRUCT:
+	case BTF_KIND_UNION:
+	case BTF_KIND_DATASEC:
+	case BTF_KIND_ENUM64:
+		return vlen * 3 * sizeof(uint32_t);
+	case BTF_KIND_ENUM:
+	case BTF_KIND_FUNC_PROTO:
+		return vlen * 2 * sizeof(uint32_t);
+	case BTF_KIND_PTR:
+	case BTF_KIND_FWD:
+	case BTF_KIND_TYPEDEF:
+	case BTF_KIND_VOLATILE:
+	case BTF_KIND_CONST:
+	case BTF_KIND_RESTRICT:
+	case BTF_KIND_FUNC:
+	case BTF_KIND_FLOAT:
+	case BTF_KIND_TYPE_TAG:
+		return 0;
+	default:
+		return (uint32_t)-1;
+	}
+}
+
+/*
+ *  Verify the BTF data and index its types by id and by name.  The data
+ *  buffer is kept for the life of the session.
+ */
+static int
+btf_parse(char *data, ulong size, char *source)
+{
+	struct btf_header *hdr;
+	struct btf_type *t;
+	char *types, *p;
+	uint32_t count, id, datalen;
+	ulong hash;
+
+	hdr = (struct btf_header *)data;
+	if ((size < sizeof(struct btf_header)) || (hdr->magic != BTF_MAGIC) ||
+	    (hdr->version != BTF_VERSION) ||
+	    (hdr->hdr_len < sizeof(struct btf_header)) ||
+	    ((ulong)hdr->hdr_len + hdr->type_off + hdr->type_len > size) ||
+	    ((ulong)hdr->hdr_len + hdr->str_off + hdr->str_len > size) ||
+	    !hdr->str_len) {
+		error(INFO, "%s: invalid BTF data\n", source);
+		return FALSE;
+	}
+
+	types = data + hdr->hdr_len + hdr->type_off;
+	btf_data.strings = data + hdr->hdr_len + hdr->str_off;
+	btf_data.str_len = hdr->str_len;
+	if (btf_data.strings[btf_data.str_len-1] != NULLCHAR) {
+		error(INFO, "%s: invalid BTF string section\n", source);
+		return FALSE;
+	}
+
+	for (p = types, count = 1; p < types + hdr->type_len; count++) {
+		t = (struct btf_type *)p;
+		if ((p + sizeof(struct btf_type) > types + hdr->type_len) ||
+		    ((datalen = btf_type_datalen(t)) == (uint32_t)-1) ||
+		    (p + sizeof(struct btf_type) + datalen >
+		    types + hdr->type_len)) {
+			error(INFO, "%s: invalid BTF type %d\n", source, count);
+			return FALSE;
+		}
+		p += sizeof(struct btf_type) + datalen;
+	}
+
+	if (!(btf_data.types = calloc(count, sizeof(struct btf_type *))) ||
+	    !(btf_data.next = calloc(count, sizeof(uint32_t))) ||
+	    !(btf_data.hash = calloc(BTF_NAME_HASH, sizeof(uint32_t)))) {
+		error(INFO, "cannot malloc BTF type index\n");
+		free(btf_data.types);
+		free(btf_data.next);
+		btf_data.types = NULL;
+		btf_data.next = NULL;
+		return FALSE;
+	}
+
+	for (p = types, id = 1; id < count; id++) {
+		t = (struct btf_type *)p;
+		btf_data.types[id] = t;
+		p += sizeof(struct btf_type) + btf_type_datalen(t);
+
+		if (!(BTF_KINDMASK(BTF_INFO_KIND(t->info)) & BTF_HASHED_KINDS) ||
+		    !t->name_off)
+			continue;
+		hash = btf_name_hash(btf_name(t->name_off));
+		btf_data.next[id] = btf_data.hash[hash];
+		btf_data.hash[hash] = id;
+	}
+
+	/*
+	 *  Verify the references that are followed by the lookups.
+	 */
+	for (id = 1; id < count; id++) {
+		t = btf_data.types[id];
+		switch (BTF_INFO_KIND(t->info))
+		{
+		case BTF_KIND_PTR:
+		case BTF_KIND_TYPEDEF:
+		case BTF_KIND_VOLATILE:
+		case BTF_KIND_CONST:
+		case BTF_KIND_RESTRICT:
+		case BTF_KIND_TYPE_TAG:
+			if (t->size_type >= count)
+				goto bad_reference;
+			break;
+		case BTF_KIND_ARRAY:
+			if (((struct btf_array *)(t + 1))->type >= count)
+				goto bad_reference;
+			break;
+		}
+	}
+
+	btf_data.nr_types = count;
+	btf_data.data = data;
+	btf_data.size = size;
+	btf_data.source = source;
+
+	return TRUE;
+
+bad_reference:
+	error(INFO, "%s: invalid BTF type reference in type %d\n", source, id);
+	free(btf_data.types);
+	free(btf_data.next);
+	free(btf_data.hash);
+	btf_data.types = NULL;
+	btf_data.next = NULL;
+	btf_data.hash = NULL;
+	return FALSE;
+}
+
+/*
+ *  Read a section of the vmlinux file, which is not necessarily one that
+ *  bfd has opened.  Returns a malloc'd buffer.
+ */
+static char *
+btf_read_elf_section(char *file, char *section, ulong *sizep)
+{
+	int fd;
+	char *shdrs, *shstrtab, *buf, *name;
+	Elf64_Ehdr ehdr;
+	Elf32_Ehdr *ehdr32;
+	ulong i, shnum, shentsize, shoff, shstrndx;
+	ulong sh_name, sh_type, sh_offset, sh_size, strtab_offset, strtab_size;
+	int is64;
+
+	shdrs = shstrtab = buf = NULL;
+
+	if (!file || ((fd = open(file, O_RDONLY)) < 0))
+		return NULL;
+
+	if ((pread(fd, &ehdr, sizeof(Elf64_Ehdr), 0) != sizeof(Elf64_Ehdr)) ||
+	    memcmp(ehdr.e_ident, ELFMAG, SELFMAG))
+		goto bailout;
+
+	if ((is64 = (ehdr.e_ident[EI_CLASS] == ELFCLASS64))) {
+		shnum = ehdr.e_shnum;
+		shentsize = ehdr.e_shentsize;
+		shoff = ehdr.e_shoff;
+		shstrndx = ehdr.e_shstrndx;
+		if (shentsize != sizeof(Elf64_Shdr))
+			goto bailout;
+	} else if (ehdr.e_ident[EI_CLASS] == ELFCLASS32) {
+		ehdr32 = (Elf32_Ehdr *)&ehdr;
+		shnum = ehdr32->e_shnum;
+		shentsize = ehdr32->e_shentsize;
+		shoff = ehdr32->e_shoff;
+		shstrndx = ehdr32->e_shstrndx;
+		if (shentsize != sizeof(Elf32_Shdr))
+			goto bailout;
+	} else
+		goto bailout;
+
+	if (!shnum || (shstrndx >= shnum) ||
+	    !(shdrs = malloc(shnum * shentsize)) ||
+	    (pread(fd, shdrs, shnum * shentsize, shoff) != shnum * shentsize))
+		goto bailout;
+
+#define SHDR_FIELD(i, field) (is64 ? \
+	(ulong)((Elf64_Shdr *)shdrs)[i].field : \
+	(ulong)((Elf32_Shdr *)shdrs)[i].field)
+
+	strtab_offset = SHDR_FIELD(shstrndx, sh_offset);
+	strtab_size = SHDR_FIELD(shstrndx, sh_size);
+	if (!strtab_size || !(shstrtab = malloc(strtab_size + 1)) ||
+	    (pread(fd, shstrtab, strtab_size, strtab_offset) != strtab_size))
+		goto bailout;
+	shstrtab[strtab_size] = NULLCHAR;
+
+	for (i = 0; i < shnum; i++) {
+		sh_name = SHDR_FIELD(i, sh_name);
+		sh_type = SHDR_FIELD(i, sh_type);
+		sh_offset = SHDR_FIELD(i, sh_offset);
+		sh_size = SHDR_FIELD(i, sh_size);
+		name = (sh_name < strtab_size) ? shstrtab + sh_name : "";
+
+		if (!STREQ(name, section) || (sh_type == SHT_NOBITS) ||
+		    !sh_size)
+			continue;
+
+		if (!(buf = malloc(sh_size)) ||
+		    (pread(fd, buf, sh_size, sh_offset) != sh_size)) {
+			free(buf);
+			buf = NULL;
+		} else
+			*sizep = sh_size;
+		break;
+	}
+
+bailout:
+	free(shdrs);
+	free(shstrtab);
+	close(fd);
+	return buf;
+}
+
+/*
+ *  Find and index the BTF data on first use.  The kernel memory copy is
+ *  only tried once kernel virtual addresses can be read; until then the
+ *  queries are passed on to gdb.
+ */
+static int
+btf_load(void)
+{
+	char *data;
+	ulong size, start, end;
+
+	data = NULL;
+	size = 0;
+
+	if (!btf_data.files_searched) {
+		btf_data.files_searched = TRUE;
+
+		if ((data = btf_read_elf_section(pc->namelist, ".BTF", &size))) {
+			if (btf_parse(data, size, pc->namelist))
+				goto loaded;
+			free(data);
+		}
+
+		if (pc->namelist_debug && (data =
+		    btf_read_elf_section(pc->namelist_debug, ".BTF", &size))) {
+			if (btf_parse(data, size, pc->namelist_debug))
+				goto loaded;
+			free(data);
+		}
+	}
+
+	if (!symbol_exists("__start_BTF") || !symbol_exists("__stop_BTF"))
+		goto unavailable;
+
+	if (!(vt->flags & VM_INIT))
+		return FALSE;
+
+	start = symbol_value("__start_BTF");
+	end = symbol_value("__stop_BTF");
+	if ((end <= start) || ((end - start) > (256 * 1024 * 1024)) ||
+	    !(data = malloc(end - start)))
+		goto unavailable;
+	size = end - start;
+
+	if (!readmem(start, KVADDR, data, size, "BTF data",
+	    RETURN_ON_ERROR|QUIET) || !btf_parse(data, size, "kernel memory")) {
+		free(data);
+		goto unavailable;
+	}
+
+loaded:
+	btf_data.state = BTF_LOADED;
+	if (CRASHDEBUG(1))
+		error(INFO, "BTF: %d types from %s\n",
+			btf_data.nr_types - 1, btf_data.source);
+	return TRUE;
+
+unavailable:
+	btf_data.state = BTF_UNAVAILABLE;
+	if (CRASHDEBUG(1))
+		error(INFO, "BTF: no type information found\n");
+	return FALSE;
+}
+
+/*
+ *  "help -s" output.
+ */
+void
+dump_btf_info(void)
+{
+	fprintf(fp, "                 btf: %s\n",
+		!(pc->flags2 & BTF_TYPES) ? "(off)" :
+		btf_data.state == BTF_LOADED ? btf_data.source :
+		btf_data.state == BTF_UNAVAILABLE ? "(unavailable)" :
+		"(not loaded)");
+	if (btf_data.state == BTF_LOADED)
+		fprintf(fp, "               types: %d  size: %ld\n",
+			btf_data.nr_types - 1, btf_data.size);
+	fprintf(fp, "                hits: %ld  fallbacks: %ld\n",
+		btf_data.hits, btf_data.fallbacks);
+	fprintf(fp, "              prints: %ld  fallbacks: %ld\n",
+		btf_data.prints, btf_data.print_fallbacks);
+}
@@ -15,6 +15,7 @@
  * GNU General Public License for more details.
  */
 
+#define _GNU_SOURCE		/* fopencookie() */
 #include "defs.h"
 
 static void restore_sanity(void);
@@ -29,6 +30,9 @@ static int alias_exists(char *);
 static void resolve_aliases(void);
 static int setup_redirect(int);
 int multiple_pipes(char **);
+static FILE *pipe_filter_open(char *);
+static int pipe_filter_fclose(FILE *);
+static int pipe_filter_done(FILE *);
 static int output_command_to_pids(void);
 static void set_my_tty(void);
 static char *signame(int);
@@ -117,6 +121,7 @@ process_command_line(void)
 		sprintf(pc->command_line, "< %s", pc->input_file);
 		pc->flags |= INIT_IFILE;
 	} else if (pc->flags & TTY) {
+		readline_init();
 		if (!(pc->readline = readline(pc->prompt))) {
 			args[0] = NULL;
 			fprintf(fp, "\n");
@@ -138,7 +143,7 @@ process_command_line(void)
 		check_special_handling(pc->command_line);
         } else {
         	if (fgets(pc->command_line, BUFSIZE-1, stdin) == NULL)
-			clean_exit(1);
+			clean_exit(pc->flags2 & BATCH_SESSION ? 0 : 1);
 		clean_line(pc->command_line);
 		strcpy(pc->orig_line, pc->command_line);
         }
@@ -459,7 +464,9 @@ setup_scroll_command(void)
  *  Parse the command line for pipe or redirect characters:  
  *
  *   1. if a "|" character is found, popen() what comes after it, and 
- *      modify the contents of the global "fp" FILE pointer.
+ *      modify the contents of the global "fp" FILE pointer.  Simple
+ *      grep, head, tail and wc -l pipelines are instead filtered in
+ *      place by pipe_filter_open().
  *   2. if one or two ">" characters are found, fopen() the filename that
  *      follows, and modify the contents of the global "fp" FILE pointer.
  * 
@@ -534,6 +541,25 @@ setup_redirect(int origin)
 			if (pc->redirect & REDIRECT_SHELL_COMMAND)
 				return shell_command(p);
 
+			if ((pipe = pipe_filter_open(p))) {
+				switch (origin)
+				{
+				case FROM_COMMAND_LINE:
+					fp = pc->pipe = pipe;
+					break;
+
+				case FROM_INPUT_FILE:
+					fp = pc->ifile_pipe = pipe;
+					break;
+				}
+
+				strcpy(pc->pipe_command, p);
+				null_first_space(pc->pipe_command);
+
+				pc->redirect |= (REDIRECT_TO_PIPE|REDIRECT_TO_FILTER);
+				return REDIRECT_TO_PIPE;
+			}
+
                         if ((pipe = popen(p, "w")) == NULL) {
                                 error(INFO, "cannot open pipe\n");
 				pc->redirect |= REDIRECT_FAILURE;
@@ -696,6 +722,581 @@ multiple_pipes(char **input)
 		return FALSE;
 }
 
+/*
+ *  Common pipe targets -- grep, head, tail and wc -l -- are applied
+ *  within crash itself rather than by a popen()'d shell.  This avoids
+ *  the fork and exec of the shell and its commands, and the /proc scan
+ *  for their pids, for each command line, which adds up when an input
+ *  file runs many commands.  A pipeline is only filtered in place if
+ *  every stage is one of the simple forms below, and it contains no
+ *  shell syntax other than quoting; anything else is passed to popen()
+ *  as before:
+ *
+ *    grep [-v] [-i] [-c] [-E | -F] [-e] pattern   (also egrep and fgrep)
+ *    head [-N | -n N]
+ *    tail [-N | -n N]
+ *    wc -l
+ *
+ *  The filtered output is written to stdout, where the popen()'d
+ *  command would have written it.
+ */
+#define PIPE_FILTER_STAGES  (8)
+#define PIPE_FILTER_ARGS    (16)
+#define PIPE_FILTER_LINES   (10)
+
+#define FILTER_GREP  (1)
+#define FILTER_HEAD  (2)
+#define FILTER_TAIL  (3)
+#define FILTER_COUNT (4)
+
+struct filter_stage {
+	int type;
+	int invert;
+	int icase;
+	int fixed;
+	int count_only;
+	int regex_valid;
+	regex_t regex;
+	char *pattern;
+	long limit;
+	long count;
+	char **ring;
+};
+
+struct pipe_filter {
+	struct pipe_filter *next;
+	FILE *fp;
+	int stages;
+	int done;
+	struct filter_stage stage[PIPE_FILTER_STAGES];
+	char *line;
+	size_t linelen;
+	size_t linesize;
+};
+
+static struct pipe_filter *pipe_filter_list = NULL;
+
+/*
+ *  Split a pipeline into words, honoring quotes and backslashes as the
+ *  shell would, with a NULL word in place of each unquoted '|'.
+ *  Returns the word count, or -1 if the pipeline contains anything that
+ *  would require a shell: expansions, globbing, redirection, command
+ *  lists or subshells.
+ */
+static int
+pipe_filter_words(char *s, char *buf, char **words, int max)
+{
+	int cnt, quote, inword;
+	char *b;
+
+	cnt = 0;
+	inword = quote = FALSE;
+	b = buf;
+
+	for ( ; ; s++) {
+		if (quote == '\'') {
+			if (!*s)
+				return -1;
+			if (*s == '\'')
+				quote = FALSE;
+			else
+				*b++ = *s;
+			continue;
+		}
+
+		if (quote == '"') {
+			if (!*s || (*s == '$') || (*s == '`'))
+				return -1;
+			if (*s == '"')
+				quote = FALSE;
+			else if ((*s == '\\') && s[1] && strchr("\\\"$`", s[1]))
+				*b++ = *++s;
+			else
+				*b++ = *s;
+			continue;
+		}
+
+		if (!*s || whitespace(*s) || (*s == '|')) {
+			if (inword) {
+				*b++ = NULLCHAR;
+				inword = FALSE;
+			}
+			if (*s == '|') {
+				if (cnt == max)
+					return -1;
+				words[cnt++] = NULL;
+			}
+			if (!*s)
+				break;
+			continue;
+		}
+
+		if (strchr(";&<>()$`*?[]{}~#", *s))
+			return -1;
+
+		if (!inword) {
+			if (cnt == max)
+				return -1;
+			words[cnt++] = b;
+			inword = TRUE;
+		}
+
+		switch (*s)
+		{
+		case '\'':
+		case '"':
+			quote = *s;
+			break;
+		case '\\':
+			if (!s[1])
+				return -1;
+			*b++ = *++s;
+			break;
+		default:
+			*b++ = *s;
+			break;
+		}
+	}
+
+	return cnt;
+}
+
+/*
+ *  Parse the "-N", "-n N" or "-nN" line count of head and tail.
+ */
+static int
+pipe_filter_lines(char **argv, int argc, long *limit)
+{
+	char *p;
+
+	*limit = PIPE_FILTER_LINES;
+
+	if (argc == 1)
+		return TRUE;
+
+	if ((argc == 2) && (argv[1][0] == '-') && decimal(&argv[1][1], 0)) {
+		*limit = atol(&argv[1][1]);
+		return TRUE;
+	}
+
+	if (STRNEQ(argv[1], "-n")) {
+		if ((argc == 2) && argv[1][2])
+			p = &argv[1][2];
+		else if ((argc == 3) && !argv[1][2])
+			p = argv[2];
+		else
+			return FALSE;
+		if (!decimal(p, 0))
+			return FALSE;
+		*limit = atol(p);
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static int
+pipe_filter_grep(char **argv, int argc, struct filter_stage *fs)
+{
+	int i, flags;
+	char *p, *pattern;
+
+	flags = STREQ(argv[0], "egrep") ? REG_EXTENDED : 0;
+	fs->fixed = STREQ(argv[0], "fgrep");
+	pattern = NULL;
+
+	/*
+	 *  Exactly one pattern following the options, and no file names.
+	 */
+	for (i = 1; i < argc; i++) {
+		if (pattern)
+			return FALSE;
+		if ((argv[i][0] != '-') || !argv[i][1]) {
+			pattern = argv[i];
+			continue;
+		}
+		if (STREQ(argv[i], "--")) {
+			if (++i < argc)
+				pattern = argv[i];
+			continue;
+		}
+		for (p = &argv[i][1]; *p && !pattern; p++) {
+			switch (*p)
+			{
+			case 'v':
+				fs->invert = TRUE;
+				break;
+			case 'i':
+				fs->icase = TRUE;
+				break;
+			case 'c':
+				fs->count_only = TRUE;
+				break;
+			case 'E':
+				flags |= REG_EXTENDED;
+				fs->fixed = FALSE;
+				break;
+			case 'F':
+				flags &= ~REG_EXTENDED;
+				fs->fixed = TRUE;
+				break;
+			case 'e':
+				if (p[1])
+					pattern = p+1;
+				else if (++i < argc)
+					pattern = argv[i];
+				else
+					return FALSE;
+				break;
+			default:
+				return FALSE;
+			}
+		}
+	}
+
+	if (!pattern || !(fs->pattern = strdup(pattern)))
+		return FALSE;
+
+	if (fs->fixed)
+		return TRUE;
+
+	if (fs->icase)
+		flags |= REG_ICASE;
+	if (regcomp(&fs->regex, fs->pattern, flags|REG_NOSUB))
+		return FALSE;
+	fs->regex_valid = TRUE;
+
+	return TRUE;
+}
+
+static int
+pipe_filter_stage(char **argv, int argc, struct filter_stage *fs)
+{
+	if (!argc)
+		return FALSE;
+
+	if (STREQ(argv[0], "grep") || STREQ(argv[0], "egrep") ||
+	    STREQ(argv[0], "fgrep")) {
+		fs->type = FILTER_GREP;
+		return pipe_filter_grep(argv, argc, fs);
+	}
+
+	if (STREQ(argv[0], "head")) {
+		fs->type = FILTER_HEAD;
+		return pipe_filter_lines(argv, argc, &fs->limit);
+	}
+
+	if (STREQ(argv[0], "tail")) {
+		fs->type = FILTER_TAIL;
+		if (!pipe_filter_lines(argv, argc, &fs->limit))
+			return FALSE;
+		if (fs->limit &&
+		    !(fs->ring = calloc(fs->limit, sizeof(char *))))
+			return FALSE;
+		return TRUE;
+	}
+
+	if (STREQ(argv[0], "wc") && (argc == 2) && STREQ(argv[1], "-l")) {
+		fs->type = FILTER_COUNT;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static int
+pipe_filter_match(struct filter_stage *fs, char *line)
+{
+	int match;
+
+	if (fs->regex_valid)
+		match = (regexec(&fs->regex, line, 0, NULL, 0) == 0);
+	else if (fs->icase)
+		match = (strcasestr(line, fs->pattern) != NULL);
+	else
+		match = (strstr(line, fs->pattern) != NULL);
+
+	return fs->invert ? !match : match;
+}
+
+/*
+ *  Pass a line without its newline through the stages of a pipeline,
+ *  beginning with the stage "index".
+ */
+static void
+pipe_filter_line(struct pipe_filter *pf, int index, char *line)
+{
+	struct filter_stage *fs;
+	int i;
+
+	for (i = index; i < pf->stages; i++) {
+		fs = &pf->stage[i];
+
+		switch (fs->type)
+		{
+		case FILTER_GREP:
+			if (!pipe_filter_match(fs, line))
+				return;
+			if (fs->count_only) {
+				fs->count++;
+				return;
+			}
+			break;
+
+		case FILTER_HEAD:
+			if (fs->count >= fs->limit)
+				return;
+			fs->count++;
+			break;
+
+		case FILTER_TAIL:
+			if (fs->limit) {
+				free(fs->ring[fs->count % fs->limit]);
+				fs->ring[fs->count % fs->limit] = strdup(line);
+			}
+			fs->count++;
+			return;
+
+		case FILTER_COUNT:
+			fs->count++;
+			return;
+		}
+	}
+
+	fprintf(stdout, "%s\n", line);
+}
+
+/*
+ *  Once a head stage has passed its last line, and nothing before it
+ *  needs to see the rest of the input, the command can be stopped the
+ *  same way as when a piped-to command exits.
+ */
+static void
+pipe_filter_check_done(struct pipe_filter *pf)
+{
+	struct filter_stage *fs;
+	int i;
+
+	for (i = 0; i < pf->stages; i++) {
+		fs = &pf->stage[i];
+		if ((fs->type == FILTER_HEAD) && (fs->count >= fs->limit)) {
+			pf->done = TRUE;
+			return;
+		}
+		if ((fs->type != FILTER_GREP) || fs->count_only)
+			return;
+	}
+}
+
+static ssize_t
+pipe_filter_write(void *cookie, const char *buf, size_t size)
+{
+	struct pipe_filter *pf = (struct pipe_filter *)cookie;
+	const char *nl;
+	size_t len, left;
+	char *line;
+
+	if (pf->done)
+		return size;
+
+	for (left = size; left; buf += len, left -= len) {
+		nl = memchr(buf, '\n', left);
+		len = nl ? (nl - buf) + 1 : left;
+
+		if (pf->linelen + len + 1 > pf->linesize) {
+			if (!(line = realloc(pf->line,
+			    MAX(pf->linesize * 2, pf->linelen + len + BUFSIZE)))) {
+				errno = ENOMEM;
+				return -1;
+			}
+			pf->line = line;
+			pf->linesize = MAX(pf->linesize * 2,
+				pf->linelen + len + BUFSIZE);
+		}
+		memcpy(pf->line + pf->linelen, buf, nl ? len - 1 : len);
+		pf->linelen += nl ? len - 1 : len;
+
+		if (nl) {
+			pf->line[pf->linelen] = NULLCHAR;
+			pf->linelen = 0;
+			pipe_filter_line(pf, 0, pf->line);
+			pipe_filter_check_done(pf);
+			if (pf->done)
+				break;
+		}
+	}
+
+	fflush(stdout);
+
+	return size;
+}
+
+/*
+ *  At the end of the command, pass the output of the tail and counting
+ *  stages on to the stages that follow them, and free the pipeline.
+ */
+static int
+pipe_filter_close(void *cookie)
+{
+	struct pipe_filter *pf = (struct pipe_filter *)cookie;
+	struct pipe_filter **pfp;
+	struct filter_stage *fs;
+	char buf[BUFSIZE];
+	long j;
+	int i;
+
+	if (pf->linelen && !pf->done) {
+		pf->line[pf->linelen] = NULLCHAR;
+		pipe_filter_line(pf, 0, pf->line);
+	}
+
+	for (i = 0; i < pf->stages; i++) {
+		fs = &pf->stage[i];
+
+		switch (fs->type)
+		{
+		case FILTER_GREP:
+			if (fs->count_only) {
+				sprintf(buf, "%ld", fs->count);
+				pipe_filter_line(pf, i+1, buf);
+			}
+			break;
+
+		case FILTER_TAIL:
+			j = fs->count > fs->limit ? fs->count - fs->limit : 0;
+			for ( ; j < fs->count; j++) {
+				pipe_filter_line(pf, i+1,
+					fs->ring[j % fs->limit]);
+				free(fs->ring[j % fs->limit]);
+			}
+			free(fs->ring);
+			break;
+
+		case FILTER_COUNT:
+			sprintf(buf, "%ld", fs->count);
+			pipe_filter_line(pf, i+1, buf);
+			break;
+		}
+
+		if (fs->regex_valid)
+			regfree(&fs->regex);
+		free(fs->pattern);
+	}
+
+	fflush(stdout);
+
+	for (pfp = &pipe_filter_list; *pfp; pfp = &(*pfp)->next) {
+		if (*pfp == pf) {
+			*pfp = pf->next;
+			break;
+		}
+	}
+
+	free(pf->line);
+	free(pf);
+
+	return 0;
+}
+
+/*
+ *  Return a FILE that applies the pipeline "cmd" to the output written
+ *  to it, or NULL if the pipeline has to be run by the shell.
+ */
+static FILE *
+pipe_filter_open(char *cmd)
+{
+	cookie_io_functions_t funcs;
+	struct pipe_filter *pf;
+	struct filter_stage *fs;
+	char buf[BUFSIZE*2];
+	char *words[PIPE_FILTER_STAGES * (PIPE_FILTER_ARGS+1)];
+	int i, argc, cnt, start;
+	FILE *fptr;
+
+	if (!(pc->flags2 & PIPE_FILTER) || (strlen(cmd) >= BUFSIZE) ||
+	    ((cnt = pipe_filter_words(cmd, buf, words,
+	    PIPE_FILTER_STAGES * (PIPE_FILTER_ARGS+1))) <= 0))
+		return NULL;
+
+	if ((pf = calloc(1, sizeof(struct pipe_filter))) == NULL)
+		return NULL;
+
+	for (i = start = 0; i <= cnt; i++) {
+		if ((i < cnt) && words[i])
+			continue;
+		argc = i - start;
+		if ((pf->stages == PIPE_FILTER_STAGES) ||
+		    (argc > PIPE_FILTER_ARGS))
+			goto not_filtered;
+		fs = &pf->stage[pf->stages++];
+		if (!pipe_filter_stage(&words[start], argc, fs))
+			goto not_filtered;
+		start = i+1;
+	}
+
+	funcs.read = NULL;
+	funcs.write = pipe_filter_write;
+	funcs.seek = NULL;
+	funcs.close = pipe_filter_close;
+
+	if ((fptr = fopencookie(pf, "w", funcs)) == NULL)
+		goto not_filtered;
+
+	pf->fp = fptr;
+	pf->next = pipe_filter_list;
+	pipe_filter_list = pf;
+
+	return fptr;
+
+not_filtered:
+	for (i = 0; i < pf->stages; i++) {
+		fs = &pf->stage[i];
+		if (fs->regex_valid)
+			regfree(&fs->regex);
+		free(fs->pattern);
+		free(fs->ring);
+	}
+	free(pf);
+
+	return NULL;
+}
+
+/*
+ *  Close the FILE of an in-process pipeline, returning FALSE if "fptr"
+ *  is not one.
+ */
+static int
+pipe_filter_fclose(FILE *fptr)
+{
+	struct pipe_filter *pf;
+
+	for (pf = pipe_filter_list; pf; pf = pf->next) {
+		if (pf->fp == fptr) {
+			fclose(fptr);
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/*
+ *  Determine whether an in-process pipeline has seen all of the output
+ *  that it needs.
+ */
+static int
+pipe_filter_done(FILE *fptr)
+{
+	struct pipe_filter *pf;
+
+	for (pf = pipe_filter_list; pf; pf = pf->next) {
+		if (pf->fp == fptr)
+			return pf->done;
+	}
+
+	return FALSE;
+}
+
 void
 debug_redirect(char *s)
 {
@@ -726,6 +1327,8 @@ debug_redirect(char *s)
                 console("%sREDIRECT_PID_KNOWN", others++ ? "|" : "");
         if (pc->redirect & REDIRECT_MULTI_PIPE)
                 console("%sREDIRECT_MULTI_PIPE", others++ ? "|" : "");
+        if (pc->redirect & REDIRECT_TO_FILTER)
+                console("%sREDIRECT_TO_FILTER", others++ ? "|" : "");
         console(")\n");
 
 	if (pc->pipe_pid || strlen(pc->pipe_command)) {
@@ -753,6 +1356,9 @@ output_open(void)
 {
 	int waitstatus, waitret;
 
+	if (pc->redirect & REDIRECT_TO_FILTER)
+		return !pipe_filter_done(fp);
+
 	if (!(pc->flags & TTY)) 
 		return TRUE;
 
@@ -874,6 +1480,9 @@ retry:
 	if (pc->pipe_pid)	
 		return pc->pipe_pid;
 
+	if (!strlen(pc->my_tty))
+		set_my_tty();
+
 	sprintf(buf1, "ps -ft %s", pc->my_tty);
 	console("%s: ", buf1);
 
@@ -944,10 +1553,8 @@ cmdline_init(void)
 		restore_sanity();
 
 		pc->flags |= TTY;
-		set_my_tty();
 
 		SIGACTION(SIGINT, restart, &pc->sigaction, NULL);
-		readline_init();
         }
         else {
 		if (fd < 0)
@@ -1104,7 +1711,8 @@ restore_sanity(void)
 		pc->stdpipe_pid = 0;
         }
 	if (pc->pipe) {
-		close(fileno(pc->pipe));
+		if (!pipe_filter_fclose(pc->pipe))
+			close(fileno(pc->pipe));
 	 	pc->pipe = NULL;
 		console("wait for redirect %d->%d to finish...\n",
 			pc->pipe_shell_pid, pc->pipe_pid);
@@ -1123,7 +1731,8 @@ restore_sanity(void)
 	}
 	if (pc->ifile_pipe) {
 		fflush(pc->ifile_pipe);
-		close(fileno(pc->ifile_pipe));
+		if (!pipe_filter_fclose(pc->ifile_pipe))
+			close(fileno(pc->ifile_pipe));
 		pc->ifile_pipe = NULL;
         	if (pc->pipe_pid &&
             	    ((pc->redirect & (PIPE_OPTIONS|REDIRECT_PID_KNOWN)) ==
@@ -1219,9 +1828,6 @@ restore_sanity(void)
 	clear_vma_cache();
 	clear_active_set();
 
-	if (kt->ikconfig_flags & IKCONFIG_LOADED)
-		read_in_kernel_config(IKCFG_FREE);
-
 	/*
 	 *  Call the cleanup() function of any extension.
 	 */
@@ -1237,8 +1843,11 @@ restore_sanity(void)
 		dump_vma_cache(0);
 	}
 	
-	if (REMOTE())
+	if (REMOTE()) {
 		remote_clear_pipeline();
+		if (REMOTE_ACTIVE())
+			page_cache_flush();
+	}
 
 	hq_close();
 }
@@ -1255,7 +1864,8 @@ restore_ifile_sanity(void)
 	pc->flags &= ~IFILE_ERROR;
 
         if (pc->ifile_pipe) {
-		close(fileno(pc->ifile_pipe));
+		if (!pipe_filter_fclose(pc->ifile_pipe))
+			close(fileno(pc->ifile_pipe));
                 pc->ifile_pipe = NULL;
         }
 
@@ -2048,11 +2658,19 @@ cmd_repeat(void)
 
 /*
  *  Initialize readline, set the editing mode, and then perform any 
- *  crash-specific bindings, etc.
+ *  crash-specific bindings, etc.  This is deferred until the first
+ *  command is read from the terminal, so that a session that only runs
+ *  input files never sets up readline.
  */
 static void
 readline_init(void)
 {               
+	static int initialized = FALSE;
+
+	if (initialized)
+		return;
+	initialized = TRUE;
+
         rl_initialize();
 
 	if (STREQ(pc->editing_mode, "vi")) {
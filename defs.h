@@ -403,6 +403,7 @@ struct number_option {
 #define REDIRECT_SHELL_COMMAND (0x100)
 #define REDIRECT_PID_KNOWN     (0x200)
 #define REDIRECT_MULTI_PIPE    (0x400)
+#define REDIRECT_TO_FILTER     (0x800)
 
 #define PIPE_OPTIONS (FROM_COMMAND_LINE | FROM_INPUT_FILE | REDIRECT_TO_PIPE | \
                       REDIRECT_TO_STDPIPE | REDIRECT_TO_FILE)
@@ -413,6 +414,25 @@ struct number_option {
 #define MEMORY_DRIVER_DEVICE        "/dev/crash"
 #define MEMORY_DRIVER_DEVICE_MODE   (S_IFCHR|S_IRUSR)
 
+/*
+ *  Vectored reads of physical memory from the /dev/crash driver,
+ *  version 1.6 and later.
+ */
+struct dev_crash_read_range {
+	ulonglong paddr;
+	ulonglong len;
+	ulonglong buf;
+};
+
+struct dev_crash_read_vec {
+	ulonglong nr_ranges;
+	ulonglong ranges;
+	ulonglong bytes_read;
+};
+
+#define DEV_CRASH_READ_VEC	_IOWR('c', 2, struct dev_crash_read_vec)
+#define DEV_CRASH_MAX_RANGES	(1024)
+
 /*
  *  structure definitions
  */
@@ -507,6 +527,8 @@ struct program_context {
 #define MM_STRUCT_FORCE (0x10000)
 #define CPUMASK         (0x20000)
 #define PARTIAL_READ_OK (0x40000)
+#define MOD_LAZY        (0x80000)
+#define MOD_THREADS    (0x100000)
 	ulonglong curcmd_private;	/* general purpose per-command info */
 	int cur_gdb_cmd;                /* current gdb command */
 	int last_gdb_cmd;               /* previously-executed gdb command */
@@ -558,6 +580,22 @@ struct program_context {
 #define MEMSRC_LOCAL         (0x80000ULL)
 #define REDZONE             (0x100000ULL)
 #define VMWARE_VMSS_GUESTDUMP (0x200000ULL)
+#define MMAP_DUMPFILE      (0x400000ULL)
+#define DATATYPE_CACHE     (0x800000ULL)
+#define INDEX_CACHE       (0x1000000ULL)
+#define BTF_TYPES         (0x2000000ULL)
+#define READMEM_PROFILE   (0x4000000ULL)
+#define STARTUP_TIMING    (0x8000000ULL)
+#define TRACE_SPANS      (0x10000000ULL)
+#define TRACING()        (pc->flags2 & TRACE_SPANS)
+#define SESSION_CACHE    (0x20000000ULL)
+#define PIPE_FILTER      (0x40000000ULL)
+#define BATCH_SESSION    (0x80000000ULL)
+
+#define OUTPUT_TEXT   (0)
+#define OUTPUT_JSON   (1)
+#define OUTPUT_CSV    (2)
+#define STRUCTURED_OUTPUT()  (pc->output_format != OUTPUT_TEXT)
 	char *cleanup;
 	char *namelist_orig;
 	char *namelist_debug_orig;
@@ -569,6 +607,10 @@ struct program_context {
 	char *(*read_vmcoreinfo)(const char *);
 	FILE *error_fp;			/* error() message direction */
 	char *error_path;		/* stderr path information */
+	char *index_cache_dir;		/* --index_cache directory */
+	int output_format;		/* "set output" */
+	int batch_jobs;			/* --batch sessions at a time */
+	char *batch_output;		/* --batch_output directory */
 };
 
 #define READMEM  pc->readmem
@@ -612,6 +654,7 @@ struct extension_table {
 #define REGISTERED              (0x1)      /* extension_table flags */
 #define DUPLICATE_COMMAND_NAME  (0x2)
 #define NO_MINIMAL_COMMANDS     (0x4)
+#define LAZY_LOAD               (0x8)      /* command stubs, not yet loaded */
 
 struct new_utsname {
         char sysname[65];
@@ -878,6 +921,9 @@ struct task_table {                      /* kernel/local task table data */
 	int callbacks;
 	struct task_context **context_by_task; /* task_context sorted by task addr */
 	ulong pid_xarray;
+	uint *context_task_hash;	/* context_array index + 1, by task addr */
+	uint *context_pid_hash;		/* context_array index + 1, by pid */
+	ulong context_hash_size;
 };
 
 #define TASK_INIT_DONE       (0x1)
@@ -1065,6 +1111,8 @@ struct machdep_table {
         void (*show_interrupts)(int, ulong *);
 	int (*is_page_ptr)(ulong, physaddr_t *);
 	int (*get_cpu_reg)(int, int, const char *, int, void *);
+	void (*cache_save)(void);
+	int (*vtop_extent)(struct task_context *, ulong, int, physaddr_t *, ulong *);
 };
 
 /*
@@ -1179,6 +1227,7 @@ extern struct machdep_table *machdep;
 #define FOREACH_F_FLAG2 (0x10000000)
 #define FOREACH_y_FLAG  (0x20000000)
 #define FOREACH_GLEADER (0x40000000)
+#define FOREACH_U_FLAG  (0x80000000)
 
 #define FOREACH_PS_EXCLUSIVE \
   (FOREACH_g_FLAG|FOREACH_a_FLAG|FOREACH_t_FLAG|FOREACH_c_FLAG|FOREACH_p_FLAG|FOREACH_l_FLAG|FOREACH_r_FLAG|FOREACH_m_FLAG)
@@ -1203,6 +1252,7 @@ struct foreach_data {
 	int args;
 	int regexs;
 	int policy;
+	int threads;
 };
 
 struct reference {       
@@ -1215,6 +1265,27 @@ struct reference {
 	void *refp;
 };
 
+/*
+ *  A task's open file descriptors, as walked by open_task_fds() and
+ *  next_task_fd().  The fd[] array is read TASK_FDS_CHUNK pointers at a
+ *  time, and only where the open_fds bitmap has bits set.
+ */
+#define TASK_FDS_CHUNK (512)
+
+struct task_fds {
+	ulong files_struct;
+	ulong fdtable;
+	int max_fdset;
+	int max_fds;
+	ulong fd;		/* address of the fd[] array */
+	ulong *open_fds;	/* copy of the open_fds bitmap */
+	long limit;		/* fd numbers covered by open_fds */
+	long next;
+	ulong *files;		/* TASK_FDS_CHUNK entries of fd[] */
+	long files_base;
+	long files_count;
+};
+
 struct offset_table {                    /* stash of commonly-used offsets */
 	long list_head_next;             /* add new entries to end of table */
 	long list_head_prev;
@@ -2181,6 +2252,49 @@ struct offset_table {                    /* stash of commonly-used offsets */
 	long blk_mq_tags_nr_reserved_tags;
 	long blk_mq_tags_rqs;
 	long request_queue_hctx_table;
+	long vm_struct_caller;
+	long maple_tree_ma_root;
+	long maple_node_slot;
+	long maple_node_mr64;
+	long maple_node_ma64;
+	long maple_range_64_pivot;
+	long maple_range_64_slot;
+	long maple_arange_64_pivot;
+	long maple_arange_64_slot;
+	long mm_struct_mm_mt;
+	long printk_info_facility;
+	long log_facility;
+	long log_caller_id;
+	long address_space_host;
+	long inode_i_dentry;
+	long dentry_d_alias;
+	long sock_common_skc_state;
+	long net_list;
+	long bpf_array_elem_size;
+	long bpf_array_value;
+	long bpf_array_pptrs;
+	long bpf_htab_buckets;
+	long bpf_htab_n_buckets;
+	long bpf_htab_elem_size;
+	long htab_elem_hash_node;
+	long htab_elem_key;
+	long hlist_nulls_head_first;
+	long hlist_nulls_node_next;
+	long mem_cgroup_css;
+	long mem_cgroup_memory;
+	long mem_cgroup_swap;
+	long mem_cgroup_memsw;
+	long mem_cgroup_vmstats;
+	long mem_cgroup_vmstats_percpu;
+	long mem_cgroup_nodeinfo;
+	long memcg_vmstats_state;
+	long memcg_vmstats_percpu_state;
+	long memcg_vmstats_percpu_state_prev;
+	long mem_cgroup_per_node_lru_zone_size;
+	long page_counter_usage;
+	long page_counter_max;
+	long cgroup_subsys_state_children;
+	long cgroup_subsys_state_sibling;
 };
 
 struct size_table {         /* stash of commonly-used sizes */
@@ -2351,6 +2465,13 @@ struct size_table {         /* stash of commonly-used sizes */
 	long sbitmap_queue;
 	long sbq_wait_state;
 	long blk_mq_tags;
+	long maple_tree;
+	long maple_node;
+	long bucket;
+	long mem_cgroup;
+	long memcg_vmstats_state;
+	long memcg_vmstats_percpu_state;
+	long mem_cgroup_per_node_lru_zone_size;
 };
 
 struct array_table {
@@ -2580,6 +2701,10 @@ struct vm_table {                /* kernel VM-related data */
 		char *name;
 	} *pageflags_data;
 	ulong max_mem_section_nr;
+	ulong **mem_section_maps;	/* section_mem_map of each section, by root */
+	ulong mem_section_cmdgen;
+	ulong mem_section_memo_nr;	/* section last found by nr_to_section() */
+	ulong mem_section_memo_addr;
 };
 
 #define NODES                       (0x1)
@@ -2771,7 +2896,7 @@ struct downsized {
 #define SYMVAL_HASH_INDEX(vaddr) \
         (((vaddr) >> machdep->pageshift) % SYMVAL_HASH)
 
-#define SYMNAME_HASH (512)
+#define SYMNAME_HASH (512)	/* minimum symname_hash buckets, a power of 2 */
 
 #define PATCH_KERNEL_SYMBOLS_START  ((char *)(1))
 #define PATCH_KERNEL_SYMBOLS_STOP   ((char *)(2))
@@ -2796,7 +2921,8 @@ struct symbol_table_data {
         } symval_hash[SYMVAL_HASH];
         double val_hash_searches;
         double val_hash_iterations;
-        struct syment *symname_hash[SYMNAME_HASH];
+        struct syment **symname_hash;
+        uint symname_hash_size;
 	struct symbol_namespace kernel_namespace;
 	struct syment *ext_module_symtable;
 	struct syment *ext_module_symend;
@@ -2823,7 +2949,13 @@ struct symbol_table_data {
 	ulong kaiser_init_vmlinux;
 	int kernel_symbol_type;
 	ulong linux_banner_vmlinux;
-	struct syment *mod_symname_hash[SYMNAME_HASH];
+	struct syment **mod_symname_hash;
+	uint mod_symname_hash_size;
+	ulong mod_symname_hash_count;
+	ulong *symval_array;		/* symtable values, if sorted */
+	ulong value_search_memo_hits;
+	ulong value_search_memo_misses;
+	long lazy_modules;		/* modules with MOD_LAZY_SYMS set */
 };
 
 /* flags for st */
@@ -2865,6 +2997,9 @@ struct symbol_table_data {
 #define MOD_NOPATCH    (0x20)
 #define MOD_INIT       (0x40)
 #define MOD_DO_READNOW (0x80)
+#define MOD_LAZY_SYMS     (0x100)
+#define MOD_LAZY_SECTIONS (0x200)
+#define MOD_LAZY_READNOW  (0x400)
 
 #define SEC_FOUND       (0x10000)
 
@@ -2914,6 +3049,7 @@ struct load_module {
 	ulong mod_percpu;
 	ulong mod_percpu_size;
 	struct objfile *loaded_objfile;
+	char *mod_lazy_namelist;	/* deferred "mod -S -L" object file */
 };
 
 #define IN_MODULE(A,L) \
@@ -2938,6 +3074,14 @@ struct load_module {
 
 #define USE_USER_PGD       (UVADDR << 2)
 
+/*
+ *  vtop_vector() and ptov_vector() status values.
+ */
+#define VTOP_VEC_MAPPED    (0)
+#define VTOP_VEC_UNMAPPED  (1)
+#define VTOP_VEC_AMBIGUOUS (2)
+#define VTOP_VEC_INVALID   (3)
+
 #define VERIFY_ADDR        (0x8)   /* vm_area_dump() flags -- must follow */
 #define PRINT_INODES      (0x10)   /* KVADDR, UVADDR, and PHYSADDR */
 #define PRINT_MM_STRUCT   (0x20)
@@ -3242,6 +3386,7 @@ typedef signed int s32;
 #define PTE_SHARED      (3UL << 8)         /* SH[1:0], inner shareable */
 #define PTE_AF          (1UL << 10)        /* Access Flag */
 #define PTE_NG          (1UL << 11)        /* nG */
+#define PTE_CONT        (1UL << 52)        /* Contiguous range */
 #define PTE_PXN         (1UL << 53)        /* Privileged XN */
 #define PTE_UXN         (1UL << 54)        /* User XN */
 
@@ -4958,6 +5103,7 @@ extern long _ZOMBIE_;
 #define PS_SUMMARY    (0x40000)
 #define PS_POLICY     (0x80000)
 #define PS_ACTIVE    (0x100000)
+#define PS_SORT      (0x200000)
 
 #define PS_EXCLUSIVE (PS_TGID_LIST|PS_ARGV_ENVP|PS_TIMES|PS_CHILD_LIST|PS_PPID_LIST|PS_LAST_RUN|PS_RLIMIT|PS_MSECS|PS_SUMMARY|PS_ACTIVE)
 
@@ -4976,8 +5122,19 @@ struct psinfo {
 	int regexs;
 	ulong *cpus;
 	int policy;
+	int sort_by;			/* PS_SORT_RSS or PS_SORT_VSZ */
+	int threads;
+	int sort_count;
+	struct ps_sort_entry {
+		struct task_context *tc;
+		ulong value;
+		int seq;
+	} *sort_list;
 };
 
+#define PS_SORT_RSS    (1)
+#define PS_SORT_VSZ    (2)
+
 #define IS_A_NUMBER(X)      (decimal(X, 0) || hexadecimal(X, 0))
 #define AMBIGUOUS_NUMBER(X) (decimal(X, 0) && hexadecimal(X, 0))
 
@@ -5027,6 +5184,8 @@ void cmd_quit(void);         /* main.c */
 void cmd_mach(void);         /* main.c */
 void cmd_help(void);         /* help.c */
 void cmd_test(void);         /* test.c */
+void cmd_bench(void);        /* bench.c */
+void cmd_memcg(void);        /* memcg.c */
 void cmd_ascii(void);        /* tools.c */
 void cmd_sbitmapq(void);     /* sbitmap.c */
 void cmd_bpf(void);          /* bfp.c */
@@ -5048,6 +5207,8 @@ void cmd_kmem(void);         /* memory.c */
 void cmd_search(void);       /* memory.c */
 void cmd_swap(void);         /* memory.c */
 void cmd_pte(void);          /* memory.c */
+void cmd_rmap(void);         /* memory.c */
+void cmd_ucore(void);        /* memory.c */
 void cmd_ps(void);           /* task.c */
 void cmd_task(void);         /* task.c */
 void cmd_foreach(void);      /* task.c */
@@ -5086,6 +5247,16 @@ void cmd_ipcs(void);         /* ipcs.c */
 void main_loop(void);
 void exec_command(void);
 struct command_table_entry *get_command_table_entry(char *);
+struct startup_phase {
+	char *name;
+	ulonglong usecs;
+	ulonglong cpu_usecs;
+	ulong reads;		/* readmem() calls, if --timing */
+	ulonglong bytes;
+};
+#define MAX_STARTUP_PHASES (24)
+void startup_phase(char *);
+int get_startup_phases(struct startup_phase **);
 void program_usage(int);
 #define LONG_FORM  (1)
 #define SHORT_FORM (0)
@@ -5205,6 +5376,7 @@ ulong dtol(char *, int, int *);
 unsigned int dtoi(char *, int, int *);
 ulong stol(char *, int, int *);
 ulonglong stoll(char *, int, int *);
+ulonglong sizetoll(char *, int, int *);
 ulonglong htoll(char *, int, int *);
 ulonglong dtoll(char *, int, int *);
 int decimal(char *, int);
@@ -5231,6 +5403,8 @@ struct radix_tree_ops {
 		      ulong index, void *private);
 	uint radix;
 	void *private;
+	ulong first;		/* only visit entries at first..last */
+	ulong last;
 };
 int do_radix_tree_traverse(ulong ptr, int is_root, struct radix_tree_ops *ops);
 struct xarray_ops {
@@ -5238,8 +5412,20 @@ struct xarray_ops {
 		      ulong index, void *private);
 	uint radix;
 	void *private;
+	ulong first;		/* only visit entries at first..last */
+	ulong last;
 };
 int do_xarray_traverse(ulong ptr, int is_root, struct xarray_ops *ops);
+struct maple_tree_ops {
+	void (*entry)(ulong node, ulong slot, const char *path,
+		      ulong first, ulong last, void *private);
+	uint radix;
+	void *private;
+	ulong first;		/* only visit entries overlapping first..last */
+	ulong last;
+};
+int do_maple_tree_traverse(ulong ptr, int is_root, struct maple_tree_ops *ops);
+int do_mptree(struct tree_data *);
 int do_rdtree(struct tree_data *);
 int do_rbtree(struct tree_data *);
 int do_xatree(struct tree_data *);
@@ -5259,6 +5445,8 @@ char *ordinal(ulong, char *);
 char *first_nonspace(char *);
 void dump_hash_table(int);
 void dump_shared_bufs(void);
+ulonglong hq_memory_used(void);
+ulonglong getbuf_memory_used(void);
 void drop_core(char *);
 int extract_hex(char *, ulong *, char, ulong);
 int count_bits_int(int);
@@ -5305,6 +5493,33 @@ struct rb_node *rb_right(struct rb_node *, struct rb_node *);
 struct rb_node *rb_left(struct rb_node *, struct rb_node *);
 struct rb_node *rb_next(struct rb_node *);
 struct rb_node *rb_last(struct rb_root *);
+#define MAX_PARALLEL_THREADS (64)
+void run_parallel(int, int, void (*)(void *, int, int), void *);
+int run_forked(int, int, void (*)(void *, int), void *);
+int trace_open(char *);
+void trace_close(void);
+ulonglong trace_time(void);
+void trace_span(char *, char *, char *, ulonglong);
+void trace_flush(void);
+void trace_set_min_usecs(ulong);
+ulong trace_min_usecs(void);
+char *trace_path(void);
+int set_output_format(char *);
+char *output_format_name(void);
+void record_begin(char *);
+void record_string(char *, char *);
+void record_long(char *, long);
+void record_ulong(char *, ulong);
+void record_hex(char *, ulong);
+void record_double(char *, double);
+void record_bool(char *, int);
+void record_end(void);
+int vmcoreinfo_table_init(const char *, size_t);
+char *vmcoreinfo_table_read_string(const char *);
+long vmcoreinfo_read_integer(const char *, long);
+#define FORKED_SERIAL  (0)
+#define FORKED_DONE    (1)
+#define FORKED_BAILOUT (2)
 
 /* 
  *  symbols.c 
@@ -5390,12 +5605,21 @@ int is_module_address(ulong, char *);
 ulong lowest_module_address(void);
 ulong highest_module_address(void);
 int load_module_symbols(char *, char *, ulong);
+void defer_module_symbols(struct load_module *, char *);
+int load_lazy_module_symbols(ulong);
 void delete_load_module(ulong);
 ulong gdb_load_module_callback(ulong, char *);
 char *load_module_filter(char *, int);
 #define LM_P_FILTER   (1)
 #define LM_DIS_FILTER (2)
 long datatype_info(char *, char *, struct datatype_member *);
+void datatype_cache_save(void);
+int get_build_id(struct bfd *, char *, int);
+void datatype_cache_invalidate(void);
+void line_number_cache_invalidate(void);
+ulonglong symbol_table_memory_used(void);
+ulonglong datatype_cache_memory_used(void);
+ulonglong line_number_cache_memory_used(void);
 int get_symbol_type(char *, char *, struct gnu_request *);
 int get_symbol_length(char *);
 void dump_numargs_cache(void);
@@ -5426,12 +5650,89 @@ int is_downsized(char *);
 int is_string(char *, char *);
 struct syment *symbol_complete_match(const char *, struct syment *);
 
+/*
+ *  Per-thread context for readmem_ctx(), which reads physical memory
+ *  from threads other than the one running the command.  The dumpfile
+ *  reader that supports it fills in its read_page() function and keeps
+ *  its scratch buffers and lookup state here instead of in globals.
+ */
+struct readmem_context {
+	int (*read_page)(struct readmem_context *, physaddr_t, char *, int);
+	void (*cleanup)(struct readmem_context *);
+	char *scratch;
+	void *private;
+	void *hint;
+	ulong reads;
+	ulong errors;
+	char errmsg[BUFSIZE];
+};
+
+/*
+ *  A request passed to readmem_batch(), which sets result to TRUE if
+ *  size bytes at addr were read into buffer.
+ */
+struct readmem_request {
+	ulonglong addr;
+	int memtype;
+	void *buffer;
+	long size;
+	char *type;
+	int result;
+};
+
+/*
+ *  A physically contiguous extent of a virtual address range, as
+ *  returned by vtop_range().
+ */
+struct vtop_extent {
+	ulong vaddr;
+	physaddr_t paddr;
+	ulong length;
+};
+
 /*  
  *  memory.c 
  */
 void mem_init(void);
 void vm_init(void);
 int readmem(ulonglong, int, void *, long, char *, ulong);
+void readmem_profile_start(void);
+void readmem_profile_report(void);
+struct readmem_profile_totals {
+	ulong reads;
+	ulonglong bytes;
+	ulong failures;
+	ulong backend_calls;
+	ulonglong backend_usecs;
+};
+void readmem_profile_stop(struct readmem_profile_totals *);
+void readmem_profile_get(struct readmem_profile_totals *);
+int readmem_batch(struct readmem_request *, int, ulong);
+struct readmem_context *readmem_context_alloc(void);
+void readmem_context_free(struct readmem_context *);
+int readmem_ctx(struct readmem_context *, physaddr_t, void *, long);
+int page_cache_read_ctx(struct readmem_context *, physaddr_t, void *, int);
+void page_cache_flush(void);
+void page_cache_prefill(physaddr_t, void *);
+void page_cache_set_size(ulonglong);
+void page_cache_set_live(int);
+#define LIVE_CACHE_OFF      (0)
+#define LIVE_CACHE_COMMAND  (-1)
+int page_cache_live(void);
+ulonglong page_cache_size(void);
+void dump_page_cache(void);
+void vtop_cache_flush(void);
+void vtop_cache_set(int);
+int vtop_cache_enabled(void);
+void dump_vtop_cache(void);
+ulonglong memory_limit_cap(ulonglong);
+int memory_limit_reserve(ulong);
+void memory_limit_check(void);
+void memory_limit_set(ulonglong);
+ulonglong memory_limit_size(void);
+void dump_memory_accounts(void);
+void slab_index_flush(void);
+void dump_slab_index(void);
 int writemem(ulonglong, int, void *, long, char *, ulong);
 int generic_verify_paddr(uint64_t);
 int read_dev_mem(int, void *, int, ulong, physaddr_t);
@@ -5447,6 +5748,10 @@ int write_daemon(int, void *, int, ulong, physaddr_t);
 int kvtop(struct task_context *, ulong, physaddr_t *, int);
 int uvtop(struct task_context *, ulong, physaddr_t *, int);
 void do_vtop(ulong, struct task_context *, ulong);
+int vtop_vector(struct task_context *, ulong, int, ulong *, physaddr_t *, int *);
+int ptov_vector(int, physaddr_t *, ulong *, int *);
+int vtop_range(struct task_context *, int, ulong *, ulong, struct vtop_extent *, int);
+void rmap_index_annotate(physaddr_t);
 void raw_stack_dump(ulong, ulong);
 void raw_data_dump(ulong, long, int);
 int accessible(ulong);
@@ -5460,6 +5765,7 @@ int is_page_ptr(ulong, physaddr_t *);
 void dump_vm_table(int);
 int read_string(ulong, char *, int);
 void get_task_mem_usage(ulong, struct task_mem_usage *);
+int cache_task_mem_usage(int);
 char *get_memory_size(char *);
 uint64_t generic_memory_size(void);
 char *swap_location(ulonglong, char *); 
@@ -5473,6 +5779,15 @@ int phys_to_page(physaddr_t, ulong *);
 int generic_get_kvaddr_ranges(struct vaddr_range *);
 int l1_cache_size(void);
 int dumpfile_memory(int);
+void mem_map_cache_set_size(ulong);
+ulong mem_map_cache_size(void);
+struct mapping_pages {
+	ulong mapping;
+	ulong pages;
+};
+int page_cache_mapping_counts(struct mapping_pages **, ulong *);
+int dumpfile_next_present(physaddr_t, physaddr_t *);
+int dumpfile_page_present(physaddr_t);
 #define DUMPFILE_MEM_USED    (1)
 #define DUMPFILE_FREE_MEM    (2)
 #define DUMPFILE_MEM_DUMP    (3)
@@ -5482,6 +5797,8 @@ int generic_is_kvaddr(ulong);
 int generic_is_uvaddr(ulong, struct task_context *);
 void fill_stackbuf(struct bt_info *);
 void alter_stackbuf(struct bt_info *);
+int read_stack_window(ulong, char *, long, char *, ulong, int);
+void stack_window_flush(void);
 int vaddr_type(ulong, struct task_context *);
 char *format_stack_entry(struct bt_info *bt, char *, ulong, ulong);
 int in_user_stack(ulong, ulong);
@@ -5500,12 +5817,17 @@ int file_exists(char *, struct stat *);
 int file_readable(char *);
 int is_directory(char *);
 char *search_directory_tree(char *, char *, int);
+void directory_index_start(void);
+void directory_index_flush(void);
 void open_tmpfile(void);
 void close_tmpfile(void);
 void open_tmpfile2(void);
 void set_tmpfile2(FILE *);
 void close_tmpfile2(void);
 void open_files_dump(ulong, int, struct reference *);
+int open_task_fds(ulong, struct task_fds *);
+int next_task_fd(struct task_fds *, ulong *);
+void close_task_fds(struct task_fds *);
 void get_pathname(ulong, char *, int, int, ulong);
 ulong *get_mount_list(int *, struct task_context *);
 char *vfsmount_devname(ulong, char *, int);
@@ -5554,7 +5876,9 @@ int file_dump(ulong, ulong, ulong, int, int);
 #define DUMP_DENTRY_ONLY    0x4
 #define DUMP_EMPTY_FILE     0x8
 #define DUMP_FILE_NRPAGES  0x10
+#define DUMP_FILE_RECORD   0x20
 int same_file(char *, char *);
+char *mmap_dumpfile(int, off_t *);
 int cleanup_memory_driver(void);
 
 
@@ -5640,9 +5964,13 @@ extern char *help_ptov[];
 extern char *help_quit[];
 extern char *help_rd[];
 extern char *help_repeat[];
+extern char *help_rmap[];
+extern char *help_ucore[];
 extern char *help_runq[];
 extern char *help_ipcs[];
 extern char *help_sbitmapq[];
+extern char *help_bench[];
+extern char *help_memcg[];
 extern char *help_search[];
 extern char *help_set[];
 extern char *help_sig[];
@@ -5711,6 +6039,7 @@ char *fill_mm_struct(ulong);
 #define IS_LAST_MM_READ(mm)     ((ulong)(mm) == tt->last_mm_read)
 void do_task(ulong, ulong, struct reference *, unsigned int);
 void clear_task_cache(void);
+ulonglong task_table_memory_used(void);
 int get_active_set(void);
 void clear_active_set(void);
 void do_sig(ulong, ulong, struct reference *);
@@ -5759,6 +6088,8 @@ void display_sys_stats(void);
 char *get_uptime(char *, ulonglong *);
 void clone_bt_info(struct bt_info *, struct bt_info *, struct task_context *);
 void dump_kernel_table(int);
+void dis_cache_invalidate(void);
+ulonglong dis_cache_memory_used(void);
 void dump_bt_info(struct bt_info *, char *where);
 void dump_log(int);
 #define LOG_LEVEL(v) ((v) & 0x07)
@@ -5768,6 +6099,8 @@ void dump_log(int);
 #define SHOW_LOG_AUDIT (0x8)
 #define SHOW_LOG_CTIME (0x10)
 #define SHOW_LOG_SAFE  (0x20)
+#define SHOW_LOG_FILTER (0x40)
+int log_filter_match(ulonglong, int, int, uint, int, char *, int);
 void set_cpu(int);
 void clear_machdep_cache(void);
 struct stack_hook *gather_text_list(struct bt_info *);
@@ -5777,6 +6110,8 @@ int get_cpus_present(void);
 int get_cpus_possible(void);
 int check_offline_cpu(int);
 int hide_offline_cpu(int);
+int percpu_gather(ulong, long, void *, ulong);
+#define PERCPU_CACHED    (0x80000000)	/* percpu_gather() flag */
 int get_highest_cpu_online(void);
 int get_highest_cpu_present(void);
 int get_cpus_to_display(void);
@@ -5882,6 +6217,7 @@ struct remote_file {
 ulonglong xen_m2p(ulonglong);
 
 void read_in_kernel_config(int);
+void ikconfig_preload(void);
 
 #define IKCFG_INIT   (0)
 #define IKCFG_READ   (1)
@@ -5928,9 +6264,15 @@ struct sbitmap_context {
 };
 
 typedef bool (*sbitmap_for_each_fn)(unsigned int idx, void *p);
+typedef bool (*sbitmap_for_each_batch_fn)(const unsigned int *idx,
+	unsigned int nr, void *p);
+
+#define SBITMAP_BATCH_SIZE (256)
 
 void sbitmap_for_each_set(const struct sbitmap_context *sc,
 	sbitmap_for_each_fn fn, void *data);
+void sbitmap_for_each_set_batch(const struct sbitmap_context *sc,
+	sbitmap_for_each_batch_fn fn, void *data);
 void sbitmap_context_load(ulong addr, struct sbitmap_context *sc);
 
 /* sbitmap_queue helpers */
@@ -6711,12 +7053,14 @@ FILE *set_netdump_fp(FILE *);
 int netdump_memory_dump(FILE *);
 void get_netdump_regs(struct bt_info *, ulong *, ulong *);
 int is_partial_netdump(void);
+int netdump_next_present(physaddr_t, physaddr_t *);
 void get_netdump_regs_x86(struct bt_info *, ulong *, ulong *);
 void get_netdump_regs_x86_64(struct bt_info *, ulong *, ulong *);
 void dump_registers_for_elf_dumpfiles(void);
 struct vmcore_data;
 struct vmcore_data *get_kdump_vmcore_data(void);
 int read_kdump(int, void *, int, ulong, physaddr_t);
+int netdump_readmem_context_init(struct readmem_context *);
 int write_kdump(int, void *, int, ulong, physaddr_t);
 int is_kdump(char *, ulong);
 int kdump_init(char *, FILE *);
@@ -6777,6 +7121,7 @@ int is_ramdump_image(void);
 int is_diskdump(char *);
 uint diskdump_page_size(void);
 int read_diskdump(int, void *, int, ulong, physaddr_t);
+int diskdump_readmem_context_init(struct readmem_context *);
 int write_diskdump(int, void *, int, ulong, physaddr_t);
 int diskdump_free_memory(void);
 int diskdump_memory_used(void);
@@ -6805,9 +7150,20 @@ int diskdump_get_nr_cpus(void);
 QEMUCPUState *diskdump_get_qemucpustate(int);
 void diskdump_device_dump_info(FILE *);
 void diskdump_device_dump_extract(int, char *, FILE *);
+void diskdump_set_cache_size(ulonglong);
+ulonglong diskdump_cache_size(void);
+void diskdump_cache_resize(void);
+ulonglong diskdump_cache_memory_used(void);
+void diskdump_set_readahead(ulong);
+ulong diskdump_readahead(void);
+int diskdump_next_present(physaddr_t, physaddr_t *);
+int diskdump_dumped_pages(ulong *, ulong *);
 ulong readswap(ulonglong pte_val, char *buf, ulong len, ulonglong vaddr);
 /*support for zram*/
 ulong try_zram_decompress(ulonglong pte_val, unsigned char *buf, ulong len, ulonglong vaddr);
+void dump_zram_cache_stats(void);
+ulonglong zram_cache_memory_used(void);
+void zram_cache_release(void);
 #define OBJ_TAG_BITS     1
 #ifndef MAX_POSSIBLE_PHYSMEM_BITS
 #define MAX_POSSIBLE_PHYSMEM_BITS (MAX_PHYSMEM_BITS())
@@ -6823,6 +7179,8 @@ ulong try_zram_decompress(ulonglong pte_val, unsigned char *buf, ulong len, ulon
 #define SECTORS_PER_PAGE        (1 << SECTORS_PER_PAGE_SHIFT)
 #define ZRAM_FLAG_SHIFT         (1<<24)
 #define ZRAM_FLAG_SAME_BIT      (1<<25)
+#define ZRAM_CACHE_PAGES        (256)	/* decompressed swap pages */
+#define ZRAM_SWAP_TYPES         (32)	/* cached swap device lookups */
 struct zspage {
     struct {
         unsigned int fullness : 2;
@@ -6914,6 +7272,7 @@ int sadump_phys_base(ulong *);
 int sadump_set_phys_base(ulong);
 void sadump_show_diskset(void);
 int sadump_is_zero_excluded(void);
+int sadump_next_present(physaddr_t, physaddr_t *);
 void sadump_set_zero_excluded(void);
 void sadump_unset_zero_excluded(void);
 struct sadump_data;
@@ -6959,6 +7318,7 @@ void remote_exit(void);
 int remote_execute(void);
 void remote_clear_pipeline(void);
 int remote_memory_read(int, char *, int, physaddr_t, int);
+int remote_memory_readahead(int, char *, physaddr_t);
 
 /*
  * vmware_vmss.c
@@ -6978,6 +7338,7 @@ int vmware_vmss_get_cr3_cr4_idtr(int, ulong *, ulong *, ulong *);
 int vmware_vmss_phys_base(ulong *phys_base);
 int vmware_vmss_set_phys_base(ulong);
 int vmware_vmss_get_cpu_reg(int, int, const char *, int, void *);
+void vmware_vmss_map_memory(void);
 
 /*
  * vmware_guestdump.c
@@ -6990,12 +7351,33 @@ int vmware_guestdump_memory_dump(FILE *);
  * kaslr_helper.c
  */
 int calc_kaslr_offset(ulong *, ulong *);
+void dump_kaslr_steps(void);
 
 /*
  * printk.c
  */
 void dump_lockless_record_log(int);
 
+/*
+ * session.c
+ */
+void *session_cache_get(char *, ulong *);
+void session_cache_put(char *, void *, ulong);
+void session_cache_save(void);
+void dump_session_cache(void);
+
+/*
+ * batch.c
+ */
+void batch_dumpfiles(char **);
+
+/*
+ * btf.c
+ */
+int btf_datatype_info(char *, char *, struct gnu_request *);
+int btf_print_datatype(char *, ulong);
+void dump_btf_info(void);
+
 /*
  *  gnu_binutils.c
  */
@@ -4287,37 +4287,37 @@ use_mq_interface(unsigned long q)
 		return 1;
 }
 
+/*
+ * mctx is the part of a blk_mq_ctx, starting at offset base, that holds
+ * both the rq_dispatched and rq_completed counters.
+ */
 static void
-get_one_mctx_diskio(unsigned long mctx, struct diskio *io)
+get_one_mctx_diskio(char *mctx, long base, struct diskio *io)
 {
-	unsigned long dispatch[2];
-	unsigned long comp[2];
+	unsigned long *dispatch, *comp;
 
-	readmem(mctx + OFFSET(blk_mq_ctx_rq_dispatched),
-		KVADDR, dispatch, sizeof(ulong) * 2, "blk_mq_ctx.rq_dispatched",
-		FAULT_ON_ERROR);
-
-	readmem(mctx + OFFSET(blk_mq_ctx_rq_completed),
-		KVADDR, comp, sizeof(ulong) * 2, "blk_mq_ctx.rq_completed",
-		FAULT_ON_ERROR);
+	dispatch = (ulong *)(mctx + OFFSET(blk_mq_ctx_rq_dispatched) - base);
+	comp = (ulong *)(mctx + OFFSET(blk_mq_ctx_rq_completed) - base);
 
 	io->read = (dispatch[0] - comp[0]);
 	io->write = (dispatch[1] - comp[1]);
 }
 
-typedef bool (busy_tag_iter_fn)(ulong rq, void *data);
-
 struct mq_inflight {
 	ulong q;
 	struct diskio *dio;
+	char *rqbuf;	/* leading part of a request */
+	long rqlen;
 };
 
-struct bt_iter_data {
-	ulong tags;
-	uint reserved;
-	uint nr_reserved_tags;
-	busy_tag_iter_fn *fn;
-	void *data;
+/*
+ * The busy tags of one sbitmap_queue, as gathered by
+ * sbitmap_for_each_set_batch().
+ */
+struct bt_busy_tags {
+	uint *bitnrs;
+	uint count;
+	uint max;
 };
 
 /*
@@ -4335,23 +4335,19 @@ static uint op_is_write(uint op)
 static bool mq_check_inflight(ulong rq, void *data)
 {
 	uint cmd_flags = 0, state = 0;
-	ulong addr = 0, queue = 0;
+	ulong queue = 0;
 	struct mq_inflight *mi = data;
 
 	if (!IS_KVADDR(rq))
 		return TRUE;
 
-	addr = rq + OFFSET(request_q);
-	if (!readmem(addr, KVADDR, &queue, sizeof(ulong), "request.q", RETURN_ON_ERROR))
-		return FALSE;
-
-	addr = rq + OFFSET(request_cmd_flags);
-	if (!readmem(addr, KVADDR, &cmd_flags, sizeof(uint), "request.cmd_flags", RETURN_ON_ERROR))
+	/* request.q, request.cmd_flags and request.state */
+	if (!readmem(rq, KVADDR, mi->rqbuf, mi->rqlen, "request", RETURN_ON_ERROR))
 		return FALSE;
 
-	addr = rq + OFFSET(request_state);
-	if (!readmem(addr, KVADDR, &state, sizeof(uint), "request.state", RETURN_ON_ERROR))
-		return FALSE;
+	queue = ULONG(mi->rqbuf + OFFSET(request_q));
+	cmd_flags = UINT(mi->rqbuf + OFFSET(request_cmd_flags));
+	state = UINT(mi->rqbuf + OFFSET(request_state));
 
 	if (queue == mi->q && state == MQ_RQ_IN_FLIGHT) {
 		if (op_is_write(cmd_flags))
@@ -4363,27 +4359,24 @@ static bool mq_check_inflight(ulong rq, void *data)
 	return TRUE;
 }
 
-static bool bt_iter(uint bitnr, void *data)
+static bool bt_gather(const uint *bitnrs, uint nr, void *data)
 {
-	ulong addr = 0, rqs_addr = 0, rq = 0;
-	struct bt_iter_data *iter_data = data;
-	ulong tag = iter_data->tags;
+	struct bt_busy_tags *bt = data;
 
-	if (!iter_data->reserved)
-		bitnr += iter_data->nr_reserved_tags;
+	if (bt->count + nr > bt->max)
+		nr = bt->max - bt->count;
 
-	/* rqs */
-	addr = tag + OFFSET(blk_mq_tags_rqs);
-	if (!readmem(addr, KVADDR, &rqs_addr, sizeof(void *), "blk_mq_tags.rqs", RETURN_ON_ERROR))
-		return FALSE;
-
-	addr = rqs_addr + bitnr * sizeof(ulong); /* rqs[bitnr] */
-	if (!readmem(addr, KVADDR, &rq, sizeof(ulong), "blk_mq_tags.rqs[]", RETURN_ON_ERROR))
-		return FALSE;
+	BCOPY(bitnrs, bt->bitnrs + bt->count, sizeof(uint) * nr);
+	bt->count += nr;
 
-	return iter_data->fn(rq, iter_data->data);
+	return bt->count < bt->max;
 }
 
+/*
+ * Gather the busy tags from the sbitmap words first, and then read the
+ * blk_mq_tags.rqs[] entries that they index with a single readmem(),
+ * rather than reading blk_mq_tags.rqs and one rqs[] entry per busy tag.
+ */
 static void bt_for_each(ulong q, ulong tags, ulong sbq, uint reserved, uint nr_resvd_tags, struct diskio *dio)
 {
 	struct sbitmap_context sc = {0};
@@ -4391,25 +4384,69 @@ static void bt_for_each(ulong q, ulong tags, ulong sbq, uint reserved, uint nr_r
 		.q = q,
 		.dio = dio,
 	};
-	struct bt_iter_data iter_data = {
-		.tags = tags,
-		.reserved = reserved,
-		.nr_reserved_tags = nr_resvd_tags,
-		.fn = mq_check_inflight,
-		.data = &mi,
-	};
+	struct bt_busy_tags bt = {0};
+	ulong rqs_addr = 0, *rqs = NULL;
+	uint i, first, last, bitnr;
 
 	sbitmap_context_load(sbq + OFFSET(sbitmap_queue_sb), &sc);
-	sbitmap_for_each_set(&sc, bt_iter, &iter_data);
+	if (!sc.depth)
+		return;
+
+	bt.bitnrs = (uint *)GETBUF(sizeof(uint) * sc.depth);
+	bt.max = sc.depth;
+	sbitmap_for_each_set_batch(&sc, bt_gather, &bt);
+	if (!bt.count)
+		goto out;
+
+	if (!reserved) {
+		for (i = 0; i < bt.count; i++)
+			bt.bitnrs[i] += nr_resvd_tags;
+	}
+
+	for (i = 0, first = last = bt.bitnrs[0]; i < bt.count; i++) {
+		first = MIN(first, bt.bitnrs[i]);
+		last = MAX(last, bt.bitnrs[i]);
+	}
+
+	/* rqs */
+	if (!readmem(tags + OFFSET(blk_mq_tags_rqs), KVADDR, &rqs_addr,
+	    sizeof(void *), "blk_mq_tags.rqs", RETURN_ON_ERROR))
+		goto out;
+
+	/* rqs[first] through rqs[last] */
+	rqs = (ulong *)GETBUF(sizeof(ulong) * (last - first + 1));
+	if (!readmem(rqs_addr + first * sizeof(ulong), KVADDR, rqs,
+	    sizeof(ulong) * (last - first + 1), "blk_mq_tags.rqs[]",
+	    RETURN_ON_ERROR))
+		goto out;
+
+	mi.rqlen = MAX(OFFSET(request_q) + sizeof(ulong),
+		OFFSET(request_cmd_flags) + sizeof(uint));
+	mi.rqlen = MAX(mi.rqlen, OFFSET(request_state) + sizeof(uint));
+	mi.rqbuf = GETBUF(mi.rqlen);
+
+	for (i = 0; i < bt.count; i++) {
+		bitnr = bt.bitnrs[i];
+		if (!mq_check_inflight(rqs[bitnr - first], &mi))
+			break;
+	}
+
+out:
+	if (mi.rqbuf)
+		FREEBUF(mi.rqbuf);
+	if (rqs)
+		FREEBUF(rqs);
+	FREEBUF(bt.bitnrs);
 }
 
 static void queue_for_each_hw_ctx(ulong q, ulong *hctx, uint cnt, struct diskio *dio)
 {
 	uint i;
-	int bitmap_tags_is_ptr = 0;
+	static int bitmap_tags_is_ptr = -1;
 
-	if (MEMBER_TYPE("blk_mq_tags", "bitmap_tags") == TYPE_CODE_PTR)
-		bitmap_tags_is_ptr = 1;
+	if (bitmap_tags_is_ptr < 0)
+		bitmap_tags_is_ptr = (MEMBER_TYPE("blk_mq_tags", "bitmap_tags") ==
+			TYPE_CODE_PTR);
 
 	for (i = 0; i < cnt; i++) {
 		ulong addr = 0, tags = 0;
@@ -4499,7 +4536,8 @@ get_mq_diskio(unsigned long q, unsigned long *mq_count)
 {
 	int cpu;
 	unsigned long queue_ctx;
-	unsigned long mctx_addr;
+	long base, size;
+	char *mctx;
 	struct diskio tmp = {0};
 
 	/*
@@ -4523,32 +4561,44 @@ get_mq_diskio(unsigned long q, unsigned long *mq_count)
 		sizeof(ulong), "request_queue.queue_ctx",
 		FAULT_ON_ERROR);
 
+	if (!((kt->flags & SMP) && (kt->flags & PER_CPU_OFF)))
+		return;
+
+	/*
+	 * Gather the span of each cpu's blk_mq_ctx that contains both
+	 * counters, for all cpus at once.
+	 */
+	base = MIN(OFFSET(blk_mq_ctx_rq_dispatched),
+		OFFSET(blk_mq_ctx_rq_completed));
+	size = MAX(OFFSET(blk_mq_ctx_rq_dispatched),
+		OFFSET(blk_mq_ctx_rq_completed)) + sizeof(ulong) * 2 - base;
+	mctx = GETBUF(size * kt->cpus);
+	percpu_gather(queue_ctx + base, size, mctx, FAULT_ON_ERROR);
+
 	for (cpu = 0; cpu < kt->cpus; cpu++) {
-		if ((kt->flags & SMP) && (kt->flags & PER_CPU_OFF)) {
-			mctx_addr = queue_ctx + kt->__per_cpu_offset[cpu];
-			get_one_mctx_diskio(mctx_addr, &tmp);
-			mq_count[0] += tmp.read;
-			mq_count[1] += tmp.write;
-		}
+		get_one_mctx_diskio(mctx + size * cpu, base, &tmp);
+		mq_count[0] += tmp.read;
+		mq_count[1] += tmp.write;
 	}
+
+	FREEBUF(mctx);
 }
 
 static void
 get_one_diskio_from_dkstats(unsigned long dkstats, unsigned long *count)
 {
 	int cpu;
-	unsigned long dkstats_addr;
-	unsigned long in_flight[2];
+	unsigned long in_flight[kt->cpus][2];
+
+	if (!((kt->flags & SMP) && (kt->flags & PER_CPU_OFF)))
+		return;
+
+	percpu_gather(dkstats + OFFSET(disk_stats_in_flight),
+		sizeof(long) * 2, in_flight, FAULT_ON_ERROR);
 
 	for (cpu = 0; cpu < kt->cpus; cpu++) {
-		if ((kt->flags & SMP) && (kt->flags & PER_CPU_OFF)) {
-			dkstats_addr = dkstats + kt->__per_cpu_offset[cpu];
-			readmem(dkstats_addr + OFFSET(disk_stats_in_flight),
-				KVADDR, in_flight, sizeof(long) * 2,
-				"disk_stats.in_flight", FAULT_ON_ERROR);
-			count[0] += in_flight[0];
-			count[1] += in_flight[1];
-		}
+		count[0] += in_flight[cpu][0];
+		count[1] += in_flight[cpu][1];
 	}
 }
 
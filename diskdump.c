@@ -27,8 +27,10 @@
 #include "diskdump.h"
 #include "xen_dom0.h"
 #include "vmcore.h"
+#include <pthread.h>
 
 #define BITMAP_SECT_LEN	4096
+#define DUMPABLE_BLOCK_LEN	512	/* pfns per block_rank[] entry */
 
 struct diskdump_data {
 	char *filename;
@@ -68,13 +70,50 @@ struct diskdump_data {
 		uint64_t pg_addr;
 		char *pg_bufptr;
 		ulong pg_hit_count;
-	} page_cache_hdr[DISKDUMP_CACHED_PAGES];
+		struct page_cache_hdr *pg_hash_next;	/* hash chain */
+		struct page_cache_hdr *pg_lru_prev;	/* toward MRU */
+		struct page_cache_hdr *pg_lru_next;	/* toward LRU */
+	} *page_cache_hdr;
+	int	page_cache_pages;	/* number of page_cache_hdr entries */
+	struct page_cache_hdr **page_cache_hash;
+	int	page_cache_hash_size;	/* power of 2 */
+	struct page_cache_hdr *lru_head;	/* most recently used */
+	struct page_cache_hdr *lru_tail;	/* next page to evict */
 	char	*page_cache_buf;	/* base of cached buffer pages */
-	int	evict_index;		/* next page to evict */
 	ulong	evictions;		/* total evictions done */
 	ulong	cached_reads;
+	ulong	decompressions;		/* pages uncompressed */
+	ulonglong decompress_usecs;	/* time spent uncompressing */
+	ulong	last_miss_pfn;		/* read-ahead sequence detection */
+	ulong	readahead_next_pfn;	/* first pfn past last read-ahead */
+	int	sequential_misses;
+	ulong	readahead_window;	/* size of readahead_buf in pages */
+	char	*readahead_buf;		/* compressed data of read-ahead pages */
+	void	*readahead_jobs;	/* struct readahead_job array */
+	ulong	readaheads;		/* read-ahead batches done */
+	ulong	readahead_pages;	/* pages cached by read-ahead */
+	ulong	readahead_hits;		/* read-ahead pages later accessed */
+
+	/* page descriptor cache */
+	struct pd_cache_section {
+		ulong pd_sect;		/* valid_pages[] index + 1, 0 if unused */
+		ulong pd_count;		/* descriptors in the section */
+		ulong pd_last_used;
+		page_desc_t *pd_array;
+	} pd_cache[DISKDUMP_PD_CACHE_SECTIONS];
+	ulong	pd_cache_clock;
+	ulong	pd_cache_hits;
+	ulong	pd_cache_loads;
+
+	/* page data read buffer */
+	char	*databuf;
+	off_t	databuf_offset;
+	ssize_t	databuf_len;
+	ulong	databuf_hits;
+	ulong	databuf_reads;
 	ulong  *valid_pages;
 	int     max_sect_len;           /* highest bucket of valid_pages */
+	ushort *block_rank;		/* dumpable pages before each block */
 	ulong   accesses;
 	ulong	snapshot_task;
 };
@@ -82,6 +121,12 @@ struct diskdump_data {
 static struct diskdump_data diskdump_data = { 0 };
 static struct diskdump_data *dd = &diskdump_data;
 
+/*
+ *  Requested page cache size in bytes, as set by "set diskdump_cache".
+ *  Zero means the DISKDUMP_CACHED_PAGES default.
+ */
+static ulonglong diskdump_cache_bytes = 0;
+
 ulong *diskdump_flags = &diskdump_data.flags;
 
 static int __diskdump_memory_dump(FILE *);
@@ -90,6 +135,10 @@ static void dump_note_offsets(FILE *);
 static char *vmcoreinfo_read_string(const char *);
 static void diskdump_get_osrelease(void);
 static int valid_note_address(unsigned char *);
+static void alloc_page_cache(struct diskdump_data *);
+static void free_page_cache(struct diskdump_data *);
+static ulong paddr_to_pfn(physaddr_t);
+static physaddr_t pfn_to_paddr(ulong);
 
 /* For split dumpfile */
 static struct diskdump_data **dd_list = NULL;
@@ -250,6 +299,71 @@ page_is_dumpable(unsigned long nr)
 	return dd->dumpable_bitmap[nr>>3] & (1 << (nr & 7));
 }
 
+/*
+ *  Returns 64 bits of a dumpfile bitmap starting at pfn (word << 6), with
+ *  the bit of the lowest pfn being the least significant bit.
+ */
+static inline ulonglong
+bitmap_word(char *map, ulong word)
+{
+	return le64toh(((ulonglong *)map)[word]);
+}
+
+/*
+ *  Count the bits set in a dumpfile bitmap for the pfns from start up to,
+ *  but not including, end, a 64-bit word at a time.
+ */
+static ulong
+count_bitmap_pfns(char *map, ulong start, ulong end)
+{
+	ulong count, word, last;
+	ulonglong bits;
+
+	if (start >= end)
+		return 0;
+
+	word = start >> 6;
+	last = (end - 1) >> 6;
+	bits = bitmap_word(map, word) & (~0ULL << (start & 63));
+
+	for (count = 0; word < last; bits = bitmap_word(map, ++word))
+		count += __builtin_popcountll(bits);
+
+	bits &= ~0ULL >> (63 - ((end - 1) & 63));
+	return count + __builtin_popcountll(bits);
+}
+
+/*
+ *  Find the first pfn from start up to, but not including, end whose bit
+ *  is set in a dumpfile bitmap, skipping the zero words of excluded runs.
+ */
+static int
+next_bitmap_pfn(char *map, ulong start, ulong end, ulong *next)
+{
+	ulong word, last, pfn;
+	ulonglong bits;
+
+	if (start >= end)
+		return FALSE;
+
+	word = start >> 6;
+	last = (end - 1) >> 6;
+	bits = bitmap_word(map, word) & (~0ULL << (start & 63));
+
+	while (!bits) {
+		if (++word > last)
+			return FALSE;
+		bits = bitmap_word(map, word);
+	}
+
+	pfn = (word << 6) + __builtin_ctzll(bits);
+	if (pfn >= end)
+		return FALSE;
+
+	*next = pfn;
+	return TRUE;
+}
+
 static inline int 
 dump_is_partial(const struct disk_dump_header *header)
 {
@@ -530,6 +644,115 @@ read_pd(int fd, off_t offset, page_desc_t *pd)
 	return 0;
 }
 
+/*
+ *  Read the page descriptor of pfn, whose position in the descriptor
+ *  table was calculated by pfn_to_pos().
+ *
+ *  The descriptors of all dumpable pages in a bitmap section are stored
+ *  contiguously, so on a miss the whole section's worth is read with a
+ *  single I/O request into one of DISKDUMP_PD_CACHE_SECTIONS slots, the
+ *  least recently used of which gets replaced.  If the section cannot be
+ *  read in its entirety, e.g. in a truncated dumpfile, fall back to
+ *  reading the single descriptor.
+ */
+static int
+read_pd_cached(ulong pfn, ulong desc_pos, page_desc_t *pd)
+{
+	int i;
+	ulong sect, index, count;
+	size_t size;
+	off_t offset;
+	struct pd_cache_section *pdc, *victim;
+
+	if (KDUMP_SPLIT())
+		sect = (pfn - dd->sub_header_kdump->start_pfn_64) / BITMAP_SECT_LEN;
+	else
+		sect = pfn / BITMAP_SECT_LEN;
+
+	offset = dd->data_offset + (off_t)(desc_pos - 1)*sizeof(page_desc_t);
+
+	if (sect >= dd->max_sect_len)
+		return read_pd(dd->dfd, offset, pd);
+
+	index = desc_pos - 1 - dd->valid_pages[sect];
+
+	for (i = 0, victim = NULL; i < DISKDUMP_PD_CACHE_SECTIONS; i++) {
+		pdc = &dd->pd_cache[i];
+		if (pdc->pd_sect == sect+1) {
+			dd->pd_cache_hits++;
+			goto found;
+		}
+		if (!victim || (pdc->pd_last_used < victim->pd_last_used))
+			victim = pdc;
+	}
+
+	pdc = victim;
+	if (!pdc->pd_array &&
+	    !(pdc->pd_array = malloc(BITMAP_SECT_LEN * sizeof(page_desc_t))))
+		return read_pd(dd->dfd, offset, pd);
+
+	count = dd->valid_pages[sect+1] - dd->valid_pages[sect];
+	size = count * sizeof(page_desc_t);
+	offset = dd->data_offset + (off_t)dd->valid_pages[sect]*sizeof(page_desc_t);
+	pdc->pd_sect = 0;
+
+	if (FLAT_FORMAT()) {
+		if (!read_flattened_format(dd->dfd, offset, pdc->pd_array, size))
+			goto fallback;
+	} else if (pread(dd->dfd, pdc->pd_array, size, offset) != size)
+		goto fallback;
+
+	pdc->pd_sect = sect+1;
+	pdc->pd_count = count;
+	dd->pd_cache_loads++;
+found:
+	pdc->pd_last_used = ++dd->pd_cache_clock;
+	if (index >= pdc->pd_count)
+		goto fallback;
+	*pd = pdc->pd_array[index];
+	return 0;
+
+fallback:
+	offset = dd->data_offset + (off_t)(desc_pos - 1)*sizeof(page_desc_t);
+	return read_pd(dd->dfd, offset, pd);
+}
+
+/*
+ *  Read page data that is not in flattened format.  The data of pages
+ *  that follow one another in the dumpfile is usually contiguous, so the
+ *  file is read in DISKDUMP_DATABUF_SIZE chunks, from which the requests
+ *  for adjacent pages are then satisfied without further I/O.
+ */
+static int
+read_page_data(off_t offset, char *buf, uint size)
+{
+	if (!dd->databuf &&
+	    !(dd->databuf = malloc(MAX(DISKDUMP_DATABUF_SIZE, dd->block_size)))) {
+		if (lseek(dd->dfd, offset, SEEK_SET) == (off_t)-1)
+			return SEEK_ERROR;
+		if (read(dd->dfd, buf, size) != size)
+			return READ_ERROR;
+		return 0;
+	}
+
+	if ((offset >= dd->databuf_offset) &&
+	    (offset + size <= dd->databuf_offset + dd->databuf_len)) {
+		dd->databuf_hits++;
+	} else {
+		dd->databuf_len = pread(dd->dfd, dd->databuf,
+			MAX(DISKDUMP_DATABUF_SIZE, dd->block_size), offset);
+		dd->databuf_offset = offset;
+		dd->databuf_reads++;
+		if (dd->databuf_len < (ssize_t)size) {
+			dd->databuf_len = 0;
+			return READ_ERROR;
+		}
+	}
+
+	memcpy(buf, dd->databuf + (offset - dd->databuf_offset), size);
+	return 0;
+}
+
 static int 
 read_dump_header(char *file)
 {
@@ -541,10 +764,9 @@ read_dump_header(char *file)
 	int block_size = (int)sysconf(_SC_PAGESIZE);
 	off_t offset;
 	const off_t failed = (off_t)-1;
-	ulong pfn;
+	ulong pfn, limit;
 	int i, j, max_sect_len;
 	int is_split = 0;
-	ulonglong tmp, *bitmap;
 
 	if (block_size < 0)
 		return FALSE;
@@ -887,14 +1109,27 @@ restart:
 	dd->valid_pages = calloc(sizeof(ulong), max_sect_len + 1);
 	dd->max_sect_len = max_sect_len;
 
-	/* It is safe to convert it to (ulonglong *). */
-	bitmap = (ulonglong *)dd->dumpable_bitmap;
+	/*
+	 *  valid_pages[] holds the number of dumpable pages before each
+	 *  bitmap section, and block_rank[] the number of dumpable pages
+	 *  between the start of a section and each DUMPABLE_BLOCK_LEN block
+	 *  within it, so that pfn_to_pos() never has to count more than one
+	 *  block's worth of bits.
+	 */
+	dd->block_rank = calloc(sizeof(ushort),
+		max_sect_len * (BITMAP_SECT_LEN / DUMPABLE_BLOCK_LEN));
+	limit = (ulong)dd->bitmap_len * 8;
+
 	for (i = 1; i < max_sect_len + 1; i++) {
 		dd->valid_pages[i] = dd->valid_pages[i - 1];
-		for (j = 0; j < BITMAP_SECT_LEN; j += 64, pfn += 64) {
-			tmp = bitmap[pfn >> 6];
-			if (tmp)
-				dd->valid_pages[i] += hweight64(tmp);
+		for (j = 0; j < BITMAP_SECT_LEN; j += DUMPABLE_BLOCK_LEN,
+		     pfn += DUMPABLE_BLOCK_LEN) {
+			if (dd->block_rank)
+				dd->block_rank[(i - 1) * (BITMAP_SECT_LEN /
+				    DUMPABLE_BLOCK_LEN) + j / DUMPABLE_BLOCK_LEN] =
+					dd->valid_pages[i] - dd->valid_pages[i - 1];
+			dd->valid_pages[i] += count_bitmap_pfns(dd->dumpable_bitmap,
+				MIN(pfn, limit), MIN(pfn + DUMPABLE_BLOCK_LEN, limit));
 		}
 	}
 
@@ -933,26 +1168,96 @@ err:
 static ulong
 pfn_to_pos(ulong pfn)
 {
-	ulong desc_pos, j, valid;
-	ulong p1, p2;
+	ulong start, p1, p2;
 
-	if (KDUMP_SPLIT()) {
-		p1 = pfn - dd->sub_header_kdump->start_pfn_64;
-		p2 = round(p1, BITMAP_SECT_LEN)
-			+ dd->sub_header_kdump->start_pfn_64;
-	}
-	else {
-		p1 = pfn; 
-		p2 = round(pfn, BITMAP_SECT_LEN); 
+	start = KDUMP_SPLIT() ? dd->sub_header_kdump->start_pfn_64 : 0;
+	p1 = pfn - start;
+
+	if (dd->block_rank)
+		p2 = round(p1, DUMPABLE_BLOCK_LEN) + start;
+	else
+		p2 = round(p1, BITMAP_SECT_LEN) + start;
+
+	return dd->valid_pages[p1 / BITMAP_SECT_LEN] +
+		(dd->block_rank ? dd->block_rank[p1 / DUMPABLE_BLOCK_LEN] : 0) +
+		count_bitmap_pfns(dd->dumpable_bitmap, p2, pfn + 1);
+}
+
+/*
+ *  dumpfile_next_present() backend: find the first page at or above paddr
+ *  that was dumped, searching all dumpfiles of a split dump.  Returns
+ *  FALSE if there are no more dumpable pages.
+ */
+int
+diskdump_next_present(physaddr_t paddr, physaddr_t *nextpaddr)
+{
+	int i, found;
+	ulong pfn, start, end, p, next;
+	struct diskdump_data *d;
+
+	*nextpaddr = paddr;
+	if (XEN_CORE_DUMPFILE())
+		return TRUE;
+
+	pfn = paddr_to_pfn(paddr);
+	next = 0;
+
+	for (i = found = 0; i < MAX(num_dumpfiles, 1); i++) {
+		d = KDUMP_SPLIT() ? dd_list[i] : dd;
+		if (KDUMP_SPLIT()) {
+			start = d->sub_header_kdump->start_pfn_64;
+			end = d->sub_header_kdump->end_pfn_64;
+		} else {
+			start = 0;
+			end = d->max_mapnr;
+		}
+		end = MIN(end, (ulong)d->bitmap_len * 8);
+
+		if (next_bitmap_pfn(d->dumpable_bitmap, MAX(pfn, start), end, &p) &&
+		    (!found || (p < next))) {
+			next = p;
+			found = TRUE;
+		}
 	}
 
-	valid = dd->valid_pages[p1 / BITMAP_SECT_LEN];
+	if (found && (next > pfn))
+		*nextpaddr = pfn_to_paddr(next);
+
+	return found;
+}
+
+/*
+ *  For the "kmem -i" output of partial dumps, return the number of RAM
+ *  pages and the number of those pages that were actually dumped.
+ */
+int
+diskdump_dumped_pages(ulong *ram, ulong *dumped)
+{
+	int i;
+	ulong start, end;
+	struct diskdump_data *d;
+
+	if (!dd || !dd->header || !dump_is_partial(dd->header))
+		return FALSE;
+
+	*ram = *dumped = 0;
 
-	for (j = p2, desc_pos = valid; j <= pfn; j++)
-			if (page_is_dumpable(j))
-				desc_pos++;
+	for (i = 0; i < MAX(num_dumpfiles, 1); i++) {
+		d = KDUMP_SPLIT() ? dd_list[i] : dd;
+		if (KDUMP_SPLIT()) {
+			start = d->sub_header_kdump->start_pfn_64;
+			end = d->sub_header_kdump->end_pfn_64;
+		} else {
+			start = 0;
+			end = d->max_mapnr;
+		}
+		end = MIN(end, (ulong)d->bitmap_len * 4);
+
+		*ram += count_bitmap_pfns(d->bitmap, start, end);
+		*dumped += count_bitmap_pfns(d->dumpable_bitmap, start, end);
+	}
 
-	return desc_pos;
+	return TRUE;
 }
 
 
@@ -964,19 +1269,10 @@ pfn_to_pos(ulong pfn)
 int
 is_diskdump(char *file)
 {
-	int sz, i;
-
 	if (!open_dump_file(file) || !read_dump_header(file))
 		return FALSE;
 
-	sz = dd->block_size * (DISKDUMP_CACHED_PAGES);
-	if ((dd->page_cache_buf = malloc(sz)) == NULL)
-		error(FATAL, "%s: cannot malloc compressed page_cache_buf\n",
-			DISKDUMP_VALID() ? "diskdump" : "compressed kdump");
-
-	for (i = 0; i < DISKDUMP_CACHED_PAGES; i++)
-		dd->page_cache_hdr[i].pg_bufptr =
-			&dd->page_cache_buf[i * dd->block_size];
+	alloc_page_cache(dd);
 
 	if ((dd->compressed_page = (char *)malloc(dd->block_size)) == NULL)
 		error(FATAL, "%s: cannot malloc compressed page space\n",
@@ -1040,119 +1336,787 @@ diskdump_phys_base(unsigned long *phys_base)
 	return FALSE;
 }
 
-int
-diskdump_set_phys_base(unsigned long phys_base)
+int
+diskdump_set_phys_base(unsigned long phys_base)
+{
+	if (diskdump_kaslr_check()) {
+		dd->sub_header_kdump->phys_base = phys_base;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*
+ *  Page cache sizing and bookkeeping.
+ *
+ *  The cache consists of page_cache_pages block-sized buffers, each with
+ *  a page_cache_hdr that is linked into a hash chain keyed by its physical
+ *  address and into an LRU list.  Invalid (empty) entries are always kept
+ *  at the LRU tail so that they are consumed before any valid page gets
+ *  evicted.
+ */
+static int
+page_cache_pages_wanted(struct diskdump_data *ddp)
+{
+	ulonglong pages;
+
+	if (!diskdump_cache_bytes || !ddp->block_size)
+		return DISKDUMP_CACHED_PAGES;
+
+	pages = memory_limit_cap(diskdump_cache_bytes) / ddp->block_size;
+	if (pages < DISKDUMP_CACHED_PAGES)
+		pages = DISKDUMP_CACHED_PAGES;
+	if (pages > DISKDUMP_MAX_CACHED_PAGES)
+		pages = DISKDUMP_MAX_CACHED_PAGES;
+
+	return (int)pages;
+}
+
+static void
+alloc_page_cache(struct diskdump_data *ddp)
+{
+	int i, pages, hash_size;
+	struct page_cache_hdr *pgc;
+
+	pages = page_cache_pages_wanted(ddp);
+	for (hash_size = 1; hash_size < pages; hash_size <<= 1)
+		;
+
+	if ((ddp->page_cache_buf = malloc((size_t)ddp->block_size * pages)) == NULL)
+		error(FATAL, "%s: cannot malloc compressed page_cache_buf\n",
+			DISKDUMP_VALID() ? "diskdump" : "compressed kdump");
+	if ((ddp->page_cache_hdr = calloc(pages,
+	    sizeof(struct page_cache_hdr))) == NULL)
+		error(FATAL, "%s: cannot malloc page_cache_hdr array\n",
+			DISKDUMP_VALID() ? "diskdump" : "compressed kdump");
+	if ((ddp->page_cache_hash = calloc(hash_size,
+	    sizeof(struct page_cache_hdr *))) == NULL)
+		error(FATAL, "%s: cannot malloc page_cache_hash table\n",
+			DISKDUMP_VALID() ? "diskdump" : "compressed kdump");
+
+	ddp->page_cache_pages = pages;
+	ddp->page_cache_hash_size = hash_size;
+
+	for (i = 0; i < pages; i++) {
+		pgc = &ddp->page_cache_hdr[i];
+		pgc->pg_bufptr = &ddp->page_cache_buf[(size_t)i * ddp->block_size];
+		pgc->pg_lru_prev = i ? &ddp->page_cache_hdr[i-1] : NULL;
+		pgc->pg_lru_next = (i < pages-1) ? &ddp->page_cache_hdr[i+1] : NULL;
+	}
+	ddp->lru_head = &ddp->page_cache_hdr[0];
+	ddp->lru_tail = &ddp->page_cache_hdr[pages-1];
+	ddp->curbufptr = NULL;
+}
+
+static void
+free_page_cache(struct diskdump_data *ddp)
+{
+	free(ddp->page_cache_buf);
+	free(ddp->page_cache_hdr);
+	free(ddp->page_cache_hash);
+	ddp->page_cache_buf = NULL;
+	ddp->page_cache_hdr = NULL;
+	ddp->page_cache_hash = NULL;
+	ddp->lru_head = ddp->lru_tail = NULL;
+	ddp->page_cache_pages = ddp->page_cache_hash_size = 0;
+	ddp->curbufptr = NULL;
+}
+
+static inline struct page_cache_hdr **
+page_cache_bucket(physaddr_t paddr)
+{
+	uint64_t key = (uint64_t)paddr >> dd->block_shift;
+
+	/* Fibonacci hashing: spreads consecutive pfns across the table */
+	key *= 0x9e3779b97f4a7c15ULL;
+	return &dd->page_cache_hash[(key >> 32) & (dd->page_cache_hash_size-1)];
+}
+
+static void
+page_cache_unhash(struct page_cache_hdr *pgc)
+{
+	struct page_cache_hdr **pp;
+
+	for (pp = page_cache_bucket(pgc->pg_addr); *pp; pp = &(*pp)->pg_hash_next) {
+		if (*pp == pgc) {
+			*pp = pgc->pg_hash_next;
+			break;
+		}
+	}
+	pgc->pg_hash_next = NULL;
+}
+
+static void
+page_cache_lru_unlink(struct page_cache_hdr *pgc)
+{
+	if (pgc->pg_lru_prev)
+		pgc->pg_lru_prev->pg_lru_next = pgc->pg_lru_next;
+	else
+		dd->lru_head = pgc->pg_lru_next;
+	if (pgc->pg_lru_next)
+		pgc->pg_lru_next->pg_lru_prev = pgc->pg_lru_prev;
+	else
+		dd->lru_tail = pgc->pg_lru_prev;
+	pgc->pg_lru_prev = pgc->pg_lru_next = NULL;
+}
+
+static void
+page_cache_lru_make_head(struct page_cache_hdr *pgc)
+{
+	if (dd->lru_head == pgc)
+		return;
+
+	page_cache_lru_unlink(pgc);
+	pgc->pg_lru_next = dd->lru_head;
+	if (dd->lru_head)
+		dd->lru_head->pg_lru_prev = pgc;
+	dd->lru_head = pgc;
+	if (!dd->lru_tail)
+		dd->lru_tail = pgc;
+}
+
+static void
+page_cache_lru_make_tail(struct page_cache_hdr *pgc)
+{
+	if (dd->lru_tail == pgc)
+		return;
+
+	page_cache_lru_unlink(pgc);
+	pgc->pg_lru_prev = dd->lru_tail;
+	if (dd->lru_tail)
+		dd->lru_tail->pg_lru_next = pgc;
+	dd->lru_tail = pgc;
+	if (!dd->lru_head)
+		dd->lru_head = pgc;
+}
+
+/*
+ *  Handle "set diskdump_cache <size>".  The size is given in bytes, with an
+ *  optional K, M or G suffix, and is rounded down to a whole number of pages.
+ *  If a compressed dumpfile is already open, its cache is reallocated, which
+ *  discards any currently-cached pages.
+ */
+void
+diskdump_set_cache_size(ulonglong bytes)
+{
+	int i;
+	struct diskdump_data *ddp;
+
+	diskdump_cache_bytes = bytes;
+
+	if (!DISKDUMP_VALID() && !KDUMP_CMPRS_VALID())
+		return;
+
+	ddp = dd;
+	if (KDUMP_SPLIT() && (dd_list != NULL)) {
+		for (i = 0; i < num_dumpfiles; i++) {
+			dd = dd_list[i];
+			free_page_cache(dd);
+			alloc_page_cache(dd);
+		}
+		dd = ddp;
+	} else {
+		free_page_cache(dd);
+		alloc_page_cache(dd);
+	}
+}
+
+/*
+ *  Reallocate the page cache at the requested size, for "set memlimit".
+ */
+void
+diskdump_cache_resize(void)
+{
+	diskdump_set_cache_size(diskdump_cache_bytes);
+}
+
+/*
+ *  Return the page cache size in bytes: that of the open compressed
+ *  dumpfile if there is one, otherwise the requested size.
+ */
+ulonglong
+diskdump_cache_size(void)
+{
+	if (DISKDUMP_VALID() || KDUMP_CMPRS_VALID())
+		return (ulonglong)dd->page_cache_pages * dd->block_size;
+
+	return diskdump_cache_bytes;
+}
+
+/*
+ *  Check whether paddr is already cached.
+ */
+static int
+page_is_cached(physaddr_t paddr)
+{
+	struct page_cache_hdr *pgc;
+
+	dd->accesses++;
+
+	for (pgc = *page_cache_bucket(paddr); pgc; pgc = pgc->pg_hash_next) {
+		if (pgc->pg_addr == paddr) {
+			if (pgc->pg_flags & PAGE_READAHEAD) {
+				pgc->pg_flags &= ~PAGE_READAHEAD;
+				dd->readahead_hits++;
+			}
+			pgc->pg_hit_count++;
+			page_cache_lru_make_head(pgc);
+			dd->curbufptr = pgc->pg_bufptr;
+			dd->cached_reads++;
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/*
+ * Translate physical address in paddr to PFN number. This means normally that
+ * we just shift paddr by some constant. Some architectures need special
+ * handling for this, however.
+ */
+static ulong
+paddr_to_pfn(physaddr_t paddr)
+{
+#ifdef ARM
+	/*
+	 * In ARM, PFN 0 means first page in kernel direct-mapped view.
+	 * This is also first page in mem_map as well.
+	 */
+	return (paddr - machdep->machspec->phys_base) >> dd->block_shift;
+#else
+	return paddr >> dd->block_shift;
+#endif
+}
+
+/*
+ *  Uncompress one block of page data from inbuf into outbuf.  Returns 0 on
+ *  success, or -1 with a description of the failure in errmsg.
+ *
+ *  This function is also run by the read-ahead worker threads, so it must
+ *  not call error() or modify any shared state.  Each caller provides its
+ *  own ZSTD decompression context, which is created on first use.
+ */
+static int
+uncompress_block(uint pd_flags, char *inbuf, uint insize, char *outbuf,
+		 void **zstd_dctx, char *errmsg)
+{
+	int ret;
+	ulong retlen;
+	const int block_size = dd->block_size;
+
+	if (pd_flags & DUMP_DH_COMPRESSED_ZLIB) {
+		retlen = block_size;
+		ret = uncompress((unsigned char *)outbuf,
+		                 &retlen,
+		                 (unsigned char *)inbuf,
+		                 insize);
+		if ((ret != Z_OK) || (retlen != block_size)) {
+			sprintf(errmsg, "uncompress failed: %d", ret);
+			return -1;
+		}
+	} else if (pd_flags & DUMP_DH_COMPRESSED_LZO) {
+
+		if (!(dd->flags & LZO_SUPPORTED)) {
+			sprintf(errmsg, "uncompress failed: no lzo compression support");
+			return -1;
+		}
+
+#ifdef LZO
+		retlen = block_size;
+		ret = lzo1x_decompress_safe((unsigned char *)inbuf,
+					    insize,
+					    (unsigned char *)outbuf,
+					    &retlen,
+					    LZO1X_MEM_DECOMPRESS);
+		if ((ret != LZO_E_OK) || (retlen != block_size)) {
+			sprintf(errmsg, "uncompress failed: %d", ret);
+			return -1;
+		}
+#endif
+	} else if (pd_flags & DUMP_DH_COMPRESSED_SNAPPY) {
+
+		if (!(dd->flags & SNAPPY_SUPPORTED)) {
+			sprintf(errmsg, "uncompress failed: no snappy compression support");
+			return -1;
+		}
+
+#ifdef SNAPPY
+		ret = snappy_uncompressed_length(inbuf, insize, (size_t *)&retlen);
+		if (ret != SNAPPY_OK) {
+			sprintf(errmsg, "uncompress failed: %d", ret);
+			return -1;
+		}
+
+		ret = snappy_uncompress(inbuf, insize, outbuf, (size_t *)&retlen);
+		if ((ret != SNAPPY_OK) || (retlen != block_size)) {
+			sprintf(errmsg, "uncompress failed: %d", ret);
+			return -1;
+		}
+#endif
+	} else if (pd_flags & DUMP_DH_COMPRESSED_ZSTD) {
+
+		if (!(dd->flags & ZSTD_SUPPORTED)) {
+			sprintf(errmsg, "uncompess failed: no zstd compression support");
+			return -1;
+		}
+#ifdef ZSTD
+		if (!*zstd_dctx) {
+			*zstd_dctx = ZSTD_createDCtx();
+			if (!*zstd_dctx) {
+				sprintf(errmsg, "uncompess failed: cannot create ZSTD_DCtx");
+				return -1;
+			}
+		}
+
+		retlen = ZSTD_decompressDCtx((ZSTD_DCtx *)*zstd_dctx,
+				outbuf, block_size, inbuf, insize);
+		if (ZSTD_isError(retlen) || (retlen != block_size)) {
+			sprintf(errmsg, "uncompress failed: %d (%s)",
+				(int)retlen, ZSTD_getErrorName(retlen));
+			return -1;
+		}
+#endif
+	} else
+		memcpy(outbuf, inbuf, block_size);
+
+	return 0;
+}
+
+static physaddr_t
+pfn_to_paddr(ulong pfn)
+{
+#ifdef ARM
+	return ((physaddr_t)pfn << dd->block_shift) + machdep->machspec->phys_base;
+#else
+	return (physaddr_t)pfn << dd->block_shift;
+#endif
+}
+
+/*
+ *  readmem_ctx() reader for compressed kdumps.  This is read_diskdump()
+ *  and cache_page() without the page cache, reading the dumpfile with
+ *  pread() into the context's own buffers so that it can run in any
+ *  thread.  Split and flattened dumpfiles are not supported, since both
+ *  depend on state that changes with every read.
+ */
+static int
+diskdump_read_page_ctx(struct readmem_context *ctx, physaddr_t paddr,
+		       char *bufptr, int cnt)
+{
+	ulong pfn, desc_pos, page_offset;
+	off_t offset;
+	page_desc_t pd;
+	char *inbuf, *outbuf;
+
+	pfn = paddr_to_pfn(paddr);
+	page_offset = paddr & ((physaddr_t)(dd->block_size-1));
+
+	if ((pfn >= dd->max_mapnr) || !page_is_ram(pfn))
+		return SEEK_ERROR;
+
+	if (!page_is_dumpable(pfn)) {
+		if ((dd->flags & (ZERO_EXCLUDED|ERROR_EXCLUDED)) ==
+		    ERROR_EXCLUDED)
+			return PAGE_EXCLUDED;
+		memset(bufptr, 0, cnt);
+		return cnt;
+	}
+
+	desc_pos = pfn_to_pos(pfn);
+	offset = dd->data_offset + (off_t)(desc_pos - 1)*sizeof(page_desc_t);
+	if (pread(dd->dfd, &pd, sizeof(pd), offset) != sizeof(pd))
+		return READ_ERROR;
+
+	if (pd.size > dd->block_size)
+		return READ_ERROR;
+
+	if (0 == pd.offset) {
+		if (!(*diskdump_flags & ZERO_EXCLUDED))
+			return PAGE_INCOMPLETE;
+		memset(bufptr, 0, cnt);
+		return cnt;
+	}
+
+	inbuf = ctx->scratch;
+	outbuf = ctx->scratch + dd->block_size;
+
+	if (pread(dd->dfd, inbuf, pd.size, pd.offset) != pd.size)
+		return READ_ERROR;
+
+	if (uncompress_block(pd.flags, inbuf, pd.size, outbuf,
+	    &ctx->private, ctx->errmsg) < 0)
+		return READ_ERROR;
+
+	memcpy(bufptr, outbuf + page_offset, cnt);
+	return cnt;
+}
+
+static void
+diskdump_readmem_context_cleanup(struct readmem_context *ctx)
+{
+#ifdef ZSTD
+	if (ctx->private)
+		ZSTD_freeDCtx((ZSTD_DCtx *)ctx->private);
+#endif
+	ctx->private = NULL;
+}
+
+int
+diskdump_readmem_context_init(struct readmem_context *ctx)
+{
+	if (!dd || KDUMP_SPLIT() || FLAT_FORMAT() || XEN_CORE_DUMPFILE())
+		return FALSE;
+
+	if ((ctx->scratch = malloc(dd->block_size * 2)) == NULL)
+		return FALSE;
+
+	ctx->read_page = diskdump_read_page_ctx;
+	ctx->cleanup = diskdump_readmem_context_cleanup;
+	return TRUE;
+}
+
+/*
+ *  Read-ahead decompression.
+ *
+ *  When cache_page() sees misses on consecutive pfns, the descriptors and
+ *  compressed data of the next diskdump_readahead dumpable pages are read in
+ *  by the main thread, and the pages are then uncompressed directly into
+ *  their page cache entries by a pool of worker threads, with the main
+ *  thread taking a share of the work.  The batch is complete before the
+ *  read-ahead returns, so the page cache itself is never accessed
+ *  concurrently.
+ */
+#define DISKDUMP_MAX_READAHEAD_THREADS	(32)
+#define DISKDUMP_SEQUENTIAL_MISSES	(2)
+
+struct readahead_job {
+	char *inbuf;
+	char *outbuf;
+	uint size;
+	uint flags;
+	int status;
+	char errmsg[80];
+};
+
+static struct readahead_pool {
+	int nthreads;
+	pthread_t *threads;
+	pthread_mutex_t lock;
+	pthread_cond_t work_cv;
+	pthread_cond_t done_cv;
+	struct readahead_job *jobs;
+	int njobs;
+	int next;		/* next job to be claimed */
+	int remaining;		/* jobs not yet completed */
+	ulong generation;	/* bumped when a new batch is posted */
+} readahead_pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.work_cv = PTHREAD_COND_INITIALIZER,
+	.done_cv = PTHREAD_COND_INITIALIZER,
+};
+
+static ulong diskdump_readahead_pages = 0;
+
+/*
+ *  Claim and run jobs from the current batch until none are left.
+ *  Called and returns with the pool lock held.
+ */
+static void
+readahead_run_jobs(struct readahead_pool *pool, void **zstd_dctx)
+{
+	struct readahead_job *job;
+
+	while (pool->next < pool->njobs) {
+		job = &pool->jobs[pool->next++];
+		pthread_mutex_unlock(&pool->lock);
+		job->status = uncompress_block(job->flags, job->inbuf,
+			job->size, job->outbuf, zstd_dctx, job->errmsg);
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->remaining == 0)
+			pthread_cond_signal(&pool->done_cv);
+	}
+}
+
+static void *
+readahead_worker(void *arg)
+{
+	struct readahead_pool *pool = arg;
+	ulong seen = 0;
+	void *zstd_dctx = NULL;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (pool->generation == seen)
+			pthread_cond_wait(&pool->work_cv, &pool->lock);
+		seen = pool->generation;
+		readahead_run_jobs(pool, &zstd_dctx);
+	}
+
+	return NULL;
+}
+
+/*
+ *  Start the worker threads on first use.  The workers block all signals
+ *  so that SIGINT and friends are always delivered to the main thread.
+ */
+static void
+readahead_pool_init(struct readahead_pool *pool)
+{
+	int i;
+	long cpus;
+	sigset_t all, saved;
+
+	if (pool->threads)
+		return;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus > DISKDUMP_MAX_READAHEAD_THREADS)
+		cpus = DISKDUMP_MAX_READAHEAD_THREADS;
+	if (cpus <= 1) {
+		pool->nthreads = 0;
+		return;
+	}
+
+	if ((pool->threads = calloc(cpus - 1, sizeof(pthread_t))) == NULL) {
+		error(INFO, "cannot malloc read-ahead thread array\n");
+		return;
+	}
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &saved);
+	for (i = 0; i < cpus - 1; i++) {
+		if (pthread_create(&pool->threads[i], NULL,
+		    readahead_worker, pool))
+			break;
+	}
+	pthread_sigmask(SIG_SETMASK, &saved, NULL);
+
+	pool->nthreads = i;
+
+	if (CRASHDEBUG(1))
+		fprintf(fp, "diskdump: %d read-ahead worker threads\n",
+			pool->nthreads);
+}
+
+/*
+ *  Uncompress a batch of jobs, using the worker threads if there are any.
+ */
+static void
+readahead_run_batch(struct readahead_job *jobs, int njobs)
+{
+	struct readahead_pool *pool = &readahead_pool;
+	static void *zstd_dctx = NULL;
+
+	readahead_pool_init(pool);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->jobs = jobs;
+	pool->njobs = njobs;
+	pool->next = 0;
+	pool->remaining = njobs;
+	pool->generation++;
+	if (pool->nthreads)
+		pthread_cond_broadcast(&pool->work_cv);
+
+	readahead_run_jobs(pool, &zstd_dctx);
+
+	while (pool->remaining)
+		pthread_cond_wait(&pool->done_cv, &pool->lock);
+	pool->jobs = NULL;
+	pool->njobs = 0;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ *  Handle "set diskdump_readahead <pages>".  Zero turns read-ahead off.
+ */
+void
+diskdump_set_readahead(ulong pages)
+{
+	diskdump_readahead_pages = pages;
+}
+
+ulong
+diskdump_readahead(void)
 {
-	if (diskdump_kaslr_check()) {
-		dd->sub_header_kdump->phys_base = phys_base;
-		return TRUE;
-	}
-
-	return FALSE;
+	return diskdump_readahead_pages;
 }
 
 /*
- *  Check whether paddr is already cached.
+ *  Read ahead the dumpable pages following pfn that are not already
+ *  cached.  The window is limited to half of the page cache so that the
+ *  page that triggered the read-ahead cannot be evicted by it.  Any page
+ *  that cannot be read ahead for whatever reason is simply skipped, to be
+ *  handled -- and have its errors reported -- by a subsequent cache_page().
  */
-static int
-page_is_cached(physaddr_t paddr)
+static void
+readahead_batch(ulong pfn)
 {
-	int i;
-	struct page_cache_hdr *pgc;
+	ulong p, end, window, desc_pos;
+	int i, njobs;
+	page_desc_t pd;
+	physaddr_t paddr;
+	struct page_cache_hdr *pgc, **pp;
+	struct readahead_job *job;
+	struct timespec ts_start, ts_end;
+	ulonglong tstart;
+	const int block_size = dd->block_size;
 
-	dd->accesses++;
+	window = MIN(diskdump_readahead_pages, dd->page_cache_pages/2);
+	if (!window)
+		return;
+
+	if (dd->readahead_window < window) {
+		free(dd->readahead_buf);
+		free(dd->readahead_jobs);
+		dd->readahead_buf = malloc((size_t)window * block_size);
+		dd->readahead_jobs = calloc(window, sizeof(struct readahead_job));
+		if (!dd->readahead_buf || !dd->readahead_jobs) {
+			free(dd->readahead_buf);
+			free(dd->readahead_jobs);
+			dd->readahead_buf = NULL;
+			dd->readahead_jobs = NULL;
+			dd->readahead_window = 0;
+			return;
+		}
+		dd->readahead_window = window;
+	}
 
-	for (i = 0; i < DISKDUMP_CACHED_PAGES; i++) {
+	end = pfn + window;
+	if (end > dd->max_mapnr)
+		end = dd->max_mapnr;
+	if (KDUMP_SPLIT() && (end > dd->sub_header_kdump->end_pfn_64))
+		end = dd->sub_header_kdump->end_pfn_64;
 
-		pgc = &dd->page_cache_hdr[i];
+	for (p = pfn, njobs = 0; p < end; p++) {
+		if (!page_is_ram(p) || !page_is_dumpable(p))
+			continue;
 
-		if (!DISKDUMP_VALID_PAGE(pgc->pg_flags))
+		paddr = pfn_to_paddr(p);
+		for (pgc = *page_cache_bucket(paddr); pgc; pgc = pgc->pg_hash_next)
+			if (pgc->pg_addr == paddr)
+				break;
+		if (pgc)
 			continue;
 
-		if (pgc->pg_addr == paddr) {
-			pgc->pg_hit_count++;
-			dd->curbufptr = pgc->pg_bufptr;
-			dd->cached_reads++;
-			return TRUE;
+		desc_pos = pfn_to_pos(p);
+		if (read_pd_cached(p, desc_pos, &pd))
+			break;
+		if ((pd.size > block_size) || (pd.offset == 0))
+			continue;
+
+		job = (struct readahead_job *)dd->readahead_jobs + njobs;
+		job->inbuf = dd->readahead_buf + (size_t)njobs * block_size;
+		if (FLAT_FORMAT()) {
+			if (!read_flattened_format(dd->dfd, pd.offset,
+			    job->inbuf, pd.size))
+				break;
+		} else if (read_page_data(pd.offset, job->inbuf, pd.size))
+			break;
+
+		/*
+		 *  Claim the LRU entry now; it is moved to the head of the
+		 *  list so that the next job claims a different one, but is
+		 *  not hashed until its data is valid.
+		 */
+		pgc = dd->lru_tail;
+		if (DISKDUMP_VALID_PAGE(pgc->pg_flags)) {
+			page_cache_unhash(pgc);
+			dd->evictions++;
 		}
+		pgc->pg_flags = 0;
+		pgc->pg_addr = paddr;
+		pgc->pg_hit_count = 0;
+		page_cache_lru_make_head(pgc);
+
+		job->outbuf = pgc->pg_bufptr;
+		job->size = pd.size;
+		job->flags = pd.flags;
+		job->status = 0;
+		njobs++;
 	}
-	return FALSE;
-}
 
-/*
- * Translate physical address in paddr to PFN number. This means normally that
- * we just shift paddr by some constant. Some architectures need special
- * handling for this, however.
- */
-static ulong
-paddr_to_pfn(physaddr_t paddr)
-{
-#ifdef ARM
-	/*
-	 * In ARM, PFN 0 means first page in kernel direct-mapped view.
-	 * This is also first page in mem_map as well.
-	 */
-	return (paddr - machdep->machspec->phys_base) >> dd->block_shift;
-#else
-	return paddr >> dd->block_shift;
-#endif
+	if (!njobs)
+		return;
+
+	tstart = TRACING() ? trace_time() : 0;
+	clock_gettime(CLOCK_MONOTONIC, &ts_start);
+	readahead_run_batch(dd->readahead_jobs, njobs);
+	clock_gettime(CLOCK_MONOTONIC, &ts_end);
+	trace_span("decompress", "readahead_run_batch", NULL, tstart);
+	dd->decompress_usecs +=
+		(ulonglong)(ts_end.tv_sec - ts_start.tv_sec) * 1000000 +
+		(ts_end.tv_nsec - ts_start.tv_nsec) / 1000;
+
+	dd->readaheads++;
+
+	for (i = 0; i < njobs; i++) {
+		job = (struct readahead_job *)dd->readahead_jobs + i;
+		pgc = &dd->page_cache_hdr[(job->outbuf - dd->page_cache_buf) /
+			block_size];
+		if (job->status < 0) {
+			if (CRASHDEBUG(8))
+				fprintf(fp, "read_diskdump/readahead_batch: "
+				    "%llx: %s\n", (ulonglong)pgc->pg_addr,
+					job->errmsg);
+			page_cache_lru_make_tail(pgc);
+			continue;
+		}
+		if (job->flags & DUMP_DH_COMPRESSED)
+			dd->decompressions++;
+		pgc->pg_flags |= (PAGE_VALID|PAGE_READAHEAD);
+		pp = page_cache_bucket(pgc->pg_addr);
+		pgc->pg_hash_next = *pp;
+		*pp = pgc;
+		dd->readahead_pages++;
+	}
 }
 
 /*
  *  Cache the page's data.
  *
- *  If an empty page cache location is available, take it.  Otherwise, evict
- *  the entry indexed by evict_index, and then bump evict index.  The hit_count
- *  is only gathered for dump_diskdump_environment().
+ *  Take the entry at the tail of the LRU list, which is either an empty
+ *  page cache location or the least recently used page, which is evicted.
+ *  The hit_count is only gathered for dump_diskdump_environment().
  *
  *  If the page is compressed, uncompress it into the selected page cache entry.
  *  If the page is raw, just copy it into the selected page cache entry.
  *  If all works OK, update diskdump->curbufptr to point to the page's
- *  uncompressed data.
+ *  uncompressed data.  Finally, if this miss continues a sequential run
+ *  of misses, read ahead the pages that follow it.
  */
 static int
 cache_page(physaddr_t paddr)
 {
-	int i, ret;
-	int found;
+	int ret;
 	ulong pfn;
 	ulong desc_pos;
-	off_t seek_offset;
 	page_desc_t pd;
 	const int block_size = dd->block_size;
-	const off_t failed = (off_t)-1;
-	ulong retlen;
-#ifdef ZSTD
-	static ZSTD_DCtx *dctx = NULL;
-#endif
-
-	for (i = found = 0; i < DISKDUMP_CACHED_PAGES; i++) {
-		if (DISKDUMP_VALID_PAGE(dd->page_cache_hdr[i].pg_flags))
-			continue;
-		found = TRUE;
-		break;
-	}
-
-	if (!found) {
-		i = dd->evict_index;
-		dd->page_cache_hdr[i].pg_hit_count = 0;
-		dd->evict_index =
-			(dd->evict_index+1) % DISKDUMP_CACHED_PAGES;
+	struct page_cache_hdr *pgc;
+	struct timespec ts_start, ts_end;
+	ulonglong tstart;
+	char errmsg[80];
+	static void *zstd_dctx = NULL;
+
+	pgc = dd->lru_tail;
+	if (DISKDUMP_VALID_PAGE(pgc->pg_flags)) {
+		page_cache_unhash(pgc);
+		pgc->pg_hit_count = 0;
 		dd->evictions++;
 	}
 
-	dd->page_cache_hdr[i].pg_flags = 0;
-	dd->page_cache_hdr[i].pg_addr = paddr;
-	dd->page_cache_hdr[i].pg_hit_count++;
+	pgc->pg_flags = 0;
+	pgc->pg_addr = paddr;
+	pgc->pg_hit_count++;
 
 	/* find page descriptor */
 	pfn = paddr_to_pfn(paddr);
 	desc_pos = pfn_to_pos(pfn);
-	seek_offset = dd->data_offset
-			+ (off_t)(desc_pos - 1)*sizeof(page_desc_t);
 
 	/* read page descriptor */
-	ret = read_pd(dd->dfd, seek_offset, &pd);
+	ret = read_pd_cached(pfn, desc_pos, &pd);
 	if (ret)
 		return ret;
 
@@ -1170,9 +2134,9 @@ cache_page(physaddr_t paddr)
 		 */
 		if (*diskdump_flags & ZERO_EXCLUDED) {
 			if (CRASHDEBUG(8))
-				fprintf(fp, 
+				fprintf(fp,
 			    	    "read_diskdump/cache_page: zero-fill: "
-				    "paddr/pfn: %llx/%lx\n", 
+				    "paddr/pfn: %llx/%lx\n",
 					(ulonglong)paddr, pfn);
 			memset(dd->compressed_page, 0, dd->block_size);
 		} else {
@@ -1184,108 +2148,53 @@ cache_page(physaddr_t paddr)
 					(ulonglong)paddr, pfn, desc_pos);
 			return PAGE_INCOMPLETE;
 		}
-	} else {
-		if (lseek(dd->dfd, pd.offset, SEEK_SET) == failed)
-			return SEEK_ERROR;
-		if (read(dd->dfd, dd->compressed_page, pd.size) != pd.size)
-			return READ_ERROR;
-	}
-
-	if (pd.flags & DUMP_DH_COMPRESSED_ZLIB) {
-		retlen = block_size;
-		ret = uncompress((unsigned char *)dd->page_cache_hdr[i].pg_bufptr,
-		                 &retlen,
-		                 (unsigned char *)dd->compressed_page,
-		                 pd.size);
-		if ((ret != Z_OK) || (retlen != block_size)) {
-			error(INFO, "%s: uncompress failed: %d\n", 
-				DISKDUMP_VALID() ? "diskdump" : "compressed kdump",
-				ret);
-			return READ_ERROR;
-		}
-	} else if (pd.flags & DUMP_DH_COMPRESSED_LZO) {
-
-		if (!(dd->flags & LZO_SUPPORTED)) {
-			error(INFO, "%s: uncompress failed: no lzo compression support\n",
-			      DISKDUMP_VALID() ? "diskdump" : "compressed kdump");
-			return READ_ERROR;
-		}
-
-#ifdef LZO
-		retlen = block_size;
-		ret = lzo1x_decompress_safe((unsigned char *)dd->compressed_page,
-					    pd.size,
-					    (unsigned char *)dd->page_cache_hdr[i].pg_bufptr,
-					    &retlen,
-					    LZO1X_MEM_DECOMPRESS);
-		if ((ret != LZO_E_OK) || (retlen != block_size)) {
-			error(INFO, "%s: uncompress failed: %d\n", 
-				DISKDUMP_VALID() ? "diskdump" : "compressed kdump",
-				ret);
-			return READ_ERROR;
-		}
-#endif
-	} else if (pd.flags & DUMP_DH_COMPRESSED_SNAPPY) {
+	} else if ((ret = read_page_data(pd.offset, dd->compressed_page, pd.size)))
+		return ret;
 
-		if (!(dd->flags & SNAPPY_SUPPORTED)) {
-			error(INFO, "%s: uncompress failed: no snappy compression support\n",
-			      DISKDUMP_VALID() ? "diskdump" : "compressed kdump");
-			return READ_ERROR;
-		}
+	tstart = 0;
+	if (pd.flags & DUMP_DH_COMPRESSED) {
+		dd->decompressions++;
+		clock_gettime(CLOCK_MONOTONIC, &ts_start);
+		tstart = TRACING() ? trace_time() : 0;
+	}
 
-#ifdef SNAPPY
-		ret = snappy_uncompressed_length((char *)dd->compressed_page,
-						 pd.size, (size_t *)&retlen);
-		if (ret != SNAPPY_OK) {
-			error(INFO, "%s: uncompress failed: %d\n",
-			      DISKDUMP_VALID() ? "diskdump" : "compressed kdump",
-			      ret);
-			return READ_ERROR;
-		}
+	if (uncompress_block(pd.flags, dd->compressed_page, pd.size,
+	    pgc->pg_bufptr, &zstd_dctx, errmsg) < 0) {
+		error(INFO, "%s: %s\n",
+			DISKDUMP_VALID() ? "diskdump" : "compressed kdump",
+			errmsg);
+		return READ_ERROR;
+	}
 
-		ret = snappy_uncompress((char *)dd->compressed_page, pd.size,
-					(char *)dd->page_cache_hdr[i].pg_bufptr,
-					(size_t *)&retlen);
-		if ((ret != SNAPPY_OK) || (retlen != block_size)) {
-			error(INFO, "%s: uncompress failed: %d\n", 
-			      DISKDUMP_VALID() ? "diskdump" : "compressed kdump",
-			      ret);
-			return READ_ERROR;
-		}
-#endif
-	} else if (pd.flags & DUMP_DH_COMPRESSED_ZSTD) {
+	if (pd.flags & DUMP_DH_COMPRESSED) {
+		clock_gettime(CLOCK_MONOTONIC, &ts_end);
+		dd->decompress_usecs +=
+			(ulonglong)(ts_end.tv_sec - ts_start.tv_sec) * 1000000 +
+			(ts_end.tv_nsec - ts_start.tv_nsec) / 1000;
+		trace_span("decompress", "uncompress_block", NULL, tstart);
+	}
 
-		if (!(dd->flags & ZSTD_SUPPORTED)) {
-			error(INFO, "%s: uncompess failed: no zstd compression support\n",
-				DISKDUMP_VALID() ? "diskdump" : "compressed kdump");
-			return READ_ERROR;
-		}
-#ifdef ZSTD
-		if (!dctx) {
-			dctx = ZSTD_createDCtx();
-			if (!dctx) {
-				error(INFO, "%s: uncompess failed: cannot create ZSTD_DCtx\n",
-					DISKDUMP_VALID() ? "diskdump" : "compressed kdump");
-				return READ_ERROR;
-			}
-		}
+	pgc->pg_flags |= PAGE_VALID;
+	pgc->pg_hash_next = *page_cache_bucket(paddr);
+	*page_cache_bucket(paddr) = pgc;
+	page_cache_lru_make_head(pgc);
+	dd->curbufptr = pgc->pg_bufptr;
 
-		retlen = ZSTD_decompressDCtx(dctx,
-				dd->page_cache_hdr[i].pg_bufptr, block_size,
-				dd->compressed_page, pd.size);
-		if (ZSTD_isError(retlen) || (retlen != block_size)) {
-			error(INFO, "%s: uncompress failed: %d (%s)\n",
-				DISKDUMP_VALID() ? "diskdump" : "compressed kdump",
-				retlen, ZSTD_getErrorName(retlen));
-			return READ_ERROR;
+	if (diskdump_readahead_pages) {
+		if ((pfn == dd->last_miss_pfn + 1) ||
+		    (pfn == dd->readahead_next_pfn))
+			dd->sequential_misses++;
+		else
+			dd->sequential_misses = 0;
+		dd->last_miss_pfn = pfn;
+
+		if (dd->sequential_misses >= DISKDUMP_SEQUENTIAL_MISSES) {
+			readahead_batch(pfn + 1);
+			dd->readahead_next_pfn = pfn + 1 +
+				MIN(diskdump_readahead_pages,
+				    dd->page_cache_pages/2);
 		}
-#endif
-	} else
-		memcpy(dd->page_cache_hdr[i].pg_bufptr,
-		       dd->compressed_page, block_size);
-
-	dd->page_cache_hdr[i].pg_flags |= PAGE_VALID;
-	dd->curbufptr = dd->page_cache_hdr[i].pg_bufptr;
+	}
 
 	return TRUE;
 }
@@ -1811,6 +2720,7 @@ __diskdump_memory_dump(FILE *fp)
 	struct disk_dump_header *dh;
 	struct disk_dump_sub_header *dsh;
 	struct kdump_sub_header *kdsh;
+	struct page_cache_hdr *pgc;
 	ulong *tasks;
 
 	if (FLAT_FORMAT())
@@ -2115,20 +3025,32 @@ __diskdump_memory_dump(FILE *fp)
 	fprintf(fp, "   compressed_page: %lx\n", (ulong)dd->compressed_page);
 	fprintf(fp, "         curbufptr: %lx\n\n", (ulong)dd->curbufptr);
 
-	for (i = 0; i < DISKDUMP_CACHED_PAGES; i++) {
-		fprintf(fp, "%spage_cache_hdr[%d]:\n", i < 10 ? " " : "", i);
-		fprintf(fp, "            pg_flags: %x (", dd->page_cache_hdr[i].pg_flags);
+	for (i = 0, pgc = dd->lru_head; pgc && (i < DISKDUMP_CACHED_PAGES);
+	     i++, pgc = pgc->pg_lru_next) {
+		fprintf(fp, "%spage_cache_hdr[%d]:\n", i < 10 ? " " : "",
+			(int)(pgc - dd->page_cache_hdr));
+		fprintf(fp, "            pg_flags: %x (", pgc->pg_flags);
 		others = 0;
-		if (dd->page_cache_hdr[i].pg_flags & PAGE_VALID)
+		if (pgc->pg_flags & PAGE_VALID)
                 	fprintf(fp, "%sPAGE_VALID", others++ ? "|" : "");
+		if (pgc->pg_flags & PAGE_READAHEAD)
+			fprintf(fp, "%sPAGE_READAHEAD", others++ ? "|" : "");
 		fprintf(fp, ")\n");
-		fprintf(fp, "             pg_addr: %llx\n", (ulonglong)dd->page_cache_hdr[i].pg_addr);
-		fprintf(fp, "           pg_bufptr: %lx\n", (ulong)dd->page_cache_hdr[i].pg_bufptr);
-		fprintf(fp, "        pg_hit_count: %ld\n", dd->page_cache_hdr[i].pg_hit_count);
+		fprintf(fp, "             pg_addr: %llx\n", (ulonglong)pgc->pg_addr);
+		fprintf(fp, "           pg_bufptr: %lx\n", (ulong)pgc->pg_bufptr);
+		fprintf(fp, "        pg_hit_count: %ld\n", pgc->pg_hit_count);
 	}
+	if (dd->page_cache_pages > DISKDUMP_CACHED_PAGES)
+		fprintf(fp, "   (%d most recently used of %d entries shown)\n",
+			DISKDUMP_CACHED_PAGES, dd->page_cache_pages);
 
 	fprintf(fp, "\n    page_cache_buf: %lx\n", (ulong)dd->page_cache_buf);
-	fprintf(fp, "       evict_index: %d\n", dd->evict_index);
+	fprintf(fp, "  page_cache_pages: %d (%lld bytes)\n", dd->page_cache_pages,
+		(ulonglong)dd->page_cache_pages * dd->block_size);
+	fprintf(fp, "   page_cache_hash: %lx\n", (ulong)dd->page_cache_hash);
+	fprintf(fp, "page_cache_hash_size: %d\n", dd->page_cache_hash_size);
+	fprintf(fp, "          lru_head: %lx\n", (ulong)dd->lru_head);
+	fprintf(fp, "          lru_tail: %lx\n", (ulong)dd->lru_tail);
 	fprintf(fp, "         evictions: %ld\n", dd->evictions);
 	fprintf(fp, "          accesses: %ld\n", dd->accesses);
 	fprintf(fp, "      cached_reads: %ld ", dd->cached_reads);
@@ -2137,8 +3059,32 @@ __diskdump_memory_dump(FILE *fp)
 			dd->cached_reads * 100 / dd->accesses);
 	else
 		fprintf(fp, "\n");
+	fprintf(fp, "      cache_misses: %ld\n", dd->accesses - dd->cached_reads);
+	fprintf(fp, "    decompressions: %ld\n", dd->decompressions);
+	fprintf(fp, "  decompress_usecs: %lld ", dd->decompress_usecs);
+	if (dd->decompressions)
+		fprintf(fp, "(%lld usecs/page)\n",
+			dd->decompress_usecs / dd->decompressions);
+	else
+		fprintf(fp, "\n");
+	fprintf(fp, "    pd_cache_loads: %ld\n", dd->pd_cache_loads);
+	fprintf(fp, "     pd_cache_hits: %ld\n", dd->pd_cache_hits);
+	fprintf(fp, "           databuf: %lx\n", (ulong)dd->databuf);
+	fprintf(fp, "     databuf_reads: %ld\n", dd->databuf_reads);
+	fprintf(fp, "      databuf_hits: %ld\n", dd->databuf_hits);
+	fprintf(fp, "diskdump_readahead: %ld\n", diskdump_readahead_pages);
+	fprintf(fp, "  readahead_threads: %d\n", readahead_pool.nthreads);
+	fprintf(fp, "        readaheads: %ld\n", dd->readaheads);
+	fprintf(fp, "   readahead_pages: %ld\n", dd->readahead_pages);
+	fprintf(fp, "    readahead_hits: %ld ", dd->readahead_hits);
+	if (dd->readahead_pages)
+		fprintf(fp, "(%ld%%)\n",
+			dd->readahead_hits * 100 / dd->readahead_pages);
+	else
+		fprintf(fp, "\n");
 	fprintf(fp, "       valid_pages: %lx\n", (ulong)dd->valid_pages);
 	fprintf(fp, " total_valid_pages: %ld\n", dd->valid_pages[dd->max_sect_len]);
+	fprintf(fp, "        block_rank: %lx\n", (ulong)dd->block_rank);
 
 	return 0;
 }
@@ -2262,20 +3208,25 @@ diskdump_get_prstatus_percpu(int cpu)
 static char *
 vmcoreinfo_read_string(const char *key)
 {
-	char *buf, *value_string, *p1, *p2;
-	size_t value_length;
+	char *buf;
 	ulong size_vmcoreinfo;
 	off_t offset;
-	char keybuf[BUFSIZE];
 	const off_t failed = (off_t)-1;
+	static int loaded = FALSE;
 
 	if (dd->header->header_version < 3)
 		return NULL;
 
-	buf = value_string = NULL;
+	/*
+	 *  The note data is read from the dumpfile once, into the shared
+	 *  vmcoreinfo table.
+	 */
+	if (loaded)
+		return vmcoreinfo_table_read_string(key);
+	loaded = TRUE;
+
 	size_vmcoreinfo = dd->sub_header_kdump->size_vmcoreinfo;
 	offset = dd->sub_header_kdump->offset_vmcoreinfo;
-	sprintf(keybuf, "%s=", key);
 
 	if ((buf = malloc(size_vmcoreinfo+1)) == NULL) {
 		error(INFO, "compressed kdump: cannot malloc vmcoreinfo"
@@ -2299,21 +3250,12 @@ vmcoreinfo_read_string(const char *key)
 		}
 	}
 
-	buf[size_vmcoreinfo] = '\n';
-
-	if ((p1 = strstr(buf, keybuf))) {
-		p2 = p1 + strlen(keybuf);
-		p1 = strstr(p2, "\n");
-		value_length = p1-p2;
-		value_string = calloc(value_length+1, sizeof(char));
-		strncpy(value_string, p2, value_length);
-		value_string[value_length] = NULLCHAR;
-	}
+	vmcoreinfo_table_init(buf, size_vmcoreinfo);
 err:
 	if (buf)
 		free(buf);
 
-	return value_string;
+	return vmcoreinfo_table_read_string(key);
 }
 
 static void
@@ -2824,18 +3766,242 @@ static int get_disk_name_private_data(ulonglong pte_val, ulonglong vaddr,
 	return TRUE;
 }
 
+/*
+ *  Reading the memory of a process that has been swapped out to zram
+ *  would otherwise locate and decompress the same zram object for each
+ *  readmem() of the page, and look up the swap device for each page.
+ *  The swap device of each swap type is therefore looked up once, and
+ *  the most recently used ZRAM_CACHE_PAGES decompressed pages are kept,
+ *  keyed by swap type and offset.  On a live system both are discarded
+ *  at the start of each command.
+ */
+struct zram_swap_device {
+	int valid;
+	char name[32];
+	ulong private_data;		/* struct zram */
+};
+
+struct zram_cache_page {
+	int valid;
+	ulong swp_type;
+	ulonglong swp_offset;
+	ulong last_used;
+	unsigned char *page;
+};
+
+static struct zram_cache {
+	struct zram_swap_device devices[ZRAM_SWAP_TYPES];
+	struct zram_cache_page pages[ZRAM_CACHE_PAGES];
+	ulong clock;
+	ulong hits;
+	ulong misses;
+	ulong cmdgen;
+} zram_cache = { 0 };
+
+static void
+zram_cache_check(void)
+{
+	int i;
+
+	if (!ACTIVE() || (zram_cache.cmdgen == pc->cmdgencur))
+		return;
+
+	for (i = 0; i < ZRAM_SWAP_TYPES; i++)
+		zram_cache.devices[i].valid = FALSE;
+	for (i = 0; i < ZRAM_CACHE_PAGES; i++)
+		zram_cache.pages[i].valid = FALSE;
+	zram_cache.cmdgen = pc->cmdgencur;
+}
+
+static ulonglong
+zram_swp_offset(ulonglong pte_val)
+{
+	if (THIS_KERNEL_VERSION >= LINUX(2, 6, 0))
+		return (ulonglong)__swp_offset(pte_val);
+	else
+		return (ulonglong)SWP_OFFSET(pte_val);
+}
+
+/*
+ *  Return the name and private data of the swap device of a swap entry.
+ */
+static struct zram_swap_device *
+zram_swap_device(ulonglong pte_val, ulonglong vaddr)
+{
+	ulong swp_type;
+	struct zram_swap_device *zsd;
+	static struct zram_swap_device uncached;
+
+	zram_cache_check();
+
+	swp_type = __swp_type(pte_val);
+	if (swp_type < ZRAM_SWAP_TYPES)
+		zsd = &zram_cache.devices[swp_type];
+	else {
+		zsd = &uncached;
+		zsd->valid = FALSE;
+	}
+
+	if (!zsd->valid) {
+		BZERO(zsd->name, sizeof(zsd->name));
+		if (!get_disk_name_private_data(pte_val, vaddr, zsd->name,
+		    &zsd->private_data))
+			return NULL;
+		zsd->valid = TRUE;
+	}
+
+	return zsd;
+}
+
+/*
+ *  Copy len bytes at the page offset of vaddr from a cached decompressed
+ *  swap page, if there is one.
+ */
+static int
+zram_cache_read(ulonglong pte_val, unsigned char *buf, ulong len,
+		ulonglong vaddr)
+{
+	int i;
+	ulong swp_type;
+	ulonglong swp_offset;
+	struct zram_cache_page *zcp;
+
+	zram_cache_check();
+
+	swp_type = __swp_type(pte_val);
+	swp_offset = zram_swp_offset(pte_val);
+
+	for (i = 0; i < ZRAM_CACHE_PAGES; i++) {
+		zcp = &zram_cache.pages[i];
+		if (zcp->valid && (zcp->swp_offset == swp_offset) &&
+		    (zcp->swp_type == swp_type)) {
+			memcpy(buf, zcp->page + PAGEOFFSET(vaddr), len);
+			zcp->last_used = ++zram_cache.clock;
+			zram_cache.hits++;
+			return TRUE;
+		}
+	}
+
+	zram_cache.misses++;
+	return FALSE;
+}
+
+/*
+ *  Return the least recently used cache page, invalidated so that it can
+ *  be filled with the swap page of pte_val, or NULL if no page buffer
+ *  can be allocated.
+ */
+static struct zram_cache_page *
+zram_cache_victim(ulonglong pte_val)
+{
+	int i;
+	struct zram_cache_page *zcp, *victim;
+
+	for (i = 0, victim = NULL; i < ZRAM_CACHE_PAGES; i++) {
+		zcp = &zram_cache.pages[i];
+		if (!zcp->valid) {
+			victim = zcp;
+			break;
+		}
+		if (!victim || (zcp->last_used < victim->last_used))
+			victim = zcp;
+	}
+
+	if (!victim->page &&
+	    (!memory_limit_reserve(PAGESIZE()) ||
+	     !(victim->page = (unsigned char *)malloc(PAGESIZE()))))
+		return NULL;
+
+	victim->valid = FALSE;
+	victim->swp_type = __swp_type(pte_val);
+	victim->swp_offset = zram_swp_offset(pte_val);
+
+	return victim;
+}
+
+/*
+ *  The memory used by the page caches and readahead buffers of the open
+ *  compressed dumpfiles.
+ */
+ulonglong
+diskdump_cache_memory_used(void)
+{
+	int i, cnt;
+	ulonglong bytes;
+	struct diskdump_data *ddp;
+
+	if (!DISKDUMP_VALID() && !KDUMP_CMPRS_VALID())
+		return 0;
+
+	cnt = (KDUMP_SPLIT() && (dd_list != NULL)) ? num_dumpfiles : 1;
+
+	for (i = 0, bytes = 0; i < cnt; i++) {
+		ddp = (cnt > 1) ? dd_list[i] : dd;
+		bytes += (ulonglong)ddp->page_cache_pages *
+			(ddp->block_size + sizeof(struct page_cache_hdr));
+		bytes += (ulonglong)ddp->page_cache_hash_size *
+			sizeof(struct page_cache_hdr *);
+		bytes += (ulonglong)ddp->readahead_window *
+			(ddp->block_size + sizeof(struct readahead_job));
+	}
+
+	return bytes;
+}
+
+ulonglong
+zram_cache_memory_used(void)
+{
+	int i;
+	ulonglong bytes;
+
+	for (i = 0, bytes = 0; i < ZRAM_CACHE_PAGES; i++)
+		if (zram_cache.pages[i].page)
+			bytes += PAGESIZE();
+
+	return bytes;
+}
+
+/*
+ *  Free the cached pages, for "set memlimit".
+ */
+void
+zram_cache_release(void)
+{
+	int i;
+
+	for (i = 0; i < ZRAM_CACHE_PAGES; i++) {
+		free(zram_cache.pages[i].page);
+		zram_cache.pages[i].page = NULL;
+		zram_cache.pages[i].valid = FALSE;
+	}
+}
+
+void
+dump_zram_cache_stats(void)
+{
+	int i, cached;
+
+	for (i = cached = 0; i < ZRAM_CACHE_PAGES; i++)
+		if (zram_cache.pages[i].valid)
+			cached++;
+
+	fprintf(fp, "         zram_cache: pages: %d/%d hits: %ld misses: %ld\n",
+		cached, ZRAM_CACHE_PAGES, zram_cache.hits, zram_cache.misses);
+}
+
 ulong readswap(ulonglong pte_val, char *buf, ulong len, ulonglong vaddr)
 {
-	char name[32] = {0};
+	struct zram_swap_device *zsd;
 
-	if (!get_disk_name_private_data(pte_val, vaddr, name, NULL))
+	if (!(zsd = zram_swap_device(pte_val, vaddr)))
 		return 0;
 
-	if (!strncmp(name, "zram", 4)) {
+	if (!strncmp(zsd->name, "zram", 4)) {
 		return try_zram_decompress(pte_val, (unsigned char *)buf, len, vaddr);
 	} else {
 		if (CRASHDEBUG(2))
-			error(WARNING, "this page has been swapped to %s\n", name);
+			error(WARNING, "this page has been swapped to %s\n",
+				zsd->name);
 		return 0;
 	}
 }
@@ -2856,6 +4022,11 @@ try_zram_decompress(ulonglong pte_val, unsigned char *buf, ulong len, ulonglong
 	unsigned char *outbuf = NULL;
 	ulong zram, zram_table_entry, sector, index, entry, flags, size,
 		outsize, off;
+	struct zram_swap_device *zsd;
+	struct zram_cache_page *zcp;
+
+	if (zram_cache_read(pte_val, buf, len, vaddr))
+		return len;
 
 	if (INVALID_MEMBER(zram_compressor)) {
 		zram_init();
@@ -2870,8 +4041,9 @@ try_zram_decompress(ulonglong pte_val, unsigned char *buf, ulong len, ulonglong
 	if (CRASHDEBUG(2))
 		error(WARNING, "this page has swapped to zram\n");
 
-	if (!get_disk_name_private_data(pte_val, vaddr, NULL, &zram))
+	if (!(zsd = zram_swap_device(pte_val, vaddr)))
 		return 0;
+	zram = zsd->private_data;
 
 	readmem(zram + OFFSET(zram_compressor), KVADDR, name,
 		sizeof(name), "zram compressor", FAULT_ON_ERROR);
@@ -2895,18 +4067,23 @@ try_zram_decompress(ulonglong pte_val, unsigned char *buf, ulong len, ulonglong
 		return 0;
 	}
 
-	if (THIS_KERNEL_VERSION >= LINUX(2, 6, 0)) {
-		swp_offset = (ulonglong)__swp_offset(pte_val);
-	} else {
-		swp_offset = (ulonglong)SWP_OFFSET(pte_val);
-	}
+	swp_offset = zram_swp_offset(pte_val);
+
+	/*
+	 *  The whole page is decompressed into a cache page, from which
+	 *  the requested part is then copied.
+	 */
+	if ((zcp = zram_cache_victim(pte_val)))
+		outbuf = zcp->page;
+	else
+		outbuf = (unsigned char *)GETBUF(PAGESIZE());
 
 	zram_buf = (unsigned char *)GETBUF(PAGESIZE());
 	/* lookup page from swap cache */
 	off = PAGEOFFSET(vaddr);
 	obj_addr = lookup_swap_cache(pte_val, zram_buf);
 	if (obj_addr != NULL) {
-		memcpy(buf, obj_addr + off, len);
+		memcpy(outbuf, obj_addr, PAGESIZE());
 		goto out;
 	}
 
@@ -2920,7 +4097,7 @@ try_zram_decompress(ulonglong pte_val, unsigned char *buf, ulong len, ulonglong
 	readmem(zram_table_entry + OFFSET(zram_table_flag), KVADDR, &flags,
 		sizeof(void *), "zram_table_flag", FAULT_ON_ERROR);
 	if (!entry || (flags & ZRAM_FLAG_SAME_BIT)) {
-		memset(buf, entry, len);
+		memset(outbuf, entry, PAGESIZE());
 		goto out;
 	}
 	size = flags & (ZRAM_FLAG_SHIFT -1);
@@ -2939,22 +4116,27 @@ try_zram_decompress(ulonglong pte_val, unsigned char *buf, ulong len, ulonglong
 	}
 
 	if (size == PAGESIZE()) {
-		memcpy(buf, obj_addr + off, len);
+		memcpy(outbuf, obj_addr, PAGESIZE());
 	} else {
-		outbuf = (unsigned char *)GETBUF(PAGESIZE());
 		outsize = PAGESIZE();
-		if (!decompressor(obj_addr, size, outbuf, &outsize, NULL))
-			memcpy(buf, outbuf + off, len);
-		else {
+		if (decompressor(obj_addr, size, outbuf, &outsize, NULL)) {
 			error(WARNING, "zram decompress error\n");
 			len = 0;
 		}
-		FREEBUF(outbuf);
 	}
 
 out:
-	if (len && CRASHDEBUG(2))
-		error(INFO, "%lx: zram decompress success\n", vaddr);
+	if (len) {
+		memcpy(buf, outbuf + off, len);
+		if (zcp) {
+			zcp->valid = TRUE;
+			zcp->last_used = ++zram_cache.clock;
+		}
+		if (CRASHDEBUG(2))
+			error(INFO, "%lx: zram decompress success\n", vaddr);
+	}
+	if (!zcp)
+		FREEBUF(outbuf);
 	FREEBUF(zram_buf);
 	return len;
 }
@@ -96,7 +96,14 @@ typedef struct page_desc {
 	unsigned long long	page_flags;	/* page flags */
 } page_desc_t;
 
-#define DISKDUMP_CACHED_PAGES	(16)
+#define DUMP_DH_COMPRESSED	(DUMP_DH_COMPRESSED_ZLIB|DUMP_DH_COMPRESSED_LZO|\
+				 DUMP_DH_COMPRESSED_SNAPPY|DUMP_DH_COMPRESSED_ZSTD)
+
+#define DISKDUMP_CACHED_PAGES	(16)		/* default and minimum */
+#define DISKDUMP_MAX_CACHED_PAGES (1 << 28)
+#define DISKDUMP_PD_CACHE_SECTIONS (8)	/* bitmap sections of page_desc_t */
+#define DISKDUMP_DATABUF_SIZE	(128 * 1024)
 #define PAGE_VALID		(0x1)	/* flags */
+#define PAGE_READAHEAD		(0x2)	/* cached by read-ahead, not yet read */
 #define DISKDUMP_VALID_PAGE(flags)	((flags) & PAGE_VALID)
 
@@ -22,6 +22,11 @@ static int in_extensions_library(char *, char *);
 static char *get_extensions_directory(char *);
 static void show_all_extensions(void);
 static void show_extensions(char *);
+static int register_lazy_extension(char *, char *, FILE *);
+static void lazy_extension_command(void);
+static void drop_lazy_extension(struct extension_table *);
+
+#define EXTENSIONS_MANIFEST    "extensions.manifest"
 
 #define DUMP_EXTENSIONS        (0)
 #define LOAD_EXTENSION         (1)
@@ -158,6 +163,9 @@ dump_extension_table(int verbose)
 			if (ext->flags & REGISTERED)
 				fprintf(fp, "%sREGISTERED", others++ ?
 					"|" : "");
+			if (ext->flags & LAZY_LOAD)
+				fprintf(fp, "%sLAZY_LOAD", others++ ?
+					"|" : "");
 			fprintf(fp, ")\n");
                         fprintf(fp, "            next: %lx\n", (ulong)ext->next);
                         fprintf(fp, "            prev: %lx\n", (ulong)ext->prev);
@@ -206,6 +214,8 @@ dump_extension_table(int verbose)
                         mkstring(buf, longest, LJUST, ext->filename));
                 for (cp = ext->command_table; cp->name; cp++)
                         fprintf(fp, "%s ", cp->name);
+		if (ext->flags & LAZY_LOAD)
+			fprintf(fp, "(not yet loaded)");
 		fprintf(fp, "\n");
 	} while ((ext = ext->prev));
 }
@@ -303,6 +313,18 @@ load_extension(char *lib)
 		return;
 	}
 
+	/*
+	 *  Replace the command stubs of a library listed in the
+	 *  extensions manifest.
+	 */
+	for (curext = extension_table; curext; curext = curext->next) {
+		if ((curext->flags & LAZY_LOAD) &&
+		    same_file(curext->filename, ext->filename)) {
+			drop_lazy_extension(curext);
+			break;
+		}
+	}
+
 	for (curext = extension_table; curext; curext = curext->next) {
 		if (same_file(curext->filename, ext->filename)) {
 			fprintf(fp, "%s: shared object already loaded\n", 
@@ -424,6 +446,151 @@ get_extensions_directory(char *dirbuf)
 }
 
 
+/*
+ *  Look up a shared object in the extensions manifest, which contains
+ *  one line for each library that should be loaded on demand:
+ *
+ *    <shared-object> <command> [<command> ...]
+ *
+ *  If it is listed, register command stubs under the library's name
+ *  instead of loading it; the library is dlopen()'d the first time that
+ *  one of its commands is run.  Returns FALSE if the library should be
+ *  loaded now.
+ */
+static int
+register_lazy_extension(char *filename, char *lib, FILE *manifest)
+{
+	struct extension_table *ext;
+	struct command_table_entry *ct;
+	char buf[BUFSIZE];
+	char *arglist[MAXARGS];
+	int i, argc;
+
+	if (!manifest || (pc->flags & MINIMAL_MODE))
+		return FALSE;
+
+	rewind(manifest);
+	argc = 0;
+	while (fgets(buf, BUFSIZE, manifest)) {
+		if (buf[0] == '#')
+			continue;
+		if ((argc = parse_line(buf, arglist)) < 2)
+			continue;
+		if (STREQ(arglist[0], lib))
+			break;
+		argc = 0;
+	}
+
+	if (argc < 2)
+		return FALSE;
+
+	for (i = 1; i < argc; i++) {
+		if (get_command_table_entry(arglist[i])) {
+			error(INFO, "%s: \"%s\" is a duplicate of a "
+				"currently-existing command: loading it now\n",
+				lib, arglist[i]);
+			return FALSE;
+		}
+	}
+
+	if ((ext = (struct extension_table *)calloc(1,
+	    sizeof(struct extension_table) + strlen(filename) + 1)) == NULL)
+		return FALSE;
+	if ((ct = (struct command_table_entry *)calloc(argc,
+	    sizeof(struct command_table_entry))) == NULL) {
+		free(ext);
+		return FALSE;
+	}
+
+	ext->filename = (char *)((ulong)ext + sizeof(struct extension_table));
+	strcpy(ext->filename, filename);
+	ext->command_table = ct;
+	ext->flags = LAZY_LOAD;
+
+	for (i = 1; i < argc; i++, ct++) {
+		if ((ct->name = strdup(arglist[i])) == NULL) {
+			drop_lazy_extension(ext);
+			return FALSE;
+		}
+		ct->func = lazy_extension_command;
+		ct->flags = REFRESH_TASK_TABLE;
+	}
+
+	if (extension_table) {
+		extension_table->prev = ext;
+		ext->next = extension_table;
+	}
+	extension_table = ext;
+
+	return TRUE;
+}
+
+/*
+ *  Unlink and free the command stubs of a library that has not been
+ *  loaded.
+ */
+static void
+drop_lazy_extension(struct extension_table *ext)
+{
+	struct command_table_entry *cp;
+
+	if (extension_table == ext) {
+		extension_table = ext->next;
+		if (ext->next)
+			ext->next->prev = NULL;
+	} else if (ext->prev) {
+		ext->prev->next = ext->next;
+		if (ext->next)
+			ext->next->prev = ext->prev;
+	}
+
+	for (cp = ext->command_table; cp->name; cp++)
+		free(cp->name);
+	free(ext->command_table);
+	free(ext);
+}
+
+/*
+ *  The command function of all stubs: load the library that provides
+ *  the command, and then run the command that it registered.
+ */
+static void
+lazy_extension_command(void)
+{
+	struct extension_table *ext;
+	struct command_table_entry *cp;
+	char cmd[BUFSIZE];
+	char lib[BUFSIZE];
+
+	strcpy(cmd, pc->curcmd);
+
+	for (ext = extension_table; ext; ext = ext->next) {
+		if (!(ext->flags & LAZY_LOAD))
+			continue;
+		for (cp = ext->command_table; cp->name; cp++) {
+			if (STREQ(cp->name, cmd))
+				goto found;
+		}
+	}
+	error(FATAL, "%s: command stub has no shared object\n", cmd);
+
+found:
+	/*
+	 *  load_extension() frees the stubs, including the one that
+	 *  pc->curcmd points to.
+	 */
+	strcpy(lib, ext->filename);
+	pc->curcmd = pc->program_name;
+	load_extension(lib);
+
+	if (!(cp = get_command_table_entry(cmd)) ||
+	    (cp->func == lazy_extension_command))
+		error(FATAL, "%s: command not registered by %s\n", cmd, lib);
+
+	pc->curcmd = cp->name;
+	(*cp->func)();
+}
+
 void
 preload_extensions(void)
 {
@@ -431,6 +598,7 @@ preload_extensions(void)
 	struct dirent *dp;
 	char dirbuf[BUFSIZE];
 	char filename[BUFSIZE*2];
+	FILE *manifest;
 	int found;
 
 	if (!get_extensions_directory(dirbuf))
@@ -444,6 +612,10 @@ preload_extensions(void)
 
 	pc->curcmd = pc->program_name;
 
+	sprintf(filename, "%s%s%s", dirbuf,
+		LASTCHAR(dirbuf) == '/' ? "" : "/", EXTENSIONS_MANIFEST);
+	manifest = fopen(filename, "r");
+
         for (found = 0, dp = readdir(dirp); dp != NULL; dp = readdir(dirp)) {
 		sprintf(filename, "%s%s%s", dirbuf, 
 			LASTCHAR(dirbuf) == '/' ? "" : "/",
@@ -454,10 +626,15 @@ preload_extensions(void)
 
 		found++;
 
-		load_extension(dp->d_name);
+		if (!register_lazy_extension(filename, dp->d_name, manifest))
+			load_extension(dp->d_name);
 	}
 
 	closedir(dirp);
+	if (manifest) {
+		fclose(manifest);
+		help_init();
+	}
 	
 	if (found)
 		fprintf(fp, "\n");
@@ -480,6 +657,10 @@ unload_extension(char *lib)
 	if (!lib) {
 		while (extension_table) {
 			ext = extension_table;
+			if (ext->flags & LAZY_LOAD) {
+				drop_lazy_extension(ext);
+				continue;
+			}
                         if (dlclose(ext->handle))
                                 error(FATAL,
                                     "dlclose: %s: shared object not open\n",
@@ -510,7 +691,13 @@ unload_extension(char *lib)
         for (ext = extension_table, found = FALSE; ext; ext = ext->next) {
                 if (same_file(lib, ext->filename)) {
 			found = TRUE;
-			if (dlclose(ext->handle))
+			if (ext->flags & LAZY_LOAD) {
+				fprintf(fp, "%s: command stubs removed\n",
+					ext->filename);
+				drop_lazy_extension(ext);
+				help_init();
+				break;
+			} else if (dlclose(ext->handle))
 				error(INFO, 
 				    "dlclose: %s: shared object not open\n", 
 					ext->filename);
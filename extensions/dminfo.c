@@ -1130,6 +1130,8 @@ dminfo_show_details(unsigned long table, unsigned int num_targets, int info_type
 {
 	unsigned int i;
 	unsigned long head, target_size, target, target_type;
+	unsigned long *target_types;
+	struct readmem_request *reqs;
 	struct dminfo_target_analyzer *ta;
 	char buf[BUFSIZE];
 
@@ -1140,6 +1142,25 @@ dminfo_show_details(unsigned long table, unsigned int num_targets, int info_type
 	GET_VALUE(table, dm_table, targets, head);
 	target_size = STRUCT_SIZE("struct dm_target");
 
+	/*
+	 * Read the type of every target up front, with one request
+	 * per target, which readmem_batch() combines.
+	 */
+	INIT_MBR_TABLE(dm_target, type);
+	target_types = (unsigned long *)GETBUF(sizeof(unsigned long) * num_targets);
+	reqs = (struct readmem_request *)
+		GETBUF(sizeof(struct readmem_request) * num_targets);
+	for (i = 0; i < num_targets; i++) {
+		reqs[i].addr = head + target_size * i +
+			mbr_ary[DM_dm_target_type].offset;
+		reqs[i].memtype = KVADDR;
+		reqs[i].buffer = &target_types[i];
+		reqs[i].size = MIN(mbr_ary[DM_dm_target_type].size,
+			sizeof(unsigned long));
+		reqs[i].type = MSG("GET_VALUE", "dm_target", "type");
+	}
+	readmem_batch(reqs, num_targets, FAULT_ON_ERROR);
+
 	fprintf(fp, "  %-16s  %-11s  %s\n",
 		"TARGET", "TARGET_TYPE", "PRIVATE_DATA");
 
@@ -1147,7 +1168,7 @@ dminfo_show_details(unsigned long table, unsigned int num_targets, int info_type
 		target = head + target_size * i; /* Get next target */
 
 		/* Get target information */
-		GET_VALUE(target, dm_target, type, target_type);
+		target_type = target_types[i];
 		GET_PTR_STR(target_type, target_type, name, buf, BUFSIZE);
 
 		fprintf(fp, "  %-16lx  %-11s", target, buf);
@@ -1177,6 +1198,9 @@ dminfo_show_details(unsigned long table, unsigned int num_targets, int info_type
 	if (i != num_targets)
 		fprintf(fp, " ERROR: targets are less than num_targets:%d",
 			num_targets);
+
+	FREEBUF(reqs);
+	FREEBUF(target_types);
 }
 
 /*
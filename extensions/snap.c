@@ -18,6 +18,7 @@
 #include <sys/time.h>
 #include <linux/types.h>
 #include <elf.h>
+#include <pthread.h>
 
 void snap_init(void);
 void snap_fini(void);
@@ -31,9 +32,14 @@ static struct command_table_entry command_table[] = {
 };
 
 static char *generate_elf_header(int, int, char *);
+static size_t dump_snap_notes(char *);
 static int verify_paddr(physaddr_t);
 static void init_ram_segments(void);
 static int print_progress(const char *, ulong);
+struct snap_compression;
+static struct snap_compression *snap_compression(char *);
+static int write_kdump_compressed(int, char *, struct snap_compression *,
+	int, int);
 
 #if defined(X86) || defined(X86_64) || defined(IA64) || defined(PPC64) || defined(ARM64)
 int supported = TRUE;
@@ -69,6 +75,8 @@ cmd_snap(void)
 	char *elf_header;
 	Elf64_Phdr *load;
 	int load_index;
+	struct snap_compression *compression;
+	int threads, fflag;
 
 	if (!supported)
 		error(FATAL, "command not supported on the %s architecture\n",
@@ -77,8 +85,11 @@ cmd_snap(void)
 	filename = NULL;
 	buf = GETBUF(PAGESIZE()); 
 	type = KDUMP_ELF64;
+	compression = NULL;
+	threads = 0;
+	fflag = FALSE;
 
-        while ((c = getopt(argcnt, args, "n")) != EOF) {
+        while ((c = getopt(argcnt, args, "nc:fj:")) != EOF) {
                 switch(c)
                 {
 		case 'n':
@@ -87,6 +98,17 @@ cmd_snap(void)
 			else
 				type = NETDUMP_ELF64;
 			break;
+		case 'c':
+			compression = snap_compression(optarg);
+			break;
+		case 'f':
+			fflag = TRUE;
+			break;
+		case 'j':
+			threads = stol(optarg, FAULT_ON_ERROR, NULL);
+			if (threads < 1)
+				error(FATAL, "invalid thread count: %s\n", optarg);
+			break;
                 default:
                         argerrs++;
                         break;
@@ -96,6 +118,11 @@ cmd_snap(void)
         if (argerrs || !args[optind])
                 cmd_usage(pc->curcmd, SYNOPSIS);
 
+	if (compression && (type == NETDUMP_ELF64))
+		error(FATAL, "-c and -n are mutually exclusive\n");
+	if (!compression && (fflag || threads))
+		error(FATAL, "-f and -j require -c\n");
+
 	while (args[optind]) {
 		if (filename)
                 	cmd_usage(pc->curcmd, SYNOPSIS);
@@ -113,6 +140,14 @@ cmd_snap(void)
                 cmd_usage(pc->curcmd, SYNOPSIS);
 
 	init_ram_segments();
+	print_progress(filename, 0);
+
+	if (compression) {
+		if (!write_kdump_compressed(fd, filename, compression,
+		    threads, fflag))
+			return;
+		goto done;
+	}
 
 	if (!(elf_header = generate_elf_header(type, fd, filename)))
 		error(FATAL, "cannot generate ELF header\n");
@@ -136,17 +171,18 @@ cmd_snap(void)
 			if (write(fd, &buf[0], PAGESIZE()) != PAGESIZE())
 				error(FATAL, "write to dumpfile failed\n");
 
-			if (!print_progress(filename, BTOP(paddr)))
+			if (!print_progress(filename, 1))
 				return;
 		}
 	}
 
+	FREEBUF(elf_header);
+done:
         fprintf(stderr, "\r%s: [100%%] ", filename);
 	fprintf(fp, "\n");
 	sprintf(buf, "/bin/ls -l %s\n", filename);
 	system(buf);
 
-	FREEBUF(elf_header);
 	FREEBUF(buf);
 }
 
@@ -154,13 +190,25 @@ cmd_snap(void)
 char *help_snap[] = {
         "snap",                     /* command name */
         "take a memory snapshot",   /* short description */
-        "[-n] dumpfile",            /* filename */
+        "[-n | -c method [-f] [-j threads]] dumpfile",  /* filename */
  
         "  This command takes a snapshot of physical memory and creates an ELF vmcore.",
 	"  The default vmcore is a kdump-style dumpfile.  Supported on x86, x86_64,",
 	"  ia64 and ppc64 architectures only.",
 	" ",
 	"    -n  create a netdump-style vmcore (n/a on x86_64).",
+	"    -c method",
+	"        create a compressed kdump dumpfile instead, as written by makedumpfile,",
+	"        with each page compressed using the \"zlib\", \"lzo\", \"snappy\" or",
+	"        \"zstd\" method, or stored as is with \"none\".  The lzo, snappy and",
+	"        zstd methods are only available if crash and this extension were",
+	"        built with them.  Pages filled with zeroes all share a single copy.",
+	"    -f  with -c, leave out the pages that are on the free lists of the zones.",
+	"        Since the free lists keep changing while the snapshot is taken, the",
+	"        contents of a page that gets allocated in the meantime may be lost.",
+	"    -j threads",
+	"        with -c, the number of threads that compress pages while memory is",
+	"        being read; the default is the number of online cpus, up to 32.",
         NULL
 };
 
@@ -407,6 +455,74 @@ dump_elf_note(char *buf, Elf64_Word type, char *name, char *desc, int d_len)
 	return len;
 }
 
+/*
+ *  Create the NT_PRSTATUS, NT_PRPSINFO and "SNAP" NT_TASKSTRUCT notes
+ *  at buf, and return their total length.
+ */
+static size_t
+dump_snap_notes(char *buf)
+{
+	char *ptr;
+	size_t len;
+	int prstatus_len;
+	struct elf_prpsinfo_64 prpsinfo;
+	union prstatus prstatus;
+	struct SNAP_info {
+		ulonglong task_struct;
+		ulonglong arch_data1;
+		ulonglong arch_data2;
+	} SNAP_info;
+
+	if (machine_type("X86_64"))
+		prstatus_len = sizeof(prstatus.x86_64);
+	else if (machine_type("X86"))
+		prstatus_len = sizeof(prstatus.x86);
+	else if (machine_type("IA64"))
+		prstatus_len = sizeof(prstatus.ia64);
+	else if (machine_type("PPC64"))
+		prstatus_len = sizeof(prstatus.ppc64);
+	else
+		prstatus_len = sizeof(prstatus.arm64);
+
+	ptr = buf;
+
+	/* NT_PRSTATUS note */
+	memset(&prstatus, 0, sizeof(prstatus));
+	len = dump_elf_note(ptr, NT_PRSTATUS, "CORE",
+		(char *)&prstatus, prstatus_len);
+	ptr += len;
+
+	/* NT_PRPSINFO note */
+	memset(&prpsinfo, 0, sizeof(struct elf_prpsinfo_64));
+	prpsinfo.pr_state = 0;
+	prpsinfo.pr_sname = 'R';
+	prpsinfo.pr_zomb = 0;
+	strcpy(prpsinfo.pr_fname, "vmlinux");
+
+	len = dump_elf_note(ptr, NT_PRPSINFO, "CORE",
+		(char *)&prpsinfo, sizeof(prpsinfo));
+	ptr += len;
+
+  	/* NT_TASKSTRUCT note */
+	SNAP_info.task_struct = CURRENT_TASK();
+#ifdef X86_64
+	SNAP_info.arch_data1 = kt->relocate;
+	SNAP_info.arch_data2 = 0;
+#elif ARM64
+	SNAP_info.arch_data1 = machdep->machspec->kimage_voffset;
+	SNAP_info.arch_data2 = (machdep->machspec->VA_BITS_ACTUAL << 32) | 
+				machdep->machspec->CONFIG_ARM64_VA_BITS;
+#else
+	SNAP_info.arch_data1 = 0;
+	SNAP_info.arch_data2 = 0;
+#endif
+	len = dump_elf_note (ptr, NT_TASKSTRUCT, "SNAP",
+		(char *)&SNAP_info, sizeof(struct SNAP_info));
+	ptr += len;
+
+	return ptr - buf;
+}
+
 char *
 generate_elf_header(int type, int fd, char *filename)
 {
@@ -417,37 +533,24 @@ generate_elf_header(int type, int fd, char *filename)
 	Elf64_Phdr *load;
 	size_t offset, len, l_offset;
 	size_t data_offset;
-	struct elf_prpsinfo_64 prpsinfo;
-	union prstatus prstatus;
-	int prstatus_len;
 	ushort e_machine;
 	int num_segments;
 	struct node_table *nt;
-	struct SNAP_info {
-		ulonglong task_struct;
-		ulonglong arch_data1;
-		ulonglong arch_data2;
-	} SNAP_info;
 
 	num_segments = vt->numnodes;
 
 	if (machine_type("X86_64")) {
 		e_machine = EM_X86_64;
-		prstatus_len = sizeof(prstatus.x86_64);
 		num_segments += 1;  /* mapped kernel section for phys_base */
 	} else if (machine_type("X86")) {
 		e_machine = EM_386;
-		prstatus_len = sizeof(prstatus.x86);
 	} else if (machine_type("IA64")) {
 		e_machine = EM_IA_64;
-		prstatus_len = sizeof(prstatus.ia64);
 		num_segments += 1;  /* mapped kernel section for phys_start */
 	} else if (machine_type("PPC64")) {
 		e_machine = EM_PPC64;
-		prstatus_len = sizeof(prstatus.ppc64);
 	} else if (machine_type("ARM64")) {
 		e_machine = EM_AARCH64;
-		prstatus_len = sizeof(prstatus.arm64);
 	} else
 		return NULL;
 
@@ -587,43 +690,7 @@ generate_elf_header(int type, int fd, char *filename)
 	}
 	notes->p_offset = offset;
 
-	/* NT_PRSTATUS note */
-	memset(&prstatus, 0, sizeof(prstatus));
-	len = dump_elf_note(ptr, NT_PRSTATUS, "CORE",
-		(char *)&prstatus, prstatus_len);
-	offset += len;
-	ptr += len;
-	notes->p_filesz += len;
-
-	/* NT_PRPSINFO note */
-	memset(&prpsinfo, 0, sizeof(struct elf_prpsinfo_64));
-	prpsinfo.pr_state = 0;
-	prpsinfo.pr_sname = 'R';
-	prpsinfo.pr_zomb = 0;
-	strcpy(prpsinfo.pr_fname, "vmlinux");
-
-	len = dump_elf_note(ptr, NT_PRPSINFO, "CORE",
-		(char *)&prpsinfo, sizeof(prpsinfo));
-
-	offset += len;
-	ptr += len;
-	notes->p_filesz += len;
-
-  	/* NT_TASKSTRUCT note */
-	SNAP_info.task_struct = CURRENT_TASK();
-#ifdef X86_64
-	SNAP_info.arch_data1 = kt->relocate;
-	SNAP_info.arch_data2 = 0;
-#elif ARM64
-	SNAP_info.arch_data1 = machdep->machspec->kimage_voffset;
-	SNAP_info.arch_data2 = (machdep->machspec->VA_BITS_ACTUAL << 32) | 
-				machdep->machspec->CONFIG_ARM64_VA_BITS;
-#else
-	SNAP_info.arch_data1 = 0;
-	SNAP_info.arch_data2 = 0;
-#endif
-	len = dump_elf_note (ptr, NT_TASKSTRUCT, "SNAP",
-		(char *)&SNAP_info, sizeof(struct SNAP_info));
+	len = dump_snap_notes(ptr);
 	offset += len;
 	ptr += len;
 	notes->p_filesz += len;
@@ -767,10 +834,11 @@ verify_paddr(physaddr_t paddr)
 
 /*
  *  Borrowed from makedumpfile, prints a percentage-done value 
- *  once per second. 
+ *  once per second.  The number of pages done since the previous call
+ *  is passed in pages; zero restarts the count for a new snapshot.
  */
 static int
-print_progress(const char *filename, ulong current)
+print_progress(const char *filename, ulong pages)
 {
         int n, progress;
         time_t tm;
@@ -779,6 +847,12 @@ print_progress(const char *filename, ulong current)
 	static ulong total_pages = 0;
 	static ulong written_pages = 0;
 
+	if (!pages) {
+		last_time = 0;
+		total_pages = written_pages = 0;
+		return TRUE;
+	}
+
 	if (!total_pages) {
         	for (n = 0; n < vt->numnodes; n++) {
                 	nt = &vt->node_table[n];
@@ -791,7 +865,7 @@ print_progress(const char *filename, ulong current)
 		return FALSE;
 	}
 
-        if (++written_pages < total_pages) {
+        if ((written_pages += pages) < total_pages) {
                 tm = time(NULL);
                 if (tm - last_time < 1)
                         return TRUE;
@@ -804,3 +878,912 @@ print_progress(const char *filename, ulong current)
 
 	return TRUE;
 }
+
+/******************************************************************************
+ *                       Compressed kdump dumpfiles                           *
+ ******************************************************************************/
+
+/*
+ *  The compressed kdump format, borrowed from the diskdump.h file.
+ *
+ *    block 0                  disk_dump_header
+ *    block 1 ...              kdump_sub_header, ELF notes, vmcoreinfo
+ *    block 1 + sub_hdr_size   bitmap of existing pages, then bitmap of
+ *                             dumped pages
+ *    data_offset              page_desc_t of each dumped page, in pfn order
+ *                             followed by the page data
+ */
+#define KDUMP_SIGNATURE		"KDUMP   "
+#define KDUMP_SIG_LEN		(sizeof(KDUMP_SIGNATURE) - 1)
+#define KDUMP_HEADER_VERSION	(6)
+
+struct disk_dump_header {
+	char			signature[KDUMP_SIG_LEN];
+	int			header_version;
+	struct new_utsname	utsname;
+	struct timeval		timestamp;
+	unsigned int		status;
+	int			block_size;
+	int			sub_hdr_size;
+	unsigned int		bitmap_blocks;
+	unsigned int		max_mapnr;
+	unsigned int		total_ram_blocks;
+	unsigned int		device_blocks;
+	unsigned int		written_blocks;
+	unsigned int		current_cpu;
+	int			nr_cpus;
+};
+
+struct kdump_sub_header {
+	unsigned long	phys_base;
+	int		dump_level;
+	int		split;
+	unsigned long	start_pfn;
+	unsigned long	end_pfn;
+	off_t		offset_vmcoreinfo;
+	unsigned long	size_vmcoreinfo;
+	off_t		offset_note;
+	unsigned long	size_note;
+	off_t		offset_eraseinfo;
+	unsigned long	size_eraseinfo;
+	unsigned long long start_pfn_64;
+	unsigned long long end_pfn_64;
+	unsigned long long max_mapnr_64;
+};
+
+#define DUMP_DH_COMPRESSED_ZLIB    0x1
+#define DUMP_DH_COMPRESSED_LZO     0x2
+#define DUMP_DH_COMPRESSED_SNAPPY  0x4
+#define DUMP_DH_COMPRESSED_INCOMPLETE  0x8
+#define DUMP_DH_COMPRESSED_ZSTD    0x20
+
+typedef struct page_desc {
+	off_t			offset;
+	unsigned int		size;
+	unsigned int		flags;
+	unsigned long long	page_flags;
+} page_desc_t;
+
+static struct snap_compression {
+	char *name;
+	uint flag;
+} snap_compressions[] = {
+	{ "none",	0 },
+	{ "zlib",	DUMP_DH_COMPRESSED_ZLIB },
+#ifdef LZO
+	{ "lzo",	DUMP_DH_COMPRESSED_LZO },
+#endif
+#ifdef SNAPPY
+	{ "snappy",	DUMP_DH_COMPRESSED_SNAPPY },
+#endif
+#ifdef ZSTD
+	{ "zstd",	DUMP_DH_COMPRESSED_ZSTD },
+#endif
+	{ NULL }
+};
+
+static struct snap_compression *
+snap_compression(char *name)
+{
+	struct snap_compression *sc;
+
+	for (sc = snap_compressions; sc->name; sc++) {
+		if (STREQ(sc->name, name))
+			return sc;
+	}
+
+	error(FATAL, "unsupported compression method: %s\n", name);
+	return NULL;
+}
+
+#define SNAP_MAX_THREADS	(32)
+#define SNAP_BATCH_PAGES	(256)	/* pages read and written at once */
+#define SNAP_CLAIM_PAGES	(16)	/* pages compressed per claim */
+
+#define NOT_DUMPED		(0)	/* snap_batch state[] values */
+#define DUMP_DATA		(1)
+#define DUMP_ZERO		(2)
+
+/*
+ *  SNAP_BATCH_PAGES pages that are contiguous in physical memory.  The
+ *  main thread reads them, the compression threads compress them, and
+ *  the main thread then writes them out while reading the next batch.
+ */
+struct snap_batch {
+	ulonglong pfn;		/* of pages[0] */
+	int npages;
+	char *pages;
+	char *out;		/* compressed data, bound bytes per page */
+	uint *size;		/* compressed size, 0 to store the page as is */
+	char *state;
+};
+
+/*
+ *  Per-thread compression state.
+ */
+struct snap_compressor {
+	void *wrkmem;		/* lzo */
+	void *cctx;		/* zstd */
+};
+
+static struct snap_pool {
+	int nthreads;
+	pthread_t *threads;
+	pthread_mutex_t lock;
+	pthread_cond_t work_cv;
+	pthread_cond_t done_cv;
+	struct snap_compressor *compressors;	/* nthreads + 1 */
+	uint method;
+	uint block_size;
+	uint bound;
+	struct snap_batch *batch;	/* being compressed */
+	int next;			/* next page to be claimed */
+	int remaining;			/* pages not yet compressed */
+	ulong generation;		/* bumped when a batch is posted */
+	int exiting;
+} snap_pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.work_cv = PTHREAD_COND_INITIALIZER,
+	.done_cv = PTHREAD_COND_INITIALIZER,
+};
+
+static uint
+snap_compress_bound(uint method, uint block_size)
+{
+	switch (method)
+	{
+	case DUMP_DH_COMPRESSED_ZLIB:
+		return compressBound(block_size);
+#ifdef LZO
+	case DUMP_DH_COMPRESSED_LZO:
+		return block_size + block_size/16 + 64 + 3;
+#endif
+#ifdef SNAPPY
+	case DUMP_DH_COMPRESSED_SNAPPY:
+		return snappy_max_compressed_length(block_size);
+#endif
+#ifdef ZSTD
+	case DUMP_DH_COMPRESSED_ZSTD:
+		return ZSTD_compressBound(block_size);
+#endif
+	}
+
+	return block_size;
+}
+
+/*
+ *  Compress a page into out, and return the compressed size, or 0 if the
+ *  page does not get any smaller.  Called by the compression threads, so
+ *  nothing in here may use crash's own facilities.
+ */
+static uint
+snap_compress_page(struct snap_pool *pool, struct snap_compressor *sc,
+	char *in, char *out)
+{
+	ulong size = 0;
+
+	switch (pool->method)
+	{
+	case DUMP_DH_COMPRESSED_ZLIB: {
+		uLongf len = pool->bound;
+
+		if (compress2((Bytef *)out, &len, (Bytef *)in,
+		    pool->block_size, Z_BEST_SPEED) == Z_OK)
+			size = len;
+		break;
+	}
+#ifdef LZO
+	case DUMP_DH_COMPRESSED_LZO: {
+		lzo_uint len;
+
+		if (lzo1x_1_compress((unsigned char *)in, pool->block_size,
+		    (unsigned char *)out, &len, sc->wrkmem) == LZO_E_OK)
+			size = len;
+		break;
+	}
+#endif
+#ifdef SNAPPY
+	case DUMP_DH_COMPRESSED_SNAPPY: {
+		size_t len = pool->bound;
+
+		if (snappy_compress(in, pool->block_size, out, &len) == SNAPPY_OK)
+			size = len;
+		break;
+	}
+#endif
+#ifdef ZSTD
+	case DUMP_DH_COMPRESSED_ZSTD: {
+		size_t len;
+
+		len = ZSTD_compressCCtx(sc->cctx, out, pool->bound, in,
+			pool->block_size, 1);
+		if (!ZSTD_isError(len))
+			size = len;
+		break;
+	}
+#endif
+	}
+
+	return (size < pool->block_size) ? size : 0;
+}
+
+static int
+page_is_zero(char *page, uint block_size)
+{
+	ulong *p, *end;
+
+	for (p = (ulong *)page, end = (ulong *)(page + block_size); p < end; p++) {
+		if (*p)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ *  Claim and compress pages of the current batch until none are left.
+ *  Called and returns with the pool lock held.
+ */
+static void
+snap_run_jobs(struct snap_pool *pool, struct snap_compressor *sc)
+{
+	struct snap_batch *b;
+	int i, first, last;
+	char *page;
+
+	while (pool->batch && (pool->next < pool->batch->npages)) {
+		b = pool->batch;
+		first = pool->next;
+		last = MIN(first + SNAP_CLAIM_PAGES, b->npages);
+		pool->next = last;
+		pthread_mutex_unlock(&pool->lock);
+
+		for (i = first; i < last; i++) {
+			if (b->state[i] != DUMP_DATA)
+				continue;
+			page = b->pages + (ulong)i * pool->block_size;
+			if (page_is_zero(page, pool->block_size))
+				b->state[i] = DUMP_ZERO;
+			else if (pool->method)
+				b->size[i] = snap_compress_page(pool, sc, page,
+					b->out + (ulong)i * pool->bound);
+		}
+
+		pthread_mutex_lock(&pool->lock);
+		pool->remaining -= last - first;
+		if (pool->remaining == 0)
+			pthread_cond_signal(&pool->done_cv);
+	}
+}
+
+static void *
+snap_worker(void *arg)
+{
+	struct snap_compressor *sc = arg;
+	struct snap_pool *pool = &snap_pool;
+	ulong seen = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while ((pool->generation == seen) && !pool->exiting)
+			pthread_cond_wait(&pool->work_cv, &pool->lock);
+		if (pool->exiting)
+			break;
+		seen = pool->generation;
+		snap_run_jobs(pool, sc);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+static void
+snap_pool_init(struct snap_pool *pool, int threads, uint method)
+{
+	int i;
+	sigset_t all, saved;
+
+	pool->method = method;
+	pool->block_size = PAGESIZE();
+	pool->bound = snap_compress_bound(method, pool->block_size);
+	pool->batch = NULL;
+	pool->next = pool->remaining = 0;
+	pool->exiting = FALSE;
+	pool->nthreads = 0;
+
+	if ((pool->compressors = calloc(threads, sizeof(struct snap_compressor))) == NULL ||
+	    (pool->threads = calloc(threads, sizeof(pthread_t))) == NULL)
+		error(FATAL, "cannot malloc compression thread data\n");
+
+	for (i = 0; i < threads; i++) {
+#ifdef LZO
+		if ((method == DUMP_DH_COMPRESSED_LZO) &&
+		    !(pool->compressors[i].wrkmem = malloc(LZO1X_1_MEM_COMPRESS)))
+			error(FATAL, "cannot malloc lzo work memory\n");
+#endif
+#ifdef ZSTD
+		if ((method == DUMP_DH_COMPRESSED_ZSTD) &&
+		    !(pool->compressors[i].cctx = ZSTD_createCCtx()))
+			error(FATAL, "cannot create ZSTD_CCtx\n");
+#endif
+	}
+
+	/*
+	 *  The first compressor belongs to the main thread, which compresses
+	 *  whatever is left of a batch once it has read the next one.  The
+	 *  workers block all signals so that SIGINT gets to the main thread.
+	 */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &saved);
+	for (i = 1; i < threads; i++) {
+		if (pthread_create(&pool->threads[i], NULL, snap_worker,
+		    &pool->compressors[i]))
+			break;
+		pool->nthreads++;
+	}
+	pthread_sigmask(SIG_SETMASK, &saved, NULL);
+
+	if (CRASHDEBUG(1))
+		fprintf(fp, "snap: %d compression threads\n", pool->nthreads + 1);
+}
+
+static void
+snap_pool_fini(struct snap_pool *pool, int threads)
+{
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->exiting = TRUE;
+	pthread_cond_broadcast(&pool->work_cv);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 1; i <= pool->nthreads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	for (i = 0; i < threads; i++) {
+		free(pool->compressors[i].wrkmem);
+#ifdef ZSTD
+		if (pool->compressors[i].cctx)
+			ZSTD_freeCCtx(pool->compressors[i].cctx);
+#endif
+	}
+	free(pool->compressors);
+	free(pool->threads);
+	pool->compressors = NULL;
+	pool->threads = NULL;
+}
+
+static void
+snap_post_batch(struct snap_pool *pool, struct snap_batch *b)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->batch = b;
+	pool->next = 0;
+	pool->remaining = b->npages;
+	pool->generation++;
+	if (pool->nthreads)
+		pthread_cond_broadcast(&pool->work_cv);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static void
+snap_wait_batch(struct snap_pool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	snap_run_jobs(pool, &pool->compressors[0]);
+	while (pool->remaining)
+		pthread_cond_wait(&pool->done_cv, &pool->lock);
+	pool->batch = NULL;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+#define SET_PFN_BIT(bitmap, pfn)   ((bitmap)[(pfn) >> 3] |= (1 << ((pfn) & 7)))
+#define CLEAR_PFN_BIT(bitmap, pfn) ((bitmap)[(pfn) >> 3] &= ~(1 << ((pfn) & 7)))
+#define PFN_BIT(bitmap, pfn)       ((bitmap)[(pfn) >> 3] & (1 << ((pfn) & 7)))
+
+struct snap_free_pages {
+	char *bitmap;
+	ulonglong max_mapnr;
+	ulong chunk;		/* pages per free list entry */
+	ulong count;
+};
+
+static int
+snap_free_page(void *page, void *arg)
+{
+	struct snap_free_pages *sfp = arg;
+	physaddr_t paddr;
+	ulonglong pfn;
+	ulong i;
+
+	if (!is_page_ptr((ulong)page, &paddr))
+		return FALSE;
+
+	for (i = 0, pfn = BTOP(paddr); i < sfp->chunk; i++, pfn++) {
+		if (pfn < sfp->max_mapnr) {
+			SET_PFN_BIT(sfp->bitmap, pfn);
+			sfp->count++;
+		}
+	}
+
+	return FALSE;
+}
+
+/*
+ *  Mark the pages on the free_area lists of every zone in sfp->bitmap.
+ *  The lists keep changing underneath, so a list that cannot be walked
+ *  to its end is just used as far as it goes.
+ */
+static void
+snap_gather_free_pages(struct snap_free_pages *sfp)
+{
+	int n, z, order, t, list_count;
+	ulong node_zones, free_area, free_list, next;
+	struct list_data list_data, *ld;
+
+	if (!(vt->flags & (NODES|ZONES)) || !VALID_MEMBER(zone_free_area) ||
+	    !VALID_MEMBER(page_lru) || !VALID_STRUCT(free_area))
+		option_not_supported('f');
+
+	list_count = MEMBER_SIZE("free_area", "free_list") / SIZE(list_head);
+	if (list_count < 1)
+		list_count = 1;
+
+	ld = &list_data;
+
+	for (n = 0; n < vt->numnodes; n++) {
+		node_zones = vt->node_table[n].pgdat + OFFSET(pglist_data_node_zones);
+		for (z = 0; z < vt->nr_zones; z++) {
+			free_area = node_zones + (z * SIZE(zone)) +
+				OFFSET(zone_free_area);
+			for (order = 0; order < vt->nr_free_areas; order++,
+			     free_area += SIZE(free_area)) {
+				sfp->chunk = 1UL << order;
+				for (t = 0, free_list = free_area; t < list_count;
+				     t++, free_list += SIZE(list_head)) {
+					if (!readmem(free_list, KVADDR, &next,
+					    sizeof(ulong), "free_area free_list",
+					    QUIET|RETURN_ON_ERROR) ||
+					    !next || (next == free_list))
+						continue;
+
+					BZERO(ld, sizeof(struct list_data));
+					ld->flags = RETURN_ON_DUPLICATE|
+						RETURN_ON_LIST_ERROR|LIST_CALLBACK;
+					ld->start = next;
+					ld->end = free_list;
+					ld->list_head_offset = OFFSET(page_lru) +
+						OFFSET(list_head_next);
+					ld->callback_func = snap_free_page;
+					ld->callback_data = sfp;
+					hq_open();
+					do_list(ld);
+					hq_close();
+				}
+			}
+		}
+	}
+
+	if (CRASHDEBUG(1))
+		fprintf(fp, "snap: %ld free pages\n", sfp->count);
+}
+
+/*
+ *  Copy the VMCOREINFO note data of the running kernel, which among other
+ *  things holds the KASLR offset, into a GETBUF'd buffer.
+ */
+static char *
+get_vmcoreinfo(ulong *sizep)
+{
+	FILE *fptr;
+	ulonglong paddr;
+	ulong size;
+	char *note, *info;
+	Elf64_Nhdr *nhdr;
+	size_t desc;
+
+	if ((fptr = fopen("/sys/kernel/vmcoreinfo", "r")) == NULL)
+		return NULL;
+	if (fscanf(fptr, "%llx %lx", &paddr, &size) != 2) {
+		fclose(fptr);
+		return NULL;
+	}
+	fclose(fptr);
+
+	if (size < sizeof(Elf64_Nhdr))
+		return NULL;
+
+	note = GETBUF(size);
+	if (!readmem(paddr, PHYSADDR, note, size, "vmcoreinfo note",
+	    QUIET|RETURN_ON_ERROR)) {
+		FREEBUF(note);
+		return NULL;
+	}
+
+	/* Elf32_Nhdr and Elf64_Nhdr are the same */
+	nhdr = (Elf64_Nhdr *)note;
+	desc = sizeof(Elf64_Nhdr) + roundup(nhdr->n_namesz, 4);
+	if ((desc + nhdr->n_descsz > size) || !nhdr->n_descsz) {
+		FREEBUF(note);
+		return NULL;
+	}
+
+	info = GETBUF(nhdr->n_descsz);
+	memcpy(info, note + desc, nhdr->n_descsz);
+	*sizep = nhdr->n_descsz;
+	FREEBUF(note);
+
+	return info;
+}
+
+static int
+snap_pwrite(int fd, void *buf, size_t len, off_t offset)
+{
+	ssize_t n;
+
+	while (len) {
+		if ((n = pwrite(fd, buf, len, offset)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return FALSE;
+		}
+		buf += n;
+		len -= n;
+		offset += n;
+	}
+
+	return TRUE;
+}
+
+/*
+ *  Read the dumpable pages of a batch, a contiguous run of them at a time;
+ *  if a run cannot be read in one go, its pages are read one by one.
+ */
+static void
+snap_read_batch(struct snap_batch *b, char *dumpable)
+{
+	int i, j, k;
+	ulong bs = PAGESIZE();
+
+	for (i = 0; i < b->npages; i = j) {
+		b->size[i] = 0;
+		if (!PFN_BIT(dumpable, b->pfn + i)) {
+			b->state[i] = NOT_DUMPED;
+			j = i + 1;
+			continue;
+		}
+
+		for (j = i + 1; (j < b->npages) && PFN_BIT(dumpable, b->pfn + j); j++)
+			b->size[j] = 0;
+
+		if (readmem(PTOB(b->pfn + i), PHYSADDR, b->pages + i * bs,
+		    (j - i) * bs, "memory pages", QUIET|RETURN_ON_ERROR)) {
+			for (k = i; k < j; k++)
+				b->state[k] = DUMP_DATA;
+			continue;
+		}
+
+		for (k = i; k < j; k++) {
+			if (readmem(PTOB(b->pfn + k), PHYSADDR, b->pages + k * bs,
+			    bs, "memory page", QUIET|RETURN_ON_ERROR))
+				b->state[k] = DUMP_DATA;
+			else
+				b->state[k] = NOT_DUMPED;
+		}
+	}
+}
+
+/*
+ *  Write the page descriptors and data of a compressed batch.  Pages that
+ *  could not be read are taken out of the dumpable bitmap, which keeps
+ *  the descriptors of the remaining pages in pfn order.
+ */
+static int
+snap_write_batch(int fd, struct snap_batch *b, char *dumpable, uint method,
+	off_t pd_offset, off_t zero_offset, ulong *pages_written,
+	off_t *data_offset, char *wbuf, page_desc_t *pds)
+{
+	int i, n;
+	size_t len;
+	ulong bs = PAGESIZE();
+	uint bound = snap_compress_bound(method, bs);
+
+	for (i = n = 0, len = 0; i < b->npages; i++) {
+		switch (b->state[i])
+		{
+		case NOT_DUMPED:
+			if (PFN_BIT(dumpable, b->pfn + i))
+				CLEAR_PFN_BIT(dumpable, b->pfn + i);
+			continue;
+
+		case DUMP_ZERO:
+			pds[n].offset = zero_offset;
+			pds[n].size = bs;
+			pds[n].flags = 0;
+			break;
+
+		case DUMP_DATA:
+			pds[n].offset = *data_offset + len;
+			if (b->size[i]) {
+				memcpy(wbuf + len, b->out + (ulong)i * bound,
+					b->size[i]);
+				pds[n].size = b->size[i];
+				pds[n].flags = method;
+			} else {
+				memcpy(wbuf + len, b->pages + i * bs, bs);
+				pds[n].size = bs;
+				pds[n].flags = 0;
+			}
+			len += pds[n].size;
+			break;
+		}
+		pds[n].page_flags = 0;
+		n++;
+	}
+
+	if (len && !snap_pwrite(fd, wbuf, len, *data_offset))
+		return FALSE;
+	if (n && !snap_pwrite(fd, pds, n * sizeof(page_desc_t),
+	    pd_offset + *pages_written * sizeof(page_desc_t)))
+		return FALSE;
+
+	*data_offset += len;
+	*pages_written += n;
+
+	return TRUE;
+}
+
+/*
+ *  Take the snapshot as a compressed kdump dumpfile, which the diskdump
+ *  code can read like any other.  The main thread reads memory one batch
+ *  ahead of the compression threads, and pages filled with zeroes all
+ *  share a single copy in the dumpfile.  The headers and the bitmaps are
+ *  written last, once it is known which pages actually made it.
+ */
+static int
+write_kdump_compressed(int fd, char *filename, struct snap_compression *sc,
+	int threads, int exclude_free)
+{
+	int n, i, cur, interrupted, ok;
+	ulong bs, c, dumpable_pages, pages_written, notes_len, vmcoreinfo_len;
+	ulonglong pfn, max_mapnr, next_pfn;
+	physaddr_t paddr;
+	size_t bitmap_len, sub_len;
+	off_t pd_offset, zero_offset, data_offset;
+	char *existing, *dumpable, *sub, *vmcoreinfo, *wbuf, *zero;
+	struct disk_dump_header *dh;
+	struct kdump_sub_header *ksh;
+	struct snap_free_pages sfp;
+	struct snap_batch batch[2], *b;
+	struct node_table *nt;
+	struct snap_pool *pool = &snap_pool;
+	page_desc_t *pds;
+
+	bs = PAGESIZE();
+
+	if (!threads) {
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (threads < 1)
+			threads = 1;
+	}
+	threads = MIN(threads, SNAP_MAX_THREADS);
+
+#ifdef LZO
+	if ((sc->flag == DUMP_DH_COMPRESSED_LZO) && (lzo_init() != LZO_E_OK))
+		error(FATAL, "lzo_init() failed\n");
+#endif
+
+	for (n = 0, max_mapnr = 0; n < vt->numnodes; n++) {
+		nt = &vt->node_table[n];
+		max_mapnr = MAX(max_mapnr, BTOP(nt->start_paddr) + nt->size);
+	}
+
+	bitmap_len = roundup((max_mapnr + 7) / 8, bs);
+	existing = GETBUF(bitmap_len);
+	dumpable = GETBUF(bitmap_len);
+
+	if (exclude_free) {
+		BZERO(&sfp, sizeof(struct snap_free_pages));
+		sfp.bitmap = GETBUF(bitmap_len);
+		sfp.max_mapnr = max_mapnr;
+		snap_gather_free_pages(&sfp);
+	} else
+		sfp.bitmap = NULL;
+
+	for (n = 0, dumpable_pages = 0; n < vt->numnodes; n++) {
+		nt = &vt->node_table[n];
+		for (c = 0, paddr = nt->start_paddr; c < nt->size;
+		     c++, paddr += bs) {
+			if (!verify_paddr(paddr))
+				continue;
+			pfn = BTOP(paddr);
+			SET_PFN_BIT(existing, pfn);
+			if (sfp.bitmap && PFN_BIT(sfp.bitmap, pfn))
+				continue;
+			SET_PFN_BIT(dumpable, pfn);
+			dumpable_pages++;
+		}
+	}
+
+	if (sfp.bitmap)
+		FREEBUF(sfp.bitmap);
+
+	/*
+	 *  The sub header blocks also hold the notes and the vmcoreinfo.
+	 */
+	sub = GETBUF(bs * 2);
+	notes_len = dump_snap_notes(sub + sizeof(struct kdump_sub_header));
+	vmcoreinfo_len = 0;
+	vmcoreinfo = get_vmcoreinfo(&vmcoreinfo_len);
+	sub_len = roundup(sizeof(struct kdump_sub_header) + notes_len +
+		vmcoreinfo_len, bs);
+	if (sub_len > bs * 2) {
+		char *tmp = GETBUF(sub_len);
+		memcpy(tmp, sub, bs * 2);
+		FREEBUF(sub);
+		sub = tmp;
+	}
+	if (vmcoreinfo)
+		memcpy(sub + sizeof(struct kdump_sub_header) + notes_len,
+			vmcoreinfo, vmcoreinfo_len);
+
+	pd_offset = bs + sub_len + bitmap_len * 2;
+	zero_offset = pd_offset + (off_t)dumpable_pages * sizeof(page_desc_t);
+	data_offset = zero_offset + bs;
+
+	zero = GETBUF(bs);
+	if (!snap_pwrite(fd, zero, bs, zero_offset))
+		error(FATAL, "write to dumpfile failed\n");
+
+	for (i = 0; i < 2; i++) {
+		batch[i].pages = GETBUF(SNAP_BATCH_PAGES * bs);
+		batch[i].out = GETBUF(SNAP_BATCH_PAGES *
+			snap_compress_bound(sc->flag, bs));
+		batch[i].size = (uint *)GETBUF(SNAP_BATCH_PAGES * sizeof(uint));
+		batch[i].state = GETBUF(SNAP_BATCH_PAGES);
+		batch[i].npages = 0;
+	}
+	wbuf = GETBUF(SNAP_BATCH_PAGES * bs);
+	pds = (page_desc_t *)GETBUF(SNAP_BATCH_PAGES * sizeof(page_desc_t));
+
+	snap_pool_init(pool, threads, sc->flag);
+
+	/*
+	 *  batch[cur] is read while batch[!cur] is being compressed.
+	 */
+	pages_written = 0;
+	interrupted = FALSE;
+	ok = TRUE;
+	cur = 0;
+	next_pfn = max_mapnr;
+
+	for (n = 0; n <= vt->numnodes; n++) {
+		if (n < vt->numnodes) {
+			nt = &vt->node_table[n];
+			pfn = BTOP(nt->start_paddr);
+			c = nt->size;
+		} else
+			c = 0;
+
+		do {
+			b = &batch[cur];
+			if (c && !interrupted) {
+				b->pfn = pfn;
+				b->npages = MIN(c, SNAP_BATCH_PAGES);
+				snap_read_batch(b, dumpable);
+				pfn += b->npages;
+				c -= b->npages;
+			} else {
+				b->npages = 0;
+				c = 0;
+			}
+
+			b = &batch[!cur];
+			if (b->npages) {
+				snap_wait_batch(pool);
+				if (ok && !snap_write_batch(fd, b, dumpable,
+				    sc->flag, pd_offset, zero_offset,
+				    &pages_written, &data_offset, wbuf, pds))
+					ok = FALSE;
+				if (!interrupted &&
+				    !print_progress(filename, b->npages)) {
+					interrupted = TRUE;
+					next_pfn = batch[cur].npages ?
+						batch[cur].pfn : b->pfn + b->npages;
+				}
+				b->npages = 0;
+			}
+
+			if (batch[cur].npages) {
+				if (interrupted || !ok)
+					batch[cur].npages = 0;
+				else
+					snap_post_batch(pool, &batch[cur]);
+			}
+			cur = !cur;
+		} while (c && ok && !interrupted);
+
+		if (!ok || interrupted) {
+			/* flush the batch that may still be in progress */
+			if (batch[!cur].npages) {
+				snap_wait_batch(pool);
+				batch[!cur].npages = 0;
+			}
+			break;
+		}
+	}
+
+	snap_pool_fini(pool, threads);
+
+	if (!ok)
+		error(FATAL, "write to dumpfile failed\n");
+
+	/*
+	 *  Whatever was not written when the snapshot was interrupted is
+	 *  left out of the dumpable bitmap.
+	 */
+	if (interrupted) {
+		for (pfn = next_pfn; pfn < max_mapnr; pfn++)
+			CLEAR_PFN_BIT(dumpable, pfn);
+	}
+
+	dh = (struct disk_dump_header *)GETBUF(bs);
+	memcpy(dh->signature, KDUMP_SIGNATURE, KDUMP_SIG_LEN);
+	dh->header_version = KDUMP_HEADER_VERSION;
+	dh->utsname = kt->utsname;
+	gettimeofday(&dh->timestamp, NULL);
+	dh->status = sc->flag;
+	if (interrupted)
+		dh->status |= DUMP_DH_COMPRESSED_INCOMPLETE;
+	dh->block_size = bs;
+	dh->sub_hdr_size = sub_len / bs;
+	dh->bitmap_blocks = (bitmap_len * 2) / bs;
+	dh->max_mapnr = (uint)max_mapnr;
+	dh->current_cpu = 0;
+	dh->nr_cpus = kt->cpus;
+
+	ksh = (struct kdump_sub_header *)sub;
+#ifdef X86_64
+	ksh->phys_base = machdep->machspec->phys_base;
+#endif
+	ksh->dump_level = exclude_free ? 16 : 0;
+	ksh->start_pfn_64 = 0;
+	ksh->end_pfn_64 = max_mapnr;
+	ksh->max_mapnr_64 = max_mapnr;
+	ksh->start_pfn = (ulong)ksh->start_pfn_64;
+	ksh->end_pfn = (ulong)ksh->end_pfn_64;
+	ksh->offset_note = bs + sizeof(struct kdump_sub_header);
+	ksh->size_note = notes_len;
+	if (vmcoreinfo) {
+		ksh->offset_vmcoreinfo = ksh->offset_note + notes_len;
+		ksh->size_vmcoreinfo = vmcoreinfo_len;
+	}
+
+	if (!snap_pwrite(fd, dh, bs, 0) ||
+	    !snap_pwrite(fd, sub, sub_len, bs) ||
+	    !snap_pwrite(fd, existing, bitmap_len, bs + sub_len) ||
+	    !snap_pwrite(fd, dumpable, bitmap_len, bs + sub_len + bitmap_len))
+		error(FATAL, "write to dumpfile failed\n");
+
+	if (CRASHDEBUG(1))
+		fprintf(fp, "snap: %ld of %ld dumpable pages written\n",
+			pages_written, dumpable_pages);
+
+	for (i = 0; i < 2; i++) {
+		FREEBUF(batch[i].pages);
+		FREEBUF(batch[i].out);
+		FREEBUF(batch[i].size);
+		FREEBUF(batch[i].state);
+	}
+	FREEBUF(wbuf);
+	FREEBUF(pds);
+	FREEBUF(zero);
+	FREEBUF(dh);
+	FREEBUF(sub);
+	if (vmcoreinfo)
+		FREEBUF(vmcoreinfo);
+	FREEBUF(existing);
+	FREEBUF(dumpable);
+
+	return !interrupted;
+}
@@ -44,7 +44,10 @@ ifeq ($(shell /bin/ls ./defs.h 2> /dev/null), ./defs.h)
   INCDIR=.
 endif
 
+# the -DLZO, -DSNAPPY and -DZSTD flags that crash was built with
+COMPRESSION_CFLAGS=$(filter -DLZO -DSNAPPY -DZSTD,$(shell cat ../CFLAGS.extra 2>/dev/null))
+
 all: snap.so
 	
 snap.so: $(INCDIR)/defs.h snap.c 
-	gcc -Wall -g -I$(INCDIR) -shared -rdynamic -o snap.so snap.c -fPIC -D$(TARGET) $(TARGET_CFLAGS) $(GDB_FLAGS)
+	gcc -Wall -g -I$(INCDIR) -shared -rdynamic -o snap.so snap.c -fPIC -D$(TARGET) $(TARGET_CFLAGS) $(GDB_FLAGS) $(COMPRESSION_CFLAGS) -lpthread
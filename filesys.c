@@ -15,6 +15,7 @@
  * GNU General Public License for more details.
  */
 
+#define _GNU_SOURCE		/* fopencookie() */
 #include "defs.h"
 #include <sys/sysmacros.h>
 #include <linux/major.h>
@@ -35,6 +36,8 @@ static ulong *create_dentry_array_percpu(ulong, int *);
 static void show_fuser(char *, char *);
 static int mount_point(char *);
 static int open_file_reference(struct reference *);
+static void file_dump_record(int, ulong, ulong, ulong, char *, char *,
+	ulong, ulong, int);
 static void memory_source_init(void);
 static int get_pathname_component(ulong, ulong, int, char *, char *);
 char *inode_type(char *, char *);
@@ -50,35 +53,119 @@ static ulong get_root_vfsmount(char *);
 static void check_live_arch_mismatch(void);
 static long get_inode_nrpages(ulong);
 static void dump_inode_page_cache_info(ulong);
+static void dump_page_cache_owners(ulong);
 
-#define DENTRY_CACHE (20)
-#define INODE_CACHE  (20)
-#define FILE_CACHE   (20)
+/*
+ *  The file, dentry and inode structures read by the files, net -s and
+ *  fuser commands are kept in least-recently-used object caches that
+ *  are hashed by address.  On live systems they are cleared before each
+ *  command; with a dumpfile they persist for the session.
+ */
+#define FS_CACHE_ENTRIES (1024)
+#define FS_CACHE_HASH    (256)
+#define FS_CACHE_HASH_INDEX(addr) \
+	((((addr) >> 6) ^ ((addr) >> 14)) & (FS_CACHE_HASH-1))
 
-static struct filesys_table {
-        char *dentry_cache;
-	ulong cached_dentry[DENTRY_CACHE];
-	ulong cached_dentry_hits[DENTRY_CACHE];
-	int dentry_cache_index;
-	ulong dentry_cache_fills;
-
-        char *inode_cache;
-        ulong cached_inode[INODE_CACHE];
-        ulong cached_inode_hits[INODE_CACHE];
-        int inode_cache_index;
-        ulong inode_cache_fills;
-
-        char *file_cache;
-        ulong cached_file[FILE_CACHE];
-        ulong cached_file_hits[FILE_CACHE];
-        int file_cache_index;
-        ulong file_cache_fills;
+struct fs_object_cache {
+	char *name;
+	long size;
+	char *objects;
+	ulong addr[FS_CACHE_ENTRIES];
+	ulong hits[FS_CACHE_ENTRIES];
+	int hash_next[FS_CACHE_ENTRIES];
+	int lru_prev[FS_CACHE_ENTRIES];
+	int lru_next[FS_CACHE_ENTRIES];
+	int hash[FS_CACHE_HASH];
+	int mru, lru;
+	int used;
+	ulong fills;
+};
+
+/*
+ *  Pathnames built by get_pathname(), keyed by dentry, vfsmount and its
+ *  "full" argument.  A walk up the d_parent chain that reaches a cached
+ *  directory in the same mount is completed from that directory's path,
+ *  and the paths of the directories passed on the way are cached as
+ *  well, so that the siblings of a file share the work.
+ */
+#define PATHNAME_CACHE_HASH   (1024)
+#define PATHNAME_CACHE_MAX    (16384)
+#define PATHNAME_CACHE_LEVELS (64)
+#define PATHNAME_CACHE_INDEX(dentry, vfsmnt) \
+	((((dentry) >> 6) ^ ((vfsmnt) >> 6)) & (PATHNAME_CACHE_HASH-1))
+
+struct pathname_cache_entry {
+	struct pathname_cache_entry *next;
+	ulong dentry;
+	ulong vfsmnt;
+	int full;
+	int slash;		/* the dentry's own name is "/" */
+	char *path;
+};
+
+/*
+ *  The mount list of each mount namespace that get_mount_list() has
+ *  walked, and the members of each mount that the mount, files and
+ *  pathname code use, keyed by vfsmount address, so that crossing a
+ *  mount point or matching a mount's superblock does not read the
+ *  mount structure again.  They are kept for the session, or until the
+ *  next command on a live system.
+ */
+#define MOUNT_TABLE_HASH  (256)
+#define MOUNT_ENTRY_HASH  (16384)
+#define MOUNT_TABLE_INDEX(namespace)  (((namespace) >> 6) & (MOUNT_TABLE_HASH-1))
+#define MOUNT_ENTRY_INDEX(vfsmnt)     (((vfsmnt) >> 5) & (MOUNT_ENTRY_HASH-1))
+
+struct mount_table {
+	struct mount_table *next;
+	ulong namespace;	/* or the vfsmntlist symbol */
+	int count;
+	ulong *list;
+};
+
+struct mount_entry {
+	struct mount_entry *next;
+	ulong vfsmnt;
+	ulong devname;
+	ulong dirname;
+	ulong mnt_parent;	/* the parent's vfsmount address */
+	ulong mountpoint;
+	ulong sb;
+};
 
+static struct filesys_table {
+	struct fs_object_cache dentry_cache;
+	struct fs_object_cache inode_cache;
+	struct fs_object_cache file_cache;
+
+	struct pathname_cache_entry *pathname_cache[PATHNAME_CACHE_HASH];
+	int pathname_cache_count;
+	ulong pathname_cache_lookups;
+	ulong pathname_cache_hits;
+	ulong pathname_cache_prefix_hits;
+
+	struct mount_table *mount_tables[MOUNT_TABLE_HASH];
+	struct mount_entry *mount_entries[MOUNT_ENTRY_HASH];
+	int mount_table_count;
+	ulong mount_entry_count;
+	ulong mount_table_hits;
+	ulong mount_entry_hits;
 } filesys_table = { 0 };
 
 
 static struct filesys_table *ft = &filesys_table;
 
+static void fs_cache_init(struct fs_object_cache *, char *, long);
+static void fs_cache_clear(struct fs_object_cache *);
+static char *fs_cache_fill(struct fs_object_cache *, ulong);
+static void dump_fs_cache(struct fs_object_cache *, int);
+static struct pathname_cache_entry *pathname_cache_lookup(ulong, ulong, int);
+static void pathname_cache_enter(ulong, ulong, int, int, char *, int);
+static void clear_pathname_cache(void);
+static ulong *mount_table_get(ulong, int *);
+static struct mount_entry *mount_entry_get(ulong);
+static void clear_mount_cache(void);
+
 /*
  *  Open the namelist, dumpfile and output devices.
  */
@@ -1007,6 +1094,248 @@ is_directory(char *file)
 }
 
 
+/*
+ *  While "mod -S" locates the object file of each installed module, the
+ *  same directory trees would otherwise be walked by a find command up to
+ *  three times per module.  Between directory_index_start() and
+ *  directory_index_flush(), each tree is instead read once into an index
+ *  of the pathnames it contains, in the same order that find would list
+ *  them, and search_directory_tree() looks the file up there.
+ */
+#define DIR_INDEX_HASH      (1024)
+#define DIR_INDEX_MAX_DEPTH (64)
+
+struct dir_index_entry {
+	char *path;
+	char *name;			/* basename of path */
+	long next;			/* hash chain, -1 terminated */
+};
+
+struct dir_index {
+	char *directory;
+	int follow_links;
+	long count;
+	long size;
+	struct dir_index_entry *entries;
+	long hash[DIR_INDEX_HASH];
+	struct dir_index *next;
+};
+
+static struct directory_index_data {
+	ulong cmdgen;
+	int active;
+	struct dir_index *indexes;
+	ulong trees;
+	ulong lookups;
+} directory_index = { 0 };
+
+static ulong
+dir_index_hash(char *name)
+{
+	ulong hash = 5381;
+
+	while (*name)
+		hash = ((hash << 5) + hash) + (unsigned char)*name++;
+
+	return hash % DIR_INDEX_HASH;
+}
+
+/*
+ *  Add a pathname to the index, linking it into its hash chain only if it
+ *  is the first with its basename, since find would report that one.
+ */
+static int
+dir_index_add(struct dir_index *di, char *path)
+{
+	struct dir_index_entry *entries, *de;
+	ulong hash;
+	long i;
+
+	if (di->count == di->size) {
+		if (!(entries = realloc(di->entries,
+		    sizeof(struct dir_index_entry) * (di->size + 1024))))
+			return FALSE;
+		di->entries = entries;
+		di->size += 1024;
+	}
+
+	de = &di->entries[di->count];
+	de->path = path;
+	de->name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+	de->next = -1;
+
+	hash = dir_index_hash(de->name);
+	for (i = di->hash[hash]; i >= 0; i = di->entries[i].next) {
+		if (STREQ(di->entries[i].name, de->name))
+			break;
+		if (di->entries[i].next < 0) {
+			di->entries[i].next = di->count;
+			break;
+		}
+	}
+	if (di->hash[hash] < 0)
+		di->hash[hash] = di->count;
+
+	di->count++;
+	return TRUE;
+}
+
+/*
+ *  Walk a directory tree depth-first in readdir() order, as find does.
+ *  When following symbolic links, directories that are already being
+ *  walked further up are skipped so that link loops terminate.
+ */
+static void
+dir_index_walk(struct dir_index *di, char *directory, int depth,
+	struct stat *ancestors)
+{
+	DIR *dirp;
+	struct dirent *dp;
+	struct stat sbuf;
+	char *path;
+	int i, loop;
+
+	if ((depth >= DIR_INDEX_MAX_DEPTH) || !(dirp = opendir(directory)))
+		return;
+
+	while ((dp = readdir(dirp))) {
+		if (STREQ(dp->d_name, ".") || STREQ(dp->d_name, ".."))
+			continue;
+
+		if (!(path = malloc(strlen(directory) + strlen(dp->d_name) + 2)))
+			break;
+		sprintf(path, "%s%s%s", directory,
+			LASTCHAR(directory) == '/' ? "" : "/", dp->d_name);
+		if (!dir_index_add(di, path)) {
+			free(path);
+			break;
+		}
+
+		if ((di->follow_links ? stat(path, &sbuf) :
+		    lstat(path, &sbuf)) || !S_ISDIR(sbuf.st_mode))
+			continue;
+
+		for (i = loop = 0; i < depth; i++) {
+			if ((ancestors[i].st_dev == sbuf.st_dev) &&
+			    (ancestors[i].st_ino == sbuf.st_ino))
+				loop = TRUE;
+		}
+		if (loop)
+			continue;
+
+		ancestors[depth] = sbuf;
+		dir_index_walk(di, path, depth+1, ancestors);
+	}
+
+	closedir(dirp);
+}
+
+static struct dir_index *
+get_directory_index(char *directory, int follow_links)
+{
+	struct dir_index *di;
+	struct stat ancestors[DIR_INDEX_MAX_DEPTH+1];
+	int i;
+
+	for (di = directory_index.indexes; di; di = di->next) {
+		if ((di->follow_links == follow_links) &&
+		    STREQ(di->directory, directory))
+			return di;
+	}
+
+	if (!(di = calloc(1, sizeof(struct dir_index))) ||
+	    !(di->directory = strdup(directory))) {
+		free(di);
+		return NULL;
+	}
+	di->follow_links = follow_links;
+	for (i = 0; i < DIR_INDEX_HASH; i++)
+		di->hash[i] = -1;
+
+	if (stat(directory, &ancestors[0]) == 0)
+		dir_index_walk(di, directory, 1, ancestors);
+
+	di->next = directory_index.indexes;
+	directory_index.indexes = di;
+	directory_index.trees++;
+
+	if (CRASHDEBUG(1))
+		fprintf(fp, "directory index: %s: %ld entries\n",
+			directory, di->count);
+
+	return di;
+}
+
+static char *
+search_directory_index(char *directory, char *file, int follow_links)
+{
+	struct dir_index *di;
+	char *start, *end, *retbuf;
+	regex_t regex;
+	long i;
+
+	if (!(di = get_directory_index(directory, follow_links)))
+		return NULL;
+
+	directory_index.lookups++;
+	retbuf = NULL;
+
+	if ((start = strstr(file, "[")) && (end = strstr(file, "]")) &&
+	    (start < end) && (regcomp(&regex, file, 0) == 0)) {
+		for (i = 0; i < di->count; i++) {
+			if (regexec(&regex, di->entries[i].name, 0,
+			    NULL, 0) == 0)
+				break;
+		}
+		regfree(&regex);
+	} else {
+		for (i = di->hash[dir_index_hash(file)]; i >= 0;
+		     i = di->entries[i].next) {
+			if (STREQ(di->entries[i].name, file))
+				break;
+		}
+	}
+
+	if ((i >= 0) && (i < di->count)) {
+		retbuf = GETBUF(strlen(di->entries[i].path)+1);
+		strcpy(retbuf, di->entries[i].path);
+	}
+
+	return retbuf;
+}
+
+void
+directory_index_start(void)
+{
+	directory_index_flush();
+	directory_index.active = TRUE;
+	directory_index.cmdgen = pc->cmdgencur;
+}
+
+void
+directory_index_flush(void)
+{
+	struct dir_index *di;
+	long i;
+
+	if (directory_index.active && CRASHDEBUG(1))
+		fprintf(fp, "directory index: %ld trees indexed, %ld lookups\n",
+			directory_index.trees, directory_index.lookups);
+
+	directory_index.trees = directory_index.lookups = 0;
+
+	while ((di = directory_index.indexes)) {
+		directory_index.indexes = di->next;
+		for (i = 0; i < di->count; i++)
+			free(di->entries[i].path);
+		free(di->entries);
+		free(di->directory);
+		free(di);
+	}
+
+	directory_index.active = FALSE;
+}
+
 /*
  *  Search a directory tree for filename, and if found, return a temporarily
  *  allocated buffer containing the full pathname.   The "done" business is
@@ -1024,6 +1353,13 @@ search_directory_tree(char *directory, char *file, int follow_links)
 	regex_t regex;
 	int regex_used, done;
 
+	if (directory_index.active &&
+	    (directory_index.cmdgen == pc->cmdgencur)) {
+		if (!is_directory(directory) || (*file == '('))
+			return NULL;
+		return search_directory_index(directory, file, follow_links);
+	}
+
 	if (!file_exists("/usr/bin/find", NULL) || 
 	    !file_exists("/bin/echo", NULL) ||
 	    !is_directory(directory) ||
@@ -1092,6 +1428,160 @@ is_a_tty(char *filename)
         return FALSE;
 }
 
+/*
+ *  The temporary files are kept in memory: a FILE opened with
+ *  fopencookie() on a growable buffer, which supports the same writes,
+ *  rewind(), fseek(), ftell() and fgets() as a file, but never touches
+ *  the disk.  If one cannot be created, tmpfile() is used instead.
+ */
+struct memory_tmpfile {
+	char *data;
+	size_t size;			/* bytes of data */
+	size_t alloc;			/* bytes allocated */
+	off64_t pos;
+};
+
+#define MEMORY_TMPFILE_KEEP	(1024 * 1024)
+
+static struct memory_tmpfile *tmp_fp_buffer = NULL;
+
+static ssize_t
+memory_tmpfile_read(void *cookie, char *buf, size_t size)
+{
+	struct memory_tmpfile *mt = (struct memory_tmpfile *)cookie;
+
+	if (mt->pos >= mt->size)
+		return 0;
+	size = MIN(size, mt->size - mt->pos);
+	memcpy(buf, mt->data + mt->pos, size);
+	mt->pos += size;
+
+	return size;
+}
+
+static ssize_t
+memory_tmpfile_write(void *cookie, const char *buf, size_t size)
+{
+	struct memory_tmpfile *mt = (struct memory_tmpfile *)cookie;
+	size_t alloc;
+	char *data;
+
+	if (mt->pos + size > mt->alloc) {
+		for (alloc = MAX(mt->alloc, BUFSIZE); alloc < mt->pos + size; )
+			alloc *= 2;
+		if (!(data = realloc(mt->data, alloc))) {
+			errno = ENOSPC;
+			return -1;
+		}
+		mt->data = data;
+		mt->alloc = alloc;
+	}
+
+	if (mt->pos > mt->size)
+		BZERO(mt->data + mt->size, mt->pos - mt->size);
+	memcpy(mt->data + mt->pos, buf, size);
+	mt->pos += size;
+	if (mt->pos > mt->size)
+		mt->size = mt->pos;
+
+	return size;
+}
+
+static int
+memory_tmpfile_seek(void *cookie, off64_t *offset, int whence)
+{
+	struct memory_tmpfile *mt = (struct memory_tmpfile *)cookie;
+	off64_t pos;
+
+	switch (whence)
+	{
+	case SEEK_SET:
+		pos = *offset;
+		break;
+	case SEEK_CUR:
+		pos = mt->pos + *offset;
+		break;
+	case SEEK_END:
+		pos = mt->size + *offset;
+		break;
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (pos < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	*offset = mt->pos = pos;
+	return 0;
+}
+
+static int
+memory_tmpfile_close(void *cookie)
+{
+	struct memory_tmpfile *mt = (struct memory_tmpfile *)cookie;
+
+	if (mt == tmp_fp_buffer)
+		tmp_fp_buffer = NULL;
+	free(mt->data);
+	free(mt);
+
+	return 0;
+}
+
+static FILE *
+open_memory_tmpfile(struct memory_tmpfile **mtp)
+{
+	cookie_io_functions_t funcs;
+	struct memory_tmpfile *mt;
+	FILE *fptr;
+
+	funcs.read = memory_tmpfile_read;
+	funcs.write = memory_tmpfile_write;
+	funcs.seek = memory_tmpfile_seek;
+	funcs.close = memory_tmpfile_close;
+
+	if (!(mt = calloc(1, sizeof(struct memory_tmpfile))))
+		return tmpfile();
+
+	if (!(fptr = fopencookie(mt, "w+", funcs))) {
+		free(mt);
+		return tmpfile();
+	}
+
+	if (mtp)
+		*mtp = mt;
+
+	return fptr;
+}
+
+/*
+ *  Empty the primary tmpfile for its next use, releasing the memory of
+ *  an unusually large one.
+ */
+static void
+truncate_tmp_fp(void)
+{
+	int ret ATTRIBUTE_UNUSED;
+	struct memory_tmpfile *mt;
+
+	fflush(pc->tmp_fp);
+
+	if ((mt = tmp_fp_buffer)) {
+		mt->size = 0;
+		if (mt->alloc > MEMORY_TMPFILE_KEEP) {
+			free(mt->data);
+			mt->data = NULL;
+			mt->alloc = 0;
+		}
+	} else
+		ret = ftruncate(fileno(pc->tmp_fp), 0);
+
+	rewind(pc->tmp_fp);
+}
+
 /*
  *  Open a tmpfile for command output.  fp is stashed in pc->saved_fp, and
  *  temporarily set to the new FILE pointer.  This allows a command to still
@@ -1104,19 +1594,16 @@ is_a_tty(char *filename)
 void
 open_tmpfile(void)
 {
-	int ret ATTRIBUTE_UNUSED;
-
         if (pc->tmpfile)
                 error(FATAL, "recursive temporary file usage\n");
 
 	if (!pc->tmp_fp) {
-        	if ((pc->tmp_fp = tmpfile()) == NULL) 
+        	if ((pc->tmp_fp = open_memory_tmpfile(&tmp_fp_buffer)) == NULL) 
                 	error(FATAL, "cannot open temporary file\n");
 	}
 
 	fflush(pc->tmpfile);
-	ret = ftruncate(fileno(pc->tmp_fp), 0);
-	rewind(pc->tmp_fp);
+	truncate_tmp_fp();
 
 	pc->tmpfile = pc->tmp_fp;
 	pc->saved_fp = fp;
@@ -1129,7 +1616,7 @@ open_tmpfile(void)
         if (pc->tmpfile)
                 error(FATAL, "recursive temporary file usage\n");
 
-        if ((pc->tmpfile = tmpfile()) == NULL) {
+        if ((pc->tmpfile = open_memory_tmpfile(NULL)) == NULL) {
                 error(FATAL, "cannot open temporary file\n");
         } else {
                 pc->saved_fp = fp;
@@ -1146,12 +1633,8 @@ open_tmpfile(void)
 void
 close_tmpfile(void)
 {
-	int ret ATTRIBUTE_UNUSED;
-
 	if (pc->tmpfile) {
-		fflush(pc->tmpfile);
-		ret = ftruncate(fileno(pc->tmpfile), 0);
-		rewind(pc->tmpfile);
+		truncate_tmp_fp();
 		pc->tmpfile = NULL;
 		fp = pc->saved_fp;
 	} else 
@@ -1186,7 +1669,7 @@ open_tmpfile2(void)
         if (pc->tmpfile2)
                 error(FATAL, "recursive secondary temporary file usage\n");
                 
-        if ((pc->tmpfile2 = tmpfile()) == NULL)
+        if ((pc->tmpfile2 = open_memory_tmpfile(NULL)) == NULL)
                 error(FATAL, "cannot open secondary temporary file\n");
         
         rewind(pc->tmpfile2);
@@ -1385,7 +1868,7 @@ show_mounts(ulong one_vfsmount, int flags, struct task_context *namespace_contex
 	char buf4[BUFSIZE/2];
 	ulong *dentry_list, *dp, *mntlist;
 	ulong *vfsmnt;
-	char *vfsmount_buf, *super_block_buf, *mount_buf;
+	char *super_block_buf;
 	ulong dentry, inode, inode_sb, mnt_parent;
 	char *dentry_buf, *inode_buf;
 	int cnt, i, m, files_header_printed;
@@ -1393,6 +1876,7 @@ show_mounts(ulong one_vfsmount, int flags, struct task_context *namespace_contex
 	int devlen;
 	char mount_files_header[BUFSIZE];
 	long per_cpu_s_files;
+	struct mount_entry *me;
 
         sprintf(mount_files_header, "%s%s%s%sTYPE%sPATH\n",
                 mkstring(buf1, VADDR_PRLEN, CENTER|LJUST, "DENTRY"),
@@ -1453,44 +1937,16 @@ show_mounts(ulong one_vfsmount, int flags, struct task_context *namespace_contex
 			&cnt);
 	}
 
-	if (VALID_STRUCT(mount)) {
-		mount_buf = GETBUF(SIZE(mount));
-		vfsmount_buf = mount_buf + OFFSET(mount_mnt);
-	} else {
-		mount_buf = NULL;
-		vfsmount_buf = GETBUF(SIZE(vfsmount));
-	}
 	super_block_buf = GETBUF(SIZE(super_block));
 
 	for (m = 0, vfsmnt = mntlist; m < mount_cnt; m++, vfsmnt++) {
-		if (VALID_STRUCT(mount)) {
-			readmem(*vfsmnt, KVADDR, mount_buf, SIZE(mount),
-				"mount buffer", FAULT_ON_ERROR);
-			devp = ULONG(mount_buf +  OFFSET(mount_mnt_devname));
-		} else {
-			readmem(*vfsmnt, KVADDR, vfsmount_buf, SIZE(vfsmount),
-				"vfsmount buffer", FAULT_ON_ERROR);
-			devp = ULONG(vfsmount_buf +  OFFSET(vfsmount_mnt_devname));
-		}
-
-		if (VALID_MEMBER(vfsmount_mnt_dirname)) {
-			dirp = ULONG(vfsmount_buf +  
-				OFFSET(vfsmount_mnt_dirname)); 
-		} else {
-			if (VALID_STRUCT(mount)) {
-				mnt_parent = ULONG(mount_buf + 
-					OFFSET(mount_mnt_parent));
-				dentry = ULONG(mount_buf +  
-					OFFSET(mount_mnt_mountpoint));
-			} else {
-				mnt_parent = ULONG(vfsmount_buf + 
-					OFFSET(vfsmount_mnt_parent));
-				dentry = ULONG(vfsmount_buf +  
-					OFFSET(vfsmount_mnt_mountpoint));
-			}
-		}
-
-		sbp = ULONG(vfsmount_buf + OFFSET(vfsmount_mnt_sb)); 
+		me = mount_entry_get(VALID_STRUCT(mount) ?
+			*vfsmnt + OFFSET(mount_mnt) : *vfsmnt);
+		devp = me->devname;
+		dirp = me->dirname;
+		mnt_parent = me->mnt_parent;
+		dentry = me->mountpoint;
+		sbp = me->sb;
 
 		if (flags)
 			fprintf(fp, "%s", mount_hdr);
@@ -1530,8 +1986,7 @@ show_mounts(ulong one_vfsmount, int flags, struct task_context *namespace_contex
                 	else
                         	fprintf(fp, "%-10s\n", "(unknown)");
 		} else {
-			get_pathname(dentry, buf1, BUFSIZE, 1, VALID_STRUCT(mount) ?
-				mnt_parent + OFFSET(mount_mnt) : mnt_parent);
+			get_pathname(dentry, buf1, BUFSIZE, 1, mnt_parent);
                        	fprintf(fp, "%-10s\n", buf1);
 		}
 
@@ -1596,15 +2051,13 @@ show_mounts(ulong one_vfsmount, int flags, struct task_context *namespace_contex
 
 	if (!one_vfsmount)
 		FREEBUF(mntlist); 
-	if (VALID_STRUCT(mount))
-		FREEBUF(mount_buf);
-	else
-		FREEBUF(vfsmount_buf);
 	FREEBUF(super_block_buf);
 }
 
 /*
  *  Allocate and fill a list of the currently-mounted vfsmount pointers.
+ *  The list of each namespace is walked once, and then copied from the
+ *  mount table cache.
  */
 ulong *
 get_mount_list(int *cntptr, struct task_context *namespace_context)
@@ -1612,12 +2065,17 @@ get_mount_list(int *cntptr, struct task_context *namespace_context)
 	struct list_data list_data, *ld;
 	ulong namespace, root, nsproxy, mnt_ns;
 	struct task_context *tc;
+	struct mount_table *mt;
+	ulong *list;
 	
         ld = &list_data;
         BZERO(ld, sizeof(struct list_data));
 	ld->flags |= LIST_ALLOCATE;
 
 	if (symbol_exists("vfsmntlist")) {
+		namespace = symbol_value("vfsmntlist");
+		if ((list = mount_table_get(namespace, cntptr)))
+			return list;
         	get_symbol_data("vfsmntlist", sizeof(void *), &ld->start);
                	ld->end = symbol_value("vfsmntlist");
 	} else if (VALID_MEMBER(task_struct_nsproxy)) {
@@ -1630,6 +2088,9 @@ get_mount_list(int *cntptr, struct task_context *namespace_context)
 			&mnt_ns, sizeof(void *), "nsproxy mnt_ns", 
 			RETURN_ON_ERROR|QUIET))
 			error(FATAL, "cannot determine mount list location!\n");
+		namespace = mnt_ns;
+		if ((list = mount_table_get(namespace, cntptr)))
+			return list;
         	if (!readmem(mnt_ns + OFFSET(mnt_namespace_root), KVADDR, 
 			&root, sizeof(void *), "mnt_namespace root", 
 			RETURN_ON_ERROR|QUIET))
@@ -1644,6 +2105,8 @@ get_mount_list(int *cntptr, struct task_context *namespace_context)
         	readmem(tc->task + OFFSET(task_struct_namespace), KVADDR, 
 			&namespace, sizeof(void *), "task namespace", 
 			FAULT_ON_ERROR);
+		if ((list = mount_table_get(namespace, cntptr)))
+			return list;
         	if (!readmem(namespace + OFFSET(namespace_root), KVADDR, 
 			&root, sizeof(void *), "namespace root", 
 			RETURN_ON_ERROR|QUIET))
@@ -1666,9 +2129,135 @@ get_mount_list(int *cntptr, struct task_context *namespace_context)
                 ld->member_offset = OFFSET(vfsmount_mnt_next);
         
         *cntptr = do_list(ld);
+
+	if ((*cntptr > 0) &&
+	    (mt = malloc(sizeof(struct mount_table) + (*cntptr * sizeof(ulong))))) {
+		mt->namespace = namespace;
+		mt->count = *cntptr;
+		mt->list = (ulong *)(mt + 1);
+		BCOPY(ld->list_ptr, mt->list, *cntptr * sizeof(ulong));
+		mt->next = ft->mount_tables[MOUNT_TABLE_INDEX(namespace)];
+		ft->mount_tables[MOUNT_TABLE_INDEX(namespace)] = mt;
+		ft->mount_table_count++;
+	}
+
         return(ld->list_ptr);
 }
 
+/*
+ *  Return a copy of the cached mount list of a namespace, or NULL if it
+ *  has not been walked.
+ */
+static ulong *
+mount_table_get(ulong namespace, int *cntptr)
+{
+	struct mount_table *mt;
+	ulong *list;
+
+	for (mt = ft->mount_tables[MOUNT_TABLE_INDEX(namespace)]; mt;
+	     mt = mt->next) {
+		if (mt->namespace == namespace) {
+			list = (ulong *)GETBUF(mt->count * sizeof(ulong));
+			BCOPY(mt->list, list, mt->count * sizeof(ulong));
+			*cntptr = mt->count;
+			ft->mount_table_hits++;
+			return list;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ *  Return the cached members of the mount whose vfsmount is at vfsmnt,
+ *  reading its mount (or vfsmount) structure on first use.
+ */
+static struct mount_entry *
+mount_entry_get(ulong vfsmnt)
+{
+	struct mount_entry *me;
+	char *mount_buf, *vfsmount_buf;
+	int index;
+
+	index = MOUNT_ENTRY_INDEX(vfsmnt);
+	for (me = ft->mount_entries[index]; me; me = me->next) {
+		if (me->vfsmnt == vfsmnt) {
+			ft->mount_entry_hits++;
+			return me;
+		}
+	}
+
+	if (VALID_STRUCT(mount)) {
+		mount_buf = GETBUF(SIZE(mount));
+		readmem(vfsmnt - OFFSET(mount_mnt), KVADDR, mount_buf,
+			SIZE(mount), "mount buffer", FAULT_ON_ERROR);
+	} else {
+		mount_buf = GETBUF(SIZE(vfsmount));
+		readmem(vfsmnt, KVADDR, mount_buf, SIZE(vfsmount),
+			"vfsmount buffer", FAULT_ON_ERROR);
+	}
+
+	if (!(me = calloc(1, sizeof(struct mount_entry))))
+		error(FATAL, "cannot allocate mount cache entry\n");
+
+	if (VALID_STRUCT(mount)) {
+		vfsmount_buf = mount_buf + OFFSET(mount_mnt);
+		me->devname = ULONG(mount_buf + OFFSET(mount_mnt_devname));
+		if (VALID_MEMBER(mount_mnt_parent))
+			me->mnt_parent = ULONG(mount_buf +
+				OFFSET(mount_mnt_parent)) + OFFSET(mount_mnt);
+		if (VALID_MEMBER(mount_mnt_mountpoint))
+			me->mountpoint = ULONG(mount_buf +
+				OFFSET(mount_mnt_mountpoint));
+	} else {
+		vfsmount_buf = mount_buf;
+		me->devname = ULONG(vfsmount_buf + OFFSET(vfsmount_mnt_devname));
+		if (VALID_MEMBER(vfsmount_mnt_dirname))
+			me->dirname = ULONG(vfsmount_buf +
+				OFFSET(vfsmount_mnt_dirname));
+		if (VALID_MEMBER(vfsmount_mnt_parent))
+			me->mnt_parent = ULONG(vfsmount_buf +
+				OFFSET(vfsmount_mnt_parent));
+		if (VALID_MEMBER(vfsmount_mnt_mountpoint))
+			me->mountpoint = ULONG(vfsmount_buf +
+				OFFSET(vfsmount_mnt_mountpoint));
+	}
+	me->sb = ULONG(vfsmount_buf + OFFSET(vfsmount_mnt_sb));
+	FREEBUF(mount_buf);
+
+	me->vfsmnt = vfsmnt;
+	me->next = ft->mount_entries[index];
+	ft->mount_entries[index] = me;
+	ft->mount_entry_count++;
+
+	return me;
+}
+
+static void
+clear_mount_cache(void)
+{
+	struct mount_table *mt, *mtnext;
+	struct mount_entry *me, *menext;
+	int i;
+
+	for (i = 0; i < MOUNT_TABLE_HASH; i++) {
+		for (mt = ft->mount_tables[i]; mt; mt = mtnext) {
+			mtnext = mt->next;
+			free(mt);
+		}
+		ft->mount_tables[i] = NULL;
+	}
+	for (i = 0; i < MOUNT_ENTRY_HASH; i++) {
+		for (me = ft->mount_entries[i]; me; me = menext) {
+			menext = me->next;
+			free(me);
+		}
+		ft->mount_entries[i] = NULL;
+	}
+	ft->mount_table_count = 0;
+	ft->mount_entry_count = 0;
+}
+
 
 /*
  *  Given a dentry, display its address, inode, super_block, pathname.
@@ -1677,8 +2266,8 @@ static void
 display_dentry_info(ulong dentry)
 {
 	int m, found;
-        char *dentry_buf, *inode_buf, *vfsmount_buf, *mount_buf;
-        ulong inode, superblock, sb, vfs;
+        char *dentry_buf, *inode_buf;
+        ulong inode, superblock, vfs;
 	ulong *mntlist, *vfsmnt;
 	char pathname[BUFSIZE];
 	char buf1[BUFSIZE];
@@ -1712,55 +2301,27 @@ display_dentry_info(ulong dentry)
 
         if (VALID_MEMBER(file_f_vfsmnt)) {
 		mntlist = get_mount_list(&mount_cnt, pid_to_context(1));
-		if (VALID_STRUCT(mount)) {
-			mount_buf = GETBUF(SIZE(mount));
-			vfsmount_buf = mount_buf + OFFSET(mount_mnt);
-		} else {
-			mount_buf = NULL;
-			vfsmount_buf = GETBUF(SIZE(vfsmount));
-		}
 
         	for (m = found = 0, vfsmnt = mntlist; 
 		     m < mount_cnt; m++, vfsmnt++) {
-			if (VALID_STRUCT(mount))
-				readmem(*vfsmnt, KVADDR, mount_buf, SIZE(mount),
-					"mount buffer", FAULT_ON_ERROR);
-			else
-				readmem(*vfsmnt, KVADDR, vfsmount_buf, SIZE(vfsmount),
-					"vfsmount buffer", FAULT_ON_ERROR);
-                	sb = ULONG(vfsmount_buf + OFFSET(vfsmount_mnt_sb));
-			if (superblock && (sb == superblock)) {
-                		get_pathname(dentry, pathname, BUFSIZE, 1,
-					VALID_STRUCT(mount) ?
-					*vfsmnt+OFFSET(mount_mnt) : *vfsmnt);
+			vfs = VALID_STRUCT(mount) ?
+				*vfsmnt + OFFSET(mount_mnt) : *vfsmnt;
+			if (superblock && (mount_entry_get(vfs)->sb == superblock)) {
+                		get_pathname(dentry, pathname, BUFSIZE, 1, vfs);
 				found = TRUE;
 			}
 		}
 
 		if (!found && symbol_exists("pipe_mnt")) {
 			get_symbol_data("pipe_mnt", sizeof(long), &vfs);
-			if (VALID_STRUCT(mount))
-				readmem(vfs - OFFSET(mount_mnt), KVADDR, mount_buf, SIZE(mount),
-					"mount buffer", FAULT_ON_ERROR);
-			else
-				readmem(vfs, KVADDR, vfsmount_buf, SIZE(vfsmount),
-					"vfsmount buffer", FAULT_ON_ERROR);
-                        sb = ULONG(vfsmount_buf + OFFSET(vfsmount_mnt_sb));
-                        if (superblock && (sb == superblock)) {
+                        if (superblock && (mount_entry_get(vfs)->sb == superblock)) {
                                 get_pathname(dentry, pathname, BUFSIZE, 1, vfs);
                                 found = TRUE;
                         }
 		}
 		if (!found && symbol_exists("sock_mnt")) {
 			get_symbol_data("sock_mnt", sizeof(long), &vfs);
-			if (VALID_STRUCT(mount))
-				readmem(vfs - OFFSET(mount_mnt), KVADDR, mount_buf, SIZE(mount),
-					"mount buffer", FAULT_ON_ERROR);
-			else
-				readmem(vfs, KVADDR, vfsmount_buf, SIZE(vfsmount),
-					"vfsmount buffer", FAULT_ON_ERROR);
-                        sb = ULONG(vfsmount_buf + OFFSET(vfsmount_mnt_sb));
-                        if (superblock && (sb == superblock)) {
+                        if (superblock && (mount_entry_get(vfs)->sb == superblock)) {
                                 get_pathname(dentry, pathname, BUFSIZE, 1, vfs);
                                 found = TRUE;
                         }
@@ -1770,13 +2331,8 @@ display_dentry_info(ulong dentry)
         	get_pathname(dentry, pathname, BUFSIZE, 1, 0);
 	}
 
-	if (mntlist) {
+	if (mntlist)
 		FREEBUF(mntlist);
-		if (VALID_STRUCT(mount))
-			FREEBUF(mount_buf);
-		else
-			FREEBUF(vfsmount_buf);
-	}
 
 nopath:
 	fprintf(fp, "%s%s%s%s%s%s%s%s%s\n",
@@ -2026,6 +2582,11 @@ vfs_init(void)
 	MEMBER_OFFSET_INIT(inode_i_op, "inode", "i_op");
 	MEMBER_OFFSET_INIT(inode_i_sb, "inode", "i_sb");
 	MEMBER_OFFSET_INIT(inode_u, "inode", "u");
+	MEMBER_OFFSET_INIT(inode_i_dentry, "inode", "i_dentry");
+	MEMBER_OFFSET_INIT(dentry_d_alias, "dentry", "d_alias");
+	if (INVALID_MEMBER(dentry_d_alias))	/* d_alias is first in d_u */
+		MEMBER_OFFSET_INIT(dentry_d_alias, "dentry", "d_u");
+	MEMBER_OFFSET_INIT(address_space_host, "address_space", "host");
 	MEMBER_OFFSET_INIT(qstr_name, "qstr", "name");
 	MEMBER_OFFSET_INIT(qstr_len, "qstr", "len");
 	if (INVALID_MEMBER(qstr_len))
@@ -2090,12 +2651,9 @@ vfs_init(void)
 	STRUCT_SIZE_INIT(fs_struct, "fs_struct");
 	STRUCT_SIZE_INIT(super_block, "super_block");
 
-	if (!(ft->file_cache = (char *)malloc(SIZE(file)*FILE_CACHE)))
-		error(FATAL, "cannot malloc file cache\n");
-	if (!(ft->dentry_cache = (char *)malloc(SIZE(dentry)*DENTRY_CACHE)))
-		error(FATAL, "cannot malloc dentry cache\n");
-	if (!(ft->inode_cache = (char *)malloc(SIZE(inode)*INODE_CACHE)))
-		error(FATAL, "cannot malloc inode cache\n");
+	fs_cache_init(&ft->file_cache, "file", SIZE(file));
+	fs_cache_init(&ft->dentry_cache, "dentry", SIZE(dentry));
+	fs_cache_init(&ft->inode_cache, "inode", SIZE(inode));
 
 	MEMBER_OFFSET_INIT(rb_root_rb_node, 
 		"rb_root","rb_node");
@@ -2108,65 +2666,147 @@ vfs_init(void)
 void
 dump_filesys_table(int verbose)
 {
-	int i;
-	ulong fhits, dhits, ihits;
-
-	if (!verbose)
-		goto show_hit_rates;
-
-        for (i = 0; i < FILE_CACHE; i++)
-                fprintf(fp, "   cached_file[%2d]: %lx (%ld)\n",
-                        i, ft->cached_file[i],
-                        ft->cached_file_hits[i]);
-        fprintf(fp, "        file_cache: %lx\n", (ulong)ft->file_cache);
-        fprintf(fp, "  file_cache_index: %d\n", ft->file_cache_index);
-        fprintf(fp, "  file_cache_fills: %ld\n", ft->file_cache_fills);
-
-	for (i = 0; i < DENTRY_CACHE; i++)
-		fprintf(fp, "  cached_dentry[%2d]: %lx (%ld)\n", 
-			i, ft->cached_dentry[i],
-			ft->cached_dentry_hits[i]);
-	fprintf(fp, "      dentry_cache: %lx\n", (ulong)ft->dentry_cache);
-	fprintf(fp, "dentry_cache_index: %d\n", ft->dentry_cache_index);
-	fprintf(fp, "dentry_cache_fills: %ld\n", ft->dentry_cache_fills);
-
-        for (i = 0; i < INODE_CACHE; i++)
-                fprintf(fp, "  cached_inode[%2d]: %lx (%ld)\n",
-                        i, ft->cached_inode[i],
-                        ft->cached_inode_hits[i]);
-        fprintf(fp, "       inode_cache: %lx\n", (ulong)ft->inode_cache);
-        fprintf(fp, " inode_cache_index: %d\n", ft->inode_cache_index);
-        fprintf(fp, " inode_cache_fills: %ld\n", ft->inode_cache_fills);
-
-show_hit_rates:
-        if (ft->file_cache_fills) {
-                for (i = fhits = 0; i < FILE_CACHE; i++)
-                        fhits += ft->cached_file_hits[i];
-
-                fprintf(fp, "     file hit rate: %2ld%% (%ld of %ld)\n",
-                        (fhits * 100)/ft->file_cache_fills,
-                        fhits, ft->file_cache_fills);
-	} 
-
-        if (ft->dentry_cache_fills) {
-                for (i = dhits = 0; i < DENTRY_CACHE; i++)
-                        dhits += ft->cached_dentry_hits[i];
+	dump_fs_cache(&ft->file_cache, verbose);
+	dump_fs_cache(&ft->dentry_cache, verbose);
+	dump_fs_cache(&ft->inode_cache, verbose);
+
+	if (verbose)
+		fprintf(fp, "   pathname_cache: %d of %d entries\n",
+			ft->pathname_cache_count, PATHNAME_CACHE_MAX);
+	if (ft->pathname_cache_lookups)
+		fprintf(fp, " pathname hit rate: %2ld%% (%ld of %ld, %ld prefix)\n",
+			(ft->pathname_cache_hits * 100)/ft->pathname_cache_lookups,
+			ft->pathname_cache_hits, ft->pathname_cache_lookups,
+			ft->pathname_cache_prefix_hits);
+	if (verbose || ft->mount_table_count)
+		fprintf(fp, "      mount_cache: %d namespaces, %ld mounts "
+			"(%ld list hits, %ld mount hits)\n",
+			ft->mount_table_count, ft->mount_entry_count,
+			ft->mount_table_hits, ft->mount_entry_hits);
+}
 
-		fprintf(fp, "   dentry hit rate: %2ld%% (%ld of %ld)\n",
-			(dhits * 100)/ft->dentry_cache_fills,
-			dhits, ft->dentry_cache_fills);
+static void
+dump_fs_cache(struct fs_object_cache *fc, int verbose)
+{
+	int i;
+	ulong hits;
+
+	if (!fc->objects)
+		return;
+
+	if (verbose) {
+		for (i = fc->mru; i >= 0; i = fc->lru_next[i])
+			if (fc->addr[i])
+				fprintf(fp, "%8s_cache[%4d]: %lx (%ld)\n",
+					fc->name, i, fc->addr[i], fc->hits[i]);
+		fprintf(fp, "%12s_cache: %lx\n", fc->name, (ulong)fc->objects);
+		fprintf(fp, "%6s_cache_entries: %d of %d\n", fc->name,
+			fc->used, FS_CACHE_ENTRIES);
+		fprintf(fp, "%8s_cache_fills: %ld\n", fc->name, fc->fills);
 	}
 
-        if (ft->inode_cache_fills) {
-                for (i = ihits = 0; i < INODE_CACHE; i++)
-                        ihits += ft->cached_inode_hits[i];
+	if (fc->fills) {
+		for (i = hits = 0; i < fc->used; i++)
+			hits += fc->hits[i];
 
-		fprintf(fp, "    inode hit rate: %2ld%% (%ld of %ld)\n",
-                        (ihits * 100)/ft->inode_cache_fills,
-                        ihits, ft->inode_cache_fills);
+		fprintf(fp, "%10s hit rate: %2ld%% (%ld of %ld)\n",
+			fc->name, (hits * 100)/fc->fills, hits, fc->fills);
 	}
 }
 
+/*
+ *  Return a dentry of an inode from its i_dentry alias list, or 0.
+ */
+static ulong
+inode_to_dentry(ulong inode, char *inode_buf)
+{
+	ulong first;
+
+	if (INVALID_MEMBER(inode_i_dentry) || INVALID_MEMBER(dentry_d_alias))
+		return 0;
+
+	first = ULONG(inode_buf + OFFSET(inode_i_dentry));
+	if (!first || (first == (inode + OFFSET(inode_i_dentry))))
+		return 0;
+
+	return (first - OFFSET(dentry_d_alias));
+}
+
+/*
+ *  files -C: display the address_space structures that own the most
+ *  pages in the page cache, as counted by a single scan of the mem_map.
+ *  A count of 0 displays all of them.
+ */
+static void
+dump_page_cache_owners(ulong count)
+{
+	struct mapping_pages *mp;
+	int i, cnt;
+	ulong total, inode, dentry, nrpages;
+	char *inode_buf, *type;
+	char pathname[BUFSIZE];
+	char buf1[BUFSIZE];
+	char buf2[BUFSIZE];
+	char buf3[BUFSIZE];
+
+	cnt = page_cache_mapping_counts(&mp, &total);
+	if (!count || (count > cnt))
+		count = cnt;
+
+	inode_buf = GETBUF(SIZE(inode));
+
+	fprintf(fp, "%s%s%s%s   PAGES  NRPAGES%sTYPE%sPATH\n",
+		mkstring(buf1, MAX(VADDR_PRLEN, strlen("ADDRESS_SPACE")),
+		CENTER|LJUST, "ADDRESS_SPACE"),
+		space(MINSPACE),
+		mkstring(buf2, VADDR_PRLEN, CENTER|LJUST, "INODE"),
+		space(MINSPACE),
+		space(MINSPACE),
+		space(MINSPACE));
+
+	for (i = 0; i < count; i++) {
+		inode = nrpages = 0;
+		type = "N/A ";
+		pathname[0] = NULLCHAR;
+
+		if (!readmem(mp[i].mapping + OFFSET(address_space_host), KVADDR,
+		    &inode, sizeof(void *), "address_space host",
+		    RETURN_ON_ERROR|QUIET))
+			inode = 0;
+		if (VALID_MEMBER(address_space_nrpages) &&
+		    !readmem(mp[i].mapping + OFFSET(address_space_nrpages),
+		    KVADDR, &nrpages, sizeof(ulong), "address_space nrpages",
+		    RETURN_ON_ERROR|QUIET))
+			nrpages = 0;
+
+		if (inode && readmem(inode, KVADDR, inode_buf, SIZE(inode),
+		    "inode buffer", RETURN_ON_ERROR|QUIET)) {
+			if ((dentry = inode_to_dentry(inode, inode_buf)))
+				get_pathname(dentry, pathname, BUFSIZE, 1, 0);
+			type = inode_type(inode_buf, pathname);
+		}
+
+		fprintf(fp, "%s%s%s%s%8ld %8ld%s%s%s%s\n",
+			mkstring(buf1, MAX(VADDR_PRLEN, strlen("ADDRESS_SPACE")),
+			LJUST|LONG_HEX, MKSTR(mp[i].mapping)),
+			space(MINSPACE),
+			mkstring(buf2, VADDR_PRLEN, LJUST|LONG_HEX, MKSTR(inode)),
+			space(MINSPACE),
+			mp[i].pages, nrpages,
+			space(MINSPACE), type,
+			space(MINSPACE), pathname);
+	}
+
+	fprintf(fp, "\n%ld pages (%s) in %d address_space structures",
+		total, pages_to_size(total, buf3), cnt);
+	if (count < cnt)
+		fprintf(fp, ", %ld shown", count);
+	fprintf(fp, "\n");
+
+	FREEBUF(inode_buf);
+	FREEBUF(mp);
+}
+
 /*
  * Get the page count for the specific mapping
  */
@@ -2272,7 +2912,7 @@ cmd_files(void)
         ref = NULL;
         refarg = NULL;
 
-        while ((c = getopt(argcnt, args, "d:R:p:c")) != EOF) {
+        while ((c = getopt(argcnt, args, "d:R:p:cC:")) != EOF) {
                 switch(c)
 		{
 		case 'R':
@@ -2308,6 +2948,15 @@ cmd_files(void)
 				option_not_supported('c');
 			break;
 
+		case 'C':
+			if (VALID_MEMBER(address_space_host) &&
+			    VALID_MEMBER(page_mapping)) {
+				value = dtol(optarg, FAULT_ON_ERROR, NULL);
+				dump_page_cache_owners(value);
+			} else
+				option_not_supported('C');
+			return;
+
 		default:
 			argerrs++;
 			break;
@@ -2342,7 +2991,8 @@ cmd_files(void)
                                 if (!ref)
                                         print_task_header(fp, tc, subsequent);
                                 open_files_dump(tc->task, open_flags, ref);
-                                fprintf(fp, "\n");
+				if (ref || !STRUCTURED_OUTPUT())
+					fprintf(fp, "\n");
                         }
                         break;
 
@@ -2386,6 +3036,169 @@ cmd_files(void)
 
 
 
+/*
+ *  Set up a walk of the open file descriptors of the files_struct at
+ *  files_struct_addr, which is shared by open_files_dump() and the net
+ *  command's dump_sockets_workhorse().  Returns FALSE if the task has
+ *  no file descriptor table to walk.
+ */
+int
+open_task_fds(ulong files_struct_addr, struct task_fds *tf)
+{
+	char *files_struct_buf, *fdtable_buf;
+	ulong open_fds_addr;
+	long open_fds_size, lim;
+
+	BZERO(tf, sizeof(struct task_fds));
+
+	if (!(tf->files_struct = files_struct_addr))
+		return FALSE;
+
+	files_struct_buf = GETBUF(SIZE(files_struct));
+	fdtable_buf = NULL;
+
+	readmem(files_struct_addr, KVADDR, files_struct_buf,
+		SIZE(files_struct), "files_struct buffer", FAULT_ON_ERROR);
+
+	if (VALID_MEMBER(files_struct_max_fdset)) {
+		tf->max_fdset = INT(files_struct_buf +
+			OFFSET(files_struct_max_fdset));
+		tf->max_fds = INT(files_struct_buf +
+			OFFSET(files_struct_max_fds));
+	}
+
+	if (VALID_MEMBER(files_struct_fdt)) {
+		tf->fdtable = ULONG(files_struct_buf + OFFSET(files_struct_fdt));
+
+		if (tf->fdtable) {
+			fdtable_buf = GETBUF(SIZE(fdtable));
+			readmem(tf->fdtable, KVADDR, fdtable_buf,
+				SIZE(fdtable), "fdtable buffer", FAULT_ON_ERROR);
+			if (VALID_MEMBER(fdtable_max_fdset))
+				tf->max_fdset = INT(fdtable_buf +
+					OFFSET(fdtable_max_fdset));
+			else
+				tf->max_fdset = -1;
+			tf->max_fds = INT(fdtable_buf + OFFSET(fdtable_max_fds));
+		}
+	}
+
+	if ((VALID_MEMBER(files_struct_fdt) && !tf->fdtable) ||
+	    (tf->max_fdset == 0) || (tf->max_fds == 0))
+		goto no_fds;
+
+	if (VALID_MEMBER(fdtable_open_fds))
+		open_fds_addr = ULONG(fdtable_buf + OFFSET(fdtable_open_fds));
+	else
+		open_fds_addr = ULONG(files_struct_buf +
+			OFFSET(files_struct_open_fds));
+
+	if (VALID_MEMBER(fdtable_fd))
+		tf->fd = ULONG(fdtable_buf + OFFSET(fdtable_fd));
+	else
+		tf->fd = ULONG(files_struct_buf + OFFSET(files_struct_fd));
+
+	if (!open_fds_addr || !tf->fd)
+		goto no_fds;
+
+	/*
+	 *  Only the bitmap words below max_fdset and max_fds are looked at.
+	 */
+	lim = (tf->max_fdset >= 0) ? MIN(tf->max_fdset, tf->max_fds) :
+		tf->max_fds;
+	tf->limit = roundup(lim, BITS_PER_LONG);
+
+	open_fds_size = MAX(tf->max_fdset, tf->max_fds) / BITS_PER_BYTE;
+	tf->open_fds = (ulong *)GETBUF(MAX(open_fds_size,
+		tf->limit / BITS_PER_BYTE));
+
+	if (VALID_MEMBER(files_struct_open_fds_init) &&
+	    (open_fds_addr == (files_struct_addr +
+	    OFFSET(files_struct_open_fds_init))))
+		BCOPY(files_struct_buf + OFFSET(files_struct_open_fds_init),
+			tf->open_fds, open_fds_size);
+	else
+		readmem(open_fds_addr, KVADDR, tf->open_fds,
+			open_fds_size, "fdtable open_fds", FAULT_ON_ERROR);
+
+	tf->files = (ulong *)GETBUF(sizeof(ulong) * TASK_FDS_CHUNK);
+
+	if (fdtable_buf)
+		FREEBUF(fdtable_buf);
+	FREEBUF(files_struct_buf);
+
+	return TRUE;
+
+no_fds:
+	if (fdtable_buf)
+		FREEBUF(fdtable_buf);
+	FREEBUF(files_struct_buf);
+
+	return FALSE;
+}
+
+/*
+ *  Return the next open file descriptor number, and its file pointer in
+ *  *file, or -1 when there are no more.  Descriptors with a NULL file
+ *  pointer are skipped.  The fd[] entries are read in chunks of
+ *  TASK_FDS_CHUNK, falling back to reading a single entry if the chunk
+ *  cannot be read in its entirety or lies beyond max_fds.
+ */
+int
+next_task_fd(struct task_fds *tf, ulong *file)
+{
+	long i, chunk, count;
+	ulong set;
+
+	while (tf->next < tf->limit) {
+		i = tf->next;
+		set = tf->open_fds[i / BITS_PER_LONG] >> (i % BITS_PER_LONG);
+		if (!set) {
+			tf->next = roundup(i + 1, BITS_PER_LONG);
+			continue;
+		}
+		tf->next++;
+		if (!(set & 1))
+			continue;
+
+		if ((i < tf->files_base) ||
+		    (i >= (tf->files_base + tf->files_count))) {
+			chunk = (i / TASK_FDS_CHUNK) * TASK_FDS_CHUNK;
+			count = MIN(TASK_FDS_CHUNK, tf->max_fds - chunk);
+			tf->files_count = 0;
+			if ((count > 0) &&
+			    readmem(tf->fd + chunk*sizeof(struct file *), KVADDR,
+			    tf->files, count*sizeof(struct file *), "fd file",
+			    RETURN_ON_ERROR|QUIET)) {
+				tf->files_base = chunk;
+				tf->files_count = count;
+			}
+		}
+
+		if (tf->files_count)
+			*file = tf->files[i - tf->files_base];
+		else
+			readmem(tf->fd + i*sizeof(struct file *), KVADDR,
+				file, sizeof(struct file *), "fd file",
+				FAULT_ON_ERROR);
+
+		if (*file)
+			return (int)i;
+	}
+
+	return -1;
+}
+
+void
+close_task_fds(struct task_fds *tf)
+{
+	if (tf->open_fds)
+		FREEBUF(tf->open_fds);
+	if (tf->files)
+		FREEBUF(tf->files);
+	tf->open_fds = tf->files = NULL;
+}
+
 /*
  *  open_files_dump() does the work for cmd_files().
  */
@@ -2395,23 +3208,16 @@ open_files_dump(ulong task, int flags, struct reference *ref)
 {
         struct task_context *tc;
 	ulong files_struct_addr; 
-	ulong fdtable_addr = 0;
-	char *files_struct_buf, *fdtable_buf = NULL;
+	struct task_fds tf;
 	ulong fs_struct_addr;
 	char *dentry_buf, *fs_struct_buf;
 	char *ret ATTRIBUTE_UNUSED;
 	ulong root_dentry, pwd_dentry;
 	ulong root_inode, pwd_inode;
 	ulong vfsmnt;
-	int max_fdset = 0;
-	int max_fds = 0;
-	ulong open_fds_addr;
-	int open_fds_size;
-	ulong *open_fds;
-	ulong fd;
 	ulong file;
 	ulong value;
-	int i, j, use_path;
+	int i, use_path;
 	int header_printed = 0;
 	char root_pathname[BUFSIZE];
 	char pwd_pathname[BUFSIZE];
@@ -2423,12 +3229,10 @@ open_files_dump(ulong task, int flags, struct reference *ref)
 	char root_pwd[BUFSIZE*4];
 	int root_pwd_printed = 0;
 	int file_dump_flags = 0;
+	int records;
 
 	BZERO(root_pathname, BUFSIZE);
 	BZERO(pwd_pathname, BUFSIZE);
-	files_struct_buf = GETBUF(SIZE(files_struct));
-	if (VALID_STRUCT(fdtable))
-		fdtable_buf = GETBUF(SIZE(fdtable));
 	fill_task_struct(task);
 
 	if (flags & PRINT_NRPAGES) {
@@ -2458,6 +3262,8 @@ open_files_dump(ulong task, int flags, struct reference *ref)
 	if (ref) 
 		ref->cmdflags = 0;
 
+	records = STRUCTURED_OUTPUT() && !ref && !(flags & PRINT_INODES);
+
 	fs_struct_addr = ULONG(tt->task_struct + OFFSET(task_struct_fs));
 
         if (fs_struct_addr) {
@@ -2534,6 +3340,12 @@ open_files_dump(ulong task, int flags, struct reference *ref)
 				root_pwd_printed = TRUE;
 				ref->cmdflags |= FILES_REF_FOUND;
 			}
+		} else if (records) {
+			record_begin("task_fs");
+			record_long("pid", tc->pid);
+			record_string("root", root_pathname);
+			record_string("cwd", pwd_pathname);
+			record_end();
 		} else
 			fprintf(fp, "ROOT: %s    CWD: %s\n", 
 				root_pathname, pwd_pathname);
@@ -2543,46 +3355,12 @@ open_files_dump(ulong task, int flags, struct reference *ref)
 
 	files_struct_addr = ULONG(tt->task_struct + OFFSET(task_struct_files));
 
-	if (files_struct_addr) {
-		readmem(files_struct_addr, KVADDR, files_struct_buf,
-			SIZE(files_struct), "files_struct buffer",
-			FAULT_ON_ERROR);
-	
-		if (VALID_MEMBER(files_struct_max_fdset)) {
-			max_fdset = INT(files_struct_buf +
-			OFFSET(files_struct_max_fdset));
-
-			max_fds = INT(files_struct_buf +
-			OFFSET(files_struct_max_fds));
-		}
-	}
-
-	if (VALID_MEMBER(files_struct_fdt)) {
-		fdtable_addr = ULONG(files_struct_buf + OFFSET(files_struct_fdt));
-
-		if (fdtable_addr) {
-			readmem(fdtable_addr, KVADDR, fdtable_buf,
-	 			SIZE(fdtable), "fdtable buffer", FAULT_ON_ERROR); 
-			if (VALID_MEMBER(fdtable_max_fdset))
-				max_fdset = INT(fdtable_buf +
-					OFFSET(fdtable_max_fdset));
-			else
-				max_fdset = -1;
-			max_fds = INT(fdtable_buf +
-        	                OFFSET(fdtable_max_fds));
-		}
-	}
-
-	if ((VALID_MEMBER(files_struct_fdt) && !fdtable_addr) || 
-	    !files_struct_addr || max_fdset == 0 || max_fds == 0) {
+	if (!open_task_fds(files_struct_addr, &tf)) {
 		if (ref) {
 			if (ref->cmdflags & FILES_REF_FOUND)
 				fprintf(fp, "\n");
-		} else
+		} else if (!records)
 			fprintf(fp, "No open files\n");
-		if (fdtable_buf)
-			FREEBUF(fdtable_buf);
-		FREEBUF(files_struct_buf);
 		return;
 	}
 
@@ -2592,7 +3370,7 @@ open_files_dump(ulong task, int flags, struct reference *ref)
                         ref->cmdflags |= FILES_REF_HEXNUM;
                 } else {
 			value = dtol(ref->str, FAULT_ON_ERROR, NULL);
-			if (value <= MAX(max_fdset, max_fds)) {
+			if (value <= MAX(tf.max_fdset, tf.max_fds)) {
                               	ref->decval = value;
                                	ref->cmdflags |= FILES_REF_DECNUM;
 			} else {
@@ -2603,106 +3381,46 @@ open_files_dump(ulong task, int flags, struct reference *ref)
 		}
         }
 
-	if (VALID_MEMBER(fdtable_open_fds))
-		open_fds_addr = ULONG(fdtable_buf +
-			OFFSET(fdtable_open_fds));
-	else
-		open_fds_addr = ULONG(files_struct_buf +
-			OFFSET(files_struct_open_fds));
-
-	open_fds_size = MAX(max_fdset, max_fds) / BITS_PER_BYTE;	
-	open_fds = (ulong *)GETBUF(open_fds_size);
-	if (!open_fds) {
-		if (fdtable_buf)
-			FREEBUF(fdtable_buf);
-		FREEBUF(files_struct_buf);
-		return;
-	}
-
-	if (open_fds_addr) {
-		if (VALID_MEMBER(files_struct_open_fds_init) && 
-		    (open_fds_addr == (files_struct_addr + 
-		    OFFSET(files_struct_open_fds_init)))) 
-			BCOPY(files_struct_buf + 
-			        OFFSET(files_struct_open_fds_init),
-				open_fds, open_fds_size);
-		else
-			readmem(open_fds_addr, KVADDR, open_fds,
-				open_fds_size, "fdtable open_fds",
-				FAULT_ON_ERROR);
-	} 
-
-	if (VALID_MEMBER(fdtable_fd))
-		fd = ULONG(fdtable_buf + OFFSET(fdtable_fd));
-	else
-		fd = ULONG(files_struct_buf + OFFSET(files_struct_fd));
-
-	if (!open_fds_addr || !fd) {
-                if (ref && (ref->cmdflags & FILES_REF_FOUND))
-                	fprintf(fp, "\n");
-		if (fdtable_buf)
-			FREEBUF(fdtable_buf);
-		FREEBUF(files_struct_buf);
-		FREEBUF(open_fds);
-		return;
-	}
-
 	file_dump_flags = DUMP_FULL_NAME | DUMP_EMPTY_FILE;
 	if (flags & PRINT_NRPAGES)
 		file_dump_flags |= DUMP_FILE_NRPAGES;
+	if (records)
+		file_dump_flags |= DUMP_FILE_RECORD;
 
-	j = 0;
-	for (;;) {
-		unsigned long set;
-		i = j * BITS_PER_LONG;
-		if (((max_fdset >= 0) && (i >= max_fdset)) || 
-		    (i >= max_fds))
-			 break;
-		set = open_fds[j++];
-		while (set) {
-			if (set & 1) {
-        			readmem(fd + i*sizeof(struct file *), KVADDR, 
-					&file, sizeof(struct file *), 
-					"fd file", FAULT_ON_ERROR);
-
-				if (ref && file) {
-					open_tmpfile();
-                                        if (file_dump(file, 0, 0, i, file_dump_flags)) {
-						BZERO(buf4, BUFSIZE);
-						rewind(pc->tmpfile);
-						ret = fgets(buf4, BUFSIZE, 
-							pc->tmpfile);
-						close_tmpfile();
-						ref->refp = buf4;
-						if (open_file_reference(ref)) { 
-							PRINT_FILE_REFERENCE();
-						}
-					} else
-						close_tmpfile();
-				}
-				else if (file) {
-					if (!header_printed) {
-						fprintf(fp, "%s", files_header);
-						header_printed = 1;
-					}
-					file_dump(file, 0, 0, i, file_dump_flags);
+	while ((i = next_task_fd(&tf, &file)) >= 0) {
+		if (ref) {
+			open_tmpfile();
+			if (file_dump(file, 0, 0, i, file_dump_flags)) {
+				BZERO(buf4, BUFSIZE);
+				rewind(pc->tmpfile);
+				ret = fgets(buf4, BUFSIZE, pc->tmpfile);
+				close_tmpfile();
+				ref->refp = buf4;
+				if (open_file_reference(ref)) {
+					PRINT_FILE_REFERENCE();
 				}
+			} else
+				close_tmpfile();
+		} else if (records) {
+			record_begin("file");
+			record_long("pid", tc->pid);
+			file_dump(file, 0, 0, i, file_dump_flags);
+		} else {
+			if (!header_printed) {
+				fprintf(fp, "%s", files_header);
+				header_printed = 1;
 			}
-			i++;
-			set >>= 1;
+			file_dump(file, 0, 0, i, file_dump_flags);
 		}
 	}
 
-	if (!header_printed && !ref)
+	if (!header_printed && !ref && !records)
 		fprintf(fp, "No open files\n");
 
 	if (ref && (ref->cmdflags & FILES_REF_FOUND))
 		fprintf(fp, "\n");
 
-	if (fdtable_buf)
-		FREEBUF(fdtable_buf);
-	FREEBUF(files_struct_buf);
-	FREEBUF(open_fds);
+	close_task_fds(&tf);
 }
 
 /*
@@ -2892,6 +3610,10 @@ file_dump(ulong file, ulong dentry, ulong inode, int fd, int flags)
 	}
 
 	if (!dentry) {
+		if (flags & DUMP_FILE_RECORD) {
+			file_dump_record(fd, file, 0, 0, NULL, NULL, 0, 0, flags);
+			return TRUE;
+		}
 		if (flags & DUMP_EMPTY_FILE) {
 			fprintf(fp, "%3d%s%s%s%s%s%s%s%s%s%s\n",
 				fd,
@@ -2922,6 +3644,11 @@ file_dump(ulong file, ulong dentry, ulong inode, int fd, int flags)
 	}
 
 	if (!inode) { 
+		if (flags & DUMP_FILE_RECORD) {
+			file_dump_record(fd, file, dentry, 0, NULL, NULL, 0, 0,
+				flags);
+			return TRUE;
+		}
 		if (flags & DUMP_EMPTY_FILE) {
 			fprintf(fp, "%3d%s%s%s%s%s%s%s%s%s%s\n",
 				fd,
@@ -2969,6 +3696,16 @@ file_dump(ulong file, ulong dentry, ulong inode, int fd, int flags)
 	else
 		printpath = pathname+1;
 
+	if (flags & DUMP_FILE_RECORD) {
+		if (flags & DUMP_FILE_NRPAGES) {
+			i_mapping = ULONG(inode_buf + OFFSET(inode_i_mapping));
+			nrpages = get_inode_nrpages(i_mapping);
+		}
+		file_dump_record(fd, file, dentry, inode, type, printpath,
+			i_mapping, nrpages, flags);
+		return TRUE;
+	}
+
 	if (flags & DUMP_INODE_ONLY) {
 		fprintf(fp, "%s%s%s%s%s\n",
 			mkstring(buf1, VADDR_PRLEN, 
@@ -3039,6 +3776,36 @@ file_dump(ulong file, ulong dentry, ulong inode, int fd, int flags)
 	return TRUE;
 }
 
+/*
+ *  Complete the record of an open file that was begun by the caller,
+ *  for DUMP_FILE_RECORD.  A missing dentry, inode, type or path, shown
+ *  as "?" by the text output, is left out of the record.
+ */
+static void
+file_dump_record(int fd, ulong file, ulong dentry, ulong inode, char *type,
+		 char *path, ulong i_mapping, ulong nrpages, int flags)
+{
+	char buf[BUFSIZE];
+
+	record_long("fd", fd);
+	record_hex("file", file);
+	if (dentry)
+		record_hex("dentry", dentry);
+	if (inode)
+		record_hex("inode", inode);
+	if ((flags & DUMP_FILE_NRPAGES) && inode) {
+		record_hex("i_mapping", i_mapping);
+		record_ulong("nrpages", nrpages);
+	}
+	if (type) {
+		strlcpy(buf, type, BUFSIZE);
+		record_string("type", clean_line(buf));
+	}
+	if (path)
+		record_string("path", path);
+	record_end();
+}
+
 /*
  *  Get the dentry associated with a file.
  */
@@ -3079,32 +3846,50 @@ get_pathname(ulong dentry, char *pathname, int length, int full, ulong vfsmnt)
 	ulong tmp_dentry, parent;
 	int d_name_len = 0;
 	ulong d_name_name;
-	ulong tmp_vfsmnt, mnt_parent;
-	char *dentry_buf, *vfsmnt_buf, *mnt_buf;
+	ulong tmp_vfsmnt;
+	char *dentry_buf;
+	struct pathname_cache_entry *pce;
+	struct mount_entry *me;
+	struct pathname_level {
+		ulong dentry;
+		int tail;
+		int slash;
+	} levels[PATHNAME_CACHE_LEVELS];
+	int i, len, nlevels, cacheable, same_mount;
 
 	BZERO(buf, BUFSIZE);
 	BZERO(tmpname, BUFSIZE);
 	BZERO(pathname, length);
-	if (VALID_STRUCT(mount)) {
-		if (VALID_MEMBER(mount_mnt_mountpoint)) {
-			mnt_buf = GETBUF(SIZE(mount));
-			vfsmnt_buf = mnt_buf + OFFSET(mount_mnt);
-		} else {
-			mnt_buf = NULL;
-			vfsmnt_buf = NULL;
-		}
-	} else {
-		mnt_buf = NULL;
-		vfsmnt_buf = VALID_MEMBER(vfsmount_mnt_mountpoint) ? 
-			GETBUF(SIZE(vfsmount)) : NULL;
+
+	if ((pce = pathname_cache_lookup(dentry, vfsmnt, full))) {
+		strncpy(pathname, pce->path, length-1);
+		return;
 	}
 
 	parent = dentry;
 	tmp_vfsmnt = vfsmnt;
+	nlevels = 0;
+	cacheable = same_mount = TRUE;
 
 	do {
 		tmp_dentry = parent;
 
+		/*
+		 *  Complete the walk from a cached ancestor's pathname.  The
+		 *  path built so far must not have crossed a mount point, and
+		 *  must not have been limited to BUFSIZE.
+		 */
+		if ((tmp_dentry != dentry) && same_mount && cacheable &&
+		    (pathname[0] != '/') &&
+		    (pce = pathname_cache_lookup(tmp_dentry, tmp_vfsmnt, full)) &&
+		    (strlen(pce->path) + strlen(pathname) + 2 < BUFSIZE)) {
+			strncpy(tmpname, pathname, BUFSIZE-1);
+			sprintf(pathname, "%s%s%s", pce->path,
+				pce->slash ? "" : "/", tmpname);
+			ft->pathname_cache_prefix_hits++;
+			break;
+		}
+
 		dentry_buf = fill_dentry_cache(tmp_dentry);
 
 		d_name_len = INT(dentry_buf +
@@ -3134,48 +3919,39 @@ get_pathname(ulong dentry, char *pathname, int length, int full, ulong vfsmnt)
 					sprintf(pathname, 
 						"%s%s", buf, tmpname);
 				}
-			}
+			} else
+				cacheable = FALSE;
 		} else {
 			strncpy(pathname, buf, BUFSIZE);
 		}
 
+		/*
+		 *  Until a mount point is crossed, this dentry's own pathname
+		 *  is what the final pathname will be, less the part that was
+		 *  added by the dentries below it.
+		 */
+		if (same_mount && (nlevels < PATHNAME_CACHE_LEVELS)) {
+			levels[nlevels].dentry = tmp_dentry;
+			levels[nlevels].tail = strlen(pathname) - strlen(buf);
+			levels[nlevels].slash = (d_name_len == 1) && STREQ(buf, "/");
+			nlevels++;
+		}
+
 		parent = ULONG(dentry_buf + OFFSET(dentry_d_parent)); 
 			
 		if (tmp_dentry == parent && full) {
-			if (VALID_MEMBER(vfsmount_mnt_mountpoint)) {
+			same_mount = FALSE;
+			if (VALID_MEMBER(vfsmount_mnt_mountpoint) ||
+			    VALID_STRUCT(mount)) {
 				if (tmp_vfsmnt) {
 					if (strncmp(pathname, "//", 2) == 0)
 						shift_string_left(pathname, 1);
-                                        readmem(tmp_vfsmnt, KVADDR, vfsmnt_buf,
-						SIZE(vfsmount), 
-						"vfsmount buffer", 
-						FAULT_ON_ERROR);
-        				parent = ULONG(vfsmnt_buf + 
-					    OFFSET(vfsmount_mnt_mountpoint));
-        				mnt_parent = ULONG(vfsmnt_buf + 
-					    OFFSET(vfsmount_mnt_parent));
-					if (tmp_vfsmnt == mnt_parent)
+					me = mount_entry_get(tmp_vfsmnt);
+					parent = me->mountpoint;
+					if (tmp_vfsmnt == me->mnt_parent)
 						break;
 					else
-						tmp_vfsmnt = mnt_parent;
-				}
-			} else if (VALID_STRUCT(mount)) {
-				if (tmp_vfsmnt) {
-					if (strncmp(pathname, "//", 2) == 0)
-						shift_string_left(pathname, 1);
-                                        readmem(tmp_vfsmnt - OFFSET(mount_mnt),
-						KVADDR, mnt_buf,
-						SIZE(mount), 
-						"mount buffer", 
-						FAULT_ON_ERROR);
-        				parent = ULONG(mnt_buf + 
-					    OFFSET(mount_mnt_mountpoint));
-        				mnt_parent = ULONG(mnt_buf + 
-					    OFFSET(mount_mnt_parent));
-					if ((tmp_vfsmnt - OFFSET(mount_mnt)) == mnt_parent)
-						break;
-					else
-						tmp_vfsmnt = mnt_parent + OFFSET(mount_mnt);
+						tmp_vfsmnt = me->mnt_parent;
 				}
 			}
 			else {
@@ -3186,10 +3962,87 @@ get_pathname(ulong dentry, char *pathname, int length, int full, ulong vfsmnt)
 						
 	} while (tmp_dentry != parent && parent);
 
-	if (mnt_buf)
-		FREEBUF(mnt_buf);
-	else if (vfsmnt_buf)
-		FREEBUF(vfsmnt_buf);
+	if (cacheable) {
+		len = strlen(pathname);
+		for (i = 0; i < nlevels; i++) {
+			if (levels[i].tail < len)
+				pathname_cache_enter(levels[i].dentry, vfsmnt,
+					full, levels[i].slash, pathname,
+					len - levels[i].tail);
+		}
+	}
+}
+
+static struct pathname_cache_entry *
+pathname_cache_lookup(ulong dentry, ulong vfsmnt, int full)
+{
+	struct pathname_cache_entry *pce;
+
+	ft->pathname_cache_lookups++;
+
+	for (pce = ft->pathname_cache[PATHNAME_CACHE_INDEX(dentry, vfsmnt)];
+	     pce; pce = pce->next) {
+		if ((pce->dentry == dentry) && (pce->vfsmnt == vfsmnt) &&
+		    (pce->full == full)) {
+			ft->pathname_cache_hits++;
+			return pce;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ *  Cache the first len characters of path as the pathname of dentry.
+ *  When the cache fills up, it is emptied and starts over.
+ */
+static void
+pathname_cache_enter(ulong dentry, ulong vfsmnt, int full, int slash,
+		     char *path, int len)
+{
+	struct pathname_cache_entry *pce;
+	int index;
+
+	index = PATHNAME_CACHE_INDEX(dentry, vfsmnt);
+	for (pce = ft->pathname_cache[index]; pce; pce = pce->next)
+		if ((pce->dentry == dentry) && (pce->vfsmnt == vfsmnt) &&
+		    (pce->full == full))
+			return;
+
+	if (ft->pathname_cache_count >= PATHNAME_CACHE_MAX)
+		clear_pathname_cache();
+
+	if (!(pce = (struct pathname_cache_entry *)
+	    malloc(sizeof(struct pathname_cache_entry) + len + 1)))
+		return;
+
+	pce->dentry = dentry;
+	pce->vfsmnt = vfsmnt;
+	pce->full = full;
+	pce->slash = slash;
+	pce->path = (char *)(pce + 1);
+	strncpy(pce->path, path, len);
+	pce->path[len] = NULLCHAR;
+
+	pce->next = ft->pathname_cache[index];
+	ft->pathname_cache[index] = pce;
+	ft->pathname_cache_count++;
+}
+
+static void
+clear_pathname_cache(void)
+{
+	struct pathname_cache_entry *pce, *next;
+	int i;
+
+	for (i = 0; i < PATHNAME_CACHE_HASH; i++) {
+		for (pce = ft->pathname_cache[i]; pce; pce = next) {
+			next = pce->next;
+			free(pce);
+		}
+		ft->pathname_cache[i] = NULL;
+	}
+	ft->pathname_cache_count = 0;
 }
 
 /*
@@ -3217,35 +4070,132 @@ get_pathname_component(ulong dentry,
 	return len;
 }
 
+static void
+fs_cache_init(struct fs_object_cache *fc, char *name, long size)
+{
+	fc->name = name;
+	fc->size = size;
+	if (!(fc->objects = (char *)malloc(size * FS_CACHE_ENTRIES)))
+		error(FATAL, "cannot malloc %s cache\n", name);
+	fs_cache_clear(fc);
+}
+
+static void
+fs_cache_clear(struct fs_object_cache *fc)
+{
+	int i;
+
+	for (i = 0; i < FS_CACHE_HASH; i++)
+		fc->hash[i] = -1;
+	for (i = 0; i < FS_CACHE_ENTRIES; i++) {
+		fc->addr[i] = 0;
+		fc->hits[i] = 0;
+	}
+	fc->mru = fc->lru = -1;
+	fc->used = 0;
+	fc->fills = 0;
+}
+
+static void
+fs_cache_unlink(struct fs_object_cache *fc, int i)
+{
+	if (fc->lru_prev[i] >= 0)
+		fc->lru_next[fc->lru_prev[i]] = fc->lru_next[i];
+	else
+		fc->mru = fc->lru_next[i];
+	if (fc->lru_next[i] >= 0)
+		fc->lru_prev[fc->lru_next[i]] = fc->lru_prev[i];
+	else
+		fc->lru = fc->lru_prev[i];
+}
+
+static void
+fs_cache_make_mru(struct fs_object_cache *fc, int i)
+{
+	fc->lru_prev[i] = -1;
+	fc->lru_next[i] = fc->mru;
+	if (fc->mru >= 0)
+		fc->lru_prev[fc->mru] = i;
+	fc->mru = i;
+	if (fc->lru < 0)
+		fc->lru = i;
+}
+
+static void
+fs_cache_unhash(struct fs_object_cache *fc, int i)
+{
+	int *linkp;
+
+	if (!fc->addr[i])
+		return;
+
+	for (linkp = &fc->hash[FS_CACHE_HASH_INDEX(fc->addr[i])]; *linkp >= 0;
+	     linkp = &fc->hash_next[*linkp]) {
+		if (*linkp == i) {
+			*linkp = fc->hash_next[i];
+			break;
+		}
+	}
+	fc->addr[i] = 0;
+	fc->hits[i] = 0;
+}
+
 /*
- *  Cache the passed-in file structure.
+ *  Return the cached copy of the object at addr, reading it into the
+ *  least recently used entry if it is not cached.  The entry being
+ *  replaced is unhashed before the readmem(), so that a failed read
+ *  leaves it empty rather than holding a partial copy.
  */
-char *
-fill_file_cache(ulong file)
+static char *
+fs_cache_fill(struct fs_object_cache *fc, ulong addr)
 {
-        int i;
-        char *cache;
+	int i, h;
+	char *cache;
 
-        ft->file_cache_fills++;
+	fc->fills++;
 
-        for (i = 0; i < DENTRY_CACHE; i++) {
-                if (ft->cached_file[i] == file) {
-                        ft->cached_file_hits[i]++;
-                        cache = ft->file_cache + (SIZE(file)*i);
-                        return(cache);
-                }
-        }
+	h = FS_CACHE_HASH_INDEX(addr);
+	for (i = fc->hash[h]; i >= 0; i = fc->hash_next[i]) {
+		if (fc->addr[i] == addr) {
+			fc->hits[i]++;
+			if (fc->mru != i) {
+				fs_cache_unlink(fc, i);
+				fs_cache_make_mru(fc, i);
+			}
+			return (fc->objects + (fc->size*i));
+		}
+	}
 
-        cache = ft->file_cache + (SIZE(file)*ft->file_cache_index);
+	if (fc->used < FS_CACHE_ENTRIES)
+		i = fc->used;
+	else {
+		i = fc->lru;
+		fs_cache_unhash(fc, i);
+	}
 
-        readmem(file, KVADDR, cache, SIZE(file),
-                "fill_file_cache", FAULT_ON_ERROR);
+	cache = fc->objects + (fc->size*i);
+	readmem(addr, KVADDR, cache, fc->size, fc->name, FAULT_ON_ERROR);
 
-        ft->cached_file[ft->file_cache_index] = file;
+	if (i == fc->used)
+		fc->used++;
+	else
+		fs_cache_unlink(fc, i);
+	fs_cache_make_mru(fc, i);
 
-        ft->file_cache_index = (ft->file_cache_index+1) % DENTRY_CACHE;
+	fc->addr[i] = addr;
+	fc->hash_next[i] = fc->hash[h];
+	fc->hash[h] = i;
 
-        return(cache);
+	return cache;
+}
+
+/*
+ *  Cache the passed-in file structure.
+ */
+char *
+fill_file_cache(ulong file)
+{
+	return fs_cache_fill(&ft->file_cache, file);
 }
 
 /*
@@ -3254,51 +4204,19 @@ fill_file_cache(ulong file)
 void
 clear_file_cache(void)
 {
-        int i;
-
-        if (DUMPFILE())
-                return;
-
-        for (i = 0; i < DENTRY_CACHE; i++) {
-                ft->cached_file[i] = 0;
-                ft->cached_file_hits[i] = 0;
-        }
+	if (DUMPFILE())
+		return;
 
-        ft->file_cache_fills = 0;
-        ft->file_cache_index = 0;
+	fs_cache_clear(&ft->file_cache);
 }
 
-
-
 /*
  *  Cache the passed-in dentry structure.
  */
 char *
 fill_dentry_cache(ulong dentry)
 {
-	int i;
-	char *cache;
-
-	ft->dentry_cache_fills++;
-
-        for (i = 0; i < DENTRY_CACHE; i++) {
-                if (ft->cached_dentry[i] == dentry) {
-			ft->cached_dentry_hits[i]++;
-			cache = ft->dentry_cache + (SIZE(dentry)*i);
-			return(cache);
-		}
-	}
-
-	cache = ft->dentry_cache + (SIZE(dentry)*ft->dentry_cache_index);
-
-        readmem(dentry, KVADDR, cache, SIZE(dentry),
-        	"fill_dentry_cache", FAULT_ON_ERROR);
-
-	ft->cached_dentry[ft->dentry_cache_index] = dentry;
-
-	ft->dentry_cache_index = (ft->dentry_cache_index+1) % DENTRY_CACHE;
-
-	return(cache);
+	return fs_cache_fill(&ft->dentry_cache, dentry);
 }
 
 /*
@@ -3307,18 +4225,12 @@ fill_dentry_cache(ulong dentry)
 void
 clear_dentry_cache(void)
 {
-	int i;
-
 	if (DUMPFILE())
 		return;
 
-        for (i = 0; i < DENTRY_CACHE; i++) {
-                ft->cached_dentry[i] = 0;
-        	ft->cached_dentry_hits[i] = 0;
-	}
-
-        ft->dentry_cache_fills = 0;
-	ft->dentry_cache_index = 0;
+	fs_cache_clear(&ft->dentry_cache);
+	clear_pathname_cache();
+	clear_mount_cache();
 }
 
 /*
@@ -3327,49 +4239,19 @@ clear_dentry_cache(void)
 char *
 fill_inode_cache(ulong inode)
 {
-        int i;
-        char *cache;
-
-        ft->inode_cache_fills++;
-
-        for (i = 0; i < INODE_CACHE; i++) {
-                if (ft->cached_inode[i] == inode) {
-                        ft->cached_inode_hits[i]++;
-                        cache = ft->inode_cache + (SIZE(inode)*i);
-                        return(cache);
-                }
-        }
-
-        cache = ft->inode_cache + (SIZE(inode)*ft->inode_cache_index);
-
-        readmem(inode, KVADDR, cache, SIZE(inode),
-                "fill_inode_cache", FAULT_ON_ERROR);
-
-        ft->cached_inode[ft->inode_cache_index] = inode;
-
-        ft->inode_cache_index = (ft->inode_cache_index+1) % INODE_CACHE;
-
-        return(cache);
+	return fs_cache_fill(&ft->inode_cache, inode);
 }
 
-/*      
+/*
  *  If active, clear the inode references.
  */
 void
 clear_inode_cache(void)
 {
-        int i; 
- 
-        if (DUMPFILE())
-                return;
- 
-        for (i = 0; i < DENTRY_CACHE; i++) {
-                ft->cached_inode[i] = 0;
-                ft->cached_inode_hits[i] = 0;
-        }
+	if (DUMPFILE())
+		return;
 
-        ft->inode_cache_fills = 0;
-        ft->inode_cache_index = 0;
+	fs_cache_clear(&ft->inode_cache);
 }
 
 
@@ -3644,6 +4526,36 @@ same_file(char *f1, char *f2)
 }
 
 
+/*
+ *  Map an entire dumpfile read-only for "set mmap on", so that the
+ *  dumpfile readers can copy page data straight out of the mapping rather
+ *  than issuing an lseek() and read() for each page.  Returns NULL if the
+ *  file is not a regular file, is too large for the address space, or
+ *  cannot be mapped, in which case the caller keeps using read().
+ */
+char *
+mmap_dumpfile(int fd, off_t *sizep)
+{
+	struct stat sbuf;
+	char *addr;
+
+	if ((fstat(fd, &sbuf) < 0) || !S_ISREG(sbuf.st_mode) ||
+	    (sbuf.st_size == 0) || ((off_t)(size_t)sbuf.st_size != sbuf.st_size))
+		return NULL;
+
+	addr = mmap(NULL, (size_t)sbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (addr == MAP_FAILED) {
+		if (CRASHDEBUG(1))
+			error(INFO, "mmap_dumpfile: mmap: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	madvise(addr, (size_t)sbuf.st_size, MADV_RANDOM);
+
+	*sizep = sbuf.st_size;
+	return addr;
+}
+
 /*
  *  Determine which live memory source to use.
  */
@@ -4104,6 +5016,8 @@ do_radix_tree(ulong root, int flag, struct list_pair *rtp)
 	struct radix_tree_ops ops = {
 		.radix		= 16,
 		.private	= &info,
+		.first		= 0,
+		.last		= ~0UL,
 	};
 
 	switch (flag)
@@ -4114,10 +5028,9 @@ do_radix_tree(ulong root, int flag, struct list_pair *rtp)
 
 	case RADIX_TREE_SEARCH:
 		/*
-		 * FIXME: do_radix_tree_traverse() traverses whole
-		 * radix tree, not binary search. So this search is
-		 * not efficient.
+		 * Only the path down to rtp->index is read.
 		 */
+		ops.first = ops.last = rtp->index;
 		ops.entry = do_radix_tree_search;
 		break;
 
@@ -4252,6 +5165,8 @@ do_xarray(ulong root, int flag, struct list_pair *xp)
 	struct xarray_ops ops = {
 		.radix		= 16,
 		.private	= &info,
+		.first		= 0,
+		.last		= ~0UL,
 	};
 
 	switch (flag)
@@ -4261,6 +5176,7 @@ do_xarray(ulong root, int flag, struct list_pair *xp)
 		break;
 
 	case XARRAY_SEARCH:
+		ops.first = ops.last = xp->index;
 		ops.entry = do_xarray_search;
 		break;
 
@@ -34,6 +34,9 @@ unsigned int *gdb_output_radix;
 static void gdb_error_debug(void);
 
 static ulong gdb_user_print_option_address(char *);
+static int gdb_read_cached(ulong, int, void *, int);
+
+static ulong gdb_request_gen;	/* counts gdb_interface() requests */
 
 /*
  *  Called from main() this routine sets up the call-back hook such that
@@ -43,8 +46,29 @@ static ulong gdb_user_print_option_address(char *);
 void
 gdb_main_loop(int argc, char **argv)
 {
+	static char *gdb_argv[10];
+	static char index_cache_dir[BUFSIZE];
+
+	gdb_argv[0] = argv[0];
+	argv = gdb_argv;
 	argc = 1;
 
+	/*
+	 *  The index cache must be enabled before gdb reads the namelist,
+	 *  so that an existing index of it is used rather than scanning
+	 *  all of its debuginfo, and that one is written otherwise.
+	 */
+	if ((pc->flags2 & INDEX_CACHE) && !(pc->flags & READNOW)) {
+		if (pc->index_cache_dir) {
+			snprintf(index_cache_dir, BUFSIZE,
+				"set index-cache directory %s", pc->index_cache_dir);
+			argv[argc++] = "-iex";
+			argv[argc++] = index_cache_dir;
+		}
+		argv[argc++] = "-iex";
+		argv[argc++] = "set index-cache on";
+	}
+
 	if (pc->flags & SILENT) {
 		if (pc->flags & READNOW)
 			argv[argc++] = "--readnow";
@@ -375,6 +399,9 @@ gdb_pass_through(char *cmd, FILE *fptr, ulong flags)
 void 
 gdb_interface(struct gnu_request *req)
 {
+	ulonglong tstart;
+	char buf[BUFSIZE];
+
 	if (!(pc->flags & GDB_INIT)) 
 		error(FATAL, "gdb_interface: gdb not initialized?\n"); 
 
@@ -388,6 +415,14 @@ gdb_interface(struct gnu_request *req)
 
 	pc->cur_req = req;
 	pc->cur_gdb_cmd = req->command;
+	gdb_request_gen++;
+
+	if ((req->command == GNU_ADD_SYMBOL_FILE) ||
+	    (req->command == GNU_DELETE_SYMBOL_FILE)) {
+		datatype_cache_invalidate();
+		line_number_cache_invalidate();
+		dis_cache_invalidate();
+	}
 
 	if (CRASHDEBUG(2))
 		dump_gnu_request(req, IN_GDB);
@@ -405,10 +440,17 @@ gdb_interface(struct gnu_request *req)
 		SIGACTION(SIGPIPE, SIG_IGN, &pc->sigaction, NULL);
 	} 
 
+	tstart = TRACING() ? trace_time() : 0;
+
 	pc->flags |= IN_GDB;
 	gdb_command_funnel(req);
 	pc->flags &= ~IN_GDB;
 
+	if (TRACING())
+		trace_span("gdb", gdb_command_string(req->command, buf, TRUE),
+			req->command == GNU_PASS_THROUGH ? req->buf : NULL,
+			tstart);
+
 	SIGACTION(SIGINT, restart, &pc->sigaction, NULL);
 	SIGACTION(SIGSEGV, SIG_DFL, &pc->sigaction, NULL);
 
@@ -805,6 +847,19 @@ cmd_gdb(void)
 	 *  If the command is not restricted, pass it on.
 	 */
 	if (!is_restricted_command(*argv, FAULT_ON_ERROR)) {
+		if (STREQ(*argv, "add-symbol-file") ||
+		    STREQ(*argv, "remove-symbol-file") ||
+		    STREQ(*argv, "symbol-file") || STREQ(*argv, "file")) {
+			datatype_cache_invalidate();
+			line_number_cache_invalidate();
+		}
+
+		/*
+		 *  gdb settings such as the disassembly flavor affect
+		 *  the cached disassembly.
+		 */
+		dis_cache_invalidate();
+
 		if (STREQ(pc->command_line, "gdb")) {
 			strcpy(buf, first_space(pc->orig_line));
 			strip_beginning_whitespace(buf);
@@ -819,10 +874,90 @@ cmd_gdb(void)
 	}
 }
 
+/*
+ *  Page cache for the small reads that gdb makes while evaluating
+ *  expressions and disassembling.  Cached pages are only used during
+ *  the crash command that read them, and on live systems only during
+ *  the same gdb request, since the memory may change underneath.
+ *  User virtual address pages are tagged with the task whose address
+ *  space they were read from.
+ */
+#define GDB_READ_CACHE_PAGES (8)
+
+static struct gdb_read_cache {
+	ulong page;
+	ulong task;
+	ulong cmdgen;
+	ulong reqgen;
+	ulong last_used;
+	int memtype;
+	char *data;
+} gdb_read_cache[GDB_READ_CACHE_PAGES];
+
+static ulong gdb_read_cache_clock;
+
+/*
+ *  Copy len bytes at addr out of cached pages, reading any pages that
+ *  are not yet cached.  Returns FALSE if a page cannot be read in its
+ *  entirety, in which case the caller does the read itself, so that
+ *  errors and partial reads are handled as before.
+ */
+static int
+gdb_read_cached(ulong addr, int memtype, void *buf, int len)
+{
+	int i, cnt;
+	ulong page, offset, task;
+	struct gdb_read_cache *gc, *victim;
+	char *bufptr;
+
+	task = (memtype == UVADDR) ? CURRENT_TASK() : 0;
+	bufptr = (char *)buf;
+
+	while (len > 0) {
+		page = addr & ~((ulong)PAGESIZE() - 1);
+		offset = addr - page;
+		cnt = MIN(len, PAGESIZE() - offset);
+
+		for (i = 0, victim = NULL; i < GDB_READ_CACHE_PAGES; i++) {
+			gc = &gdb_read_cache[i];
+			if (gc->data && (gc->page == page) &&
+			    (gc->memtype == memtype) && (gc->task == task) &&
+			    (gc->cmdgen == pc->cmdgencur) &&
+			    (!ACTIVE() || (gc->reqgen == gdb_request_gen))) {
+				goto found;
+			}
+			if (!victim || (gc->last_used < victim->last_used))
+				victim = gc;
+		}
+
+		gc = victim;
+		if (!gc->data && !(gc->data = malloc(PAGESIZE())))
+			return FALSE;
+		gc->cmdgen = 0;
+		if (!readmem(page, memtype, gc->data, PAGESIZE(),
+		    "gdb_readmem_callback page", RETURN_ON_ERROR|QUIET))
+			return FALSE;
+		gc->page = page;
+		gc->memtype = memtype;
+		gc->task = task;
+		gc->cmdgen = pc->cmdgencur;
+		gc->reqgen = gdb_request_gen;
+found:
+		gc->last_used = ++gdb_read_cache_clock;
+		BCOPY(gc->data + offset, bufptr, cnt);
+		addr += cnt;
+		bufptr += cnt;
+		len -= cnt;
+	}
+
+	return TRUE;
+}
+
 /*
  *  The gdb target_xfer_memory() has a hook installed to re-route
  *  all memory accesses back here; reads of 1 or 4 bytes come primarily
- *  from text disassembly requests, and are diverted to the text cache.
+ *  from text disassembly requests.  Reads smaller than a page are
+ *  served from the gdb read cache where possible.
  */
 int 
 gdb_readmem_callback(ulong addr, void *buf, int len, int write)
@@ -873,6 +1008,9 @@ gdb_readmem_callback(ulong addr, void *buf, int len, int write)
 	if (memtype == FILEADDR)
 		return(readmem(pc->curcmd_private, memtype, buf, len,
 			"gdb_readmem_callback", readflags));
+
+	if ((len < PAGESIZE()) && gdb_read_cached(addr, memtype, buf, len))
+		return TRUE;
 	
 	switch (len)
 	{
@@ -72,6 +72,7 @@ struct command_table_entry linux_command_table[] = {
 	{"*", 	    cmd_pointer, help_pointer, 0},
 	{"alias",   cmd_alias,   help_alias,   0},
         {"ascii",   cmd_ascii,   help_ascii,   0},
+	{"bench",   cmd_bench,   help_bench,   0},
         {"bpf",     cmd_bpf,     help_bpf,     0},
         {"bt",      cmd_bt,      help_bt,      REFRESH_TASK_TABLE},
 	{"btop",    cmd_btop,    help_btop,    0},
@@ -92,6 +93,7 @@ struct command_table_entry linux_command_table[] = {
 	{"log",     cmd_log,     help_log,     MINIMAL},
 	{"mach",    cmd_mach,    help_mach,    0},
 	{"map",     cmd_map,     help_map,     HIDDEN_COMMAND},
+	{"memcg",   cmd_memcg,   help_memcg,   0},
 	{"mod",     cmd_mod,     help_mod,     0},
 	{"mount",   cmd_mount,   help_mount,   REFRESH_TASK_TABLE},
 	{"net",	    cmd_net,	help_net,      REFRESH_TASK_TABLE},
@@ -104,6 +106,8 @@ struct command_table_entry linux_command_table[] = {
         {"tree",    cmd_tree,    help_tree,    REFRESH_TASK_TABLE},
         {"rd",      cmd_rd,      help_rd,      MINIMAL},
 	{"repeat",  cmd_repeat,  help_repeat,  0},
+	{"rmap",    cmd_rmap,    help_rmap,    REFRESH_TASK_TABLE},
+	{"ucore",   cmd_ucore,   help_ucore,   REFRESH_TASK_TABLE},
 	{"runq",    cmd_runq,    help_runq,    REFRESH_TASK_TABLE},
 	{"sbitmapq", cmd_sbitmapq, help_sbitmapq, 0},
         {"search",  cmd_search,  help_search,  0},
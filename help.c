@@ -325,6 +325,14 @@ char *program_usage_info[] = {
     "    Search for the kernel source code in directory instead of in the",
     "    standard location that is compiled into the debuginfo data.",
     "",
+    "  --index_cache[=directory]",
+    "    Have the embedded gdb module save an index of the NAMELIST's",
+    "    debuginfo data in its index cache, by default in $HOME/.cache/gdb,",
+    "    or else in directory.  Later sessions with the same NAMELIST then",
+    "    start without scanning all of its debuginfo data, which is instead",
+    "    read per compilation unit when first needed.  This option has no",
+    "    effect if --readnow is also used.",
+    "",
     "  --reloc size",
     "    When analyzing live x86 kernels configured with a CONFIG_PHYSICAL_START ",
     "    value that is larger than its CONFIG_PHYSICAL_ALIGN value, then it will",
@@ -332,8 +340,9 @@ char *program_usage_info[] = {
     "    the two values.",
     "",
     "  --hash count",
-    "    Set the number of internal hash queue heads used for list gathering",
-    "    and verification.  The default count is 32768.",
+    "    Set the initial number of internal hash table slots used for list",
+    "    gathering and verification, which is rounded up to a power of 2; the",
+    "    table grows as required.  The default count is 32768.",
     "",
     "  --kaslr offset | auto",
     "    If x86, x86_64 or s390x kernel was configured with CONFIG_RANDOMIZE_BASE,",
@@ -361,6 +370,34 @@ char *program_usage_info[] = {
     "    Show or hide command output that is associated with offline cpus,",
     "    overriding any settings in either ./.crashrc or $HOME/.crashrc.",
     "",
+    "  --timing",
+    "    Record the wall and CPU time, and the number of readmem() calls and",
+    "    bytes read, of each phase of the session initialization, from the",
+    "    opening of the dumpfile to the display of the system information.",
+    "    The phases are displayed at the end of the \"help -p\" output, followed",
+    "    by the steps that were tried to find the KASLR offset of sadump, QEMU",
+    "    and VMware dumpfiles that do not contain vmcoreinfo.",
+    "",
+    "  --session_cache",
+    "    Save the task table and the KASLR offset that are gathered from a",
+    "    dumpfile during session initialization in $XDG_CACHE_HOME/crash, or",
+    "    $HOME/.cache/crash, and reuse them in later sessions that are run",
+    "    with the same dumpfile and vmlinux file.  Not used on live systems.",
+    "",
+    "  --batch jobs",
+    "    Run the commands in the -i input file against each of the dumpfile",
+    "    arguments, in a separate session for each dumpfile, with up to jobs",
+    "    sessions running at a time.  The NAMELIST and System.map arguments",
+    "    are used by all of the sessions.  The session of the first dumpfile",
+    "    is run by itself, so that the datatype cache and the --index_cache",
+    "    files of a shared NAMELIST are only written once.  The output of",
+    "    each session is written to a file named after the dumpfile's path,",
+    "    with a \".out\" suffix, and its completion status is displayed.",
+    "",
+    "  --batch_output directory",
+    "    Write the --batch output files in directory instead of in the",
+    "    current directory.",
+    "",
     "FILES:",
     "",
     "  .crashrc",
@@ -535,7 +572,7 @@ cmd_help(void)
 	oflag = 0;
 
         while ((c = getopt(argcnt, args, 
-	        "efNDdmM:ngcaBbHhkKsvVoptTzLOr")) != EOF) {
+	        "efNDdmM:ngcaBbHhkKsvVoptTuzLOr")) != EOF) {
                 switch(c)
                 {
 		case 'e':
@@ -549,6 +586,7 @@ cmd_help(void)
 		case 'n':
 		case 'D':
 			dumpfile_memory(DUMPFILE_MEM_DUMP);
+			dump_page_cache();
 			return;
 
 		case 'd':
@@ -560,6 +598,8 @@ cmd_help(void)
 			return;
 		case 'm':
 			dump_machdep_table(0);
+			dump_vtop_cache();
+			dump_slab_index();
 			return;
 
 		case 'g':
@@ -634,6 +674,10 @@ cmd_help(void)
 			dump_program_context();
 			return;
 
+		case 'u':
+			dump_memory_accounts();
+			return;
+
 		case 'z':
 			fprintf(fp, "help options:\n");
 			fprintf(fp, " -a - alias data\n");
@@ -660,6 +704,7 @@ cmd_help(void)
 			fprintf(fp, " -s - symbol table data\n");
 			fprintf(fp, " -t - task_table\n");
 			fprintf(fp, " -T - task_table plus context_array\n");
+			fprintf(fp, " -u - crash memory usage\n");
 			fprintf(fp, " -v - vm_table\n");
 			fprintf(fp, " -V - vm_table (verbose)\n");
 			fprintf(fp, " -z - help options\n");
@@ -844,7 +889,7 @@ char *help_foreach[] = {
 "  command  select one or more of the following commands to be run on the tasks",
 "           selected, or on all tasks:\n",
 "              bt  run the \"bt\" command  (optional flags: -r -t -l -e -R -f -F",
-"                  -o -s -x -d)",
+"                  -o -s -x -d -U)",
 "              vm  run the \"vm\" command  (optional flags: -p -v -m -R -d -x)",
 "            task  run the \"task\" command  (optional flags: -R -d -x)",
 "           files  run the \"files\" command  (optional flag: -c -R)",
@@ -856,6 +901,16 @@ char *help_foreach[] = {
 "            vtop  run the \"vtop\" command  (optional flags: -c -u -k)\n",
 "     flag  Pass this optional flag to the command selected.",
 " argument  Pass this argument to the command selected.",
+" -j count  spread the selected tasks across this many worker processes,",
+"           each with a private copy of the session.  The output of each",
+"           task is held back and displayed in the original task order, so",
+"           that it matches that of a serial run, except that error messages",
+"           are shown in-line with the task output.  Not supported with",
+"           \"ps -G\".",
+"       -U  with \"bt\", group the selected tasks by backtrace instead of",
+"           displaying each task's backtrace.  Each unique backtrace is shown",
+"           once, without its stack addresses, preceded by the number of",
+"           tasks and their PIDs.  The groups are shown largest first.",
 " ",
 "  A header containing the PID, task address, cpu and command name will be",
 "  pre-pended before the command output for each selected task.  Consult the",
@@ -962,6 +1017,78 @@ char *help_ascii[] = {
 NULL
 };
 
+char *help_bench[] = {
+"bench",
+"run benchmark workloads",
+"[-n count] [-S] [\"command line\" ...]",
+"  This command runs a set of workloads against the current session and",
+"  reports how each performed, so that the results of different crash",
+"  versions, or of different set options, can be compared on the same",
+"  dumpfile.  The output of the workloads is discarded.  Each startup phase",
+"  of the session, and each workload run, is reported as a JSON object on",
+"  a line of its own, containing the elapsed wall and CPU time and, for",
+"  each run, its readmem() calls, bytes and failures, dumpfile reader calls",
+"  and time, and the peak resident set size of the crash process so far.",
+"  The readmem() counts of the startup phases are only available if the",
+"  session was started with the --timing option.",
+"  A workload that fails is reported with an \"error\" status.\n",
+"    -n count  run each workload this many times.",
+"          -S  do not report the startup phases.",
+"  command line  a command to run as a workload instead of the default",
+"              workloads; quote a command line that contains spaces.  The",
+"              default workloads are:\n",
+"                foreach bt",
+"                kmem -s",
+"                search -k -l 0x10000000 0xdeadbeefdeadbeef",
+"                list task_struct.tasks -s task_struct.pid -h init_task",
+"                log",
+"                foreach files",
+"                foreach task -R pid,comm",
+"\nEXAMPLES",
+"  Run \"bt -a\" and \"kmem -i\" twice each:\n",
+"    %s> bench -S -n 2 \"bt -a\" \"kmem -i\"",
+"    {\"workload\": \"bt -a\", \"run\": 1, \"status\": \"ok\", \"wall_secs\": 0.081230, ...",
+"    {\"workload\": \"bt -a\", \"run\": 2, \"status\": \"ok\", \"wall_secs\": 0.012911, ...",
+"    {\"workload\": \"kmem -i\", \"run\": 1, \"status\": \"ok\", \"wall_secs\": 0.402118, ...",
+"    {\"workload\": \"kmem -i\", \"run\": 2, \"status\": \"ok\", \"wall_secs\": 0.398012, ...",
+NULL
+};
+
+char *help_memcg[] = {
+"memcg",
+"memory cgroup usage",
+"[-n count] [-s usage|swap|anon|file|shmem|slab] [-N] [mem_cgroup ...]",
+"  This command walks the memory cgroup hierarchy from root_mem_cgroup and",
+"  displays the memory cgroups that use the most memory, largest first.",
+"  For each one it shows the mem_cgroup address, its memory usage and",
+"  limit, its swap usage, its anonymous, file, shmem and slab memory as",
+"  shown by its memory.stat file, and its path in the cgroup filesystem.",
+"  The memory.stat values include the per-cpu counts that have not yet",
+"  been flushed by the kernel.\n",
+"    -n count  display this many memory cgroups; the default is 20, and 0",
+"              displays all of them.",
+"    -s field  sort by usage (the default), swap, anon, file, shmem or slab.",
+"          -N  also display the LRU list sizes of each node.",
+"  mem_cgroup  display the mem_cgroup at this hexadecimal address instead",
+"              of walking the hierarchy.",
+"\nEXAMPLES",
+"  Display the three memory cgroups that use the most memory:\n",
+"    %s> memcg -n 3",
+"       MEM_CGROUP        USAGE      LIMIT       SWAP       ANON       FILE      SHMEM       SLAB  PATH",
+"    ffff8881001c4000    12.3 GB  unlimited     512 KB     3.1 GB     8.6 GB      92 MB   311.4 MB  /",
+"    ffff888104a1a000     6.9 GB       8 GB          0     2.2 GB     4.5 GB      12 MB   120.5 MB  /system.slice",
+"    ffff88810c312000     4.1 GB  unlimited          0     1.9 GB     2.1 GB       4 MB    81.2 MB  /user.slice",
+"",
+"    57 memory cgroups, the 3 largest by usage shown",
+"\n  Display the LRU list sizes of each node of a memory cgroup:\n",
+"    %s> memcg -N ffff888104a1a000",
+"       MEM_CGROUP        USAGE      LIMIT       SWAP       ANON       FILE      SHMEM       SLAB  PATH",
+"    ffff888104a1a000     6.9 GB       8 GB          0     2.2 GB     4.5 GB      12 MB   120.5 MB  /system.slice",
+"                      NODE 0:  ANON 1.2 GB  FILE 2.4 GB  UNEVICTABLE 0",
+"                      NODE 1:  ANON 1 GB  FILE 2.1 GB  UNEVICTABLE 0",
+NULL
+};
+
 char *help_sbitmapq[] = {
 "sbitmapq",
 "sbitmap_queue struct contents",
@@ -1124,6 +1251,7 @@ char *help_help[] = {
 "    -s - symbol table data",
 "    -t - task_table",
 "    -T - task_table plus context_array",
+"    -u - crash memory usage",
 "    -v - vm_table",
 "    -V - vm_table (verbose)",
 "    -z - help options",
@@ -1193,6 +1321,85 @@ char *help_set[] = {
 "         redzone  on | off     if on, CONFIG_SLUB object addresses displayed by",
 "                               the kmem command will point to the SLAB_RED_ZONE",
 "                               padding inserted at the beginning of the object.", 
+"            mmap  on | off     if on, uncompressed ELF, ramdump and flattened",
+"                               dumpfiles are memory-mapped, and page data is",
+"                               copied from the mapping instead of being read.",
+"          output  text | json | csv",
+"                               if json or csv, the \"ps\", \"kmem -s\",",
+"                               \"files\" and \"net -s\" commands, and the",
+"                               task headers of other commands, display each",
+"                               table row as a record instead of a text line:",
+"                               a JSON object per line, or CSV lines preceded",
+"                               by a line of field names.  Other commands and",
+"                               options are not affected.",
+"     pipe_filter  on | off     if on, output piped to grep, egrep, fgrep, head,",
+"                               tail or \"wc -l\" is filtered by %s itself",
+"                               instead of by a shell, as long as the pipeline",
+"                               only uses the -v, -i, -c, -E, -F and -e options",
+"                               of grep, the -N and -n N options of head and",
+"                               tail, and no shell syntax other than quotes.",
+"         profile  on | off     if on, each command's output is followed by a",
+"                               summary of its readmem() calls, dumpfile reads,",
+"                               page cache hits and address translations, and",
+"                               of the readmem() types it requested most often.",
+"                               Work done by forked \"-j\" worker processes is",
+"                               not counted.",
+"           trace  file | off   if a file is given, a span is written to it for",
+"                               each command, and for the dumpfile reads, page",
+"                               decompressions, gdb requests, list, tree and",
+"                               xarray walks and back traces within it, in the",
+"                               Chrome trace event format that is read by",
+"                               chrome://tracing and the Perfetto UI.",
+"       trace_min  usecs        spans other than commands that are shorter than",
+"                               this are left out of the trace file; the",
+"                               default is 10 microseconds.",
+"      vtop_cache  on | off     if on, kernel and user virtual address",
+"                               translations are cached; the cache is flushed",
+"                               whenever the context is changed with \"set\".",
+"  datatype_cache  on | off     if on, the structure sizes and member offsets",
+"                               looked up during session initialization are",
+"                               saved in a file in $HOME/.cache/crash named",
+"                               after the vmlinux build-id, and are read from",
+"                               it by later sessions with the same kernel.",
+"                               On x86_64, the stack frame sizes determined by",
+"                               \"bt\" are saved in the same way.",
+"                               This only takes effect from a .crashrc file.",
+"             btf  on | off     if on, structure sizes and member offsets are",
+"                               looked up in the kernel's BTF type information,",
+"                               from the vmlinux .BTF section or the kernel's",
+"                               __start_BTF data, before gdb is queried, and",
+"                               structures and unions displayed by \"struct\",",
+"                               \"union\" and other commands are formatted from",
+"                               it in the same format as gdb's.  Lookups and",
+"                               types that BTF cannot answer are left to gdb.",
+"      page_cache  size | off   sets the size of the page cache shared by the",
+"                               dumpfile formats, and of the compressed kdump",
+"                               page cache; the size is in bytes, and may be",
+"                               followed by a K, M or G suffix.  \"help -D\"",
+"                               shows the cache statistics of each format.",
+"      live_cache  off | command | seconds",
+"                               on a live system, caches the pages read from",
+"                               /dev/mem, /proc/kcore or /dev/crash in the page",
+"                               cache, until the next command starts, or for",
+"                               the given number of seconds.  Any \"set\"",
+"                               command also flushes the cached pages.  The",
+"                               default is off.",
+"   mem_map_cache  count        sets the number of page structures that are read",
+"                               at a time when kmem -p and the other commands",
+"                               that scan the mem_map array walk through it.",
+"  diskdump_cache  size         sets the size of the compressed kdump page cache;",
+"                               the size is in bytes, and may be followed by a",
+"                               K, M or G suffix; the minimum is 16 pages.",
+"  diskdump_readahead  pages | off  when sequential reads of a compressed kdump",
+"                               are detected, read ahead and uncompress up to",
+"                               this many following pages in parallel (up to",
+"                               half of the diskdump_cache size).",
+"        memlimit  size | off   sets a limit on crash's own memory use; the size",
+"                               is in bytes, and may be followed by a K, M or G",
+"                               suffix.  The page caches are sized to fit within",
+"                               it, and the line number, disassembly and zram",
+"                               caches are emptied before crash grows past it.",
+"                               \"help -u\" shows what the memory is used for.",
 "   error  default | redirect | filename   set the destination of error messages.",
 "                               \"default\": error messages are always displayed",
 "                                 on the console; if the output of a command is",
@@ -1258,6 +1465,21 @@ char *help_set[] = {
 "             scope: (not set)",
 "           offline: show",
 "           redzone: on",
+"              mmap: off",
+"           profile: off",
+"            output: text",
+"       pipe_filter: on",
+"             trace: off",
+"         trace_min: 10",
+"        vtop_cache: on",
+"    datatype_cache: on",
+"               btf: off",
+"        page_cache: 67108864",
+"        live_cache: off",
+"     mem_map_cache: 32768",
+"    diskdump_cache: 65536",
+"diskdump_readahead: 0",
+"          memlimit: 0",
 "             error: default",
 " ",
 "  Show the current context:\n",
@@ -1379,7 +1601,7 @@ NULL
 char *help_ps[] = {
 "ps",
 "display process status information",
-"[-k|-u|-G|-y policy] [-s] [-p|-c|-t|-[l|m][-C cpu]|-a|-g|-r|-S|-A]\n     [pid | task | command] ...",
+"[-k|-u|-G|-y policy] [-s] [-o rss|vsz] [-j count] [-p|-c|-t|-[l|m][-C cpu]|-a|-g|-r|-S|-A]\n     [pid | task | command] ...",
 "  This command displays process status for selected, or all, processes" ,
 "  in the system.  If no arguments are entered, the process data is",
 "  is displayed for all processes.  Specific processes may be selected",
@@ -1427,6 +1649,14 @@ char *help_ps[] = {
 " ",
 "       -s  replace the TASK column with the KSTACKP column.",
 " ",
+"  The default output may be sorted by the tasks' memory usage:",
+" ",
+" -o field  sort the output by the RSS or VSZ column, with the largest first,",
+"           where field is either \"rss\" or \"vsz\"; tasks with the same",
+"           value are shown in their usual order.",
+" -j count  when displaying all tasks, calculate the memory usage of the",
+"           tasks in this many worker processes before displaying them.",
+" ",
 "  On SMP machines, the active task on each CPU will be highlighted by an",
 "  angle bracket (\">\") preceding its information.  If the crash variable",
 "  \"offline\" is set to \"hide\", the active task on an offline CPU will",
@@ -1909,12 +2139,15 @@ char *help_bt[] = {
 "bt",
 "backtrace",
 "[-a|-c cpu(s)|-g|-r|-t|-T|-l|-e|-E|-f|-F|-o|-O|-v|-p] [-R ref] [-s [-x|d]]"
-"\n     [-I ip] [-S sp] [-n idle] [pid | task]",
+"\n     [-I ip] [-S sp] [-n idle] [-j count] [pid | task]",
 "  Display a kernel stack backtrace.  If no arguments are given, the stack",
 "  trace of the current context will be displayed.\n",
 "       -a  displays the stack traces of the active task on each CPU.",
 "           (only applicable to crash dumps)",
 "       -A  same as -a, but also displays vector registers (S390X only).",
+" -j count  with -a or -A, spread the active tasks across this many worker",
+"           processes; the stack traces are displayed in CPU order, as",
+"           they are without -j.",
 "  -n idle  filter the stack of idle tasks (x86_64, arm64).",
 "           (only applicable to crash dumps)",
 "       -p  display the stack trace of the panic task only.",
@@ -2315,6 +2548,13 @@ char *help_extend[] = {
 "  a list of their commands will be displayed.  The registered commands",
 "  contained in each shared object file will appear automatically in the ",
 "  \"help\" command screen.",
+"\n  When %s starts, it loads each shared object found in the first of the",
+"  directories 2 through 5 above that exists.  If that directory contains a",
+"  file named \"extensions.manifest\", any shared object listed in it is not",
+"  loaded until one of its commands is first entered.  Each line of the file",
+"  names a shared object followed by the commands that it registers:\n",
+"    snap.so snap",
+"    eppic.so eppic",
 "\n  An example of a shared object prototype file, and how to compile it",
 "  into a shared object, is appended below.",
 "\nEXAMPLES",
@@ -2530,7 +2770,7 @@ NULL
 char *help_bpf[] = {
 "bpf",
 "extended Berkeley Packet Filter (eBPF)",
-"[[-p ID | -P] [-tTj]] [[-m ID] | -M] [-s] [-xd]",
+"[[-p ID | -P] [-tTj]] [[-m ID] | -M] [-ec] [-s] [-xd]",
 " ",
 "  This command provides information on currently-loaded eBPF programs and maps.",
 "  With no arguments, basic information about each loaded eBPF program and map",
@@ -2551,6 +2791,14 @@ char *help_bpf[] = {
 "           pairs that can be stored within the map, the number of bytes locked",
 "           into memory, its name string, and its UID.",
 "    -M     same as -m, but displays the basic and extra data for all maps.",    
+"    -e     with -m or -M, display the address, key and value of each entry of",
+"           array, hash and LRU hash maps, and their per-cpu variants, in",
+"           hexadecimal.  For per-cpu maps, the value of each possible cpu is",
+"           displayed, along with their total if the value size is 4 or 8.",
+"    -c     with -m or -M, display the number of entries of those maps and",
+"           the bytes of memory that they use, the number of buckets of hash",
+"           maps, how many are used and their longest chain, and for per-cpu",
+"           maps with 4 or 8 byte values, the total of all values.",
 "    -t     translate the bytecode of the specified program ID.",
 "    -T     same as -t, but also dump the bytecode of each instruction.",
 "    -j     disassemble the jited code of the specified program ID.",
@@ -2614,6 +2862,24 @@ char *help_bpf[] = {
 "       KEY_SIZE: 4  VALUE_SIZE: 8  MAX_ENTRIES: 10000  MEMLOCK: 1953792",
 "       NAME: \"lru_hash_map\"  UID: 0",
 "",
+"  Display the entries and statistics of the per-cpu hash map ID 37:\n",
+"  %s> bpf -m 37 -ec",
+"   ID     BPF_MAP       BPF_MAP_TYPE   MAP_FLAGS",
+"   37 ffff9ff260d77c00   PERCPU_HASH    00000000",
+"       KEY_SIZE: 4  VALUE_SIZE: 8  MAX_ENTRIES: 1024  MEMLOCK: 143360",
+"       NAME: \"percpu_hash\"  UID: 0",
+"",
+"    ffff9ff1ae7a0000  KEY: 01 00 00 00",
+"      CPU 0: 05 00 00 00 00 00 00 00",
+"      CPU 1: 02 00 00 00 00 00 00 00",
+"      TOTAL: 7",
+"    ffff9ff1ae7a0040  KEY: 02 00 00 00",
+"      CPU 0: 00 00 00 00 00 00 00 00",
+"      CPU 1: 01 00 00 00 00 00 00 00",
+"      TOTAL: 1",
+"",
+"       ENTRIES: 2  MEMORY: 16512  BUCKETS: 1024  USED: 2  MAX_CHAIN: 1  PERCPU_TOTAL: 8",
+"",
 "  Disassemble the jited program of program ID 20:\n",
 "  %s> bpf -p 20 -j",
 "  ID     BPF_PROG       BPF_PROG_AUX   BPF_PROG_TYPE       TAG        USED_MAPS",
@@ -3002,7 +3268,9 @@ char *help_map[] = {
 "  the crash utility to access the system's memory in a random access manner.",
 "  Therefore, during crash session initialization, a potentially time-consuming",
 "  dumpfile scan procedure is required to create a physical-memory-to-file-offset",
-"  map for use during the session.",
+"  map for use during the session.  If possible, the map is then saved in a",
+"  file in the same directory as the dumpfile, with \".map\" appended to the",
+"  dumpfile name, so that subsequent crash sessions do not require the scan.",
 " ",  
 "  This command may be used to append the memory map data to the dumpfile or",
 "  to store it in a permanent file.  After this has been done, subsequent crash",
@@ -3031,7 +3299,7 @@ NULL
 char *help_timer[] = {
 "timer",
 "timer queue data",
-"[-r][-C cpu]",
+"[-r][-s|-m][-C cpu]",
 "  This command displays the timer queue entries, both old- and new-style,",
 "  in chronological order.  In the case of the old-style timers, the",
 "  timer_table array index is shown; in the case of the new-style timers, ",
@@ -3041,6 +3309,13 @@ char *help_timer[] = {
 "        chronological order.  In the case of the old-style hrtimers, the",
 "        expiration time is a single value; in the new-style hrtimers, the",
 "        expiration time is a range.",
+"    -s  Instead of the timers, display the number of timers queued with",
+"        each callback function, most frequent first, for all of the cpus",
+"        that are displayed.  It may be used with -r, and is supported on",
+"        Linux 4.8 and later timer wheels.",
+"    -m  Merge the per-cpu timer_bases of Linux 4.8 and later kernels into",
+"        a single list in chronological order, showing the cpu and base of",
+"        each timer.",
 " -C cpu Restrict the output to one or more CPUs, where multiple cpu[s] can", 
 "        be specified, for example, as \"1,3,5\", \"1-3\", or \"1,3,5-7,10\".",
 "\nEXAMPLES",
@@ -3079,6 +3354,30 @@ char *help_timer[] = {
 "      4296506084   215046  ffff9801aba629c8  ffffffff83ac5ea0  <idle_worker_timeout>",
 "    ...",
 " ",
+"  Count the timers of each callback function:\n",
+"    %s> timer -s",
+"    JIFFIES",
+"    4296291038",
+"    ",
+"         COUNT      FUNCTION",
+"           803  ffffffff8412e4e0  <tw_timer_handler>",
+"           412  ffffffff83ac6b70  <delayed_work_timer_fn>",
+"            97  ffffffff83b29880  <process_timeout>",
+"    ...",
+"          1389  TOTAL",
+" ",
+"  Display the timers of all cpus in chronological order:\n",
+"    %s> timer -m",
+"    JIFFIES",
+"    4296291038",
+"    ",
+"      CPU  BASE  EXPIRES        TTE         TIMER_LIST     FUNCTION",
+"        1  STD     4296282997    -8041  ffff9801aba55ce0  ffffffff83a3bda0  <mce_timer_fn>",
+"        3  STD     4296283012    -8026  ffff9801abb55ce0  ffffffff83a3bda0  <mce_timer_fn>",
+"        1  STD     4296283104    -7934  ffff97fd84bd35e0  ffffffff83ac6b70  <delayed_work_timer_fn>",
+"        1  DEF     4296291264      226  ffffffff855eb238  ffffffff83c08fb0  <writeout_period>",
+"    ...",
+" ",
 "  Display a new-style hrtimer queue:\n",
 "    %s> timer -r",
 "    ...",
@@ -3113,7 +3412,7 @@ NULL
 char *help_runq[] = {
 "runq",
 "run queue",
-"[-t] [-T] [-m] [-g] [-c cpu(s)]",
+"[-t] [-T] [-m] [-g] [-c cpu(s)] [-j threads]",
 "  With no argument, this command displays the tasks on the run queues",
 "  of each cpu.",
 " ",
@@ -3133,6 +3432,10 @@ char *help_runq[] = {
 " -c cpu  restrict the output to the run queue data of one or more CPUs,",
 "         which can be specified using the format \"3\", \"1,8,9\", \"1-23\",",
 "         or \"1,8,9-14\".",
+" -j threads",
+"         with no option or with -g, on CFS kernels, display the cpus in the",
+"         specified number of worker processes.  The output is the same, and",
+"         is displayed in cpu order.",
 "\nEXAMPLES",
 " Display the tasks on an O(1) scheduler run queue:\n",
 "    %s> runq",
@@ -3269,6 +3572,74 @@ NULL
 };
 
 
+char *help_rmap[] = {
+"rmap",
+"tasks mapping physical memory",
+"[-b] [-s] [-p] [address ...]",
+"  This command displays the tasks whose user address spaces map each",
+"  physical address, along with the virtual address at which each of them",
+"  maps it.  The first time that it is used, the page tables of every",
+"  mm_struct are walked once, one VM area at a time, to build an index of",
+"  the physical memory that they map, which is then kept for the rest of",
+"  the session.  Each mm_struct is shown with the lowest-numbered task that",
+"  uses it.  Once the index has been built, \"kmem -P address\" and \"kmem\"",
+"  with a physical address also display the tasks that map the address.",
+"  On a live system, the index shows the mappings as of when it was built.\n",
+"        -b  build the index again.",
+"        -s  display statistics of the index.",
+"        -p  the addresses are page structure addresses instead of",
+"            physical addresses.",
+"   address  a hexadecimal physical address, or a page structure address",
+"            if -p is used.",
+"\nEXAMPLES",
+"  Display the tasks that map physical address 1f0e2a000:\n",
+"    %s> rmap 1f0e2a000",
+"    PHYSADDR: 1f0e2a000",
+"          PID        TASK              VADDR        COMM",
+"         1130  ffff9a4c0b5e8000  7f2b1c3e2000      \"sshd\"",
+"         1544  ffff9a4c0a3f4000  7f2b1c3e2000      \"sshd\"",
+" ",
+"  Display the statistics of the index, building it again first:\n",
+"    %s> rmap -b -s",
+"    please wait... (building reverse-mapping index)",
+"       MM_STRUCTS: 142",
+"             VMAS: 9874",
+"          EXTENTS: 301554",
+"       MAX EXTENT: 2097152",
+"       INDEX SIZE: 15728640",
+NULL
+};
+
+char *help_ucore[] = {
+"ucore",
+"write a user process core file",
+"[-o file] [pid | taskp]",
+"  This command writes an ELF core file of the user address space of the",
+"  current context, or of a task specified by its PID or task_struct",
+"  address.  Each VM area is written as a PT_LOAD segment, and the file",
+"  contains an NT_PRPSINFO note with the PID, command name and arguments",
+"  of the task.  The page tables of each VM area are walked one contiguous",
+"  block at a time, and the memory of each block is read in large pieces.",
+"  Pages that are not mapped are left as holes in the file, except that",
+"  the swapped-out pages of anonymous VM areas are read from the swap",
+"  device or zram.  Pages that cannot be read are also left as holes.",
+"  The VM areas of device mappings are written with no file contents.",
+"  Thread register notes are not written, so the file can be used to",
+"  examine memory but not to display backtraces.\n",
+"   -o file  the name of the file to write; the default is \"core.<pid>\".",
+"       pid  a process PID.",
+"     taskp  a hexadecimal task_struct pointer.",
+"\nEXAMPLES",
+"  Write a core file of PID 1130:\n",
+"    %s> ucore 1130",
+"    core.1130: PID 1130: 58 VMAs, 2317 pages, 12 swapped pages",
+" ",
+"  Write a core file of the current context to /tmp/sshd.core:\n",
+"    %s> ucore -o /tmp/sshd.core",
+"    /tmp/sshd.core: PID 1544: 61 VMAs, 2406 pages",
+NULL
+};
+
 char *help_pte[] = {
 "pte",
 "translate a page table entry",
@@ -3497,7 +3868,7 @@ char *help_search[] = {
 "search",
 "search memory",
 "[-s start] [ -[kKV] | -u | -p | -t | -T ] [-e end | -l length] [-m mask]\n"
-"         [-x count] -[cwh] [value | (expression) | symbol | string] ...",
+"         [-x count] [-j threads] -[cwh] [value | (expression) | symbol | string] ...",
 "  This command searches for a given value within a range of user virtual, kernel",
 "  virtual, or physical memory space.  If no end nor length value is entered, ",
 "  then the search stops at the end of user virtual, kernel virtual, or physical",
@@ -3544,6 +3915,13 @@ char *help_search[] = {
 "              before and after memory context will consist of \"count\" memory",
 "              items of the same size as the \"value\" argument.  This option is",
 "              not applicable with the -c option.",
+"  -j threads  Read and check the pages for matches using this many threads;",
+"              the pages are read by the command itself if the dumpfile type",
+"              does not support reading from multiple threads.  The output is",
+"              the same as that of a serial search.  With -t or -T, the stack",
+"              pages of many tasks are checked at once, and the output is",
+"              still displayed task by task.  This option is not applicable",
+"              with the -c option.",
 "       value  Search for this hexadecimal long, unless modified by the -c, -w, ",
 "              or -h options.",
 "(expression)  Search for the value of this expression; the expression value must",
@@ -4022,7 +4400,7 @@ NULL
 char *help_log[] = {
 "log",
 "dump system message buffer",
-"[-Ttdmas]",
+"[-Ttdmas] [-l level] [-f facility] [-c caller] [-g string] [-r start-end]",
 "  This command dumps the kernel log_buf contents in chronological order.  The",
 "  command supports the older log_buf formats, which may or may not contain a",
 "  timestamp inserted prior to each message, as well as the newer variable-length", 
@@ -4045,6 +4423,23 @@ char *help_log[] = {
 "        been copied out to the user-space audit daemon.",
 "    -s  Dump the printk logs remaining in kernel safe per-CPU buffers that",
 "        have not been flushed out to log_buf.",
+"  ",
+"  The following options select the messages to display, and are applied",
+"  before each message is formatted.  They are only applicable to the",
+"  variable-length record format, and may be combined:",
+"  ",
+"      -l level  only display messages of this log level, or of a more",
+"                severe one.  The level may be 0 through 7, or one of emerg,",
+"                alert, crit, err, warning, notice, info or debug.",
+"   -f facility  only display messages of this syslog facility, which may be",
+"                a number, or a name such as kern, user or daemon.",
+"     -c caller  only display messages whose caller id is this thread or cpu,",
+"                in the form \"T<pid>\" or \"C<cpu>\".  A plain number is",
+"                taken as a pid.",
+"     -g string  only display messages containing this string.",
+"  -r start-end  only display messages whose timestamp is within this range",
+"                of seconds since boot, e.g. \"-r 10.5-20\".  Either bound",
+"                may be omitted, and \"-r start\" means \"-r start-\".",
 " ",        
 "\nEXAMPLES",
 "  Dump the kernel message buffer:\n",
@@ -4213,6 +4608,13 @@ char *help_log[] = {
 "    CPU: 0  ADDR: ffff8ca4fbc1ad00 LEN: 0  MESSAGE_LOST: 0",
 "      (empty)",
 "    ...",
+" ",
+"  Display the messages of level \"err\" or more severe that were logged",
+"  between 100 and 200 seconds after boot:\n",
+"    %s> log -l err -r 100-200",
+"    [  104.873062] EXT4-fs error (device sda2): ext4_find_entry:1455: inode #2:",
+"                   comm ls: reading directory lblock 0",
+"    [  131.530011] Buffer I/O error on dev sda2, logical block 0, async page read",
 NULL               
 };
 
@@ -4565,7 +4967,7 @@ NULL
 char *help_vtop[] = {
 "vtop",
 "virtual to physical",
-"[-c [pid | taskp]] [-u|-k] address ...",
+"[-c [pid | taskp]] [-u|-k] [-b] [-f file] [address ...]",
 "  This command translates a user or kernel virtual address to its physical",
 "  address.  Also displayed is the PTE translation, the vm_area_struct data",
 "  for user virtual addresses, the mem_map page data associated with the",
@@ -4589,6 +4991,17 @@ char *help_vtop[] = {
 "                      the pid or taskp argument should NOT be entered; the",
 "                      address will be translated using the page directory of",
 "                      each task specified by \"foreach\".",
+"   -b                 Display only one line per address, containing its",
+"                      virtual and physical addresses, or the reason that",
+"                      it could not be translated.  The translations are",
+"                      done quietly, so that they can be satisfied from the",
+"                      translation cache.",
+"   -f file            Translate the addresses in the file, one per line,",
+"                      after any addresses on the command line; implies -b.",
+"                      The address is the first word of each line, and may",
+"                      end with a colon, so the output of \"search\" or \"rd\"",
+"                      can be used as it is.  Blank lines and lines that",
+"                      start with \"#\" are skipped.",
 "   address            A hexadecimal user or kernel virtual address.",
 "\nEXAMPLES",
 "  Translate user virtual address 80b4000:\n",
@@ -5669,7 +6082,7 @@ NULL
 char *help_ptov[] = {
 "ptov",
 "physical to virtual\n         per-cpu to virtual",
-"[address | offset:cpuspec]",
+"[-b] [-f file] [address | offset:cpuspec] ...",
 "  This command translates a hexadecimal physical address into a kernel",
 "  virtual address.  Alternatively, a hexadecimal per-cpu offset and",
 "  cpu specifier will be translated into kernel virtual addresses for",
@@ -5680,6 +6093,11 @@ char *help_ptov[] = {
 "                    :a[ll]        all CPUs.",
 "                    :#[-#][,...]  CPU list(s), e.g. \"1,3,5\", \"1-3\",",
 "                                or \"1,3,5-7,10\".",
+"              -b  display only one line per physical address, and do not",
+"                  accept per-cpu offsets.",
+"         -f file  translate the physical addresses in the file, one per",
+"                  line, after any addresses on the command line; implies",
+"                  -b.  The lines are read as with \"vtop -f\".",
 "\nEXAMPLES",
 "  Translate physical address 56e000 into a kernel virtual address:\n",
 "    %s> ptov 56e000",
@@ -5701,7 +6119,7 @@ NULL
 char *help_mod[] = {
 "mod",
 "module information and loading of symbols and debugging data",
-"-s module [objfile] | -d module | -S [directory] [-D|-t|-r|-R|-o|-g]",
+"-s module [objfile] | -d module | -S [directory] [-D|-t|-r|-R|-o|-g|-L|-j threads]",
 "  With no arguments, this command displays basic information of the currently",
 "  installed modules, consisting of the module address, name, base address,",
 "  size, the object file name (if known), and whether the module was compiled",
@@ -5773,6 +6191,16 @@ char *help_mod[] = {
 "                   -g  When used with -s or -S, add a module object's section",
 "                       start and end addresses to its symbol list.",
 "                   -o  Load module symbols with old mechanism.",
+"                   -L  When used with -S, only locate each module's object",
+"                       file, shown as \"(deferred)\", and postpone the loading",
+"                       of its symbolic and debugging data until an address in",
+"                       the module is first used by \"bt -l\", \"dis\", \"struct\"",
+"                       or \"union\", or by any other command that translates",
+"                       a module text address into a source line number.",
+"           -j threads  When used with -S, read the object files that have been",
+"                       found with the number of threads specified, from 1 to",
+"                       64, before their symbolic and debugging data are loaded",
+"                       one module at a time.",
 " ",
 "  If the %s session was invoked with the \"--mod <directory>\" option, or",
 "  a CRASH_MODULE_PATH environment variable exists, then /lib/modules/<release>",
@@ -5978,12 +6406,12 @@ char *help__list[] = {
 "           -r  For a list linked with list_head structures, traverse the list",
 "               in the reverse order by using the \"prev\" pointer instead",
 "               of \"next\".",
-"           -B  Use the algorithm from R. P. Brent to detect loops instead of",
-"               using a hash table.  This algorithm uses a tiny fixed amount of",
-"               memory and so is especially helpful for longer lists.  The output",
-"               is slightly different than the normal list output as it will",
-"               print the length of the loop, the start of the loop, and the",
-"               first duplicate in the list.",
+"           -B  Use the algorithm from R. P. Brent to detect loops, which is",
+"               the default.  Instead of keeping every entry in a hash table,",
+"               this algorithm uses a tiny fixed amount of memory regardless of",
+"               the length of the list.  If a loop is found, the length of the",
+"               loop, the start of the loop, and the first duplicate in the",
+"               list are displayed.  The option is accepted for compatibility.",
 " ",
 "  The meaning of the \"start\" argument, which can be expressed symbolically,",
 "  in hexadecimal format, or an expression evaluating to an address, depends",
@@ -6306,19 +6734,19 @@ NULL
 
 char *help_tree[] = {
 "tree",
-"display radix tree, XArray or red-black tree",
-"[-t [radix|xarray|rbtree]] [-r offset] [-[s|S] struct[.member[,member]]]\n       -[x|d] [-o offset] [-l] [-p] [-N] start",
-"  This command dumps the contents of a radix tree, an XAarray, or a red-black",
-"  tree.  The arguments are as follows:\n",
+"display radix tree, XArray, maple tree or red-black tree",
+"[-t [radix|xarray|maple|rbtree]] [-r offset] [-[s|S] struct[.member[,member]]]\n       -[x|d] [-o offset] [-l] [-p] [-N] start",
+"  This command dumps the contents of a radix tree, an XAarray, a maple tree,",
+"  or a red-black tree.  The arguments are as follows:\n",
 "    -t type  The type of tree to dump; the type string can be one of ",
-"             \"radix\", \"rbtree\", or \"xarray\", or alternatively, \"ra\",",
-"             \"rb\" or \"x\" are acceptable.  If not specified, rbtree is the",
-"             default type.",
+"             \"radix\", \"rbtree\", \"xarray\" or \"maple\", or alternatively,",
+"             \"ra\", \"rb\", \"x\" or \"m\" are acceptable.  If not specified,",
+"             rbtree is the default type.",
 "  -r offset  If the \"start\" argument is the address of a data structure that",
-"             contains an radix_tree_root, xarray or rb_root structure, then this", 
-"             is the offset to that structure member.  If the offset is non-zero,",
-"             then this option is required.  The offset may be entered in either",
-"             of two manners:",
+"             contains an radix_tree_root, xarray, maple_tree or rb_root",
+"             structure, then this is the offset to that structure member.  If",
+"             the offset is non-zero, then this option is required.  The offset",
+"             may be entered in either of two manners:",
 "               1. In \"structure.member\" format.",
 "               2. A number of bytes.",
 "  -o offset  For red-black trees only, the offset of the rb_node within its ",
@@ -6349,7 +6777,9 @@ char *help_tree[] = {
 "             indicates \"root/l/r\" means that the node is the right child",
 "             of the left child of the root node.  For radix trees and xarrays,",
 "             the index, the height, and the slot index values are shown with",
-"             respect to the root.",
+"             respect to the root.  For maple trees, the range of indexes",
+"             covered by the entry, and the slot index values from the root,",
+"             are shown.",
 "         -x  Override default output format with hexadecimal format.",
 "         -d  Override default output format with decimal format.",
 " ",
@@ -6364,8 +6794,8 @@ char *help_tree[] = {
 "             non-zero.",
 "               ",
 "   -N start  The address of a radix_tree_node, xa_node or rb_node structure,",
-"             bypassing the radix_tree_root, xarray, or rb_root that points",
-"             to it.",
+"             or an encoded maple_node pointer, bypassing the radix_tree_root,",
+"             xarray, maple_tree or rb_root that points to it.",
 "",
 "\nEXAMPLES",
 "  The vmap_area_root is a standalone rb_root structure.  Display the ",
@@ -6755,8 +7185,9 @@ NULL
 char *help_kmem[] = {
 "kmem",
 "kernel memory",
-"[-f|-F|-c|-C|-i|-v|-V|-n|-z|-o|-h] [-p | -m member[,member]]\n"
-"       [[-s|-S|-S=cpu[s]|-r] [slab] [-I slab[,slab]]] [-g [flags]] [[-P] address]]",
+"[-f|-F [-j count]|-c|-C|-i [-a]|-v [-t]|-V|-n|-z|-o|-h] [-p [-t] | -m member[,member]]\n"
+"       [[-s|-S|-S=cpu[s]|-r] [slab] [-I slab[,slab]] [-j count]] [-g [flags]]\n"
+"       [[-P] address]]",
 "  This command displays information about the use of kernel memory.\n",
 "        -f  displays the contents of the system free memory headers.",
 "            also verifies that the page count equals nr_free_pages.",
@@ -6764,6 +7195,11 @@ char *help_kmem[] = {
 "        -c  walks through the page_hash_table and verifies page_cache_size.",
 "        -C  same as -c, but also dumps all pages in the page_hash_table.",
 "        -i  displays general memory usage information",
+"        -a  when used with -i, count the SHARED pages and the pages with",
+"            buffers by walking all page structures.  Otherwise, if the",
+"            kernel's totalram_pages, vm_stat NR_SHMEM and slab counters all",
+"            exist, the output is built from them alone, and SHARED shows the",
+"            shmem and tmpfs pages, as /proc/meminfo does.",
 "        -v  displays the mapped virtual memory regions allocated by vmalloc().",
 "        -V  displays the kernel vm_stat table if it exists, or in more recent",
 "            kernels, the vm_zone_stat, vm_node_stat and vm_numa_stat tables,",
@@ -6785,6 +7221,11 @@ char *help_kmem[] = {
 "            mem_map[] array, made up of the page struct address, its associated",
 "            physical address, the page.mapping, page.index, page._count and",
 "            page.flags fields.",
+"        -t  when used with -p, displays the number of page structures that",
+"            have each page flag set, and their total size, instead of a line",
+"            for each page structure.  When used with -v, displays the number",
+"            and total size of the vmalloc'd regions allocated by each caller",
+"            function, largest first, instead of a line for each region.",
 " -m member  similar to -p, but displays page structure contents specified by",
 "            a comma-separated list of one or more struct page members.  The",
 "            \"flags\" member will always be expressed in hexadecimal format, and",
@@ -6816,6 +7257,14 @@ char *help_kmem[] = {
 "            all slab cache names and addresses are listed.",
 "   -I slab  when used with -s, -S or -r, one or more slab cache names in a",
 "            comma-separated list may be specified as slab caches to ignore.",
+"  -j count  when used with -s, -S or -r, and without a slab argument, spread",
+"            the slab caches across this many worker processes.  The output",
+"            of each cache is held back and displayed in the original order,",
+"            so that it matches that of a serial run, except that error",
+"            messages are shown in-line.  (currently only available if",
+"            CONFIG_SLUB)  When used with -f or -F, and without an address",
+"            argument, the free lists of each order of each zone are walked",
+"            by the worker processes, and displayed in the original order.",
 "        -g  displays the enumerator value of all bits in the page structure's",
 "            \"flags\" field.",
 "     flags  when used with -g, translates all bits in this hexadecimal page",
@@ -7806,7 +8255,7 @@ NULL
 char *help_files[] = {
 "files",
 "open files",
-"[-d dentry] | [-p inode] | [-c] [-R reference] [pid | taskp] ... ",
+"[-d dentry] | [-p inode] | [-C count] | [-c] [-R reference] [pid | taskp] ... ",
 "  This command displays information about open files of a context.",
 "  It prints the context's current root directory and current working", 
 "  directory, and then for each open file descriptor it prints a pointer",
@@ -7825,6 +8274,13 @@ char *help_files[] = {
 "                inode, a pointer to the inode's i_mapping address_space",
 "                structure, the number of pages of the inode that are in",
 "                the page cache, the file type, and the pathname.",
+"     -C count   scans the mem_map array once, and displays the count",
+"                address_space structures that own the most pages in the page",
+"                cache, with their host inode, the number of pages found, the",
+"                address_space nrpages value, the file type, and the pathname",
+"                relative to its filesystem's root.  If count is 0, all of",
+"                them are displayed.  The scan is done once per session when",
+"                running on a dumpfile.",
 "  -R reference  search for references to this file descriptor number,",
 "                filename, dentry, inode, address_space, or file structure",
 "                address.",
@@ -7917,6 +8373,15 @@ char *help_files[] = {
 "      6  e4809e48   e4809ef0        0  REG   /var/log/spooler",
 "      7  d9c43884   d9c4392c        0  REG   /var/log/boot.log",
 " ",
+"  Display the three files that have the most pages in the page cache:\n",
+"    %s> files -C 3",
+"    ADDRESS_SPACE   INODE        PAGES  NRPAGES  TYPE  PATH",
+"    f6519368       f65192c0     12285    12285  REG   /usr/lib/locale/locale-archive",
+"    f2721d04       f2721c5c      2136     2136  REG   /lib/libc-2.5.so",
+"    cbda492c       cbda4884       939      939  REG   /usr/sbin/httpd",
+"    ",
+"    31874 pages (124.5 MB) in 1873 address_space structures, 3 shown",
+" ",
 "  For the inode at address f59b90fc, display all of its pages that are in",
 "  the page cache:\n",
 "    %s> files -p f59b90fc",
@@ -7960,7 +8425,8 @@ NULL
 char *help_net[] = {
 "net",
 "network command",
-"[[-s | -S] [-xd] [-R ref] [pid | task]] [-a] [ -n [pid | task]] [-N addr]",
+"[[-s | -S] [-xd] [-R ref] [pid | task]] [-s -t [-j threads] [pid | task]]\n"
+"       [-a [-c]] [ -n [pid | task]] [-A [-c]] [-N addr]",
 "  Displays various network related data.\n",
 "  If no arguments are entered, the list of network devices, names and IP",
 "  addresses are displayed.  For kernels supporting namespaces, the -n option",
@@ -7968,7 +8434,9 @@ char *help_net[] = {
 "  network namespace of a current context or a task specified by pid or task:\n",
 "        -n  the namespace of the current context.",
 "    -n pid  a process PID.",
-"   -n task  a hexadecimal task_struct pointer.\n",
+"   -n task  a hexadecimal task_struct pointer.",
+"        -A  the devices of every network namespace, listed by namespace.",
+"     -A -c  just the number of devices in each network namespace.\n",
 
 "  The -s and -S options display data with respect to the current context, but",
 "  may be appended with an argument to show the socket data with respect",
@@ -7990,8 +8458,20 @@ char *help_net[] = {
 "  or sock data will be displayed:\n",
 "    -R ref  socket or sock address, or file descriptor.",
 " ",
+"  The -t option, used with -s, displays a summary of the open sockets of all",
+"  tasks, or of the tasks specified by pid or task, instead of one line per",
+"  socket.  Sockets shared by several tasks or file descriptors are counted",
+"  once.  The sockets are counted by family and type, INET and INET6 stream",
+"  sockets by TCP state, and the most common local TCP and UDP ports are",
+"  shown:\n",
+"        -t  display the socket summary.",
+"-j threads  split the task files_structs among the specified number of",
+"            worker processes.",
+" ",
 "  Other options:\n",
 "        -a  display the ARP cache.",
+"     -a -c  display the number of ARP cache entries of each device, in",
+"            total and by state, instead of the entries themselves.",
 "   -N addr  translates an IPv4 address expressed as a decimal or hexadecimal",
 "            value into a standard numbers-and-dots notation.",
 "        -x  override default output format with hexadecimal format.",
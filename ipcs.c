@@ -29,6 +29,8 @@
 #define MAX_ID_BIT (1U << MAX_ID_SHIFT)
 #define MAX_ID_MASK (MAX_ID_BIT - 1)
 
+#define HSB_CACHE_ENTRIES (4)
+
 #define SHM_DEST   01000
 #define SHM_LOCKED 02000
 
@@ -77,6 +79,11 @@ struct ipcs_table {
 	int seq_multiplier;
 	int cnt;
 	struct list_pair *lp;
+	struct hugetlbfs_sb_cache {
+		ulong sb;
+		ulong pages_per_hugepage;
+	} hsb_cache[HSB_CACHE_ENTRIES];
+	int hsb_cache_next;
 };
 
 /*
@@ -96,8 +103,10 @@ static void get_sem_info(struct sem_info *, ulong, int);
 static void get_msg_info(struct msg_info *, ulong, int);
 static void add_rss_swap(ulong, int, ulong *, ulong *);
 static int is_file_hugepages(ulong);
-static void gather_radix_tree_entries(ulong);
-static void gather_xarray_entries(ulong);
+static void gather_radix_tree_entries(ulong, int);
+static void gather_xarray_entries(ulong, int);
+static void gather_idr_layer_entries(ulong, int);
+static void idr_layer_walk(ulong, int, ulong, int);
 
 /*
  * global data
@@ -367,6 +376,8 @@ dump_shared_memory(int specified, ulong specified_value, int verbose, ulong task
 
 	dump_shm = dump_shm_info;
 
+	BZERO(ipcs_table.hsb_cache, sizeof(ipcs_table.hsb_cache));
+
 	if (VALID_MEMBER(kern_ipc_perm_id)) {
 		ipc_search = ipc_search_idr;
 	} else {
@@ -596,10 +607,9 @@ ipc_search_array(ulong ipc_ids_p, int specified, ulong specified_value, int (*fn
 static int
 ipc_search_idr(ulong ipc_ids_p, int specified, ulong specified_value, int (*fn)(ulong, int, ulong, int, int), int verbose)
 {
-	int i, in_use;
+	int i, id, in_use;
 	ulong ipcs_idr_p;
 	ulong ipc;
-	int next_id, total;
 	int found = 0;
 
 	readmem(ipc_ids_p + OFFSET(ipc_ids_in_use), KVADDR, &in_use, 
@@ -617,38 +627,29 @@ ipc_search_idr(ulong ipc_ids_p, int specified, ulong specified_value, int (*fn)(
 		switch (ipcs_table.init_flags & (IDR_RADIX|IDR_XARRAY))
 		{
 		case IDR_RADIX: 
-			gather_radix_tree_entries(ipcs_idr_p);
+			gather_radix_tree_entries(ipcs_idr_p, in_use);
 			break;
 		case IDR_XARRAY:
-			gather_xarray_entries(ipcs_idr_p);
+			gather_xarray_entries(ipcs_idr_p, in_use);
 			break;
 		}
+	} else
+		gather_idr_layer_entries(ipcs_idr_p, in_use);
 
-		for (i = 0; i < ipcs_table.cnt; i++) {
-			ipc = (ulong)ipcs_table.lp[i].value;
-			if (fn(ipc, specified, specified_value, UNUSED, verbose)) {
-				found = 1;
-				if (specified != SPECIFIED_NOTHING)
-					break;
-			}
-		}
-
-		if (ipcs_table.lp)
-			FREEBUF(ipcs_table.lp);
-	} else {
-		for (total = 0, next_id = 0; total < in_use; next_id++) {
-			ipc = idr_find(ipcs_idr_p, next_id);
-			if (ipc == 0)
-				continue;
-			
-			total++;
-			if (fn(ipc, specified, specified_value, next_id, verbose)) {
-				found = 1;
-				if (specified != SPECIFIED_NOTHING)
-					break;
-			}
+	for (i = 0; i < ipcs_table.cnt; i++) {
+		ipc = (ulong)ipcs_table.lp[i].value;
+		id = VALID_MEMBER(idr_idr_rt) ?
+			UNUSED : (int)ipcs_table.lp[i].index;
+		if (fn(ipc, specified, specified_value, id, verbose)) {
+			found = 1;
+			if (specified != SPECIFIED_NOTHING)
+				break;
 		}
 	}
+
+	if (ipcs_table.lp)
+		FREEBUF(ipcs_table.lp);
+	ipcs_table.lp = NULL;
 	
 	if (!verbose && specified == SPECIFIED_NOTHING)
 		fprintf(fp, "\n");
@@ -1046,10 +1047,24 @@ add_rss_swap(ulong inode_p, int hugepage, ulong *rss, ulong *swap)
 		if (VALID_SIZE(hstate)) {
 			unsigned long i_sb_p, hsb_p, hstate_p;
 			unsigned int order;
+			struct hugetlbfs_sb_cache *hc;
+			int i;
 
 			readmem(inode_p + OFFSET(inode_i_sb), KVADDR, &i_sb_p,
 				sizeof(ulong), "inode.i_sb",
 				FAULT_ON_ERROR);
+			/*
+			 * The segments share a few hugetlbfs super blocks,
+			 * so the hstate page counts of the recent ones are
+			 * kept for the duration of the command.
+			 */
+			for (i = 0; i < HSB_CACHE_ENTRIES; i++) {
+				hc = &ipcs_table.hsb_cache[i];
+				if (hc->sb && (hc->sb == i_sb_p)) {
+					*rss += hc->pages_per_hugepage * nr_pages;
+					return;
+				}
+			}
 			readmem(i_sb_p + OFFSET(super_block_s_fs_info),
 				KVADDR,	&hsb_p, sizeof(ulong),
 				"super_block.s_fs_info", FAULT_ON_ERROR);
@@ -1060,6 +1075,11 @@ add_rss_swap(ulong inode_p, int hugepage, ulong *rss, ulong *swap)
 				&order,	sizeof(uint), "hstate.order",
 				FAULT_ON_ERROR);
 			pages_per_hugepage = 1 << order;
+			hc = &ipcs_table.hsb_cache[ipcs_table.hsb_cache_next];
+			hc->sb = i_sb_p;
+			hc->pages_per_hugepage = pages_per_hugepage;
+			ipcs_table.hsb_cache_next = (ipcs_table.hsb_cache_next + 1) %
+				HSB_CACHE_ENTRIES;
 		} else {
 			unsigned long hpage_shift;
 			/*
@@ -1129,11 +1149,25 @@ again:
 	return 0;
 }
 
+/*
+ * The in_use count of the ipc_ids is the number of entries to expect,
+ * so they are gathered in one walk of the tree into an array with room
+ * for one more.  The tree is only counted first, and walked again, if it
+ * turns out to hold more than that.
+ */
 static void
-gather_radix_tree_entries(ulong ipcs_idr_p)
+gather_radix_tree_entries(ulong ipcs_idr_p, int in_use)
 {
 	long len;
 
+	len = sizeof(struct list_pair) * (in_use+2);
+	ipcs_table.lp = (struct list_pair *)GETBUF(len);
+	ipcs_table.lp[0].index = in_use+1;
+	ipcs_table.cnt = do_radix_tree(ipcs_idr_p, RADIX_TREE_GATHER, ipcs_table.lp);
+	if (ipcs_table.cnt <= in_use)
+		return;
+	FREEBUF(ipcs_table.lp);
+
 	ipcs_table.cnt = do_radix_tree(ipcs_idr_p, RADIX_TREE_COUNT, NULL);
 
 	if (ipcs_table.cnt) {
@@ -1146,10 +1180,18 @@ gather_radix_tree_entries(ulong ipcs_idr_p)
 }
 
 static void
-gather_xarray_entries(ulong ipcs_idr_p)
+gather_xarray_entries(ulong ipcs_idr_p, int in_use)
 {
 	long len;
 
+	len = sizeof(struct list_pair) * (in_use+2);
+	ipcs_table.lp = (struct list_pair *)GETBUF(len);
+	ipcs_table.lp[0].index = in_use+1;
+	ipcs_table.cnt = do_xarray(ipcs_idr_p, XARRAY_GATHER, ipcs_table.lp);
+	if (ipcs_table.cnt <= in_use)
+		return;
+	FREEBUF(ipcs_table.lp);
+
 	ipcs_table.cnt = do_xarray(ipcs_idr_p, XARRAY_COUNT, NULL);
 
 	if (ipcs_table.cnt) {
@@ -1161,3 +1203,71 @@ gather_xarray_entries(ulong ipcs_idr_p)
 		ipcs_table.lp = NULL;
 }
 
+/*
+ * Gather the first in_use entries of an idr of the original layered
+ * design, in id order, with one walk of its idr_layer tree that reads
+ * the ary[] of each layer whole, instead of looking up every id from
+ * the top with idr_find().
+ */
+static void
+gather_idr_layer_entries(ulong idp, int in_use)
+{
+	ulong idr_layer_p;
+	int layer, idr_layers;
+
+	ipcs_table.cnt = 0;
+	ipcs_table.lp = NULL;
+
+	readmem(idp + OFFSET(idr_top), KVADDR, &idr_layer_p,
+		sizeof(ulong), "idr.top", FAULT_ON_ERROR);
+
+	if (!idr_layer_p)
+		return;
+
+	if (VALID_MEMBER(idr_layer_layer)) {
+		readmem(idr_layer_p + OFFSET(idr_layer_layer), KVADDR,
+			&layer,	sizeof(int), "idr_layer.layer",
+			FAULT_ON_ERROR);
+		idr_layers = layer + 1;
+	} else {
+		readmem(idp + OFFSET(idr_layers), KVADDR, &idr_layers,
+			sizeof(int), "idr.layers", FAULT_ON_ERROR);
+	}
+
+	if ((idr_layers <= 0) ||
+	    ((idr_layers - 1) * ipcs_table.idr_bits > MAX_ID_SHIFT))
+		return;
+
+	ipcs_table.lp = (struct list_pair *)
+		GETBUF(sizeof(struct list_pair) * (in_use+1));
+
+	idr_layer_walk(idr_layer_p, idr_layers - 1, 0, in_use);
+}
+
+static void
+idr_layer_walk(ulong idr_layer_p, int height, ulong base, int max)
+{
+	int i, n;
+	ulong id, *ary;
+
+	n = 1 << ipcs_table.idr_bits;
+	ary = (ulong *)GETBUF(sizeof(ulong) * n);
+
+	readmem(idr_layer_p + OFFSET(idr_layer_ary), KVADDR, ary,
+		sizeof(ulong) * n, "idr_layer.ary", FAULT_ON_ERROR);
+
+	for (i = 0; (i < n) && (ipcs_table.cnt < max); i++) {
+		if (!ary[i])
+			continue;
+		id = base | ((ulong)i << (height * ipcs_table.idr_bits));
+		if (height)
+			idr_layer_walk(ary[i], height - 1, id, max);
+		else {
+			ipcs_table.lp[ipcs_table.cnt].index = id;
+			ipcs_table.lp[ipcs_table.cnt].value = (void *)ary[i];
+			ipcs_table.cnt++;
+		}
+	}
+
+	FREEBUF(ary);
+}
@@ -23,7 +23,104 @@
 #include <elf.h>
 #include <inttypes.h>
 
+/*
+ *  The steps of calc_kaslr_offset(), in the order that they are tried,
+ *  with the time and readmem() traffic that each has cost.  The readmem()
+ *  counts are only gathered when the session was started with --timing.
+ */
+struct kaslr_step {
+	char *name;
+	int calls;
+	int found;
+	ulonglong usecs;
+	ulong reads;
+	ulonglong bytes;
+};
+
+static struct kaslr_step kaslr_steps[] = {
+#define KASLR_STEP_VMCOREINFO	(0)
+	{ "vmcoreinfo" },
+#define KASLR_STEP_CACHE	(1)
+	{ "session_cache" },
+#define KASLR_STEP_IDT		(2)
+	{ "idt" },
+#define KASLR_STEP_PAGE_TABLES	(3)
+	{ "page_tables" },
+#define KASLR_STEP_ELFCOREHDR	(4)
+	{ "elfcorehdr" },
+	{ NULL }
+};
+
+/*
+ *  Display the KASLR offset steps that were run, for "help -p".
+ */
+void
+dump_kaslr_steps(void)
+{
+	struct kaslr_step *ks;
+
+	if (!kaslr_steps[KASLR_STEP_VMCOREINFO].calls)
+		return;
+
+	fprintf(fp, "\n      kaslr steps:  %-18s %5s %12s %10s %14s\n",
+		"STEP", "CALLS", "WALL", "READMEMS", "BYTES");
+
+	for (ks = kaslr_steps; ks->name; ks++) {
+		if (!ks->calls)
+			continue;
+		fprintf(fp, "                   %-18s %5d %5lld.%06lld %10ld %14lld%s\n",
+			ks->name, ks->calls, ks->usecs / 1000000,
+			ks->usecs % 1000000, ks->reads, ks->bytes,
+			ks->found ? "  (found)" : "");
+	}
+}
+
 #ifdef X86_64
+struct kaslr_step_mark {
+	struct timespec start;
+	struct readmem_profile_totals totals;
+};
+
+static void
+kaslr_step_begin(struct kaslr_step_mark *mark)
+{
+	BZERO(&mark->totals, sizeof(struct readmem_profile_totals));
+	if (pc->flags2 & STARTUP_TIMING)
+		readmem_profile_get(&mark->totals);
+	clock_gettime(CLOCK_MONOTONIC, &mark->start);
+}
+
+static int
+kaslr_step_end(int step, struct kaslr_step_mark *mark, int found)
+{
+	struct kaslr_step *ks;
+	struct readmem_profile_totals totals;
+	struct timespec now;
+	ulonglong usecs;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	BZERO(&totals, sizeof(struct readmem_profile_totals));
+	if (pc->flags2 & STARTUP_TIMING)
+		readmem_profile_get(&totals);
+
+	usecs = (ulonglong)(now.tv_sec - mark->start.tv_sec) * 1000000 +
+		(now.tv_nsec - mark->start.tv_nsec) / 1000;
+
+	ks = &kaslr_steps[step];
+	ks->calls++;
+	ks->usecs += usecs;
+	ks->reads += totals.reads - mark->totals.reads;
+	ks->bytes += totals.bytes - mark->totals.bytes;
+	if (found)
+		ks->found = TRUE;
+
+	if (CRASHDEBUG(1))
+		fprintf(fp, "calc_kaslr_offset: %s: %s (%lld usecs)\n",
+			ks->name, found ? "found" : "not found", usecs);
+
+	return found;
+}
+
 /*
  * Get address of vector0 interrupt handler (Devide Error) from Interrupt
  * Descriptor Table.
@@ -40,7 +137,9 @@ get_vec0_addr(ulong idtr)
 		uint32_t zero1;
 	} __attribute__((packed)) gate;
 
-	readmem(idtr, PHYSADDR, &gate, sizeof(gate), "idt_table", FAULT_ON_ERROR);
+	if (!readmem(idtr, PHYSADDR, &gate, sizeof(gate), "idt_table",
+	    RETURN_ON_ERROR|QUIET))
+		return 0;
 
 	return ((ulong)gate.offset_high << 32)
 		+ ((ulong)gate.offset_middle << 16)
@@ -419,6 +518,13 @@ find_kernel_start(uint64_t pgd, ulong *va, ulong *pa)
 	else
 		*va = ~__VIRTUAL_MASK;
 
+	/*
+	 *  The FILL_xxx() reads are fatal, so check that each page table
+	 *  page is in the dumpfile first; a CPU whose tables have been
+	 *  excluded just fails over to the next one.
+	 */
+	if (!dumpfile_page_present(pgd & PHYSICAL_PAGE_MASK))
+		return FALSE;
 	FILL_PGD(pgd & PHYSICAL_PAGE_MASK, PHYSADDR, PAGESIZE());
 	for (; pgd_idx < PTRS_PER_PGD; pgd_idx++) {
 		pgd_pte = ULONG(machdep->pgd + pgd_idx * sizeof(uint64_t));
@@ -431,6 +537,8 @@ find_kernel_start(uint64_t pgd, ulong *va, ulong *pa)
 	*va |= (ulong)pgd_idx << __PGDIR_SHIFT;
 
 	if (machdep->flags & VM_5LEVEL) {
+		if (!dumpfile_page_present(pgd_pte & PHYSICAL_PAGE_MASK))
+			return FALSE;
 		FILL_P4D(pgd_pte & PHYSICAL_PAGE_MASK, PHYSADDR, PAGESIZE());
 		for (; p4d_idx < PTRS_PER_P4D; p4d_idx++) {
 			/* reuse pgd_pte */
@@ -444,6 +552,8 @@ find_kernel_start(uint64_t pgd, ulong *va, ulong *pa)
 		*va |= (ulong)p4d_idx << P4D_SHIFT;
 	}
 
+	if (!dumpfile_page_present(pgd_pte & PHYSICAL_PAGE_MASK))
+		return FALSE;
 	FILL_PUD(pgd_pte & PHYSICAL_PAGE_MASK, PHYSADDR, PAGESIZE());
 	for (; pud_idx < PTRS_PER_PUD; pud_idx++) {
 		pud_pte = ULONG(machdep->pud + pud_idx * sizeof(uint64_t));
@@ -460,6 +570,8 @@ find_kernel_start(uint64_t pgd, ulong *va, ulong *pa)
 		return TRUE;
 	}
 
+	if (!dumpfile_page_present(pud_pte & PHYSICAL_PAGE_MASK))
+		return FALSE;
 	FILL_PMD(pud_pte & PHYSICAL_PAGE_MASK, PHYSADDR, PAGESIZE());
 	for (; pmd_idx < PTRS_PER_PMD; pmd_idx++) {
 		pmd_pte = ULONG(machdep->pmd + pmd_idx * sizeof(uint64_t));
@@ -476,6 +588,8 @@ find_kernel_start(uint64_t pgd, ulong *va, ulong *pa)
 		return TRUE;
 	}
 
+	if (!dumpfile_page_present(pmd_pte & PHYSICAL_PAGE_MASK))
+		return FALSE;
 	FILL_PTBL(pmd_pte & PHYSICAL_PAGE_MASK, PHYSADDR, PAGESIZE());
 	for (; pte_idx < PTRS_PER_PTE; pte_idx++) {
 		pte = ULONG(machdep->ptbl + pte_idx * sizeof(uint64_t));
@@ -575,7 +689,7 @@ calc_kaslr_offset_from_idt(uint64_t idtr, uint64_t pgd, ulong *kaslr_offset, ulo
 	ulong divide_error_vmcore;
 	int verbose = CRASHDEBUG(1)? 1: 0;
 
-	if (!idtr)
+	if (!idtr || !st->divide_error_vmlinux)
 		return FALSE;
 
 	/* Convert virtual address of IDT table to physical address */
@@ -583,7 +697,8 @@ calc_kaslr_offset_from_idt(uint64_t idtr, uint64_t pgd, ulong *kaslr_offset, ulo
 		return FALSE;
 
 	/* Now we can calculate kaslr_offset and phys_base */
-	divide_error_vmcore = get_vec0_addr(idtr_paddr);
+	if (!(divide_error_vmcore = get_vec0_addr(idtr_paddr)))
+		return FALSE;
 	*kaslr_offset = divide_error_vmcore - st->divide_error_vmlinux;
 	*phys_base = idtr_paddr -
 		(st->idt_table_vmlinux + *kaslr_offset - __START_KERNEL_map);
@@ -613,7 +728,15 @@ calc_kaslr_offset_from_idt(uint64_t idtr, uint64_t pgd, ulong *kaslr_offset, ulo
  *   physical address of __START_KERNEL_map. This is also decided randomly by
  *   kaslr.
  *
- * It walks through all available CPUs registers to calculate the offset/base.
+ * The cheapest sources are tried first:
+ *
+ * 1) KERNELOFFSET and NUMBER(phys_base) in the dumpfile's own vmcoreinfo.
+ * 2) The values found by an earlier --session_cache session.
+ * 3) For each available CPU, the vector 0 entry of the IDT pointed to by
+ *    its IDTR, and failing that, a walk of the page tables pointed to by
+ *    its CR3, both of which are checked against the linux_banner.
+ *
+ * Each step's cost is shown by "help -p" when crash is run with --timing.
  *
  * Also, it considers the case where dump is captured whle kdump is working,
  * IDTR points to the IDT table of 2nd kernel, not 1st kernel.
@@ -631,17 +754,106 @@ calc_kaslr_offset_from_idt(uint64_t idtr, uint64_t pgd, ulong *kaslr_offset, ulo
 #define PTI_USER_PGTABLE_MASK	(1 << PTI_USER_PGTABLE_BIT)
 #define CR3_PCID_MASK		0xFFFull
 #define CR4_LA57		(1 << 12)
+/*
+ *  Set up the 4-level or 5-level page table geometry for kvtop().
+ *  calc_kaslr_offset() is called before machdep_init(PRE_GDB), so
+ *  these are not initialized yet.
+ */
+static void
+kaslr_set_paging_mode(int la57)
+{
+	if (la57) {
+		machdep->flags |= VM_5LEVEL;
+		machdep->machspec->physical_mask_shift = __PHYSICAL_MASK_SHIFT_5LEVEL;
+		machdep->machspec->pgdir_shift = PGDIR_SHIFT_5LEVEL;
+		machdep->machspec->ptrs_per_pgd = PTRS_PER_PGD_5LEVEL;
+		if (!machdep->machspec->p4d &&
+		    ((machdep->machspec->p4d = (char *)malloc(PAGESIZE())) == NULL))
+			error(FATAL, "cannot malloc p4d space.");
+		machdep->machspec->last_p4d_read = 0;
+	} else {
+		machdep->machspec->physical_mask_shift = __PHYSICAL_MASK_SHIFT_2_6;
+		machdep->machspec->pgdir_shift = PGDIR_SHIFT;
+		machdep->machspec->ptrs_per_pgd = PTRS_PER_PGD;
+	}
+}
+
+static int
+kaslr_offset_from_dump_vmcoreinfo(ulong *kaslr_offset, ulong *phys_base)
+{
+	char *string;
+	ulong offset;
+
+	if (!(string = pc->read_vmcoreinfo("KERNELOFFSET")))
+		return FALSE;
+	offset = htol(string, RETURN_ON_ERROR|QUIET, NULL);
+	free(string);
+	if (offset == BADADDR)
+		return FALSE;
+
+	if (!(string = pc->read_vmcoreinfo("NUMBER(phys_base)")))
+		return FALSE;
+	if (*string == '-')
+		*phys_base = dtol(string+1, QUIET, NULL) * -1;
+	else
+		*phys_base = dtol(string, QUIET, NULL);
+	free(string);
+	*kaslr_offset = offset;
+
+	return TRUE;
+}
+
+/*
+ *  The "kaslr_offset" section of the session cache.
+ */
+struct kaslr_image {
+	ulong kaslr_offset;
+	ulong phys_base;
+	ulong la57;
+};
+
+static int
+kaslr_offset_from_session_cache(ulong *kaslr_offset, ulong *phys_base)
+{
+	struct kaslr_image *image;
+	ulong size;
+
+	if (!(image = session_cache_get("kaslr_offset", &size)) ||
+	    (size != sizeof(struct kaslr_image)))
+		return FALSE;
+
+	if (image->la57)
+		kaslr_set_paging_mode(TRUE);
+
+	*kaslr_offset = image->kaslr_offset;
+	*phys_base = image->phys_base;
+
+	return TRUE;
+}
+
 int
 calc_kaslr_offset(ulong *ko, ulong *pb)
 {
 	uint64_t cr3 = 0, cr4 = 0, idtr = 0, pgd = 0;
-	ulong kaslr_offset, phys_base;
-	ulong kaslr_offset_kdump, phys_base_kdump;
-	int cpu, nr_cpus;
+	ulong kaslr_offset = 0, phys_base = 0;
+	ulong kaslr_offset_kdump = 0, phys_base_kdump = 0;
+	struct kaslr_step_mark mark;
+	struct kaslr_image image;
+	int cpu, nr_cpus, found;
 
 	if (!machine_type("X86_64"))
 		return FALSE;
 
+	kaslr_step_begin(&mark);
+	if (kaslr_step_end(KASLR_STEP_VMCOREINFO, &mark,
+	    kaslr_offset_from_dump_vmcoreinfo(&kaslr_offset, &phys_base)))
+		goto done;
+
+	kaslr_step_begin(&mark);
+	if (kaslr_step_end(KASLR_STEP_CACHE, &mark,
+	    kaslr_offset_from_session_cache(&kaslr_offset, &phys_base)))
+		goto done;
+
 	nr_cpus = get_nr_cpus();
 
 	for (cpu = 0; cpu < nr_cpus; cpu++) {
@@ -659,39 +871,31 @@ calc_kaslr_offset(ulong *ko, ulong *pb)
 		/*
 		 * Set up for kvtop.
 		 *
-		 * calc_kaslr_offset() is called before machdep_init(PRE_GDB), so some
-		 * variables are not initialized yet. Set up them here to call kvtop().
-		 *
 		 * TODO: XEN is not supported
 		 */
 		vt->kernel_pgd[0] = pgd;
 		machdep->last_pgd_read = vt->kernel_pgd[0];
-		if (cr4 & CR4_LA57) {
-			machdep->flags |= VM_5LEVEL;
-			machdep->machspec->physical_mask_shift = __PHYSICAL_MASK_SHIFT_5LEVEL;
-			machdep->machspec->pgdir_shift = PGDIR_SHIFT_5LEVEL;
-			machdep->machspec->ptrs_per_pgd = PTRS_PER_PGD_5LEVEL;
-			if ((machdep->machspec->p4d = (char *)malloc(PAGESIZE())) == NULL)
-				error(FATAL, "cannot malloc p4d space.");
-			machdep->machspec->last_p4d_read = 0;
-		} else {
-			machdep->machspec->physical_mask_shift = __PHYSICAL_MASK_SHIFT_2_6;
-			machdep->machspec->pgdir_shift = PGDIR_SHIFT;
-			machdep->machspec->ptrs_per_pgd = PTRS_PER_PGD;
-		}
+		kaslr_set_paging_mode(cr4 & CR4_LA57 ? TRUE : FALSE);
+		if (!dumpfile_page_present(pgd))
+			continue;
 		if (!readmem(pgd, PHYSADDR, machdep->pgd, PAGESIZE(),
 					"pgd", RETURN_ON_ERROR))
 			continue;
 
-		if (!calc_kaslr_offset_from_page_tables(pgd, &kaslr_offset,
-							&phys_base)) {
-			if (!calc_kaslr_offset_from_idt(idtr, pgd,
-							&kaslr_offset,
-							&phys_base))
-				continue;
-		}
+		/*
+		 * The IDT lookup costs a translation and a single gate
+		 * read, so it is tried before the page table walk.
+		 */
+		kaslr_step_begin(&mark);
+		found = calc_kaslr_offset_from_idt(idtr, pgd, &kaslr_offset,
+			&phys_base) && verify_kaslr_offset(kaslr_offset);
+		if (kaslr_step_end(KASLR_STEP_IDT, &mark, found))
+			goto found;
 
-		if (verify_kaslr_offset(kaslr_offset))
+		kaslr_step_begin(&mark);
+		found = calc_kaslr_offset_from_page_tables(pgd, &kaslr_offset,
+			&phys_base) && verify_kaslr_offset(kaslr_offset);
+		if (kaslr_step_end(KASLR_STEP_PAGE_TABLES, &mark, found))
 			goto found;
 	}
 
@@ -705,8 +909,10 @@ found:
 	 * kernel. If we are in 2nd kernel, get kaslr_offset/phys_base
 	 * from vmcoreinfo
 	 */
-	if (get_kaslr_offset_from_vmcoreinfo(kaslr_offset, &kaslr_offset_kdump,
-					     &phys_base_kdump)) {
+	kaslr_step_begin(&mark);
+	if (kaslr_step_end(KASLR_STEP_ELFCOREHDR, &mark,
+	    get_kaslr_offset_from_vmcoreinfo(kaslr_offset, &kaslr_offset_kdump,
+	    &phys_base_kdump))) {
 		kaslr_offset = kaslr_offset_kdump;
 		phys_base = phys_base_kdump;
 	} else if (CRASHDEBUG(1)) {
@@ -714,6 +920,15 @@ found:
 		fprintf(fp, "kaslr_helper: asssuming the kdump 1st kernel.\n");
 	}
 
+	image.kaslr_offset = kaslr_offset;
+	image.phys_base = phys_base;
+	image.la57 = machdep->flags & VM_5LEVEL ? TRUE : FALSE;
+	session_cache_put("kaslr_offset", &image, sizeof(struct kaslr_image));
+
+	vt->kernel_pgd[0] = 0;
+	machdep->last_pgd_read = 0;
+
+done:
 	if (CRASHDEBUG(1)) {
 		fprintf(fp, "calc_kaslr_offset: kaslr_offset=%lx\n",
 			kaslr_offset);
@@ -723,8 +938,6 @@ found:
 	*ko = kaslr_offset;
 	*pb = phys_base;
 
-	vt->kernel_pgd[0] = 0;
-	machdep->last_pgd_read = 0;
 	return TRUE;
 }
 #else
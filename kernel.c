@@ -30,9 +30,11 @@
 #include "bfd.h"
 
 static void do_module_cmd(ulong, char *, ulong, char *, char *);
+static void do_back_trace(struct bt_info *);
 static void show_module_taint(void);
 static char *find_module_objfile(char *, char *, char *);
 static char *module_objfile_search(char *, char *, char *);
+static void module_objfile_prefetch(void *, int, int);
 static char *get_loadavg(char *);
 static void get_lkcd_regs(struct bt_info *, ulong *, ulong *);
 static void dump_sys_call_table(char *, int);
@@ -47,6 +49,8 @@ static void dump_hrtimer_data(const ulong *cpus);
 static void dump_hrtimer_clock_base(const void *, const int);
 static void dump_hrtimer_base(const void *, const int);
 static void dump_active_timers(const void *, ulonglong);
+static int get_active_timers(const void *, ulong **);
+static void summarize_active_timers(const void *);
 static int get_expires_len(const int, const ulong *, ulonglong, const int);
 static void print_timer(const void *, ulonglong);
 static ulonglong ktime_to_ns(const void *);
@@ -62,6 +66,8 @@ static int do_timer_list_v3(ulong, int, ulong *, void *,ulong *, ulong *, ulong,
 struct timer_bases_data;
 static int do_timer_list_v4(struct timer_bases_data *, ulong);
 static int compare_timer_data(const void *, const void *);
+static void timer_summary_add(ulong);
+static void dump_timer_summary(void);
 static void panic_this_kernel(void);
 static void dump_waitq(ulong, char *);
 static void reinit_modules(void);
@@ -86,6 +92,7 @@ static void get_xtime(struct timespec *);
 static char *log_from_idx(uint32_t, char *);
 static uint32_t log_next(uint32_t, char *);
 static void dump_log_entry(char *, int);
+static void parse_log_filter(int, char *);
 static void dump_variable_length_record_log(int);
 static void hypervisor_init(void);
 static void dump_log_legacy(void);
@@ -103,6 +110,8 @@ static char *vmcoreinfo_read_string(const char *);
 static void check_vmcoreinfo(void);
 static int is_pvops_xen(void);
 static int get_linux_banner_from_vmlinux(char *, size_t);
+static void bt_active_job(void *, int);
+static int bt_active_parallel(struct bt_info *, char *, int);
 
 
 /*
@@ -1843,6 +1852,115 @@ set_reverse_tmpfile_offset(struct gnu_request *req, ulong target)
 
 static char *dis_err = "gdb unable to disassemble kernel virtual address %lx\n";
 
+/*
+ *  Session cache of the raw gdb disassembly output used by "dis", keyed
+ *  by the x/i command string and gdb's output radix.  Kernel text does
+ *  not change in a dumpfile, so it is only emptied when the symbol files
+ *  known to gdb, or gdb's settings, change.  It is not used on live
+ *  systems, where text may be patched at run time.
+ */
+#define DIS_CACHE_ENTRIES   (64)
+#define DIS_CACHE_MAX_TEXT  (MEGABYTES(1))
+
+static struct dis_cache_entry {
+	char *cmd;
+	uint radix;
+	char *text;
+	long len;
+	ulong last_used;
+} dis_cache[DIS_CACHE_ENTRIES];
+
+static ulong dis_cache_clock;
+static ulong dis_cache_hits;
+static ulong dis_cache_misses;
+
+void
+dis_cache_invalidate(void)
+{
+	int i;
+
+	for (i = 0; i < DIS_CACHE_ENTRIES; i++) {
+		free(dis_cache[i].cmd);
+		free(dis_cache[i].text);
+		BZERO(&dis_cache[i], sizeof(struct dis_cache_entry));
+	}
+}
+
+ulonglong
+dis_cache_memory_used(void)
+{
+	int i;
+	ulonglong bytes;
+
+	for (i = 0, bytes = 0; i < DIS_CACHE_ENTRIES; i++)
+		if (dis_cache[i].cmd)
+			bytes += strlen(dis_cache[i].cmd) + 1 + dis_cache[i].len;
+
+	return bytes;
+}
+
+/*
+ *  Write the gdb output of an x/i command to pc->tmpfile, from the
+ *  cache if possible.  On a miss the output is captured from the
+ *  tmpfile after gdb has written it.
+ */
+static int
+dis_cache_pass_through(char *cmd)
+{
+	int i;
+	long len;
+	struct dis_cache_entry *dce, *victim;
+	char *text;
+
+	if (ACTIVE())
+		return gdb_pass_through(cmd, NULL, GNU_RETURN_ON_ERROR);
+
+	for (i = 0, victim = NULL; i < DIS_CACHE_ENTRIES; i++) {
+		dce = &dis_cache[i];
+		if (dce->cmd && STREQ(dce->cmd, cmd) &&
+		    (dce->radix == *gdb_output_radix)) {
+			dce->last_used = ++dis_cache_clock;
+			dis_cache_hits++;
+			if (fwrite(dce->text, 1, dce->len, pc->tmpfile) != dce->len)
+				return FALSE;
+			return TRUE;
+		}
+		if (!victim || (dce->last_used < victim->last_used))
+			victim = dce;
+	}
+
+	dis_cache_misses++;
+
+	if (!gdb_pass_through(cmd, NULL, GNU_RETURN_ON_ERROR))
+		return FALSE;
+
+	fflush(pc->tmpfile);
+	if (((len = ftell(pc->tmpfile)) <= 0) || (len > DIS_CACHE_MAX_TEXT) ||
+	    !memory_limit_reserve(len) || !(text = malloc(len)))
+		return TRUE;
+
+	rewind(pc->tmpfile);
+	if (fread(text, 1, len, pc->tmpfile) != len) {
+		free(text);
+		fseek(pc->tmpfile, 0, SEEK_END);
+		return TRUE;
+	}
+
+	free(victim->cmd);
+	free(victim->text);
+	if (!(victim->cmd = strdup(cmd))) {
+		free(text);
+		BZERO(victim, sizeof(struct dis_cache_entry));
+		return TRUE;
+	}
+	victim->radix = *gdb_output_radix;
+	victim->text = text;
+	victim->len = len;
+	victim->last_used = ++dis_cache_clock;
+
+	return TRUE;
+}
+
 void
 cmd_dis(void)
 {
@@ -2023,6 +2141,9 @@ cmd_dis(void)
 			count_entered++;
 		}
 
+		if (!user_mode)
+			load_lazy_module_symbols(req->addr);
+
 		if (sources) {
 			list_source_code(req, count_entered);
 			return;
@@ -2096,7 +2217,7 @@ cmd_dis(void)
 				forward || req->flags & GNU_FUNCTION_ONLY ? 
 				req->addr2 - req->addr : 1, 
 				req->addr);
-		gdb_pass_through(buf5, NULL, GNU_RETURN_ON_ERROR);
+		dis_cache_pass_through(buf5);
 
 		if (req->flags & GNU_COMMAND_FAILED) {
 			close_tmpfile();
@@ -2478,13 +2599,93 @@ clone_bt_info(struct bt_info *orig, struct bt_info *new,
 	pc->flags &= ~IN_FOREACH;				\
 	}
 
+/*
+ *  The active tasks of a "bt -a", each of which is a run_forked() job
+ *  with "bt -a -j".
+ */
+struct bt_active_jobs {
+	int count;
+	struct task_context **tc;
+	struct bt_info *bt_setup;
+	char *refptr;
+};
+
+/*
+ *  run_forked() job: display the back trace of one active task.  An
+ *  error in the back trace just ends the job, as it ends that task's
+ *  back trace in the serial loop.
+ */
+static void
+bt_active_job(void *arg, int j)
+{
+	struct bt_active_jobs *bj = arg;
+	struct bt_info bt_info, *bt;
+	struct reference reference;
+
+	bt = &bt_info;
+	clone_bt_info(bj->bt_setup, bt, bj->tc[j]);
+	if (bj->refptr) {
+		BZERO(&reference, sizeof(struct reference));
+		bt->ref = &reference;
+		bt->ref->str = bj->refptr;
+	}
+
+	if (setjmp(pc->foreach_loop_env)) {
+		pc->flags &= ~IN_FOREACH;
+		free_all_bufs();
+		return;
+	}
+
+	if (!BT_REFERENCE_CHECK(bt))
+		print_task_header(fp, bj->tc[j], j);
+	pc->flags |= IN_FOREACH;
+	back_trace(bt);
+	pc->flags &= ~IN_FOREACH;
+}
+
+/*
+ *  "bt -a -j threads": unwind the active tasks in worker processes, with
+ *  their output displayed in cpu order.  Returns FALSE if the back traces
+ *  should be done serially instead.
+ */
+static int
+bt_active_parallel(struct bt_info *bt_setup, char *refptr, int threads)
+{
+	int c, ret;
+	struct bt_active_jobs jobs;
+	struct task_context *tc;
+
+	BZERO(&jobs, sizeof(struct bt_active_jobs));
+	jobs.bt_setup = bt_setup;
+	jobs.refptr = refptr;
+
+	/*
+	 *  Not a GETBUF(), since run_forked() frees all buffers if the
+	 *  command is interrupted.
+	 */
+	if (!(jobs.tc = calloc(NR_CPUS, sizeof(struct task_context *)))) {
+		error(INFO, "cannot malloc bt job array\n");
+		return FALSE;
+	}
+
+	for (c = 0; c < NR_CPUS; c++) {
+		if ((tc = task_to_context(tt->panic_threads[c])))
+			jobs.tc[jobs.count++] = tc;
+	}
+
+	ret = run_forked(threads, jobs.count, bt_active_job, &jobs);
+
+	free(jobs.tc);
+	return (ret != FORKED_SERIAL);
+}
+
 void
 cmd_bt(void)
 {
 	int i, c;
 	ulong value, *cpus;
         struct task_context *tc;
-	int subsequent, active, panic;
+	int subsequent, active, panic, threads;
 	struct stack_hook hook;
 	struct bt_info bt_info, bt_setup, *bt;
 	struct reference reference;
@@ -2494,7 +2695,7 @@ cmd_bt(void)
 
 	tc = NULL;
 	cpus = NULL;
-	subsequent = active = panic = 0;
+	subsequent = active = panic = threads = 0;
 	hook.eip = hook.esp = 0;
 	refptr = 0;
 	bt = &bt_info;
@@ -2503,7 +2704,7 @@ cmd_bt(void)
 	if (kt->flags & USE_OPT_BT)
 		bt->flags |= BT_OPT_BACK_TRACE;
 
-	while ((c = getopt(argcnt, args, "D:fFI:S:c:n:aAloreEgstTdxR:Ovp")) != EOF) {
+	while ((c = getopt(argcnt, args, "D:fFI:S:c:n:aAloreEgstTdxR:Ovpj:")) != EOF) {
                 switch (c)
 		{
 		case 'f':
@@ -2672,6 +2873,13 @@ cmd_bt(void)
 			active++;
 			break;
 
+		case 'j':
+			threads = dtoi(optarg, FAULT_ON_ERROR, NULL);
+			if ((threads < 1) || (threads > MAX_PARALLEL_THREADS))
+				error(FATAL, "-j: thread count must be between "
+					"1 and %d\n", MAX_PARALLEL_THREADS);
+			break;
+
 		case 'n':
 			if ((machine_type("X86_64") || machine_type("ARM64")) &&
 			    STREQ(optarg, "idle"))
@@ -2721,6 +2929,9 @@ cmd_bt(void)
 	if (argerrs)
 		cmd_usage(pc->curcmd, SYNOPSIS);
 
+	if (threads && !active)
+		error(FATAL, "-j option requires the -a option\n");
+
 	if (bt->flags & BT_FRAMESIZE_DEBUG) {
 		if (machdep->flags & FRAMESIZE_DEBUG) {
 			while (args[optind]) {
@@ -2825,6 +3036,10 @@ cmd_bt(void)
 			error(FATAL, 
 			    "-a option cannot be used with the -g option\n");
 
+		if ((threads > 1) &&
+		    bt_active_parallel(&bt_setup, refptr, threads))
+			return;
+
 		for (c = 0; c < NR_CPUS; c++) {
 			if (setjmp(pc->foreach_loop_env)) {
 				pc->flags &= ~IN_FOREACH;
@@ -2983,6 +3198,21 @@ in_alternate_stack(int cpu, ulong address)
  */
 void
 back_trace(struct bt_info *bt)
+{
+	ulonglong tstart;
+
+	if (!TRACING()) {
+		do_back_trace(bt);
+		return;
+	}
+
+	tstart = trace_time();
+	do_back_trace(bt);
+	trace_span("walker", "back_trace", NULL, tstart);
+}
+
+static void
+do_back_trace(struct bt_info *bt)
 {
 	int i;
 	ulong *up;
@@ -3299,9 +3529,9 @@ restore_stack(struct bt_info *bt)
 		bt->flags |= BT_SOFTIRQ; 
                 bt->stackbase = tt->softirq_ctx[bt->tc->processor];
                 bt->stacktop = bt->stackbase + STACKSIZE();
-		if (!readmem(bt->stackbase, KVADDR, bt->stackbuf,
+		if (!read_stack_window(bt->stackbase, bt->stackbuf,
 		    bt->stacktop - bt->stackbase, 
-		    "restore softirq_ctx stack", RETURN_ON_ERROR)) {
+		    "restore softirq_ctx stack", RETURN_ON_ERROR, FALSE)) {
 			error(INFO, 
 			    "read of softirq stack at %lx failed\n", 
 				bt->stackbase);
@@ -3312,9 +3542,9 @@ restore_stack(struct bt_info *bt)
 		bt->stackbase = GET_STACKBASE(bt->tc->task);
 	        bt->stacktop = GET_STACKTOP(bt->tc->task);
 	
-	        if (!readmem(bt->stackbase, KVADDR, bt->stackbuf,
+	        if (!read_stack_window(bt->stackbase, bt->stackbuf,
 	            bt->stacktop - bt->stackbase, 
-		    "restore_stack contents", RETURN_ON_ERROR)) {
+		    "restore_stack contents", RETURN_ON_ERROR, FALSE)) {
 	        	error(INFO, "restore_stack of stack at %lx failed\n", 
 				bt->stackbase);
 			type = 0;
@@ -3966,14 +4196,25 @@ irregularity:
 #define REINIT_MODULES                (7)
 #define LIST_ALL_MODULE_TAINT         (8)
 
+#define MODULE_PREFETCH_BUFSIZE (1024*1024)
+
+struct module_prefetch {
+	char **objfiles;
+	char *buf[MAX_PARALLEL_THREADS];
+};
+
+static int mod_load_threads;	/* "mod -S -j threads" */
+
 void
 cmd_mod(void)
 {
-	int c, ctmp;
+	int c, ctmp, shift;
 	char *p, *objfile, *modref, *tree, *symlink;
 	ulong flag, address;
 	char buf[BUFSIZE];
 
+	mod_load_threads = 1;
+
 	if (kt->flags & NO_MODULE_ACCESS)
 		error(FATAL, "cannot access vmalloc'd module memory\n");
 
@@ -4010,6 +4251,39 @@ cmd_mod(void)
 			}
 			argcnt--;
 			c--;
+		} else if (STREQ(args[c], "-L")) {
+			ctmp = c;
+			pc->curcmd_flags |= MOD_LAZY;
+			while (ctmp < argcnt) {
+				args[ctmp] = args[ctmp+1];
+				ctmp++;
+			}
+			argcnt--;
+			c--;
+		} else if (STRNEQ(args[c], "-j")) {
+			if (strlen(args[c]) > 2) {
+				p = args[c]+2;
+				shift = 1;
+			} else if ((c+1) < argcnt) {
+				p = args[c+1];
+				shift = 2;
+			} else
+				cmd_usage(pc->curcmd, SYNOPSIS);
+			mod_load_threads = dtoi(p, FAULT_ON_ERROR, NULL);
+			if ((mod_load_threads < 1) ||
+			    (mod_load_threads > MAX_PARALLEL_THREADS))
+				error(FATAL, "-j: thread count must be between "
+					"1 and %d\n", MAX_PARALLEL_THREADS);
+			while (shift--) {
+				ctmp = c;
+				while (ctmp < argcnt) {
+					args[ctmp] = args[ctmp+1];
+					ctmp++;
+				}
+				argcnt--;
+			}
+			pc->curcmd_flags |= MOD_THREADS;
+			c--;
 		} else {
 			if ((p = strstr(args[c], "g"))) {
 				pc->curcmd_flags |= MOD_SECTIONS;
@@ -4019,6 +4293,10 @@ cmd_mod(void)
 				pc->curcmd_flags |= MOD_READNOW;
 				shift_string_left(p, 1);
 			}
+			if ((p = strstr(args[c], "L"))) {
+				pc->curcmd_flags |= MOD_LAZY;
+				shift_string_left(p, 1);
+			}
 			/* if I've removed everything but the '-', toss it */
 			if (STREQ(args[c], "-")) {
 				ctmp = c;
@@ -4126,6 +4404,10 @@ cmd_mod(void)
 	if (tree && (flag != LOAD_ALL_MODULE_SYMBOLS))
 		argerrs++;
 
+	if ((pc->curcmd_flags & (MOD_LAZY|MOD_THREADS)) &&
+	    (flag != LOAD_ALL_MODULE_SYMBOLS))
+		argerrs++;
+
 	if (argerrs)
 		cmd_usage(pc->curcmd, SYNOPSIS);
 
@@ -4498,6 +4780,8 @@ do_module_cmd(ulong flag, char *modref, ulong address,
 {
 	int i, j;
 	struct load_module *lm, *lmp;
+	struct module_prefetch prefetch;
+	char **objfiles;
 	int maxnamelen;
 	int maxsizelen;
 	char buf1[BUFSIZE];
@@ -4553,6 +4837,9 @@ do_module_cmd(ulong flag, char *modref, ulong address,
 						lm->mod_namelist,
 						lm->mod_flags & MOD_REMOTE ?
 						" (temporary)" : "");  
+				else if (lm->mod_flags & MOD_LAZY_SYMS)
+					fprintf(fp, "%s (deferred)",
+						lm->mod_lazy_namelist);
 				else {
 					fprintf(fp, "(not loaded)");
 					if (lm->mod_flags & MOD_KALLSYMS)
@@ -4606,6 +4893,33 @@ do_module_cmd(ulong flag, char *modref, ulong address,
 		break;
 
 	case LOAD_ALL_MODULE_SYMBOLS:
+		/*
+		 *  Locate all of the object files first, searching each
+		 *  directory tree only once, and with "-j threads", read
+		 *  them in parallel so that the serial loading below finds
+		 *  them in the page cache.
+		 */
+		objfiles = (char **)GETBUF(sizeof(char *) * kt->mods_installed);
+		directory_index_start();
+		for (i = 0; i < kt->mods_installed; i++) {
+			lm = &st->load_modules[i];
+			if (!STREQ(lm->mod_name, "(unknown module)"))
+				objfiles[i] = find_module_objfile(lm->mod_name,
+					NULL, tree);
+		}
+		directory_index_flush();
+
+		if ((mod_load_threads > 1) && !(pc->curcmd_flags & MOD_LAZY)) {
+			BZERO(&prefetch, sizeof(struct module_prefetch));
+			prefetch.objfiles = objfiles;
+			for (i = 0; i < mod_load_threads; i++)
+				prefetch.buf[i] = malloc(MODULE_PREFETCH_BUFSIZE);
+			run_parallel(mod_load_threads, kt->mods_installed,
+				module_objfile_prefetch, &prefetch);
+			for (i = 0; i < mod_load_threads; i++)
+				free(prefetch.buf[i]);
+		}
+
 		for (i = j = 0; i < kt->mods_installed; i++) {
 			lm = &st->load_modules[i];
 
@@ -4619,11 +4933,14 @@ do_module_cmd(ulong flag, char *modref, ulong address,
 			modref = lm->mod_name;
 			address = lm->mod_base;
 
-			if ((objfile = find_module_objfile(modref,NULL,tree))) {
+			if ((objfile = objfiles[i])) {
 				if (!is_elf_file(objfile)) {
                         		error(INFO, 
 			                  "%s: not an ELF format object file\n",
 						objfile);
+				} else if ((pc->curcmd_flags & MOD_LAZY) &&
+				    !(lm->mod_flags & MOD_LOAD_SYMS)) {
+					defer_module_symbols(lm, objfile);
 				} else if (!load_module_symbols(modref, 
 					objfile, address))
 					error(INFO, 
@@ -4647,6 +4964,7 @@ do_module_cmd(ulong flag, char *modref, ulong address,
                               "cannot find or load object file for %s module\n",
 					modref);
 		}
+		FREEBUF(objfiles);
 		do_module_cmd(REMOTE_MODULE_SAVE_MSG, 0, 0, 0, tree);
 		break;
 
@@ -4669,6 +4987,27 @@ do_module_cmd(ulong flag, char *modref, ulong address,
 	}
 }
 
+/*
+ *  run_parallel() job for "mod -S -j threads": read a module object file
+ *  into the page cache ahead of its loading.  Only the file is touched,
+ *  since neither bfd nor gdb can be used outside of the main thread.
+ */
+static void
+module_objfile_prefetch(void *arg, int job, int thread)
+{
+	struct module_prefetch *mp = (struct module_prefetch *)arg;
+	int fd;
+
+	if (!mp->objfiles[job] || !mp->buf[thread])
+		return;
+
+	if ((fd = open(mp->objfiles[job], O_RDONLY)) < 0)
+		return;
+	while (read(fd, mp->buf[thread], MODULE_PREFETCH_BUFSIZE) > 0)
+		;
+	close(fd);
+}
+
 /*
  *  Reinitialize the current set of modules:
  *
@@ -4687,7 +5026,10 @@ reinit_modules(void)
         st->ext_module_symtable = NULL;
         st->load_modules = NULL;
         kt->mods_installed = 0;
-	memset(st->mod_symname_hash, 0, sizeof(st->mod_symname_hash));
+	if (st->mod_symname_hash)
+		BZERO(st->mod_symname_hash,
+			sizeof(struct syment *) * st->mod_symname_hash_size);
+	st->mod_symname_hash_count = 0;
 
         module_init();
 }
@@ -5012,6 +5354,26 @@ unlink_module(struct load_module *load_module)
 }
 
 
+/*
+ *  The record filters of the current "log" command, which are applied
+ *  before a record is formatted.
+ */
+static struct log_filter {
+	int flags;
+	ulonglong ts_start;	/* nanoseconds */
+	ulonglong ts_end;
+	int level;		/* this level and more severe ones */
+	int facility;
+	uint caller_id;
+	char *text;
+} log_filter = { 0 };
+
+#define LOG_FILTER_TIME     (0x1)
+#define LOG_FILTER_LEVEL    (0x2)
+#define LOG_FILTER_FACILITY (0x4)
+#define LOG_FILTER_CALLER   (0x8)
+#define LOG_FILTER_TEXT    (0x10)
+
 /*
  *  Dump the kernel log_buf in chronological order.
  */
@@ -5024,9 +5386,19 @@ cmd_log(void)
 
 	msg_flags = 0;
 
-        while ((c = getopt(argcnt, args, "Ttdmas")) != EOF) {
+	BZERO(&log_filter, sizeof(struct log_filter));
+
+        while ((c = getopt(argcnt, args, "Ttdmasl:f:c:g:r:")) != EOF) {
                 switch(c)
                 {
+		case 'l':
+		case 'f':
+		case 'c':
+		case 'g':
+		case 'r':
+			parse_log_filter(c, optarg);
+			msg_flags |= SHOW_LOG_FILTER;
+			break;
 		case 'T':
 			msg_flags |= SHOW_LOG_CTIME;
 			break;
@@ -5059,6 +5431,11 @@ cmd_log(void)
 		return;
 	}
 
+	if ((msg_flags & SHOW_LOG_FILTER) &&
+	    (msg_flags & (SHOW_LOG_AUDIT|SHOW_LOG_SAFE)))
+		error(FATAL, "the -l, -f, -c, -g and -r options cannot be "
+			"used with -a or -s\n");
+
 	if (msg_flags & SHOW_LOG_AUDIT) {
 		dump_audit();
 		return;
@@ -5070,7 +5447,178 @@ cmd_log(void)
 	}
 
 	dump_log(msg_flags);
-	dump_printk_safe_seq_buf(msg_flags);
+	if (!(msg_flags & SHOW_LOG_FILTER))
+		dump_printk_safe_seq_buf(msg_flags);
+}
+
+static char *log_level_names[] = {
+	"emerg", "alert", "crit", "err", "warning", "notice", "info", "debug",
+	NULL
+};
+
+static char *log_facility_names[] = {
+	"kern", "user", "mail", "daemon", "auth", "syslog", "lpr", "news",
+	"uucp", "cron", "authpriv", "ftp", "ntp", "security", "console",
+	"solaris-cron", "local0", "local1", "local2", "local3", "local4",
+	"local5", "local6", "local7", NULL
+};
+
+/*
+ *  Convert a "seconds[.fraction]" string into nanoseconds.
+ */
+static int
+log_seconds_to_nsec(char *s, ulonglong *nsec)
+{
+	ulonglong secs, frac;
+	int digits;
+
+	if (!*s)
+		return FALSE;
+
+	for (secs = 0; (*s >= '0') && (*s <= '9'); s++)
+		secs = (secs * 10) + (*s - '0');
+
+	frac = 0;
+	digits = 0;
+	if (*s == '.') {
+		for (s++; (*s >= '0') && (*s <= '9'); s++) {
+			if (digits < 9) {
+				frac = (frac * 10) + (*s - '0');
+				digits++;
+			}
+		}
+	}
+	if (*s)
+		return FALSE;
+
+	for ( ; digits < 9; digits++)
+		frac *= 10;
+
+	*nsec = (secs * 1000000000ULL) + frac;
+	return TRUE;
+}
+
+static int
+log_name_index(char *s, char **names)
+{
+	int i;
+
+	for (i = 0; names[i]; i++) {
+		if (STREQ(s, names[i]))
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+ *  Parse the argument of a "log" record filter option into log_filter.
+ */
+static void
+parse_log_filter(int c, char *arg)
+{
+	char *p;
+	ulong value;
+
+	switch (c)
+	{
+	case 'l':
+		if ((log_filter.level = log_name_index(arg, log_level_names)) < 0) {
+			if (!decimal(arg, 0) ||
+			    ((value = dtol(arg, RETURN_ON_ERROR, NULL)) > 7))
+				error(FATAL, "invalid log level: %s\n", arg);
+			log_filter.level = value;
+		}
+		log_filter.flags |= LOG_FILTER_LEVEL;
+		break;
+
+	case 'f':
+		if ((log_filter.facility =
+		    log_name_index(arg, log_facility_names)) < 0) {
+			if (!decimal(arg, 0) ||
+			    ((value = dtol(arg, RETURN_ON_ERROR, NULL)) > 127))
+				error(FATAL, "invalid log facility: %s\n", arg);
+			log_filter.facility = value;
+		}
+		log_filter.flags |= LOG_FILTER_FACILITY;
+		break;
+
+	case 'c':
+		p = arg;
+		if ((*p == 'T') || (*p == 'C'))
+			p++;
+		if (!*p || !decimal(p, 0))
+			error(FATAL, "invalid caller id: %s\n", arg);
+		value = dtol(p, FAULT_ON_ERROR, NULL);
+		log_filter.caller_id = (uint)value;
+		if (*arg == 'C')
+			log_filter.caller_id |= 0x80000000;
+		log_filter.flags |= LOG_FILTER_CALLER;
+		break;
+
+	case 'g':
+		log_filter.text = arg;
+		log_filter.flags |= LOG_FILTER_TEXT;
+		break;
+
+	case 'r':
+		log_filter.ts_start = 0;
+		log_filter.ts_end = ~0ULL;
+		if ((p = strchr(arg, '-')))
+			*p++ = NULLCHAR;
+		if ((*arg && !log_seconds_to_nsec(arg, &log_filter.ts_start)) ||
+		    (p && *p && !log_seconds_to_nsec(p, &log_filter.ts_end)) ||
+		    (!*arg && !(p && *p)))
+			error(FATAL, "invalid time range: %s%s%s\n", arg,
+				p ? "-" : "", p ? p : "");
+		if (log_filter.ts_end < log_filter.ts_start)
+			error(FATAL, "invalid time range: end precedes start\n");
+		log_filter.flags |= LOG_FILTER_TIME;
+		break;
+	}
+}
+
+/*
+ *  Apply the "log" record filters to a record before it is formatted.
+ *  A level or facility of -1 means that the record format lacks it, and
+ *  caller_valid is FALSE if it has no caller id.
+ */
+int
+log_filter_match(ulonglong ts_nsec, int level, int facility, uint caller_id,
+		 int caller_valid, char *text, int text_len)
+{
+	int len;
+	char *p, *end;
+
+	if ((log_filter.flags & LOG_FILTER_TIME) &&
+	    ((ts_nsec < log_filter.ts_start) || (ts_nsec > log_filter.ts_end)))
+		return FALSE;
+
+	if ((log_filter.flags & LOG_FILTER_LEVEL) &&
+	    ((level < 0) || (level > log_filter.level)))
+		return FALSE;
+
+	if ((log_filter.flags & LOG_FILTER_FACILITY) &&
+	    (facility != log_filter.facility))
+		return FALSE;
+
+	if ((log_filter.flags & LOG_FILTER_CALLER) &&
+	    (!caller_valid || (caller_id != log_filter.caller_id)))
+		return FALSE;
+
+	if (log_filter.flags & LOG_FILTER_TEXT) {
+		len = strlen(log_filter.text);
+		if (len > text_len)
+			return FALSE;
+		for (p = text, end = text + text_len - len; p <= end; p++) {
+			if ((*p == *log_filter.text) &&
+			    !memcmp(p, log_filter.text, len))
+				return TRUE;
+		}
+		return FALSE;
+	}
+
+	return TRUE;
 }
 
 
@@ -5100,6 +5648,9 @@ dump_log(int msg_flags)
 		option_not_supported('T');
 	if (msg_flags & SHOW_LOG_DICT)
 		option_not_supported('d');
+	if (msg_flags & SHOW_LOG_FILTER)
+		error(FATAL, "the -l, -f, -c, -g and -r options are not "
+			"supported with this log_buf format\n");
 	if ((msg_flags & SHOW_LOG_TEXT) && STREQ(pc->curcmd, "log"))
 		option_not_supported('t');
 
@@ -5284,6 +5835,17 @@ dump_log_entry(char *logptr, int msg_flags)
 
 	msg = logptr + SIZE(log);
 
+	if ((msg_flags & SHOW_LOG_FILTER) &&
+	    !log_filter_match(ts_nsec,
+	    VALID_MEMBER(log_level) || VALID_MEMBER(log_flags_level) ?
+	    LOG_LEVEL(level) : -1,
+	    VALID_MEMBER(log_facility) ?
+	    UCHAR(logptr + OFFSET(log_facility)) : -1,
+	    VALID_MEMBER(log_caller_id) ?
+	    UINT(logptr + OFFSET(log_caller_id)) : 0,
+	    VALID_MEMBER(log_caller_id), msg, text_len))
+		return;
+
 	if (CRASHDEBUG(1))
 		fprintf(fp, 
 		    "\nlog %lx -> msg: %lx ts_nsec: %lld flags/level: %x"
@@ -5370,6 +5932,8 @@ dump_variable_length_record_log(int msg_flags)
 		MEMBER_OFFSET_INIT(log_level, log_struct_name, "level");
 		MEMBER_SIZE_INIT(log_level, log_struct_name, "level");
 		MEMBER_OFFSET_INIT(log_flags_level, log_struct_name, "flags_level");
+		MEMBER_OFFSET_INIT(log_facility, log_struct_name, "facility");
+		MEMBER_OFFSET_INIT(log_caller_id, log_struct_name, "caller_id");
 			
 		/*
 		 * If things change, don't kill a dumpfile session 
@@ -5388,6 +5952,13 @@ dump_variable_length_record_log(int msg_flags)
 		}
 	}
 
+	if ((msg_flags & SHOW_LOG_FILTER) &&
+	    (log_filter.flags & LOG_FILTER_CALLER) && INVALID_MEMBER(log_caller_id))
+		option_not_supported('c');
+	if ((msg_flags & SHOW_LOG_FILTER) &&
+	    (log_filter.flags & LOG_FILTER_FACILITY) && INVALID_MEMBER(log_facility))
+		option_not_supported('f');
+
 	get_symbol_data("log_first_idx", sizeof(uint32_t), &log_first_idx);
 	get_symbol_data("log_next_idx", sizeof(uint32_t), &log_next_idx);
 	get_symbol_data("log_buf_len", sizeof(uint32_t), &log_buf_len);
@@ -6199,6 +6770,8 @@ dump_kernel_table(int verbose)
 	fprintf(fp, "   gcc_version: %d.%d.%d\n", kt->gcc_version[0], 
 		kt->gcc_version[1], kt->gcc_version[2]);
 	fprintf(fp, "     BUG_bytes: %d\n", kt->BUG_bytes);
+	fprintf(fp, "     dis_cache: hits: %ld  misses: %ld\n",
+		dis_cache_hits, dis_cache_misses);
 	fprintf(fp, "      relocate: %lx", kt->relocate);
 	if (kt->flags2 & KASLR)
 		fprintf(fp, "  (KASLR offset: %lx / %ldMB)", 
@@ -6578,80 +7151,130 @@ cmd_irq(void)
 	}
 }
 
-static ulong
-get_irq_desc_addr(int irq)
+/*
+ *  The entries of the irq_desc_tree, gathered once in index order, so
+ *  that the irq_desc of each irq is found with a binary search instead
+ *  of a gather of the whole tree.  On live systems, the gather is done
+ *  again by the first lookup of each command.
+ */
+static struct irq_desc_index {
+	ulong cmdgen;
+	ulong cnt;
+	struct list_pair *lp;
+} irq_desc_index = { 0 };
+
+static struct list_pair *
+irq_desc_tree_index(ulong *cntp)
 {
-	int c;
-	ulong cnt, addr, ptr;
-	long len;
+	ulong cnt;
 	struct list_pair *lp;
 
-	addr = 0;
-	lp = NULL;
+	if (irq_desc_index.lp &&
+	    (!ACTIVE() || (irq_desc_index.cmdgen == pc->cmdgencur))) {
+		*cntp = irq_desc_index.cnt;
+		return irq_desc_index.lp;
+	}
 
-	if (!VALID_STRUCT(irq_desc_t))
-		error(FATAL, "cannot determine size of irq_desc_t\n");
-	len = SIZE(irq_desc_t);
+	free(irq_desc_index.lp);
+	irq_desc_index.lp = NULL;
 
-        if (symbol_exists("irq_desc"))
-		addr = symbol_value("irq_desc") + (len * irq);
-        else if (symbol_exists("_irq_desc"))
-		addr = symbol_value("_irq_desc") + (len * irq);
-	else if (symbol_exists("irq_desc_ptrs")) {
-		if (get_symbol_type("irq_desc_ptrs", NULL, NULL) == TYPE_CODE_PTR)
-			get_symbol_data("irq_desc_ptrs", sizeof(void *), &ptr);
-		else
-			ptr = symbol_value("irq_desc_ptrs");
-		ptr += (irq * sizeof(void *));
-		readmem(ptr, KVADDR, &addr,
-                        sizeof(void *), "irq_desc_ptrs entry",
-                        FAULT_ON_ERROR);
-	} else if (kt->flags2 & (IRQ_DESC_TREE_RADIX|IRQ_DESC_TREE_XARRAY)) {
-		if (kt->highest_irq && (irq > kt->highest_irq))
-			return addr;
+	cnt = 0;
+	switch (kt->flags2 & (IRQ_DESC_TREE_RADIX|IRQ_DESC_TREE_XARRAY))
+	{
+	case IRQ_DESC_TREE_RADIX:
+		cnt = do_radix_tree(symbol_value("irq_desc_tree"),
+			RADIX_TREE_COUNT, NULL);
+		break;
+	case IRQ_DESC_TREE_XARRAY:
+		cnt = do_xarray(symbol_value("irq_desc_tree"),
+			XARRAY_COUNT, NULL);
+		break;
+	}
 
-		cnt = 0;
-		switch (kt->flags2 & (IRQ_DESC_TREE_RADIX|IRQ_DESC_TREE_XARRAY))
-		{
-		case IRQ_DESC_TREE_RADIX:
-			cnt = do_radix_tree(symbol_value("irq_desc_tree"),
-				RADIX_TREE_COUNT, NULL);
-			break;
-		case IRQ_DESC_TREE_XARRAY:
-			cnt = do_xarray(symbol_value("irq_desc_tree"),
-				XARRAY_COUNT, NULL);
-			break;
-		}
-		len = sizeof(struct list_pair) * (cnt+1);
-		lp = (struct list_pair *)GETBUF(len);
-		lp[0].index = cnt;
+	if (!cnt)
+		return NULL;
 
-		switch (kt->flags2 & (IRQ_DESC_TREE_RADIX|IRQ_DESC_TREE_XARRAY))
-		{
-		case IRQ_DESC_TREE_RADIX:
-			cnt = do_radix_tree(symbol_value("irq_desc_tree"),
-				RADIX_TREE_GATHER, lp);
-			break;
-		case IRQ_DESC_TREE_XARRAY:
-			cnt = do_xarray(symbol_value("irq_desc_tree"),
-				XARRAY_GATHER, lp);
-			break;
-		}
+	if (!(lp = (struct list_pair *)malloc(sizeof(struct list_pair) * (cnt+1))))
+		error(FATAL, "cannot malloc irq_desc_tree index\n");
+	lp[0].index = cnt;
+
+	switch (kt->flags2 & (IRQ_DESC_TREE_RADIX|IRQ_DESC_TREE_XARRAY))
+	{
+	case IRQ_DESC_TREE_RADIX:
+		cnt = do_radix_tree(symbol_value("irq_desc_tree"),
+			RADIX_TREE_GATHER, lp);
+		break;
+	case IRQ_DESC_TREE_XARRAY:
+		cnt = do_xarray(symbol_value("irq_desc_tree"),
+			XARRAY_GATHER, lp);
+		break;
+	}
+
+	if (!cnt) {
+		free(lp);
+		return NULL;
+	}
+
+	irq_desc_index.lp = lp;
+	irq_desc_index.cnt = cnt;
+	irq_desc_index.cmdgen = pc->cmdgencur;
+
+	*cntp = cnt;
+	return lp;
+}
+
+static ulong
+get_irq_desc_addr(int irq)
+{
+	int c, lo, hi;
+	ulong cnt, addr, ptr;
+	long len;
+	struct list_pair *lp;
+
+	addr = 0;
+	lp = NULL;
+
+	if (!VALID_STRUCT(irq_desc_t))
+		error(FATAL, "cannot determine size of irq_desc_t\n");
+	len = SIZE(irq_desc_t);
+
+        if (symbol_exists("irq_desc"))
+		addr = symbol_value("irq_desc") + (len * irq);
+        else if (symbol_exists("_irq_desc"))
+		addr = symbol_value("_irq_desc") + (len * irq);
+	else if (symbol_exists("irq_desc_ptrs")) {
+		if (get_symbol_type("irq_desc_ptrs", NULL, NULL) == TYPE_CODE_PTR)
+			get_symbol_data("irq_desc_ptrs", sizeof(void *), &ptr);
+		else
+			ptr = symbol_value("irq_desc_ptrs");
+		ptr += (irq * sizeof(void *));
+		readmem(ptr, KVADDR, &addr,
+                        sizeof(void *), "irq_desc_ptrs entry",
+                        FAULT_ON_ERROR);
+	} else if (kt->flags2 & (IRQ_DESC_TREE_RADIX|IRQ_DESC_TREE_XARRAY)) {
+		if (!(lp = irq_desc_tree_index(&cnt)))
+			return addr;
 
 		if (kt->highest_irq == 0)
 			kt->highest_irq = lp[cnt-1].index;
 
-		for (c = 0; c < cnt; c++) {
-			if (lp[c].index == irq) {
-				if (CRASHDEBUG(1))
-					fprintf(fp, "index: %ld value: %lx\n",
-						lp[c].index, (ulong)lp[c].value);
-				addr = (ulong)lp[c].value;
-				break;
-			}
+		if (irq > kt->highest_irq)
+			return addr;
+
+		for (lo = 0, hi = cnt; lo < hi; ) {
+			c = (lo + hi) / 2;
+			if (lp[c].index < (ulong)irq)
+				lo = c + 1;
+			else
+				hi = c;
 		}
 
-		FREEBUF(lp);
+		if ((lo < cnt) && (lp[lo].index == (ulong)irq)) {
+			if (CRASHDEBUG(1))
+				fprintf(fp, "index: %ld value: %lx\n",
+					lp[lo].index, (ulong)lp[lo].value);
+			addr = (ulong)lp[lo].value;
+		}
 	} else {
 		error(FATAL,
 		    "neither irq_desc, _irq_desc, irq_desc_ptrs "
@@ -7294,7 +7917,6 @@ generic_show_interrupts(int irq, ulong *cpus)
 	int i;
 	ulong irq_desc_addr;
 	ulong handler, action, name;
-	uint kstat_irq;
 	uint kstat_irqs[kt->cpus];
 	ulong kstat_irqs_ptr;
 	struct syment *percpu_sp;
@@ -7303,6 +7925,7 @@ generic_show_interrupts(int irq, ulong *cpus)
 	char buf1[BUFSIZE];
 	char buf2[BUFSIZE];
 	char name_buf[BUFSIZE];
+	char *desc;
 
 	handler = UNINITIALIZED;
 
@@ -7310,59 +7933,49 @@ generic_show_interrupts(int irq, ulong *cpus)
 	if (!irq_desc_addr)
 		return;
 
-	readmem(irq_desc_addr + OFFSET(irq_desc_t_action), KVADDR,
-	        &action, sizeof(long), "irq_desc action", FAULT_ON_ERROR);
+	/*
+	 *  The members used below are all taken from one read of the
+	 *  irq_desc.
+	 */
+	desc = GETBUF(SIZE(irq_desc_t));
+	readmem(irq_desc_addr, KVADDR, desc, SIZE(irq_desc_t),
+	        "irq_desc", FAULT_ON_ERROR);
 
-	if (!action)
+	action = ULONG(desc + OFFSET(irq_desc_t_action));
+
+	if (!action) {
+		FREEBUF(desc);
 		return;
+	}
 
 	if (!symbol_exists("kstat_irqs_cpu")) { /* for RHEL5 or earlier */
-		if (!(percpu_sp = per_cpu_symbol_search("kstat")))
+		if (!(percpu_sp = per_cpu_symbol_search("kstat"))) {
+			FREEBUF(desc);
 			return;
-
-		for (i = 0; i < kt->cpus; i++) {
-			if (!(NUM_IN_BITMAP(cpus, i)))
-				continue;
-
-			tmp = percpu_sp->value + kt->__per_cpu_offset[i];
-			readmem(tmp + OFFSET(kernel_stat_irqs) + sizeof(uint) * irq,
-			        KVADDR, &kstat_irq, sizeof(uint),
-			        "kernel_stat irqs", FAULT_ON_ERROR);
-			kstat_irqs[i] = kstat_irq;
 		}
-	} else {
-		readmem(irq_desc_addr + OFFSET(irq_desc_t_kstat_irqs),
-		        KVADDR, &kstat_irqs_ptr, sizeof(long),
-		        "irq_desc kstat_irqs", FAULT_ON_ERROR);
-		if (THIS_KERNEL_VERSION > LINUX(2,6,37)) {
-			for (i = 0; i < kt->cpus; i++) {
-				if (!(NUM_IN_BITMAP(cpus, i)))
-					continue;
 
-				tmp = kstat_irqs_ptr + kt->__per_cpu_offset[i];
-				readmem(tmp, KVADDR, &kstat_irq, sizeof(uint),
-				        "kernel_stat irqs", FAULT_ON_ERROR);
-				kstat_irqs[i] = kstat_irq;
-			}
-		} else
+		percpu_gather(percpu_sp->value + OFFSET(kernel_stat_irqs) +
+			sizeof(uint) * irq, sizeof(uint), kstat_irqs,
+			FAULT_ON_ERROR);
+	} else {
+		kstat_irqs_ptr = ULONG(desc + OFFSET(irq_desc_t_kstat_irqs));
+		if (THIS_KERNEL_VERSION > LINUX(2,6,37))
+			percpu_gather(kstat_irqs_ptr, sizeof(uint), kstat_irqs,
+				FAULT_ON_ERROR);
+		else
 			readmem(kstat_irqs_ptr, KVADDR, kstat_irqs,
 			        sizeof(kstat_irqs), "kstat_irqs",
 			        FAULT_ON_ERROR);
 	}
 	if (VALID_MEMBER(irq_desc_t_handler))
-		readmem(irq_desc_addr + OFFSET(irq_desc_t_handler),
-		        KVADDR, &handler, sizeof(long), "irq_desc handler",
-		        FAULT_ON_ERROR);
+		handler = ULONG(desc + OFFSET(irq_desc_t_handler));
 	else if (VALID_MEMBER(irq_desc_t_chip))
-		readmem(irq_desc_addr + OFFSET(irq_desc_t_chip), KVADDR,
-		        &handler, sizeof(long), "irq_desc chip",
-		        FAULT_ON_ERROR);
+		handler = ULONG(desc + OFFSET(irq_desc_t_chip));
 	else if (VALID_MEMBER(irq_data_chip)) {
-		tmp = irq_desc_addr + OFFSET(irq_data_chip);
+		tmp = OFFSET(irq_data_chip);
 		if (VALID_MEMBER(irq_desc_irq_data))
 			tmp += OFFSET(irq_desc_irq_data);
-		readmem(tmp, KVADDR, &handler, sizeof(long), "irq_data chip",
-			FAULT_ON_ERROR);
+		handler = ULONG(desc + tmp);
 	}
 
 	fprintf(fp, "%3d: ", irq);
@@ -7395,9 +8008,7 @@ generic_show_interrupts(int irq, ulong *cpus)
 				fprintf(fp, "%8s", buf);
 			BZERO(buf1, BUFSIZE);
 			if (VALID_MEMBER(irq_desc_t_name))
-				readmem(irq_desc_addr+OFFSET(irq_desc_t_name),
-				        KVADDR,	&tmp1, sizeof(void *),
-				        "irq_desc name", FAULT_ON_ERROR);
+				tmp1 = ULONG(desc + OFFSET(irq_desc_t_name));
 			if (read_string(tmp1, buf1, BUFSIZE-1))
 				fprintf(fp, "-%-8s", buf1);
 		}
@@ -7422,6 +8033,7 @@ generic_show_interrupts(int irq, ulong *cpus)
 	}
 
 	fprintf(fp, " %s\n", name_buf);
+	FREEBUF(desc);
 }
 
 /*
@@ -7635,6 +8247,108 @@ display_bh_4(void)
 	FREEBUF(array);
 }
 
+/*
+ *  "timer -s" only counts the timers of each callback function, in a
+ *  table that is displayed once all of the selected cpus are done.
+ */
+struct timer_func_count {
+	ulong function;
+	ulong count;
+};
+
+static struct timer_summary {
+	struct timer_func_count *entries;
+	ulong size;
+	ulong count;
+	ulong timers;
+} *timer_summary = NULL;
+
+/*
+ *  "timer -m" merges the timers of all timer_bases into one list.
+ */
+static int timer_merge = FALSE;
+
+static void
+timer_summary_add(ulong function)
+{
+	ulong i, h, oldsize;
+	struct timer_func_count *old, *tfc;
+	struct timer_summary *ts = timer_summary;
+
+	if ((ts->count + 1) * 4 > ts->size * 3) {
+		old = ts->entries;
+		oldsize = ts->size;
+		ts->size = oldsize ? oldsize * 2 : 256;
+		ts->entries = (struct timer_func_count *)
+			GETBUF(sizeof(struct timer_func_count) * ts->size);
+		for (i = 0; i < oldsize; i++) {
+			if (!old[i].count)
+				continue;
+			h = (old[i].function >> 4) & (ts->size - 1);
+			while (ts->entries[h].count)
+				h = (h + 1) & (ts->size - 1);
+			ts->entries[h] = old[i];
+		}
+		if (old)
+			FREEBUF(old);
+	}
+
+	h = (function >> 4) & (ts->size - 1);
+	while ((tfc = &ts->entries[h])->count) {
+		if (tfc->function == function)
+			break;
+		h = (h + 1) & (ts->size - 1);
+	}
+
+	if (!tfc->count) {
+		tfc->function = function;
+		ts->count++;
+	}
+	tfc->count++;
+	ts->timers++;
+}
+
+static int
+compare_timer_func_count(const void *v1, const void *v2)
+{
+	const struct timer_func_count *t1 = v1, *t2 = v2;
+
+	if (t1->count != t2->count)
+		return t1->count > t2->count ? -1 : 1;
+	return t1->function < t2->function ? -1 :
+		t1->function > t2->function ? 1 : 0;
+}
+
+static void
+dump_timer_summary(void)
+{
+	ulong i, n;
+	struct timer_summary *ts = timer_summary;
+	struct timer_func_count *tfc;
+	char buf1[BUFSIZE];
+	char buf2[BUFSIZE];
+
+	for (i = n = 0; i < ts->size; i++) {
+		if (ts->entries[i].count)
+			ts->entries[n++] = ts->entries[i];
+	}
+	qsort(ts->entries, n, sizeof(struct timer_func_count),
+		compare_timer_func_count);
+
+	fprintf(fp, "     COUNT  %s\n",
+		mkstring(buf1, VADDR_PRLEN, CENTER|LJUST, "FUNCTION"));
+
+	for (i = 0; i < n; i++) {
+		tfc = &ts->entries[i];
+		fprintf(fp, "%10ld  %s  <%s>\n", tfc->count,
+			mkstring(buf1, VADDR_PRLEN, RJUST|LONG_HEX,
+			MKSTR(tfc->function)),
+			value_to_symstr(tfc->function, buf2, 0));
+	}
+
+	fprintf(fp, "%10ld  TOTAL\n", ts->timers);
+}
+
 /*
  *  Dump the entries in the old- and new-style timer queues in
  *  chronological order.
@@ -7643,19 +8357,29 @@ void
 cmd_timer(void)
 {
         int c;
-	int rflag;
+	int rflag, sflag, mflag;
 	char *cpuspec;
 	ulong *cpus = NULL;
 
-	rflag = 0;
+	rflag = sflag = mflag = 0;
+	timer_summary = NULL;
+	timer_merge = FALSE;
 
-        while ((c = getopt(argcnt, args, "rC:")) != EOF) {
+        while ((c = getopt(argcnt, args, "rsmC:")) != EOF) {
                 switch(c)
                 {
 		case 'r':
 			rflag = 1;
 			break;
 
+		case 's':
+			sflag = 1;
+			break;
+
+		case 'm':
+			mflag = 1;
+			break;
+
 		case 'C':
 			cpuspec = optarg;
 			cpus = get_cpumask_buf();
@@ -7671,11 +8395,32 @@ cmd_timer(void)
         if (argerrs)
                 cmd_usage(pc->curcmd, SYNOPSIS);
 
+	if (sflag && mflag)
+		error(FATAL, "-s and -m are mutually exclusive\n");
+	if (mflag && (rflag || !(kt->flags2 & TIMER_BASES)))
+		option_not_supported('m');
+	if (sflag && !rflag && !(kt->flags2 & TIMER_BASES))
+		option_not_supported('s');
+
+	if (sflag)
+		timer_summary = (struct timer_summary *)
+			GETBUF(sizeof(struct timer_summary));
+	timer_merge = mflag;
+
 	if (rflag)
 		dump_hrtimer_data(cpus);
 	else
 		dump_timer_data(cpus);
 
+	if (timer_summary) {
+		dump_timer_summary();
+		if (timer_summary->entries)
+			FREEBUF(timer_summary->entries);
+		FREEBUF(timer_summary);
+		timer_summary = NULL;
+	}
+	timer_merge = FALSE;
+
 	if (cpus)
 		FREEBUF(cpus);
 }
@@ -7686,6 +8431,7 @@ dump_hrtimer_data(const ulong *cpus)
 	int i, j, k = 0;
 	int hrtimer_max_clock_bases, max_hrtimer_bases;
 	struct syment * hrtimer_bases;
+	void *base;
 
 	hrtimer_max_clock_bases = 0;
 	max_hrtimer_bases = 0;
@@ -7707,6 +8453,28 @@ dump_hrtimer_data(const ulong *cpus)
 
 	hrtimer_bases = per_cpu_symbol_search("hrtimer_bases");
 
+	if (timer_summary) {
+		for (i = 0; i < kt->cpus; i++) {
+			if ((cpus && !NUM_IN_BITMAP(cpus, i)) ||
+			    hide_offline_cpu(i))
+				continue;
+
+			base = (void *)(hrtimer_bases->value) +
+				kt->__per_cpu_offset[i];
+			if (VALID_STRUCT(hrtimer_clock_base)) {
+				for (j = 0; j < hrtimer_max_clock_bases; j++)
+					summarize_active_timers(base +
+						OFFSET(hrtimer_cpu_base_clock_base) +
+						SIZE(hrtimer_clock_base) * j);
+			} else {
+				for (j = 0; j < max_hrtimer_bases; j++)
+					summarize_active_timers(base +
+						SIZE(hrtimer_base) * j);
+			}
+		}
+		return;
+	}
+
 	for (i = 0; i < kt->cpus; i++) {
 		if (cpus && !NUM_IN_BITMAP(cpus, i))
 			continue;
@@ -7799,28 +8567,21 @@ dump_hrtimer_base(const void *hrtimer_bases, const int num)
 	dump_active_timers(base, now);
 }
 
-static void
-dump_active_timers(const void *base, ulonglong now)
+/*
+ *  Gather the rb_nodes of the hrtimers queued on a clock base, in
+ *  chronological order, into a GETBUF'd list, and return their count.
+ */
+static int
+get_active_timers(const void *base, ulong **timer_listp)
 {
-	int next, i, t;
 	struct rb_node *curr;
 	int timer_cnt;
-	ulong *timer_list;
-	void  *timer;
-	char buf1[BUFSIZE];
-	char buf2[BUFSIZE];
-	char buf3[BUFSIZE];
-	char buf4[BUFSIZE];
-	char buf5[BUFSIZE];
 
-	next = 0;
-	timer_list = 0;
+	*timer_listp = NULL;
 
 	/* search hrtimers */
 	hq_open();
 	timer_cnt = 0;
-next_one:
-	i = 0;
 
 	/* get the first node */
 	if (VALID_MEMBER(hrtimer_base_pending))
@@ -7848,28 +8609,76 @@ next_one:
 			KVADDR, &curr, sizeof(curr),
 			"hrtimer_clock_base active", FAULT_ON_ERROR);
 
-	while (curr && i < next) {
-		curr = rb_next(curr);
-		i++;
-	}
-
-	if (curr) {
+	/*
+	 *  Walk the tree once, rather than starting over from the
+	 *  first node for each subsequent timer.
+	 */
+	for ( ; curr; curr = rb_next(curr)) {
 		if (!hq_enter((ulong)curr)) {
 			error(INFO, "duplicate rb_node: %lx\n", curr);
-			return;
+			break;
 		}
-
 		timer_cnt++;
-		next++;
-		goto next_one;
 	}
 
 	if (timer_cnt) {
-		timer_list = (ulong *)GETBUF(timer_cnt * sizeof(long));
-		timer_cnt = retrieve_list(timer_list, timer_cnt);
+		*timer_listp = (ulong *)GETBUF(timer_cnt * sizeof(long));
+		timer_cnt = retrieve_list(*timer_listp, timer_cnt);
 	}
 	hq_close();
 
+	return timer_cnt;
+}
+
+static inline void *
+hrtimer_of_node(ulong node)
+{
+	if (VALID_MEMBER(timerqueue_node_node))
+		return (void *)(node - OFFSET(timerqueue_node_node) -
+			OFFSET(hrtimer_node));
+	else
+		return (void *)(node - OFFSET(hrtimer_node));
+}
+
+/*
+ *  "timer -r -s": count the hrtimers of a clock base by function.
+ */
+static void
+summarize_active_timers(const void *base)
+{
+	int t, timer_cnt;
+	ulong *timer_list;
+	ulong function;
+
+	timer_cnt = get_active_timers(base, &timer_list);
+
+	for (t = 0; t < timer_cnt; t++) {
+		if (!readmem((ulong)(hrtimer_of_node(timer_list[t]) +
+		    OFFSET(hrtimer_function)), KVADDR, &function,
+		    sizeof(function), "hrtimer function", QUIET|RETURN_ON_ERROR))
+			function = 0;
+		timer_summary_add(function);
+	}
+
+	if (timer_list)
+		FREEBUF(timer_list);
+}
+
+static void
+dump_active_timers(const void *base, ulonglong now)
+{
+	int t;
+	int timer_cnt;
+	ulong *timer_list;
+	void  *timer;
+	char buf1[BUFSIZE];
+	char buf2[BUFSIZE];
+	char buf3[BUFSIZE];
+	char buf4[BUFSIZE];
+	char buf5[BUFSIZE];
+
+	timer_cnt = get_active_timers(base, &timer_list);
+
 	if (!timer_cnt) {
 		fprintf(fp, "  (empty)\n");
 		return;
@@ -7911,15 +8720,11 @@ next_one:
 
 	/* print timers */
 	for (t = 0; t < timer_cnt; t++) {
-		if (VALID_MEMBER(timerqueue_node_node))
-			timer = (void *)(timer_list[t] -
-				OFFSET(timerqueue_node_node) -
-				OFFSET(hrtimer_node));
-		else
-			timer = (void *)(timer_list[t] - OFFSET(hrtimer_node));
-
+		timer = hrtimer_of_node(timer_list[t]);
 		print_timer(timer, now);
 	}
+
+	FREEBUF(timer_list);
 }
 
 static int
@@ -8067,6 +8872,7 @@ struct timer_data {
 	ulong expires;
 	ulong function;
 	long tte;
+	ulong text;	/* function, or what its descriptor points to */
 };
 
 struct tv_range {
@@ -9089,7 +9895,7 @@ do_timer_list_v4(struct timer_bases_data *data, ulong jiffies)
 	int i, t, timer_cnt, found;
 	struct list_data list_data, *ld;
 	ulong *timer_list;
-	ulong expires, function;
+	ulong expires, function, text;
 	long oldsize;
 	char *timer_list_buf;
 
@@ -9141,10 +9947,25 @@ do_timer_list_v4(struct timer_bases_data *data, ulong jiffies)
 			expires = ULONG(timer_list_buf + OFFSET(timer_list_expires));
 			function = ULONG(timer_list_buf + OFFSET(timer_list_function));
 
+			if (is_kernel_text(function))
+				text = function;
+			else if (!readmem(function, KVADDR, &text, sizeof(ulong),
+			    "timer function", RETURN_ON_ERROR|QUIET) ||
+			    !is_kernel_text(text)) {
+				if (LIVE()) {
+					if (CRASHDEBUG(1))
+						fprintf(fp, "(invalid/stale entry at %lx)\n",
+							timer_list[t]);
+					continue;
+				}
+				text = function;
+			}
+
 			data->timers[data->cnt].address = timer_list[t];
 			data->timers[data->cnt].expires = expires;
 			data->timers[data->cnt].function = function;
 			data->timers[data->cnt].tte = expires - jiffies;
+			data->timers[data->cnt].text = text;
 			data->cnt++;
 
 			if (data->cnt == data->total) {
@@ -9165,18 +9986,133 @@ do_timer_list_v4(struct timer_bases_data *data, ulong jiffies)
 	return found;
 }
 
+/*
+ *  The sorted timers of one timer_base, for "timer -m".
+ */
+struct timer_bases_run {
+	struct timer_data *timers;
+	int cnt, next;
+	int cpu, base;
+};
+
+#define RUN_EXPIRES(runs, i) ((runs)[i].timers[(runs)[i].next].expires)
+
+static int
+timer_bases_tte_len(struct timer_data *timers, int cnt, int tlen)
+{
+	int i;
+	ulong highest_tte;
+	char buf[BUFSIZE];
+
+	for (i = 0, highest_tte = 0; i < cnt; i++) {
+		if (labs(timers[i].tte) > highest_tte)
+			highest_tte = labs(timers[i].tte);
+	}
+
+	/* +1 accounts possible "-" sign */
+	sprintf(buf, "%ld", highest_tte);
+	return MAX(MAX(strlen(buf) + 1, strlen("TTE")), tlen);
+}
+
+static void
+print_timer_bases_timer(struct timer_data *td, int flen, int tlen)
+{
+	char buf1[BUFSIZE];
+	char buf2[BUFSIZE];
+
+	fprintf(fp, "  %s",
+		mkstring(buf1, flen, RJUST|LONG_DEC, MKSTR(td->expires)));
+	fprintf(fp, "  %s",
+		mkstring(buf1, tlen, RJUST|SLONG_DEC, MKSTR(td->tte)));
+	mkstring(buf1, VADDR_PRLEN, RJUST|LONG_HEX, MKSTR(td->address));
+	fprintf(fp, "  %s  ", mkstring(buf2, 16, CENTER, buf1));
+	fprintf(fp, "%s  <%s>\n",
+		mkstring(buf1, VADDR_PRLEN, RJUST|LONG_HEX, MKSTR(td->function)),
+		value_to_symstr(td->text, buf2, 0));
+}
+
+/*
+ *  Each run is already sorted, so the runs are merged by means of a
+ *  min-heap of their indexes, keyed by the next timer of each run.
+ */
+static void
+timer_bases_heap_down(struct timer_bases_run *runs, int *heap, int n, int i)
+{
+	int c, tmp;
+
+	while ((c = 2*i + 1) < n) {
+		if ((c+1 < n) &&
+		    (RUN_EXPIRES(runs, heap[c+1]) < RUN_EXPIRES(runs, heap[c])))
+			c++;
+		if (RUN_EXPIRES(runs, heap[i]) <= RUN_EXPIRES(runs, heap[c]))
+			break;
+		tmp = heap[i];
+		heap[i] = heap[c];
+		heap[c] = tmp;
+		i = c;
+	}
+}
+
+static void
+dump_timer_bases_merged(struct timer_bases_run *runs, int nruns, int flen)
+{
+	int i, n, tlen, *heap;
+	struct timer_bases_run *r;
+	char buf1[BUFSIZE];
+	char buf4[BUFSIZE];
+
+	for (i = 0, tlen = 0; i < nruns; i++)
+		tlen = timer_bases_tte_len(runs[i].timers, runs[i].cnt, tlen);
+	if (!nruns)
+		tlen = timer_bases_tte_len(NULL, 0, 0);
+
+	fprintf(fp, "  CPU  BASE  %s     %s     TIMER_LIST     FUNCTION\n",
+		mkstring(buf1, flen, LJUST, "EXPIRES"),
+		mkstring(buf4, tlen, LJUST, "TTE"));
+
+	if (!nruns) {
+		fprintf(fp, "  (none)\n");
+		return;
+	}
+
+	heap = (int *)GETBUF(sizeof(int) * nruns);
+	for (i = 0; i < nruns; i++)
+		heap[i] = i;
+	n = nruns;
+	for (i = n/2 - 1; i >= 0; i--)
+		timer_bases_heap_down(runs, heap, n, i);
+
+	while (n) {
+		r = &runs[heap[0]];
+		fprintf(fp, "  %3d  %s", r->cpu, r->base == 0 ? "STD " : "DEF ");
+		print_timer_bases_timer(&r->timers[r->next], flen, tlen);
+		if (++r->next == r->cnt)
+			heap[0] = heap[--n];
+		if (n)
+			timer_bases_heap_down(runs, heap, n, 0);
+	}
+
+	FREEBUF(heap);
+}
+
 /*
  *  Linux 4.8 timers use new timer_bases[][]
+ *
+ *  By default, the timers of each timer_base are displayed as soon as
+ *  they are gathered, so that only one timer_base worth of them is kept
+ *  around.  "timer -s" only counts them, and "timer -m" keeps them all
+ *  in order to merge them.
  */
 static void
 dump_timer_data_timer_bases(const ulong *cpus)
 {
-	int i, cpu, flen, tlen, base, nr_bases, found, display, j = 0;
+	int i, cpu, flen, tlen, base, nr_bases, found, nruns, j = 0;
 	struct syment *sp;
-	ulong timer_base, jiffies, function, highest_tte;
+	ulong timer_base, jiffies;
 	struct timer_bases_data data;
+	struct timer_bases_run *runs;
+	int display;
 	char buf1[BUFSIZE];
-	char buf2[BUFSIZE];
 	char buf4[BUFSIZE];
 
 	if (!(data.num_vectors = get_array_length("timer_base.vectors", NULL, 0)))
@@ -9188,6 +10124,11 @@ dump_timer_data_timer_bases(const ulong *cpus)
 
 	nr_bases = kernel_symbol_exists("sysctl_timer_migration") ? 2 : 1;
 	cpu = 0;
+	display = !timer_summary && !timer_merge;
+
+	nruns = 0;
+	runs = timer_merge ? (struct timer_bases_run *)
+		GETBUF(sizeof(struct timer_bases_run) * kt->cpus * nr_bases) : NULL;
 
 	get_symbol_data("jiffies", sizeof(ulong), &jiffies);
 	sprintf(buf1, "%ld", jiffies);
@@ -9206,7 +10147,8 @@ next_cpu:
 	 * hide data of offline cpu and goto next cpu
 	 */
 	if (hide_offline_cpu(cpu)) {
-		fprintf(fp, "TIMER_BASES[%d]: [OFFLINE]\n", cpu);
+		if (display)
+			fprintf(fp, "TIMER_BASES[%d]: [OFFLINE]\n", cpu);
 		if (++cpu < kt->cpus)
 			goto next_cpu;
 		goto done;
@@ -9220,12 +10162,13 @@ next_cpu:
 	else
 		timer_base = sp->value;
 
-	if (j++)
+	if (display && j++)
 		fprintf(fp, "\n");
 next_base:
 
-	fprintf(fp, "TIMER_BASES[%d][%s]: %lx\n", cpu,  
-		base == 0 ? "BASE_STD" : "BASE_DEF", timer_base);
+	if (display)
+		fprintf(fp, "TIMER_BASES[%d][%s]: %lx\n", cpu,
+			base == 0 ? "BASE_STD" : "BASE_DEF", timer_base);
 
 	readmem(timer_base + OFFSET(timer_base_vectors), KVADDR, data.vectors, 
 		data.num_vectors * sizeof(void *), "timer_base.vectors[]", FAULT_ON_ERROR); 
@@ -9233,83 +10176,41 @@ next_base:
 	data.timer_base = timer_base;
 
 	found = do_timer_list_v4(&data, jiffies);
-	
-	qsort(data.timers, found, sizeof(struct timer_data), compare_timer_data);
 
-	highest_tte = 0;
-	for (i = 0; i < found; i++) {
-	    display = FALSE;
-
-	    if (is_kernel_text(data.timers[i].function)) {
-		display = TRUE;
-	    } else {
-		if (readmem(data.timers[i].function, KVADDR, &function,
-		    sizeof(ulong), "timer function",
-		    RETURN_ON_ERROR|QUIET) && is_kernel_text(function)) {
-		    display = TRUE;
-		} else {
-                    if (LIVE())
-			display = FALSE;
-		    else
-			display = TRUE;
+	if (timer_summary) {
+		for (i = 0; i < found; i++)
+			timer_summary_add(data.timers[i].text);
+	} else if (timer_merge) {
+		if (found) {
+			runs[nruns].timers = (struct timer_data *)
+				GETBUF(sizeof(struct timer_data) * found);
+			BCOPY(data.timers, runs[nruns].timers,
+				sizeof(struct timer_data) * found);
+			qsort(runs[nruns].timers, found,
+				sizeof(struct timer_data), compare_timer_data);
+			runs[nruns].cnt = found;
+			runs[nruns].next = 0;
+			runs[nruns].cpu = cpu;
+			runs[nruns].base = base;
+			nruns++;
 		}
-	    }
-
-	    if (display) {
-		if (abs(data.timers[i].tte) > highest_tte)
-		    highest_tte = abs(data.timers[i].tte);
-	    }
-	}
-
-	/* +1 accounts possible "-" sign */
-	sprintf(buf4, "%ld", highest_tte);
-	tlen = MAX(strlen(buf4) + 1, strlen("TTE"));
+	} else {
+		qsort(data.timers, found, sizeof(struct timer_data),
+			compare_timer_data);
 
-	fprintf(fp, "  %s     %s     TIMER_LIST     FUNCTION\n",
-		mkstring(buf1, flen, LJUST, "EXPIRES"),
-		mkstring(buf4, tlen, LJUST, "TTE"));
+		tlen = timer_bases_tte_len(data.timers, found, 0);
 
-	for (i = 0; i < found; i++) {
-		display = FALSE;
+		fprintf(fp, "  %s     %s     TIMER_LIST     FUNCTION\n",
+			mkstring(buf1, flen, LJUST, "EXPIRES"),
+			mkstring(buf4, tlen, LJUST, "TTE"));
 
-		if (is_kernel_text(data.timers[i].function)) {
-			display = TRUE;
-			function = data.timers[i].function;
-		} else {
-			if (readmem(data.timers[i].function, KVADDR, &function,
-			    sizeof(ulong), "timer function",
-			    RETURN_ON_ERROR|QUIET) && is_kernel_text(function))
-				display = TRUE;
-			else {
-				if (LIVE()) {
-					if (CRASHDEBUG(1))
-						fprintf(fp, "(invalid/stale entry at %lx)\n", 
-							data.timers[i].address);
-					display = FALSE;
-				} else {
-					function = data.timers[i].function;
-					display = TRUE;
-				}
-			}
-		}
+		for (i = 0; i < found; i++)
+			print_timer_bases_timer(&data.timers[i], flen, tlen);
 
-		if (display) {
-			fprintf(fp, "  %s", 
-				mkstring(buf1, flen, RJUST|LONG_DEC, MKSTR(data.timers[i].expires)));
-			fprintf(fp, "  %s",
-				mkstring(buf4, tlen, RJUST|SLONG_DEC, MKSTR(data.timers[i].tte)));
-			mkstring(buf1, VADDR_PRLEN, RJUST|LONG_HEX, MKSTR(data.timers[i].address));
-			fprintf(fp, "  %s  ", mkstring(buf2, 16, CENTER, buf1));
-			fprintf(fp, "%s  <%s>\n",
-				mkstring(buf1, VADDR_PRLEN, RJUST|LONG_HEX, 
-				MKSTR(data.timers[i].function)),
-				value_to_symstr(function, buf2, 0));
-		}
+		if (!found)
+			fprintf(fp, "  (none)\n");
 	}
 
-	if (!found)
-		fprintf(fp, "  (none)\n");
-
 	if ((nr_bases == 2) && (base == 0)) {
 		base++;
 		timer_base += SIZE(timer_base);
@@ -9319,11 +10220,16 @@ next_base:
 	if (++cpu < kt->cpus)
 		goto next_cpu;
 done:
+	if (timer_merge) {
+		dump_timer_bases_merged(runs, nruns, flen);
+		for (i = 0; i < nruns; i++)
+			FREEBUF(runs[i].timers);
+		FREEBUF(runs);
+	}
 	FREEBUF(data.vectors);
 	FREEBUF(data.timers);
 }
 
-
 /*
  *  Panic a live system by exploiting this code in do_exit():
  *
@@ -9595,6 +10501,89 @@ hide_offline_cpu(int cpu)
 	return check_offline_cpu(cpu);
 }
 
+/*
+ *  percpu_gather() reads a per-cpu variable of all kt->cpus cpus with a
+ *  single readmem_batch() call, which reads the cpus' copies that are
+ *  close enough together with one readmem().
+ */
+#define PERCPU_GATHER_CACHE (32)		/* PERCPU_CACHED entries */
+
+static struct percpu_gather_cache {
+	ulong addr;
+	long size;
+	char *data;
+} percpu_gather_cache[PERCPU_GATHER_CACHE] = { { 0 } };
+static int percpu_gather_next = 0;
+
+/*
+ *  Copy size bytes of the per-cpu variable at addr of each cpu, from 0 up
+ *  to kt->cpus, into consecutive size-byte slots of buf.  The readmem()
+ *  error handling is taken from flags; with RETURN_ON_ERROR, the slots of
+ *  the cpus that cannot be read are zeroed, and FALSE is returned.  With
+ *  PERCPU_CACHED, the data of a dumpfile is kept for the session, so that
+ *  subsequent requests for the same variable do not read it again.
+ */
+int
+percpu_gather(ulong addr, long size, void *buf, ulong flags)
+{
+	int i, ret;
+	char *data;
+	struct readmem_request *reqs;
+	struct percpu_gather_cache *pgc;
+	int cpus = kt->cpus;
+
+	if (!size || (cpus < 1))
+		return TRUE;
+
+	if ((flags & PERCPU_CACHED) && DUMPFILE()) {
+		for (i = 0; i < PERCPU_GATHER_CACHE; i++) {
+			pgc = &percpu_gather_cache[i];
+			if (pgc->data && (pgc->addr == addr) &&
+			    (pgc->size == size)) {
+				BCOPY(pgc->data, buf, size * cpus);
+				return TRUE;
+			}
+		}
+	}
+
+	data = (char *)buf;
+
+	reqs = (struct readmem_request *)
+		GETBUF(sizeof(struct readmem_request) * cpus);
+	for (i = 0; i < cpus; i++) {
+		if ((kt->flags & SMP) && (kt->flags & PER_CPU_OFF))
+			reqs[i].addr = addr + kt->__per_cpu_offset[i];
+		else
+			reqs[i].addr = addr;
+		reqs[i].memtype = KVADDR;
+		reqs[i].buffer = data + i * size;
+		reqs[i].size = size;
+		reqs[i].type = "per-cpu data";
+	}
+
+	ret = (readmem_batch(reqs, cpus, flags & ~PERCPU_CACHED) == cpus);
+
+	for (i = 0; !ret && (i < cpus); i++) {
+		if (!reqs[i].result)
+			BZERO(data + i * size, size);
+	}
+
+	FREEBUF(reqs);
+
+	if (ret && (flags & PERCPU_CACHED) && DUMPFILE()) {
+		pgc = &percpu_gather_cache[percpu_gather_next];
+		if ((pgc->data = realloc(pgc->data, size * cpus))) {
+			pgc->addr = addr;
+			pgc->size = size;
+			BCOPY(buf, pgc->data, size * cpus);
+			percpu_gather_next = (percpu_gather_next + 1) %
+				PERCPU_GATHER_CACHE;
+		}
+	}
+
+	return ret;
+}
+
 /*
  *  If it exists, return the highest cpu number in the cpu_online_map.
  */
@@ -10315,12 +11304,49 @@ search_mapping_page(ulong mfn, ulong *index, ulong *startptr, ulong *endptr)
 
 /*
  * IKCONFIG management.
+ *
+ * The decompressed config is parsed once into ikconfig_all, whose
+ * entries are chained by name from ikconfig_hash[], and is then kept
+ * for the rest of the session.  The decompressed text is also saved in
+ * the session cache, from which ikconfig_preload() can set up the table
+ * of a later session before gdb is initialized, without reading and
+ * inflating kernel_config_data again.
  */
 #define IKCONFIG_MAX		5000
+#define IKCONFIG_HASH_SIZE	(1024)
 static struct ikconfig_list {
 	char *name;
 	char *val;
+	int next;
 } *ikconfig_all;
+static int ikconfig_max;
+static int ikconfig_hash[IKCONFIG_HASH_SIZE];
+
+static ulong ikconfig_hash_index(char *name)
+{
+	ulong hash;
+
+	for (hash = 0; *name; name++)
+		hash = (hash * 31) + (unsigned char)*name;
+
+	return hash % IKCONFIG_HASH_SIZE;
+}
+
+static struct ikconfig_list *ikconfig_lookup(char *name)
+{
+	int i;
+
+	if (!ikconfig_all)
+		return NULL;
+
+	for (i = ikconfig_hash[ikconfig_hash_index(name)]; i >= 0;
+	     i = ikconfig_all[i].next) {
+		if (STREQ(name, ikconfig_all[i].name))
+			return &ikconfig_all[i];
+	}
+
+	return NULL;
+}
 
 static int add_ikconfig_entry(char *line, struct ikconfig_list *ent)
 {
@@ -10345,13 +11371,18 @@ static int add_ikconfig_entry(char *line, struct ikconfig_list *ent)
 static int setup_ikconfig(char *config)
 {
 	char *ent, *tokptr;
-	struct ikconfig_list *new;
+	struct ikconfig_list *new, *cur;
+	ulong idx;
+	int i;
 
-	ikconfig_all = calloc(1, sizeof(struct ikconfig_list) * IKCONFIG_MAX);
+	ikconfig_max = IKCONFIG_MAX;
+	ikconfig_all = calloc(1, sizeof(struct ikconfig_list) * ikconfig_max);
 	if (!ikconfig_all) {
 		error(WARNING, "cannot calloc for ikconfig entries.\n");
 		return 0;
 	}
+	for (i = 0; i < IKCONFIG_HASH_SIZE; i++)
+		ikconfig_hash[i] = -1;
 
 	ent =  strtok_r(config, "\n", &tokptr);
 	while (ent) {
@@ -10359,22 +11390,42 @@ static int setup_ikconfig(char *config)
 			ent++;
 
 		if (STRNEQ(ent, "CONFIG_")) {
-			if (add_ikconfig_entry(ent, &ikconfig_all[kt->ikconfig_ents]))
-				kt->ikconfig_ents++;
-			if (kt->ikconfig_ents == IKCONFIG_MAX) {
-				error(WARNING, "ikconfig overflow.\n");
-				return 1;
+			if (kt->ikconfig_ents == ikconfig_max) {
+				if (!(new = realloc(ikconfig_all,
+				    sizeof(struct ikconfig_list) * ikconfig_max * 2))) {
+					error(WARNING, "ikconfig overflow.\n");
+					return 1;
+				}
+				ikconfig_all = new;
+				ikconfig_max *= 2;
+			}
+			cur = &ikconfig_all[kt->ikconfig_ents];
+			if (add_ikconfig_entry(ent, cur)) {
+				/*
+				 *  The first of any duplicate entries is used.
+				 */
+				if (ikconfig_lookup(cur->name)) {
+					free(cur->name);
+					free(cur->val);
+				} else {
+					idx = ikconfig_hash_index(cur->name);
+					cur->next = ikconfig_hash[idx];
+					ikconfig_hash[idx] = kt->ikconfig_ents++;
+				}
 			}
 		}
 		ent = strtok_r(NULL, "\n", &tokptr);
 	}
 	if (kt->ikconfig_ents == 0) {
 		free(ikconfig_all);
+		ikconfig_all = NULL;
 		return 0;
 	}
 	if ((new = realloc(ikconfig_all,
-	    sizeof(struct ikconfig_list) * kt->ikconfig_ents)))
+	    sizeof(struct ikconfig_list) * kt->ikconfig_ents))) {
 		ikconfig_all = new;
+		ikconfig_max = kt->ikconfig_ents;
+	}
 
 	return 1;
 }
@@ -10388,13 +11439,13 @@ static void free_ikconfig(void)
 		free(ikconfig_all[i].val);
 	}
 	free(ikconfig_all);
+	ikconfig_all = NULL;
 }
 
 int get_kernel_config(char *conf_name, char **str)
 {
-	int i;
 	int ret = IKCONFIG_N;
-	char *name;
+	struct ikconfig_list *ent;
 
 	if (!(kt->ikconfig_flags & IKCONFIG_AVAIL)) {
 		error(WARNING, "CONFIG_IKCONFIG is not set\n");
@@ -10407,64 +11458,92 @@ int get_kernel_config(char *conf_name, char **str)
 		}
 	}
 
-	name = strdup(conf_name);
-	if (!strncmp(name, "CONFIG_", strlen("CONFIG_")))
-		sscanf(name, "CONFIG_%s", name);
-
-	for (i = 0; i < kt->ikconfig_ents; i++) {
-		if (STREQ(name, ikconfig_all[i].name)) {
-			if (str)
-				*str = ikconfig_all[i].val;
-			if (STREQ(ikconfig_all[i].val, "y"))
-				ret = IKCONFIG_Y;
-			else if (STREQ(ikconfig_all[i].val, "m"))
-				ret = IKCONFIG_M;
-			else
-				ret = IKCONFIG_STR;
+	if (STRNEQ(conf_name, "CONFIG_"))
+		conf_name += strlen("CONFIG_");
 
-			break;
-		}
+	if ((ent = ikconfig_lookup(conf_name))) {
+		if (str)
+			*str = ent->val;
+		if (STREQ(ent->val, "y"))
+			ret = IKCONFIG_Y;
+		else if (STREQ(ent->val, "m"))
+			ret = IKCONFIG_M;
+		else
+			ret = IKCONFIG_STR;
 	}
-	free(name);
 
 	return ret;
 }
 
 /*
- *  Read the relevant IKCONFIG (In Kernel Config) data if available.
+ *  Return a copy of the decompressed config text saved in the session
+ *  cache, or NULL if it was not saved.
  */
+static char *
+ikconfig_cached_text(void)
+{
+	char *cached, *text;
+	ulong size;
 
-static char *ikconfig[] = {
-        "CONFIG_NR_CPUS",
-        "CONFIG_PGTABLE_4",
-        "CONFIG_HZ",
-	"CONFIG_DEBUG_BUGVERBOSE",
-	"CONFIG_DEBUG_INFO_REDUCED",
-        NULL,
-};
+	if (!(cached = session_cache_get("ikconfig", &size)) || !size ||
+	    (cached[size-1] != NULLCHAR) || !(text = malloc(size)))
+		return NULL;
+
+	memcpy(text, cached, size);
+	return text;
+}
 
+/*
+ *  Called before gdb is initialized: if the config of this dumpfile
+ *  was saved in the session cache, set up its table so that the
+ *  startup code can use get_kernel_config() from then on.
+ */
 void
-read_in_kernel_config(int command)
+ikconfig_preload(void)
+{
+	char *text;
+
+	if ((kt->flags & NO_IKCONFIG) ||
+	    (kt->ikconfig_flags & IKCONFIG_LOADED) ||
+	    !(text = ikconfig_cached_text()))
+		return;
+
+	if (setup_ikconfig(text)) {
+		kt->ikconfig_flags |= (IKCONFIG_AVAIL|IKCONFIG_LOADED);
+		if (CRASHDEBUG(1))
+			fprintf(fp, "ikconfig: %d valid configs (cached).\n",
+				kt->ikconfig_ents);
+	}
+	free(text);
+}
+
+/*
+ *  Return the decompressed config text in a malloc'd, NUL-terminated
+ *  buffer, from the session cache if possible, or else by reading and
+ *  inflating kernel_config_data, in which case it is put in the
+ *  session cache.
+ */
+static char *
+ikconfig_text(int command)
 {
 	struct syment *sp;
-	int ii, jj, ret, end, found=0;
+	int ii, ret, end, found=0;
 	unsigned long size, bufsz;
 	uint64_t magic;
-	char *pos, *ln, *buf, *head, *tail, *val, *uncomp;
-	char line[512];
+	char *buf, *head, *tail, *uncomp;
 	z_stream stream;
 
-	if ((kt->flags & NO_IKCONFIG) && !(pc->flags & RUNTIME))
-		return;
+	if ((uncomp = ikconfig_cached_text()))
+		return uncomp;
 
 	if ((sp = symbol_search("kernel_config_data")) == NULL) {
 		if (command == IKCFG_READ)
 			error(FATAL, 
 			    "kernel_config_data does not exist in this kernel\n");
-		else if (command == IKCFG_SETUP || command == IKCFG_FREE)
+		else if (command == IKCFG_SETUP)
 			error(WARNING, 
 			    "kernel_config_data does not exist in this kernel\n");
-		return;
+		return NULL;
 	}
 	
 	/* We don't know how large IKCONFIG is, so we start with 
@@ -10478,7 +11557,7 @@ again:
 
 	if ((buf = (char *)malloc(size)) == NULL) {
 		error(WARNING, "cannot malloc IKCONFIG input buffer\n");
-		return;
+		return NULL;
 	}
 	
         if (!readmem(sp->value, KVADDR, buf, size,
@@ -10521,7 +11600,7 @@ again:
 	if (found) {
 		bufsz = tail - head;
 		size = 10 * bufsz;
-		if ((uncomp = (char *)malloc(size)) == NULL) {
+		if ((uncomp = (char *)malloc(size + 1)) == NULL) {
 			error(WARNING, "cannot malloc IKCONFIG output buffer\n");
 			goto out2;
 		}
@@ -10570,34 +11649,84 @@ again:
 
 	ret = inflateEnd(&stream);
 
-	pos = uncomp;
+	uncomp[size] = NULLCHAR;
+	free(buf);
 
-	if (command == IKCFG_INIT)
-		kt->ikconfig_flags |= IKCONFIG_AVAIL;
-	else if (command == IKCFG_SETUP) {
-		if (!(kt->ikconfig_flags & IKCONFIG_LOADED)) {
-			if (setup_ikconfig(pos)) {
-				kt->ikconfig_flags |= IKCONFIG_LOADED;
-				if (CRASHDEBUG(1))
-					fprintf(fp,
-					"ikconfig: %d valid configs.\n",
-						kt->ikconfig_ents);
-			} else
-				error(WARNING, "IKCFG_SETUP failed\n\n");
-		} else
-			error(WARNING, 
-				"IKCFG_SETUP: ikconfig data already loaded\n");
-		goto out1;
-	} else if (command == IKCFG_FREE) {
+	if (!(pc->flags & RUNTIME))
+		session_cache_put("ikconfig", uncomp, size + 1);
+
+	return uncomp;
+
+out1:
+	free(uncomp);
+out2:
+	free(buf);
+
+	return NULL;
+}
+
+/*
+ *  Read the relevant IKCONFIG (In Kernel Config) data if available.
+ */
+
+static char *ikconfig[] = {
+        "CONFIG_NR_CPUS",
+        "CONFIG_PGTABLE_4",
+        "CONFIG_HZ",
+	"CONFIG_DEBUG_BUGVERBOSE",
+	"CONFIG_DEBUG_INFO_REDUCED",
+        NULL,
+};
+
+void
+read_in_kernel_config(int command)
+{
+	int ii, jj, ret;
+	char *pos, *ln, *head, *val, *uncomp, *copy;
+	char line[512];
+
+	if ((kt->flags & NO_IKCONFIG) && !(pc->flags & RUNTIME))
+		return;
+
+	if (command == IKCFG_FREE) {
 		if (kt->ikconfig_flags & IKCONFIG_LOADED) {
 			free_ikconfig();
 			kt->ikconfig_ents = 0;
 			kt->ikconfig_flags &= ~IKCONFIG_LOADED;
 		} else
 			error(WARNING, "IKCFG_FREE: ikconfig data not loaded\n");
-		goto out1;
+		return;
+	}
+
+	if ((command == IKCFG_SETUP) && (kt->ikconfig_flags & IKCONFIG_LOADED)) {
+		error(WARNING, "IKCFG_SETUP: ikconfig data already loaded\n");
+		return;
+	}
+
+	if (!(uncomp = ikconfig_text(command)))
+		return;
+
+	pos = uncomp;
+
+	if (command == IKCFG_INIT)
+		kt->ikconfig_flags |= IKCONFIG_AVAIL;
+
+	if (((command == IKCFG_INIT) || (command == IKCFG_SETUP)) &&
+	    !(kt->ikconfig_flags & IKCONFIG_LOADED)) {
+		if ((copy = strdup(uncomp)) && setup_ikconfig(copy)) {
+			kt->ikconfig_flags |= IKCONFIG_LOADED;
+			if (CRASHDEBUG(1))
+				fprintf(fp,
+				"ikconfig: %d valid configs.\n",
+					kt->ikconfig_ents);
+		} else
+			error(WARNING, "IKCFG_SETUP failed\n\n");
+		free(copy);
 	}
 
+	if (command == IKCFG_SETUP)
+		goto out;
+
 	do {
 		ret = sscanf(pos, "%511[^\n]\n%n", line, &ii);
 		if (ret > 0) {
@@ -10680,12 +11809,8 @@ again:
 		}
 	} while (ret > 0);
 
-out1:
+out:
 	free(uncomp);
-out2:
-	free(buf);
-
-	return;
 }
 
 static void
@@ -11717,6 +12842,7 @@ dump_printk_safe_seq_buf(int msg_flags)
 
 /*
  * Reads a string value from the VMCOREINFO data stored in (live) memory.
+ * The data is read once, into the shared vmcoreinfo table.
  *
  * Returns a string (that has to be freed by the caller) that contains the
  * value for key or NULL if the key has not been found.
@@ -11724,13 +12850,13 @@ dump_printk_safe_seq_buf(int msg_flags)
 static char *
 vmcoreinfo_read_string(const char *key)
 {
-	char *buf, *value_string, *p1, *p2;
-	size_t value_length;
+	char *buf;
 	size_t vmcoreinfo_size;
 	ulong vmcoreinfo_data;
-	char keybuf[BUFSIZE];
+	static int loaded = FALSE;
 
-	buf = value_string = NULL;
+	if (loaded)
+		return vmcoreinfo_table_read_string(key);
 
 	switch (get_symbol_type("vmcoreinfo_data", NULL, NULL))
 	{
@@ -11746,8 +12872,6 @@ vmcoreinfo_read_string(const char *key)
 
 	get_symbol_data("vmcoreinfo_size", sizeof(vmcoreinfo_size), &vmcoreinfo_size);
 
-	sprintf(keybuf, "%s=", key);
-
 	if ((buf = malloc(vmcoreinfo_size+1)) == NULL) {
 		error(INFO, "cannot malloc vmcoreinfo buffer\n");
 		goto err;
@@ -11759,21 +12883,12 @@ vmcoreinfo_read_string(const char *key)
 		goto err;
 	}
 
-	buf[vmcoreinfo_size] = '\n';
-
-	if ((p1 = strstr(buf, keybuf))) {
-		p2 = p1 + strlen(keybuf);
-		p1 = strstr(p2, "\n");
-		value_length = p1-p2;
-		value_string = calloc(value_length+1, sizeof(char));
-		strncpy(value_string, p2, value_length);
-		value_string[value_length] = NULLCHAR;
-	}
+	loaded = vmcoreinfo_table_init(buf, vmcoreinfo_size);
 err:
 	if (buf)
 		free(buf);
 
-	return value_string;
+	return vmcoreinfo_table_read_string(key);
 }
 
 static void
@@ -30,6 +30,10 @@ static void write_mapfile_registers(void);
 static void write_mapfile_trailer(void);
 static void read_mapfile_trailer(void);
 static void read_mapfile_registers(void);
+static void build_mapfile_index(void);
+static int write_mapfile_index(char *);
+static void load_mapfile_index(void);
+static struct mapindex_run *mapindex_lookup(uint64_t);
 
 #define RAM_OFFSET_COMPRESSED (~(off_t)255)
 #define QEMU_COMPRESSED       ((WRITE_ERROR)-1)
@@ -70,7 +74,7 @@ is_kvmdump(char *filename)
 		error(INFO, "%s: read: %s\n", filename, strerror(errno));
 		return FALSE;
 	}
-	if (trailer.magic == MAPFILE_MAGIC) {
+	if ((trailer.magic == MAPFILE_MAGIC) || (trailer.magic == MAPINDEX_MAGIC)) {
 		kvm->mapinfo.map_start_offset = trailer.map_start_offset;
 		kvm->flags |= MAPFILE_APPENDED;
 	}
@@ -85,7 +89,7 @@ kvmdump_init(char *filename, FILE *fptr)
 {
 	int i, page_size;
         struct command_table_entry *cp;
-	char *cachebuf;
+	char *cachebuf, *mapfile;
 	FILE *tmpfp;
 
 	if (!machine_type("X86") && !machine_type("X86_64")) {
@@ -135,6 +139,9 @@ kvmdump_init(char *filename, FILE *fptr)
 		kvm->page_cache[i].bufptr = cachebuf + (i * page_size);
 	}
 
+	if ((kvm->readahead_buf = malloc(KVMDUMP_READAHEAD_PAGES * 2 * page_size)) == NULL)
+		error(FATAL, "cannot malloc KVM readahead buffer\n");
+
 	kvmdump_regs_store(KVMDUMP_REGS_START, NULL);
 
 	if (qemu_init(filename)) {
@@ -142,13 +149,31 @@ kvmdump_init(char *filename, FILE *fptr)
 		{
 		case TMPFILE:
 			kvmdump_regs_store(KVMDUMP_REGS_END, NULL);
+			build_mapfile_index();
 			write_mapfile_trailer();
+			/*
+			 *  Save the index so that the next session can skip
+			 *  the dumpfile scan; this is silently skipped if the
+			 *  dumpfile's directory is not writable.
+			 */
+			if (kvm->runs) {
+				mapfile = GETBUF(strlen(pc->dumpfile)+10);
+				sprintf(mapfile, "%s.map", pc->dumpfile);
+				if (!file_exists(mapfile, NULL) &&
+				    write_mapfile_index(mapfile) &&
+				    CRASHDEBUG(1))
+					error(INFO, "KVM mapfile index saved: %s\n",
+						mapfile);
+				FREEBUF(mapfile);
+			}
 			break;
 
 		case MAPFILE:
 		case MAPFILE_APPENDED:
 		case MAPFILE|MAPFILE_APPENDED:
 			read_mapfile_trailer();
+			if (kvm->mapinfo.magic == MAPINDEX_MAGIC)
+				load_mapfile_index();
 			kvmdump_regs_store(KVMDUMP_REGS_END, NULL);
 			break;
 		}
@@ -247,6 +272,8 @@ kvmdump_memory_dump(FILE *ofp)
 		fprintf(ofp, "%sREGS_FROM_DUMPFILE", others++ ? "|" : "");
 	if (kvm->flags & REGS_NOT_AVAIL)
 		fprintf(ofp, "%sREGS_NOT_AVAIL", others++ ? "|" : "");
+	if (kvm->flags & MAPFILE_INDEX)
+		fprintf(ofp, "%sMAPFILE_INDEX", others++ ? "|" : "");
 	fprintf(ofp, ")\n");
 
 	fprintf(ofp, "            mapfd: %d\n", kvm->mapfd);
@@ -261,7 +288,8 @@ kvmdump_memory_dump(FILE *ofp)
         	fprintf(ofp, "           kvbase: (unused)\n");
 	fprintf(ofp, "          mapinfo:\n");
         fprintf(ofp, "              magic: %llx %s\n", (ulonglong)kvm->mapinfo.magic,
-		kvm->mapinfo.magic == MAPFILE_MAGIC ?  "(MAPFILE_MAGIC)" : "");
+		kvm->mapinfo.magic == MAPFILE_MAGIC ?  "(MAPFILE_MAGIC)" :
+		kvm->mapinfo.magic == MAPINDEX_MAGIC ?  "(MAPINDEX_MAGIC)" : "");
         fprintf(ofp, "          phys_base: %llx %s\n", (ulonglong)kvm->mapinfo.phys_base,
 		machine_type("X86") ? "(unused)" : "");
         fprintf(ofp, "     cpu_version_id: %ld\n", (ulong)kvm->mapinfo.cpu_version_id);
@@ -284,6 +312,13 @@ kvmdump_memory_dump(FILE *ofp)
 			kvm->compresses * 100 / kvm->accesses);
 	else
 		fprintf(ofp, "\n");
+	fprintf(ofp, "       readaheads: %ld\n", kvm->readaheads);
+	fprintf(ofp, "    readahead_buf: %lx\n", (ulong)kvm->readahead_buf);
+	fprintf(ofp, "             runs: %lx\n", (ulong)kvm->runs);
+	fprintf(ofp, "          nr_runs: %ld\n", kvm->nr_runs);
+	fprintf(ofp, "         last_run: %lx\n", (ulong)kvm->last_run);
+	fprintf(ofp, "        index_map: %lx (size: %ld)\n",
+		(ulong)kvm->index_map, (ulong)kvm->index_map_size);
 
 	for (i = 0; i < KVMDUMP_CACHED_PAGES; i++) {
 		if (kvm->page_cache[i].paddr == CACHE_UNUSED)
@@ -323,7 +358,8 @@ kvmdump_memory_dump(FILE *ofp)
 			strerror(errno));
 
 	fprintf(ofp, "             magic: %llx %s\n", (ulonglong)trailer.magic,
-		trailer.magic == MAPFILE_MAGIC ? "(MAPFILE_MAGIC)" : "");
+		trailer.magic == MAPFILE_MAGIC ? "(MAPFILE_MAGIC)" :
+		trailer.magic == MAPINDEX_MAGIC ? "(MAPINDEX_MAGIC)" : "");
 	fprintf(ofp, "         phys_base: %llx %s\n", (ulonglong)trailer.phys_base,
 		machine_type("X86") ? "(unused)" : "");
 	fprintf(ofp, "    cpu_version_id: %ld\n", (ulong)trailer.cpu_version_id);
@@ -513,6 +549,77 @@ kvmdump_phys_base(unsigned long *phys_base)
         return FALSE;
 }
 
+/*
+ *  Returns TRUE if paddr is in the page cache.
+ */
+static int
+page_is_cached(physaddr_t paddr)
+{
+	int idx;
+
+	for (idx = 0; idx < KVMDUMP_CACHED_PAGES; idx++) {
+		if (kvm->page_cache[idx].paddr == paddr)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*
+ *  The pages of a run are stored at a fixed stride in the dumpfile, so
+ *  a cache miss reads the requested page together with up to
+ *  KVMDUMP_READAHEAD_PAGES-1 pages that follow it in the same run with
+ *  one pread(), and caches all of them.  Returns the number of pages
+ *  read, or 0 if only the single page should be read.
+ */
+static int
+cache_page_readahead(physaddr_t paddr, off_t offset)
+{
+	int i, n, idx;
+	int64_t stride;
+	size_t page_size;
+	off_t next;
+	ssize_t len;
+	struct kvm_page_cache_hdr *pgc;
+
+	page_size = memory_page_size();
+
+	if (!kvm->runs || !kvm->last_run)
+		return 0;
+	stride = kvm->last_run->stride;
+	if ((stride < (int64_t)page_size) || (stride > 2 * (int64_t)page_size))
+		return 0;
+
+	for (n = 1; n < KVMDUMP_READAHEAD_PAGES; n++) {
+		if ((load_mapfile_offset(paddr + n * page_size, &next) < 0) ||
+		    (next != offset + n * stride) ||
+		    page_is_cached(paddr + n * page_size))
+			break;
+	}
+	if (n == 1)
+		return 0;
+
+	len = (n - 1) * stride + page_size;
+	if (pread(kvm->vmfd, kvm->readahead_buf, len, offset) != len)
+		return 0;
+
+	for (i = n - 1; i >= 0; i--) {
+		idx = kvm->evict_index;
+		pgc = &kvm->page_cache[idx];
+		BCOPY(kvm->readahead_buf + i * stride, pgc->bufptr, page_size);
+		pgc->paddr = paddr + i * page_size;
+		kvm->evict_index = (idx+1) % KVMDUMP_CACHED_PAGES;
+	}
+
+	/*
+	 *  The requested page was stored last.
+	 */
+	kvm->un.curbufptr = pgc->bufptr;
+	kvm->readaheads++;
+
+	return n;
+}
+
 static int
 cache_page(physaddr_t paddr)
 {
@@ -545,6 +652,10 @@ cache_page(physaddr_t paddr)
 		return QEMU_COMPRESSED;
 	}
 
+	if (cache_page_readahead(paddr, offset))
+		return (kvm->evict_index + KVMDUMP_CACHED_PAGES - 1) %
+			KVMDUMP_CACHED_PAGES;
+
 	idx = kvm->evict_index;
 	pgc = &kvm->page_cache[idx];
         page_size = memory_page_size();
@@ -635,6 +746,22 @@ load_mapfile_offset(uint64_t physaddr, off_t *entry_ptr)
 		}
 		break;
 	}
+
+	if (kvm->runs) {
+		struct mapindex_run *run;
+
+		if (!(run = mapindex_lookup(kvm_addr/4096))) {
+			if (CRASHDEBUG(1))
+				error(INFO, "load_mapfile_offset: "
+				    "physical: %llx not in %s index\n",
+					(unsigned long long)physaddr,
+					mapfile_in_use());
+			return SEEK_ERROR;
+		}
+		*entry_ptr = (off_t)(run->offset +
+			(int64_t)(kvm_addr/4096 - run->pfn) * run->stride);
+		return 0;
+	}
  
 	if (lseek(kvm->mapfd, mapfile_offset(kvm_addr), SEEK_SET) < 0) {
 		if (CRASHDEBUG(1))
@@ -657,6 +784,216 @@ load_mapfile_offset(uint64_t physaddr, off_t *entry_ptr)
 	return 0;
 }
 
+/*
+ *  Find the run containing pfn, checking the run found by the previous
+ *  lookup first.
+ */
+static struct mapindex_run *
+mapindex_lookup(uint64_t pfn)
+{
+	long lo, hi, mid;
+	struct mapindex_run *run;
+
+	if ((run = kvm->last_run) && (pfn >= run->pfn) &&
+	    (pfn < run->pfn + run->count))
+		return run;
+
+	lo = 0;
+	hi = kvm->nr_runs - 1;
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		run = &kvm->runs[mid];
+		if (pfn < run->pfn)
+			hi = mid - 1;
+		else if (pfn >= run->pfn + run->count)
+			lo = mid + 1;
+		else
+			return (kvm->last_run = run);
+	}
+
+	return NULL;
+}
+
+/*
+ *  After the dumpfile scan has stored one file offset per page in the
+ *  tmpfile, collapse them into the runs of pages that are stored at a
+ *  fixed stride.  The index is used for all subsequent lookups, and it
+ *  is much smaller than the per-page array.  Pages with a zero offset
+ *  were not in the dumpfile.
+ */
+static void
+build_mapfile_index(void)
+{
+	int i, n;
+	uint64_t pfn;
+	off_t entry, *entries;
+	struct mapindex_run *runs, *run;
+	ulong nr_runs, max_runs;
+
+#define MAPINDEX_CHUNK (4096)
+
+	if (lseek(kvm->mapfd, 0, SEEK_SET) < 0)
+		return;
+	if ((entries = malloc(MAPINDEX_CHUNK * sizeof(off_t))) == NULL)
+		return;
+
+	runs = NULL;
+	run = NULL;
+	nr_runs = max_runs = 0;
+	pfn = 0;
+
+	while ((n = read(kvm->mapfd, entries,
+	    MAPINDEX_CHUNK * sizeof(off_t))) > 0) {
+		n /= sizeof(off_t);
+		for (i = 0; i < n; i++, pfn++) {
+			if ((entry = entries[i]) == 0) {
+				run = NULL;
+				continue;
+			}
+			if (run && (pfn == run->pfn + run->count)) {
+				if (run->count == 1) {
+					if ((entry == run->offset) ||
+					    ((entry > 0) && (run->offset > 0))) {
+						run->stride = entry - run->offset;
+						run->count++;
+						continue;
+					}
+				} else if (entry == run->offset +
+				    (int64_t)run->count * run->stride) {
+					run->count++;
+					continue;
+				}
+			}
+			if (nr_runs == max_runs) {
+				max_runs = max_runs ? max_runs * 2 : 1024;
+				if ((run = realloc(runs, max_runs *
+				    sizeof(struct mapindex_run))) == NULL) {
+					free(runs);
+					free(entries);
+					return;
+				}
+				runs = run;
+			}
+			run = &runs[nr_runs++];
+			run->pfn = pfn;
+			run->count = 1;
+			run->offset = entry;
+			run->stride = 0;
+		}
+	}
+
+	free(entries);
+
+	if (n < 0 || !nr_runs) {
+		free(runs);
+		return;
+	}
+
+	kvm->runs = runs;
+	kvm->nr_runs = nr_runs;
+	kvm->flags |= MAPFILE_INDEX;
+}
+
+/*
+ *  Write the run index, the register set, and the trailer to a new
+ *  mapfile.
+ */
+static int
+write_mapfile_index(char *filename)
+{
+	int fd;
+	size_t size;
+	uint64_t magic;
+	struct mapindex_header header;
+	struct mapinfo_trailer trailer;
+
+	if ((fd = open(filename, O_CREAT|O_EXCL|O_WRONLY, 0644)) < 0) {
+		if (CRASHDEBUG(1))
+			error(INFO, "%s: open: %s\n", filename, strerror(errno));
+		return FALSE;
+	}
+
+	header.magic = MAPINDEX_MAGIC;
+	header.nr_runs = kvm->nr_runs;
+	if (write(fd, &header, sizeof(header)) != sizeof(header))
+		goto bailout;
+
+	size = sizeof(struct mapindex_run) * kvm->nr_runs;
+	if (write(fd, kvm->runs, size) != size)
+		goto bailout;
+
+	if (kvm->cpu_devices) {
+		size = sizeof(struct register_set) * kvm->cpu_devices;
+		if (write(fd, &kvm->registers[0], size) != size)
+			goto bailout;
+		if (write(fd, &kvm->cpu_devices, sizeof(uint64_t)) !=
+		    sizeof(uint64_t))
+			goto bailout;
+		magic = REGS_MAGIC;
+		if (write(fd, &magic, sizeof(uint64_t)) != sizeof(uint64_t))
+			goto bailout;
+	}
+
+	trailer = kvm->mapinfo;
+	trailer.map_start_offset = 0;
+	trailer.magic = MAPINDEX_MAGIC;
+	if (write(fd, &trailer, sizeof(trailer)) != sizeof(trailer))
+		goto bailout;
+
+	close(fd);
+	return TRUE;
+
+bailout:
+	error(INFO, "%s: write: %s\n", filename, strerror(errno));
+	close(fd);
+	unlink(filename);
+	return FALSE;
+}
+
+/*
+ *  Map the run index of a MAPINDEX_MAGIC mapfile, or of one that has
+ *  been appended to the dumpfile.  If the index cannot be mapped, it
+ *  is read instead.
+ */
+static void
+load_mapfile_index(void)
+{
+	off_t start, base;
+	size_t size;
+	char *addr;
+	struct mapindex_header header;
+
+	start = mapfile_offset(0);
+
+	if (pread(kvm->mapfd, &header, sizeof(header), start) != sizeof(header))
+		error(FATAL, "%s: read: %s\n", mapfile_in_use(), strerror(errno));
+	if (header.magic != MAPINDEX_MAGIC)
+		error(FATAL, "%s: invalid mapfile index\n", mapfile_in_use());
+
+	base = start & ~((off_t)memory_page_size() - 1);
+	size = (start - base) + sizeof(header) +
+		header.nr_runs * sizeof(struct mapindex_run);
+
+	addr = mmap(NULL, size, PROT_READ, MAP_SHARED, kvm->mapfd, base);
+	if (addr != MAP_FAILED) {
+		kvm->index_map = addr;
+		kvm->index_map_size = size;
+		kvm->runs = (struct mapindex_run *)
+			(addr + (start - base) + sizeof(header));
+	} else {
+		size = header.nr_runs * sizeof(struct mapindex_run);
+		if ((kvm->runs = malloc(size)) == NULL)
+			error(FATAL, "cannot malloc KVM mapfile index\n");
+		if (pread(kvm->mapfd, kvm->runs, size, start + sizeof(header))
+		    != size)
+			error(FATAL, "%s: read: %s\n", mapfile_in_use(),
+				strerror(errno));
+	}
+
+	kvm->nr_runs = header.nr_runs;
+	kvm->flags |= MAPFILE_INDEX;
+}
+
 static void
 kvmdump_mapfile_create(char *filename)
 {
@@ -675,6 +1012,14 @@ kvmdump_mapfile_create(char *filename)
 		return;
 	}
 
+	if ((kvm->flags & TMPFILE) && kvm->runs) {
+		if (write_mapfile_index(filename))
+			fprintf(fp, "MAP FILE CREATED: %s\n", filename);
+		else
+			error(INFO, "%s: cannot create mapfile\n", filename);
+		return;
+	}
+
 	if ((fdmem = open(filename, O_CREAT|O_RDWR, 0644)) < 0) {
 		error(INFO, "%s: open: %s\n", filename, strerror(errno));
 		return;
@@ -818,7 +1163,7 @@ is_kvmdump_mapfile(char *filename)
 		goto bailout;
         }
 
-	if (trailer.magic == MAPFILE_MAGIC) {
+	if ((trailer.magic == MAPFILE_MAGIC) || (trailer.magic == MAPINDEX_MAGIC)) {
 		if (pc->dumpfile && (trailer.checksum != kvm->mapinfo.checksum)) {
 			error(kvm->flags & MAPFILE_FOUND ? INFO : FATAL,
 			    "checksum mismatch between %s and %s\n\n",
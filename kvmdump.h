@@ -38,9 +38,28 @@ struct register_set {
 
 #define REGS_MAGIC    (0xfeedbeefdeadbabeULL)
 #define MAPFILE_MAGIC (0xfeedbabedeadbeefULL)
+#define MAPINDEX_MAGIC (0xfeedbabedeadfaceULL)
 #define CHKSUM_SIZE   (4096)
 
-#define KVMDUMP_CACHED_PAGES 32
+/*
+ *  A mapfile with a MAPINDEX_MAGIC trailer starts with a sorted list of
+ *  runs of pages instead of one file offset per page.  The register set
+ *  and trailer that follow are the same as in the MAPFILE_MAGIC format.
+ */
+struct mapindex_header {
+	uint64_t magic;
+	uint64_t nr_runs;
+};
+
+struct mapindex_run {
+	uint64_t pfn;		/* first page of the run */
+	uint64_t count;		/* number of pages */
+	int64_t offset;		/* file offset of the first page */
+	int64_t stride;		/* 0 if all pages are the same compressed page */
+};
+
+#define KVMDUMP_CACHED_PAGES    64
+#define KVMDUMP_READAHEAD_PAGES 16
 
 struct kvmdump_data {
 	ulong flags;
@@ -67,6 +86,13 @@ struct kvmdump_data {
 	uint64_t cpu_devices;
 	struct register_set *registers;
 	uint64_t iohole;
+	struct mapindex_run *runs;
+	ulong nr_runs;
+	struct mapindex_run *last_run;
+	char *index_map;
+	size_t index_map_size;
+	char *readahead_buf;
+	ulong readaheads;
 };
 
 #define TMPFILE              (0x2)
@@ -79,6 +105,7 @@ struct kvmdump_data {
 #define REGS_FROM_DUMPFILE (0x100)
 #define REGS_FROM_MAPFILE  (0x200)
 #define REGS_NOT_AVAIL     (0x400)
+#define MAPFILE_INDEX      (0x800)
 
 extern struct kvmdump_data *kvm;
 
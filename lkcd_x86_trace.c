@@ -484,10 +484,23 @@ struct framesize_cache {
 	int flags;
 	int frmsize;
 	int bp_adjust;
+	struct framesize_cache *next;
 };
-#define FRAMESIZE_CACHE (200)
 
-static struct framesize_cache framesize_cache[FRAMESIZE_CACHE] = {{0}};
+/*
+ *  The cache entries are hashed by return address, and are kept for the
+ *  whole session, so that "foreach bt" only decodes the instructions of
+ *  each function once.  The entries are allocated FRAMESIZE_CACHE_INCR
+ *  at a time, and framesize_cache[] lists them in the order entered.
+ */
+#define FRAMESIZE_CACHE_INCR (200)
+#define FRAMESIZE_CACHE_HASH (512)
+#define FRAMESIZE_HASH(X) (((X) ^ ((X) >> 9)) % FRAMESIZE_CACHE_HASH)
+
+static struct framesize_cache *framesize_cache_hash[FRAMESIZE_CACHE_HASH] = { 0 };
+static struct framesize_cache **framesize_cache = NULL;
+static int framesize_cache_count = 0;
+static int framesize_cache_size = 0;
 static struct framesize_cache framesize_cache_empty = {0};
 
 #define FSZ_QUERY     (1)
@@ -498,80 +511,96 @@ static struct framesize_cache framesize_cache_empty = {0};
 #define FRAMESIZE_CACHE_ENTER(pc,szp) cache_framesize(FSZ_ENTER, pc, szp, NULL)
 #define FRAMESIZE_CACHE_VALIDATE(pc,fcpp) cache_framesize(FSZ_VALIDATE, pc, NULL, fcpp)
 
+/*
+ *  Return the next unused entry, reusing those left by a cache clear
+ *  before allocating more of them.
+ */
+static struct framesize_cache *
+framesize_cache_alloc(void)
+{
+	int i;
+	struct framesize_cache **new_fcp, *fc;
+
+	if (framesize_cache_count == framesize_cache_size) {
+		if (!(new_fcp = realloc(framesize_cache,
+		    (framesize_cache_size+FRAMESIZE_CACHE_INCR) *
+		    sizeof(struct framesize_cache *))) ||
+		    !(fc = calloc(FRAMESIZE_CACHE_INCR,
+		    sizeof(struct framesize_cache)))) {
+			if (new_fcp)
+				framesize_cache = new_fcp;
+			error(INFO, "cannot allocate framesize_cache space!\n");
+			return NULL;
+		}
+		framesize_cache = new_fcp;
+		for (i = 0; i < FRAMESIZE_CACHE_INCR; i++)
+			framesize_cache[framesize_cache_size+i] = fc++;
+		framesize_cache_size += FRAMESIZE_CACHE_INCR;
+	}
+
+	fc = framesize_cache[framesize_cache_count++];
+	BZERO(fc, sizeof(struct framesize_cache));
+
+	return fc;
+}
+
 static int
 cache_framesize(int cmd, kaddr_t funcaddr, int *fsize, void **ptr)
 {
-	int i;
-	static ulong last_cleared = 0;
+	struct framesize_cache *fc, fc_local;
 
-retry:
-	for (i = 0; i < FRAMESIZE_CACHE; i++) {
-		if (framesize_cache[i].pc == funcaddr) { 
+	for (fc = framesize_cache_hash[FRAMESIZE_HASH(funcaddr)]; fc;
+	     fc = fc->next) {
+		if (fc->pc == funcaddr) {
 			switch (cmd)
 			{
 			case FSZ_VALIDATE:
-				*ptr = &framesize_cache[i];
+				*ptr = fc;
 				return TRUE;
 
 			case FSZ_QUERY:
-				*fsize = framesize_cache[i].frmsize;
+				*fsize = fc->frmsize;
 				return TRUE;
 
 			case FSZ_ENTER:
-				*fsize = framesize_cache[i].frmsize;
+				*fsize = fc->frmsize;
 				return TRUE;
 			}
 		}
-		
-		/*
-		 *  The entry does not exist.
-		 *
-		 *  If FSZ_QUERY or FSZ_VALIDATE, return their 
-		 *  no-such-entry indications.
-		 *
-		 *  Otherwise, load up the entry with the new data, and
-		 *  and modify it with known kludgery.
-		 */
-		if (framesize_cache[i].pc == 0) {
-			switch (cmd)
-			{
-			case FSZ_QUERY:
-				return FALSE;
-
-			case FSZ_VALIDATE:
-				*ptr = &framesize_cache_empty;
-				return FALSE;
-
-			case FSZ_ENTER:
-				framesize_cache[i].pc = funcaddr;
-				framesize_cache[i].frmsize = *fsize;
-				framesize_cache[i].bp_adjust = 0;
-				framesize_modify(&framesize_cache[i]);
-				*fsize = framesize_cache[i].frmsize;
-				return TRUE;
-			} 
-		}
 	}
 
-	console("framesize_cache is full\n");
-
 	/*
- 	 *  No place to put it, or it doesn't exist.
+	 *  The entry does not exist.
+	 *
+	 *  If FSZ_QUERY or FSZ_VALIDATE, return their 
+	 *  no-such-entry indications.
+	 *
+	 *  Otherwise, load up the entry with the new data, and
+	 *  and modify it with known kludgery.
 	 */
 	switch (cmd)
 	{
-	case FSZ_VALIDATE:
-		*ptr = &framesize_cache_empty;
+	case FSZ_QUERY:
 		return FALSE;
 
-	case FSZ_QUERY:
+	case FSZ_VALIDATE:
+		*ptr = &framesize_cache_empty;
 		return FALSE;
 
 	case FSZ_ENTER:
-		BZERO(&framesize_cache[last_cleared % FRAMESIZE_CACHE], 
-			sizeof(struct framesize_cache));
-		last_cleared++;
-		goto retry;
+		if ((fc = framesize_cache_alloc())) {
+			fc->next = framesize_cache_hash[FRAMESIZE_HASH(funcaddr)];
+			framesize_cache_hash[FRAMESIZE_HASH(funcaddr)] = fc;
+		} else {
+			fc = &fc_local;
+			BZERO(fc, sizeof(struct framesize_cache));
+		}
+		fc->pc = funcaddr;
+		fc->frmsize = *fsize;
+		fc->bp_adjust = 0;
+		framesize_modify(fc);
+		*fsize = fc->frmsize;
+		return TRUE;
 	}
 
 	return FALSE; /* can't get here -- for compiler happiness */
@@ -691,16 +720,16 @@ dump_framesize_cache(FILE *ofp, struct framesize_cache *fcp)
 {
         int i, count;
         struct syment *sp, *spm;
+	struct framesize_cache *fc;
 	ulong offset;
 	int once;
 
-        for (i = once = count = 0; i < FRAMESIZE_CACHE; i++) {
-		if (framesize_cache[i].pc == 0)
-			break;
+        for (i = once = count = 0; i < framesize_cache_count; i++) {
+		fc = framesize_cache[i];
 
 		count++;
 
-		if (fcp && (fcp != &framesize_cache[i]))
+		if (fcp && (fcp != fc))
 			continue;
 
 		if (!once) {
@@ -710,18 +739,18 @@ dump_framesize_cache(FILE *ofp, struct framesize_cache *fcp)
 		}
 
 		fprintf(ofp, "%8x %4d %4d  %s  ",
-			framesize_cache[i].pc,
-			framesize_cache[i].frmsize,
-			framesize_cache[i].bp_adjust,
-			framesize_cache[i].flags & FRAMESIZE_VALIDATE ?
+			fc->pc,
+			fc->frmsize,
+			fc->bp_adjust,
+			fc->flags & FRAMESIZE_VALIDATE ?
 			"V" : "-");	
-        	if ((sp = value_search(framesize_cache[i].pc, &offset)) ||
-		    (spm = kl_lkup_symaddr(framesize_cache[i].pc))) {
+        	if ((sp = value_search(fc->pc, &offset)) ||
+		    (spm = kl_lkup_symaddr(fc->pc))) {
 			if (sp) 
 				fprintf(ofp, "(%s+", sp->name);
 			else {
 				fprintf(ofp, "(%s+", spm->name);
-		    		offset = framesize_cache[i].pc - spm->value;
+		    		offset = fc->pc - spm->value;
 			}
 			switch (pc->output_radix)
 			{
@@ -754,47 +783,41 @@ static int
 modify_framesize_cache_entry(FILE *ofp, ulong eip, int framesize)
 {
         int i, found, all_cleared;
+	struct framesize_cache *fc;
+
+        for (i = found = all_cleared = 0; i < framesize_cache_count; i++) {
+		fc = framesize_cache[i];
 
-        for (i = found = all_cleared = 0; i < FRAMESIZE_CACHE; i++) {
 		if (!eip) {
 			switch (framesize)
 			{
 			case -1:
-				framesize_cache[i].flags |= FRAMESIZE_VALIDATE;
+				fc->flags |= FRAMESIZE_VALIDATE;
 				break;
 			case -2:
-				framesize_cache[i].flags &= ~FRAMESIZE_VALIDATE;
-				break;
-			default:
-				framesize_cache[i].pc = 0;
-				framesize_cache[i].frmsize = 0;
-				framesize_cache[i].flags = 0;
-				all_cleared = TRUE;
+				fc->flags &= ~FRAMESIZE_VALIDATE;
 				break;
 			}
 			continue;
 		}
 
-		if (framesize_cache[i].pc == 0)
-			break;
-
-                if (framesize_cache[i].pc == eip) {
+                if (fc->pc == eip) {
 			found++;
 
 			switch (framesize)
 			{
 			case -1:
-				framesize_cache[i].flags |= FRAMESIZE_VALIDATE;
+				fc->flags |= FRAMESIZE_VALIDATE;
 				break;
 			case -2:
-				framesize_cache[i].flags &= ~FRAMESIZE_VALIDATE;
+				fc->flags &= ~FRAMESIZE_VALIDATE;
 				break;
 			default:
-				framesize_cache[i].frmsize = framesize;
+				fc->frmsize = framesize;
 				break;
 			}
 
-			dump_framesize_cache(ofp, &framesize_cache[i]);
+			dump_framesize_cache(ofp, fc);
 
 			return TRUE;
 		}
@@ -803,6 +826,12 @@ modify_framesize_cache_entry(FILE *ofp, ulong eip, int framesize)
 	if (eip && !found)
 		fprintf(ofp, "eip: %lx not found in framesize cache\n", eip);
 
+	if (!eip && !framesize && framesize_cache_count) {
+		framesize_cache_count = 0;
+		BZERO(framesize_cache_hash, sizeof(framesize_cache_hash));
+		all_cleared = TRUE;
+	}
+
 	if (all_cleared)
 		fprintf(ofp, "framesize cache cleared\n");
 
@@ -20,6 +20,7 @@
 #include <curses.h>
 #include <getopt.h>
 #include <sys/prctl.h>
+#include <sys/resource.h>
 
 static void setup_environment(int, char **);
 static int is_external_command(void);
@@ -72,6 +73,11 @@ static struct option long_options[] = {
 	{"hash", required_argument, 0, 0},
 	{"offline", required_argument, 0, 0},
 	{"src", required_argument, 0, 0},
+	{"index_cache", optional_argument, 0, 0},
+	{"timing", 0, 0, 0},
+	{"session_cache", 0, 0, 0},
+	{"batch", required_argument, 0, 0},
+	{"batch_output", required_argument, 0, 0},
         {0, 0, 0, 0}
 };
 
@@ -81,7 +87,9 @@ main(int argc, char **argv)
 	int i, c, option_index;
 	char *tmpname;
 
+	startup_phase(NULL);
 	setup_environment(argc, argv);
+	startup_phase("setup_environment");
 
 	/* 
 	 *  Get and verify command line options.
@@ -299,6 +307,52 @@ main(int argc, char **argv)
 			else if (STREQ(long_options[option_index].name, "src"))
 				kt->source_tree = optarg;
 
+			else if (STREQ(long_options[option_index].name, "timing")) {
+				pc->flags2 |= STARTUP_TIMING;
+				readmem_profile_start();
+			}
+
+			else if (STREQ(long_options[option_index].name,
+			    "session_cache"))
+				pc->flags2 |= SESSION_CACHE;
+
+			else if (STREQ(long_options[option_index].name,
+			    "index_cache")) {
+#ifdef GDB_10_2
+				pc->flags2 |= INDEX_CACHE;
+				if (optarg) {
+					if (!is_directory(optarg)) {
+						error(INFO, "invalid --index_cache "
+							"directory: %s\n", optarg);
+						program_usage(SHORT_FORM);
+					}
+					pc->index_cache_dir = optarg;
+				}
+#else
+				error(INFO, "--index_cache is not supported "
+					"by this version of gdb\n");
+				program_usage(SHORT_FORM);
+#endif
+			}
+
+			else if (STREQ(long_options[option_index].name, "batch")) {
+				if (!decimal(optarg, 0) || !(pc->batch_jobs = atoi(optarg))) {
+					error(INFO, "invalid --batch argument: %s\n",
+						optarg);
+					program_usage(SHORT_FORM);
+				}
+			}
+
+			else if (STREQ(long_options[option_index].name,
+			    "batch_output")) {
+				if (!is_directory(optarg)) {
+					error(INFO, "invalid --batch_output "
+						"directory: %s\n", optarg);
+					program_usage(SHORT_FORM);
+				}
+				pc->batch_output = optarg;
+			}
+
 			else {
 				error(INFO, "internal error: option %s unhandled\n",
 					long_options[option_index].name);
@@ -417,6 +471,12 @@ main(int argc, char **argv)
 	}
 	opterr = 1;
 
+	/*
+	 *  With --batch, only the children forked for each dumpfile return.
+	 */
+	if (pc->batch_jobs)
+		batch_dumpfiles(argv);
+
 	display_version();
 
 	/*
@@ -694,6 +754,7 @@ main(int argc, char **argv)
 	}
 	
 	check_xen_hyper();
+	startup_phase("dumpfile_init");
 
         if (setjmp(pc->main_loop_env))
                 clean_exit(1);
@@ -707,10 +768,14 @@ main(int argc, char **argv)
         mem_init();
        	hq_init();
 	machdep_init(PRE_SYMTAB);
+	startup_phase("pre_symtab_init");
         symtab_init();
+	startup_phase("symtab_init");
+	ikconfig_preload();
 	paravirt_init();
 	machdep_init(PRE_GDB);
         datatype_init();
+	startup_phase("datatype_init");
 
 	/*
 	 *  gdb_main_loop() modifies "command_loop_hook" to point to the 
@@ -732,6 +797,8 @@ main(int argc, char **argv)
 void
 main_loop(void)
 {
+	struct readmem_profile_totals totals;
+
 	if (pc->flags2 & ERASEINFO_DATA)
 		error(WARNING, "\n%s:\n         "
 		    "Kernel data has been erased from this dumpfile.  This may "
@@ -764,7 +831,9 @@ main_loop(void)
 	}
 
         if (!(pc->flags & GDB_INIT)) {
+		startup_phase("gdb_main_loop");
 		gdb_session_init();
+		startup_phase("gdb_session_init");
 		machdep_init(POST_RELOC);
 		show_untrusted_files();
 		kdump_backup_region_init();
@@ -780,15 +849,20 @@ main_loop(void)
 			read_in_kernel_config(IKCFG_INIT);
 			kernel_init();
 			machdep_init(POST_GDB);
+			startup_phase("kernel_init");
         		vm_init();
 			machdep_init(POST_VM);
+			startup_phase("vm_init");
         		module_init();
+			startup_phase("module_init");
         		help_init();
         		task_init();
+			startup_phase("task_init");
         		vfs_init();
 			net_init();
 			dev_init();
 			machdep_init(POST_INIT);
+			startup_phase("vfs_net_dev_init");
 		}
 	} else
 		SIGACTION(SIGINT, restart, &pc->sigaction, NULL);
@@ -816,8 +890,14 @@ main_loop(void)
             error(NOTE, 
 		"minimal mode commands: log, dis, rd, sym, eval, set, extend and exit\n\n");
 
+	startup_phase("display");
+	if (pc->flags2 & STARTUP_TIMING)
+		readmem_profile_stop(&totals);
         pc->flags |= RUNTIME;
 
+	datatype_cache_save();
+	session_cache_save();
+
 	if (pc->flags & PRELOAD_EXTENSIONS)
 		preload_extensions();
 
@@ -853,6 +933,7 @@ exec_command(void)
 {
 	struct command_table_entry *ct;
 	struct args_input_file args_ifile;
+	ulonglong tstart;
 
         if (args[0] && (args[0][0] == '\\') && args[0][1]) {
 		shift_string_left(args[0], 1);
@@ -886,11 +967,22 @@ reattempt:
                 pc->curcmd = ct->name;
 		pc->cmdgencur++;
 
+		memory_limit_check();
+		if (pc->flags2 & READMEM_PROFILE)
+			readmem_profile_start();
+		tstart = TRACING() ? trace_time() : 0;
+
 		if (is_args_input_file(ct, &args_ifile))
 			exec_args_input_file(ct, &args_ifile);
 		else
 			(*ct->func)();
 
+		if (TRACING()) {
+			trace_span("command", ct->name, pc->orig_line, tstart);
+			trace_flush();
+		}
+		readmem_profile_report();
+
                 pc->lastcmd = pc->curcmd;
                 pc->curcmd = pc->program_name;
                 return;
@@ -933,6 +1025,86 @@ reattempt:
 }
 
 
+/*
+ *  Record the wall and CPU time since the previous call as that of the
+ *  named startup phase, along with the readmem() calls and bytes if the
+ *  --timing option is in effect; they are displayed by "help -p", and
+ *  by "bench".  The first call, with a NULL name, only starts the clock.
+ */
+static struct startup_phase startup_phases[MAX_STARTUP_PHASES];
+static int nr_startup_phases;
+
+void
+startup_phase(char *name)
+{
+	static struct timespec mark;
+	static ulonglong cpu_mark;
+	static struct readmem_profile_totals totals_mark;
+	struct timespec now;
+	struct rusage ru;
+	struct readmem_profile_totals totals;
+	struct startup_phase *sp;
+	ulonglong cpu;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	getrusage(RUSAGE_SELF, &ru);
+	cpu = (ulonglong)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000 +
+		ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+	BZERO(&totals, sizeof(struct readmem_profile_totals));
+	if (pc->flags2 & STARTUP_TIMING)
+		readmem_profile_get(&totals);
+
+	if (name && mark.tv_sec && (nr_startup_phases < MAX_STARTUP_PHASES)) {
+		sp = &startup_phases[nr_startup_phases++];
+		sp->name = name;
+		sp->usecs = (ulonglong)(now.tv_sec - mark.tv_sec) * 1000000 +
+			(now.tv_nsec - mark.tv_nsec) / 1000;
+		sp->cpu_usecs = cpu - cpu_mark;
+		sp->reads = totals.reads - totals_mark.reads;
+		sp->bytes = totals.bytes - totals_mark.bytes;
+	}
+
+	mark = now;
+	cpu_mark = cpu;
+	totals_mark = totals;
+}
+
+static void
+dump_startup_phases(void)
+{
+	int i;
+	struct startup_phase *sp;
+	ulonglong usecs, cpu_usecs, bytes;
+	ulong reads;
+
+	fprintf(fp, "\n  startup phases:  %-18s %12s %12s %10s %14s\n",
+		"PHASE", "WALL", "CPU", "READMEMS", "BYTES");
+
+	usecs = cpu_usecs = bytes = 0;
+	reads = 0;
+	for (i = 0; i < nr_startup_phases; i++) {
+		sp = &startup_phases[i];
+		fprintf(fp, "                   %-18s %5lld.%06lld %5lld.%06lld %10ld %14lld\n",
+			sp->name, sp->usecs / 1000000, sp->usecs % 1000000,
+			sp->cpu_usecs / 1000000, sp->cpu_usecs % 1000000,
+			sp->reads, sp->bytes);
+		usecs += sp->usecs;
+		cpu_usecs += sp->cpu_usecs;
+		reads += sp->reads;
+		bytes += sp->bytes;
+	}
+	fprintf(fp, "                   %-18s %5lld.%06lld %5lld.%06lld %10ld %14lld\n",
+		"(total)", usecs / 1000000, usecs % 1000000,
+		cpu_usecs / 1000000, cpu_usecs % 1000000, reads, bytes);
+}
+
+int
+get_startup_phases(struct startup_phase **phases)
+{
+	*phases = startup_phases;
+	return nr_startup_phases;
+}
+
 /*
  *  Find the command_table structure associated with a command name.
  */
@@ -1117,6 +1289,8 @@ setup_environment(int argc, char **argv)
         pc->flags = (HASH|SCROLL);
 	pc->flags |= DATADEBUG;          /* default until unnecessary */
 	pc->flags2 |= REDZONE;
+	pc->flags2 |= DATATYPE_CACHE;
+	pc->flags2 |= PIPE_FILTER;
 	pc->confd = -2;
 	pc->machine_type = MACHINE_TYPE;
 	if (file_readable("/dev/mem")) {     /* defaults until argv[] is parsed */
@@ -1153,8 +1327,10 @@ setup_environment(int argc, char **argv)
 
 	/* 
 	 *  Set up the default scrolling behavior for terminal output.
+	 *  Output is never scrolled when the commands are not coming
+	 *  from a terminal.
 	 */
-	if (isatty(fileno(stdout))) {
+	if (isatty(fileno(stdout)) && isatty(fileno(stdin))) {
 		if (CRASHPAGER_valid()) {
 			pc->flags |= SCROLL;
 			pc->scroll_command = SCROLL_CRASHPAGER;
@@ -1500,6 +1676,26 @@ dump_program_context(void)
 		fprintf(fp, "%sREDZONE", others++ ? "|" : "");
 	if (pc->flags2 & VMWARE_VMSS_GUESTDUMP)
 		fprintf(fp, "%sVMWARE_VMSS_GUESTDUMP", others++ ? "|" : "");
+	if (pc->flags2 & MMAP_DUMPFILE)
+		fprintf(fp, "%sMMAP_DUMPFILE", others++ ? "|" : "");
+	if (pc->flags2 & DATATYPE_CACHE)
+		fprintf(fp, "%sDATATYPE_CACHE", others++ ? "|" : "");
+	if (pc->flags2 & INDEX_CACHE)
+		fprintf(fp, "%sINDEX_CACHE", others++ ? "|" : "");
+	if (pc->flags2 & BTF_TYPES)
+		fprintf(fp, "%sBTF_TYPES", others++ ? "|" : "");
+	if (pc->flags2 & READMEM_PROFILE)
+		fprintf(fp, "%sREADMEM_PROFILE", others++ ? "|" : "");
+	if (pc->flags2 & STARTUP_TIMING)
+		fprintf(fp, "%sSTARTUP_TIMING", others++ ? "|" : "");
+	if (pc->flags2 & TRACE_SPANS)
+		fprintf(fp, "%sTRACE_SPANS", others++ ? "|" : "");
+	if (pc->flags2 & SESSION_CACHE)
+		fprintf(fp, "%sSESSION_CACHE", others++ ? "|" : "");
+	if (pc->flags2 & PIPE_FILTER)
+		fprintf(fp, "%sPIPE_FILTER", others++ ? "|" : "");
+	if (pc->flags2 & BATCH_SESSION)
+		fprintf(fp, "%sBATCH_SESSION", others++ ? "|" : "");
 	fprintf(fp, ")\n");
 
 	fprintf(fp, "         namelist: %s\n", pc->namelist);
@@ -1613,6 +1809,9 @@ dump_program_context(void)
 	if (pc->redirect & REDIRECT_MULTI_PIPE)
 		sprintf(&buf[strlen(buf)], 
 			"%sREDIRECT_MULTI_PIPE", others++ ? "|" : "");
+	if (pc->redirect & REDIRECT_TO_FILTER)
+		sprintf(&buf[strlen(buf)],
+			"%sREDIRECT_TO_FILTER", others++ ? "|" : "");
 	if (pc->redirect)
 		strcat(buf, ")");
 
@@ -1746,6 +1945,18 @@ dump_program_context(void)
 	fprintf(fp, "  read_vmcoreinfo: %lx\n", (ulong)pc->read_vmcoreinfo);
 	fprintf(fp, "         error_fp: %lx\n", (ulong)pc->error_fp);
 	fprintf(fp, "       error_path: %s\n", pc->error_path);
+	fprintf(fp, "  index_cache_dir: %s\n", pc->index_cache_dir ?
+		pc->index_cache_dir : "(default)");
+	fprintf(fp, "       batch_jobs: %d\n", pc->batch_jobs);
+	fprintf(fp, "     batch_output: %s\n", pc->batch_output ?
+		pc->batch_output : "(unused)");
+	if (pc->flags2 & SESSION_CACHE)
+		dump_session_cache();
+
+	if (pc->flags2 & STARTUP_TIMING) {
+		dump_startup_phases();
+		dump_kaslr_steps();
+	}
 }
 
 char *
@@ -1839,6 +2050,9 @@ dump_build_data(void)
 int 
 clean_exit(int status)
 {
+	if (machdep->cache_save)
+		machdep->cache_save();
+
 	if (pc->flags & MEMMOD)
 		cleanup_memory_driver();
 
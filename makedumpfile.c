@@ -37,10 +37,21 @@ struct all_flat_data {
 	unsigned long long	num_array;
 	struct flat_data	*array;
 	size_t			file_size;
+	char			*index_file;
+	char			*index_state;
 };
 
 struct all_flat_data afd;
 
+/*
+ *  "set mmap on" mapping of the flattened dumpfile.
+ */
+static struct flat_mapping {
+	int fd;
+	char *addr;
+	off_t size;
+} flat_map = { -1, NULL, 0 };
+
 struct makedumpfile_header fh_save;
 
 static int
@@ -54,6 +65,147 @@ is_bigendian(void)
 		return FALSE;
 }
 
+/*
+ *  Load the flat_data array from the sidecar index of a flattened dumpfile,
+ *  provided that it was created for this dumpfile as it is now.
+ */
+static int
+read_flat_index(struct stat64 *dstat, char *index_file)
+{
+	int fd;
+	size_t size;
+	unsigned long long i;
+	struct stat64 istat;
+	struct flat_index_header fih;
+	struct flat_data *array;
+
+	if ((fd = open(index_file, O_RDONLY)) < 0)
+		return FALSE;
+
+	array = NULL;
+	if (fstat64(fd, &istat) < 0)
+		goto bailout;
+	if (read(fd, &fih, sizeof(fih)) != sizeof(fih))
+		goto bailout;
+
+	if (memcmp(fih.signature, FLAT_INDEX_SIGNATURE,
+	    sizeof(fih.signature)) ||
+	    (fih.version != FLAT_INDEX_VERSION) ||
+	    (fih.byte_order != FLAT_INDEX_BYTE_ORDER) ||
+	    (fih.entry_size != sizeof(struct flat_data))) {
+		if (CRASHDEBUG(1))
+			error(INFO, "%s: unrecognized flat format index\n",
+				index_file);
+		goto bailout;
+	}
+
+	if ((fih.file_size != dstat->st_size) ||
+	    (fih.mtime_sec != dstat->st_mtim.tv_sec) ||
+	    (fih.mtime_nsec != dstat->st_mtim.tv_nsec)) {
+		if (CRASHDEBUG(1))
+			error(INFO, "%s: stale flat format index\n", index_file);
+		goto bailout;
+	}
+
+	if (!fih.num_array ||
+	    (fih.num_array > (istat.st_size / sizeof(struct flat_data))) ||
+	    (istat.st_size != sizeof(fih) +
+	    (fih.num_array * sizeof(struct flat_data))))
+		goto bailout;
+
+	size = fih.num_array * sizeof(struct flat_data);
+	if ((array = malloc(size)) == NULL)
+		goto bailout;
+	if (read(fd, array, size) != size)
+		goto bailout;
+
+	for (i = 0; i < fih.num_array; i++) {
+		if ((array[i].off_flattened < MAX_SIZE_MDF_HEADER) ||
+		    (array[i].buf_size < 0) ||
+		    (array[i].off_flattened + array[i].buf_size >
+		    dstat->st_size) ||
+		    (i && (array[i].off_rearranged <
+		    array[i-1].off_rearranged))) {
+			if (CRASHDEBUG(1))
+				error(INFO, "%s: invalid flat format index\n",
+					index_file);
+			goto bailout;
+		}
+	}
+
+	close(fd);
+
+	afd.num_array = fih.num_array;
+	afd.array = array;
+
+	return TRUE;
+
+bailout:
+	free(array);
+	close(fd);
+	return FALSE;
+}
+
+/*
+ *  Save the flat_data array built by store_flat_data_array() in the sidecar
+ *  index file.  It is written to a temporary file that is then renamed, so
+ *  that an interrupted session cannot leave a truncated index behind.
+ *  Failure is not an error; the dumpfile directory may well be read-only.
+ */
+static void
+write_flat_index(struct stat64 *dstat, char *index_file)
+{
+	int fd;
+	size_t size;
+	char *tmpfile;
+	struct flat_index_header fih;
+
+	if ((tmpfile = malloc(strlen(index_file) + strlen(".XXXXXX") + 1)) == NULL)
+		return;
+	sprintf(tmpfile, "%s.XXXXXX", index_file);
+
+	if ((fd = mkstemp(tmpfile)) < 0) {
+		if (CRASHDEBUG(1))
+			error(INFO, "cannot create flat format index %s: %s\n",
+				index_file, strerror(errno));
+		free(tmpfile);
+		return;
+	}
+
+	BZERO(&fih, sizeof(fih));
+	memcpy(fih.signature, FLAT_INDEX_SIGNATURE, sizeof(fih.signature));
+	fih.version = FLAT_INDEX_VERSION;
+	fih.byte_order = FLAT_INDEX_BYTE_ORDER;
+	fih.entry_size = sizeof(struct flat_data);
+	fih.file_size = dstat->st_size;
+	fih.mtime_sec = dstat->st_mtim.tv_sec;
+	fih.mtime_nsec = dstat->st_mtim.tv_nsec;
+	fih.num_array = afd.num_array;
+
+	size = afd.num_array * sizeof(struct flat_data);
+
+	if ((write(fd, &fih, sizeof(fih)) != sizeof(fih)) ||
+	    (write(fd, afd.array, size) != size) ||
+	    (fchmod(fd, 0644) < 0)) {
+		close(fd);
+		goto bailout;
+	}
+	if ((close(fd) < 0) || (rename(tmpfile, index_file) < 0))
+		goto bailout;
+
+	afd.index_state = "written";
+	free(tmpfile);
+	return;
+
+bailout:
+	if (CRASHDEBUG(1))
+		error(INFO, "cannot write flat format index %s: %s\n",
+			index_file, strerror(errno));
+	unlink(tmpfile);
+
+	free(tmpfile);
+}
+
 static unsigned long long
 store_flat_data_array(char *file, struct flat_data **fda)
 {
@@ -182,14 +334,39 @@ read_all_makedumpfile_data_header(char *file)
 	unsigned long long	num;
 	struct flat_data	*fda = NULL;
 	long long retval;
+	struct stat64		stat;
+	char			*index_file;
+
+	index_file = NULL;
+	if ((stat64(file, &stat) == 0) &&
+	    (index_file = malloc(strlen(file) + strlen(FLAT_INDEX_SUFFIX) + 1))) {
+		sprintf(index_file, "%s%s", file, FLAT_INDEX_SUFFIX);
+		if (read_flat_index(&stat, index_file)) {
+			afd.index_file = index_file;
+			afd.index_state = "loaded";
+			if (CRASHDEBUG(1))
+				fprintf(fp, "%s: using flat format index %s\n",
+					file, index_file);
+			return TRUE;
+		}
+	}
 
 	retval = num = store_flat_data_array(file, &fda);
-	if (retval < 0)
+	if (retval < 0) {
+		free(index_file);
 		return FALSE;
+	}
 
 	afd.num_array = num;
 	afd.array     = fda;
 
+	if (index_file) {
+		afd.index_file = index_file;
+		afd.index_state = "not written";
+		if (num)
+			write_flat_index(&stat, index_file);
+	}
+
 	return TRUE;
 }
 
@@ -256,6 +433,19 @@ out:
 static int
 read_raw_dump_file(int fd, off_t offset, void *buf, size_t size)
 {
+	if (pc->flags2 & MMAP_DUMPFILE) {
+		if (flat_map.fd != fd) {
+			if (flat_map.addr)
+				munmap(flat_map.addr, flat_map.size);
+			flat_map.addr = mmap_dumpfile(fd, &flat_map.size);
+			flat_map.fd = fd;
+		}
+		if (flat_map.addr && (offset + size <= flat_map.size)) {
+			memcpy(buf, flat_map.addr + offset, size);
+			return TRUE;
+		}
+	}
+
 	if (lseek(fd, offset, SEEK_SET) < 0) {
 		if (CRASHDEBUG(1))
 			error(INFO, "read_raw_dump_file: lseek error (flat format)\n");
@@ -270,71 +460,70 @@ read_raw_dump_file(int fd, off_t offset, void *buf, size_t size)
 	return TRUE;
 }
 
+/*
+ *  Return the number of flat_data entries whose rearranged offset is
+ *  less than or equal to offset; the entry that may contain offset is
+ *  the one just below the returned index.
+ */
+static unsigned long long
+flat_data_upper_bound(off_t offset)
+{
+	unsigned long long lo, hi, mid;
+
+	lo = 0;
+	hi = afd.num_array;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (afd.array[mid].off_rearranged <= offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
 int
 read_flattened_format(int fd, off_t offset, void *buf, size_t size)
 {
-	unsigned long long	index, index_start, index_end;
+	unsigned long long	index;
 	int64_t			range_start, range_end;
-	size_t			read_size, remain_size;
+	size_t			read_size;
 	off_t			offset_read;
 	struct flat_data	*ptr;
 
-	index_start = 0;
-	index_end   = afd.num_array;
-
-	while (1) {
-		index = (index_start + index_end) / 2;
-		ptr = afd.array + index;
-		range_start = ptr->off_rearranged;
-		range_end   = ptr->off_rearranged + ptr->buf_size;
+	while (size) {
+		index = flat_data_upper_bound(offset);
+		ptr = index ? afd.array + index - 1 : NULL;
 
-		if ((range_start <= offset) && (offset < range_end)) {
+		if (ptr && (offset < ptr->off_rearranged + ptr->buf_size)) {
 			/* Found a corresponding array. */
+			range_start = ptr->off_rearranged;
+			range_end   = ptr->off_rearranged + ptr->buf_size;
 			offset_read = (offset - range_start) + ptr->off_flattened;
-
-			if (offset + size <= range_end) {
-				if (!read_raw_dump_file(fd, offset_read, buf, size))
-					return FALSE;
-				break;
-			}
-
-			/* Searh other array corresponding to remaining data. */
-			read_size   = range_end - offset;
-			remain_size = size - read_size;
+			read_size   = MIN(size, range_end - offset);
 			if (!read_raw_dump_file(fd, offset_read, buf, read_size))
 				return FALSE;
-			if (!read_flattened_format(fd, offset + read_size,
-					(char *)buf + read_size, remain_size))
-				return FALSE;
-			break;
-
-		} else if ((index == index_start) &&
-			   (index_start + 1 == index_end)) {
+		} else {
 			/*
 			 * Try to read not-written area. That is a common case,
 			 * because the area might be skipped by lseek().
-			 * This area should be the data filled with zero.
+			 * This area should be the data filled with zero,
+			 * up to the start of the next array, if any.
 			 */
-			ptr = afd.array + index_end;
-			if (offset + size <= ptr->off_rearranged) {
-				memset(buf, 0x0, size);
-			} else {
-				read_size   = ptr->off_rearranged - offset;
-				remain_size = size - read_size;
-				memset(buf, 0x0, read_size);
-				if (!read_flattened_format(fd,
-						offset + read_size,
-						(char *)buf + read_size,
-						remain_size))
-					return FALSE;
-			}
-			break;
+			if (index < afd.num_array)
+				read_size = MIN(size,
+					afd.array[index].off_rearranged - offset);
+			else
+				read_size = size;
+			memset(buf, 0x0, read_size);
+		}
 
-		} else if (offset < ptr->off_rearranged)
-			index_end   = index;
-		else
-			index_start = index;
+		offset += read_size;
+		buf = (char *)buf + read_size;
+		size -= read_size;
 	}
+
 	return TRUE;
 }
 
@@ -364,7 +553,10 @@ dump_flat_header(FILE *ofp)
 	fprintf(ofp, "      all_flat_data:\n");
 	fprintf(ofp, "          num_array: %lld\n", (ulonglong)afd.num_array);
 	fprintf(ofp, "              array: %lx\n", (ulong)afd.array);
-	fprintf(ofp, "          file_size: %ld\n\n", (ulong)afd.file_size);
+	fprintf(ofp, "          file_size: %ld\n", (ulong)afd.file_size);
+	fprintf(ofp, "         index_file: %s (%s)\n\n",
+		afd.index_file ? afd.index_file : "(none)",
+		afd.index_state ? afd.index_state : "not used");
 }
 
 static void 
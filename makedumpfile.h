@@ -44,3 +44,26 @@ struct makedumpfile_data_header {
 	int64_t buf_size;
 };
 
+/*
+ *  Sidecar index file written next to a flattened dumpfile, containing
+ *  the sorted flat_data array so that later sessions need not scan the
+ *  whole dumpfile.  It is stored in host byte order, and is only used if
+ *  the dumpfile's size and modification time still match.
+ */
+#define FLAT_INDEX_SUFFIX	".flatidx"
+#define FLAT_INDEX_SIGNATURE	"crashfdx"
+#define FLAT_INDEX_VERSION	(1)
+#define FLAT_INDEX_BYTE_ORDER	(0x12345678)
+
+struct flat_index_header {
+	char     signature[8];		/* = "crashfdx" */
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t entry_size;		/* sizeof(struct flat_data) */
+	uint32_t pad;
+	int64_t  file_size;		/* of the dumpfile */
+	int64_t  mtime_sec;
+	int64_t  mtime_nsec;
+	uint64_t num_array;
+};
+
@@ -0,0 +1,746 @@
+/* memcg.c - core analysis suite
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "defs.h"
+
+/*
+ *  The memcg command walks the memory cgroup hierarchy from
+ *  root_mem_cgroup, one do_list() of each cgroup_subsys_state's
+ *  children at a time, and reads each mem_cgroup once.  Its usage comes
+ *  from its page_counters, and its memory.stat counters from the
+ *  flushed vmstats array plus the per-cpu counts that have not been
+ *  flushed yet, which are read for all cpus at once by percpu_gather().
+ *
+ *  The layout of the statistics has changed many times, so each field
+ *  is found by the names of the enumerators that have indexed it, and
+ *  on kernels that only track a subset of the node_stat_item and
+ *  memcg_stat_item counters, by way of mem_cgroup_stats_index[].
+ */
+#define MEMCG_DEFAULT_COUNT	(20)
+#define MEMCG_MAX_DEPTH		(64)
+
+#define MCG_USAGE	(0)
+#define MCG_SWAP	(1)
+#define MCG_ANON	(2)
+#define MCG_FILE	(3)
+#define MCG_SHMEM	(4)
+#define MCG_SLAB	(5)
+#define MCG_FIELDS	(6)
+
+static char *memcg_field_names[MCG_FIELDS] = {
+	"usage", "swap", "anon", "file", "shmem", "slab"
+};
+
+/*
+ *  The counters summed into each field, by the enumerator names that
+ *  have been used for them, oldest first.  Names starting with "NR_"
+ *  are node_stat_item values, which memcgs did not use before the
+ *  MEM_CGROUP_STAT_ enumerators were removed.
+ */
+static struct memcg_stat {
+	int field;
+	int bytes;
+	char *names[4];
+	long index;
+} memcg_stats[] = {
+	{ MCG_ANON,   FALSE, { "MEM_CGROUP_STAT_RSS", "MEMCG_RSS", "NR_ANON_MAPPED" } },
+	{ MCG_FILE,   FALSE, { "MEM_CGROUP_STAT_CACHE", "MEMCG_CACHE", "NR_FILE_PAGES" } },
+	{ MCG_SHMEM,  FALSE, { "MEM_CGROUP_STAT_SHMEM", "NR_SHMEM" } },
+	{ MCG_SLAB,   TRUE,  { "NR_SLAB_RECLAIMABLE_B" } },
+	{ MCG_SLAB,   TRUE,  { "NR_SLAB_UNRECLAIMABLE_B" } },
+	{ MCG_SLAB,   FALSE, { "NR_SLAB_RECLAIMABLE" } },
+	{ MCG_SLAB,   FALSE, { "NR_SLAB_UNRECLAIMABLE" } },
+};
+#define MEMCG_STATS	(sizeof(memcg_stats)/sizeof(struct memcg_stat))
+
+#define MEMCG_VMSTATS_PTR	(0x1)	/* flushed counters in memcg_vmstats */
+#define MEMCG_VMSTATS_ARRAY	(0x2)	/* flushed counters in mem_cgroup */
+#define MEMCG_PERCPU		(0x4)	/* per-cpu counters */
+#define MEMCG_PERCPU_PREV	(0x8)	/* with their values as of the last flush */
+#define MEMCG_LRU		(0x10)	/* mem_cgroup_per_node.lru_zone_size */
+
+static struct memcg_table {
+	int flags;
+	int initialized;
+	long state_offset;		/* of the flushed counters */
+	long lo;			/* span of the counters needed */
+	long hi;
+	long nr_lru_lists;
+	long nr_zones;
+	long lru[5];			/* enum lru_list values */
+	char *percpu_state;		/* percpu_gather() buffers */
+	char *percpu_prev;
+	long *state;
+} memcg_table = { 0 };
+
+static struct memcg_table *mt = &memcg_table;
+
+struct memcg_info {
+	ulong memcg;
+	ulong css;
+	ulong max;
+	int depth;
+	ulong value[MCG_FIELDS];	/* in pages */
+};
+
+static void memcg_init(void);
+static long memcg_stat_index(int);
+static int memcg_read(struct memcg_info *, char *);
+static ulong *memcg_children(struct memcg_info *, char *, int *);
+static int memcg_compare(const void *, const void *);
+static char *memcg_path(ulong, char *);
+static void memcg_show(struct memcg_info *, int);
+static void memcg_show_nodes(struct memcg_info *);
+
+static int memcg_sort_field;
+
+/*
+ *  Display the memory usage of the memory cgroups, largest first.
+ */
+void
+cmd_memcg(void)
+{
+	int c, i, j, cnt, count, nodes, max, nchildren;
+	ulong root, value, *children;
+	char *memcg_buf;
+	struct memcg_info *mi, *new;
+
+	count = MEMCG_DEFAULT_COUNT;
+	memcg_sort_field = MCG_USAGE;
+	nodes = FALSE;
+
+	while ((c = getopt(argcnt, args, "n:s:N")) != EOF) {
+		switch(c)
+		{
+		case 'n':
+			count = dtoi(optarg, FAULT_ON_ERROR, NULL);
+			break;
+
+		case 's':
+			for (i = 0; i < MCG_FIELDS; i++) {
+				if (STREQ(optarg, memcg_field_names[i]))
+					break;
+			}
+			if (i == MCG_FIELDS)
+				error(FATAL, "invalid sort field: %s\n", optarg);
+			memcg_sort_field = i;
+			break;
+
+		case 'N':
+			nodes = TRUE;
+			break;
+
+		default:
+			argerrs++;
+			break;
+		}
+	}
+
+	if (argerrs)
+		cmd_usage(pc->curcmd, SYNOPSIS);
+
+	memcg_init();
+
+	memcg_buf = GETBUF(SIZE(mem_cgroup));
+
+	if (args[optind]) {
+		for (cnt = 0; args[optind]; optind++) {
+			value = htol(args[optind], FAULT_ON_ERROR, NULL);
+			mi = (struct memcg_info *)GETBUF(sizeof(struct memcg_info));
+			mi->memcg = value;
+			if (!memcg_read(mi, memcg_buf))
+				error(FATAL, "cannot read mem_cgroup at %lx\n",
+					value);
+			memcg_show(mi, cnt++ == 0);
+			if (nodes)
+				memcg_show_nodes(mi);
+			FREEBUF(mi);
+		}
+		FREEBUF(memcg_buf);
+		return;
+	}
+
+	if (!symbol_exists("root_mem_cgroup"))
+		error(FATAL, "root_mem_cgroup does not exist in this kernel\n");
+	get_symbol_data("root_mem_cgroup", sizeof(ulong), &root);
+	if (!root)
+		error(FATAL, "memory cgroups are not enabled\n");
+
+	/*
+	 *  Breadth-first, so that the children of each memcg are gathered
+	 *  as it is reached.
+	 */
+	max = 1024;
+	mi = (struct memcg_info *)GETBUF(sizeof(struct memcg_info) * max);
+	mi[0].memcg = root;
+	for (i = 0, cnt = 1; i < cnt; i++) {
+		if (!memcg_read(&mi[i], memcg_buf)) {
+			error(INFO, "cannot read mem_cgroup at %lx\n",
+				mi[i].memcg);
+			mi[i].memcg = 0;
+			continue;
+		}
+		if (mi[i].depth >= MEMCG_MAX_DEPTH)
+			continue;
+
+		if (!(children = memcg_children(&mi[i], memcg_buf, &nchildren)))
+			continue;
+		if ((cnt + nchildren) > max) {
+			while ((cnt + nchildren) > max)
+				max *= 2;
+			new = (struct memcg_info *)
+				GETBUF(sizeof(struct memcg_info) * max);
+			BCOPY(mi, new, sizeof(struct memcg_info) * cnt);
+			FREEBUF(mi);
+			mi = new;
+		}
+		for (j = 0; j < nchildren; j++, cnt++) {
+			mi[cnt].css = children[j];
+			mi[cnt].memcg = children[j] - OFFSET(mem_cgroup_css);
+			mi[cnt].depth = mi[i].depth + 1;
+		}
+		FREEBUF(children);
+	}
+
+	qsort(mi, cnt, sizeof(struct memcg_info), memcg_compare);
+
+	for (i = j = 0; (i < cnt) && (!count || (j < count)); i++) {
+		if (!mi[i].memcg)
+			continue;
+		memcg_show(&mi[i], j++ == 0);
+		if (nodes)
+			memcg_show_nodes(&mi[i]);
+	}
+
+	for (i = j = 0; i < cnt; i++) {
+		if (mi[i].memcg)
+			j++;
+	}
+	fprintf(fp, "\n%d memory cgroup%s", j, j == 1 ? "" : "s");
+	if (count && (count < j))
+		fprintf(fp, ", the %d largest by %s shown", count,
+			memcg_field_names[memcg_sort_field]);
+	fprintf(fp, "\n");
+
+	FREEBUF(mi);
+	FREEBUF(memcg_buf);
+}
+
+/*
+ *  Find the offsets and the statistics layout once.
+ */
+static void
+memcg_init(void)
+{
+	int i;
+	long nstats, type, idx;
+	char *lru_names[] = { "LRU_INACTIVE_ANON", "LRU_ACTIVE_ANON",
+		"LRU_INACTIVE_FILE", "LRU_ACTIVE_FILE", "LRU_UNEVICTABLE" };
+
+	if (mt->initialized)
+		return;
+
+	STRUCT_SIZE_INIT(mem_cgroup, "mem_cgroup");
+	if (!VALID_STRUCT(mem_cgroup))
+		error(FATAL, "memory cgroups are not supported by this kernel\n");
+
+	MEMBER_OFFSET_INIT(mem_cgroup_css, "mem_cgroup", "css");
+	MEMBER_OFFSET_INIT(mem_cgroup_memory, "mem_cgroup", "memory");
+	MEMBER_OFFSET_INIT(mem_cgroup_swap, "mem_cgroup", "swap");
+	MEMBER_OFFSET_INIT(mem_cgroup_memsw, "mem_cgroup", "memsw");
+	MEMBER_OFFSET_INIT(mem_cgroup_nodeinfo, "mem_cgroup", "nodeinfo");
+	MEMBER_OFFSET_INIT(page_counter_usage, "page_counter", "usage");
+	MEMBER_OFFSET_INIT(page_counter_max, "page_counter", "max");
+	if (INVALID_MEMBER(page_counter_max))
+		MEMBER_OFFSET_INIT(page_counter_max, "page_counter", "limit");
+	MEMBER_OFFSET_INIT(cgroup_subsys_state_children,
+		"cgroup_subsys_state", "children");
+	MEMBER_OFFSET_INIT(cgroup_subsys_state_sibling,
+		"cgroup_subsys_state", "sibling");
+	MEMBER_OFFSET_INIT(cgroup_subsys_state_cgroup,
+		"cgroup_subsys_state", "cgroup");
+	MEMBER_OFFSET_INIT(cgroup_kn, "cgroup", "kn");
+	MEMBER_OFFSET_INIT(cgroup_dentry, "cgroup", "dentry");
+	MEMBER_OFFSET_INIT(kernfs_node_name, "kernfs_node", "name");
+	MEMBER_OFFSET_INIT(kernfs_node_parent, "kernfs_node", "parent");
+	if (INVALID_MEMBER(kernfs_node_parent))
+		MEMBER_OFFSET_INIT(kernfs_node_parent, "kernfs_node", "__parent");
+
+	if (INVALID_MEMBER(mem_cgroup_css) || INVALID_MEMBER(mem_cgroup_memory) ||
+	    INVALID_MEMBER(page_counter_usage) ||
+	    INVALID_MEMBER(cgroup_subsys_state_children) ||
+	    INVALID_MEMBER(cgroup_subsys_state_sibling))
+		error(FATAL, "memory cgroup page counters not found\n");
+
+	/*
+	 *  The flushed counters.
+	 */
+	nstats = 0;
+	if (MEMBER_EXISTS("mem_cgroup", "vmstats")) {
+		MEMBER_OFFSET_INIT(mem_cgroup_vmstats, "mem_cgroup", "vmstats");
+		type = MEMBER_TYPE("mem_cgroup", "vmstats");
+		if (type == TYPE_CODE_ARRAY) {
+			MEMBER_SIZE_INIT(memcg_vmstats_state, "mem_cgroup",
+				"vmstats");
+			mt->flags |= MEMCG_VMSTATS_ARRAY;
+			mt->state_offset = OFFSET(mem_cgroup_vmstats);
+		} else {
+			MEMBER_OFFSET_INIT(memcg_vmstats_state, "memcg_vmstats",
+				"state");
+			MEMBER_SIZE_INIT(memcg_vmstats_state, "memcg_vmstats",
+				"state");
+			if (VALID_MEMBER(memcg_vmstats_state) &&
+			    (type == TYPE_CODE_PTR)) {
+				mt->flags |= MEMCG_VMSTATS_PTR;
+				mt->state_offset = OFFSET(memcg_vmstats_state);
+			} else if (VALID_MEMBER(memcg_vmstats_state)) {
+				mt->flags |= MEMCG_VMSTATS_ARRAY;
+				mt->state_offset = OFFSET(mem_cgroup_vmstats) +
+					OFFSET(memcg_vmstats_state);
+			}
+		}
+	} else if (MEMBER_EXISTS("mem_cgroup", "stat") &&
+	    (MEMBER_TYPE("mem_cgroup", "stat") == TYPE_CODE_ARRAY)) {
+		MEMBER_OFFSET_INIT(mem_cgroup_vmstats, "mem_cgroup", "stat");
+		MEMBER_SIZE_INIT(memcg_vmstats_state, "mem_cgroup", "stat");
+		mt->flags |= MEMCG_VMSTATS_ARRAY;
+		mt->state_offset = OFFSET(mem_cgroup_vmstats);
+	}
+	if (mt->flags & (MEMCG_VMSTATS_PTR|MEMCG_VMSTATS_ARRAY))
+		nstats = SIZE(memcg_vmstats_state) / sizeof(long);
+
+	/*
+	 *  The per-cpu counters, which on the oldest kernels are the only
+	 *  counters, and otherwise hold what has not been flushed.
+	 */
+	if (MEMBER_EXISTS("mem_cgroup", "vmstats_percpu")) {
+		MEMBER_OFFSET_INIT(mem_cgroup_vmstats_percpu, "mem_cgroup",
+			"vmstats_percpu");
+		MEMBER_OFFSET_INIT(memcg_vmstats_percpu_state,
+			"memcg_vmstats_percpu", "state");
+		MEMBER_SIZE_INIT(memcg_vmstats_percpu_state,
+			"memcg_vmstats_percpu", "state");
+		if (INVALID_MEMBER(memcg_vmstats_percpu_state)) {
+			MEMBER_OFFSET_INIT(memcg_vmstats_percpu_state,
+				"memcg_vmstats_percpu", "stat");
+			MEMBER_SIZE_INIT(memcg_vmstats_percpu_state,
+				"memcg_vmstats_percpu", "stat");
+		}
+		MEMBER_OFFSET_INIT(memcg_vmstats_percpu_state_prev,
+			"memcg_vmstats_percpu", "state_prev");
+	} else {
+		if (MEMBER_EXISTS("mem_cgroup", "stat_cpu"))
+			MEMBER_OFFSET_INIT(mem_cgroup_vmstats_percpu,
+				"mem_cgroup", "stat_cpu");
+		else if (MEMBER_EXISTS("mem_cgroup", "stat") &&
+		    (MEMBER_TYPE("mem_cgroup", "stat") == TYPE_CODE_PTR))
+			MEMBER_OFFSET_INIT(mem_cgroup_vmstats_percpu,
+				"mem_cgroup", "stat");
+		MEMBER_OFFSET_INIT(memcg_vmstats_percpu_state,
+			"mem_cgroup_stat_cpu", "count");
+		MEMBER_SIZE_INIT(memcg_vmstats_percpu_state,
+			"mem_cgroup_stat_cpu", "count");
+	}
+	if (VALID_MEMBER(mem_cgroup_vmstats_percpu) &&
+	    VALID_MEMBER(memcg_vmstats_percpu_state)) {
+		mt->flags |= MEMCG_PERCPU;
+		if (VALID_MEMBER(memcg_vmstats_percpu_state_prev))
+			mt->flags |= MEMCG_PERCPU_PREV;
+		if (!nstats)
+			nstats = SIZE(memcg_vmstats_percpu_state) / sizeof(long);
+		else
+			nstats = MIN(nstats,
+				SIZE(memcg_vmstats_percpu_state) / sizeof(long));
+	}
+
+	mt->lo = nstats;
+	mt->hi = -1;
+	for (i = 0; i < MEMCG_STATS; i++) {
+		memcg_stats[i].index = -1;
+		if (!nstats)
+			continue;
+		idx = memcg_stat_index(i);
+		if ((idx < 0) || (idx >= nstats))
+			continue;
+		memcg_stats[i].index = idx;
+		mt->lo = MIN(mt->lo, idx);
+		mt->hi = MAX(mt->hi, idx);
+	}
+
+	if (mt->hi >= mt->lo) {
+		mt->state = (long *)malloc(sizeof(long) * (mt->hi - mt->lo + 1));
+		if (mt->flags & MEMCG_PERCPU) {
+			mt->percpu_state = malloc(sizeof(long) *
+				(mt->hi - mt->lo + 1) * kt->cpus);
+			mt->percpu_prev = malloc(sizeof(long) *
+				(mt->hi - mt->lo + 1) * kt->cpus);
+		}
+		if (!mt->state || ((mt->flags & MEMCG_PERCPU) &&
+		    (!mt->percpu_state || !mt->percpu_prev)))
+			error(FATAL, "cannot malloc memcg statistics buffers\n");
+	}
+
+	/*
+	 *  The LRU sizes of each node.
+	 */
+	MEMBER_OFFSET_INIT(mem_cgroup_per_node_lru_zone_size,
+		"mem_cgroup_per_node", "lru_zone_size");
+	MEMBER_SIZE_INIT(mem_cgroup_per_node_lru_zone_size,
+		"mem_cgroup_per_node", "lru_zone_size");
+	if (VALID_MEMBER(mem_cgroup_nodeinfo) &&
+	    VALID_MEMBER(mem_cgroup_per_node_lru_zone_size) &&
+	    enumerator_value("NR_LRU_LISTS", &mt->nr_lru_lists) &&
+	    (mt->nr_lru_lists > 0)) {
+		mt->nr_zones = SIZE(mem_cgroup_per_node_lru_zone_size) /
+			(sizeof(ulong) * mt->nr_lru_lists);
+		for (i = 0; i < 5; i++) {
+			if (!enumerator_value(lru_names[i], &mt->lru[i]) ||
+			    (mt->lru[i] >= mt->nr_lru_lists))
+				mt->lru[i] = -1;
+		}
+		if (mt->nr_zones > 0)
+			mt->flags |= MEMCG_LRU;
+	}
+
+	mt->initialized = TRUE;
+}
+
+/*
+ *  Return the index into the memcg counters of memcg_stats[stat], or -1
+ *  if this kernel does not count it.
+ */
+static long
+memcg_stat_index(int stat)
+{
+	int i, old;
+	long item, nr_items, idx;
+	unsigned char map;
+	struct syment *sp;
+	char *name;
+
+	old = enumerator_value("MEM_CGROUP_STAT_CACHE", &item);
+
+	for (i = 0; (i < 4) && (name = memcg_stats[stat].names[i]); i++) {
+		if (old && STRNEQ(name, "NR_"))
+			continue;
+		if (enumerator_value(name, &item))
+			break;
+	}
+	if ((i == 4) || !name)
+		return -1;
+
+	/*
+	 *  Kernels that count only the node_stat_item and memcg_stat_item
+	 *  values that memcgs use map them to their counters.
+	 */
+	idx = item;
+	if ((sp = symbol_search("mem_cgroup_stats_index"))) {
+		if (!enumerator_value("MEMCG_NR_STAT", &nr_items) ||
+		    (item >= nr_items) ||
+		    !readmem(sp->value + item, KVADDR, &map, sizeof(map),
+		    "mem_cgroup_stats_index", RETURN_ON_ERROR|QUIET) ||
+		    (map == 0xff))
+			return -1;
+		idx = map;
+	}
+
+	return idx;
+}
+
+/*
+ *  Read a mem_cgroup and fill in its memcg_info.  The counters of
+ *  memory.stat are the flushed values plus what each cpu has counted
+ *  since, so they are as current as the counters themselves.
+ */
+static int
+memcg_read(struct memcg_info *mi, char *memcg_buf)
+{
+	int i, cpu;
+	long n, value, *state, *prev;
+	ulong vmstats, percpu, usage, memsw;
+	struct memcg_stat *ms;
+
+	if (!readmem(mi->memcg, KVADDR, memcg_buf, SIZE(mem_cgroup),
+	    "mem_cgroup", RETURN_ON_ERROR|QUIET))
+		return FALSE;
+
+	mi->css = mi->memcg + OFFSET(mem_cgroup_css);
+	BZERO(mi->value, sizeof(mi->value));
+
+	usage = ULONG(memcg_buf + OFFSET(mem_cgroup_memory) +
+		OFFSET(page_counter_usage));
+	mi->value[MCG_USAGE] = usage;
+	mi->max = VALID_MEMBER(page_counter_max) ?
+		ULONG(memcg_buf + OFFSET(mem_cgroup_memory) +
+		OFFSET(page_counter_max)) : (ulong)(-1);
+
+	/*
+	 *  The swap counter is only charged on the default hierarchy, and
+	 *  memsw, memory plus swap, only on the legacy hierarchy.
+	 */
+	if (VALID_MEMBER(mem_cgroup_swap))
+		mi->value[MCG_SWAP] = ULONG(memcg_buf +
+			OFFSET(mem_cgroup_swap) + OFFSET(page_counter_usage));
+	if (!mi->value[MCG_SWAP] && VALID_MEMBER(mem_cgroup_memsw)) {
+		memsw = ULONG(memcg_buf + OFFSET(mem_cgroup_memsw) +
+			OFFSET(page_counter_usage));
+		if (memsw > usage)
+			mi->value[MCG_SWAP] = memsw - usage;
+	}
+
+	if (mt->hi < mt->lo)
+		return TRUE;
+
+	n = mt->hi - mt->lo + 1;
+	state = mt->state;
+	BZERO(state, sizeof(long) * n);
+
+	if (mt->flags & MEMCG_VMSTATS_PTR) {
+		vmstats = ULONG(memcg_buf + OFFSET(mem_cgroup_vmstats));
+		if (vmstats && !readmem(vmstats + mt->state_offset +
+		    (mt->lo * sizeof(long)), KVADDR, state, sizeof(long) * n,
+		    "memcg_vmstats state", RETURN_ON_ERROR|QUIET))
+			BZERO(state, sizeof(long) * n);
+	} else if (mt->flags & MEMCG_VMSTATS_ARRAY)
+		BCOPY(memcg_buf + mt->state_offset + (mt->lo * sizeof(long)),
+			state, sizeof(long) * n);
+
+	if ((mt->flags & MEMCG_PERCPU) &&
+	    (percpu = ULONG(memcg_buf + OFFSET(mem_cgroup_vmstats_percpu)))) {
+		percpu_gather(percpu + OFFSET(memcg_vmstats_percpu_state) +
+			(mt->lo * sizeof(long)), sizeof(long) * n,
+			mt->percpu_state, RETURN_ON_ERROR|QUIET);
+		if (mt->flags & MEMCG_PERCPU_PREV)
+			percpu_gather(percpu +
+				OFFSET(memcg_vmstats_percpu_state_prev) +
+				(mt->lo * sizeof(long)), sizeof(long) * n,
+				mt->percpu_prev, RETURN_ON_ERROR|QUIET);
+		else
+			BZERO(mt->percpu_prev, sizeof(long) * n * kt->cpus);
+
+		for (cpu = 0; cpu < kt->cpus; cpu++) {
+			value = cpu * n;
+			for (i = 0; i < n; i++) {
+				prev = (long *)mt->percpu_prev + value + i;
+				state[i] += *((long *)mt->percpu_state +
+					value + i) - *prev;
+			}
+		}
+	}
+
+	for (i = 0; i < MEMCG_STATS; i++) {
+		ms = &memcg_stats[i];
+		if ((ms->index < 0) || ((value = state[ms->index - mt->lo]) <= 0))
+			continue;
+		mi->value[ms->field] += ms->bytes ? value / PAGESIZE() : value;
+	}
+
+	return TRUE;
+}
+
+/*
+ *  Return the children of a memcg from its cgroup_subsys_state children
+ *  list, as the addresses of their cgroup_subsys_state structures.
+ */
+static ulong *
+memcg_children(struct memcg_info *mi, char *memcg_buf, int *cnt)
+{
+	struct list_data list_data, *ld;
+	ulong head, next;
+
+	head = mi->css + OFFSET(cgroup_subsys_state_children);
+	next = ULONG(memcg_buf + OFFSET(mem_cgroup_css) +
+		OFFSET(cgroup_subsys_state_children));
+	if (!next || (next == head))
+		return NULL;
+
+	ld = &list_data;
+	BZERO(ld, sizeof(struct list_data));
+	ld->flags = LIST_HEAD_FORMAT|LIST_HEAD_POINTER|LIST_ALLOCATE|
+		RETURN_ON_LIST_ERROR;
+	ld->start = next;
+	ld->end = head;
+	ld->list_head_offset = OFFSET(cgroup_subsys_state_sibling);
+
+	if ((*cnt = do_list(ld)) < 0) {
+		error(INFO, "invalid children list of mem_cgroup %lx\n",
+			mi->memcg);
+		return NULL;
+	}
+
+	return ld->list_ptr;
+}
+
+/*
+ *  Largest first, with the memcgs that could not be read last.
+ */
+static int
+memcg_compare(const void *v1, const void *v2)
+{
+	const struct memcg_info *m1, *m2;
+
+	m1 = (const struct memcg_info *)v1;
+	m2 = (const struct memcg_info *)v2;
+
+	if (!m1->memcg || !m2->memcg)
+		return (m1->memcg ? -1 : 0) + (m2->memcg ? 1 : 0);
+
+	if (m1->value[memcg_sort_field] != m2->value[memcg_sort_field])
+		return m1->value[memcg_sort_field] >
+			m2->value[memcg_sort_field] ? -1 : 1;
+
+	return m1->depth - m2->depth;
+}
+
+/*
+ *  The path of a memcg in the cgroup filesystem, emulating kernfs_path(),
+ *  or on kernels that predate kernfs, the path from the cgroup's dentry.
+ */
+static char *
+memcg_path(ulong css, char *buf)
+{
+	int depth;
+	ulong cgroup, kn, parent, name, dentry;
+	char component[BUFSIZE];
+	char tmp[BUFSIZE];
+
+	sprintf(buf, "(unknown)");
+
+	if (!readmem(css + OFFSET(cgroup_subsys_state_cgroup), KVADDR,
+	    &cgroup, sizeof(ulong), "css cgroup", RETURN_ON_ERROR|QUIET) ||
+	    !cgroup)
+		return buf;
+
+	if (VALID_MEMBER(cgroup_dentry)) {
+		if (readmem(cgroup + OFFSET(cgroup_dentry), KVADDR, &dentry,
+		    sizeof(ulong), "cgroup dentry", RETURN_ON_ERROR|QUIET) &&
+		    dentry)
+			get_pathname(dentry, buf, BUFSIZE, 1, 0);
+		return buf;
+	}
+
+	if (INVALID_MEMBER(cgroup_kn) || INVALID_MEMBER(kernfs_node_name) ||
+	    INVALID_MEMBER(kernfs_node_parent) ||
+	    !readmem(cgroup + OFFSET(cgroup_kn), KVADDR, &kn, sizeof(ulong),
+	    "cgroup kn", RETURN_ON_ERROR|QUIET) || !kn)
+		return buf;
+
+	BZERO(tmp, BUFSIZE);
+	for (depth = 0; kn && (depth <= MEMCG_MAX_DEPTH); depth++) {
+		if (!readmem(kn + OFFSET(kernfs_node_parent), KVADDR, &parent,
+		    sizeof(ulong), "kernfs_node parent", RETURN_ON_ERROR|QUIET))
+			return buf;
+		if (!parent)
+			break;
+		if (!readmem(kn + OFFSET(kernfs_node_name), KVADDR, &name,
+		    sizeof(ulong), "kernfs_node name", RETURN_ON_ERROR|QUIET) ||
+		    !name || !read_string(name, component, BUFSIZE-1))
+			return buf;
+		if ((strlen(component) + strlen(tmp) + 2) >= BUFSIZE)
+			return buf;
+		memmove(tmp + strlen(component) + 1, tmp, strlen(tmp) + 1);
+		tmp[0] = '/';
+		BCOPY(component, tmp + 1, strlen(component));
+		kn = parent;
+	}
+
+	sprintf(buf, "%s", strlen(tmp) ? tmp : "/");
+
+	return buf;
+}
+
+static void
+memcg_show(struct memcg_info *mi, int header)
+{
+	int i;
+	char buf[BUFSIZE];
+	char path[BUFSIZE];
+
+	if (header)
+		fprintf(fp, "%s      USAGE      LIMIT       SWAP       ANON"
+			"       FILE      SHMEM       SLAB  PATH\n",
+			mkstring(buf, VADDR_PRLEN, CENTER|LJUST, "MEM_CGROUP"));
+
+	fprintf(fp, "%s", mkstring(buf, VADDR_PRLEN, LONG_HEX|LJUST,
+		MKSTR(mi->memcg)));
+	fprintf(fp, "  %9s", pages_to_size(mi->value[MCG_USAGE], buf));
+	if (mi->max >= (LONG_MAX / PAGESIZE()))
+		fprintf(fp, "  %9s", "unlimited");
+	else
+		fprintf(fp, "  %9s", pages_to_size(mi->max, buf));
+	for (i = MCG_SWAP; i <= MCG_SLAB; i++)
+		fprintf(fp, "  %9s", pages_to_size(mi->value[i], buf));
+	fprintf(fp, "  %s\n", memcg_path(mi->css, path));
+}
+
+/*
+ *  The LRU list sizes of each node, summed over the zones.
+ */
+static void
+memcg_show_nodes(struct memcg_info *mi)
+{
+	int i, n, z, max_node;
+	ulong *nodeinfo, *lru_zone_size;
+	ulong anon, file, unevictable, value;
+	char buf1[BUFSIZE];
+	char buf2[BUFSIZE];
+	char buf3[BUFSIZE];
+
+	if (!(mt->flags & MEMCG_LRU) || !vt->numnodes)
+		return;
+
+	for (n = max_node = 0; n < vt->numnodes; n++)
+		max_node = MAX(max_node, vt->node_table[n].node_id);
+
+	nodeinfo = (ulong *)GETBUF(sizeof(ulong) * (max_node + 1));
+	lru_zone_size = (ulong *)GETBUF(SIZE(mem_cgroup_per_node_lru_zone_size));
+
+	if (!readmem(mi->memcg + OFFSET(mem_cgroup_nodeinfo), KVADDR, nodeinfo,
+	    sizeof(ulong) * (max_node + 1), "mem_cgroup nodeinfo",
+	    RETURN_ON_ERROR|QUIET))
+		goto bailout;
+
+	for (n = 0; n < vt->numnodes; n++) {
+		i = vt->node_table[n].node_id;
+		if (!nodeinfo[i] || !readmem(nodeinfo[i] +
+		    OFFSET(mem_cgroup_per_node_lru_zone_size), KVADDR,
+		    lru_zone_size, SIZE(mem_cgroup_per_node_lru_zone_size),
+		    "mem_cgroup_per_node lru_zone_size", RETURN_ON_ERROR|QUIET))
+			continue;
+
+		anon = file = unevictable = 0;
+		for (z = 0; z < mt->nr_zones; z++) {
+			for (i = 0; i < 5; i++) {
+				if (mt->lru[i] < 0)
+					continue;
+				value = lru_zone_size[(z * mt->nr_lru_lists) +
+					mt->lru[i]];
+				if (i < 2)
+					anon += value;
+				else if (i < 4)
+					file += value;
+				else
+					unevictable += value;
+			}
+		}
+
+		fprintf(fp, "%sNODE %d:  ANON %s  FILE %s  UNEVICTABLE %s\n",
+			space(VADDR_PRLEN + 2), vt->node_table[n].node_id,
+			pages_to_size(anon, buf1), pages_to_size(file, buf2),
+			pages_to_size(unevictable, buf3));
+	}
+
+bailout:
+	FREEBUF(lru_zone_size);
+	FREEBUF(nodeinfo);
+}
@@ -21,6 +21,9 @@
 #include <ctype.h>
 #include <netinet/in.h>
 #include <byteswap.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <elf.h>
 
 struct meminfo {           /* general purpose memory information structure */
         ulong cache;       /* used by the various memory searching/dumping */
@@ -67,6 +70,8 @@ struct meminfo {           /* general purpose memory information structure */
 	ulong get_totalram;
 	ulong get_buffers;
 	ulong get_slabs;
+	ulong *pageflag_counts;
+	int threads;		/* kmem -s -j worker processes */
 	char *slab_buf;
 	char *cache_buf;
 	ulong *cache_list;
@@ -134,10 +139,14 @@ struct searchinfo {
 		} s_chars;
 	} s_parms;
 	char buf[BUFSIZE];
+	int threads;		/* search -j */
 };
 
 static char *memtype_string(int, int);
 static char *error_handle_string(ulong);
+static int page_cache_read(int, void *, int, ulong, physaddr_t);
+static int memory_device_readv(int, struct dev_crash_read_range *, int);
+static int read_memory_device_vec(int, ulonglong, int, char *, long);
 static void collect_page_member_data(char *, struct meminfo *);
 struct integer_data {
 	ulong value;
@@ -149,6 +158,8 @@ static int show_page_member_data(char *, ulong, struct meminfo *, char *);
 static void dump_mem_map(struct meminfo *);
 static void dump_mem_map_SPARSEMEM(struct meminfo *);
 static void fill_mem_map_cache(ulong, ulong, char *);
+static void pageflags_bit_init(void);
+static void dump_page_flag_counts(struct meminfo *);
 static void page_flags_init(void);
 static int page_flags_init_from_pageflag_names(void);
 static int page_flags_init_from_pageflags_enum(void);
@@ -159,7 +170,7 @@ static void dump_multidimensional_free_pages(struct meminfo *);
 static void dump_free_pages_zones_v1(struct meminfo *);
 static void dump_free_pages_zones_v2(struct meminfo *);
 struct free_page_callback_data;
-static int dump_zone_free_area(ulong, int, ulong, struct free_page_callback_data *);
+static int dump_zone_free_area(ulong, int, ulong, struct free_page_callback_data *, int);
 static void dump_page_hash_table(struct meminfo *);
 static void kmem_search(struct meminfo *);
 static void kmem_cache_init(void);
@@ -212,8 +223,9 @@ static void dump_slab_objects(struct meminfo *);
 static void dump_slab_objects_percpu(struct meminfo *);
 static void dump_vmlist(struct meminfo *);
 static void dump_vmap_area(struct meminfo *);
+static void dump_vmap_area_callers(void);
 static int dump_page_lists(struct meminfo *);
-static void dump_kmeminfo(void);
+static void dump_kmeminfo(int);
 static int page_to_phys(ulong, physaddr_t *); 
 static void display_memory(ulonglong, long, ulong, int, void *); 
 static char *show_opt_string(struct searchinfo *);
@@ -227,6 +239,7 @@ static ulonglong search_uint_p(ulong *, ulonglong, int, struct searchinfo *);
 static ulonglong search_ushort_p(ulong *, ulonglong, int, struct searchinfo *);
 static ulonglong search_chars_p(ulong *, ulonglong, int, struct searchinfo *);
 static void search_virtual(struct searchinfo *);
+static void search_task_stacks(struct searchinfo *, int);
 static void search_physical(struct searchinfo *);
 static int next_upage(struct task_context *, ulong, ulong *);
 static int next_kpage(ulong, ulong *);
@@ -267,6 +280,10 @@ int section_has_mem_map(ulong);
 ulong section_mem_map_addr(ulong, int);
 ulong valid_section_nr(ulong);
 ulong pfn_to_map(ulong);
+static void mem_section_cache_init(void);
+static void mem_section_cache_refresh(void);
+static ulong *mem_section_cached_map(ulong);
+static ulong *mem_section_cached_addr(ulong);
 static int get_nodes_online(void);
 static int next_online_node(int);
 static ulong next_online_pgdat(int);
@@ -287,6 +304,9 @@ static long count_partial(ulong, struct meminfo *, ulong *);
 static short count_cpu_partial(struct meminfo *, int);
 static ulong get_freepointer(struct meminfo *, void *);
 static int count_free_objects(struct meminfo *, ulong);
+static ulong *slub_free_bitmap(struct meminfo *, ulong, int, ulong, ulong, ulong, int *);
+static void slub_free_cache_flush(void);
+static void dump_slub_free_cache(void);
 char *is_slab_page(struct meminfo *, char *);
 static void do_cpu_partial_slub(struct meminfo *, int);
 static void do_node_lists_slub(struct meminfo *, ulong, int);
@@ -324,6 +344,9 @@ static ulong freelist_ptr(struct meminfo *, ulong, ulong);
 
 #define ASCII_UNLIMITED ((ulong)(-1) >> 1)
 
+#define RD_RAW_CHUNK   (1024*1024)	/* rd -r read size */
+#define RD_WINDOW_SIZE (4096)		/* formatted rd read window */
+
 static ulong DISPLAY_DEFAULT;
 
 /*
@@ -362,6 +385,7 @@ vm_init(void)
 
         MEMBER_OFFSET_INIT(task_struct_mm, "task_struct", "mm");
         MEMBER_OFFSET_INIT(mm_struct_mmap, "mm_struct", "mmap");
+	MEMBER_OFFSET_INIT(mm_struct_mm_mt, "mm_struct", "mm_mt");
         MEMBER_OFFSET_INIT(mm_struct_pgd, "mm_struct", "pgd");
 	MEMBER_OFFSET_INIT(mm_struct_rss, "mm_struct", "rss");
 	if (!VALID_MEMBER(mm_struct_rss))
@@ -392,6 +416,7 @@ vm_init(void)
 	MEMBER_OFFSET_INIT(vm_struct_addr, "vm_struct", "addr");
 	MEMBER_OFFSET_INIT(vm_struct_size, "vm_struct", "size");
 	MEMBER_OFFSET_INIT(vm_struct_next, "vm_struct", "next");
+	MEMBER_OFFSET_INIT(vm_struct_caller, "vm_struct", "caller");
 
 	MEMBER_OFFSET_INIT(vmap_area_va_start, "vmap_area", "va_start");
 	MEMBER_OFFSET_INIT(vmap_area_va_end, "vmap_area", "va_end");
@@ -1549,6 +1574,10 @@ display_memory(ulonglong addr, long count, ulong flag, int memtype, void *opt)
 	char *hex_64_fmt = BITS32() ? "%.*llx " : "%.*lx ";
 	char *dec_64_fmt = BITS32() ? "%12lld " : "%15ld ";
 	char *dec_u64_fmt = BITS32() ? "%12llu " : "%20lu ";
+	char *rawbuf;
+	char window[RD_WINDOW_SIZE];
+	ulonglong wstart;
+	long wlen, woff;
 
 	if (count <= 0) 
 		error(FATAL, "invalid count request: %ld\n", count);
@@ -1579,16 +1608,25 @@ display_memory(ulonglong addr, long count, ulong flag, int memtype, void *opt)
 		fprintf(fp, "<addr: %llx count: %ld flag: %lx (%s)>\n", 
 			addr, count, flag, addrtype);
 
+	/*
+	 *  Raw dumps are read in RD_RAW_CHUNK pieces that, after the first,
+	 *  are aligned on RD_RAW_CHUNK boundaries, so that each readmem()
+	 *  request covers a run of whole pages.
+	 */
 	if (flag & DISPLAY_RAW) {
+		rawbuf = GETBUF(RD_RAW_CHUNK);
 		for (written = 0; written < count; written += sz) {
-			sz = BUFSIZE > (count - written) ? 
-				(size_t)(count - written) : (size_t)BUFSIZE;
-			readmem(addr + written, memtype, buf, (long)sz,
+			sz = RD_RAW_CHUNK -
+				((addr + written) & (ulonglong)(RD_RAW_CHUNK-1));
+			if (sz > (size_t)(count - written))
+				sz = (size_t)(count - written);
+			readmem(addr + written, memtype, rawbuf, (long)sz,
 				"raw dump to file", FAULT_ON_ERROR);
-			if (fwrite(buf, 1, sz, pc->tmpfile2) != sz)
+			if (fwrite(rawbuf, 1, sz, pc->tmpfile2) != sz)
 				error(FATAL, "cannot write to: %s\n",
 					(char *)opt);
 		}
+		FREEBUF(rawbuf);
 		close_tmpfile2();
 
 		fprintf(fp, "%ld bytes copied from 0x%llx to %s\n",
@@ -1650,9 +1688,33 @@ display_memory(ulonglong addr, long count, ulong flag, int memtype, void *opt)
 	else
 		error_handle = FAULT_ON_ERROR;
 
+	/*
+	 *  Rather than calling readmem() for each entry, read the memory an
+	 *  RD_WINDOW_SIZE-aligned window at a time, which never crosses a
+	 *  page boundary.  If a window cannot be read in its entirety, its
+	 *  entries are read one at a time so that unreadable entries are
+	 *  reported or skipped exactly as before.
+	 */
+	wstart = (ulonglong)(-1);
+	wlen = 0;
+
 	for (i = a = 0; i < count; i++) {
-		if(!readmem(addr, memtype, location, typesz,
-			readtype, error_handle)) {
+		woff = (long)(addr & (ulonglong)(RD_WINDOW_SIZE-1));
+		if ((addr - woff) != wstart) {
+			wstart = addr - woff;
+			wlen = RD_WINDOW_SIZE - woff;
+			if ((ulong)wlen > (count - i) * typesz)
+				wlen = (count - i) * typesz;
+			if (!readmem(addr, memtype, window + woff, wlen,
+			    readtype, RETURN_ON_ERROR|QUIET))
+				wlen = 0;
+			wlen += woff;
+		}
+
+		if ((woff + (long)typesz) <= wlen)
+			BCOPY(window + woff, location, typesz);
+		else if (!readmem(addr, memtype, location, typesz,
+		    readtype, error_handle)) {
 			addr += typesz;
 			lost += 1;
 			continue;
@@ -2246,6 +2308,214 @@ accessible(ulong kva)
 		return TRUE;							\
 	}
 
+/*
+ *  "set profile on": count the readmem() calls of each command, and the
+ *  bytes, page cache hits, dumpfile reader calls and time, and address
+ *  translations they result in, along with the number of calls and bytes
+ *  of each readmem() type string.  The summary is displayed by
+ *  exec_command() after the command completes.  When profiling is off,
+ *  the cost is a test of pc->flags2 in readmem(), the address translation
+ *  functions and the dumpfile reader calls.
+ */
+#define READMEM_PROFILE_TYPES  (1024)	/* distinct type strings counted */
+#define READMEM_PROFILE_TOP    (10)	/* type strings displayed */
+#define READMEM_PROFILE_TYPELEN (48)
+
+#define TIMESPEC_USECS(start, end) \
+	((ulonglong)((end).tv_sec - (start).tv_sec) * 1000000 + \
+	 ((end).tv_nsec - (start).tv_nsec) / 1000)
+
+static struct readmem_profile {
+	int active;
+	ulong reads;
+	ulonglong bytes;
+	ulong failures;
+	ulong page_cache_hits;
+	ulong backend_calls;
+	ulonglong backend_bytes;
+	ulonglong backend_usecs;
+	ulong kvtop_calls;
+	ulong uvtop_calls;
+	ulong vtop_cached;
+	ulonglong vtop_usecs;
+	int ntypes;
+	ulong untracked;	/* readmem() calls of types not counted */
+	struct readmem_profile_type {
+		char type[READMEM_PROFILE_TYPELEN];
+		ulong reads;
+		ulonglong bytes;
+	} types[READMEM_PROFILE_TYPES];
+} readmem_profile = { 0 };
+
+#define READMEM_PROFILING() \
+	((pc->flags2 & (READMEM_PROFILE|STARTUP_TIMING)) && readmem_profile.active)
+
+void
+readmem_profile_start(void)
+{
+	BZERO(&readmem_profile, sizeof(struct readmem_profile));
+	readmem_profile.active = TRUE;
+}
+
+static void
+readmem_profile_read(char *type, long size)
+{
+	ulong hash;
+	char *p;
+	int i, probe;
+	struct readmem_profile_type *rpt;
+
+	readmem_profile.reads++;
+	if (size > 0)
+		readmem_profile.bytes += size;
+
+	if (!type)
+		type = "(null)";
+
+	for (p = type, hash = 5381; *p && ((p - type) < (READMEM_PROFILE_TYPELEN-1)); p++)
+		hash = (hash * 33) + *p;
+
+	for (probe = 0; probe < READMEM_PROFILE_TYPES; probe++) {
+		i = (hash + probe) % READMEM_PROFILE_TYPES;
+		rpt = &readmem_profile.types[i];
+		if (!rpt->type[0]) {
+			if (readmem_profile.ntypes == (READMEM_PROFILE_TYPES/2))
+				break;
+			strncpy(rpt->type, type, READMEM_PROFILE_TYPELEN-1);
+			readmem_profile.ntypes++;
+		} else if (strncmp(rpt->type, type, READMEM_PROFILE_TYPELEN-1))
+			continue;
+		rpt->reads++;
+		if (size > 0)
+			rpt->bytes += size;
+		return;
+	}
+
+	readmem_profile.untracked++;
+}
+
+/*
+ *  Call the pc->readmem() function of the dumpfile format, timing it if
+ *  the command is being profiled or traced.
+ */
+static int
+readmem_backend(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr)
+{
+	int ret;
+	struct timespec start, end;
+	ulonglong tstart;
+
+	if (!READMEM_PROFILING() && !TRACING())
+		return READMEM(fd, bufptr, cnt, addr, paddr);
+
+	tstart = TRACING() ? trace_time() : 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = READMEM(fd, bufptr, cnt, addr, paddr);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (READMEM_PROFILING()) {
+		readmem_profile.backend_calls++;
+		if (ret > 0)
+			readmem_profile.backend_bytes += ret;
+		readmem_profile.backend_usecs += TIMESPEC_USECS(start, end);
+	}
+
+	if (tstart)
+		trace_span("readmem", readmem_function_name(), NULL, tstart);
+
+	return ret;
+}
+
+/*
+ *  Return the totals counted so far.
+ */
+void
+readmem_profile_get(struct readmem_profile_totals *totals)
+{
+	totals->reads = readmem_profile.reads;
+	totals->bytes = readmem_profile.bytes;
+	totals->failures = readmem_profile.failures;
+	totals->backend_calls = readmem_profile.backend_calls;
+	totals->backend_usecs = readmem_profile.backend_usecs;
+}
+
+/*
+ *  Stop profiling without displaying the summary, and return the totals.
+ */
+void
+readmem_profile_stop(struct readmem_profile_totals *totals)
+{
+	readmem_profile_get(totals);
+	readmem_profile.active = FALSE;
+}
+
+static int
+compare_readmem_profile_type(const void *v1, const void *v2)
+{
+	struct readmem_profile_type *t1, *t2;
+
+	t1 = *(struct readmem_profile_type **)v1;
+	t2 = *(struct readmem_profile_type **)v2;
+
+	if (t1->reads != t2->reads)
+		return (t1->reads > t2->reads) ? -1 : 1;
+	if (t1->bytes != t2->bytes)
+		return (t1->bytes > t2->bytes) ? -1 : 1;
+	return strcmp(t1->type, t2->type);
+}
+
+void
+readmem_profile_report(void)
+{
+	int i, cnt;
+	struct readmem_profile_type **sorted;
+
+	if (!READMEM_PROFILING())
+		return;
+
+	readmem_profile.active = FALSE;
+
+	if (!(pc->flags2 & READMEM_PROFILE))
+		return;
+
+	fprintf(fp, "\nprofile: %s\n", pc->curcmd);
+	fprintf(fp, "    readmem: %ld calls  %lld bytes  %ld failed\n",
+		readmem_profile.reads, readmem_profile.bytes,
+		readmem_profile.failures);
+	fprintf(fp, " page cache: %ld hits\n", readmem_profile.page_cache_hits);
+	fprintf(fp, "    backend: %s: %ld calls  %lld bytes  %lld.%06lld secs\n",
+		readmem_function_name(), readmem_profile.backend_calls,
+		readmem_profile.backend_bytes,
+		readmem_profile.backend_usecs / 1000000,
+		readmem_profile.backend_usecs % 1000000);
+	fprintf(fp, "kvtop/uvtop: %ld/%ld calls  %ld cached  %lld.%06lld secs\n",
+		readmem_profile.kvtop_calls, readmem_profile.uvtop_calls,
+		readmem_profile.vtop_cached,
+		readmem_profile.vtop_usecs / 1000000,
+		readmem_profile.vtop_usecs % 1000000);
+
+	if (!readmem_profile.ntypes)
+		return;
+
+	sorted = (struct readmem_profile_type **)
+		GETBUF(sizeof(struct readmem_profile_type *) * readmem_profile.ntypes);
+	for (i = cnt = 0; i < READMEM_PROFILE_TYPES; i++)
+		if (readmem_profile.types[i].type[0])
+			sorted[cnt++] = &readmem_profile.types[i];
+	qsort(sorted, cnt, sizeof(struct readmem_profile_type *),
+		compare_readmem_profile_type);
+
+	fprintf(fp, "  top types:      CALLS           BYTES  TYPE\n");
+	for (i = 0; (i < cnt) && (i < READMEM_PROFILE_TOP); i++)
+		fprintf(fp, "             %10ld  %14lld  \"%s\"\n",
+			sorted[i]->reads, sorted[i]->bytes, sorted[i]->type);
+	if (readmem_profile.untracked)
+		fprintf(fp, "             %10ld  %14s  (other types)\n",
+			readmem_profile.untracked, "");
+
+	FREEBUF(sorted);
+}
+
 int
 readmem(ulonglong addr, int memtype, void *buffer, long size,
 	char *type, ulong error_handle)
@@ -2261,6 +2531,9 @@ readmem(ulonglong addr, int memtype, void *buffer, long size,
 			addr, memtype_string(memtype, 1), type, size, 
 			error_handle_string(error_handle), (ulong)buffer);
 
+	if (READMEM_PROFILING())
+		readmem_profile_read(type, size);
+
 	bufptr = (char *)buffer;
 	orig_size = size;
 
@@ -2310,6 +2583,12 @@ readmem(ulonglong addr, int memtype, void *buffer, long size,
 		return generic_read_dumpfile(addr, buffer, size, type, error_handle);
         }
 
+	if ((pc->readmem == read_memory_device) &&
+	    ((memtype == KVADDR) || (memtype == PHYSADDR)) &&
+	    (size > PAGESIZE() - PAGEOFFSET(addr)) &&
+	    read_memory_device_vec(fd, addr, memtype, bufptr, size))
+		return TRUE;
+
         while (size > 0) {
 		switch (memtype)
 		{
@@ -2376,7 +2655,7 @@ readmem(ulonglong addr, int memtype, void *buffer, long size,
 		else
 			pc->curcmd_flags &= ~MEMTYPE_KVADDR;
 
-		switch (READMEM(fd, bufptr, cnt, 
+		switch (page_cache_read(fd, bufptr, cnt, 
 		    (memtype == PHYSADDR) || (memtype == XENMACHADDR) ? 0 : addr, paddr))
 		{
 		case SEEK_ERROR:
@@ -2420,6 +2699,8 @@ readmem(ulonglong addr, int memtype, void *buffer, long size,
         return TRUE;
 
 readmem_error:
+	if (READMEM_PROFILING())
+		readmem_profile.failures++;
 	
         switch (error_handle)
         {
@@ -2439,1415 +2720,4069 @@ readmem_error:
 }
 
 /*
- *  Accept anything...
+ *  readmem_batch() reads a set of requests in any order it sees fit: the
+ *  requests are sorted by address, and those of the same memory type that
+ *  are close enough together are read with a single readmem() call, which
+ *  gets them through the dumpfile reader's read-ahead and page cache, or
+ *  the memory driver's vectored reads, in as few steps as possible.  If a
+ *  combined read fails, perhaps only in a gap between requests, the
+ *  requests are read individually with the caller's error_handle, so that
+ *  any failure is reported as readmem() would.  Returns the number of
+ *  requests that were read.
  */
-int
-generic_verify_paddr(physaddr_t paddr)
+#define READMEM_BATCH_GAP   (PAGESIZE())	/* largest gap read over */
+#define READMEM_BATCH_MAX   (MEGABYTES(1))	/* largest combined read */
+
+static int
+compare_readmem_request(const void *v1, const void *v2)
 {
-	return TRUE;
+	const struct readmem_request *r1, *r2;
+
+	r1 = *(const struct readmem_request **)v1;
+	r2 = *(const struct readmem_request **)v2;
+
+	if (r1->memtype != r2->memtype)
+		return r1->memtype < r2->memtype ? -1 : 1;
+	if (r1->addr < r2->addr)
+		return -1;
+	return r1->addr > r2->addr;
 }
 
-/*
- *  Read from /dev/mem.
- */
 int
-read_dev_mem(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr) 
+readmem_batch(struct readmem_request *reqs, int count, ulong error_handle)
 {
-	int readcnt;
+	int i, j, k, done;
+	ulonglong start, end;
+	char *readbuf;
+	struct readmem_request **sorted, *r;
 
-	if (!machdep->verify_paddr(paddr)) {
-		if (CRASHDEBUG(1) && !STREQ(pc->curcmd, "search"))
-			error(INFO, "verify_paddr(%lx) failed\n", paddr);
-		return READ_ERROR;
-	}
+	if (count <= 0)
+		return 0;
 
-	/*
-	 *  /dev/mem disallows anything >= __pa(high_memory)
-	 *
-         *  However it will allow 64-bit lseeks to anywhere, and when followed
-	 *  by pulling a 32-bit address from the 64-bit file position, it
-	 *  quietly returns faulty data from the (wrapped-around) address.
-  	 */
-	if (vt->high_memory && (paddr >= (physaddr_t)(VTOP(vt->high_memory)))) {
-		readcnt = 0;
-		errno = 0;
-		goto try_dev_kmem;
+	sorted = (struct readmem_request **)
+		GETBUF(sizeof(struct readmem_request *) * count);
+	for (i = 0; i < count; i++) {
+		reqs[i].result = FALSE;
+		sorted[i] = &reqs[i];
+	}
+	qsort(sorted, count, sizeof(struct readmem_request *),
+		compare_readmem_request);
+
+	readbuf = NULL;
+
+	for (i = 0; i < count; i = j) {
+		r = sorted[i];
+		start = r->addr;
+		end = start + MAX(r->size, 0);
+		for (j = i+1; j < count; j++) {
+			if ((sorted[j]->memtype != r->memtype) ||
+			    (sorted[j]->size <= 0) || (r->size <= 0) ||
+			    (sorted[j]->addr > end + READMEM_BATCH_GAP) ||
+			    (MAX(end, sorted[j]->addr + sorted[j]->size) - start >
+			     READMEM_BATCH_MAX))
+				break;
+			end = MAX(end, sorted[j]->addr + sorted[j]->size);
+		}
+
+		if (j - i > 1) {
+			if (!readbuf)
+				readbuf = GETBUF(READMEM_BATCH_MAX);
+			if (readmem(start, r->memtype, readbuf, end - start,
+			    "readmem_batch", RETURN_ON_ERROR|QUIET)) {
+				for (k = i; k < j; k++) {
+					BCOPY(readbuf + (sorted[k]->addr - start),
+						sorted[k]->buffer, sorted[k]->size);
+					sorted[k]->result = TRUE;
+				}
+				continue;
+			}
+		}
+
+		for (k = i; k < j; k++)
+			sorted[k]->result = readmem(sorted[k]->addr,
+				sorted[k]->memtype, sorted[k]->buffer,
+				sorted[k]->size, sorted[k]->type, error_handle);
 	}
 
-	if (lseek(fd, (off_t)paddr, SEEK_SET) == -1) 
-		return SEEK_ERROR;
+	if (readbuf)
+		FREEBUF(readbuf);
+	FREEBUF(sorted);
 
-next_read:
-        errno = 0;
-        readcnt = read(fd, bufptr, cnt);
+	for (i = done = 0; i < count; i++)
+		done += reqs[i].result ? 1 : 0;
 
-	if ((readcnt != cnt) && CRASHDEBUG(4)) {
-		if (errno)
-			perror("/dev/mem");
-		error(INFO, "read(/dev/mem, %lx, %ld): %ld (%lx)\n",
-			paddr, cnt, readcnt, readcnt);	
-	}
+	return done;
+}
 
-try_dev_kmem:
-        /*
-         *  On 32-bit intel architectures high memory can can only be accessed
-	 *  via vmalloc'd addresses.  However, /dev/mem returns 0 bytes, and
-	 *  non-reserved memory pages can't be mmap'd, so the only alternative
-	 *  is to read it from /dev/kmem.
-         */
-        if ((readcnt != cnt) && BITS32() && !readcnt && !errno && 
-	    IS_VMALLOC_ADDR(addr))
-                readcnt = read_dev_kmem(addr, bufptr, cnt);
+/*
+ *  Allocate a context for readmem_ctx(), one of which is needed by each
+ *  thread reading memory concurrently.  Returns NULL if the dumpfile
+ *  reader cannot be used from multiple threads, in which case the
+ *  command has to do its reading with readmem() as usual.  Contexts must
+ *  be allocated and freed by the command itself, not by its threads.
+ */
+struct readmem_context *
+readmem_context_alloc(void)
+{
+	int supported;
+	struct readmem_context *ctx;
 
-	/*
-	 *  The 2.6 valid_phys_addr_range() can potentially shorten the 
-	 *  count of a legitimate read request.  So far this has only been
-	 *  seen on an ia64 where a kernel page straddles an EFI segment.
-	 */
-	if ((readcnt != cnt) && readcnt && (machdep->flags & DEVMEMRD) && 
-	     !errno) {
-		if (CRASHDEBUG(1) && !STREQ(pc->curcmd, "search"))
-			error(INFO, "read(/dev/mem, %lx, %ld): %ld (%lx)\n",
-				paddr, cnt, readcnt, readcnt);	
-		cnt -= readcnt;
-		bufptr += readcnt;
-		goto next_read;
+	if (ACTIVE() || REMOTE_MEMSRC())
+		return NULL;
+
+	if ((ctx = (struct readmem_context *)
+	    calloc(1, sizeof(struct readmem_context))) == NULL)
+		return NULL;
+
+	if (pc->readmem == read_diskdump)
+		supported = diskdump_readmem_context_init(ctx);
+	else if ((pc->readmem == read_netdump) || (pc->readmem == read_kdump))
+		supported = netdump_readmem_context_init(ctx);
+	else
+		supported = FALSE;
+
+	if (!supported) {
+		readmem_context_free(ctx);
+		return NULL;
 	}
 
-        if (readcnt != cnt) 
-		return READ_ERROR;
+	return ctx;
+}
 
-	return readcnt;
+void
+readmem_context_free(struct readmem_context *ctx)
+{
+	if (!ctx)
+		return;
+
+	if (ctx->cleanup)
+		ctx->cleanup(ctx);
+	free(ctx->scratch);
+	free(ctx);
 }
 
 /*
- *  Write to /dev/mem.
+ *  Reentrant physical memory reader.  Unlike readmem(), it does not use
+ *  the dumpfile reader's own page cache and buffers, and it never
+ *  displays an error or aborts the command: it returns FALSE, leaving a
+ *  description of the failure in ctx->errmsg.  Pages already held by the
+ *  common page cache are copied from there.
  */
 int
-write_dev_mem(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr) 
+readmem_ctx(struct readmem_context *ctx, physaddr_t paddr, void *buffer,
+	    long size)
 {
-	if (!machdep->verify_paddr(paddr)) {
-		if (CRASHDEBUG(1))
-			error(INFO, "verify_paddr(%lx) failed\n", paddr);
-		return WRITE_ERROR;
-	}
+	int cnt, ret;
+	char *bufptr;
 
-        if (lseek(fd, (off_t)paddr, SEEK_SET) == -1) 
-		return SEEK_ERROR;
+	bufptr = (char *)buffer;
 
-        if (write(fd, bufptr, cnt) != cnt) 
-		return WRITE_ERROR;
+	while (size > 0) {
+		cnt = PAGESIZE() - PAGEOFFSET(paddr);
+		if (cnt > size)
+			cnt = size;
 
-	return cnt;
+		ctx->errmsg[0] = NULLCHAR;
+		if (page_cache_read_ctx(ctx, paddr, bufptr, cnt))
+			ret = cnt;
+		else
+			ret = ctx->read_page(ctx, paddr, bufptr, cnt);
+		if (ret != cnt) {
+			ctx->errors++;
+			if (!ctx->errmsg[0])
+				sprintf(ctx->errmsg, "%s: physical address: %llx",
+					ret == SEEK_ERROR ? "seek error" :
+					ret == PAGE_EXCLUDED ? "page excluded" :
+					ret == PAGE_INCOMPLETE ? "page incomplete" :
+					"read error", (ulonglong)paddr);
+			return FALSE;
+		}
+
+		bufptr += cnt;
+		paddr += cnt;
+		size -= cnt;
+	}
+
+	ctx->reads++;
+	return TRUE;
 }
 
 /*
- *  The first required reads of memory are done in kernel_init(),
- *  so if there's a fatal read error of /dev/mem, display a warning
- *  message if it appears that CONFIG_STRICT_DEVMEM is in effect.
- *  On x86 and x86_64, only the first 256 pages of physical memory
- *  are accessible:
- *
- *    #ifdef CONFIG_STRICT_DEVMEM
- *    int devmem_is_allowed(unsigned long pagenr)
- *    {
- *            if (pagenr <= 256)
- *                    return 1;
- *            if (!page_is_ram(pagenr))
- *                    return 1;
- *            return 0;
- *    }
- *    #endif
- *
- *  It would probably suffice to simply check for the existence of 
- *  devmem_is_allowed(), but on x86 and x86_64 verify pfn 256 reads OK,
- *  and 257 fails.
- *
- *  Update: a patch has been posted to LKML to fix the off-by-one error
- *  by changing "<= 256" to "< 256":
+ *  Common page cache for the dumpfile readers, which sits between
+ *  readmem() and the pc->readmem() function of the dumpfile format.
+ *  Every page-sized or smaller read that misses reads the complete page
+ *  into the cache, so that subsequent reads of the same page are simple
+ *  copies, no matter how costly the format is to read from.  The cache
+ *  is sized by "set page_cache", shared by all formats that read from
+ *  immutable dumpfiles, and keeps hit and miss counts per format.  Live
+ *  memory sources are read directly, with the exception of a remote
+ *  daemon, where every page costs a network round trip: its pages are
+ *  cached and read ahead for the duration of a command, and flushed by
+ *  restore_sanity() if the remote system is live.
  *
- *     https://lkml.org/lkml/2012/8/28/357
- *
- *  The X86/X86_64 lower-boundary pfn check below has been changed 
- *  (preemptively) from 256 to 255.
+ *  The local live memory sources, /dev/mem, /proc/kcore and /dev/crash,
+ *  may be cached as well with "set live_cache", which bounds how stale
+ *  a cached page may be: either the cache is flushed when a command
+ *  starts, or it is flushed once it has been filled for more than a
+ *  given number of seconds.  It is also flushed by any "set" command,
+ *  which covers context changes and "set refresh".
  *
- *  In any case, if that x86/x86_64 check fails to prove CONFIG_STRICT_DEVMEM 
- *  is configured, then the function will check that "jiffies" can be read,
- *  as is done for the other architectures.
+ *  The compressed kdump and diskdump formats keep their own page cache
+ *  of decompressed pages, which is filled by the read-ahead of "set
+ *  diskdump_readahead"; for them, "set page_cache" sizes that cache
+ *  instead, and readmem() passes their reads straight through.
  *
+ *  Pages are located through an open hash of page_cache.hash[] chains
+ *  and replaced in CLOCK order.  The lock makes the cache safe to use
+ *  from readmem_ctx() threads.
+ */
+#define PAGE_CACHE_DEFAULT_SIZE  (64 * 1024 * 1024)
+#define PAGE_CACHE_NO_ENTRY      ((uint)-1)
+
+#define PAGE_CACHE_DELEGATED     (0x1)	/* the format has its own cache */
+#define PAGE_CACHE_LIVE          (0x2)	/* cached by "set live_cache" only */
+
+struct page_cache_format {
+	int (*readmem)(int, void *, int, ulong, physaddr_t);
+	char *name;
+	ulong flags;
+	ulong hits;
+	ulong misses;
+	ulong passthrough;	/* misses that could not be cached */
+};
+
+static struct page_cache_format page_cache_formats[] = {
+	{ read_netdump,        "netdump/ELF" },
+	{ read_kdump,          "kdump" },
+	{ read_diskdump,       "diskdump", PAGE_CACHE_DELEGATED },
+	{ read_lkcd_dumpfile,  "lkcd" },
+	{ read_mclx_dumpfile,  "mclx" },
+	{ read_s390_dumpfile,  "s390" },
+	{ read_kvmdump,        "kvmdump" },
+	{ read_xendump_hyper,  "xendump" },
+	{ read_sadump,         "sadump" },
+	{ read_vmware_vmss,    "vmss" },
+	{ read_ramdump,        "ramdump" },
+	{ read_daemon,         "remote" },
+	{ read_dev_mem,        "/dev/mem",    PAGE_CACHE_LIVE },
+	{ read_proc_kcore,     "/proc/kcore", PAGE_CACHE_LIVE },
+	{ read_memory_device,  "/dev/crash",  PAGE_CACHE_LIVE },
+	{ NULL }
+};
+
+struct page_cache_entry {
+	physaddr_t paddr;		/* page address */
+	uint next;			/* hash chain */
+	uint referenced;
+};
+
+static struct page_cache {
+	pthread_mutex_t lock;
+	ulonglong size;			/* budget in bytes */
+	struct page_cache_format *format;
+	struct page_cache_entry *entries;
+	char *data;
+	uint *hash;
+	ulong nr_pages;
+	ulong nr_hash;
+	ulong used;
+	ulong hand;
+	ulong evictions;
+	ulong flushes;
+	ulonglong budget;		/* size within "set memlimit" */
+	int live_window;		/* "set live_cache" */
+	ulong live_cmdgen;		/* when the live cache was flushed */
+	time_t live_start;
+} page_cache = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.size = PAGE_CACHE_DEFAULT_SIZE,
+	.budget = PAGE_CACHE_DEFAULT_SIZE,
+};
+
+static inline ulong
+page_cache_bucket(physaddr_t paddr)
+{
+	ulonglong hash;
+
+	hash = paddr >> PAGESHIFT();
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+
+	return (ulong)hash & (page_cache.nr_hash - 1);
+}
+
+static void
+page_cache_free(void)
+{
+	free(page_cache.entries);
+	free(page_cache.data);
+	free(page_cache.hash);
+	page_cache.entries = NULL;
+	page_cache.data = NULL;
+	page_cache.hash = NULL;
+	page_cache.nr_pages = page_cache.nr_hash = 0;
+	page_cache.used = page_cache.hand = 0;
+}
+
+/*
+ *  Whether the pages of a live memory source that are in the cache are
+ *  still within the "set live_cache" window.
  */
 static int
-devmem_is_restricted(void)
+page_cache_live_valid(void)
 {
-	long tmp;
-	int restricted;
+	if (page_cache.live_window == LIVE_CACHE_COMMAND)
+		return (page_cache.live_cmdgen == pc->cmdgencur);
 
+	return ((time(NULL) - page_cache.live_start) < page_cache.live_window);
+}
 
-	/*
-	 *  Check for pre-CONFIG_STRICT_DEVMEM kernels.
-	 */
-	if (!kernel_symbol_exists("devmem_is_allowed")) {
-		if (machine_type("ARM") || machine_type("ARM64") ||
-		    machine_type("X86") || machine_type("X86_64") ||
-		    machine_type("PPC") || machine_type("PPC64"))
-			return FALSE;
+static void
+page_cache_clear(void)
+{
+	ulong i;
+
+	if (page_cache.entries) {
+		for (i = 0; i < page_cache.nr_hash; i++)
+			page_cache.hash[i] = PAGE_CACHE_NO_ENTRY;
+		page_cache.used = page_cache.hand = 0;
+		page_cache.flushes++;
 	}
+	page_cache.live_cmdgen = pc->cmdgencur;
+	page_cache.live_start = time(NULL);
+}
 
-	restricted = FALSE;
+/*
+ *  Return the format of the current dumpfile if its reads are to be
+ *  cached here, allocating the cache on first use.  Called with the
+ *  lock held.
+ */
+static struct page_cache_format *
+page_cache_format(void)
+{
+	ulong i, nr_pages;
+	struct page_cache_format *pcf;
 
-	if (STREQ(pc->live_memsrc, "/dev/mem")) {
-	    	if (machine_type("X86") || machine_type("X86_64")) {
-			if (readmem(255*PAGESIZE(), PHYSADDR, &tmp,
-			    sizeof(long), "devmem_is_allowed - pfn 255",
-			    QUIET|RETURN_ON_ERROR|NO_DEVMEM_SWITCH) &&
-			    !(readmem(257*PAGESIZE(), PHYSADDR, &tmp,
-			    sizeof(long), "devmem_is_allowed - pfn 257",
-			    QUIET|RETURN_ON_ERROR|NO_DEVMEM_SWITCH)))
-				restricted = TRUE;
-		} 
-		if (kernel_symbol_exists("jiffies") &&
-		    !readmem(symbol_value("jiffies"), KVADDR, &tmp,
-		    sizeof(ulong), "devmem_is_allowed - jiffies", 
-		    QUIET|RETURN_ON_ERROR|NO_DEVMEM_SWITCH))
-			restricted = TRUE;
+	if (!page_cache.budget)
+		return NULL;
 
-		if (restricted && CRASHDEBUG(1))
-			error(INFO, 
- 	    		    "this kernel may be configured with CONFIG_STRICT_DEVMEM,"
-			    " which\n       renders /dev/mem unusable as a live memory "
-			    "source.\n");
+	if ((ACTIVE() || REMOTE_MEMSRC()) && (pc->readmem != read_daemon) &&
+	    ((page_cache.live_window == LIVE_CACHE_OFF) || REMOTE_MEMSRC()))
+		return NULL;
+
+	if (!page_cache.format || (page_cache.format->readmem != pc->readmem)) {
+		for (pcf = page_cache_formats; pcf->readmem; pcf++)
+			if (pcf->readmem == pc->readmem)
+				break;
+		if (!pcf->readmem)
+			return NULL;
+		if (page_cache.format)
+			page_cache_free();
+		page_cache.format = pcf;
 	}
 
-	return restricted;
+	if (page_cache.format->flags & PAGE_CACHE_DELEGATED)
+		return NULL;
+
+	if ((page_cache.format->flags & PAGE_CACHE_LIVE) &&
+	    (!ACTIVE() || (page_cache.live_window == LIVE_CACHE_OFF)))
+		return NULL;
+
+	if (!page_cache.entries) {
+		if (!(nr_pages = page_cache.budget / PAGESIZE()))
+			return NULL;
+		page_cache.nr_pages = MIN(nr_pages, (ulong)PAGE_CACHE_NO_ENTRY - 1);
+		for (page_cache.nr_hash = 64;
+		     page_cache.nr_hash < page_cache.nr_pages;
+		     page_cache.nr_hash <<= 1)
+			;
+		page_cache.entries = calloc(page_cache.nr_pages,
+			sizeof(struct page_cache_entry));
+		page_cache.hash = malloc(page_cache.nr_hash * sizeof(uint));
+		page_cache.data = malloc(page_cache.nr_pages * PAGESIZE());
+		if (!page_cache.entries || !page_cache.hash || !page_cache.data) {
+			page_cache_free();
+			page_cache.size = page_cache.budget = 0;
+			error(INFO, "cannot malloc page cache: disabled\n");
+			return NULL;
+		}
+		for (i = 0; i < page_cache.nr_hash; i++)
+			page_cache.hash[i] = PAGE_CACHE_NO_ENTRY;
+		page_cache.live_cmdgen = pc->cmdgencur;
+		page_cache.live_start = time(NULL);
+	}
+
+	if ((page_cache.format->flags & PAGE_CACHE_LIVE) &&
+	    !page_cache_live_valid())
+		page_cache_clear();
+
+	return page_cache.format;
 }
 
-static int
-switch_to_proc_kcore(void)
+/*
+ *  Return the cache entry of the page at ppage, or PAGE_CACHE_NO_ENTRY.
+ *  Called with the lock held.
+ */
+static uint
+page_cache_find(physaddr_t ppage)
 {
-	close(pc->mfd);
-
-	if (file_exists("/proc/kcore", NULL)) {
-		if (CRASHDEBUG(1))
-			error(INFO, "trying /proc/kcore as an alternative to /dev/mem\n\n");
-	} else
-		return FALSE;
+	uint i;
 
-	if ((pc->mfd = open("/proc/kcore", O_RDONLY)) < 0) {
-		error(INFO, "/proc/kcore: %s\n", strerror(errno));
-		return FALSE;
-	}
-	if (!proc_kcore_init(fp, pc->mfd)) {
-		error(INFO, "/proc/kcore: initialization failed\n");
-		return FALSE;
+	for (i = page_cache.hash[page_cache_bucket(ppage)];
+	     i != PAGE_CACHE_NO_ENTRY; i = page_cache.entries[i].next) {
+		if (page_cache.entries[i].paddr == ppage)
+			break;
 	}
 
-	pc->flags &= ~DEVMEM;
-	pc->flags |= PROC_KCORE;
-	pc->readmem = read_proc_kcore;
-	pc->writemem = write_proc_kcore;
-	pc->live_memsrc = "/proc/kcore";
-
-	return TRUE;
+	return i;
 }
 
 /*
- *  Read from memory driver.
+ *  Copy cnt bytes at paddr from the cache if its page is there.  Called
+ *  with the lock held.
  */
-int
-read_memory_device(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr)
+static int
+page_cache_lookup(physaddr_t paddr, void *bufptr, int cnt)
 {
-	if (pc->curcmd_flags & XEN_MACHINE_ADDR)
-		return READ_ERROR;
-
-        if (!machdep->verify_paddr(paddr)) {
-                if (CRASHDEBUG(1))
-                        error(INFO, "verify_paddr(%lx) failed\n", paddr);
-                return READ_ERROR;
-        }
+	uint i;
 
-        lseek(fd, (loff_t)paddr, SEEK_SET); 
+	if ((i = page_cache_find(paddr - PAGEOFFSET(paddr))) == PAGE_CACHE_NO_ENTRY)
+		return FALSE;
 
-        if (read(fd, bufptr, cnt) != cnt) 
-                return READ_ERROR;
+	page_cache.entries[i].referenced = TRUE;
+	memcpy(bufptr, page_cache.data + (i * PAGESIZE()) + PAGEOFFSET(paddr), cnt);
 
-        return cnt;
+	return TRUE;
 }
 
 /*
- *  Write to memory driver.  
+ *  Enter a copy of the complete page at ppage.  Called with the lock held.
  */
-int
-write_memory_device(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr)
+static void
+page_cache_enter(physaddr_t ppage, void *page)
 {
-	if (!(MEMORY_DRIVER_DEVICE_MODE & S_IWUSR))
-        	return (error(FATAL, "cannot write to %s!\n", pc->live_memsrc));
+	uint i, *link;
+	struct page_cache_entry *pce;
 
-        if (lseek(fd, (loff_t)paddr, SEEK_SET) == -1)
-                return SEEK_ERROR;
+	if (page_cache.used < page_cache.nr_pages)
+		i = page_cache.used++;
+	else {
+		for (;;) {
+			pce = &page_cache.entries[page_cache.hand];
+			if (!pce->referenced)
+				break;
+			pce->referenced = FALSE;
+			page_cache.hand = (page_cache.hand + 1) % page_cache.nr_pages;
+		}
+		i = page_cache.hand;
+		page_cache.hand = (page_cache.hand + 1) % page_cache.nr_pages;
 
-        if (write(fd, bufptr, cnt) != cnt)
-                return WRITE_ERROR;
+		for (link = &page_cache.hash[page_cache_bucket(pce->paddr)];
+		     *link != i; link = &page_cache.entries[*link].next)
+			;
+		*link = pce->next;
+		page_cache.evictions++;
+	}
 
-        return cnt;
+	pce = &page_cache.entries[i];
+	pce->paddr = ppage;
+	pce->referenced = FALSE;
+	pce->next = page_cache.hash[page_cache_bucket(ppage)];
+	page_cache.hash[page_cache_bucket(ppage)] = i;
+	memcpy(page_cache.data + (i * PAGESIZE()), page, PAGESIZE());
 }
 
 /*
- *  Read from an MCLX formatted dumpfile.
+ *  The readmem() side of the cache.  The page is read into a separate
+ *  buffer, since the format reader may call readmem() recursively.  If
+ *  the complete page cannot be read, e.g. at the end of a truncated
+ *  dumpfile, the request is passed on as is.
  */
-int
-read_mclx_dumpfile(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr) 
+static int
+page_cache_read(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr)
 {
-        if (vas_lseek((ulong)paddr, SEEK_SET)) 
-		return SEEK_ERROR;
-        
-        if (vas_read((void *)bufptr, cnt) != cnt) 
-		return READ_ERROR;
+	int ret;
+	char *page;
+	physaddr_t ppage;
+	struct page_cache_format *pcf;
 
-	return cnt;
+	if (pc->curcmd_flags & XEN_MACHINE_ADDR)
+		return readmem_backend(fd, bufptr, cnt, addr, paddr);
+
+	pthread_mutex_lock(&page_cache.lock);
+	if (!(pcf = page_cache_format())) {
+		pthread_mutex_unlock(&page_cache.lock);
+		return readmem_backend(fd, bufptr, cnt, addr, paddr);
+	}
+	if (page_cache_lookup(paddr, bufptr, cnt)) {
+		pcf->hits++;
+		pthread_mutex_unlock(&page_cache.lock);
+		if (READMEM_PROFILING())
+			readmem_profile.page_cache_hits++;
+		return cnt;
+	}
+	pcf->misses++;
+	pthread_mutex_unlock(&page_cache.lock);
+
+	ppage = paddr - PAGEOFFSET(paddr);
+	if (!(page = malloc(PAGESIZE())))
+		return readmem_backend(fd, bufptr, cnt, addr, paddr);
+
+	ret = readmem_backend(fd, page, PAGESIZE(), addr ? addr - PAGEOFFSET(paddr) : 0,
+		ppage);
+
+	if (ret == PAGESIZE()) {
+		memcpy(bufptr, page + PAGEOFFSET(paddr), cnt);
+		pthread_mutex_lock(&page_cache.lock);
+		if (page_cache_format() == pcf)
+			page_cache_enter(ppage, page);
+		pthread_mutex_unlock(&page_cache.lock);
+		ret = cnt;
+	} else if (ret != PAGE_EXCLUDED) {
+		pthread_mutex_lock(&page_cache.lock);
+		pcf->passthrough++;
+		pthread_mutex_unlock(&page_cache.lock);
+		ret = readmem_backend(fd, bufptr, cnt, addr, paddr);
+	}
+
+	free(page);
+	return ret;
 }
 
 /*
- *  Write to an MCLX formatted dumpfile.  This only modifies the buffered 
- *  copy only; if it gets flushed, the modification is lost.
+ *  Enter a complete page that a format reader has read ahead of the
+ *  current request, unless it is cached already.
  */
-int
-write_mclx_dumpfile(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr)
+void
+page_cache_prefill(physaddr_t ppage, void *page)
 {
-        if (vas_lseek((ulong)paddr, SEEK_SET)) 
-        	return SEEK_ERROR;
-                                
-        if (vas_write((void *)bufptr, cnt) != cnt) 
-		return WRITE_ERROR;
+	struct page_cache_format *pcf;
 
-	return cnt;
+	pthread_mutex_lock(&page_cache.lock);
+	if ((pcf = page_cache_format()) && (pcf->readmem == pc->readmem) &&
+	    (page_cache_find(ppage) == PAGE_CACHE_NO_ENTRY))
+		page_cache_enter(ppage, page);
+	pthread_mutex_unlock(&page_cache.lock);
 }
 
 /*
- *  Read from an LKCD formatted dumpfile.
+ *  The readmem_ctx() side of the cache: only pages that are already
+ *  cached are used, so that readmem_ctx() threads do not evict the pages
+ *  that the commands themselves work with.
  */
 int
-read_lkcd_dumpfile(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr) 
+page_cache_read_ctx(struct readmem_context *ctx, physaddr_t paddr,
+		    void *bufptr, int cnt)
 {
-	set_lkcd_fp(fp);
+	int found;
+	struct page_cache_format *pcf;
 
-        if (!lkcd_lseek(paddr)) 
-		return SEEK_ERROR;
-        
-        if (lkcd_read((void *)bufptr, cnt) != cnt) 
-		return READ_ERROR;
+	found = FALSE;
 
-	return cnt;
+	pthread_mutex_lock(&page_cache.lock);
+	if ((pcf = page_cache.format) && page_cache.entries &&
+	    (pcf->readmem == pc->readmem) &&
+	    (!(pcf->flags & PAGE_CACHE_LIVE) ||
+	     ((page_cache.live_window != LIVE_CACHE_OFF) && page_cache_live_valid())) &&
+	    (found = page_cache_lookup(paddr, bufptr, cnt)))
+		pcf->hits++;
+	pthread_mutex_unlock(&page_cache.lock);
+
+	return found;
+}
+
+void
+page_cache_flush(void)
+{
+	pthread_mutex_lock(&page_cache.lock);
+	page_cache_clear();
+	pthread_mutex_unlock(&page_cache.lock);
 }
 
 /*
- *  Write to an LKCD formatted dumpfile.  (dummy routine -- not allowed)
+ *  Handle "set live_cache off | command | seconds".
  */
-int
-write_lkcd_dumpfile(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr) 
+void
+page_cache_set_live(int window)
 {
-	return (error(FATAL, "cannot write to an LKCD compressed dump!\n"));
+	pthread_mutex_lock(&page_cache.lock);
+	page_cache_clear();
+	page_cache.live_window = window;
+	pthread_mutex_unlock(&page_cache.lock);
 }
 
+int
+page_cache_live(void)
+{
+	return page_cache.live_window;
+}
 
 /*
- *  Read from network daemon.
+ *  Handle "set page_cache size".  A size of 0 turns the cache off.
  */
-int
-read_daemon(int fd, void *bufptr, int cnt, ulong vaddr, physaddr_t paddr) 
+void
+page_cache_set_size(ulonglong bytes)
 {
-	if (remote_memory_read(pc->rmfd, bufptr, cnt, paddr, -1) == cnt)
-		return cnt;
-
-	if (!IS_VMALLOC_ADDR(vaddr) || DUMPFILE())
-		return READ_ERROR;
-
-        /*
-         *  On 32-bit architectures w/memory above ~936MB,
-         *  that memory can only be accessed via vmalloc'd
-         *  addresses.  However, /dev/mem returns 0 bytes,
-         *  and non-reserved memory pages can't be mmap'd, so
-         *  the only alternative is to read it from /dev/kmem.
-         */
-
-	if (BITS32() && remote_memory_read(pc->rkfd, bufptr, cnt, vaddr, -1) == cnt)
-                return cnt;
+	pthread_mutex_lock(&page_cache.lock);
+	page_cache_free();
+	page_cache.size = bytes;
+	page_cache.budget = memory_limit_cap(bytes);
+	pthread_mutex_unlock(&page_cache.lock);
 
-	return READ_ERROR;
+	diskdump_set_cache_size(bytes);
 }
 
 /*
- *  Write to network daemon.
+ *  Reallocate the page caches at their current sizes, as limited by
+ *  "set memlimit".
  */
-int
-write_daemon(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr) 
+static void
+page_cache_resize(void)
 {
-	return (error(FATAL, "writing to daemon not supported yet [TBD]\n"));
+	pthread_mutex_lock(&page_cache.lock);
+	page_cache_free();
+	page_cache.budget = memory_limit_cap(page_cache.size);
+	pthread_mutex_unlock(&page_cache.lock);
+
+	diskdump_cache_resize();
 }
 
 /*
- *  Turn the memtype bitmask into a string.
+ *  The page cache is sized when it is allocated, so its use is read
+ *  without taking the lock, which memory_limit_cap() callers hold.
  */
-static
-char *memtype_string(int memtype, int debug)
+static ulonglong
+page_cache_memory_used(void)
 {
-	static char membuf[40];
+	return (ulonglong)page_cache.nr_pages *
+		(PAGESIZE() + sizeof(struct page_cache_entry)) +
+		page_cache.nr_hash * sizeof(uint);
+}
 
-	switch (memtype)
-	{
-	case UVADDR:
-		sprintf(membuf, debug ? "UVADDR" : "user virtual");
-		break;
-	case KVADDR:
-		sprintf(membuf, debug ? "KVADDR" : "kernel virtual");
-		break;
-	case PHYSADDR:
-		sprintf(membuf, debug ? "PHYSADDR" : "physical");
-		break;
-	case XENMACHADDR:
-		sprintf(membuf, debug ? "XENMACHADDR" : "xen machine");
-		break;
-	case FILEADDR:
-		sprintf(membuf, debug ? "FILEADDR" : "dumpfile");
-		break;
-	default:
-		if (debug)
-			sprintf(membuf, "0x%x (?)", memtype);
-		else
-			sprintf(membuf, "unknown");
-		break;
-	}
+ulonglong
+page_cache_size(void)
+{
+	if (pc->readmem == read_diskdump)
+		return diskdump_cache_size();
 
-	return membuf;
+	return page_cache.size;
 }
 
 /*
- *  Turn the error_handle bitmask into a string,
- *  Note: FAULT_ON_ERROR == 0
+ *  Display the page cache statistics for "help -D".
  */
-static
-char *error_handle_string(ulong error_handle)
+void
+dump_page_cache(void)
 {
-        static char ebuf[20];
-	int others;
-
-	sprintf(ebuf, "(");
-	others = 0;
-
-	if (error_handle & RETURN_ON_ERROR)
-		sprintf(&ebuf[strlen(ebuf)], "%sROE", others++ ? "|" : "");
-	if (error_handle & FAULT_ON_ERROR)
-		sprintf(&ebuf[strlen(ebuf)], "%sFOE", others++ ? "|" : "");
-	if (error_handle & QUIET)
-		sprintf(&ebuf[strlen(ebuf)], "%sQ", others++ ? "|" : "");
-	if (error_handle & HEX_BIAS)
-		sprintf(&ebuf[strlen(ebuf)], "%sHB", others++ ? "|" : "");
-	if (error_handle & RETURN_PARTIAL)
-		sprintf(&ebuf[strlen(ebuf)], "%sRP", others++ ? "|" : "");
-	if (error_handle & NO_DEVMEM_SWITCH)
-		sprintf(&ebuf[strlen(ebuf)], "%sNDS", others++ ? "|" : "");
-
-	strcat(ebuf, ")");
-
-        return ebuf;
+	ulong lookups;
+	struct page_cache_format *pcf;
+
+	fprintf(fp, "\n            page_cache: %lld bytes\n", page_cache.size);
+	if (page_cache.budget != page_cache.size)
+		fprintf(fp, "                budget: %lld bytes (memlimit)\n",
+			page_cache.budget);
+	fprintf(fp, "                 pages: %ld of %ld\n", page_cache.used,
+		page_cache.nr_pages);
+	fprintf(fp, "           hash chains: %ld\n", page_cache.nr_hash);
+	fprintf(fp, "             evictions: %ld\n", page_cache.evictions);
+	fprintf(fp, "               flushes: %ld\n", page_cache.flushes);
+	if (page_cache.live_window == LIVE_CACHE_COMMAND)
+		fprintf(fp, "            live_cache: command\n");
+	else if (page_cache.live_window != LIVE_CACHE_OFF)
+		fprintf(fp, "            live_cache: %d seconds\n",
+			page_cache.live_window);
+
+	for (pcf = page_cache_formats; pcf->readmem; pcf++) {
+		if (!pcf->hits && !pcf->misses && (pcf != page_cache.format))
+			continue;
+		lookups = pcf->hits + pcf->misses;
+		fprintf(fp, "  %20s: ", pcf->name);
+		if (pcf->flags & PAGE_CACHE_DELEGATED) {
+			fprintf(fp, "(format page cache)\n");
+			continue;
+		}
+		fprintf(fp, "hits: %ld  misses: %ld  passthrough: %ld  "
+			"hit rate: %ld%%\n", pcf->hits, pcf->misses,
+			pcf->passthrough, lookups ? (pcf->hits * 100) / lookups : 0);
+	}
 }
 
-
 /*
- *  Sister routine to readmem().
+ *  Accept anything...
  */
-
 int
-writemem(ulonglong addr, int memtype, void *buffer, long size,
-	char *type, ulong error_handle)
+generic_verify_paddr(physaddr_t paddr)
 {
-	int fd;
-	long cnt;
-	physaddr_t paddr;
-	char *bufptr;
+	return TRUE;
+}
 
-        if (CRASHDEBUG(1))
-		fprintf(fp, "writemem: %llx, %s, \"%s\", %ld, %s %lx\n", 
-			addr, memtype_string(memtype, 1), type, size, 
-			error_handle_string(error_handle), (ulong)buffer);
+/*
+ *  Read from /dev/mem.
+ */
+int
+read_dev_mem(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr) 
+{
+	int readcnt;
 
-	if (size < 0) {
-		if (PRINT_ERROR_MESSAGE)
-                       	error(INFO, "invalid size request: %ld\n", size);
-		goto writemem_error;
+	if (!machdep->verify_paddr(paddr)) {
+		if (CRASHDEBUG(1) && !STREQ(pc->curcmd, "search"))
+			error(INFO, "verify_paddr(%lx) failed\n", paddr);
+		return READ_ERROR;
 	}
 
-	bufptr = (char *)buffer;
-
-	fd = ACTIVE() ? pc->mfd : pc->dfd;
-
 	/*
-	 * Screen out any error conditions.
-	 */
-        switch (memtype)
-        {
-        case UVADDR:
-                if (!CURRENT_CONTEXT()) {
-                        if (PRINT_ERROR_MESSAGE)
-                                error(INFO, "no current user process\n");
-                        goto writemem_error;
-                }
-                if (!IS_UVADDR(addr, CURRENT_CONTEXT())) {
-                        if (PRINT_ERROR_MESSAGE)
-                                error(INFO, INVALID_UVADDR, addr, type);
-                        goto writemem_error;
-                }
-                break;
-
-        case KVADDR:
-                if (!IS_KVADDR(addr)) {
-                        if (PRINT_ERROR_MESSAGE)
-                                error(INFO, INVALID_KVADDR, addr, type);
-                        goto writemem_error;
-                }
-                break;
-
-        case PHYSADDR:
-                break;
-
-
-	case FILEADDR:
-		return generic_write_dumpfile(addr, buffer, size, type, error_handle);
-        }
-
-        while (size > 0) {
-                switch (memtype)
-                {
-                case UVADDR:
-                        if (!uvtop(CURRENT_CONTEXT(), addr, &paddr, 0)) {
-                                if (PRINT_ERROR_MESSAGE)
-                                        error(INFO, INVALID_UVADDR, addr, type);
-                                goto writemem_error;
-                        }
-                        break;
-
-                case KVADDR:
-                        if (!kvtop(CURRENT_CONTEXT(), addr, &paddr, 0)) {
-                                if (PRINT_ERROR_MESSAGE)
-                                        error(INFO, INVALID_KVADDR, addr, type);
-                                goto writemem_error;
-                        }
-                        break;
-
-                case PHYSADDR:
-                        paddr = addr;
-                        break;
-                }
-
-		/* 
-		 *  Compute bytes till end of page.
-		 */
-		cnt = PAGESIZE() - PAGEOFFSET(paddr); 
-
-                if (cnt > size)
-                        cnt = size;
+	 *  /dev/mem disallows anything >= __pa(high_memory)
+	 *
+         *  However it will allow 64-bit lseeks to anywhere, and when followed
+	 *  by pulling a 32-bit address from the 64-bit file position, it
+	 *  quietly returns faulty data from the (wrapped-around) address.
+  	 */
+	if (vt->high_memory && (paddr >= (physaddr_t)(VTOP(vt->high_memory)))) {
+		readcnt = 0;
+		errno = 0;
+		goto try_dev_kmem;
+	}
 
-		switch (pc->writemem(fd, bufptr, cnt, addr, paddr))
-		{
-		case SEEK_ERROR:
-                        if (PRINT_ERROR_MESSAGE)
-                                error(INFO, SEEK_ERRMSG, memtype_string(memtype, 0), addr, type);
-                        goto writemem_error;
-			
-		case WRITE_ERROR:
-                        if (PRINT_ERROR_MESSAGE)
-                                error(INFO, WRITE_ERRMSG, memtype_string(memtype, 0), addr, type);
-                        goto writemem_error;
+	if (lseek(fd, (off_t)paddr, SEEK_SET) == -1) 
+		return SEEK_ERROR;
 
-		default:
-			break;
-		}
+next_read:
+        errno = 0;
+        readcnt = read(fd, bufptr, cnt);
 
-                addr += cnt;
-                bufptr += cnt;
-                size -= cnt;
-        }
+	if ((readcnt != cnt) && CRASHDEBUG(4)) {
+		if (errno)
+			perror("/dev/mem");
+		error(INFO, "read(/dev/mem, %lx, %ld): %ld (%lx)\n",
+			paddr, cnt, readcnt, readcnt);	
+	}
 
-        return TRUE;
+try_dev_kmem:
+        /*
+         *  On 32-bit intel architectures high memory can can only be accessed
+	 *  via vmalloc'd addresses.  However, /dev/mem returns 0 bytes, and
+	 *  non-reserved memory pages can't be mmap'd, so the only alternative
+	 *  is to read it from /dev/kmem.
+         */
+        if ((readcnt != cnt) && BITS32() && !readcnt && !errno && 
+	    IS_VMALLOC_ADDR(addr))
+                readcnt = read_dev_kmem(addr, bufptr, cnt);
 
-writemem_error:
-	
-        switch (error_handle)
-        {
-        case (FAULT_ON_ERROR):
-        case (QUIET|FAULT_ON_ERROR):
-                RESTART();
+	/*
+	 *  The 2.6 valid_phys_addr_range() can potentially shorten the 
+	 *  count of a legitimate read request.  So far this has only been
+	 *  seen on an ia64 where a kernel page straddles an EFI segment.
+	 */
+	if ((readcnt != cnt) && readcnt && (machdep->flags & DEVMEMRD) && 
+	     !errno) {
+		if (CRASHDEBUG(1) && !STREQ(pc->curcmd, "search"))
+			error(INFO, "read(/dev/mem, %lx, %ld): %ld (%lx)\n",
+				paddr, cnt, readcnt, readcnt);	
+		cnt -= readcnt;
+		bufptr += readcnt;
+		goto next_read;
+	}
 
-        case (RETURN_ON_ERROR):
-	case (QUIET|RETURN_ON_ERROR):
-		break;
-        }
+        if (readcnt != cnt) 
+		return READ_ERROR;
 
-	return FALSE;
+	return readcnt;
 }
 
 /*
- *  When /dev/mem won't allow access, try /dev/kmem.  
+ *  Write to /dev/mem.
  */
-static ssize_t
-read_dev_kmem(ulong vaddr, char *bufptr, long cnt)
+int
+write_dev_mem(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr) 
 {
-	ssize_t readcnt;
-
-	if (pc->kfd < 0) {
-		if ((pc->kfd = open("/dev/kmem", O_RDONLY)) < 0)
-			return 0; 
+	if (!machdep->verify_paddr(paddr)) {
+		if (CRASHDEBUG(1))
+			error(INFO, "verify_paddr(%lx) failed\n", paddr);
+		return WRITE_ERROR;
 	}
 
-	if (lseek(pc->kfd, vaddr, SEEK_SET) == -1) 
-		return 0;
+        if (lseek(fd, (off_t)paddr, SEEK_SET) == -1) 
+		return SEEK_ERROR;
 
-	readcnt = read(pc->kfd, bufptr, cnt);
-	if (readcnt != cnt)
-		readcnt = 0;
+        if (write(fd, bufptr, cnt) != cnt) 
+		return WRITE_ERROR;
 
-	return readcnt;
+	return cnt;
 }
 
 /*
- *  Generic dumpfile read/write functions to handle FILEADDR 
- *  memtype arguments to readmem() and writemem().  These are
- *  not to be confused with pc->readmem/writemem plug-ins.
+ *  The first required reads of memory are done in kernel_init(),
+ *  so if there's a fatal read error of /dev/mem, display a warning
+ *  message if it appears that CONFIG_STRICT_DEVMEM is in effect.
+ *  On x86 and x86_64, only the first 256 pages of physical memory
+ *  are accessible:
+ *
+ *    #ifdef CONFIG_STRICT_DEVMEM
+ *    int devmem_is_allowed(unsigned long pagenr)
+ *    {
+ *            if (pagenr <= 256)
+ *                    return 1;
+ *            if (!page_is_ram(pagenr))
+ *                    return 1;
+ *            return 0;
+ *    }
+ *    #endif
+ *
+ *  It would probably suffice to simply check for the existence of 
+ *  devmem_is_allowed(), but on x86 and x86_64 verify pfn 256 reads OK,
+ *  and 257 fails.
+ *
+ *  Update: a patch has been posted to LKML to fix the off-by-one error
+ *  by changing "<= 256" to "< 256":
+ *
+ *     https://lkml.org/lkml/2012/8/28/357
+ *
+ *  The X86/X86_64 lower-boundary pfn check below has been changed 
+ *  (preemptively) from 256 to 255.
+ *
+ *  In any case, if that x86/x86_64 check fails to prove CONFIG_STRICT_DEVMEM 
+ *  is configured, then the function will check that "jiffies" can be read,
+ *  as is done for the other architectures.
+ *
  */
-static int 
-generic_read_dumpfile(ulonglong addr, void *buffer, long size, char *type, 
-	ulong error_handle)
+static int
+devmem_is_restricted(void)
 {
-	int fd;
-	int retval;
-
-	retval = TRUE;
-
-	if (!pc->dumpfile)
-		error(FATAL, "command requires a dumpfile\n");
+	long tmp;
+	int restricted;
 
-	if ((fd = open(pc->dumpfile, O_RDONLY)) < 0)
-		error(FATAL, "%s: %s\n", pc->dumpfile,
-			strerror(errno));
 
-	if (lseek(fd, addr, SEEK_SET) == -1) {
-		if (PRINT_ERROR_MESSAGE)
-                	error(INFO, SEEK_ERRMSG, 
-				memtype_string(FILEADDR, 0), addr, type);
-		retval = FALSE;
-	} else if (read(fd, buffer, size) != size) {
-		if (PRINT_ERROR_MESSAGE)
-			error(INFO, READ_ERRMSG, 
-				memtype_string(FILEADDR, 0), addr, type);
-		retval = FALSE;
+	/*
+	 *  Check for pre-CONFIG_STRICT_DEVMEM kernels.
+	 */
+	if (!kernel_symbol_exists("devmem_is_allowed")) {
+		if (machine_type("ARM") || machine_type("ARM64") ||
+		    machine_type("X86") || machine_type("X86_64") ||
+		    machine_type("PPC") || machine_type("PPC64"))
+			return FALSE;
 	}
 
-	close(fd);
+	restricted = FALSE;
 
-	return retval;
-}
+	if (STREQ(pc->live_memsrc, "/dev/mem")) {
+	    	if (machine_type("X86") || machine_type("X86_64")) {
+			if (readmem(255*PAGESIZE(), PHYSADDR, &tmp,
+			    sizeof(long), "devmem_is_allowed - pfn 255",
+			    QUIET|RETURN_ON_ERROR|NO_DEVMEM_SWITCH) &&
+			    !(readmem(257*PAGESIZE(), PHYSADDR, &tmp,
+			    sizeof(long), "devmem_is_allowed - pfn 257",
+			    QUIET|RETURN_ON_ERROR|NO_DEVMEM_SWITCH)))
+				restricted = TRUE;
+		} 
+		if (kernel_symbol_exists("jiffies") &&
+		    !readmem(symbol_value("jiffies"), KVADDR, &tmp,
+		    sizeof(ulong), "devmem_is_allowed - jiffies", 
+		    QUIET|RETURN_ON_ERROR|NO_DEVMEM_SWITCH))
+			restricted = TRUE;
 
-static int 
-generic_write_dumpfile(ulonglong addr, void *buffer, long size, char *type, 
-	ulong error_handle)
-{
-	int fd;
-	int retval;
+		if (restricted && CRASHDEBUG(1))
+			error(INFO, 
+ 	    		    "this kernel may be configured with CONFIG_STRICT_DEVMEM,"
+			    " which\n       renders /dev/mem unusable as a live memory "
+			    "source.\n");
+	}
 
-	retval = TRUE;
+	return restricted;
+}
 
-	if (!pc->dumpfile)
-		error(FATAL, "command requires a dumpfile\n");
+static int
+switch_to_proc_kcore(void)
+{
+	close(pc->mfd);
 
-	if ((fd = open(pc->dumpfile, O_WRONLY)) < 0)
-		error(FATAL, "%s: %s\n", pc->dumpfile,
-			strerror(errno));
+	if (file_exists("/proc/kcore", NULL)) {
+		if (CRASHDEBUG(1))
+			error(INFO, "trying /proc/kcore as an alternative to /dev/mem\n\n");
+	} else
+		return FALSE;
 
-	if (lseek(fd, addr, SEEK_SET) == -1) {
-		if (PRINT_ERROR_MESSAGE)
-                	error(INFO, SEEK_ERRMSG, 
-				memtype_string(FILEADDR, 0), addr, type);
-		retval = FALSE;
-	} else if (write(fd, buffer, size) != size) {
-		if (PRINT_ERROR_MESSAGE)
-			error(INFO, WRITE_ERRMSG, 
-				memtype_string(FILEADDR, 0), addr, type);
-		retval = FALSE;
+	if ((pc->mfd = open("/proc/kcore", O_RDONLY)) < 0) {
+		error(INFO, "/proc/kcore: %s\n", strerror(errno));
+		return FALSE;
+	}
+	if (!proc_kcore_init(fp, pc->mfd)) {
+		error(INFO, "/proc/kcore: initialization failed\n");
+		return FALSE;
 	}
 
-	close(fd);
+	pc->flags &= ~DEVMEM;
+	pc->flags |= PROC_KCORE;
+	pc->readmem = read_proc_kcore;
+	pc->writemem = write_proc_kcore;
+	pc->live_memsrc = "/proc/kcore";
 
-	return retval;
+	return TRUE;
 }
 
 /*
- *  Translates a kernel virtual address to its physical address.  cmd_vtop()
- *  sets the verbose flag so that the pte translation gets displayed; all 
- *  other callers quietly accept the translation.
+ *  Read from memory driver.
  */
 int
-kvtop(struct task_context *tc, ulong kvaddr, physaddr_t *paddr, int verbose)
+read_memory_device(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr)
 {
-	physaddr_t unused;
+	if (pc->curcmd_flags & XEN_MACHINE_ADDR)
+		return READ_ERROR;
 
-	return (machdep->kvtop(tc ? tc : CURRENT_CONTEXT(), kvaddr, 
-		paddr ? paddr : &unused, verbose));
-}
+        if (!machdep->verify_paddr(paddr)) {
+                if (CRASHDEBUG(1))
+                        error(INFO, "verify_paddr(%lx) failed\n", paddr);
+                return READ_ERROR;
+        }
 
+        lseek(fd, (loff_t)paddr, SEEK_SET); 
 
-/*
- *  Translates a user virtual address to its physical address.  cmd_vtop()
- *  sets the verbose flag so that the pte translation gets displayed; all 
- *  other callers quietly accept the translation.
- *
- *  This routine can also take mapped kernel virtual addresses if the -u flag
- *  was passed to cmd_vtop().  If so, it makes the translation using the
- *  kernel-memory PGD entry instead of swapper_pg_dir.
- */
-int
-uvtop(struct task_context *tc, ulong vaddr, physaddr_t *paddr, int verbose)
-{
-	return(machdep->uvtop(tc, vaddr, paddr, verbose));
+        if (read(fd, bufptr, cnt) != cnt) 
+                return READ_ERROR;
+
+        return cnt;
 }
 
 /*
- *  The vtop command does a verbose translation of a user or kernel virtual
- *  address into it physical address.  The pte translation is shown by
- *  passing the VERBOSE flag to kvtop() or uvtop().  If it's a user virtual
- *  address, the vm_area_struct data containing the page is displayed.
- *  Lastly, the mem_map[] page data containing the address is displayed.
+ *  Set once the memory driver has turned down a DEV_CRASH_READ_VEC
+ *  request, i.e., if it is older than version 1.6.
  */
+static int memory_device_no_read_vec = FALSE;
 
-void
-cmd_vtop(void)
-{
-	int c;
-	ulong vaddr, context;
-	int others;
-	ulong vtop_flags, loop_vtop_flags;
-	struct task_context *tc;
-
-	vtop_flags = loop_vtop_flags = 0;
-	tc = NULL;
+#define MEMORY_DEVICE_VEC_RANGES  (256)
 
-        while ((c = getopt(argcnt, args, "ukc:")) != EOF) {
-                switch(c)
-		{
-		case 'c':
-	                switch (str_to_context(optarg, &context, &tc))
-	                {
-	                case STR_PID:
-	                case STR_TASK:
-				vtop_flags |= USE_USER_PGD;
-	                        break;
-	
-	                case STR_INVALID:
-	                        error(FATAL, "invalid task or pid value: %s\n",
-	                                optarg);
-	                        break;
-	                }
-			break;
+static int
+memory_device_readv(int fd, struct dev_crash_read_range *ranges, int nr_ranges)
+{
+	struct dev_crash_read_vec vec;
 
-		case 'u':
-			vtop_flags |= UVADDR;
-			break;
+	vec.nr_ranges = nr_ranges;
+	vec.ranges = (ulong)ranges;
+	vec.bytes_read = 0;
 
-		case 'k':
-			vtop_flags |= KVADDR;
-			break;
+	if (ioctl(fd, DEV_CRASH_READ_VEC, &vec) == 0)
+		return TRUE;
 
-		default:
-			argerrs++;
-			break;
-		}
+	if ((errno == EINVAL) || (errno == ENOTTY)) {
+		memory_device_no_read_vec = TRUE;
+		if (CRASHDEBUG(1))
+			error(INFO, "%s: vectored reads not supported\n",
+				pc->live_memsrc);
 	}
 
-	if (argerrs || !args[optind])
-		cmd_usage(pc->curcmd, SYNOPSIS);
-
-	if (!tc && !(tc = CURRENT_CONTEXT())) 
-      		error(FATAL, "no current user process\n");
+	return FALSE;
+}
 
-	if ((vtop_flags & (UVADDR|KVADDR)) == (UVADDR|KVADDR))
-		error(FATAL, "-u and -k options are mutually exclusive\n");
+/*
+ *  Read a request that spans pages from the memory driver with as few
+ *  DEV_CRASH_READ_VEC requests as possible, passing each run of pages
+ *  that are contiguous in physical memory as a single range.  If this
+ *  cannot be done, FALSE is returned, and readmem() goes on to read the
+ *  request a page at a time, and to report the failing page.
+ */
+static int
+read_memory_device_vec(int fd, ulonglong addr, int memtype, char *bufptr,
+	long size)
+{
+	struct dev_crash_read_range ranges[MEMORY_DEVICE_VEC_RANGES];
+	struct dev_crash_read_range *r;
+	physaddr_t paddr;
+	long cnt;
+	int n;
 
-	others = 0;
-        while (args[optind]) {
-		vaddr = htol(args[optind], FAULT_ON_ERROR, NULL);
+	if (memory_device_no_read_vec || (pc->curcmd_flags & XEN_MACHINE_ADDR))
+		return FALSE;
 
-		if (!(vtop_flags & (UVADDR|KVADDR))) {
-			switch (vaddr_type(vaddr, tc))
-			{
-                	case UVADDR:
-				loop_vtop_flags = UVADDR;
-                        	break;
-                	case KVADDR:
-				loop_vtop_flags = KVADDR;
-                        	break;
-                	case AMBIGUOUS:
-                        	error(FATAL,
-                                "ambiguous address: %lx  (requires -u or -k)\n",
-                                	vaddr);
-                        	break;
-			}
+	for (n = 0; size > 0; addr += cnt, bufptr += cnt, size -= cnt) {
+		if (memtype == KVADDR) {
+			if (!kvtop(CURRENT_CONTEXT(), addr, &paddr, 0))
+				return FALSE;
 		} else
-			loop_vtop_flags = 0;
-	
-		if (others++)
-			fprintf(fp, "\n");
+			paddr = addr;
 
-		do_vtop(vaddr, tc, vtop_flags | loop_vtop_flags);
+		if (!machdep->verify_paddr(paddr))
+			return FALSE;
 
-		if (REMOTE() && CRASHDEBUG(1)) {
-			ulong paddr = remote_vtop(tc->processor, vaddr);
+		cnt = PAGESIZE() - PAGEOFFSET(paddr);
+		if (cnt > size)
+			cnt = size;
 
-			if (paddr)
-				fprintf(fp, "rvtop(%lx)=%lx\n", vaddr, paddr);
+		if (n && (ranges[n-1].paddr + ranges[n-1].len == paddr)) {
+			ranges[n-1].len += cnt;
+			continue;
 		}
 
-		optind++;
+		if (n == MEMORY_DEVICE_VEC_RANGES) {
+			if (!memory_device_readv(fd, ranges, n))
+				return FALSE;
+			n = 0;
+		}
+
+		r = &ranges[n++];
+		r->paddr = paddr;
+		r->len = cnt;
+		r->buf = (ulong)bufptr;
 	}
+
+	return memory_device_readv(fd, ranges, n);
 }
 
 /*
- *  Do the work for cmd_vtop(), or less likely, foreach().
+ *  Write to memory driver.  
  */
-void
-do_vtop(ulong vaddr, struct task_context *tc, ulong vtop_flags)
+int
+write_memory_device(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr)
 {
-	physaddr_t paddr; 
-	ulong vma, page;
-	int page_exists;
-        struct meminfo meminfo;
-        char buf1[BUFSIZE];
-        char buf2[BUFSIZE];
-	int memtype = 0;
-
-	switch (vtop_flags & (UVADDR|KVADDR))
-	{
-	case UVADDR:
-		memtype = UVADDR;
-		break;
-
-	case KVADDR:
-		memtype = KVADDR;
-		break;
+	if (!(MEMORY_DRIVER_DEVICE_MODE & S_IWUSR))
+        	return (error(FATAL, "cannot write to %s!\n", pc->live_memsrc));
 
-	case (UVADDR|KVADDR):
-		error(FATAL, "-u and -k options are mutually exclusive\n");
-		break;
+        if (lseek(fd, (loff_t)paddr, SEEK_SET) == -1)
+                return SEEK_ERROR;
 
-	default:
-                switch (vaddr_type(vaddr, tc))
-                {
-                case UVADDR:
-                        memtype = UVADDR;
-                        break;
-                case KVADDR:
-                        memtype = KVADDR;
-                        break;
-                case AMBIGUOUS:
-			error(FATAL,
-                            "ambiguous address: %lx  (requires -u or -k)\n",
-                            	vaddr);
-                        break;
-                }
-		break;
-        }
+        if (write(fd, bufptr, cnt) != cnt)
+                return WRITE_ERROR;
 
-	page_exists = paddr = 0;
+        return cnt;
+}
 
-	switch (memtype) {
-	case UVADDR: 
-                fprintf(fp, "%s  %s\n",
-                        mkstring(buf1, UVADDR_PRLEN, LJUST, "VIRTUAL"),
+/*
+ *  Read from an MCLX formatted dumpfile.
+ */
+int
+read_mclx_dumpfile(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr) 
+{
+        if (vas_lseek((ulong)paddr, SEEK_SET)) 
+		return SEEK_ERROR;
+        
+        if (vas_read((void *)bufptr, cnt) != cnt) 
+		return READ_ERROR;
+
+	return cnt;
+}
+
+/*
+ *  Write to an MCLX formatted dumpfile.  This only modifies the buffered 
+ *  copy only; if it gets flushed, the modification is lost.
+ */
+int
+write_mclx_dumpfile(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr)
+{
+        if (vas_lseek((ulong)paddr, SEEK_SET)) 
+        	return SEEK_ERROR;
+                                
+        if (vas_write((void *)bufptr, cnt) != cnt) 
+		return WRITE_ERROR;
+
+	return cnt;
+}
+
+/*
+ *  Read from an LKCD formatted dumpfile.
+ */
+int
+read_lkcd_dumpfile(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr) 
+{
+	set_lkcd_fp(fp);
+
+        if (!lkcd_lseek(paddr)) 
+		return SEEK_ERROR;
+        
+        if (lkcd_read((void *)bufptr, cnt) != cnt) 
+		return READ_ERROR;
+
+	return cnt;
+}
+
+/*
+ *  Write to an LKCD formatted dumpfile.  (dummy routine -- not allowed)
+ */
+int
+write_lkcd_dumpfile(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr) 
+{
+	return (error(FATAL, "cannot write to an LKCD compressed dump!\n"));
+}
+
+
+/*
+ *  Read from network daemon.
+ */
+int
+read_daemon(int fd, void *bufptr, int cnt, ulong vaddr, physaddr_t paddr) 
+{
+	if ((cnt == PAGESIZE()) && !PAGEOFFSET(paddr) &&
+	    remote_memory_readahead(pc->rmfd, bufptr, paddr))
+		return cnt;
+
+	if (remote_memory_read(pc->rmfd, bufptr, cnt, paddr, -1) == cnt)
+		return cnt;
+
+	if (!IS_VMALLOC_ADDR(vaddr) || DUMPFILE())
+		return READ_ERROR;
+
+        /*
+         *  On 32-bit architectures w/memory above ~936MB,
+         *  that memory can only be accessed via vmalloc'd
+         *  addresses.  However, /dev/mem returns 0 bytes,
+         *  and non-reserved memory pages can't be mmap'd, so
+         *  the only alternative is to read it from /dev/kmem.
+         */
+
+	if (BITS32() && remote_memory_read(pc->rkfd, bufptr, cnt, vaddr, -1) == cnt)
+                return cnt;
+
+	return READ_ERROR;
+}
+
+/*
+ *  Write to network daemon.
+ */
+int
+write_daemon(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr) 
+{
+	return (error(FATAL, "writing to daemon not supported yet [TBD]\n"));
+}
+
+/*
+ *  Turn the memtype bitmask into a string.
+ */
+static
+char *memtype_string(int memtype, int debug)
+{
+	static char membuf[40];
+
+	switch (memtype)
+	{
+	case UVADDR:
+		sprintf(membuf, debug ? "UVADDR" : "user virtual");
+		break;
+	case KVADDR:
+		sprintf(membuf, debug ? "KVADDR" : "kernel virtual");
+		break;
+	case PHYSADDR:
+		sprintf(membuf, debug ? "PHYSADDR" : "physical");
+		break;
+	case XENMACHADDR:
+		sprintf(membuf, debug ? "XENMACHADDR" : "xen machine");
+		break;
+	case FILEADDR:
+		sprintf(membuf, debug ? "FILEADDR" : "dumpfile");
+		break;
+	default:
+		if (debug)
+			sprintf(membuf, "0x%x (?)", memtype);
+		else
+			sprintf(membuf, "unknown");
+		break;
+	}
+
+	return membuf;
+}
+
+/*
+ *  Turn the error_handle bitmask into a string,
+ *  Note: FAULT_ON_ERROR == 0
+ */
+static
+char *error_handle_string(ulong error_handle)
+{
+        static char ebuf[20];
+	int others;
+
+	sprintf(ebuf, "(");
+	others = 0;
+
+	if (error_handle & RETURN_ON_ERROR)
+		sprintf(&ebuf[strlen(ebuf)], "%sROE", others++ ? "|" : "");
+	if (error_handle & FAULT_ON_ERROR)
+		sprintf(&ebuf[strlen(ebuf)], "%sFOE", others++ ? "|" : "");
+	if (error_handle & QUIET)
+		sprintf(&ebuf[strlen(ebuf)], "%sQ", others++ ? "|" : "");
+	if (error_handle & HEX_BIAS)
+		sprintf(&ebuf[strlen(ebuf)], "%sHB", others++ ? "|" : "");
+	if (error_handle & RETURN_PARTIAL)
+		sprintf(&ebuf[strlen(ebuf)], "%sRP", others++ ? "|" : "");
+	if (error_handle & NO_DEVMEM_SWITCH)
+		sprintf(&ebuf[strlen(ebuf)], "%sNDS", others++ ? "|" : "");
+
+	strcat(ebuf, ")");
+
+        return ebuf;
+}
+
+
+/*
+ *  Sister routine to readmem().
+ */
+
+int
+writemem(ulonglong addr, int memtype, void *buffer, long size,
+	char *type, ulong error_handle)
+{
+	int fd;
+	long cnt;
+	physaddr_t paddr;
+	char *bufptr;
+
+	vtop_cache_flush();
+	page_cache_flush();
+	slab_index_flush();
+	slub_free_cache_flush();
+	stack_window_flush();
+
+        if (CRASHDEBUG(1))
+		fprintf(fp, "writemem: %llx, %s, \"%s\", %ld, %s %lx\n", 
+			addr, memtype_string(memtype, 1), type, size, 
+			error_handle_string(error_handle), (ulong)buffer);
+
+	if (size < 0) {
+		if (PRINT_ERROR_MESSAGE)
+                       	error(INFO, "invalid size request: %ld\n", size);
+		goto writemem_error;
+	}
+
+	bufptr = (char *)buffer;
+
+	fd = ACTIVE() ? pc->mfd : pc->dfd;
+
+	/*
+	 * Screen out any error conditions.
+	 */
+        switch (memtype)
+        {
+        case UVADDR:
+                if (!CURRENT_CONTEXT()) {
+                        if (PRINT_ERROR_MESSAGE)
+                                error(INFO, "no current user process\n");
+                        goto writemem_error;
+                }
+                if (!IS_UVADDR(addr, CURRENT_CONTEXT())) {
+                        if (PRINT_ERROR_MESSAGE)
+                                error(INFO, INVALID_UVADDR, addr, type);
+                        goto writemem_error;
+                }
+                break;
+
+        case KVADDR:
+                if (!IS_KVADDR(addr)) {
+                        if (PRINT_ERROR_MESSAGE)
+                                error(INFO, INVALID_KVADDR, addr, type);
+                        goto writemem_error;
+                }
+                break;
+
+        case PHYSADDR:
+                break;
+
+
+	case FILEADDR:
+		return generic_write_dumpfile(addr, buffer, size, type, error_handle);
+        }
+
+        while (size > 0) {
+                switch (memtype)
+                {
+                case UVADDR:
+                        if (!uvtop(CURRENT_CONTEXT(), addr, &paddr, 0)) {
+                                if (PRINT_ERROR_MESSAGE)
+                                        error(INFO, INVALID_UVADDR, addr, type);
+                                goto writemem_error;
+                        }
+                        break;
+
+                case KVADDR:
+                        if (!kvtop(CURRENT_CONTEXT(), addr, &paddr, 0)) {
+                                if (PRINT_ERROR_MESSAGE)
+                                        error(INFO, INVALID_KVADDR, addr, type);
+                                goto writemem_error;
+                        }
+                        break;
+
+                case PHYSADDR:
+                        paddr = addr;
+                        break;
+                }
+
+		/* 
+		 *  Compute bytes till end of page.
+		 */
+		cnt = PAGESIZE() - PAGEOFFSET(paddr); 
+
+                if (cnt > size)
+                        cnt = size;
+
+		switch (pc->writemem(fd, bufptr, cnt, addr, paddr))
+		{
+		case SEEK_ERROR:
+                        if (PRINT_ERROR_MESSAGE)
+                                error(INFO, SEEK_ERRMSG, memtype_string(memtype, 0), addr, type);
+                        goto writemem_error;
+			
+		case WRITE_ERROR:
+                        if (PRINT_ERROR_MESSAGE)
+                                error(INFO, WRITE_ERRMSG, memtype_string(memtype, 0), addr, type);
+                        goto writemem_error;
+
+		default:
+			break;
+		}
+
+                addr += cnt;
+                bufptr += cnt;
+                size -= cnt;
+        }
+
+        return TRUE;
+
+writemem_error:
+	
+        switch (error_handle)
+        {
+        case (FAULT_ON_ERROR):
+        case (QUIET|FAULT_ON_ERROR):
+                RESTART();
+
+        case (RETURN_ON_ERROR):
+	case (QUIET|RETURN_ON_ERROR):
+		break;
+        }
+
+	return FALSE;
+}
+
+/*
+ *  When /dev/mem won't allow access, try /dev/kmem.  
+ */
+static ssize_t
+read_dev_kmem(ulong vaddr, char *bufptr, long cnt)
+{
+	ssize_t readcnt;
+
+	if (pc->kfd < 0) {
+		if ((pc->kfd = open("/dev/kmem", O_RDONLY)) < 0)
+			return 0; 
+	}
+
+	if (lseek(pc->kfd, vaddr, SEEK_SET) == -1) 
+		return 0;
+
+	readcnt = read(pc->kfd, bufptr, cnt);
+	if (readcnt != cnt)
+		readcnt = 0;
+
+	return readcnt;
+}
+
+/*
+ *  Generic dumpfile read/write functions to handle FILEADDR 
+ *  memtype arguments to readmem() and writemem().  These are
+ *  not to be confused with pc->readmem/writemem plug-ins.
+ */
+static int 
+generic_read_dumpfile(ulonglong addr, void *buffer, long size, char *type, 
+	ulong error_handle)
+{
+	int fd;
+	int retval;
+
+	retval = TRUE;
+
+	if (!pc->dumpfile)
+		error(FATAL, "command requires a dumpfile\n");
+
+	if ((fd = open(pc->dumpfile, O_RDONLY)) < 0)
+		error(FATAL, "%s: %s\n", pc->dumpfile,
+			strerror(errno));
+
+	if (lseek(fd, addr, SEEK_SET) == -1) {
+		if (PRINT_ERROR_MESSAGE)
+                	error(INFO, SEEK_ERRMSG, 
+				memtype_string(FILEADDR, 0), addr, type);
+		retval = FALSE;
+	} else if (read(fd, buffer, size) != size) {
+		if (PRINT_ERROR_MESSAGE)
+			error(INFO, READ_ERRMSG, 
+				memtype_string(FILEADDR, 0), addr, type);
+		retval = FALSE;
+	}
+
+	close(fd);
+
+	return retval;
+}
+
+static int 
+generic_write_dumpfile(ulonglong addr, void *buffer, long size, char *type, 
+	ulong error_handle)
+{
+	int fd;
+	int retval;
+
+	retval = TRUE;
+
+	if (!pc->dumpfile)
+		error(FATAL, "command requires a dumpfile\n");
+
+	if ((fd = open(pc->dumpfile, O_WRONLY)) < 0)
+		error(FATAL, "%s: %s\n", pc->dumpfile,
+			strerror(errno));
+
+	if (lseek(fd, addr, SEEK_SET) == -1) {
+		if (PRINT_ERROR_MESSAGE)
+                	error(INFO, SEEK_ERRMSG, 
+				memtype_string(FILEADDR, 0), addr, type);
+		retval = FALSE;
+	} else if (write(fd, buffer, size) != size) {
+		if (PRINT_ERROR_MESSAGE)
+			error(INFO, WRITE_ERRMSG, 
+				memtype_string(FILEADDR, 0), addr, type);
+		retval = FALSE;
+	}
+
+	close(fd);
+
+	return retval;
+}
+
+/*
+ *  Translation cache for kvtop() and uvtop().  Successful non-verbose
+ *  translations are remembered per page in a set-associative table, keyed
+ *  by the mm_struct of the address space, or 0 for kernel addresses, so
+ *  that repeated translations of the same pages need not walk the page
+ *  tables again.  Since the page tables of a dumpfile cannot change, the
+ *  cache is only flushed by "set vtop_cache", "set <context>" and writemem();
+ *  on a live system it is also flushed before each command.  The cache is
+ *  not used until the session has been initialized, because translations
+ *  made during initialization may depend on values not yet established.
+ *
+ *  If the machdep translator has a vtop_extent() function, which reports
+ *  the size of the mapping, the translations of block and contiguous
+ *  mappings larger than a page are instead kept in a small table of
+ *  extents, each of which answers the lookups of all of its pages.
+ */
+#define VTOP_CACHE_SETS (1024)
+#define VTOP_CACHE_WAYS (4)
+#define VTOP_CACHE_EXTENTS (16)
+
+static struct vtop_cache {
+	int disabled;
+	ulong cmdgen;
+	struct vtop_cache_entry {
+		ulong mm;
+		ulong vpage;		/* virtual page number + 1 */
+		physaddr_t ppage;
+	} entries[VTOP_CACHE_SETS][VTOP_CACHE_WAYS];
+	unsigned char victim[VTOP_CACHE_SETS];
+	ulong hits;
+	ulong misses;
+	ulong flushes;
+	struct vtop_cache_extent {
+		ulong mm;
+		ulong vaddr;
+		ulong length;		/* 0 if unused */
+		physaddr_t paddr;
+	} extents[VTOP_CACHE_EXTENTS];
+	int extent_victim;
+	ulong extent_hits;
+} vtop_cache = { 0 };
+
+static inline int
+vtop_cache_usable(void)
+{
+	if (vtop_cache.disabled || !(pc->flags & RUNTIME))
+		return FALSE;
+
+	if (ACTIVE() && (vtop_cache.cmdgen != pc->cmdgencur)) {
+		vtop_cache_flush();
+		vtop_cache.cmdgen = pc->cmdgencur;
+	}
+
+	return TRUE;
+}
+
+static inline struct vtop_cache_entry *
+vtop_cache_set_of(ulong mm, ulong vpage)
+{
+	return vtop_cache.entries[(vpage ^ (mm >> 6)) & (VTOP_CACHE_SETS-1)];
+}
+
+/*
+ *  If length is non-NULL, it is set to the number of bytes from vaddr
+ *  to the end of the cached page or extent.
+ */
+static int
+vtop_cache_lookup(ulong mm, ulong vaddr, physaddr_t *paddr, ulong *length)
+{
+	int i;
+	ulong vpage;
+	struct vtop_cache_entry *set;
+	struct vtop_cache_extent *ext;
+
+	vpage = (vaddr >> PAGESHIFT()) + 1;
+	set = vtop_cache_set_of(mm, vpage);
+
+	for (i = 0; i < VTOP_CACHE_WAYS; i++) {
+		if ((set[i].vpage == vpage) && (set[i].mm == mm)) {
+			*paddr = set[i].ppage + PAGEOFFSET(vaddr);
+			if (length)
+				*length = PAGESIZE() - PAGEOFFSET(vaddr);
+			vtop_cache.hits++;
+			return TRUE;
+		}
+	}
+
+	for (i = 0, ext = vtop_cache.extents; i < VTOP_CACHE_EXTENTS; i++, ext++) {
+		if (ext->length && (ext->mm == mm) &&
+		    ((vaddr - ext->vaddr) < ext->length)) {
+			*paddr = ext->paddr + (vaddr - ext->vaddr);
+			if (length)
+				*length = ext->length - (vaddr - ext->vaddr);
+			vtop_cache.hits++;
+			vtop_cache.extent_hits++;
+			return TRUE;
+		}
+	}
+
+	vtop_cache.misses++;
+	return FALSE;
+}
+
+static void
+vtop_cache_enter(ulong mm, ulong vaddr, physaddr_t paddr)
+{
+	ulong vpage, index;
+	struct vtop_cache_entry *ent;
+
+	vpage = (vaddr >> PAGESHIFT()) + 1;
+	index = (vpage ^ (mm >> 6)) & (VTOP_CACHE_SETS-1);
+	ent = &vtop_cache.entries[index][vtop_cache.victim[index]];
+	vtop_cache.victim[index] = (vtop_cache.victim[index] + 1) %
+		VTOP_CACHE_WAYS;
+
+	ent->mm = mm;
+	ent->vpage = vpage;
+	ent->ppage = paddr - PAGEOFFSET(vaddr);
+}
+
+/*
+ *  Enter a translation whose mapping continues for length bytes from
+ *  vaddr, keeping the whole mapping as an extent if that extends past
+ *  the page of vaddr.
+ */
+static void
+vtop_cache_enter_extent(ulong mm, ulong vaddr, physaddr_t paddr, ulong length)
+{
+	ulong offset;
+	struct vtop_cache_extent *ext;
+
+	if (length <= PAGESIZE() - PAGEOFFSET(vaddr)) {
+		vtop_cache_enter(mm, vaddr, paddr);
+		return;
+	}
+
+	offset = PAGEOFFSET(vaddr);
+	ext = &vtop_cache.extents[vtop_cache.extent_victim];
+	vtop_cache.extent_victim = (vtop_cache.extent_victim + 1) %
+		VTOP_CACHE_EXTENTS;
+
+	ext->mm = mm;
+	ext->vaddr = vaddr - offset;
+	ext->paddr = paddr - offset;
+	ext->length = length + offset;
+}
+
+void
+vtop_cache_flush(void)
+{
+	BZERO(vtop_cache.entries, sizeof(vtop_cache.entries));
+	BZERO(vtop_cache.extents, sizeof(vtop_cache.extents));
+	vtop_cache.flushes++;
+}
+
+/*
+ *  Handle "set vtop_cache on|off".
+ */
+void
+vtop_cache_set(int on)
+{
+	vtop_cache.disabled = !on;
+	vtop_cache_flush();
+}
+
+int
+vtop_cache_enabled(void)
+{
+	return !vtop_cache.disabled;
+}
+
+static ulonglong
+vtop_cache_memory_used(void)
+{
+	return sizeof(vtop_cache);
+}
+
+/*
+ *  Display the translation cache statistics for "help -m".
+ */
+void
+dump_vtop_cache(void)
+{
+	int i, j, used, extents;
+	ulong lookups;
+
+	for (i = used = 0; i < VTOP_CACHE_SETS; i++)
+		for (j = 0; j < VTOP_CACHE_WAYS; j++)
+			if (vtop_cache.entries[i][j].vpage)
+				used++;
+
+	for (i = extents = 0; i < VTOP_CACHE_EXTENTS; i++)
+		if (vtop_cache.extents[i].length)
+			extents++;
+
+	lookups = vtop_cache.hits + vtop_cache.misses;
+
+	fprintf(fp, "\n            vtop_cache: %s\n",
+		vtop_cache.disabled ? "off" : "on");
+	fprintf(fp, "               entries: %d of %d (%d sets, %d ways)\n",
+		used, VTOP_CACHE_SETS * VTOP_CACHE_WAYS, VTOP_CACHE_SETS,
+		VTOP_CACHE_WAYS);
+	fprintf(fp, "               extents: %d of %d\n",
+		extents, VTOP_CACHE_EXTENTS);
+	fprintf(fp, "                  hits: %ld  (extents: %ld)\n",
+		vtop_cache.hits, vtop_cache.extent_hits);
+	fprintf(fp, "                misses: %ld\n", vtop_cache.misses);
+	fprintf(fp, "              hit rate: %ld%%\n",
+		lookups ? (vtop_cache.hits * 100) / lookups : 0);
+	fprintf(fp, "               flushes: %ld\n", vtop_cache.flushes);
+}
+
+/*
+ *  Account for crash's own memory use, by the tables and caches that
+ *  make up most of it, for "help -u" and "set memlimit".  The caches
+ *  with a shrink function are emptied when crash would otherwise grow
+ *  past the limit, and the page caches are sized to fit within it when
+ *  they are allocated.  Memory that is not accounted for here, most of
+ *  which is gdb's symbol and type data, is taken to be the difference
+ *  between the resident anonymous memory of the process and the
+ *  accounted total when each command starts.
+ */
+static struct memory_account {
+	char *name;
+	ulonglong (*used)(void);
+	void (*shrink)(void);
+} memory_accounts[] = {
+	{ "symbol tables",	symbol_table_memory_used,	NULL },
+	{ "task table",		task_table_memory_used,		NULL },
+	{ "hash table",		hq_memory_used,			NULL },
+	{ "GETBUF buffers",	getbuf_memory_used,		NULL },
+	{ "page cache",		page_cache_memory_used,		NULL },
+	{ "diskdump cache",	diskdump_cache_memory_used,	NULL },
+	{ "zram cache",		zram_cache_memory_used,		zram_cache_release },
+	{ "vtop cache",		vtop_cache_memory_used,		NULL },
+	{ "datatype cache",	datatype_cache_memory_used,	NULL },
+	{ "line number cache",	line_number_cache_memory_used,
+				line_number_cache_invalidate },
+	{ "disassembly cache",	dis_cache_memory_used,		dis_cache_invalidate },
+	{ NULL },
+};
+
+static struct memory_limit {
+	ulonglong limit;		/* "set memlimit" bytes, or 0 */
+	ulonglong other;		/* resident, but not accounted for */
+	ulong shrinks;
+	ulong resizes;
+	ulong refusals;
+} memory_limit = { 0 };
+
+static ulonglong
+memory_accounted(void)
+{
+	ulonglong total;
+	struct memory_account *ma;
+
+	for (total = 0, ma = memory_accounts; ma->name; ma++)
+		total += ma->used();
+
+	return total;
+}
+
+/*
+ *  The resident anonymous memory of the crash process, or 0 if it
+ *  cannot be determined.
+ */
+static ulonglong
+memory_resident_anon(void)
+{
+	FILE *statm;
+	ulong size, resident, shared;
+	ulonglong bytes;
+
+	if (!(statm = fopen("/proc/self/statm", "r")))
+		return 0;
+
+	bytes = 0;
+	if ((fscanf(statm, "%lu %lu %lu", &size, &resident, &shared) == 3) &&
+	    (resident > shared))
+		bytes = (ulonglong)(resident - shared) * getpagesize();
+	fclose(statm);
+
+	return bytes;
+}
+
+static void
+memory_limit_refresh(void)
+{
+	ulonglong anon, accounted;
+
+	anon = memory_resident_anon();
+	accounted = memory_accounted();
+	memory_limit.other = (anon > accounted) ? anon - accounted : 0;
+}
+
+static void
+memory_accounts_shrink(void)
+{
+	struct memory_account *ma;
+
+	for (ma = memory_accounts; ma->name; ma++)
+		if (ma->shrink)
+			ma->shrink();
+
+	memory_limit.shrinks++;
+}
+
+static inline ulonglong
+memory_limit_used(void)
+{
+	return memory_limit.other + memory_accounted();
+}
+
+/*
+ *  Return how much of a cache of want bytes fits within the memory
+ *  limit.  Called by the page caches when they are allocated, after
+ *  their previous allocation has been freed.
+ */
+ulonglong
+memory_limit_cap(ulonglong want)
+{
+	ulonglong used;
+
+	if (!memory_limit.limit)
+		return want;
+
+	if ((used = memory_limit_used()) >= memory_limit.limit)
+		return 0;
+
+	return MIN(want, memory_limit.limit - used);
+}
+
+/*
+ *  Called by the caches that grow an entry at a time before they
+ *  allocate another bytes.  Returns FALSE if that would take crash past
+ *  the memory limit even after the caches that can be emptied have
+ *  been, in which case the entry should not be cached.
+ */
+int
+memory_limit_reserve(ulong bytes)
+{
+	if (!memory_limit.limit ||
+	    ((memory_limit_used() + bytes) <= memory_limit.limit))
+		return TRUE;
+
+	memory_accounts_shrink();
+
+	if ((memory_limit_used() + bytes) <= memory_limit.limit)
+		return TRUE;
+
+	memory_limit.refusals++;
+	return FALSE;
+}
+
+/*
+ *  Called before each command.  If crash has grown past the memory
+ *  limit, empty the caches that can be emptied, and if that is not
+ *  enough, shrink the page caches to fit.  Page caches that are already
+ *  under a megabyte are left alone, so that a session in which gdb
+ *  alone is over the limit does not reallocate them for every command.
+ */
+void
+memory_limit_check(void)
+{
+	ulonglong caches;
+
+	if (!memory_limit.limit)
+		return;
+
+	memory_limit_refresh();
+
+	if (memory_limit_used() <= memory_limit.limit)
+		return;
+
+	memory_accounts_shrink();
+
+	caches = page_cache_memory_used() + diskdump_cache_memory_used();
+	if ((memory_limit_used() > memory_limit.limit) &&
+	    (caches > MEGABYTES(1))) {
+		page_cache_resize();
+		memory_limit.resizes++;
+	}
+}
+
+/*
+ *  Handle "set memlimit size".  A size of 0 removes the limit.  The
+ *  page caches are reallocated so that they either fit within the new
+ *  limit or grow back to their requested sizes.
+ */
+void
+memory_limit_set(ulonglong bytes)
+{
+	memory_limit.limit = bytes;
+	memory_limit_refresh();
+
+	if (bytes && (memory_limit_used() > bytes))
+		memory_accounts_shrink();
+
+	page_cache_resize();
+}
+
+ulonglong
+memory_limit_size(void)
+{
+	return memory_limit.limit;
+}
+
+/*
+ *  Display crash's own memory use for "help -u".
+ */
+void
+dump_memory_accounts(void)
+{
+	ulonglong used, total;
+	struct memory_account *ma;
+
+	memory_limit_refresh();
+
+	for (total = 0, ma = memory_accounts; ma->name; ma++) {
+		used = ma->used();
+		total += used;
+		fprintf(fp, "%18s: %lld bytes%s\n", ma->name, used,
+			ma->shrink ? " (discardable)" : "");
+	}
+	fprintf(fp, "%18s: %lld bytes\n", "other (gdb, etc.)",
+		memory_limit.other);
+	fprintf(fp, "%18s: %lld bytes\n", "total",
+		total + memory_limit.other);
+
+	fprintf(fp, "\n          memlimit: ");
+	if (memory_limit.limit)
+		fprintf(fp, "%lld bytes\n", memory_limit.limit);
+	else
+		fprintf(fp, "(none)\n");
+	fprintf(fp, "           shrinks: %ld\n", memory_limit.shrinks);
+	fprintf(fp, "           resizes: %ld\n", memory_limit.resizes);
+	fprintf(fp, "          refusals: %ld\n", memory_limit.refusals);
+}
+
+/*
+ *  Call the machdep translator, and if cached, enter a successful
+ *  translation in the translation cache.  Quiet translations use the
+ *  machdep vtop_extent() function if there is one, so that the size of
+ *  a block or contiguous mapping gets cached along with it, and is
+ *  returned in length if it is non-NULL.
+ */
+static int
+vtop_machdep(struct task_context *tc, ulong vaddr, int memtype,
+	     physaddr_t *paddr, ulong *length, int verbose, int cached)
+{
+	ulong mm, unused;
+	int ret;
+
+	mm = (memtype == UVADDR) ? tc->mm_struct : 0;
+
+	if (!length)
+		length = &unused;
+
+	if (!verbose && machdep->vtop_extent) {
+		ret = machdep->vtop_extent(tc, vaddr, memtype, paddr, length);
+		if (ret && cached)
+			vtop_cache_enter_extent(mm, vaddr, *paddr, *length);
+		return ret;
+	}
+
+	if (memtype == UVADDR)
+		ret = machdep->uvtop(tc, vaddr, paddr, verbose);
+	else
+		ret = machdep->kvtop(tc, vaddr, paddr, verbose);
+
+	*length = PAGESIZE() - PAGEOFFSET(vaddr);
+
+	if (ret && cached)
+		vtop_cache_enter(mm, vaddr, *paddr);
+
+	return ret;
+}
+
+/*
+ *  Translates a kernel virtual address to its physical address.  cmd_vtop()
+ *  sets the verbose flag so that the pte translation gets displayed; all 
+ *  other callers quietly accept the translation.
+ */
+int
+kvtop(struct task_context *tc, ulong kvaddr, physaddr_t *paddr, int verbose)
+{
+	physaddr_t unused;
+	int cached, ret;
+	struct timespec start, end;
+
+	if (!paddr)
+		paddr = &unused;
+
+	if (READMEM_PROFILING())
+		readmem_profile.kvtop_calls++;
+
+	if ((cached = !verbose && vtop_cache_usable()) &&
+	    vtop_cache_lookup(0, kvaddr, paddr, NULL)) {
+		if (READMEM_PROFILING())
+			readmem_profile.vtop_cached++;
+		return TRUE;
+	}
+
+	if (READMEM_PROFILING()) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		ret = vtop_machdep(tc ? tc : CURRENT_CONTEXT(), kvaddr, KVADDR,
+			paddr, NULL, verbose, cached);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		readmem_profile.vtop_usecs += TIMESPEC_USECS(start, end);
+	} else
+		ret = vtop_machdep(tc ? tc : CURRENT_CONTEXT(), kvaddr, KVADDR,
+			paddr, NULL, verbose, cached);
+
+	return ret;
+}
+
+
+/*
+ *  Translates a user virtual address to its physical address.  cmd_vtop()
+ *  sets the verbose flag so that the pte translation gets displayed; all 
+ *  other callers quietly accept the translation.
+ *
+ *  This routine can also take mapped kernel virtual addresses if the -u flag
+ *  was passed to cmd_vtop().  If so, it makes the translation using the
+ *  kernel-memory PGD entry instead of swapper_pg_dir.
+ */
+int
+uvtop(struct task_context *tc, ulong vaddr, physaddr_t *paddr, int verbose)
+{
+	int cached, ret;
+	struct timespec start, end;
+
+	if (READMEM_PROFILING())
+		readmem_profile.uvtop_calls++;
+
+	if ((cached = !verbose && tc && tc->mm_struct && vtop_cache_usable()) &&
+	    vtop_cache_lookup(tc->mm_struct, vaddr, paddr, NULL)) {
+		if (READMEM_PROFILING())
+			readmem_profile.vtop_cached++;
+		return TRUE;
+	}
+
+	if (READMEM_PROFILING()) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		ret = vtop_machdep(tc, vaddr, UVADDR, paddr, NULL, verbose, cached);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		readmem_profile.vtop_usecs += TIMESPEC_USECS(start, end);
+	} else
+		ret = vtop_machdep(tc, vaddr, UVADDR, paddr, NULL, verbose, cached);
+
+	return ret;
+}
+
+/*
+ *  Translate count virtual addresses for "vtop -b" and extension modules,
+ *  quietly, so that kvtop() and uvtop() can use the translation cache.
+ *  vtop_flags may contain UVADDR or KVADDR, otherwise the type of each
+ *  address is determined separately, and USE_USER_PGD to translate kernel
+ *  addresses with the page directory of tc.  The result of each address
+ *  is stored in status[] as one of the VTOP_VEC_xxx values, and its
+ *  physical address in paddrs[] if it is VTOP_VEC_MAPPED.  Returns the
+ *  number of mapped addresses.
+ */
+int
+vtop_vector(struct task_context *tc, ulong vtop_flags, int count,
+	    ulong *vaddrs, physaddr_t *paddrs, int *status)
+{
+	int i, memtype, mapped;
+
+	if (!tc && !(tc = CURRENT_CONTEXT()))
+		error(FATAL, "no current user process\n");
+
+	for (i = mapped = 0; i < count; i++) {
+		paddrs[i] = 0;
+
+		if (!(memtype = vtop_flags & (UVADDR|KVADDR)))
+			memtype = vaddr_type(vaddrs[i], tc);
+
+		switch (memtype)
+		{
+		case UVADDR:
+			status[i] = uvtop(tc, vaddrs[i], &paddrs[i], 0) ?
+				VTOP_VEC_MAPPED : VTOP_VEC_UNMAPPED;
+			break;
+
+		case KVADDR:
+			if (!IS_KVADDR(vaddrs[i]))
+				status[i] = VTOP_VEC_INVALID;
+			else if (vtop_flags & USE_USER_PGD)
+				status[i] = uvtop(tc, vaddrs[i], &paddrs[i], 0) ?
+					VTOP_VEC_MAPPED : VTOP_VEC_UNMAPPED;
+			else
+				status[i] = kvtop(tc, vaddrs[i], &paddrs[i], 0) ?
+					VTOP_VEC_MAPPED : VTOP_VEC_UNMAPPED;
+			break;
+
+		case AMBIGUOUS:
+			status[i] = VTOP_VEC_AMBIGUOUS;
+			break;
+
+		default:
+			status[i] = VTOP_VEC_INVALID;
+			break;
+		}
+
+		if (status[i] == VTOP_VEC_MAPPED)
+			mapped++;
+	}
+
+	return mapped;
+}
+
+/*
+ *  Translate count physical addresses into their unity-mapped kernel
+ *  virtual addresses, setting status[] as vtop_vector() does.  Returns
+ *  the number of addresses translated.
+ */
+int
+ptov_vector(int count, physaddr_t *paddrs, ulong *vaddrs, int *status)
+{
+	int i, mapped;
+	physaddr_t paddr_test;
+
+	for (i = mapped = 0; i < count; i++) {
+		vaddrs[i] = PTOV(paddrs[i]);
+		if (BITS32() && (!kvtop(0, vaddrs[i], &paddr_test, 0) ||
+		    (paddr_test != paddrs[i]))) {
+			vaddrs[i] = 0;
+			status[i] = VTOP_VEC_UNMAPPED;
+		} else {
+			status[i] = VTOP_VEC_MAPPED;
+			mapped++;
+		}
+	}
+
+	return mapped;
+}
+
+/*
+ *  Translate the memtype range of virtual addresses from *vaddr up to end
+ *  into as many as max extents of mapped memory that is contiguous both
+ *  virtually and physically, skipping the addresses that are not mapped.
+ *  With a machdep vtop_extent() function, each block or contiguous
+ *  mapping takes one page table walk, and each region left unmapped by
+ *  an empty table entry is skipped at once, and the extents feed the
+ *  translation cache; otherwise each page is translated by kvtop() or
+ *  uvtop().  *vaddr is advanced to the address at which the translation
+ *  stopped, which is end if the whole range was translated, and the
+ *  number of extents is returned.  With a max of 0, *vaddr is just
+ *  advanced to the first mapped address.
+ */
+int
+vtop_range(struct task_context *tc, int memtype, ulong *vaddr, ulong end,
+	   struct vtop_extent *extents, int max)
+{
+	int cnt, mapped, cached;
+	ulong addr, length, mm;
+	physaddr_t paddr;
+	struct vtop_extent *ext;
+
+	if (!tc)
+		tc = CURRENT_CONTEXT();
+	mm = (memtype == UVADDR) ? tc->mm_struct : 0;
+	cached = ((memtype == KVADDR) || mm) && vtop_cache_usable();
+
+	for (cnt = 0, addr = *vaddr; addr < end; addr += length) {
+		paddr = 0;
+		if (!machdep->vtop_extent) {
+			mapped = (memtype == UVADDR) ? uvtop(tc, addr, &paddr, 0) :
+				kvtop(tc, addr, &paddr, 0);
+			length = PAGESIZE() - PAGEOFFSET(addr);
+		} else if (!(cached && vtop_cache_lookup(mm, addr, &paddr, &length)))
+			mapped = vtop_machdep(tc, addr, memtype, &paddr, &length,
+				0, cached);
+		else
+			mapped = TRUE;
+
+		if (length > (end - addr))
+			length = end - addr;
+
+		if (!mapped)
+			continue;
+
+		if (cnt) {
+			ext = &extents[cnt-1];
+			if (((ext->vaddr + ext->length) == addr) &&
+			    ((ext->paddr + ext->length) == paddr)) {
+				ext->length += length;
+				continue;
+			}
+		}
+
+		if (cnt == max)
+			break;
+
+		ext = &extents[cnt++];
+		ext->vaddr = addr;
+		ext->paddr = paddr;
+		ext->length = length;
+	}
+
+	*vaddr = addr;
+
+	return cnt;
+}
+
+/*
+ *  "vtop -b" and "ptov -b" gather their addresses in batches of this size,
+ *  from the command line and then from any file named with -f.
+ */
+#define VTOP_BATCH (1024)
+
+struct vtop_batch {
+	int count;
+	FILE *ifp;
+	char *file;
+	ulong lines;
+	ulong ignored;
+	ulong vaddrs[VTOP_BATCH];
+	physaddr_t paddrs[VTOP_BATCH];
+	int status[VTOP_BATCH];
+};
+
+static void
+vtop_batch_cleanup(void *arg)
+{
+	struct vtop_batch *vb = arg;
+
+	pc->cmd_cleanup = NULL;
+	pc->cmd_cleanup_arg = NULL;
+
+	if (vb->ifp) {
+		fclose(vb->ifp);
+		vb->ifp = NULL;
+	}
+}
+
+static void
+vtop_batch_open(struct vtop_batch *vb, char *file)
+{
+	BZERO(vb, offsetof(struct vtop_batch, vaddrs));
+
+	if (!file)
+		return;
+
+	if (!(vb->ifp = fopen(file, "r")))
+		error(FATAL, "cannot open %s: %s\n", file, strerror(errno));
+	vb->file = file;
+
+	pc->cmd_cleanup_arg = (void *)vb;
+	pc->cmd_cleanup = vtop_batch_cleanup;
+}
+
+/*
+ *  Take the next address from a line of the -f file.  The address is the
+ *  first word of the line, and may be followed by a colon, so that the
+ *  output of "search" and "rd" can be used as it is.  Blank lines and
+ *  lines starting with "#" are skipped without comment.
+ */
+static int
+vtop_batch_parse(struct vtop_batch *vb, char *line, ulonglong *addr)
+{
+	char *p, *end;
+	int errflag;
+
+	vb->lines++;
+	p = strip_linefeeds(line);
+	while (whitespace(*p))
+		p++;
+	if (!*p || (*p == '#'))
+		return FALSE;
+
+	for (end = p; *end && !whitespace(*end); end++)
+		;
+	*end = NULLCHAR;
+	if ((end > p) && (*(end-1) == ':'))
+		*(end-1) = NULLCHAR;
+
+	errflag = 0;
+	*addr = htoll(p, RETURN_ON_ERROR|QUIET, &errflag);
+	if (errflag || !hexadecimal(p, 0)) {
+		if (!vb->ignored++ || CRASHDEBUG(1))
+			error(INFO, "%s: line %ld: invalid address: %s\n",
+				vb->file, vb->lines, p);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ *  Fill the batch with the next addresses, first from the remaining
+ *  command line arguments, and then from the file.  Returns the number
+ *  of addresses gathered, 0 when there are no more.
+ */
+static int
+vtop_batch_fill(struct vtop_batch *vb, int physical)
+{
+	ulonglong addr;
+	char buf[BUFSIZE];
+
+	vb->count = 0;
+
+	while (args[optind] && (vb->count < VTOP_BATCH)) {
+		addr = htoll(args[optind], FAULT_ON_ERROR, NULL);
+		if (physical)
+			vb->paddrs[vb->count++] = (physaddr_t)addr;
+		else
+			vb->vaddrs[vb->count++] = (ulong)addr;
+		optind++;
+	}
+
+	while (vb->ifp && (vb->count < VTOP_BATCH) &&
+	    fgets(buf, BUFSIZE, vb->ifp)) {
+		if (!vtop_batch_parse(vb, buf, &addr))
+			continue;
+		if (physical)
+			vb->paddrs[vb->count++] = (physaddr_t)addr;
+		else
+			vb->vaddrs[vb->count++] = (ulong)addr;
+	}
+
+	return vb->count;
+}
+
+static void
+vtop_batch_close(struct vtop_batch *vb)
+{
+	if (vb->ignored > 1)
+		error(INFO, "%s: %ld lines with invalid addresses ignored\n",
+			vb->file, vb->ignored);
+	vtop_batch_cleanup(vb);
+}
+
+/*
+ *  Display one "VIRTUAL  PHYSICAL" line per address.
+ */
+static void
+vtop_batch_display(struct vtop_batch *vb)
+{
+	int i;
+	char buf1[BUFSIZE];
+	char buf2[BUFSIZE];
+
+	for (i = 0; i < vb->count; i++) {
+		switch (vb->status[i])
+		{
+		case VTOP_VEC_MAPPED:
+			fprintf(fp, "%s  %s\n",
+			    mkstring(buf1, VADDR_PRLEN, LJUST|LONG_HEX,
+				MKSTR(vb->vaddrs[i])),
+			    mkstring(buf2, VADDR_PRLEN, LJUST|LONGLONG_HEX,
+				MKSTR(&vb->paddrs[i])));
+			break;
+		case VTOP_VEC_UNMAPPED:
+			fprintf(fp, "%s  %s\n",
+			    mkstring(buf1, VADDR_PRLEN, LJUST|LONG_HEX,
+				MKSTR(vb->vaddrs[i])),
+			    (XEN() && (vb->paddrs[i] == PADDR_NOT_AVAILABLE)) ?
+				"(page not available)" : "(not mapped)");
+			break;
+		case VTOP_VEC_AMBIGUOUS:
+			fprintf(fp, "%s  (ambiguous address)\n",
+			    mkstring(buf1, VADDR_PRLEN, LJUST|LONG_HEX,
+				MKSTR(vb->vaddrs[i])));
+			break;
+		default:
+			fprintf(fp, "%s  (invalid address)\n",
+			    mkstring(buf1, VADDR_PRLEN, LJUST|LONG_HEX,
+				MKSTR(vb->vaddrs[i])));
+			break;
+		}
+	}
+}
+
+static void
+vtop_batch(struct task_context *tc, ulong vtop_flags, char *file)
+{
+	struct vtop_batch *vb;
+	char buf1[BUFSIZE];
+	char buf2[BUFSIZE];
+
+	vb = (struct vtop_batch *)GETBUF(sizeof(struct vtop_batch));
+	vtop_batch_open(vb, file);
+
+	fprintf(fp, "%s  %s\n",
+		mkstring(buf1, VADDR_PRLEN, LJUST, "VIRTUAL"),
+		mkstring(buf2, VADDR_PRLEN, LJUST, "PHYSICAL"));
+
+	while (vtop_batch_fill(vb, FALSE)) {
+		vtop_vector(tc, vtop_flags, vb->count, vb->vaddrs,
+			vb->paddrs, vb->status);
+		vtop_batch_display(vb);
+	}
+
+	vtop_batch_close(vb);
+	FREEBUF(vb);
+}
+
+static void
+ptov_batch(char *file)
+{
+	int i;
+	struct vtop_batch *vb;
+	char buf1[BUFSIZE];
+	char buf2[BUFSIZE];
+
+	vb = (struct vtop_batch *)GETBUF(sizeof(struct vtop_batch));
+	vtop_batch_open(vb, file);
+
+	fprintf(fp, "%s  %s\n",
+		mkstring(buf1, VADDR_PRLEN, LJUST, "VIRTUAL"),
+		mkstring(buf2, VADDR_PRLEN, LJUST, "PHYSICAL"));
+
+	while (vtop_batch_fill(vb, TRUE)) {
+		ptov_vector(vb->count, vb->paddrs, vb->vaddrs, vb->status);
+		for (i = 0; i < vb->count; i++)
+			fprintf(fp, "%s  %s\n",
+			    vb->status[i] == VTOP_VEC_MAPPED ?
+			    mkstring(buf1, VADDR_PRLEN, LJUST|LONG_HEX,
+				MKSTR(vb->vaddrs[i])) :
+			    mkstring(buf1, VADDR_PRLEN, LJUST, "unknown"),
+			    mkstring(buf2, VADDR_PRLEN, LJUST|LONGLONG_HEX,
+				MKSTR(&vb->paddrs[i])));
+	}
+
+	vtop_batch_close(vb);
+	FREEBUF(vb);
+}
+
+/*
+ *  The vtop command does a verbose translation of a user or kernel virtual
+ *  address into it physical address.  The pte translation is shown by
+ *  passing the VERBOSE flag to kvtop() or uvtop().  If it's a user virtual
+ *  address, the vm_area_struct data containing the page is displayed.
+ *  Lastly, the mem_map[] page data containing the address is displayed.
+ */
+
+void
+cmd_vtop(void)
+{
+	int c;
+	ulong vaddr, context;
+	int others;
+	ulong vtop_flags, loop_vtop_flags;
+	struct task_context *tc;
+	char *file;
+	int batch;
+
+	vtop_flags = loop_vtop_flags = 0;
+	tc = NULL;
+	file = NULL;
+	batch = FALSE;
+
+        while ((c = getopt(argcnt, args, "ukc:bf:")) != EOF) {
+                switch(c)
+		{
+		case 'b':
+			batch = TRUE;
+			break;
+
+		case 'f':
+			file = optarg;
+			batch = TRUE;
+			break;
+
+		case 'c':
+	                switch (str_to_context(optarg, &context, &tc))
+	                {
+	                case STR_PID:
+	                case STR_TASK:
+				vtop_flags |= USE_USER_PGD;
+	                        break;
+	
+	                case STR_INVALID:
+	                        error(FATAL, "invalid task or pid value: %s\n",
+	                                optarg);
+	                        break;
+	                }
+			break;
+
+		case 'u':
+			vtop_flags |= UVADDR;
+			break;
+
+		case 'k':
+			vtop_flags |= KVADDR;
+			break;
+
+		default:
+			argerrs++;
+			break;
+		}
+	}
+
+	if (argerrs || (!args[optind] && !file))
+		cmd_usage(pc->curcmd, SYNOPSIS);
+
+	if (!tc && !(tc = CURRENT_CONTEXT())) 
+      		error(FATAL, "no current user process\n");
+
+	if ((vtop_flags & (UVADDR|KVADDR)) == (UVADDR|KVADDR))
+		error(FATAL, "-u and -k options are mutually exclusive\n");
+
+	if (batch) {
+		vtop_batch(tc, vtop_flags, file);
+		return;
+	}
+
+	others = 0;
+        while (args[optind]) {
+		vaddr = htol(args[optind], FAULT_ON_ERROR, NULL);
+
+		if (!(vtop_flags & (UVADDR|KVADDR))) {
+			switch (vaddr_type(vaddr, tc))
+			{
+                	case UVADDR:
+				loop_vtop_flags = UVADDR;
+                        	break;
+                	case KVADDR:
+				loop_vtop_flags = KVADDR;
+                        	break;
+                	case AMBIGUOUS:
+                        	error(FATAL,
+                                "ambiguous address: %lx  (requires -u or -k)\n",
+                                	vaddr);
+                        	break;
+			}
+		} else
+			loop_vtop_flags = 0;
+	
+		if (others++)
+			fprintf(fp, "\n");
+
+		do_vtop(vaddr, tc, vtop_flags | loop_vtop_flags);
+
+		if (REMOTE() && CRASHDEBUG(1)) {
+			ulong paddr = remote_vtop(tc->processor, vaddr);
+
+			if (paddr)
+				fprintf(fp, "rvtop(%lx)=%lx\n", vaddr, paddr);
+		}
+
+		optind++;
+	}
+}
+
+/*
+ *  Do the work for cmd_vtop(), or less likely, foreach().
+ */
+void
+do_vtop(ulong vaddr, struct task_context *tc, ulong vtop_flags)
+{
+	physaddr_t paddr; 
+	ulong vma, page;
+	int page_exists;
+        struct meminfo meminfo;
+        char buf1[BUFSIZE];
+        char buf2[BUFSIZE];
+	int memtype = 0;
+
+	switch (vtop_flags & (UVADDR|KVADDR))
+	{
+	case UVADDR:
+		memtype = UVADDR;
+		break;
+
+	case KVADDR:
+		memtype = KVADDR;
+		break;
+
+	case (UVADDR|KVADDR):
+		error(FATAL, "-u and -k options are mutually exclusive\n");
+		break;
+
+	default:
+                switch (vaddr_type(vaddr, tc))
+                {
+                case UVADDR:
+                        memtype = UVADDR;
+                        break;
+                case KVADDR:
+                        memtype = KVADDR;
+                        break;
+                case AMBIGUOUS:
+			error(FATAL,
+                            "ambiguous address: %lx  (requires -u or -k)\n",
+                            	vaddr);
+                        break;
+                }
+		break;
+        }
+
+	page_exists = paddr = 0;
+
+	switch (memtype) {
+	case UVADDR: 
+                fprintf(fp, "%s  %s\n",
+                        mkstring(buf1, UVADDR_PRLEN, LJUST, "VIRTUAL"),
+                        mkstring(buf2, VADDR_PRLEN, LJUST, "PHYSICAL"));
+
+		if (!IN_TASK_VMA(tc->task, vaddr)) {
+			fprintf(fp, "%s  (not accessible)\n\n", 
+				mkstring(buf1, UVADDR_PRLEN, LJUST|LONG_HEX,
+				    MKSTR(vaddr)));
+			return;
+		}
+		if (!uvtop(tc, vaddr, &paddr, 0)) {
+			fprintf(fp, "%s  %s\n\n", 
+				mkstring(buf1, UVADDR_PRLEN, LJUST|LONG_HEX,
+				    MKSTR(vaddr)),
+				(XEN() && (paddr == PADDR_NOT_AVAILABLE)) ?
+				"(page not available)" : "(not mapped)");
+
+			page_exists = FALSE;
+		} else {
+			fprintf(fp, "%s  %s\n\n",
+			    mkstring(buf1, UVADDR_PRLEN, LJUST|LONG_HEX, 
+				MKSTR(vaddr)),
+			    mkstring(buf2, VADDR_PRLEN, LJUST|LONGLONG_HEX, 
+				MKSTR(&paddr)));
+			page_exists = TRUE;
+		}
+		uvtop(tc, vaddr, &paddr, VERBOSE);
+		fprintf(fp, "\n");
+		vma = vm_area_dump(tc->task, UVADDR, vaddr, 0);
+		if (!page_exists) { 
+			if (swap_location(paddr, buf1))
+                       		fprintf(fp, "\nSWAP: %s\n", buf1);
+			else if (vma_file_offset(vma, vaddr, buf1))
+				fprintf(fp, "\nFILE: %s\n", buf1);
+		}
+		break; 
+
+	case KVADDR:
+                fprintf(fp, "%s  %s\n",
+                        mkstring(buf1, VADDR_PRLEN, LJUST, "VIRTUAL"),
                         mkstring(buf2, VADDR_PRLEN, LJUST, "PHYSICAL"));
 
-		if (!IN_TASK_VMA(tc->task, vaddr)) {
-			fprintf(fp, "%s  (not accessible)\n\n", 
-				mkstring(buf1, UVADDR_PRLEN, LJUST|LONG_HEX,
-				    MKSTR(vaddr)));
-			return;
-		}
-		if (!uvtop(tc, vaddr, &paddr, 0)) {
-			fprintf(fp, "%s  %s\n\n", 
-				mkstring(buf1, UVADDR_PRLEN, LJUST|LONG_HEX,
-				    MKSTR(vaddr)),
-				(XEN() && (paddr == PADDR_NOT_AVAILABLE)) ?
-				"(page not available)" : "(not mapped)");
+		if (!IS_KVADDR(vaddr)) {
+			fprintf(fp, "%-8lx  (not a kernel virtual address)\n\n",
+				vaddr);
+			return;
+		}
+		if (vtop_flags & USE_USER_PGD) {
+                	if (!uvtop(tc, vaddr, &paddr, 0)) {
+                        	fprintf(fp, "%s  %s\n\n", 
+					mkstring(buf1, UVADDR_PRLEN,
+                                        LJUST|LONG_HEX, MKSTR(vaddr)),
+					(XEN() && 
+					(paddr == PADDR_NOT_AVAILABLE)) ?
+					"(page not available)" :
+					"(not mapped)");
+                        	page_exists = FALSE;
+                	} else {
+                         	fprintf(fp, "%s  %s\n\n", 
+			     		mkstring(buf1, UVADDR_PRLEN, 
+					LJUST|LONG_HEX, MKSTR(vaddr)),
+                            		mkstring(buf2, VADDR_PRLEN, 
+					LJUST|LONGLONG_HEX, MKSTR(&paddr)));
+                         	page_exists = TRUE;
+                	}
+                	uvtop(tc, vaddr, &paddr, VERBOSE);
+		} else {
+			if (!kvtop(tc, vaddr, &paddr, 0)) {
+				fprintf(fp, "%s  %s\n\n", 
+					mkstring(buf1, VADDR_PRLEN,
+                                        LJUST|LONG_HEX, MKSTR(vaddr)),
+					(XEN() && 
+					(paddr == PADDR_NOT_AVAILABLE)) ?
+					"(page not available)" :
+					"(not mapped)");
+				page_exists = FALSE;
+			} else {
+				fprintf(fp, "%s  %s\n\n",
+                                        mkstring(buf1, VADDR_PRLEN,
+                                        LJUST|LONG_HEX, MKSTR(vaddr)),
+                                        mkstring(buf2, VADDR_PRLEN,
+                                        LJUST|LONGLONG_HEX, MKSTR(&paddr)));
+				page_exists = TRUE;
+			}
+			kvtop(tc, vaddr, &paddr, VERBOSE);
+		}
+		break;
+	}
+
+	fprintf(fp, "\n");
+
+	if (page_exists && phys_to_page(paddr, &page)) { 
+		if ((pc->flags & DEVMEM) && (paddr >= VTOP(vt->high_memory)))
+			return;
+		BZERO(&meminfo, sizeof(struct meminfo));
+		meminfo.flags = ADDRESS_SPECIFIED;
+		meminfo.spec_addr = paddr;
+		meminfo.memtype = PHYSADDR;
+		dump_mem_map(&meminfo);
+	}
+}
+
+/*
+ *  Runs PTOV() on the physical address argument or translates
+ *  a per-cpu offset and cpu specifier.
+ */
+void
+cmd_ptov(void)
+{
+	int c, len, unknown;
+	ulong vaddr;
+	physaddr_t paddr, paddr_test;
+	char buf1[BUFSIZE];
+	char buf2[BUFSIZE];
+	int others;
+	char *cpuspec;
+	ulong *cpus;
+	char *file;
+	int batch;
+
+	file = NULL;
+	batch = FALSE;
+
+        while ((c = getopt(argcnt, args, "bf:")) != EOF) {
+                switch(c)
+		{
+		case 'b':
+			batch = TRUE;
+			break;
+
+		case 'f':
+			file = optarg;
+			batch = TRUE;
+			break;
+
+		default:
+			argerrs++;
+			break;
+		}
+	}
+
+	if (argerrs || (!args[optind] && !file))
+		cmd_usage(pc->curcmd, SYNOPSIS);
+
+	if (batch) {
+		ptov_batch(file);
+		return;
+	}
+
+	others = 0;
+	cpuspec = NULL;
+	cpus = NULL;
+
+        while (args[optind]) {
+		cpuspec = strchr(args[optind], ':');
+		if (cpuspec) {
+			*cpuspec++ = NULLCHAR;
+			cpus = get_cpumask_buf();
+			if (STREQ(cpuspec, ""))
+				SET_BIT(cpus, CURRENT_CONTEXT()->processor);
+			else
+				make_cpumask(cpuspec, cpus, FAULT_ON_ERROR, NULL);
+		}
+
+		paddr = htoll(args[optind], FAULT_ON_ERROR, NULL);
+
+		if (cpuspec) {
+			sprintf(buf1, "[%d]", kt->cpus-1);
+			len = strlen(buf1) + 2;
+	
+			fprintf(fp, "%sPER-CPU OFFSET: %llx\n", 
+				others++ ? "\n" : "", (ulonglong)paddr);
+			fprintf(fp, "  %s  %s\n",
+		    		mkstring(buf1, len, LJUST, "CPU"),
+		    		mkstring(buf2, VADDR_PRLEN, LJUST, "VIRTUAL"));
+			for (c = 0; c < kt->cpus; c++) {
+				if (!NUM_IN_BITMAP(cpus, c))
+					continue;
+				vaddr = paddr + kt->__per_cpu_offset[c];
+				sprintf(buf1, "[%d]", c);
+				fprintf(fp, "  %s%lx",
+					mkstring(buf2, len, LJUST, buf1),
+					vaddr);
+
+				if (hide_offline_cpu(c))
+					fprintf(fp, " [OFFLINE]\n");
+				else
+					fprintf(fp, "\n");
+			}
+			FREEBUF(cpus);
+		} else {
+			vaddr = PTOV(paddr);
+	
+			unknown = BITS32() && (!kvtop(0, vaddr, &paddr_test, 0) || 
+			    (paddr_test != paddr));
+	
+			fprintf(fp, "%s%s  %s\n", others++ ? "\n" : "", 
+			    mkstring(buf1, VADDR_PRLEN, LJUST, "VIRTUAL"),
+			    mkstring(buf2, VADDR_PRLEN, LJUST, "PHYSICAL"));
+			fprintf(fp, "%s  %s\n", unknown ? 
+			    mkstring(buf1, VADDR_PRLEN, LJUST, "unknown") :
+			    mkstring(buf1, VADDR_PRLEN, LJUST|LONG_HEX, MKSTR(vaddr)),
+			    mkstring(buf2, VADDR_PRLEN, LJUST|LONGLONG_HEX, 
+				MKSTR(&paddr)));
+		}
+
+		optind++;
+	}
+}
+
+
+/*
+ *  Runs PTOB() on the page frame number to get the page address.
+ */
+void
+cmd_ptob(void)
+{
+        ulonglong value;
+
+        optind = 1;
+        if (!args[optind])
+                cmd_usage(pc->curcmd, SYNOPSIS);
+
+        while (args[optind]) {
+		value = stoll(args[optind], FAULT_ON_ERROR, NULL);
+		fprintf(fp, "%llx: %llx\n", value, PTOB(value));
+                optind++;
+        }
+}
+
+
+/*
+ *  Runs BTOP() on the address to get the page frame number.
+ */
+void
+cmd_btop(void)
+{
+        ulonglong value;
+
+        optind = 1;
+        if (!args[optind])
+                cmd_usage(pc->curcmd, SYNOPSIS);
+
+        while (args[optind]) {
+		value = htoll(args[optind], FAULT_ON_ERROR, NULL); 
+		fprintf(fp, "%llx: %llx\n", value, BTOP(value));
+                optind++;
+        }
+}
+
+/*
+ *  This command displays basic virtual memory information of a context,
+ *  consisting of a pointer to its mm_struct, its RSS and total virtual
+ *  memory size; and a list of pointers to each vm_area_struct, its starting
+ *  and ending address, and vm_flags value.  The argument can be a task
+ *  address or a PID number; if no args, the current context is used.
+ */
+void
+cmd_vm(void)
+{
+	int c;
+	ulong flag;
+	ulong value;
+	ulong single_vma;
+	ulonglong llvalue;
+	struct task_context *tc;
+	struct reference reference, *ref;
+	unsigned int radix;
+	int subsequent;
+
+	flag = 0;
+	single_vma = 0;
+	radix = 0;
+	ref = NULL;
+	BZERO(&reference, sizeof(struct reference));
+
+        while ((c = getopt(argcnt, args, "f:pmvR:P:xdM:")) != EOF) {
+                switch(c)
+		{
+		case 'M':
+			pc->curcmd_private = htoll(optarg, FAULT_ON_ERROR, NULL);
+			pc->curcmd_flags |= MM_STRUCT_FORCE;
+			break;
+
+		case 'f':
+			if (flag) 
+				argerrs++;
+			else {
+				llvalue = htoll(optarg, FAULT_ON_ERROR, NULL);
+				do_vm_flags(llvalue);
+				return;
+			}
+			break;
+
+		case 'p': 
+			if (flag)
+				argerrs++;
+			else
+				flag |= PHYSADDR;
+			break;
+		case 'm':
+			if (flag)
+				argerrs++;
+			else
+				flag |= PRINT_MM_STRUCT;
+			break;
+		case 'v':
+			if (flag)
+				argerrs++;
+			else
+				flag |= PRINT_VMA_STRUCTS;
+			break;
+
+		case 'R':
+			if (ref) {
+				error(INFO, "only one -R option allowed\n");
+				argerrs++;
+			} else if (flag && !(flag & PHYSADDR))
+				argerrs++;
+			else {
+				ref = &reference;
+				ref->str = optarg;
+				flag |= PHYSADDR;
+			}
+			break;
+
+		case 'P':
+			if (flag)
+				argerrs++;
+			else {
+				flag |= PRINT_SINGLE_VMA;
+				single_vma = htol(optarg, FAULT_ON_ERROR, NULL);
+			}
+			break;
+
+		case 'x':
+			if (radix == 10)
+				error(FATAL,
+					"-d and -x are mutually exclusive\n");
+			radix = 16;
+			break;
+
+		case 'd':
+			if (radix == 16)
+				error(FATAL,
+					"-d and -x are mutually exclusive\n");
+			radix = 10;
+			break;
+
+		default:
+			argerrs++;
+			break;
+		}
+	}
+
+	if (argerrs)
+		cmd_usage(pc->curcmd, SYNOPSIS);
+
+	if (radix == 10)
+		flag |= PRINT_RADIX_10;
+	else if (radix == 16)
+		flag |= PRINT_RADIX_16;
+
+	if (!args[optind]) {
+		if (!ref)
+			print_task_header(fp, CURRENT_CONTEXT(), 0);
+		vm_area_dump(CURRENT_TASK(), flag, single_vma, ref);
+		return;
+	}
+
+	subsequent = 0;
 
-			page_exists = FALSE;
-		} else {
-			fprintf(fp, "%s  %s\n\n",
-			    mkstring(buf1, UVADDR_PRLEN, LJUST|LONG_HEX, 
-				MKSTR(vaddr)),
-			    mkstring(buf2, VADDR_PRLEN, LJUST|LONGLONG_HEX, 
-				MKSTR(&paddr)));
-			page_exists = TRUE;
-		}
-		uvtop(tc, vaddr, &paddr, VERBOSE);
-		fprintf(fp, "\n");
-		vma = vm_area_dump(tc->task, UVADDR, vaddr, 0);
-		if (!page_exists) { 
-			if (swap_location(paddr, buf1))
-                       		fprintf(fp, "\nSWAP: %s\n", buf1);
-			else if (vma_file_offset(vma, vaddr, buf1))
-				fprintf(fp, "\nFILE: %s\n", buf1);
-		}
-		break; 
+	while (args[optind]) {
+		switch (str_to_context(args[optind], &value, &tc))
+		{
+		case STR_PID:
+			for (tc = pid_to_context(value); tc; tc = tc->tc_next) {
+                                if (!ref)
+                                        print_task_header(fp, tc, subsequent++);
+                                vm_area_dump(tc->task, flag, single_vma, ref);
+                        }
+			break;
 
-	case KVADDR:
-                fprintf(fp, "%s  %s\n",
-                        mkstring(buf1, VADDR_PRLEN, LJUST, "VIRTUAL"),
-                        mkstring(buf2, VADDR_PRLEN, LJUST, "PHYSICAL"));
+		case STR_TASK:
+			if (!ref)
+                                print_task_header(fp, tc, subsequent++);
+                        vm_area_dump(tc->task, flag, single_vma, ref);
+			break;
 
-		if (!IS_KVADDR(vaddr)) {
-			fprintf(fp, "%-8lx  (not a kernel virtual address)\n\n",
-				vaddr);
-			return;
-		}
-		if (vtop_flags & USE_USER_PGD) {
-                	if (!uvtop(tc, vaddr, &paddr, 0)) {
-                        	fprintf(fp, "%s  %s\n\n", 
-					mkstring(buf1, UVADDR_PRLEN,
-                                        LJUST|LONG_HEX, MKSTR(vaddr)),
-					(XEN() && 
-					(paddr == PADDR_NOT_AVAILABLE)) ?
-					"(page not available)" :
-					"(not mapped)");
-                        	page_exists = FALSE;
-                	} else {
-                         	fprintf(fp, "%s  %s\n\n", 
-			     		mkstring(buf1, UVADDR_PRLEN, 
-					LJUST|LONG_HEX, MKSTR(vaddr)),
-                            		mkstring(buf2, VADDR_PRLEN, 
-					LJUST|LONGLONG_HEX, MKSTR(&paddr)));
-                         	page_exists = TRUE;
-                	}
-                	uvtop(tc, vaddr, &paddr, VERBOSE);
-		} else {
-			if (!kvtop(tc, vaddr, &paddr, 0)) {
-				fprintf(fp, "%s  %s\n\n", 
-					mkstring(buf1, VADDR_PRLEN,
-                                        LJUST|LONG_HEX, MKSTR(vaddr)),
-					(XEN() && 
-					(paddr == PADDR_NOT_AVAILABLE)) ?
-					"(page not available)" :
-					"(not mapped)");
-				page_exists = FALSE;
-			} else {
-				fprintf(fp, "%s  %s\n\n",
-                                        mkstring(buf1, VADDR_PRLEN,
-                                        LJUST|LONG_HEX, MKSTR(vaddr)),
-                                        mkstring(buf2, VADDR_PRLEN,
-                                        LJUST|LONGLONG_HEX, MKSTR(&paddr)));
-				page_exists = TRUE;
-			}
-			kvtop(tc, vaddr, &paddr, VERBOSE);
+		case STR_INVALID:
+			error(INFO, "%sinvalid task or pid value: %s\n",
+				subsequent++ ? "\n" : "", args[optind]);
+			break;
 		}
-		break;
+
+		optind++;
 	}
+}
 
-	fprintf(fp, "\n");
+/*
+ *  Translate a vm_flags value.
+ */
 
-	if (page_exists && phys_to_page(paddr, &page)) { 
-		if ((pc->flags & DEVMEM) && (paddr >= VTOP(vt->high_memory)))
-			return;
-		BZERO(&meminfo, sizeof(struct meminfo));
-		meminfo.flags = ADDRESS_SPECIFIED;
-		meminfo.spec_addr = paddr;
-		meminfo.memtype = PHYSADDR;
-		dump_mem_map(&meminfo);
+#define VM_READ		0x00000001ULL	/* currently active flags */
+#define VM_WRITE	0x00000002ULL
+#define VM_EXEC		0x00000004ULL
+#define VM_SHARED	0x00000008ULL
+#define VM_MAYREAD	0x00000010ULL	/* limits for mprotect() etc */
+#define VM_MAYWRITE	0x00000020ULL
+#define VM_MAYEXEC	0x00000040ULL
+#define VM_MAYSHARE	0x00000080ULL
+#define VM_GROWSDOWN	0x00000100ULL	/* general info on the segment */
+#define VM_GROWSUP	0x00000200ULL
+#define VM_NOHUGEPAGE   0x00000200ULL   /* MADV_NOHUGEPAGE marked this vma */
+#define VM_SHM		0x00000400ULL	/* shared memory area, don't swap out */
+#define VM_PFNMAP       0x00000400ULL
+#define VM_DENYWRITE	0x00000800ULL	/* ETXTBSY on write attempts.. */
+#define VM_EXECUTABLE	0x00001000ULL
+#define VM_LOCKED	0x00002000ULL
+#define VM_IO           0x00004000ULL	/* Memory mapped I/O or similar */
+#define VM_SEQ_READ	0x00008000ULL	/* App will access data sequentially */
+#define VM_RAND_READ	0x00010000ULL	/* App will not benefit from clustered reads */
+#define VM_DONTCOPY	0x00020000ULL   /* Do not copy this vma on fork */
+#define VM_DONTEXPAND   0x00040000ULL   /* Cannot expand with mremap() */
+#define VM_RESERVED     0x00080000ULL   /* Don't unmap it from swap_out */
+
+#define VM_BIGPAGE      0x00100000ULL   /* bigpage mappings, no pte's */
+#define VM_BIGMAP       0x00200000ULL   /* user wants bigpage mapping */
+
+#define VM_WRITECOMBINED 0x00100000ULL   /* Write-combined */
+#define VM_NONCACHED     0x00200000ULL   /* Noncached access */
+#define VM_HUGETLB       0x00400000ULL   /* Huge tlb Page*/
+#define VM_ACCOUNT       0x00100000ULL   /* Memory is a vm accounted object */
+
+#define VM_NONLINEAR     0x00800000ULL   /* Is non-linear (remap_file_pages) */
+
+#define VM_MAPPED_COPY  0x01000000ULL    /* T if mapped copy of data (nommu mmap) */
+#define VM_HUGEPAGE     0x01000000ULL    /* MADV_HUGEPAGE marked this vma */
+
+#define VM_INSERTPAGE   0x02000000ULL    /* The vma has had "vm_insert_page()" done on it */
+#define VM_ALWAYSDUMP   0x04000000ULL    /* Always include in core dumps */
+
+#define VM_CAN_NONLINEAR 0x08000000ULL   /* Has ->fault & does nonlinear pages */
+#define VM_MIXEDMAP     0x10000000ULL    /* Can contain "struct page" and pure PFN pages */
+#define VM_SAO          0x20000000ULL    /* Strong Access Ordering (powerpc) */
+#define VM_PFN_AT_MMAP  0x40000000ULL    /* PFNMAP vma that is fully mapped at mmap time */
+#define VM_MERGEABLE    0x80000000ULL    /* KSM may merge identical pages */
+
+static void
+do_vm_flags(ulonglong flags)
+{
+	int others;
+
+	others = 0;
+
+	fprintf(fp, "%llx: (", flags);
+
+	if (flags & VM_READ) {
+		fprintf(fp, "READ");
+		others++;
+	}
+	if (flags & VM_WRITE)
+		fprintf(fp, "%sWRITE", others++ ? "|" : "");
+	if (flags & VM_EXEC)
+		fprintf(fp, "%sEXEC", others++ ? "|" : "");
+	if (flags & VM_SHARED)
+		fprintf(fp, "%sSHARED", others++ ? "|" : "");
+	if (flags & VM_MAYREAD)
+		fprintf(fp, "%sMAYREAD", others++ ? "|" : "");
+	if (flags & VM_MAYWRITE)
+		fprintf(fp, "%sMAYWRITE", others++ ? "|" : "");
+	if (flags & VM_MAYEXEC)
+		fprintf(fp, "%sMAYEXEC", others++ ? "|" : "");
+	if (flags & VM_MAYSHARE)
+		fprintf(fp, "%sMAYSHARE", others++ ? "|" : "");
+	if (flags & VM_GROWSDOWN)
+		fprintf(fp, "%sGROWSDOWN", others++ ? "|" : "");
+	if (kernel_symbol_exists("expand_upwards")) {
+	    	if (flags & VM_GROWSUP)
+			fprintf(fp, "%sGROWSUP", others++ ? "|" : "");
+	} else if (flags & VM_NOHUGEPAGE)
+		fprintf(fp, "%sNOHUGEPAGE", others++ ? "|" : "");
+	if (flags & VM_SHM) {
+		if (THIS_KERNEL_VERSION > LINUX(2,6,17))
+			fprintf(fp, "%sPFNMAP", others++ ? "|" : "");
+		else
+			fprintf(fp, "%sSHM", others++ ? "|" : "");
+	}
+	if (flags & VM_DENYWRITE)
+		fprintf(fp, "%sDENYWRITE", others++ ? "|" : "");
+	if (flags & VM_EXECUTABLE)
+		fprintf(fp, "%sEXECUTABLE", others++ ? "|" : "");
+	if (flags & VM_LOCKED)
+		fprintf(fp, "%sLOCKED", others++ ? "|" : "");
+	if (flags & VM_IO)
+		fprintf(fp, "%sIO", others++ ? "|" : "");
+	if (flags & VM_SEQ_READ)
+		fprintf(fp, "%sSEQ_READ", others++ ? "|" : "");
+	if (flags & VM_RAND_READ)
+		fprintf(fp, "%sRAND_READ", others++ ? "|" : "");
+	if (flags & VM_DONTCOPY)
+		fprintf(fp, "%sDONTCOPY", others++ ? "|" : "");
+        if (flags & VM_DONTEXPAND)
+                fprintf(fp, "%sDONTEXPAND", others++ ? "|" : "");
+        if (flags & VM_RESERVED)
+                fprintf(fp, "%sRESERVED", others++ ? "|" : "");
+	if (symbol_exists("nr_bigpages") && (THIS_KERNEL_VERSION == LINUX(2,4,9))) {
+        	if (flags & VM_BIGPAGE)
+                	fprintf(fp, "%sBIGPAGE", others++ ? "|" : "");
+        	if (flags & VM_BIGMAP)
+                	fprintf(fp, "%sBIGMAP", others++ ? "|" : "");
+	} else {
+		if ((THIS_KERNEL_VERSION < LINUX(2,4,21)) &&
+        	    (flags & VM_WRITECOMBINED))
+                	fprintf(fp, "%sWRITECOMBINED", others++ ? "|" : "");
+		if ((THIS_KERNEL_VERSION < LINUX(2,4,21)) &&
+        	    (flags & VM_NONCACHED))
+                	fprintf(fp, "%sNONCACHED", others++ ? "|" : "");
+        	if (flags & VM_HUGETLB)
+                	fprintf(fp, "%sHUGETLB", others++ ? "|" : "");
+        	if (flags & VM_ACCOUNT)
+                	fprintf(fp, "%sACCOUNT", others++ ? "|" : "");
+	}
+        if (flags & VM_NONLINEAR)
+                fprintf(fp, "%sNONLINEAR", others++ ? "|" : "");
+
+	if (flags & VM_HUGEPAGE) {
+		if (MEMBER_EXISTS("mm_struct", "pmd_huge_pte"))
+                	fprintf(fp, "%sHUGEPAGE", others++ ? "|" : "");
+		else
+                	fprintf(fp, "%sMAPPED_COPY", others++ ? "|" : "");
 	}
+
+        if (flags & VM_INSERTPAGE)
+                fprintf(fp, "%sINSERTPAGE", others++ ? "|" : "");
+        if (flags & VM_ALWAYSDUMP)
+                fprintf(fp, "%sALWAYSDUMP", others++ ? "|" : "");
+        if (flags & VM_CAN_NONLINEAR)
+                fprintf(fp, "%sCAN_NONLINEAR", others++ ? "|" : "");
+        if (flags & VM_MIXEDMAP)
+                fprintf(fp, "%sMIXEDMAP", others++ ? "|" : "");
+        if (flags & VM_SAO)
+                fprintf(fp, "%sSAO", others++ ? "|" : "");
+        if (flags & VM_PFN_AT_MMAP)
+                fprintf(fp, "%sPFN_AT_MMAP", others++ ? "|" : "");
+        if (flags & VM_MERGEABLE)
+                fprintf(fp, "%sMERGEABLE", others++ ? "|" : "");
+
+	fprintf(fp, ")\n");
+
 }
 
 /*
- *  Runs PTOV() on the physical address argument or translates
- *  a per-cpu offset and cpu specifier.
+ * Read whatever size vm_area_struct.vm_flags happens to be into a ulonglong.
  */
-void
-cmd_ptov(void)
+static ulonglong
+get_vm_flags(char *vma_buf)
 {
-	int c, len, unknown;
-	ulong vaddr;
-	physaddr_t paddr, paddr_test;
-	char buf1[BUFSIZE];
-	char buf2[BUFSIZE];
-	int others;
-	char *cpuspec;
-	ulong *cpus;
+	ulonglong vm_flags = 0;
 
-        while ((c = getopt(argcnt, args, "")) != EOF) {
-                switch(c)
-		{
-		default:
-			argerrs++;
-			break;
-		}
-	}
+	if (SIZE(vm_area_struct_vm_flags) == sizeof(short))
+		vm_flags = USHORT(vma_buf + OFFSET(vm_area_struct_vm_flags));
+	else if (SIZE(vm_area_struct_vm_flags) == sizeof(long))
+		vm_flags = ULONG(vma_buf+ OFFSET(vm_area_struct_vm_flags));
+	else if (SIZE(vm_area_struct_vm_flags) == sizeof(long long))
+		vm_flags = ULONGLONG(vma_buf+ OFFSET(vm_area_struct_vm_flags));
+	else
+		error(INFO, "questionable vm_area_struct.vm_flags size: %d\n",
+			SIZE(vm_area_struct_vm_flags));
 
-	if (argerrs || !args[optind])
-		cmd_usage(pc->curcmd, SYNOPSIS);
+	return vm_flags;
+}
 
-	others = 0;
-	cpuspec = NULL;
-	cpus = NULL;
+static void
+vm_cleanup(void *arg)
+{
+	struct task_context *tc;
 
-        while (args[optind]) {
-		cpuspec = strchr(args[optind], ':');
-		if (cpuspec) {
-			*cpuspec++ = NULLCHAR;
-			cpus = get_cpumask_buf();
-			if (STREQ(cpuspec, ""))
-				SET_BIT(cpus, CURRENT_CONTEXT()->processor);
-			else
-				make_cpumask(cpuspec, cpus, FAULT_ON_ERROR, NULL);
-		}
+	pc->cmd_cleanup = NULL;
+	pc->cmd_cleanup_arg = NULL;
 
-		paddr = htoll(args[optind], FAULT_ON_ERROR, NULL);
+	tc = (struct task_context *)arg;
+	tc->mm_struct = 0;
+}
 
-		if (cpuspec) {
-			sprintf(buf1, "[%d]", kt->cpus-1);
-			len = strlen(buf1) + 2;
-	
-			fprintf(fp, "%sPER-CPU OFFSET: %llx\n", 
-				others++ ? "\n" : "", (ulonglong)paddr);
-			fprintf(fp, "  %s  %s\n",
-		    		mkstring(buf1, len, LJUST, "CPU"),
-		    		mkstring(buf2, VADDR_PRLEN, LJUST, "VIRTUAL"));
-			for (c = 0; c < kt->cpus; c++) {
-				if (!NUM_IN_BITMAP(cpus, c))
-					continue;
-				vaddr = paddr + kt->__per_cpu_offset[c];
-				sprintf(buf1, "[%d]", c);
-				fprintf(fp, "  %s%lx",
-					mkstring(buf2, len, LJUST, buf1),
-					vaddr);
+static int
+is_valid_mm(ulong mm)
+{
+	char kbuf[BUFSIZE];
+	char *p;
+	int mm_count;
 
-				if (hide_offline_cpu(c))
-					fprintf(fp, " [OFFLINE]\n");
-				else
-					fprintf(fp, "\n");
-			}
-			FREEBUF(cpus);
-		} else {
-			vaddr = PTOV(paddr);
-	
-			unknown = BITS32() && (!kvtop(0, vaddr, &paddr_test, 0) || 
-			    (paddr_test != paddr));
-	
-			fprintf(fp, "%s%s  %s\n", others++ ? "\n" : "", 
-			    mkstring(buf1, VADDR_PRLEN, LJUST, "VIRTUAL"),
-			    mkstring(buf2, VADDR_PRLEN, LJUST, "PHYSICAL"));
-			fprintf(fp, "%s  %s\n", unknown ? 
-			    mkstring(buf1, VADDR_PRLEN, LJUST, "unknown") :
-			    mkstring(buf1, VADDR_PRLEN, LJUST|LONG_HEX, MKSTR(vaddr)),
-			    mkstring(buf2, VADDR_PRLEN, LJUST|LONGLONG_HEX, 
-				MKSTR(&paddr)));
-		}
+	if (!(p = vaddr_to_kmem_cache(mm, kbuf, VERBOSE)))
+		goto bailout;
 
-		optind++;
-	}
-}
+	if (!STRNEQ(p, "mm_struct"))
+		goto bailout;
+
+	readmem(mm + OFFSET(mm_struct_mm_count), KVADDR, &mm_count, sizeof(int),
+		"mm_struct mm_count", FAULT_ON_ERROR);
+
+	if (mm_count == 0)
+		error(FATAL, "stale mm_struct address\n");
+
+	return mm_count;
 
+bailout:
+	error(FATAL, "invalid mm_struct address\n");
+	return 0;
+}
 
 /*
- *  Runs PTOB() on the page frame number to get the page address.
+ *  Snapshots of the VMA lists of recently-used mm_structs.  IN_TASK_VMA()
+ *  is used for each candidate user address found by commands such as
+ *  "bt", and used to walk and read the mm's entire VMA list whenever the
+ *  address was not in a VMA, which for processes with tens of thousands
+ *  of mappings was far more than the small vm_area_struct cache could
+ *  hold.  Instead, the start, end, flags and file of each VMA are read
+ *  into an array once, and because the list is kept in address order,
+ *  addresses can then be looked up with a binary search.  The snapshots
+ *  of up to VMA_SNAPSHOTS mm_structs are kept, the least recently used
+ *  one being replaced.  On a live system they are discarded before each
+ *  command.  If a VMA list cannot be read, or is not in address order,
+ *  vm_area_dump() walks the list as before.
  */
-void
-cmd_ptob(void)
-{
-        ulonglong value;
+#define VMA_SNAPSHOTS (8)
+#define VMA_SNAPSHOT_MAX (1 << 22)
+
+static struct vma_snapshot_cache {
+	ulong cmdgen;
+	ulong clock;
+	struct vma_snapshot {
+		ulong mm;
+		ulong last_used;
+		int count;
+		struct vma_snapshot_entry {
+			ulong vma;
+			ulong start;
+			ulong end;
+			ulong file;
+			ulonglong flags;
+		} *entries;
+	} snapshots[VMA_SNAPSHOTS];
+	ulong hits;
+	ulong builds;
+} vma_snapshots = { 0 };
 
-        optind = 1;
-        if (!args[optind])
-                cmd_usage(pc->curcmd, SYNOPSIS);
+static void
+vma_snapshot_flush(void)
+{
+	int i;
 
-        while (args[optind]) {
-		value = stoll(args[optind], FAULT_ON_ERROR, NULL);
-		fprintf(fp, "%llx: %llx\n", value, PTOB(value));
-                optind++;
-        }
+	for (i = 0; i < VMA_SNAPSHOTS; i++)
+		free(vma_snapshots.snapshots[i].entries);
+	BZERO(vma_snapshots.snapshots, sizeof(vma_snapshots.snapshots));
 }
 
-
 /*
- *  Runs BTOP() on the address to get the page frame number.
+ *  Kernels without mm_struct.mmap keep an mm's VMAs in its mm_mt maple
+ *  tree, indexed by address.
  */
-void
-cmd_btop(void)
-{
-        ulonglong value;
+#define VMA_MAPLE_TREE() \
+	(INVALID_MEMBER(mm_struct_mmap) && VALID_MEMBER(mm_struct_mm_mt))
 
-        optind = 1;
-        if (!args[optind])
-                cmd_usage(pc->curcmd, SYNOPSIS);
+struct mm_vma_list {
+	ulong *vmas;
+	int count;
+	int avail;
+};
 
-        while (args[optind]) {
-		value = htoll(args[optind], FAULT_ON_ERROR, NULL); 
-		fprintf(fp, "%llx: %llx\n", value, BTOP(value));
-                optind++;
-        }
+static void
+mm_vma_list_entry(ulong node, ulong slot, const char *path,
+		  ulong first, ulong last, void *private)
+{
+	struct mm_vma_list *vl = private;
+
+	if (vl->count == vl->avail) {
+		RESIZEBUF(vl->vmas, sizeof(ulong) * vl->avail,
+			sizeof(ulong) * vl->avail * 2);
+		vl->avail *= 2;
+	}
+	vl->vmas[vl->count++] = slot;
 }
 
 /*
- *  This command displays basic virtual memory information of a context,
- *  consisting of a pointer to its mm_struct, its RSS and total virtual
- *  memory size; and a list of pointers to each vm_area_struct, its starting
- *  and ending address, and vm_flags value.  The argument can be a task
- *  address or a PID number; if no args, the current context is used.
+ *  Gather the addresses of the VMAs in an mm's maple tree that overlap
+ *  the user address range first through last, in address order.  The
+ *  list is returned in a GETBUF() buffer.
  */
-void
-cmd_vm(void)
+static int
+get_mm_vma_list(ulong mm, ulong first, ulong last, ulong **vmas)
 {
-	int c;
-	ulong flag;
-	ulong value;
-	ulong single_vma;
-	ulonglong llvalue;
-	struct task_context *tc;
-	struct reference reference, *ref;
-	unsigned int radix;
-	int subsequent;
+	struct mm_vma_list vma_list, *vl;
+	struct maple_tree_ops ops;
+
+	vl = &vma_list;
+	vl->avail = 64;
+	vl->count = 0;
+	vl->vmas = (ulong *)GETBUF(sizeof(ulong) * vl->avail);
+
+	BZERO(&ops, sizeof(struct maple_tree_ops));
+	ops.entry = mm_vma_list_entry;
+	ops.private = vl;
+	ops.first = first;
+	ops.last = last;
+	do_maple_tree_traverse(mm + OFFSET(mm_struct_mm_mt), TRUE, &ops);
+
+	*vmas = vl->vmas;
+	return vl->count;
+}
 
-	flag = 0;
-	single_vma = 0;
-	radix = 0;
-	ref = NULL;
-	BZERO(&reference, sizeof(struct reference));
+static struct vma_snapshot *
+get_vma_snapshot(ulong mm)
+{
+	int i, avail, nvmas;
+	ulong vma, *vmas;
+	char *vma_buf;
+	struct vma_snapshot *snap, *victim;
+	struct vma_snapshot_entry *ent, *entries;
 
-        while ((c = getopt(argcnt, args, "f:pmvR:P:xdM:")) != EOF) {
-                switch(c)
-		{
-		case 'M':
-			pc->curcmd_private = htoll(optarg, FAULT_ON_ERROR, NULL);
-			pc->curcmd_flags |= MM_STRUCT_FORCE;
-			break;
+	if (ACTIVE() && (vma_snapshots.cmdgen != pc->cmdgencur)) {
+		vma_snapshot_flush();
+		vma_snapshots.cmdgen = pc->cmdgencur;
+	}
 
-		case 'f':
-			if (flag) 
-				argerrs++;
-			else {
-				llvalue = htoll(optarg, FAULT_ON_ERROR, NULL);
-				do_vm_flags(llvalue);
-				return;
-			}
-			break;
+	for (i = 0, victim = NULL; i < VMA_SNAPSHOTS; i++) {
+		snap = &vma_snapshots.snapshots[i];
+		if (snap->mm == mm) {
+			vma_snapshots.hits++;
+			snap->last_used = ++vma_snapshots.clock;
+			return snap->entries ? snap : NULL;
+		}
+		if (!victim || (snap->last_used < victim->last_used))
+			victim = snap;
+	}
 
-		case 'p': 
-			if (flag)
-				argerrs++;
-			else
-				flag |= PHYSADDR;
-			break;
-		case 'm':
-			if (flag)
-				argerrs++;
-			else
-				flag |= PRINT_MM_STRUCT;
-			break;
-		case 'v':
-			if (flag)
-				argerrs++;
-			else
-				flag |= PRINT_VMA_STRUCTS;
-			break;
+	snap = victim;
+	free(snap->entries);
+	BZERO(snap, sizeof(struct vma_snapshot));
+	snap->mm = mm;
+	snap->last_used = ++vma_snapshots.clock;
+	vma_snapshots.builds++;
+
+	/*
+	 *  A failed snapshot is remembered with no entries, so that the
+	 *  mm's VMA list is not read again just to fail again.
+	 */
+	vmas = NULL;
+	nvmas = 0;
+	if (VMA_MAPLE_TREE()) {
+		nvmas = get_mm_vma_list(mm, 0, ~0UL, &vmas);
+		vma = nvmas ? vmas[0] : 0;
+	} else if (!readmem(mm + OFFSET(mm_struct_mmap), KVADDR, &vma,
+	    sizeof(void *), "mm_struct mmap", RETURN_ON_ERROR|QUIET))
+		return NULL;
+
+	vma_buf = GETBUF(SIZE(vm_area_struct));
+	entries = NULL;
+	avail = 0;
+
+	for (i = 0; vma; vma = vmas ? (++i < nvmas ? vmas[i] : 0) :
+	     ULONG(vma_buf + OFFSET(vm_area_struct_vm_next))) {
+		if ((snap->count == VMA_SNAPSHOT_MAX) ||
+		    !readmem(vma, KVADDR, vma_buf, SIZE(vm_area_struct),
+		    "vm_area_struct", RETURN_ON_ERROR|QUIET))
+			goto bailout;
+
+		if (snap->count == avail) {
+			avail = avail ? avail * 2 : 256;
+			if (!(ent = realloc(entries,
+			    sizeof(struct vma_snapshot_entry) * avail)))
+				goto bailout;
+			entries = ent;
+		}
+
+		ent = &entries[snap->count];
+		ent->vma = vma;
+		ent->start = ULONG(vma_buf + OFFSET(vm_area_struct_vm_start));
+		ent->end = ULONG(vma_buf + OFFSET(vm_area_struct_vm_end));
+		ent->file = ULONG(vma_buf + OFFSET(vm_area_struct_vm_file));
+		ent->flags = get_vm_flags(vma_buf);
+
+		if (snap->count && (ent->start < (ent-1)->end))
+			goto bailout;
+		snap->count++;
+	}
+
+	FREEBUF(vma_buf);
+	if (vmas)
+		FREEBUF(vmas);
+	if (!entries && !(entries = malloc(sizeof(struct vma_snapshot_entry)))) {
+		snap->count = 0;
+		return NULL;
+	}
+	snap->entries = entries;
+
+	return snap;
+
+bailout:
+	FREEBUF(vma_buf);
+	if (vmas)
+		FREEBUF(vmas);
+	free(entries);
+	snap->count = 0;
+	return NULL;
+}
+
+static struct vma_snapshot_entry *
+vma_snapshot_lookup(struct vma_snapshot *snap, ulong vaddr)
+{
+	int lo, hi, mid;
+	struct vma_snapshot_entry *ent;
+
+	lo = 0;
+	hi = snap->count - 1;
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		ent = &snap->entries[mid];
+		if (vaddr < ent->start)
+			hi = mid - 1;
+		else if (vaddr >= ent->end)
+			lo = mid + 1;
+		else
+			return ent;
+	}
 
-		case 'R':
-			if (ref) {
-				error(INFO, "only one -R option allowed\n");
-				argerrs++;
-			} else if (flag && !(flag & PHYSADDR))
-				argerrs++;
-			else {
-				ref = &reference;
-				ref->str = optarg;
-				flag |= PHYSADDR;
-			}
-			break;
+	return NULL;
+}
 
-		case 'P':
-			if (flag)
-				argerrs++;
-			else {
-				flag |= PRINT_SINGLE_VMA;
-				single_vma = htol(optarg, FAULT_ON_ERROR, NULL);
-			}
-			break;
+/*
+ *  The reverse-mapping index of the "rmap" command.  Each user address
+ *  space is walked once, one VMA at a time with vtop_range(), and each
+ *  extent of physically contiguous memory that it maps is recorded with
+ *  the first task that uses the mm_struct.  The extents are sorted by
+ *  physical address, so that the tasks mapping a physical address can
+ *  be found with a binary search, here and by "kmem <address>", for as
+ *  long as the index is kept.  It is not rebuilt automatically, so on a
+ *  live system it shows the mappings as of when it was built.
+ */
+#define RMAP_EXTENTS (1024)
 
-		case 'x':
-			if (radix == 10)
-				error(FATAL,
-					"-d and -x are mutually exclusive\n");
-			radix = 16;
-			break;
+struct rmap_extent {
+	physaddr_t paddr;
+	ulong length;
+	ulong vaddr;
+	ulong task;
+};
 
-		case 'd':
-			if (radix == 16)
-				error(FATAL,
-					"-d and -x are mutually exclusive\n");
-			radix = 10;
-			break;
+static struct rmap_index {
+	int built;
+	ulong count;
+	ulong avail;
+	ulong maxlen;
+	ulong mms;
+	ulong vmas;
+	ulong failed;
+	struct rmap_extent *extents;
+} rmap_index = { 0 };
+
+struct rmap_mm {
+	ulong mm;
+	ulong pid;
+	struct task_context *tc;
+};
 
-		default:
-			argerrs++;
-			break;
-		}
+static int
+rmap_mm_compare(const void *a, const void *b)
+{
+	const struct rmap_mm *m1 = a, *m2 = b;
+
+	if (m1->mm != m2->mm)
+		return m1->mm < m2->mm ? -1 : 1;
+	if (m1->pid != m2->pid)
+		return m1->pid < m2->pid ? -1 : 1;
+	return 0;
+}
+
+static int
+rmap_extent_compare(const void *a, const void *b)
+{
+	const struct rmap_extent *e1 = a, *e2 = b;
+
+	if (e1->paddr != e2->paddr)
+		return e1->paddr < e2->paddr ? -1 : 1;
+	return 0;
+}
+
+static void
+rmap_index_add(struct task_context *tc, struct vtop_extent *ext)
+{
+	struct rmap_extent *re;
+
+	if (rmap_index.count == rmap_index.avail) {
+		rmap_index.avail = rmap_index.avail ? rmap_index.avail * 2 : 4096;
+		if (!(re = realloc(rmap_index.extents,
+		    sizeof(struct rmap_extent) * rmap_index.avail)))
+			error(FATAL, "cannot realloc reverse-mapping index\n");
+		rmap_index.extents = re;
 	}
 
-	if (argerrs)
-		cmd_usage(pc->curcmd, SYNOPSIS);
+	re = &rmap_index.extents[rmap_index.count++];
+	re->paddr = ext->paddr;
+	re->length = ext->length;
+	re->vaddr = ext->vaddr;
+	re->task = tc->task;
 
-	if (radix == 10)
-		flag |= PRINT_RADIX_10;
-	else if (radix == 16)
-		flag |= PRINT_RADIX_16;
+	if (ext->length > rmap_index.maxlen)
+		rmap_index.maxlen = ext->length;
+}
 
-	if (!args[optind]) {
-		if (!ref)
-			print_task_header(fp, CURRENT_CONTEXT(), 0);
-		vm_area_dump(CURRENT_TASK(), flag, single_vma, ref);
-		return;
+static void
+rmap_index_build(void)
+{
+	int i, j, cnt;
+	ulong nr, vaddr;
+	struct task_context *tc;
+	struct rmap_mm *mms;
+	struct vma_snapshot *snap;
+	struct vma_snapshot_entry *ent;
+	struct vtop_extent *extents;
+
+	free(rmap_index.extents);
+	BZERO(&rmap_index, sizeof(struct rmap_index));
+
+	/*
+	 *  Each mm_struct is walked once, with the lowest-numbered task
+	 *  that uses it, which is normally its thread group leader.
+	 */
+	mms = (struct rmap_mm *)GETBUF(sizeof(struct rmap_mm) *
+		(RUNNING_TASKS() + 1));
+	tc = FIRST_CONTEXT();
+	for (i = nr = 0; i < RUNNING_TASKS(); i++, tc++) {
+		if (!tc->mm_struct)
+			continue;
+		mms[nr].mm = tc->mm_struct;
+		mms[nr].pid = tc->pid;
+		mms[nr].tc = tc;
+		nr++;
 	}
+	qsort(mms, nr, sizeof(struct rmap_mm), rmap_mm_compare);
 
-	subsequent = 0;
+	extents = (struct vtop_extent *)GETBUF(sizeof(struct vtop_extent) *
+		RMAP_EXTENTS);
 
-	while (args[optind]) {
-		switch (str_to_context(args[optind], &value, &tc))
-		{
-		case STR_PID:
-			for (tc = pid_to_context(value); tc; tc = tc->tc_next) {
-                                if (!ref)
-                                        print_task_header(fp, tc, subsequent++);
-                                vm_area_dump(tc->task, flag, single_vma, ref);
-                        }
-			break;
+	please_wait("building reverse-mapping index");
 
-		case STR_TASK:
-			if (!ref)
-                                print_task_header(fp, tc, subsequent++);
-                        vm_area_dump(tc->task, flag, single_vma, ref);
-			break;
+	for (i = 0; i < nr; i++) {
+		if (i && (mms[i].mm == mms[i-1].mm))
+			continue;
+		tc = mms[i].tc;
+		rmap_index.mms++;
 
-		case STR_INVALID:
-			error(INFO, "%sinvalid task or pid value: %s\n",
-				subsequent++ ? "\n" : "", args[optind]);
-			break;
+		if (!(snap = get_vma_snapshot(tc->mm_struct))) {
+			rmap_index.failed++;
+			continue;
 		}
 
-		optind++;
+		for (j = 0; j < snap->count; j++) {
+			ent = &snap->entries[j];
+			rmap_index.vmas++;
+			vaddr = ent->start;
+			do {
+				cnt = vtop_range(tc, UVADDR, &vaddr, ent->end,
+					extents, RMAP_EXTENTS);
+				while (cnt--)
+					rmap_index_add(tc, &extents[cnt]);
+			} while (vaddr < ent->end);
+		}
 	}
+
+	please_wait_done();
+
+	FREEBUF(extents);
+	FREEBUF(mms);
+
+	qsort(rmap_index.extents, rmap_index.count,
+		sizeof(struct rmap_extent), rmap_extent_compare);
+	rmap_index.built = TRUE;
 }
 
 /*
- *  Translate a vm_flags value.
+ *  Display the tasks that map the physical address paddr, with the
+ *  header preceded by prefix, returning how many there are.
  */
+static int
+rmap_index_show(physaddr_t paddr, char *prefix)
+{
+	int cnt;
+	ulong lo, hi, mid;
+	struct rmap_extent *re;
+	struct task_context *tc;
+	char buf1[BUFSIZE];
+	char buf2[BUFSIZE];
 
-#define VM_READ		0x00000001ULL	/* currently active flags */
-#define VM_WRITE	0x00000002ULL
-#define VM_EXEC		0x00000004ULL
-#define VM_SHARED	0x00000008ULL
-#define VM_MAYREAD	0x00000010ULL	/* limits for mprotect() etc */
-#define VM_MAYWRITE	0x00000020ULL
-#define VM_MAYEXEC	0x00000040ULL
-#define VM_MAYSHARE	0x00000080ULL
-#define VM_GROWSDOWN	0x00000100ULL	/* general info on the segment */
-#define VM_GROWSUP	0x00000200ULL
-#define VM_NOHUGEPAGE   0x00000200ULL   /* MADV_NOHUGEPAGE marked this vma */
-#define VM_SHM		0x00000400ULL	/* shared memory area, don't swap out */
-#define VM_PFNMAP       0x00000400ULL
-#define VM_DENYWRITE	0x00000800ULL	/* ETXTBSY on write attempts.. */
-#define VM_EXECUTABLE	0x00001000ULL
-#define VM_LOCKED	0x00002000ULL
-#define VM_IO           0x00004000ULL	/* Memory mapped I/O or similar */
-#define VM_SEQ_READ	0x00008000ULL	/* App will access data sequentially */
-#define VM_RAND_READ	0x00010000ULL	/* App will not benefit from clustered reads */
-#define VM_DONTCOPY	0x00020000ULL   /* Do not copy this vma on fork */
-#define VM_DONTEXPAND   0x00040000ULL   /* Cannot expand with mremap() */
-#define VM_RESERVED     0x00080000ULL   /* Don't unmap it from swap_out */
+	/*
+	 *  Find the first extent that could reach paddr.
+	 */
+	for (lo = 0, hi = rmap_index.count; lo < hi; ) {
+		mid = (lo + hi) / 2;
+		re = &rmap_index.extents[mid];
+		if ((re->paddr + rmap_index.maxlen) <= paddr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
 
-#define VM_BIGPAGE      0x00100000ULL   /* bigpage mappings, no pte's */
-#define VM_BIGMAP       0x00200000ULL   /* user wants bigpage mapping */
+	for (cnt = 0; lo < rmap_index.count; lo++) {
+		re = &rmap_index.extents[lo];
+		if (re->paddr > paddr)
+			break;
+		if (paddr >= (re->paddr + re->length))
+			continue;
 
-#define VM_WRITECOMBINED 0x00100000ULL   /* Write-combined */
-#define VM_NONCACHED     0x00200000ULL   /* Noncached access */
-#define VM_HUGETLB       0x00400000ULL   /* Huge tlb Page*/
-#define VM_ACCOUNT       0x00100000ULL   /* Memory is a vm accounted object */
+		if (!cnt++)
+			fprintf(fp, "%s    PID  %s  %s  COMM\n", prefix,
+				mkstring(buf1, VADDR_PRLEN, CENTER|LJUST, "TASK"),
+				mkstring(buf2, VADDR_PRLEN, CENTER|LJUST, "VADDR"));
 
-#define VM_NONLINEAR     0x00800000ULL   /* Is non-linear (remap_file_pages) */
+		tc = task_to_context(re->task);
+		fprintf(fp, "%s%7ld  %s  %s  \"%s\"\n", prefix,
+			tc ? tc->pid : 0,
+			mkstring(buf1, VADDR_PRLEN, LONG_HEX|LJUST,
+			MKSTR(re->task)),
+			mkstring(buf2, VADDR_PRLEN, LONG_HEX|LJUST,
+			MKSTR(re->vaddr + (ulong)(paddr - re->paddr))),
+			tc ? tc->comm : "(exited)");
+	}
 
-#define VM_MAPPED_COPY  0x01000000ULL    /* T if mapped copy of data (nommu mmap) */
-#define VM_HUGEPAGE     0x01000000ULL    /* MADV_HUGEPAGE marked this vma */
+	return cnt;
+}
 
-#define VM_INSERTPAGE   0x02000000ULL    /* The vma has had "vm_insert_page()" done on it */
-#define VM_ALWAYSDUMP   0x04000000ULL    /* Always include in core dumps */
+/*
+ *  Called by "kmem <address>" to show the tasks that map a physical
+ *  address if the reverse-mapping index has been built.
+ */
+void
+rmap_index_annotate(physaddr_t paddr)
+{
+	if (!rmap_index.built)
+		return;
 
-#define VM_CAN_NONLINEAR 0x08000000ULL   /* Has ->fault & does nonlinear pages */
-#define VM_MIXEDMAP     0x10000000ULL    /* Can contain "struct page" and pure PFN pages */
-#define VM_SAO          0x20000000ULL    /* Strong Access Ordering (powerpc) */
-#define VM_PFN_AT_MMAP  0x40000000ULL    /* PFNMAP vma that is fully mapped at mmap time */
-#define VM_MERGEABLE    0x80000000ULL    /* KSM may merge identical pages */
+	fprintf(fp, "\n");
+	if (!rmap_index_show(paddr, ""))
+		fprintf(fp, "%llx: not mapped by any task\n", (ulonglong)paddr);
+}
 
-static void
-do_vm_flags(ulonglong flags)
+/*
+ *  Display the tasks that map physical addresses or pages.
+ */
+void
+cmd_rmap(void)
 {
-	int others;
+	int c, bflag, pflag, sflag, shown;
+	ulong page;
+	physaddr_t paddr;
 
-	others = 0;
+	bflag = pflag = sflag = shown = 0;
 
-	fprintf(fp, "%llx: (", flags);
+	while ((c = getopt(argcnt, args, "bps")) != EOF) {
+		switch(c)
+		{
+		case 'b':
+			bflag++;
+			break;
 
-	if (flags & VM_READ) {
-		fprintf(fp, "READ");
-		others++;
-	}
-	if (flags & VM_WRITE)
-		fprintf(fp, "%sWRITE", others++ ? "|" : "");
-	if (flags & VM_EXEC)
-		fprintf(fp, "%sEXEC", others++ ? "|" : "");
-	if (flags & VM_SHARED)
-		fprintf(fp, "%sSHARED", others++ ? "|" : "");
-	if (flags & VM_MAYREAD)
-		fprintf(fp, "%sMAYREAD", others++ ? "|" : "");
-	if (flags & VM_MAYWRITE)
-		fprintf(fp, "%sMAYWRITE", others++ ? "|" : "");
-	if (flags & VM_MAYEXEC)
-		fprintf(fp, "%sMAYEXEC", others++ ? "|" : "");
-	if (flags & VM_MAYSHARE)
-		fprintf(fp, "%sMAYSHARE", others++ ? "|" : "");
-	if (flags & VM_GROWSDOWN)
-		fprintf(fp, "%sGROWSDOWN", others++ ? "|" : "");
-	if (kernel_symbol_exists("expand_upwards")) {
-	    	if (flags & VM_GROWSUP)
-			fprintf(fp, "%sGROWSUP", others++ ? "|" : "");
-	} else if (flags & VM_NOHUGEPAGE)
-		fprintf(fp, "%sNOHUGEPAGE", others++ ? "|" : "");
-	if (flags & VM_SHM) {
-		if (THIS_KERNEL_VERSION > LINUX(2,6,17))
-			fprintf(fp, "%sPFNMAP", others++ ? "|" : "");
-		else
-			fprintf(fp, "%sSHM", others++ ? "|" : "");
-	}
-	if (flags & VM_DENYWRITE)
-		fprintf(fp, "%sDENYWRITE", others++ ? "|" : "");
-	if (flags & VM_EXECUTABLE)
-		fprintf(fp, "%sEXECUTABLE", others++ ? "|" : "");
-	if (flags & VM_LOCKED)
-		fprintf(fp, "%sLOCKED", others++ ? "|" : "");
-	if (flags & VM_IO)
-		fprintf(fp, "%sIO", others++ ? "|" : "");
-	if (flags & VM_SEQ_READ)
-		fprintf(fp, "%sSEQ_READ", others++ ? "|" : "");
-	if (flags & VM_RAND_READ)
-		fprintf(fp, "%sRAND_READ", others++ ? "|" : "");
-	if (flags & VM_DONTCOPY)
-		fprintf(fp, "%sDONTCOPY", others++ ? "|" : "");
-        if (flags & VM_DONTEXPAND)
-                fprintf(fp, "%sDONTEXPAND", others++ ? "|" : "");
-        if (flags & VM_RESERVED)
-                fprintf(fp, "%sRESERVED", others++ ? "|" : "");
-	if (symbol_exists("nr_bigpages") && (THIS_KERNEL_VERSION == LINUX(2,4,9))) {
-        	if (flags & VM_BIGPAGE)
-                	fprintf(fp, "%sBIGPAGE", others++ ? "|" : "");
-        	if (flags & VM_BIGMAP)
-                	fprintf(fp, "%sBIGMAP", others++ ? "|" : "");
-	} else {
-		if ((THIS_KERNEL_VERSION < LINUX(2,4,21)) &&
-        	    (flags & VM_WRITECOMBINED))
-                	fprintf(fp, "%sWRITECOMBINED", others++ ? "|" : "");
-		if ((THIS_KERNEL_VERSION < LINUX(2,4,21)) &&
-        	    (flags & VM_NONCACHED))
-                	fprintf(fp, "%sNONCACHED", others++ ? "|" : "");
-        	if (flags & VM_HUGETLB)
-                	fprintf(fp, "%sHUGETLB", others++ ? "|" : "");
-        	if (flags & VM_ACCOUNT)
-                	fprintf(fp, "%sACCOUNT", others++ ? "|" : "");
+		case 'p':
+			pflag++;
+			break;
+
+		case 's':
+			sflag++;
+			break;
+
+		default:
+			argerrs++;
+			break;
+		}
 	}
-        if (flags & VM_NONLINEAR)
-                fprintf(fp, "%sNONLINEAR", others++ ? "|" : "");
 
-	if (flags & VM_HUGEPAGE) {
-		if (MEMBER_EXISTS("mm_struct", "pmd_huge_pte"))
-                	fprintf(fp, "%sHUGEPAGE", others++ ? "|" : "");
-		else
-                	fprintf(fp, "%sMAPPED_COPY", others++ ? "|" : "");
+	if (argerrs || (!args[optind] && !bflag && !sflag))
+		cmd_usage(pc->curcmd, SYNOPSIS);
+
+	if (bflag || !rmap_index.built)
+		rmap_index_build();
+
+	if (sflag) {
+		fprintf(fp, "   MM_STRUCTS: %ld\n", rmap_index.mms);
+		if (rmap_index.failed)
+			fprintf(fp, "   UNREADABLE: %ld\n", rmap_index.failed);
+		fprintf(fp, "         VMAS: %ld\n", rmap_index.vmas);
+		fprintf(fp, "      EXTENTS: %ld\n", rmap_index.count);
+		fprintf(fp, "   MAX EXTENT: %ld\n", rmap_index.maxlen);
+		fprintf(fp, "   INDEX SIZE: %ld\n",
+			rmap_index.avail * sizeof(struct rmap_extent));
+	}
+
+	for ( ; args[optind]; optind++) {
+		if (pflag) {
+			page = htol(args[optind], FAULT_ON_ERROR, NULL);
+			if (!page_to_phys(page, &paddr)) {
+				error(INFO, "%lx: not a page structure address\n",
+					page);
+				continue;
+			}
+		} else
+			paddr = htoll(args[optind], FAULT_ON_ERROR, NULL);
+
+		if (sflag || shown++)
+			fprintf(fp, "\n");
+		fprintf(fp, "PHYSADDR: %llx\n", (ulonglong)paddr);
+		if (!rmap_index_show(paddr, "  "))
+			fprintf(fp, "  (not mapped by any task)\n");
 	}
+}
 
-        if (flags & VM_INSERTPAGE)
-                fprintf(fp, "%sINSERTPAGE", others++ ? "|" : "");
-        if (flags & VM_ALWAYSDUMP)
-                fprintf(fp, "%sALWAYSDUMP", others++ ? "|" : "");
-        if (flags & VM_CAN_NONLINEAR)
-                fprintf(fp, "%sCAN_NONLINEAR", others++ ? "|" : "");
-        if (flags & VM_MIXEDMAP)
-                fprintf(fp, "%sMIXEDMAP", others++ ? "|" : "");
-        if (flags & VM_SAO)
-                fprintf(fp, "%sSAO", others++ ? "|" : "");
-        if (flags & VM_PFN_AT_MMAP)
-                fprintf(fp, "%sPFN_AT_MMAP", others++ ? "|" : "");
-        if (flags & VM_MERGEABLE)
-                fprintf(fp, "%sMERGEABLE", others++ ? "|" : "");
+/*
+ *  "ucore" writes an ELF core file of the user address space of a task.
+ *  Each VMA is translated with vtop_range(), and each physically
+ *  contiguous extent is read with large PHYSADDR readmem() calls into
+ *  an output buffer that is written out whenever it fills or the file
+ *  offset jumps.  Pages that are not mapped are left as holes in the
+ *  sparse file.  Within anonymous VMAs, the unmapped pages are checked
+ *  for swap entries, which are read by way of readswap(), and so from
+ *  zram and its page cache.
+ */
+#define UCORE_OUTPUT_BUFSIZE	(4 * 1024 * 1024)
+#define UCORE_READ_SIZE		(1024 * 1024)
+#define UCORE_EXTENTS		(1024)
 
-	fprintf(fp, ")\n");
+#ifndef EM_RISCV
+#define EM_RISCV		243
+#endif
+#ifndef EM_LOONGARCH
+#define EM_LOONGARCH		258
+#endif
+
+/*
+ *  The 64-bit kernel's struct elf_prpsinfo.
+ */
+struct ucore_prpsinfo {
+	char pr_state;
+	char pr_sname;
+	char pr_zomb;
+	char pr_nice;
+	ulong pr_flag;
+	uint pr_uid;
+	uint pr_gid;
+	int pr_pid;
+	int pr_ppid;
+	int pr_pgrp;
+	int pr_sid;
+	char pr_fname[16];
+	char pr_psargs[80];
+};
+
+struct ucore_output {
+	int fd;
+	char *file;
+	char *buf;
+	ulong len;
+	off_t offset;
+	ulong pages;
+	ulong swapped;
+	ulong unreadable;
+};
+
+static void
+ucore_cleanup(void *arg)
+{
+	struct ucore_output *uo = arg;
+
+	pc->cmd_cleanup = NULL;
+	pc->cmd_cleanup_arg = NULL;
+
+	if (uo->fd >= 0) {
+		close(uo->fd);
+		uo->fd = -1;
+	}
+	free(uo->buf);
+	uo->buf = NULL;
+}
+
+static void
+ucore_flush(struct ucore_output *uo)
+{
+	if (!uo->len)
+		return;
+
+	if (pwrite(uo->fd, uo->buf, uo->len, uo->offset) != (ssize_t)uo->len)
+		error(FATAL, "%s: write failed: %s\n", uo->file,
+			strerror(errno));
+
+	uo->offset += uo->len;
+	uo->len = 0;
+}
+
+static void
+ucore_write(struct ucore_output *uo, off_t offset, char *data, ulong len)
+{
+	ulong cnt;
 
+	if (uo->len && (offset != (uo->offset + uo->len)))
+		ucore_flush(uo);
+	if (!uo->len)
+		uo->offset = offset;
+
+	while (len) {
+		cnt = MIN(len, UCORE_OUTPUT_BUFSIZE - uo->len);
+		BCOPY(data, uo->buf + uo->len, cnt);
+		uo->len += cnt;
+		data += cnt;
+		len -= cnt;
+		if (uo->len == UCORE_OUTPUT_BUFSIZE)
+			ucore_flush(uo);
+	}
 }
 
 /*
- * Read whatever size vm_area_struct.vm_flags happens to be into a ulonglong.
+ *  Copy a physically contiguous extent into the file at offset, in
+ *  UCORE_READ_SIZE pieces, falling back to page-sized reads for any
+ *  piece that cannot be read at once.
  */
-static ulonglong
-get_vm_flags(char *vma_buf)
+static void
+ucore_write_extent(struct ucore_output *uo, off_t offset, struct vtop_extent *ext,
+		   char *buf)
 {
-	ulonglong vm_flags = 0;
+	ulong done, cnt, pg;
+
+	for (done = 0; done < ext->length; done += cnt) {
+		cnt = MIN(ext->length - done, UCORE_READ_SIZE);
+		if (readmem(ext->paddr + done, PHYSADDR, buf, cnt,
+		    "user memory", RETURN_ON_ERROR|QUIET)) {
+			ucore_write(uo, offset + done, buf, cnt);
+			uo->pages += cnt / PAGESIZE();
+			continue;
+		}
+		for (pg = 0; pg < cnt; pg += PAGESIZE()) {
+			if (readmem(ext->paddr + done + pg, PHYSADDR, buf,
+			    PAGESIZE(), "user page", RETURN_ON_ERROR|QUIET)) {
+				ucore_write(uo, offset + done + pg, buf, PAGESIZE());
+				uo->pages++;
+			} else
+				uo->unreadable++;
+		}
+	}
+}
 
-	if (SIZE(vm_area_struct_vm_flags) == sizeof(short))
-		vm_flags = USHORT(vma_buf + OFFSET(vm_area_struct_vm_flags));
-	else if (SIZE(vm_area_struct_vm_flags) == sizeof(long))
-		vm_flags = ULONG(vma_buf+ OFFSET(vm_area_struct_vm_flags));
-	else if (SIZE(vm_area_struct_vm_flags) == sizeof(long long))
-		vm_flags = ULONGLONG(vma_buf+ OFFSET(vm_area_struct_vm_flags));
-	else
-		error(INFO, "questionable vm_area_struct.vm_flags size: %d\n",
-			SIZE(vm_area_struct_vm_flags));
+/*
+ *  Copy the swapped-out pages of the unmapped range start to end.
+ */
+static void
+ucore_write_swapped(struct ucore_output *uo, struct task_context *tc,
+		    off_t offset, ulong start, ulong end, char *buf)
+{
+	ulong vaddr;
+	physaddr_t paddr;
 
-	return vm_flags;
+	for (vaddr = start; vaddr < end; vaddr += PAGESIZE()) {
+		paddr = 0;
+		if (uvtop(tc, vaddr, &paddr, 0) || !paddr)
+			continue;
+		if (readswap(paddr, buf, PAGESIZE(), vaddr) == PAGESIZE()) {
+			ucore_write(uo, offset + (vaddr - start), buf, PAGESIZE());
+			uo->swapped++;
+		}
+	}
 }
 
 static void
-vm_cleanup(void *arg)
+ucore_prpsinfo(struct task_context *tc, struct ucore_prpsinfo *psinfo)
 {
-	struct task_context *tc;
+	ulong arg_start, arg_end;
+	struct task_context *parent;
+	int i;
 
-	pc->cmd_cleanup = NULL;
-	pc->cmd_cleanup_arg = NULL;
+	BZERO(psinfo, sizeof(struct ucore_prpsinfo));
+	psinfo->pr_pid = tc->pid;
+	if ((parent = task_to_context(tc->ptask)))
+		psinfo->pr_ppid = parent->pid;
+	psinfo->pr_pgrp = task_tgid(tc->task);
+	BCOPY(tc->comm, psinfo->pr_fname, sizeof(psinfo->pr_fname)-1);
 
-	tc = (struct task_context *)arg;
-	tc->mm_struct = 0;
+	if (INVALID_MEMBER(mm_struct_arg_start)) {
+		MEMBER_OFFSET_INIT(mm_struct_arg_start, "mm_struct", "arg_start");
+		MEMBER_OFFSET_INIT(mm_struct_arg_end, "mm_struct", "arg_end");
+	}
+	if (INVALID_MEMBER(mm_struct_arg_start) || !task_mm(tc->task, TRUE))
+		return;
+
+	arg_start = ULONG(tt->mm_struct + OFFSET(mm_struct_arg_start));
+	arg_end = ULONG(tt->mm_struct + OFFSET(mm_struct_arg_end));
+	if (arg_end - arg_start > sizeof(psinfo->pr_psargs) - 1)
+		arg_end = arg_start + sizeof(psinfo->pr_psargs) - 1;
+	if ((arg_end > arg_start) &&
+	    readmem(arg_start, UVADDR, psinfo->pr_psargs, arg_end - arg_start,
+	    "arguments", RETURN_ON_ERROR|QUIET)) {
+		for (i = 0; i < (arg_end - arg_start); i++) {
+			if (psinfo->pr_psargs[i] == NULLCHAR)
+				psinfo->pr_psargs[i] = ' ';
+		}
+	}
 }
 
 static int
-is_valid_mm(ulong mm)
+ucore_machine(void)
 {
-	char kbuf[BUFSIZE];
-	char *p;
-	int mm_count;
+	if (machine_type("X86_64"))
+		return EM_X86_64;
+	if (machine_type("ARM64"))
+		return EM_AARCH64;
+	if (machine_type("PPC64"))
+		return EM_PPC64;
+	if (machine_type("S390X"))
+		return EM_S390;
+	if (machine_type("RISCV64"))
+		return EM_RISCV;
+	if (machine_type("LOONGARCH64"))
+		return EM_LOONGARCH;
+	if (machine_type("MIPS64"))
+		return EM_MIPS;
+	if (machine_type("SPARC64"))
+		return EM_SPARCV9;
+	return EM_NONE;
+}
 
-	if (!(p = vaddr_to_kmem_cache(mm, kbuf, VERBOSE)))
-		goto bailout;
+/*
+ *  Write an ELF core file of the user address space of a task.
+ */
+void
+cmd_ucore(void)
+{
+	int c, i, j, cnt, nvmas, xnum;
+	ulong value, vaddr, next, gap;
+	off_t offset, size;
+	char *file, *readbuf;
+	char filebuf[BUFSIZE];
+	struct task_context *tc;
+	struct vma_snapshot *snap;
+	struct vma_snapshot_entry *vmas, *ent;
+	struct vtop_extent *extents;
+	struct ucore_output output, *uo;
+	struct ucore_prpsinfo psinfo;
+	Elf64_Ehdr ehdr;
+	Elf64_Phdr *phdrs, *phdr;
+	Elf64_Shdr shdr;
+	Elf64_Nhdr nhdr;
+	char name[8];
+
+	file = NULL;
+	tc = CURRENT_CONTEXT();
+
+	while ((c = getopt(argcnt, args, "o:")) != EOF) {
+		switch(c)
+		{
+		case 'o':
+			file = optarg;
+			break;
 
-	if (!STRNEQ(p, "mm_struct"))
-		goto bailout;
+		default:
+			argerrs++;
+			break;
+		}
+	}
 
-	readmem(mm + OFFSET(mm_struct_mm_count), KVADDR, &mm_count, sizeof(int),
-		"mm_struct mm_count", FAULT_ON_ERROR);
+	if (argerrs)
+		cmd_usage(pc->curcmd, SYNOPSIS);
 
-	if (mm_count == 0)
-		error(FATAL, "stale mm_struct address\n");
+	if (args[optind]) {
+		switch (str_to_context(args[optind], &value, &tc))
+		{
+		case STR_PID:
+		case STR_TASK:
+			break;
+		case STR_INVALID:
+			error(FATAL, "invalid task or pid value: %s\n",
+				args[optind]);
+		}
+		if (args[++optind])
+			cmd_usage(pc->curcmd, SYNOPSIS);
+	}
 
-	return mm_count;
+	if (!BITS64() || (ucore_machine() == EM_NONE))
+		error(FATAL, "not supported on this architecture\n");
 
-bailout:
-	error(FATAL, "invalid mm_struct address\n");
-	return 0;
+	if (!tc->mm_struct)
+		error(FATAL, "PID %ld: task has no user address space\n",
+			tc->pid);
+
+	if (!(snap = get_vma_snapshot(tc->mm_struct)))
+		error(FATAL, "PID %ld: cannot read VMA list\n", tc->pid);
+
+	nvmas = snap->count;
+	vmas = (struct vma_snapshot_entry *)GETBUF(sizeof(*vmas) * (nvmas+1));
+	BCOPY(snap->entries, vmas, sizeof(*vmas) * nvmas);
+
+	if (!file) {
+		sprintf(filebuf, "core.%ld", tc->pid);
+		file = filebuf;
+	}
+
+	uo = &output;
+	BZERO(uo, sizeof(struct ucore_output));
+	uo->file = file;
+	if ((uo->fd = open(file, O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0)
+		error(FATAL, "%s: %s\n", file, strerror(errno));
+	pc->cmd_cleanup_arg = (void *)uo;
+	pc->cmd_cleanup = ucore_cleanup;
+	if (!(uo->buf = malloc(UCORE_OUTPUT_BUFSIZE)))
+		error(FATAL, "cannot malloc ucore output buffer\n");
+
+	/*
+	 *  Lay out the ELF header, the program headers, the section header
+	 *  holding the real program header count if there are too many
+	 *  for e_phnum, the NT_PRPSINFO note, and then the segments.
+	 */
+	xnum = ((nvmas + 1) >= PN_XNUM);
+	offset = sizeof(Elf64_Ehdr) + ((nvmas + 1) * sizeof(Elf64_Phdr));
+
+	BZERO(&ehdr, sizeof(Elf64_Ehdr));
+	BCOPY(ELFMAG, ehdr.e_ident, SELFMAG);
+	ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+	ehdr.e_ident[EI_DATA] = (__BYTE_ORDER == __LITTLE_ENDIAN) ?
+		ELFDATA2LSB : ELFDATA2MSB;
+	ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+	ehdr.e_ident[EI_OSABI] = ELFOSABI_NONE;
+	ehdr.e_type = ET_CORE;
+	ehdr.e_machine = ucore_machine();
+	ehdr.e_version = EV_CURRENT;
+	ehdr.e_phoff = sizeof(Elf64_Ehdr);
+	ehdr.e_ehsize = sizeof(Elf64_Ehdr);
+	ehdr.e_phentsize = sizeof(Elf64_Phdr);
+	ehdr.e_phnum = xnum ? PN_XNUM : nvmas + 1;
+	if (xnum) {
+		ehdr.e_shoff = offset;
+		ehdr.e_shentsize = sizeof(Elf64_Shdr);
+		ehdr.e_shnum = 1;
+		offset += sizeof(Elf64_Shdr);
+	}
+
+	phdrs = (Elf64_Phdr *)GETBUF(sizeof(Elf64_Phdr) * (nvmas + 1));
+
+	phdr = &phdrs[0];
+	phdr->p_type = PT_NOTE;
+	phdr->p_offset = offset;
+	phdr->p_filesz = sizeof(Elf64_Nhdr) + sizeof(name) +
+		roundup(sizeof(struct ucore_prpsinfo), 4);
+	phdr->p_align = 4;
+	offset = roundup(offset + phdr->p_filesz, PAGESIZE());
+
+	for (i = 0; i < nvmas; i++) {
+		ent = &vmas[i];
+		phdr = &phdrs[i+1];
+		phdr->p_type = PT_LOAD;
+		phdr->p_vaddr = ent->start;
+		phdr->p_memsz = ent->end - ent->start;
+		phdr->p_align = PAGESIZE();
+		if (ent->flags & VM_READ)
+			phdr->p_flags |= PF_R;
+		if (ent->flags & VM_WRITE)
+			phdr->p_flags |= PF_W;
+		if (ent->flags & VM_EXEC)
+			phdr->p_flags |= PF_X;
+		/*
+		 *  Device mappings are not dumped.
+		 */
+		if (ent->flags & (VM_IO|VM_PFNMAP))
+			continue;
+		phdr->p_offset = offset;
+		phdr->p_filesz = phdr->p_memsz;
+		offset += phdr->p_filesz;
+	}
+	size = offset;
+
+	ucore_write(uo, 0, (char *)&ehdr, sizeof(Elf64_Ehdr));
+	ucore_write(uo, sizeof(Elf64_Ehdr), (char *)phdrs,
+		sizeof(Elf64_Phdr) * (nvmas + 1));
+	if (xnum) {
+		BZERO(&shdr, sizeof(Elf64_Shdr));
+		shdr.sh_info = nvmas + 1;
+		ucore_write(uo, ehdr.e_shoff, (char *)&shdr, sizeof(Elf64_Shdr));
+	}
+
+	ucore_prpsinfo(tc, &psinfo);
+	BZERO(name, sizeof(name));
+	strcpy(name, "CORE");
+	nhdr.n_namesz = strlen(name) + 1;
+	nhdr.n_descsz = sizeof(struct ucore_prpsinfo);
+	nhdr.n_type = NT_PRPSINFO;
+	offset = phdrs[0].p_offset;
+	ucore_write(uo, offset, (char *)&nhdr, sizeof(Elf64_Nhdr));
+	ucore_write(uo, offset + sizeof(Elf64_Nhdr), name, sizeof(name));
+	ucore_write(uo, offset + sizeof(Elf64_Nhdr) + sizeof(name),
+		(char *)&psinfo, sizeof(struct ucore_prpsinfo));
+
+	/*
+	 *  The segments.
+	 */
+	extents = (struct vtop_extent *)GETBUF(sizeof(struct vtop_extent) *
+		UCORE_EXTENTS);
+	readbuf = GETBUF(UCORE_READ_SIZE);
+
+	for (i = 0; i < nvmas; i++) {
+		ent = &vmas[i];
+		phdr = &phdrs[i+1];
+		if (!phdr->p_filesz)
+			continue;
+
+		for (vaddr = ent->start; vaddr < ent->end; vaddr = next) {
+			next = vaddr;
+			cnt = vtop_range(tc, UVADDR, &next, ent->end, extents,
+				UCORE_EXTENTS);
+			for (j = 0, gap = vaddr; j <= cnt; j++) {
+				if (!ent->file && (gap < (j < cnt ? extents[j].vaddr : next)))
+					ucore_write_swapped(uo, tc, phdr->p_offset +
+						(gap - ent->start), gap,
+						j < cnt ? extents[j].vaddr : next,
+						readbuf);
+				if (j == cnt)
+					break;
+				ucore_write_extent(uo, phdr->p_offset +
+					(extents[j].vaddr - ent->start),
+					&extents[j], readbuf);
+				gap = extents[j].vaddr + extents[j].length;
+			}
+			if (next <= vaddr)
+				break;
+		}
+	}
+
+	ucore_flush(uo);
+
+	if (ftruncate(uo->fd, size) < 0)
+		error(FATAL, "%s: %s\n", file, strerror(errno));
+
+	fprintf(fp, "%s: PID %ld: %d VMAs, %ld pages", file, tc->pid, nvmas,
+		uo->pages);
+	if (uo->swapped)
+		fprintf(fp, ", %ld swapped pages", uo->swapped);
+	if (uo->unreadable)
+		fprintf(fp, ", %ld unreadable pages", uo->unreadable);
+	fprintf(fp, "\n");
+
+	ucore_cleanup(uo);
 }
 
 /*
@@ -3932,8 +6867,11 @@ vm_area_dump(ulong task, ulong flag, ulong vaddr, struct reference *ref)
 	ulong single_vma;
 	unsigned int radix;
 	int single_vma_found;
-	int found;
+	int found, vma_count, vma_index;
+	ulong *vma_list, *vma_list_buf, one_vma;
 	struct task_mem_usage task_mem_usage, *tm;
+	struct vma_snapshot *snap;
+	struct vma_snapshot_entry *ent;
 	char buf1[BUFSIZE];
 	char buf2[BUFSIZE];
 	char buf3[BUFSIZE];
@@ -4004,8 +6942,40 @@ vm_area_dump(ulong task, ulong flag, ulong vaddr, struct reference *ref)
                 return (ulong)NULL;
 	}
 
-	readmem(tm->mm_struct_addr + OFFSET(mm_struct_mmap), KVADDR, 
-		&vma, sizeof(void *), "mm_struct mmap", FAULT_ON_ERROR);
+	/*
+	 *  With a maple tree, the VMAs to be walked are gathered into
+	 *  vma_list, otherwise each one's vm_next is followed.
+	 */
+	vma = 0;
+	vma_list = vma_list_buf = NULL;
+	vma_count = vma_index = 0;
+	if (!VMA_MAPLE_TREE())
+		readmem(tm->mm_struct_addr + OFFSET(mm_struct_mmap), KVADDR,
+			&vma, sizeof(void *), "mm_struct mmap", FAULT_ON_ERROR);
+
+	/*
+	 *  A user address lookup only needs the VMA containing it.
+	 */
+	if ((flag & UVADDR) && !ref &&
+	    !(flag & (PHYSADDR|PRINT_VMA_STRUCTS|PRINT_SINGLE_VMA)) &&
+	    (snap = get_vma_snapshot(tm->mm_struct_addr))) {
+		ent = vma_snapshot_lookup(snap, vaddr);
+		if (flag & VERIFY_ADDR)
+			return ent ? ent->vma : (ulong)NULL;
+		vma = one_vma = ent ? ent->vma : 0;
+		vma_list = &one_vma;
+		vma_count = vma ? 1 : 0;
+	} else if (VMA_MAPLE_TREE()) {
+		if ((flag & UVADDR) && !ref &&
+		    !(flag & (PHYSADDR|PRINT_VMA_STRUCTS|PRINT_SINGLE_VMA)))
+			vma_count = get_mm_vma_list(tm->mm_struct_addr,
+				vaddr, vaddr, &vma_list_buf);
+		else
+			vma_count = get_mm_vma_list(tm->mm_struct_addr,
+				0, ~0UL, &vma_list_buf);
+		vma_list = vma_list_buf;
+		vma = vma_count ? vma_list[0] : 0;
+	}
 
        	sprintf(vma_header, "%s%s%s%s%s  FLAGS%sFILE\n",
                 mkstring(buf1, VADDR_PRLEN, CENTER|LJUST, "VMA"),
@@ -4030,7 +7000,11 @@ vm_area_dump(ulong task, ulong flag, ulong vaddr, struct reference *ref)
 
 		vm_mm = ULONG(vma_buf + OFFSET(vm_area_struct_vm_mm));
 		vm_end = ULONG(vma_buf + OFFSET(vm_area_struct_vm_end));
-		vm_next = ULONG(vma_buf + OFFSET(vm_area_struct_vm_next));
+		if (vma_list)
+			vm_next = (++vma_index < vma_count) ?
+				vma_list[vma_index] : 0;
+		else
+			vm_next = ULONG(vma_buf + OFFSET(vm_area_struct_vm_next));
 		vm_start = ULONG(vma_buf + OFFSET(vm_area_struct_vm_start));
 		vm_flags = get_vm_flags(vma_buf);
 		vm_file = ULONG(vma_buf + OFFSET(vm_area_struct_vm_file));
@@ -4073,8 +7047,11 @@ vm_area_dump(ulong task, ulong flag, ulong vaddr, struct reference *ref)
 		    ((vaddr >= vm_start) && (vaddr < vm_end)))) {
 			found = TRUE;
 
-			if (flag & VERIFY_ADDR)
+			if (flag & VERIFY_ADDR) {
+				if (vma_list_buf)
+					FREEBUF(vma_list_buf);
 				return vma;
+			}
 
 			if (DO_REF_SEARCH(ref)) {
 				if (VM_REF_CHECK_HEXVAL(ref, vma) ||
@@ -4135,11 +7112,17 @@ vm_area_dump(ulong task, ulong flag, ulong vaddr, struct reference *ref)
 						vm_start, vm_end, vm_mm, ref);
 			}
 
-			if (flag & UVADDR)
+			if (flag & UVADDR) {
+				if (vma_list_buf)
+					FREEBUF(vma_list_buf);
 				return vma;
+			}
 		} 
 	}
 
+	if (vma_list_buf)
+		FREEBUF(vma_list_buf);
+
 	if (flag & VERIFY_ADDR)
 		return (ulong)NULL;
 
@@ -4668,15 +7651,261 @@ show_page_member_data(char *pcache, ulong pp, struct meminfo *mi, char *outputbu
 					radix == 10 ? "%d" : "%x  ", boolbuf);
 			break;
 
-		default:
-unsupported:
-			error(FATAL, "unsupported page member reference: %s.%s\n",
-				pmd->structure, pmd->member);
-			break;
+		default:
+unsupported:
+			error(FATAL, "unsupported page member reference: %s.%s\n",
+				pmd->structure, pmd->member);
+			break;
+		}
+	}
+
+	return bufferindex += sprintf(outputbuffer+bufferindex, "\n");
+}
+
+/*
+ *  The threads of a process share its mm_struct, so "ps" on a system with
+ *  many threads would otherwise read the same mm_struct, and sum the same
+ *  per-thread rss_stat counters of its thread group, once per thread.  The
+ *  RSS, total_vm and pgd calculated by get_task_mem_usage() are therefore
+ *  cached by mm_struct and tgid.  On a live system the cache is discarded
+ *  before each command.
+ */
+#define MM_USAGE_CACHE_HASH   (4096)
+#define MM_USAGE_CACHE_MAX    (1 << 20)
+#define MM_USAGE_CACHE_INDEX(mm, tgid) \
+	((((mm) >> 6) ^ (tgid)) % MM_USAGE_CACHE_HASH)
+
+struct mm_usage_cache_entry {
+	struct mm_usage_cache_entry *next;
+	ulong mm;
+	ulong tgid;
+	ulong rss;
+	ulong total_vm;
+	ulong pgd_addr;
+};
+
+static struct mm_usage_cache {
+	ulong cmdgen;
+	struct mm_usage_cache_entry *hash[MM_USAGE_CACHE_HASH];
+	long entries;
+	ulong hits;
+	ulong misses;
+} mm_usage_cache = { 0 };
+
+static void
+mm_usage_cache_flush(void)
+{
+	int i;
+	struct mm_usage_cache_entry *muc, *next;
+
+	for (i = 0; i < MM_USAGE_CACHE_HASH; i++) {
+		for (muc = mm_usage_cache.hash[i]; muc; muc = next) {
+			next = muc->next;
+			free(muc);
+		}
+		mm_usage_cache.hash[i] = NULL;
+	}
+
+	mm_usage_cache.entries = 0;
+}
+
+static struct mm_usage_cache_entry *
+mm_usage_cache_lookup(ulong mm, ulong tgid)
+{
+	struct mm_usage_cache_entry *muc;
+
+	if (ACTIVE() && (mm_usage_cache.cmdgen != pc->cmdgencur)) {
+		if (mm_usage_cache.entries)
+			mm_usage_cache_flush();
+		mm_usage_cache.cmdgen = pc->cmdgencur;
+	}
+
+	for (muc = mm_usage_cache.hash[MM_USAGE_CACHE_INDEX(mm, tgid)];
+	     muc; muc = muc->next) {
+		if ((muc->mm == mm) && (muc->tgid == tgid))
+			return muc;
+	}
+
+	return NULL;
+}
+
+static struct mm_usage_cache_entry *
+mm_usage_cache_search(ulong mm, ulong tgid)
+{
+	struct mm_usage_cache_entry *muc;
+
+	if ((muc = mm_usage_cache_lookup(mm, tgid)))
+		mm_usage_cache.hits++;
+	else
+		mm_usage_cache.misses++;
+
+	return muc;
+}
+
+/*
+ *  The per-thread rss_stat counters are summed over the thread group,
+ *  so a CLONE_VM task in another thread group may have a different RSS
+ *  for the same mm_struct.
+ */
+static ulong
+mm_usage_tgid(ulong task)
+{
+	return VALID_MEMBER(task_struct_rss_stat) ? task_tgid(task) : 0;
+}
+
+static void
+mm_usage_cache_enter(ulong mm, ulong tgid, struct task_mem_usage *tm)
+{
+	struct mm_usage_cache_entry *muc;
+	int index;
+
+	if (mm_usage_cache.entries >= MM_USAGE_CACHE_MAX)
+		return;
+
+	if (!(muc = malloc(sizeof(struct mm_usage_cache_entry))))
+		return;
+
+	muc->mm = mm;
+	muc->tgid = tgid;
+	muc->rss = tm->rss;
+	muc->total_vm = tm->total_vm;
+	muc->pgd_addr = tm->pgd_addr;
+
+	index = MM_USAGE_CACHE_INDEX(mm, tgid);
+	muc->next = mm_usage_cache.hash[index];
+	mm_usage_cache.hash[index] = muc;
+	mm_usage_cache.entries++;
+}
+
+/*
+ *  For "ps -j", the usage of each mm_struct that is not cached yet is
+ *  calculated by run_forked() workers, MM_USAGE_JOB_TASKS tasks per job,
+ *  and passed back in a shared array to be entered into the cache, from
+ *  where get_task_mem_usage() then picks it up.
+ */
+#define MM_USAGE_JOB_TASKS (256)
+
+struct mm_usage_job_entry {
+	ulong task;
+	ulong mm;
+	ulong tgid;
+	ulong rss;
+	ulong total_vm;
+	ulong pgd_addr;
+	int valid;
+};
+
+struct mm_usage_jobs {
+	int count;
+	struct mm_usage_job_entry *entries;
+};
+
+static void
+mm_usage_job(void *arg, int job)
+{
+	int i, last;
+	struct mm_usage_jobs *jobs = arg;
+	struct mm_usage_job_entry *ent;
+	struct mm_usage_cache_entry *muc;
+	struct task_mem_usage task_mem_usage;
+
+	last = MIN((job+1) * MM_USAGE_JOB_TASKS, jobs->count);
+
+	for (i = job * MM_USAGE_JOB_TASKS; i < last; i++) {
+		ent = &jobs->entries[i];
+		get_task_mem_usage(ent->task, &task_mem_usage);
+		if ((muc = mm_usage_cache_lookup(ent->mm, ent->tgid))) {
+			ent->rss = muc->rss;
+			ent->total_vm = muc->total_vm;
+			ent->pgd_addr = muc->pgd_addr;
+			ent->valid = TRUE;
 		}
 	}
+}
 
-	return bufferindex += sprintf(outputbuffer+bufferindex, "\n");
+static int
+sort_by_mm_usage_key(const void *arg1, const void *arg2)
+{
+	struct mm_usage_job_entry *e1, *e2;
+
+	e1 = (struct mm_usage_job_entry *)arg1;
+	e2 = (struct mm_usage_job_entry *)arg2;
+
+	if (e1->mm != e2->mm)
+		return e1->mm < e2->mm ? -1 : 1;
+	if (e1->tgid != e2->tgid)
+		return e1->tgid < e2->tgid ? -1 : 1;
+	return 0;
+}
+
+/*
+ *  Enter the memory usage of all user tasks into the cache using up to
+ *  nworkers processes.  Returns the run_forked() result, FORKED_SERIAL
+ *  meaning that the usage will be calculated on demand.
+ */
+int
+cache_task_mem_usage(int nworkers)
+{
+	int i, cnt, ret;
+	size_t size;
+	struct task_context *tc;
+	struct mm_usage_jobs jobs;
+	struct mm_usage_job_entry *ent, *entries;
+	struct task_mem_usage task_mem_usage;
+
+	size = sizeof(struct mm_usage_job_entry) * MAX(RUNNING_TASKS(), 1);
+	entries = mmap(NULL, size, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (entries == MAP_FAILED) {
+		error(INFO, "cannot mmap memory usage array: %s\n",
+			strerror(errno));
+		return FORKED_SERIAL;
+	}
+
+	tc = FIRST_CONTEXT();
+	for (i = cnt = 0; i < RUNNING_TASKS(); i++, tc++) {
+		if (!tc->mm_struct || IS_ZOMBIE(tc->task) ||
+		    IS_EXITING(tc->task))
+			continue;
+		ent = &entries[cnt];
+		BZERO(ent, sizeof(struct mm_usage_job_entry));
+		ent->task = tc->task;
+		ent->mm = tc->mm_struct;
+		ent->tgid = mm_usage_tgid(tc->task);
+		if (!mm_usage_cache_lookup(ent->mm, ent->tgid))
+			cnt++;
+	}
+
+	/*
+	 *  Only one task of each mm_struct/tgid pair is needed.
+	 */
+	qsort(entries, cnt, sizeof(struct mm_usage_job_entry),
+		sort_by_mm_usage_key);
+	for (i = jobs.count = 0; i < cnt; i++) {
+		if (jobs.count && !sort_by_mm_usage_key(&entries[i],
+		    &entries[jobs.count-1]))
+			continue;
+		entries[jobs.count++] = entries[i];
+	}
+	jobs.entries = entries;
+
+	ret = run_forked(nworkers,
+		(jobs.count + MM_USAGE_JOB_TASKS - 1) / MM_USAGE_JOB_TASKS,
+		mm_usage_job, &jobs);
+
+	for (i = 0; (ret == FORKED_DONE) && (i < jobs.count); i++) {
+		ent = &entries[i];
+		if (!ent->valid || mm_usage_cache_lookup(ent->mm, ent->tgid))
+			continue;
+		task_mem_usage.rss = ent->rss;
+		task_mem_usage.total_vm = ent->total_vm;
+		task_mem_usage.pgd_addr = ent->pgd_addr;
+		mm_usage_cache_enter(ent->mm, ent->tgid, &task_mem_usage);
+	}
+
+	munmap(entries, size);
+
+	return ret;
 }
 
 /*
@@ -4687,7 +7916,9 @@ void
 get_task_mem_usage(ulong task, struct task_mem_usage *tm)
 {
 	struct task_context *tc;
+	struct mm_usage_cache_entry *muc;
 	long rss = 0, rss_cache = 0;
+	ulong tgid;
 
 	BZERO(tm, sizeof(struct task_mem_usage));
 
@@ -4701,6 +7932,15 @@ get_task_mem_usage(ulong task, struct task_mem_usage *tm)
 
 	tm->mm_struct_addr = tc->mm_struct;
 
+	tgid = mm_usage_tgid(task);
+
+	if ((muc = mm_usage_cache_search(tc->mm_struct, tgid))) {
+		tm->rss = muc->rss;
+		tm->total_vm = muc->total_vm;
+		tm->pgd_addr = muc->pgd_addr;
+		goto pct_physmem;
+	}
+
 	if (!task_mm(task, TRUE))
 		return;
 
@@ -4809,6 +8049,9 @@ get_task_mem_usage(ulong task, struct task_mem_usage *tm)
         tm->total_vm = ULONG(tt->mm_struct + OFFSET(mm_struct_total_vm));
         tm->pgd_addr = ULONG(tt->mm_struct + OFFSET(mm_struct_pgd));
 
+	mm_usage_cache_enter(tc->mm_struct, tgid, tm);
+
+pct_physmem:
 	if (is_kernel_thread(task) && !tm->rss)
 		return;
 
@@ -4875,6 +8118,8 @@ get_task_mem_usage(ulong task, struct task_mem_usage *tm)
 #define SLAB_BITFIELD          (ADDRESS_SPECIFIED << 25)
 #define SLAB_GATHER_FAILURE    (ADDRESS_SPECIFIED << 26)
 #define GET_SLAB_ROOT_CACHES   (ADDRESS_SPECIFIED << 27)
+#define GET_PAGEFLAG_COUNTS    (ADDRESS_SPECIFIED << 28)
+#define GET_MAPPING_COUNTS     (ADDRESS_SPECIFIED << 29)
 
 #define GET_ALL \
 	(GET_SHARED_PAGES|GET_TOTALRAM_PAGES|GET_BUFFERS_PAGES|GET_SLAB_PAGES)
@@ -4886,7 +8131,7 @@ cmd_kmem(void)
 	int c;
 	int sflag, Sflag, pflag, fflag, Fflag, vflag, zflag, oflag, gflag; 
 	int nflag, cflag, Cflag, iflag, lflag, Lflag, Pflag, Vflag, hflag;
-	int rflag;
+	int rflag, tflag, aflag;
 	struct meminfo meminfo;
 	ulonglong value[MAXARGS];
 	char buf[BUFSIZE];
@@ -4899,15 +8144,27 @@ cmd_kmem(void)
 	spec_addr = choose_cpu = 0;
         sflag =	Sflag = pflag = fflag = Fflag = Pflag = zflag = oflag = 0;
 	vflag = Cflag = cflag = iflag = nflag = lflag = Lflag = Vflag = 0;
-	gflag = hflag = rflag = 0;
+	gflag = hflag = rflag = tflag = aflag = 0;
 	escape = FALSE;
 	BZERO(&meminfo, sizeof(struct meminfo));
 	BZERO(&value[0], sizeof(ulonglong)*MAXARGS);
 	pc->curcmd_flags &= ~HEADER_PRINTED;
 
-        while ((c = getopt(argcnt, args, "gI:sS::rFfm:pvczCinl:L:PVoh")) != EOF) {
+        while ((c = getopt(argcnt, args, "gI:sS::rFfm:pvczCinl:L:PVohtj:a")) != EOF) {
                 switch(c)
 		{
+		case 't':
+			tflag = 1;
+			break;
+
+		case 'j':
+			meminfo.threads = stol(optarg, FAULT_ON_ERROR, NULL);
+			if ((meminfo.threads < 1) ||
+			    (meminfo.threads > MAX_PARALLEL_THREADS))
+				error(FATAL, "-j: thread count must be between "
+					"1 and %d\n", MAX_PARALLEL_THREADS);
+			break;
+
 		case 'V':
 			Vflag = 1;
 			break;
@@ -4924,6 +8181,10 @@ cmd_kmem(void)
 			iflag = 1;
 			break;
 
+		case 'a':
+			aflag = 1;
+			break;
+
 		case 'h': 
 			hflag = 1;
 			break;
@@ -5058,6 +8319,27 @@ cmd_kmem(void)
 		cmd_usage(pc->curcmd, SYNOPSIS);
 	} 
 
+	if (tflag && !vflag && (!pflag || meminfo.nr_members)) {
+		error(INFO, "-t can only be used with -p or -v\n");
+		cmd_usage(pc->curcmd, SYNOPSIS);
+	}
+
+	if (aflag && !iflag) {
+		error(INFO, "-a can only be used with -i\n");
+		cmd_usage(pc->curcmd, SYNOPSIS);
+	}
+
+	if (meminfo.threads && !(sflag || Sflag || rflag || fflag || Fflag)) {
+		error(INFO, "-j can only be used with -s, -S, -r, -f or -F\n");
+		cmd_usage(pc->curcmd, SYNOPSIS);
+	}
+
+	if ((meminfo.threads > 1) && (sflag || Sflag || rflag) &&
+	    !(vt->flags & KMALLOC_SLUB)) {
+		error(INFO, "-j is only supported with CONFIG_SLUB\n");
+		meminfo.threads = 0;
+	}
+
 	if (sflag || Sflag || rflag || !(vt->flags & KMEM_CACHE_INIT))
 		kmem_cache_init();
 
@@ -5188,7 +8470,7 @@ cmd_kmem(void)
                  * no value arguments allowed! 
                  */
                 if (zflag || nflag || iflag || Fflag || Cflag || Lflag || 
-		    Vflag || oflag || hflag || rflag) {
+		    Vflag || oflag || hflag || rflag || tflag) {
 			error(INFO, 
 			    "no address arguments allowed with this option\n");
                         cmd_usage(pc->curcmd, SYNOPSIS);
@@ -5208,9 +8490,16 @@ cmd_kmem(void)
 	}
 
 	if (iflag == 1)
-		dump_kmeminfo();
+		dump_kmeminfo(aflag);
 
-	if (pflag == 1)
+	if ((pflag == 1) && tflag) {
+		meminfo.flags = GET_PAGEFLAG_COUNTS;
+		meminfo.pageflag_counts = (ulong *)
+			GETBUF(sizeof(ulong) * (BITS_PER_LONG + 1));
+		dump_mem_map(&meminfo);
+		dump_page_flag_counts(&meminfo);
+		FREEBUF(meminfo.pageflag_counts);
+	} else if (pflag == 1)
 		dump_mem_map(&meminfo);
 
 	if (fflag == 1)
@@ -5254,7 +8543,9 @@ cmd_kmem(void)
 			FREEBUF(cpus);
 	}
 
-	if (vflag == 1)
+	if ((vflag == 1) && tflag)
+		dump_vmap_area_callers();
+	else if (vflag == 1)
 		dump_vmlist(&meminfo);
 
 	if (Cflag == 1) {
@@ -5481,12 +8772,181 @@ PG_slab_flag_init(void)
 
 #define v26_PG_private              12
 
-#define PGMM_CACHED (512)
+#define PGMM_CACHED (32768)	/* default page structs read per request */
+#define PGMM_CACHED_MAX (1 << 20)
+#define PGMM_CACHED_ADDR (512)	/* when looking up a single page */
+
+static ulong mem_map_cache_pages = PGMM_CACHED;
+
+/*
+ *  "set mem_map_cache": the number of page structures that kmem -p and the
+ *  other mem_map scans read with each request.
+ */
+void
+mem_map_cache_set_size(ulong count)
+{
+	if (!count)
+		count = PGMM_CACHED;
+
+	mem_map_cache_pages = MIN(count, PGMM_CACHED_MAX);
+}
+
+ulong
+mem_map_cache_size(void)
+{
+	return mem_map_cache_pages;
+}
+
+/*
+ *  GET_PAGEFLAG_COUNTS: add the bits set in a page's flags to the per-bit
+ *  totals, visiting only the bits that are set.  The element following
+ *  the per-bit counts holds the number of pages counted.
+ */
+static inline void
+count_page_flags(struct meminfo *mi, ulong flags)
+{
+	mi->pageflag_counts[BITS_PER_LONG]++;
+
+	for ( ; flags; flags &= flags - 1)
+		mi->pageflag_counts[__builtin_ctzl(flags)]++;
+}
+
+/*
+ *  The number of pages in the page cache of each address_space, gathered
+ *  by a GET_MAPPING_COUNTS scan of the mem_map.  The table is open-addressed
+ *  by address_space address.  With a dumpfile it is built once and kept
+ *  for the session; on a live system each request scans the mem_map anew.
+ */
+#define PAGE_MAPPING_FLAGS (0x3)	/* PAGE_MAPPING_ANON|PAGE_MAPPING_MOVABLE */
+#define MAPPING_PAGES_HASH(mapping) (((mapping) >> 6) * 0x9e3779b97f4a7c15ULL)
+
+static struct page_cache_owners {
+	struct mapping_pages *table;
+	ulong size;
+	ulong count;
+	ulong pages;
+	int valid;
+} page_cache_owners = { 0 };
+
+static void
+page_cache_owners_resize(ulong size)
+{
+	struct page_cache_owners *pco = &page_cache_owners;
+	struct mapping_pages *table, *mp;
+	ulong i, index;
+
+	if (!(table = (struct mapping_pages *)
+	    calloc(size, sizeof(struct mapping_pages))))
+		error(FATAL, "cannot calloc page cache owner table\n");
+
+	for (i = 0; i < pco->size; i++) {
+		mp = &pco->table[i];
+		if (!mp->mapping)
+			continue;
+		index = MAPPING_PAGES_HASH(mp->mapping) & (size-1);
+		while (table[index].mapping)
+			index = (index+1) & (size-1);
+		table[index] = *mp;
+	}
+
+	free(pco->table);
+	pco->table = table;
+	pco->size = size;
+}
+
+/*
+ *  GET_MAPPING_COUNTS: count a page against its page.mapping if it is an
+ *  address_space; anonymous, movable and slab pages are skipped.
+ */
+static void
+count_page_mapping(char *pcache, ulong flags)
+{
+	struct page_cache_owners *pco = &page_cache_owners;
+	ulong mapping, index;
+
+	if (vt->PG_slab && ((flags >> vt->PG_slab) & 1))
+		return;
+
+	mapping = ULONG(pcache + OFFSET(page_mapping));
+	if (!mapping || (mapping & PAGE_MAPPING_FLAGS) || !IS_KVADDR(mapping))
+		return;
+
+	if (((pco->count+1) * 2) > pco->size)
+		page_cache_owners_resize(pco->size ? pco->size * 2 : 4096);
+
+	index = MAPPING_PAGES_HASH(mapping) & (pco->size-1);
+	while (pco->table[index].mapping && (pco->table[index].mapping != mapping))
+		index = (index+1) & (pco->size-1);
+
+	if (!pco->table[index].mapping) {
+		pco->table[index].mapping = mapping;
+		pco->count++;
+	}
+	pco->table[index].pages++;
+	pco->pages++;
+}
+
+static int
+compare_mapping_pages(const void *v1, const void *v2)
+{
+	const struct mapping_pages *mp1 = v1, *mp2 = v2;
+
+	if (mp1->pages != mp2->pages)
+		return (mp1->pages < mp2->pages) ? 1 : -1;
+	if (mp1->mapping != mp2->mapping)
+		return (mp1->mapping < mp2->mapping) ? -1 : 1;
+	return 0;
+}
+
+/*
+ *  Return the address_space structures that own page cache pages, with
+ *  their page counts, in a GETBUF'd array sorted by descending count.
+ *  The number of entries is returned, and the total number of pages
+ *  counted is passed back in *total if it is non-NULL.
+ */
+int
+page_cache_mapping_counts(struct mapping_pages **mpp, ulong *total)
+{
+	struct page_cache_owners *pco = &page_cache_owners;
+	struct meminfo meminfo;
+	struct mapping_pages *mp;
+	ulong i, cnt;
+
+	if (INVALID_MEMBER(page_mapping))
+		error(FATAL, "page.mapping is not available\n");
+
+	if (!pco->valid || !DUMPFILE()) {
+		if (pco->size)
+			BZERO(pco->table, pco->size * sizeof(struct mapping_pages));
+		pco->count = pco->pages = 0;
+		pco->valid = FALSE;
+
+		BZERO(&meminfo, sizeof(struct meminfo));
+		meminfo.flags = GET_MAPPING_COUNTS;
+		dump_mem_map(&meminfo);
+
+		pco->valid = TRUE;
+	}
+
+	mp = (struct mapping_pages *)
+		GETBUF(MAX(pco->count, 1) * sizeof(struct mapping_pages));
+	for (i = cnt = 0; i < pco->size; i++) {
+		if (pco->table[i].mapping)
+			mp[cnt++] = pco->table[i];
+	}
+	qsort(mp, cnt, sizeof(struct mapping_pages), compare_mapping_pages);
+
+	*mpp = mp;
+	if (total)
+		*total = pco->pages;
+
+	return (int)cnt;
+}
 
 static void
 dump_mem_map_SPARSEMEM(struct meminfo *mi)
 {
-	ulong i;
+	ulong i, cached, chunk;
 	long total_pages;
 	int others, page_not_mapped, phys_not_mapped, page_mapping;
 	ulong pp, ppend;
@@ -5635,12 +9095,18 @@ dump_mem_map_SPARSEMEM(struct meminfo *mi)
 		slabs = 0;
 		break;
 
+	case GET_PAGEFLAG_COUNTS:
+	case GET_MAPPING_COUNTS:
+		break;
+
 	default:
 		print_hdr = TRUE;
 		break;
 	}
 
-	page_cache = GETBUF(SIZE(page) * PGMM_CACHED);
+	cached = (mi->flags & ADDRESS_SPECIFIED) ?
+		PGMM_CACHED_ADDR : mem_map_cache_size();
+	page_cache = GETBUF(SIZE(page) * cached);
 	done = FALSE;
 	total_pages = 0;
 
@@ -5704,15 +9170,16 @@ dump_mem_map_SPARSEMEM(struct meminfo *mi)
 		for (i = 0; i < section_size; 
 		     i++, pp += SIZE(page), phys += PAGESIZE()) {
 
-			if ((i % PGMM_CACHED) == 0) {
+			if ((i % cached) == 0) {
 
-				ppend = pp + ((PGMM_CACHED-1) * SIZE(page));
-				physend = phys + ((PGMM_CACHED-1) * PAGESIZE());
+				chunk = MIN(cached, section_size - i);
+				ppend = pp + ((chunk-1) * SIZE(page));
+				physend = phys + ((chunk-1) * PAGESIZE());
 
 				if ((pg_spec && (mi->spec_addr > ppend)) ||
 			            (phys_spec && 
 				    (PHYSPAGEBASE(mi->spec_addr) > physend))) {
-					i += (PGMM_CACHED-1);
+					i += (chunk-1);
 					pp = ppend;
 					phys = physend;
 					continue;
@@ -5721,7 +9188,7 @@ dump_mem_map_SPARSEMEM(struct meminfo *mi)
 				fill_mem_map_cache(pp, ppend, page_cache);
 			}
 
-			pcache = page_cache + ((i%PGMM_CACHED) * SIZE(page));
+			pcache = page_cache + ((i%cached) * SIZE(page));
 
 			if (received_SIGINT())
 				restart(0);
@@ -5745,6 +9212,14 @@ dump_mem_map_SPARSEMEM(struct meminfo *mi)
 
 	                switch (mi->flags)
 			{
+			case GET_PAGEFLAG_COUNTS:
+				count_page_flags(mi, flags);
+				continue;
+
+			case GET_MAPPING_COUNTS:
+				count_page_mapping(pcache, flags);
+				continue;
+
 			case GET_ALL:
 			case GET_BUFFERS_PAGES:
 				if (VALID_MEMBER(page_buffers)) {
@@ -5970,7 +9445,7 @@ display_members:
 static void
 dump_mem_map(struct meminfo *mi)
 {
-	long i, n;
+	long i, n, cached, chunk;
 	long total_pages;
 	int others, page_not_mapped, phys_not_mapped, page_mapping;
 	ulong pp, ppend;
@@ -6124,12 +9599,18 @@ dump_mem_map(struct meminfo *mi)
 		slabs = 0;
 		break;
 
+	case GET_PAGEFLAG_COUNTS:
+	case GET_MAPPING_COUNTS:
+		break;
+
 	default:
 		print_hdr = TRUE;
 		break;
 	}
 
-	page_cache = GETBUF(SIZE(page) * PGMM_CACHED);
+	cached = (mi->flags & ADDRESS_SPECIFIED) ?
+		PGMM_CACHED_ADDR : mem_map_cache_size();
+	page_cache = GETBUF(SIZE(page) * cached);
 	done = FALSE;
 	total_pages = 0;
 
@@ -6155,14 +9636,15 @@ dump_mem_map(struct meminfo *mi)
 		for (i = 0; i < node_size; 
 		     i++, pp += SIZE(page), phys += PAGESIZE()) {
 
-			if ((i % PGMM_CACHED) == 0) {
-				ppend = pp + ((PGMM_CACHED-1) * SIZE(page));
-				physend = phys + ((PGMM_CACHED-1) * PAGESIZE());
+			if ((i % cached) == 0) {
+				chunk = MIN(cached, (long)node_size - i);
+				ppend = pp + ((chunk-1) * SIZE(page));
+				physend = phys + ((chunk-1) * PAGESIZE());
 
 				if ((pg_spec && (mi->spec_addr > ppend)) ||
 			            (phys_spec && 
 				    (PHYSPAGEBASE(mi->spec_addr) > physend))) {
-					i += (PGMM_CACHED-1);
+					i += (chunk-1);
 					pp = ppend;
 					phys = physend;
 					continue;
@@ -6171,7 +9653,7 @@ dump_mem_map(struct meminfo *mi)
 				fill_mem_map_cache(pp, ppend, page_cache);
 			}
 
-			pcache = page_cache + ((i%PGMM_CACHED) * SIZE(page));
+			pcache = page_cache + ((i%cached) * SIZE(page));
 
 			if (received_SIGINT())
 				restart(0);
@@ -6195,6 +9677,14 @@ dump_mem_map(struct meminfo *mi)
 
 	                switch (mi->flags)
 			{
+			case GET_PAGEFLAG_COUNTS:
+				count_page_flags(mi, flags);
+				continue;
+
+			case GET_MAPPING_COUNTS:
+				count_page_mapping(pcache, flags);
+				continue;
+
 			case GET_ALL:
 			case GET_BUFFERS_PAGES:
 				if (VALID_MEMBER(page_buffers)) {
@@ -6419,10 +9909,10 @@ display_members:
 }
 
 /*
- *  Stash a chunk of PGMM_CACHED page structures, starting at addr, into the
+ *  Stash the chunk of page structures from pp through ppend into the
  *  passed-in buffer.  The mem_map array is normally guaranteed to be
  *  readable except in the case of virtual mem_map usage.  When V_MEM_MAP
- *  is in place, read all pages consumed by PGMM_CACHED page structures
+ *  is in place, read all pages consumed by the page structures
  *  that are currently mapped, leaving the unmapped ones just zeroed out.
  */
 static void
@@ -6431,11 +9921,12 @@ fill_mem_map_cache(ulong pp, ulong ppend, char *page_cache)
 	long size, cnt;
 	ulong addr;
         char *bufptr;
+	physaddr_t paddr;
 
 	/*
 	 *  Try to read it in one fell swoop.
  	 */
-	if (readmem(pp, KVADDR, page_cache, SIZE(page) * PGMM_CACHED,
+	if (readmem(pp, KVADDR, page_cache, ppend - pp + SIZE(page),
       	    "page struct cache", RETURN_ON_ERROR|QUIET))
 		return;
 
@@ -6443,7 +9934,7 @@ fill_mem_map_cache(ulong pp, ulong ppend, char *page_cache)
 	 *  Break it into page-size-or-less requests, warning if it's
 	 *  not a virtual mem_map.
 	 */
-        size = SIZE(page) * PGMM_CACHED;
+        size = ppend - pp + SIZE(page);
         addr = pp;
         bufptr = page_cache;
 
@@ -6456,7 +9947,13 @@ fill_mem_map_cache(ulong pp, ulong ppend, char *page_cache)
                 if (cnt > size)
                         cnt = size;
 
-		if (!readmem(addr, KVADDR, bufptr, cnt,
+		/*
+		 *  Don't bother reading page structs whose backing page
+		 *  was excluded from the dumpfile.
+		 */
+		if ((DUMPFILE() && kvtop(NULL, addr, &paddr, 0) &&
+		    !dumpfile_page_present(paddr)) ||
+		    !readmem(addr, KVADDR, bufptr, cnt,
                     "virtual page struct cache", RETURN_ON_ERROR|QUIET)) {
 			BZERO(bufptr, cnt);
 			if (!((vt->flags & V_MEM_MAP) || (machdep->flags & VMEMMAP)) && ((addr+cnt) < ppend))
@@ -6541,6 +10038,80 @@ page_flags_init(void)
 
 	PG_reserved_flag_init();
 	PG_slab_flag_init();
+	pageflags_bit_init();
+}
+
+/*
+ *  Index the page flag names by bit number, so that translate_page_flags()
+ *  and "kmem -p -t" only have to visit the bits that are set in a page's
+ *  flags.  translate_page_flags() can only do that if every name covers a
+ *  single bit and the names are in bit order, which keeps its output the
+ *  same as that of a walk through the whole pageflags_data array.
+ */
+static char *pageflags_bit_name[BITS_PER_LONG];
+static ulong pageflags_bit_mask;
+static int pageflags_bitwise;
+
+static void
+pageflags_bit_init(void)
+{
+	int i, bit, last;
+	ulong mask;
+
+	BZERO(pageflags_bit_name, sizeof(pageflags_bit_name));
+	pageflags_bit_mask = 0;
+	pageflags_bitwise = (vt->flags & PAGEFLAGS) ? TRUE : FALSE;
+
+	if (!(vt->flags & PAGEFLAGS))
+		return;
+
+	for (i = 0, last = -1; i < vt->nr_pageflags; i++) {
+		mask = vt->pageflags_data[i].mask;
+		if (!mask || (mask & (mask - 1))) {
+			pageflags_bitwise = FALSE;
+			continue;
+		}
+		bit = __builtin_ctzl(mask);
+		if (bit <= last)
+			pageflags_bitwise = FALSE;
+		last = bit;
+		if (!pageflags_bit_name[bit])
+			pageflags_bit_name[bit] = vt->pageflags_data[i].name;
+		pageflags_bit_mask |= mask;
+	}
+}
+
+/*
+ *  Display the totals gathered by a GET_PAGEFLAG_COUNTS scan of the
+ *  mem_map for "kmem -p -t".
+ */
+static void
+dump_page_flag_counts(struct meminfo *mi)
+{
+	int bit;
+	ulong pages, count;
+	char name[BUFSIZE];
+	char buf[BUFSIZE];
+
+	pages = mi->pageflag_counts[BITS_PER_LONG];
+
+	fprintf(fp, "%20s  %10s  %11s  PERCENTAGE\n", "FLAG", "PAGES", "TOTAL");
+
+	for (bit = 0; bit < BITS_PER_LONG; bit++) {
+		count = mi->pageflag_counts[bit];
+		if (pageflags_bit_name[bit])
+			sprintf(name, "%s", pageflags_bit_name[bit]);
+		else if (count)
+			sprintf(name, "bit %d", bit);
+		else
+			continue;
+		fprintf(fp, "%20s  %10ld  %11s  %3ld%% of TOTAL PAGES\n",
+			name, count, pages_to_size(count, buf),
+			pages ? (count * 100) / pages : 0);
+	}
+
+	fprintf(fp, "%20s  %10ld  %11s         ----\n", "TOTAL PAGES",
+		pages, pages_to_size(pages, buf));
 }
 
 static int
@@ -6711,22 +10282,29 @@ static int
 translate_page_flags(char *buffer, ulong flags)
 {
 	char buf[BUFSIZE];
+	char *p;
 	int i, others;
+	ulong bits;
 
-	sprintf(buf, "%lx", flags);
+	p = buf + sprintf(buf, "%lx", flags);
 
-	if (flags) {
+	if (flags && pageflags_bitwise) {
+		for (bits = flags & pageflags_bit_mask, others = 0; bits;
+		     bits &= bits - 1)
+			p += sprintf(p, "%s%s", others++ ? "," : " ",
+				pageflags_bit_name[__builtin_ctzl(bits)]);
+	} else if (flags) {
 		for (i = others = 0; i < vt->nr_pageflags; i++) {
 			if (flags & vt->pageflags_data[i].mask)
-				sprintf(&buf[strlen(buf)], "%s%s",
+				p += sprintf(p, "%s%s",
 					others++ ? "," : " ",
 					vt->pageflags_data[i].name);
 		}
 	}
-	strcat(buf, "\n");
+	strcpy(p, "\n");
 	strcpy(buffer, buf);
 
-	return(strlen(buf));
+	return(p + 1 - buf);
 }
 
 /*
@@ -7417,8 +10995,6 @@ dump_free_pages_zones_v1(struct meminfo *fi)
 	if (do_search)
 		open_tmpfile();
 
-	hq_open();
-
 	for (n = sum = found = 0; n < vt->numnodes; n++) {
                 nt = &vt->node_table[n];
 		node_zones = nt->pgdat + OFFSET(pglist_data_node_zones);
@@ -7521,14 +11097,12 @@ dump_free_pages_zones_v1(struct meminfo *fi)
 			if (value)
 				found += dump_zone_free_area(node_zones+
 					OFFSET(zone_struct_free_area), 
-					vt->nr_free_areas, verbose, NULL);
+					vt->nr_free_areas, verbose, NULL, -1);
 
 			node_zones += SIZE(zone_struct);
 		}
 	}
 
-	hq_close();
-
         if (fi->flags & (GET_FREE_PAGES|GET_ZONE_SIZES|GET_FREE_HIGHMEM_PAGES)) {
                 fi->retval = sum;
                 return;
@@ -7669,6 +11243,176 @@ free_page_callback(void *page, void *arg)
 }
 
 
+/*
+ *  Display the line of node n's zone i that precedes its free areas, and
+ *  return the zone's free page count.
+ */
+static ulong
+dump_free_pages_zone_hdr_v2(int n, int i, ulong node_zones,
+			    long zone_size_offset)
+{
+	ulong value, size, pp;
+	ulong zone_mem_map, zone_start_paddr, zone_start_pfn, zone_start_mapnr;
+	physaddr_t phys;
+	struct node_table *nt;
+	char buf[BUFSIZE];
+	char buf1[BUFSIZE];
+	char buf2[BUFSIZE];
+	char buf3[BUFSIZE];
+
+	nt = &vt->node_table[n];
+
+	if ((i == 0) && ((vt->flags & NODES) || (vt->numnodes > 1))) {
+		if (n) {
+			fprintf(fp, "\n");
+			pad_line(fp, VADDR_PRLEN > 8 ? 74 : 66, '-');
+			fprintf(fp, "\n");
+		}
+		fprintf(fp, "%sNODE\n %2d\n", n ? "\n" : "", nt->node_id);
+	}
+
+	fprintf(fp, "%s%s  %s  START_PADDR  START_MAPNR\n",
+		i > 0 ? "\n" : "", zone_hdr,
+		mkstring(buf1, VADDR_PRLEN, CENTER|LJUST, "MEM_MAP"));
+
+	fprintf(fp, "%3d   ", i);
+
+	readmem(node_zones+OFFSET(zone_name), KVADDR, &value, sizeof(void *),
+		"node_zones name", FAULT_ON_ERROR);
+	if (read_string(value, buf, BUFSIZE-1))
+		fprintf(fp, "%-9s ", buf);
+	else
+		fprintf(fp, "(unknown) ");
+
+	readmem(node_zones+zone_size_offset, KVADDR, &size, sizeof(ulong),
+		"node_zones size", FAULT_ON_ERROR);
+	fprintf(fp, "%6ld  ", size);
+
+	readmem(node_zones+OFFSET(zone_free_pages), KVADDR, &value,
+		sizeof(ulong), "node_zones free_pages", FAULT_ON_ERROR);
+	fprintf(fp, "%6ld  ", value);
+
+	zone_mem_map = 0;
+	if (VALID_MEMBER(zone_zone_mem_map))
+		readmem(node_zones+OFFSET(zone_zone_mem_map), KVADDR,
+			&zone_mem_map, sizeof(ulong),
+			"node_zones zone_mem_map", FAULT_ON_ERROR);
+
+	readmem(node_zones+OFFSET(zone_zone_start_pfn), KVADDR,
+		&zone_start_pfn, sizeof(ulong),
+		"node_zones zone_start_pfn", FAULT_ON_ERROR);
+	zone_start_paddr = PTOB(zone_start_pfn);
+
+	if (!VALID_MEMBER(zone_zone_mem_map)) {
+		if (IS_SPARSEMEM() || IS_DISCONTIGMEM()) {
+			if (size) {
+				phys = PTOB(zone_start_pfn);
+				if (phys_to_page(phys, &pp))
+					zone_mem_map = pp;
+			}
+		} else if (vt->flags & FLATMEM) {
+			if (size)
+				zone_mem_map = nt->mem_map +
+					(zone_start_pfn * SIZE(page));
+		} else
+			error(FATAL, "\ncannot determine zone mem_map: TBD\n");
+	}
+
+	if (zone_mem_map)
+		zone_start_mapnr = (zone_mem_map - nt->mem_map) / SIZE(page);
+	else
+		zone_start_mapnr = 0;
+
+	fprintf(fp, "%s  %s  %s\n",
+		mkstring(buf1, VADDR_PRLEN, CENTER|LONG_HEX,
+			MKSTR(zone_mem_map)),
+		mkstring(buf2, strlen("START_PADDR"), CENTER|LONG_HEX|RJUST,
+			MKSTR(zone_start_paddr)),
+		mkstring(buf3, strlen("START_MAPNR"), CENTER|LONG_DEC|RJUST,
+			MKSTR(zone_start_mapnr)));
+
+	return value;
+}
+
+/*
+ *  For "kmem -f -j" and "kmem -F -j", each free area order of each zone is
+ *  a run_forked() job.  The page counts found by the jobs are passed back
+ *  in a shared array, along with the zone free page counts read by the
+ *  order 0 jobs.
+ */
+struct free_pages_zones_jobs {
+	long zone_size_offset;
+	ulong verbose;
+	ulong *value;
+	ulong *found;
+};
+
+static void
+dump_free_pages_zones_job(void *arg, int job)
+{
+	struct free_pages_zones_jobs *jobs = arg;
+	int n, i, order;
+	ulong node_zones, value;
+
+	order = job % vt->nr_free_areas;
+	i = (job / vt->nr_free_areas) % vt->nr_zones;
+	n = job / (vt->nr_free_areas * vt->nr_zones);
+
+	node_zones = vt->node_table[n].pgdat + OFFSET(pglist_data_node_zones) +
+		(i * SIZE(zone));
+
+	if (order == 0)
+		value = jobs->value[job] = dump_free_pages_zone_hdr_v2(n, i,
+			node_zones, jobs->zone_size_offset);
+	else
+		readmem(node_zones+OFFSET(zone_free_pages), KVADDR, &value,
+			sizeof(ulong), "node_zones free_pages", FAULT_ON_ERROR);
+
+	jobs->found[job] = value ? dump_zone_free_area(node_zones +
+		OFFSET(zone_free_area), vt->nr_free_areas, jobs->verbose,
+		NULL, order) : 0;
+}
+
+/*
+ *  Returns the run_forked() result; if the jobs were not run, the caller
+ *  walks the zones itself.
+ */
+static int
+dump_free_pages_zones_parallel(struct meminfo *fi, long zone_size_offset,
+			       ulong verbose, ulong *sum, ulong *found)
+{
+	int j, njobs, ret;
+	size_t size;
+	ulong *results;
+	struct free_pages_zones_jobs jobs;
+
+	njobs = vt->numnodes * vt->nr_zones * vt->nr_free_areas;
+	size = sizeof(ulong) * njobs * 2;
+	results = mmap(NULL, size, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (results == MAP_FAILED) {
+		error(INFO, "cannot mmap free area results: %s\n",
+			strerror(errno));
+		return FORKED_SERIAL;
+	}
+	BZERO(results, size);
+
+	jobs.zone_size_offset = zone_size_offset;
+	jobs.verbose = verbose;
+	jobs.value = results;
+	jobs.found = results + njobs;
+
+	ret = run_forked(fi->threads, njobs, dump_free_pages_zones_job, &jobs);
+
+	for (j = 0; (ret == FORKED_DONE) && (j < njobs); j++) {
+		*sum += jobs.value[j];
+		*found += jobs.found[j];
+	}
+	munmap(results, size);
+
+	return ret;
+}
+
 /*
  *  Same as dump_free_pages_zones_v1(), but updated for numerous 2.6 zone 
  *  and free_area related data structure changes.
@@ -7684,19 +11428,12 @@ dump_free_pages_zones_v2(struct meminfo *fi)
 	int order, errflag, do_search;
 	ulong offset, verbose, value, sum, found; 
 	ulong this_addr;
-	physaddr_t phys, this_phys, searchphys, end_paddr;
+	physaddr_t this_phys, searchphys, end_paddr;
 	ulong searchpage;
 	struct free_page_callback_data callback_data;
-	ulong pp;
-        ulong zone_mem_map;
-        ulong zone_start_paddr;
-	ulong zone_start_pfn;
-        ulong zone_start_mapnr;
 	struct node_table *nt;
 	char buf[BUFSIZE], *p;
 	char buf1[BUFSIZE];
-	char buf2[BUFSIZE];
-	char buf3[BUFSIZE];
 	char last_node[BUFSIZE];
 	char last_zone[BUFSIZE];
 	char last_area[BUFSIZE];
@@ -7748,9 +11485,24 @@ dump_free_pages_zones_v2(struct meminfo *fi)
 	if (do_search)
 		open_tmpfile();
 
-	hq_open();
+	/*
+	 *  The free lists are independent of each other, so with -j they
+	 *  can be walked by worker processes.
+	 */
+	sum = found = 0;
+	if ((fi->threads > 1) && !do_search &&
+	    !(fi->flags & (GET_FREE_PAGES|GET_ZONE_SIZES|GET_FREE_HIGHMEM_PAGES))) {
+		switch (dump_free_pages_zones_parallel(fi, zone_size_offset,
+		    verbose, &sum, &found))
+		{
+		case FORKED_DONE:
+			goto done_search;
+		case FORKED_BAILOUT:
+			return;
+		}
+	}
 
-	for (n = sum = found = 0; n < vt->numnodes; n++) {
+	for (n = 0; n < vt->numnodes; n++) {
                 nt = &vt->node_table[n];
 		node_zones = nt->pgdat + OFFSET(pglist_data_node_zones);
 
@@ -7795,88 +11547,8 @@ dump_free_pages_zones_v2(struct meminfo *fi)
 	                        continue;
 			}
 
-			if ((i == 0) && ((vt->flags & NODES) || (vt->numnodes > 1))) {
-				if (n) {
-					fprintf(fp, "\n");
-					pad_line(fp, 
-						VADDR_PRLEN > 8 ? 74 : 66, '-');
-					fprintf(fp, "\n");
-				}
-				fprintf(fp, "%sNODE\n %2d\n", 
-					n ? "\n" : "", nt->node_id);
-			}
-
-	                fprintf(fp, "%s%s  %s  START_PADDR  START_MAPNR\n",
-				i > 0 ? "\n" : "",
-	                        zone_hdr,
-	                        mkstring(buf1, VADDR_PRLEN, CENTER|LJUST, 
-				    "MEM_MAP"));
-	
-			fprintf(fp, "%3d   ", i);
-	
-	        	readmem(node_zones+OFFSET(zone_name), KVADDR, 
-				&value, sizeof(void *), 
-				"node_zones name", FAULT_ON_ERROR);
-	                if (read_string(value, buf, BUFSIZE-1))
-	                	fprintf(fp, "%-9s ", buf);
-			else
-				fprintf(fp, "(unknown) ");
-	
-	        	readmem(node_zones+zone_size_offset, KVADDR, 
-				&size, sizeof(ulong), 
-				"node_zones size", FAULT_ON_ERROR);
-	                fprintf(fp, "%6ld  ", size);
-	
-	        	readmem(node_zones+OFFSET(zone_free_pages), 
-				KVADDR, &value, sizeof(ulong), 
-				"node_zones free_pages", FAULT_ON_ERROR);
-	
-	                fprintf(fp, "%6ld  ", value);
-	
-			if (VALID_MEMBER(zone_zone_mem_map)) {
-                        	readmem(node_zones+OFFSET(zone_zone_mem_map),
-                                	KVADDR, &zone_mem_map, sizeof(ulong),
-                                	"node_zones zone_mem_map", FAULT_ON_ERROR);
-			}
-
-			readmem(node_zones+ OFFSET(zone_zone_start_pfn),
-                                KVADDR, &zone_start_pfn, sizeof(ulong),
-                                "node_zones zone_start_pfn", FAULT_ON_ERROR);
-                        zone_start_paddr = PTOB(zone_start_pfn);
-
-			if (!VALID_MEMBER(zone_zone_mem_map)) {
-				if (IS_SPARSEMEM() || IS_DISCONTIGMEM()) {
-					zone_mem_map = 0;
-					if (size) {
-						phys = PTOB(zone_start_pfn);
-                                        	if (phys_to_page(phys, &pp))
-                                                	zone_mem_map = pp;
-					}
-				} else if (vt->flags & FLATMEM) {
-					zone_mem_map = 0;
-					if (size)
-						zone_mem_map = nt->mem_map +
-							(zone_start_pfn * SIZE(page));
-				} else
-					error(FATAL, "\ncannot determine zone mem_map: TBD\n");
-			}
-
-                        if (zone_mem_map) 
-                        	zone_start_mapnr = 
-					(zone_mem_map - nt->mem_map) / 
-						SIZE(page);
-                        else
-                                zone_start_mapnr = 0;
-	
-	                fprintf(fp, "%s  %s  %s\n",
-	                	mkstring(buf1, VADDR_PRLEN,
-	                            CENTER|LONG_HEX,MKSTR(zone_mem_map)),
-	                	mkstring(buf2, strlen("START_PADDR"),
-	                            CENTER|LONG_HEX|RJUST,
-					MKSTR(zone_start_paddr)),
-	                	mkstring(buf3, strlen("START_MAPNR"),
-	                            CENTER|LONG_DEC|RJUST,
-					MKSTR(zone_start_mapnr)));
+			value = dump_free_pages_zone_hdr_v2(n, i, node_zones,
+				zone_size_offset);
 	
 			sum += value;
 
@@ -7891,14 +11563,14 @@ dump_free_pages_zones_v2(struct meminfo *fi)
 						found += dump_zone_free_area(node_zones+
 							OFFSET(zone_free_area), 
 							vt->nr_free_areas, verbose,
-							&callback_data);
+							&callback_data, -1);
 
 					if (callback_data.found)
 						goto done_search;
 				} else 
 					found += dump_zone_free_area(node_zones+
 						OFFSET(zone_free_area), 
-						vt->nr_free_areas, verbose, NULL);
+						vt->nr_free_areas, verbose, NULL, -1);
 			}
 
 			node_zones += SIZE(zone);
@@ -7906,8 +11578,6 @@ dump_free_pages_zones_v2(struct meminfo *fi)
 	}
 
 done_search:
-	hq_close();
-
         if (fi->flags & (GET_FREE_PAGES|GET_ZONE_SIZES|GET_FREE_HIGHMEM_PAGES)) {
                 fi->retval = sum;
                 return;
@@ -8119,9 +11789,20 @@ dump_zone_page_usage(void)
 char *free_area_hdr3 = "AREA    SIZE  FREE_AREA_STRUCT\n";
 char *free_area_hdr4 = "AREA    SIZE  FREE_AREA_STRUCT  BLOCKS  PAGES\n";
 
+/*
+ *  The free lists of a large system may contain many millions of pages,
+ *  and the pages are only counted or displayed, so rather than entering
+ *  each of them into the hash queue, the lists are streamed and checked
+ *  for loops with Brent's algorithm.  A page that has been linked onto
+ *  more than one list also shows up as a loop, since the walk of the
+ *  first list cannot get back to its own list head.
+ *
+ *  If order is not -1, only the lists of that order are dumped, with
+ *  the header being shown along with order 0.
+ */
 static int
 dump_zone_free_area(ulong free_area, int num, ulong verbose, 
-		    struct free_page_callback_data *callback_data)
+		    struct free_page_callback_data *callback_data, int order)
 {
 	int i, j;
 	long chunk_size;
@@ -8161,7 +11842,7 @@ dump_zone_free_area(ulong free_area, int num, ulong verbose,
 
 	ld = &list_data;
 
-	if (!verbose)
+	if (!verbose && (order <= 0))
 		fprintf(fp, "%s", free_area_hdr4);
 
 	total_free = 0;
@@ -8172,6 +11853,8 @@ dump_zone_free_area(ulong free_area, int num, ulong verbose,
 
 	for (i = 0; i < num; i++, 
 	     free_area += SIZE_OPTION(free_area_struct, free_area)) {
+		if ((order >= 0) && (i != order))
+			continue;
 		if (verbose)
 			fprintf(fp, "%s", free_area_hdr3);
 		fprintf(fp, "%3d ", i);
@@ -8197,7 +11880,7 @@ dump_zone_free_area(ulong free_area, int num, ulong verbose,
 			fprintf(fp, "\n");
 
                 BZERO(ld, sizeof(struct list_data));
-                ld->flags = verbose | RETURN_ON_DUPLICATE;
+                ld->flags = verbose | RETURN_ON_DUPLICATE | LIST_BRENT_ALGO;
                 ld->start = free_area_buf[0];
                 ld->end = free_area;
 		if (VALID_MEMBER(page_list_next))
@@ -8208,7 +11891,7 @@ dump_zone_free_area(ulong free_area, int num, ulong verbose,
 		else error(FATAL, 
 			"neither page.list or page.lru exist?\n");
 
-                cnt = do_list(ld);
+                cnt = do_list_no_hash(ld);
 		if (cnt < 0) {
 			error(pc->curcmd_flags & IGNORE_ERRORS ? INFO : FATAL, 
 			    "corrupted free list from free_area_struct: %lx\n", 
@@ -8229,6 +11912,8 @@ multiple_lists:
 
 	for (i = 0; i < num; i++, 
 	     free_area += SIZE_OPTION(free_area_struct, free_area)) {
+		if ((order >= 0) && (i != order))
+			continue;
 
 		readmem(free_area, KVADDR, free_area_buf2,
 			SIZE(free_area), "free_area struct", FAULT_ON_ERROR);
@@ -8263,7 +11948,7 @@ multiple_lists:
 				fprintf(fp, "\n");
 
 			BZERO(ld, sizeof(struct list_data));
-			ld->flags = verbose | RETURN_ON_DUPLICATE;
+			ld->flags = verbose | RETURN_ON_DUPLICATE | LIST_BRENT_ALGO;
 			ld->start = *free_ptr;
 			ld->end = free_list;
 			ld->list_head_offset = OFFSET(page_lru) + 
@@ -8275,7 +11960,7 @@ multiple_lists:
 				ld->callback_data = (void *)callback_data;
 				callback_data->chunk_size = chunk_size;
 			}
-			cnt = do_list(ld);
+			cnt = do_list_no_hash(ld);
 			if (cnt < 0) {
 				error(pc->curcmd_flags & IGNORE_ERRORS ? INFO : FATAL, 
 				    "corrupted free list %d from free_area struct: %lx\n", 
@@ -8310,7 +11995,7 @@ bailout:
 char *kmeminfo_hdr = "                 PAGES        TOTAL      PERCENTAGE\n";
 
 static void
-dump_kmeminfo(void)
+dump_kmeminfo(int scan)
 {
 	int i, len;
 	ulong totalram_pages;
@@ -8330,6 +12015,7 @@ dump_kmeminfo(void)
 	int overcommit_ratio;
 	ulong hugetlb_total_pages, hugetlb_total_free_pages = 0;
 	int done_hugetlb_calc = 0; 
+	ulong dump_ram_pages, dumped_pages;
 	long nr_file_pages, nr_slab;
 	ulong swapper_space_nrpages;
 	ulong pct;
@@ -8340,28 +12026,62 @@ dump_kmeminfo(void)
         ulong get_totalram;
         ulong get_buffers;
         ulong get_slabs;
+	long nr_shmem;
+	int have_slabs;
 	char buf[BUFSIZE];
 
 
 	BZERO(&meminfo, sizeof(struct meminfo));
-	meminfo.flags = GET_ALL;
-	dump_mem_map(&meminfo);
-	get_totalram = meminfo.get_totalram;
-	shared_pages = meminfo.get_shared;
-	get_buffers = meminfo.get_buffers;
-	get_slabs = meminfo.get_slabs;
 
 	/*
 	 *  If vm_stat array exists, override page search info.
 	 */
+	have_slabs = FALSE;
+	nr_shmem = -1;
+	get_slabs = 0;
 	if (vm_stat_init()) {
-		if (dump_vm_stat("NR_SLAB", &nr_slab, 0))
+		if (dump_vm_stat("NR_SLAB", &nr_slab, 0)) {
 			get_slabs = nr_slab;
-		else if (dump_vm_stat("NR_SLAB_RECLAIMABLE", &nr_slab, 0)) {
+			have_slabs = TRUE;
+		} else if (dump_vm_stat("NR_SLAB_RECLAIMABLE", &nr_slab, 0)) {
 			get_slabs = nr_slab;
+			have_slabs = TRUE;
 			if (dump_vm_stat("NR_SLAB_UNRECLAIMABLE", &nr_slab, 0))
 				get_slabs += nr_slab;
+		} else if (dump_vm_stat("NR_SLAB_RECLAIMABLE_B", &nr_slab, 0)) {
+			get_slabs = nr_slab;
+			have_slabs = TRUE;
+			if (dump_vm_stat("NR_SLAB_UNRECLAIMABLE_B", &nr_slab, 0))
+				get_slabs += nr_slab;
 		}
+		if (!dump_vm_stat("NR_SHMEM", &nr_shmem, 0))
+			nr_shmem = -1;
+	}
+
+	/*
+	 *  Walking every page structure is by far the most expensive part
+	 *  of "kmem -i" on a large system, so it is only done if "kmem -i -a"
+	 *  is entered, or if the totalram_pages, vm_stat NR_SHMEM and slab
+	 *  counters are not all available.  In the latter case, SHARED is
+	 *  the count of non-reserved pages with a page count greater than 1,
+	 *  otherwise it is the count of shmem and tmpfs pages, as shown by
+	 *  /proc/meminfo.
+	 */
+	if (!scan && (symbol_exists("totalram_pages") ||
+	    symbol_exists("_totalram_pages")) && vt->totalram_pages &&
+	    (nr_shmem >= 0) && have_slabs) {
+		get_totalram = vt->totalram_pages;
+		shared_pages = (ulong)nr_shmem;
+		get_buffers = 0;
+	} else {
+		meminfo.flags = GET_ALL;
+		dump_mem_map(&meminfo);
+		get_totalram = meminfo.get_totalram;
+		shared_pages = meminfo.get_shared;
+		get_buffers = meminfo.get_buffers;
+		if (!have_slabs)
+			get_slabs = meminfo.get_slabs;
+		scan = TRUE;
 	}
 
 	fprintf(fp, "%s", kmeminfo_hdr);
@@ -8424,7 +12144,7 @@ dump_kmeminfo(void)
         fprintf(fp, "%13s  %7ld  %11s  %3ld%% of TOTAL MEM\n", 
 		"BUFFERS", buffer_pages, pages_to_size(buffer_pages, buf), pct);
 
-	if (CRASHDEBUG(1)) 
+	if (CRASHDEBUG(1) && scan)
         	error(NOTE, "pages with buffers: %ld\n", get_buffers);
 
 	/*
@@ -8573,6 +12293,26 @@ dump_kmeminfo(void)
 			pages_to_size(hugetlb_total_free_pages, buf), pct);
 	}
 
+	/*
+	 *  Show how much of the RAM was excluded from a partial
+	 *  compressed dumpfile.
+	 */
+	if (DISKDUMP_DUMPFILE() &&
+	    diskdump_dumped_pages(&dump_ram_pages, &dumped_pages)) {
+		fprintf(fp, "\n%13s  %7ld  %11s         ----\n",
+			"DUMP RAM", dump_ram_pages,
+			pages_to_size(dump_ram_pages, buf));
+		pct = dump_ram_pages ? (dumped_pages * 100) / dump_ram_pages : 0;
+		fprintf(fp, "%13s  %7ld  %11s  %3ld%% of DUMP RAM\n",
+			"DUMPED", dumped_pages,
+			pages_to_size(dumped_pages, buf), pct);
+		pct = dump_ram_pages ?
+			((dump_ram_pages - dumped_pages) * 100) / dump_ram_pages : 0;
+		fprintf(fp, "%13s  %7ld  %11s  %3ld%% of DUMP RAM\n",
+			"EXCLUDED", dump_ram_pages - dumped_pages,
+			pages_to_size(dump_ram_pages - dumped_pages, buf), pct);
+	}
+
         /*
          *  get swap data from dump_swap_info().
          */
@@ -8900,24 +12640,45 @@ next_entry:
 		vi->retval = verified;
 }
 
-static void
-dump_vmap_area(struct meminfo *vi)
+/*
+ *  Index of the vmalloc'd vmap_area structures, which is loaded from the
+ *  vmap_area_list the first time that it is needed.  The list is kept in
+ *  address order by the kernel, so the index is normally sorted, and an
+ *  address can be looked up with a binary search instead of a walk of
+ *  what may be tens of thousands of list entries.  If the entries are not
+ *  found to be in order, lookups fall back to scanning the whole index.
+ *  On a live system the index is reloaded by each command.
+ */
+static struct vmap_area_index {
+	int loaded;
+	int sorted;
+	ulong cmdgen;
+	int count;
+	struct vmap_area_entry {
+		ulong vmap_area;
+		ulong vm_struct;
+		ulong start;
+		ulong end;
+	} *entries;
+} vmap_area_index = { 0 };
+
+static int
+vmap_area_index_load(void)
 {
 	int i, cnt;
-	ulong start, end, vm_struct, flags, vm;
+	ulong flags, vm;
 	struct list_data list_data, *ld;
-	char *vmap_area_buf; 
-	ulong size, pcheck, count, verified; 
-	physaddr_t paddr;
-	char buf1[BUFSIZE];
-	char buf2[BUFSIZE];
-	char buf3[BUFSIZE];
-	char buf4[BUFSIZE];
+	struct vmap_area_entry *ent;
+	char *vmap_area_buf;
 
 #define VM_VM_AREA 0x4   /* mm/vmalloc.c */
 
-	vmap_area_buf = GETBUF(SIZE(vmap_area));
-	start = count = verified = size = 0;
+	if (vmap_area_index.loaded &&
+	    (!ACTIVE() || (vmap_area_index.cmdgen == pc->cmdgencur)))
+		return TRUE;
+
+	free(vmap_area_index.entries);
+	BZERO(&vmap_area_index, sizeof(struct vmap_area_index));
 
 	ld = &list_data;
 	BZERO(ld, sizeof(struct list_data));
@@ -8927,28 +12688,21 @@ dump_vmap_area(struct meminfo *vi)
 	ld->end = symbol_value("vmap_area_list");
 	cnt = do_list(ld);
 	if (cnt < 0) {
-		FREEBUF(vmap_area_buf);
 		error(WARNING, "invalid/corrupt vmap_area_list\n"); 
-		vi->retval = 0;
-		return;
+		return FALSE;
 	}
 
-	for (i = 0; i < cnt; i++) {
-		if (!(pc->curcmd_flags & HEADER_PRINTED) && (i == 0) && 
-		    !(vi->flags & (GET_HIGHEST|GET_PHYS_TO_VMALLOC|
-		      GET_VMLIST_COUNT|GET_VMLIST|VMLIST_VERIFY))) {
-			fprintf(fp, "%s  ", 
-			    mkstring(buf1, MAX(strlen("VMAP_AREA"), VADDR_PRLEN),
-			    	CENTER|LJUST, "VMAP_AREA"));
-			fprintf(fp, "%s  ", 
-			    mkstring(buf1, MAX(strlen("VM_STRUCT"), VADDR_PRLEN),
-			    	CENTER|LJUST, "VM_STRUCT"));
-			fprintf(fp, "%s     SIZE\n",
-			    mkstring(buf1, (VADDR_PRLEN * 2) + strlen(" - "),
-				CENTER|LJUST, "ADDRESS RANGE"));
-			pc->curcmd_flags |= HEADER_PRINTED;
-		}
+	if (!(vmap_area_index.entries = (struct vmap_area_entry *)
+	    malloc(sizeof(struct vmap_area_entry) * MAX(cnt, 1)))) {
+		FREEBUF(ld->list_ptr);
+		error(WARNING, "cannot malloc vmap_area index\n");
+		return FALSE;
+	}
+
+	vmap_area_buf = GETBUF(SIZE(vmap_area));
+	vmap_area_index.sorted = TRUE;
 
+	for (i = 0; i < cnt; i++) {
 		readmem(ld->list_ptr[i], KVADDR, vmap_area_buf,
                         SIZE(vmap_area), "vmap_area struct", FAULT_ON_ERROR); 
 
@@ -8961,9 +12715,106 @@ dump_vmap_area(struct meminfo *vi)
 			if (!vm)
 				continue;
 		}
-		start = ULONG(vmap_area_buf + OFFSET(vmap_area_va_start));
-		end = ULONG(vmap_area_buf + OFFSET(vmap_area_va_end));
-		vm_struct = ULONG(vmap_area_buf + OFFSET(vmap_area_vm));
+
+		ent = &vmap_area_index.entries[vmap_area_index.count];
+		ent->vmap_area = ld->list_ptr[i];
+		ent->vm_struct = ULONG(vmap_area_buf + OFFSET(vmap_area_vm));
+		ent->start = ULONG(vmap_area_buf + OFFSET(vmap_area_va_start));
+		ent->end = ULONG(vmap_area_buf + OFFSET(vmap_area_va_end));
+
+		if (vmap_area_index.count && (ent->start < (ent-1)->end))
+			vmap_area_index.sorted = FALSE;
+		vmap_area_index.count++;
+	}
+
+	FREEBUF(vmap_area_buf);
+	FREEBUF(ld->list_ptr);
+
+	vmap_area_index.loaded = TRUE;
+	vmap_area_index.cmdgen = pc->cmdgencur;
+
+	return TRUE;
+}
+
+/*
+ *  Binary-search a sorted index for the vmap_area entry containing vaddr,
+ *  returning its index, or the count of entries if there is none.
+ */
+static int
+vmap_area_index_search(ulong vaddr)
+{
+	int lo, hi, mid;
+	struct vmap_area_entry *ent;
+
+	lo = 0;
+	hi = vmap_area_index.count - 1;
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		ent = &vmap_area_index.entries[mid];
+		if (vaddr < ent->start)
+			hi = mid - 1;
+		else if (vaddr >= ent->end)
+			lo = mid + 1;
+		else
+			return mid;
+	}
+
+	return vmap_area_index.count;
+}
+
+static void
+dump_vmap_area(struct meminfo *vi)
+{
+	int i, cnt;
+	ulong start, end, vm_struct;
+	ulong size, pcheck, count, verified; 
+	physaddr_t paddr;
+	struct vmap_area_entry *ent;
+	char buf1[BUFSIZE];
+	char buf2[BUFSIZE];
+	char buf3[BUFSIZE];
+	char buf4[BUFSIZE];
+
+	start = count = verified = size = 0;
+
+	if (!vmap_area_index_load()) {
+		vi->retval = 0;
+		return;
+	}
+
+	cnt = vmap_area_index.count;
+
+	if (!(pc->curcmd_flags & HEADER_PRINTED) && cnt &&
+	    !(vi->flags & (GET_HIGHEST|GET_PHYS_TO_VMALLOC|
+	      GET_VMLIST_COUNT|GET_VMLIST|VMLIST_VERIFY))) {
+		fprintf(fp, "%s  ",
+		    mkstring(buf1, MAX(strlen("VMAP_AREA"), VADDR_PRLEN),
+		    	CENTER|LJUST, "VMAP_AREA"));
+		fprintf(fp, "%s  ",
+		    mkstring(buf1, MAX(strlen("VM_STRUCT"), VADDR_PRLEN),
+		    	CENTER|LJUST, "VM_STRUCT"));
+		fprintf(fp, "%s     SIZE\n",
+		    mkstring(buf1, (VADDR_PRLEN * 2) + strlen(" - "),
+			CENTER|LJUST, "ADDRESS RANGE"));
+		pc->curcmd_flags |= HEADER_PRINTED;
+	}
+
+	/*
+	 *  A virtual address can only be in the area found by the index.
+	 */
+	i = 0;
+	if ((vi->flags & ADDRESS_SPECIFIED) && (vi->memtype == KVADDR) &&
+	    !(vi->flags & (GET_HIGHEST|GET_VMLIST_COUNT|GET_VMLIST)) &&
+	    vmap_area_index.sorted) {
+		i = vmap_area_index_search(vi->spec_addr);
+		cnt = MIN(i + 1, cnt);
+	}
+
+	for ( ; i < cnt; i++) {
+		ent = &vmap_area_index.entries[i];
+		start = ent->start;
+		end = ent->end;
+		vm_struct = ent->vm_struct;
 
 		size = end - start;
 
@@ -8990,7 +12841,7 @@ dump_vmap_area(struct meminfo *vi)
 			} 	
 			fprintf(fp, "%s%s  %s%s  %s - %s  %7ld\n",
 				mkstring(buf1,VADDR_PRLEN, LONG_HEX|CENTER|LJUST,
-				MKSTR(ld->list_ptr[i])), space(MINSPACE-1),
+				MKSTR(ent->vmap_area)), space(MINSPACE-1),
 				mkstring(buf2,VADDR_PRLEN, LONG_HEX|CENTER|LJUST,
 				MKSTR(vm_struct)), space(MINSPACE-1),
 				mkstring(buf3, VADDR_PRLEN, LONG_HEX|RJUST,
@@ -9011,14 +12862,13 @@ dump_vmap_area(struct meminfo *vi)
 					if (vi->flags & GET_PHYS_TO_VMALLOC) {
 						vi->retval = pcheck +
 						    PAGEOFFSET(vi->spec_addr);
-						FREEBUF(ld->list_ptr);
 						return;
 				        } else
 						fprintf(fp,
 						"%s%s  %s%s  %s - %s  %7ld\n",
 						mkstring(buf1,VADDR_PRLEN, 
 						LONG_HEX|CENTER|LJUST,
-						MKSTR(ld->list_ptr[i])), 
+						MKSTR(ent->vmap_area)),
 						space(MINSPACE-1),
 						mkstring(buf2, VADDR_PRLEN,
 						LONG_HEX|CENTER|LJUST,
@@ -9035,9 +12885,6 @@ dump_vmap_area(struct meminfo *vi)
 		}
 	}
 
-	FREEBUF(vmap_area_buf);
-	FREEBUF(ld->list_ptr);
-
 	if (vi->flags & GET_HIGHEST)
 		vi->retval = start+size;
 
@@ -9048,6 +12895,106 @@ dump_vmap_area(struct meminfo *vi)
 		vi->retval = verified;
 }
 
+struct vmalloc_caller {
+	ulong caller;
+	ulong areas;
+	ulong size;
+};
+
+static int
+compare_vmalloc_caller(const void *v1, const void *v2)
+{
+	const struct vmalloc_caller *c1, *c2;
+
+	c1 = (const struct vmalloc_caller *)v1;
+	c2 = (const struct vmalloc_caller *)v2;
+
+	if (c1->caller != c2->caller)
+		return c1->caller < c2->caller ? -1 : 1;
+	return 0;
+}
+
+static int
+compare_vmalloc_caller_size(const void *v1, const void *v2)
+{
+	const struct vmalloc_caller *c1, *c2;
+
+	c1 = (const struct vmalloc_caller *)v1;
+	c2 = (const struct vmalloc_caller *)v2;
+
+	if (c1->size != c2->size)
+		return c1->size > c2->size ? -1 : 1;
+	return compare_vmalloc_caller(v1, v2);
+}
+
+/*
+ *  "kmem -v -t": summarize the vmalloc'd areas by the function that
+ *  allocated them, largest total size first.
+ */
+static void
+dump_vmap_area_callers(void)
+{
+	int i, n;
+	ulong caller, areas, total;
+	struct vmalloc_caller *callers;
+	struct vmap_area_entry *ent;
+	char buf1[BUFSIZE];
+	char buf2[BUFSIZE];
+
+	if (!(vt->flags & USE_VMAP_AREA) || INVALID_MEMBER(vm_struct_caller))
+		error(FATAL, "-t requires vmap_area and vm_struct.caller\n");
+
+	if (!vmap_area_index_load())
+		return;
+
+	callers = (struct vmalloc_caller *)GETBUF(sizeof(struct vmalloc_caller) *
+		MAX(vmap_area_index.count, 1));
+
+	for (i = 0; i < vmap_area_index.count; i++) {
+		ent = &vmap_area_index.entries[i];
+		caller = 0;
+		if (ent->vm_struct)
+			readmem(ent->vm_struct + OFFSET(vm_struct_caller),
+				KVADDR, &caller, sizeof(void *),
+				"vm_struct caller", RETURN_ON_ERROR|QUIET);
+		callers[i].caller = caller;
+		callers[i].areas = 1;
+		callers[i].size = ent->end - ent->start;
+	}
+
+	qsort(callers, vmap_area_index.count, sizeof(struct vmalloc_caller),
+		compare_vmalloc_caller);
+
+	for (i = n = 0; i < vmap_area_index.count; i++) {
+		if (n && (callers[n-1].caller == callers[i].caller)) {
+			callers[n-1].areas++;
+			callers[n-1].size += callers[i].size;
+		} else
+			callers[n++] = callers[i];
+	}
+
+	qsort(callers, n, sizeof(struct vmalloc_caller),
+		compare_vmalloc_caller_size);
+
+	fprintf(fp, "%s    AREAS          SIZE  FUNCTION\n",
+		mkstring(buf1, VADDR_PRLEN, CENTER|LJUST, "CALLER"));
+
+	for (i = 0, areas = total = 0; i < n; i++) {
+		fprintf(fp, "%s  %7ld  %12ld  %s\n",
+			mkstring(buf1, VADDR_PRLEN, LONG_HEX|RJUST,
+			MKSTR(callers[i].caller)), callers[i].areas,
+			callers[i].size, callers[i].caller ?
+			value_to_symstr(callers[i].caller, buf2, 0) : "(unknown)");
+		areas += callers[i].areas;
+		total += callers[i].size;
+	}
+
+	fprintf(fp, "%s  %7ld  %12ld\n",
+		mkstring(buf1, VADDR_PRLEN, RJUST, "TOTAL"), areas, total);
+
+	FREEBUF(callers);
+}
+
 
 /*
  *  dump_page_lists() displays information from the active_list,
@@ -9432,20 +13379,190 @@ kmem_cache_list(struct meminfo *mi)
 			}
 	        }
 
-		fprintf(fp, "%lx %s\n", cache, buf);
+		fprintf(fp, "%lx %s\n", cache, buf);
+
+		cache = ULONG(cache_buf + next_offset);
+
+		if (has_cache_chain && (cache == cache_chain))
+			readmem(cache, KVADDR, &cache, sizeof(char *),
+				"cache_chain", FAULT_ON_ERROR);
+
+		if (vt->flags & (PERCPU_KMALLOC_V1|PERCPU_KMALLOC_V2))
+			cache -= next_offset;
+
+        } while (cache != cache_cache);
+
+	FREEBUF(cache_buf);
+}
+
+/*
+ *  Reverse index from pages to the slab caches that own them.  Commands
+ *  such as "bt -F" and "rd -S" ask vaddr_to_kmem_cache() about every
+ *  word that looks like a kernel address, and without the index each
+ *  query reads the page's flags and slab pointer, and then walks the
+ *  cache list to find the cache's name.  The outcome for each page that
+ *  has been looked up, either the cache that owns it or the fact that it
+ *  is not a slab page, is remembered in a set-associative table keyed by
+ *  pfn, and the names of the caches found so far are kept in a separate
+ *  table, so that repeated queries of a page need no memory reads at all.
+ *  The index is built lazily; like the vtop cache, it is flushed by
+ *  writemem(), and on a live system, before each command.
+ */
+#define SLAB_INDEX_SETS (4096)
+#define SLAB_INDEX_WAYS (4)
+
+static struct slab_index {
+	ulong cmdgen;
+	struct slab_index_entry {
+		ulong pfn;		/* page frame number + 1 */
+		int name;		/* names[] index, or -1 if not slab */
+	} entries[SLAB_INDEX_SETS][SLAB_INDEX_WAYS];
+	unsigned char victim[SLAB_INDEX_SETS];
+	struct slab_index_name {
+		ulong cache;
+		char *name;
+	} *names;
+	int count;
+	int avail;
+	ulong hits;
+	ulong misses;
+	ulong flushes;
+} slab_index = { 0 };
+
+static inline int
+slab_index_usable(void)
+{
+	if (!(pc->flags & RUNTIME) || (vt->flags & KMEM_CACHE_UNAVAIL))
+		return FALSE;
+
+	if (ACTIVE() && (slab_index.cmdgen != pc->cmdgencur)) {
+		slab_index_flush();
+		slab_index.cmdgen = pc->cmdgencur;
+	}
+
+	return TRUE;
+}
+
+static struct slab_index_entry *
+slab_index_lookup(ulong pfn)
+{
+	int i;
+	struct slab_index_entry *set;
+
+	set = slab_index.entries[(pfn + 1) & (SLAB_INDEX_SETS-1)];
+
+	for (i = 0; i < SLAB_INDEX_WAYS; i++) {
+		if (set[i].pfn == pfn + 1) {
+			slab_index.hits++;
+			return &set[i];
+		}
+	}
+
+	slab_index.misses++;
+	return NULL;
+}
+
+static void
+slab_index_enter(ulong pfn, int name)
+{
+	ulong index;
+	struct slab_index_entry *ent;
+
+	index = (pfn + 1) & (SLAB_INDEX_SETS-1);
+	ent = &slab_index.entries[index][slab_index.victim[index]];
+	slab_index.victim[index] = (slab_index.victim[index] + 1) %
+		SLAB_INDEX_WAYS;
+
+	ent->pfn = pfn + 1;
+	ent->name = name;
+}
+
+/*
+ *  Same as is_kmem_cache_addr(), but the names of the caches that have
+ *  been found are remembered.  On success, *index is set to the name's
+ *  slab_index.names[] entry, or -1 if it could not be stored.
+ */
+static char *
+slab_index_cache_name(ulong cache, char *buf, int *index)
+{
+	int i;
+	struct slab_index_name *names;
+
+	*index = -1;
 
-		cache = ULONG(cache_buf + next_offset);
+	for (i = 0; i < slab_index.count; i++) {
+		if (slab_index.names[i].cache == cache) {
+			strcpy(buf, slab_index.names[i].name);
+			*index = i;
+			return buf;
+		}
+	}
 
-		if (has_cache_chain && (cache == cache_chain))
-			readmem(cache, KVADDR, &cache, sizeof(char *),
-				"cache_chain", FAULT_ON_ERROR);
+	if (!is_kmem_cache_addr(cache, buf))
+		return NULL;
 
-		if (vt->flags & (PERCPU_KMALLOC_V1|PERCPU_KMALLOC_V2))
-			cache -= next_offset;
+	if (slab_index.count == slab_index.avail) {
+		if (!(names = realloc(slab_index.names,
+		    sizeof(struct slab_index_name) *
+		    (slab_index.avail ? slab_index.avail * 2 : 64))))
+			return buf;
+		slab_index.names = names;
+		slab_index.avail = slab_index.avail ? slab_index.avail * 2 : 64;
+	}
 
-        } while (cache != cache_cache);
+	if (!(slab_index.names[slab_index.count].name = strdup(buf)))
+		return buf;
+	slab_index.names[slab_index.count].cache = cache;
+	*index = slab_index.count++;
 
-	FREEBUF(cache_buf);
+	return buf;
+}
+
+void
+slab_index_flush(void)
+{
+	int i;
+
+	BZERO(slab_index.entries, sizeof(slab_index.entries));
+
+	for (i = 0; i < slab_index.count; i++)
+		free(slab_index.names[i].name);
+	slab_index.count = 0;
+	slab_index.flushes++;
+}
+
+/*
+ *  Display the slab index statistics for "help -m".
+ */
+void
+dump_slab_index(void)
+{
+	int i, j, used, slab;
+	ulong lookups;
+
+	for (i = used = slab = 0; i < SLAB_INDEX_SETS; i++) {
+		for (j = 0; j < SLAB_INDEX_WAYS; j++) {
+			if (slab_index.entries[i][j].pfn) {
+				used++;
+				if (slab_index.entries[i][j].name >= 0)
+					slab++;
+			}
+		}
+	}
+
+	lookups = slab_index.hits + slab_index.misses;
+
+	fprintf(fp, "\n            slab_index:\n");
+	fprintf(fp, "               entries: %d of %d (%d slab pages)\n",
+		used, SLAB_INDEX_SETS * SLAB_INDEX_WAYS, slab);
+	fprintf(fp, "                caches: %d\n", slab_index.count);
+	fprintf(fp, "                  hits: %ld\n", slab_index.hits);
+	fprintf(fp, "                misses: %ld\n", slab_index.misses);
+	fprintf(fp, "              hit rate: %ld%%\n",
+		lookups ? (slab_index.hits * 100) / lookups : 0);
+	fprintf(fp, "               flushes: %ld\n", slab_index.flushes);
+
+	dump_slub_free_cache();
 }
 
 /*
@@ -9457,7 +13574,10 @@ static char *
 vaddr_to_kmem_cache(ulong vaddr, char *buf, int verbose)
 {
 	physaddr_t paddr;
-	ulong page, cache, page_flags;
+	ulong pfn, page, cache, page_flags;
+	int cached, index;
+	struct slab_index_entry *ent;
+	char *p;
 
         if (!kvtop(NULL, vaddr, &paddr, 0)) {
 		if (verbose)
@@ -9467,6 +13587,15 @@ vaddr_to_kmem_cache(ulong vaddr, char *buf, int verbose)
 		return NULL;
 	}
 
+	pfn = (ulong)(paddr >> PAGESHIFT());
+
+	if ((cached = slab_index_usable()) && (ent = slab_index_lookup(pfn))) {
+		if (ent->name < 0)
+			return NULL;
+		strcpy(buf, slab_index.names[ent->name].name);
+		return buf;
+	}
+
 	if (!phys_to_page(paddr, &page)) {
 		if (verbose)
 			error(WARNING, 
@@ -9487,9 +13616,9 @@ vaddr_to_kmem_cache(ulong vaddr, char *buf, int verbose)
 					&page_flags, sizeof(ulong), "page.flags",
 					FAULT_ON_ERROR);
 				if (!(page_flags & (1 << vt->PG_slab)))
-					return NULL;
+					goto not_slab;
 			} else
-				return NULL;
+				goto not_slab;
 		}
 	}
 
@@ -9514,7 +13643,18 @@ vaddr_to_kmem_cache(ulong vaddr, char *buf, int verbose)
 	else
 		error(FATAL, "cannot determine slab cache from page struct\n");
 
-	return(is_kmem_cache_addr(cache, buf)); 
+	if (!cached)
+		return(is_kmem_cache_addr(cache, buf));
+
+	p = slab_index_cache_name(cache, buf, &index);
+	if (!p || (index >= 0))
+		slab_index_enter(pfn, index);
+	return p;
+
+not_slab:
+	if (cached)
+		slab_index_enter(pfn, -1);
+	return NULL;
 }
 
 
@@ -9522,6 +13662,7 @@ static char *
 is_slab_overload_page(ulong vaddr, ulong *page_head, char *buf)
 {
 	ulong cache;
+	int index;
 	char *p;
 
         if ((vt->flags & SLAB_OVERLOAD_PAGE) &&
@@ -9530,7 +13671,10 @@ is_slab_overload_page(ulong vaddr, ulong *page_head, char *buf)
                 readmem(compound_head(vaddr)+OFFSET(page_slab),
                         KVADDR, &cache, sizeof(void *),
                         "page.slab", FAULT_ON_ERROR);
-		p = is_kmem_cache_addr(cache, buf);
+		if (slab_index_usable())
+			p = slab_index_cache_name(cache, buf, &index);
+		else
+			p = is_kmem_cache_addr(cache, buf);
 		if (p)
 			*page_head = compound_head(vaddr);
 		return p;
@@ -10220,10 +14364,34 @@ ignore_cache(struct meminfo *si, char *name)
 #define KMEM_SLAB_FREELIST      (9)
 
 #define DUMP_KMEM_CACHE_TAG(addr, name, tag) \
-	fprintf(fp, "%lx %-43s  %s\n", addr, tag, name)
+	dump_kmem_cache_tag(addr, name, tag)
 
 #define DUMP_KMEM_CACHE_INFO()  dump_kmem_cache_info(si)
 
+/*
+ *  The "kmem -s" cache summaries are displayed as records with "set
+ *  output json|csv"; the slab details of "kmem -S", and the searches for
+ *  an address, keep their text form.
+ */
+#define KMEM_CACHE_RECORDS(si) \
+	(STRUCTURED_OUTPUT() && \
+	 !((si)->flags & (VERBOSE|ADDRESS_SPECIFIED|GET_SLAB_PAGES)))
+
+static void
+dump_kmem_cache_tag(ulong addr, char *name, char *tag)
+{
+	if (STRUCTURED_OUTPUT()) {
+		record_begin("kmem_cache");
+		record_hex("cache", addr);
+		record_string("name", name);
+		record_string("status", tag);
+		record_end();
+		return;
+	}
+
+	fprintf(fp, "%lx %-43s  %s\n", addr, tag, name);
+}
+
 static void
 dump_kmem_cache_info(struct meminfo *si)
 {
@@ -10234,22 +14402,35 @@ dump_kmem_cache_info(struct meminfo *si)
 		error(INFO, "%s: cannot gather relevant slab data\n", si->curname);
 
 	objsize = (vt->flags & KMALLOC_SLUB) ? si->objsize : si->size;
+	allocated = (vt->flags & (PERCPU_KMALLOC_V1|PERCPU_KMALLOC_V2)) ?
+			si->inuse - si->cpucached_cache : si->inuse;
+	total = (vt->flags & KMALLOC_SLUB) ?
+			si->inuse + si->free : si->num_slabs * si->c_num;
+
+	if (KMEM_CACHE_RECORDS(si)) {
+		record_begin("kmem_cache");
+		record_hex("cache", si->cache);
+		record_string("name", si->curname);
+		record_ulong("objsize", objsize);
+		if (!(si->flags & SLAB_GATHER_FAILURE)) {
+			record_ulong("allocated", allocated);
+			record_ulong("total", total);
+			record_ulong("slabs", si->num_slabs);
+		}
+		record_ulong("ssize", si->slabsize);
+		record_end();
+		return;
+	}
 
 	fprintf(fp, "%s %8ld  ",
 		mkstring(b1, VADDR_PRLEN, LJUST|LONG_HEX, MKSTR(si->cache)),
 		objsize);
 
-	if (si->flags & SLAB_GATHER_FAILURE) {
+	if (si->flags & SLAB_GATHER_FAILURE)
 		fprintf(fp, "%9s  %8s  %5s  ", "?", "?", "?");
-	} else {
-		allocated = (vt->flags & (PERCPU_KMALLOC_V1|PERCPU_KMALLOC_V2)) ?
-				si->inuse - si->cpucached_cache : si->inuse;
-		total = (vt->flags & KMALLOC_SLUB) ?
-				si->inuse + si->free : si->num_slabs * si->c_num;
-
+	else
 		fprintf(fp, "%9ld  %8ld  %5ld  ",
 			allocated, total, si->num_slabs);
-	}
 
 	fprintf(fp, "%4ldk  %s\n", si->slabsize/1024, si->curname);
 }
@@ -10296,7 +14477,8 @@ dump_kmem_cache(struct meminfo *si)
 	reqname = NULL;
 
 	if ((!(si->flags & VERBOSE) || si->reqname) &&
-	     !(si->flags & (ADDRESS_SPECIFIED|GET_SLAB_PAGES)))
+	     !(si->flags & (ADDRESS_SPECIFIED|GET_SLAB_PAGES)) &&
+	     !KMEM_CACHE_RECORDS(si))
 		fprintf(fp, "%s", kmem_cache_hdr);
 
 	si->addrlist = (ulong *)GETBUF((vt->kmem_max_c_num+1) * sizeof(ulong));
@@ -10504,7 +14686,8 @@ dump_kmem_cache_percpu_v1(struct meminfo *si)
 	reqname = NULL;
 
 	if ((!(si->flags & VERBOSE) || si->reqname) &&
-	     !(si->flags & (ADDRESS_SPECIFIED|GET_SLAB_PAGES)))
+	     !(si->flags & (ADDRESS_SPECIFIED|GET_SLAB_PAGES)) &&
+	     !KMEM_CACHE_RECORDS(si))
 		fprintf(fp, "%s", kmem_cache_hdr);
 
 	si->addrlist = (ulong *)GETBUF((vt->kmem_max_c_num+1) * sizeof(ulong));
@@ -10724,7 +14907,8 @@ dump_kmem_cache_percpu_v2(struct meminfo *si)
 	reqname = NULL;
 
 	if ((!(si->flags & VERBOSE) || si->reqname) &&
-	     !(si->flags & (ADDRESS_SPECIFIED|GET_SLAB_PAGES)))
+	     !(si->flags & (ADDRESS_SPECIFIED|GET_SLAB_PAGES)) &&
+	     !KMEM_CACHE_RECORDS(si))
 		fprintf(fp, "%s", kmem_cache_hdr);
 
 	si->addrlist = (ulong *)GETBUF((vt->kmem_max_c_num+1) * sizeof(ulong));
@@ -13587,6 +17771,8 @@ mem_map:
 	if (!mi->retval)
 		fprintf(fp, "%llx: %s address not found in mem map\n", 
 			mi->spec_addr, memtype_string(mi->memtype, 0));
+	else if (mi->memtype == PHYSADDR)
+		rmap_index_annotate(mi->spec_addr);
 }
 
 int
@@ -13936,6 +18122,9 @@ dump_vm_table(int verbose)
 	fprintf(fp, "            mem_sec: %lx\n", (ulong)vt->mem_sec);
 	fprintf(fp, "        mem_section: %lx\n", (ulong)vt->mem_section);
 	fprintf(fp, " max_mem_section_nr: %ld\n", (ulong)vt->max_mem_section_nr);
+	fprintf(fp, "   mem_section_maps: %lx\n", (ulong)vt->mem_section_maps);
+	fprintf(fp, " mem_section_cmdgen: %ld\n", vt->mem_section_cmdgen);
+	fprintf(fp, "mem_section_memo_nr: %ld\n", vt->mem_section_memo_nr);
 	fprintf(fp, "       ZONE_HIGHMEM: %d\n", vt->ZONE_HIGHMEM);
 	fprintf(fp, "node_online_map_len: %d\n", vt->node_online_map_len);
 	if (vt->node_online_map_len) {
@@ -13976,6 +18165,11 @@ dump_vm_table(int verbose)
 			vt->pageflags_data[i].name);
 	}
 
+	fprintf(fp, "     mm_usage_cache: entries: %ld hits: %ld misses: %ld\n",
+		mm_usage_cache.entries, mm_usage_cache.hits,
+		mm_usage_cache.misses);
+	dump_zram_cache_stats();
+
 	dump_vma_cache(VERBOSE);
 }
 
@@ -14032,6 +18226,15 @@ dump_vma_cache(ulong verbose)
         fprintf(fp, "          vma_cache: %lx\n", (ulong)vt->vma_cache);
         fprintf(fp, "    vma_cache_index: %d\n", vt->vma_cache_index);
         fprintf(fp, "    vma_cache_fills: %ld\n", vt->vma_cache_fills);
+	for (i = 0; i < VMA_SNAPSHOTS; i++)
+		if (vma_snapshots.snapshots[i].mm)
+			fprintf(fp, "    vma_snapshot[%d]: mm: %lx vmas: %d%s\n",
+				i, vma_snapshots.snapshots[i].mm,
+				vma_snapshots.snapshots[i].count,
+				vma_snapshots.snapshots[i].entries ?
+				"" : " (unusable)");
+	fprintf(fp, "  vma_snapshot_hits: %ld\n", vma_snapshots.hits);
+	fprintf(fp, "vma_snapshot_builds: %ld\n", vma_snapshots.builds);
 	fflush(fp);
 
 show_hits:
@@ -14135,10 +18338,19 @@ address_space_start(struct task_context *tc, ulong *addr)
 {
         ulong vma;
         char *vma_buf;
+	struct vma_snapshot *snap;
 
         if (!tc->mm_struct)
                 return FALSE;
 
+	if ((snap = get_vma_snapshot(tc->mm_struct))) {
+		if (!snap->count)
+			return FALSE;
+		*addr = snap->entries[0].start;
+		return TRUE;
+	} else if (VMA_MAPLE_TREE())
+		return FALSE;
+
         fill_mm_struct(tc->mm_struct);
         vma = ULONG(tt->mm_struct + OFFSET(mm_struct_mmap));
         if (!vma)
@@ -14240,7 +18452,7 @@ cmd_search(void)
 
 	searchinfo.mode = SEARCH_ULONG;	/* default search */
 
-        while ((c = getopt(argcnt, args, "Ttl:ukKVps:e:v:m:hwcx:")) != EOF) {
+        while ((c = getopt(argcnt, args, "Ttl:ukKVps:e:v:m:hwcx:j:")) != EOF) {
                 switch(c)
                 {
 		case 'u':
@@ -14345,6 +18557,16 @@ cmd_search(void)
 			context = dtoi(optarg, FAULT_ON_ERROR, NULL);
 			break;
 
+		case 'j':
+			searchinfo.threads = dtoi(optarg, FAULT_ON_ERROR, NULL);
+			if (searchinfo.threads < 1)
+				error(FATAL, "invalid thread count: %s\n", optarg);
+			if (searchinfo.threads > MAX_PARALLEL_THREADS)
+				error(FATAL, 
+				    "thread count %d is too large: maximum is %d\n",
+					searchinfo.threads, MAX_PARALLEL_THREADS);
+			break;
+
 		case 'T':
 		case 't':
 			if (XEN_HYPER_MODE())
@@ -14544,6 +18766,9 @@ cmd_search(void)
 
 		searchinfo.context = context;
 	}
+
+	if ((searchinfo.threads > 1) && (searchinfo.mode == SEARCH_CHARS))
+		error(FATAL, "-j option is not allowed with -c\n");
 		
 	searchinfo.vcnt = 0; 
 	searchinfo.val = UNUSED;
@@ -14643,6 +18868,11 @@ cmd_search(void)
 			break;
 		}
 
+		if ((tflag || Tflag) && (searchinfo.threads > 1)) {
+			search_task_stacks(&searchinfo, Tflag);
+			break;
+		}
+
 		if (tflag || Tflag) {
 			searchinfo.tasks_found = 0;
 			tc = FIRST_CONTEXT();
@@ -14801,12 +19031,68 @@ display_with_pre_and_post(void *bufptr, ulonglong addr, struct searchinfo *si)
 	fprintf(fp, "\n");
 }
 
+/*
+ *  Nearly all of the memory being searched contains none of the search
+ *  values, so each search buffer is first checked in SEARCH_BLOCK-entry
+ *  blocks for any (masked) match at all, and only the blocks that have
+ *  one are gone through entry by entry to report the matches in order.
+ *  The block checks consist of branch-free loops over a fixed value,
+ *  which the compiler turns into vector compares where the target
+ *  architecture has them.
+ */
+#define SEARCH_BLOCK (64)
+
+#define DEFINE_SEARCH_BLOCK_MATCH(NAME, TYPE)				\
+static int								\
+NAME(TYPE *ptr, int cnt, TYPE mask, TYPE *value, int vcnt)		\
+{									\
+	int i, j;							\
+	TYPE target;							\
+	int hit;							\
+									\
+	for (j = 0; j < vcnt; j++) {					\
+		target = value[j] | mask;				\
+		for (i = hit = 0; i < cnt; i++)				\
+			hit |= ((ptr[i] | mask) == target);		\
+		if (hit)						\
+			return TRUE;					\
+	}								\
+	return FALSE;							\
+}
+
+DEFINE_SEARCH_BLOCK_MATCH(search_block_ulong, ulong)
+DEFINE_SEARCH_BLOCK_MATCH(search_block_uint, uint)
+DEFINE_SEARCH_BLOCK_MATCH(search_block_ushort, ushort)
+
+/*
+ *  Return the number of leading entries of a cnt-entry buffer that can be
+ *  skipped because their SEARCH_BLOCK-sized blocks contain no match.
+ */
+#define SEARCH_SKIP(BLOCK_MATCH, PTR, CNT, MASK, VALUE, VCNT)		\
+({									\
+	int __skip, __n;						\
+	for (__skip = 0; __skip < (CNT); __skip += __n) {		\
+		__n = MIN(SEARCH_BLOCK, (CNT) - __skip);		\
+		if (BLOCK_MATCH((PTR) + __skip, __n, MASK, VALUE, VCNT))\
+			break;						\
+	}								\
+	__skip;								\
+})
+
 static ulong
 search_ulong(ulong *bufptr, ulong addr, int longcnt, struct searchinfo *si)
 {
-	int i;
+	int i, skip;
 	ulong mask = si->s_parms.s_ulong.mask;
 	for (i = 0; i < longcnt; i++, bufptr++, addr += sizeof(long)) {
+		if (!(i % SEARCH_BLOCK) && (skip = SEARCH_SKIP(search_block_ulong,
+		    bufptr, longcnt - i, mask, si->s_parms.s_ulong.value,
+		    si->vcnt))) {
+			i += skip - 1;
+			bufptr += skip - 1;
+			addr += (skip - 1) * sizeof(long);
+			continue;
+		}
 		for (si->val = 0; si->val < si->vcnt; si->val++) {
 			if (SEARCHMASK(*bufptr) == 
 			    SEARCHMASK(si->s_parms.s_ulong.value[si->val])) {
@@ -14831,9 +19117,17 @@ search_ulong(ulong *bufptr, ulong addr, int longcnt, struct searchinfo *si)
 static ulonglong
 search_ulong_p(ulong *bufptr, ulonglong addr, int longcnt, struct searchinfo *si)
 {
-	int i;
+	int i, skip;
 	ulong mask = si->s_parms.s_ulong.mask;
 	for (i = 0; i < longcnt; i++, bufptr++, addr += sizeof(long)) {
+		if (!(i % SEARCH_BLOCK) && (skip = SEARCH_SKIP(search_block_ulong,
+		    bufptr, longcnt - i, mask, si->s_parms.s_ulong.value,
+		    si->vcnt))) {
+			i += skip - 1;
+			bufptr += skip - 1;
+			addr += (skip - 1) * sizeof(long);
+			continue;
+		}
 		for (si->val = 0; si->val < si->vcnt; si->val++) {
 			if (SEARCHMASK(*bufptr) == 
 			    SEARCHMASK(si->s_parms.s_ulong.value[si->val])) {
@@ -14851,12 +19145,19 @@ search_ulong_p(ulong *bufptr, ulonglong addr, int longcnt, struct searchinfo *si
 static ulong
 search_uint(ulong *bufptr, ulong addr, int longcnt, struct searchinfo *si)
 {
-	int i;
+	int i, skip;
 	int cnt = longcnt * (sizeof(long)/sizeof(int));
 	uint *ptr = (uint *)bufptr;
 	uint mask = si->s_parms.s_uint.mask;
 
 	for (i = 0; i < cnt; i++, ptr++, addr += sizeof(int)) {
+		if (!(i % SEARCH_BLOCK) && (skip = SEARCH_SKIP(search_block_uint,
+		    ptr, cnt - i, mask, si->s_parms.s_uint.value, si->vcnt))) {
+			i += skip - 1;
+			ptr += skip - 1;
+			addr += (skip - 1) * sizeof(int);
+			continue;
+		}
 		for (si->val = 0; si->val < si->vcnt; si->val++) {
 			if (SEARCHMASK(*ptr) == 
 			    SEARCHMASK(si->s_parms.s_uint.value[si->val])) {
@@ -14881,12 +19182,19 @@ search_uint(ulong *bufptr, ulong addr, int longcnt, struct searchinfo *si)
 static ulonglong
 search_uint_p(ulong *bufptr, ulonglong addr, int longcnt, struct searchinfo *si)
 {
-	int i;
+	int i, skip;
 	int cnt = longcnt * (sizeof(long)/sizeof(int));
 	uint *ptr = (uint *)bufptr;
 	uint mask = si->s_parms.s_uint.mask;
 
 	for (i = 0; i < cnt; i++, ptr++, addr += sizeof(int)) {
+		if (!(i % SEARCH_BLOCK) && (skip = SEARCH_SKIP(search_block_uint,
+		    ptr, cnt - i, mask, si->s_parms.s_uint.value, si->vcnt))) {
+			i += skip - 1;
+			ptr += skip - 1;
+			addr += (skip - 1) * sizeof(int);
+			continue;
+		}
 		for (si->val = 0; si->val < si->vcnt; si->val++) {
 			if (SEARCHMASK(*ptr) == 
 			    SEARCHMASK(si->s_parms.s_uint.value[si->val])) {
@@ -14904,12 +19212,19 @@ search_uint_p(ulong *bufptr, ulonglong addr, int longcnt, struct searchinfo *si)
 static ulong
 search_ushort(ulong *bufptr, ulong addr, int longcnt, struct searchinfo *si)
 {
-	int i;
+	int i, skip;
 	int cnt = longcnt * (sizeof(long)/sizeof(short));
 	ushort *ptr = (ushort *)bufptr;
 	ushort mask = si->s_parms.s_ushort.mask;
 
 	for (i = 0; i < cnt; i++, ptr++, addr += sizeof(short)) {
+		if (!(i % SEARCH_BLOCK) && (skip = SEARCH_SKIP(search_block_ushort,
+		    ptr, cnt - i, mask, si->s_parms.s_ushort.value, si->vcnt))) {
+			i += skip - 1;
+			ptr += skip - 1;
+			addr += (skip - 1) * sizeof(short);
+			continue;
+		}
 		for (si->val = 0; si->val < si->vcnt; si->val++) {
 			if (SEARCHMASK(*ptr) == 
 			    SEARCHMASK(si->s_parms.s_ushort.value[si->val])) {
@@ -14934,12 +19249,19 @@ search_ushort(ulong *bufptr, ulong addr, int longcnt, struct searchinfo *si)
 static ulonglong
 search_ushort_p(ulong *bufptr, ulonglong addr, int longcnt, struct searchinfo *si)
 {
-	int i;
+	int i, skip;
 	int cnt = longcnt * (sizeof(long)/sizeof(short));
 	ushort *ptr = (ushort *)bufptr;
 	ushort mask = si->s_parms.s_ushort.mask;
 
 	for (i = 0; i < cnt; i++, ptr++, addr += sizeof(short)) {
+		if (!(i % SEARCH_BLOCK) && (skip = SEARCH_SKIP(search_block_ushort,
+		    ptr, cnt - i, mask, si->s_parms.s_ushort.value, si->vcnt))) {
+			i += skip - 1;
+			ptr += skip - 1;
+			addr += (skip - 1) * sizeof(short);
+			continue;
+		}
 		for (si->val = 0; si->val < si->vcnt; si->val++) {
 			if (SEARCHMASK(*ptr) == 
 			    SEARCHMASK(si->s_parms.s_ushort.value[si->val])) {
@@ -15010,6 +19332,7 @@ search_chars(ulong *bufptr, ulong addr, int longcnt, struct searchinfo *si)
 	char *target;
 	int charcnt = longcnt * sizeof(long);
 	char *ptr = (char *)bufptr;
+	char first_char[256];	/* first characters of the targets */
 
 	/* is this the first page of this search? */
 	if (si->s_parms.s_chars.started_flag == 0) {
@@ -15039,8 +19362,10 @@ search_chars(ulong *bufptr, ulong addr, int longcnt, struct searchinfo *si)
 
 	/* set up for possible cross matches on this page */
 	cross_match_next_addr = addr + charcnt;
+	BZERO(first_char, sizeof(first_char));
 	for (j = 0; j < si->vcnt; j++) {
 		len = si->s_parms.s_chars.len[j];
+		first_char[(unsigned char)si->s_parms.s_chars.value[j][0]] = TRUE;
 		cross[j].cnt = 0;
 		cross[j].addr = addr + longcnt * sizeof(long) - (len - 1);
 		for (i = 0; i < len - 1; i++) 
@@ -15048,6 +19373,8 @@ search_chars(ulong *bufptr, ulong addr, int longcnt, struct searchinfo *si)
 	}
 	
 	for (i = 0; i < charcnt; i++, ptr++, addr++) {
+		if (!first_char[(unsigned char)*ptr])
+			continue;
 		for (j = 0; j < si->vcnt; j++) {
 			target = si->s_parms.s_chars.value[j];
 			len = si->s_parms.s_chars.len[j];
@@ -15099,6 +19426,7 @@ search_chars_p(ulong *bufptr, ulonglong addr_p, int longcnt, struct searchinfo *
 	char *target;
 	int charcnt = longcnt * sizeof(long);
 	char *ptr = (char *)bufptr;
+	char first_char[256];	/* first characters of the targets */
 
 	/* is this the first page of this search? */
 	if (si->s_parms.s_chars.started_flag == 0) {
@@ -15128,8 +19456,10 @@ search_chars_p(ulong *bufptr, ulonglong addr_p, int longcnt, struct searchinfo *
 
 	/* set up for possible cross matches on this page */
 	cross_match_next_addr_p = addr_p + charcnt;
+	BZERO(first_char, sizeof(first_char));
 	for (j = 0; j < si->vcnt; j++) {
 		len = si->s_parms.s_chars.len[j];
+		first_char[(unsigned char)si->s_parms.s_chars.value[j][0]] = TRUE;
 		cross[j].cnt = 0;
 		cross[j].addr_p = addr_p + longcnt * sizeof(long) - (len - 1);
 		for (i = 0; i < len - 1; i++) 
@@ -15137,6 +19467,8 @@ search_chars_p(ulong *bufptr, ulonglong addr_p, int longcnt, struct searchinfo *
 	}
 	
 	for (i = 0; i < charcnt; i++, ptr++, addr_p++) {
+		if (!first_char[(unsigned char)*ptr])
+			continue;
 		for (j = 0; j < si->vcnt; j++) {
 			target = si->s_parms.s_chars.value[j];
 			len = si->s_parms.s_chars.len[j];
@@ -15159,6 +19491,218 @@ search_chars_p(ulong *bufptr, ulonglong addr_p, int longcnt, struct searchinfo *
 	return addr_p;
 }
 
+/*
+ *  For "search -j", the pages are collected in batches whose pages are
+ *  then checked for matches by run_parallel() threads.  If the dumpfile
+ *  supports readmem_ctx(), the threads read the pages as well, and the
+ *  command only translates the page addresses; otherwise the command
+ *  reads the pages itself.  The pages that contain a match are then
+ *  searched in address order in the command's own context, so that the
+ *  output is exactly that of a serial search.
+ */
+#define SEARCH_BATCH_PAGES (256)
+
+struct search_batch {
+	struct searchinfo *si;
+	char *pagebuf;		/* SEARCH_BATCH_PAGES pages */
+	int count;
+	ulong read_errors;	/* of pages read by the threads */
+	struct readmem_context *ctx[MAX_PARALLEL_THREADS];
+	struct search_batch_page {
+		ulong *ubp;
+		ulonglong addr;
+		physaddr_t paddr;	/* to be read by the threads */
+		int wordcnt;
+		int unread;
+		int hit;
+		struct task_context *tc;	/* search -t|-T stack page */
+	} pages[SEARCH_BATCH_PAGES];
+	struct task_context *tc;	/* of the pages being added */
+	struct task_context *last_tc;	/* of the last page with a match */
+};
+
+static struct search_batch *
+search_batch_alloc(struct searchinfo *si)
+{
+	int i;
+	struct search_batch *batch;
+
+	batch = (struct search_batch *)GETBUF(sizeof(struct search_batch));
+	batch->si = si;
+	batch->pagebuf = GETBUF(SEARCH_BATCH_PAGES * PAGESIZE());
+
+	if (XEN_HYPER_MODE())
+		return batch;
+
+	for (i = 0; i < si->threads; i++) {
+		if (!(batch->ctx[i] = readmem_context_alloc())) {
+			while (i--) {
+				readmem_context_free(batch->ctx[i]);
+				batch->ctx[i] = NULL;
+			}
+			break;
+		}
+	}
+
+	if (CRASHDEBUG(1))
+		fprintf(fp, "search: pages read by %s\n",
+			batch->ctx[0] ? "the search threads" : "the command");
+
+	return batch;
+}
+
+static void
+search_batch_free(struct search_batch *batch)
+{
+	int i;
+
+	for (i = 0; i < MAX_PARALLEL_THREADS; i++)
+		readmem_context_free(batch->ctx[i]);
+	FREEBUF(batch->pagebuf);
+	FREEBUF(batch);
+}
+
+/*
+ *  Whether the search threads are to read the pages of the batch.
+ */
+static int
+search_batch_reads(struct search_batch *batch)
+{
+	return batch->ctx[0] ? TRUE : FALSE;
+}
+
+/*
+ *  Return the buffer that the next page of a batch should be read into.
+ */
+static char *
+search_batch_pagebuf(struct search_batch *batch)
+{
+	return batch->pagebuf + (batch->count * PAGESIZE());
+}
+
+/*
+ *  run_parallel() job: read a batched page if necessary, and determine
+ *  whether it contains a match.
+ */
+static void
+search_batch_scan(void *arg, int job, int thread)
+{
+	struct search_batch *batch = arg;
+	struct search_batch_page *sbp = &batch->pages[job];
+	struct searchinfo *si = batch->si;
+
+	if (sbp->unread) {
+		if (!readmem_ctx(batch->ctx[thread], sbp->paddr,
+		    batch->pagebuf + (job * PAGESIZE()), PAGESIZE())) {
+			sbp->hit = FALSE;
+			return;
+		}
+		sbp->unread = FALSE;
+	}
+
+	switch (si->mode)
+	{
+	case SEARCH_ULONG:
+		sbp->hit = search_block_ulong(sbp->ubp, sbp->wordcnt,
+			si->s_parms.s_ulong.mask, si->s_parms.s_ulong.value,
+			si->vcnt);
+		break;
+	case SEARCH_UINT:
+		sbp->hit = search_block_uint((uint *)sbp->ubp,
+			sbp->wordcnt * (sizeof(long)/sizeof(int)),
+			si->s_parms.s_uint.mask, si->s_parms.s_uint.value,
+			si->vcnt);
+		break;
+	case SEARCH_USHORT:
+		sbp->hit = search_block_ushort((ushort *)sbp->ubp,
+			sbp->wordcnt * (sizeof(long)/sizeof(short)),
+			si->s_parms.s_ushort.mask, si->s_parms.s_ushort.value,
+			si->vcnt);
+		break;
+	default:
+		sbp->hit = FALSE;
+		break;
+	}
+}
+
+/*
+ *  Check all pages of a batch in parallel, and then search the ones
+ *  that contain a match.
+ */
+static void
+search_batch_flush(struct search_batch *batch, int physical)
+{
+	int i;
+	struct search_batch_page *sbp;
+	struct searchinfo *si = batch->si;
+
+	run_parallel(si->threads, batch->count, search_batch_scan, batch);
+
+	for (i = 0; i < batch->count; i++) {
+		sbp = &batch->pages[i];
+		if (sbp->unread)
+			batch->read_errors++;
+		if (!sbp->hit)
+			continue;
+
+		if (sbp->tc && (sbp->tc != batch->last_tc)) {
+			si->task_context = sbp->tc;
+			si->do_task_header = TRUE;
+			batch->last_tc = sbp->tc;
+		}
+
+		switch (si->mode)
+		{
+		case SEARCH_ULONG:
+			if (physical)
+				search_ulong_p(sbp->ubp, sbp->addr, sbp->wordcnt, si);
+			else
+				search_ulong(sbp->ubp, (ulong)sbp->addr, 
+					sbp->wordcnt, si);
+			break;
+		case SEARCH_UINT:
+			if (physical)
+				search_uint_p(sbp->ubp, sbp->addr, sbp->wordcnt, si);
+			else
+				search_uint(sbp->ubp, (ulong)sbp->addr, 
+					sbp->wordcnt, si);
+			break;
+		case SEARCH_USHORT:
+			if (physical)
+				search_ushort_p(sbp->ubp, sbp->addr, sbp->wordcnt, si);
+			else
+				search_ushort(sbp->ubp, (ulong)sbp->addr, 
+					sbp->wordcnt, si);
+			break;
+		}
+	}
+
+	batch->count = 0;
+}
+
+/*
+ *  Add a page to a batch, flushing the batch when it is full.  The page
+ *  has either been read into search_batch_pagebuf() already, or, if
+ *  search_batch_reads(), is to be read from paddr by the threads.
+ */
+static void
+search_batch_add(struct search_batch *batch, ulong *ubp, ulonglong addr,
+		 physaddr_t paddr, int wordcnt, int physical)
+{
+	struct search_batch_page *sbp;
+
+	sbp = &batch->pages[batch->count++];
+	sbp->ubp = ubp;
+	sbp->addr = addr;
+	sbp->paddr = paddr;
+	sbp->unread = search_batch_reads(batch);
+	sbp->wordcnt = wordcnt;
+	sbp->tc = batch->tc;
+
+	if (batch->count == SEARCH_BATCH_PAGES)
+		search_batch_flush(batch, physical);
+}
+
 static void
 search_virtual(struct searchinfo *si)
 {
@@ -15167,9 +19711,10 @@ search_virtual(struct searchinfo *si)
 	int wordcnt, lastpage;
 	ulong page;
 	physaddr_t paddr; 
-	char *pagebuf;
+	char *pagebuf, *buf;
 	ulong pct, pages_read, pages_checked;
 	time_t begin, finish;
+	struct search_batch *batch;
 
 	start = si->vaddr_start;
 	end = si->vaddr_end;
@@ -15177,6 +19722,7 @@ search_virtual(struct searchinfo *si)
 	begin = finish = 0;
 
 	pagebuf = GETBUF(PAGESIZE());
+	batch = (si->threads > 1) ? search_batch_alloc(si) : NULL;
 
 	if (start & (sizeof(long)-1)) {
 		start &= ~(sizeof(long)-1);
@@ -15196,12 +19742,13 @@ search_virtual(struct searchinfo *si)
 		lastpage = (VIRTPAGEBASE(next) == VIRTPAGEBASE(end));
 		if (LKCD_DUMPFILE())
 			set_lkcd_nohash();
+		buf = batch ? search_batch_pagebuf(batch) : pagebuf;
 
 		/*
 		 *  Keep it virtual for Xen hypervisor.
 		 */
 		if (XEN_HYPER_MODE()) {
-                	if (!readmem(pp, KVADDR, pagebuf, PAGESIZE(),
+                	if (!readmem(pp, KVADDR, buf, PAGESIZE(),
                     	    "search page", RETURN_ON_ERROR|QUIET)) {
 				if (CRASHDEBUG(1))
 					fprintf(fp, 
@@ -15232,7 +19779,10 @@ search_virtual(struct searchinfo *si)
                         break;
                 }
 
-                if (!readmem(paddr, PHYSADDR, pagebuf, PAGESIZE(),
+		if (batch && search_batch_reads(batch))
+			goto virtual;
+
+                if (!readmem(paddr, PHYSADDR, buf, PAGESIZE(),
                     "search page", RETURN_ON_ERROR|QUIET)) {
 			pp += PAGESIZE();
 			continue;
@@ -15240,7 +19790,7 @@ search_virtual(struct searchinfo *si)
 virtual:
 		pages_read++;
 
-		ubp = (ulong *)&pagebuf[next - pp];
+		ubp = (ulong *)&buf[next - pp];
 		if (lastpage) {
 			if (end == (ulong)(-1))
 				wordcnt = PAGESIZE()/sizeof(long);
@@ -15249,7 +19799,9 @@ virtual:
 		} else
 			wordcnt = (PAGESIZE() - (next - pp))/sizeof(long);
 
-		switch (si->mode)
+		if (batch)
+			search_batch_add(batch, ubp, next, paddr, wordcnt, FALSE);
+		else switch (si->mode)
 		{
 		case SEARCH_ULONG:
 			next = search_ulong(ubp, next, wordcnt, si);
@@ -15277,6 +19829,12 @@ virtual:
 	}
 
 done:
+	if (batch) {
+		search_batch_flush(batch, FALSE);
+		pages_read -= batch->read_errors;
+		search_batch_free(batch);
+	}
+
 	if (CRASHDEBUG(1)) {
 		finish = time(NULL);
 		pct = (pages_read * 100)/pages_checked;
@@ -15288,6 +19846,65 @@ done:
 	FREEBUF(pagebuf);
 }
 
+/*
+ *  "search -t|-T -j": rather than searching one kernel stack at a time,
+ *  the stack pages of all tasks are added to the same batch, so that the
+ *  threads can check the pages of many tasks at once.  Each page carries
+ *  its task, whose header is displayed in front of the first match in
+ *  its stack, so the output is in task order, and then in address order,
+ *  just as that of a serial search.
+ */
+static void
+search_task_stacks(struct searchinfo *si, int active_only)
+{
+	ulong i, pp, top;
+	int wordcnt;
+	physaddr_t paddr;
+	char *buf;
+	struct task_context *tc;
+	struct search_batch *batch;
+
+	batch = search_batch_alloc(si);
+	si->tasks_found = 0;
+
+	tc = FIRST_CONTEXT();
+	for (i = 0; i < RUNNING_TASKS(); i++, tc++) {
+		if (active_only && !is_task_active(tc->task))
+			continue;
+
+		batch->tc = tc;
+		top = GET_STACKTOP(tc->task);
+
+		for (pp = GET_STACKBASE(tc->task); pp < top; pp += PAGESIZE()) {
+			if (LKCD_DUMPFILE())
+				set_lkcd_nohash();
+			if (!kvtop(CURRENT_CONTEXT(), pp, &paddr, 0))
+				continue;
+
+			buf = search_batch_pagebuf(batch);
+			if (!search_batch_reads(batch) &&
+			    !readmem(paddr, PHYSADDR, buf, PAGESIZE(),
+			    "search page", RETURN_ON_ERROR|QUIET))
+				continue;
+
+			if ((top - pp) < PAGESIZE())
+				wordcnt = (top - pp)/sizeof(long);
+			else
+				wordcnt = PAGESIZE()/sizeof(long);
+
+			search_batch_add(batch, (ulong *)buf, pp, paddr,
+				wordcnt, FALSE);
+		}
+	}
+
+	search_batch_flush(batch, FALSE);
+
+	if (CRASHDEBUG(1))
+		fprintf(fp, "search_task_stacks: %ld stack page read errors\n",
+			batch->read_errors);
+
+	search_batch_free(batch);
+}
 
 static void
 search_physical(struct searchinfo *si)
@@ -15296,10 +19913,12 @@ search_physical(struct searchinfo *si)
 	ulong *ubp;
 	int wordcnt, lastpage;
 	ulonglong pnext, ppp;
-	char *pagebuf;
+	physaddr_t present;
+	char *pagebuf, *buf;
 	ulong pct, pages_read, pages_checked;
 	time_t begin, finish;
 	ulong page;
+	struct search_batch *batch;
 
 	start_in = si->paddr_start;
 	end_in = si->paddr_end;
@@ -15307,6 +19926,7 @@ search_physical(struct searchinfo *si)
 	begin = finish = 0;
 
 	pagebuf = GETBUF(PAGESIZE());
+	batch = (si->threads > 1) ? search_batch_alloc(si) : NULL;
 
         if (start_in & (sizeof(ulonglong)-1)) {
                 start_in &= ~(sizeof(ulonglong)-1);
@@ -15326,17 +19946,30 @@ search_physical(struct searchinfo *si)
                 lastpage = (PHYSPAGEBASE(pnext) == PHYSPAGEBASE(end_in));
                 if (LKCD_DUMPFILE())
                         set_lkcd_nohash();
+		buf = batch ? search_batch_pagebuf(batch) : pagebuf;
+
+		/*
+		 *  Jump over the pages excluded from the dumpfile
+		 *  without trying to read them.
+		 */
+		if (!dumpfile_page_present(ppp)) {
+			if (!dumpfile_next_present(ppp, &present))
+				break;
+			ppp = present;
+			continue;
+		}
 
                 if (!phys_to_page(ppp, &page) || 
-		    !readmem(ppp, PHYSADDR, pagebuf, PAGESIZE(),
-                   	"search page", RETURN_ON_ERROR|QUIET)) {
+		    (!(batch && search_batch_reads(batch)) &&
+		    !readmem(ppp, PHYSADDR, buf, PAGESIZE(),
+                   	"search page", RETURN_ON_ERROR|QUIET))) {
 			if (!next_physpage(ppp, &ppp))
 				break;
 			continue;
 		}
 
 		pages_read++;
-                ubp = (ulong *)&pagebuf[pnext - ppp];
+                ubp = (ulong *)&buf[pnext - ppp];
                 if (lastpage) {
                         if (end_in == (ulonglong)(-1))
                                 wordcnt = PAGESIZE()/sizeof(long);
@@ -15345,7 +19978,9 @@ search_physical(struct searchinfo *si)
                 } else
                         wordcnt = (PAGESIZE() - (pnext - ppp))/sizeof(long);
 
-		switch (si->mode)
+		if (batch)
+			search_batch_add(batch, ubp, pnext, ppp, wordcnt, TRUE);
+		else switch (si->mode)
 		{
 		case SEARCH_ULONG:
 			pnext = search_ulong_p(ubp, pnext, wordcnt, si);
@@ -15368,6 +20003,12 @@ search_physical(struct searchinfo *si)
 		ppp += PAGESIZE();
 	}
 
+	if (batch) {
+		search_batch_flush(batch, TRUE);
+		pages_read -= batch->read_errors;
+		search_batch_free(batch);
+	}
+
 	if (CRASHDEBUG(1)) {
 		finish = time(NULL);
 		pct = (pages_read * 100)/pages_checked;
@@ -15391,18 +20032,41 @@ next_upage(struct task_context *tc, ulong vaddr, ulong *nextvaddr)
 	char *vma_buf;
         ulong vm_start, vm_end;
 	ulong vm_next;
+	int lo, hi, mid;
+	struct vma_snapshot *snap;
 
         if (!tc->mm_struct)
                 return FALSE;
 
         fill_mm_struct(tc->mm_struct);
-	vma = ULONG(tt->mm_struct + OFFSET(mm_struct_mmap));
 	total_vm = ULONG(tt->mm_struct + OFFSET(mm_struct_total_vm));
 
-	if (!vma || (total_vm == 0))
+	vaddr = VIRTPAGEBASE(vaddr) + PAGESIZE();  /* first possible page */
+
+	/*
+	 *  Find the first VMA that ends beyond vaddr.
+	 */
+	if (total_vm && (snap = get_vma_snapshot(tc->mm_struct))) {
+		lo = 0;
+		hi = snap->count;
+		while (lo < hi) {
+			mid = (lo + hi) / 2;
+			if (snap->entries[mid].end <= vaddr)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo == snap->count)
+			return FALSE;
+		*nextvaddr = MAX(vaddr, snap->entries[lo].start);
+		return TRUE;
+	} else if (VMA_MAPLE_TREE())
 		return FALSE;
 
-	vaddr = VIRTPAGEBASE(vaddr) + PAGESIZE();  /* first possible page */
+	vma = ULONG(tt->mm_struct + OFFSET(mm_struct_mmap));
+
+	if (!vma || (total_vm == 0))
+		return FALSE;
 
         for ( ; vma; vma = vm_next) {
                 vma_buf = fill_vma_cache(vma);
@@ -15580,10 +20244,16 @@ next_kpage(ulong vaddr, ulong *nextvaddr)
 		return next_vmlist_vaddr(vaddr, nextvaddr);
 
 	case KVADDR_VMEMMAP:  
-		*nextvaddr = vaddr;
-		return TRUE;
-
 	case KVADDR_START_MAP:
+		/*
+		 *  Skip the unmapped regions of the sparse vmemmap
+		 *  as a whole if the machdep walker reports them.
+		 */
+		if (machdep->vtop_extent) {
+			vtop_range(NULL, KVADDR, &vaddr, (ulong)(-1), NULL, 0);
+			if (vaddr == (ulong)(-1))
+				return FALSE;
+		}
 		*nextvaddr = vaddr;
 		return TRUE;
 
@@ -15602,6 +20272,7 @@ static int
 next_physpage(ulonglong paddr, ulonglong *nextpaddr)
 {
 	int n;
+	physaddr_t next;
 	ulonglong node_start;
 	ulonglong node_end;
 	struct node_table *nt;
@@ -15615,12 +20286,19 @@ next_physpage(ulonglong paddr, ulonglong *nextpaddr)
 			continue;
 
 		if (paddr < node_start) {
-			*nextpaddr = node_start;
+			if (!dumpfile_next_present(node_start, &next))
+				return FALSE;
+			*nextpaddr = next;
 			return TRUE;
 		}
 
 		if (paddr < node_end) {
-			*nextpaddr = paddr + PAGESIZE();
+			/*
+			 *  Skip the pages excluded from the dumpfile.
+			 */
+			if (!dumpfile_next_present(paddr + PAGESIZE(), &next))
+				return FALSE;
+			*nextpaddr = next;
 			return TRUE;
 		}
 	}
@@ -17111,6 +21789,51 @@ l1_cache_size(void)
 /*
  *  Multi-purpose routine used to query/control dumpfile memory usage.
  */
+/*
+ *  Find the lowest physical address at or above paddr whose page is
+ *  contained in the dumpfile, so that scans of physical memory can jump
+ *  over the runs of pages that were excluded from it, rather than having
+ *  each of their reads fail.  Returns FALSE if no pages remain at or above
+ *  paddr.  Live systems, and dumpfiles whose backends cannot tell, report
+ *  every address as present.  An address found beyond paddr is rounded
+ *  down to its page boundary.
+ */
+int
+dumpfile_next_present(physaddr_t paddr, physaddr_t *next)
+{
+	int present;
+
+	*next = paddr;
+
+	if (!DUMPFILE() || REMOTE_DUMPFILE())
+		return TRUE;
+	else if (pc->flags & (NETDUMP|KDUMP))
+		present = netdump_next_present(paddr, next);
+	else if (pc->flags & DISKDUMP)
+		present = diskdump_next_present(paddr, next);
+	else if (pc->flags & SADUMP)
+		present = sadump_next_present(paddr, next);
+	else
+		return TRUE;
+
+	if (present && (*next > paddr))
+		*next = MAX(paddr, PHYSPAGEBASE(*next));
+
+	return present;
+}
+
+/*
+ *  Returns TRUE if the page containing paddr is in the dumpfile.
+ */
+int
+dumpfile_page_present(physaddr_t paddr)
+{
+	physaddr_t next;
+
+	return dumpfile_next_present(PHYSPAGEBASE(paddr), &next) &&
+		(next == PHYSPAGEBASE(paddr));
+}
+
 int
 dumpfile_memory(int cmd)
 {
@@ -17219,6 +21942,8 @@ sparse_decode_mem_map(ulong coded_mem_map, ulong section_nr)
 	    (section_nr_to_pfn(section_nr) * SIZE(page));
 }
 
+static ulong mem_section_root_addr;
+
 void
 sparse_mem_init(void)
 {
@@ -17280,9 +22005,139 @@ sparse_mem_init(void)
 		get_symbol_data("mem_section", sizeof(void *), &addr);
 	else
 		addr = symbol_value("mem_section");
+	mem_section_root_addr = addr;
 
 	readmem(addr, KVADDR, vt->mem_sec, mem_section_size,
 		"memory section root table", FAULT_ON_ERROR);
+
+	mem_section_cache_init();
+}
+
+/*
+ *  Keep the section_mem_map word of every section in a local array for
+ *  each section root, so that the pfn_to_map() path and the section
+ *  walks don't read each mem_section again on every call.  Each present
+ *  root is read with a single readmem(); a root whose read fails is left
+ *  uncached, and its sections are read individually as before.  On live
+ *  systems, the cache and the root table are reloaded by the first use
+ *  in each command, since sections come and go with memory hotplug.
+ */
+static void
+mem_section_cache_init(void)
+{
+	ulong r, i, addr, roots, per_root, len;
+	ulong *mem_sec;
+	char *buf;
+
+	roots = NR_SECTION_ROOTS();
+	per_root = SECTIONS_PER_ROOT();
+	mem_sec = vt->mem_sec;
+
+	if (vt->mem_section_maps) {
+		for (r = 0; r < roots; r++)
+			free(vt->mem_section_maps[r]);
+	} else if (!(vt->mem_section_maps = calloc(roots, sizeof(ulong *)))) {
+		error(INFO, "cannot malloc mem_section cache\n");
+		return;
+	}
+
+	BZERO(vt->mem_section_maps, roots * sizeof(ulong *));
+	vt->mem_section_memo_addr = 0;
+	vt->mem_section_cmdgen = pc->cmdgencur;
+
+	if (IS_SPARSEMEM_EX()) {
+		len = per_root * SIZE(mem_section);
+		buf = GETBUF(len);
+		for (r = 0; r < roots; r++) {
+			if (!mem_sec[r] || !IS_KVADDR(mem_sec[r]))
+				continue;
+			if (!readmem(mem_sec[r], KVADDR, buf, len,
+			    "memory section root", RETURN_ON_ERROR|QUIET))
+				continue;
+			if (!(vt->mem_section_maps[r] =
+			    malloc(per_root * sizeof(ulong))))
+				break;
+			for (i = 0; i < per_root; i++)
+				vt->mem_section_maps[r][i] = ULONG(buf +
+					(i * SIZE(mem_section)) +
+					OFFSET(mem_section_section_mem_map));
+		}
+		FREEBUF(buf);
+		return;
+	}
+
+	/*
+	 *  The static mem_section[][] array is read in one piece, with one
+	 *  allocation per root for the sake of the generic lookup.
+	 */
+	addr = symbol_value("mem_section");
+	len = roots * per_root * SIZE(mem_section);
+	buf = GETBUF(len);
+	if (readmem(addr, KVADDR, buf, len, "mem_section array",
+	    RETURN_ON_ERROR|QUIET)) {
+		for (r = 0; r < roots; r++) {
+			if (!(vt->mem_section_maps[r] =
+			    malloc(per_root * sizeof(ulong))))
+				break;
+			for (i = 0; i < per_root; i++)
+				vt->mem_section_maps[r][i] = ULONG(buf +
+					(((r * per_root) + i) * SIZE(mem_section)) +
+					OFFSET(mem_section_section_mem_map));
+		}
+	}
+	FREEBUF(buf);
+}
+
+static void
+mem_section_cache_refresh(void)
+{
+	if (!ACTIVE() || !vt->mem_section_maps ||
+	    (vt->mem_section_cmdgen == pc->cmdgencur))
+		return;
+
+	if (IS_SPARSEMEM_EX())
+		readmem(mem_section_root_addr, KVADDR, vt->mem_sec,
+			sizeof(void *) * NR_SECTION_ROOTS(),
+			"memory section root table", FAULT_ON_ERROR);
+
+	mem_section_cache_init();
+}
+
+/*
+ *  Return a pointer to the cached section_mem_map word of section nr,
+ *  or NULL if it is not cached.
+ */
+static ulong *
+mem_section_cached_map(ulong nr)
+{
+	ulong r;
+
+	mem_section_cache_refresh();
+
+	if (!vt->mem_section_maps)
+		return NULL;
+
+	if ((r = SECTION_NR_TO_ROOT(nr)) >= NR_SECTION_ROOTS())
+		return NULL;
+
+	if (!vt->mem_section_maps[r])
+		return NULL;
+
+	return &vt->mem_section_maps[r][nr & SECTION_ROOT_MASK()];
+}
+
+/*
+ *  Return a pointer to the cached section_mem_map word of the mem_section
+ *  at addr if it is the one last returned by nr_to_section(), which is
+ *  how the callers of the functions below have found it.
+ */
+static ulong *
+mem_section_cached_addr(ulong addr)
+{
+	if (!addr || (addr != vt->mem_section_memo_addr))
+		return NULL;
+
+	return mem_section_cached_map(vt->mem_section_memo_nr);
 }
 
 char *
@@ -17303,6 +22158,8 @@ nr_to_section(ulong nr)
 	ulong addr;
 	ulong *mem_sec = vt->mem_sec;
 
+	mem_section_cache_refresh();
+
 	if (IS_SPARSEMEM_EX()) {
 		if (SECTION_NR_TO_ROOT(nr) >= NR_SECTION_ROOTS()) {
 			if (!STREQ(pc->curcmd, "rd") && 
@@ -17329,6 +22186,9 @@ nr_to_section(ulong nr)
 	if (!IS_KVADDR(addr))
 		return 0;
 
+	vt->mem_section_memo_nr = nr;
+	vt->mem_section_memo_addr = addr;
+
 	return addr;
 }
 
@@ -17358,6 +22218,10 @@ int
 valid_section(ulong addr)
 {
 	char *mem_section;
+	ulong *map;
+
+	if ((map = mem_section_cached_addr(addr)))
+		return (*map & SECTION_MARKED_PRESENT);
 
 	if ((mem_section = read_mem_section(addr)))
         	return (ULONG(mem_section + 
@@ -17370,13 +22234,16 @@ int
 section_has_mem_map(ulong addr)
 {
 	char *mem_section;
-	ulong kernel_version_bit;
+	ulong kernel_version_bit, *map;
 
 	if (THIS_KERNEL_VERSION >= LINUX(2,6,24))
 		kernel_version_bit = SECTION_HAS_MEM_MAP;
 	else
 		kernel_version_bit = SECTION_MARKED_PRESENT;
 
+	if ((map = mem_section_cached_addr(addr)))
+		return (*map & kernel_version_bit);
+
 	if ((mem_section = read_mem_section(addr)))
 		return (ULONG(mem_section + 
 			OFFSET(mem_section_section_mem_map))
@@ -17388,7 +22255,14 @@ ulong
 section_mem_map_addr(ulong addr, int raw)
 {   
 	char *mem_section;
-	ulong map;
+	ulong map, *mapp;
+
+	if ((mapp = mem_section_cached_addr(addr))) {
+		map = *mapp;
+		if (!raw)
+			map &= SECTION_MAP_MASK;
+		return map;
+	}
 
 	if ((mem_section = read_mem_section(addr))) {
 		map = ULONG(mem_section + 
@@ -17404,7 +22278,13 @@ section_mem_map_addr(ulong addr, int raw)
 ulong 
 valid_section_nr(ulong nr)
 {
-	ulong addr = nr_to_section(nr);
+	ulong addr, *map;
+
+	if ((map = mem_section_cached_map(nr)) &&
+	    !(*map & SECTION_MARKED_PRESENT))
+		return 0;
+
+	addr = nr_to_section(nr);
 
 	if (valid_section(addr))
 		return addr;
@@ -18278,14 +23158,13 @@ dump_page_states(void)
 {
 	struct syment *sp;
 	ulong addr, value;
-	int i, c, fd, len, instance, members;
+	int i, c, len, instance, members;
 	char buf[BUFSIZE];
         char *arglist[MAXARGS];
 	struct entry {
 		char *name;
 		ulong value;
 	} *entry_list;
-	struct stat stat;
 	char *namebuf, *nameptr;
 
 	if (!(sp = per_cpu_symbol_search("per_cpu__page_states"))) {
@@ -18305,10 +23184,8 @@ dump_page_states(void)
 		return FALSE;
 	}
 
-	fflush(pc->tmpfile);
-	fd = fileno(pc->tmpfile);
-	fstat(fd, &stat);
-	namebuf = GETBUF(stat.st_size);
+	fseek(pc->tmpfile, 0, SEEK_END);
+	namebuf = GETBUF(ftell(pc->tmpfile));
 	nameptr = namebuf;
 
 	rewind(pc->tmpfile);
@@ -18653,15 +23530,180 @@ kmem_cache_list_common(struct meminfo *mi)
 	FREEBUF(cache_list);
 }
 
+/*
+ *  Display the kmem_cache at si->cache_list[i] for dump_kmem_cache_slub().
+ *  Returns TRUE if it was the requested cache, and no others need to be
+ *  looked at.
+ */
+static int
+dump_kmem_cache_slub_entry(struct meminfo *si, int i, char *reqname)
+{
+	ulong name, oo;
+	unsigned int size, objsize, objects, order, offset;
+	char buf[BUFSIZE];
+
+	order = objects = 0;
+	BZERO(si->cache_buf, SIZE(kmem_cache));
+	if (!readmem(si->cache_list[i], KVADDR, si->cache_buf, 
+	    SIZE(kmem_cache), "kmem_cache buffer", 
+	    RETURN_ON_ERROR|RETURN_PARTIAL))
+		goto next_cache;
+
+	name = ULONG(si->cache_buf + OFFSET(kmem_cache_name)); 
+	if (!read_string(name, buf, BUFSIZE-1))
+		sprintf(buf, "(unknown)");
+	if (reqname) {
+		if (!STREQ(reqname, buf))
+			return FALSE;
+		if (!KMEM_CACHE_RECORDS(si))
+			fprintf(fp, "%s", kmem_cache_hdr);
+	}
+	if (ignore_cache(si, buf)) {
+		DUMP_KMEM_CACHE_TAG(si->cache_list[i], buf, "[IGNORED]");
+		goto next_cache;
+	}
+
+	objsize = UINT(si->cache_buf + OFFSET(kmem_cache_objsize)); 
+	size = UINT(si->cache_buf + OFFSET(kmem_cache_size)); 
+	offset = UINT(si->cache_buf + OFFSET(kmem_cache_offset));
+	if (VALID_MEMBER(kmem_cache_objects)) {
+		objects = UINT(si->cache_buf + 
+			OFFSET(kmem_cache_objects)); 
+		order = UINT(si->cache_buf + OFFSET(kmem_cache_order)); 
+	} else if (VALID_MEMBER(kmem_cache_oo)) {
+		oo = ULONG(si->cache_buf + OFFSET(kmem_cache_oo));
+		objects = oo_objects(oo);
+		order = oo_order(oo);
+	} else
+		error(FATAL, "cannot determine "
+		    	"kmem_cache objects/order values\n");
+
+	si->cache = si->cache_list[i];
+	si->curname = buf;
+	si->objsize = objsize;
+	si->size = size;
+	si->objects = objects;
+	si->slabsize = (PAGESIZE() << order);
+	si->inuse = si->num_slabs = 0;
+	si->slab_offset = offset;
+	si->random = VALID_MEMBER(kmem_cache_random) ?
+		ULONG(si->cache_buf + OFFSET(kmem_cache_random)) : 0;
+
+	if (!get_kmem_cache_slub_data(GET_SLUB_SLABS, si) ||
+	    !get_kmem_cache_slub_data(GET_SLUB_OBJECTS, si))
+		si->flags |= SLAB_GATHER_FAILURE;
+
+	/* accumulate children's slabinfo */
+	if (si->flags & GET_SLAB_ROOT_CACHES) {
+		struct meminfo *mi;
+		int j;
+		char buf2[BUFSIZE];
+
+		mi = (struct meminfo *)GETBUF(sizeof(struct meminfo));
+		memcpy(mi, si, sizeof(struct meminfo));
+
+		mi->cache_count = get_kmem_cache_child_list(&mi->cache_list,
+					si->cache_list[i]);
+
+		if (!mi->cache_count)
+			goto no_children;
+
+		mi->cache_buf = GETBUF(SIZE(kmem_cache));
+
+		for (j = 0; j < mi->cache_count; j++) {
+			BZERO(mi->cache_buf, SIZE(kmem_cache));
+			if (!readmem(mi->cache_list[j], KVADDR, mi->cache_buf,
+			    SIZE(kmem_cache), "kmem_cache buffer",
+			    RETURN_ON_ERROR|RETURN_PARTIAL))
+				continue;
+
+			name = ULONG(mi->cache_buf + OFFSET(kmem_cache_name));
+			if (!read_string(name, buf2, BUFSIZE-1))
+				sprintf(buf2, "(unknown)");
+
+			objsize = UINT(mi->cache_buf + OFFSET(kmem_cache_objsize));
+			size = UINT(mi->cache_buf + OFFSET(kmem_cache_size));
+			offset = UINT(mi->cache_buf + OFFSET(kmem_cache_offset));
+			if (VALID_MEMBER(kmem_cache_objects)) {
+				objects = UINT(mi->cache_buf +
+					OFFSET(kmem_cache_objects));
+				order = UINT(mi->cache_buf + OFFSET(kmem_cache_order));
+			} else if (VALID_MEMBER(kmem_cache_oo)) {
+				oo = ULONG(mi->cache_buf + OFFSET(kmem_cache_oo));
+				objects = oo_objects(oo);
+				order = oo_order(oo);
+			} else
+				error(FATAL, "cannot determine "
+					"kmem_cache objects/order values\n");
+
+			mi->cache = mi->cache_list[j];
+			mi->curname = buf2;
+			mi->objsize = objsize;
+			mi->size = size;
+			mi->objects = objects;
+			mi->slabsize = (PAGESIZE() << order);
+			mi->inuse = mi->num_slabs = 0;
+			mi->slab_offset = offset;
+			mi->random = VALID_MEMBER(kmem_cache_random) ?
+				ULONG(mi->cache_buf + OFFSET(kmem_cache_random)) : 0;
+
+			if (!get_kmem_cache_slub_data(GET_SLUB_SLABS, mi) ||
+			    !get_kmem_cache_slub_data(GET_SLUB_OBJECTS, mi)) {
+				si->flags |= SLAB_GATHER_FAILURE;
+				continue;
+			}
+
+			si->inuse += mi->inuse;
+			si->free += mi->free;
+			si->num_slabs += mi->num_slabs;
+
+			if (CRASHDEBUG(1))
+				dump_kmem_cache_info(mi);
+		}
+		FREEBUF(mi->cache_buf);
+		FREEBUF(mi->cache_list);
+no_children:
+		FREEBUF(mi);
+	}
+
+	DUMP_KMEM_CACHE_INFO();
+
+	if (si->flags & SLAB_GATHER_FAILURE) {
+		si->flags &= ~SLAB_GATHER_FAILURE;
+		goto next_cache;
+	}
+
+	if (si->flags & ADDRESS_SPECIFIED) {
+		if (!si->slab)
+                		si->slab = vaddr_to_slab(si->spec_addr);
+		do_slab_slub(si, VERBOSE);
+	} else if (si->flags & VERBOSE) {
+		do_kmem_cache_slub(si);
+		if (!reqname && ((i+1) < si->cache_count))
+			fprintf(fp, "%s", kmem_cache_hdr);
+	}
+
+next_cache:
+	return reqname ? TRUE : FALSE;
+}
+
+/*
+ *  run_forked() job for "kmem -s -j": display one cache.
+ */
+static void
+dump_kmem_cache_slub_job(void *arg, int i)
+{
+	struct meminfo *si = arg;
+
+	dump_kmem_cache_slub_entry(si, i, NULL);
+}
+
 static void
 dump_kmem_cache_slub(struct meminfo *si)
 {
 	int i;
-	ulong name, oo;
-	unsigned int size, objsize, objects, order, offset;
 	char *reqname, *p1;
 	char kbuf[BUFSIZE];
-	char buf[BUFSIZE];
 
 	if (INVALID_MEMBER(kmem_cache_node_nr_slabs)) {
 		error(INFO, 
@@ -18670,7 +23712,6 @@ dump_kmem_cache_slub(struct meminfo *si)
 		return;
 	}
 
-	order = objects = 0;
 	if (si->flags & GET_SLAB_ROOT_CACHES)
 		si->cache_count = get_kmem_cache_root_list(&si->cache_list);
 	else
@@ -18683,7 +23724,8 @@ dump_kmem_cache_slub(struct meminfo *si)
 		si->flags |= SLAB_BITFIELD;
 
 	if (!si->reqname &&
-	     !(si->flags & (ADDRESS_SPECIFIED|GET_SLAB_PAGES)))
+	     !(si->flags & (ADDRESS_SPECIFIED|GET_SLAB_PAGES)) &&
+	     !KMEM_CACHE_RECORDS(si))
 		fprintf(fp, "%s", kmem_cache_hdr);
 
 	if (si->flags & ADDRESS_SPECIFIED) {
@@ -18706,148 +23748,23 @@ dump_kmem_cache_slub(struct meminfo *si)
 	} else
 		reqname = si->reqname;
 
-	for (i = 0; i < si->cache_count; i++) {
-		BZERO(si->cache_buf, SIZE(kmem_cache));
-		if (!readmem(si->cache_list[i], KVADDR, si->cache_buf, 
-		    SIZE(kmem_cache), "kmem_cache buffer", 
-		    RETURN_ON_ERROR|RETURN_PARTIAL))
-			goto next_cache;
-
-		name = ULONG(si->cache_buf + OFFSET(kmem_cache_name)); 
-		if (!read_string(name, buf, BUFSIZE-1))
-			sprintf(buf, "(unknown)");
-		if (reqname) {
-			if (!STREQ(reqname, buf))
-				continue;
-			fprintf(fp, "%s", kmem_cache_hdr);
-		}
-		if (ignore_cache(si, buf)) {
-			DUMP_KMEM_CACHE_TAG(si->cache_list[i], buf, "[IGNORED]");
-			goto next_cache;
-		}
-
-		objsize = UINT(si->cache_buf + OFFSET(kmem_cache_objsize)); 
-		size = UINT(si->cache_buf + OFFSET(kmem_cache_size)); 
-		offset = UINT(si->cache_buf + OFFSET(kmem_cache_offset));
-		if (VALID_MEMBER(kmem_cache_objects)) {
-			objects = UINT(si->cache_buf + 
-				OFFSET(kmem_cache_objects)); 
-			order = UINT(si->cache_buf + OFFSET(kmem_cache_order)); 
-		} else if (VALID_MEMBER(kmem_cache_oo)) {
-			oo = ULONG(si->cache_buf + OFFSET(kmem_cache_oo));
-			objects = oo_objects(oo);
-			order = oo_order(oo);
-		} else
-			error(FATAL, "cannot determine "
-			    	"kmem_cache objects/order values\n");
-
-		si->cache = si->cache_list[i];
-		si->curname = buf;
-		si->objsize = objsize;
-		si->size = size;
-		si->objects = objects;
-		si->slabsize = (PAGESIZE() << order);
-		si->inuse = si->num_slabs = 0;
-		si->slab_offset = offset;
-		si->random = VALID_MEMBER(kmem_cache_random) ?
-			ULONG(si->cache_buf + OFFSET(kmem_cache_random)) : 0;
-
-		if (!get_kmem_cache_slub_data(GET_SLUB_SLABS, si) ||
-		    !get_kmem_cache_slub_data(GET_SLUB_OBJECTS, si))
-			si->flags |= SLAB_GATHER_FAILURE;
-
-		/* accumulate children's slabinfo */
-		if (si->flags & GET_SLAB_ROOT_CACHES) {
-			struct meminfo *mi;
-			int j;
-			char buf2[BUFSIZE];
-
-			mi = (struct meminfo *)GETBUF(sizeof(struct meminfo));
-			memcpy(mi, si, sizeof(struct meminfo));
-
-			mi->cache_count = get_kmem_cache_child_list(&mi->cache_list,
-						si->cache_list[i]);
-
-			if (!mi->cache_count)
-				goto no_children;
-
-			mi->cache_buf = GETBUF(SIZE(kmem_cache));
-
-			for (j = 0; j < mi->cache_count; j++) {
-				BZERO(mi->cache_buf, SIZE(kmem_cache));
-				if (!readmem(mi->cache_list[j], KVADDR, mi->cache_buf,
-				    SIZE(kmem_cache), "kmem_cache buffer",
-				    RETURN_ON_ERROR|RETURN_PARTIAL))
-					continue;
-
-				name = ULONG(mi->cache_buf + OFFSET(kmem_cache_name));
-				if (!read_string(name, buf2, BUFSIZE-1))
-					sprintf(buf2, "(unknown)");
-
-				objsize = UINT(mi->cache_buf + OFFSET(kmem_cache_objsize));
-				size = UINT(mi->cache_buf + OFFSET(kmem_cache_size));
-				offset = UINT(mi->cache_buf + OFFSET(kmem_cache_offset));
-				if (VALID_MEMBER(kmem_cache_objects)) {
-					objects = UINT(mi->cache_buf +
-						OFFSET(kmem_cache_objects));
-					order = UINT(mi->cache_buf + OFFSET(kmem_cache_order));
-				} else if (VALID_MEMBER(kmem_cache_oo)) {
-					oo = ULONG(mi->cache_buf + OFFSET(kmem_cache_oo));
-					objects = oo_objects(oo);
-					order = oo_order(oo);
-				} else
-					error(FATAL, "cannot determine "
-						"kmem_cache objects/order values\n");
-
-				mi->cache = mi->cache_list[j];
-				mi->curname = buf2;
-				mi->objsize = objsize;
-				mi->size = size;
-				mi->objects = objects;
-				mi->slabsize = (PAGESIZE() << order);
-				mi->inuse = mi->num_slabs = 0;
-				mi->slab_offset = offset;
-				mi->random = VALID_MEMBER(kmem_cache_random) ?
-					ULONG(mi->cache_buf + OFFSET(kmem_cache_random)) : 0;
-
-				if (!get_kmem_cache_slub_data(GET_SLUB_SLABS, mi) ||
-				    !get_kmem_cache_slub_data(GET_SLUB_OBJECTS, mi)) {
-					si->flags |= SLAB_GATHER_FAILURE;
-					continue;
-				}
-
-				si->inuse += mi->inuse;
-				si->free += mi->free;
-				si->num_slabs += mi->num_slabs;
-
-				if (CRASHDEBUG(1))
-					dump_kmem_cache_info(mi);
-			}
-			FREEBUF(mi->cache_buf);
-			FREEBUF(mi->cache_list);
-no_children:
-			FREEBUF(mi);
-		}
-
-		DUMP_KMEM_CACHE_INFO();
-
-		if (si->flags & SLAB_GATHER_FAILURE) {
-			si->flags &= ~SLAB_GATHER_FAILURE;
-			goto next_cache;
-		}
-
-		if (si->flags & ADDRESS_SPECIFIED) {
-			if (!si->slab)
-                		si->slab = vaddr_to_slab(si->spec_addr);
-			do_slab_slub(si, VERBOSE);
-		} else if (si->flags & VERBOSE) {
-			do_kmem_cache_slub(si);
-			if (!reqname && ((i+1) < si->cache_count))
-				fprintf(fp, "%s", kmem_cache_hdr);
+	/*
+	 *  The caches are independent of each other, so with -j they can
+	 *  be displayed by worker processes.
+	 */
+	if ((si->threads > 1) && !reqname) {
+		switch (run_forked(si->threads, si->cache_count,
+		    dump_kmem_cache_slub_job, si))
+		{
+		case FORKED_DONE:
+			goto bailout;
+		case FORKED_BAILOUT:
+			return;
 		}
+	}
 
-next_cache:
-		if (reqname) 
+	for (i = 0; i < si->cache_count; i++) {
+		if (dump_kmem_cache_slub_entry(si, i, reqname))
 			break;
 	}
 
@@ -19238,6 +24155,179 @@ do_kmem_cache_slub(struct meminfo *si)
 		node, objects, inuse, objects - inuse); \
       }
 
+/*
+ *  Cache of the free-object bitmaps of SLUB slabs.  Displaying the
+ *  objects of a slab requires knowing which of them are on the slab's
+ *  freelist or on its per-cpu freelist, and decoding those lists takes a
+ *  read of each free object, which "kmem -S" and "kmem <address>" would
+ *  otherwise repeat for every object in the slab, and again each time a
+ *  slab is displayed.  The bitmaps are keyed by slab page along with the
+ *  heads of both freelists, so a slab whose lists have changed is simply
+ *  a miss.  The total size of the cached bitmaps is capped; slabs beyond
+ *  the cap still get a bitmap, which the caller frees.  Like the vtop
+ *  cache, it is flushed by writemem(), and on a live system, before each
+ *  command.
+ */
+#define PAGE_MAPPING_ANON  1
+
+#define SLUB_FREE_CACHE_SETS (1024)
+#define SLUB_FREE_CACHE_WAYS (4)
+#define SLUB_FREE_CACHE_MAX_BYTES (16 * 1024 * 1024)
+
+static struct slub_free_cache {
+	ulong cmdgen;
+	struct slub_free_entry {
+		ulong slab;
+		ulong freelist;
+		ulong cpu_freelist;
+		int objects;
+		ulong *bitmap;
+	} entries[SLUB_FREE_CACHE_SETS][SLUB_FREE_CACHE_WAYS];
+	unsigned char victim[SLUB_FREE_CACHE_SETS];
+	ulong bytes;
+	ulong hits;
+	ulong misses;
+	ulong uncached;
+} slub_free_cache = { 0 };
+
+static void
+slub_free_cache_flush(void)
+{
+	int i, j;
+
+	for (i = 0; i < SLUB_FREE_CACHE_SETS; i++)
+		for (j = 0; j < SLUB_FREE_CACHE_WAYS; j++)
+			free(slub_free_cache.entries[i][j].bitmap);
+
+	BZERO(slub_free_cache.entries, sizeof(slub_free_cache.entries));
+	slub_free_cache.bytes = 0;
+}
+
+/*
+ *  Return a bitmap with a bit set for each object of the slab starting at
+ *  vaddr that is found on either freelist, or NULL if the lists cannot be
+ *  read or are corrupt.  If *uncached is set on return, the bitmap is not
+ *  held by the cache and must be freed by the caller.
+ */
+static ulong *
+slub_free_bitmap(struct meminfo *si, ulong vaddr, int objects, ulong freelist,
+		 ulong cpu_freelist, ulong red_left_pad, int *uncached)
+{
+	int i, cached;
+	ulong q, index, size, lists[2];
+	ulong *bitmap;
+	struct slub_free_entry *set, *ent;
+
+	*uncached = FALSE;
+	cached = pc->flags & RUNTIME;
+
+	if (cached && ACTIVE() && (slub_free_cache.cmdgen != pc->cmdgencur)) {
+		slub_free_cache_flush();
+		slub_free_cache.cmdgen = pc->cmdgencur;
+	}
+
+	index = (si->slab >> 6) & (SLUB_FREE_CACHE_SETS-1);
+	set = slub_free_cache.entries[index];
+
+	for (i = 0; cached && (i < SLUB_FREE_CACHE_WAYS); i++) {
+		if ((set[i].slab == si->slab) && (set[i].freelist == freelist) &&
+		    (set[i].cpu_freelist == cpu_freelist) &&
+		    (set[i].objects == objects)) {
+			slub_free_cache.hits++;
+			return set[i].bitmap;
+		}
+	}
+
+	slub_free_cache.misses++;
+
+	size = sizeof(ulong) * ((objects + BITS_PER_LONG - 1) / BITS_PER_LONG);
+	if (!(bitmap = (ulong *)calloc(1, size))) {
+		error(INFO, "%s: cannot allocate free object bitmap\n",
+			si->curname);
+		return NULL;
+	}
+
+	lists[0] = freelist;
+	lists[1] = cpu_freelist;
+
+	hq_open();
+	for (i = 0; i < 2; i++) {
+		for (q = lists[i]; q; q = get_freepointer(si, (void *)q)) {
+			if (q == BADADDR)
+				goto bailout;
+			if (q & PAGE_MAPPING_ANON)
+				break;
+			if (!hq_enter(q)) {
+				error(INFO, "%s: slab: %lx duplicate freelist object: %lx\n",
+				      si->curname, si->slab, q);
+				goto bailout;
+			}
+			if (q < vaddr + red_left_pad)
+				continue;
+			if ((q - vaddr - red_left_pad) % si->size)
+				continue;
+			index = (q - vaddr - red_left_pad) / si->size;
+			if (index < objects)
+				bitmap[index / BITS_PER_LONG] |=
+					1UL << (index % BITS_PER_LONG);
+		}
+	}
+	hq_close();
+
+	if (!cached || (slub_free_cache.bytes + size > SLUB_FREE_CACHE_MAX_BYTES)) {
+		slub_free_cache.uncached++;
+		*uncached = TRUE;
+		return bitmap;
+	}
+
+	index = (si->slab >> 6) & (SLUB_FREE_CACHE_SETS-1);
+	ent = &set[slub_free_cache.victim[index]];
+	slub_free_cache.victim[index] = (slub_free_cache.victim[index] + 1) %
+		SLUB_FREE_CACHE_WAYS;
+
+	if (ent->bitmap) {
+		free(ent->bitmap);
+		slub_free_cache.bytes -= sizeof(ulong) *
+			((ent->objects + BITS_PER_LONG - 1) / BITS_PER_LONG);
+	}
+
+	ent->slab = si->slab;
+	ent->freelist = freelist;
+	ent->cpu_freelist = cpu_freelist;
+	ent->objects = objects;
+	ent->bitmap = bitmap;
+	slub_free_cache.bytes += size;
+
+	return bitmap;
+
+bailout:
+	hq_close();
+	free(bitmap);
+	return NULL;
+}
+
+/*
+ *  Display the free-object bitmap cache statistics for "help -m".
+ */
+static void
+dump_slub_free_cache(void)
+{
+	int i, j, used;
+
+	for (i = used = 0; i < SLUB_FREE_CACHE_SETS; i++)
+		for (j = 0; j < SLUB_FREE_CACHE_WAYS; j++)
+			if (slub_free_cache.entries[i][j].bitmap)
+				used++;
+
+	fprintf(fp, "\n       slub_free_cache:\n");
+	fprintf(fp, "               entries: %d of %d (%ld of %d bytes)\n",
+		used, SLUB_FREE_CACHE_SETS * SLUB_FREE_CACHE_WAYS,
+		slub_free_cache.bytes, SLUB_FREE_CACHE_MAX_BYTES);
+	fprintf(fp, "                  hits: %ld\n", slub_free_cache.hits);
+	fprintf(fp, "                misses: %ld\n", slub_free_cache.misses);
+	fprintf(fp, "              uncached: %ld\n", slub_free_cache.uncached);
+}
+
 static int
 do_slab_slub(struct meminfo *si, int verbose)
 {
@@ -19245,8 +24335,8 @@ do_slab_slub(struct meminfo *si, int verbose)
 	ulong vaddr;
 	ushort inuse, objects; 
 	ulong freelist, cpu_freelist, cpu_slab_ptr;
-	int i, free_objects, cpu_slab, is_free, node;
-	ulong p, q;
+	int i, free_objects, cpu_slab, is_free, node, uncached;
+	ulong p, q, *bitmap;
 #define SLAB_RED_ZONE 0x00000400UL
 	ulong flags, red_left_pad;
 
@@ -19315,8 +24405,6 @@ do_slab_slub(struct meminfo *si, int verbose)
 
 	fprintf(fp, "  %s", free_inuse_hdr);
 
-#define PAGE_MAPPING_ANON  1
-
 	if (CRASHDEBUG(8)) {
 		fprintf(fp, "< SLUB: free list START: >\n");
 		i = 0;
@@ -19341,35 +24429,13 @@ do_slab_slub(struct meminfo *si, int verbose)
 			red_left_pad = ULONG(si->cache_buf + OFFSET(kmem_cache_red_left_pad));
 	}
 
-	for (p = vaddr; p < vaddr + objects * si->size; p += si->size) {
-		hq_open();
-		is_free = FALSE;
-		/* Search an object on both of freelist and cpu_freelist */
-		ulong lists[] = { freelist, cpu_freelist, };
-		for (i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
-			for (is_free = 0, q = lists[i]; q;
-			     q = get_freepointer(si, (void *)q)) {
+	/* Mark the objects found on both the freelist and cpu_freelist */
+	if (!(bitmap = slub_free_bitmap(si, vaddr, objects, freelist,
+	    cpu_freelist, red_left_pad, &uncached)))
+		return FALSE;
 
-				if (q == BADADDR) {
-					hq_close();
-					return FALSE;
-				}
-				if (q & PAGE_MAPPING_ANON)
-					break;
-				if ((p + red_left_pad) == q) {
-					is_free = TRUE;
-					goto found_object;
-				}
-				if (!hq_enter(q)) {
-					hq_close();
-					error(INFO, "%s: slab: %lx duplicate freelist object: %lx\n",
-					      si->curname, si->slab, q);
-					return FALSE;
-				}
-			}
-		}
-	found_object:
-		hq_close();
+	for (i = 0, p = vaddr; i < objects; i++, p += si->size) {
+		is_free = (bitmap[i / BITS_PER_LONG] >> (i % BITS_PER_LONG)) & 1;
 
 		if (si->flags & ADDRESS_SPECIFIED) {
 			if ((si->spec_addr < p) ||
@@ -19389,6 +24455,9 @@ do_slab_slub(struct meminfo *si, int verbose)
 
 	}
 
+	if (uncached)
+		free(bitmap);
+
 	return TRUE;
 }
 
@@ -35,6 +35,10 @@
 #include <linux/mm.h>
 #include <linux/highmem.h>
 #include <linux/mmzone.h>
+#include <linux/sched.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)
+#include <linux/sched/signal.h>
+#endif
 
 extern int page_is_ram(unsigned long);
 
@@ -155,7 +159,28 @@ static inline void unmap_virtual(struct page *page)
 #endif
 
 
-#define CRASH_VERSION   "1.5"
+#define CRASH_VERSION   "1.6"
+
+/*
+ *  Vectored read of a list of physical address ranges, each of which is
+ *  copied to its own user buffer.  The ranges are read in order until
+ *  one of them fails; bytes_read returns the total number of bytes that
+ *  were copied.  The crash utility has the same definitions.
+ */
+struct crash_read_range {
+	__u64 paddr;
+	__u64 len;
+	__u64 buf;
+};
+
+struct crash_read_vec {
+	__u64 nr_ranges;
+	__u64 ranges;		/* struct crash_read_range array */
+	__u64 bytes_read;
+};
+
+#define DEV_CRASH_READ_VEC	_IOWR('c', 2, struct crash_read_vec)
+#define DEV_CRASH_MAX_RANGES	(1024)
 
 /*
  *  These are the file operation functions that allow crash utility
@@ -223,18 +248,11 @@ crash_write(struct file *file, const char *buf, size_t count, loff_t *poff)
  *  get a virtual address for it, and copy it out.
  *  Accesses must fit within a page.
  */
-static ssize_t
-crash_read(struct file *file, char *buf, size_t count, loff_t *poff)
+static int
+crash_read_page(char *buffer, u64 offset, char *buf, size_t count)
 {
 	void *vaddr;
 	struct page *page;
-	u64 offset;
-	ssize_t read;
-	char *buffer = file->private_data;
-
-	offset = *poff;
-	if (offset >> PAGE_SHIFT != (offset+count-1) >> PAGE_SHIFT)
-		return -EINVAL;
 
 	vaddr = map_virtual(offset, &page);
 	if (!vaddr)
@@ -253,11 +271,98 @@ crash_read(struct file *file, char *buf, size_t count, loff_t *poff)
 	}
 	unmap_virtual(page);
 
-	read = count;
+	return 0;
+}
+
+/*
+ *  Copy out count bytes of physical memory starting at offset, one page
+ *  at a time.  Returns the number of bytes copied before the first page
+ *  that could not be read.
+ */
+static ssize_t
+crash_read_pages(char *buffer, u64 offset, char *buf, size_t count)
+{
+	size_t chunk;
+	ssize_t read;
+
+	for (read = 0; count; read += chunk) {
+		chunk = min_t(size_t, count, PAGE_SIZE - (offset & (PAGE_SIZE-1)));
+		if (crash_read_page(buffer, offset, buf, chunk))
+			break;
+		offset += chunk;
+		buf += chunk;
+		count -= chunk;
+
+		if (count) {
+			if (fatal_signal_pending(current))
+				break;
+			cond_resched();
+		}
+	}
+
+	return read;
+}
+
+/*
+ *  Reads may span any number of pages; a read that fails part way
+ *  through returns the number of bytes read up to there.
+ */
+static ssize_t
+crash_read(struct file *file, char *buf, size_t count, loff_t *poff)
+{
+	ssize_t read;
+	char *buffer = file->private_data;
+
+	if (!count)
+		return 0;
+
+	read = crash_read_pages(buffer, *poff, buf, count);
+	if (!read)
+		return -EFAULT;
+
 	*poff += read;
 	return read;
 }
 
+static long
+crash_read_vec(struct file *file, unsigned long arg)
+{
+	struct crash_read_vec vec;
+	struct crash_read_range range;
+	struct crash_read_vec *uvec = (struct crash_read_vec *)arg;
+	struct crash_read_range *uranges;
+	char *buffer = file->private_data;
+	__u64 i, bytes_read;
+	ssize_t read;
+	long ret;
+
+	if (copy_from_user(&vec, uvec, sizeof(vec)))
+		return -EFAULT;
+	if (vec.nr_ranges > DEV_CRASH_MAX_RANGES)
+		return -E2BIG;
+
+	uranges = (struct crash_read_range *)(unsigned long)vec.ranges;
+
+	for (i = bytes_read = ret = 0; i < vec.nr_ranges; i++) {
+		if (copy_from_user(&range, &uranges[i], sizeof(range))) {
+			ret = -EFAULT;
+			break;
+		}
+		read = crash_read_pages(buffer, range.paddr,
+			(char *)(unsigned long)range.buf, range.len);
+		bytes_read += read;
+		if (read != range.len) {
+			ret = -EFAULT;
+			break;
+		}
+	}
+
+	if (put_user(bytes_read, &uvec->bytes_read))
+		return -EFAULT;
+
+	return ret;
+}
+
 static int
 crash_open(struct inode * inode, struct file * filp)
 {
@@ -304,6 +409,9 @@ crash_arch_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 static long 
 crash_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
+	if (cmd == DEV_CRASH_READ_VEC)
+		return crash_read_vec(file, arg);
+
 #ifdef DEV_CRASH_ARCH_DATA
 	return crash_arch_ioctl(file, cmd, arg);
 #else
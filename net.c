@@ -59,6 +59,26 @@ struct devinfo {
 	short		dev_type;
 };
 
+/*
+ *  The net devices referenced by the neighbour entries, hashed by address,
+ *  so that each device is read once per "net -a", and so that "net -a -c"
+ *  can count the entries of each device by state.
+ */
+#define NUD_STATES	(8)	/* nud_state bits */
+
+struct arp_devinfo {
+	ulong		dev;
+	struct devinfo	dinfo;
+	ulong		neighbours;
+	ulong		states[NUD_STATES];
+};
+
+struct arp_devinfo_table {
+	struct arp_devinfo *entries;
+	ulong		size;	/* power of 2 */
+	ulong		count;
+};
+
 #define BYTES_IP_ADDR	15	/* bytes to print IP addr (xxx.xxx.xxx.xxx) */
 #define BYTES_PORT_NUM	5	/* bytes to print port number */
 /* bytes needed for <ip address>:<port> notation */
@@ -67,18 +87,27 @@ struct devinfo {
 static void show_net_devices(ulong);
 static void show_net_devices_v2(ulong);
 static void show_net_devices_v3(ulong);
-static void print_neighbour_q(ulong, int);
+static int show_net_namespace_devices(ulong, char *, char **, long *, long, int);
+static void show_net_namespaces(int);
+static void print_neighbour_q(ulong, int, struct arp_devinfo_table *, int);
 static void get_netdev_info(ulong, struct devinfo *);
-static void get_device_name(ulong, char *);
-static long get_device_address(ulong, char **, long);
+static struct arp_devinfo *arp_devinfo_lookup(struct arp_devinfo_table *, ulong);
+static void dump_arp_summary(struct arp_devinfo_table *);
+static void get_device_name(ulong, char *, char *);
+static long get_device_address(ulong, char *, char **, long);
 static void get_sock_info(ulong, char *);
-static void dump_arp(void);
+static char *socket_family_name(ushort, char *);
+static char *socket_type_name(ushort, char *);
+static void dump_arp(int);
 static void arp_state_to_flags(unsigned char);
 static void dump_ether_hw(unsigned char *, int);
 static void dump_sockets(ulong, struct reference *);
-static int  sym_socket_dump(ulong, int, int, ulong, struct reference *);
+static int  sym_socket_dump(ulong, ulong, int, int, ulong, struct reference *);
+static int  file_to_socket(ulong, ulong *, ulong *);
+static void dump_socket_summary(int);
 static void dump_hw_addr(unsigned char *, int);
 static char *dump_in6_addr_port(uint16_t *, uint16_t, char *, int *);
+static char *dump_in6_addr(uint16_t *, char *);
 
 
 #define MK_TYPE_T(f,s,m)						\
@@ -115,6 +144,7 @@ net_init(void)
 			"net_device", "ip_ptr");
 		MEMBER_OFFSET_INIT(net_device_dev_list, "net_device", "dev_list");
 		MEMBER_OFFSET_INIT(net_dev_base_head, "net", "dev_base_head");
+		MEMBER_OFFSET_INIT(net_list, "net", "list");
 		ARRAY_LENGTH_INIT(net->net_device_name_index,
 			net_device_name, "net_device.name", NULL, sizeof(char));
 		net->flags |= (NETDEV_INIT|STRUCT_NET_DEVICE);
@@ -198,6 +228,8 @@ net_init(void)
 			 */
 			MEMBER_OFFSET_INIT(sock_common_skc_family,
 				"sock_common", "skc_family");
+			MEMBER_OFFSET_INIT(sock_common_skc_state,
+				"sock_common", "skc_state");
 			MEMBER_OFFSET_INIT(sock_sk_type, "sock", "sk_type");
 			/*
 			 *  struct inet_sock {
@@ -313,7 +345,7 @@ net_init(void)
  * The net command...
  */
 
-#define NETOPTS	  "N:asSR:xdn"
+#define NETOPTS	  "N:asSR:xdntj:Ac"
 #define s_FLAG FOREACH_s_FLAG
 #define S_FLAG FOREACH_S_FLAG
 #define x_FLAG FOREACH_x_FLAG
@@ -332,7 +364,7 @@ net_init(void)
 void
 cmd_net(void)
 {
-	int c;
+	int c, tflag, threads, Aflag, cflag;
 	ulong sflag, nflag, aflag;
 	ulong value;
 	ulong task;
@@ -345,6 +377,7 @@ cmd_net(void)
 
 	ref = NULL;
 	sflag = nflag = aflag = 0;
+	tflag = threads = Aflag = cflag = 0;
 	task = pid_to_task(0);
 
 	while ((c = getopt(argcnt, args, NETOPTS)) != EOF) {
@@ -360,10 +393,17 @@ cmd_net(void)
 			break;
 
 		case 'a':
-			dump_arp();
 			aflag++;
 			break;
 
+		case 'A':
+			Aflag = 1;
+			break;
+
+		case 'c':
+			cflag = 1;
+			break;
+
 		case 'N':
 			value = stol(optarg, FAULT_ON_ERROR, NULL);
 			in_addr.s_addr = (in_addr_t)value;
@@ -400,6 +440,14 @@ cmd_net(void)
 			sflag |= d_FLAG;
 			break;
 
+		case 't':
+			tflag = 1;
+			break;
+
+		case 'j':
+			threads = dtoi(optarg, FAULT_ON_ERROR, NULL);
+			break;
+
 		case 'n':
 			nflag = 1;
 			task = CURRENT_TASK();
@@ -422,10 +470,31 @@ cmd_net(void)
 	if (argerrs) 
 		cmd_usage(pc->curcmd, SYNOPSIS);
 
-	if (sflag & (s_FLAG|S_FLAG))
+	if ((tflag && (!(sflag & s_FLAG) || (sflag & (x_FLAG|d_FLAG)) || ref)) ||
+	    (threads && !tflag)) {
+		error(INFO, "-t requires -s, and -j requires -t; "
+			"-t cannot be used with -R, -x or -d\n");
+		cmd_usage(pc->curcmd, SYNOPSIS);
+	}
+
+	if ((Aflag && (nflag || (sflag & (s_FLAG|S_FLAG)))) ||
+	    (cflag && !aflag && !Aflag)) {
+		error(INFO, "-c requires -a or -A; "
+			"-A cannot be used with -n, -s or -S\n");
+		cmd_usage(pc->curcmd, SYNOPSIS);
+	}
+
+	if (aflag)
+		dump_arp(cflag);
+
+	if (tflag)
+		dump_socket_summary(threads);
+	else if (sflag & (s_FLAG|S_FLAG))
 		dump_sockets(sflag, ref);
 	else {
-		if ((argcnt == 1) || nflag)
+		if (Aflag)
+			show_net_namespaces(cflag);
+		else if ((argcnt == 1) || nflag)
 			show_net_devices(task);
 		else if (!aflag)
 			cmd_usage(pc->curcmd, SYNOPSIS);
@@ -471,10 +540,10 @@ show_net_devices(ulong task)
                 fprintf(fp, "%s  ", 
                     mkstring(buf, flen, CENTER|RJUST|LONG_HEX, MKSTR(next)));
 
-		get_device_name(next, buf);
+		get_device_name(next, NULL, buf);
 		fprintf(fp, "%-6s ", buf);
 
-		buflen = get_device_address(next, &buf, buflen);
+		buflen = get_device_address(next, NULL, &buf, buflen);
 		fprintf(fp, "%s\n", buf);
 
         	readmem(next+net->dev_next, KVADDR, &next, 
@@ -524,10 +593,11 @@ show_net_devices_v2(ulong task)
 			mkstring(buf, flen, CENTER|RJUST|LONG_HEX,
 			MKSTR(ld->list_ptr[i])));
 
-		get_device_name(ld->list_ptr[i], buf);
+		get_device_name(ld->list_ptr[i], net_device_buf, buf);
 		fprintf(fp, "%-6s ", buf);
 
-		buflen = get_device_address(ld->list_ptr[i], &buf, buflen);
+		buflen = get_device_address(ld->list_ptr[i], net_device_buf,
+			&buf, buflen);
 		fprintf(fp, "%s\n", buf);
 	}
 	
@@ -540,11 +610,9 @@ static void
 show_net_devices_v3(ulong task)
 {
 	ulong nsproxy_p, net_ns_p;
-	struct list_data list_data, *ld;
 	char *net_device_buf;
 	char *buf;
 	long buflen = BUFSIZE;
-	int ndevcnt, i;
 	long flen;
 
 	if (!net->netdevice) /* initialized in net_init() */
@@ -559,9 +627,6 @@ show_net_devices_v3(ulong task)
 
 	net_device_buf = GETBUF(SIZE(net_device));
 
-	ld =  &list_data;
-	BZERO(ld, sizeof(struct list_data));
-	ld->flags |= LIST_ALLOCATE;
 	if (VALID_MEMBER(nsproxy_net_ns)) {
 		readmem(task + OFFSET(task_struct_nsproxy), KVADDR, &nsproxy_p,
 			sizeof(ulong), "task_struct.nsproxy", FAULT_ON_ERROR);
@@ -570,30 +635,123 @@ show_net_devices_v3(ulong task)
 			error(FATAL, "cannot determine net_namespace location!\n");
 	} else
 		net_ns_p = symbol_value("init_net");
+
+	show_net_namespace_devices(net_ns_p, net_device_buf, &buf, &buflen,
+		flen, FALSE);
+
+	FREEBUF(net_device_buf);
+	FREEBUF(buf);
+}
+
+/*
+ *  Display the devices of the network namespace at net_ns_p, or if
+ *  count_only is set, just count them.  The name and ip_ptr of each
+ *  device are taken from the net_device that is read into net_device_buf,
+ *  rather than being read from the dumpfile separately.
+ */
+static int
+show_net_namespace_devices(ulong net_ns_p, char *net_device_buf, char **bufp,
+			   long *buflen, long flen, int count_only)
+{
+	struct list_data list_data, *ld;
+	int ndevcnt, i;
+
+	ld =  &list_data;
+	BZERO(ld, sizeof(struct list_data));
+	ld->flags |= LIST_ALLOCATE;
 	ld->start = ld->end = net_ns_p + OFFSET(net_dev_base_head);
 	ld->list_head_offset = OFFSET(net_device_dev_list);
 
 	ndevcnt = do_list(ld);
 
 	/*
-	 *  Skip the first entry (init_net).
+	 *  Skip the first entry (the list head in the net namespace).
 	 */
-	for (i = 1; i < ndevcnt; ++i) {
+	for (i = 1; !count_only && (i < ndevcnt); ++i) {
 		readmem(ld->list_ptr[i], KVADDR, net_device_buf,
 			SIZE(net_device), "net_device buffer",
 			FAULT_ON_ERROR);
 
                 fprintf(fp, "%s  ",
-			mkstring(buf, flen, CENTER|RJUST|LONG_HEX,
+			mkstring(*bufp, flen, CENTER|RJUST|LONG_HEX,
 			MKSTR(ld->list_ptr[i])));
 
-		get_device_name(ld->list_ptr[i], buf);
-		fprintf(fp, "%-6s ", buf);
+		get_device_name(ld->list_ptr[i], net_device_buf, *bufp);
+		fprintf(fp, "%-6s ", *bufp);
 
-		buflen = get_device_address(ld->list_ptr[i], &buf, buflen);
-		fprintf(fp, "%s\n", buf);
+		*buflen = get_device_address(ld->list_ptr[i], net_device_buf,
+			bufp, *buflen);
+		fprintf(fp, "%s\n", *bufp);
 	}
 	
+	FREEBUF(ld->list_ptr);
+
+	return ndevcnt > 0 ? ndevcnt - 1 : 0;
+}
+
+/*
+ *  "net -A": display the devices of every network namespace on the
+ *  net_namespace_list, or with -c, just the number of devices of each.
+ */
+static void
+show_net_namespaces(int count_only)
+{
+	struct list_data list_data, *ld;
+	char *net_device_buf;
+	char *buf;
+	long buflen = BUFSIZE;
+	int nscnt, i, ndevs;
+	ulong total;
+	long flen;
+
+	if (!net->netdevice || !symbol_exists("net_namespace_list") ||
+	    INVALID_MEMBER(net_list) || INVALID_MEMBER(net_dev_base_head)) {
+		option_not_supported('A');
+		return;
+	}
+
+	buf = GETBUF(buflen);
+	flen = MAX(VADDR_PRLEN, strlen(net->netdevice));
+	net_device_buf = GETBUF(SIZE(net_device));
+
+	ld =  &list_data;
+	BZERO(ld, sizeof(struct list_data));
+	ld->flags |= LIST_ALLOCATE;
+	ld->start = ld->end = symbol_value("net_namespace_list");
+	ld->list_head_offset = OFFSET(net_list);
+
+	nscnt = do_list(ld);
+
+	if (count_only)
+		fprintf(fp, "%s  DEVICES\n",
+			mkstring(buf, VADDR_PRLEN, CENTER|LJUST, "NET_NAMESPACE"));
+
+	/*
+	 *  Skip the first entry (net_namespace_list).
+	 */
+	for (i = 1, total = 0; i < nscnt; i++) {
+		if (!count_only) {
+			fprintf(fp, "%sNET_NAMESPACE: %lx\n", i > 1 ? "\n" : "",
+				ld->list_ptr[i]);
+			fprintf(fp, "%s  NAME   IP ADDRESS(ES)\n",
+				mkstring(upper_case(net->netdevice, buf),
+				flen, CENTER|LJUST, NULL));
+		}
+
+		ndevs = show_net_namespace_devices(ld->list_ptr[i],
+			net_device_buf, &buf, &buflen, flen, count_only);
+		total += ndevs;
+
+		if (count_only)
+			fprintf(fp, "%s  %7d\n",
+				mkstring(buf, VADDR_PRLEN, RJUST|LONG_HEX,
+				MKSTR(ld->list_ptr[i])), ndevs);
+	}
+
+	if (count_only)
+		fprintf(fp, "%s  %7ld\n",
+			mkstring(buf, VADDR_PRLEN, RJUST, "TOTAL"), total);
+
 	FREEBUF(ld->list_ptr);
 	FREEBUF(net_device_buf);
 	FREEBUF(buf);
@@ -606,7 +764,7 @@ show_net_devices_v3(ulong task)
 	"NEIGHBOUR        IP ADDRESS      HW TYPE    HW ADDRESS         DEVICE  STATE"
 
 static void
-dump_arp(void)
+dump_arp(int summary)
 {
 	ulong	arp_tbl;		/* address of arp_tbl */
 	ulong	*hash_buckets;
@@ -618,6 +776,7 @@ dump_arp(void)
 	int	header_printed = 0;
 	int	hash_mask = 0;
 	ulong	nht;
+	struct arp_devinfo_table arp_devinfo_table, *adt;
 
 	if (!symbol_exists("arp_tbl")) 
 		error(FATAL, "arp_tbl does not exist in this kernel\n");
@@ -700,29 +859,137 @@ dump_arp(void)
 			KVADDR, hash_buckets, hash_bytes,
 			"neigh_table hash_buckets", FAULT_ON_ERROR);
 
+	adt = &arp_devinfo_table;
+	BZERO(adt, sizeof(struct arp_devinfo_table));
+
 	for (i = 0; i < nhash_buckets; i++) {
 		if (hash_buckets[i] != (ulong)NULL) {
-			if (!header_printed) {
+			if (!header_printed && !summary) {
 				fprintf(fp, "%s\n", ARP_HEADING);
 				header_printed = 1;
 			}
-			print_neighbour_q(hash_buckets[i], key_len);
+			print_neighbour_q(hash_buckets[i], key_len, adt, summary);
 		}
 	}
 
+	if (summary)
+		dump_arp_summary(adt);
+
 	fflush(fp);
 
+	if (adt->entries)
+		FREEBUF(adt->entries);
 	FREEBUF(hash_buckets);
 }
 
+/*
+ *  Return the arp_devinfo_table entry of a net device, creating it on
+ *  first use.
+ */
+static struct arp_devinfo *
+arp_devinfo_lookup(struct arp_devinfo_table *adt, ulong dev)
+{
+	ulong i, h, oldsize;
+	struct arp_devinfo *old, *adi;
+
+	if ((adt->count + 1) * 4 > adt->size * 3) {
+		old = adt->entries;
+		oldsize = adt->size;
+		adt->size = oldsize ? oldsize * 2 : 64;
+		adt->entries = (struct arp_devinfo *)
+			GETBUF(sizeof(struct arp_devinfo) * adt->size);
+		for (i = 0; i < oldsize; i++) {
+			if (!old[i].dev)
+				continue;
+			h = (old[i].dev >> 8) & (adt->size - 1);
+			while (adt->entries[h].dev)
+				h = (h + 1) & (adt->size - 1);
+			adt->entries[h] = old[i];
+		}
+		if (old)
+			FREEBUF(old);
+	}
+
+	h = (dev >> 8) & (adt->size - 1);
+	while ((adi = &adt->entries[h])->dev) {
+		if (adi->dev == dev)
+			return adi;
+		h = (h + 1) & (adt->size - 1);
+	}
+
+	get_netdev_info(dev, &adi->dinfo);
+	adi->dev = dev;
+	adt->count++;
+
+	return adi;
+}
+
+static int
+compare_arp_devinfo(const void *v1, const void *v2)
+{
+	const struct arp_devinfo *adi1 = v1, *adi2 = v2;
+
+	return strcmp(adi1->dinfo.dev_name, adi2->dinfo.dev_name);
+}
+
+/*
+ *  "net -a -c": the number of neighbour entries of each device, in total
+ *  and by nud_state bit.
+ */
+static void
+dump_arp_summary(struct arp_devinfo_table *adt)
+{
+	ulong i, n, total;
+	int s;
+	struct arp_devinfo *adi;
+	char buf[BUFSIZE];
+	long flen;
+	static char *nud_names[NUD_STATES] = {
+		"INCOMPLETE", "REACHABLE", "STALE", "DELAY",
+		"PROBE", "FAILED", "NOARP", "PERMANENT"
+	};
+
+	for (i = n = 0; i < adt->size; i++) {
+		if (adt->entries[i].dev)
+			adt->entries[n++] = adt->entries[i];
+	}
+	qsort(adt->entries, n, sizeof(struct arp_devinfo), compare_arp_devinfo);
+
+	flen = MAX(VADDR_PRLEN, strlen(net->netdevice));
+
+	fprintf(fp, "%s  %-6s  %10s", mkstring(upper_case(net->netdevice, buf),
+		flen, CENTER|LJUST, NULL), "NAME", "NEIGHBOURS");
+	for (s = 0; s < NUD_STATES; s++)
+		fprintf(fp, "  %s", nud_names[s]);
+	fprintf(fp, "\n");
+
+	for (i = total = 0; i < n; i++) {
+		adi = &adt->entries[i];
+		total += adi->neighbours;
+		fprintf(fp, "%s  %-6s  %10ld", mkstring(buf, flen,
+			RJUST|LONG_HEX, MKSTR(adi->dev)), adi->dinfo.dev_name,
+			adi->neighbours);
+		for (s = 0; s < NUD_STATES; s++)
+			fprintf(fp, "  %*ld", (int)strlen(nud_names[s]),
+				adi->states[s]);
+		fprintf(fp, "\n");
+	}
+
+	fprintf(fp, "%s  %-6s  %10ld\n", mkstring(buf, flen, RJUST,
+		"TOTAL"), "", total);
+}
+
 /*
  * Dump out the relevant information of a neighbour structure for the
- * ARP table.
+ * ARP table, or with summary set, just count it.  The members needed are
+ * read with a single readmem() of the leading part of the neighbour, and
+ * the device information comes from the arp_devinfo_table.
  */
 static void
-print_neighbour_q(ulong addr, int key_len)
+print_neighbour_q(ulong addr, int key_len, struct arp_devinfo_table *adt,
+		  int summary)
 {
-	int i;
+	int i, s;
 	ulong	dev;			/* dev address of this struct */
 	unsigned char *ha_buf;		/* buffer for hardware address */
 	uint	ha_size;		/* size of HW address */
@@ -730,26 +997,41 @@ print_neighbour_q(ulong addr, int key_len)
 	struct devinfo dinfo;
 	unsigned char state;		/* state of ARP entry */
 	struct in_addr in_addr;
+	struct arp_devinfo *adi;
+	char	*neighbour_buf;
+	long	len;
 
 	ha_size = (i = ARRAY_LENGTH(neighbour_ha)) ?
 		i : get_array_length("neighbour.ha", NULL, sizeof(char));
-	ha_buf = (unsigned char *)GETBUF(ha_size);
+
+	len = MAX(OFFSET(neighbour_primary_key) + sizeof(ipaddr),
+		OFFSET(neighbour_ha) + ha_size);
+	len = MAX(len, OFFSET(neighbour_dev) + sizeof(dev));
+	len = MAX(len, OFFSET(neighbour_nud_state) + sizeof(state));
+	len = MAX(len, OFFSET(neighbour_next) + sizeof(addr));
+	neighbour_buf = GETBUF(len);
+	ha_buf = (unsigned char *)neighbour_buf + OFFSET(neighbour_ha);
 
 	while (addr) {
-		readmem(addr + OFFSET(neighbour_primary_key), KVADDR, 
-			&ipaddr, sizeof(ipaddr), "neighbour primary_key", 
-			FAULT_ON_ERROR);
+		readmem(addr, KVADDR, neighbour_buf, len,
+			"neighbour buffer", FAULT_ON_ERROR);
 
-		readmem(addr + OFFSET(neighbour_ha), KVADDR, ha_buf, ha_size,
-			"neighbour ha", FAULT_ON_ERROR);
+		ipaddr = UINT(neighbour_buf + OFFSET(neighbour_primary_key));
+		dev = ULONG(neighbour_buf + OFFSET(neighbour_dev));
+		state = UCHAR(neighbour_buf + OFFSET(neighbour_nud_state));
 
-		readmem(addr + OFFSET(neighbour_dev), KVADDR, &dev, sizeof(dev),
-			"neighbour dev", FAULT_ON_ERROR);
-		get_netdev_info(dev, &dinfo);
+		adi = arp_devinfo_lookup(adt, dev);
+		dinfo = adi->dinfo;
 
-		readmem(addr + OFFSET(neighbour_nud_state), KVADDR, 
-			&state, sizeof(state), "neighbour nud_state", 
-			FAULT_ON_ERROR);
+		if (summary) {
+			adi->neighbours++;
+			for (s = 0; s < NUD_STATES; s++) {
+				if (state & (1 << s))
+					adi->states[s]++;
+			}
+			addr = ULONG(neighbour_buf + OFFSET(neighbour_next));
+			continue;
+		}
 
 		in_addr.s_addr = ipaddr;
 		fprintf(fp, "%-16lx %-16s", addr, inet_ntoa(in_addr));
@@ -814,11 +1096,10 @@ print_neighbour_q(ulong addr, int key_len)
 
 		arp_state_to_flags(state);
 
-		readmem(addr + OFFSET(neighbour_next), KVADDR, 
-			&addr, sizeof(addr), "neighbour next", FAULT_ON_ERROR);
+		addr = ULONG(neighbour_buf + OFFSET(neighbour_next));
 	}
 
-	FREEBUF(ha_buf);
+	FREEBUF(neighbour_buf);
 }
 
 /*
@@ -829,7 +1110,7 @@ get_netdev_info(ulong devaddr, struct devinfo *dip)
 {
 	short	dev_type;
 
-	get_device_name(devaddr, dip->dev_name);
+	get_device_name(devaddr, NULL, dip->dev_name);
 
 	readmem(devaddr + net->dev_type, KVADDR, 
 		&dev_type, sizeof(dev_type), net->dev_type_t, FAULT_ON_ERROR);
@@ -842,10 +1123,11 @@ get_netdev_info(ulong devaddr, struct devinfo *dip)
 }
 
 /*
- *  Get the device name.
+ *  Get the device name.  If the caller has already read the net_device
+ *  into devbuf, an embedded name is copied from there.
  */
 static void
-get_device_name(ulong devaddr, char *buf)
+get_device_name(ulong devaddr, char *devbuf, char *buf)
 {
 	ulong	name_addr;
 
@@ -853,15 +1135,24 @@ get_device_name(ulong devaddr, char *buf)
 	{
 	case STRUCT_NET_DEVICE:
 		if (net->net_device_name_index > 0) {
-                	readmem(devaddr + net->dev_name, KVADDR,
-                        	buf, net->net_device_name_index, 
-				net->dev_name_t, FAULT_ON_ERROR);
+			if (devbuf)
+				BCOPY(devbuf + net->dev_name, buf,
+					net->net_device_name_index);
+			else
+                		readmem(devaddr + net->dev_name, KVADDR,
+                        		buf, net->net_device_name_index,
+					net->dev_name_t, FAULT_ON_ERROR);
 			return;
 		} 
 
 		/* fallthrough */
 
         case STRUCT_DEVICE:
+		if (devbuf) {
+			name_addr = ULONG(devbuf + net->dev_name);
+			read_string(name_addr, buf, DEV_NAME_MAX);
+			break;
+		}
                 readmem(devaddr + net->dev_name, KVADDR,
                         &name_addr, sizeof(name_addr), net->dev_name_t,
                         FAULT_ON_ERROR);
@@ -878,9 +1169,10 @@ get_device_name(ulong devaddr, char *buf)
  *  in_ifaddr->ifa_address contains the address. 
  *  in_ifaddr->ifa_next points to the next in_ifaddr in the list (if any).
  * 
+ *  As with get_device_name(), ip_ptr is taken from devbuf if it is passed.
  */
 static long
-get_device_address(ulong devaddr, char **bufp, long buflen)
+get_device_address(ulong devaddr, char *devbuf, char **bufp, long buflen)
 {
 	ulong ip_ptr, ifa_list;
 	struct in_addr ifa_address;
@@ -892,8 +1184,11 @@ get_device_address(ulong devaddr, char **bufp, long buflen)
 	BZERO(buf, buflen);
 	BZERO(buf2, BUFSIZE);
 
-        readmem(devaddr + net->dev_ip_ptr, KVADDR,
-        	&ip_ptr, sizeof(ulong), "ip_ptr", FAULT_ON_ERROR);
+	if (devbuf)
+		ip_ptr = ULONG(devbuf + net->dev_ip_ptr);
+	else
+        	readmem(devaddr + net->dev_ip_ptr, KVADDR,
+        		&ip_ptr, sizeof(ulong), "ip_ptr", FAULT_ON_ERROR);
 
 	if (!ip_ptr)
 		return buflen;
@@ -937,6 +1232,7 @@ get_sock_info(ulong sock, char *buf)
 	uint16_t u6_addr16_src[8];
 	uint16_t u6_addr16_dest[8];
 	char buf2[BUFSIZE];
+	char namebuf[16];
 	struct in_addr in_addr;
 	int len;
 
@@ -985,78 +1281,28 @@ get_sock_info(ulong sock, char *buf)
 		break;
 	}
 
-	switch (family)
-	{
-	case AF_UNSPEC:
-		sprintf(buf, "UNSPEC:"); break;
-	case AF_UNIX: 
-		sprintf(buf, "UNIX:"); break;
-	case AF_INET: 
-		sprintf(buf, "INET:"); break;
-	case AF_AX25: 
-		sprintf(buf, "AX25:"); break;
-	case AF_IPX:  
-		sprintf(buf, "IPX:"); break;
-	case AF_APPLETALK:
-		sprintf(buf, "APPLETALK:"); break;
-	case AF_NETROM:
-		sprintf(buf, "NETROM:"); break;
-	case AF_BRIDGE:
-		sprintf(buf, "BRIDGE:"); break;
-	case AF_ATMPVC:
-		sprintf(buf, "ATMPVC:"); break;
-	case AF_X25:  
-		sprintf(buf, "X25:"); break;
-	case AF_INET6:
-		sprintf(buf, "INET6:"); break;
-	case AF_ROSE: 
-		sprintf(buf, "ROSE:"); break;
-	case AF_DECnet:
-		sprintf(buf, "DECnet:"); break;
-	case AF_NETBEUI:
-		sprintf(buf, "NETBEUI:"); break;
-	case AF_SECURITY: 
-		sprintf(buf, "SECURITY/KEY:"); break;
-	case AF_NETLINK: 
-		sprintf(buf, "NETLINK/ROUTE:"); break;
-	case AF_PACKET:  
-		sprintf(buf, "PACKET:"); break;
-	case AF_ASH:     
-		sprintf(buf, "ASH:"); break;
-	case AF_ECONET:  
-		sprintf(buf, "ECONET:"); break;
-	case AF_ATMSVC: 
-		sprintf(buf, "ATMSVC:"); break;
-	case AF_SNA:    
-		sprintf(buf, "SNA:"); break;
-	case AF_IRDA:   
-		sprintf(buf, "IRDA:"); break;
-#ifndef AF_PPPOX
-#define AF_PPPOX 24
-#endif
-	case AF_PPPOX:  
-		sprintf(buf, "PPPOX:"); break;
-	default:
-		sprintf(buf, "%d:", family); break;
+	/*
+	 *  With "set output json|csv", the fields are added to the record
+	 *  begun by sym_socket_dump() instead.
+	 */
+	if (STRUCTURED_OUTPUT()) {
+		record_string("family", socket_family_name(family, namebuf));
+		record_string("type", socket_type_name(type, namebuf));
+		if (family == AF_INET) {
+			in_addr.s_addr = rcv_saddr;
+			record_string("source", inet_ntoa(in_addr));
+			record_long("source_port", ntohs(sport));
+			in_addr.s_addr = daddr;
+			record_string("destination", inet_ntoa(in_addr));
+			record_long("destination_port", ntohs(dport));
+		}
+		goto free_buffers;
 	}
 
-	switch (type)
-	{
-	case SOCK_STREAM:
-		sprintf(&buf[strlen(buf)], "STREAM"); break;
-	case SOCK_DGRAM:
-		sprintf(&buf[strlen(buf)], "DGRAM "); break;
-	case SOCK_RAW:
-		sprintf(&buf[strlen(buf)], "RAW"); break;
-	case SOCK_RDM: 
-		sprintf(&buf[strlen(buf)], "RDM"); break;
-	case SOCK_SEQPACKET:
-		sprintf(&buf[strlen(buf)], "SEQPACKET"); break;
-	case SOCK_PACKET:
-		sprintf(&buf[strlen(buf)], "PACKET"); break;
-	default:
-		sprintf(&buf[strlen(buf)], "%d", type); break;
-	}
+	sprintf(buf, "%s:", socket_family_name(family, namebuf));
+	/* SOCK_DGRAM is padded to line up with SOCK_STREAM */
+	sprintf(&buf[strlen(buf)], "%s%s", socket_type_name(type, namebuf),
+		(type == SOCK_DGRAM) ? " " : "");
 
 	/* make sure we have room at the end... */
 //	sprintf(&buf[strlen(buf)], "%s", space(MINSPACE-1));
@@ -1090,6 +1336,7 @@ get_sock_info(ulong sock, char *buf)
 		}
 	}
 
+free_buffers:
 	if (sockbuf)
 		FREEBUF(sockbuf);
 	if (inet_sockbuf)
@@ -1118,6 +1365,15 @@ get_sock_info(ulong sock, char *buf)
                     "ipv6_daddr buffer", QUIET|RETURN_ON_ERROR))
 			break;
 
+		if (STRUCTURED_OUTPUT()) {
+			record_string("source", dump_in6_addr(u6_addr16_src, buf2));
+			record_long("source_port", ntohs(sport));
+			record_string("destination",
+				dump_in6_addr(u6_addr16_dest, buf2));
+			record_long("destination_port", ntohs(dport));
+			break;
+		}
+
 		sprintf(&buf[strlen(buf)], "%*s ", BITS32() ? 22 : 12,
 			dump_in6_addr_port(u6_addr16_src, sport, buf2, &len));
 		if (BITS32() && (len > 22))
@@ -1130,6 +1386,95 @@ get_sock_info(ulong sock, char *buf)
 	}
 }
 
+/*
+ *  Return the name of a socket address family, or its number if unknown.
+ */
+static char *
+socket_family_name(ushort family, char *buf)
+{
+	switch (family)
+	{
+	case AF_UNSPEC:
+		return "UNSPEC";
+	case AF_UNIX:
+		return "UNIX";
+	case AF_INET:
+		return "INET";
+	case AF_AX25:
+		return "AX25";
+	case AF_IPX:
+		return "IPX";
+	case AF_APPLETALK:
+		return "APPLETALK";
+	case AF_NETROM:
+		return "NETROM";
+	case AF_BRIDGE:
+		return "BRIDGE";
+	case AF_ATMPVC:
+		return "ATMPVC";
+	case AF_X25:
+		return "X25";
+	case AF_INET6:
+		return "INET6";
+	case AF_ROSE:
+		return "ROSE";
+	case AF_DECnet:
+		return "DECnet";
+	case AF_NETBEUI:
+		return "NETBEUI";
+	case AF_SECURITY:
+		return "SECURITY/KEY";
+	case AF_NETLINK:
+		return "NETLINK/ROUTE";
+	case AF_PACKET:
+		return "PACKET";
+	case AF_ASH:
+		return "ASH";
+	case AF_ECONET:
+		return "ECONET";
+	case AF_ATMSVC:
+		return "ATMSVC";
+	case AF_SNA:
+		return "SNA";
+	case AF_IRDA:
+		return "IRDA";
+#ifndef AF_PPPOX
+#define AF_PPPOX 24
+#endif
+	case AF_PPPOX:
+		return "PPPOX";
+	}
+
+	sprintf(buf, "%d", family);
+	return buf;
+}
+
+/*
+ *  Return the name of a socket type, or its number if unknown.
+ */
+static char *
+socket_type_name(ushort type, char *buf)
+{
+	switch (type)
+	{
+	case SOCK_STREAM:
+		return "STREAM";
+	case SOCK_DGRAM:
+		return "DGRAM";
+	case SOCK_RAW:
+		return "RAW";
+	case SOCK_RDM:
+		return "RDM";
+	case SOCK_SEQPACKET:
+		return "SEQPACKET";
+	case SOCK_PACKET:
+		return "PACKET";
+	}
+
+	sprintf(buf, "%d", type);
+	return buf;
+}
+
 static char *
 dump_in6_addr_port(uint16_t *addr, uint16_t port, char *buf, int *len)
 {
@@ -1150,6 +1495,22 @@ dump_in6_addr_port(uint16_t *addr, uint16_t port, char *buf, int *len)
 	return buf;
 }
 
+static char *
+dump_in6_addr(uint16_t *addr, char *buf)
+{
+	sprintf(buf, "%x:%x:%x:%x:%x:%x:%x:%x",
+                ntohs(addr[0]),
+                ntohs(addr[1]),
+                ntohs(addr[2]),
+                ntohs(addr[3]),
+                ntohs(addr[4]),
+                ntohs(addr[5]),
+                ntohs(addr[6]),
+                ntohs(addr[7]));
+
+	return buf;
+}
+
 
 /*
  *	XXX - copied from neighbour.h !!!!!!
@@ -1369,15 +1730,10 @@ dump_sockets(ulong flag, struct reference *ref)
 void
 dump_sockets_workhorse(ulong task, ulong flag, struct reference *ref)
 {
-	ulong files_struct_addr = 0, fdtable_addr = 0;
-	int max_fdset = 0;
-	int max_fds = 0;
-	ulong open_fds_addr = 0;
-	ulong *open_fds;
-	int open_fds_size;
-	ulong fd;
+	ulong files_struct_addr = 0;
+	struct task_fds tf;
 	ulong file;
-	int i, j;
+	int i;
 	int sockets_found = 0;
 	ulong value;
 
@@ -1401,67 +1757,13 @@ dump_sockets_workhorse(ulong task, ulong flag, struct reference *ref)
 	readmem(task + OFFSET(task_struct_files), KVADDR, &files_struct_addr,
             sizeof(void *), "task files contents", FAULT_ON_ERROR);
 
-        if (files_struct_addr) {
-                if (VALID_MEMBER(files_struct_max_fdset)) {
-		 	readmem(files_struct_addr + OFFSET(files_struct_max_fdset),
-		          	KVADDR, &max_fdset, sizeof(int),
-				"files_struct max_fdset", FAULT_ON_ERROR);
-		      	readmem(files_struct_addr + OFFSET(files_struct_max_fds),
-        	        	KVADDR, &max_fds, sizeof(int), "files_struct max_fds",
-                	   	FAULT_ON_ERROR);
-                }
-		else if (VALID_MEMBER(files_struct_fdt)) {
-			readmem(files_struct_addr + OFFSET(files_struct_fdt), KVADDR,
-				&fdtable_addr, sizeof(void *), "fdtable buffer",
-				FAULT_ON_ERROR);
-			if (VALID_MEMBER(fdtable_max_fdset))
-		      		readmem(fdtable_addr + OFFSET(fdtable_max_fdset),
-        	         		KVADDR, &max_fdset, sizeof(int),
-					"fdtable_struct max_fdset", FAULT_ON_ERROR);
-			else
-				max_fdset = -1;
-		      	readmem(fdtable_addr + OFFSET(fdtable_max_fds),
-	      	            	KVADDR, &max_fds, sizeof(int), "fdtable_struct max_fds",
-	               	    	FAULT_ON_ERROR);
-    		}
-	}
-
-	if ((VALID_MEMBER(files_struct_fdt) && !fdtable_addr) ||
-	    !files_struct_addr || (max_fdset == 0) || (max_fds == 0)) {
-		if (!NET_REFERENCE_CHECK(ref))
+	if (!open_task_fds(files_struct_addr, &tf)) {
+		if (!NET_REFERENCE_CHECK(ref) &&
+		    !(STRUCTURED_OUTPUT() && (flag & s_FLAG)))
 			fprintf(fp, "No open sockets.\n");
 		return;
 	}
 
-	if (VALID_MEMBER(fdtable_open_fds)){
-		readmem(fdtable_addr + OFFSET(fdtable_open_fds), KVADDR,
-     	  		&open_fds_addr, sizeof(void *), "files_struct open_fds addr",
-	            	FAULT_ON_ERROR);
-		readmem(fdtable_addr + OFFSET(fdtable_fd), KVADDR, &fd,
-           		sizeof(void *), "files_struct fd addr", FAULT_ON_ERROR);
-	} else {
-		readmem(files_struct_addr + OFFSET(files_struct_open_fds), KVADDR,
-            		&open_fds_addr, sizeof(void *), "files_struct open_fds addr",
-	          	FAULT_ON_ERROR);
-		readmem(files_struct_addr + OFFSET(files_struct_fd), KVADDR, &fd,
-            		sizeof(void *), "files_struct fd addr", FAULT_ON_ERROR);
-	}
-
-	open_fds_size = MAX(max_fdset, max_fds) / BITS_PER_BYTE;
-	open_fds = (ulong *)GETBUF(open_fds_size);
-	if (!open_fds)
-		return;
-
-	if (open_fds_addr) 
-		readmem(open_fds_addr, KVADDR, open_fds, open_fds_size,
-	               	"files_struct open_fds", FAULT_ON_ERROR);
-    	if (!open_fds_addr || !fd) { 
-		if (!NET_REFERENCE_CHECK(ref))
-			fprintf(fp, "No open sockets.\n");
-		FREEBUF(open_fds);
-        	return;
-	}
-
 	if (NET_REFERENCE_CHECK(ref)) {
                 if (IS_A_NUMBER(ref->str)) {
 	                if (hexadecimal_only(ref->str, 0)) {
@@ -1470,7 +1772,7 @@ dump_sockets_workhorse(ulong task, ulong flag, struct reference *ref)
 	                        ref->cmdflags |= NET_REF_HEXNUM;
 	                } else {
 	                        value = dtol(ref->str, FAULT_ON_ERROR, NULL);
-	                        if (value <= MAX(max_fdset, max_fds)) {
+	                        if (value <= MAX(tf.max_fdset, tf.max_fds)) {
 	                                ref->decval = value;
 	                                ref->cmdflags |= NET_REF_DECNUM;
 	                        } else {
@@ -1483,80 +1785,38 @@ dump_sockets_workhorse(ulong task, ulong flag, struct reference *ref)
 		ref->ref1 = task;
 	}
 
-    	j = 0;
-    	for (;;) {
-	        unsigned long set;
-	        i = j * BITS_PER_LONG;
-	        if (((max_fdset >= 0) && (i >= max_fdset)) || (i >= max_fds))
-	            	break;
-	        set = open_fds[j++];
-	        while (set) {
-	            	if (set & 1) {
-		                readmem(fd + i*sizeof(struct file *), KVADDR, 
-		                        &file, sizeof(struct file *), 
-		                        "fd file", FAULT_ON_ERROR);
-		                if (file) {
-		                    	if (sym_socket_dump(file, i, 
-					    sockets_found, flag, ref)) {
-		                        	sockets_found++;
-					}
-		                }
-	            	}
-	            	i++;
-	            	set >>= 1;
-	        }
-        }
-
-    	if (!sockets_found && !NET_REFERENCE_CHECK(ref))
+	while ((i = next_task_fd(&tf, &file)) >= 0) {
+		if (sym_socket_dump(task, file, i, sockets_found, flag, ref))
+			sockets_found++;
+	}
+
+    	if (!sockets_found && !NET_REFERENCE_CHECK(ref) &&
+	    !(STRUCTURED_OUTPUT() && (flag & s_FLAG)))
         	fprintf(fp, "No open sockets.\n");
 
 	if (NET_REFERENCE_FOUND(ref))
 		fprintf(fp, "\n");
 
-	FREEBUF(open_fds);
+	close_task_fds(&tf);
 }
 
 
 /*
- *  Dump a struct socket symbolically.  Dave makes this _very_ easy.
- *
- *  Return TRUE if we found a socket, FALSE otherwise.
+ *  If a file is a socket, return TRUE, along with the addresses of its
+ *  struct socket and its sock.
  */
-
-static char *socket_hdr_32 = 
-"FD   SOCKET     SOCK    FAMILY:TYPE          SOURCE-PORT      DESTINATION-PORT";
-static char *socket_hdr_64 = 
-"FD      SOCKET            SOCK       FAMILY:TYPE SOURCE-PORT DESTINATION-PORT";
-
 static int
-sym_socket_dump(ulong file, 
-		int fd, 
-		int sockets_found, 
-		ulong flag,
-		struct reference *ref)
+file_to_socket(ulong file, ulong *struct_socket, ulong *sock)
 {
 	uint16_t umode16 = 0;
 	uint32_t umode32 = 0;
     	uint mode = 0;
-    	ulong dentry = 0, inode = 0,
-        struct_socket = 0;
-	ulong sock = 0;
+    	ulong dentry = 0, inode = 0;
 	char *file_buf, *dentry_buf, *inode_buf, *socket_buf;
-	char buf1[BUFSIZE];
-	char buf2[BUFSIZE];
-	char *socket_hdr = BITS32() ? socket_hdr_32 : socket_hdr_64;
-	unsigned int radix;
 
 	file_buf = fill_file_cache(file);
 	dentry = ULONG(file_buf + OFFSET(file_f_dentry));
 
-	if (flag & d_FLAG)
-		radix = 10;
-	else if (flag & x_FLAG)
-		radix = 16;
-	else
-		radix = 0;
-
     	if (!dentry)
         	return FALSE;
 
@@ -1564,11 +1824,10 @@ sym_socket_dump(ulong file,
 	inode = ULONG(dentry_buf + OFFSET(dentry_d_inode));
 
     	if (!inode)
-        	return FALSE; 
+        	return FALSE;
 
 	inode_buf = fill_inode_cache(inode);
 
-
 	switch (SIZE(umode_t))
 	{
 	case SIZEOF_32BIT:
@@ -1588,28 +1847,67 @@ sym_socket_dump(ulong file,
     	if (!S_ISSOCK(mode))
         	return FALSE;
 
-	/* 
-	 * 2.6 (SOCK_V2) -- socket is inode addr minus sizeof(struct socket) 
+	/*
+	 * 2.6 (SOCK_V2) -- socket is inode addr minus sizeof(struct socket)
 	 */
-	switch (net->flags & (SOCK_V1|SOCK_V2))  
+	switch (net->flags & (SOCK_V1|SOCK_V2))
 	{
 	case SOCK_V1:
-    		struct_socket = inode + OFFSET(inode_u);
-		sock = ULONG(inode_buf + OFFSET(inode_u) + OFFSET(socket_sk));
+    		*struct_socket = inode + OFFSET(inode_u);
+		*sock = ULONG(inode_buf + OFFSET(inode_u) + OFFSET(socket_sk));
 		break;
 
 	case SOCK_V2:
-		if (!VALID_SIZE(inet_sock)) 
-			error(FATAL, 
+		if (!VALID_SIZE(inet_sock))
+			error(FATAL,
               	           "cannot determine what an inet_sock structure is\n");
-    		struct_socket = inode - OFFSET(socket_alloc_vfs_inode);
+    		*struct_socket = inode - OFFSET(socket_alloc_vfs_inode);
 		socket_buf = GETBUF(SIZE(socket));
-                readmem(struct_socket, KVADDR, socket_buf,
+                readmem(*struct_socket, KVADDR, socket_buf,
                         SIZE(socket), "socket buffer", FAULT_ON_ERROR);
-		sock = ULONG(socket_buf + OFFSET(socket_sk));
+		*sock = ULONG(socket_buf + OFFSET(socket_sk));
 		FREEBUF(socket_buf);
 		break;
-	} 
+	}
+
+	return TRUE;
+}
+
+/*
+ *  Dump a struct socket symbolically.  Dave makes this _very_ easy.
+ *
+ *  Return TRUE if we found a socket, FALSE otherwise.
+ */
+
+static char *socket_hdr_32 = 
+"FD   SOCKET     SOCK    FAMILY:TYPE          SOURCE-PORT      DESTINATION-PORT";
+static char *socket_hdr_64 = 
+"FD      SOCKET            SOCK       FAMILY:TYPE SOURCE-PORT DESTINATION-PORT";
+
+static int
+sym_socket_dump(ulong task,
+		ulong file,
+		int fd, 
+		int sockets_found, 
+		ulong flag,
+		struct reference *ref)
+{
+    	ulong struct_socket = 0;
+	ulong sock = 0;
+	char buf1[BUFSIZE];
+	char buf2[BUFSIZE];
+	char *socket_hdr = BITS32() ? socket_hdr_32 : socket_hdr_64;
+	unsigned int radix;
+
+	if (flag & d_FLAG)
+		radix = 10;
+	else if (flag & x_FLAG)
+		radix = 16;
+	else
+		radix = 0;
+
+	if (!file_to_socket(file, &struct_socket, &sock))
+		return FALSE;
 
 	if (NET_REFERENCE_CHECK(ref)) {
 		if ((ref->cmdflags & NET_REF_HEXNUM) &&
@@ -1670,6 +1968,17 @@ sym_socket_dump(ulong file,
 		break;
 
 	case s_FLAG:
+		if (STRUCTURED_OUTPUT()) {
+			record_begin("socket");
+			record_long("pid", task_to_pid(task));
+			record_long("fd", fd);
+			record_hex("socket", struct_socket);
+			record_hex("sock", sock);
+			get_sock_info(sock, buf1);
+			record_end();
+			return TRUE;
+		}
+
 		if (!sockets_found) {
 			fprintf(fp, "%s\n", socket_hdr);
 		}
@@ -1694,3 +2003,336 @@ sym_socket_dump(ulong file,
 
     	return TRUE;
 }
+
+/*
+ *  "net -s -t": the sockets of a set of tasks, counted by family and
+ *  type, by TCP state, and by TCP and UDP local port.  Each files_struct
+ *  is walked once, however many tasks share it, and each struct file
+ *  is counted once, however many descriptors refer to it.
+ */
+#define TCP_STATES           (13)
+#define SOCKET_SUMMARY_TYPES (64)
+#define SOCKET_SUMMARY_PORTS (20)	/* ports shown for TCP and UDP */
+#define SOCKET_UNREADABLE    (-1)
+
+static char *tcp_state_names[TCP_STATES] = {
+	"0", "ESTABLISHED", "SYN_SENT", "SYN_RECV", "FIN_WAIT1",
+	"FIN_WAIT2", "TIME_WAIT", "CLOSE", "CLOSE_WAIT", "LAST_ACK",
+	"LISTEN", "CLOSING", "NEW_SYN_RECV"
+};
+
+struct socket_summary_info {
+	ulong file;
+	int family;
+	int type;
+	int state;
+	int port;
+};
+
+struct socket_summary {
+	ulong *files_structs;	/* one per job */
+	int tasks;
+	int forked;
+	pid_t pid;
+	ulong sockets;
+	ulong unreadable;
+	int ntypes;
+	struct {
+		int family;
+		int type;
+		ulong count;
+	} types[SOCKET_SUMMARY_TYPES];
+	ulong other_types;
+	ulong tcp_states[TCP_STATES+1];	/* last is any other state */
+	ulong *tcp_ports;
+	ulong *udp_ports;
+};
+
+/*
+ *  Gather the summary fields of a socket file, reading only as much of
+ *  the sock as they require.
+ */
+static int
+get_socket_summary_info(ulong file, struct socket_summary_info *ssi)
+{
+	ulong struct_socket, sock;
+	long len;
+	char *sockbuf;
+
+	if (!file_to_socket(file, &struct_socket, &sock))
+		return FALSE;
+
+	ssi->file = file;
+	ssi->family = SOCKET_UNREADABLE;
+	ssi->type = ssi->state = ssi->port = 0;
+
+	len = MAX(OFFSET(sock_common_skc_family), OFFSET(sock_sk_type)) +
+		sizeof(ushort);
+	if (VALID_MEMBER(sock_common_skc_state))
+		len = MAX(len, OFFSET(sock_common_skc_state) + 1);
+	len = MAX(len, OFFSET(inet_sock_inet) + OFFSET(inet_opt_sport) +
+		sizeof(ushort));
+
+	sockbuf = GETBUF(len);
+	if (sock && readmem(sock, KVADDR, sockbuf, len, "sock buffer",
+	    RETURN_ON_ERROR|QUIET)) {
+		ssi->family = USHORT(sockbuf + OFFSET(sock_common_skc_family));
+		ssi->type = USHORT(sockbuf + OFFSET(sock_sk_type));
+		if (VALID_MEMBER(sock_common_skc_state))
+			ssi->state = UCHAR(sockbuf +
+				OFFSET(sock_common_skc_state));
+		if ((ssi->family == AF_INET) || (ssi->family == AF_INET6))
+			ssi->port = ntohs(USHORT(sockbuf +
+				OFFSET(inet_sock_inet) + OFFSET(inet_opt_sport)));
+	}
+	FREEBUF(sockbuf);
+
+	return TRUE;
+}
+
+static void
+socket_summary_add(struct socket_summary *ss, struct socket_summary_info *ssi)
+{
+	int i;
+
+	ss->sockets++;
+
+	if (ssi->family == SOCKET_UNREADABLE) {
+		ss->unreadable++;
+		return;
+	}
+
+	for (i = 0; i < ss->ntypes; i++) {
+		if ((ss->types[i].family == ssi->family) &&
+		    (ss->types[i].type == ssi->type))
+			break;
+	}
+	if (i < ss->ntypes)
+		ss->types[i].count++;
+	else if (ss->ntypes < SOCKET_SUMMARY_TYPES) {
+		ss->types[i].family = ssi->family;
+		ss->types[i].type = ssi->type;
+		ss->types[i].count = 1;
+		ss->ntypes++;
+	} else
+		ss->other_types++;
+
+	if ((ssi->family != AF_INET) && (ssi->family != AF_INET6))
+		return;
+
+	switch (ssi->type)
+	{
+	case SOCK_STREAM:
+		if ((ssi->state > 0) && (ssi->state < TCP_STATES))
+			ss->tcp_states[ssi->state]++;
+		else
+			ss->tcp_states[TCP_STATES]++;
+		ss->tcp_ports[ssi->port & 0xffff]++;
+		break;
+
+	case SOCK_DGRAM:
+		ss->udp_ports[ssi->port & 0xffff]++;
+		break;
+	}
+}
+
+/*
+ *  Count the sockets of one files_struct.  In a run_forked() worker, the
+ *  sockets are written out as "SOCK" lines for the parent to count.
+ *  Files already seen are skipped by way of the hash queue, except when
+ *  the parent re-runs a job that a worker failed to complete, since the
+ *  parent uses the hash queue to skip the files reported by more than one
+ *  worker process.
+ */
+static void
+socket_summary_job(void *arg, int j)
+{
+	struct socket_summary *ss = arg;
+	struct socket_summary_info ssi;
+	struct task_fds tf;
+	ulong file;
+
+	if (!open_task_fds(ss->files_structs[j], &tf))
+		return;
+
+	while (next_task_fd(&tf, &file) >= 0) {
+		if ((!ss->forked || (getpid() != ss->pid)) && !hq_enter(file))
+			continue;
+		if (!get_socket_summary_info(file, &ssi))
+			continue;
+		if (ss->forked)
+			fprintf(fp, "SOCK %lx %d %d %d %d\n", ssi.file,
+				ssi.family, ssi.type, ssi.state, ssi.port);
+		else
+			socket_summary_add(ss, &ssi);
+	}
+
+	close_task_fds(&tf);
+}
+
+static void
+socket_summary_task(struct socket_summary *ss, struct task_context *tc,
+		    int *njobs)
+{
+	ulong files_struct;
+
+	ss->tasks++;
+
+	if (!readmem(tc->task + OFFSET(task_struct_files), KVADDR,
+	    &files_struct, sizeof(void *), "task files contents",
+	    RETURN_ON_ERROR|QUIET) || !files_struct)
+		return;
+
+	if (hq_enter(files_struct))
+		ss->files_structs[(*njobs)++] = files_struct;
+}
+
+static void
+dump_socket_ports(char *proto, ulong *ports)
+{
+	int i, j, shown, top[SOCKET_SUMMARY_PORTS];
+
+	for (shown = 0; shown < SOCKET_SUMMARY_PORTS; shown++) {
+		for (i = 0, top[shown] = -1; i <= 0xffff; i++) {
+			if (!ports[i])
+				continue;
+			for (j = 0; (j < shown) && (top[j] != i); j++)
+				;
+			if ((j == shown) &&
+			    ((top[shown] < 0) || (ports[i] > ports[top[shown]])))
+				top[shown] = i;
+		}
+		if (top[shown] < 0)
+			break;
+	}
+
+	if (!shown)
+		return;
+
+	fprintf(fp, "\n%s PORT     SOCKETS\n", proto);
+	for (i = 0; i < shown; i++)
+		fprintf(fp, "%8d  %10ld\n", top[i], ports[top[i]]);
+}
+
+static void
+dump_socket_summary(int threads)
+{
+	int i, njobs, ret;
+	ulong value;
+	struct task_context *tc;
+	struct socket_summary *ss;
+	struct socket_summary_info ssi;
+	char buf[BUFSIZE];
+	char namebuf1[16], namebuf2[16];
+
+	if (!(net->flags & SOCK_V2) || INVALID_MEMBER(sock_common_skc_family))
+		option_not_supported('t');
+
+	ss = (struct socket_summary *)GETBUF(sizeof(struct socket_summary));
+	ss->files_structs = (ulong *)GETBUF(sizeof(ulong) * RUNNING_TASKS());
+	ss->tcp_ports = (ulong *)GETBUF(sizeof(ulong) * 65536);
+	ss->udp_ports = (ulong *)GETBUF(sizeof(ulong) * 65536);
+	ss->pid = getpid();
+
+	hq_open();
+
+	njobs = 0;
+	if (!args[optind]) {
+		tc = FIRST_CONTEXT();
+		for (i = 0; i < RUNNING_TASKS(); i++, tc++)
+			socket_summary_task(ss, tc, &njobs);
+	}
+
+	while (args[optind]) {
+                switch (str_to_context(args[optind], &value, &tc))
+                {
+                case STR_PID:
+                        for (tc = pid_to_context(value); tc; tc = tc->tc_next)
+				socket_summary_task(ss, tc, &njobs);
+                        break;
+
+                case STR_TASK:
+			socket_summary_task(ss, tc, &njobs);
+                        break;
+
+                case STR_INVALID:
+                        error(INFO, "invalid task or pid value: %s\n",
+				args[optind]);
+                        break;
+                }
+
+		optind++;
+	}
+
+	ret = FORKED_SERIAL;
+	if ((threads > 1) && (njobs > 1)) {
+		ss->forked = TRUE;
+		open_tmpfile();
+		ret = run_forked(threads, njobs, socket_summary_job, ss);
+		if (ret == FORKED_DONE) {
+			rewind(pc->tmpfile);
+			while (fgets(buf, BUFSIZE, pc->tmpfile)) {
+				if (sscanf(buf, "SOCK %lx %d %d %d %d",
+				    &ssi.file, &ssi.family, &ssi.type,
+				    &ssi.state, &ssi.port) != 5) {
+					fprintf(pc->saved_fp, "%s", buf);
+					continue;
+				}
+				if (hq_enter(ssi.file))
+					socket_summary_add(ss, &ssi);
+			}
+		}
+		close_tmpfile();
+		if (ret == FORKED_BAILOUT) {
+			hq_close();
+			return;
+		}
+		ss->forked = FALSE;
+	}
+
+	if (ret == FORKED_SERIAL) {
+		for (i = 0; i < njobs; i++)
+			socket_summary_job(ss, i);
+	}
+
+	hq_close();
+
+	fprintf(fp, "  TASKS: %d  FILES_STRUCTS: %d  SOCKETS: %ld",
+		ss->tasks, njobs, ss->sockets);
+	if (ss->unreadable)
+		fprintf(fp, " (%ld unreadable)", ss->unreadable);
+	fprintf(fp, "\n");
+
+	if (ss->ntypes || ss->other_types)
+		fprintf(fp, "\n%-20s  %10s\n", "FAMILY:TYPE", "SOCKETS");
+	for (i = 0; i < ss->ntypes; i++) {
+		sprintf(buf, "%s:%s",
+			socket_family_name(ss->types[i].family, namebuf1),
+			socket_type_name(ss->types[i].type, namebuf2));
+		fprintf(fp, "%-20s  %10ld\n", buf, ss->types[i].count);
+	}
+	if (ss->other_types)
+		fprintf(fp, "%-20s  %10ld\n", "(other)", ss->other_types);
+
+	for (i = 0, value = 0; i <= TCP_STATES; i++)
+		value += ss->tcp_states[i];
+	if (value) {
+		fprintf(fp, "\n%-20s  %10s\n", "TCP STATE", "SOCKETS");
+		for (i = 1; i < TCP_STATES; i++) {
+			if (ss->tcp_states[i])
+				fprintf(fp, "%-20s  %10ld\n",
+					tcp_state_names[i], ss->tcp_states[i]);
+		}
+		if (ss->tcp_states[TCP_STATES])
+			fprintf(fp, "%-20s  %10ld\n", "(other)",
+				ss->tcp_states[TCP_STATES]);
+	}
+
+	dump_socket_ports("TCP", ss->tcp_ports);
+	dump_socket_ports("UDP", ss->udp_ports);
+
+	FREEBUF(ss->files_structs);
+	FREEBUF(ss->tcp_ports);
+	FREEBUF(ss->udp_ports);
+	FREEBUF(ss);
+}
@@ -43,6 +43,10 @@ static void get_netdump_regs_arm(struct bt_info *, ulong *, ulong *);
 static void get_netdump_regs_arm64(struct bt_info *, ulong *, ulong *);
 static void get_netdump_regs_mips(struct bt_info *, ulong *, ulong *);
 static void check_dumpfile_size(char *);
+static void build_pt_load_index(void);
+static struct pt_load_segment *pt_load_segment_lookup(physaddr_t,
+	struct pt_load_segment **);
+static int netdump_paddr_to_offset(physaddr_t, struct pt_load_segment **, off_t *);
 static int proc_kcore_init_32(FILE *, int);
 static int proc_kcore_init_64(FILE *, int);
 static char *get_regs_from_note(char *, ulong *, ulong *);
@@ -394,6 +398,7 @@ is_netdump(char *file, ulong source_query)
                 dump_Elf32_Phdr(nd->notes32, ELFREAD);
 		for (i = 0; i < nd->num_pt_load_segments; i++) 
                 	dump_Elf32_Phdr(nd->load32 + i, ELFSTORE+i);
+		build_pt_load_index();
         	offset32 = nd->notes32->p_offset;
                 for (tot = 0; tot < nd->notes32->p_filesz; tot += len) {
                         if (!(len = dump_Elf32_Nhdr(offset32, ELFSTORE)))
@@ -432,6 +437,7 @@ is_netdump(char *file, ulong source_query)
                 dump_Elf64_Phdr(nd->notes64, ELFREAD);
 		for (i = 0; i < nd->num_pt_load_segments; i++)
                 	dump_Elf64_Phdr(nd->load64 + i, ELFSTORE+i);
+		build_pt_load_index();
                 offset64 = nd->notes64->p_offset;
                 for (tot = 0; tot < nd->notes64->p_filesz; tot += len) {
                         if (!(len = dump_Elf64_Nhdr(offset64, ELFSTORE)))
@@ -731,69 +737,266 @@ netdump_init(char *unused, FILE *fptr)
 }
 
 /*
- *  Read from a netdump-created dumpfile.
+ *  Returns the end of the physical address range covered by a PT_LOAD
+ *  segment, including any zero-filled p_memsz tail.
+ */
+static inline physaddr_t
+pt_load_extent_end(struct pt_load_segment *pls)
+{
+	return (pls->zero_fill > pls->phys_end) ? pls->zero_fill : pls->phys_end;
+}
+
+static int
+compare_pt_load_segment(const void *v1, const void *v2)
+{
+	struct pt_load_segment *pls1, *pls2;
+
+	pls1 = *(struct pt_load_segment **)v1;
+	pls2 = *(struct pt_load_segment **)v2;
+
+	if (pls1->phys_start < pls2->phys_start)
+		return -1;
+	if (pls1->phys_start > pls2->phys_start)
+		return 1;
+	return 0;
+}
+
+/*
+ *  Once all PT_LOAD segments have been stored, create an index of them
+ *  sorted by physical address, so that pt_load_segment_lookup() can
+ *  binary-search it.  Empty segments are left out.  If the remaining
+ *  segments overlap, the first matching segment in program header order
+ *  has to be used, so the index is not created and lookups fall back to
+ *  a linear scan.
+ */
+static void
+build_pt_load_index(void)
+{
+	int i, cnt;
+	struct pt_load_segment *pls;
+
+	free(nd->pt_load_index);
+	nd->pt_load_index = NULL;
+	nd->num_pt_load_index = 0;
+	nd->pt_load_last = NULL;
+
+	if (nd->num_pt_load_segments < 2)
+		return;
+
+	if ((nd->pt_load_index = (struct pt_load_segment **)
+	    malloc(sizeof(struct pt_load_segment *) *
+	    nd->num_pt_load_segments)) == NULL) {
+		error(INFO, "cannot malloc PT_LOAD segment index\n");
+		return;
+	}
+
+	for (i = cnt = 0; i < nd->num_pt_load_segments; i++) {
+		pls = &nd->pt_load_segments[i];
+		if (pt_load_extent_end(pls) > pls->phys_start)
+			nd->pt_load_index[cnt++] = pls;
+	}
+
+	qsort(nd->pt_load_index, cnt, sizeof(struct pt_load_segment *),
+		compare_pt_load_segment);
+
+	for (i = 1; i < cnt; i++) {
+		if (nd->pt_load_index[i]->phys_start <
+		    pt_load_extent_end(nd->pt_load_index[i-1])) {
+			if (CRASHDEBUG(1))
+				error(INFO, "overlapping PT_LOAD segments: "
+				    "using linear segment search\n");
+			free(nd->pt_load_index);
+			nd->pt_load_index = NULL;
+			return;
+		}
+	}
+
+	nd->num_pt_load_index = cnt;
+}
+
+/*
+ *  Find the PT_LOAD segment whose data or zero-filled tail contains paddr.
+ *  When the index is in use, the segment found by the previous lookup is
+ *  checked first, since consecutive reads are usually of the same segment.
+ */
+static struct pt_load_segment *
+pt_load_segment_lookup(physaddr_t paddr, struct pt_load_segment **last)
+{
+	int i, lo, hi, mid;
+	struct pt_load_segment *pls;
+
+	if (!nd->pt_load_index) {
+		for (i = 0; i < nd->num_pt_load_segments; i++) {
+			pls = &nd->pt_load_segments[i];
+			if ((paddr >= pls->phys_start) &&
+			    (paddr < pls->phys_end))
+				return pls;
+			if (pls->zero_fill && (paddr >= pls->phys_end) &&
+			    (paddr < pls->zero_fill))
+				return pls;
+		}
+		return NULL;
+	}
+
+	if ((pls = *last) && (paddr >= pls->phys_start) &&
+	    (paddr < pt_load_extent_end(pls)))
+		return pls;
+
+	lo = 0;
+	hi = nd->num_pt_load_index - 1;
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		pls = nd->pt_load_index[mid];
+		if (paddr < pls->phys_start)
+			hi = mid - 1;
+		else if (paddr >= pt_load_extent_end(pls))
+			lo = mid + 1;
+		else
+			return (*last = pls);
+	}
+
+	return NULL;
+}
+
+/*
+ *  dumpfile_next_present() backend: find the lowest physical address at
+ *  or above paddr that is contained in a PT_LOAD segment, including its
+ *  zero-filled tail.  Returns FALSE if there are no segments beyond paddr.
+ *  Formats whose reads are not confined to the PT_LOAD segments, or that
+ *  remap addresses before the lookup, report every address as present.
  */
 int
-read_netdump(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr)
+netdump_next_present(physaddr_t paddr, physaddr_t *next)
 {
-	off_t offset;
-	ssize_t read_ret;
+	int i, lo, hi, mid, found;
+	physaddr_t start;
 	struct pt_load_segment *pls;
-	int i;
 
-	offset = 0;
+	*next = paddr;
+
+	switch (DUMPFILE_FORMAT(nd->flags))
+	{
+	case NETDUMP_ELF64:
+	case KDUMP_ELF32:
+	case KDUMP_ELF64:
+		break;
+	default:
+		return TRUE;
+	}
+
+	if ((nd->num_pt_load_segments < 2) || XEN_CORE_DUMPFILE() ||
+	    (nd->flags & QEMU_MEM_DUMP_KDUMP_BACKUP))
+		return TRUE;
+
+	if (!nd->pt_load_index) {
+		for (i = found = 0; i < nd->num_pt_load_segments; i++) {
+			pls = &nd->pt_load_segments[i];
+			if ((pt_load_extent_end(pls) <= pls->phys_start) ||
+			    (pt_load_extent_end(pls) <= paddr))
+				continue;
+			start = MAX(paddr, pls->phys_start);
+			if (!found || (start < *next)) {
+				*next = start;
+				found = TRUE;
+			}
+		}
+		return found;
+	}
+
+	/*
+	 *  Find the first indexed segment that ends above paddr.
+	 */
+	lo = 0;
+	hi = nd->num_pt_load_index;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (pt_load_extent_end(nd->pt_load_index[mid]) <= paddr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == nd->num_pt_load_index)
+		return FALSE;
+
+	*next = MAX(paddr, nd->pt_load_index[lo]->phys_start);
+	return TRUE;
+}
+
+/*
+ *  Translate a physical address into its offset in the dumpfile.  Returns
+ *  TRUE, FALSE if the address is in the zero-filled p_memsz tail of a
+ *  PT_LOAD segment, or READ_ERROR if no segment contains it.  The caller
+ *  passes in the segment lookup hint, so that each readmem_ctx() thread
+ *  can keep its own.
+ */
+static int
+netdump_paddr_to_offset(physaddr_t paddr, struct pt_load_segment **last,
+			off_t *offsetp)
+{
+	struct pt_load_segment *pls;
+
+	*offsetp = 0;
 
 	/*
 	 *  The Elf32_Phdr has 32-bit fields for p_paddr, p_filesz and
 	 *  p_memsz, so for now, multiple PT_LOAD segment support is
 	 *  restricted to 64-bit machines for netdump/diskdump vmcores.
 	 *  However, kexec/kdump has introduced the optional use of a
-         *  64-bit ELF header for 32-bit processors.
-	 */ 
+	 *  64-bit ELF header for 32-bit processors.
+	 */
         switch (DUMPFILE_FORMAT(nd->flags))
 	{
 	case NETDUMP_ELF32:
-		offset = (off_t)paddr + (off_t)nd->header_size;
+		*offsetp = (off_t)paddr + (off_t)nd->header_size;
 		break;
 
 	case NETDUMP_ELF64:
 	case KDUMP_ELF32:
 	case KDUMP_ELF64:
 		if (nd->num_pt_load_segments == 1) {
-			offset = (off_t)paddr + (off_t)nd->header_size -
+			*offsetp = (off_t)paddr + (off_t)nd->header_size -
 				(off_t)nd->pt_load_segments[0].phys_start;
 			break;
 		}
 
-		for (i = offset = 0; i < nd->num_pt_load_segments; i++) {
-			pls = &nd->pt_load_segments[i];
-			if ((paddr >= pls->phys_start) &&
-			    (paddr < pls->phys_end)) {
-				offset = (off_t)(paddr - pls->phys_start) +
-					pls->file_offset;
-				break;
-			}
-			if (pls->zero_fill && (paddr >= pls->phys_end) &&
-			    (paddr < pls->zero_fill)) {
-				memset(bufptr, 0, cnt);
-				if (CRASHDEBUG(8))
-					fprintf(fp, "read_netdump: zero-fill: "
-					    "addr: %lx paddr: %llx cnt: %d\n",
-						addr, (ulonglong)paddr, cnt);
-                		return cnt;
-			}
-		}
-	
-		if (!offset) {
-			if (CRASHDEBUG(8))
-				fprintf(fp, "read_netdump: READ_ERROR: "
-				    "offset not found for paddr: %llx\n",
-					(ulonglong)paddr);
-	                return READ_ERROR;
-		}
-		
+		if (!(pls = pt_load_segment_lookup(paddr, last)))
+			return READ_ERROR;
+		if (paddr >= pls->phys_end)
+			return FALSE;
+		*offsetp = (off_t)(paddr - pls->phys_start) + pls->file_offset;
 		break;
-	}	
+	}
+
+	return TRUE;
+}
+
+/*
+ *  Read from a netdump-created dumpfile.
+ */
+int
+read_netdump(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr)
+{
+	off_t offset;
+	ssize_t read_ret;
+
+	switch (netdump_paddr_to_offset(paddr, &nd->pt_load_last, &offset))
+	{
+	case FALSE:
+		memset(bufptr, 0, cnt);
+		if (CRASHDEBUG(8))
+			fprintf(fp, "read_netdump: zero-fill: "
+			    "addr: %lx paddr: %llx cnt: %d\n",
+				addr, (ulonglong)paddr, cnt);
+		return cnt;
+
+	case READ_ERROR:
+		if (CRASHDEBUG(8))
+			fprintf(fp, "read_netdump: READ_ERROR: "
+			    "offset not found for paddr: %llx\n",
+				(ulonglong)paddr);
+		return READ_ERROR;
+	}
 
 	if (CRASHDEBUG(8))
 		fprintf(fp, "read_netdump: addr: %lx paddr: %llx cnt: %d offset: %llx\n",
@@ -809,6 +1012,21 @@ read_netdump(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr)
 			return READ_ERROR;
 		}
 	} else {
+		if ((pc->flags2 & MMAP_DUMPFILE) && !nd->mmap_tried) {
+			nd->mmap_addr = mmap_dumpfile(nd->ndfd, &nd->mmap_size);
+			nd->mmap_tried = TRUE;
+		}
+
+		/*
+		 *  Reads that extend past the end of the mapping are passed
+		 *  on to read() below for its short-read handling.
+		 */
+		if ((pc->flags2 & MMAP_DUMPFILE) && nd->mmap_addr &&
+		    (offset + cnt <= nd->mmap_size)) {
+			memcpy(bufptr, nd->mmap_addr + offset, cnt);
+			return cnt;
+		}
+
 		if (lseek(nd->ndfd, offset, SEEK_SET) == -1) {
 			if (CRASHDEBUG(8))
 				fprintf(fp, "read_netdump: SEEK_ERROR: "
@@ -853,7 +1071,6 @@ write_netdump(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr)
 {
 	off_t offset;
 	struct pt_load_segment *pls;
-	int i;
 
 	offset = 0;
 
@@ -871,15 +1088,11 @@ write_netdump(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr)
 			break;
 		}
 
-		for (i = offset = 0; i < nd->num_pt_load_segments; i++) {
-			pls = &nd->pt_load_segments[i];
-			if ((paddr >= pls->phys_start) &&
-			    (paddr < pls->phys_end)) {
-				offset = (off_t)(paddr - pls->phys_start) +
-					pls->file_offset;
-				break;
-			}
-		}
+		offset = 0;
+		if ((pls = pt_load_segment_lookup(paddr, &nd->pt_load_last)) &&
+		    (paddr < pls->phys_end))
+			offset = (off_t)(paddr - pls->phys_start) +
+				pls->file_offset;
 	
 		if (!offset) 
 	                return READ_ERROR;
@@ -1244,6 +1457,14 @@ netdump_memory_dump(FILE *fp)
 		netdump_print("              zero_fill: %llx\n", 
 			pls->zero_fill);
 	}
+	netdump_print("          pt_load_index: %lx ", nd->pt_load_index);
+	if (nd->pt_load_index)
+		netdump_print("(%d segments)\n", nd->num_pt_load_index);
+	else
+		netdump_print("(linear search)\n");
+	netdump_print("           pt_load_last: %lx\n", nd->pt_load_last);
+	netdump_print("              mmap_addr: %lx\n", nd->mmap_addr);
+	netdump_print("              mmap_size: %llx\n", (ulonglong)nd->mmap_size);
 	netdump_print("             elf_header: %lx\n", nd->elf_header);
 	netdump_print("                  elf32: %lx\n", nd->elf32);
 	netdump_print("                notes32: %lx\n", nd->notes32);
@@ -1895,9 +2116,6 @@ dump_Elf64_Shdr(Elf64_Shdr *shdr)
 static char *
 vmcoreinfo_read_string(const char *key)
 {
-	int i, j, end;
-	size_t value_length;
-	size_t key_length = strlen(key);
 	char *vmcoreinfo;
 	uint size_vmcoreinfo;
 	char *value = NULL;
@@ -1942,73 +2160,13 @@ vmcoreinfo_read_string(const char *key)
 	} else if (ACTIVE() && pkd->vmcoreinfo) {
 		vmcoreinfo = (char *)pkd->vmcoreinfo;
 		size_vmcoreinfo = pkd->size_vmcoreinfo;
-	} else {
-		vmcoreinfo = NULL;
-		size_vmcoreinfo = 0;
-	}
-
-	if (!vmcoreinfo)
+	} else
 		return NULL;
 
-	/* the '+ 1' is the equal sign */
-	for (i = 0; i < (int)(size_vmcoreinfo - key_length + 1); i++) {
-		/*
-		 * We must also check if we're at the beginning of VMCOREINFO
-		 * or the separating newline is there, and of course if we 
-		 * have a equal sign after the key.
-		 */
-		if ((strncmp(vmcoreinfo+i, key, key_length) == 0) &&
-		    (i == 0 || vmcoreinfo[i-1] == '\n') &&
-		    (vmcoreinfo[i+key_length] == '=')) {
-
-			end = -1;
-
-			/* Found -- search for the next newline. */
-			for (j = i + key_length + 1; 
-			     j < size_vmcoreinfo; j++) {
-				if (vmcoreinfo[j] == '\n') {
-					end = j;
-					break;
-				}
-			}
-
-			/* 
-			 * If we didn't find an end, we assume it's the end 
-			 * of VMCOREINFO data. 
-			 */
-			if (end == -1) {
-				/* Point after the end. */
-				end = size_vmcoreinfo + 1;
-			}
-
-			value_length = end - (1+ i + key_length);
-			value = calloc(value_length+1, sizeof(char));
-			if (value)
-				strncpy(value, vmcoreinfo + i + key_length + 1, 
-					value_length);
-			break;
-		}
-	}
-
-	return value;
-}
-
-/*
- * Reads an integer value from VMCOREINFO.
- */
-static long
-vmcoreinfo_read_integer(const char *key, long default_value)
-{
-	char *string;
-	long retval = default_value;
-
-	string = vmcoreinfo_read_string(key);
-	if (string) {
-		retval = atol(string);
-		free(string);
-	}
+	if (!vmcoreinfo_table_init(vmcoreinfo, size_vmcoreinfo))
+		return NULL;
 
-	return retval;
+	return vmcoreinfo_table_read_string(key);
 }
 
 void
@@ -2159,9 +2317,12 @@ dump_Elf32_Nhdr(Elf32_Off offset, int store)
 			netdump_print("(unused)\n");
 			nd->vmcoreinfo = (char *)(ptr + note->n_namesz + 1);
 			nd->size_vmcoreinfo = note->n_descsz;
-			if (READ_PAGESIZE_FROM_VMCOREINFO() && store)
+			if (READ_PAGESIZE_FROM_VMCOREINFO() && store) {
+				vmcoreinfo_table_init(nd->vmcoreinfo,
+					nd->size_vmcoreinfo);
 				nd->page_size = (uint)
 					vmcoreinfo_read_integer("PAGESIZE", 0);
+			}
 			pc->flags2 |= VMCOREINFO;
 		} else if (eraseinfo) {
 			netdump_print("(unused)\n");
@@ -2447,9 +2608,12 @@ dump_Elf64_Nhdr(Elf64_Off offset, int store)
 				((note->n_namesz + 3) & ~3));
 			nd->size_vmcoreinfo = note->n_descsz;
 
-			if (READ_PAGESIZE_FROM_VMCOREINFO() && store)
+			if (READ_PAGESIZE_FROM_VMCOREINFO() && store) {
+				vmcoreinfo_table_init(nd->vmcoreinfo,
+					nd->size_vmcoreinfo);
 				nd->page_size = (uint)
 					vmcoreinfo_read_integer("PAGESIZE", 0);
+			}
 			pc->flags2 |= VMCOREINFO;
 		} else if (eraseinfo) {
 			netdump_print("(unused)\n");
@@ -3933,6 +4097,65 @@ read_kdump(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr)
 	return read_netdump(fd, bufptr, cnt, addr, paddr);
 }
 
+/*
+ *  readmem_ctx() reader for ELF dumpfiles, which reads the dumpfile with
+ *  pread(), or copies from an existing "set mmap on" mapping, so that it
+ *  can run in any thread.
+ */
+static int
+netdump_read_page_ctx(struct readmem_context *ctx, physaddr_t paddr,
+		      char *bufptr, int cnt)
+{
+	off_t offset;
+	ssize_t read_ret;
+	struct pt_load_segment *last;
+
+	if ((nd->flags & QEMU_MEM_DUMP_KDUMP_BACKUP) &&
+	    (paddr >= nd->backup_src_start) &&
+	    (paddr < nd->backup_src_start + nd->backup_src_size))
+		paddr += nd->backup_offset - nd->backup_src_start;
+
+	last = ctx->hint;
+	switch (netdump_paddr_to_offset(paddr, &last, &offset))
+	{
+	case FALSE:
+		memset(bufptr, 0, cnt);
+		return cnt;
+
+	case READ_ERROR:
+		sprintf(ctx->errmsg, "no PT_LOAD segment for physical "
+			"address: %llx", (ulonglong)paddr);
+		return READ_ERROR;
+	}
+	ctx->hint = last;
+
+	if (nd->mmap_addr && (offset + cnt <= nd->mmap_size)) {
+		memcpy(bufptr, nd->mmap_addr + offset, cnt);
+		return cnt;
+	}
+
+	read_ret = pread(nd->ndfd, bufptr, cnt, offset);
+	if (read_ret != cnt) {
+		if ((read_ret >= 0) && (*diskdump_flags & ZERO_EXCLUDED)) {
+			bzero(bufptr + read_ret, cnt - read_ret);
+			return cnt;
+		}
+		return READ_ERROR;
+	}
+
+	return cnt;
+}
+
+int
+netdump_readmem_context_init(struct readmem_context *ctx)
+{
+	if (FLAT_FORMAT() || XEN_CORE_DUMPFILE())
+		return FALSE;
+
+	ctx->read_page = netdump_read_page_ctx;
+	return TRUE;
+}
+
 int
 write_kdump(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr)
 {
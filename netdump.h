@@ -93,6 +93,12 @@ struct vmcore_data {
 	ulong arch_data2;
 	void *nt_vmcoredd_array[NR_DEVICE_DUMPS];
 	uint  num_vmcoredd_notes;
+	struct pt_load_segment **pt_load_index;	/* sorted by phys_start */
+	uint num_pt_load_index;
+	struct pt_load_segment *pt_load_last;	/* last lookup hit */
+	char *mmap_addr;			/* "set mmap on" mapping */
+	off_t mmap_size;
+	int mmap_tried;
 };
 
 #define DUMP_ELF_INCOMPLETE  0x1   /* dumpfile is incomplete */
@@ -22,6 +22,8 @@
 
 static int ppc64_kvtop(struct task_context *, ulong, physaddr_t *, int);
 static int ppc64_uvtop(struct task_context *, ulong, physaddr_t *, int);
+static int ppc64_vtop_extent(struct task_context *, ulong, int, physaddr_t *, ulong *);
+static int compare_vmemmap(const void *, const void *);
 static ulong ppc64_vmalloc_start(void);
 static int ppc64_vmemmap_to_phys(ulong, physaddr_t *, int);
 static int ppc64_is_task_addr(ulong);
@@ -386,6 +388,7 @@ ppc64_init(int when)
 	        machdep->processor_speed = ppc64_processor_speed;
 	        machdep->uvtop = ppc64_uvtop;
 	        machdep->kvtop = ppc64_kvtop;
+		machdep->vtop_extent = ppc64_vtop_extent;
 	        machdep->get_task_pgd = ppc64_get_task_pgd;
 		machdep->get_stack_frame = ppc64_get_stack_frame;
 		machdep->get_stackbase = ppc64_get_stackbase;
@@ -800,6 +803,7 @@ ppc64_dump_machdep_table(ulong arg)
         fprintf(fp, "    processor_speed: ppc64_processor_speed()\n");
         fprintf(fp, "              uvtop: ppc64_uvtop()\n");
         fprintf(fp, "              kvtop: ppc64_kvtop()\n");
+	fprintf(fp, "        vtop_extent: ppc64_vtop_extent()\n");
         fprintf(fp, "       get_task_pgd: ppc64_get_task_pgd()\n");
 	fprintf(fp, "           dump_irq: ppc64_dump_irq()\n");
         fprintf(fp, "    get_stack_frame: ppc64_get_stack_frame()\n");
@@ -981,6 +985,15 @@ ppc64_vtop(ulong vaddr, ulong *pgd, physaddr_t *paddr, int verbose)
 	return TRUE;
 }
 
+/*
+ * The size of the region translated by the last table entry read by
+ * ppc64_vtop_level4(), which is that of its huge page or page mapping
+ * if the translation succeeded, or that of the region left unmapped by
+ * an empty entry.  For a vmemmap address, it is the size of the block
+ * of the vmemmap_list that it is in.
+ */
+static ulong ppc64_vtop_mapsize = 0;
+
 /*
  * Virtual to physical memory translation. This function will be called
  * by both ppc64_kvtop and ppc64_uvtop.
@@ -1006,6 +1019,7 @@ ppc64_vtop_level4(ulong vaddr, ulong *level4, physaddr_t *paddr, int verbose)
 	pgd_pte = swap64(ULONG(machdep->pgd + PAGEOFFSET(pgdir)), swap);
 	if (verbose)
 		fprintf(fp, "  PGD: %lx => %lx\n", (ulong)pgdir, pgd_pte);
+	ppc64_vtop_mapsize = 1UL << machdep->machspec->l4_shift;
 	if (!pgd_pte)
 		return FALSE;
 
@@ -1025,6 +1039,7 @@ ppc64_vtop_level4(ulong vaddr, ulong *level4, physaddr_t *paddr, int verbose)
 
 		if (verbose)
 			fprintf(fp, "  PUD: %lx => %lx\n", (ulong)page_upper, pud_pte);
+		ppc64_vtop_mapsize = 1UL << machdep->machspec->l3_shift;
 		if (!pud_pte)
 			return FALSE;
 
@@ -1046,6 +1061,7 @@ ppc64_vtop_level4(ulong vaddr, ulong *level4, physaddr_t *paddr, int verbose)
 	if (verbose)
 		fprintf(fp, "  PMD: %lx => %lx\n", (ulong)page_middle, pmd_pte);
 
+	ppc64_vtop_mapsize = 1UL << machdep->machspec->l2_shift;
 	if (!(pmd_pte))
 		return FALSE;
 
@@ -1069,6 +1085,7 @@ ppc64_vtop_level4(ulong vaddr, ulong *level4, physaddr_t *paddr, int verbose)
 	if (verbose)
 		fprintf(fp, "  PTE: %lx => %lx\n", (ulong)page_table, pte);
 
+	ppc64_vtop_mapsize = PAGESIZE();
 	if (!(pte & _PAGE_PRESENT)) {
 		if (pte && verbose) {
 			fprintf(fp, "\n");
@@ -1209,6 +1226,31 @@ ppc64_kvtop(struct task_context *tc, ulong kvaddr,
 		return ppc64_vtop(kvaddr, (ulong *)vt->kernel_pgd[0], paddr, verbose);
 }
 
+/*
+ *  Translate a kernel or user virtual address quietly, and also return
+ *  the number of bytes from it to the end of its vmemmap block, huge
+ *  page or page mapping, or, if it is not mapped, to the end of the
+ *  region left unmapped by the table entry that stopped the walk.  The
+ *  same Linux page tables are walked with the radix and hash MMUs.
+ */
+static int
+ppc64_vtop_extent(struct task_context *tc, ulong vaddr, int memtype,
+		  physaddr_t *paddr, ulong *length)
+{
+	int ret;
+
+	ppc64_vtop_mapsize = PAGESIZE();
+
+	if (memtype == UVADDR)
+		ret = ppc64_uvtop(tc, vaddr, paddr, 0);
+	else
+		ret = ppc64_kvtop(tc, vaddr, paddr, 0);
+
+	*length = ppc64_vtop_mapsize - (vaddr & (ppc64_vtop_mapsize - 1));
+
+	return ret;
+}
+
 static void
 ppc64_init_paca_info(void)
 {
@@ -1353,6 +1395,12 @@ void ppc64_vmemmap_init(void)
 			ms->vmemmap_base = ms->vmemmap_list[i].virt;
 	}
 
+	/*
+	 *  Sort the list for ppc64_vmemmap_to_phys().
+	 */
+	qsort(ms->vmemmap_list, cnt, sizeof(struct ppc64_vmemmap),
+		compare_vmemmap);
+
 	ms->vmemmap_cnt = cnt;
 	machdep->flags |= VMEMMAP_AWARE;
 	if (CRASHDEBUG(1))
@@ -1370,7 +1418,7 @@ out:
 static int
 ppc64_vmemmap_to_phys(ulong kvaddr, physaddr_t *paddr, int verbose)
 {
-	int i;
+	int i, lo, hi;
 	ulong offset;
 	struct machine_specific *ms;
 
@@ -1394,18 +1442,40 @@ ppc64_vmemmap_to_phys(ulong kvaddr, physaddr_t *paddr, int verbose)
 
 	ms = machdep->machspec;
 
-	for (i = 0; i < ms->vmemmap_cnt; i++) {
-		if ((kvaddr >= ms->vmemmap_list[i].virt) &&
-		    (kvaddr < (ms->vmemmap_list[i].virt + ms->vmemmap_psize))) {
-			offset = kvaddr - ms->vmemmap_list[i].virt;
-			*paddr = ms->vmemmap_list[i].phys + offset;
-			return TRUE;
-		}
+	/*
+	 *  Binary search for the last block starting at or below kvaddr.
+	 */
+	for (lo = 0, hi = ms->vmemmap_cnt; lo < hi; ) {
+		i = lo + (hi - lo) / 2;
+		if (ms->vmemmap_list[i].virt <= kvaddr)
+			lo = i + 1;
+		else
+			hi = i;
+	}
+
+	if (lo && (kvaddr < (ms->vmemmap_list[lo-1].virt + ms->vmemmap_psize))) {
+		offset = kvaddr - ms->vmemmap_list[lo-1].virt;
+		*paddr = ms->vmemmap_list[lo-1].phys + offset;
+		ppc64_vtop_mapsize = ms->vmemmap_psize;
+		return TRUE;
 	}
 
 	return FALSE;
 }
 
+static int
+compare_vmemmap(const void *v1, const void *v2)
+{
+	const struct ppc64_vmemmap *m1, *m2;
+
+	m1 = (const struct ppc64_vmemmap *)v1;
+	m2 = (const struct ppc64_vmemmap *)v2;
+
+	if (m1->virt < m2->virt)
+		return -1;
+	return m1->virt > m2->virt;
+}
+
 /*
  *  Determine where vmalloc'd memory starts.
  */
@@ -13,8 +13,26 @@ struct prb_map {
 	char *text_data_ring;
 	unsigned long text_data_ring_size;
 	char *text_data;
+
+	/*
+	 * The descriptor and info rings are read in chunks of
+	 * PRB_CHUNK_RECORDS, and the text data ring through a window of
+	 * PRB_TEXT_WINDOW bytes, rather than in their entirety.
+	 */
+	unsigned long descs_kaddr;
+	unsigned long infos_kaddr;
+	unsigned long text_data_kaddr;
+	unsigned long chunk_index;	/* ring index of descs[0] and infos[0] */
+	unsigned long chunk_count;
+	unsigned long text_window_begin;
+	unsigned long text_window_len;
+	unsigned long text_window_size;
+	int read_error;
 };
 
+#define PRB_CHUNK_RECORDS	(1024)
+#define PRB_TEXT_WINDOW		(1024*1024)
+
 /*
  * desc_state and DESC_* definitions taken from kernel source:
  *
@@ -65,6 +83,7 @@ init_offsets(void)
 	MEMBER_OFFSET_INIT(printk_info_text_len, n, "text_len");
 	MEMBER_OFFSET_INIT(printk_info_level, n, "level");
 	MEMBER_OFFSET_INIT(printk_info_caller_id, n, "caller_id");
+	MEMBER_OFFSET_INIT(printk_info_facility, n, "facility");
 	MEMBER_OFFSET_INIT(printk_info_dev_info, n, "dev_info");
 
 	n = "dev_printk_info";
@@ -100,6 +119,71 @@ init_offsets(void)
 	MEMBER_OFFSET_INIT(atomic_long_t_counter, n, "counter");
 }
 
+/*
+ *  Make the descriptor and info of a record available in m->descs and
+ *  m->infos, reading the chunk of records that starts with it if needed.
+ */
+static int
+prb_read_chunk(struct prb_map *m, unsigned long id)
+{
+	unsigned long index;
+
+	index = id % m->desc_ring_count;
+	if (m->chunk_count && (index >= m->chunk_index) &&
+	    (index < m->chunk_index + m->chunk_count))
+		return TRUE;
+
+	m->chunk_index = index;
+	m->chunk_count = MIN(PRB_CHUNK_RECORDS, m->desc_ring_count - index);
+
+	if (!readmem(m->descs_kaddr + (index * SIZE(prb_desc)), KVADDR,
+	    m->descs, SIZE(prb_desc) * m->chunk_count,
+	    "prb_desc_ring contents", RETURN_ON_ERROR|QUIET)) {
+		error(WARNING, "\ncannot read prb_desc_ring contents\n");
+		m->chunk_count = 0;
+		m->read_error = TRUE;
+		return FALSE;
+	}
+
+	if (!readmem(m->infos_kaddr + (index * SIZE(printk_info)), KVADDR,
+	    m->infos, SIZE(printk_info) * m->chunk_count,
+	    "prb_info_ring contents", RETURN_ON_ERROR|QUIET)) {
+		error(WARNING, "\ncannot read prb_info_ring contents\n");
+		m->chunk_count = 0;
+		m->read_error = TRUE;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ *  Return a pointer to len bytes of the text data ring at offset begin,
+ *  moving the text window there if needed.
+ */
+static char *
+prb_text(struct prb_map *m, unsigned long begin, unsigned long len)
+{
+	if (m->text_window_len && (begin >= m->text_window_begin) &&
+	    (begin + len <= m->text_window_begin + m->text_window_len))
+		return m->text_data + (begin - m->text_window_begin);
+
+	m->text_window_begin = begin;
+	m->text_window_len = MIN(m->text_window_size,
+		m->text_data_ring_size - begin);
+
+	if (!readmem(m->text_data_kaddr + begin, KVADDR, m->text_data,
+	    m->text_window_len, "prb_text_data_ring contents",
+	    RETURN_ON_ERROR|QUIET)) {
+		error(WARNING, "\ncannot read prb_text_data_ring contents\n");
+		m->text_window_len = 0;
+		m->read_error = TRUE;
+		return NULL;
+	}
+
+	return m->text_data;
+}
+
 static void
 dump_record(struct prb_map *m, unsigned long id, int msg_flags)
 {
@@ -114,11 +198,15 @@ dump_record(struct prb_map *m, unsigned long id, int msg_flags)
 	uint64_t ts_nsec;
 	ulonglong nanos;
 	ulonglong seq;
-	int ilen = 0, i;
+	int ilen = 0, i, dataless;
 	char *desc, *info, *text, *p;
 	ulong rem;
 
-	desc = m->descs + ((id % m->desc_ring_count) * SIZE(prb_desc));
+	if (!prb_read_chunk(m, id))
+		return;
+
+	desc = m->descs + (((id % m->desc_ring_count) - m->chunk_index) *
+		SIZE(prb_desc));
 
 	/* skip non-committed record */
 	state_var = ULONG(desc + OFFSET(prb_desc_state_var) +
@@ -127,7 +215,8 @@ dump_record(struct prb_map *m, unsigned long id, int msg_flags)
 	if (state != desc_committed && state != desc_finalized)
 		return;
 
-	info = m->infos + ((id % m->desc_ring_count) * SIZE(printk_info));
+	info = m->infos + (((id % m->desc_ring_count) - m->chunk_index) *
+		SIZE(printk_info));
 
 	seq = ULONGLONG(info + OFFSET(printk_info_seq));
 	caller_id = UINT(info + OFFSET(printk_info_caller_id));
@@ -144,8 +233,35 @@ dump_record(struct prb_map *m, unsigned long id, int msg_flags)
 		     OFFSET(prb_data_blk_lpos_next)) %
 			m->text_data_ring_size;
 
+	if (!(dataless = (begin == next))) {
+		/* handle wrapping data block */
+		if (begin > next)
+			begin = 0;
+
+		/* skip over descriptor ID */
+		begin += sizeof(unsigned long);
+
+		/* handle truncated messages */
+		if (next - begin < text_len)
+			text_len = next - begin;
+
+		if (!(text = prb_text(m, begin, text_len)))
+			return;
+	} else {
+		text = "";
+		text_len = 0;
+	}
+
+	if ((msg_flags & SHOW_LOG_FILTER) &&
+	    !log_filter_match(ULONGLONG(info + OFFSET(printk_info_ts_nsec)),
+	    UCHAR(info + OFFSET(printk_info_level)) >> 5,
+	    VALID_MEMBER(printk_info_facility) ?
+	    UCHAR(info + OFFSET(printk_info_facility)) : -1,
+	    caller_id, TRUE, text, text_len))
+		return;
+
 	/* skip data-less text blocks */
-	if (begin == next)
+	if (dataless)
 		goto out;
 
 	if ((msg_flags & SHOW_LOG_TEXT) == 0) {
@@ -235,32 +351,26 @@ dump_lockless_record_log(int msg_flags)
 	m.desc_ring_count = 1 << UINT(m.desc_ring + OFFSET(prb_desc_ring_count_bits));
 
 	kaddr = ULONG(m.desc_ring + OFFSET(prb_desc_ring_descs));
-	m.descs = GETBUF(SIZE(prb_desc) * m.desc_ring_count);
-	if (!readmem(kaddr, KVADDR, m.descs, SIZE(prb_desc) * m.desc_ring_count,
-		     "prb_desc_ring contents", RETURN_ON_ERROR|QUIET)) {
-		error(WARNING, "\ncannot read prb_desc_ring contents\n");
-		goto out_descs;
-	}
+	m.descs_kaddr = kaddr;
+	m.descs = GETBUF(SIZE(prb_desc) *
+		MIN(PRB_CHUNK_RECORDS, m.desc_ring_count));
 
 	kaddr = ULONG(m.desc_ring + OFFSET(prb_desc_ring_infos));
-	m.infos = GETBUF(SIZE(printk_info) * m.desc_ring_count);
-	if (!readmem(kaddr, KVADDR, m.infos, SIZE(printk_info) * m.desc_ring_count,
-		     "prb_info_ring contents", RETURN_ON_ERROR|QUIET)) {
-		error(WARNING, "\ncannot read prb_info_ring contents\n");
-		goto out_infos;
-	}
+	m.infos_kaddr = kaddr;
+	m.infos = GETBUF(SIZE(printk_info) *
+		MIN(PRB_CHUNK_RECORDS, m.desc_ring_count));
+	m.chunk_index = m.chunk_count = 0;
 
 	/* setup text data ring */
 	m.text_data_ring = m.prb + OFFSET(prb_text_data_ring);
 	m.text_data_ring_size = 1 << UINT(m.text_data_ring + OFFSET(prb_data_ring_size_bits));
 
 	kaddr = ULONG(m.text_data_ring + OFFSET(prb_data_ring_data));
-	m.text_data = GETBUF(m.text_data_ring_size);
-	if (!readmem(kaddr, KVADDR, m.text_data, m.text_data_ring_size,
-		     "prb_text_data_ring contents", RETURN_ON_ERROR|QUIET)) {
-		error(WARNING, "\ncannot read prb_text_data_ring contents\n");
-		goto out_text_data;
-	}
+	m.text_data_kaddr = kaddr;
+	m.text_window_size = MIN(PRB_TEXT_WINDOW, m.text_data_ring_size);
+	m.text_data = GETBUF(m.text_window_size);
+	m.text_window_begin = m.text_window_len = 0;
+	m.read_error = FALSE;
 
 	/* ready to go */
 
@@ -271,19 +381,18 @@ dump_lockless_record_log(int msg_flags)
 
 	hq_open();
 
-	for (id = tail_id; id != head_id; id = (id + 1) & DESC_ID_MASK)
+	for (id = tail_id; (id != head_id) && !m.read_error;
+	     id = (id + 1) & DESC_ID_MASK)
 		dump_record(&m, id, msg_flags);
 
 	/* dump head record */
-	dump_record(&m, id, msg_flags);
+	if (!m.read_error)
+		dump_record(&m, id, msg_flags);
 
 	hq_close();
 
-out_text_data:
 	FREEBUF(m.text_data);
-out_infos:
 	FREEBUF(m.infos);
-out_descs:
 	FREEBUF(m.descs);
 out_prb:
 	FREEBUF(m.prb);
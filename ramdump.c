@@ -27,6 +27,9 @@ struct ramdump_def {
 	int rfd;
 	ulonglong start_paddr;
 	ulonglong end_paddr;
+	char *mmap_addr;		/* "set mmap on" mapping */
+	off_t mmap_size;
+	int mmap_tried;
 };
 
 static struct ramdump_def *ramdump;
@@ -265,6 +268,9 @@ int is_ramdump(char *p)
 			if (!ramdump)
 				error(FATAL, "realloc failure\n");
 			ramdump[nodes - 1].path = pat;
+			ramdump[nodes - 1].mmap_addr = NULL;
+			ramdump[nodes - 1].mmap_size = 0;
+			ramdump[nodes - 1].mmap_tried = FALSE;
 			pat = strtok_r(NULL, "@", &y);
 			ramdump[nodes - 1].start_paddr =
 				htoll(pat, RETURN_ON_ERROR, &err);
@@ -337,6 +343,17 @@ read_ramdump(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr)
 		"read_ramdump: addr: %lx paddr: %llx cnt: %d offset: %llx\n",
 			addr, (ulonglong)paddr, cnt, (ulonglong)offset);
 
+	if ((pc->flags2 & MMAP_DUMPFILE) && !r->mmap_tried) {
+		r->mmap_addr = mmap_dumpfile(r->rfd, &r->mmap_size);
+		r->mmap_tried = TRUE;
+	}
+
+	if ((pc->flags2 & MMAP_DUMPFILE) && r->mmap_addr &&
+	    (offset + cnt <= r->mmap_size)) {
+		memcpy(bufptr, r->mmap_addr + offset, cnt);
+		return cnt;
+	}
+
 	if (lseek(r->rfd, offset, SEEK_SET) == -1) {
 		if (CRASHDEBUG(8))
 			fprintf(fp, "read_ramdump: SEEK_ERROR: "
@@ -392,6 +409,8 @@ dump_ramdump_data()
 			(ulonglong)ramdump[i].start_paddr);
 		fprintf(fp, "                end_paddr: %llx\n", 
 			(ulonglong)ramdump[i].end_paddr);
+		fprintf(fp, "                mmap_addr: %lx\n",
+			(ulong)ramdump[i].mmap_addr);
 	}
 
 	fprintf(fp, "\n");
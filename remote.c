@@ -33,10 +33,21 @@
 #define MAXRECVBUFSIZE (131072) 
 #define READBUFSIZE    (MAXRECVBUFSIZE+DATA_HDRSIZE)
 
+/*
+ *  A "READ_VEC fd count addr len [addr len ...]" request reads a list of
+ *  ranges of a file opened with "OPEN".  Each range is answered like a
+ *  READ_LIVE request, all of them back to back, up to and including the
+ *  first one that fails.  The daemon advertises this, and whether it can
+ *  compress files with zstd for "READ_ZSTD", in its "FEATURES" reply.
+ */
+#define MAX_READ_VEC   (32)
+
 #ifdef DAEMON
 /*
  *  The remote daemon.  
  */
+#include <sys/mman.h>
+#include <pthread.h>
 
 static int daemon_init(void);
 static ulong daemon_htol(char *);
@@ -60,6 +71,37 @@ static void daemon_send(void *, int);
 static int daemon_proc_version(char *);
 static void handle_connection(int);
 
+/*
+ *  Identity of a memory source, which keys the page cache shared by the
+ *  connections.  Sources that may change underneath, like /dev/mem, are
+ *  not regular files and are not cached.
+ */
+struct daemon_source {
+	int type;
+	dev_t dev;
+	ino_t ino;
+};
+
+#define SOURCE_NONE     (0)
+#define SOURCE_FILE     (1)	/* OPEN'd file read by READ_LIVE, READ_VEC */
+#define SOURCE_NETDUMP  (2)	/* READ_NETDUMP */
+#define SOURCE_LKCD     (3)	/* READ_LKCD */
+
+typedef int (*daemon_reader)(int, ulong, char *, int);
+
+#define DAEMON_CACHE_DEFAULT_MB  (256)
+#define DAEMON_CACHE_BLOCK       (4096)
+#define DAEMON_CACHE_WAYS        (8)
+
+static int daemon_cache_init(ulong);
+static void daemon_cache_stats(void);
+static void daemon_source_init(struct daemon_source *, int, int);
+static int daemon_cache_read(struct daemon_source *, daemon_reader, int,
+	ulong, char *, int);
+static int daemon_read_file(int, ulong, char *, int);
+static int daemon_read_netdump(int, ulong, char *, int);
+static int daemon_read_lkcd(int, ulong, char *, int);
+
 struct remote_context {
         int sock;
         int remdebug; 
@@ -76,12 +118,18 @@ main(int argc, char **argv)
         struct hostent *hp;
         ushort tcp_port;
         char hostname[MAXHOSTNAMELEN];
+	ulong cache_mb;
 
 	tcp_port = 0;
+	cache_mb = DAEMON_CACHE_DEFAULT_MB;
         optind = 0;
-        while ((c = getopt(argc, argv, "vd:")) > 0) {
+        while ((c = getopt(argc, argv, "vd:c:")) > 0) {
                 switch (c)
                 {
+		case 'c':
+			cache_mb = strtoul(optarg, NULL, 0);
+			break;
+
 		case 'v':
 			printf("%s %s\n", basename(argv[0]), 
 				/* BASELEVEL_REVISION */ "(deprecated)");
@@ -123,6 +171,13 @@ main(int argc, char **argv)
         if (!daemon_init())
                 exit(1);
 
+	/*
+	 *  The page cache is set up before any connection is accepted,
+	 *  so that all of the forked children share it.
+	 */
+	if (cache_mb && !daemon_cache_init(cache_mb))
+		console("page cache of %ld MB not available\n", cache_mb);
+
 	console("<daemon %d initiated>\n", getpid());
 
         if ((sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
@@ -205,7 +260,13 @@ handle_connection(int sock)
 	char *p1, *p2, *p3;
 	size_t cnt;
 	int fds[MAX_REMOTE_FDS];
+	struct daemon_source sources[MAX_REMOTE_FDS];
+	struct daemon_source netdump_source, lkcd_source;
 	int mfd;
+	ulong vec_addr[MAX_READ_VEC];
+	int vec_len[MAX_READ_VEC];
+	struct daemon_source *srcp;
+	int zstd;
 	ulong addr, total, reqsize, bufsize;
         fd_set rfds;
         int len, first, retval, done;
@@ -215,8 +276,11 @@ handle_connection(int sock)
 
 	console("< new connection >\n");
 
-	for (i = 0; i < MAX_REMOTE_FDS; i++)
+	for (i = 0; i < MAX_REMOTE_FDS; i++) {
 		fds[i] = -1;
+		sources[i].type = SOURCE_NONE;
+	}
+	netdump_source.type = lkcd_source.type = SOURCE_NONE;
 
 	while (TRUE) {
 
@@ -266,6 +330,8 @@ handle_connection(int sock)
 						daemon_filesize(fds[i]));
 					strcat(sendbuf, buf1);
 				}
+				daemon_source_init(&sources[i], fds[i],
+					SOURCE_FILE);
 			} else 
 				strcat(sendbuf, " <FAIL>");
 
@@ -290,7 +356,16 @@ handle_connection(int sock)
 
                         BZERO(readbuf, READBUFSIZE);
 
-                        if (lseek(mfd, addr, SEEK_SET) == -1) 
+			for (i = 0; i < MAX_REMOTE_FDS; i++) {
+				if (fds[i] == mfd)
+					break;
+			}
+
+			if (i < MAX_REMOTE_FDS)
+				len = daemon_cache_read(&sources[i],
+				    daemon_read_file, mfd, addr,
+				    &readbuf[DATA_HDRSIZE], len);
+                        else if (lseek(mfd, addr, SEEK_SET) == -1)
                                 len = 0;        
                         else if (read(mfd, &readbuf[DATA_HDRSIZE], len) != len) 
                                 len = 0;
@@ -308,6 +383,87 @@ handle_connection(int sock)
 
                         continue;
 
+		} else if (STRNEQ(recvbuf, "READ_VEC ")) {
+
+			p1 = strtok(recvbuf, " ");   /* READ_VEC */
+			p1 = strtok(NULL, " ");      /* filename id */
+			mfd = atoi(p1);
+			p1 = strtok(NULL, " ");      /* range count */
+			cnt = p1 ? atoi(p1) : 0;
+
+			for (i = 0; (i < cnt) && (i < MAX_READ_VEC); i++) {
+				p2 = strtok(NULL, " ");      /* address */
+				p3 = strtok(NULL, " ");      /* length */
+				if (!p2 || !p3)
+					break;
+				vec_addr[i] = daemon_htol(p2);
+				vec_len[i] = atoi(p3);
+				if ((vec_len[i] <= 0) ||
+				    (vec_len[i] > MAXRECVBUFSIZE))
+					break;
+			}
+			cnt = i;
+
+			/*
+			 *  Let the kernel read ahead of the ranges of a
+			 *  dumpfile while the first ones are being sent.
+			 */
+			if (cnt > 1 && (fstat(mfd, &sbuf) == 0) &&
+			    S_ISREG(sbuf.st_mode))
+				posix_fadvise(mfd, vec_addr[0],
+				    vec_addr[cnt-1] + vec_len[cnt-1] - vec_addr[0],
+				    POSIX_FADV_WILLNEED);
+
+			/*
+			 *  A malformed request gets a single FAIL reply.
+			 */
+			if (!cnt) {
+				sprintf(readbuf, "%s%07ld", FAILMSG, (ulong)EINVAL);
+				console("[%s]\n", readbuf);
+				daemon_send(readbuf, DATA_HDRSIZE);
+				continue;
+			}
+
+			for (i = 0; i < MAX_REMOTE_FDS; i++) {
+				if (fds[i] == mfd)
+					break;
+			}
+			srcp = (i < MAX_REMOTE_FDS) ? &sources[i] : NULL;
+
+			for (i = 0; i < cnt; i++) {
+				len = vec_len[i];
+				errno = 0;
+				BZERO(readbuf, DATA_HDRSIZE);
+
+				if ((srcp ? daemon_cache_read(srcp,
+				    daemon_read_file, mfd, vec_addr[i],
+				    &readbuf[DATA_HDRSIZE], len) :
+				    daemon_read_file(mfd, vec_addr[i],
+				    &readbuf[DATA_HDRSIZE], len)) != len) {
+					sprintf(readbuf, "%s%07ld", FAILMSG,
+						(ulong)(errno ? errno : EIO));
+					console("[%s]\n", readbuf);
+					daemon_send(readbuf, DATA_HDRSIZE);
+					break;
+				}
+
+				sprintf(readbuf, "%s%07ld", DONEMSG, (ulong)len);
+				console("(%ld)", len);
+				daemon_send(readbuf, len+DATA_HDRSIZE);
+			}
+			console("\n");
+
+			continue;
+
+		} else if (STRNEQ(recvbuf, "FEATURES")) {
+
+			sprintf(sendbuf, "FEATURES READ_VEC %d%s", MAX_READ_VEC,
+				daemon_file_exists("/usr/bin/zstd", NULL) ?
+				" ZSTD" : "");
+			console("[%s]\n", sendbuf);
+			daemon_send(sendbuf, strlen(sendbuf));
+			continue;
+
                 } else if (STRNEQ(recvbuf, "READ_NETDUMP ")) {
 
                         strcpy(savebuf, recvbuf);
@@ -321,9 +477,9 @@ handle_connection(int sock)
                         BZERO(readbuf, READBUFSIZE);
                         errno = 0;
 
-                        if ((len = read_netdump(UNUSED,
-                            &readbuf[DATA_HDRSIZE], len, UNUSED, addr)) < 0)
-                                len = 0;
+                        len = daemon_cache_read(&netdump_source,
+			    daemon_read_netdump, UNUSED, addr,
+			    &readbuf[DATA_HDRSIZE], len);
 
                         if (len) {
                                 sprintf(readbuf, "%s%07ld", DONEMSG,(ulong)len);                                console("(%ld)\n", (ulong)len);
@@ -380,6 +536,7 @@ handle_connection(int sock)
                                 if (fds[i] == mfd) {
 					close(mfd);
 					fds[i] = -1;
+					sources[i].type = SOURCE_NONE;
 					retval = TRUE;
                                         break;
 				}
@@ -485,10 +642,12 @@ handle_connection(int sock)
                         daemon_send(sendbuf, strlen(sendbuf));
                         continue;
 
-		} else if (STRNEQ(recvbuf, "READ_GZIP ")) {
+		} else if (STRNEQ(recvbuf, "READ_GZIP ") ||
+			   STRNEQ(recvbuf, "READ_ZSTD ")) {
 
                         strcpy(savebuf, recvbuf);
-                        p1 = strtok(recvbuf, " ");   /* READ_GZIP */
+			zstd = STRNEQ(recvbuf, "READ_ZSTD ");
+                        p1 = strtok(recvbuf, " ");   /* READ_GZIP or READ_ZSTD */
 			p1 = strtok(NULL, " ");      /* bufsize */
 			bufsize = atol(p1);
                         file = strtok(NULL, " ");    /* filename */
@@ -496,7 +655,10 @@ handle_connection(int sock)
 			errno = 0;
 			reqsize = bufsize - DATA_HDRSIZE;
 
-                        sprintf(readbuf, "/usr/bin/gzip -c %s", file);
+			if (zstd)
+				sprintf(readbuf, "/usr/bin/zstd -q -c %s", file);
+			else
+                        	sprintf(readbuf, "/usr/bin/gzip -c %s", file);
 
                         if ((pipe = popen(readbuf, "r")) == NULL) {
 				sprintf(readbuf, "%s%07ld", FAILMSG, 
@@ -534,7 +696,7 @@ handle_connection(int sock)
 				daemon_send(readbuf, bufsize);
 			}
 
-			console("GZIP total: %ld\n", total);
+			console("%s total: %ld\n", zstd ? "ZSTD" : "GZIP", total);
 
 			pclose(pipe);
 			continue;
@@ -751,8 +913,15 @@ handle_connection(int sock)
                                 }
                         }
 
-                        sprintf(sendbuf, "%s %s", savebuf,
-                            netdump_init(p3, NULL) ? "OK" : "<FAIL>");
+                        if (netdump_init(p3, NULL)) {
+				sprintf(sendbuf, "%s OK", savebuf);
+				if ((mfd = open(p3, O_RDONLY)) >= 0) {
+					daemon_source_init(&netdump_source,
+						mfd, SOURCE_NETDUMP);
+					close(mfd);
+				}
+			} else
+				sprintf(sendbuf, "%s <FAIL>", savebuf);
 
                         if ((addr = get_netdump_panic_task())) {
                                 sprintf(readbuf, "\npanic_task: %lx\n", addr);
@@ -770,9 +939,12 @@ handle_connection(int sock)
                         p2 = strtok(NULL, " ");      /* fd */
                         p3 = strtok(NULL, " ");      /* dumpfile */
 
-			sprintf(sendbuf, "%s %s", savebuf,
-			    lkcd_dump_init(NULL, atoi(p2), p3) ? 
-				"OK" : "<FAIL>");
+			if (lkcd_dump_init(NULL, atoi(p2), p3)) {
+				sprintf(sendbuf, "%s OK", savebuf);
+				daemon_source_init(&lkcd_source, atoi(p2),
+					SOURCE_LKCD);
+			} else
+				sprintf(sendbuf, "%s <FAIL>", savebuf);
 
 			if ((addr = get_lkcd_panic_task())) {
 				sprintf(readbuf, "\npanic_task: %lx\n", addr);
@@ -805,11 +977,9 @@ handle_connection(int sock)
                         BZERO(readbuf, READBUFSIZE);
 			errno = 0;
 
-                        if (!lkcd_lseek(addr))
-                                len = 0;         
-                        else if (lkcd_read((void *)
-				&readbuf[DATA_HDRSIZE], len) != len)
-                                len = 0;
+                        len = daemon_cache_read(&lkcd_source,
+			    daemon_read_lkcd, mfd, addr,
+			    &readbuf[DATA_HDRSIZE], len);
 
 			if (len) {
 				sprintf(readbuf, "%s%07ld", DONEMSG,(ulong)len);
@@ -979,6 +1149,8 @@ handle_connection(int sock)
 
 		} else if (STRNEQ(recvbuf, "EXIT")) {
 
+			daemon_cache_stats();
+
 			sprintf(sendbuf, "%s OK", recvbuf);
 			console("[%s]\n", sendbuf);
 			daemon_send(sendbuf, strlen(sendbuf));
@@ -1032,6 +1204,222 @@ daemon_send(void *buffer, int len)
 
 	console("daemon_send: sent %d\n", len);
 }
+
+/*
+ *  Page cache shared by all connections, so that the clients that look
+ *  at the same dumpfile at the same time only have it read from disk,
+ *  and in the case of LKCD dumpfiles decompressed, once.  It lives in an
+ *  anonymous shared mapping that the forked children inherit, and is
+ *  made up of DAEMON_CACHE_WAYS-way sets of DAEMON_CACHE_BLOCK blocks,
+ *  keyed by the identity of the source and the block's address in it.
+ *  The lock is a robust, process-shared mutex, so that a child that
+ *  dies while holding it does not hang the others.
+ */
+struct daemon_cache_entry {
+	int type;
+	dev_t dev;
+	ino_t ino;
+	ulong block;
+	ulong last_used;
+};
+
+static struct daemon_cache {
+	pthread_mutex_t lock;
+	ulong nr_sets;
+	ulong clock;
+	ulong hits;
+	ulong misses;
+	struct daemon_cache_entry *entries;
+	char *data;
+} *dcache = NULL;
+
+static void
+daemon_cache_stats(void)
+{
+	if (dcache)
+		console("page cache: %ld hits %ld misses\n",
+			dcache->hits, dcache->misses);
+}
+
+static int
+daemon_cache_init(ulong megabytes)
+{
+	ulong nr_blocks, size;
+	pthread_mutexattr_t attr;
+	char *p;
+
+	nr_blocks = (megabytes * 1024 * 1024) / DAEMON_CACHE_BLOCK;
+	if (nr_blocks < DAEMON_CACHE_WAYS)
+		return FALSE;
+	nr_blocks -= nr_blocks % DAEMON_CACHE_WAYS;
+
+	size = sizeof(struct daemon_cache) +
+		(nr_blocks * sizeof(struct daemon_cache_entry));
+	size = roundup(size, DAEMON_CACHE_BLOCK);
+
+	p = mmap(NULL, size + (nr_blocks * DAEMON_CACHE_BLOCK),
+		PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		console("daemon_cache_init: mmap: %s\n", strerror(errno));
+		return FALSE;
+	}
+
+	dcache = (struct daemon_cache *)p;
+	dcache->nr_sets = nr_blocks / DAEMON_CACHE_WAYS;
+	dcache->entries = (struct daemon_cache_entry *)
+		(p + sizeof(struct daemon_cache));
+	dcache->data = p + size;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	if (pthread_mutex_init(&dcache->lock, &attr)) {
+		munmap(p, size + (nr_blocks * DAEMON_CACHE_BLOCK));
+		dcache = NULL;
+		return FALSE;
+	}
+	pthread_mutexattr_destroy(&attr);
+
+	console("page cache: %ld blocks in %ld sets\n", nr_blocks,
+		dcache->nr_sets);
+
+	return TRUE;
+}
+
+static void
+daemon_cache_lock(void)
+{
+	if (pthread_mutex_lock(&dcache->lock) == EOWNERDEAD)
+		pthread_mutex_consistent(&dcache->lock);
+}
+
+/*
+ *  Key a connection's source by the file's device and inode, if it is
+ *  a regular file, which keeps it from changing while it is cached.
+ */
+static void
+daemon_source_init(struct daemon_source *src, int fd, int type)
+{
+	struct stat sbuf;
+
+	src->type = SOURCE_NONE;
+
+	if (!dcache || (fstat(fd, &sbuf) < 0) || !S_ISREG(sbuf.st_mode))
+		return;
+
+	src->type = type;
+	src->dev = sbuf.st_dev;
+	src->ino = sbuf.st_ino;
+}
+
+static struct daemon_cache_entry *
+daemon_cache_set(struct daemon_source *src, ulong block)
+{
+	ulong hash;
+
+	hash = (block / DAEMON_CACHE_BLOCK) ^ ((ulong)src->ino << 16) ^
+		(ulong)src->dev ^ src->type;
+	hash *= 0x9e3779b97f4a7c15UL;
+	hash ^= hash >> 29;
+
+	return &dcache->entries[(hash % dcache->nr_sets) * DAEMON_CACHE_WAYS];
+}
+
+/*
+ *  Read len bytes at addr of a source through the shared cache.  On a
+ *  miss the complete block is read and entered; requests that cross a
+ *  block boundary, blocks that cannot be read in full, and uncached
+ *  sources are handed to the reader as is.  Returns len, or 0 on failure.
+ */
+static int
+daemon_cache_read(struct daemon_source *src, daemon_reader reader, int fd,
+	ulong addr, char *buf, int len)
+{
+	int i;
+	ulong block;
+	struct daemon_cache_entry *set, *e, *victim;
+	char blockbuf[DAEMON_CACHE_BLOCK];
+
+	block = addr & ~((ulong)DAEMON_CACHE_BLOCK - 1);
+
+	if (!dcache || (src->type == SOURCE_NONE) || (len <= 0) ||
+	    ((addr + len - 1) & ~((ulong)DAEMON_CACHE_BLOCK - 1)) != block)
+		return reader(fd, addr, buf, len);
+
+	set = daemon_cache_set(src, block);
+
+	daemon_cache_lock();
+	for (i = 0, victim = set; i < DAEMON_CACHE_WAYS; i++) {
+		e = &set[i];
+		if ((e->type == src->type) && (e->block == block) &&
+		    (e->ino == src->ino) && (e->dev == src->dev)) {
+			e->last_used = ++dcache->clock;
+			dcache->hits++;
+			memcpy(buf, dcache->data + ((e - dcache->entries) *
+				DAEMON_CACHE_BLOCK) + (addr - block), len);
+			pthread_mutex_unlock(&dcache->lock);
+			return len;
+		}
+		if (e->last_used < victim->last_used)
+			victim = e;
+	}
+	dcache->misses++;
+	pthread_mutex_unlock(&dcache->lock);
+
+	if (reader(fd, block, blockbuf, DAEMON_CACHE_BLOCK) != DAEMON_CACHE_BLOCK)
+		return reader(fd, addr, buf, len);
+
+	memcpy(buf, blockbuf + (addr - block), len);
+
+	/*
+	 *  Another connection may have entered the block meanwhile, in
+	 *  which case this possibly chooses the same victim again.
+	 */
+	daemon_cache_lock();
+	for (i = 0, victim = set; i < DAEMON_CACHE_WAYS; i++) {
+		e = &set[i];
+		if ((e->type == src->type) && (e->block == block) &&
+		    (e->ino == src->ino) && (e->dev == src->dev)) {
+			victim = NULL;
+			break;
+		}
+		if (e->last_used < victim->last_used)
+			victim = e;
+	}
+	if (victim) {
+		victim->type = src->type;
+		victim->dev = src->dev;
+		victim->ino = src->ino;
+		victim->block = block;
+		victim->last_used = ++dcache->clock;
+		memcpy(dcache->data + ((victim - dcache->entries) *
+			DAEMON_CACHE_BLOCK), blockbuf, DAEMON_CACHE_BLOCK);
+	}
+	pthread_mutex_unlock(&dcache->lock);
+
+	return len;
+}
+
+static int
+daemon_read_file(int fd, ulong addr, char *buf, int len)
+{
+	return (pread(fd, buf, len, addr) == len) ? len : 0;
+}
+
+static int
+daemon_read_netdump(int fd, ulong addr, char *buf, int len)
+{
+	return (read_netdump(UNUSED, buf, len, UNUSED, addr) == len) ? len : 0;
+}
+
+static int
+daemon_read_lkcd(int fd, ulong addr, char *buf, int len)
+{
+	if (!lkcd_lseek(addr))
+		return 0;
+
+	return (lkcd_read((void *)buf, len) == len) ? len : 0;
+}
  
 /*
  *  debug print if the -d command line option was used.
@@ -1813,15 +2201,22 @@ static int remote_tcp_read(int, const char *, size_t);
 static int remote_tcp_read_string(int, const char *, size_t, int);
 static int remote_tcp_write(int, const void *, size_t);
 static int remote_tcp_write_string(int, const char *);
+static void remote_features(void);
+static int remote_read_reply(char *, int);
 
 struct _remote_context {
         uint flags;
         int n_cpus;
         int vfd;
         char remote_type[10];
+        int max_read_vec;
 } remote_context;
 
 #define NIL_FLAG       (0x01U)
+#define READ_VEC_FLAG  (0x02U)
+#define ZSTD_FLAG      (0x04U)
+
+#define REMOTE_READAHEAD_PAGES (16)
 
 #define NIL_MODE() (rc->flags & NIL_FLAG)
 
@@ -2276,6 +2671,44 @@ remote_file_close(struct remote_file *rfp)
 	return (strstr(recvbuf, "OK") ? TRUE : FALSE);
 }
 
+/*
+ *  Find out whether the daemon handles READ_VEC requests, and whether it
+ *  can compress files with zstd.  Daemons that predate the FEATURES
+ *  request fail it.
+ */
+static void
+remote_features(void)
+{
+	char sendbuf[BUFSIZE];
+	char recvbuf[BUFSIZE];
+	char *p1;
+
+	if (NIL_MODE())
+		return;
+
+        BZERO(sendbuf, BUFSIZE);
+        BZERO(recvbuf, BUFSIZE);
+        sprintf(sendbuf, "FEATURES");
+        remote_tcp_write_string(pc->sockfd, sendbuf);
+        remote_tcp_read_string(pc->sockfd, recvbuf, BUFSIZE-1, NIL_MODE());
+
+	if (CRASHDEBUG(1))
+		fprintf(fp, "remote_features: [%s]\n", recvbuf);
+
+	if (!STRNEQ(recvbuf, "FEATURES ") || strstr(recvbuf, "FAIL"))
+		return;
+
+	strtok(recvbuf, " ");		/* FEATURES */
+	while ((p1 = strtok(NULL, " "))) {
+		if (STREQ(p1, "READ_VEC") && (p1 = strtok(NULL, " "))) {
+			rc->max_read_vec = MIN(atoi(p1), REMOTE_READAHEAD_PAGES);
+			if (rc->max_read_vec > 1)
+				rc->flags |= READ_VEC_FLAG;
+		} else if (STREQ(p1, "ZSTD"))
+			rc->flags |= ZSTD_FLAG;
+	}
+}
+
 /*
  *  Get a copy of the daemon machine's /proc/version
  */
@@ -2528,6 +2961,8 @@ remote_fd_init(void)
 		program_usage(SHORT_FORM);
 	}
 
+	remote_features();
+
 	/*
 	 *  Account for the remote possibility of a local dumpfile 
 	 *  being entered on the command line.
@@ -3367,13 +3802,24 @@ copy_remote_gzip_file(struct remote_file *rfp, char *file, char *ttystr)
 	size_t gtot;
 	struct stat sbuf;
         ulong pct, ret, req, tot, total;
+	int zstd;
 
-	sprintf(readbuf, "/usr/bin/gunzip > %s", pc->namelist);
+	/*
+	 *  zstd is used instead of gzip if both ends have it, since it
+	 *  compresses and decompresses the kernel several times faster.
+	 */
+	zstd = (rc->flags & ZSTD_FLAG) && file_exists("/usr/bin/zstd", NULL);
+
+	if (zstd)
+		sprintf(readbuf, "/usr/bin/zstd -d -q -c > %s", pc->namelist);
+	else
+		sprintf(readbuf, "/usr/bin/gunzip > %s", pc->namelist);
         if ((pipe = popen(readbuf, "w")) == NULL)
 		error(FATAL, "cannot open pipe to create %s\n", pc->namelist);
 
         BZERO(sendbuf, BUFSIZE);
-        sprintf(sendbuf, "READ_GZIP %ld %s", pc->rcvbufsize, rfp->filename);
+        sprintf(sendbuf, "%s %ld %s", zstd ? "READ_ZSTD" : "READ_GZIP",
+		pc->rcvbufsize, rfp->filename);
         remote_tcp_write_string(pc->sockfd, sendbuf);
 
        	bzero(readbuf, READBUFSIZE);
@@ -3432,7 +3878,8 @@ copy_remote_gzip_file(struct remote_file *rfp, char *file, char *ttystr)
 	}
 
 	if (CRASHDEBUG(1))
-		fprintf(fp, "copy_remote_gzip_file: GZIP total: %ld\n", total);
+		fprintf(fp, "copy_remote_gzip_file: %s total: %ld\n",
+			zstd ? "ZSTD" : "GZIP", total);
 
 	pclose(pipe);
 }
@@ -3686,9 +4133,6 @@ int
 remote_memory_read(int rfd, char *buffer, int cnt, physaddr_t address, int vcpu)
 {
         char sendbuf[BUFSIZE];
-	char datahdr[DATA_HDRSIZE];
-	char *p1;
-	int ret, tot;
 	ulong addr;
 
 	addr = (ulong)address;  /* may be virtual */
@@ -3710,10 +4154,19 @@ remote_memory_read(int rfd, char *buffer, int cnt, physaddr_t address, int vcpu)
 	if (remote_tcp_write_string(pc->sockfd, sendbuf))
 		return -1;
 
-	/*
-	 *  Read request will come back with a singular header 
-	 *  followed by the data.
-         */
+	return remote_read_reply(buffer, cnt);
+}
+
+/*
+ *  Read requests come back with a singular header followed by the data.
+ */
+static int
+remote_read_reply(char *buffer, int cnt)
+{
+	char datahdr[DATA_HDRSIZE];
+	char *p1;
+	int ret, tot;
+
         BZERO(datahdr, DATA_HDRSIZE);
 	ret = remote_tcp_read_string(pc->sockfd, datahdr, DATA_HDRSIZE, 1);
 	if (ret <= 0)
@@ -3753,6 +4206,59 @@ remote_memory_read(int rfd, char *buffer, int cnt, physaddr_t address, int vcpu)
 	return tot;
 }
 
+/*
+ *  Read the page at paddr along with the pages that follow it with one
+ *  READ_VEC request, entering the pages read ahead into the page cache.
+ *  The daemon stops at the first page that cannot be read.  Returns FALSE
+ *  if the daemon or the memory source do not allow it, or if the page at
+ *  paddr could not be read, in which case remote_memory_read() is used.
+ */
+int
+remote_memory_readahead(int rfd, char *buffer, physaddr_t paddr)
+{
+	char sendbuf[BUFSIZE];
+	char *page;
+	int i, n;
+	long psz;
+
+	if (!(rc->flags & READ_VEC_FLAG) || REMOTE_DUMPFILE() ||
+	    !page_cache_size())
+		return FALSE;
+
+	psz = PAGESIZE();
+
+	for (n = 1; n < rc->max_read_vec; n++) {
+		if (!machdep->verify_paddr(paddr + (n * psz)))
+			break;
+	}
+	if (n == 1)
+		return FALSE;
+
+        BZERO(sendbuf, BUFSIZE);
+	sprintf(sendbuf, "READ_VEC %d %d", rfd, n);
+	for (i = 0; i < n; i++)
+		sprintf(&sendbuf[strlen(sendbuf)], " %llx %ld",
+			(ulonglong)(paddr + (i * psz)), psz);
+
+	if (remote_tcp_write_string(pc->sockfd, sendbuf))
+		return FALSE;
+
+	page = GETBUF(psz);
+	for (i = 0; i < n; i++) {
+		if (remote_read_reply(i ? page : buffer, psz) != psz)
+			break;
+		if (i)
+			page_cache_prefill(paddr + (i * psz), page);
+	}
+	FREEBUF(page);
+
+	if (CRASHDEBUG(3))
+		fprintf(fp, "remote_memory_readahead: %llx: %d of %d pages\n",
+			(ulonglong)paddr, i, n);
+
+	return (i > 0);
+}
+
 /*
  *  If a command was interrupted locally, there may be leftover data waiting
  *  to be read.
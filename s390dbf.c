@@ -20,6 +20,7 @@
 #include "defs.h"
 #include <iconv.h>
 #include <ctype.h>
+#include <fnmatch.h>
 
 /*
  * Compat layer to integrate lcrash commands into crash
@@ -281,14 +282,13 @@ typedef struct debug_info_s {
 	int page_order;
 	int buf_size;
 	int entry_size;
-	void **areas; /* contents of debug areas from dump */
+	kaddr_t areas_addr; /* areas pointer array in dump */
 	int active_area;
 	int *active_entry; /* change to uint32_t ? */
 	debug_view_t *views[DEBUG_MAX_VIEWS];
 	char name[DEBUG_MAX_PROCF_LEN];
 	kaddr_t addr;
 	int pages_per_area_v2;
-	void ***areas_v2;
 } debug_info_t;
 
 
@@ -317,6 +317,7 @@ static debug_info_t *debug_area_last  = NULL;
 static debug_view_t *debug_views[LCRASH_DB_VIEWS];
 static int initialized = 0;
 static iconv_t ebcdic_ascii_conv = 0;
+static int dbf_max_level = -1;	/* -l: highest level printed, -1 for all */
 
 void s390dbf_usage(command_t * cmd);
 static int add_lcrash_debug_view(debug_view_t *);
@@ -700,9 +701,64 @@ debug_find_oldest_entry(debug_entry_v1_t *entries, int num, int entry_size)
 }
 
 
+/*
+ * Return whether an entry passes the "-l level" filter, which is applied
+ * before the entry is handed to the header and format functions.
+ */
+static int
+debug_entry_selected(void *entry)
+{
+	int level;
+
+	if (dbf_max_level < 0)
+		return 1;
+	if (dbf_version == DBF_VERSION_V3)
+		level = ((debug_entry_v3_t *) entry)->level;
+	else
+		level = ((debug_entry_v1_t *) entry)->id.fields.level;
+	return level <= dbf_max_level;
+}
+
+/*
+ * Read the contents of debug area "area" into buf with a single read.
+ */
+static void
+debug_read_area_v1(debug_info_t *db_info, int area, void *buf)
+{
+	kaddr_t dbe_addr;
+
+	dbe_addr = KL_VREAD_PTR(db_info->areas_addr + area * KL_NBPW);
+	GET_BLOCK(dbe_addr, PAGE_SIZE << db_info->page_order, buf);
+}
+
+/*
+ * Read the pages of debug area "area" into the contiguous buf.  The page
+ * pointer array is read at once, and pages that are contiguous in the
+ * dump are read together.
+ */
+static void
+debug_read_area_v2(debug_info_t *db_info, int area, char *buf,
+		   kaddr_t *pages)
+{
+	kaddr_t page_array_ptr;
+	int i, j;
+
+	page_array_ptr = KL_VREAD_PTR(db_info->areas_addr + area * KL_NBPW);
+	GET_BLOCK(page_array_ptr, db_info->pages_per_area_v2 * KL_NBPW, pages);
+	for (i = 0; i < db_info->pages_per_area_v2; i = j) {
+		for (j = i + 1; j < db_info->pages_per_area_v2; j++) {
+			if (pages[j] != pages[j - 1] + PAGE_SIZE)
+				break;
+		}
+		/* read raw data for debug area */
+		GET_BLOCK(pages[i], (j - i) * PAGE_SIZE, buf + i * PAGE_SIZE);
+	}
+}
+
 /*
  * debug_format_output:
  * - calls prolog, header and format functions of view to format output
+ * - the debug areas are read and printed one at a time
  */
 static int
 debug_format_output_v1(debug_info_t * debug_area, debug_view_t *view, 
@@ -713,6 +769,7 @@ debug_format_output_v1(debug_info_t * debug_area, debug_view_t *view,
 	debug_entry_v1_t *act_entry, *last_entry;
 	char *act_entry_data;
 	char buf[2048];
+	void *area_buf = NULL;
 	size_t items ATTRIBUTE_UNUSED;
 
 	/* print prolog */
@@ -729,17 +786,24 @@ debug_format_output_v1(debug_info_t * debug_area, debug_view_t *view,
 		goto out;
 	}
 	nr_of_entries = (PAGE_SIZE << debug_area->page_order) / debug_area->entry_size;
+	if ((area_buf = malloc(PAGE_SIZE << debug_area->page_order)) == NULL) {
+		fprintf(KL_ERRORFP, "Could not allocate debug area buffer\n");
+		goto out;
+	}
 	for (i = 0; i < debug_area->nr_areas; i++) {
-		act_entry = debug_find_oldest_entry(debug_area->areas[i],
+		debug_read_area_v1(debug_area, i, area_buf);
+		act_entry = debug_find_oldest_entry(area_buf,
 						    nr_of_entries,
 						    debug_area->entry_size);
-		last_entry = (debug_entry_v1_t *) ((char *) debug_area->areas[i] +
+		last_entry = (debug_entry_v1_t *) ((char *) area_buf +
 			     (PAGE_SIZE << debug_area->page_order) -
 			     debug_area->entry_size);
 		for (j = 0; j < nr_of_entries; j++) {
 			act_entry_data = (char*)act_entry + dbe_size;
 			if (act_entry->id.stck == 0)
 				break;	/* empty entry */
+			if (!debug_entry_selected(act_entry))
+				goto next;
 			if (view->header_proc) {
 				len = view->header_proc(debug_area, view, i,
 						  act_entry, buf);
@@ -752,14 +816,16 @@ debug_format_output_v1(debug_info_t * debug_area, debug_view_t *view,
 				items = fwrite(buf,len, 1, ofp);
 				memset(buf, 0, 2048); 
 			}
+next:
 			act_entry =
 			    (debug_entry_v1_t *) (((char *) act_entry) +
 					       debug_area->entry_size);
 			if (act_entry > last_entry)
-				act_entry = debug_area->areas[i];
+				act_entry = area_buf;
 		}
 	}
       out:
+	free(area_buf);
 	return 1;
 }
 
@@ -775,6 +841,8 @@ debug_format_output_v2(debug_info_t * debug_area,
 	void *act_entry;
 	char *act_entry_data;
 	char buf[2048];
+	char *area_buf = NULL;
+	kaddr_t *pages = NULL;
 	size_t items ATTRIBUTE_UNUSED;
 
 	/* print prolog */
@@ -790,10 +858,19 @@ debug_format_output_v2(debug_info_t * debug_area,
 		fprintf(ofp, "Invalid entry_size: %i\n",debug_area->entry_size);
 		goto out;
 	}
+	if (debug_area->pages_per_area_v2 <= 0)
+		goto out;
+	area_buf = malloc(debug_area->pages_per_area_v2 * PAGE_SIZE);
+	pages = malloc(debug_area->pages_per_area_v2 * sizeof(kaddr_t));
+	if (!area_buf || !pages) {
+		fprintf(KL_ERRORFP, "Could not allocate debug area buffer\n");
+		goto out;
+	}
 	for (i = 0; i < debug_area->nr_areas; i++) {
 		int nr_entries_per_page = PAGE_SIZE/debug_area->entry_size;
+		debug_read_area_v2(debug_area, i, area_buf, pages);
 		for (j = 0; j < debug_area->pages_per_area_v2; j++) {
-			act_entry = debug_area->areas_v2[i][j];
+			act_entry = area_buf + j * PAGE_SIZE;
 			for (k = 0; k < nr_entries_per_page; k++) {
 				act_entry_data = (char*)act_entry + dbe_size;
 				if (dbf_version == DBF_VERSION_V3 &&
@@ -802,6 +879,8 @@ debug_format_output_v2(debug_info_t * debug_area,
 				else if (dbf_version < DBF_VERSION_V3 &&
 				    ((debug_entry_v1_t *) act_entry)->id.stck == 0)
 					break;	/* empty entry */
+				if (!debug_entry_selected(act_entry))
+					goto next;
 				if (view->header_proc) {
 					len = view->header_proc(debug_area, 
 						view, i, act_entry, buf);
@@ -814,15 +893,36 @@ debug_format_output_v2(debug_info_t * debug_area,
 					items = fwrite(buf,len, 1, ofp);
 					memset(buf, 0, 2048); 
 				}
+next:
 				act_entry = ((char *) act_entry) +
 					debug_area->entry_size;
 			}
 		}
 	}
 out:
+	free(area_buf);
+	free(pages);
 	return 1;
 }
 
+/*
+ * Debug log names given on the command line may be shell wildcard
+ * patterns.
+ */
+static int
+is_debug_area_pattern(const char *area_name)
+{
+	return strpbrk(area_name, "*?[") != NULL;
+}
+
+static int
+debug_area_matches(const char *area_name, const char *name)
+{
+	if (is_debug_area_pattern(area_name))
+		return fnmatch(area_name, name, 0) == 0;
+	return strcmp(area_name, name) == 0;
+}
+
 static debug_info_t *
 find_debug_area(const char *area_name)
 {
@@ -907,54 +1007,12 @@ free_debug_view(debug_view_t* view)
 		free(view);
 }
 
-static void
-debug_get_areas_v1(debug_info_t* db_info, void* k_dbi)
-{
-	kaddr_t mem_pos;
-	kaddr_t dbe_addr;
-	int area_size, i;
-
-       	/* get areas */
-	/* place to hold ptrs to debug areas in lcrash */
-	area_size = PAGE_SIZE << db_info->page_order;
-       	db_info->areas = (void**)malloc(db_info->nr_areas * sizeof(void *));
-	memset(db_info->areas, 0, db_info->nr_areas * sizeof(void *));
-       	mem_pos = KL_ULONG(k_dbi,"debug_info","areas");
-       	for (i = 0; i < db_info->nr_areas; i++) {
-		dbe_addr = KL_VREAD_PTR(mem_pos);
-		db_info->areas[i] = (debug_entry_v1_t *) malloc(area_size);
-		/* read raw data for debug area */
-	       	GET_BLOCK(dbe_addr, area_size, db_info->areas[i]);
-		mem_pos += KL_NBPW;
-	}
-}
-
-static void
-debug_get_areas_v2(debug_info_t* db_info, void* k_dbi)
-{
-	kaddr_t area_ptr;
-	kaddr_t page_array_ptr;
-	kaddr_t page_ptr;
-	int i,j;
-       	db_info->areas_v2=(void***)malloc(db_info->nr_areas * sizeof(void **));
-       	area_ptr = KL_ULONG(k_dbi,"debug_info","areas");
-       	for (i = 0; i < db_info->nr_areas; i++) {
-		db_info->areas_v2[i] = (void**)malloc(db_info->pages_per_area_v2
-							* sizeof(void*));
-		page_array_ptr = KL_VREAD_PTR(area_ptr);
-		for(j=0; j < db_info->pages_per_area_v2; j++) {
-			page_ptr = KL_VREAD_PTR(page_array_ptr);
-			db_info->areas_v2[i][j] = (void*)malloc(PAGE_SIZE);
-			/* read raw data for debug area */
-	       		GET_BLOCK(page_ptr, PAGE_SIZE, db_info->areas_v2[i][j]);
-			page_array_ptr += KL_NBPW;
-		}
-		area_ptr += KL_NBPW;
-	}
-}
-
+/*
+ * Copy a debug_info structure from the dump.  The contents of its debug
+ * areas are read later, one area at a time, while they are printed.
+ */
 static debug_info_t*
-get_debug_info(kaddr_t addr,int get_areas)
+get_debug_info(kaddr_t addr)
 {
 	void *k_dbi;
 	kaddr_t mem_pos;
@@ -991,20 +1049,11 @@ get_debug_info(kaddr_t addr,int get_areas)
 	db_info->entry_size       = KL_INT(k_dbi,"debug_info","entry_size");
 	db_info->next_dbi	 = KL_ULONG(k_dbi,"debug_info","next");
 	db_info->prev_dbi	 = KL_ULONG(k_dbi,"debug_info","prev");
+	db_info->areas_addr       = KL_ULONG(k_dbi,"debug_info","areas");
 	db_info->addr	     = addr;
 	strncpy(db_info->name,K_PTR(k_dbi,"debug_info","name"),
 		DEBUG_MAX_PROCF_LEN);
 
-
-	if(get_areas){
-		if(dbf_version == DBF_VERSION_V1)
-			debug_get_areas_v1(db_info,k_dbi);
-		else
-			debug_get_areas_v2(db_info,k_dbi);
-	} else {
-		db_info->areas = NULL;
-	}
-
 	/* get views */
 	mem_pos = (uaddr_t) K_PTR(k_dbi,"debug_info","views");
 	memset(&db_info->views, 0, DEBUG_MAX_VIEWS * sizeof(void*));
@@ -1022,35 +1071,9 @@ get_debug_info(kaddr_t addr,int get_areas)
 }
 
 static void
-free_debug_info_v1(debug_info_t * db_info)
+free_debug_info(debug_info_t * db_info)
 {
 	int i;
-	if(db_info->areas){
-		for (i = 0; i < db_info->nr_areas; i++) {
-			free(db_info->areas[i]);
-		}
-	}
-	for (i = 0; i < DEBUG_MAX_VIEWS; i++) {
-		free_debug_view(db_info->views[i]);
-	}
-	free(db_info->areas);
-	free(db_info);
-}
-
-static void
-free_debug_info_v2(debug_info_t * db_info)
-{
-	int i,j;
-	if(db_info->areas) {
-		for (i = 0; i < db_info->nr_areas; i++) {
-			for(j = 0; j < db_info->pages_per_area_v2; j++) {
-				free(db_info->areas_v2[i][j]);
-			}
-			free(db_info->areas[i]);
-		}
-		free(db_info->areas);
-		db_info->areas = NULL;
-	}
 	for (i = 0; i < DEBUG_MAX_VIEWS; i++) {
 		free_debug_view(db_info->views[i]);
 	}
@@ -1060,13 +1083,11 @@ free_debug_info_v2(debug_info_t * db_info)
 static void
 debug_write_output(debug_info_t *db_info, debug_view_t *db_view, FILE * fp)
 {
-	if (dbf_version == DBF_VERSION_V1) {
+	if (dbf_version == DBF_VERSION_V1)
 		debug_format_output_v1(db_info, db_view, fp);
-		free_debug_info_v1(db_info);
-	} else {
+	else
 		debug_format_output_v2(db_info, db_view, fp);
-		free_debug_info_v2(db_info);
-	}
+	free_debug_info(db_info);
 }
 
 static int
@@ -1082,7 +1103,7 @@ get_debug_areas(void)
 	}
 	act_debug_area = KL_VREAD_PTR(debug_sym->s_addr);
 	while(act_debug_area != 0){
-		act_debug_area_cpy = get_debug_info(act_debug_area,0);
+		act_debug_area_cpy = get_debug_info(act_debug_area);
 		act_debug_area     = act_debug_area_cpy->next_dbi;
 	 	if(debug_area_first == NULL){
 			debug_area_first = act_debug_area_cpy;
@@ -1102,10 +1123,7 @@ free_debug_areas(void)
 
 	while(act_debug_info != NULL){
 		next = act_debug_info->next;
-		if(dbf_version == DBF_VERSION_V1)
-			free_debug_info_v1(act_debug_info);
-		else
-			free_debug_info_v2(act_debug_info);
+		free_debug_info(act_debug_info);
 		act_debug_info = next;
 	}
 
@@ -1156,21 +1174,33 @@ add_lcrash_debug_view(debug_view_t *view)
 static int
 list_one_view(char *area_name, char *view_name, command_t * cmd)
 {
-	debug_info_t *db_info;
+	debug_info_t *act_debug_info;
 	debug_view_t *db_view;
+	int found = 0;
 
-	if ((db_info = find_debug_area(area_name)) == NULL) {
-		fprintf(cmd->efp, "Debug log '%s' not found!\n", area_name);
+	if ((db_view = find_lcrash_debug_view(view_name)) == NULL) {
+		fprintf(cmd->efp, "View '%s' not registered!\n", view_name);
 		return -1;
 	}
 
-	db_info = get_debug_info(db_info->addr,1);
+	for (act_debug_info = debug_area_first; act_debug_info != NULL;
+	     act_debug_info = act_debug_info->next) {
+		if (!debug_area_matches(area_name, act_debug_info->name))
+			continue;
+		if (is_debug_area_pattern(area_name))
+			fprintf(cmd->ofp, "%s%s:\n", found ? "\n" : "",
+				act_debug_info->name);
+		found++;
+		debug_write_output(get_debug_info(act_debug_info->addr),
+				   db_view, cmd->ofp);
+		if (!is_debug_area_pattern(area_name))
+			break;
+	}
 
-	if ((db_view = find_lcrash_debug_view(view_name)) == NULL) {
-		fprintf(cmd->efp, "View '%s' not registered!\n", view_name);
+	if (!found) {
+		fprintf(cmd->efp, "Debug log '%s' not found!\n", area_name);
 		return -1;
 	}
-	debug_write_output(db_info, db_view, cmd->ofp);
 	return 0;
 }
 
@@ -1191,7 +1221,25 @@ static int
 list_one_area(const char *area_name, command_t * cmd)
 {
 	debug_info_t *db_info;
-	int i;
+	int i, found = 0;
+
+	if (is_debug_area_pattern(area_name)) {
+		for (db_info = debug_area_first; db_info != NULL;
+		     db_info = db_info->next) {
+			if (!debug_area_matches(area_name, db_info->name))
+				continue;
+			if (found++)
+				fprintf(cmd->ofp, "\n");
+			list_one_area(db_info->name, cmd);
+		}
+		if (!found) {
+			fprintf(cmd->efp, "Debug log '%s' not found!\n",
+				area_name);
+			return -1;
+		}
+		return 0;
+	}
+
 	if ((db_info = find_debug_area(area_name)) == NULL) {
 		fprintf(cmd->efp, "Debug log '%s' not found!\n", area_name);
 		return -1;
@@ -1260,18 +1308,19 @@ save_one_view(const char *dbf_dir_name, const char *area_name,
 		fprintf(cmd->efp, "Debug log '%s' not found!\n", area_name);
 		return -1;
 	}
-	db_info = get_debug_info(db_info->addr, 1);
-
 	db_view = find_lcrash_debug_view(view_name);
 	if (db_view == NULL) {
 		fprintf(cmd->efp, "View '%s' not registered!\n", view_name);
 		return -1;
 	}
+	db_info = get_debug_info(db_info->addr);
+
 	sprintf(path_view, "%s/%s/%s", dbf_dir_name, area_name, view_name);
 	view_fh = fopen(path_view, "w");
 	if (view_fh == NULL) {
 		fprintf(cmd->efp, "Could not create file: %s (%s)\n",
 			path_view, strerror(errno));
+		free_debug_info(db_info);
 		return -1;
 	}
 	debug_write_output(db_info, db_view, view_fh);
@@ -1379,11 +1428,13 @@ s390dbf_cmd(command_t * cmd)
 		return -1;
 
 	if (cmd->flags & SAVE_DBF_FLAG) {
-		if (cmd->nargs != 2) {
+		if (cmd->nargs != 1) {
 			fprintf(cmd->efp, "Specify directory name for -s\n");
+			free_debug_areas();
 			return 1;
 		}
-		save_dbf(cmd->args[1], cmd);
+		save_dbf(cmd->args[0], cmd);
+		free_debug_areas();
 		return 0;
 	}
 	switch (cmd->nargs) {
@@ -1403,7 +1454,7 @@ s390dbf_cmd(command_t * cmd)
 	return rc;
 }
 
-#define _S390DBF_USAGE " [-v] [-s dirname] [debug log] [debug view]"
+#define _S390DBF_USAGE " [-v] [-l level] [-s dirname] [debug log] [debug view]"
 
 /*
  * s390dbf_usage() -- Print the usage string for the 's390dbf' command.
@@ -1421,7 +1472,7 @@ s390dbf_usage(command_t * cmd)
 char *help_s390dbf[] = {
 	"s390dbf",
 	"s390dbf prints out debug feature logs",
-	"[-v] [-s dirname] [debug log] [debug view]"
+	"[-v] [-l level] [-s dirname] [debug log] [debug view]",
 	"",
 	"Display Debug logs:",
 	" + If called without parameters, all active debug logs are listed.",
@@ -1430,6 +1481,10 @@ char *help_s390dbf[] = {
 	"   of the debug views are not available to 'crash'.",
 	" + If called with the name of a debug-log and an available viewname,",
 	"   the specified view is printed.",
+	" + The name of a debug-log may be a wildcard pattern such as 'qeth*',",
+	"   in which case all matching debug-logs are used.",
+	" + If called with '-l level', only the entries of a printed view whose",
+	"   level is less than or equal to the specified level are shown.",
 	" + If called with '-s dirname', the s390dbf is saved to the specified",
 	"   directory",
 	" + If called with '-v', all debug views which are available to",
@@ -1448,11 +1503,9 @@ void cmd_s390dbf()
 		.command = "s390dbf",
 	};
 
-	cmd.nargs=argcnt - 1;
-	for (i=1; i < argcnt; i++)
-		cmd.args[i-1] = args[i];
-	
-	while ((c = getopt(argcnt, args, "vs")) != EOF) {
+	dbf_max_level = -1;
+
+	while ((c = getopt(argcnt, args, "vsl:")) != EOF) {
 		switch(c) {
 		case 'v':
 			cmd.flags |= VIEWS_FLAG;
@@ -1460,11 +1513,19 @@ void cmd_s390dbf()
 		case 's':
 			cmd.flags |= SAVE_DBF_FLAG;
 			break;
+		case 'l':
+			dbf_max_level = dtoi(optarg, FAULT_ON_ERROR, NULL);
+			break;
 		default:
 			s390dbf_usage(&cmd);
 			return;
 		}
 	}
+
+	cmd.nargs = argcnt - optind;
+	for (i = optind; i < argcnt; i++)
+		cmd.args[i - optind] = args[i];
+
 	s390dbf_cmd(&cmd);
 }
 
@@ -21,6 +21,7 @@
 #include <arpa/inet.h> /* htonl, htons */
 #include <elf.h>
 #include <inttypes.h>
+#include <pthread.h>
 
 enum {
 	failed = -1
@@ -51,6 +52,8 @@ static int cpu_to_apicid(int cpu, int *apicid);
 static int get_sadump_smram_cpu_state(int cpu, struct sadump_smram_cpu_state *smram);
 static int block_table_init(void);
 static uint64_t pfn_to_block(uint64_t pfn);
+static uint64_t count_dumpable(uint64_t start, uint64_t end);
+static int read_sadump_readahead(uint64_t pfn, uint64_t block);
 static void mask_reserved_fields(struct sadump_smram_cpu_state *smram);
 
 struct sadump_data *
@@ -87,6 +90,8 @@ sadump_cleanup_sadump_data(void)
 	free(sd->dumpable_bitmap);
 	free(sd->page_buf);
 	free(sd->block_table);
+	free(sd->disk_end);
+	free(sd->readahead_buf);
 	if (sd->sd_list[0])
 		free(sd->sd_list[0]);
 	free(sd->sd_list);
@@ -736,31 +741,42 @@ page_is_dumpable(uint64_t nr)
 	return is_set_bit(sd->dumpable_bitmap, nr);
 }
 
+/*
+ *  The data of the disk set is the concatenation of the data areas of
+ *  its disks, so the disk holding an offset is found by a binary search
+ *  of the cumulative disk sizes, which are computed on first use since
+ *  the disks are added one at a time.
+ */
 static int
 lookup_diskset(uint64_t whole_offset, int *diskid, uint64_t *disk_offset)
 {
-	uint64_t offset = whole_offset;
-	int i;
-
-	for (i = 0; i < sd->sd_list_len; ++i) {
-		uint64_t used_device_i, ram_size;
-		ulong data_offset_i;
-
-		used_device_i = sd->sd_list[i]->header->used_device;
-		data_offset_i = sd->sd_list[i]->data_offset;
+	int i, lo, hi;
 
-		ram_size = used_device_i - data_offset_i;
+	if (!sd->disk_end) {
+		sd->disk_end = malloc(sd->sd_list_len * sizeof(uint64_t));
+		if (!sd->disk_end) {
+			error(INFO, "sadump: cannot malloc disk set offsets\n");
+			return FALSE;
+		}
+		for (i = 0; i < sd->sd_list_len; ++i)
+			sd->disk_end[i] = (i ? sd->disk_end[i-1] : 0) +
+				sd->sd_list[i]->header->used_device -
+				sd->sd_list[i]->data_offset;
+	}
 
-		if (offset < ram_size)
-			break;
-		offset -= ram_size;
+	for (lo = 0, hi = sd->sd_list_len; lo < hi; ) {
+		i = (lo + hi) / 2;
+		if (whole_offset < sd->disk_end[i])
+			hi = i;
+		else
+			lo = i + 1;
 	}
 
-	if (i == sd->sd_list_len)
+	if (lo == sd->sd_list_len)
 		return FALSE;
 
-	*diskid = i;
-	*disk_offset = offset;
+	*diskid = lo;
+	*disk_offset = whole_offset - (lo ? sd->disk_end[lo-1] : 0);
 
 	return TRUE;
 }
@@ -802,6 +818,12 @@ int read_sadump(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr)
 
 	block = pfn_to_block(pfn);
 
+	if ((block == sd->next_block) && read_sadump_readahead(pfn, block)) {
+		memcpy(bufptr, sd->page_buf + page_offset, cnt);
+		return cnt;
+	}
+	sd->next_block = block + 1;
+
 	whole_offset = block * sd->block_size;
 
 	if (sd->flags & SADUMP_DISKSET) {
@@ -819,10 +841,8 @@ int read_sadump(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr)
 
 	}
 
-	if (lseek(dfd, perdisk_offset, SEEK_SET) == failed)
-		return SEEK_ERROR;
-
-	if (read(dfd, sd->page_buf, sd->block_size) != sd->block_size)
+	if (pread(dfd, sd->page_buf, sd->block_size, perdisk_offset) !=
+	    sd->block_size)
 		return READ_ERROR;
 
 	memcpy(bufptr, sd->page_buf + page_offset, cnt);
@@ -1103,6 +1123,11 @@ int sadump_memory_dump(FILE *fp)
 	fprintf(fp, "  backup_src_start: %llx\n", sd->backup_src_start);
 	fprintf(fp, "   backup_src_size: %lx\n", sd->backup_src_size);
 	fprintf(fp, "     backup_offset: %llx\n", (ulonglong)sd->backup_src_size);
+	fprintf(fp, "          disk_end: %lx\n", (ulong)sd->disk_end);
+	fprintf(fp, "     readahead_buf: %lx\n", (ulong)sd->readahead_buf);
+	fprintf(fp, "        next_block: %llu\n", (ulonglong)sd->next_block);
+	fprintf(fp, "        readaheads: %ld\n", sd->readaheads);
+	fprintf(fp, "   readahead_pages: %ld\n", sd->readahead_pages);
 
 	for (i = 0; i < sd->sd_list_len; ++i) {
 		struct sadump_diskset_data *sdd = sd->sd_list[i];
@@ -1606,7 +1631,7 @@ void sadump_show_diskset(void)
 
 static int block_table_init(void)
 {
-	uint64_t pfn, section, max_section, *block_table;
+	uint64_t section, max_section, *block_table;
 
 	max_section = divideup(sd->max_mapnr, SADUMP_PF_SECTION_NUM);
 
@@ -1616,15 +1641,10 @@ static int block_table_init(void)
 		return FALSE;
 	}
 
-	for (section = 0; section < max_section; ++section) {
-		if (section > 0)
-			block_table[section] = block_table[section-1];
-		for (pfn = section * SADUMP_PF_SECTION_NUM;
-		     pfn < (section + 1) * SADUMP_PF_SECTION_NUM;
-		     ++pfn)
-			if (page_is_dumpable(pfn))
-				block_table[section]++;
-	}
+	for (section = 0; section < max_section; ++section)
+		block_table[section] = (section ? block_table[section-1] : 0) +
+			count_dumpable(section * SADUMP_PF_SECTION_NUM,
+				       (section + 1) * SADUMP_PF_SECTION_NUM);
 
 	sd->block_table = block_table;
 
@@ -1633,7 +1653,7 @@ static int block_table_init(void)
 
 static uint64_t pfn_to_block(uint64_t pfn)
 {
-	uint64_t block, section, p;
+	uint64_t block, section;
 
 	section = pfn / SADUMP_PF_SECTION_NUM;
 
@@ -1642,11 +1662,224 @@ static uint64_t pfn_to_block(uint64_t pfn)
 	else
 		block = 0;
 
-	for (p = section * SADUMP_PF_SECTION_NUM; p < pfn; ++p)
+	return block + count_dumpable(section * SADUMP_PF_SECTION_NUM, pfn);
+}
+
+/*
+ *  Count the dumpable pages from start up to end.  The population count
+ *  of a bitmap word does not depend upon the bit order within it, so the
+ *  aligned words in between are counted 64 pages at a time.
+ */
+static uint64_t count_dumpable(uint64_t start, uint64_t end)
+{
+	uint64_t pfn, count;
+
+	for (pfn = start, count = 0; (pfn < end) && (pfn & 63); ++pfn)
+		count += page_is_dumpable(pfn);
+	for ( ; pfn + 64 <= end; pfn += 64)
+		count += __builtin_popcountll(*(uint64_t *)
+			&sd->dumpable_bitmap[pfn >> 3]);
+	for ( ; pfn < end; ++pfn)
+		count += page_is_dumpable(pfn);
+
+	return count;
+}
+
+/*
+ *  Read-ahead.
+ *
+ *  Only the dumpable pages are stored, in pfn order, so the blocks that
+ *  follow the block of a page hold the next dumpable pages, however far
+ *  apart those are.  When read_sadump() misses on the block following
+ *  the last one it read, that block and up to SADUMP_READAHEAD_PAGES-1
+ *  blocks after it are read at once, and all but the requested page are
+ *  entered into the common page cache.  The data of a disk set runs from
+ *  one disk to the next, so a window that crosses disks is split into one
+ *  read per disk, and those reads are issued in parallel.
+ */
+#define SADUMP_READAHEAD_PAGES	(256)
+#define SADUMP_READAHEAD_SCAN	(SADUMP_PF_SECTION_NUM)
+
+struct sadump_read {
+	int dfd;
+	char *buf;
+	size_t len;
+	off_t offset;
+	int status;
+	pthread_t thread;
+};
+
+static void *
+sadump_read_worker(void *arg)
+{
+	struct sadump_read *r = arg;
+
+	r->status = (pread(r->dfd, r->buf, r->len, r->offset) == r->len);
+
+	return NULL;
+}
+
+/*
+ *  Read the block of pfn into sd->page_buf along with the blocks that
+ *  follow it.  Returns FALSE if read-ahead is not possible, or if the
+ *  requested block could not be read, leaving it to the single block
+ *  read of read_sadump() to handle and report its errors.
+ */
+static int read_sadump_readahead(uint64_t pfn, uint64_t block)
+{
+	uint64_t p, paddr, pfns[SADUMP_READAHEAD_PAGES];
+	uint64_t whole_offset, disk_offset, len;
+	struct sadump_read reads[SADUMP_READAHEAD_PAGES], *r;
+	int i, n, nreads, diskid, window, started;
+	sigset_t all, saved;
+
+	if ((sd->block_size != PAGESIZE()) ||
+	    ((window = page_cache_size() / sd->block_size / 2) < 2))
+		return FALSE;
+	if (window > SADUMP_READAHEAD_PAGES)
+		window = SADUMP_READAHEAD_PAGES;
+
+	for (n = 0, p = pfn; (n < window) && (p < sd->max_mapnr) &&
+	     (p < pfn + SADUMP_READAHEAD_SCAN); ++p) {
 		if (page_is_dumpable(p))
-			block++;
+			pfns[n++] = p;
+	}
+	if (n < 2)
+		return FALSE;
+
+	if (!sd->readahead_buf &&
+	    !(sd->readahead_buf = malloc(SADUMP_READAHEAD_PAGES * sd->block_size)))
+		return FALSE;
+
+	whole_offset = block * sd->block_size;
+	len = (uint64_t)n * sd->block_size;
+
+	for (nreads = 0; len; nreads++) {
+		r = &reads[nreads];
+		r->buf = sd->readahead_buf + (whole_offset - block * sd->block_size);
+		if (sd->flags & SADUMP_DISKSET) {
+			if (!lookup_diskset(whole_offset, &diskid, &disk_offset))
+				break;
+			r->dfd = sd->sd_list[diskid]->dfd;
+			r->offset = disk_offset + sd->sd_list[diskid]->data_offset;
+			r->len = MIN(len, sd->disk_end[diskid] - whole_offset);
+		} else {
+			r->dfd = sd->dfd;
+			r->offset = whole_offset + sd->data_offset;
+			r->len = len;
+		}
+		r->status = FALSE;
+		whole_offset += r->len;
+		len -= r->len;
+	}
+	if (!nreads)
+		return FALSE;
+
+	/*
+	 *  The reads from the other disks are issued by threads that block
+	 *  all signals, so that SIGINT and friends go to the main thread.
+	 */
+	started = 0;
+	if (nreads > 1) {
+		sigfillset(&all);
+		pthread_sigmask(SIG_SETMASK, &all, &saved);
+		for (started = 1; started < nreads; started++) {
+			if (pthread_create(&reads[started].thread, NULL,
+			    sadump_read_worker, &reads[started]))
+				break;
+		}
+		pthread_sigmask(SIG_SETMASK, &saved, NULL);
+	}
 
-	return block;
+	sadump_read_worker(&reads[0]);
+
+	for (i = 1; i < nreads; i++) {
+		if (i < started)
+			pthread_join(reads[i].thread, NULL);
+		else
+			sadump_read_worker(&reads[i]);
+	}
+
+	if (!reads[0].status)
+		return FALSE;
+
+	memcpy(sd->page_buf, sd->readahead_buf, sd->block_size);
+
+	for (i = 1, r = &reads[0]; i < n; i++) {
+		while (sd->readahead_buf + (uint64_t)i * sd->block_size >=
+		       r->buf + r->len) {
+			if (++r == &reads[nreads])
+				break;
+		}
+		if ((r == &reads[nreads]) || !r->status)
+			break;
+		if (!page_is_ram(pfns[i]))
+			continue;
+		/*
+		 *  Reads of the kdump backup source region are redirected.
+		 */
+		paddr = pfns[i] << sd->block_shift;
+		if ((sd->flags & SADUMP_KDUMP_BACKUP) &&
+		    (paddr >= sd->backup_src_start) &&
+		    (paddr < sd->backup_src_start + sd->backup_src_size))
+			continue;
+		page_cache_prefill(paddr,
+			sd->readahead_buf + (uint64_t)i * sd->block_size);
+		sd->readahead_pages++;
+	}
+
+	sd->readaheads++;
+	sd->next_block = block + i;
+
+	if (CRASHDEBUG(8))
+		fprintf(fp, "sadump: read-ahead: pfn %llx: %d of %d pages, "
+			"%d read%s\n", (ulonglong)pfn, i, n, nreads,
+			nreads > 1 ? "s" : "");
+
+	return TRUE;
+}
+
+/*
+ *  dumpfile_next_present() backend: find the first page at or above paddr
+ *  that is RAM and, unless excluded pages are being zero-filled, dumpable.
+ *  Bitmap words with no bits set are skipped 64 pages at a time.  Returns
+ *  FALSE if there are no more such pages.
+ */
+int sadump_next_present(physaddr_t paddr, physaddr_t *next)
+{
+	uint64_t pfn;
+	char *bitmap;
+
+	*next = paddr;
+
+	bitmap = (sd->flags & SADUMP_ZERO_EXCLUDED) ?
+		sd->bitmap : sd->dumpable_bitmap;
+
+	for (pfn = paddr_to_pfn(paddr); pfn < sd->max_mapnr; pfn++) {
+		while (!(pfn & 63) && (pfn + 64 <= sd->max_mapnr) &&
+		       !*(uint64_t *)&bitmap[pfn >> 3])
+			pfn += 64;
+		if ((pfn < sd->max_mapnr) && is_set_bit(bitmap, pfn) &&
+		    page_is_ram(pfn))
+			break;
+	}
+
+	if (pfn >= sd->max_mapnr)
+		return FALSE;
+
+	if (pfn > paddr_to_pfn(paddr))
+		*next = (physaddr_t)pfn << sd->block_shift;
+
+	/*
+	 *  Reads of the kdump backup source region are redirected, so do
+	 *  not skip over it.
+	 */
+	if ((sd->flags & SADUMP_KDUMP_BACKUP) &&
+	    (paddr < sd->backup_src_start + sd->backup_src_size) &&
+	    (*next > sd->backup_src_start))
+		*next = MAX(paddr, sd->backup_src_start);
+
+	return TRUE;
 }
 
 int sadump_is_zero_excluded(void)
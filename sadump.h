@@ -220,6 +220,12 @@ struct sadump_data {
 
 	uint64_t max_mapnr;
 	ulong phys_base;
+
+	uint64_t *disk_end;	/* data bytes on the disks up to each one */
+	char *readahead_buf;
+	uint64_t next_block;	/* block that continues a sequential read */
+	ulong readaheads;
+	ulong readahead_pages;
 };
 
 struct sadump_data *sadump_get_sadump_data(void);
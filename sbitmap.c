@@ -85,24 +85,39 @@ static inline unsigned int __map_depth(const struct sbitmap_context *sc, int ind
        return 1U << sc->shift;
 }
 
+/*
+ * Read all of the sbitmap_word structures of an sbitmap with one readmem(),
+ * instead of one per word.  The caller must FREEBUF() the returned buffer.
+ */
+static char *sbitmap_words_read(const struct sbitmap_context *sc)
+{
+	const ulong size = SIZE(sbitmap_word) * (sc->map_nr ? sc->map_nr : 1);
+	char *sbitmap_words_buf;
+
+	sbitmap_words_buf = GETBUF(size);
+	if (sc->map_nr && !readmem(sc->map_addr, KVADDR, sbitmap_words_buf,
+	    size, "sbitmap_word", RETURN_ON_ERROR)) {
+		FREEBUF(sbitmap_words_buf);
+		error(FATAL, "cannot read sbitmap_word\n");
+	}
+
+	return sbitmap_words_buf;
+}
+
 static unsigned int __sbitmap_weight(const struct sbitmap_context *sc, bool set)
 {
 	const ulong sbitmap_word_size = SIZE(sbitmap_word);
 	const ulong w_word_off = OFFSET(sbitmap_word_word);
 
 	unsigned int weight = 0;
-	ulong addr = sc->map_addr;
 	ulong depth, word, cleared;
-	char *sbitmap_word_buf;
+	char *sbitmap_words_buf, *sbitmap_word_buf;
 	int i;
 
-	sbitmap_word_buf = GETBUF(sbitmap_word_size);
+	sbitmap_words_buf = sbitmap_words_read(sc);
 
 	for (i = 0; i < sc->map_nr; i++) {
-		if (!readmem(addr, KVADDR, sbitmap_word_buf, sbitmap_word_size, "sbitmap_word", RETURN_ON_ERROR)) {
-			FREEBUF(sbitmap_word_buf);
-			error(FATAL, "cannot read sbitmap_word\n");
-		}
+		sbitmap_word_buf = sbitmap_words_buf + (sbitmap_word_size * i);
 
 		depth = __map_depth(sc, i);
 
@@ -116,11 +131,9 @@ static unsigned int __sbitmap_weight(const struct sbitmap_context *sc, bool set)
 				cleared = 0;
 			weight += bitmap_weight(cleared, depth);
 		}
-
-		addr += sbitmap_word_size;
 	}
 
-	FREEBUF(sbitmap_word_buf);
+	FREEBUF(sbitmap_words_buf);
 
 	return weight;
 }
@@ -158,19 +171,15 @@ static void sbitmap_bitmap_show(const struct sbitmap_context *sc)
 	uint8_t byte = 0;
 	unsigned int byte_bits = 0;
 	unsigned int offset = 0;
-	ulong addr = sc->map_addr;
-	char *sbitmap_word_buf;
+	char *sbitmap_words_buf, *sbitmap_word_buf;
 	int i;
 
-	sbitmap_word_buf = GETBUF(sbitmap_word_size);
+	sbitmap_words_buf = sbitmap_words_read(sc);
 
 	for (i = 0; i < sc->map_nr; i++) {
 		unsigned long word, cleared, word_bits;
 
-		if (!readmem(addr, KVADDR, sbitmap_word_buf, sbitmap_word_size, "sbitmap_word", RETURN_ON_ERROR)) {
-			FREEBUF(sbitmap_word_buf);
-			error(FATAL, "cannot read sbitmap_word\n");
-		}
+		sbitmap_word_buf = sbitmap_words_buf + (sbitmap_word_size * i);
 
 		word = ULONG(sbitmap_word_buf + w_word_off);
 		if (VALID_MEMBER(sbitmap_word_cleared))
@@ -195,8 +204,6 @@ static void sbitmap_bitmap_show(const struct sbitmap_context *sc)
 			word >>= bits;
 			word_bits -= bits;
 		}
-
-		addr += sbitmap_word_size;
 	}
 	if (byte_bits) {
 		sbitmap_emit_byte(offset, byte);
@@ -205,24 +212,34 @@ static void sbitmap_bitmap_show(const struct sbitmap_context *sc)
 	if (offset)
 		fputc('\n', fp);
 
-	FREEBUF(sbitmap_word_buf);
+	FREEBUF(sbitmap_words_buf);
 }
 
-static unsigned long sbitmap_find_next_bit(unsigned long word,
+/*
+ * Returns the bits of word from offset up to, but not including, size.
+ */
+static unsigned long sbitmap_word_range(unsigned long word,
 		unsigned long size, unsigned long offset)
 {
 	if (size > BITS_PER_LONG)
 		error(FATAL, "%s: word size isn't correct\n", __func__);
 
-	for (; offset < size; offset++)
-		if (word & (1UL << offset))
-			return offset;
+	if (size < BITS_PER_LONG)
+		word &= BIT(size) - 1;
+	if (offset >= BITS_PER_LONG)
+		return 0;
 
-	return size;
+	return word & (~0UL << offset);
 }
 
+/*
+ * Walk the set bits of the sbitmap, passing their indices to fn in
+ * batches of up to SBITMAP_BATCH_SIZE.  The words are taken from a single
+ * read of the map array, and the set bits of each word are found with
+ * ctz rather than by testing each bit.
+ */
 static void __sbitmap_for_each_set(const struct sbitmap_context *sc,
-		unsigned int start, sbitmap_for_each_fn fn, void *data)
+		unsigned int start, sbitmap_for_each_batch_fn fn, void *data)
 {
 	const ulong sbitmap_word_size = SIZE(sbitmap_word);
 	const ulong w_word_off = OFFSET(sbitmap_word_word);
@@ -230,9 +247,11 @@ static void __sbitmap_for_each_set(const struct sbitmap_context *sc,
 	unsigned int index;
 	unsigned int nr;
 	unsigned int scanned = 0;
-	char *sbitmap_word_buf;
+	unsigned int batch[SBITMAP_BATCH_SIZE];
+	unsigned int nbatch = 0;
+	char *sbitmap_words_buf, *sbitmap_word_buf;
 
-	sbitmap_word_buf = GETBUF(sbitmap_word_size);
+	sbitmap_words_buf = sbitmap_words_read(sc);
 
 	if (start >= sc->map_nr)
 		start = 0;
@@ -241,14 +260,10 @@ static void __sbitmap_for_each_set(const struct sbitmap_context *sc,
 	nr = start & ((1U << sc->shift) - 1U);
 
 	while (scanned < sc->depth) {
-		unsigned long w_addr = sc->map_addr + (sbitmap_word_size * index);
 		unsigned long w_word, w_cleared;
 		unsigned long word, depth;
 
-		if (!readmem(w_addr, KVADDR, sbitmap_word_buf, sbitmap_word_size, "sbitmap_word", RETURN_ON_ERROR)) {
-			FREEBUF(sbitmap_word_buf);
-			error(FATAL, "cannot read sbitmap_word\n");
-		}
+		sbitmap_word_buf = sbitmap_words_buf + (sbitmap_word_size * index);
 
 		w_word = ULONG(sbitmap_word_buf + w_word_off);
 		if (VALID_MEMBER(sbitmap_word_cleared))
@@ -265,18 +280,20 @@ static void __sbitmap_for_each_set(const struct sbitmap_context *sc,
 
 		/*
 		 * On the first iteration of the outer loop, we need to add the
-		 * bit offset back to the size of the word for find_next_bit().
-		 * On all other iterations, nr is zero, so this is a noop.
+		 * bit offset back to the size of the word.  On all other
+		 * iterations, nr is zero, so this is a noop.
 		 */
 		depth += nr;
-		while (1) {
-			nr = sbitmap_find_next_bit(word, depth, nr);
-			if (nr >= depth)
-				break;
-			if (!fn((index << sc->shift) + nr, data))
-				goto exit;
-
-			nr++;
+		word = sbitmap_word_range(word, depth, nr);
+		while (word) {
+			batch[nbatch++] = (index << sc->shift) + __builtin_ctzl(word);
+			word &= word - 1;
+
+			if (nbatch == SBITMAP_BATCH_SIZE) {
+				if (!fn(batch, nbatch, data))
+					goto exit;
+				nbatch = 0;
+			}
 		}
 next:
 		nr = 0;
@@ -284,14 +301,45 @@ next:
 			index = 0;
 	}
 
+	if (nbatch)
+		fn(batch, nbatch, data);
 exit:
-	FREEBUF(sbitmap_word_buf);
+	FREEBUF(sbitmap_words_buf);
+}
+
+void sbitmap_for_each_set_batch(const struct sbitmap_context *sc,
+		sbitmap_for_each_batch_fn fn, void *data)
+{
+	__sbitmap_for_each_set(sc, 0, fn, data);
+}
+
+struct sbitmap_each_set {
+	sbitmap_for_each_fn fn;
+	void *data;
+};
+
+static bool sbitmap_each_set_batch(const unsigned int *idx, unsigned int nr,
+		void *p)
+{
+	const struct sbitmap_each_set *es = p;
+	unsigned int i;
+
+	for (i = 0; i < nr; i++)
+		if (!es->fn(idx[i], es->data))
+			return false;
+
+	return true;
 }
 
 void sbitmap_for_each_set(const struct sbitmap_context *sc,
 		sbitmap_for_each_fn fn, void *data)
 {
-	__sbitmap_for_each_set(sc, 0, fn, data);
+	struct sbitmap_each_set es = {
+		.fn = fn,
+		.data = data,
+	};
+
+	__sbitmap_for_each_set(sc, 0, sbitmap_each_set_batch, &es);
 }
 
 static void sbitmap_queue_show(const struct sbitmap_queue_context *sqc,
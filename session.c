@@ -0,0 +1,434 @@
+/* session.c - core analysis suite
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "defs.h"
+#include <sys/mman.h>
+
+/*
+ *  The session cache, enabled with --session_cache, saves tables that
+ *  are derived from the dumpfile during session initialization, such
+ *  as the task table and the KASLR offset, in a file that is named
+ *  after the dumpfile's identity.  The next session with the same
+ *  dumpfile and vmlinux maps the file, and the initialization code that
+ *  finds a table in it uses it instead of gathering it from the dump.
+ *
+ *  The dumpfile's identity is its size and a checksum of its first
+ *  SESSION_CACHE_HEADER_BYTES, which cover the dumpfile header; its key
+ *  also contains the build-id of the vmlinux file, the crash version
+ *  and the machine type.  The file is looked for and written in
+ *  $XDG_CACHE_HOME/crash, or $HOME/.cache/crash, alongside the datatype
+ *  cache files.  Live systems are never cached.
+ *
+ *  Each table is stored as a named section, whose format is up to the
+ *  code that stores it; a table whose format changes should be given a
+ *  new section name.
+ */
+#define SESSION_CACHE_MAGIC	"crashssc"
+#define SESSION_CACHE_VERSION	(1)
+#define SESSION_CACHE_KEYLEN	(256)
+#define SESSION_CACHE_NAMELEN	(16)
+#define SESSION_CACHE_SECTIONS	(8)
+#define SESSION_CACHE_SUFFIX	".session"
+#define SESSION_CACHE_HEADER_BYTES (64 * 1024)
+
+struct session_cache_section {
+	char name[SESSION_CACHE_NAMELEN];
+	ulong offset;			/* from the start of the file */
+	ulong size;
+};
+
+struct session_cache_header {
+	char magic[8];
+	uint version;
+	uint nsections;
+	char key[SESSION_CACHE_KEYLEN];
+	struct session_cache_section sections[SESSION_CACHE_SECTIONS];
+};
+
+#define SSC_UNINITIALIZED	(0)
+#define SSC_ACTIVE		(1)
+#define SSC_DISABLED		(2)
+
+static struct session_cache {
+	int state;
+	char key[SESSION_CACHE_KEYLEN];
+	char *file;
+	char *map;			/* mapped cache file */
+	size_t mapsize;
+	struct session_cache_new {
+		char name[SESSION_CACHE_NAMELEN];
+		void *data;
+		ulong size;
+	} new[SESSION_CACHE_SECTIONS];
+	int nnew;
+	ulong hits;
+	ulong misses;
+} session_cache = { 0 };
+
+static int session_cache_init(void);
+static int session_cache_identity(char *, ulonglong *, ulonglong *);
+static void session_cache_load(void);
+
+/*
+ *  The size of the dumpfile, and an FNV-1a checksum of its header.
+ */
+static int
+session_cache_identity(char *file, ulonglong *size, ulonglong *checksum)
+{
+	int fd;
+	long i, cnt;
+	struct stat sbuf;
+	unsigned char *buf;
+	ulonglong hash;
+
+	if ((fd = open(file, O_RDONLY)) < 0)
+		return FALSE;
+
+	if ((fstat(fd, &sbuf) < 0) || !S_ISREG(sbuf.st_mode) ||
+	    !(buf = malloc(SESSION_CACHE_HEADER_BYTES))) {
+		close(fd);
+		return FALSE;
+	}
+
+	cnt = read(fd, buf, SESSION_CACHE_HEADER_BYTES);
+	close(fd);
+
+	if (cnt <= 0) {
+		free(buf);
+		return FALSE;
+	}
+
+	for (i = 0, hash = 0xcbf29ce484222325ULL; i < cnt; i++) {
+		hash ^= buf[i];
+		hash *= 0x100000001b3ULL;
+	}
+	free(buf);
+
+	*size = (ulonglong)sbuf.st_size;
+	*checksum = hash;
+	return TRUE;
+}
+
+/*
+ *  Determine the cache key and file, and map the file if it exists.
+ *  Called on first use, once the vmlinux file has been opened.
+ */
+static int
+session_cache_init(void)
+{
+	char buildid[BUFSIZE];
+	char dir[PATH_MAX];
+	char name[BUFSIZE];
+	ulonglong size, checksum;
+	char *p;
+
+	if (session_cache.state != SSC_UNINITIALIZED)
+		return (session_cache.state == SSC_ACTIVE);
+
+	session_cache.state = SSC_DISABLED;
+
+	if (!(pc->flags2 & SESSION_CACHE) || ACTIVE() || !pc->dumpfile ||
+	    (pc->flags & (KERNTYPES|MINIMAL_MODE)) || !st->bfd)
+		return FALSE;
+
+	if (!get_build_id(st->bfd, buildid, BUFSIZE)) {
+		if (CRASHDEBUG(1))
+			error(INFO, "session cache: no build-id in %s\n",
+				pc->namelist);
+		return FALSE;
+	}
+
+	if (!session_cache_identity(pc->dumpfile, &size, &checksum)) {
+		if (CRASHDEBUG(1))
+			error(INFO, "session cache: cannot read %s\n",
+				pc->dumpfile);
+		return FALSE;
+	}
+
+	if (snprintf(session_cache.key, SESSION_CACHE_KEYLEN,
+	    "%s %llx %llx %s %s %ld", buildid, size, checksum,
+	    pc->program_version, pc->machine_type,
+	    (long)sizeof(long)) >= SESSION_CACHE_KEYLEN)
+		return FALSE;
+
+	if ((p = getenv("XDG_CACHE_HOME")) && strlen(p))
+		snprintf(dir, PATH_MAX, "%s/crash", p);
+	else if ((p = getenv("HOME")) && strlen(p))
+		snprintf(dir, PATH_MAX, "%s/.cache/crash", p);
+	else
+		return FALSE;
+
+	snprintf(name, BUFSIZE, "%016llx%s", checksum ^ size,
+		SESSION_CACHE_SUFFIX);
+	if (!(session_cache.file = malloc(strlen(dir) + strlen(name) + 2)))
+		return FALSE;
+	sprintf(session_cache.file, "%s/%s", dir, name);
+
+	session_cache.state = SSC_ACTIVE;
+	session_cache_load();
+
+	return TRUE;
+}
+
+/*
+ *  Map the cache file and verify its header and section table.  A file
+ *  that does not match is ignored, and replaced when the session's
+ *  tables are saved.
+ */
+static void
+session_cache_load(void)
+{
+	int fd;
+	uint i;
+	struct stat sbuf;
+	struct session_cache_header *sch;
+	struct session_cache_section *scs;
+	char *map;
+	size_t size;
+
+	if ((fd = open(session_cache.file, O_RDONLY)) < 0)
+		return;
+
+	if ((fstat(fd, &sbuf) < 0) ||
+	    (sbuf.st_size < sizeof(struct session_cache_header))) {
+		close(fd);
+		return;
+	}
+	size = sbuf.st_size;
+
+	map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return;
+
+	sch = (struct session_cache_header *)map;
+	if (memcmp(sch->magic, SESSION_CACHE_MAGIC, sizeof(sch->magic)) ||
+	    (sch->version != SESSION_CACHE_VERSION) ||
+	    (sch->nsections > SESSION_CACHE_SECTIONS) ||
+	    strncmp(sch->key, session_cache.key, SESSION_CACHE_KEYLEN))
+		goto bailout;
+
+	for (i = 0; i < sch->nsections; i++) {
+		scs = &sch->sections[i];
+		if ((scs->offset < sizeof(struct session_cache_header)) ||
+		    (scs->offset > size) || (scs->size > size - scs->offset) ||
+		    (scs->offset % sizeof(ulong)) ||
+		    (scs->name[SESSION_CACHE_NAMELEN-1] != NULLCHAR))
+			goto bailout;
+	}
+
+	session_cache.map = map;
+	session_cache.mapsize = size;
+
+	if (CRASHDEBUG(1))
+		error(INFO, "session cache: %s: %d sections\n",
+			session_cache.file, sch->nsections);
+	return;
+
+bailout:
+	if (CRASHDEBUG(1))
+		error(INFO, "session cache: %s: not used\n", session_cache.file);
+	munmap(map, size);
+}
+
+/*
+ *  Return the contents of the saved section name, and its size in
+ *  *size, or NULL if it was not saved.  The contents are read-only, and
+ *  only remain valid until session initialization is complete.
+ */
+void *
+session_cache_get(char *name, ulong *size)
+{
+	uint i;
+	struct session_cache_header *sch;
+
+	if (!session_cache_init())
+		return NULL;
+
+	if ((sch = (struct session_cache_header *)session_cache.map)) {
+		for (i = 0; i < sch->nsections; i++) {
+			if (STREQ(sch->sections[i].name, name)) {
+				*size = sch->sections[i].size;
+				session_cache.hits++;
+				return session_cache.map + sch->sections[i].offset;
+			}
+		}
+	}
+
+	session_cache.misses++;
+	return NULL;
+}
+
+/*
+ *  Have the contents of section name saved at the end of session
+ *  initialization.  The data is copied.
+ */
+void
+session_cache_put(char *name, void *data, ulong size)
+{
+	int i;
+	struct session_cache_new *scn;
+
+	if (!session_cache_init() || (strlen(name) >= SESSION_CACHE_NAMELEN))
+		return;
+
+	for (i = 0, scn = NULL; i < session_cache.nnew; i++) {
+		if (STREQ(session_cache.new[i].name, name)) {
+			scn = &session_cache.new[i];
+			free(scn->data);
+			break;
+		}
+	}
+
+	if (!scn) {
+		if (session_cache.nnew == SESSION_CACHE_SECTIONS)
+			return;
+		scn = &session_cache.new[session_cache.nnew++];
+		strcpy(scn->name, name);
+	}
+
+	if (!(scn->data = malloc(MAX(size, 1)))) {
+		scn->size = 0;
+		return;
+	}
+	memcpy(scn->data, data, size);
+	scn->size = size;
+}
+
+/*
+ *  Called once session initialization is complete: if any sections
+ *  were put, write out a new file containing them and the sections of
+ *  the old file that were not replaced.  The old file is unmapped in
+ *  either case.
+ */
+void
+session_cache_save(void)
+{
+	struct session_cache_header sch, *old;
+	struct session_cache_section *scs;
+	char *data[SESSION_CACHE_SECTIONS];
+	char *tmpfile, *p;
+	char pad[sizeof(ulong)];
+	ulong offset;
+	int i, j, fd, ok;
+
+	if ((session_cache.state != SSC_ACTIVE) || !session_cache.nnew)
+		goto out;
+
+	BZERO(&sch, sizeof(struct session_cache_header));
+	memcpy(sch.magic, SESSION_CACHE_MAGIC, sizeof(sch.magic));
+	sch.version = SESSION_CACHE_VERSION;
+	memcpy(sch.key, session_cache.key, SESSION_CACHE_KEYLEN);
+
+	for (i = 0; i < session_cache.nnew; i++) {
+		scs = &sch.sections[sch.nsections];
+		strcpy(scs->name, session_cache.new[i].name);
+		scs->size = session_cache.new[i].size;
+		data[sch.nsections++] = session_cache.new[i].data;
+	}
+
+	if ((old = (struct session_cache_header *)session_cache.map)) {
+		for (i = 0; i < old->nsections; i++) {
+			if (sch.nsections == SESSION_CACHE_SECTIONS)
+				break;
+			for (j = 0; j < session_cache.nnew; j++)
+				if (STREQ(old->sections[i].name,
+				    session_cache.new[j].name))
+					break;
+			if (j < session_cache.nnew)
+				continue;
+			sch.sections[sch.nsections] = old->sections[i];
+			data[sch.nsections++] = session_cache.map +
+				old->sections[i].offset;
+		}
+	}
+
+	for (i = 0, offset = sizeof(sch); i < sch.nsections; i++) {
+		sch.sections[i].offset = offset;
+		offset += roundup(sch.sections[i].size, sizeof(ulong));
+	}
+
+	if (!(tmpfile = malloc(strlen(session_cache.file) + 8)))
+		goto out;
+
+	/*
+	 *  Create $HOME/.cache and $HOME/.cache/crash as required.
+	 */
+	strcpy(tmpfile, session_cache.file);
+	p = strrchr(tmpfile, '/');
+	*p = NULLCHAR;
+	if ((mkdir(tmpfile, 0755) < 0) && (errno == ENOENT)) {
+		p = strrchr(tmpfile, '/');
+		*p = NULLCHAR;
+		mkdir(tmpfile, 0755);
+		*p = '/';
+		mkdir(tmpfile, 0755);
+	}
+
+	sprintf(tmpfile, "%s.XXXXXX", session_cache.file);
+	if ((fd = mkstemp(tmpfile)) < 0) {
+		if (CRASHDEBUG(1))
+			error(INFO, "session cache: %s: %s\n", tmpfile,
+				strerror(errno));
+		free(tmpfile);
+		goto out;
+	}
+
+	BZERO(pad, sizeof(pad));
+	ok = (write(fd, &sch, sizeof(sch)) == sizeof(sch));
+	for (i = 0; ok && (i < sch.nsections); i++) {
+		ok = (write(fd, data[i], sch.sections[i].size) ==
+			sch.sections[i].size);
+		j = roundup(sch.sections[i].size, sizeof(ulong)) -
+			sch.sections[i].size;
+		if (ok && j)
+			ok = (write(fd, pad, j) == j);
+	}
+
+	if ((close(fd) < 0) || !ok || (rename(tmpfile, session_cache.file) < 0)) {
+		if (CRASHDEBUG(1))
+			error(INFO, "session cache: cannot write %s\n",
+				session_cache.file);
+		unlink(tmpfile);
+	}
+
+	free(tmpfile);
+
+out:
+	for (i = 0; i < session_cache.nnew; i++) {
+		free(session_cache.new[i].data);
+		session_cache.new[i].data = NULL;
+	}
+	session_cache.nnew = 0;
+
+	if (session_cache.map) {
+		munmap(session_cache.map, session_cache.mapsize);
+		session_cache.map = NULL;
+	}
+}
+
+/*
+ *  Display the session cache state for "help -p".
+ */
+void
+dump_session_cache(void)
+{
+	fprintf(fp, "    session_cache: ");
+	if (session_cache.state != SSC_ACTIVE) {
+		fprintf(fp, "(not used)\n");
+		return;
+	}
+	fprintf(fp, "%s\n", session_cache.file);
+	fprintf(fp, "                   hits: %ld  misses: %ld\n",
+		session_cache.hits, session_cache.misses);
+}
@@ -56,6 +56,7 @@ struct load_module;
 static int add_symbol_file(struct load_module *);
 static int add_symbol_file_kallsyms(struct load_module *, struct gnu_request *);
 static void find_mod_etext(struct load_module *); 
+static void clear_lazy_module_symbols(struct load_module *);
 static long rodata_search(ulong *, ulong);
 static int ascii_long(ulong word);
 static int is_bfd_format(char *); 
@@ -63,9 +64,28 @@ static int is_binary_stripped(char *);
 static int namespace_ctl(int, struct symbol_namespace *, void *, void *);
 static void symval_hash_init(void);
 static struct syment *symval_hash_search(ulong);
+static struct syment *symval_array_search(ulong);
+static struct syment *value_search_uncached(ulong, ulong *);
+struct datatype_cache_entry;
+static void datatype_request_to_entry(char *, char *, struct gnu_request *,
+	struct datatype_cache_entry *);
+static void datatype_info_gdb(char *, char *, struct gnu_request *, char *,
+	struct datatype_cache_entry *);
+static long anon_member_info(char *, char *, struct datatype_member *);
+static void datatype_cache_init(void);
+static int datatype_cache_load(void);
+static struct datatype_cache_entry *datatype_cache_lookup(uint, char *, char *);
+static void datatype_cache_enter(uint, char *, char *,
+	struct datatype_cache_entry *);
+static void dump_datatype_cache(void);
+static void dump_line_number_cache(void);
+static void value_search_memo_flush(void);
+static void symname_index_flush(int);
+static struct syment *module_symbol_scan_start(struct load_module *,
+	struct syment *, struct syment *, ulong);
 static void symname_hash_init(void);
 static void symname_hash_install(struct syment *);
-static struct syment *symname_hash_search(struct syment *[], char *);
+static struct syment *symname_hash_search(struct syment **, uint, char *);
 static void gnu_qsort(bfd *, void *, long, unsigned int, asymbol *, asymbol *);
 static int check_gnu_debuglink(bfd *);
 static int separate_debug_file_exists(const char *, unsigned long, int *);
@@ -1051,6 +1071,30 @@ symval_hash_init(void)
 	int index;
 	struct syment *sp, *sph;
 
+	value_search_memo_flush();
+	symname_index_flush(FALSE);
+
+	/*
+	 *  If the symbol values are in ascending order, which they are once
+	 *  sorted by store_symbols(), copy them into a compact array that
+	 *  lets symval_array_search() binary-search them without touching
+	 *  the much larger syment structures.
+	 */
+	free(st->symval_array);
+	if ((st->symval_array = malloc(sizeof(ulong) * (st->symcnt+1)))) {
+		for (sp = st->symtable; sp < st->symend; sp++) {
+			if ((sp > st->symtable) && (sp->value < (sp-1)->value)) {
+				if (CRASHDEBUG(1))
+					error(INFO, "symbol values are not sorted: "
+					    "using symval_hash\n");
+				free(st->symval_array);
+				st->symval_array = NULL;
+				break;
+			}
+			st->symval_array[sp - st->symtable] = sp->value;
+		}
+	}
+
         for (sp = st->symtable; sp < st->symend; sp++) {
 		index = SYMVAL_HASH_INDEX(sp->value);
 
@@ -1110,6 +1154,105 @@ symval_hash_search(ulong value)
 	return splo;
 }
 
+/*
+ *  Binary-search the sorted symbol values for the first symbol whose value
+ *  equals the value, or failing that, the last symbol below it.  Returns
+ *  the same symbol that symval_hash_search() would, and falls back to it
+ *  if the symbol values are not sorted.
+ */
+static struct syment *
+symval_array_search(ulong value)
+{
+	long lo, hi, mid;
+
+	if (!st->symval_array)
+		return symval_hash_search(value);
+
+	st->val_hash_searches += 1;
+
+	lo = 0;
+	hi = st->symcnt;
+	while (lo < hi) {
+		st->val_hash_iterations += 1;
+		mid = lo + (hi - lo) / 2;
+		if (st->symval_array[mid] < value)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if ((lo < st->symcnt) && (st->symval_array[lo] == value))
+		return &st->symtable[lo];
+
+	return lo ? &st->symtable[lo-1] : NULL;
+}
+
+/*
+ *  Memo of recent value_search() results.  Backtraces and memory dumps
+ *  resolve the same return addresses and function pointers over and over,
+ *  so the result for each value is kept for the rest of the command.
+ */
+#define VALUE_SEARCH_MEMO	(256)
+#define VALUE_SEARCH_MEMO_INDEX(value) \
+	((((value) >> 4) ^ ((value) >> 12)) % VALUE_SEARCH_MEMO)
+
+static struct value_search_memo {
+	ulong value;
+	ulong offset;
+	struct syment *sp;
+	ulong cmdgen;
+	ulong epoch;
+} value_search_memo[VALUE_SEARCH_MEMO];
+
+static ulong value_search_memo_epoch = 1;
+
+/*
+ *  Invalidate the memo whenever symbols are installed or removed.
+ */
+static void
+value_search_memo_flush(void)
+{
+	value_search_memo_epoch++;
+}
+
+/*
+ *  Name indexes of the kernel and of the module symbols, built on first
+ *  use by symbol_query() and symbol_complete_match().  Each one holds its
+ *  symbols in the order that they are searched, a copy of them sorted by
+ *  name for prefix matches, and a trigram index for substring matches,
+ *  which lists the symbols whose names contain each hashed trigram in
+ *  search order.  A substring query only checks the symbols listed for
+ *  its rarest trigram.
+ */
+#define SYMNAME_TRIGRAMS	(65536)
+#define SYMNAME_TRIGRAM(p) \
+	(((((uint)(unsigned char)(p)[0] * 31) + (unsigned char)(p)[1]) * 31 + \
+	  (unsigned char)(p)[2]) % SYMNAME_TRIGRAMS)
+
+struct symname_index {
+	int valid;
+	int modules;
+	long cnt;
+	struct syment **syms;		/* in search order */
+	struct syment **sorted;		/* by name */
+	uint *tri_start;		/* SYMNAME_TRIGRAMS+1 offsets into tri_list */
+	uint *tri_list;			/* indexes into syms */
+};
+
+static struct symname_index symname_index[2] = {
+	{ .modules = FALSE },
+	{ .modules = TRUE },
+};
+
+/*
+ *  Have the kernel or module name index rebuilt by its next use.
+ */
+static void
+symname_index_flush(int modules)
+{
+	symname_index[modules ? 1 : 0].valid = FALSE;
+}
+
 /*
  *  Store all kernel static symbols into the symname_hash.
  */
@@ -1117,6 +1260,20 @@ static void
 symname_hash_init(void)
 {
         struct syment *sp;
+	uint size;
+
+	for (size = SYMNAME_HASH; size < st->symcnt; size <<= 1)
+		;
+
+	if (size != st->symname_hash_size) {
+		free(st->symname_hash);
+		st->symname_hash = NULL;
+	}
+	if (!st->symname_hash &&
+	    !(st->symname_hash = malloc(sizeof(struct syment *) * size)))
+		error(FATAL, "cannot malloc symname_hash table\n");
+	BZERO(st->symname_hash, sizeof(struct syment *) * size);
+	st->symname_hash_size = size;
 
         for (sp = st->symtable; sp < st->symend; sp++) 
 		symname_hash_install(sp);
@@ -1127,19 +1284,30 @@ symname_hash_init(void)
 		st->__per_cpu_end = sp->value;
 }
 
+/*
+ *  FNV-1a hash of a symbol name, folded so that its high-order bits also
+ *  affect the bucket chosen by masking with a power-of-2 table size.
+ *  Unlike sampling a few characters of the name, every character counts,
+ *  so the many symbols that share a prefix and suffix, such as the
+ *  "__ksymtab_" and "__kstrtab_" families, no longer pile up in a
+ *  handful of buckets.
+ */
 static unsigned int
-symname_hash_index(char *name)
+symname_hash_index(char *name, uint size)
 {
-	unsigned int len, value;
-	unsigned char *array = (unsigned char *)name;
+	unsigned int hash;
+	unsigned char *p;
 
-	len = strlen(name);
-	if (!len)
+	if (!*name)
 		error(FATAL, "The length of the symbol name is zero!\n");
 
-	value = array[len - 1] * array[len / 2];
+	for (hash = 2166136261U, p = (unsigned char *)name; *p; p++) {
+		hash ^= *p;
+		hash *= 16777619U;
+	}
+	hash ^= hash >> 16;
 
-	return (array[0] ^ value) % SYMNAME_HASH;
+	return hash & (size - 1);
 }
 
 /*
@@ -1151,8 +1319,9 @@ symname_hash_install(struct syment *spn)
 	struct syment *sp;
 	unsigned int index;
 
-	index = symname_hash_index(spn->name);
+	index = symname_hash_index(spn->name, st->symname_hash_size);
 	spn->cnt = 1;
+	spn->name_hash_next = NULL;
 
         if ((sp = st->symname_hash[index]) == NULL) 
         	st->symname_hash[index] = spn;
@@ -1173,18 +1342,16 @@ symname_hash_install(struct syment *spn)
 }
 
 /*
- *  Install a single kernel module symbol into the mod_symname_hash.
+ *  Link a module symbol into the mod_symname_hash chain of its bucket,
+ *  which is kept sorted by symbol value.
  */
 static void
-mod_symname_hash_install(struct syment *spn)
+mod_symname_hash_link(struct syment *spn)
 {
 	struct syment *sp;
 	unsigned int index;
 
-	if (!spn)
-		return;
-
-	index = symname_hash_index(spn->name);
+	index = symname_hash_index(spn->name, st->mod_symname_hash_size);
 
 	sp = st->mod_symname_hash[index];
 
@@ -1203,25 +1370,77 @@ mod_symname_hash_install(struct syment *spn)
 	}
 }
 
+/*
+ *  Create the mod_symname_hash, or rehash its symbols into a larger
+ *  table once the chains have grown too long.
+ */
+static void
+mod_symname_hash_resize(uint size)
+{
+	uint i, oldsize;
+	struct syment **oldtable, *sp, *next;
+
+	oldtable = st->mod_symname_hash;
+	oldsize = st->mod_symname_hash_size;
+
+	if (!(st->mod_symname_hash = calloc(size, sizeof(struct syment *)))) {
+		if (!oldtable)
+			error(FATAL, "cannot malloc mod_symname_hash table\n");
+		st->mod_symname_hash = oldtable;
+		return;
+	}
+	st->mod_symname_hash_size = size;
+
+	for (i = 0; i < oldsize; i++) {
+		for (sp = oldtable[i]; sp; sp = next) {
+			next = sp->name_hash_next;
+			mod_symname_hash_link(sp);
+		}
+	}
+
+	free(oldtable);
+}
+
+/*
+ *  Install a single kernel module symbol into the mod_symname_hash,
+ *  growing the table to keep the average chain length at or below 2.
+ */
+static void
+mod_symname_hash_install(struct syment *spn)
+{
+	if (!spn)
+		return;
+
+	if (!st->mod_symname_hash)
+		mod_symname_hash_resize(SYMNAME_HASH);
+	else if (st->mod_symname_hash_count >= 2 * st->mod_symname_hash_size)
+		mod_symname_hash_resize(st->mod_symname_hash_size * 4);
+
+	mod_symname_hash_link(spn);
+	st->mod_symname_hash_count++;
+}
+
 static void
 mod_symname_hash_remove(struct syment *spn)
 {
 	struct syment *sp;
 	unsigned int index;
 
-	if (!spn)
+	if (!spn || !st->mod_symname_hash)
 		return;
 
-	index = symname_hash_index(spn->name);
+	index = symname_hash_index(spn->name, st->mod_symname_hash_size);
 
 	if (st->mod_symname_hash[index] == spn) {
 		st->mod_symname_hash[index] = spn->name_hash_next;
+		st->mod_symname_hash_count--;
 		return;
 	}
 
 	for (sp = st->mod_symname_hash[index]; sp; sp = sp->name_hash_next) {
 		if (sp->name_hash_next == spn) {
 			sp->name_hash_next = spn->name_hash_next;
+			st->mod_symname_hash_count--;
 			return;
 		}
 	}
@@ -1232,6 +1451,9 @@ mod_symtable_hash_install_range(struct syment *from, struct syment *to)
 {
 	struct syment *sp;
 
+	value_search_memo_flush();
+	symname_index_flush(TRUE);
+
 	for (sp = from; sp <= to; sp++)
 		mod_symname_hash_install(sp);
 }
@@ -1241,6 +1463,9 @@ mod_symtable_hash_remove_range(struct syment *from, struct syment *to)
 {
 	struct syment *sp;
 
+	value_search_memo_flush();
+	symname_index_flush(TRUE);
+
 	for (sp = from; sp <= to; sp++)
 		mod_symname_hash_remove(sp);
 }
@@ -1249,11 +1474,14 @@ mod_symtable_hash_remove_range(struct syment *from, struct syment *to)
  *  Static kernel symbol value search
  */
 static struct syment *
-symname_hash_search(struct syment *table[], char *name)
+symname_hash_search(struct syment **table, uint size, char *name)
 {
 	struct syment *sp;
 
-	sp = table[symname_hash_index(name)];
+	if (!table)
+		return NULL;
+
+	sp = table[symname_hash_index(name, size)];
 
 	while (sp) {
 		if (STREQ(sp->name, name)) 
@@ -3219,31 +3447,77 @@ kallsyms_module_function_size(struct syment *sp, struct load_module *lm, ulong *
 	return FALSE;
 }
 
+/*
+ *  Summarize a symname_hash table: the number of symbols and used
+ *  buckets, the chain lengths, and with CRASHDEBUG(1), a histogram of
+ *  the number of buckets per chain length.
+ */
 static void
-dump_symname_hash_table(struct syment *table[])
+dump_symname_hash_table(struct syment **table, uint size)
 {
-	int i, cnt, tot;
+	uint i, cnt, used, longest;
+	ulong tot, histogram[9];
 	struct syment *sp;
 
-	fprintf(fp, "    ");
-	for (i = tot = 0; i < SYMNAME_HASH; i++) {
-		fprintf(fp, "[%3d]: ", i);
-		if ((sp = table[i]) == NULL)
-			fprintf(fp, "%3d  ", 0);
-		else {
-			cnt = 1;
-			while (sp->name_hash_next) {
-				cnt++;
-				sp = sp->name_hash_next;
-			}
-			fprintf(fp, "%3d  ", cnt);
+	BZERO(histogram, sizeof(histogram));
+
+	for (i = used = longest = tot = 0; table && (i < size); i++) {
+		for (cnt = 0, sp = table[i]; sp; sp = sp->name_hash_next)
+			cnt++;
+		if (cnt) {
+			used++;
 			tot += cnt;
 		}
-		if (i && (((i+1) % 6) == 0))
-			fprintf(fp, "\n    ");
+		longest = MAX(longest, cnt);
+		histogram[MIN(cnt, 8)]++;
 	}
-	if (SYMNAME_HASH % 6)
+
+	fprintf(fp, "      symbols: %ld  used buckets: %d  longest chain: %d"
+		"  (avg: %.1f)\n", tot, used, longest,
+		used ? (double)tot/(double)used : 0.0);
+
+	if (CRASHDEBUG(1) && table) {
+		fprintf(fp, "   ");
+		for (i = 0; i < 9; i++)
+			fprintf(fp, " [%d%s]: %ld", i, i == 8 ? "+" : "",
+				histogram[i]);
 		fprintf(fp, "\n");
+	}
+}
+
+/*
+ *  The memory used by the kernel and module symbol tables, their name
+ *  spaces and their hash tables, for "help -u".
+ */
+ulonglong
+symbol_table_memory_used(void)
+{
+	int i;
+	ulonglong bytes;
+	struct load_module *lm;
+
+	bytes = (ulonglong)st->symcnt * sizeof(struct syment);
+	bytes += st->kernel_namespace.size;
+	bytes += (ulonglong)st->symname_hash_size * sizeof(struct syment *);
+	if (st->symval_array)
+		bytes += (ulonglong)(st->symcnt+1) * sizeof(ulong);
+	bytes += (ulonglong)st->ext_module_symcnt * sizeof(struct syment);
+	bytes += st->ext_module_namespace.size;
+	bytes += (ulonglong)st->mod_symname_hash_size * sizeof(struct syment *);
+	bytes += (ulonglong)st->mods_installed * sizeof(struct load_module);
+
+	for (i = 0; i < st->mods_installed; i++) {
+		lm = &st->load_modules[i];
+		if (lm->mod_load_symtable)
+			bytes += (ulonglong)lm->mod_symalloc *
+				sizeof(struct syment);
+		bytes += lm->mod_load_namespace.size;
+		if (lm->mod_section_data)
+			bytes += (ulonglong)lm->mod_sections *
+				sizeof(struct mod_section_data);
+	}
+
+	return bytes;
 }
 
 /*
@@ -3379,16 +3653,21 @@ dump_symbol_table(void)
         fprintf(fp, " val_hash_iterations: %.0f  (avg: %.1f)\n",
                 st->val_hash_iterations,
                 st->val_hash_iterations/st->val_hash_searches);
-
-        fprintf(fp, "   symname_hash[%d]: %lx\n", SYMNAME_HASH,
-                (ulong)&st->symname_hash[0]);
-	if (CRASHDEBUG(1))
-		dump_symname_hash_table(st->symname_hash);
-
-	fprintf(fp, "mod_symname_hash[%d]: %lx\n", SYMNAME_HASH,
-		(ulong)&st->mod_symname_hash[0]);
-	if (CRASHDEBUG(1))
-		dump_symname_hash_table(st->mod_symname_hash);
+	fprintf(fp, "        symval_array: %lx\n", (ulong)st->symval_array);
+	fprintf(fp, " value_search_memo[%d]: hits: %ld  misses: %ld\n",
+		VALUE_SEARCH_MEMO, st->value_search_memo_hits,
+		st->value_search_memo_misses);
+	dump_datatype_cache();
+	dump_line_number_cache();
+	dump_btf_info();
+
+        fprintf(fp, "   symname_hash[%d]: %lx\n", st->symname_hash_size,
+                (ulong)st->symname_hash);
+	dump_symname_hash_table(st->symname_hash, st->symname_hash_size);
+
+	fprintf(fp, "mod_symname_hash[%d]: %lx\n", st->mod_symname_hash_size,
+		(ulong)st->mod_symname_hash);
+	dump_symname_hash_table(st->mod_symname_hash, st->mod_symname_hash_size);
 
 	fprintf(fp, "    symbol_namespace: ");
 	fprintf(fp, "address: %lx  ", (ulong)st->kernel_namespace.address);
@@ -3441,7 +3720,16 @@ dump_symbol_table(void)
 			fprintf(fp, "%sMOD_INIT", others++ ? "|" : "");
 		if (lm->mod_flags & MOD_DO_READNOW)
 			fprintf(fp, "%sMOD_DO_READNOW", others++ ? "|" : "");
+		if (lm->mod_flags & MOD_LAZY_SYMS)
+			fprintf(fp, "%sMOD_LAZY_SYMS", others++ ? "|" : "");
+		if (lm->mod_flags & MOD_LAZY_SECTIONS)
+			fprintf(fp, "%sMOD_LAZY_SECTIONS", others++ ? "|" : "");
+		if (lm->mod_flags & MOD_LAZY_READNOW)
+			fprintf(fp, "%sMOD_LAZY_READNOW", others++ ? "|" : "");
 		fprintf(fp, ")\n");
+		if (lm->mod_flags & MOD_LAZY_SYMS)
+			fprintf(fp, "     mod_lazy_namelist: %s\n",
+				lm->mod_lazy_namelist);
 
         	fprintf(fp, "          mod_symtable: %lx\n",
 			(ulong)lm->mod_symtable);
@@ -4376,6 +4664,109 @@ show_symbol(struct syment *sp, ulong offset, ulong show_flags)
 	fprintf(fp, "\n");
 }
 
+/*
+ *  Session cache of get_line_number() results, keyed by text address,
+ *  so that "bt -l" and "dis -l" do not ask gdb again for an address
+ *  that has already been resolved.  It is emptied when the symbol files
+ *  known to gdb change.
+ */
+#define LINE_NUMBER_CACHE_HASH  (4096)
+#define LINE_NUMBER_CACHE_MAX   (65536)
+#define LINE_NUMBER_CACHE_INDEX(addr) \
+	((((addr) >> 2) ^ ((addr) >> 14)) % LINE_NUMBER_CACHE_HASH)
+
+struct line_number_cache_entry {
+	struct line_number_cache_entry *next;
+	ulong addr;
+	char *line;
+};
+
+static struct line_number_cache {
+	struct line_number_cache_entry *hash[LINE_NUMBER_CACHE_HASH];
+	long entries;
+	ulong hits;
+	ulong misses;
+	ulong invalidations;
+	ulong bytes;
+} line_number_cache = { { 0 } };
+
+static struct line_number_cache_entry *
+line_number_cache_search(ulong addr)
+{
+	struct line_number_cache_entry *lnc;
+
+	for (lnc = line_number_cache.hash[LINE_NUMBER_CACHE_INDEX(addr)];
+	     lnc; lnc = lnc->next) {
+		if (lnc->addr == addr)
+			return lnc;
+	}
+
+	return NULL;
+}
+
+static void
+line_number_cache_enter(ulong addr, char *line)
+{
+	struct line_number_cache_entry *lnc;
+	int index;
+	ulong size;
+
+	if (line_number_cache.entries >= LINE_NUMBER_CACHE_MAX)
+		return;
+
+	size = sizeof(struct line_number_cache_entry) + strlen(line) + 1;
+	if (!memory_limit_reserve(size) || !(lnc = malloc(size)))
+		return;
+
+	lnc->addr = addr;
+	lnc->line = (char *)(lnc + 1);
+	strcpy(lnc->line, line);
+
+	index = LINE_NUMBER_CACHE_INDEX(addr);
+	lnc->next = line_number_cache.hash[index];
+	line_number_cache.hash[index] = lnc;
+	line_number_cache.entries++;
+	line_number_cache.bytes += size;
+}
+
+void
+line_number_cache_invalidate(void)
+{
+	struct line_number_cache_entry *lnc, *next;
+	int i;
+
+	if (!line_number_cache.entries)
+		return;
+
+	for (i = 0; i < LINE_NUMBER_CACHE_HASH; i++) {
+		for (lnc = line_number_cache.hash[i]; lnc; lnc = next) {
+			next = lnc->next;
+			free(lnc);
+		}
+		line_number_cache.hash[i] = NULL;
+	}
+
+	line_number_cache.entries = 0;
+	line_number_cache.bytes = 0;
+	line_number_cache.invalidations++;
+}
+
+ulonglong
+line_number_cache_memory_used(void)
+{
+	return line_number_cache.bytes;
+}
+
+static void
+dump_line_number_cache(void)
+{
+	fprintf(fp, "   line_number_cache: %ld entries\n",
+		line_number_cache.entries);
+	fprintf(fp, "                hits: %ld  misses: %ld  invalidations: %ld\n",
+		line_number_cache.hits, line_number_cache.misses,
+		line_number_cache.invalidations);
+}
+
 /*
  *  Use the gdb_interface to get a line number associated with a 
  *  text address -- but first check whether the address gets past 
@@ -4387,6 +4778,7 @@ get_line_number(ulong addr, char *buf, int reserved)
 	char *p;
 	struct gnu_request request, *req;
 	struct line_number_hook *lnh;
+	struct line_number_cache_entry *lnc;
 	struct syment *sp;
 	char bldbuf[BUFSIZE], *name;
 	struct load_module *lm;
@@ -4398,10 +4790,18 @@ get_line_number(ulong addr, char *buf, int reserved)
 		return(buf);
 
 	if (module_symbol(addr, NULL, &lm, NULL, 0)) {
+		if (lm->mod_flags & MOD_LAZY_SYMS)
+			load_lazy_module_symbols(addr);
 		if (!(lm->mod_flags & MOD_LOAD_SYMS))
 			return(buf);
 	}
 
+	if ((lnc = line_number_cache_search(addr))) {
+		line_number_cache.hits++;
+		return(strcpy(buf, lnc->line));
+	}
+	line_number_cache.misses++;
+
 	if ((lnh = machdep->line_number_hooks)) {
         	name = closest_symbol(addr);
 		while (lnh->func) {
@@ -4431,6 +4831,8 @@ get_line_number(ulong addr, char *buf, int reserved)
 	while ((p = strstr(buf, "//")))
 		shift_string_left(p+1, 1); 
 
+	line_number_cache_enter(addr, buf);
+
 	return(buf);
 }
 
@@ -4499,29 +4901,25 @@ get_build_directory(char *buf)
 	return buf;
 }
 /*
- *  Search for all symbols containing a string.
+ *  Store the kernel or the module symbols in list, in the order that
+ *  they have always been searched, returning their count; with a NULL
+ *  list, just count them.
  */
-int 
-symbol_query(char *s, char *print_pad, struct syment **spp)
+static long
+symname_index_gather(int modules, struct syment **list)
 {
-	int i;
-        struct syment *sp, *sp_end;
+	int i, search_init;
+	long cnt;
+	struct syment *sp;
 	struct load_module *lm;
-	int cnt, search_init;
 
 	cnt = 0;
 
-        for (sp = st->symtable; sp < st->symend; sp++) {
-		if (strstr(sp->name, s)) {
-			if (print_pad) {
-				if (strlen(print_pad))
-					fprintf(fp, "%s", print_pad);
-				show_symbol(sp, 0, SHOW_RADIX());
-			}
-			if (spp)
-				*spp = sp;
-			cnt++;
-		}
+	if (!modules) {
+		for (sp = st->symtable; sp < st->symend; sp++, cnt++)
+			if (list)
+				list[cnt] = sp;
+		return cnt;
 	}
 
 	search_init = FALSE;
@@ -4530,111 +4928,234 @@ symbol_query(char *s, char *print_pad, struct syment **spp)
 		lm = &st->load_modules[i];
 		if (lm->mod_flags & MOD_INIT)
 			search_init = TRUE;
-		sp = lm->mod_symtable;
-		sp_end = lm->mod_symend;
-
-		for ( ; sp < sp_end; sp++) {
+		for (sp = lm->mod_symtable; sp < lm->mod_symend; sp++) {
 			if (MODULE_START(sp))
 				continue;
-
-			if (strstr(sp->name, s)) {
-				if (print_pad) {
-					if (strlen(print_pad))
-						fprintf(fp, "%s", print_pad);
-					show_symbol(sp, 0, 
-						SHOW_RADIX()|SHOW_MODULE);
-				}
-				if (spp)
-					*spp = sp;
-				cnt++;
-			}
+			if (list)
+				list[cnt] = sp;
+			cnt++;
 		}
 	}
 
 	if (!search_init)
-		return(cnt);
-	
+		return cnt;
+
 	for (i = 0; i < st->mods_installed; i++) {
 		lm = &st->load_modules[i];
 		if (!lm->mod_init_symtable)
 			continue;
-		sp = lm->mod_init_symtable;
-		sp_end = lm->mod_init_symend;
-
-		for ( ; sp < sp_end; sp++) {
+		for (sp = lm->mod_init_symtable; sp < lm->mod_init_symend; sp++) {
 			if (MODULE_START(sp))
 				continue;
-
-			if (strstr(sp->name, s)) {
-				if (print_pad) {
-					if (strlen(print_pad))
-						fprintf(fp, "%s", print_pad);
-					show_symbol(sp, 0, 
-						SHOW_RADIX()|SHOW_MODULE);
-				}
-				if (spp)
-					*spp = sp;
-				cnt++;
-			}
+			if (list)
+				list[cnt] = sp;
+			cnt++;
 		}
 	}
 
-	return(cnt);
+	return cnt;
 }
 
 static int
-skip_symbols(struct syment *sp, char *s)
+symname_index_compare(const void *a, const void *b)
 {
-	int pseudos, skip = FALSE;
-
-	pseudos = (strstr(s, "_MODULE_START_") || strstr(s, "_MODULE_END_") ||
-		strstr(s, "_MODULE_INIT_START_") || strstr(s, "_MODULE_INIT_END_"));
-	if (!pseudos && MODULE_PSEUDO_SYMBOL(sp))
-		skip = TRUE;
-	return skip;
+	return strcmp((*(struct syment **)a)->name,
+		(*(struct syment **)b)->name);
 }
 
 /*
- *  Return the syment of a symbol.
+ *  Return the kernel or module name index, (re)building it if necessary.
  */
-struct syment *
-symbol_search(char *s)
+static struct symname_index *
+symname_index_get(int modules)
 {
-	struct syment *sp_hashed, *sp;
+	long i, cnt;
+	uint h, total, *cursor = NULL;
+	char *p;
+	struct symname_index *idx;
 
-	sp_hashed = symname_hash_search(st->symname_hash, s);
+	idx = &symname_index[modules ? 1 : 0];
+	if (idx->valid)
+		return idx;
 
-        for (sp = sp_hashed ? sp_hashed : st->symtable; sp < st->symend; sp++) {
-                if (STREQ(s, sp->name)) 
-                        return(sp);
-        }
+	free(idx->syms);
+	free(idx->sorted);
+	free(idx->tri_start);
+	free(idx->tri_list);
+	idx->syms = idx->sorted = NULL;
+	idx->tri_start = idx->tri_list = NULL;
 
-	sp = st->mod_symname_hash[symname_hash_index(s)];
-	while (sp) {
-		if (skip_symbols(sp, s)) {
-			sp = sp->name_hash_next;
-			continue;
+	cnt = symname_index_gather(modules, NULL);
+
+	if (!(idx->syms = malloc(sizeof(struct syment *) * (cnt+1))) ||
+	    !(idx->sorted = malloc(sizeof(struct syment *) * (cnt+1))) ||
+	    !(idx->tri_start = calloc(SYMNAME_TRIGRAMS+1, sizeof(uint))) ||
+	    !(cursor = calloc(SYMNAME_TRIGRAMS, sizeof(uint))))
+		error(FATAL, "cannot malloc symbol name index\n");
+
+	cnt = symname_index_gather(modules, idx->syms);
+	BCOPY(idx->syms, idx->sorted, sizeof(struct syment *) * cnt);
+	qsort(idx->sorted, cnt, sizeof(struct syment *), symname_index_compare);
+
+	/*
+	 *  Count the names containing each trigram, with cursor[] holding
+	 *  the last name counted, plus one, so that a trigram that occurs
+	 *  more than once in a name is only counted once.
+	 */
+	for (i = 0; i < cnt; i++) {
+		for (p = idx->syms[i]->name; p[0] && p[1] && p[2]; p++) {
+			h = SYMNAME_TRIGRAM(p);
+			if (cursor[h] == (uint)(i+1))
+				continue;
+			cursor[h] = i+1;
+			idx->tri_start[h+1]++;
 		}
-		if (STREQ(sp->name, s))
-			return sp;
-		sp = sp->name_hash_next;
 	}
 
-        return((struct syment *)NULL);
+	for (h = 0; h < SYMNAME_TRIGRAMS; h++)
+		idx->tri_start[h+1] += idx->tri_start[h];
+	total = idx->tri_start[SYMNAME_TRIGRAMS];
+
+	if (!(idx->tri_list = malloc(sizeof(uint) * (total+1))))
+		error(FATAL, "cannot malloc symbol name index\n");
+
+	BCOPY(idx->tri_start, cursor, sizeof(uint) * SYMNAME_TRIGRAMS);
+	for (i = 0; i < cnt; i++) {
+		for (p = idx->syms[i]->name; p[0] && p[1] && p[2]; p++) {
+			h = SYMNAME_TRIGRAM(p);
+			if ((cursor[h] > idx->tri_start[h]) &&
+			    (idx->tri_list[cursor[h]-1] == (uint)i))
+				continue;
+			idx->tri_list[cursor[h]++] = i;
+		}
+	}
+
+	free(cursor);
+
+	idx->cnt = cnt;
+	idx->valid = TRUE;
+
+	if (CRASHDEBUG(1))
+		fprintf(fp, "symname_index: %s: %ld symbols, %d trigram entries\n",
+			modules ? "modules" : "kernel", cnt, total);
+
+	return idx;
 }
 
 /*
- *  Count the number of instances of a symbol name.
+ *  Display the symbols of an index whose names contain s, returning
+ *  their count.
  */
-int
-symbol_name_count(char *s)
+static int
+symname_index_query(struct symname_index *idx, char *s, char *print_pad,
+		    struct syment **spp)
 {
-        int i;
-        struct syment *sp, *sp_end;
-        struct load_module *lm;
-        int count, pseudos, search_init;
-
-	count = 0;
+	int cnt;
+	uint h, i, start, end;
+	char *p;
+	struct syment *sp;
+
+	start = 0;
+	end = idx->cnt;
+
+	if (strlen(s) >= 3) {
+		for (p = s; p[2]; p++) {
+			h = SYMNAME_TRIGRAM(p);
+			if ((p == s) ||
+			    ((idx->tri_start[h+1] - idx->tri_start[h]) < (end - start))) {
+				start = idx->tri_start[h];
+				end = idx->tri_start[h+1];
+			}
+		}
+	}
+
+	for (i = start, cnt = 0; i < end; i++) {
+		sp = (strlen(s) >= 3) ? idx->syms[idx->tri_list[i]] : idx->syms[i];
+		if (!strstr(sp->name, s))
+			continue;
+		if (print_pad) {
+			if (strlen(print_pad))
+				fprintf(fp, "%s", print_pad);
+			show_symbol(sp, 0, idx->modules ?
+				SHOW_RADIX()|SHOW_MODULE : SHOW_RADIX());
+		}
+		if (spp)
+			*spp = sp;
+		cnt++;
+	}
+
+	return cnt;
+}
+
+/*
+ *  Search for all symbols containing a string.
+ */
+int 
+symbol_query(char *s, char *print_pad, struct syment **spp)
+{
+	int cnt;
+
+	cnt = symname_index_query(symname_index_get(FALSE), s, print_pad, spp);
+	cnt += symname_index_query(symname_index_get(TRUE), s, print_pad, spp);
+
+	return(cnt);
+}
+
+static int
+skip_symbols(struct syment *sp, char *s)
+{
+	int pseudos, skip = FALSE;
+
+	pseudos = (strstr(s, "_MODULE_START_") || strstr(s, "_MODULE_END_") ||
+		strstr(s, "_MODULE_INIT_START_") || strstr(s, "_MODULE_INIT_END_"));
+	if (!pseudos && MODULE_PSEUDO_SYMBOL(sp))
+		skip = TRUE;
+	return skip;
+}
+
+/*
+ *  Return the syment of a symbol.
+ */
+struct syment *
+symbol_search(char *s)
+{
+	struct syment *sp_hashed, *sp;
+
+	sp_hashed = symname_hash_search(st->symname_hash,
+		st->symname_hash_size, s);
+
+        for (sp = sp_hashed ? sp_hashed : st->symtable; sp < st->symend; sp++) {
+                if (STREQ(s, sp->name)) 
+                        return(sp);
+        }
+
+	sp = st->mod_symname_hash ? st->mod_symname_hash[symname_hash_index(s,
+		st->mod_symname_hash_size)] : NULL;
+	while (sp) {
+		if (skip_symbols(sp, s)) {
+			sp = sp->name_hash_next;
+			continue;
+		}
+		if (STREQ(sp->name, s))
+			return sp;
+		sp = sp->name_hash_next;
+	}
+
+        return((struct syment *)NULL);
+}
+
+/*
+ *  Count the number of instances of a symbol name.
+ */
+int
+symbol_name_count(char *s)
+{
+        int i;
+        struct syment *sp, *sp_end;
+        struct load_module *lm;
+        int count, pseudos, search_init;
+
+	count = 0;
 
         for (sp = st->symtable; sp < st->symend; sp++) {
                 if (STREQ(s, sp->name)) {
@@ -4867,6 +5388,40 @@ module_symbol(ulong value,
 	return FALSE;
 }
 
+/*
+ *  Find where value_search_module() can start its linear scan of a
+ *  module's symbols, which are sorted by value.  Binary-search for the
+ *  first symbol at or above the value, and then back up to the closest
+ *  ordinary symbol below it, since the scan would have made that symbol
+ *  its splast candidate regardless of any symbols preceding it.
+ */
+static struct syment *
+module_symbol_scan_start(struct load_module *lm, struct syment *sp,
+	struct syment *sp_end, ulong value)
+{
+	struct syment *lo, *hi, *mid;
+
+	lo = sp;
+	hi = sp_end + 1;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (mid->value < value)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (lo--; lo > sp; lo--) {
+		if (MODULE_PSEUDO_SYMBOL(lo) || is_insmod_builtin(lm, lo))
+			continue;
+		if (machine_type("ARM64") && IN_MODULE_PERCPU(lo->value, lm))
+			continue;
+		return lo;
+	}
+
+	return sp;
+}
+
 struct syment *
 value_search_module(ulong value, ulong *offset)
 {
@@ -4907,6 +5462,7 @@ retry:
                 *  when they have unique values.
 		*/
 		splast = NULL;
+		sp = module_symbol_scan_start(lm, sp, sp_end, value);
                 for ( ; sp <= sp_end; sp++) {
 			if (machine_type("ARM64") &&
 			    IN_MODULE_PERCPU(sp->value, lm) &&
@@ -4975,6 +5531,41 @@ retry:
  */
 struct syment *
 value_search(ulong value, ulong *offset)
+{
+	struct value_search_memo *vsm;
+	struct syment *sp;
+	ulong off;
+
+	if (!(pc->flags & RUNTIME))
+		return value_search_uncached(value, offset);
+
+	vsm = &value_search_memo[VALUE_SEARCH_MEMO_INDEX(value)];
+	if ((vsm->epoch == value_search_memo_epoch) &&
+	    (vsm->cmdgen == pc->cmdgencur) && (vsm->value == value)) {
+		st->value_search_memo_hits++;
+		if (vsm->sp && offset)
+			*offset = vsm->offset;
+		return vsm->sp;
+	}
+
+	st->value_search_memo_misses++;
+	off = 0;
+	sp = value_search_uncached(value, &off);
+
+	vsm->value = value;
+	vsm->offset = off;
+	vsm->sp = sp;
+	vsm->cmdgen = pc->cmdgencur;
+	vsm->epoch = value_search_memo_epoch;
+
+	if (sp && offset)
+		*offset = off;
+
+	return sp;
+}
+
+static struct syment *
+value_search_uncached(ulong value, ulong *offset)
 {
         struct syment *sp, *spnext;
 
@@ -4987,7 +5578,7 @@ value_search(ulong value, ulong *offset)
 	if (IS_VMALLOC_ADDR(value))
 		goto check_modules;
 
-	if ((sp = symval_hash_search(value)) == NULL)
+	if ((sp = symval_array_search(value)) == NULL)
 		sp = st->symtable;
  
         for ( ; sp < st->symend; sp++) {
@@ -5067,7 +5658,7 @@ value_search_base_kernel(ulong value, ulong *offset)
         if (value < st->symtable[0].value)
         	return((struct syment *)NULL);
 
-	if ((sp = symval_hash_search(value)) == NULL)
+	if ((sp = symval_array_search(value)) == NULL)
 		sp = st->symtable;
  
         for ( ; sp < st->symend; sp++) {
@@ -5512,10 +6103,11 @@ value_symbol(ulong value)
 int
 symbol_exists(char *symbol)
 {
-	if (symname_hash_search(st->symname_hash, symbol))
+	if (symname_hash_search(st->symname_hash, st->symname_hash_size, symbol))
 		return TRUE;
 
-	if (symname_hash_search(st->mod_symname_hash, symbol))
+	if (symname_hash_search(st->mod_symname_hash,
+	    st->mod_symname_hash_size, symbol))
 		return TRUE;
 
         return(FALSE);
@@ -5565,83 +6157,665 @@ per_cpu_symbol_search(char *symbol)
 	return NULL;
 }
 
-/*
- *  Determine whether a static kernel symbol exists.
- */
-int
-kernel_symbol_exists(char *symbol)
-{
-	return !!symname_hash_search(st->symname_hash, symbol);
-}
+/*
+ *  Determine whether a static kernel symbol exists.
+ */
+int
+kernel_symbol_exists(char *symbol)
+{
+	return !!symname_hash_search(st->symname_hash,
+		st->symname_hash_size, symbol);
+}
+
+/*
+ *  Similar to above, but return the syment of the kernel symbol.
+ */
+struct syment *
+kernel_symbol_search(char *symbol)
+{
+	return symname_hash_search(st->symname_hash,
+		st->symname_hash_size, symbol);
+}
+
+/*
+ *  Return the number of instances of a symbol name along with pointers to
+ *  their syment structures.
+ */
+int
+get_syment_array(char *symbol, struct syment **sp_array, int max)
+{
+        int i, cnt;
+        struct syment *sp, *sp_end;
+        struct load_module *lm;
+
+	cnt = 0;
+
+        for (sp = st->symtable; sp < st->symend; sp++) {
+                if ((*symbol == *(sp->name)) && STREQ(symbol, sp->name)) {
+			if (!sp_array) 
+				return sp->cnt;
+			if (max) { 
+				if (cnt == max) {
+					error(INFO, 
+					    "symbol count overflow (%s)\n",
+						symbol); 
+					return cnt;
+				} else
+					sp_array[cnt] = sp;
+			}
+			if (sp->cnt == 1)
+				return 1;
+			cnt++;
+		}
+        }
+
+        for (i = 0; i < st->mods_installed; i++) {
+                lm = &st->load_modules[i];
+                sp = lm->mod_symtable;
+                sp_end = lm->mod_symend;
+
+                for ( ; sp < sp_end; sp++) {
+                        if (STREQ(symbol, sp->name)) {
+				if (max && (cnt < max))
+                                	sp_array[cnt] = sp;
+                                cnt++;
+			}
+                }
+
+		if (lm->mod_init_symtable) {
+                	sp = lm->mod_init_symtable;
+                	sp_end = lm->mod_init_symend;
+			for ( ; sp < sp_end; sp++) {
+				if (STREQ(symbol, sp->name)) {
+					if (max && (cnt < max))
+						sp_array[cnt] = sp;
+					cnt++;
+				}
+			}
+		}
+	}
+
+        return cnt;
+}
+
+/*
+ *  The datatype cache records the answers to the datatype_info() queries
+ *  made during session initialization, which mostly come from the many
+ *  MEMBER_OFFSET_INIT() and STRUCT_SIZE_INIT() invocations, and saves them
+ *  in a file named after the build-id of the vmlinux file.  The next
+ *  session with the same kernel maps the file and answers the queries
+ *  without going through gdb.  The file is looked for and written in
+ *  $XDG_CACHE_HOME/crash, or $HOME/.cache/crash, and is only used if its
+ *  key matches the build-id, the crash version, and the machine type.
+ *  The cache file can be disabled with "set datatype_cache off" in a
+ *  .crashrc file.
+ *
+ *  The same table also memoizes the queries made by commands and extension
+ *  modules at runtime, such as the member lookups that "list -s" and
+ *  "struct" make for every structure they display.  Those entries are not
+ *  saved, and the table is emptied whenever gdb adds or removes a symbol
+ *  file, as that may change the answers.
+ */
+#define DATATYPE_CACHE_MAGIC	"crashdtc"
+#define DATATYPE_CACHE_VERSION	(1)
+#define DATATYPE_CACHE_KEYLEN	(256)
+#define DATATYPE_CACHE_SUFFIX	".dtcache"
+
+struct datatype_cache_header {
+	char magic[8];
+	uint version;
+	uint entry_size;
+	uint nentries;
+	uint strsize;
+	char key[DATATYPE_CACHE_KEYLEN];
+};
+
+#define DTC_DATATYPE		(0)	/* datatype_info() query kinds */
+#define DTC_ANON_MEMBER_OFFSET	(1)
+#define DTC_ANON_MEMBER_SIZE	(2)
+
+#define DTC_FAILED		(0x1)	/* GNU_COMMAND_FAILED */
+#define DTC_TYPEDEF		(0x2)
+
+#define DTC_NO_MEMBER		((uint)-1)
+
+struct datatype_cache_entry {
+	uint name;			/* string table offsets */
+	uint member;
+	uint kind;
+	uint flags;
+	int typecode;
+	int member_typecode;
+	ulong type_found;
+	long size;
+	long offset;
+	long member_size;
+};
+
+#define DTC_UNINITIALIZED	(0)
+#define DTC_ACTIVE		(1)
+#define DTC_DISABLED		(2)
+
+static struct datatype_cache {
+	int state;
+	int dirty;
+	char key[DATATYPE_CACHE_KEYLEN];
+	char *file;
+	char *map;			/* mapped cache file */
+	size_t mapsize;
+	struct datatype_cache_entry *entries;
+	uint nentries;
+	uint maxentries;
+	char *strings;
+	uint strsize;
+	uint maxstrsize;
+	uint *index;			/* entry index + 1, open-addressed */
+	uint indexsize;
+	ulong loaded;
+	ulong hits;
+	ulong misses;
+	ulong invalidations;
+} datatype_cache = { 0 };
+
+/*
+ *  Read the GNU build-id note of a bfd as a hexadecimal string.
+ */
+int
+get_build_id(bfd *bfd, char *buf, int len)
+{
+	asection *sect;
+	bfd_size_type size;
+	unsigned char *contents, *desc;
+	ulong namesz, descsz, i;
+
+	if (!bfd || !(sect = bfd_get_section_by_name(bfd, ".note.gnu.build-id")))
+		return FALSE;
+
+	if ((size = bfd_section_size(sect)) < 16)
+		return FALSE;
+
+	contents = (unsigned char *)GETBUF(size);
+	if (!bfd_get_section_contents(bfd, sect, contents, (file_ptr)0, size)) {
+		FREEBUF(contents);
+		return FALSE;
+	}
+
+	namesz = bfd_get_32(bfd, (bfd_byte *)contents);
+	descsz = bfd_get_32(bfd, (bfd_byte *)contents + 4);
+	desc = contents + 12 + roundup(namesz, 4);
+
+	if (!descsz || ((desc - contents) + descsz > size) ||
+	    ((descsz * 2) + 1 > len)) {
+		FREEBUF(contents);
+		return FALSE;
+	}
+
+	for (i = 0; i < descsz; i++)
+		sprintf(&buf[i*2], "%02x", desc[i]);
+
+	FREEBUF(contents);
+	return TRUE;
+}
+
+static unsigned int
+datatype_cache_hash(uint kind, char *name, char *member)
+{
+	unsigned int hash;
+	unsigned char *p;
+
+	hash = 2166136261U ^ kind;
+	for (p = (unsigned char *)name; *p; p++) {
+		hash ^= *p;
+		hash *= 16777619U;
+	}
+	hash ^= '.';
+	hash *= 16777619U;
+	for (p = (unsigned char *)member; p && *p; p++) {
+		hash ^= *p;
+		hash *= 16777619U;
+	}
+
+	return hash ^ (hash >> 16);
+}
+
+/*
+ *  (Re)build the open-addressed index of the cache entries, sized to
+ *  keep it at most half full.
+ */
+static int
+datatype_cache_index(uint size)
+{
+	uint i, slot;
+	struct datatype_cache_entry *dce;
+	char *member;
+
+	free(datatype_cache.index);
+	if (!(datatype_cache.index = calloc(size, sizeof(uint)))) {
+		datatype_cache.indexsize = 0;
+		return FALSE;
+	}
+	datatype_cache.indexsize = size;
+
+	for (i = 0; i < datatype_cache.nentries; i++) {
+		dce = &datatype_cache.entries[i];
+		member = (dce->member == DTC_NO_MEMBER) ?
+			NULL : datatype_cache.strings + dce->member;
+		slot = datatype_cache_hash(dce->kind,
+			datatype_cache.strings + dce->name, member) & (size - 1);
+		while (datatype_cache.index[slot])
+			slot = (slot + 1) & (size - 1);
+		datatype_cache.index[slot] = i + 1;
+	}
+
+	return TRUE;
+}
+
+/*
+ *  Determine the cache key and file, and load the file if it exists.
+ *  Without a file, the cache only serves as an in-memory memo.
+ */
+static void
+datatype_cache_init(void)
+{
+	char buildid[BUFSIZE];
+	char dir[PATH_MAX];
+	char *p;
+
+	datatype_cache.state = DTC_ACTIVE;
+
+	if (!(pc->flags2 & DATATYPE_CACHE) || (pc->flags & (KERNTYPES|MINIMAL_MODE)))
+		return;
+
+	if (!get_build_id(st->bfd, buildid, BUFSIZE)) {
+		if (CRASHDEBUG(1))
+			error(INFO, "datatype cache: no build-id in %s\n",
+				pc->namelist);
+		return;
+	}
+
+	snprintf(datatype_cache.key, DATATYPE_CACHE_KEYLEN,
+		"%s %s %s %ld", buildid, pc->program_version,
+		pc->machine_type, (long)sizeof(long));
+
+	if ((p = getenv("XDG_CACHE_HOME")) && strlen(p))
+		snprintf(dir, PATH_MAX, "%s/crash", p);
+	else if ((p = getenv("HOME")) && strlen(p))
+		snprintf(dir, PATH_MAX, "%s/.cache/crash", p);
+	else
+		return;
+
+	if (!(datatype_cache.file = malloc(strlen(dir) + strlen(buildid) +
+	    strlen(DATATYPE_CACHE_SUFFIX) + 2)))
+		return;
+	sprintf(datatype_cache.file, "%s/%s%s", dir, buildid,
+		DATATYPE_CACHE_SUFFIX);
+
+	if (!datatype_cache_load() && CRASHDEBUG(1))
+		error(INFO, "datatype cache: %s: not used\n", datatype_cache.file);
+}
+
+/*
+ *  Map the cache file and verify it; the entries and their strings are
+ *  used in place until a new entry has to be added.
+ */
+static int
+datatype_cache_load(void)
+{
+	int fd;
+	struct stat sbuf;
+	struct datatype_cache_header *dch;
+	struct datatype_cache_entry *dce;
+	char *map;
+	size_t size;
+	uint i, isize;
+
+	if ((fd = open(datatype_cache.file, O_RDONLY)) < 0)
+		return FALSE;
+
+	if ((fstat(fd, &sbuf) < 0) ||
+	    (sbuf.st_size < sizeof(struct datatype_cache_header))) {
+		close(fd);
+		return FALSE;
+	}
+	size = sbuf.st_size;
+
+	map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return FALSE;
+
+	dch = (struct datatype_cache_header *)map;
+	if (memcmp(dch->magic, DATATYPE_CACHE_MAGIC, sizeof(dch->magic)) ||
+	    (dch->version != DATATYPE_CACHE_VERSION) ||
+	    (dch->entry_size != sizeof(struct datatype_cache_entry)) ||
+	    strncmp(dch->key, datatype_cache.key, DATATYPE_CACHE_KEYLEN) ||
+	    (size != sizeof(struct datatype_cache_header) +
+	    ((size_t)dch->nentries * sizeof(struct datatype_cache_entry)) +
+	    dch->strsize) || !dch->strsize)
+		goto bailout;
+
+	datatype_cache.entries = (struct datatype_cache_entry *)(dch + 1);
+	datatype_cache.strings = (char *)(datatype_cache.entries + dch->nentries);
+
+	if (datatype_cache.strings[dch->strsize - 1] != NULLCHAR)
+		goto bailout;
+
+	for (i = 0; i < dch->nentries; i++) {
+		dce = &datatype_cache.entries[i];
+		if ((dce->name >= dch->strsize) || (dce->kind > DTC_ANON_MEMBER_SIZE) ||
+		    ((dce->member != DTC_NO_MEMBER) && (dce->member >= dch->strsize)))
+			goto bailout;
+	}
+
+	datatype_cache.map = map;
+	datatype_cache.mapsize = size;
+	datatype_cache.nentries = datatype_cache.maxentries = dch->nentries;
+	datatype_cache.strsize = datatype_cache.maxstrsize = dch->strsize;
+
+	for (isize = 1024; isize < (dch->nentries * 2); isize <<= 1)
+		;
+	if (!datatype_cache_index(isize))
+		goto bailout;
+
+	datatype_cache.loaded = dch->nentries;
+
+	return TRUE;
+
+bailout:
+	munmap(map, size);
+	datatype_cache.map = NULL;
+	datatype_cache.entries = NULL;
+	datatype_cache.strings = NULL;
+	datatype_cache.nentries = datatype_cache.maxentries = 0;
+	datatype_cache.strsize = datatype_cache.maxstrsize = 0;
+	return FALSE;
+}
+
+/*
+ *  Only the queries made during session initialization are recorded.
+ */
+static struct datatype_cache_entry *
+datatype_cache_lookup(uint kind, char *name, char *member)
+{
+	uint slot, i;
+	struct datatype_cache_entry *dce;
+
+	if (pc->flags & RUNTIME)
+		return NULL;
+
+	if (datatype_cache.state == DTC_UNINITIALIZED)
+		datatype_cache_init();
+
+	if ((datatype_cache.state != DTC_ACTIVE) || !datatype_cache.indexsize) {
+		datatype_cache.misses++;
+		return NULL;
+	}
+
+	slot = datatype_cache_hash(kind, name, member) &
+		(datatype_cache.indexsize - 1);
+	while ((i = datatype_cache.index[slot])) {
+		dce = &datatype_cache.entries[i-1];
+		if ((dce->kind == kind) &&
+		    STREQ(datatype_cache.strings + dce->name, name) &&
+		    (member ? ((dce->member != DTC_NO_MEMBER) &&
+		    STREQ(datatype_cache.strings + dce->member, member)) :
+		    (dce->member == DTC_NO_MEMBER))) {
+			datatype_cache.hits++;
+			return dce;
+		}
+		slot = (slot + 1) & (datatype_cache.indexsize - 1);
+	}
+
+	datatype_cache.misses++;
+	return NULL;
+}
+
+/*
+ *  Append a string to the cache's string table, returning its offset.
+ */
+static uint
+datatype_cache_string(char *s)
+{
+	uint len, offset;
+	char *strings;
+
+	len = strlen(s) + 1;
+	if (datatype_cache.strsize + len > datatype_cache.maxstrsize) {
+		if (!(strings = realloc(datatype_cache.strings,
+		    MAX(datatype_cache.maxstrsize * 2,
+		    datatype_cache.strsize + len + 4096))))
+			return DTC_NO_MEMBER;
+		datatype_cache.strings = strings;
+		datatype_cache.maxstrsize = MAX(datatype_cache.maxstrsize * 2,
+			datatype_cache.strsize + len + 4096);
+	}
+
+	offset = datatype_cache.strsize;
+	memcpy(datatype_cache.strings + offset, s, len);
+	datatype_cache.strsize += len;
+
+	return offset;
+}
+
+/*
+ *  Move the entries and strings out of the read-only file mapping so
+ *  that new entries can be added.
+ */
+static int
+datatype_cache_unmap(void)
+{
+	struct datatype_cache_entry *entries;
+	char *strings;
+
+	entries = malloc(MAX(datatype_cache.nentries, 1) *
+		sizeof(struct datatype_cache_entry));
+	strings = malloc(MAX(datatype_cache.strsize, 1));
+	if (!entries || !strings) {
+		free(entries);
+		free(strings);
+		return FALSE;
+	}
+
+	memcpy(entries, datatype_cache.entries,
+		datatype_cache.nentries * sizeof(struct datatype_cache_entry));
+	memcpy(strings, datatype_cache.strings, datatype_cache.strsize);
+	munmap(datatype_cache.map, datatype_cache.mapsize);
+
+	datatype_cache.map = NULL;
+	datatype_cache.entries = entries;
+	datatype_cache.strings = strings;
+	datatype_cache.maxentries = MAX(datatype_cache.nentries, 1);
+	datatype_cache.maxstrsize = MAX(datatype_cache.strsize, 1);
+
+	return TRUE;
+}
+
+static void
+datatype_cache_enter(uint kind, char *name, char *member,
+	struct datatype_cache_entry *entry)
+{
+	struct datatype_cache_entry *dce, *entries;
+	uint n, slot;
+
+	if (datatype_cache.state != DTC_ACTIVE)
+		return;
+
+	if (datatype_cache.map && !datatype_cache_unmap())
+		goto disable;
+
+	if (datatype_cache.nentries == datatype_cache.maxentries) {
+		n = MAX(datatype_cache.maxentries * 2, 1024);
+		if (!memory_limit_reserve((n - datatype_cache.maxentries) *
+		    sizeof(struct datatype_cache_entry)))
+			return;
+		if (!(entries = realloc(datatype_cache.entries,
+		    n * sizeof(struct datatype_cache_entry))))
+			goto disable;
+		datatype_cache.entries = entries;
+		datatype_cache.maxentries = n;
+	}
+
+	if ((datatype_cache.nentries + 1) * 2 > datatype_cache.indexsize) {
+		if (!datatype_cache_index(MAX(datatype_cache.indexsize * 2, 2048)))
+			goto disable;
+	}
+
+	dce = &datatype_cache.entries[datatype_cache.nentries];
+	*dce = *entry;
+	dce->kind = kind;
+	if ((dce->name = datatype_cache_string(name)) == DTC_NO_MEMBER)
+		goto disable;
+	dce->member = DTC_NO_MEMBER;
+	if (member && ((dce->member = datatype_cache_string(member)) == DTC_NO_MEMBER))
+		goto disable;
+
+	slot = datatype_cache_hash(kind, name, member) &
+		(datatype_cache.indexsize - 1);
+	while (datatype_cache.index[slot])
+		slot = (slot + 1) & (datatype_cache.indexsize - 1);
+	datatype_cache.index[slot] = ++datatype_cache.nentries;
+
+	if (!(pc->flags & RUNTIME))
+		datatype_cache.dirty = TRUE;
+	return;
+
+disable:
+	error(INFO, "datatype cache: out of memory: disabled\n");
+	datatype_cache.state = DTC_DISABLED;
+}
+
+/*
+ *  Empty the cache when the symbol files known to gdb change.  This is
+ *  exported for extension modules that load symbol files of their own.
+ */
+void
+datatype_cache_invalidate(void)
+{
+	if (datatype_cache.state != DTC_ACTIVE)
+		return;
+
+	if (datatype_cache.map) {
+		munmap(datatype_cache.map, datatype_cache.mapsize);
+		datatype_cache.map = NULL;
+		datatype_cache.entries = NULL;
+		datatype_cache.strings = NULL;
+		datatype_cache.maxentries = datatype_cache.maxstrsize = 0;
+	}
+
+	datatype_cache.nentries = 0;
+	datatype_cache.strsize = 0;
+	if (datatype_cache.index)
+		BZERO(datatype_cache.index,
+			datatype_cache.indexsize * sizeof(uint));
+
+	/*
+	 *  A file saved now would be missing the entries just discarded.
+	 */
+	datatype_cache.dirty = FALSE;
+	datatype_cache.invalidations++;
+}
+
+/*
+ *  Called once session initialization is complete: if any queries were
+ *  not answered by the cache file, write out a new one.
+ */
+void
+datatype_cache_save(void)
+{
+	struct datatype_cache_header dch;
+	char *tmpfile, *p;
+	int fd, ok;
+
+	if ((datatype_cache.state != DTC_ACTIVE) || !datatype_cache.file ||
+	    !datatype_cache.dirty || datatype_cache.invalidations)
+		return;
+
+	datatype_cache.dirty = FALSE;
+
+	if (!(tmpfile = malloc(strlen(datatype_cache.file) + 8)))
+		return;
+
+	/*
+	 *  Create $HOME/.cache and $HOME/.cache/crash as required.
+	 */
+	strcpy(tmpfile, datatype_cache.file);
+	p = strrchr(tmpfile, '/');
+	*p = NULLCHAR;
+	if ((mkdir(tmpfile, 0755) < 0) && (errno == ENOENT)) {
+		p = strrchr(tmpfile, '/');
+		*p = NULLCHAR;
+		mkdir(tmpfile, 0755);
+		*p = '/';
+		mkdir(tmpfile, 0755);
+	}
+
+	sprintf(tmpfile, "%s.XXXXXX", datatype_cache.file);
+	if ((fd = mkstemp(tmpfile)) < 0) {
+		if (CRASHDEBUG(1))
+			error(INFO, "datatype cache: %s: %s\n", tmpfile,
+				strerror(errno));
+		free(tmpfile);
+		return;
+	}
+
+	BZERO(&dch, sizeof(struct datatype_cache_header));
+	memcpy(dch.magic, DATATYPE_CACHE_MAGIC, sizeof(dch.magic));
+	dch.version = DATATYPE_CACHE_VERSION;
+	dch.entry_size = sizeof(struct datatype_cache_entry);
+	dch.nentries = datatype_cache.nentries;
+	dch.strsize = datatype_cache.strsize;
+	strncpy(dch.key, datatype_cache.key, DATATYPE_CACHE_KEYLEN-1);
+
+	ok = (write(fd, &dch, sizeof(dch)) == sizeof(dch)) &&
+	    (write(fd, datatype_cache.entries, datatype_cache.nentries *
+		sizeof(struct datatype_cache_entry)) == datatype_cache.nentries *
+		sizeof(struct datatype_cache_entry)) &&
+	    (write(fd, datatype_cache.strings, datatype_cache.strsize) ==
+		datatype_cache.strsize);
+
+	if ((close(fd) < 0) || !ok || (rename(tmpfile, datatype_cache.file) < 0)) {
+		if (CRASHDEBUG(1))
+			error(INFO, "datatype cache: cannot write %s\n",
+				datatype_cache.file);
+		unlink(tmpfile);
+	}
 
-/*
- *  Similar to above, but return the syment of the kernel symbol.
- */
-struct syment *
-kernel_symbol_search(char *symbol)
-{
-	return symname_hash_search(st->symname_hash, symbol);
+	free(tmpfile);
 }
 
 /*
- *  Return the number of instances of a symbol name along with pointers to
- *  their syment structures.
+ *  The memory used by the datatype cache, other than that of a cache
+ *  file that is still mapped as it was read.
  */
-int
-get_syment_array(char *symbol, struct syment **sp_array, int max)
+ulonglong
+datatype_cache_memory_used(void)
 {
-        int i, cnt;
-        struct syment *sp, *sp_end;
-        struct load_module *lm;
-
-	cnt = 0;
-
-        for (sp = st->symtable; sp < st->symend; sp++) {
-                if ((*symbol == *(sp->name)) && STREQ(symbol, sp->name)) {
-			if (!sp_array) 
-				return sp->cnt;
-			if (max) { 
-				if (cnt == max) {
-					error(INFO, 
-					    "symbol count overflow (%s)\n",
-						symbol); 
-					return cnt;
-				} else
-					sp_array[cnt] = sp;
-			}
-			if (sp->cnt == 1)
-				return 1;
-			cnt++;
-		}
-        }
-
-        for (i = 0; i < st->mods_installed; i++) {
-                lm = &st->load_modules[i];
-                sp = lm->mod_symtable;
-                sp_end = lm->mod_symend;
+	ulonglong bytes;
 
-                for ( ; sp < sp_end; sp++) {
-                        if (STREQ(symbol, sp->name)) {
-				if (max && (cnt < max))
-                                	sp_array[cnt] = sp;
-                                cnt++;
-			}
-                }
+	bytes = (ulonglong)datatype_cache.indexsize * sizeof(uint);
+	if (!datatype_cache.map)
+		bytes += (ulonglong)datatype_cache.maxentries *
+			sizeof(struct datatype_cache_entry) +
+			datatype_cache.maxstrsize;
 
-		if (lm->mod_init_symtable) {
-                	sp = lm->mod_init_symtable;
-                	sp_end = lm->mod_init_symend;
-			for ( ; sp < sp_end; sp++) {
-				if (STREQ(symbol, sp->name)) {
-					if (max && (cnt < max))
-						sp_array[cnt] = sp;
-					cnt++;
-				}
-			}
-		}
-	}
+	return bytes;
+}
 
-        return cnt;
+static void
+dump_datatype_cache(void)
+{
+	fprintf(fp, "      datatype_cache: %s\n",
+		datatype_cache.state == DTC_ACTIVE ? "active" :
+		(datatype_cache.state == DTC_DISABLED ? "(disabled)" :
+		"(uninitialized)"));
+	fprintf(fp, "                file: %s\n",
+		datatype_cache.file ? datatype_cache.file : "(none)");
+	fprintf(fp, "                 key: %s\n", datatype_cache.key);
+	fprintf(fp, "             entries: %d  (loaded: %ld)\n",
+		datatype_cache.nentries, datatype_cache.loaded);
+	fprintf(fp, "                hits: %ld  misses: %ld  invalidations: %ld\n",
+		datatype_cache.hits, datatype_cache.misses,
+		datatype_cache.invalidations);
 }
 
 /*
@@ -5675,16 +6849,98 @@ long
 datatype_info(char *name, char *member, struct datatype_member *dm)
 {
 	struct gnu_request request, *req = &request;
-	long offset, size, member_size;
-	int member_typecode;
-	ulong type_found;
+	struct datatype_cache_entry entry, *dce;
 	char buf[BUFSIZE];
 
-	if (dm == ANON_MEMBER_OFFSET_REQUEST)
-		return anon_member_offset(name, member);
+	if ((dm == ANON_MEMBER_OFFSET_REQUEST) ||
+	    (dm == ANON_MEMBER_SIZE_REQUEST))
+		return anon_member_info(name, member, dm);
+
+	/*
+	 *  MEMBER_TYPE_NAME_REQUEST returns a type name string owned by gdb,
+	 *  and enumerator lookups return a tagname, neither of which can be
+	 *  kept in the datatype cache.
+	 */
+	if ((dm != MEMBER_TYPE_NAME_REQUEST) &&
+	    (dce = datatype_cache_lookup(DTC_DATATYPE, name, member)))
+		req = NULL;
+	else if ((dm != MEMBER_TYPE_NAME_REQUEST) &&
+	    (pc->flags2 & BTF_TYPES) && btf_datatype_info(name, member, req)) {
+		dce = &entry;
+		datatype_request_to_entry(name, member, req, dce);
+		datatype_cache_enter(DTC_DATATYPE, name, member, dce);
+	} else {
+		dce = &entry;
+		datatype_info_gdb(name, member, req, buf, dce);
+		if ((dm != MEMBER_TYPE_NAME_REQUEST) && !req->tagname)
+			datatype_cache_enter(DTC_DATATYPE, name, member, dce);
+	}
+
+	if (dce->flags & DTC_FAILED)
+		return (dm == MEMBER_TYPE_NAME_REQUEST) ? 0 : -1;
+
+        if (dm && (dm != MEMBER_SIZE_REQUEST) && (dm != MEMBER_TYPE_REQUEST) &&
+	    (dm != STRUCT_SIZE_REQUEST) && (dm != MEMBER_TYPE_NAME_REQUEST)) {
+                dm->type = dce->type_found;
+                dm->size = dce->size;
+		dm->member_size = dce->member_size;
+		dm->member_typecode = dce->member_typecode;
+		dm->member_offset = dce->offset;
+		if (dce->flags & DTC_TYPEDEF) {
+			dm->flags |= TYPEDEF;
+		}
+		if (req && req->tagname) {
+			dm->tagname = req->tagname;
+			dm->value = req->value;
+		}
+        }
+
+	if (!dce->type_found) 
+		return (dm == MEMBER_TYPE_NAME_REQUEST) ? 0 : -1;
+
+	if (dm == MEMBER_SIZE_REQUEST)
+		return dce->member_size;
+	else if (dm == MEMBER_TYPE_REQUEST)
+		return dce->member_typecode;
+	else if (dm == MEMBER_TYPE_NAME_REQUEST) {
+		if (req->member_main_type_name)
+			return (ulong)req->member_main_type_name;
+		else if (req->member_main_type_tag_name)
+			return (ulong)req->member_main_type_tag_name;
+		else if (req->member_target_type_name)
+			return (ulong)req->member_target_type_name;
+		else if (req->member_target_type_tag_name)
+			return (ulong)req->member_target_type_tag_name;
+		else
+			return 0;
+	} else if (dm == STRUCT_SIZE_REQUEST) {
+		if ((dce->typecode == TYPE_CODE_STRUCT) || 
+		    (dce->typecode == TYPE_CODE_UNION) ||
+		     (dce->flags & DTC_TYPEDEF))
+			return dce->size;
+		else
+			return -1;
+        } else if (member) {
+		if ((dce->typecode == TYPE_CODE_STRUCT) || 
+		    (dce->typecode == TYPE_CODE_UNION))
+			return dce->offset;
+		else
+			return -1;
+	} else
+                return dce->size;
+}
 
-	if (dm == ANON_MEMBER_SIZE_REQUEST)
-		return anon_member_size(name, member);
+/*
+ *  Query gdb for a datatype, or a member within it, on behalf of
+ *  datatype_info(), and reduce the answer to a datatype cache entry.
+ *  The request is left intact for the callers that need the strings
+ *  it points to.
+ */
+static void
+datatype_info_gdb(char *name, char *member, struct gnu_request *req, char *buf,
+	struct datatype_cache_entry *dce)
+{
+	BZERO(dce, sizeof(struct datatype_cache_entry));
 
 	strcpy(buf, name);
 
@@ -5696,8 +6952,10 @@ datatype_info(char *name, char *member, struct datatype_member *dm)
 	req->fp = pc->nullfp;
 
 	gdb_interface(req);
-	if (req->flags & GNU_COMMAND_FAILED)
-		return (dm == MEMBER_TYPE_NAME_REQUEST) ? 0 : -1;
+	if (req->flags & GNU_COMMAND_FAILED) {
+		dce->flags = DTC_FAILED;
+		return;
+	}
 
 	if (!req->typecode) {
 		sprintf(buf, "struct %s", name);
@@ -5709,6 +6967,23 @@ datatype_info(char *name, char *member, struct datatype_member *dm)
 		gdb_interface(req);
 	}
 
+	datatype_request_to_entry(name, member, req, dce);
+}
+
+/*
+ *  Reduce the answer to a GNU_GET_DATATYPE request, from gdb or from
+ *  btf_datatype_info(), to a datatype cache entry.
+ */
+static void
+datatype_request_to_entry(char *name, char *member, struct gnu_request *req,
+	struct datatype_cache_entry *dce)
+{
+	long offset, size, member_size;
+	int member_typecode;
+	ulong type_found;
+
+	BZERO(dce, sizeof(struct datatype_cache_entry));
+
 	member_typecode = TYPE_CODE_UNDEF;
 	member_size = 0;
 	type_found = 0;
@@ -5809,55 +7084,40 @@ datatype_info(char *name, char *member, struct datatype_member *dm)
 		break;
 	}
 
-        if (dm && (dm != MEMBER_SIZE_REQUEST) && (dm != MEMBER_TYPE_REQUEST) &&
-	    (dm != STRUCT_SIZE_REQUEST) && (dm != MEMBER_TYPE_NAME_REQUEST)) {
-                dm->type = type_found;
-                dm->size = size;
-		dm->member_size = member_size;
-		dm->member_typecode = member_typecode;
-		dm->member_offset = offset;
-		if (req->is_typedef) {
-			dm->flags |= TYPEDEF;
-		}
-		if (req->tagname) {
-			dm->tagname = req->tagname;
-			dm->value = req->value;
-		}
-        }
+	dce->typecode = req->typecode;
+	dce->type_found = type_found;
+	dce->size = size;
+	dce->offset = offset;
+	dce->member_size = member_size;
+	dce->member_typecode = member_typecode;
+	if (req->is_typedef)
+		dce->flags |= DTC_TYPEDEF;
+}
 
-	if (!type_found) 
-		return (dm == MEMBER_TYPE_NAME_REQUEST) ? 0 : -1;
+/*
+ *  Handle ANON_MEMBER_OFFSET_REQUEST and ANON_MEMBER_SIZE_REQUEST, whose
+ *  answers are kept in the datatype cache as the entry's offset.
+ */
+static long
+anon_member_info(char *name, char *member, struct datatype_member *dm)
+{
+	struct datatype_cache_entry entry, *dce;
+	uint kind;
 
-	if (dm == MEMBER_SIZE_REQUEST)
-		return member_size;
-	else if (dm == MEMBER_TYPE_REQUEST)
-		return member_typecode;
-	else if (dm == MEMBER_TYPE_NAME_REQUEST) {
-		if (req->member_main_type_name)
-			return (ulong)req->member_main_type_name;
-		else if (req->member_main_type_tag_name)
-			return (ulong)req->member_main_type_tag_name;
-		else if (req->member_target_type_name)
-			return (ulong)req->member_target_type_name;
-		else if (req->member_target_type_tag_name)
-			return (ulong)req->member_target_type_tag_name;
-		else
-			return 0;
-	} else if (dm == STRUCT_SIZE_REQUEST) {
-		if ((req->typecode == TYPE_CODE_STRUCT) || 
-		    (req->typecode == TYPE_CODE_UNION) ||
-		     req->is_typedef)
-			return size;
-		else
-			return -1;
-        } else if (member) {
-		if ((req->typecode == TYPE_CODE_STRUCT) || 
-		    (req->typecode == TYPE_CODE_UNION))
-			return offset;
-		else
-			return -1;
-	} else
-                return size;
+	kind = (dm == ANON_MEMBER_OFFSET_REQUEST) ?
+		DTC_ANON_MEMBER_OFFSET : DTC_ANON_MEMBER_SIZE;
+
+	if ((dce = datatype_cache_lookup(kind, name, member)))
+		return dce->offset;
+
+	BZERO(&entry, sizeof(struct datatype_cache_entry));
+	if (kind == DTC_ANON_MEMBER_OFFSET)
+		entry.offset = anon_member_offset(name, member);
+	else
+		entry.offset = anon_member_size(name, member);
+	datatype_cache_enter(kind, name, member, &entry);
+
+	return entry.offset;
 }
 
 /*
@@ -6613,6 +7873,10 @@ cmd_datatype_common(ulong flags)
 	if ((flags & DEREF_POINTERS) && !aflag)
 		error(FATAL, "-p option requires address argument\n");
 
+	if (aflag && !cpuspec &&
+	    !(pc->curcmd_flags & (MEMTYPE_UVADDR|MEMTYPE_FILEADDR)))
+		load_lazy_module_symbols(addr);
+
 	if (list_head_offset)
 		addr -= list_head_offset;
 
@@ -7744,22 +9008,26 @@ is_datatype_command(void)
 }
 
 /*
- *  Given a structure name and an address, have gdb do most of the work.
+ *  Given a structure name and an address, have gdb do most of the work,
+ *  unless "set btf on" allows it to be formatted from the BTF data.
  */
 static void
 print_struct(char *s, ulong addr)
 {
 	char buf[BUFSIZE];
+	char typename[BUFSIZE];
 
 	if (is_downsized(s))
 		pc->curcmd_flags |= PARTIAL_READ_OK;
 
 	if (is_typedef(s))
-        	sprintf(buf, "output *(%s *)0x%lx", s, addr);
+		sprintf(typename, "%s", s);
 	else
-        	sprintf(buf, "output *(struct %s *)0x%lx", s, addr);
+		sprintf(typename, "struct %s", s);
+	sprintf(buf, "output *(%s *)0x%lx", typename, addr);
 	fprintf(fp, "struct %s ", s);
-	gdb_pass_through(buf, NULL, GNU_RETURN_ON_ERROR);
+	if (!(pc->flags2 & BTF_TYPES) || !btf_print_datatype(typename, addr))
+		gdb_pass_through(buf, NULL, GNU_RETURN_ON_ERROR);
 	fprintf(fp, "\n");
 
 	pc->curcmd_flags &= ~PARTIAL_READ_OK;
@@ -7767,22 +9035,26 @@ print_struct(char *s, ulong addr)
 
 
 /*
- *  Given a union name and an address, let gdb do the work.
+ *  Given a union name and an address, let gdb do the work, unless "set
+ *  btf on" allows it to be formatted from the BTF data.
  */
 static void
 print_union(char *s, ulong addr)
 {
 	char buf[BUFSIZE];
+	char typename[BUFSIZE];
 
 	if (is_downsized(s))
 		pc->curcmd_flags |= PARTIAL_READ_OK;
 
         if (is_typedef(s))
-                sprintf(buf, "output *(%s *)0x%lx", s, addr);
+		sprintf(typename, "%s", s);
         else 
-        	sprintf(buf, "output *(union %s *)0x%lx", s, addr);
+		sprintf(typename, "union %s", s);
+	sprintf(buf, "output *(%s *)0x%lx", typename, addr);
         fprintf(fp, "union %s ", s);
-        gdb_pass_through(buf, NULL, GNU_RETURN_ON_ERROR);
+	if (!(pc->flags2 & BTF_TYPES) || !btf_print_datatype(typename, addr))
+		gdb_pass_through(buf, NULL, GNU_RETURN_ON_ERROR);
 
 	pc->curcmd_flags &= ~PARTIAL_READ_OK;
 }
@@ -9096,6 +10368,8 @@ dump_offset_table(char *spec, ulong makestruct)
 
 	fprintf(fp, "                mm_struct_mmap: %ld\n", 
 		OFFSET(mm_struct_mmap));
+	fprintf(fp, "               mm_struct_mm_mt: %ld\n",
+		OFFSET(mm_struct_mm_mt));
 	fprintf(fp, "                 mm_struct_pgd: %ld\n", 
 		OFFSET(mm_struct_pgd));
 	fprintf(fp, "            mm_struct_mm_count: %ld\n", 
@@ -9147,6 +10421,8 @@ dump_offset_table(char *spec, ulong makestruct)
         	OFFSET(vm_struct_size));
 	fprintf(fp, "                vm_struct_next: %ld\n",
         	OFFSET(vm_struct_next));
+	fprintf(fp, "              vm_struct_caller: %ld\n",
+		OFFSET(vm_struct_caller));
 
 	fprintf(fp, "            vmap_area_va_start: %ld\n", 
 		OFFSET(vmap_area_va_start));
@@ -10523,12 +11799,77 @@ dump_offset_table(char *spec, ulong makestruct)
 		OFFSET(log_level));
 	fprintf(fp, "               log_flags_level: %ld\n",
 		OFFSET(log_flags_level));
+	fprintf(fp, "                  log_facility: %ld\n",
+		OFFSET(log_facility));
+	fprintf(fp, "                 log_caller_id: %ld\n",
+		OFFSET(log_caller_id));
+	fprintf(fp, "            address_space_host: %ld\n",
+		OFFSET(address_space_host));
+	fprintf(fp, "                inode_i_dentry: %ld\n",
+		OFFSET(inode_i_dentry));
+	fprintf(fp, "                dentry_d_alias: %ld\n",
+		OFFSET(dentry_d_alias));
+	fprintf(fp, "         sock_common_skc_state: %ld\n",
+		OFFSET(sock_common_skc_state));
+	fprintf(fp, "                      net_list: %ld\n",
+		OFFSET(net_list));
+	fprintf(fp, "           bpf_array_elem_size: %ld\n",
+		OFFSET(bpf_array_elem_size));
+	fprintf(fp, "               bpf_array_value: %ld\n",
+		OFFSET(bpf_array_value));
+	fprintf(fp, "               bpf_array_pptrs: %ld\n",
+		OFFSET(bpf_array_pptrs));
+	fprintf(fp, "              bpf_htab_buckets: %ld\n",
+		OFFSET(bpf_htab_buckets));
+	fprintf(fp, "            bpf_htab_n_buckets: %ld\n",
+		OFFSET(bpf_htab_n_buckets));
+	fprintf(fp, "            bpf_htab_elem_size: %ld\n",
+		OFFSET(bpf_htab_elem_size));
+	fprintf(fp, "           htab_elem_hash_node: %ld\n",
+		OFFSET(htab_elem_hash_node));
+	fprintf(fp, "                 htab_elem_key: %ld\n",
+		OFFSET(htab_elem_key));
+	fprintf(fp, "        hlist_nulls_head_first: %ld\n",
+		OFFSET(hlist_nulls_head_first));
+	fprintf(fp, "         hlist_nulls_node_next: %ld\n",
+		OFFSET(hlist_nulls_node_next));
+	fprintf(fp, "                mem_cgroup_css: %ld\n",
+		OFFSET(mem_cgroup_css));
+	fprintf(fp, "             mem_cgroup_memory: %ld\n",
+		OFFSET(mem_cgroup_memory));
+	fprintf(fp, "               mem_cgroup_swap: %ld\n",
+		OFFSET(mem_cgroup_swap));
+	fprintf(fp, "              mem_cgroup_memsw: %ld\n",
+		OFFSET(mem_cgroup_memsw));
+	fprintf(fp, "            mem_cgroup_vmstats: %ld\n",
+		OFFSET(mem_cgroup_vmstats));
+	fprintf(fp, "     mem_cgroup_vmstats_percpu: %ld\n",
+		OFFSET(mem_cgroup_vmstats_percpu));
+	fprintf(fp, "           mem_cgroup_nodeinfo: %ld\n",
+		OFFSET(mem_cgroup_nodeinfo));
+	fprintf(fp, "           memcg_vmstats_state: %ld\n",
+		OFFSET(memcg_vmstats_state));
+	fprintf(fp, "    memcg_vmstats_percpu_state: %ld\n",
+		OFFSET(memcg_vmstats_percpu_state));
+	fprintf(fp, "memcg_vmstats_percpu_state_prev: %ld\n",
+		OFFSET(memcg_vmstats_percpu_state_prev));
+	fprintf(fp, "mem_cgroup_per_node_lru_zone_size: %ld\n",
+		OFFSET(mem_cgroup_per_node_lru_zone_size));
+	fprintf(fp, "            page_counter_usage: %ld\n",
+		OFFSET(page_counter_usage));
+	fprintf(fp, "              page_counter_max: %ld\n",
+		OFFSET(page_counter_max));
+	fprintf(fp, "  cgroup_subsys_state_children: %ld\n",
+		OFFSET(cgroup_subsys_state_children));
+	fprintf(fp, "   cgroup_subsys_state_sibling: %ld\n",
+		OFFSET(cgroup_subsys_state_sibling));
 
 	fprintf(fp, "               printk_info_seq: %ld\n", OFFSET(printk_info_seq));
 	fprintf(fp, "           printk_info_ts_nseq: %ld\n", OFFSET(printk_info_ts_nsec));
 	fprintf(fp, "          printk_info_text_len: %ld\n", OFFSET(printk_info_text_len));
 	fprintf(fp, "             printk_info_level: %ld\n", OFFSET(printk_info_level));
 	fprintf(fp, "         printk_info_caller_id: %ld\n", OFFSET(printk_info_caller_id));
+	fprintf(fp, "          printk_info_facility: %ld\n", OFFSET(printk_info_facility));
 	fprintf(fp, "          printk_info_dev_info: %ld\n", OFFSET(printk_info_dev_info));
 	fprintf(fp, "     dev_printk_info_subsystem: %ld\n", OFFSET(dev_printk_info_subsystem));
 	fprintf(fp, "        dev_printk_info_device: %ld\n", OFFSET(dev_printk_info_device));
@@ -10711,6 +12052,22 @@ dump_offset_table(char *spec, ulong makestruct)
 		OFFSET(xarray_xa_head));
 	fprintf(fp, "                 xa_node_slots: %ld\n",
 		OFFSET(xa_node_slots));
+	fprintf(fp, "            maple_tree_ma_root: %ld\n",
+		OFFSET(maple_tree_ma_root));
+	fprintf(fp, "               maple_node_slot: %ld\n",
+		OFFSET(maple_node_slot));
+	fprintf(fp, "               maple_node_mr64: %ld\n",
+		OFFSET(maple_node_mr64));
+	fprintf(fp, "               maple_node_ma64: %ld\n",
+		OFFSET(maple_node_ma64));
+	fprintf(fp, "          maple_range_64_pivot: %ld\n",
+		OFFSET(maple_range_64_pivot));
+	fprintf(fp, "           maple_range_64_slot: %ld\n",
+		OFFSET(maple_range_64_slot));
+	fprintf(fp, "         maple_arange_64_pivot: %ld\n",
+		OFFSET(maple_arange_64_pivot));
+	fprintf(fp, "          maple_arange_64_slot: %ld\n",
+		OFFSET(maple_arange_64_slot));
 	fprintf(fp, "                 xa_node_shift: %ld\n",
 		OFFSET(xa_node_shift));
 
@@ -11017,6 +12374,20 @@ dump_offset_table(char *spec, ulong makestruct)
 		SIZE(xarray));
 	fprintf(fp, "                       xa_node: %ld\n",
 		SIZE(xa_node));
+	fprintf(fp, "                    maple_tree: %ld\n",
+		SIZE(maple_tree));
+	fprintf(fp, "                    maple_node: %ld\n",
+		SIZE(maple_node));
+	fprintf(fp, "                        bucket: %ld\n",
+		SIZE(bucket));
+	fprintf(fp, "                    mem_cgroup: %ld\n",
+		SIZE(mem_cgroup));
+	fprintf(fp, "           memcg_vmstats_state: %ld\n",
+		SIZE(memcg_vmstats_state));
+	fprintf(fp, "    memcg_vmstats_percpu_state: %ld\n",
+		SIZE(memcg_vmstats_percpu_state));
+	fprintf(fp, "mem_cgroup_per_node_lru_zone_size: %ld\n",
+		SIZE(mem_cgroup_per_node_lru_zone_size));
 	fprintf(fp, "                   printk_info: %ld\n", SIZE(printk_info));
 	fprintf(fp, "             printk_ringbuffer: %ld\n", SIZE(printk_ringbuffer));
 	fprintf(fp, "                      prb_desc: %ld\n", SIZE(prb_desc));
@@ -11759,6 +13130,86 @@ compare_prios(const void *v1, const void *v2)
 
 
 
+/*
+ *  "mod -S -L" records the object file of each module in lieu of loading
+ *  it, along with any -g or -r option in effect.  The module's symbols and
+ *  debuginfo are then loaded by load_lazy_module_symbols() the first time
+ *  that an address within the module is used by get_line_number(), or as
+ *  the starting address of a "dis", "struct" or "union" command.
+ */
+void
+defer_module_symbols(struct load_module *lm, char *namelist)
+{
+	clear_lazy_module_symbols(lm);
+
+	if ((lm->mod_lazy_namelist = strdup(namelist)) == NULL) {
+		error(INFO, "%s: cannot defer loading of: %s\n",
+			lm->mod_name, namelist);
+		return;
+	}
+
+	lm->mod_flags |= MOD_LAZY_SYMS;
+	if (pc->curcmd_flags & MOD_SECTIONS)
+		lm->mod_flags |= MOD_LAZY_SECTIONS;
+	if (pc->curcmd_flags & MOD_READNOW)
+		lm->mod_flags |= MOD_LAZY_READNOW;
+	st->lazy_modules++;
+}
+
+static void
+clear_lazy_module_symbols(struct load_module *lm)
+{
+	if (!(lm->mod_flags & MOD_LAZY_SYMS))
+		return;
+
+	free(lm->mod_lazy_namelist);
+	lm->mod_lazy_namelist = NULL;
+	lm->mod_flags &= ~(MOD_LAZY_SYMS|MOD_LAZY_SECTIONS|MOD_LAZY_READNOW);
+	st->lazy_modules--;
+}
+
+/*
+ *  If addr is within a module whose symbols were deferred by "mod -S -L",
+ *  load them now.  The deferred state is cleared beforehand so that a
+ *  module whose object file fails to load is not retried by every command.
+ */
+int
+load_lazy_module_symbols(ulong addr)
+{
+	struct load_module *lm;
+	ulong curcmd_flags;
+	char *namelist;
+	int loaded;
+
+	if (!st->lazy_modules ||
+	    !module_symbol(addr, NULL, &lm, NULL, 0) ||
+	    !(lm->mod_flags & MOD_LAZY_SYMS))
+		return FALSE;
+
+	curcmd_flags = pc->curcmd_flags;
+	if (lm->mod_flags & MOD_LAZY_SECTIONS)
+		pc->curcmd_flags |= MOD_SECTIONS;
+	if (lm->mod_flags & MOD_LAZY_READNOW)
+		pc->curcmd_flags |= MOD_READNOW;
+
+	namelist = GETBUF(strlen(lm->mod_lazy_namelist)+1);
+	strcpy(namelist, lm->mod_lazy_namelist);
+	clear_lazy_module_symbols(lm);
+
+	if (CRASHDEBUG(1))
+		fprintf(fp, "%s: loading deferred module symbols: %s\n",
+			lm->mod_name, namelist);
+
+	if (!(loaded = load_module_symbols(lm->mod_name, namelist,
+	    lm->mod_base)))
+		error(INFO, "cannot load symbols from: %s\n", namelist);
+
+	pc->curcmd_flags = curcmd_flags;
+	FREEBUF(namelist);
+
+	return loaded;
+}
+
 /*
  *  This routine scours a module object file namelist for global text and
  *  data symbols, sorting and storing them in a static table for quick 
@@ -11784,6 +13235,8 @@ load_module_symbols(char *modref, char *namelist, ulong base_addr)
 	if (!is_module_name(modref, NULL, &lm))
 		error(FATAL, "%s: not a loaded module name\n", modref);
 
+	clear_lazy_module_symbols(lm);
+
 	if ((lm->mod_flags & MOD_LOAD_SYMS) || strlen(lm->mod_namelist)) {
 		if (CRASHDEBUG(1))
 			fprintf(fp, "%s: module symbols are already loaded\n", 
@@ -12605,6 +14058,7 @@ delete_load_module(ulong base_addr)
 
         req = &request; 
 	BZERO(req, sizeof(struct gnu_request));
+	value_search_memo_flush();
        	req->command = GNU_DELETE_SYMBOL_FILE;
 
 	if (base_addr == ALL_MODULES) {
@@ -12639,6 +14093,7 @@ delete_load_module(ulong base_addr)
 				free(lm->mod_section_data);
 			lm->mod_section_data = (struct mod_section_data *)0;
 			lm->loaded_objfile = NULL;
+			clear_lazy_module_symbols(lm);
 		}
 		st->flags &= ~LOAD_MODULE_SYMS;
 		return;
@@ -12678,6 +14133,7 @@ delete_load_module(ulong base_addr)
 				free(lm->mod_section_data);
 			lm->mod_section_data = (struct mod_section_data *)0;
 			lm->loaded_objfile = NULL;
+			clear_lazy_module_symbols(lm);
                 } else if (lm->mod_flags & MOD_LOAD_SYMS)
 			st->flags |= LOAD_MODULE_SYMS;
         }
@@ -13409,72 +14865,55 @@ is_downsized(char *name)
 	return FALSE;
 }
 
-struct syment *
-symbol_complete_match(const char *match, struct syment *sp_last)
+/*
+ *  Return the first symbol of a name index whose name is not less than
+ *  match.
+ */
+static long
+symname_index_lower_bound(struct symname_index *idx, const char *match)
 {
-	int i;
-	struct syment *sp, *sp_end, *sp_start;
-	struct load_module *lm;
-	int search_init;
-
-	if (sp_last) {
-		sp_start = next_symbol(NULL, sp_last);
-		if (!sp_start)
-			return NULL;
-	} else	
-		sp_start = st->symtable;
+	long lo, hi, mid;
 
-	if ((sp_start >= st->symtable) && (sp_start < st->symend)) {
-		for (sp = sp_start; sp < st->symend; sp++) {
-			if (STRNEQ(sp->name, match))
-				return sp;
-		}
-		sp_start = NULL;
+	for (lo = 0, hi = idx->cnt; lo < hi; ) {
+		mid = (lo + hi) / 2;
+		if (strcmp(idx->sorted[mid]->name, match) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
 
-	search_init = FALSE;
+	return lo;
+}
 
-	for (i = 0; i < st->mods_installed; i++) {
-		lm = &st->load_modules[i];
-		if (lm->mod_flags & MOD_INIT)
-			search_init = TRUE;
-		sp_end = lm->mod_symend;
-		if (!sp_start)
-			sp_start = lm->mod_symtable;
+/*
+ *  Return the next symbol after sp_last, or the first one if sp_last is
+ *  NULL, whose name begins with match.  The kernel symbols are returned
+ *  in name order, followed by the module symbols in name order.
+ */
+struct syment *
+symbol_complete_match(const char *match, struct syment *sp_last)
+{
+	static int modules;
+	static long pos;
+	struct symname_index *idx;
 
-		if ((sp_start >= lm->mod_symtable) && (sp_start < sp_end)) {
-			for (sp = sp_start; sp < sp_end; sp++) {
-				if (MODULE_START(sp))
-					continue;
-	
-				if (STRNEQ(sp->name, match))
-					return sp;
-			}
-			sp_start = NULL;
-		}
+	if (!sp_last) {
+		modules = FALSE;
+		pos = symname_index_lower_bound(symname_index_get(FALSE), match);
+	} else {
+		idx = symname_index_get(modules);
+		if ((pos >= idx->cnt) || (idx->sorted[pos] != sp_last))
+			return NULL;
+		pos++;
 	}
 
-	if (!search_init)
-		return NULL;
-	
-	for (i = 0; i < st->mods_installed; i++) {
-		lm = &st->load_modules[i];
-		if (!lm->mod_init_symtable)
-			continue;
-		sp_end = lm->mod_init_symend;
-		if (!sp_start)
-			sp_start = lm->mod_init_symtable;
-
-		if ((sp_start >= lm->mod_init_symtable) && (sp_start < sp_end)) {
-			for (sp = sp_start; sp < sp_end; sp++) {
-				if (MODULE_START(sp))
-					continue;
-	
-				if (STRNEQ(sp->name, match))
-					return sp;
-			}
-		}
+	while (TRUE) {
+		idx = symname_index_get(modules);
+		if ((pos < idx->cnt) && STRNEQ(idx->sorted[pos]->name, match))
+			return idx->sorted[pos];
+		if (modules)
+			return NULL;
+		modules = TRUE;
+		pos = symname_index_lower_bound(symname_index_get(TRUE), match);
 	}
-
-	return NULL;
 }
@@ -33,7 +33,11 @@ static void refresh_active_task_table(void);
 static int radix_tree_task_callback(ulong);
 static void refresh_radix_tree_task_table(void);
 static void refresh_xarray_task_table(void);
+static int task_table_restore(void);
+static void task_table_store(void);
 static struct task_context *add_context(ulong, char *);
+static char *fill_task_context(ulong);
+static void build_context_hash(void);
 static void refresh_context(ulong, ulong);
 static ulong parent_of(ulong);
 static void parent_list(ulong);
@@ -87,6 +91,7 @@ static void reuse_task_group_info_array(void);
 static void free_task_group_info_array(void);
 static void fill_task_group_info_array(int, ulong, char *, int);
 static void dump_tasks_by_task_group(void);
+static int runq_threads;	/* "runq -j" */
 static void task_struct_member(struct task_context *,unsigned int, struct reference *);
 static void signal_reference(struct task_context *, ulong, struct reference *);
 static void do_sig_thread_group(ulong);
@@ -104,6 +109,9 @@ static ulonglong sigaction_mask(ulong);
 static int task_has_cpu(ulong, char *);
 static int is_foreach_keyword(char *, int *);
 static void foreach_cleanup(void *);
+static void bt_group_task(struct task_context *, int);
+static void bt_group_display(void);
+static void bt_group_free(void);
 static void ps_cleanup(void *);
 static char *task_pointer_string(struct task_context *, ulong, char *);
 static int panic_context_adjusted(struct task_context *tc);
@@ -546,9 +554,20 @@ task_init(void)
 	MEMBER_OFFSET_INIT(xa_node_slots, "xa_node","slots");
 	MEMBER_OFFSET_INIT(xa_node_shift, "xa_node","shift");
 
+	STRUCT_SIZE_INIT(maple_tree, "maple_tree");
+	STRUCT_SIZE_INIT(maple_node, "maple_node");
+	MEMBER_OFFSET_INIT(maple_tree_ma_root, "maple_tree", "ma_root");
+	MEMBER_OFFSET_INIT(maple_node_slot, "maple_node", "slot");
+	MEMBER_OFFSET_INIT(maple_node_mr64, "maple_node", "mr64");
+	MEMBER_OFFSET_INIT(maple_node_ma64, "maple_node", "ma64");
+	MEMBER_OFFSET_INIT(maple_range_64_pivot, "maple_range_64", "pivot");
+	MEMBER_OFFSET_INIT(maple_range_64_slot, "maple_range_64", "slot");
+	MEMBER_OFFSET_INIT(maple_arange_64_pivot, "maple_arange_64", "pivot");
+	MEMBER_OFFSET_INIT(maple_arange_64_slot, "maple_arange_64", "slot");
+
 	if (symbol_exists("pidhash") && symbol_exists("pid_hash") &&
 	    !symbol_exists("pidhash_shift"))
-		error(FATAL, 
+		error(FATAL,
         "pidhash and pid_hash both exist -- cannot distinquish between them\n");
 
 	if (VALID_MEMBER(pid_namespace_idr)) {
@@ -657,7 +676,10 @@ task_init(void)
 	if (tt->flags & ACTIVE_ONLY)
 		tt->refresh_task_table = refresh_active_task_table;
 
-	tt->refresh_task_table(); 
+	if (!task_table_restore()) {
+		tt->refresh_task_table();
+		task_table_store();
+	}
 
 	if (tt->flags & TASK_REFRESH_OFF) 
 		tt->flags &= ~(TASK_REFRESH|TASK_REFRESH_OFF);
@@ -976,7 +998,7 @@ retry:
         for (i = 0, tlp = (ulong *)tt->task_local, tt->running_tasks = 0;
              i < tt->max_tasks; i++, tlp++) {
                 if (TASK_IN_USE(*tlp)) {
-                	if (!(tp = fill_task_struct(*tlp))) {
+                	if (!(tp = fill_task_context(*tlp))) {
                         	if (DUMPFILE())
                                 	continue;
                         	retries++;
@@ -1192,7 +1214,7 @@ retry:
 			goto retry;
 		}	
 	
-                if (!(tp = fill_task_struct(*tlp))) {
+                if (!(tp = fill_task_context(*tlp))) {
                      	if (DUMPFILE())
                         	continue;
                         retries++;
@@ -1386,7 +1408,7 @@ retry_pidhash:
 			goto retry_pidhash;
 		}	
 	
-		if (!(tp = fill_task_struct(*tlp))) {
+		if (!(tp = fill_task_context(*tlp))) {
                         if (DUMPFILE())
                                 continue;
                         retries++;
@@ -1583,7 +1605,7 @@ retry_pid_hash:
 			goto retry_pid_hash;
 		}	
 	
-		if (!(tp = fill_task_struct(*tlp))) {
+		if (!(tp = fill_task_context(*tlp))) {
                         if (DUMPFILE())
                                 continue;
                         retries++;
@@ -1840,7 +1862,7 @@ retry_pid_hash:
 			goto retry_pid_hash;
 		}	
 	
-		if (!(tp = fill_task_struct(*tlp))) {
+		if (!(tp = fill_task_context(*tlp))) {
                         if (DUMPFILE())
                                 continue;
                         retries++;
@@ -2060,7 +2082,7 @@ retry_pid_hash:
 			goto retry_pid_hash;
 		}	
 	
-		if (!(tp = fill_task_struct(*tlp))) {
+		if (!(tp = fill_task_context(*tlp))) {
                         if (DUMPFILE())
                                 continue;
                         retries++;
@@ -2308,7 +2330,7 @@ chain_next:
 			goto retry_pid_hash;
 		}	
 	
-		if (!(tp = fill_task_struct(*tlp))) {
+		if (!(tp = fill_task_context(*tlp))) {
                         if (DUMPFILE())
                                 continue;
                         retries++;
@@ -2524,7 +2546,7 @@ retry_radix_tree:
 			goto retry_radix_tree;
 		}
 
-		if (!(tp = fill_task_struct(*tlp))) {
+		if (!(tp = fill_task_context(*tlp))) {
 			if (DUMPFILE())
 				continue;
 			retries++;
@@ -2545,6 +2567,105 @@ retry_radix_tree:
 }
 
 
+/*
+ *  The "tasks" section of the session cache holds the task table of a
+ *  dumpfile, which never changes, as gathered by its refresh function:
+ *  a task_table_image header, the panic_threads[] array, and the
+ *  running_tasks task_context and tgid_context entries.
+ */
+struct task_table_image {
+	ulong running_tasks;
+	ulong nr_cpus;
+};
+
+static int
+task_table_restore(void)
+{
+	struct task_table_image *image;
+	struct task_context *tc;
+	ulong *panic_threads;
+	ulong size, i;
+	char *p;
+
+	if (!DUMPFILE() || !(p = session_cache_get("tasks", &size)))
+		return FALSE;
+
+	image = (struct task_table_image *)p;
+	if ((size < sizeof(struct task_table_image)) || !image->running_tasks ||
+	    (image->nr_cpus != NR_CPUS) ||
+	    (size != sizeof(struct task_table_image) + NR_CPUS * sizeof(ulong) +
+	    image->running_tasks * (sizeof(struct task_context) +
+	    sizeof(struct tgid_context)))) {
+		error(INFO, "session cache: invalid task table\n");
+		return FALSE;
+	}
+	p += sizeof(struct task_table_image);
+
+	if (image->running_tasks > tt->max_tasks) {
+		tt->max_tasks = image->running_tasks + TASK_SLUSH;
+		allocate_task_space(tt->max_tasks);
+	}
+
+	panic_threads = (ulong *)p;
+	p += NR_CPUS * sizeof(ulong);
+	if (!symbol_exists("panic_threads")) {
+		tt->flags |= POPULATE_PANIC;
+		for (i = 0; i < NR_CPUS; i++) {
+			if (panic_threads[i])
+				tt->panic_threads[i] = panic_threads[i];
+		}
+	}
+
+	BCOPY(p, tt->context_array,
+		image->running_tasks * sizeof(struct task_context));
+	p += image->running_tasks * sizeof(struct task_context);
+	BCOPY(p, tt->tgid_array,
+		image->running_tasks * sizeof(struct tgid_context));
+
+	for (i = 0, tc = tt->context_array; i < image->running_tasks; i++, tc++)
+		tc->tc_next = NULL;
+
+	clear_task_cache();
+	tt->running_tasks = image->running_tasks;
+	tt->flags &= ~INDEXED_CONTEXTS;
+
+	return TRUE;
+}
+
+static void
+task_table_store(void)
+{
+	struct task_table_image image;
+	ulong size;
+	char *buf, *p;
+
+	if (!DUMPFILE() || !tt->running_tasks)
+		return;
+
+	image.running_tasks = tt->running_tasks;
+	image.nr_cpus = NR_CPUS;
+
+	size = sizeof(struct task_table_image) + NR_CPUS * sizeof(ulong) +
+		tt->running_tasks * (sizeof(struct task_context) +
+		sizeof(struct tgid_context));
+	if (!(buf = malloc(size)))
+		return;
+
+	p = buf;
+	BCOPY(&image, p, sizeof(struct task_table_image));
+	p += sizeof(struct task_table_image);
+	BCOPY(tt->panic_threads, p, NR_CPUS * sizeof(ulong));
+	p += NR_CPUS * sizeof(ulong);
+	BCOPY(tt->context_array, p,
+		tt->running_tasks * sizeof(struct task_context));
+	p += tt->running_tasks * sizeof(struct task_context);
+	BCOPY(tt->tgid_array, p,
+		tt->running_tasks * sizeof(struct tgid_context));
+
+	session_cache_put("tasks", buf, size);
+	free(buf);
+}
+
 /*
  *  Linux 4.20: pid_hash[] IDR changed from radix tree to xarray
  */
@@ -2740,7 +2861,7 @@ retry_xarray:
 			goto retry_xarray;
 		}
 
-		if (!(tp = fill_task_struct(*tlp))) {
+		if (!(tp = fill_task_context(*tlp))) {
 			if (DUMPFILE())
 				continue;
 			retries++;
@@ -2841,7 +2962,7 @@ retry_active:
 			goto retry_active;
 		}	
 	
-		if (!(tp = fill_task_struct(*tlp))) {
+		if (!(tp = fill_task_context(*tlp))) {
                         if (DUMPFILE())
                                 continue;
                         retries++;
@@ -3020,30 +3141,162 @@ sort_by_task(const void *arg1, const void *arg2)
 	return (t1->task < t2->task) ? -1 : 1;
 }
 
-/* sort context_by_task by task address */
+/*
+ *  The context_array and running_tasks count the last index was built for.
+ */
+static struct task_context *indexed_context_array;
+static ulong indexed_running_tasks;
+
+/*
+ *  sort context_by_task by task address
+ *
+ *  On a live system this runs after every task table refresh.  If the
+ *  number of tasks is unchanged and the previous permutation still sorts
+ *  the refreshed array by task address, which is the usual case when no
+ *  task has been created or has exited in between, keep the index as is.
+ */
 static void
 sort_context_by_task(void)
 {
 	int i;
 
+	if ((tt->context_array == indexed_context_array) &&
+	    (tt->running_tasks == indexed_running_tasks)) {
+		for (i = 1; i < tt->running_tasks; i++) {
+			if (tt->context_by_task[i-1]->task >=
+			    tt->context_by_task[i]->task)
+				break;
+		}
+		if (i >= tt->running_tasks) {
+			tt->flags |= INDEXED_CONTEXTS;
+			build_context_hash();
+			return;
+		}
+	}
+
 	for (i = 0; i < tt->running_tasks; i++)
 		tt->context_by_task[i] = &tt->context_array[i];
 	qsort(tt->context_by_task, tt->running_tasks,
 	      sizeof(*tt->context_by_task), sort_by_task);
 	tt->flags |= INDEXED_CONTEXTS;
+
+	indexed_context_array = tt->context_array;
+	indexed_running_tasks = tt->running_tasks;
+
+	build_context_hash();
+}
+
+static inline ulong
+context_hash_slot(ulong key)
+{
+	ulonglong hash;
+
+	hash = key;
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+
+	return (ulong)hash & (tt->context_hash_size - 1);
+}
+
+/*
+ *  Build the open-addressed hash indexes of the context_array by task
+ *  address and by pid, which task_to_context(), pid_to_context() and
+ *  their relatives use while INDEXED_CONTEXTS is set.  Each slot holds a
+ *  context_array index + 1, or 0 if unused.  Since the contexts are
+ *  entered in array order and collisions are resolved by linear probing,
+ *  the contexts sharing a pid are found in array order as well.  If the
+ *  tables cannot be allocated, the lookups fall back to a linear search.
+ */
+static void
+build_context_hash(void)
+{
+	ulong i, size, slot;
+	struct task_context *tc;
+
+	for (size = 64; size < (tt->running_tasks * 2); size <<= 1)
+		;
+
+	if (size > tt->context_hash_size) {
+		free(tt->context_task_hash);
+		free(tt->context_pid_hash);
+		tt->context_task_hash = malloc(size * sizeof(uint));
+		tt->context_pid_hash = malloc(size * sizeof(uint));
+		if (!tt->context_task_hash || !tt->context_pid_hash) {
+			free(tt->context_task_hash);
+			free(tt->context_pid_hash);
+			tt->context_task_hash = tt->context_pid_hash = NULL;
+			tt->context_hash_size = 0;
+			error(INFO, "cannot malloc task context hash tables\n");
+			return;
+		}
+		tt->context_hash_size = size;
+	} else if (!tt->context_hash_size)
+		return;
+
+	BZERO(tt->context_task_hash, tt->context_hash_size * sizeof(uint));
+	BZERO(tt->context_pid_hash, tt->context_hash_size * sizeof(uint));
+
+	for (i = 0, tc = FIRST_CONTEXT(); i < RUNNING_TASKS(); i++, tc++) {
+		slot = context_hash_slot(tc->task);
+		while (tt->context_task_hash[slot])
+			slot = (slot + 1) & (tt->context_hash_size - 1);
+		tt->context_task_hash[slot] = i + 1;
+
+		slot = context_hash_slot(tc->pid);
+		while (tt->context_pid_hash[slot])
+			slot = (slot + 1) & (tt->context_hash_size - 1);
+		tt->context_pid_hash[slot] = i + 1;
+	}
+}
+
+#define CONTEXT_HASH_INDEXED() \
+	((tt->flags & INDEXED_CONTEXTS) && tt->context_hash_size)
+
+/*
+ *  Return the first context of a pid, in context_array order, starting
+ *  the pid hash probe sequence at *slotp; *slotp is updated so that the
+ *  next context with the same pid can be found by calling it again.
+ */
+static struct task_context *
+context_pid_hash_next(ulong pid, ulong *slotp)
+{
+	ulong slot;
+	uint index;
+	struct task_context *tc;
+
+	for (slot = *slotp; (index = tt->context_pid_hash[slot]);
+	     slot = (slot + 1) & (tt->context_hash_size - 1)) {
+		tc = tt->context_array + index - 1;
+		if (tc->pid == pid) {
+			*slotp = (slot + 1) & (tt->context_hash_size - 1);
+			return tc;
+		}
+	}
+
+	return NULL;
 }
 
 /*
  *  Sort the task_context array by PID number; for PID 0, sort by processor.
+ *  The PID-indexed radix tree and xarray walks already gather the tasks
+ *  in that order, in which case the qsort() is skipped.
  */
 void
 sort_context_array(void)
 {
+	int i;
         ulong curtask;
 
 	curtask = CURRENT_TASK();
-	qsort((void *)tt->context_array, (size_t)tt->running_tasks,
-        	sizeof(struct task_context), sort_by_pid);
+	for (i = 1; i < tt->running_tasks; i++) {
+		if (sort_by_pid(&tt->context_array[i-1],
+		    &tt->context_array[i]) > 0)
+			break;
+	}
+	if (i < tt->running_tasks)
+		qsort((void *)tt->context_array, (size_t)tt->running_tasks,
+			sizeof(struct task_context), sort_by_pid);
 	set_context(curtask, NO_PID);
 
 	sort_context_by_task();
@@ -3123,6 +3376,130 @@ sort_by_tgid(const void *arg1, const void *arg2)
 		t1->tgid == t2->tgid ? 0 : 1);
 }
 
+/*
+ *  The byte ranges of the task_struct members consumed by add_context()
+ *  and task_has_cpu(), sorted by offset, with ranges that lie within
+ *  TASK_CONTEXT_RANGE_GAP bytes of each other merged.
+ */
+#define TASK_CONTEXT_MAX_RANGES (8)
+#define TASK_CONTEXT_RANGE_GAP  (256)
+
+static struct task_context_range {
+	long offset;
+	long size;
+} task_context_range[TASK_CONTEXT_MAX_RANGES];
+static int task_context_ranges;		/* -1 if not usable */
+
+static void
+add_task_context_range(long offset, long size)
+{
+	int i;
+
+	if (task_context_ranges < 0)
+		return;
+
+	if ((offset < 0) || (task_context_ranges == TASK_CONTEXT_MAX_RANGES)) {
+		task_context_ranges = -1;
+		return;
+	}
+
+	for (i = task_context_ranges++; i &&
+	     (task_context_range[i-1].offset > offset); i--)
+		task_context_range[i] = task_context_range[i-1];
+	task_context_range[i].offset = offset;
+	task_context_range[i].size = size;
+}
+
+static void
+merge_task_context_ranges(void)
+{
+	int i, cnt;
+	long end;
+	struct task_context_range *r;
+
+	for (i = 1, cnt = 0; i < task_context_ranges; i++) {
+		r = &task_context_range[cnt];
+		if (task_context_range[i].offset <=
+		    (r->offset + r->size + TASK_CONTEXT_RANGE_GAP)) {
+			end = task_context_range[i].offset +
+				task_context_range[i].size;
+			r->size = MAX(r->offset + r->size, end) - r->offset;
+		} else
+			task_context_range[++cnt] = task_context_range[i];
+	}
+
+	task_context_ranges = cnt + 1;
+}
+
+static void
+init_task_context_ranges(void)
+{
+	add_task_context_range(OFFSET(task_struct_pid), sizeof(pid_t));
+	add_task_context_range(OFFSET(task_struct_tgid), sizeof(pid_t));
+	add_task_context_range(OFFSET(task_struct_comm), TASK_COMM_LEN);
+	add_task_context_range(OFFSET(task_struct_mm), sizeof(ulong));
+	if (VALID_MEMBER(task_struct_p_pptr))
+		add_task_context_range(OFFSET(task_struct_p_pptr), sizeof(ulong));
+	else
+		add_task_context_range(OFFSET(task_struct_parent), sizeof(ulong));
+
+	if (tt->flags & THREAD_INFO) {
+		if (!(tt->flags & THREAD_INFO_IN_TASK))
+			add_task_context_range(OFFSET(task_struct_thread_info),
+				sizeof(ulong));
+		else if (VALID_MEMBER(task_struct_cpu))
+			add_task_context_range(OFFSET(task_struct_cpu), sizeof(int));
+	} else if (VALID_MEMBER(task_struct_processor))
+		add_task_context_range(OFFSET(task_struct_processor), sizeof(int));
+	else if (VALID_MEMBER(task_struct_cpu))
+		add_task_context_range(OFFSET(task_struct_cpu), sizeof(int));
+
+	if (VALID_MEMBER(task_struct_has_cpu))
+		add_task_context_range(OFFSET(task_struct_has_cpu), sizeof(int));
+	else if (VALID_MEMBER(task_struct_cpus_runnable))
+		add_task_context_range(OFFSET(task_struct_cpus_runnable),
+			sizeof(ulong));
+
+	if (task_context_ranges > 0)
+		merge_task_context_ranges();
+	else
+		task_context_ranges = -1;
+}
+
+/*
+ *  Used by the refresh_xxx_task_table() functions.  The initial task table
+ *  is built from complete task_struct reads, but on a live system, where
+ *  the table is refreshed before every command, only the members needed
+ *  to fill in each task_context are re-read.  They are placed at their
+ *  offsets in tt->task_struct, which consequently no longer holds a
+ *  complete task_struct, so last_task_read is cleared.
+ */
+static char *
+fill_task_context(ulong task)
+{
+	int i;
+	struct task_context_range *r;
+
+	if (!ACTIVE() || !(tt->flags & TASK_INIT_DONE))
+		return fill_task_struct(task);
+
+	if (!task_context_ranges)
+		init_task_context_ranges();
+	if (task_context_ranges < 0)
+		return fill_task_struct(task);
+
+	tt->last_task_read = 0;
+
+	for (i = 0; i < task_context_ranges; i++) {
+		r = &task_context_range[i];
+		if (!readmem(task + r->offset, KVADDR, tt->task_struct + r->offset,
+		    r->size, "task_struct members", RETURN_ON_ERROR|QUIET))
+			return NULL;
+	}
+
+	return(tt->task_struct);
+}
+
 /*
  *  Keep a stash of the last task_struct accessed.  Chances are it will
  *  be hit several times before the next task is accessed.
@@ -3172,15 +3549,116 @@ fill_thread_info(ulong thread_info)
  *  and fill the task_struct buffer, dealing with possible future separation
  *  of task_struct and stack and/or cache coloring of stack top.
  */
+/*
+ *  The stack window keeps copies of the kernel stacks most recently read
+ *  during backtraces, so that the per-cpu IRQ and exception stacks, and
+ *  the process stack that a backtrace returns to after leaving them, are
+ *  read from memory only once instead of upon each stack transition or
+ *  for each task whose backtrace passes through them.  The first window
+ *  holds the task stack last read by fill_stackbuf(), and the others hold
+ *  the least recently used alternate stacks.  On live systems the windows
+ *  are only valid for the current command.
+ */
+#define STACK_WINDOWS         (16)
+#define STACK_WINDOW_MAX_SIZE (1024*1024)
+
+static struct stack_window_cache {
+	ulong cmdgen;
+	ulong clock;
+	ulong hits;
+	ulong reads;
+	struct stack_window {
+		ulong base;		/* 0 if unused */
+		long size;
+		long bufsize;
+		ulong last_used;
+		char *buf;
+	} windows[STACK_WINDOWS];
+} stack_window_cache = { 0 };
+
+void
+stack_window_flush(void)
+{
+	int i;
+
+	for (i = 0; i < STACK_WINDOWS; i++)
+		stack_window_cache.windows[i].base = 0;
+}
+
+/*
+ *  Read size bytes of the kernel stack at base into buf, using the stack
+ *  window if it already holds them.  Returns the readmem() result.
+ */
+int
+read_stack_window(ulong base, char *buf, long size, char *type,
+		  ulong error_handle, int task_stack)
+{
+	int i;
+	char *newbuf;
+	struct stack_window *sw, *victim;
+	struct stack_window_cache *swc;
+
+	swc = &stack_window_cache;
+
+	if ((size <= 0) || (size > STACK_WINDOW_MAX_SIZE))
+		return readmem(base, KVADDR, buf, size, type, error_handle);
+
+	if (ACTIVE() && (swc->cmdgen != pc->cmdgencur)) {
+		stack_window_flush();
+		swc->cmdgen = pc->cmdgencur;
+	}
+
+	for (i = 0; i < STACK_WINDOWS; i++) {
+		sw = &swc->windows[i];
+		if ((sw->base == base) && (sw->size >= size)) {
+			BCOPY(sw->buf, buf, size);
+			sw->last_used = ++swc->clock;
+			swc->hits++;
+			return TRUE;
+		}
+	}
+
+	if (!readmem(base, KVADDR, buf, size, type, error_handle))
+		return FALSE;
+
+	swc->reads++;
+
+	if (task_stack)
+		victim = &swc->windows[0];
+	else {
+		for (i = 1, victim = NULL; i < STACK_WINDOWS; i++) {
+			sw = &swc->windows[i];
+			if (!victim || (sw->last_used < victim->last_used))
+				victim = sw;
+		}
+	}
+
+	if (victim->bufsize < size) {
+		if (!(newbuf = realloc(victim->buf, size))) {
+			victim->base = 0;
+			return TRUE;
+		}
+		victim->buf = newbuf;
+		victim->bufsize = size;
+	}
+
+	BCOPY(buf, victim->buf, size);
+	victim->base = base;
+	victim->size = size;
+	victim->last_used = ++swc->clock;
+
+	return TRUE;
+}
+
 void
 fill_stackbuf(struct bt_info *bt)
 {
 	if (!bt->stackbuf) {
 		bt->stackbuf = GETBUF(bt->stacktop - bt->stackbase);
 
-        	if (!readmem(bt->stackbase, KVADDR, bt->stackbuf, 
-	    	    bt->stacktop - bt->stackbase, 
-		    "stack contents", RETURN_ON_ERROR))
+        	if (!read_stack_window(bt->stackbase, bt->stackbuf,
+	    	    bt->stacktop - bt->stackbase,
+		    "stack contents", RETURN_ON_ERROR, TRUE))
                 	error(FATAL, "read of stack at %lx failed\n", 
 				bt->stackbase);
 	} 
@@ -3206,8 +3684,9 @@ fill_stackbuf(struct bt_info *bt)
 void
 alter_stackbuf(struct bt_info *bt)
 {
-	if (!readmem(bt->stackbase, KVADDR, bt->stackbuf,
-       	    bt->stacktop - bt->stackbase, "stack contents", RETURN_ON_ERROR))
+	if (!read_stack_window(bt->stackbase, bt->stackbuf,
+	    bt->stacktop - bt->stackbase, "stack contents", RETURN_ON_ERROR,
+	    FALSE))
         	error(FATAL, "read of stack at %lx failed\n", bt->stackbase);
 }
 
@@ -3241,6 +3720,26 @@ clear_task_cache(void)
                 tt->last_task_read = tt->last_mm_read = 0;
 }
 
+/*
+ *  The memory used by the task context array and its indexes, for
+ *  "help -u".
+ */
+ulonglong
+task_table_memory_used(void)
+{
+	ulonglong bytes;
+
+	if (!tt->context_array)
+		return 0;
+
+	bytes = (ulonglong)tt->max_tasks * (sizeof(void *) +
+		sizeof(struct task_context) + sizeof(struct task_context *) +
+		sizeof(struct tgid_context));
+	bytes += (ulonglong)tt->context_hash_size * sizeof(uint) * 2;
+
+	return bytes;
+}
+
 /*
  *  Shorthand command to dump the current context's task_struct, or if
  *  pid or task arguments are entered, the task_structs of the targets.
@@ -3504,7 +4003,7 @@ cmd_ps(void)
 	cpuspec = NULL;
 	flag = 0;
 
-        while ((c = getopt(argcnt, args, "ASgstcpkuGlmarC:y:")) != EOF) {
+        while ((c = getopt(argcnt, args, "ASgstcpkuGlmarC:y:o:j:")) != EOF) {
                 switch(c)
 		{
 		case 'k':
@@ -3615,6 +4114,27 @@ cmd_ps(void)
 			flag |= PS_ACTIVE;
 			break;
 
+		case 'o':
+			if (STREQ(optarg, "rss"))
+				psinfo.sort_by = PS_SORT_RSS;
+			else if (STREQ(optarg, "vsz"))
+				psinfo.sort_by = PS_SORT_VSZ;
+			else {
+				error(INFO, "invalid sort field: %s\n", optarg);
+				argerrs++;
+				break;
+			}
+			flag |= PS_SORT;
+			break;
+
+		case 'j':
+			psinfo.threads = stol(optarg, FAULT_ON_ERROR, NULL);
+			if ((psinfo.threads < 1) ||
+			    (psinfo.threads > MAX_PARALLEL_THREADS))
+				error(FATAL, "-j: thread count must be between "
+					"1 and %d\n", MAX_PARALLEL_THREADS);
+			break;
+
 		default:
 			argerrs++;
 			break;
@@ -3624,6 +4144,13 @@ cmd_ps(void)
 	if (argerrs)
 		cmd_usage(pc->curcmd, SYNOPSIS);
 
+	if ((flag & PS_SORT) && (flag & (PS_EXCLUSIVE & ~PS_ACTIVE)))
+		error(FATAL,
+		    "-o option is only applicable to the default ps output\n");
+	if (psinfo.threads && (flag & (PS_EXCLUSIVE & ~PS_ACTIVE)))
+		error(FATAL,
+		    "-j option is only applicable to the default ps output\n");
+
 	if (flag & (PS_LAST_RUN|PS_MSECS))
 		sort_context_array_by_last_run();
 	else if (psinfo.cpus) {
@@ -3821,6 +4348,26 @@ show_ps_data(ulong flag, struct task_context *tc, struct psinfo *psi)
 	if ((flag & PS_ACTIVE) && (flag & PS_SHOW_ALL) && !task_active)
 		return;
 
+	if (STRUCTURED_OUTPUT()) {
+		record_begin("task");
+		record_long("pid", tc->pid);
+		record_long("ppid", task_to_pid(tc->ptask));
+		record_long("cpu", tc->processor);
+		record_hex("task", tc->task);
+		if (flag & PS_KSTACKP)
+			record_string("kstackp", clean_line(task_pointer_string(tc,
+				PS_KSTACKP, buf3)));
+		record_string("state", task_state_string(tc->task, buf1, !VERBOSE));
+		record_double("pct_mem", tm->pct_physmem);
+		record_ulong("vsz_kb", (tm->total_vm * PAGESIZE())/1024);
+		record_ulong("rss_kb", (tm->rss * PAGESIZE())/1024);
+		record_string("comm", tc->comm);
+		record_bool("active", task_active);
+		record_bool("kernel_thread", is_kernel_thread(tc->task));
+		record_end();
+		return;
+	}
+
 	if (task_active) {
 		if (hide_offline_cpu(tc->processor))
 			fprintf(fp, "- ");
@@ -3847,6 +4394,73 @@ show_ps_data(ulong flag, struct task_context *tc, struct psinfo *psi)
 		fprintf(fp, "%s\n", tc->comm);
 }
 
+static int
+sort_by_mem_usage(const void *arg1, const void *arg2)
+{
+	struct ps_sort_entry *e1, *e2;
+
+	e1 = (struct ps_sort_entry *)arg1;
+	e2 = (struct ps_sort_entry *)arg2;
+
+	if (e1->value > e2->value)
+		return -1;
+	if (e1->value < e2->value)
+		return 1;
+
+	return e1->seq < e2->seq ? -1 : (e1->seq > e2->seq ? 1 : 0);
+}
+
+/*
+ *  For "ps -o rss|vsz", gather the tasks that would be displayed, and their
+ *  memory usage, instead of displaying them.  Tasks that share an mm_struct
+ *  are looked up in the get_task_mem_usage() cache, so it is not a problem
+ *  that each task's usage is computed again for its display.
+ */
+static void
+ps_sort_enter(struct task_context *tc, struct psinfo *psi, int max)
+{
+	struct task_mem_usage task_mem_usage, *tm;
+	struct ps_sort_entry *ent;
+
+	if (!psi->sort_list)
+		psi->sort_list = (struct ps_sort_entry *)
+			GETBUF(sizeof(struct ps_sort_entry) * max);
+
+	if (psi->sort_count >= max)
+		return;
+
+	tm = &task_mem_usage;
+	get_task_mem_usage(tc->task, tm);
+
+	ent = &psi->sort_list[psi->sort_count];
+	ent->tc = tc;
+	ent->value = (psi->sort_by == PS_SORT_RSS) ? tm->rss : tm->total_vm;
+	ent->seq = psi->sort_count++;
+}
+
+/*
+ *  Display the gathered tasks with the largest RSS or VSZ first; tasks
+ *  having the same usage are shown in their usual order.
+ */
+static void
+show_ps_sorted(ulong flag, struct psinfo *psi)
+{
+	int i;
+
+	if (!psi->sort_count)
+		return;
+
+	qsort(psi->sort_list, psi->sort_count, sizeof(struct ps_sort_entry),
+		sort_by_mem_usage);
+
+	for (i = 0; i < psi->sort_count; i++)
+		show_ps_data(flag, psi->sort_list[i].tc, psi);
+
+	FREEBUF(psi->sort_list);
+	psi->sort_list = NULL;
+	psi->sort_count = 0;
+}
+
 static void
 show_ps(ulong flag, struct psinfo *psi)
 {
@@ -3855,7 +4469,8 @@ show_ps(ulong flag, struct psinfo *psi)
 	int print;
 	char buf[BUFSIZE];
 
-	if (!(flag & ((PS_EXCLUSIVE & ~PS_ACTIVE)|PS_NO_HEADER))) 
+	if (!(flag & ((PS_EXCLUSIVE & ~PS_ACTIVE)|PS_NO_HEADER)) &&
+	    !STRUCTURED_OUTPUT())
 		fprintf(fp, 
 		    "      PID    PPID  CPU %s  ST  %%MEM      VSZ      RSS  COMM\n",
 			flag & PS_KSTACKP ?
@@ -3879,9 +4494,20 @@ show_ps(ulong flag, struct psinfo *psi)
 			return;
 		}
 
+		if ((psi->threads > 1) &&
+		    (cache_task_mem_usage(psi->threads) == FORKED_BAILOUT))
+			return;
+
 		tc = FIRST_CONTEXT();
-		for (i = 0; i < RUNNING_TASKS(); i++, tc++)
-			show_ps_data(flag, tc, psi);
+		for (i = 0; i < RUNNING_TASKS(); i++, tc++) {
+			if (flag & PS_SORT)
+				ps_sort_enter(tc, psi, RUNNING_TASKS());
+			else
+				show_ps_data(flag, tc, psi);
+		}
+
+		if (flag & PS_SORT)
+			show_ps_sorted(flag, psi);
 		
 		return;
 	}
@@ -3935,11 +4561,17 @@ show_ps(ulong flag, struct psinfo *psi)
 			if (print) {
 				if (flag & PS_TIMES) 
 					show_task_times(tc, flag);
+				else if (flag & PS_SORT)
+					ps_sort_enter(tc, psi,
+						RUNNING_TASKS() * psi->argc);
 				else
 					show_ps_data(flag, tc, psi);
 			}
 		}
 	}
+
+	if (flag & PS_SORT)
+		show_ps_sorted(flag, psi);
 }
 
 static void 
@@ -4887,8 +5519,15 @@ ulong
 pid_to_task(ulong pid)
 {
 	int i;
+	ulong slot;
 	struct task_context *tc;
 
+	if (CONTEXT_HASH_INDEXED()) {
+		slot = context_hash_slot(pid);
+		tc = context_pid_hash_next(pid, &slot);
+		return tc ? tc->task : (ulong)NULL;
+	}
+
 	tc = FIRST_CONTEXT();
         for (i = 0; i < RUNNING_TASKS(); i++, tc++) 
         	if (tc->pid == pid)
@@ -4922,6 +5561,9 @@ task_exists(ulong task)
         int i;
         struct task_context *tc;
 
+	if (CONTEXT_HASH_INDEXED())
+		return task_to_context(task) ? TRUE : FALSE;
+
         tc = FIRST_CONTEXT();
         for (i = 0; i < RUNNING_TASKS(); i++, tc++) 
                 if (tc->task == task)
@@ -4937,12 +5579,25 @@ struct task_context *
 task_to_context(ulong task)
 {
 	struct task_context key, *tc, **found;
+	ulong slot;
+	uint index;
 	int i;
 
-	/* Binary search the context_by_task array. */
-	if (tt->flags & INDEXED_CONTEXTS) {
-		key.task = task;
-		tc = &key;
+	if (CONTEXT_HASH_INDEXED()) {
+		for (slot = context_hash_slot(task);
+		     (index = tt->context_task_hash[slot]);
+		     slot = (slot + 1) & (tt->context_hash_size - 1)) {
+			tc = tt->context_array + index - 1;
+			if (tc->task == task)
+				return tc;
+		}
+		return NULL;
+	}
+
+	/* Binary search the context_by_task array. */
+	if (tt->flags & INDEXED_CONTEXTS) {
+		key.task = task;
+		tc = &key;
 		found = bsearch(&tc, tt->context_by_task, tt->running_tasks,
 				sizeof(*tt->context_by_task), sort_by_task);
 		return found ? *found : NULL;
@@ -4964,7 +5619,19 @@ tgid_to_context(ulong parent_tgid)
 {
         int i;
         struct task_context *tc;
-	ulong tgid;
+	ulong tgid, slot;
+
+	/*
+	 *  The thread group leader's pid is the tgid.
+	 */
+	if (CONTEXT_HASH_INDEXED()) {
+		slot = context_hash_slot(parent_tgid);
+		while ((tc = context_pid_hash_next(parent_tgid, &slot))) {
+			if (task_tgid(tc->task) == parent_tgid)
+				return tc;
+		}
+		return NULL;
+	}
 
         tc = FIRST_CONTEXT();
         for (i = 0; i < RUNNING_TASKS(); i++, tc++) {
@@ -4985,11 +5652,26 @@ struct task_context *
 pid_to_context(ulong pid)
 {
         int i;
+	ulong slot;
         struct task_context *tc, *firsttc, *lasttc;
 
-        tc = FIRST_CONTEXT();
         firsttc = lasttc = NULL;
 
+	if (CONTEXT_HASH_INDEXED()) {
+		slot = context_hash_slot(pid);
+		while ((tc = context_pid_hash_next(pid, &slot))) {
+			if (!firsttc)
+				firsttc = tc;
+			if (lasttc)
+				lasttc->tc_next = tc;
+			tc->tc_next = NULL;
+			lasttc = tc;
+		}
+		return firsttc;
+	}
+
+        tc = FIRST_CONTEXT();
+
         for (i = 0; i < RUNNING_TASKS(); i++, tc++) {
                 if (tc->pid == pid) {
 			if (!firsttc)
@@ -5012,13 +5694,27 @@ int
 pid_exists(ulong pid)
 {
         int i;
+	ulong slot;
         struct task_context *tc, *lasttc;
 	int count;
 
-        tc = FIRST_CONTEXT();
 	count = 0;
 	lasttc = NULL;
 
+	if (CONTEXT_HASH_INDEXED()) {
+		slot = context_hash_slot(pid);
+		while ((tc = context_pid_hash_next(pid, &slot))) {
+			count++;
+			if (lasttc)
+				lasttc->tc_next = tc;
+			tc->tc_next = NULL;
+			lasttc = tc;
+		}
+		return(count);
+	}
+
+        tc = FIRST_CONTEXT();
+
         for (i = 0; i < RUNNING_TASKS(); i++, tc++) {
                 if (tc->pid == pid) {
                         count++;
@@ -5098,7 +5794,7 @@ task_to_thread_info(ulong task)
         struct task_context *tc;
 
 	if (!(tt->flags & THREAD_INFO))
-		error(FATAL, 
+		error(FATAL,
 		   "task_to_thread_info: thread_info struct does not exist!\n");
 
         tc = FIRST_CONTEXT();
@@ -5274,6 +5970,17 @@ set_context(ulong task, ulong pid)
 	struct task_context *tc;
 	int found;
 
+	/*
+	 *  Since NO_PID matches no context, the first context of the task
+	 *  is the one the loop below would select.
+	 */
+	if (task && (pid == NO_PID) && CONTEXT_HASH_INDEXED()) {
+		if ((tc = task_to_context(task))) {
+			CURRENT_CONTEXT() = tc;
+			return TRUE;
+		}
+	}
+
 	tc = FIRST_CONTEXT();
 
         for (i = 0, found = FALSE; i < RUNNING_TASKS(); i++, tc++) {
@@ -5330,6 +6037,8 @@ panic_context_adjusted(struct task_context *tc)
 
         if (pgrp && tgid && (pgrp == tgid) && !pid_exists((ulong)pgrp)) {
                 tc->pid = (ulong)pgrp;
+		if (tt->flags & INDEXED_CONTEXTS)
+			build_context_hash();
                 return CONTEXT_ADJUSTED;
         }
 
@@ -6144,7 +6853,7 @@ task_has_cpu(ulong task, char *local_task)
 			}
 		}
 	} else
-		error(FATAL, 
+		error(FATAL,
     "task_struct has no has_cpu, or cpus_runnable; runqueues[] not defined?\n");
 
 	return has_cpu;
@@ -6420,9 +7129,17 @@ cmd_foreach(void)
 	BZERO(&foreach_data, sizeof(struct foreach_data));
 	fd = &foreach_data;
 
-        while ((c = getopt(argcnt, args, "R:vomlgersStTpukcfFxhdaGy:")) != EOF) {
+        while ((c = getopt(argcnt, args, "R:vomlgersStTpukcfFxhdaGUy:j:")) != EOF) {
                 switch(c)
 		{
+		case 'j':
+			fd->threads = stol(optarg, FAULT_ON_ERROR, NULL);
+			if ((fd->threads < 1) ||
+			    (fd->threads > MAX_PARALLEL_THREADS))
+				error(FATAL, "-j: thread count must be between "
+					"1 and %d\n", MAX_PARALLEL_THREADS);
+			break;
+
 		case 'R':
 			fd->reference = optarg;
 			break;
@@ -6515,6 +7232,10 @@ cmd_foreach(void)
 			fd->flags |= FOREACH_G_FLAG;
 			break;
 
+		case 'U':
+			fd->flags |= FOREACH_U_FLAG;
+			break;
+
 		case 'y':
 			fd->flags |= FOREACH_y_FLAG;
 			fd->policy = make_sched_policy(optarg);
@@ -6789,6 +7510,427 @@ bailout:
 	foreach_cleanup((void *)fd);
 }
 
+/*
+ *  Per-command state shared by the tasks of a foreach run.
+ */
+struct foreach_run {
+	struct foreach_data *fd;
+	int specified;
+	int print_header;
+	int increments;		/* "subsequent" increments per task */
+	struct reference *ref;
+	struct bt_info *bt;
+	struct psinfo *psinfo;
+};
+
+/*
+ *  A task handed to a "foreach -j" worker process, and the location of
+ *  its output in that worker's output file.  The array lives in shared
+ *  memory, where the workers claim the next unclaimed task.
+ */
+struct foreach_job {
+	struct task_context *tc;
+	ulong sig_group;	/* sig -g thread group to display, or 0 */
+};
+
+struct foreach_jobs {
+	struct foreach_run *fr;
+	struct foreach_job *job;
+};
+
+/*
+ *  Determine whether a task is selected by the foreach arguments.
+ */
+static int
+foreach_selected(struct foreach_run *fr, struct task_context *tc)
+{
+	int j, doit;
+	char buf[TASK_COMM_LEN];
+	struct foreach_data *fd = fr->fd;
+	int specified = fr->specified;
+
+	doit = FALSE;
+
+	if ((fd->flags & FOREACH_ACTIVE) && !is_task_active(tc->task))
+		return FALSE;
+
+	if ((fd->flags & FOREACH_USER) && is_kernel_thread(tc->task))
+		return FALSE;
+
+	if ((fd->flags & FOREACH_GLEADER) && tc->pid != task_tgid(tc->task))
+		return FALSE;
+
+	if ((fd->flags & FOREACH_KERNEL) && !is_kernel_thread(tc->task))
+		return FALSE;
+
+	if (fd->flags & FOREACH_STATE) {
+		if (fd->state == _RUNNING_) {
+			if (task_state(tc->task) != _RUNNING_)
+				return FALSE;
+		} else if (fd->state & _UNINTERRUPTIBLE_) {
+			if (!(task_state(tc->task) & _UNINTERRUPTIBLE_))
+				return FALSE;
+
+			if (valid_task_state(_NOLOAD_)) {
+				if (fd->state & _NOLOAD_) {
+					if (!(task_state(tc->task) & _NOLOAD_))
+						return FALSE;
+				} else {
+					if ((task_state(tc->task) & _NOLOAD_))
+						return FALSE;
+				}
+			}
+		} else if (!(task_state(tc->task) & fd->state))
+			return FALSE;
+	}
+
+	if (specified) {
+		for (j = 0; j < fd->tasks; j++) {
+			if (fd->task_array[j] == tc->task) {
+				doit = TRUE;
+				break;
+			}
+		}
+
+		for (j = 0; !doit && (j < fd->pids); j++) {
+			if (fd->pid_array[j] == tc->pid) {
+				doit = TRUE;
+				break;
+			}
+		}
+
+ 		for (j = 0; !doit && (j < fd->comms); j++) {
+			strlcpy(buf, fd->comm_array[j], TASK_COMM_LEN);
+			if (STREQ(buf, tc->comm)) {
+				doit = TRUE;
+				break;
+			}
+		}
+
+		for (j = 0; !doit && (j < fd->regexs); j++) {
+			if (regexec(&fd->regex_info[j].regex, 
+			    tc->comm, 0, NULL, 0) == 0) {
+				doit = TRUE;
+				break;
+			}
+		}
+	} else 
+		doit = TRUE;
+
+	return doit;
+}
+
+/*
+ *  Run the foreach command(s) on one task.  For "foreach -j", job is the
+ *  task's entry in the foreach_parallel() job array, otherwise NULL.
+ */
+static void
+foreach_task(struct foreach_run *fr, struct task_context *tc, int *subsequent,
+	     struct foreach_job *job)
+{
+	int k, a;
+	unsigned int radix;
+	ulong cmdflags;
+	ulong tgid;
+	struct task_context *tgc;
+	struct foreach_data *fd = fr->fd;
+	struct reference *ref = fr->ref;
+	struct bt_info *bt = fr->bt;
+	struct psinfo *psinfo = fr->psinfo;
+
+	if (fd->reference) {
+		BZERO(ref, sizeof(struct reference));
+		ref->str = fd->reference;
+	} else if (fr->print_header)
+		print_task_header(fp, tc, (*subsequent)++);
+
+	for (k = 0; k < fd->keys; k++) {
+		free_all_bufs();
+
+		switch(fd->keyword_array[k])
+		{
+		case FOREACH_BT:
+			pc->curcmd = "bt";
+			BZERO(bt, sizeof(struct bt_info));;
+			bt->task = tc->task;
+			bt->tc = tc;
+			bt->stackbase = GET_STACKBASE(tc->task);
+			bt->stacktop = GET_STACKTOP(tc->task);
+			if (fd->flags & FOREACH_r_FLAG)
+				bt->flags |= BT_RAW;
+			if (fd->flags & FOREACH_s_FLAG)
+				bt->flags |= BT_SYMBOL_OFFSET;
+			if (fd->flags & FOREACH_t_FLAG)
+				bt->flags |= BT_TEXT_SYMBOLS;
+			if (fd->flags & FOREACH_T_FLAG) {
+				bt->flags |= BT_TEXT_SYMBOLS;
+				bt->flags |= BT_TEXT_SYMBOLS_ALL;
+			}
+			if ((fd->flags & FOREACH_o_FLAG) ||
+			    (kt->flags & USE_OPT_BT))
+				bt->flags |= BT_OPT_BACK_TRACE;
+                        if (fd->flags & FOREACH_e_FLAG)
+                                bt->flags |= BT_EFRAME_SEARCH;
+#ifdef GDB_5_3
+                        if (fd->flags & FOREACH_g_FLAG)
+                                bt->flags |= BT_USE_GDB;
+#endif
+                        if (fd->flags & FOREACH_l_FLAG) 
+                                bt->flags |= BT_LINE_NUMBERS;
+                        if (fd->flags & FOREACH_f_FLAG) 
+                                bt->flags |= BT_FULL;
+                        if (fd->flags & FOREACH_F_FLAG) 
+                                bt->flags |= (BT_FULL|BT_FULL_SYM_SLAB);
+                        if (fd->flags & FOREACH_F_FLAG2) 
+                                bt->flags |= BT_FULL_SYM_SLAB2;
+                        if (fd->flags & FOREACH_x_FLAG) 
+				bt->radix = 16;
+                        if (fd->flags & FOREACH_d_FLAG) 
+				bt->radix = 10;
+			if (fd->reference)
+				bt->ref = ref;
+			if (fd->flags & FOREACH_U_FLAG) {
+				open_tmpfile();
+				back_trace(bt);
+				bt_group_task(tc, FALSE);
+			} else
+				back_trace(bt);
+			break;
+
+		case FOREACH_VM:
+			pc->curcmd = "vm";
+			cmdflags = 0;
+			if (fd->flags & FOREACH_x_FLAG)
+				cmdflags = PRINT_RADIX_16;
+			else if (fd->flags & FOREACH_d_FLAG)
+				cmdflags = PRINT_RADIX_10;
+			if (fd->flags & FOREACH_i_FLAG)
+				vm_area_dump(tc->task, 
+				    PRINT_INODES, 0, NULL);
+			else if (fd->flags & FOREACH_p_FLAG)
+				vm_area_dump(tc->task, 
+				    PHYSADDR, 0, 
+				    fd->reference ? ref : NULL);
+			else if (fd->flags & FOREACH_m_FLAG)
+				vm_area_dump(tc->task, 
+				    PRINT_MM_STRUCT|cmdflags, 0, NULL);
+			else if (fd->flags & FOREACH_v_FLAG)
+				vm_area_dump(tc->task, 
+				    PRINT_VMA_STRUCTS|cmdflags, 0, NULL);
+			else
+				vm_area_dump(tc->task, 0, 0, 
+				    fd->reference ? ref : NULL);
+			break;
+
+		case FOREACH_TASK:
+			pc->curcmd = "task";
+			if (fd->flags & FOREACH_x_FLAG)
+				radix = 16;
+			else if (fd->flags & FOREACH_d_FLAG)
+				radix = 10;
+			else
+				radix = pc->output_radix;
+			do_task(tc->task, FOREACH_TASK, 
+				fd->reference ? ref : NULL, 
+				radix);
+			break;
+
+                case FOREACH_SIG:
+			pc->curcmd = "sig";
+			if (job && (fd->flags & FOREACH_g_FLAG)) {
+				if (job->sig_group)
+					do_sig_thread_group(job->sig_group);
+			} else if (fd->flags & FOREACH_g_FLAG) {
+				tgid = task_tgid(tc->task);	
+				tgc = tgid_to_context(tgid);
+				if (hq_enter(tgc->task))
+					do_sig_thread_group(tgc->task);
+			} else 
+                        	do_sig(tc->task, FOREACH_SIG,
+                                	fd->reference ? ref : NULL);
+                        break;
+
+		case FOREACH_SET:
+			pc->curcmd = "set";
+			show_context(tc);
+			break;
+
+		case FOREACH_PS:
+			pc->curcmd = "ps";
+                        psinfo->task[0] = tc->task;
+                        psinfo->pid[0] = NO_PID;
+                        psinfo->type[0] = PS_BY_TASK;
+			psinfo->argc = 1;
+                        cmdflags = PS_BY_TASK;
+			if ((*subsequent)++)
+				cmdflags |= PS_NO_HEADER;
+			if (fd->flags & FOREACH_G_FLAG)
+				cmdflags |= PS_GROUP;
+			if (fd->flags & FOREACH_s_FLAG)
+				cmdflags |= PS_KSTACKP;
+			if (fd->flags & FOREACH_y_FLAG) {
+				cmdflags |= PS_POLICY;
+				psinfo->policy = fd->policy;
+			}
+			/*
+			 * mutually exclusive flags
+			 */ 
+			if (fd->flags & FOREACH_a_FLAG)
+				cmdflags |= PS_ARGV_ENVP;
+			else if (fd->flags & FOREACH_c_FLAG)
+				cmdflags |= PS_CHILD_LIST;
+			else if (fd->flags & FOREACH_p_FLAG)
+				cmdflags |= PS_PPID_LIST;
+			else if (fd->flags & FOREACH_t_FLAG)
+				cmdflags |= PS_TIMES;
+			else if (fd->flags & FOREACH_l_FLAG)
+				cmdflags |= PS_LAST_RUN;
+			else if (fd->flags & FOREACH_m_FLAG)
+				cmdflags |= PS_MSECS;
+			else if (fd->flags & FOREACH_r_FLAG)
+				cmdflags |= PS_RLIMIT;
+			else if (fd->flags & FOREACH_g_FLAG)
+				cmdflags |= PS_TGID_LIST;
+			show_ps(cmdflags, psinfo);
+			break;
+
+		case FOREACH_FILES:
+			pc->curcmd = "files";
+			cmdflags = 0;
+
+			if (fd->flags & FOREACH_i_FLAG)
+				cmdflags |= PRINT_INODES;
+			if (fd->flags & FOREACH_c_FLAG)
+				cmdflags |= PRINT_NRPAGES;
+
+			open_files_dump(tc->task,
+				cmdflags,
+				fd->reference ? ref : NULL);
+			break;
+
+		case FOREACH_NET:
+			pc->curcmd = "net";
+			if (fd->flags & (FOREACH_s_FLAG|FOREACH_S_FLAG))
+				dump_sockets_workhorse(tc->task,
+					fd->flags, 
+					fd->reference ? ref : NULL);
+			break;
+
+		case FOREACH_VTOP:
+			pc->curcmd = "vtop";
+			cmdflags = 0;
+			if (fd->flags & FOREACH_c_FLAG)
+				cmdflags |= USE_USER_PGD;
+			if (fd->flags & FOREACH_u_FLAG)
+				cmdflags |= UVADDR;
+			if (fd->flags & FOREACH_k_FLAG)
+				cmdflags |= KVADDR;
+
+			for (a = 0; a < fd->args; a++) { 
+				do_vtop(htol((char *)fd->arg_array[a], 
+					FAULT_ON_ERROR, NULL), tc,
+					cmdflags);
+			}
+			break;
+
+		case FOREACH_TEST:
+			pc->curcmd = "test";
+			foreach_test(tc->task, 0);
+			break;
+		}
+
+		pc->curcmd = "foreach";
+	}
+}
+
+/*
+ *  run_forked() job for "foreach -j": run the command(s) on one task.
+ *  An error that would return to the foreach loop just ends the job.
+ */
+static void
+foreach_parallel_job(void *arg, int j)
+{
+	int subsequent;
+	struct foreach_jobs *jobs = arg;
+
+	if (setjmp(pc->foreach_loop_env)) {
+		free_all_bufs();
+		return;
+	}
+	pc->flags |= IN_FOREACH;
+
+	subsequent = j * jobs->fr->increments;
+	foreach_task(jobs->fr, jobs->job[j].tc, &subsequent, &jobs->job[j]);
+}
+
+/*
+ *  "foreach -j threads": the selected tasks are spread across worker
+ *  processes by run_forked(), and their output is displayed in the
+ *  original task order.  Any state that carries over from one task to
+ *  the next is worked out ahead of time: the header separators, and for
+ *  "sig -g", the thread group that each task displays, if any.  "ps -G"
+ *  depends on the tasks processed before, and is run serially.
+ */
+static int
+foreach_parallel(struct foreach_run *fr)
+{
+	int j, k, njobs, sig_g, ret;
+	struct foreach_data *fd = fr->fd;
+	struct foreach_jobs jobs;
+	struct task_context *tc, *tgc;
+
+	sig_g = FALSE;
+	for (k = 0; k < fd->keys; k++) {
+		switch (fd->keyword_array[k])
+		{
+		case FOREACH_PS:
+			if (fd->flags & FOREACH_G_FLAG) {
+				error(INFO, "-j is not supported with ps -G\n");
+				return FORKED_SERIAL;
+			}
+			break;
+		case FOREACH_SIG:
+			if (fd->flags & FOREACH_g_FLAG)
+				sig_g = TRUE;
+			break;
+		}
+	}
+
+	for (j = njobs = 0, tc = FIRST_CONTEXT(); j < RUNNING_TASKS(); j++, tc++)
+		if (foreach_selected(fr, tc))
+			njobs++;
+
+	if (njobs < 2)
+		return FORKED_SERIAL;
+
+	/*
+	 *  Not a GETBUF(), since run_forked() frees all buffers if the
+	 *  command is interrupted.
+	 */
+	if (!(jobs.job = calloc(njobs, sizeof(struct foreach_job)))) {
+		error(INFO, "cannot malloc foreach job array\n");
+		return FORKED_SERIAL;
+	}
+	jobs.fr = fr;
+
+	for (j = k = 0, tc = FIRST_CONTEXT(); j < RUNNING_TASKS(); j++, tc++) {
+		if ((k == njobs) || !foreach_selected(fr, tc))
+			continue;
+		jobs.job[k].tc = tc;
+		if (sig_g) {
+			tgc = tgid_to_context(task_tgid(tc->task));
+			if (tgc && hq_enter(tgc->task))
+				jobs.job[k].sig_group = tgc->task;
+		}
+		k++;
+	}
+
+	ret = run_forked(fd->threads, k, foreach_parallel_job, &jobs);
+
+	free(jobs.job);
+	return ret;
+}
+
 /*
  *  Do the work for cmd_foreach().
  */
@@ -6796,18 +7938,14 @@ void
 foreach(struct foreach_data *fd)
 {
         int i, j, k, a;
-        struct task_context *tc, *tgc;
+        struct task_context *tc;
 	int specified;
-	int doit;
 	int subsequent;
-	unsigned int radix;
-	ulong cmdflags; 
-	ulong tgid;
 	struct reference reference, *ref;
 	int print_header;
 	struct bt_info bt_info, *bt;
-	char buf[TASK_COMM_LEN];
 	struct psinfo psinfo;
+	struct foreach_run run;
 
 	/* 
 	 *  Filter out any command/option issues.
@@ -6932,6 +8070,19 @@ foreach(struct foreach_data *fd)
                                 error(FATAL,
 				    "bt -g option is not supported when issued from foreach\n");
 #endif
+			if (fd->flags & FOREACH_U_FLAG) {
+				if (fd->keys > 1)
+					error(FATAL,
+					    "bt -U cannot be combined with other foreach commands\n");
+				if (fd->reference)
+					error(FATAL,
+					    "bt -U cannot be used with the -R option\n");
+				if (fd->threads > 1)
+					error(FATAL,
+					    "bt -U cannot be used with the -j option\n");
+				bt_group_free();
+				print_header = FALSE;
+			}
 			bt = &bt_info;
 			break;
 
@@ -7009,78 +8160,32 @@ foreach(struct foreach_data *fd)
 		(fd->flags & FOREACH_SPECIFIED));
 	ref = &reference;
 
-        tc = FIRST_CONTEXT();
-
-        for (i = 0; i < RUNNING_TASKS(); i++, tc++) {
-		doit = FALSE;
-
-		if ((fd->flags & FOREACH_ACTIVE) && !is_task_active(tc->task))
-			continue;
-
-		if ((fd->flags & FOREACH_USER) && is_kernel_thread(tc->task))
-			continue;
-
-		if ((fd->flags & FOREACH_GLEADER) && tc->pid != task_tgid(tc->task))
-			continue;
-
-		if ((fd->flags & FOREACH_KERNEL) && !is_kernel_thread(tc->task))
-			continue;
-
-		if (fd->flags & FOREACH_STATE) {
-			if (fd->state == _RUNNING_) {
-				if (task_state(tc->task) != _RUNNING_)
-					continue;
-			} else if (fd->state & _UNINTERRUPTIBLE_) {
-				if (!(task_state(tc->task) & _UNINTERRUPTIBLE_))
-					continue;
+	run.fd = fd;
+	run.specified = specified;
+	run.print_header = print_header;
+	run.increments = !fd->reference && print_header;
+	for (k = 0; k < fd->keys; k++) {
+		if (fd->keyword_array[k] == FOREACH_PS)
+			run.increments++;
+	}
+	run.ref = ref;
+	run.bt = bt;
+	run.psinfo = &psinfo;
 
-				if (valid_task_state(_NOLOAD_)) {
-					if (fd->state & _NOLOAD_) {
-						if (!(task_state(tc->task) & _NOLOAD_))
-							continue;
-					} else {
-						if ((task_state(tc->task) & _NOLOAD_))
-							continue;
-					}
-				}
-			} else if (!(task_state(tc->task) & fd->state))
-				continue;
+	if (fd->threads > 1) {
+		switch (foreach_parallel(&run))
+		{
+		case FORKED_DONE:
+			goto foreach_post_process;
+		case FORKED_BAILOUT:
+			goto foreach_bailout;
 		}
+	}
 
-		if (specified) {
-			for (j = 0; j < fd->tasks; j++) {
-				if (fd->task_array[j] == tc->task) {
-					doit = TRUE;
-					break;
-				}
-			}
-	
-			for (j = 0; !doit && (j < fd->pids); j++) {
-				if (fd->pid_array[j] == tc->pid) {
-					doit = TRUE;
-					break;
-				}
-			}
-	
-	 		for (j = 0; !doit && (j < fd->comms); j++) {
-				strlcpy(buf, fd->comm_array[j], TASK_COMM_LEN);
-				if (STREQ(buf, tc->comm)) {
-					doit = TRUE;
-					break;
-				}
-			}
-
-			for (j = 0; !doit && (j < fd->regexs); j++) {
-				if (regexec(&fd->regex_info[j].regex, 
-				    tc->comm, 0, NULL, 0) == 0) {
-					doit = TRUE;
-					break;
-				}
-			}
-		} else 
-			doit = TRUE;
+        tc = FIRST_CONTEXT();
 
-		if (!doit)
+        for (i = 0; i < RUNNING_TASKS(); i++, tc++) {
+		if (!foreach_selected(&run, tc))
 			continue;
 
 		if (output_closed() || received_SIGINT()) {
@@ -7089,224 +8194,266 @@ foreach(struct foreach_data *fd)
 		}
 
                 if (setjmp(pc->foreach_loop_env)) {
+			if ((fd->flags & FOREACH_U_FLAG) && pc->tmpfile)
+				bt_group_task(tc, TRUE);
 			free_all_bufs();
                         continue;
 		}
 		pc->flags |= IN_FOREACH;
 
-		if (fd->reference) {
-			BZERO(ref, sizeof(struct reference));
-			ref->str = fd->reference;
-		} else if (print_header)
-			print_task_header(fp, tc, subsequent++);
+		foreach_task(&run, tc, &subsequent, NULL);
+	}
 
-		for (k = 0; k < fd->keys; k++) {
-			free_all_bufs();
+foreach_post_process:
+	/*
+	 *  Post-process any commands requiring it.
+	 */
+        for (k = 0; k < fd->keys; k++) {
+                switch(fd->keyword_array[k])
+                {
+		case FOREACH_BT:
+			if (fd->flags & FOREACH_U_FLAG) {
+				bt_group_display();
+				bt_group_free();
+			}
+			break;
 
-			switch(fd->keyword_array[k])
-			{
-			case FOREACH_BT:
-				pc->curcmd = "bt";
-				BZERO(bt, sizeof(struct bt_info));;
-				bt->task = tc->task;
-				bt->tc = tc;
-				bt->stackbase = GET_STACKBASE(tc->task);
-				bt->stacktop = GET_STACKTOP(tc->task);
-				if (fd->flags & FOREACH_r_FLAG)
-					bt->flags |= BT_RAW;
-				if (fd->flags & FOREACH_s_FLAG)
-					bt->flags |= BT_SYMBOL_OFFSET;
-				if (fd->flags & FOREACH_t_FLAG)
-					bt->flags |= BT_TEXT_SYMBOLS;
-				if (fd->flags & FOREACH_T_FLAG) {
-					bt->flags |= BT_TEXT_SYMBOLS;
-					bt->flags |= BT_TEXT_SYMBOLS_ALL;
-				}
-				if ((fd->flags & FOREACH_o_FLAG) ||
-				    (kt->flags & USE_OPT_BT))
-					bt->flags |= BT_OPT_BACK_TRACE;
-                                if (fd->flags & FOREACH_e_FLAG)
-                                        bt->flags |= BT_EFRAME_SEARCH;
-#ifdef GDB_5_3
-                                if (fd->flags & FOREACH_g_FLAG)
-                                        bt->flags |= BT_USE_GDB;
-#endif
-                                if (fd->flags & FOREACH_l_FLAG) 
-                                        bt->flags |= BT_LINE_NUMBERS;
-                                if (fd->flags & FOREACH_f_FLAG) 
-                                        bt->flags |= BT_FULL;
-                                if (fd->flags & FOREACH_F_FLAG) 
-                                        bt->flags |= (BT_FULL|BT_FULL_SYM_SLAB);
-                                if (fd->flags & FOREACH_F_FLAG2) 
-                                        bt->flags |= BT_FULL_SYM_SLAB2;
-                                if (fd->flags & FOREACH_x_FLAG) 
-					bt->radix = 16;
-                                if (fd->flags & FOREACH_d_FLAG) 
-					bt->radix = 10;
-				if (fd->reference)
-					bt->ref = ref;
-				back_trace(bt); 
-				break;
+		case FOREACH_SIG:
+                        if (fd->flags & FOREACH_g_FLAG)
+				hq_close();
+			break;
+		}
+	}
 
-			case FOREACH_VM:
-				pc->curcmd = "vm";
-				cmdflags = 0;
-				if (fd->flags & FOREACH_x_FLAG)
-					cmdflags = PRINT_RADIX_16;
-				else if (fd->flags & FOREACH_d_FLAG)
-					cmdflags = PRINT_RADIX_10;
-				if (fd->flags & FOREACH_i_FLAG)
-					vm_area_dump(tc->task, 
-					    PRINT_INODES, 0, NULL);
-				else if (fd->flags & FOREACH_p_FLAG)
-					vm_area_dump(tc->task, 
-					    PHYSADDR, 0, 
-					    fd->reference ? ref : NULL);
-				else if (fd->flags & FOREACH_m_FLAG)
-					vm_area_dump(tc->task, 
-					    PRINT_MM_STRUCT|cmdflags, 0, NULL);
-				else if (fd->flags & FOREACH_v_FLAG)
-					vm_area_dump(tc->task, 
-					    PRINT_VMA_STRUCTS|cmdflags, 0, NULL);
-				else
-					vm_area_dump(tc->task, 0, 0, 
-					    fd->reference ? ref : NULL);
-				break;
+foreach_bailout:
 
-			case FOREACH_TASK:
-				pc->curcmd = "task";
-				if (fd->flags & FOREACH_x_FLAG)
-					radix = 16;
-				else if (fd->flags & FOREACH_d_FLAG)
-					radix = 10;
-				else
-					radix = pc->output_radix;
-				do_task(tc->task, FOREACH_TASK, 
-					fd->reference ? ref : NULL, 
-					radix);
-				break;
+	pc->flags &= ~IN_FOREACH;
+}
 
-                        case FOREACH_SIG:
-				pc->curcmd = "sig";
-				if (fd->flags & FOREACH_g_FLAG) {
-					tgid = task_tgid(tc->task);	
-					tgc = tgid_to_context(tgid);
-					if (hq_enter(tgc->task))
-						do_sig_thread_group(tgc->task);
-				} else 
-                                	do_sig(tc->task, FOREACH_SIG,
-                                        	fd->reference ? ref : NULL);
-                                break;
-
-			case FOREACH_SET:
-				pc->curcmd = "set";
-				show_context(tc);
-				break;
+/*
+ *  "foreach bt -U" groups the tasks by backtrace.  The output of each
+ *  task's backtrace is captured in the temporary file, and the stack
+ *  addresses in its frame lines are removed, so that the tasks whose
+ *  backtraces pass through the same functions and return addresses end
+ *  up in the same group.  The groups are displayed once all tasks have
+ *  been seen, each with its task count and PIDs.
+ */
+#define BT_GROUP_HASH (1024)	/* power of 2 */
 
-			case FOREACH_PS:
-				pc->curcmd = "ps";
-                                psinfo.task[0] = tc->task;
-                                psinfo.pid[0] = NO_PID;
-                                psinfo.type[0] = PS_BY_TASK;
-				psinfo.argc = 1;
-                                cmdflags = PS_BY_TASK;
-				if (subsequent++)
-					cmdflags |= PS_NO_HEADER;
-				if (fd->flags & FOREACH_G_FLAG)
-					cmdflags |= PS_GROUP;
-				if (fd->flags & FOREACH_s_FLAG)
-					cmdflags |= PS_KSTACKP;
-				if (fd->flags & FOREACH_y_FLAG) {
-					cmdflags |= PS_POLICY;
-					psinfo.policy = fd->policy;
-				}
-				/*
-				 * mutually exclusive flags
-				 */ 
-				if (fd->flags & FOREACH_a_FLAG)
-					cmdflags |= PS_ARGV_ENVP;
-				else if (fd->flags & FOREACH_c_FLAG)
-					cmdflags |= PS_CHILD_LIST;
-				else if (fd->flags & FOREACH_p_FLAG)
-					cmdflags |= PS_PPID_LIST;
-				else if (fd->flags & FOREACH_t_FLAG)
-					cmdflags |= PS_TIMES;
-				else if (fd->flags & FOREACH_l_FLAG)
-					cmdflags |= PS_LAST_RUN;
-				else if (fd->flags & FOREACH_m_FLAG)
-					cmdflags |= PS_MSECS;
-				else if (fd->flags & FOREACH_r_FLAG)
-					cmdflags |= PS_RLIMIT;
-				else if (fd->flags & FOREACH_g_FLAG)
-					cmdflags |= PS_TGID_LIST;
-				show_ps(cmdflags, &psinfo);
-				break;
+static struct bt_group {
+	struct bt_group *next;
+	ulong hash;
+	char *stack;		/* backtrace text without stack addresses */
+	long count;
+	long tasks_alloc;
+	struct task_context **tasks;
+} *bt_group_hash[BT_GROUP_HASH];
 
-			case FOREACH_FILES:
-				pc->curcmd = "files";
-				cmdflags = 0;
+static long bt_groups = 0;
 
-				if (fd->flags & FOREACH_i_FLAG)
-					cmdflags |= PRINT_INODES;
-				if (fd->flags & FOREACH_c_FLAG)
-					cmdflags |= PRINT_NRPAGES;
+/*
+ *  Remove the stack address from a " #N [address] function at pc" line.
+ */
+static void
+bt_group_normalize(char *line)
+{
+	char *p1, *p2;
 
-				open_files_dump(tc->task,
-					cmdflags,
-					fd->reference ? ref : NULL);
-				break;
+	p1 = line;
+	while (*p1 == ' ')
+		p1++;
+	if ((*p1 != '#') || (*(p1+1) < '0') || (*(p1+1) > '9'))
+		return;
+	strtoul(p1+1, &p1, 10);
+	if ((*p1 != ' ') || (*(p1+1) != '[') || (*(p1+2) == '-'))
+		return;
+	strtoul(p1+2, &p2, 16);
+	if ((p2 == p1+2) || (*p2 != ']'))
+		return;
+	shift_string_left(p1, (int)(p2 - p1) + 1);
+}
 
-			case FOREACH_NET:
-				pc->curcmd = "net";
-				if (fd->flags & (FOREACH_s_FLAG|FOREACH_S_FLAG))
-					dump_sockets_workhorse(tc->task,
-						fd->flags, 
-						fd->reference ? ref : NULL);
-				break;
+static ulong
+bt_group_hash_string(char *s)
+{
+	ulong hash;
 
-			case FOREACH_VTOP:
-				pc->curcmd = "vtop";
-				cmdflags = 0;
-				if (fd->flags & FOREACH_c_FLAG)
-					cmdflags |= USE_USER_PGD;
-				if (fd->flags & FOREACH_u_FLAG)
-					cmdflags |= UVADDR;
-				if (fd->flags & FOREACH_k_FLAG)
-					cmdflags |= KVADDR;
-
-				for (a = 0; a < fd->args; a++) { 
-					do_vtop(htol((char *)fd->arg_array[a], 
-						FAULT_ON_ERROR, NULL), tc,
-						cmdflags);
-				}
+	for (hash = 5381; *s; s++)
+		hash = (hash * 33) ^ (unsigned char)*s;
+
+	return hash;
+}
+
+/*
+ *  Read and close the temporary file containing the backtrace of a task,
+ *  and add the task to the group of its backtrace.
+ */
+static void
+bt_group_task(struct task_context *tc, int aborted)
+{
+	char buf[BUFSIZE];
+	char *stack, *newp;
+	long len, size, cnt;
+	ulong hash;
+	struct bt_group *bg;
+	struct task_context **tasks;
+
+	len = 0;
+	size = BUFSIZE;
+	stack = malloc(size);
+
+	rewind(pc->tmpfile);
+	while (stack && fgets(buf, BUFSIZE, pc->tmpfile)) {
+		bt_group_normalize(buf);
+		cnt = strlen(buf);
+		if ((len + cnt + 1) > size) {
+			size = MAX(size * 2, len + cnt + 1);
+			if (!(newp = realloc(stack, size))) {
+				free(stack);
+				stack = NULL;
 				break;
+			}
+			stack = newp;
+		}
+		BCOPY(buf, stack + len, cnt);
+		len += cnt;
+	}
+	close_tmpfile();
+
+	if (!stack) {
+		error(INFO, "cannot malloc backtrace of task %lx\n", tc->task);
+		return;
+	}
+	stack[len] = NULLCHAR;
+
+	if (aborted) {
+		cnt = strlen("    (backtrace failed)\n");
+		if ((len + cnt + 1) > size) {
+			if (!(newp = realloc(stack, len + cnt + 1))) {
+				free(stack);
+				return;
+			}
+			stack = newp;
+		}
+		strcat(stack, "    (backtrace failed)\n");
+	}
+
+	hash = bt_group_hash_string(stack);
+
+	for (bg = bt_group_hash[hash & (BT_GROUP_HASH-1)]; bg; bg = bg->next) {
+		if ((bg->hash == hash) && STREQ(bg->stack, stack))
+			break;
+	}
+
+	if (bg)
+		free(stack);
+	else {
+		if (!(bg = calloc(1, sizeof(struct bt_group)))) {
+			free(stack);
+			error(INFO, "cannot malloc backtrace group\n");
+			return;
+		}
+		bg->hash = hash;
+		bg->stack = stack;
+		bg->next = bt_group_hash[hash & (BT_GROUP_HASH-1)];
+		bt_group_hash[hash & (BT_GROUP_HASH-1)] = bg;
+		bt_groups++;
+	}
+
+	if (bg->count == bg->tasks_alloc) {
+		cnt = bg->tasks_alloc ? bg->tasks_alloc * 2 : 16;
+		if (!(tasks = realloc(bg->tasks,
+		    sizeof(struct task_context *) * cnt))) {
+			error(INFO, "cannot malloc backtrace group tasks\n");
+			return;
+		}
+		bg->tasks = tasks;
+		bg->tasks_alloc = cnt;
+	}
+	bg->tasks[bg->count++] = tc;
+}
+
+static int
+compare_bt_group(const void *v1, const void *v2)
+{
+	struct bt_group *bg1, *bg2;
+
+	bg1 = *(struct bt_group **)v1;
+	bg2 = *(struct bt_group **)v2;
+
+	if (bg1->count > bg2->count)
+		return -1;
+	if (bg1->count < bg2->count)
+		return 1;
+	if (bg1->tasks[0]->pid < bg2->tasks[0]->pid)
+		return -1;
+	if (bg1->tasks[0]->pid > bg2->tasks[0]->pid)
+		return 1;
+	return 0;
+}
+
+/*
+ *  Display the backtrace groups, largest first.
+ */
+static void
+bt_group_display(void)
+{
+	int i;
+	long g, t, tasks, col, indent;
+	struct bt_group *bg, **groups;
+	char buf[BUFSIZE];
+
+	if (!bt_groups)
+		return;
+
+	groups = (struct bt_group **)GETBUF(sizeof(struct bt_group *) * bt_groups);
+
+	for (i = g = tasks = 0; i < BT_GROUP_HASH; i++) {
+		for (bg = bt_group_hash[i]; bg; bg = bg->next) {
+			groups[g++] = bg;
+			tasks += bg->count;
+		}
+	}
+
+	qsort(groups, bt_groups, sizeof(struct bt_group *), compare_bt_group);
+
+	for (g = 0; g < bt_groups; g++) {
+		bg = groups[g];
+		indent = col = fprintf(fp, "TASKS: %ld  PIDS:", bg->count);
+		for (t = 0; t < bg->count; t++) {
+			sprintf(buf, " %ld", bg->tasks[t]->pid);
+			if ((col + strlen(buf)) > 79) {
+				fprintf(fp, "\n%s", space(indent));
+				col = indent;
+			}
+			col += fprintf(fp, "%s", buf);
+		}
+		fprintf(fp, "\n%s\n", bg->stack);
+	}
 
-			case FOREACH_TEST:
-				pc->curcmd = "test";
-				foreach_test(tc->task, 0);
-				break;
-			}
+	fprintf(fp, "%ld unique backtrace%s in %ld task%s\n", bt_groups,
+		bt_groups == 1 ? "" : "s", tasks, tasks == 1 ? "" : "s");
 
-			pc->curcmd = "foreach";
-		} 
-	}
+	FREEBUF(groups);
+}
 
-	/*
-	 *  Post-process any commands requiring it.
-	 */
-        for (k = 0; k < fd->keys; k++) {
-                switch(fd->keyword_array[k])
-                {
-		case FOREACH_SIG:
-                        if (fd->flags & FOREACH_g_FLAG)
-				hq_close();
-			break;
+static void
+bt_group_free(void)
+{
+	int i;
+	struct bt_group *bg, *next;
+
+	for (i = 0; i < BT_GROUP_HASH; i++) {
+		for (bg = bt_group_hash[i]; bg; bg = next) {
+			next = bg->next;
+			free(bg->stack);
+			free(bg->tasks);
+			free(bg);
 		}
+		bt_group_hash[i] = NULL;
 	}
 
-foreach_bailout:
-
-	pc->flags &= ~IN_FOREACH;
+	bt_groups = 0;
 }
 
 /*
@@ -7388,6 +8535,13 @@ is_foreach_keyword(char *s, int *key)
 	return FALSE;
 }
 
+/*
+ *  The panic search "foreach bt" of a task list this large is spread
+ *  across a worker process per host cpu, as with "foreach -j", which
+ *  keeps its output in task order.
+ */
+#define PANIC_SEARCH_PARALLEL_TASKS (256)
+
 /*
  *  Try the dumpfile-specific manner of finding the panic task first.  If
  *  that fails, find the panic task the hard way -- do a "foreach bt" in the 
@@ -7421,6 +8575,10 @@ panic_search(void)
 	else
 		fd->flags |= (FOREACH_t_FLAG|FOREACH_o_FLAG);
 
+	if (RUNNING_TASKS() >= PANIC_SEARCH_PARALLEL_TASKS)
+		fd->threads = MIN(MAX((int)sysconf(_SC_NPROCESSORS_ONLN), 1),
+			MAX_PARALLEL_THREADS);
+
 	dietask = lasttask = NO_TASK;
 	
 	found = FALSE;
@@ -7714,6 +8872,16 @@ print_task_header(FILE *out, struct task_context *tc, int newline)
 	char buf[BUFSIZE];
 	char buf1[BUFSIZE];
 
+	if (STRUCTURED_OUTPUT() && (out == fp)) {
+		record_begin("task_header");
+		record_long("pid", tc->pid);
+		record_hex("task", tc->task);
+		record_long("cpu", tc->processor);
+		record_string("comm", tc->comm);
+		record_end();
+		return;
+	}
+
         fprintf(out, "%sPID: %-7ld  TASK: %s  CPU: %-3s  COMMAND: \"%s\"\n",
 		newline ? "\n" : "", tc->pid, 
 		mkstring(buf1, VADDR_PRLEN, LJUST|LONG_HEX, MKSTR(tc->task)),
@@ -7752,6 +8920,9 @@ dump_task_table(int verbose)
 	fprintf(fp, "   context_by_task: %lx\n",  (ulong)tt->context_by_task);
 	fprintf(fp, "        tgid_array: %lx\n",  (ulong)tt->tgid_array);
 	fprintf(fp, "     tgid_searches: %ld\n",  tt->tgid_searches);
+	fprintf(fp, " context_task_hash: %lx\n", (ulong)tt->context_task_hash);
+	fprintf(fp, "  context_pid_hash: %lx\n", (ulong)tt->context_pid_hash);
+	fprintf(fp, " context_hash_size: %ld\n", tt->context_hash_size);
 	fprintf(fp, "   tgid_cache_hits: %ld (%ld%%)\n", tt->tgid_cache_hits,
 		tt->tgid_searches ? 
 		tt->tgid_cache_hits * 100 / tt->tgid_searches : 0);
@@ -7868,7 +9039,22 @@ dump_task_table(int verbose)
         fprintf(fp, "       pidhash_len: %d\n", tt->pidhash_len);
         fprintf(fp, "      pidhash_addr: %lx\n", tt->pidhash_addr);
 	fprintf(fp, "    last_task_read: %lx\n", tt->last_task_read);
+	fprintf(fp, "task_context_range:");
+	if (task_context_ranges < 0)
+		fprintf(fp, " (complete task_struct)");
+	for (i = 0; i < task_context_ranges; i++)
+		fprintf(fp, " %ld-%ld", task_context_range[i].offset,
+			task_context_range[i].offset + task_context_range[i].size);
+	fprintf(fp, "\n");
 	fprintf(fp, "      last_mm_read: %lx\n", tt->last_mm_read);
+	fprintf(fp, "      stack_window: %ld reads, %ld hits\n",
+		stack_window_cache.reads, stack_window_cache.hits);
+	for (i = 0; i < STACK_WINDOWS; i++) {
+		if (stack_window_cache.windows[i].base)
+			fprintf(fp, "                    [%d] %lx (%ld bytes)\n", i,
+				stack_window_cache.windows[i].base,
+				stack_window_cache.windows[i].size);
+	}
 	fprintf(fp, "       task_struct: %lx\n", (ulong)tt->task_struct);
 	fprintf(fp, "         mm_struct: %lx\n", (ulong)tt->mm_struct);
 	fprintf(fp, "       init_pid_ns: %lx\n", tt->init_pid_ns);
@@ -8791,7 +9977,9 @@ cmd_runq(void)
 	int dump_task_group_flag = 0;
 	int dump_milliseconds_flag = 0;
 
-        while ((c = getopt(argcnt, args, "dtTgmc:")) != EOF) {
+	runq_threads = 0;
+
+        while ((c = getopt(argcnt, args, "dtTgmc:j:")) != EOF) {
                 switch(c)
                 {
 		case 'd':
@@ -8826,6 +10014,9 @@ cmd_runq(void)
 				pc->curcmd_private = (ulong)cpus;
 			}
 			break;
+		case 'j':
+			runq_threads = dtoi(optarg, FAULT_ON_ERROR, NULL);
+			break;
                 default:
                         argerrs++;
                         break;
@@ -8836,6 +10027,12 @@ cmd_runq(void)
         if (argerrs)
                 cmd_usage(pc->curcmd, SYNOPSIS);
 
+	if (runq_threads && (dump_timestamp_flag || dump_lag_flag ||
+	    dump_milliseconds_flag || sched_debug)) {
+		error(INFO, "-j cannot be used with -t, -T, -m or -d\n");
+		cmd_usage(pc->curcmd, SYNOPSIS);
+	}
+
 	if (dump_timestamp_flag)
                 dump_on_rq_timestamp();
 	else if (dump_lag_flag)
@@ -9130,7 +10327,7 @@ start_again:
 		offs = OFFSET(task_struct_next_run);
 		next = runqueue_head = symbol_value("init_task_union");
 	} else
-		error(FATAL, 
+		error(FATAL,
 		    "cannot determine run queue structures\n");
 
 	cnt = 0;
@@ -9326,27 +10523,100 @@ struct task_group_info {
 	char *name;
 	ulong task_group;
 	struct task_group_info *parent;
+	int order;			/* position in the hierarchy walk */
+	ulong *cfs_rqs;			/* task_group.cfs_rq[kt->cpus] */
+	ulong *rt_rqs;			/* task_group.rt_rq[kt->cpus] */
+	int nr_children;
+	struct task_group_info **children;	/* in tgi_array order */
 };
 
 static struct task_group_info **tgi_array;
 static int tgi_p = 0;
 static int tgi_p_max = 0;
 
+#define TGI_RQ(rqs, cpu)	((rqs) ? (rqs)[(cpu)] : 0)
+
+/*
+ *  The task_group_info entries hashed by task_group address.
+ */
+static struct task_group_info **tgi_hash;
+static int tgi_hash_size = 0;
+
+static int
+compare_task_group_info(const void *v1, const void *v2)
+{
+	const struct task_group_info *t1, *t2;
+
+	t1 = *(const struct task_group_info **)v1;
+	t2 = *(const struct task_group_info **)v2;
+
+	if (t1->depth != t2->depth)
+		return t1->depth < t2->depth ? -1 : 1;
+
+	return t1->order < t2->order ? -1 : (t1->order > t2->order);
+}
+
+/*
+ *  Sort the task groups by depth, keeping those of the same depth in the
+ *  order that they were found, and then link each to its children and
+ *  enter it in the tgi_hash.
+ */
 static void
 sort_task_group_info_array(void)
 {
-	int i, j;
-	struct task_group_info *tmp;
+	int i, h;
+	struct task_group_info *tgi, *parent;
 
-	for (i = 0; i < tgi_p - 1; i++) {
-		for (j = 0; j < tgi_p - i - 1; j++) {
-			if (tgi_array[j]->depth > tgi_array[j+1]->depth) {
-				tmp = tgi_array[j+1];
-				tgi_array[j+1] = tgi_array[j];
-				tgi_array[j] = tmp;
-			}
-		}
+	for (i = 0; i < tgi_p; i++)
+		tgi_array[i]->order = i;
+
+	qsort(tgi_array, tgi_p, sizeof(struct task_group_info *),
+		compare_task_group_info);
+
+	for (i = 0; i < tgi_p; i++) {
+		if ((parent = tgi_array[i]->parent))
+			parent->nr_children++;
+	}
+	for (i = 0; i < tgi_p; i++) {
+		tgi = tgi_array[i];
+		if (tgi->nr_children)
+			tgi->children = (struct task_group_info **)
+				GETBUF(sizeof(void *) * tgi->nr_children);
+		tgi->nr_children = 0;
+	}
+	for (i = 0; i < tgi_p; i++) {
+		if ((parent = tgi_array[i]->parent))
+			parent->children[parent->nr_children++] = tgi_array[i];
+	}
+
+	for (tgi_hash_size = 64; tgi_hash_size < (tgi_p * 2); )
+		tgi_hash_size *= 2;
+	tgi_hash = (struct task_group_info **)
+		GETBUF(sizeof(void *) * tgi_hash_size);
+	for (i = 0; i < tgi_p; i++) {
+		h = (tgi_array[i]->task_group >> 6) & (tgi_hash_size - 1);
+		while (tgi_hash[h])
+			h = (h + 1) & (tgi_hash_size - 1);
+		tgi_hash[h] = tgi_array[i];
+	}
+}
+
+static struct task_group_info *
+task_group_to_info(ulong task_group)
+{
+	int h;
+
+	if (!tgi_hash_size)
+		return NULL;
+
+	h = (task_group >> 6) & (tgi_hash_size - 1);
+	while (tgi_hash[h]) {
+		if (tgi_hash[h]->task_group == task_group)
+			return tgi_hash[h];
+		h = (h + 1) & (tgi_hash_size - 1);
 	}
+
+	return NULL;
 }
 
 static void
@@ -9375,10 +10645,20 @@ free_task_group_info_array(void)
 	for (i = 0; i < tgi_p; i++) {
 		if (tgi_array[i]->name)
 			FREEBUF(tgi_array[i]->name);
+		if (tgi_array[i]->cfs_rqs)
+			FREEBUF(tgi_array[i]->cfs_rqs);
+		if (tgi_array[i]->rt_rqs)
+			FREEBUF(tgi_array[i]->rt_rqs);
+		if (tgi_array[i]->children)
+			FREEBUF(tgi_array[i]->children);
 		FREEBUF(tgi_array[i]);
 	}
 	tgi_p = 0;
 	FREEBUF(tgi_array);
+	if (tgi_hash)
+		FREEBUF(tgi_hash);
+	tgi_hash = NULL;
+	tgi_hash_size = 0;
 }
 
 static void
@@ -9436,7 +10716,7 @@ static void
 print_parent_task_group_fair(void *t, int cpu)
 {
 	struct task_group_info *tgi;
-	ulong cfs_rq_c, cfs_rq_p;
+	ulong cfs_rq_p;
 
 	tgi = ((struct task_group_info *)t)->parent;
 	if (tgi && tgi->use)
@@ -9444,11 +10724,7 @@ print_parent_task_group_fair(void *t, int cpu)
 	else
 		return;
 
-	readmem(tgi->task_group + OFFSET(task_group_cfs_rq),
-		KVADDR, &cfs_rq_c, sizeof(ulong),
-		"task_group cfs_rq", FAULT_ON_ERROR);
-	readmem(cfs_rq_c + cpu * sizeof(ulong), KVADDR, &cfs_rq_p,
-		sizeof(ulong), "task_group cfs_rq", FAULT_ON_ERROR);
+	cfs_rq_p = TGI_RQ(tgi->cfs_rqs, cpu);
 
 	print_group_header_fair(tgi->depth, cfs_rq_p, tgi);
 	tgi->use = 0;
@@ -9459,23 +10735,22 @@ dump_tasks_in_lower_dequeued_cfs_rq(int depth, ulong cfs_rq, int cpu,
 	struct task_context *ctc)
 {
 	int i, total, nr_running;
-	ulong group, cfs_rq_c, cfs_rq_p;
+	ulong group, cfs_rq_p;
+	struct task_group_info *tgi, *child;
 
 	total = 0;
-	for (i = 0; i < tgi_p; i++) {
-		if (tgi_array[i]->use == 0 || tgi_array[i]->depth - depth != 1)
-			continue;
 
-		readmem(cfs_rq + OFFSET(cfs_rq_tg), KVADDR, &group,
-			sizeof(ulong), "cfs_rq tg", FAULT_ON_ERROR);
-		if (group != tgi_array[i]->parent->task_group)
+	readmem(cfs_rq + OFFSET(cfs_rq_tg), KVADDR, &group,
+		sizeof(ulong), "cfs_rq tg", FAULT_ON_ERROR);
+	if (!(tgi = task_group_to_info(group)))
+		return total;
+
+	for (i = 0; i < tgi->nr_children; i++) {
+		child = tgi->children[i];
+		if (child->use == 0 || child->depth - depth != 1)
 			continue;
 
-		readmem(tgi_array[i]->task_group + OFFSET(task_group_cfs_rq),
-			KVADDR, &cfs_rq_c, sizeof(ulong), "task_group cfs_rq",
-			FAULT_ON_ERROR);
-		readmem(cfs_rq_c + cpu * sizeof(ulong), KVADDR, &cfs_rq_p,
-			sizeof(ulong), "task_group cfs_rq", FAULT_ON_ERROR);
+		cfs_rq_p = TGI_RQ(child->cfs_rqs, cpu);
 		if (cfs_rq == cfs_rq_p)
 			continue;
 
@@ -9488,7 +10763,7 @@ dump_tasks_in_lower_dequeued_cfs_rq(int depth, ulong cfs_rq, int cpu,
 			continue;
 		}
 
-		print_parent_task_group_fair(tgi_array[i], cpu);
+		print_parent_task_group_fair(child, cpu);
 
 		total++;
 		total += dump_tasks_in_task_group_cfs_rq(depth + 1, cfs_rq_p, cpu, ctc);
@@ -9561,7 +10836,8 @@ dump_tasks_in_task_group_cfs_rq(int depth, ulong cfs_rq, int cpu,
 	struct rb_root *root;
 	struct rb_node *node;
 	ulong my_q, leftmost, curr, curr_my_q, tg;
-	int total, i;
+	struct task_group_info *tgi;
+	int total;
 
 	total = 0;
 	curr_my_q = curr = 0;
@@ -9570,13 +10846,9 @@ dump_tasks_in_task_group_cfs_rq(int depth, ulong cfs_rq, int cpu,
 		readmem(cfs_rq + OFFSET(cfs_rq_tg), KVADDR,
 			&tg, sizeof(ulong), "cfs_rq tg",
 			FAULT_ON_ERROR);
-		for (i = 0; i < tgi_p; i++) {
-			if (tgi_array[i]->task_group == tg) {
-				print_group_header_fair(depth,
-					cfs_rq, tgi_array[i]);
-				tgi_array[i]->use = 0;
-				break;
-			}
+		if ((tgi = task_group_to_info(tg))) {
+			print_group_header_fair(depth, cfs_rq, tgi);
+			tgi->use = 0;
 		}
 	}
 
@@ -9788,104 +11060,173 @@ task_group_offset_init(void)
 	}
 }
 
+/*
+ *  The cpus selected for a "runq" display, each of which is a run_forked()
+ *  job with "runq -j".
+ */
+struct runq_jobs {
+	int count;
+	int *cpu;
+	struct syment *rq_sp;		/* dump_CFS_runqueues() */
+	struct syment *init_sp;
+	char *runqbuf;
+	char *cfs_rq_buf;
+	ulong root_task_group;		/* dump_tasks_by_task_group() */
+	char *task_group_name;
+	struct task_group_info *root;
+};
+
 static void
-dump_CFS_runqueues(void)
+runq_jobs_init(struct runq_jobs *rj)
+{
+	int cpu;
+	ulong *cpus;
+
+	cpus = pc->curcmd_flags & CPUMASK ?
+		(ulong *)(ulong)pc->curcmd_private : NULL;
+
+	BZERO(rj, sizeof(struct runq_jobs));
+	rj->cpu = (int *)GETBUF(sizeof(int) * kt->cpus);
+	for (cpu = 0; cpu < kt->cpus; cpu++) {
+		if (cpus && !NUM_IN_BITMAP(cpus, cpu))
+			continue;
+		rj->cpu[rj->count++] = cpu;
+	}
+}
+
+/*
+ *  Run func for each selected cpu, in worker processes if "runq -j" was
+ *  entered.  Each cpu's display only depends upon the task_group data
+ *  gathered beforehand, and the output is shown in cpu order either way.
+ *  Returns FALSE if the command was interrupted, in which case the
+ *  buffers have already been freed.
+ */
+static int
+runq_for_each_cpu(struct runq_jobs *rj, void (*func)(void *, int))
+{
+	int j;
+
+	if (runq_threads > 1) {
+		switch (run_forked(runq_threads, rj->count, func, rj))
+		{
+		case FORKED_DONE:
+			return TRUE;
+		case FORKED_BAILOUT:
+			return FALSE;
+		}
+	}
+
+	for (j = 0; j < rj->count; j++)
+		func(rj, j);
+
+	return TRUE;
+}
+
+static void
+dump_CFS_runqueue_cpu(void *arg, int j)
 {
-	int cpu, tot, displayed;
+	struct runq_jobs *rj = arg;
+	int cpu, tot;
 	ulong runq, cfs_rq, prio_array;
-	char *runqbuf, *cfs_rq_buf;
-	ulong tasks_timeline ATTRIBUTE_UNUSED;
+	char *runqbuf;
 	struct task_context *tc;
 	struct rb_root *root;
-	struct syment *rq_sp, *init_sp;
-	ulong *cpus;
 
-	cfs_rq_offset_init();
+	cpu = rj->cpu[j];
+	runqbuf = rj->runqbuf;
 
-	if (!(rq_sp = per_cpu_symbol_search("per_cpu__runqueues")))
-		error(FATAL, "per-cpu runqueues do not exist\n");
+	if ((kt->flags & SMP) && (kt->flags & PER_CPU_OFF))
+		runq = rj->rq_sp->value + kt->__per_cpu_offset[cpu];
+	else
+		runq = rj->rq_sp->value;
 
-        runqbuf = GETBUF(SIZE(runqueue));
-	if ((init_sp = per_cpu_symbol_search("per_cpu__init_cfs_rq")))
-		cfs_rq_buf = GETBUF(SIZE(cfs_rq));
+	fprintf(fp, "%sCPU %d ", j ? "\n" : "", cpu);
+
+	if (hide_offline_cpu(cpu)) {
+		fprintf(fp, "[OFFLINE]\n");
+		return;
+	} else
+		fprintf(fp, "RUNQUEUE: %lx\n", runq);
+
+	fprintf(fp, "  CURRENT: ");
+	if ((tc = task_to_context(tt->active_set[cpu])))
+		fprintf(fp, "PID: %-5ld  TASK: %lx  COMMAND: \"%s\"\n",
+			tc->pid, tc->task, tc->comm);
 	else
-		cfs_rq_buf = NULL;
+		fprintf(fp, "%lx\n", tt->active_set[cpu]);
 
-	get_active_set();
-	cpus = pc->curcmd_flags & CPUMASK ? 
-		(ulong *)(ulong)pc->curcmd_private : NULL;
+	readmem(runq, KVADDR, runqbuf, SIZE(runqueue),
+		"per-cpu rq", FAULT_ON_ERROR);
 
-        for (cpu = displayed = 0; cpu < kt->cpus; cpu++) {
-		if (cpus && !NUM_IN_BITMAP(cpus, cpu))
-			continue;
-		
+	if (rj->cfs_rq_buf) {
+		/*
+		 *  Use default task group's cfs_rq on each cpu.
+		 */
 		if ((kt->flags & SMP) && (kt->flags & PER_CPU_OFF))
-			runq = rq_sp->value + kt->__per_cpu_offset[cpu];
+			cfs_rq = rj->init_sp->value + kt->__per_cpu_offset[cpu];
 		else
-			runq = rq_sp->value;
+			cfs_rq = rj->init_sp->value;
 
-                fprintf(fp, "%sCPU %d ", displayed++ ? "\n" : "", cpu);
+		readmem(cfs_rq, KVADDR, rj->cfs_rq_buf, SIZE(cfs_rq),
+			"per-cpu cfs_rq", FAULT_ON_ERROR);
+		root = (struct rb_root *)(cfs_rq +
+			OFFSET(cfs_rq_tasks_timeline));
+	} else {
+		cfs_rq = runq + OFFSET(rq_cfs);
+		root = (struct rb_root *)(runq + OFFSET(rq_cfs) +
+			OFFSET(cfs_rq_tasks_timeline));
+	}
 
-		if (hide_offline_cpu(cpu)) {
-			fprintf(fp, "[OFFLINE]\n");
-			continue;
-		} else
-			fprintf(fp, "RUNQUEUE: %lx\n", runq);
+	prio_array = runq + OFFSET(rq_rt) + OFFSET(rt_rq_active);
+	fprintf(fp, "  RT PRIO_ARRAY: %lx\n",  prio_array);
 
-		fprintf(fp, "  CURRENT: ");
-		if ((tc = task_to_context(tt->active_set[cpu])))
-			fprintf(fp, "PID: %-5ld  TASK: %lx  COMMAND: \"%s\"\n",
-				tc->pid, tc->task, tc->comm);
-		else
-			fprintf(fp, "%lx\n", tt->active_set[cpu]);
+	tot = dump_RT_prio_array(prio_array,
+		&runqbuf[OFFSET(rq_rt) + OFFSET(rt_rq_active)]);
+	if (!tot) {
+		INDENT(5);
+		fprintf(fp, "[no tasks queued]\n");
+	}
 
-                readmem(runq, KVADDR, runqbuf, SIZE(runqueue),
-                        "per-cpu rq", FAULT_ON_ERROR);
+	fprintf(fp, "  CFS RB_ROOT: %lx\n", (ulong)root);
 
-		if (cfs_rq_buf) {
-			/*
-		 	 *  Use default task group's cfs_rq on each cpu.
-		 	 */
-			if ((kt->flags & SMP) && (kt->flags & PER_CPU_OFF))
-				cfs_rq = init_sp->value + kt->__per_cpu_offset[cpu];
-			else
-				cfs_rq = init_sp->value;
+	hq_open();
+	tot = dump_tasks_in_cfs_rq(cfs_rq);
+	hq_close();
 
-			readmem(cfs_rq, KVADDR, cfs_rq_buf, SIZE(cfs_rq),
-				"per-cpu cfs_rq", FAULT_ON_ERROR);
-			root = (struct rb_root *)(cfs_rq + 
-				OFFSET(cfs_rq_tasks_timeline));
-		} else {
-			cfs_rq = runq + OFFSET(rq_cfs);
-			root = (struct rb_root *)(runq + OFFSET(rq_cfs) + 
-				OFFSET(cfs_rq_tasks_timeline));
-		}
+	if (!tot) {
+		INDENT(5);
+		fprintf(fp, "[no tasks queued]\n");
+	}
+}
 
-		prio_array = runq + OFFSET(rq_rt) + OFFSET(rt_rq_active);
-		fprintf(fp, "  RT PRIO_ARRAY: %lx\n",  prio_array);
+static void
+dump_CFS_runqueues(void)
+{
+	struct runq_jobs runq_jobs, *rj;
 
-		tot = dump_RT_prio_array(prio_array,
-			&runqbuf[OFFSET(rq_rt) + OFFSET(rt_rq_active)]);
-		if (!tot) {
-			INDENT(5);
-			fprintf(fp, "[no tasks queued]\n");
-		}
+	cfs_rq_offset_init();
 
-		fprintf(fp, "  CFS RB_ROOT: %lx\n", (ulong)root);
+	rj = &runq_jobs;
+	runq_jobs_init(rj);
 
-		hq_open();
-		tot = dump_tasks_in_cfs_rq(cfs_rq);
-		hq_close();
+	if (!(rj->rq_sp = per_cpu_symbol_search("per_cpu__runqueues")))
+		error(FATAL, "per-cpu runqueues do not exist\n");
 
-		if (!tot) {
-			INDENT(5);
-			fprintf(fp, "[no tasks queued]\n");
-		}
-	}
+        rj->runqbuf = GETBUF(SIZE(runqueue));
+	if ((rj->init_sp = per_cpu_symbol_search("per_cpu__init_cfs_rq")))
+		rj->cfs_rq_buf = GETBUF(SIZE(cfs_rq));
+	else
+		rj->cfs_rq_buf = NULL;
+
+	get_active_set();
 
-	FREEBUF(runqbuf);
-	if (cfs_rq_buf)
-		FREEBUF(cfs_rq_buf);
+	if (!runq_for_each_cpu(rj, dump_CFS_runqueue_cpu))
+		return;
+
+	FREEBUF(rj->runqbuf);
+	if (rj->cfs_rq_buf)
+		FREEBUF(rj->cfs_rq_buf);
+	FREEBUF(rj->cpu);
 }
 
 static void
@@ -9913,7 +11254,7 @@ print_parent_task_group_rt(void *t, int cpu)
 {
 	int prio;
 	struct task_group_info *tgi;
-	ulong rt_rq_c, rt_rq_p;
+	ulong rt_rq_p;
 
 
 	tgi = ((struct task_group_info *)t)->parent;
@@ -9922,11 +11263,7 @@ print_parent_task_group_rt(void *t, int cpu)
 	else
 		return;
 
-	readmem(tgi->task_group + OFFSET(task_group_rt_rq),
-		KVADDR, &rt_rq_c, sizeof(ulong),
-		"task_group rt_rq", FAULT_ON_ERROR);
-	readmem(rt_rq_c + cpu * sizeof(ulong), KVADDR, &rt_rq_p,
-		sizeof(ulong), "task_group rt_rq", FAULT_ON_ERROR);
+	rt_rq_p = TGI_RQ(tgi->rt_rqs, cpu);
 
 	readmem(rt_rq_p + OFFSET(rt_rq_highest_prio), KVADDR, &prio,
 		sizeof(int), "rt_rq highest prio", FAULT_ON_ERROR);
@@ -9941,27 +11278,26 @@ static int
 dump_tasks_in_lower_dequeued_rt_rq(int depth, ulong rt_rq, int cpu)
 {
 	int i, prio, tot, delta, nr_running;
-	ulong rt_rq_c, rt_rq_p, group;
+	ulong rt_rq_p, group;
+	struct task_group_info *tgi, *child;
 
 	tot = 0;
-	for (i = 0; i < tgi_p; i++) {
-		delta = tgi_array[i]->depth - depth;
+
+	readmem(rt_rq + OFFSET(rt_rq_tg), KVADDR, &group,
+		sizeof(ulong), "rt_rq tg", FAULT_ON_ERROR);
+	if (!(tgi = task_group_to_info(group)))
+		return tot;
+
+	for (i = 0; i < tgi->nr_children; i++) {
+		child = tgi->children[i];
+		delta = child->depth - depth;
 		if (delta > 1)
 			break;
 
-		if (tgi_array[i]->use == 0 || delta < 1)
-			continue;
-
-		readmem(rt_rq + OFFSET(rt_rq_tg), KVADDR, &group,
-			sizeof(ulong), "rt_rq tg", FAULT_ON_ERROR);
-		if (group != tgi_array[i]->parent->task_group)
+		if (child->use == 0 || delta < 1)
 			continue;
 
-		readmem(tgi_array[i]->task_group + OFFSET(task_group_rt_rq),
-			KVADDR, &rt_rq_c, sizeof(ulong), "task_group rt_rq",
-			FAULT_ON_ERROR);
-		readmem(rt_rq_c + cpu * sizeof(ulong), KVADDR, &rt_rq_p,
-			sizeof(ulong), "task_group rt_rq", FAULT_ON_ERROR);
+		rt_rq_p = TGI_RQ(child->rt_rqs, cpu);
 		if (rt_rq == rt_rq_p)
 			continue;
 
@@ -9974,7 +11310,7 @@ dump_tasks_in_lower_dequeued_rt_rq(int depth, ulong rt_rq, int cpu)
 			continue;
 		}
 
-		print_parent_task_group_rt(tgi_array[i], cpu);
+		print_parent_task_group_rt(child, cpu);
 
 		readmem(rt_rq_p + OFFSET(rt_rq_highest_prio), KVADDR,
 			&prio, sizeof(int), "rt_rq highest_prio",
@@ -10076,6 +11412,7 @@ dump_tasks_in_task_group_rt_rq(int depth, ulong rt_rq, int cpu)
 	struct task_context *tc;
 	ulong my_q, task_addr, tg, k_prio_array;
 	char *rt_rq_buf, *u_prio_array;
+	struct task_group_info *tgi;
 
 	k_prio_array = rt_rq +  OFFSET(rt_rq_active);
 	rt_rq_buf = GETBUF(SIZE(rt_rq));
@@ -10086,12 +11423,9 @@ dump_tasks_in_task_group_rt_rq(int depth, ulong rt_rq, int cpu)
 		readmem(rt_rq + OFFSET(rt_rq_tg), KVADDR,
 			&tg, sizeof(ulong), "rt_rq tg",
 			FAULT_ON_ERROR);
-		for (i = 0; i < tgi_p; i++) {
-			if (tgi_array[i]->task_group == tg) {
-				print_group_header_rt(rt_rq, tgi_array[i]);
-				tgi_array[i]->use = 0;
-				break;
-			}
+		if ((tgi = task_group_to_info(tg))) {
+			print_group_header_rt(rt_rq, tgi);
+			tgi->use = 0;
 		}
 	}
 
@@ -10228,6 +11562,25 @@ get_task_group_name(ulong group)
 	return tmp;
 }
 
+/*
+ *  Read a task_group's per-cpu cfs_rq or rt_rq pointer array once, rather
+ *  than reading one pointer each time that a cpu's rq is needed.
+ */
+static ulong *
+task_group_rq_array(ulong addr, char *type)
+{
+	ulong *rqs;
+
+	if (!addr)
+		return NULL;
+
+	rqs = (ulong *)GETBUF(sizeof(ulong) * kt->cpus);
+	readmem(addr, KVADDR, rqs, sizeof(ulong) * kt->cpus, type,
+		FAULT_ON_ERROR);
+
+	return rqs;
+}
+
 static void
 fill_task_group_info_array(int depth, ulong group, char *group_buf, int i)
 {
@@ -10247,6 +11600,12 @@ fill_task_group_info_array(int depth, ulong group, char *group_buf, int i)
 	tgi_array[tgi_p]->depth = depth;
 	tgi_array[tgi_p]->name = get_task_group_name(group);
 	tgi_array[tgi_p]->task_group = group;
+	tgi_array[tgi_p]->cfs_rqs = VALID_MEMBER(task_group_cfs_rq) ?
+		task_group_rq_array(ULONG(group_buf + OFFSET(task_group_cfs_rq)),
+		"task_group cfs_rq") : NULL;
+	tgi_array[tgi_p]->rt_rqs = VALID_MEMBER(task_group_rt_rq) ?
+		task_group_rq_array(ULONG(group_buf + OFFSET(task_group_rt_rq)),
+		"task_group rt_rq") : NULL;
 	if (i >= 0)
 		tgi_array[tgi_p]->parent = tgi_array[i];
 	else
@@ -10281,16 +11640,57 @@ fill_task_group_info_array(int depth, ulong group, char *group_buf, int i)
 	}
 }
 
+static void
+dump_task_group_cpu(void *arg, int j)
+{
+	struct runq_jobs *rj = arg;
+	struct task_group_info *root = rj->root;
+	struct task_context *tc;
+	ulong cfs_rq_p, rt_rq_p;
+	int cpu;
+
+	cpu = rj->cpu[j];
+
+	rt_rq_p = TGI_RQ(root->rt_rqs, cpu);
+	cfs_rq_p = TGI_RQ(root->cfs_rqs, cpu);
+
+	fprintf(fp, "%sCPU %d", j ? "\n" : "", cpu);
+
+	if (hide_offline_cpu(cpu)) {
+		fprintf(fp, " [OFFLINE]\n");
+		return;
+	} else
+		fprintf(fp, "\n");
+
+	fprintf(fp, "  CURRENT: ");
+	if ((tc = task_to_context(tt->active_set[cpu])))
+		fprintf(fp, "PID: %-5ld  TASK: %lx  COMMAND: \"%s\"\n",
+			tc->pid, tc->task, tc->comm);
+	else
+		fprintf(fp, "%lx\n", tt->active_set[cpu]);
+
+	if (root->rt_rqs) {
+		fprintf(fp, "  %s_TASK_GROUP: %lx  RT_RQ: %lx\n",
+			rj->task_group_name, rj->root_task_group, rt_rq_p);
+		reuse_task_group_info_array();
+		dump_tasks_in_task_group_rt_rq(0, rt_rq_p, cpu);
+	}
+
+	if (root->cfs_rqs) {
+		fprintf(fp, "  %s_TASK_GROUP: %lx  CFS_RQ: %lx\n",
+			rj->task_group_name, rj->root_task_group, cfs_rq_p);
+		reuse_task_group_info_array();
+		dump_tasks_in_task_group_cfs_rq(0, cfs_rq_p, cpu, tc);
+	}
+}
+
 static void
 dump_tasks_by_task_group(void)
 {
-	int cpu, displayed;
-	ulong root_task_group, cfs_rq = 0, cfs_rq_p;
-	ulong rt_rq = 0, rt_rq_p;
+	ulong root_task_group;
 	char *buf;
-	struct task_context *tc;
 	char *task_group_name;
-	ulong *cpus;
+	struct runq_jobs runq_jobs, *rj;
 
 	cfs_rq_offset_init();
 	task_group_offset_init();
@@ -10312,63 +11712,33 @@ dump_tasks_by_task_group(void)
 	buf = GETBUF(SIZE(task_group));
 	readmem(root_task_group, KVADDR, buf, SIZE(task_group),
 		"task_group", FAULT_ON_ERROR);
-	if (VALID_MEMBER(task_group_rt_rq))
-		rt_rq = ULONG(buf + OFFSET(task_group_rt_rq));
-	if (VALID_MEMBER(task_group_cfs_rq))
-		cfs_rq = ULONG(buf + OFFSET(task_group_cfs_rq));
 
+	/*
+	 *  The hierarchy, including the per-cpu cfs_rq and rt_rq pointers
+	 *  of each task_group, is gathered once and shared by all cpus.
+	 */
 	fill_task_group_info_array(0, root_task_group, buf, -1);
+
+	rj = &runq_jobs;
+	runq_jobs_init(rj);
+	rj->root_task_group = root_task_group;
+	rj->task_group_name = task_group_name;
+	rj->root = tgi_array[0];
+
 	sort_task_group_info_array();
 	if (CRASHDEBUG(1))
 		print_task_group_info_array();
 
 	get_active_set();
 
-	cpus = pc->curcmd_flags & CPUMASK ? 
-		(ulong *)(ulong)pc->curcmd_private : NULL;
-
-	for (cpu = displayed = 0; cpu < kt->cpus; cpu++) {
-		if (cpus && !NUM_IN_BITMAP(cpus, cpu))
-			continue;
-
-		if (rt_rq)
-			readmem(rt_rq + cpu * sizeof(ulong), KVADDR,
-				&rt_rq_p, sizeof(ulong), "task_group rt_rq",
-				FAULT_ON_ERROR);
-		if (cfs_rq)
-			readmem(cfs_rq + cpu * sizeof(ulong), KVADDR,
-				&cfs_rq_p, sizeof(ulong), "task_group cfs_rq",
-				FAULT_ON_ERROR);
-		fprintf(fp, "%sCPU %d", displayed++ ? "\n" : "", cpu);
-
-		if (hide_offline_cpu(cpu)) {
-			fprintf(fp, " [OFFLINE]\n");
-			continue;
-		} else
-			fprintf(fp, "\n");
-
-		fprintf(fp, "  CURRENT: ");
-		if ((tc = task_to_context(tt->active_set[cpu])))
-			fprintf(fp, "PID: %-5ld  TASK: %lx  COMMAND: \"%s\"\n",
-				tc->pid, tc->task, tc->comm);
-		else
-			fprintf(fp, "%lx\n", tt->active_set[cpu]);
-
-		if (rt_rq) {
-			fprintf(fp, "  %s_TASK_GROUP: %lx  RT_RQ: %lx\n",
-				task_group_name, root_task_group, rt_rq_p);
-			reuse_task_group_info_array();
-			dump_tasks_in_task_group_rt_rq(0, rt_rq_p, cpu);
-		}
-
-		if (cfs_rq) {
-			fprintf(fp, "  %s_TASK_GROUP: %lx  CFS_RQ: %lx\n",
-				task_group_name, root_task_group, cfs_rq_p);
-			reuse_task_group_info_array();
-			dump_tasks_in_task_group_cfs_rq(0, cfs_rq_p, cpu, tc);
-		}
+	if (!runq_for_each_cpu(rj, dump_task_group_cpu)) {
+		tgi_p = 0;
+		tgi_hash = NULL;
+		tgi_hash_size = 0;
+		return;
 	}
 
+	FREEBUF(rj->cpu);
 	FREEBUF(buf);
 	free_task_group_info_array();
 }
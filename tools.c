@@ -17,6 +17,7 @@
 
 #include "defs.h"
 #include <ctype.h>
+#include <pthread.h>
 
 #ifdef VALGRIND
 #include <valgrind/valgrind.h>
@@ -24,11 +25,13 @@
 #endif
 
 static void print_number(struct number_option *, int, int);
-static long alloc_hq_entry(void);
-struct hq_entry;
-static void dealloc_hq_entry(struct hq_entry *);
+struct hash_table;
+static int alloc_hq_entry(struct hash_table *);
+static int hq_rehash(struct hash_table *);
 static void show_options(void);
+static char *live_cache_string(char *);
 static void dump_struct_members(struct list_data *, int, ulong);
+static int do_list_walk(struct list_data *);
 static void rbtree_iteration(ulong, struct tree_data *, char *);
 static void dump_struct_members_for_tree(struct tree_data *, int, ulong);
 
@@ -37,10 +40,24 @@ struct req_entry {
 	int *is_str, *is_ptr;
 	ulong *width, *offset;
 	int count;
+	char *span;		/* buffer for the members printed directly */
+	ulong span_offset;
+	ulong span_size;
 };
 
-static void print_value(struct req_entry *, unsigned int, ulong, unsigned int);
+/*
+ *  Largest range of a structure that dump_struct_members_fast() reads
+ *  with a single readmem() call.
+ */
+#define REQ_ENTRY_MAX_SPAN	(16384)
+
+#define REQ_ENTRY_DIRECT(e, i) \
+	((e)->width[i] > 0 && ((e)->width[i] <= 8 || (e)->is_str[i]))
+
+static void print_value(struct req_entry *, unsigned int, ulong, unsigned int,
+	char *);
 static struct req_entry *fill_member_offsets(char *);
+static void dump_struct_members_span(struct req_entry *, int, ulong, char *);
 static void dump_struct_members_fast(struct req_entry *, int, ulong);
 
 FILE *
@@ -684,6 +701,65 @@ stoll(char *s, int flags, int *errptr)
         return UNUSED;
 }
 
+/*
+ *  Convert a decimal size string with an optional K, M, G or T suffix
+ *  into a number of bytes.
+ */
+ulonglong
+sizetoll(char *s, int flags, int *errptr)
+{
+	char buf[BUFSIZE];
+	char *p1;
+	int shift;
+
+	if (strlen(s) >= BUFSIZE)
+		goto sizetoll_error;
+
+	strcpy(buf, s);
+	p1 = &buf[strlen(buf)-1];
+	shift = 0;
+
+	switch (*p1)
+	{
+	case 'T':
+	case 't':
+		shift += 10;
+	case 'G':
+	case 'g':
+		shift += 10;
+	case 'M':
+	case 'm':
+		shift += 10;
+	case 'K':
+	case 'k':
+		shift += 10;
+		*p1 = NULLCHAR;
+		break;
+	}
+
+	if (!strlen(buf) || !decimal(buf, 0))
+		goto sizetoll_error;
+
+	return dtoll(buf, flags, errptr) << shift;
+
+sizetoll_error:
+	if (!(flags & QUIET))
+		error(INFO, "not a valid size: %s\n", s);
+
+	switch (flags & (FAULT_ON_ERROR|RETURN_ON_ERROR))
+	{
+	case FAULT_ON_ERROR:
+		RESTART();
+
+	case RETURN_ON_ERROR:
+		if (errptr)
+			*errptr = TRUE;
+		break;
+	}
+
+	return UNUSED;
+}
+
 /*
  *  Append a two-character string to a number to make 1, 2, 3 and 4 into 
  *  1st, 2nd, 3rd, 4th, and so on...
@@ -1844,6 +1920,12 @@ cmd_set(void)
 	runtime = pc->flags & RUNTIME ? TRUE : FALSE;
 	from_rc_file = pc->curcmd_flags & FROM_RCFILE ? TRUE : FALSE;
 
+	/*
+	 *  Any change of context or settings starts the live page cache over.
+	 */
+	if (runtime && ACTIVE() && (page_cache_live() != LIVE_CACHE_OFF))
+		page_cache_flush();
+
         while ((c = getopt(argcnt, args, "pvc:a:")) != EOF) {
                 switch(c)
 		{
@@ -1872,6 +1954,7 @@ cmd_set(void)
 
 			if (ACTIVE()) {
 				set_context(tt->this_task, NO_PID);
+				vtop_cache_flush();
 				show_context(CURRENT_CONTEXT());
 				return;
 			}
@@ -1881,6 +1964,7 @@ cmd_set(void)
 				return;
 			}
         		set_context(tt->panic_task, NO_PID);
+			vtop_cache_flush();
 			show_context(CURRENT_CONTEXT());
 			return;
 
@@ -2534,6 +2618,301 @@ cmd_set(void)
 			}
 			return;
 
+		} else if (STREQ(args[optind], "mmap")) {
+			if (args[optind+1]) {
+				optind++;
+				if (STREQ(args[optind], "on"))
+					pc->flags2 |= MMAP_DUMPFILE;
+				else if (STREQ(args[optind], "off"))
+					pc->flags2 &= ~MMAP_DUMPFILE;
+				else if (IS_A_NUMBER(args[optind])) {
+					value = stol(args[optind],
+						FAULT_ON_ERROR, NULL);
+					if (value)
+						pc->flags2 |= MMAP_DUMPFILE;
+					else
+						pc->flags2 &= ~MMAP_DUMPFILE;
+				} else
+					goto invalid_set_command;
+			}
+
+			if (runtime)
+				fprintf(fp, "mmap: %s\n",
+					pc->flags2 & MMAP_DUMPFILE ? "on" : "off");
+			return;
+
+		} else if (STREQ(args[optind], "trace")) {
+			if (args[optind+1]) {
+				optind++;
+				if (STREQ(args[optind], "off"))
+					trace_close();
+				else if (!trace_open(args[optind]))
+					return;
+			}
+
+			if (runtime)
+				fprintf(fp, "trace: %s\n", trace_path() ?
+					trace_path() : "off");
+			return;
+
+		} else if (STREQ(args[optind], "trace_min")) {
+			if (args[optind+1]) {
+				optind++;
+				value = stol(args[optind], FAULT_ON_ERROR, NULL);
+				trace_set_min_usecs(value);
+			}
+
+			if (runtime)
+				fprintf(fp, "trace_min: %ld\n", trace_min_usecs());
+			return;
+
+		} else if (STREQ(args[optind], "output")) {
+			if (args[optind+1]) {
+				optind++;
+				if (!set_output_format(args[optind]))
+					goto invalid_set_command;
+			}
+
+			if (runtime)
+				fprintf(fp, "output: %s\n", output_format_name());
+			return;
+
+		} else if (STREQ(args[optind], "pipe_filter")) {
+			if (args[optind+1]) {
+				optind++;
+				if (STREQ(args[optind], "on"))
+					pc->flags2 |= PIPE_FILTER;
+				else if (STREQ(args[optind], "off"))
+					pc->flags2 &= ~PIPE_FILTER;
+				else if (IS_A_NUMBER(args[optind])) {
+					value = stol(args[optind],
+						FAULT_ON_ERROR, NULL);
+					if (value)
+						pc->flags2 |= PIPE_FILTER;
+					else
+						pc->flags2 &= ~PIPE_FILTER;
+				} else
+					goto invalid_set_command;
+			}
+
+			if (runtime)
+				fprintf(fp, "pipe_filter: %s\n",
+					pc->flags2 & PIPE_FILTER ? "on" : "off");
+			return;
+
+		} else if (STREQ(args[optind], "profile")) {
+			if (args[optind+1]) {
+				optind++;
+				if (STREQ(args[optind], "on"))
+					pc->flags2 |= READMEM_PROFILE;
+				else if (STREQ(args[optind], "off"))
+					pc->flags2 &= ~READMEM_PROFILE;
+				else if (IS_A_NUMBER(args[optind])) {
+					value = stol(args[optind],
+						FAULT_ON_ERROR, NULL);
+					if (value)
+						pc->flags2 |= READMEM_PROFILE;
+					else
+						pc->flags2 &= ~READMEM_PROFILE;
+				} else
+					goto invalid_set_command;
+			}
+
+			if (runtime)
+				fprintf(fp, "profile: %s\n",
+					pc->flags2 & READMEM_PROFILE ? "on" : "off");
+			return;
+
+		} else if (STREQ(args[optind], "vtop_cache")) {
+			if (args[optind+1]) {
+				optind++;
+				if (STREQ(args[optind], "on"))
+					vtop_cache_set(TRUE);
+				else if (STREQ(args[optind], "off"))
+					vtop_cache_set(FALSE);
+				else if (IS_A_NUMBER(args[optind])) {
+					value = stol(args[optind],
+						FAULT_ON_ERROR, NULL);
+					vtop_cache_set(value ? TRUE : FALSE);
+				} else
+					goto invalid_set_command;
+			}
+
+			if (runtime)
+				fprintf(fp, "vtop_cache: %s\n",
+					vtop_cache_enabled() ? "on" : "off");
+			return;
+
+		} else if (STREQ(args[optind], "datatype_cache")) {
+			if (args[optind+1]) {
+				optind++;
+				if (from_rc_file)
+					already_done();
+				else if (STREQ(args[optind], "on"))
+					pc->flags2 |= DATATYPE_CACHE;
+				else if (STREQ(args[optind], "off"))
+					pc->flags2 &= ~DATATYPE_CACHE;
+				else if (IS_A_NUMBER(args[optind])) {
+					value = stol(args[optind],
+						FAULT_ON_ERROR, NULL);
+					if (value)
+						pc->flags2 |= DATATYPE_CACHE;
+					else
+						pc->flags2 &= ~DATATYPE_CACHE;
+				} else
+					goto invalid_set_command;
+			}
+
+			if (runtime)
+				fprintf(fp, "datatype_cache: %s\n",
+					pc->flags2 & DATATYPE_CACHE ? "on" : "off");
+			return;
+
+		} else if (STREQ(args[optind], "btf")) {
+			if (args[optind+1]) {
+				optind++;
+				if (STREQ(args[optind], "on"))
+					pc->flags2 |= BTF_TYPES;
+				else if (STREQ(args[optind], "off"))
+					pc->flags2 &= ~BTF_TYPES;
+				else if (IS_A_NUMBER(args[optind])) {
+					value = stol(args[optind],
+						FAULT_ON_ERROR, NULL);
+					if (value)
+						pc->flags2 |= BTF_TYPES;
+					else
+						pc->flags2 &= ~BTF_TYPES;
+				} else
+					goto invalid_set_command;
+			}
+
+			if (runtime)
+				fprintf(fp, "btf: %s\n",
+					pc->flags2 & BTF_TYPES ? "on" : "off");
+			return;
+
+		} else if (STREQ(args[optind], "page_cache")) {
+			if (args[optind+1]) {
+				optind++;
+				if (from_rc_file)
+					already_done();
+				else if (STREQ(args[optind], "off"))
+					page_cache_set_size(0);
+				else {
+					int err = FALSE;
+					ulonglong bytes;
+
+					bytes = sizetoll(args[optind],
+						RETURN_ON_ERROR|QUIET, &err);
+					if (err)
+						goto invalid_set_command;
+					page_cache_set_size(bytes);
+				}
+			}
+
+			if (runtime)
+				fprintf(fp, "page_cache: %lld\n",
+					page_cache_size());
+			return;
+
+		} else if (STREQ(args[optind], "live_cache")) {
+			if (args[optind+1]) {
+				optind++;
+				if (STREQ(args[optind], "off"))
+					page_cache_set_live(LIVE_CACHE_OFF);
+				else if (STREQ(args[optind], "command"))
+					page_cache_set_live(LIVE_CACHE_COMMAND);
+				else if (decimal(args[optind], 0) &&
+				    ((value = stol(args[optind], FAULT_ON_ERROR,
+				    NULL)) > 0) && (value == (int)value))
+					page_cache_set_live((int)value);
+				else
+					goto invalid_set_command;
+			}
+
+			if (runtime)
+				fprintf(fp, "live_cache: %s\n",
+					live_cache_string(buf));
+			return;
+
+		} else if (STREQ(args[optind], "memlimit")) {
+			if (args[optind+1]) {
+				optind++;
+				if (STREQ(args[optind], "off"))
+					memory_limit_set(0);
+				else {
+					int err = FALSE;
+					ulonglong bytes;
+
+					bytes = sizetoll(args[optind],
+						RETURN_ON_ERROR|QUIET, &err);
+					if (err)
+						goto invalid_set_command;
+					memory_limit_set(bytes);
+				}
+			}
+
+			if (runtime)
+				fprintf(fp, "memlimit: %lld\n",
+					memory_limit_size());
+			return;
+
+		} else if (STREQ(args[optind], "mem_map_cache")) {
+			if (args[optind+1]) {
+				optind++;
+				if (!IS_A_NUMBER(args[optind]) ||
+				    !(value = stol(args[optind],
+				    RETURN_ON_ERROR|QUIET, NULL)))
+					goto invalid_set_command;
+				mem_map_cache_set_size(value);
+			}
+
+			if (runtime)
+				fprintf(fp, "mem_map_cache: %ld\n",
+					mem_map_cache_size());
+			return;
+
+		} else if (STREQ(args[optind], "diskdump_cache")) {
+			if (args[optind+1]) {
+				optind++;
+				if (from_rc_file)
+					already_done();
+				else {
+					int err = FALSE;
+					ulonglong bytes;
+
+					bytes = sizetoll(args[optind],
+						RETURN_ON_ERROR|QUIET, &err);
+					if (err)
+						goto invalid_set_command;
+					diskdump_set_cache_size(bytes);
+				}
+			}
+
+			if (runtime)
+				fprintf(fp, "diskdump_cache: %lld\n",
+					diskdump_cache_size());
+			return;
+
+		} else if (STREQ(args[optind], "diskdump_readahead")) {
+			if (args[optind+1]) {
+				optind++;
+				if (from_rc_file)
+					already_done();
+				else if (decimal(args[optind], 0))
+					diskdump_set_readahead(dtol(args[optind],
+						FAULT_ON_ERROR, NULL));
+				else if (STREQ(args[optind], "off"))
+					diskdump_set_readahead(0);
+				else
+					goto invalid_set_command;
+			}
+
+			if (runtime)
+				fprintf(fp, "diskdump_readahead: %ld\n",
+					diskdump_readahead());
+			return;
+
                 } else if (STREQ(args[optind], "error")) {
                         if (args[optind+1]) {
                                 optind++;
@@ -2559,15 +2938,19 @@ cmd_set(void)
 	                case STR_PID:
                                 pid = value;
                                 task = NO_TASK;
-                        	if (set_context(task, pid))
+                        	if (set_context(task, pid)) {
+					vtop_cache_flush();
                                 	show_context(CURRENT_CONTEXT());
+				}
 	                        break;
 	
 	                case STR_TASK:
                                 task = value;
                                 pid = NO_PID;
-                                if (set_context(task, pid))
+                                if (set_context(task, pid)) {
+					vtop_cache_flush();
                                         show_context(CURRENT_CONTEXT()); 
+				}
 	                        break;
 	
 	                case STR_INVALID:
@@ -2604,6 +2987,21 @@ invalid_set_command:
 /*
  *  Display the set of settable internal variables.
  */
+static char *
+live_cache_string(char *buf)
+{
+	int window;
+
+	if ((window = page_cache_live()) == LIVE_CACHE_OFF)
+		sprintf(buf, "off");
+	else if (window == LIVE_CACHE_COMMAND)
+		sprintf(buf, "command");
+	else
+		sprintf(buf, "%d seconds", window);
+
+	return buf;
+}
+
 static void
 show_options(void)
 {
@@ -2654,6 +3052,21 @@ show_options(void)
 		fprintf(fp, "(not set)\n");
 	fprintf(fp, "       offline: %s\n", pc->flags2 & OFFLINE_HIDE ? "hide" : "show");
 	fprintf(fp, "       redzone: %s\n", pc->flags2 & REDZONE ? "on" : "off");
+	fprintf(fp, "          mmap: %s\n", pc->flags2 & MMAP_DUMPFILE ? "on" : "off");
+	fprintf(fp, "       profile: %s\n", pc->flags2 & READMEM_PROFILE ? "on" : "off");
+	fprintf(fp, "        output: %s\n", output_format_name());
+	fprintf(fp, "   pipe_filter: %s\n", pc->flags2 & PIPE_FILTER ? "on" : "off");
+	fprintf(fp, "         trace: %s\n", trace_path() ? trace_path() : "off");
+	fprintf(fp, "     trace_min: %ld\n", trace_min_usecs());
+	fprintf(fp, "    vtop_cache: %s\n", vtop_cache_enabled() ? "on" : "off");
+	fprintf(fp, "datatype_cache: %s\n", pc->flags2 & DATATYPE_CACHE ? "on" : "off");
+	fprintf(fp, "           btf: %s\n", pc->flags2 & BTF_TYPES ? "on" : "off");
+	fprintf(fp, "    page_cache: %lld\n", page_cache_size());
+	fprintf(fp, "    live_cache: %s\n", live_cache_string(buf));
+	fprintf(fp, " mem_map_cache: %ld\n", mem_map_cache_size());
+	fprintf(fp, "diskdump_cache: %lld\n", diskdump_cache_size());
+	fprintf(fp, "diskdump_readahead: %ld\n", diskdump_readahead());
+	fprintf(fp, "      memlimit: %lld\n", memory_limit_size());
 	fprintf(fp, "         error: %s\n", pc->error_path);
 }
 
@@ -3632,33 +4045,59 @@ next_arg:
 	ld->flags &= ~(LIST_OFFSET_ENTERED|LIST_START_ENTERED);
 	ld->flags |= VERBOSE;
 
-	if (ld->flags & LIST_BRENT_ALGO)
-		c = do_list_no_hash(ld);
-	else {
-		hq_open();
-		c = do_list(ld);
-		hq_close();
-	}
+	/*
+	 *  The list entries are only displayed, so there is no need to
+	 *  keep them in the hash table: stream the list, and detect loops
+	 *  with Brent's algorithm, so that memory use does not grow with
+	 *  the length of the list.
+	 */
+	ld->flags |= LIST_BRENT_ALGO;
+	c = do_list_no_hash(ld);
 
         if (ld->structname_args)
 		FREEBUF(ld->structname);
 }
 
+/*
+ *  Display the members of a structure that were resolved by
+ *  fill_member_offsets().  The members that can be formatted directly
+ *  are all read with one readmem() of the range of the structure that
+ *  contains them, falling back to reading them one at a time if that
+ *  range cannot be read in its entirety.  Any other members are handed
+ *  to gdb.
+ */
 void
 dump_struct_members_fast(struct req_entry *e, int radix, ulong p)
 {
-	unsigned int i;
-	char b[BUFSIZE];
+	char *span;
 
 	if (!(e && IS_KVADDR(p)))
 		return;
 
+	span = NULL;
+	if (e->span && readmem(p + e->span_offset, KVADDR, e->span,
+	    e->span_size, "structure members", RETURN_ON_ERROR|QUIET))
+		span = e->span;
+
+	dump_struct_members_span(e, radix, p, span);
+}
+
+/*
+ *  Display the members of the structure at p, taking those that are
+ *  formatted directly from span if it is non-NULL.
+ */
+static void
+dump_struct_members_span(struct req_entry *e, int radix, ulong p, char *span)
+{
+	unsigned int i;
+	char b[BUFSIZE];
+
 	if (!radix)
 		radix = *gdb_output_radix;
 
 	for (i = 0; i < e->count; i++) {
-		if (0 < e->width[i] && (e->width[i] <= 8 || e->is_str[i])) {
-			print_value(e, i, p, e->is_ptr[i] ? 16 : radix);
+		if (REQ_ENTRY_DIRECT(e, i)) {
+			print_value(e, i, p, e->is_ptr[i] ? 16 : radix, span);
 		} else if (e->width[i] == 0 || e->width[i] > 8) {
 			snprintf(b, BUFSIZE, "%s.%s", e->name, e->member[i]);
 			dump_struct_member(b, p, radix);
@@ -3670,6 +4109,7 @@ static struct req_entry *
 fill_member_offsets(char *arg)
 {
 	int j;
+	ulong start, end;
 	char *p, m;
 	struct req_entry *e;
 	char buf[BUFSIZE];
@@ -3719,25 +4159,59 @@ fill_member_offsets(char *arg)
 		e->width[j] = ANON_MEMBER_OFFSET(e->name, buf) - e->offset[j];
 	}
 
+	/*
+	 *  Determine the range of the structure covering all members
+	 *  that print_value() formats directly.
+	 */
+	for (j = 0, start = end = 0; j < e->count; j++) {
+		if (!REQ_ENTRY_DIRECT(e, j))
+			continue;
+		if (!end || (e->offset[j] < start))
+			start = e->offset[j];
+		if (e->offset[j] + e->width[j] > end)
+			end = e->offset[j] + e->width[j];
+	}
+
+	if (end && ((end - start) <= REQ_ENTRY_MAX_SPAN)) {
+		e->span_offset = start;
+		e->span_size = end - start;
+		e->span = GETBUF(e->span_size);
+	}
+
 	return e;
 }
 
+/*
+ *  Display a member of the structure at addr.  If span is non-NULL, it
+ *  contains the structure's e->span_size bytes at e->span_offset, from
+ *  which the member is taken instead of being read.
+ */
 static void
-print_value(struct req_entry *e, unsigned int i, ulong addr, unsigned int radix)
+print_value(struct req_entry *e, unsigned int i, ulong addr, unsigned int radix,
+	char *span)
 {
 	union { uint64_t v64; uint32_t v32;
 		uint16_t v16; uint8_t v8;
 	} v;
 	char buf[BUFSIZE];
 	struct syment *sym;
+	char *member;
+	ulong len;
 
 	addr += e->offset[i];
+	member = span ? span + (e->offset[i] - e->span_offset) : NULL;
+	v.v64 = 0;
 
 	/* Read up to 8 bytes, counters, pointers, etc. */
-	if (e->width[i] <= 8 && !readmem(addr, KVADDR, &v, e->width[i],
-	    "structure value", RETURN_ON_ERROR | QUIET)) {
-		error(INFO, "cannot access member: %s at %lx\n", e->member[i], addr);
-		return;
+	if (e->width[i] <= 8) {
+		if (member)
+			memcpy(&v, member, e->width[i]);
+		else if (!readmem(addr, KVADDR, &v, e->width[i],
+		    "structure value", RETURN_ON_ERROR | QUIET)) {
+			error(INFO, "cannot access member: %s at %lx\n",
+				e->member[i], addr);
+			return;
+		}
 	}
 	snprintf(buf, BUFSIZE, "  %%s = %s%%%s%s",
 		 (radix == 16 ? "0x" : ""),
@@ -3757,6 +4231,11 @@ print_value(struct req_entry *e, unsigned int i, ulong addr, unsigned int radix)
 		if (e->is_ptr[i]) {
 			read_string(v.v64, buf, BUFSIZE);
 			fprintf(fp, "  \"%s\"", buf);
+		} else if (member) {
+			len = MIN(e->width[i], BUFSIZE-1);
+			memcpy(buf, member, len);
+			buf[len] = NULLCHAR;
+			fprintf(fp, "  %s = \"%s\"", e->member[i], buf);
 		} else {
 			read_string(addr, buf, e->width[i]);
 			fprintf(fp, "  %s = \"%s\"", e->member[i], buf);
@@ -3774,11 +4253,27 @@ print_value(struct req_entry *e, unsigned int i, ulong addr, unsigned int radix)
 int
 do_list(struct list_data *ld)
 {
-	ulong next, last, first, offset;
-	ulong searchfor, readflag;
-	int i, count, others, close_hq_on_return;
-	unsigned int radix;
-	struct req_entry **e = NULL;
+	int count;
+	ulonglong tstart;
+
+	if (!TRACING())
+		return do_list_walk(ld);
+
+	tstart = trace_time();
+	count = do_list_walk(ld);
+	trace_span("walker", "do_list", NULL, tstart);
+
+	return count;
+}
+
+static int
+do_list_walk(struct list_data *ld)
+{
+	ulong next, last, first, offset;
+	ulong searchfor, readflag;
+	int i, count, others, close_hq_on_return;
+	unsigned int radix;
+	struct req_entry **e = NULL;
 
 	if (CRASHDEBUG(1)) {
 		others = 0;
@@ -4307,6 +4802,8 @@ dump_struct_members(struct list_data *ld, int idx, ulong next)
 #define RADIXTREE_REQUEST (0x1)
 #define RBTREE_REQUEST    (0x2)
 #define XARRAY_REQUEST    (0x4)
+#define MAPLE_REQUEST     (0x8)
+#define NON_RBTREE_REQUEST (RADIXTREE_REQUEST|XARRAY_REQUEST|MAPLE_REQUEST)
 
 void
 cmd_tree()
@@ -4328,7 +4825,7 @@ cmd_tree()
 		switch (c)
 		{
 		case 't':
-			if (type_flag & (RADIXTREE_REQUEST|RBTREE_REQUEST|XARRAY_REQUEST)) {
+			if (type_flag & (NON_RBTREE_REQUEST|RBTREE_REQUEST)) {
 				error(INFO, "multiple tree types may not be entered\n");
 				cmd_usage(pc->curcmd, SYNOPSIS);
 			}
@@ -4342,6 +4839,8 @@ cmd_tree()
 				type_flag = RBTREE_REQUEST;
 			else if (STRNEQ(optarg, "x"))
 				type_flag = XARRAY_REQUEST;
+			else if (STRNEQ(optarg, "m"))
+				type_flag = MAPLE_REQUEST;
 			else {
 				error(INFO, "invalid tree type: %s\n", optarg);
 				cmd_usage(pc->curcmd, SYNOPSIS);
@@ -4426,13 +4925,15 @@ cmd_tree()
 	if (argerrs)
 		cmd_usage(pc->curcmd, SYNOPSIS);
 
-	if ((type_flag & (XARRAY_REQUEST|RADIXTREE_REQUEST)) && (td->flags & TREE_LINEAR_ORDER))
+	if ((type_flag & NON_RBTREE_REQUEST) && (td->flags & TREE_LINEAR_ORDER))
 		error(FATAL, "-l option is not applicable to %s\n", 
-			type_flag & RADIXTREE_REQUEST ? "radix trees" : "Xarrays");
+			type_flag & RADIXTREE_REQUEST ? "radix trees" :
+			type_flag & MAPLE_REQUEST ? "maple trees" : "Xarrays");
 
-	if ((type_flag & (XARRAY_REQUEST|RADIXTREE_REQUEST)) && (td->flags & TREE_NODE_OFFSET_ENTERED))
+	if ((type_flag & NON_RBTREE_REQUEST) && (td->flags & TREE_NODE_OFFSET_ENTERED))
 		error(FATAL, "-o option is not applicable to %s\n",
-			type_flag & RADIXTREE_REQUEST ? "radix trees" : "Xarrays");
+			type_flag & RADIXTREE_REQUEST ? "radix trees" :
+			type_flag & MAPLE_REQUEST ? "maple trees" : "Xarrays");
 
 	if ((td->flags & TREE_ROOT_OFFSET_ENTERED) && 
 	    (td->flags & TREE_NODE_POINTER))
@@ -4512,6 +5013,8 @@ next_arg:
 				fprintf(fp, "radix\n");
 			else if (type_flag & XARRAY_REQUEST)
 				fprintf(fp, "xarray\n");
+			else if (type_flag & MAPLE_REQUEST)
+				fprintf(fp, "maple\n");
 			else
 				fprintf(fp, "red-black%s", 
 					type_flag & RBTREE_REQUEST ? 
@@ -4532,6 +5035,8 @@ next_arg:
 		do_rdtree(td);
 	else if (type_flag & XARRAY_REQUEST)
 		do_xatree(td);
+	else if (type_flag & MAPLE_REQUEST)
+		do_mptree(td);
 	else
 		do_rbtree(td);
 	hq_close();
@@ -4547,38 +5052,77 @@ static ulong RADIX_TREE_MAP_MASK = UNINITIALIZED;
 #define RADIX_TREE_ENTRY_MASK		3UL
 #define RADIX_TREE_INTERNAL_NODE	1UL
 
+/*
+ *  Read a radix_tree_node or xa_node with one readmem() into a local
+ *  buffer, returning a pointer to its slots[] array in the buffer.  The
+ *  whole structure is read if its size is known, and otherwise all of
+ *  it up through the end of the slots[] array.
+ */
+static ulong *
+read_tree_node_slots(ulong node, long size, long slots_offset, ulong nslots,
+		     char *type, char **bufp)
+{
+	long len;
+	char *node_buf;
+
+	len = slots_offset + (sizeof(void *) * nslots);
+	if (size > len)
+		len = size;
+
+	node_buf = GETBUF(len);
+	readmem(node, KVADDR, node_buf, len, type, FAULT_ON_ERROR);
+
+	*bufp = node_buf;
+	return (ulong *)(node_buf + slots_offset);
+}
+
+/*
+ *  Each node is read with a single readmem(), and only the slots whose
+ *  index ranges overlap ops->first through ops->last are visited.
+ */
 static void do_radix_tree_iter(ulong node, uint height, char *path,
 			       ulong index, struct radix_tree_ops *ops)
 {
 	uint off;
+	ulong slot, shift, first, last;
+	ulong *slots;
+	char *node_buf;
+	char child_path[BUFSIZE];
 
 	if (!hq_enter(node))
 		error(FATAL,
 			"\nduplicate tree node: %lx\n", node);
 
+	slots = read_tree_node_slots(node, SIZE(radix_tree_node),
+		OFFSET(radix_tree_node_slots), RADIX_TREE_MAP_SIZE,
+		"radix_tree_node", &node_buf);
+
+	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
+
 	for (off = 0; off < RADIX_TREE_MAP_SIZE; off++) {
-		ulong slot;
-		ulong shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
+		first = index | ((ulong)off << shift);
+		last = first + ((1UL << shift) - 1);
+		if (last < ops->first)
+			continue;
+		if (first > ops->last)
+			break;
 
-		readmem(node + OFFSET(radix_tree_node_slots) +
-			sizeof(void *) * off, KVADDR, &slot, sizeof(void *),
-			"radix_tree_node.slot[off]", FAULT_ON_ERROR);
-		if (!slot)
+		if (!(slot = slots[off]))
 			continue;
 
 		if (slot & RADIX_TREE_INTERNAL_NODE)
 			slot &= ~RADIX_TREE_INTERNAL_NODE;
 
 		if (height == 1)
-			ops->entry(node, slot, path, index | off, ops->private);
+			ops->entry(node, slot, path, first, ops->private);
 		else {
-			ulong child_index = index | (off << shift);
-			char child_path[BUFSIZE];
 			sprintf(child_path, "%s/%d", path, off);
 			do_radix_tree_iter(slot, height - 1,
-					   child_path, child_index, ops);
+					   child_path, first, ops);
 		}
 	}
+
+	FREEBUF(node_buf);
 }
 
 int do_radix_tree_traverse(ulong ptr, int is_root, struct radix_tree_ops *ops)
@@ -4703,34 +5247,44 @@ do_xarray_iter(ulong node, uint height, char *path,
 	       ulong index, struct xarray_ops *ops)
 {
 	uint off;
+	ulong slot, shift, first, last;
+	ulong *slots;
+	char *node_buf;
+	char child_path[BUFSIZE];
 
 	if (!hq_enter(node))
 		error(FATAL,
 			"\nduplicate tree node: %lx\n", node);
 
+	slots = read_tree_node_slots(node, SIZE(xa_node),
+		OFFSET(xa_node_slots), XA_CHUNK_SIZE, "xa_node", &node_buf);
+
+	shift = (height - 1) * XA_CHUNK_SHIFT;
+
 	for (off = 0; off < XA_CHUNK_SIZE; off++) {
-		ulong slot;
-		ulong shift = (height - 1) * XA_CHUNK_SHIFT;
+		first = index | ((ulong)off << shift);
+		last = first + ((1UL << shift) - 1);
+		if (last < ops->first)
+			continue;
+		if (first > ops->last)
+			break;
 
-		readmem(node + OFFSET(xa_node_slots) +
-			sizeof(void *) * off, KVADDR, &slot, sizeof(void *),
-			"xa_node.slots[off]", FAULT_ON_ERROR);
-		if (!slot)
+		if (!(slot = slots[off]))
 			continue;
 
 		if ((slot & XARRAY_TAG_MASK) == XARRAY_TAG_INTERNAL)
 			slot &= ~XARRAY_TAG_INTERNAL;
 
 		if (height == 1)
-			ops->entry(node, slot, path, index | off, ops->private);
+			ops->entry(node, slot, path, first, ops->private);
 		else {
-			ulong child_index = index | (off << shift);
-			char child_path[BUFSIZE];
 			sprintf(child_path, "%s/%d", path, off);
 			do_xarray_iter(slot, height - 1,
-					   child_path, child_index, ops);
+					   child_path, first, ops);
 		}
 	}
+
+	FREEBUF(node_buf);
 }
 
 int 
@@ -4741,6 +5295,9 @@ do_xarray_traverse(ulong ptr, int is_root, struct xarray_ops *ops)
 	uint height, is_internal;
 	unsigned char shift;
 	char path[BUFSIZE];
+	ulonglong tstart;
+
+	tstart = TRACING() ? trace_time() : 0;
 
 	if (!VALID_STRUCT(xarray) || !VALID_STRUCT(xa_node) ||
 	      !VALID_MEMBER(xarray_xa_head) ||
@@ -4805,6 +5362,9 @@ do_xarray_traverse(ulong ptr, int is_root, struct xarray_ops *ops)
 		do_xarray_iter(node_p, height, path, 0, ops);
 	}
 
+	if (is_root)
+		trace_span("walker", "do_xarray_traverse", NULL, tstart);
+
 	return 0;
 }
 
@@ -4865,6 +5425,8 @@ int do_rdtree(struct tree_data *td)
 	struct radix_tree_ops ops = {
 		.entry		= do_rdtree_entry,
 		.private	= td,
+		.first		= 0,
+		.last		= ~0UL,
 	};
 	int is_root = !(td->flags & TREE_NODE_POINTER);
 
@@ -4938,6 +5500,8 @@ int do_xatree(struct tree_data *td)
 	struct xarray_ops ops = {
 		.entry		= do_xarray_entry,
 		.private	= td,
+		.first		= 0,
+		.last		= ~0UL,
 	};
 	int is_root = !(td->flags & TREE_NODE_POINTER);
 
@@ -4953,11 +5517,273 @@ int do_xatree(struct tree_data *td)
 	return 0;
 }
 
+/*
+ *  Maple trees.  Each maple_node is read with a single readmem() and
+ *  its pivots and slots are decoded from the local copy.  A node's slot
+ *  i covers the index range from the preceding pivot + 1 (or the node's
+ *  minimum) through pivot[i] (or the node's maximum), so only the
+ *  subtrees whose ranges overlap ops->first through ops->last are read.
+ */
+#define MAPLE_NODE_MASK		(255UL)
+#define MAPLE_NODE_TYPE_SHIFT	(3)
+#define MAPLE_NODE_TYPE_MASK	(0xf)
+#define MAPLE_HEIGHT_MAX	(31)
+
+enum maple_type {
+	maple_dense,
+	maple_leaf_64,
+	maple_range_64,
+	maple_arange_64,
+};
+
+static ulong MAPLE_NODE_SLOTS = UNINITIALIZED;
+static ulong MAPLE_RANGE64_SLOTS = UNINITIALIZED;
+static ulong MAPLE_ARANGE64_SLOTS = UNINITIALIZED;
+
+#define maple_is_internal(entry)	(((entry) & 3) == 2)
+#define maple_is_node(entry)		(maple_is_internal(entry) && ((entry) > 4096))
+
+static void
+do_maple_tree_iter(ulong entry, ulong min, ulong max, char *path,
+		   int height, struct maple_tree_ops *ops)
+{
+	ulong node, first, last, slot, nslots, i;
+	ulong *pivots, *slots;
+	enum maple_type type;
+	char *node_buf;
+	char child_path[BUFSIZE];
+
+	node = entry & ~MAPLE_NODE_MASK;
+	type = (entry >> MAPLE_NODE_TYPE_SHIFT) & MAPLE_NODE_TYPE_MASK;
+
+	if (!hq_enter(node))
+		error(FATAL, "\nduplicate tree node: %lx\n", node);
+
+	if (height > MAPLE_HEIGHT_MAX)
+		error(FATAL, "maple_node %lx: maple tree height exceeds %d\n",
+			node, MAPLE_HEIGHT_MAX);
+
+	node_buf = GETBUF(SIZE(maple_node));
+	readmem(node, KVADDR, node_buf, SIZE(maple_node), "maple_node",
+		FAULT_ON_ERROR);
+
+	switch (type)
+	{
+	case maple_dense:
+		slots = (ulong *)(node_buf + OFFSET(maple_node_slot));
+		for (i = 0; (i < MAPLE_NODE_SLOTS) && (min + i <= max); i++) {
+			if (min + i < ops->first)
+				continue;
+			if (min + i > ops->last)
+				break;
+			if (!(slot = slots[i]) || maple_is_internal(slot))
+				continue;
+			sprintf(child_path, "%s/%ld", path, i);
+			ops->entry(node, slot, child_path, min + i, min + i,
+				ops->private);
+		}
+		FREEBUF(node_buf);
+		return;
+
+	case maple_leaf_64:
+	case maple_range_64:
+		pivots = (ulong *)(node_buf + OFFSET(maple_node_mr64) +
+			OFFSET(maple_range_64_pivot));
+		slots = (ulong *)(node_buf + OFFSET(maple_node_mr64) +
+			OFFSET(maple_range_64_slot));
+		nslots = MAPLE_RANGE64_SLOTS;
+		break;
+
+	case maple_arange_64:
+		pivots = (ulong *)(node_buf + OFFSET(maple_node_ma64) +
+			OFFSET(maple_arange_64_pivot));
+		slots = (ulong *)(node_buf + OFFSET(maple_node_ma64) +
+			OFFSET(maple_arange_64_slot));
+		nslots = MAPLE_ARANGE64_SLOTS;
+		break;
+
+	default:
+		error(INFO, "maple_node %lx: invalid node type: %d\n",
+			node, type);
+		FREEBUF(node_buf);
+		return;
+	}
+
+	for (i = 0, first = min; i < nslots; i++) {
+		last = (i < (nslots - 1)) ? pivots[i] : max;
+
+		if (!last && i)
+			break;
+		if ((last > max) || (last < first)) {
+			error(INFO, "maple_node %lx: invalid pivot[%ld]: %lx\n",
+				node, i, last);
+			break;
+		}
+		if (first > ops->last)
+			break;
+
+		if ((slot = slots[i]) && (last >= ops->first)) {
+			sprintf(child_path, "%s/%ld", path, i);
+			if (type == maple_leaf_64) {
+				if (!maple_is_internal(slot))
+					ops->entry(node, slot, child_path,
+						first, last, ops->private);
+			} else if (maple_is_node(slot))
+				do_maple_tree_iter(slot, first, last,
+					child_path, height + 1, ops);
+		}
+
+		if (last == max)
+			break;
+		first = last + 1;
+	}
+
+	FREEBUF(node_buf);
+}
+
+int
+do_maple_tree_traverse(ulong ptr, int is_root, struct maple_tree_ops *ops)
+{
+	ulong entry;
+	long nlen;
+	char path[BUFSIZE];
+
+	if (!VALID_STRUCT(maple_tree) || !VALID_STRUCT(maple_node) ||
+	    !VALID_MEMBER(maple_tree_ma_root) || !VALID_MEMBER(maple_node_slot) ||
+	    !VALID_MEMBER(maple_node_mr64) || !VALID_MEMBER(maple_node_ma64) ||
+	    !VALID_MEMBER(maple_range_64_pivot) ||
+	    !VALID_MEMBER(maple_range_64_slot) ||
+	    !VALID_MEMBER(maple_arange_64_pivot) ||
+	    !VALID_MEMBER(maple_arange_64_slot))
+		error(FATAL,
+			"maple trees do not exist or have changed their format\n");
+
+	if (MAPLE_NODE_SLOTS == UNINITIALIZED) {
+		if ((nlen = MEMBER_SIZE("maple_node", "slot")) <= 0)
+			error(FATAL, "cannot determine length of maple_node.slot[] array\n");
+		MAPLE_NODE_SLOTS = nlen / sizeof(void *);
+		if ((nlen = MEMBER_SIZE("maple_range_64", "slot")) <= 0)
+			error(FATAL, "cannot determine length of maple_range_64.slot[] array\n");
+		MAPLE_RANGE64_SLOTS = nlen / sizeof(void *);
+		if ((nlen = MEMBER_SIZE("maple_arange_64", "slot")) <= 0)
+			error(FATAL, "cannot determine length of maple_arange_64.slot[] array\n");
+		MAPLE_ARANGE64_SLOTS = nlen / sizeof(void *);
+	}
+
+	if (is_root)
+		readmem(ptr + OFFSET(maple_tree_ma_root), KVADDR, &entry,
+			sizeof(void *), "maple_tree ma_root", FAULT_ON_ERROR);
+	else
+		entry = ptr;
+
+	if (CRASHDEBUG(1)) {
+		fprintf(fp, "maple_node.slot[%ld] maple_range_64.slot[%ld] "
+			"maple_arange_64.slot[%ld]\n", MAPLE_NODE_SLOTS,
+			MAPLE_RANGE64_SLOTS, MAPLE_ARANGE64_SLOTS);
+		fprintf(fp, "pointer at %lx (is_root? %s):\n",
+			entry, is_root ? "yes" : "no");
+		if (is_root)
+			dump_struct("maple_tree", ptr, RADIX(ops->radix));
+	}
+
+	if (!entry)
+		return 0;
+
+	if (!maple_is_node(entry)) {
+		if (ops->first == 0) {
+			strcpy(path, "direct");
+			ops->entry(ptr, entry, path, 0, 0, ops->private);
+		}
+	} else {
+		strcpy(path, "root");
+		do_maple_tree_iter(entry, 0, ~0UL, path, 1, ops);
+	}
+
+	return 0;
+}
+
+static void do_maple_tree_entry(ulong node, ulong slot, const char *path,
+				ulong first, ulong last, void *private)
+{
+	struct tree_data *td = private;
+	static struct req_entry **e = NULL;
+	uint print_radix;
+	int i;
+
+	if (!td->count && td->structname_args) {
+		/*
+		 * Retrieve all members' info only once (count == 0)
+		 * After last iteration all memory will be freed up
+		 */
+		e = (struct req_entry **)GETBUF(sizeof(*e) * td->structname_args);
+		for (i = 0; i < td->structname_args; i++)
+			e[i] = fill_member_offsets(td->structname[i]);
+	}
+
+	td->count++;
+
+	if (td->flags & VERBOSE)
+		fprintf(fp, "%lx\n", slot);
+
+	if (td->flags & TREE_POSITION_DISPLAY) {
+		fprintf(fp, "  index: %lx-%lx  position: %s\n", first,
+			last, path);
+	}
+
+	if (td->structname) {
+		if (td->flags & TREE_STRUCT_RADIX_10)
+			print_radix = 10;
+		else if (td->flags & TREE_STRUCT_RADIX_16)
+			print_radix = 16;
+		else
+			print_radix = 0;
+
+		for (i = 0; i < td->structname_args; i++) {
+			switch (count_chars(td->structname[i], '.')) {
+			case 0:
+				dump_struct(td->structname[i], slot, print_radix);
+				break;
+			default:
+				if (td->flags & TREE_PARSE_MEMBER)
+					dump_struct_members_for_tree(td, i, slot);
+				else if (td->flags & TREE_READ_MEMBER)
+					dump_struct_members_fast(e[i], print_radix, slot);
+				break;
+			}
+		}
+	}
+}
+
+int do_mptree(struct tree_data *td)
+{
+	struct maple_tree_ops ops = {
+		.entry		= do_maple_tree_entry,
+		.private	= td,
+		.first		= 0,
+		.last		= ~0UL,
+	};
+	int is_root = !(td->flags & TREE_NODE_POINTER);
+
+	if (td->flags & TREE_STRUCT_RADIX_10)
+		ops.radix = 10;
+	else if (td->flags & TREE_STRUCT_RADIX_16)
+		ops.radix = 16;
+	else
+		ops.radix = 0;
+
+	do_maple_tree_traverse(td->start, is_root, &ops);
+
+	return 0;
+}
+
 int
 do_rbtree(struct tree_data *td)
 {
 	ulong start;
 	char pos[BUFSIZE];
+	ulonglong tstart;
+
+	tstart = TRACING() ? trace_time() : 0;
 
 	if (!VALID_MEMBER(rb_root_rb_node) || !VALID_MEMBER(rb_node_rb_left) ||
 	    !VALID_MEMBER(rb_node_rb_right))
@@ -4974,24 +5800,117 @@ do_rbtree(struct tree_data *td)
 
 	rbtree_iteration(start, td, pos);
 
+	trace_span("walker", "do_rbtree", NULL, tstart);
+
 	return td->count;
 }
 
-void
-rbtree_iteration(ulong node_p, struct tree_data *td, char *pos)
+/*
+ *  A red-black tree with any number of nodes that fit in memory is
+ *  never deeper than this, so a walk that goes deeper has entered a
+ *  loop of corrupted rb_node pointers.
+ */
+#define RBTREE_MAX_DEPTH	(128)
+
+struct rbtree_walk {
+	ulong node;
+	int depth;
+	int state;		/* 0: left subtree next, 1: right subtree next */
+	int spanned;		/* buf holds the struct members, not just rb_node */
+	char *buf;
+};
+
+/*
+ *  Read the window of len bytes at node_p + lo, which contains both the
+ *  rb_node and the members to be displayed, into buf.  If that fails,
+ *  read just the rb_node into its place in buf.  Returns 2 if the whole
+ *  window was read, 1 if only the rb_node, and 0 if neither.
+ */
+static int
+rbtree_read_node(ulong node_p, long lo, long len, long node_len, char *buf,
+		 ulong error_handle)
+{
+	if ((len > node_len) &&
+	    readmem(node_p + lo, KVADDR, buf, len, "rb_node and members",
+	    RETURN_ON_ERROR|QUIET))
+		return 2;
+
+	if (readmem(node_p, KVADDR, buf - lo, node_len, "rb_node",
+	    error_handle))
+		return 1;
+
+	return 0;
+}
+
+static void
+rbtree_show_node(struct rbtree_walk *w, struct tree_data *td,
+		 struct req_entry **e, uint print_radix, long lo, char *pos)
 {
 	int i;
+	ulong struct_p;
+
+	td->count++;
+
+	struct_p = w->node - td->node_member_offset;
+
+	if (td->flags & VERBOSE)
+		fprintf(fp, "%lx\n", struct_p);
+
+	if (td->flags & TREE_POSITION_DISPLAY)
+		fprintf(fp, "  position: %s\n", pos);
+
+	if (!td->structname)
+		return;
+
+	for (i = 0; i < td->structname_args; i++) {
+		switch(count_chars(td->structname[i], '.'))
+		{
+		case 0:
+			dump_struct(td->structname[i], struct_p, print_radix);
+			break;
+		default:
+			if (td->flags & TREE_PARSE_MEMBER)
+				dump_struct_members_for_tree(td, i, struct_p);
+			else if ((td->flags & TREE_READ_MEMBER) &&
+			    (w->spanned == 2) && e[i]->span)
+				dump_struct_members_span(e[i], print_radix,
+					struct_p, w->buf + ((long)e[i]->span_offset -
+					td->node_member_offset - lo));
+			else if (td->flags & TREE_READ_MEMBER)
+				dump_struct_members_fast(e[i], print_radix,
+					struct_p);
+			break;
+		}
+	}
+}
+
+/*
+ *  Walk the tree with an explicit stack instead of recursion, in
+ *  pre-order, or in-order if TREE_LINEAR_ORDER is set.  Each rb_node is
+ *  read with a single readmem() together with the members of its
+ *  containing structure that are displayed directly, and each node is
+ *  displayed as soon as it is reached.  Loops are caught by bounding the
+ *  depth of the walk rather than by entering every node in the hash
+ *  queue.
+ */
+static void
+rbtree_iteration(ulong node_p, struct tree_data *td, char *pos)
+{
+	int i, sp, depth, plen, spans;
 	uint print_radix;
-	ulong struct_p, new_p, test_p;
-	char new_pos[BUFSIZE];
-	static struct req_entry **e;
+	long lo, hi, len, node_len, off;
+	ulong child, parent;
+	char side, *bufs;
+	struct req_entry **e;
+	struct rbtree_walk *w, stack[RBTREE_MAX_DEPTH+1];
 
 	if (!node_p)
 		return;
 
-	if (!td->count && td->structname_args) {
+	e = NULL;
+	if (td->structname_args) {
 		/*
-		 * Retrieve all members' info only once (count == 0)
+		 * Retrieve all members' info only once
 		 * After last iteration all memory will be freed up
 		 */
 		e = (struct req_entry **)GETBUF(sizeof(*e) *
@@ -5000,78 +5919,108 @@ rbtree_iteration(ulong node_p, struct tree_data *td, char *pos)
 			e[i] = fill_member_offsets(td->structname[i]);
 	}
 
-	if (hq_enter(node_p))
-		td->count++;
+	if (td->flags & TREE_STRUCT_RADIX_10)
+		print_radix = 10;
+	else if (td->flags & TREE_STRUCT_RADIX_16)
+		print_radix = 16;
 	else
-		error(FATAL, "\nduplicate tree entry: %lx\n", node_p);
-
-	if ((td->flags & TREE_LINEAR_ORDER) &&
-	    readmem(node_p+OFFSET(rb_node_rb_left), KVADDR, &new_p,
-	    sizeof(void *), "rb_node rb_left", RETURN_ON_ERROR) && new_p) {
-		if (readmem(new_p+OFFSET(rb_node_rb_left), KVADDR, &test_p,
-			sizeof(void *), "rb_node rb_left", RETURN_ON_ERROR|QUIET)) {
-			sprintf(new_pos, "%s/l", pos);
-			rbtree_iteration(new_p, td, new_pos);
-		} else
-			error(INFO, "rb_node: %lx: corrupted rb_left pointer: %lx\n",
-					node_p, new_p);
+		print_radix = 0;
+
+	/*
+	 *  Determine the window relative to the rb_node that covers it
+	 *  and the directly displayed members of all -s arguments.
+	 */
+	node_len = MAX(OFFSET(rb_node_rb_left), OFFSET(rb_node_rb_right)) +
+		sizeof(void *);
+	lo = 0;
+	hi = node_len;
+	spans = FALSE;
+	if (e && (td->flags & TREE_READ_MEMBER)) {
+		for (i = 0; i < td->structname_args; i++) {
+			if (!e[i] || !e[i]->span)
+				continue;
+			off = (long)e[i]->span_offset - td->node_member_offset;
+			lo = MIN(lo, off);
+			hi = MAX(hi, off + (long)e[i]->span_size);
+			spans = TRUE;
+		}
+		if ((hi - lo) > REQ_ENTRY_MAX_SPAN) {
+			lo = 0;
+			hi = node_len;
+			spans = FALSE;
+		}
 	}
+	len = hi - lo;
 
-	struct_p = node_p - td->node_member_offset;
+	bufs = GETBUF(len * (RBTREE_MAX_DEPTH+1));
+	plen = strlen(pos);
 
-	if (td->flags & VERBOSE)
-		fprintf(fp, "%lx\n", struct_p);
-	
-	if (td->flags & TREE_POSITION_DISPLAY)
-		fprintf(fp, "  position: %s\n", pos);
+	w = &stack[0];
+	w->buf = bufs;
+	if (!(w->spanned = rbtree_read_node(node_p, lo, len, node_len,
+	    w->buf, RETURN_ON_ERROR))) {
+		FREEBUF(bufs);
+		return;
+	}
+	if (!spans)
+		w->spanned = 1;
+	w->node = node_p;
+	w->depth = 0;
+	w->state = 0;
+	sp = 1;
+
+	while (sp) {
+		w = &stack[sp-1];
+		pos[plen + (2 * w->depth)] = NULLCHAR;
+		parent = w->node;
+		depth = w->depth;
+
+		if (w->state == 0) {
+			w->state = 1;
+			if (!(td->flags & TREE_LINEAR_ORDER))
+				rbtree_show_node(w, td, e, print_radix, lo, pos);
+			child = ULONG(w->buf - lo + OFFSET(rb_node_rb_left));
+			side = 'l';
+		} else {
+			if (td->flags & TREE_LINEAR_ORDER)
+				rbtree_show_node(w, td, e, print_radix, lo, pos);
+			child = ULONG(w->buf - lo + OFFSET(rb_node_rb_right));
+			side = 'r';
+			/*
+			 *  The node is finished with, so its right child
+			 *  takes its place on the stack.
+			 */
+			sp--;
+		}
 
-	if (td->structname) {
-		if (td->flags & TREE_STRUCT_RADIX_10)
-			print_radix = 10;
-		else if (td->flags & TREE_STRUCT_RADIX_16)
-			print_radix = 16;
-		else
-			print_radix = 0;
+		if (!child)
+			continue;
 
-		for (i = 0; i < td->structname_args; i++) {
-			switch(count_chars(td->structname[i], '.'))
-			{
-			case 0:
-				dump_struct(td->structname[i], struct_p, print_radix);
-				break;
-			default:
-				if (td->flags & TREE_PARSE_MEMBER)
-					dump_struct_members_for_tree(td, i, struct_p);
-				else if (td->flags & TREE_READ_MEMBER)
-					dump_struct_members_fast(e[i], print_radix,
-						struct_p);
-				break;
-			}
+		if (depth >= RBTREE_MAX_DEPTH)
+			error(FATAL, "\nrb_node: %lx: tree is deeper than %d "
+				"levels: rb_%s pointer loop?: %lx\n", parent,
+				RBTREE_MAX_DEPTH, side == 'l' ? "left" : "right",
+				child);
+
+		w = &stack[sp];
+		w->buf = bufs + (len * sp);
+		if (!(w->spanned = rbtree_read_node(child, lo, len, node_len,
+		    w->buf, RETURN_ON_ERROR|QUIET))) {
+			error(INFO, "rb_node: %lx: corrupted rb_%s pointer: %lx\n",
+				parent, side == 'l' ? "left" : "right", child);
+			continue;
 		}
-	}
+		if (!spans)
+			w->spanned = 1;
+		w->node = child;
+		w->depth = depth + 1;
+		w->state = 0;
+		sp++;
 
-	if (!(td->flags & TREE_LINEAR_ORDER) &&
-	    readmem(node_p+OFFSET(rb_node_rb_left), KVADDR, &new_p,
-	    sizeof(void *), "rb_node rb_left", RETURN_ON_ERROR) && new_p) {
-		if (readmem(new_p+OFFSET(rb_node_rb_left), KVADDR, &test_p,
-			sizeof(void *), "rb_node rb_left", RETURN_ON_ERROR|QUIET)) {
-			sprintf(new_pos, "%s/l", pos);
-			rbtree_iteration(new_p, td, new_pos);
-		} else
-			error(INFO, "rb_node: %lx: corrupted rb_left pointer: %lx\n",
-					node_p, new_p);
+		sprintf(pos + plen + (2 * depth), "/%c", side);
 	}
 
-	if (readmem(node_p+OFFSET(rb_node_rb_right), KVADDR, &new_p,
-	    sizeof(void *), "rb_node rb_right", RETURN_ON_ERROR) && new_p) {
-		if (readmem(new_p+OFFSET(rb_node_rb_left), KVADDR, &test_p,
-			sizeof(void *), "rb_node rb_left", RETURN_ON_ERROR|QUIET)) {
-			sprintf(new_pos, "%s/r", pos);
-			rbtree_iteration(new_p, td, new_pos);
-		} else
-			error(INFO, "rb_node: %lx: corrupted rb_right pointer: %lx\n",
-					node_p, new_p);
-	}
+	FREEBUF(bufs);
 }
 
 void
@@ -5135,29 +6084,42 @@ dump_struct_members_for_tree(struct tree_data *td, int idx, ulong struct_p)
 
 #define HQ_ENTRY_CHUNK   (1024)
 #define NR_HASH_QUEUES_DEFAULT   (32768UL)
-#define HQ_SHIFT         (machdep->pageshift)
-#define HQ_INDEX(X)      (((X) >> HQ_SHIFT) % pc->nr_hash_queues)
-
-struct hq_entry {
-        int next;
-	int order;
-        ulong value;
-};
-
-struct hq_head {
-	int next;
-	int qcnt;
-};
 
+/*
+ *  The entered values are kept in insertion order in the values array,
+ *  which retrieve_list() simply copies out.  Duplicates are detected with
+ *  an open-addressed, linearly-probed set of slots containing the index
+ *  of each value plus 1, where 0 marks an empty slot.  The number of
+ *  slots is a power of 2 that starts at pc->nr_hash_queues, and is doubled
+ *  whenever the set becomes half full.  The values are run through a
+ *  64-bit finalizer so that the closely-spaced addresses of slab objects
+ *  are spread across the whole set.
+ */
 struct hash_table {
 	ulong flags;
-	struct hq_head *queue_heads;
-	struct hq_entry *memptr;
-	long count;
-	long index;
+	ulong *values;
+	long count;		/* size of the values array */
+	long index;		/* number of values entered */
+	uint *slots;
+	ulong nr_slots;
+	ulong min_slots;	/* nr_slots at hq_open() time */
 	int reallocs;
+	int rehashes;
 } hash_table = { 0 };
 
+static inline ulong
+hq_slot(struct hash_table *ht, ulong value)
+{
+	ulonglong hash;
+
+	hash = value;
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+
+	return (ulong)hash & (ht->nr_slots - 1);
+}
+
 /*
  *  For starters, allocate a hash table containing HQ_ENTRY_CHUNK entries.
  *  If necessary during runtime, it will be increased in size.
@@ -5172,17 +6134,20 @@ hq_init(void)
 	if (pc->nr_hash_queues == 0)
 		pc->nr_hash_queues = NR_HASH_QUEUES_DEFAULT;
 
-        if ((ht->queue_heads = (struct hq_head *)malloc(pc->nr_hash_queues *
-	    sizeof(struct hq_head))) == NULL) {
+	for (ht->min_slots = 2; ht->min_slots < pc->nr_hash_queues; )
+		ht->min_slots <<= 1;
+
+        if ((ht->slots = (uint *)calloc(ht->min_slots, sizeof(uint))) == NULL) {
 		error(INFO, "cannot malloc memory for hash queue heads: %s\n",
 			strerror(errno));
 		ht->flags = HASH_QUEUE_NONE;
 		pc->flags &= ~HASH;
 		return;
 	}
+	ht->nr_slots = ht->min_slots;
 
-        if ((ht->memptr = (struct hq_entry *)malloc(HQ_ENTRY_CHUNK * 
-	    sizeof(struct hq_entry))) == NULL) {
+        if ((ht->values = (ulong *)malloc(HQ_ENTRY_CHUNK * 
+	    sizeof(ulong))) == NULL) {
 		error(INFO, "cannot malloc memory for hash queues: %s\n",
 			strerror(errno));
 		ht->flags = HASH_QUEUE_NONE;
@@ -5190,59 +6155,69 @@ hq_init(void)
 		return;
 	}
         
-	BZERO(ht->memptr, HQ_ENTRY_CHUNK * sizeof(struct hq_entry));
 	ht->count = HQ_ENTRY_CHUNK;
 	ht->index = 0;
 }
 
 /*
- *  Get a free hash queue entry.  If there's no more available, realloc()
- *  a new chunk of memory with another HQ_ENTRY_CHUNK entries stuck on the end.
+ *  Double the size of the slot array and re-enter the values into it.
  */
-static long
-alloc_hq_entry(void)
+static int
+hq_rehash(struct hash_table *ht)
 {
-	struct hash_table *ht;
-	struct hq_entry *new, *end_of_old;
+	uint *slots;
+	ulong i, slot;
 
-	ht = &hash_table;
+	if ((ht->nr_slots >= (1UL << 30)) ||
+	    !(slots = (uint *)calloc(ht->nr_slots * 2, sizeof(uint)))) {
+		error(INFO, "cannot realloc memory for hash queue heads: %s\n",
+			strerror(errno));
+		ht->flags |= HASH_QUEUE_FULL;
+		return FALSE;
+	}
 
-	if (++ht->index == ht->count) {
-                if (!(new = (void *)realloc((void *)ht->memptr,
-		    (ht->count+HQ_ENTRY_CHUNK) * sizeof(struct hq_entry)))) {
-			error(INFO, 
-			    "cannot realloc memory for hash queues: %s\n",
-				strerror(errno));
-			ht->flags |= HASH_QUEUE_FULL;
-			return(-1);
-		}
-		ht->reallocs++;
-		ht->memptr = new;
-		end_of_old = ht->memptr + ht->count;
-		BZERO(end_of_old, HQ_ENTRY_CHUNK * sizeof(struct hq_entry));
-		ht->count += HQ_ENTRY_CHUNK;
+	free(ht->slots);
+	ht->slots = slots;
+	ht->nr_slots *= 2;
+	ht->rehashes++;
+
+	for (i = 0; i < ht->index; i++) {
+		slot = hq_slot(ht, ht->values[i]);
+		while (ht->slots[slot])
+			slot = (slot + 1) & (ht->nr_slots - 1);
+		ht->slots[slot] = i + 1;
 	}
 
-	return(ht->index);
+	return TRUE;
 }
 
 /*
- *  Restore the hash queue to its state before the duplicate entry 
- *  was attempted.
- */ 
-static void
-dealloc_hq_entry(struct hq_entry *entry)
+ *  Make room for another value, doubling the values array if it's full,
+ *  and the slot array if it's half full.
+ */
+static int
+alloc_hq_entry(struct hash_table *ht)
 {
-        struct hash_table *ht;
-        long hqi;
+	ulong *new;
 
-        ht = &hash_table;
-	hqi = HQ_INDEX(entry->value);
+	if (ht->index == ht->count) {
+                if (!(new = (ulong *)realloc((void *)ht->values,
+		    ht->count * 2 * sizeof(ulong)))) {
+			error(INFO, 
+			    "cannot realloc memory for hash queues: %s\n",
+				strerror(errno));
+			ht->flags |= HASH_QUEUE_FULL;
+			return FALSE;
+		}
+		ht->reallocs++;
+		ht->values = new;
+		ht->count *= 2;
+	}
 
-	ht->index--;
+	if (((ht->index + 1) * 2) > ht->nr_slots)
+		return hq_rehash(ht);
 
-	BZERO(entry, sizeof(struct hq_entry));
-	ht->queue_heads[hqi].qcnt--;
+	return TRUE;
 }
 
 /*
@@ -5252,6 +6227,7 @@ int
 hq_open(void)
 {
 	struct hash_table *ht;
+	uint *slots;
 
 	if (!(pc->flags & HASH))
 		return FALSE;
@@ -5261,8 +6237,18 @@ hq_open(void)
 		return FALSE;
 
 	ht->flags &= ~(HASH_QUEUE_FULL|HASH_QUEUE_CLOSED);
-	BZERO(ht->queue_heads, sizeof(struct hq_head) * pc->nr_hash_queues);
-	BZERO(ht->memptr, ht->count * sizeof(struct hq_entry));
+
+	/*
+	 *  Don't pay for clearing a slot array that was grown by a
+	 *  previous session entering millions of values.
+	 */
+	if ((ht->nr_slots > ht->min_slots) &&
+	    (slots = (uint *)calloc(ht->min_slots, sizeof(uint)))) {
+		free(ht->slots);
+		ht->slots = slots;
+		ht->nr_slots = ht->min_slots;
+	} else
+		BZERO(ht->slots, sizeof(uint) * ht->nr_slots);
 	ht->index = 0;
 
 	ht->flags |= HASH_QUEUE_OPEN;
@@ -5316,7 +6302,7 @@ hq_close(void)
 	return(ht->index);
 }
 
-char *corrupt_hq = "corrupt hash queue entry: value: %lx next: %d order: %d\n";
+char *corrupt_hq = "corrupt hash queue entry: value: %lx index: %ld slot: %ld\n";
 
 /*
  *  For a given value, allocate a hash queue entry and hash it into the 
@@ -5328,10 +6314,8 @@ int
 hq_enter(ulong value)
 {
 	struct hash_table *ht;
-	struct hq_entry *entry;
-	struct hq_entry *list_entry;
-	long hqi;
-	long index;
+	ulong slot;
+	uint index;
 
 	if (!(pc->flags & HASH))
 		return TRUE;
@@ -5344,71 +6328,48 @@ hq_enter(ulong value)
 	if (!(ht->flags & HASH_QUEUE_OPEN))
 		return TRUE;
 
-	if ((index = alloc_hq_entry()) < 0) 
-		return TRUE;
-
-	entry = ht->memptr + index;
-	if (entry->next || entry->value || entry->order) {
-		error(INFO, corrupt_hq,
-			entry->value, entry->next, entry->order);
-		ht->flags |= HASH_QUEUE_NONE;
-		return TRUE;
-	}
-
-	entry->next = 0;
-	entry->value = value;
-	entry->order = index;
-
-	hqi = HQ_INDEX(value);
-
-	if (ht->queue_heads[hqi].next == 0) {
-		ht->queue_heads[hqi].next = index;
-		ht->queue_heads[hqi].qcnt = 1;
+	if (!alloc_hq_entry(ht))
 		return TRUE;
-	} else
-		ht->queue_heads[hqi].qcnt++;
-
-	list_entry = ht->memptr + ht->queue_heads[hqi].next;
 
-	while (TRUE) {
-	        if (list_entry->value == entry->value) {
-			dealloc_hq_entry(entry);
-                	return FALSE;
-		}
+	slot = hq_slot(ht, value);
 
-		if (list_entry->next >= ht->count) {
-			error(INFO, corrupt_hq,
-			    	list_entry->value, 
-				list_entry->next,
-				list_entry->order);
+	while ((index = ht->slots[slot])) {
+		if (index > ht->index) {
+			error(INFO, corrupt_hq, value, (long)index, slot);
 			ht->flags |= HASH_QUEUE_NONE;
 			return TRUE;
 		}
-
-		if (list_entry->next == 0)
-			break;
-
-        	list_entry = ht->memptr + list_entry->next;
+		if (ht->values[index-1] == value)
+			return FALSE;
+		slot = (slot + 1) & (ht->nr_slots - 1);
 	}
 
-	list_entry->next = index;
+	ht->values[ht->index++] = value;
+	ht->slots[slot] = ht->index;
 
 	return TRUE;
 }
 
+/*
+ *  The memory used by the hash table, for "help -u".
+ */
+ulonglong
+hq_memory_used(void)
+{
+	return (ulonglong)hash_table.count * sizeof(ulong) +
+		(ulonglong)hash_table.nr_slots * sizeof(uint);
+}
+
 /*
  *  "hash -d" output
  */
 void
 dump_hash_table(int verbose)
 {
-	int i;
+	long i;
 	struct hash_table *ht;
-	struct hq_entry *list_entry;
-	long elements;
-	long queues_in_use;
+	ulong slot, used, probes, maxprobe;
 	int others;
-	uint minq, maxq; 
 
 	ht = &hash_table;
 	others = 0;
@@ -5423,96 +6384,64 @@ dump_hash_table(int verbose)
         if (ht->flags & HASH_QUEUE_FULL)
                 fprintf(fp, "%sHASH_QUEUE_FULL", others++ ? "|" : "");
 	fprintf(fp, ")\n");
-	fprintf(fp, "  queue_heads[%ld]: %lx\n", pc->nr_hash_queues, 
-		(ulong)ht->queue_heads);
-	fprintf(fp, "             memptr: %lx\n", (ulong)ht->memptr);
+	fprintf(fp, "        slots[%ld]: %lx", ht->nr_slots, (ulong)ht->slots);
+	if (ht->rehashes)
+		fprintf(fp, "  (%d rehashes)", ht->rehashes);
+	fprintf(fp, "\n");
+	fprintf(fp, "             values: %lx\n", (ulong)ht->values);
 	fprintf(fp, "              count: %ld  ", ht->count);
 	if (ht->reallocs)
 		fprintf(fp, "  (%d reallocs)", ht->reallocs);
 	fprintf(fp, "\n");
 	fprintf(fp, "              index: %ld\n", ht->index);
 
-	queues_in_use = 0;
-	minq = ~(0);
-	maxq = 0;
-
-	for (i = 0; i < pc->nr_hash_queues; i++) {
-               	if (ht->queue_heads[i].next == 0) {
-			minq = 0;
-                       	continue;
+	/*
+	 *  Verify that each value can be found from its home slot, and
+	 *  gather the probe sequence lengths while doing so.
+	 */
+	for (i = used = probes = maxprobe = 0; i < ht->index; i++) {
+		slot = hq_slot(ht, ht->values[i]);
+		while (ht->slots[slot] && (ht->slots[slot] != (i + 1))) {
+			slot = (slot + 1) & (ht->nr_slots - 1);
+			probes++;
 		}
-
-		if (ht->queue_heads[i].qcnt < minq)
-			minq = ht->queue_heads[i].qcnt;
-		if (ht->queue_heads[i].qcnt > maxq)
-			maxq = ht->queue_heads[i].qcnt;
-
-               	queues_in_use++;
+		if (!ht->slots[slot]) {
+			error(INFO, corrupt_hq, ht->values[i], i, slot);
+			ht->flags |= HASH_QUEUE_NONE;
+			return;
+		}
+		used++;
+		maxprobe = MAX(maxprobe, probes);
+		probes = 0;
 	}
 
-	elements = 0;
-	list_entry = ht->memptr;
-        for (i = 0; i < ht->count; i++, list_entry++) {
-	         if (!list_entry->order) {
-	                if (list_entry->value || list_entry->next)
-				goto corrupt_list_entry;
-	                continue;
-	         }
-	
-	         if (list_entry->next >= ht->count)
-	                        goto corrupt_list_entry;
-
-	         ++elements;
-       	}
-
-	if (elements != ht->index)
-        	fprintf(fp, "     elements found: %ld (expected %ld)\n", 
-			elements, ht->index);
-        fprintf(fp, "      queues in use: %ld of %ld\n", queues_in_use, 
-		pc->nr_hash_queues);
-	fprintf(fp, " queue length range: %d to %d\n", minq, maxq);
+        fprintf(fp, "         slots used: %ld of %ld\n", used, ht->nr_slots);
+	fprintf(fp, "  longest probe run: %ld\n", maxprobe);
 
 	if (verbose) {
-		if (!elements) {
+		if (!ht->index) {
         		fprintf(fp, "            entries: (none)\n");
 			return;
 		}
 
         	fprintf(fp, "            entries: ");
 
-        	list_entry = ht->memptr;
-	        for (i = 0; i < ht->count; i++, list_entry++) {
-	                 if (list_entry->order)
-	                        fprintf(fp, "%s%lx (%d)\n", 
-					list_entry->order == 1 ?
-					"" : "                     ",
-	                                list_entry->value, list_entry->order);
-	        }
+	        for (i = 0; i < ht->index; i++)
+	                fprintf(fp, "%s%lx (%ld)\n", i == 0 ?
+				"" : "                     ",
+	                        ht->values[i], i + 1);
 	}
-	return;
-
-corrupt_list_entry:
-
-        error(INFO, corrupt_hq,
-        	list_entry->value, list_entry->next, list_entry->order);
-        ht->flags |= HASH_QUEUE_NONE;
 }
 
 /*
  *  Retrieve the count of, and optionally stuff a pre-allocated array with,
- *  the current hash table entries.  The entries will be sorted according
- *  to the order in which they were entered, so from this point on, no
- *  further hq_enter() operations on this list will be allowed.  However, 
- *  multiple calls to retrieve_list are allowed because the second and 
- *  subsequent ones will go directly to where the non-zero (valid) entries 
- *  start in the potentially very large list_entry memory chunk.
+ *  the current hash table entries.  The entries are returned in the order
+ *  in which they were entered.
  */
 int
 retrieve_list(ulong array[], int count)
 {
-        int i; 
         struct hash_table *ht;
-        struct hq_entry *list_entry;
         int elements;
 
 	if (!(pc->flags & HASH))
@@ -5521,32 +6450,11 @@ retrieve_list(ulong array[], int count)
 
         ht = &hash_table;
 
-	list_entry = ht->memptr;
-	for (i = elements = 0; i < ht->count; i++, list_entry++) {
-		if (!list_entry->order) {
-			if (list_entry->value || list_entry->next)
-				goto corrupt_list_entry;
-			continue;
-		}
-
-                if (list_entry->next >= ht->count) 
-			goto corrupt_list_entry;
-
-		if (array) 
-			array[elements] = list_entry->value; 
-
-                if (++elements == count)
-                       	break;
-	}
+	elements = (count < ht->index) ? count : ht->index;
+	if (array && elements)
+		BCOPY(ht->values, array, elements * sizeof(ulong));
 
 	return elements;
-
-corrupt_list_entry:
-
-        error(INFO, corrupt_hq,
-               list_entry->value, list_entry->next, list_entry->order);
-        ht->flags |= HASH_QUEUE_NONE;
-        return(-1);
 }
 
 /*
@@ -5557,8 +6465,8 @@ int
 hq_entry_exists(ulong value)
 {
 	struct hash_table *ht;
-	struct hq_entry *list_entry;
-	long hqi;
+	ulong slot;
+	uint index;
 
 	if (!(pc->flags & HASH))
 		return FALSE;
@@ -5571,26 +6479,17 @@ hq_entry_exists(ulong value)
 	if (!(ht->flags & HASH_QUEUE_OPEN))
 		return FALSE;
 
-	hqi = HQ_INDEX(value);
-	list_entry = ht->memptr + ht->queue_heads[hqi].next;
-
-	while (TRUE) {
-		if (list_entry->value == value)
-			return TRUE;
+	slot = hq_slot(ht, value);
 
-		if (list_entry->next >= ht->count) {
-			error(INFO, corrupt_hq,
-				list_entry->value, 
-				list_entry->next,
- 				list_entry->order);
+	while ((index = ht->slots[slot])) {
+		if (index > ht->index) {
+			error(INFO, corrupt_hq, value, (long)index, slot);
 			ht->flags |= HASH_QUEUE_NONE;
 			return FALSE;
 		}
-
-		if (list_entry->next == 0)
-			break;
-
-		list_entry = ht->memptr + list_entry->next;
+		if (ht->values[index-1] == value)
+			return TRUE;
+		slot = (slot + 1) & (ht->nr_slots - 1);
 	}
 
 	return FALSE;
@@ -5632,6 +6531,15 @@ ll_power(long long base, long long exp)
  *  to GETBUF(size).  They can explicitly freed by FREEBUF(address), but
  *  they are all freed by free_all_bufs() which is called in a number of
  *  places, most not
+ *
+ *  Requests that cannot be satisfied by the static buffers are carved out
+ *  of a per-command arena of GETBUF_CHUNK_SIZE chunks.  Each arena buffer
+ *  is rounded up to a power-of-two size class, and FREEBUF() puts it on
+ *  the free list of its class for reuse by the next request of that class.
+ *  free_all_bufs() resets the arena by rewinding it to its first chunk and
+ *  emptying the free lists.  Requests larger than the biggest size class
+ *  are malloc()'d individually, and freed by free_all_bufs() if the
+ *  command does not free them.
  */
 
 #define NUMBER_1K_BUFS  (10)
@@ -5664,9 +6572,37 @@ ll_power(long long base, long long exp)
 #define B32K (4)
 
 #define SHARED_BUF_SIZES  (B32K+1)
-#define MAX_MALLOC_BUFS   (2000)
 #define MAX_CACHE_SIZE    (KILOBYTES(32))
 
+#define GETBUF_MIN_SHIFT      (6)	/* smallest size class: 64 bytes */
+#define GETBUF_CLASSES        (10)	/* 64 bytes through 32K */
+#define GETBUF_MAX_CLASS_SIZE (1L << (GETBUF_MIN_SHIFT+GETBUF_CLASSES-1))
+#define GETBUF_CHUNK_SIZE     (KILOBYTES(256))
+#define GETBUF_RETAIN_CHUNKS  (4)	/* kept across free_all_bufs() */
+
+#define GETBUF_ARENA   (0x61726e61)	/* header magic values */
+#define GETBUF_LARGE   (0x6c617267)
+#define GETBUF_FREE    (0x66726565)
+
+/*
+ *  Header preceding each arena and large buffer.
+ */
+struct getbuf_hdr {
+	uint magic;
+	int class;			/* size class, or -1 if large */
+	long size;
+	long generation;		/* arena_resets when allocated */
+	struct getbuf_hdr *next;	/* free list, or large buffer list */
+	struct getbuf_hdr *prev;	/* large buffer list */
+};
+#define GETBUF_HDR_SIZE  (roundup(sizeof(struct getbuf_hdr), 16))
+
+struct getbuf_chunk {
+	struct getbuf_chunk *next;
+	long size;
+};
+#define GETBUF_CHUNK_HDR_SIZE  (roundup(sizeof(struct getbuf_chunk), 16))
+
 struct shared_bufs {
 	char buf_1K[NUMBER_1K_BUFS][1024];
 	char buf_2K[NUMBER_2K_BUFS][2048];
@@ -5689,7 +6625,6 @@ struct shared_bufs {
         long buf_8K_ovf;
         long buf_32K_ovf;
 	int buf_inuse[SHARED_BUF_SIZES];
-	char *malloc_bp[MAX_MALLOC_BUFS];
 	long smallest;
 	long largest;
 	long embedded;
@@ -5698,8 +6633,105 @@ struct shared_bufs {
 	long frees;
 	double total;
 	ulong reqs;
+	struct getbuf_chunk *chunks;	/* arena chunks */
+	struct getbuf_chunk *chunk_curr;
+	long chunk_used;		/* bytes used in chunk_curr */
+	long nr_chunks;
+	struct getbuf_hdr *free_list[GETBUF_CLASSES];
+	struct getbuf_hdr *large_bufs;
+	long class_allocs[GETBUF_CLASSES];
+	long arena_reuses;
+	long arena_bytes;		/* carved out since the last reset */
+	long arena_maxbytes;
+	long arena_resets;
 } shared_bufs;
 
+/*
+ *  Rewind the arena to its first chunk for the next command, returning
+ *  any chunks beyond the first GETBUF_RETAIN_CHUNKS to the system.
+ */
+static void
+reset_getbuf_arena(struct shared_bufs *bp)
+{
+	int i;
+	struct getbuf_chunk *chunk, *next;
+
+	for (i = 0, chunk = bp->chunks; chunk; chunk = next) {
+		next = chunk->next;
+		if (++i == GETBUF_RETAIN_CHUNKS)
+			chunk->next = NULL;
+		else if (i > GETBUF_RETAIN_CHUNKS) {
+			free(chunk);
+			bp->nr_chunks--;
+		}
+	}
+
+	bp->chunk_curr = bp->chunks;
+	bp->chunk_used = GETBUF_CHUNK_HDR_SIZE;
+	BZERO(bp->free_list, sizeof(bp->free_list));
+	bp->arena_bytes = 0;
+	bp->arena_resets++;
+}
+
+/*
+ *  Carve a buffer out of the arena, preferring a previously freed buffer
+ *  of the same size class.  Returns NULL if a new chunk is needed and
+ *  cannot be allocated.
+ */
+static char *
+getbuf_arena(struct shared_bufs *bp, long reqsize)
+{
+	int class;
+	long need;
+	struct getbuf_hdr *hdr;
+	struct getbuf_chunk *chunk;
+	char *bufp;
+
+	class = (reqsize <= (1L << GETBUF_MIN_SHIFT)) ? 0 :
+		(int)(sizeof(long) * 8) - __builtin_clzl((ulong)reqsize - 1) -
+		GETBUF_MIN_SHIFT;
+
+	if ((hdr = bp->free_list[class])) {
+		bp->free_list[class] = hdr->next;
+		bp->arena_reuses++;
+	} else {
+		need = GETBUF_HDR_SIZE + (1L << (class + GETBUF_MIN_SHIFT));
+		if (!bp->chunk_curr ||
+		    (bp->chunk_used + need > bp->chunk_curr->size)) {
+			if (bp->chunk_curr && bp->chunk_curr->next)
+				chunk = bp->chunk_curr->next;
+			else {
+				if (!(chunk = malloc(GETBUF_CHUNK_SIZE)))
+					return NULL;
+				chunk->next = NULL;
+				chunk->size = GETBUF_CHUNK_SIZE;
+				if (bp->chunk_curr)
+					bp->chunk_curr->next = chunk;
+				else
+					bp->chunks = chunk;
+				bp->nr_chunks++;
+			}
+			bp->chunk_curr = chunk;
+			bp->chunk_used = GETBUF_CHUNK_HDR_SIZE;
+		}
+		hdr = (struct getbuf_hdr *)((char *)bp->chunk_curr + bp->chunk_used);
+		hdr->class = class;
+		hdr->size = 1L << (class + GETBUF_MIN_SHIFT);
+		bp->chunk_used += need;
+		bp->arena_bytes += need;
+		bp->arena_maxbytes = MAX(bp->arena_maxbytes, bp->arena_bytes);
+	}
+
+	hdr->magic = GETBUF_ARENA;
+	hdr->generation = bp->arena_resets;
+	hdr->next = NULL;
+	bp->class_allocs[class]++;
+
+	bufp = (char *)hdr + GETBUF_HDR_SIZE;
+	BZERO(bufp, reqsize);
+	return bufp;
+}
+
 void
 buf_init(void)
 {
@@ -5733,6 +6765,7 @@ void free_all_bufs(void)
 {
 	int i;
 	struct shared_bufs *bp;
+	struct getbuf_hdr *hdr, *next;
 
 	bp = &shared_bufs;
 	bp->embedded = 0;
@@ -5740,13 +6773,14 @@ void free_all_bufs(void)
         for (i = 0; i < SHARED_BUF_SIZES; i++)
                 bp->buf_inuse[i] = 0;
 
-	for (i = 0; i < MAX_MALLOC_BUFS; i++) {
-		if (bp->malloc_bp[i]) {
-			free(bp->malloc_bp[i]);
-			bp->malloc_bp[i] = NULL;
-			bp->frees++;
-		}
+	for (hdr = bp->large_bufs; hdr; hdr = next) {
+		next = hdr->next;
+		free(hdr);
+		bp->frees++;
 	}
+	bp->large_bufs = NULL;
+
+	reset_getbuf_arena(bp);
 
 	if (bp->mallocs != bp->frees)
 		error(WARNING, "malloc/free mismatch (%ld/%ld)\n",
@@ -5783,6 +6817,7 @@ freebuf(char *addr)
 {
         int i;
         struct shared_bufs *bp;
+	struct getbuf_hdr *hdr;
 
         bp = &shared_bufs;
 	bp->embedded--;
@@ -5792,6 +6827,10 @@ freebuf(char *addr)
                 fprintf(fp, "FREEBUF(%ld)\n", bp->embedded);
         }
 
+	if ((addr < (char *)bp->buf_1K) ||
+	    (addr >= (char *)bp->buf_32K + sizeof(bp->buf_32K)))
+		goto not_shared;
+
 	for (i = 0; i < NUMBER_1K_BUFS; i++) {
 		if (addr == (char *)&bp->buf_1K[i]) {
 			bp->buf_inuse[B1K] &= ~(1 << i);
@@ -5842,14 +6881,35 @@ freebuf(char *addr)
                 }
         }
 
-        for (i = 0; i < MAX_MALLOC_BUFS; i++) {
-                if (bp->malloc_bp[i] == addr) {
-                        free(bp->malloc_bp[i]);
-                        bp->malloc_bp[i] = NULL;
-                        bp->frees++;
-                        return;
-                }
-        }
+not_shared:
+	hdr = (struct getbuf_hdr *)(addr - GETBUF_HDR_SIZE);
+
+	switch (addr ? hdr->magic : 0)
+	{
+	case GETBUF_ARENA:
+		/*
+		 *  A buffer from before the last free_all_bufs() has
+		 *  already been reclaimed.
+		 */
+		if (hdr->generation != bp->arena_resets)
+			return;
+		hdr->magic = GETBUF_FREE;
+		hdr->next = bp->free_list[hdr->class];
+		bp->free_list[hdr->class] = hdr;
+		return;
+
+	case GETBUF_LARGE:
+		hdr->magic = GETBUF_FREE;
+		if (hdr->prev)
+			hdr->prev->next = hdr->next;
+		else
+			bp->large_bufs = hdr->next;
+		if (hdr->next)
+			hdr->next->prev = hdr->prev;
+		free(hdr);
+		bp->frees++;
+		return;
+	}
 
 	error(FATAL, 
 	    "freeing an unknown buffer -- shared buffer inconsistency!\n");
@@ -5878,6 +6938,26 @@ get_embedded(void)
 	return(bp->embedded);
 }
 
+/*
+ *  The memory used by the shared buffers, the GETBUF() arena and
+ *  the large buffers, for "help -u".
+ */
+ulonglong
+getbuf_memory_used(void)
+{
+	ulonglong bytes;
+	struct getbuf_chunk *chunk;
+	struct getbuf_hdr *hdr;
+
+	bytes = sizeof(struct shared_bufs);
+	for (chunk = shared_bufs.chunks; chunk; chunk = chunk->next)
+		bytes += chunk->size;
+	for (hdr = shared_bufs.large_bufs; hdr; hdr = hdr->next)
+		bytes += GETBUF_HDR_SIZE + hdr->size;
+
+	return bytes;
+}
+
 /*
  *  "help -b" output
  */
@@ -5886,6 +6966,7 @@ dump_shared_bufs(void)
 {
         int i;
         struct shared_bufs *bp;
+	struct getbuf_hdr *hdr;
 
         bp = &shared_bufs;
 
@@ -5917,10 +6998,25 @@ dump_shared_bufs(void)
 		fprintf(fp, "[%lx]", (ulong)bp->buf_inuse[i]);
 	fprintf(fp, "\n");
 
-        for (i = 0; i < MAX_MALLOC_BUFS; i++) 
-		if (bp->malloc_bp[i])
-			fprintf(fp, "  malloc_bp[%d]: %lx\n", 
-				i, (ulong)bp->malloc_bp[i]);
+	fprintf(fp, "  arena chunks: %ld (%ldK each)\n", bp->nr_chunks,
+		(long)GETBUF_CHUNK_SIZE/1024);
+	fprintf(fp, "   arena bytes: %ld (max: %ld)\n", bp->arena_bytes,
+		bp->arena_maxbytes);
+	fprintf(fp, "  arena resets: %ld\n", bp->arena_resets);
+	fprintf(fp, "  arena reuses: %ld\n", bp->arena_reuses);
+	for (i = 0; i < GETBUF_CLASSES; i++) {
+		long size, nfree;
+		struct getbuf_hdr *hdr;
+
+		size = 1L << (i + GETBUF_MIN_SHIFT);
+		for (nfree = 0, hdr = bp->free_list[i]; hdr; hdr = hdr->next)
+			nfree++;
+		fprintf(fp, "   arena %5ld: allocs: %ld  free: %ld\n",
+			size, bp->class_allocs[i], nfree);
+	}
+	for (i = 0, hdr = bp->large_bufs; hdr; hdr = hdr->next, i++)
+		fprintf(fp, "  large_buf[%d]: %lx (%ld)\n", i,
+			(ulong)hdr + GETBUF_HDR_SIZE, hdr->size);
 
 	if (bp->smallest == 0x7fffffff)
         	fprintf(fp, "      smallest: 0\n");
@@ -5951,11 +7047,11 @@ dump_shared_bufs(void)
 char *
 getbuf(long reqsize)
 {
-	int i;
 	int index;
 	int bdx;
 	int mask;
 	struct shared_bufs *bp;
+	struct getbuf_hdr *hdr;
 	char *bufp;
 
 	if (!reqsize) { 
@@ -6081,16 +7177,21 @@ getbuf(long reqsize)
 		break;
 	}
 
-	for (i = 0; i < MAX_MALLOC_BUFS; i++) {
-		if (bp->malloc_bp[i])
-			continue;
-
-		if ((bp->malloc_bp[i] = (char *)calloc(reqsize, 1))) {
-			bp->mallocs++;
-			return(bp->malloc_bp[i]);
-		}
+#ifndef VALGRIND
+	if ((reqsize <= GETBUF_MAX_CLASS_SIZE) && (bufp = getbuf_arena(bp, reqsize)))
+		return(bufp);
+#endif
 
-		break;
+	if ((hdr = (struct getbuf_hdr *)calloc(GETBUF_HDR_SIZE + reqsize, 1))) {
+		hdr->magic = GETBUF_LARGE;
+		hdr->class = -1;
+		hdr->size = reqsize;
+		hdr->prev = NULL;
+		if ((hdr->next = bp->large_bufs))
+			hdr->next->prev = hdr;
+		bp->large_bufs = hdr;
+		bp->mallocs++;
+		return((char *)hdr + GETBUF_HDR_SIZE);
 	}
 
 	dump_shared_bufs();
@@ -6902,3 +8003,936 @@ rb_last(struct rb_root *root)
 
 	return node;
 }
+
+/*
+ *  Worker thread pool for commands that split work into independent
+ *  jobs, such as "search -j".  The job function runs in arbitrary
+ *  threads, so it must not produce output, call error() or otherwise
+ *  touch crash's global state; it should only work on the data handed
+ *  to it, read memory with readmem_ctx() using a context of its own,
+ *  and record its results for the calling command to act upon
+ *  afterwards.  Each job is passed its thread number, from 0 for the
+ *  calling thread to nthreads-1, for indexing per-thread data.
+ */
+static struct parallel_pool {
+	int nthreads;		/* worker threads started */
+	int active;		/* workers taking part in the current batch */
+	pthread_t threads[MAX_PARALLEL_THREADS];
+	pthread_mutex_t lock;
+	pthread_cond_t work_cv;
+	pthread_cond_t done_cv;
+	void (*func)(void *, int, int);
+	void *arg;
+	int njobs;
+	int next;		/* next job to be claimed */
+	int remaining;		/* jobs not yet completed */
+	ulong generation;	/* bumped when a new batch is posted */
+} parallel_pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.work_cv = PTHREAD_COND_INITIALIZER,
+	.done_cv = PTHREAD_COND_INITIALIZER,
+};
+
+/*
+ *  Claim and run jobs from the current batch until none are left.
+ *  Called and returns with the pool lock held.
+ */
+static void
+parallel_run_jobs(struct parallel_pool *pool, int thread)
+{
+	int job;
+
+	while (pool->next < pool->njobs) {
+		job = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+		pool->func(pool->arg, job, thread);
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->remaining == 0)
+			pthread_cond_signal(&pool->done_cv);
+	}
+}
+
+static void *
+parallel_worker(void *arg)
+{
+	struct parallel_pool *pool = &parallel_pool;
+	long index = (long)arg;
+	ulong seen = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (pool->generation == seen)
+			pthread_cond_wait(&pool->work_cv, &pool->lock);
+		seen = pool->generation;
+		if (index < pool->active)
+			parallel_run_jobs(pool, index+1);
+	}
+
+	return NULL;
+}
+
+/*
+ *  Run func(arg, job, thread) for each job from 0 to njobs-1, spread across
+ *  nthreads threads including the calling one, and return when all of
+ *  them have completed.  Worker threads are started on demand and then
+ *  kept for later calls; they block all signals, and SIGINT is held off
+ *  in the calling thread until the batch is done so that a restart()
+ *  cannot longjmp away with the pool lock held.
+ */
+void
+run_parallel(int nthreads, int njobs, void (*func)(void *, int, int), void *arg)
+{
+	int i;
+	struct parallel_pool *pool = &parallel_pool;
+	sigset_t all, sigint, saved;
+
+	if (nthreads > MAX_PARALLEL_THREADS)
+		nthreads = MAX_PARALLEL_THREADS;
+
+	if ((nthreads <= 1) || (njobs <= 1)) {
+		for (i = 0; i < njobs; i++)
+			func(arg, i, 0);
+		return;
+	}
+
+	if (pool->nthreads < nthreads-1) {
+		sigfillset(&all);
+		pthread_sigmask(SIG_SETMASK, &all, &saved);
+		while (pool->nthreads < nthreads-1) {
+			if (pthread_create(&pool->threads[pool->nthreads], NULL,
+			    parallel_worker, (void *)(long)pool->nthreads))
+				break;
+			pool->nthreads++;
+		}
+		pthread_sigmask(SIG_SETMASK, &saved, NULL);
+
+		if (CRASHDEBUG(1))
+			fprintf(fp, "run_parallel: %d worker threads\n",
+				pool->nthreads);
+	}
+
+	sigemptyset(&sigint);
+	sigaddset(&sigint, SIGINT);
+	pthread_sigmask(SIG_BLOCK, &sigint, &saved);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->func = func;
+	pool->arg = arg;
+	pool->njobs = njobs;
+	pool->next = 0;
+	pool->remaining = njobs;
+	pool->active = MIN(nthreads-1, pool->nthreads);
+	pool->generation++;
+	if (pool->active)
+		pthread_cond_broadcast(&pool->work_cv);
+
+	parallel_run_jobs(pool, 0);
+
+	while (pool->remaining)
+		pthread_cond_wait(&pool->done_cv, &pool->lock);
+	pool->func = NULL;
+	pool->arg = NULL;
+	pool->njobs = 0;
+	pthread_mutex_unlock(&pool->lock);
+
+	pthread_sigmask(SIG_SETMASK, &saved, NULL);
+}
+
+/*
+ *  The state of run_forked() jobs, in memory that is shared with the
+ *  worker processes.
+ */
+struct forked_job {
+	off_t offset;		/* output in the worker's file */
+	off_t size;
+	int worker;
+	int done;
+};
+
+struct forked_jobs {
+	int count;
+	int next;
+	int abort;
+	struct forked_job job[];
+};
+
+/*
+ *  Give the worker process its own file descriptions of the files that
+ *  crash has open for reading, such as the dumpfile, /proc/kcore or the
+ *  vmlinux file, since the file offsets of inherited descriptors are
+ *  shared with the other processes, and the dumpfile readers seek before
+ *  reading.  The current offsets are carried over, because the stdio and
+ *  bfd layers expect the file position they last left behind.
+ */
+static void
+forked_reopen_files(void)
+{
+	int i, cnt, fd, newfd, flags, fdflags;
+	int fds[1024];
+	off_t pos;
+	DIR *dirp;
+	struct dirent *dp;
+	struct stat sbuf;
+	char path[BUFSIZE];
+
+	if (!(dirp = opendir("/proc/self/fd")))
+		return;
+
+	for (cnt = 0; (dp = readdir(dirp)) && (cnt < 1024); ) {
+		if (!decimal(dp->d_name, 0))
+			continue;
+		fd = atoi(dp->d_name);
+		if ((fd > 2) && (fd != dirfd(dirp)))
+			fds[cnt++] = fd;
+	}
+	closedir(dirp);
+
+	for (i = 0; i < cnt; i++) {
+		fd = fds[i];
+		if ((fstat(fd, &sbuf) < 0) || !(S_ISREG(sbuf.st_mode) ||
+		    S_ISCHR(sbuf.st_mode) || S_ISBLK(sbuf.st_mode)))
+			continue;
+		if (((flags = fcntl(fd, F_GETFL)) < 0) ||
+		    ((flags & O_ACCMODE) == O_WRONLY) || (flags & O_APPEND))
+			continue;
+		if ((fdflags = fcntl(fd, F_GETFD)) < 0)
+			continue;
+
+		sprintf(path, "/proc/self/fd/%d", fd);
+		if ((newfd = open(path, flags & O_ACCMODE)) < 0)
+			continue;
+		if (((pos = lseek(fd, 0, SEEK_CUR)) != (off_t)-1) &&
+		    (lseek(newfd, pos, SEEK_SET) != pos)) {
+			close(newfd);
+			continue;
+		}
+		if (dup2(newfd, fd) == fd)
+			fcntl(fd, F_SETFD, fdflags);
+		close(newfd);
+	}
+}
+
+/*
+ *  "set trace file": write a Chrome trace event file, which can be loaded
+ *  into chrome://tracing or the Perfetto UI, containing a span for each
+ *  command, and nested spans for dumpfile reads, page decompressions,
+ *  gdb requests, list, tree and xarray walks, and back traces.  Each span
+ *  is written as a complete ("X") event when it ends.  The spans other
+ *  than commands are sampled by duration: those shorter than the
+ *  "set trace_min" value are counted but not written, which keeps the
+ *  file to a manageable size when a command makes millions of short
+ *  dumpfile reads.  Spans are only written by the crash process itself,
+ *  not by forked -j workers.
+ */
+static struct trace_output {
+	FILE *fp;
+	char *path;
+	pid_t pid;
+	struct timespec base;
+	ulong events;
+	ulong sampled_out;
+	ulong min_usecs;
+} trace_output = { .min_usecs = 10 };
+
+int
+trace_open(char *path)
+{
+	FILE *tfp;
+
+	if (!(tfp = fopen(path, "w"))) {
+		error(INFO, "cannot open trace file: %s: %s\n", path,
+			strerror(errno));
+		return FALSE;
+	}
+
+	trace_close();
+
+	trace_output.fp = tfp;
+	trace_output.path = strdup(path);
+	trace_output.pid = getpid();
+	trace_output.events = trace_output.sampled_out = 0;
+	clock_gettime(CLOCK_MONOTONIC, &trace_output.base);
+	fprintf(tfp, "[\n");
+
+	pc->flags2 |= TRACE_SPANS;
+	return TRUE;
+}
+
+void
+trace_close(void)
+{
+	pc->flags2 &= ~TRACE_SPANS;
+
+	if (!trace_output.fp)
+		return;
+
+	fprintf(trace_output.fp, "\n]\n");
+	fclose(trace_output.fp);
+	trace_output.fp = NULL;
+
+	if (CRASHDEBUG(1))
+		error(INFO, "trace: %s: %ld events written, %ld sampled out\n",
+			trace_output.path, trace_output.events,
+			trace_output.sampled_out);
+
+	free(trace_output.path);
+	trace_output.path = NULL;
+}
+
+/*
+ *  The current time in microseconds since the trace file was opened,
+ *  to be passed back to trace_span() when the span ends.
+ */
+ulonglong
+trace_time(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (ulonglong)(now.tv_sec - trace_output.base.tv_sec) * 1000000 +
+		(now.tv_nsec - trace_output.base.tv_nsec) / 1000 + 1;
+}
+
+static void
+trace_string(FILE *tfp, char *s)
+{
+	for ( ; *s; s++) {
+		if ((*s == '"') || (*s == '\\'))
+			fprintf(tfp, "\\%c", *s);
+		else if ((unsigned char)*s < ' ')
+			fprintf(tfp, "\\u%04x", (unsigned char)*s);
+		else
+			fputc(*s, tfp);
+	}
+}
+
+/*
+ *  End a span of category cat that began at start, as returned by
+ *  trace_time(); detail, if any, is written as the "detail" argument.
+ */
+void
+trace_span(char *cat, char *name, char *detail, ulonglong start)
+{
+	ulonglong end;
+	FILE *tfp;
+
+	if (!TRACING() || !start || !(tfp = trace_output.fp) ||
+	    (getpid() != trace_output.pid))
+		return;
+
+	end = trace_time();
+
+	if (!STREQ(cat, "command") && ((end - start) < trace_output.min_usecs)) {
+		trace_output.sampled_out++;
+		return;
+	}
+
+	fprintf(tfp, "%s{\"name\": \"", trace_output.events++ ? ",\n" : "");
+	trace_string(tfp, name);
+	fprintf(tfp, "\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %lld, "
+		"\"dur\": %lld, \"pid\": %d, \"tid\": %d",
+		cat, start, end - start, trace_output.pid, trace_output.pid);
+	if (detail) {
+		fprintf(tfp, ", \"args\": {\"detail\": \"");
+		trace_string(tfp, detail);
+		fprintf(tfp, "\"}");
+	}
+	fprintf(tfp, "}");
+}
+
+void
+trace_flush(void)
+{
+	if (trace_output.fp)
+		fflush(trace_output.fp);
+}
+
+void
+trace_set_min_usecs(ulong usecs)
+{
+	trace_output.min_usecs = usecs;
+}
+
+ulong
+trace_min_usecs(void)
+{
+	return trace_output.min_usecs;
+}
+
+char *
+trace_path(void)
+{
+	return trace_output.path;
+}
+
+/*
+ *  "set output json|csv": the commands that support structured output
+ *  display each row of their tables as a record, built from the values
+ *  that they would have formatted, instead of as a text line.  A record
+ *  is started with record_begin(), given its fields in order, and ended
+ *  with record_end().  JSON records are written as they are built, one
+ *  object per line.  CSV records are buffered so that a line of field
+ *  names can be written before the first record of a command, and again
+ *  whenever the command moves on to a different type of record.  Each
+ *  record's first field is its type.
+ */
+#define RECORD_LINE_SIZE (BUFSIZE*4)
+#define MAXLEN_RECORD_NUMBER (32)
+
+static struct record_output {
+	char *type;
+	char *header_type;
+	ulong header_cmdgen;
+	int fields;
+	int names_len;
+	int values_len;
+	char names[RECORD_LINE_SIZE];
+	char values[RECORD_LINE_SIZE];
+} record_output = { 0 };
+
+static char *output_format_names[] = { "text", "json", "csv" };
+
+int
+set_output_format(char *name)
+{
+	int i;
+
+	for (i = 0; i < sizeof(output_format_names)/sizeof(char *); i++) {
+		if (STREQ(name, output_format_names[i])) {
+			pc->output_format = i;
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+char *
+output_format_name(void)
+{
+	return output_format_names[pc->output_format];
+}
+
+/*
+ *  Append a CSV value, quoted if it contains a separator, a quote, a
+ *  line break or leading or trailing spaces.
+ */
+static void
+record_csv_append(char *buf, int *len, char *s)
+{
+	int quote;
+	char *p;
+
+	quote = strpbrk(s, ",\"\r\n") || (*s == ' ') ||
+		(strlen(s) && (s[strlen(s)-1] == ' '));
+
+	if (*len && (*len < RECORD_LINE_SIZE-1))
+		buf[(*len)++] = ',';
+	if (quote && (*len < RECORD_LINE_SIZE-1))
+		buf[(*len)++] = '"';
+	for (p = s; *p && (*len < RECORD_LINE_SIZE-2); p++) {
+		if (quote && (*p == '"'))
+			buf[(*len)++] = '"';
+		buf[(*len)++] = *p;
+	}
+	if (quote && (*len < RECORD_LINE_SIZE-1))
+		buf[(*len)++] = '"';
+	buf[*len] = NULLCHAR;
+}
+
+static void
+record_field(char *name, char *value, int quoted)
+{
+	switch (pc->output_format)
+	{
+	case OUTPUT_JSON:
+		fprintf(fp, ", \"%s\": ", name);
+		if (quoted) {
+			fputc('"', fp);
+			trace_string(fp, value);
+			fputc('"', fp);
+		} else
+			fprintf(fp, "%s", value);
+		break;
+
+	case OUTPUT_CSV:
+		record_csv_append(record_output.names,
+			&record_output.names_len, name);
+		record_csv_append(record_output.values,
+			&record_output.values_len, value);
+		break;
+	}
+
+	record_output.fields++;
+}
+
+void
+record_begin(char *type)
+{
+	record_output.type = type;
+	record_output.fields = 0;
+	record_output.names_len = record_output.values_len = 0;
+
+	switch (pc->output_format)
+	{
+	case OUTPUT_JSON:
+		fprintf(fp, "{\"record\": \"%s\"", type);
+		break;
+
+	case OUTPUT_CSV:
+		record_csv_append(record_output.names,
+			&record_output.names_len, "record");
+		record_csv_append(record_output.values,
+			&record_output.values_len, type);
+		break;
+	}
+}
+
+void
+record_string(char *name, char *value)
+{
+	record_field(name, value ? value : "", TRUE);
+}
+
+void
+record_long(char *name, long value)
+{
+	char buf[MAXLEN_RECORD_NUMBER];
+
+	sprintf(buf, "%ld", value);
+	record_field(name, buf, FALSE);
+}
+
+void
+record_ulong(char *name, ulong value)
+{
+	char buf[MAXLEN_RECORD_NUMBER];
+
+	sprintf(buf, "%lu", value);
+	record_field(name, buf, FALSE);
+}
+
+/*
+ *  Addresses are hexadecimal strings, without a 0x prefix, as they are
+ *  displayed by the text output.
+ */
+void
+record_hex(char *name, ulong value)
+{
+	char buf[MAXLEN_RECORD_NUMBER];
+
+	sprintf(buf, "%lx", value);
+	record_field(name, buf, TRUE);
+}
+
+void
+record_double(char *name, double value)
+{
+	char buf[MAXLEN_RECORD_NUMBER*2];
+
+	snprintf(buf, sizeof(buf), "%g", value);
+	record_field(name, buf, FALSE);
+}
+
+void
+record_bool(char *name, int value)
+{
+	record_field(name, value ? "true" : "false", FALSE);
+}
+
+void
+record_end(void)
+{
+	switch (pc->output_format)
+	{
+	case OUTPUT_JSON:
+		fprintf(fp, "}\n");
+		break;
+
+	case OUTPUT_CSV:
+		if ((record_output.header_cmdgen != pc->cmdgencur) ||
+		    !record_output.header_type ||
+		    !STREQ(record_output.header_type, record_output.type)) {
+			fprintf(fp, "%s\n", record_output.names);
+			record_output.header_cmdgen = pc->cmdgencur;
+			record_output.header_type = record_output.type;
+		}
+		fprintf(fp, "%s\n", record_output.values);
+		break;
+	}
+
+	record_output.type = NULL;
+}
+
+/*
+ *  A run_forked() worker process: claim jobs from the shared job array
+ *  and run them, writing the output of each to the worker's own file,
+ *  along with any error messages, and recording where it went.  A job
+ *  that cannot be completed in the worker, i.e., one that would have
+ *  caused a return to the command prompt, is left unmarked so that the
+ *  parent will run it again.
+ */
+static void
+forked_worker(struct forked_jobs *jobs, int worker, FILE *ofp,
+	      void (*func)(void *, int), void *arg)
+{
+	int j;
+	struct forked_job *job;
+	sigset_t sigint;
+
+	signal(SIGINT, SIG_IGN);
+	sigemptyset(&sigint);
+	sigaddset(&sigint, SIGINT);
+	sigprocmask(SIG_UNBLOCK, &sigint, NULL);
+
+	forked_reopen_files();
+
+	fp = ofp;
+	pc->stdpipe = NULL;
+	pc->error_fp = ofp;
+	pc->error_path = "redirect";
+
+	if (setjmp(pc->main_loop_env)) {
+		fflush(ofp);
+		_exit(1);
+	}
+
+	for (;;) {
+		j = __sync_fetch_and_add(&jobs->next, 1);
+		if ((j >= jobs->count) || jobs->abort)
+			break;
+
+		job = &jobs->job[j];
+		fflush(ofp);
+		job->offset = ftello(ofp);
+		job->worker = worker;
+
+		func(arg, j);
+
+		fflush(ofp);
+		job->size = ftello(ofp) - job->offset;
+		__sync_synchronize();
+		job->done = TRUE;
+	}
+
+	fflush(ofp);
+	_exit(0);
+}
+
+/*
+ *  Copy a worker's output for a job to fp.
+ */
+static void
+forked_job_output(FILE *ofp, struct forked_job *job)
+{
+	char buf[BUFSIZE*4];
+	off_t offset, left;
+	ssize_t cnt;
+
+	for (offset = job->offset, left = job->size; left > 0;
+	     offset += cnt, left -= cnt) {
+		cnt = pread(fileno(ofp), buf, MIN(left, (off_t)sizeof(buf)),
+			offset);
+		if (cnt <= 0)
+			break;
+		fwrite(buf, 1, cnt, fp);
+	}
+}
+
+/*
+ *  Run func(arg, job) for each job from 0 to njobs-1, spread across up to
+ *  nworkers processes forked from this one, so that each has a private
+ *  copy of crash's state, including the buffer pool, the readmem() caches,
+ *  the hash queue and gdb, none of which can be shared between threads.
+ *  The output of each job is written to its worker's file, and displayed
+ *  in job order once the workers are done, producing the same output as
+ *  a serial loop, with error messages shown in-line.  The jobs must not
+ *  depend on state left behind by the jobs before them.  Jobs that a
+ *  worker failed to complete are run again here, in order.
+ *
+ *  Returns FORKED_SERIAL if the jobs were not started, and should be run
+ *  by the caller, FORKED_DONE when they have all been run, or
+ *  FORKED_BAILOUT if the command was interrupted, in which case the
+ *  buffers have been freed.
+ */
+int
+run_forked(int nworkers, int njobs, void (*func)(void *, int), void *arg)
+{
+	int j, k, w, alive, interrupted;
+	size_t size;
+	struct forked_jobs *jobs;
+	struct forked_job *job;
+	FILE *wfp[MAX_PARALLEL_THREADS];
+	pid_t pids[MAX_PARALLEL_THREADS];
+	sigset_t sigint, saved;
+	struct timespec timeout;
+	int status;
+
+	if (REMOTE()) {
+		error(INFO, "-j is not supported on remote dumpfiles\n");
+		return FORKED_SERIAL;
+	}
+
+	if ((nworkers < 2) || (njobs < 2))
+		return FORKED_SERIAL;
+
+	size = sizeof(struct forked_jobs) + njobs * sizeof(struct forked_job);
+	jobs = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS,
+		-1, 0);
+	if (jobs == MAP_FAILED) {
+		error(INFO, "cannot mmap job array: %s\n", strerror(errno));
+		return FORKED_SERIAL;
+	}
+	jobs->count = njobs;
+
+	nworkers = MIN(MIN(nworkers, njobs), MAX_PARALLEL_THREADS);
+	for (w = 0; w < nworkers; w++) {
+		if (!(wfp[w] = tmpfile())) {
+			error(INFO, "cannot create worker output file: %s\n",
+				strerror(errno));
+			break;
+		}
+	}
+	nworkers = w;
+
+	sigemptyset(&sigint);
+	sigaddset(&sigint, SIGINT);
+	sigprocmask(SIG_BLOCK, &sigint, &saved);
+	fflush(NULL);
+
+	for (w = alive = 0; w < nworkers; w++) {
+		if ((pids[w] = fork()) == 0)
+			forked_worker(jobs, w, wfp[w], func, arg);
+		if (pids[w] < 0) {
+			error(INFO, "cannot fork worker: %s\n", strerror(errno));
+			break;
+		}
+		alive++;
+	}
+
+	if (CRASHDEBUG(1))
+		fprintf(fp, "run_forked: %d jobs, %d worker processes\n",
+			jobs->count, alive);
+
+	interrupted = FALSE;
+	timeout.tv_sec = 0;
+	timeout.tv_nsec = 100000000;
+
+	while (alive) {
+		for (k = 0; k < w; k++) {
+			if ((pids[k] > 0) &&
+			    (waitpid(pids[k], &status, WNOHANG) == pids[k])) {
+				pids[k] = 0;
+				alive--;
+			}
+		}
+		if (alive && (sigtimedwait(&sigint, NULL, &timeout) == SIGINT) &&
+		    !interrupted) {
+			interrupted = TRUE;
+			jobs->abort = TRUE;
+			for (k = 0; k < w; k++) {
+				if (pids[k] > 0)
+					kill(pids[k], SIGKILL);
+			}
+		}
+	}
+
+	sigprocmask(SIG_SETMASK, &saved, NULL);
+
+	for (j = 0; !interrupted && (j < jobs->count); j++) {
+		if (output_closed() || received_SIGINT()) {
+			interrupted = TRUE;
+			break;
+		}
+
+		job = &jobs->job[j];
+		if (job->done && (job->worker < nworkers))
+			forked_job_output(wfp[job->worker], job);
+		else
+			func(arg, j);
+	}
+
+	for (w = 0; w < nworkers; w++)
+		fclose(wfp[w]);
+	munmap(jobs, size);
+
+	if (interrupted) {
+		free_all_bufs();
+		return FORKED_BAILOUT;
+	}
+
+	return FORKED_DONE;
+}
+
+/*
+ *  Parsed VMCOREINFO data, shared by the dumpfile formats and the live
+ *  memory sources that find the note.  The "key=value" lines are split
+ *  once into a hash table, along with the decimal value of each entry,
+ *  so that the many pc->read_vmcoreinfo() calls made while the session
+ *  initializes do not each have to search -- or in some cases re-read --
+ *  the note.  The first line of a duplicated key is the one that counts,
+ *  as it always was with the note text searches.
+ */
+#define VMCOREINFO_HASH (256)
+
+struct vmcoreinfo_entry {
+	struct vmcoreinfo_entry *next;
+	char *key;
+	char *value;
+	long integer;
+};
+
+static struct vmcoreinfo_table {
+	const char *note;	/* source of the data */
+	size_t size;
+	char *data;		/* copy of the note, split into strings */
+	struct vmcoreinfo_entry *entries;
+	int count;
+	struct vmcoreinfo_entry *hash[VMCOREINFO_HASH];
+} vmcoreinfo_table = { 0 };
+
+static ulong
+vmcoreinfo_hash(const char *key)
+{
+	ulong hash;
+
+	for (hash = 5381; *key; key++)
+		hash = (hash * 33) ^ (unsigned char)*key;
+
+	return hash % VMCOREINFO_HASH;
+}
+
+static struct vmcoreinfo_entry *
+vmcoreinfo_entry(const char *key)
+{
+	struct vmcoreinfo_entry *e;
+
+	for (e = vmcoreinfo_table.hash[vmcoreinfo_hash(key)]; e; e = e->next) {
+		if (STREQ(e->key, key))
+			return e;
+	}
+
+	return NULL;
+}
+
+static void
+vmcoreinfo_table_free(void)
+{
+	free(vmcoreinfo_table.data);
+	free(vmcoreinfo_table.entries);
+	BZERO(&vmcoreinfo_table, sizeof(struct vmcoreinfo_table));
+}
+
+/*
+ *  Parse the size bytes of VMCOREINFO note data at note, unless the
+ *  table already holds that note.  Callers whose note data is in a
+ *  temporary buffer only call this once.  The data ends at its first
+ *  NUL character, if any.  Returns FALSE if the table could not be
+ *  built, in which case there is no table.
+ */
+int
+vmcoreinfo_table_init(const char *note, size_t size)
+{
+	char *p, *line, *end, *eq;
+	struct vmcoreinfo_entry *e;
+	ulong h;
+	int lines;
+
+	if (vmcoreinfo_table.data && (vmcoreinfo_table.note == note) &&
+	    (vmcoreinfo_table.size == size))
+		return TRUE;
+
+	vmcoreinfo_table_free();
+
+	if (!note || !size)
+		return FALSE;
+
+	if (!(vmcoreinfo_table.data = malloc(size+1))) {
+		error(INFO, "cannot malloc vmcoreinfo table\n");
+		return FALSE;
+	}
+	memcpy(vmcoreinfo_table.data, note, size);
+	vmcoreinfo_table.data[size] = NULLCHAR;
+	end = vmcoreinfo_table.data + strlen(vmcoreinfo_table.data);
+
+	for (lines = 1, p = vmcoreinfo_table.data; p < end; p++) {
+		if (*p == '\n')
+			lines++;
+	}
+
+	if (!(vmcoreinfo_table.entries = calloc(lines,
+	    sizeof(struct vmcoreinfo_entry)))) {
+		error(INFO, "cannot malloc vmcoreinfo table\n");
+		vmcoreinfo_table_free();
+		return FALSE;
+	}
+
+	for (line = vmcoreinfo_table.data; line < end; line = p + 1) {
+		if ((p = strchr(line, '\n')))
+			*p = NULLCHAR;
+		else
+			p = end;
+		if (!(eq = strchr(line, '=')) || (eq == line))
+			continue;
+		*eq = NULLCHAR;
+		if (vmcoreinfo_entry(line))
+			continue;
+
+		e = &vmcoreinfo_table.entries[vmcoreinfo_table.count++];
+		e->key = line;
+		e->value = eq + 1;
+		e->integer = atol(e->value);
+		h = vmcoreinfo_hash(e->key);
+		e->next = vmcoreinfo_table.hash[h];
+		vmcoreinfo_table.hash[h] = e;
+	}
+
+	vmcoreinfo_table.note = note;
+	vmcoreinfo_table.size = size;
+
+	if (CRASHDEBUG(4))
+		fprintf(fp, "vmcoreinfo table: %d entries from %ld bytes\n",
+			vmcoreinfo_table.count, (ulong)size);
+
+	return TRUE;
+}
+
+/*
+ *  The pc->read_vmcoreinfo() side of the table: returns a copy of the
+ *  value of key, which has to be freed by the caller, or NULL if the key
+ *  is not there.
+ */
+char *
+vmcoreinfo_table_read_string(const char *key)
+{
+	struct vmcoreinfo_entry *e;
+
+	if (!vmcoreinfo_table.data || !(e = vmcoreinfo_entry(key)))
+		return NULL;
+
+	return strdup(e->value);
+}
+
+/*
+ *  Return the decimal value of key, or default_value if it is not there.
+ *  Sources that do not use the table are asked by way of
+ *  pc->read_vmcoreinfo().
+ */
+long
+vmcoreinfo_read_integer(const char *key, long default_value)
+{
+	struct vmcoreinfo_entry *e;
+	char *string;
+	long retval = default_value;
+
+	if (vmcoreinfo_table.data) {
+		if ((e = vmcoreinfo_entry(key)))
+			retval = e->integer;
+	} else if ((string = pc->read_vmcoreinfo(key))) {
+		retval = atol(string);
+		free(string);
+	}
+
+	return retval;
+}
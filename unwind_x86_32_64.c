@@ -35,12 +35,46 @@ static struct local_unwind_table {
         } core, init;
         void *address;
         unsigned long size;
+	struct fde_entry *fde_index;	/* FDEs sorted by startLoc */
+	int fde_count;
+	int fde_index_state;
 } *local_unwind_tables, default_unwind_table;
 
+/*
+ *  A valid FDE found in an unwind table, along with its CIE and the
+ *  location of its instructions.
+ */
+struct fde_entry {
+	unsigned long startLoc;
+	unsigned long endLoc;
+	const u32 *fde;
+	const u32 *cie;
+	const u8 *ptr;
+	signed ptrType;
+};
+
+#define FDE_INDEX_UNBUILT  (0)
+#define FDE_INDEX_BUILT    (1)
+#define FDE_INDEX_LINEAR   (2)	/* overlapping FDEs, or malloc failure */
+
+/*
+ *  The core and init text ranges of the local_unwind_tables, sorted
+ *  by address for find_table().
+ */
+static struct unwind_table_range {
+	unsigned long start;
+	unsigned long end;
+	struct local_unwind_table *table;
+} *unwind_table_ranges;
+static int unwind_table_ranges_cnt = 0;
+
 static int gather_in_memory_unwind_tables(void);
 static int populate_local_tables(ulong, char *);
 static int unwind_tables_cnt = 0;
+static void build_unwind_table_ranges(void);
 static struct local_unwind_table *find_table(unsigned long);
+static int find_fde(struct local_unwind_table *, unsigned long, int,
+	struct fde_entry *);
 static void dump_local_unwind_tables(void);
 
 static const struct {
@@ -146,6 +180,69 @@ struct unwind_state {
 
 static const struct cfa badCFA = { ARRAY_SIZE(reg_info), 1 };
 
+/*
+ *  The CFA and register rules that processCFI() produces for a PC depend
+ *  only upon the unwind tables, which are read once during initialization,
+ *  so they are cached here by PC, along with the errors of PCs that cannot
+ *  be unwound.  Only the frame update is then done for each frame.
+ */
+#define CFI_CACHE_ENTRIES  (4096)	/* power of 2 */
+#define CFI_CACHE_HASH(pc) 	((((pc) >> 4) ^ ((pc) >> 16)) & (CFI_CACHE_ENTRIES-1))
+
+static struct cfi_cache {
+	struct cfi_cache_entry {
+		unsigned long pc;	/* 0 if unused */
+		int is_ehframe;
+		int error;
+		sleb128_t dataAlign;
+		struct cfa cfa;
+		struct unwind_item regs[ARRAY_SIZE(reg_info)];
+	} *entries;
+	ulong hits;
+	ulong misses;
+} cfi_cache = { 0 };
+
+static struct cfi_cache_entry *
+cfi_cache_lookup(unsigned long pc, int is_ehframe)
+{
+	struct cfi_cache_entry *ce;
+
+	if (!cfi_cache.entries &&
+	    !(cfi_cache.entries = calloc(CFI_CACHE_ENTRIES,
+	    sizeof(struct cfi_cache_entry))))
+		return NULL;
+
+	ce = &cfi_cache.entries[CFI_CACHE_HASH(pc)];
+	if ((ce->pc == pc) && (ce->is_ehframe == is_ehframe)) {
+		cfi_cache.hits++;
+		return ce;
+	}
+
+	cfi_cache.misses++;
+	return NULL;
+}
+
+static int
+cfi_cache_enter(unsigned long pc, int is_ehframe, int error,
+		struct unwind_state *state)
+{
+	struct cfi_cache_entry *ce;
+
+	if (cfi_cache.entries) {
+		ce = &cfi_cache.entries[CFI_CACHE_HASH(pc)];
+		ce->pc = pc;
+		ce->is_ehframe = is_ehframe;
+		ce->error = error;
+		if (state) {
+			ce->dataAlign = state->dataAlign;
+			ce->cfa = state->cfa;
+			memcpy(ce->regs, state->regs, sizeof(ce->regs));
+		}
+	}
+
+	return error;
+}
+
 static uleb128_t get_uleb128(const u8 **pcur, const u8 *end)
 {
 	const u8 *cur = *pcur;
@@ -506,8 +603,9 @@ unwind(struct unwind_frame_info *frame, int is_ehframe)
 	signed ptrType = -1;
 	uleb128_t retAddrReg = 0;
 //	struct unwind_table *table;
-	void *unwind_table;
 	struct local_unwind_table *table;
+	struct fde_entry fe;
+	struct cfi_cache_entry *ce;
 	struct unwind_state state;
 	u64 reg_ptr = 0;
 
@@ -515,52 +613,23 @@ unwind(struct unwind_frame_info *frame, int is_ehframe)
 	if (UNW_PC(frame) == 0)
 		return -EINVAL;
 
-	if ((table = find_table(UNW_PC(frame)))) {
-//		unsigned long tableSize = unwind_table_size;
-		unsigned long tableSize = table->size;
-
-		unwind_table = table->address;
+	if ((ce = cfi_cache_lookup(UNW_PC(frame), is_ehframe))) {
+		if (ce->error)
+			return ce->error;
+		state.dataAlign = ce->dataAlign;
+		state.cfa = ce->cfa;
+		memcpy(state.regs, ce->regs, sizeof(state.regs));
+		goto update_frame;
+	}
 
-		for (fde = unwind_table;
-		     tableSize > sizeof(*fde) && tableSize - sizeof(*fde) >= *fde;
-		     tableSize -= sizeof(*fde) + *fde,
-		     fde += 1 + *fde / sizeof(*fde)) {
-			if (!*fde || (*fde & (sizeof(*fde) - 1)))
-				break;
-			if (is_ehframe && !fde[1])
-				continue; /* this is a CIE */
-			else if (fde[1] == 0xffffffff)
-				continue; /* this is a CIE */
-			if ((fde[1] & (sizeof(*fde) - 1))
-			    || fde[1] > (unsigned long)(fde + 1)
-			                - (unsigned long)unwind_table)
-				continue; /* this is not a valid FDE */
-			if (is_ehframe)
-				cie = fde + 1 - fde[1] / sizeof(*fde);
-			else
-				cie = unwind_table + fde[1];
-			if (*cie <= sizeof(*cie) + 4
-			    || *cie >= fde[1] - sizeof(*fde)
-			    || (*cie & (sizeof(*cie) - 1))
-			    || (cie[1] != 0xffffffff && cie[1])
-			    || (ptrType = fde_pointer_type(cie)) < 0) {
-				cie = NULL; /* this is not a (valid) CIE */
-				continue;
-			}
-			ptr = (const u8 *)(fde + 2);
-			startLoc = read_pointer(&ptr,
-			                        (const u8 *)(fde + 1) + *fde,
-			                        ptrType);
-			endLoc = startLoc
-			         + read_pointer(&ptr,
-			                        (const u8 *)(fde + 1) + *fde,
-			                        ptrType & DW_EH_PE_indirect
-			                        ? ptrType
-			                        : ptrType & (DW_EH_PE_FORM|DW_EH_PE_signed));
-			if (UNW_PC(frame) >= startLoc && UNW_PC(frame) < endLoc)
-				break;
-			cie = NULL;
-		}
+	if ((table = find_table(UNW_PC(frame))) &&
+	    find_fde(table, UNW_PC(frame), is_ehframe, &fe)) {
+		fde = fe.fde;
+		cie = fe.cie;
+		ptr = fe.ptr;
+		ptrType = fe.ptrType;
+		startLoc = fe.startLoc;
+		endLoc = fe.endLoc;
 	}
 	if (cie != NULL) {
 		memset(&state, 0, sizeof(state));
@@ -616,7 +685,7 @@ unwind(struct unwind_frame_info *frame, int is_ehframe)
 		}
 	}
 	if (cie == NULL || fde == NULL)
-		return -ENXIO;
+		return cfi_cache_enter(UNW_PC(frame), is_ehframe, -ENXIO, NULL);
 
 	state.org = startLoc;
 	memcpy(&state.cfa, &badCFA, sizeof(state.cfa));
@@ -627,8 +696,10 @@ unwind(struct unwind_frame_info *frame, int is_ehframe)
 	   || state.cfa.reg >= ARRAY_SIZE(reg_info)
 	   || reg_info[state.cfa.reg].width != sizeof(unsigned long)
 	   || state.cfa.offs % sizeof(unsigned long)) {
-		return -EIO;
+		return cfi_cache_enter(UNW_PC(frame), is_ehframe, -EIO, NULL);
 		}
+	cfi_cache_enter(UNW_PC(frame), is_ehframe, 0, &state);
+update_frame:
 	/* update frame */
 	cfa = FRAME_REG(state.cfa.reg, unsigned long) + state.cfa.offs;
 	startLoc = min((unsigned long)UNW_SP(frame), cfa);
@@ -990,6 +1061,7 @@ populate_local_tables(ulong root, char *buf)
 	}
 
 	unwind_tables_cnt = cnt;
+	build_unwind_table_ranges();
 
 	if (CRASHDEBUG(7))
 		dump_local_unwind_tables();
@@ -1000,17 +1072,99 @@ failed:
 	return unwind_tables_cnt;
 }
 
+static int
+compare_unwind_table_range(const void *v1, const void *v2)
+{
+	const struct unwind_table_range *r1, *r2;
+
+	r1 = (const struct unwind_table_range *)v1;
+	r2 = (const struct unwind_table_range *)v2;
+
+	if (r1->start < r2->start)
+		return -1;
+	if (r1->start > r2->start)
+		return 1;
+	return 0;
+}
+
+/*
+ *  Create the address-sorted array of core and init text ranges that
+ *  find_table() binary-searches.  If any ranges overlap, the first table
+ *  in list order has to be used, so the array is not created and
+ *  find_table() falls back to a linear scan.
+ */
+static void
+build_unwind_table_ranges(void)
+{
+	int i, cnt;
+	struct local_unwind_table *tp;
+	struct unwind_table_range *rp;
+
+	if ((unwind_tables_cnt <= 0) || !(unwind_table_ranges =
+	    malloc(sizeof(struct unwind_table_range) * unwind_tables_cnt * 2)))
+		return;
+
+	for (i = cnt = 0; i < unwind_tables_cnt; i++) {
+		tp = &local_unwind_tables[i];
+		if (tp->core.range) {
+			rp = &unwind_table_ranges[cnt++];
+			rp->start = tp->core.pc;
+			rp->end = tp->core.pc + tp->core.range;
+			rp->table = tp;
+		}
+		if (tp->init.range) {
+			rp = &unwind_table_ranges[cnt++];
+			rp->start = tp->init.pc;
+			rp->end = tp->init.pc + tp->init.range;
+			rp->table = tp;
+		}
+	}
+
+	qsort(unwind_table_ranges, cnt, sizeof(struct unwind_table_range),
+		compare_unwind_table_range);
+
+	for (i = 1; i < cnt; i++) {
+		if (unwind_table_ranges[i].start < unwind_table_ranges[i-1].end) {
+			if (CRASHDEBUG(1))
+				error(INFO, "overlapping unwind_table ranges: "
+				    "using linear table search\n");
+			free(unwind_table_ranges);
+			unwind_table_ranges = NULL;
+			return;
+		}
+	}
+
+	unwind_table_ranges_cnt = cnt;
+}
+
 /*
  *  Find the unwind_table containing a pc.
  */
 static struct local_unwind_table *
 find_table(unsigned long pc)
 {
-	int i;
+	int i, lo, hi, mid;
 	struct local_unwind_table *tp, *table;
+	struct unwind_table_range *rp;
 
 	table = &default_unwind_table;
 
+	if (unwind_table_ranges) {
+		lo = 0;
+		hi = unwind_table_ranges_cnt - 1;
+		while (lo <= hi) {
+			mid = (lo + hi) / 2;
+			rp = &unwind_table_ranges[mid];
+			if (pc < rp->start)
+				hi = mid - 1;
+			else if (pc >= rp->end)
+				lo = mid + 1;
+			else
+				return rp->table;
+		}
+		return table;
+	}
+
         for (i = 0; i < unwind_tables_cnt; i++, tp++) {
 		tp = &local_unwind_tables[i];
                 if ((pc >= tp->core.pc
@@ -1025,6 +1179,213 @@ find_table(unsigned long pc)
         return table;
 }
 
+/*
+ *  Walk the entries of an unwind table, calling the callback function
+ *  with each valid FDE until it returns TRUE.  Returns the number of
+ *  valid FDEs passed to the callback function.
+ */
+static int
+walk_fdes(struct local_unwind_table *table, int is_ehframe,
+	  int (*callback)(struct fde_entry *, void *), void *arg)
+{
+	const u32 *fde, *cie;
+	const u8 *ptr;
+	unsigned long tableSize;
+	void *unwind_table;
+	struct fde_entry fe;
+	signed ptrType;
+	int cnt;
+
+	unwind_table = table->address;
+	tableSize = table->size;
+	cnt = 0;
+
+	for (fde = unwind_table;
+	     tableSize > sizeof(*fde) && tableSize - sizeof(*fde) >= *fde;
+	     tableSize -= sizeof(*fde) + *fde,
+	     fde += 1 + *fde / sizeof(*fde)) {
+		if (!*fde || (*fde & (sizeof(*fde) - 1)))
+			break;
+		if (is_ehframe && !fde[1])
+			continue; /* this is a CIE */
+		else if (fde[1] == 0xffffffff)
+			continue; /* this is a CIE */
+		if ((fde[1] & (sizeof(*fde) - 1))
+		    || fde[1] > (unsigned long)(fde + 1)
+		                - (unsigned long)unwind_table)
+			continue; /* this is not a valid FDE */
+		if (is_ehframe)
+			cie = fde + 1 - fde[1] / sizeof(*fde);
+		else
+			cie = unwind_table + fde[1];
+		if (*cie <= sizeof(*cie) + 4
+		    || *cie >= fde[1] - sizeof(*fde)
+		    || (*cie & (sizeof(*cie) - 1))
+		    || (cie[1] != 0xffffffff && cie[1])
+		    || (ptrType = fde_pointer_type(cie)) < 0)
+			continue; /* this is not a (valid) CIE */
+		ptr = (const u8 *)(fde + 2);
+		fe.startLoc = read_pointer(&ptr,
+		                           (const u8 *)(fde + 1) + *fde,
+		                           ptrType);
+		fe.endLoc = fe.startLoc
+		         + read_pointer(&ptr,
+		                        (const u8 *)(fde + 1) + *fde,
+		                        ptrType & DW_EH_PE_indirect
+		                        ? ptrType
+		                        : ptrType & (DW_EH_PE_FORM|DW_EH_PE_signed));
+		fe.fde = fde;
+		fe.cie = cie;
+		fe.ptr = ptr;
+		fe.ptrType = ptrType;
+		cnt++;
+		if (callback(&fe, arg))
+			break;
+	}
+
+	return cnt;
+}
+
+struct fde_search {
+	unsigned long pc;
+	struct fde_entry *fe;
+	int found;
+};
+
+static int
+fde_search_callback(struct fde_entry *fe, void *arg)
+{
+	struct fde_search *fs = (struct fde_search *)arg;
+
+	if (fs->pc >= fe->startLoc && fs->pc < fe->endLoc) {
+		*fs->fe = *fe;
+		fs->found = TRUE;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static int
+fde_count_callback(struct fde_entry *fe, void *arg)
+{
+	return FALSE;
+}
+
+static int
+fde_index_callback(struct fde_entry *fe, void *arg)
+{
+	struct local_unwind_table *table = (struct local_unwind_table *)arg;
+
+	table->fde_index[table->fde_count++] = *fe;
+
+	return FALSE;
+}
+
+static int
+compare_fde_entry(const void *v1, const void *v2)
+{
+	const struct fde_entry *fe1, *fe2;
+
+	fe1 = (const struct fde_entry *)v1;
+	fe2 = (const struct fde_entry *)v2;
+
+	if (fe1->startLoc < fe2->startLoc)
+		return -1;
+	if (fe1->startLoc > fe2->startLoc)
+		return 1;
+	return 0;
+}
+
+/*
+ *  Create a table's FDE search index, sorted by start address.  Empty
+ *  FDEs can never match, and are left out.  As with the table ranges,
+ *  overlapping FDEs would make the result depend upon table order, so
+ *  such a table is always searched linearly.
+ */
+static void
+build_fde_index(struct local_unwind_table *table, int is_ehframe)
+{
+	int i, cnt;
+
+	table->fde_index_state = FDE_INDEX_LINEAR;
+
+	if (!(cnt = walk_fdes(table, is_ehframe, fde_count_callback, NULL)))
+		return;
+
+	if (!(table->fde_index = malloc(sizeof(struct fde_entry) * cnt)))
+		return;
+
+	table->fde_count = 0;
+	walk_fdes(table, is_ehframe, fde_index_callback, table);
+
+	for (i = cnt = 0; i < table->fde_count; i++) {
+		if (table->fde_index[i].endLoc > table->fde_index[i].startLoc)
+			table->fde_index[cnt++] = table->fde_index[i];
+	}
+	table->fde_count = cnt;
+
+	qsort(table->fde_index, cnt, sizeof(struct fde_entry),
+		compare_fde_entry);
+
+	for (i = 1; i < cnt; i++) {
+		if (table->fde_index[i].startLoc <
+		    table->fde_index[i-1].endLoc) {
+			if (CRASHDEBUG(1))
+				error(INFO, "overlapping FDEs in unwind table %lx: "
+				    "using linear FDE search\n",
+					(ulong)table->address);
+			free(table->fde_index);
+			table->fde_index = NULL;
+			table->fde_count = 0;
+			return;
+		}
+	}
+
+	table->fde_index_state = FDE_INDEX_BUILT;
+}
+
+/*
+ *  Find the FDE covering a pc in an unwind table, using the table's
+ *  FDE search index, which is created upon first use.
+ */
+static int
+find_fde(struct local_unwind_table *table, unsigned long pc, int is_ehframe,
+	 struct fde_entry *fe)
+{
+	int lo, hi, mid;
+	struct fde_entry *ep;
+	struct fde_search fs;
+
+	if (table->fde_index_state == FDE_INDEX_UNBUILT)
+		build_fde_index(table, is_ehframe);
+
+	if (table->fde_index_state == FDE_INDEX_BUILT) {
+		lo = 0;
+		hi = table->fde_count - 1;
+		while (lo <= hi) {
+			mid = (lo + hi) / 2;
+			ep = &table->fde_index[mid];
+			if (pc < ep->startLoc)
+				hi = mid - 1;
+			else if (pc >= ep->endLoc)
+				lo = mid + 1;
+			else {
+				*fe = *ep;
+				return TRUE;
+			}
+		}
+		return FALSE;
+	}
+
+	fs.pc = pc;
+	fs.fe = fe;
+	fs.found = FALSE;
+	walk_fdes(table, is_ehframe, fde_search_callback, &fs);
+
+	return fs.found;
+}
+
 static void 
 dump_local_unwind_tables(void)
 {
@@ -1048,8 +1409,18 @@ dump_local_unwind_tables(void)
 	fprintf(fp, "default_unwind_table:\n");
 	fprintf(fp, "      address: %lx\n",
 		(ulong)default_unwind_table.address);
-	fprintf(fp, "         size: %ld\n\n",
+	fprintf(fp, "         size: %ld\n",
 		(ulong)default_unwind_table.size);
+	fprintf(fp, "    fde_index: %lx (%d FDEs)\n\n",
+		(ulong)default_unwind_table.fde_index,
+		default_unwind_table.fde_count);
+
+	fprintf(fp, "unwind_table_ranges: %lx (%d ranges)\n",
+		(ulong)unwind_table_ranges, unwind_table_ranges_cnt);
+	fprintf(fp, "          cfi_cache: %lx (%d entries)\n",
+		(ulong)cfi_cache.entries, CFI_CACHE_ENTRIES);
+	fprintf(fp, "     cfi_cache hits: %ld\n", cfi_cache.hits);
+	fprintf(fp, "   cfi_cache misses: %ld\n\n", cfi_cache.misses);
 
 	fprintf(fp, "local_unwind_tables[%d]:\n", unwind_tables_cnt);
         for (i = 0; i < unwind_tables_cnt; i++, tp++) {
@@ -1061,6 +1432,8 @@ dump_local_unwind_tables(void)
 		fprintf(fp, "        range: %ld\n", tp->init.range);
 		fprintf(fp, "      address: %lx\n", (ulong)tp->address);
 		fprintf(fp, "         size: %ld\n", tp->size);
+		fprintf(fp, "    fde_index: %lx (%d FDEs)\n",
+			(ulong)tp->fde_index, tp->fde_count);
 	}
 }
 
@@ -60,6 +60,361 @@ is_vmware_vmss(char *filename)
 	return TRUE;
 }
 
+/*
+ *  Decode the tags of a group, starting at the current file position.
+ *  Returns FALSE if the dumpfile cannot be used.
+ */
+static int
+vmss_parse_group(FILE *fp, char *group, char *filename, FILE *ofp)
+{
+	for (;;) {
+		uint16_t tag;
+		char name[TAG_NAMELEN_MASK + 1];
+		unsigned nameLen;
+		unsigned nindx;
+		int idx[3];
+		unsigned j;
+		int nextgroup = FALSE;
+
+		if (fread(&tag, sizeof(tag), 1, fp) != 1) {
+			error(INFO, LOGPRX"Cannot read tag.\n");
+			break;
+		}
+		if (tag == NULL_TAG)
+			break;
+
+		nameLen = TAG_NAMELEN(tag);
+		if (fread(name, nameLen, 1, fp) != 1) {
+			error(INFO, LOGPRX"Cannot read tag name.\n");
+			break;
+		}
+		name[nameLen] = 0;
+		DEBUG_PARSE_PRINT((ofp, LOGPRX"\t Item %20s", name));
+
+		nindx = TAG_NINDX(tag);
+		if (nindx > 3) {
+			error(INFO, LOGPRX"Too many indexes %d (> 3).\n", nindx);
+			break;
+		}
+		idx[0] = idx[1] = idx[2] = NO_INDEX;
+		for (j= 0; j < nindx; j++) {
+			if (fread(&idx[j], sizeof(idx[0]), 1, fp) != 1) {
+				error(INFO, LOGPRX"Cannot read index.\n");
+				nextgroup = TRUE;
+				break;
+			}
+			DEBUG_PARSE_PRINT((ofp, "[%d]", idx[j]));
+		}
+		if (nextgroup) {
+			DEBUG_PARSE_PRINT((ofp, "\n"));
+			break;
+		}
+
+		if (IS_BLOCK_TAG(tag)) {
+			uint64_t nbytes;
+			uint64_t blockpos;
+			uint64_t nbytesinmem;
+			int compressed = IS_BLOCK_COMPRESSED_TAG(tag);
+			uint16_t padsize;
+
+			if (fread(&nbytes, sizeof(nbytes), 1, fp) != 1) {
+				error(INFO, LOGPRX"Cannot read block size.\n");
+				break;
+			}
+			if (fread(&nbytesinmem, sizeof(nbytesinmem), 1, fp) != 1) {
+				error(INFO, LOGPRX"Cannot read block memory size.\n");
+				break;
+			}
+			if (fread(&padsize, sizeof(padsize), 1, fp) != 1) {
+				error(INFO, LOGPRX"Cannot read block padding size.\n");
+				break;
+			}
+			if ((blockpos = ftell(fp)) == -1) {
+				error(INFO, LOGPRX"Cannot determine location within VMSS file.\n");
+				break;
+			}
+			blockpos += padsize;
+
+			if (strcmp(name, "Memory") == 0) {
+				/* The things that we really care about...*/
+				vmss.memoffset = blockpos;
+				vmss.memsize = nbytesinmem;
+				vmss.separate_vmem = FALSE;
+				DEBUG_PARSE_PRINT((ofp, "\t=> %sBLOCK: position=%#llx size=%#llx memsize=%#llx\n",
+						   compressed ? "COMPRESSED " : "",
+						   (ulonglong)blockpos, (ulonglong)nbytes, (ulonglong)nbytesinmem));
+
+				if (compressed) {
+					error(INFO, LOGPRX"Cannot handle compressed memory dump yet!\n");
+					return FALSE;
+				}
+
+				if (fseek(fp, blockpos + nbytes, SEEK_SET) == -1) {
+					error(INFO, LOGPRX"Cannot seek past block at %#llx.\n",
+					      (ulonglong)(blockpos + nbytes));
+					break;
+				}
+			} else if (strcmp(name, "gpregs") == 0 &&
+				   nbytes == VMW_GPREGS_SIZE &&
+				   idx[0] < vmss.num_vcpus) {
+				int cpu = idx[0];
+				if (fread(vmss.regs64[cpu], VMW_GPREGS_SIZE, 1, fp) != 1) {
+					error(INFO, LOGPRX"Failed to read '%s': [Error %d] %s\n",
+					      filename, errno, strerror(errno));
+					break;
+				}
+				DEBUG_PARSE_PRINT((ofp, "\n"));
+				vmss.vcpu_regs[cpu] |= REGS_PRESENT_GPREGS;
+			} else if (strcmp(name, "CR64") == 0 &&
+				   nbytes == VMW_CR64_SIZE &&
+				   idx[0] < vmss.num_vcpus) {
+				int cpu = idx[0];
+				DEBUG_PARSE_PRINT((ofp, "\t=> "));
+				if (fread(&vmss.regs64[cpu]->cr[0], VMW_CR64_SIZE, 1, fp) != 1) {
+					error(INFO, LOGPRX"Failed to read '%s': [Error %d] %s\n",
+					      filename, errno, strerror(errno));
+					break;
+				}
+				for (j = 0; j < VMW_CR64_SIZE / 8; j++)
+					DEBUG_PARSE_PRINT((ofp, "%s%016llX", j ? " " : "",
+							(ulonglong)vmss.regs64[cpu]->cr[j]));
+				DEBUG_PARSE_PRINT((ofp, "\n"));
+				vmss.vcpu_regs[cpu] |= REGS_PRESENT_CRS;
+			} else if (strcmp(name, "IDTR") == 0 &&
+				   nbytes == VMW_IDTR_SIZE &&
+				   idx[0] < vmss.num_vcpus) {
+				int cpu = idx[0];
+				uint64_t idtr;
+				if (fseek(fp, blockpos + 2, SEEK_SET) == -1) {
+					error(INFO, LOGPRX"Cannot seek past block at %#llx.\n",
+					      (ulonglong)(blockpos + 2));
+					break;
+				}
+				if (fread(&idtr, sizeof(idtr), 1, fp) != 1) {
+					error(INFO, LOGPRX"Failed to read '%s': [Error %d] %s\n",
+					      filename, errno, strerror(errno));
+					break;
+				}
+				DEBUG_PARSE_PRINT((ofp, "\n"));
+				vmss.regs64[cpu]->idtr = idtr;
+				vmss.vcpu_regs[cpu] |= REGS_PRESENT_IDTR;
+			} else {
+				if (fseek(fp, blockpos + nbytes, SEEK_SET) == -1) {
+					error(INFO, LOGPRX"Cannot seek past block at %#llx.\n",
+					      (ulonglong)(blockpos + nbytes));
+					break;
+				}
+				DEBUG_PARSE_PRINT((ofp, "\n"));
+			}
+		} else {
+			union {
+				uint8_t val[TAG_VALSIZE_MASK];
+				uint32_t val32;
+				uint64_t val64;
+			} u;
+			unsigned k;
+			unsigned valsize = TAG_VALSIZE(tag);
+			uint64_t blockpos = ftell(fp);
+
+			DEBUG_PARSE_PRINT((ofp, "\t=> position=%#llx size=%#x: ", (ulonglong)blockpos, valsize));
+			if (fread(u.val, sizeof(u.val[0]), valsize, fp) != valsize) {
+				error(INFO, LOGPRX"Cannot read item.\n");
+				break;
+			}
+			for (k = 0; k < valsize; k++) {
+				/* Assume Little Endian */
+				DEBUG_PARSE_PRINT((ofp, "%02X", u.val[valsize - k - 1]));
+			}
+
+			if (strcmp(group, "memory") == 0) {
+				if (strcmp(name, "regionsCount") == 0) {
+					vmss.regionscount = u.val32;
+				}
+				if ((strcmp(name, "regionPageNum") == 0 ||
+				     strcmp(name, "regionPPN") == 0 ||
+				     strcmp(name, "regionSize") == 0) &&
+				    (idx[0] < 0 || idx[0] >= MAX_REGIONS)) {
+					error(INFO, LOGPRX"Too many memory regions (> %d).\n",
+					      MAX_REGIONS);
+					return FALSE;
+				}
+			        if (strcmp(name, "regionPageNum") == 0) {
+					vmss.regions[idx[0]].startpagenum = u.val32;
+				}
+				if (strcmp(name, "regionPPN") == 0) {
+					vmss.regions[idx[0]].startppn = u.val32;
+				}
+				if (strcmp(name, "regionSize") == 0) {
+					vmss.regions[idx[0]].size = u.val32;
+				}
+				if (strcmp(name, "align_mask") == 0) {
+					vmss.alignmask = u.val32;
+				}
+			} else if (strcmp(group, "cpu") == 0) {
+				if (strcmp(name, "cpu:numVCPUs") == 0) {
+					if (vmss.regs64 != NULL) {
+						error(INFO, LOGPRX"Duplicated cpu:numVCPUs entry.\n");
+						break;
+					}
+
+					vmss.num_vcpus = u.val32;
+					vmss.regs64 = malloc(vmss.num_vcpus * sizeof(void *));
+					vmss.vcpu_regs = malloc(vmss.num_vcpus * sizeof(uint32_t));
+
+					for (k = 0; k < vmss.num_vcpus; k++) {
+						vmss.regs64[k] = malloc(sizeof(vmssregs64));
+						memset(vmss.regs64[k], 0, sizeof(vmssregs64));
+						vmss.vcpu_regs[k] = 0;
+					}
+				} else if (strcmp(name, "rax") == 0) {
+					int cpu = idx[0];
+					vmss.regs64[cpu]->rax = u.val64;
+					vmss.vcpu_regs[cpu] |= REGS_PRESENT_RAX;
+				} else if (strcmp(name, "rcx") == 0) {
+					int cpu = idx[0];
+					vmss.regs64[cpu]->rcx = u.val64;
+					vmss.vcpu_regs[cpu] |= REGS_PRESENT_RCX;
+				} else if (strcmp(name, "rdx") == 0) {
+					int cpu = idx[0];
+					vmss.regs64[cpu]->rdx = u.val64;
+					vmss.vcpu_regs[cpu] |= REGS_PRESENT_RDX;
+				} else if (strcmp(name, "rbx") == 0) {
+					int cpu = idx[0];
+					vmss.regs64[cpu]->rbx = u.val64;
+					vmss.vcpu_regs[cpu] |= REGS_PRESENT_RBX;
+				} else if (strcmp(name, "rbp") == 0) {
+					int cpu = idx[0];
+					vmss.regs64[cpu]->rbp = u.val64;
+					vmss.vcpu_regs[cpu] |= REGS_PRESENT_RBP;
+				} else if (strcmp(name, "rsp") == 0) {
+					int cpu = idx[0];
+					vmss.regs64[cpu]->rsp = u.val64;
+					vmss.vcpu_regs[cpu] |= REGS_PRESENT_RSP;
+				} else if (strcmp(name, "rsi") == 0) {
+					int cpu = idx[0];
+					vmss.regs64[cpu]->rsi = u.val64;
+					vmss.vcpu_regs[cpu] |= REGS_PRESENT_RSI;
+				} else if (strcmp(name, "rdi") == 0) {
+					int cpu = idx[0];
+					vmss.regs64[cpu]->rdi = u.val64;
+					vmss.vcpu_regs[cpu] |= REGS_PRESENT_RDI;
+				} else if (strcmp(name, "r8") == 0) {
+					int cpu = idx[0];
+					vmss.regs64[cpu]->r8 = u.val64;
+					vmss.vcpu_regs[cpu] |= REGS_PRESENT_R8;
+				} else if (strcmp(name, "r9") == 0) {
+					int cpu = idx[0];
+					vmss.regs64[cpu]->r9 = u.val64;
+					vmss.vcpu_regs[cpu] |= REGS_PRESENT_R9;
+				} else if (strcmp(name, "r10") == 0) {
+					int cpu = idx[0];
+					vmss.regs64[cpu]->r10 = u.val64;
+					vmss.vcpu_regs[cpu] |= REGS_PRESENT_R10;
+				} else if (strcmp(name, "r11") == 0) {
+					int cpu = idx[0];
+					vmss.regs64[cpu]->r11 = u.val64;
+					vmss.vcpu_regs[cpu] |= REGS_PRESENT_R11;
+				} else if (strcmp(name, "r12") == 0) {
+					int cpu = idx[0];
+					vmss.regs64[cpu]->r12 = u.val64;
+					vmss.vcpu_regs[cpu] |= REGS_PRESENT_R12;
+				} else if (strcmp(name, "r13") == 0) {
+					int cpu = idx[0];
+					vmss.regs64[cpu]->r13 = u.val64;
+					vmss.vcpu_regs[cpu] |= REGS_PRESENT_R13;
+				} else if (strcmp(name, "r14") == 0) {
+					int cpu = idx[0];
+					vmss.regs64[cpu]->r14 = u.val64;
+					vmss.vcpu_regs[cpu] |= REGS_PRESENT_R14;
+				} else if (strcmp(name, "r15") == 0) {
+					int cpu = idx[0];
+					vmss.regs64[cpu]->r15 = u.val64;
+					vmss.vcpu_regs[cpu] |= REGS_PRESENT_R15;
+				} else if (strcmp(name, "CR64") == 0) {
+					int cpu = idx[0];
+					switch (idx[1]) {
+						case 0:
+							vmss.regs64[cpu]->cr[0] = u.val64;
+							vmss.vcpu_regs[cpu] |= REGS_PRESENT_CR0;
+							break;
+						case 1:
+							vmss.regs64[cpu]->cr[1] = u.val64;
+							vmss.vcpu_regs[cpu] |= REGS_PRESENT_CR1;
+							break;
+						case 2:
+							vmss.regs64[cpu]->cr[2] = u.val64;
+							vmss.vcpu_regs[cpu] |= REGS_PRESENT_CR2;
+							break;
+						case 3:
+							vmss.regs64[cpu]->cr[3] = u.val64;
+							vmss.vcpu_regs[cpu] |= REGS_PRESENT_CR3;
+							break;
+						case 4:
+							vmss.regs64[cpu]->cr[4] = u.val64;
+							vmss.vcpu_regs[cpu] |= REGS_PRESENT_CR4;
+							break;
+					}
+				} else if (strcmp(name, "IDTR") == 0) {
+					int cpu = idx[0];
+					if (idx[1] == 1)
+						vmss.regs64[cpu]->idtr = u.val32;
+					else if (idx[1] == 2) {
+						vmss.regs64[cpu]->idtr |= (uint64_t) u.val32 << 32;
+						vmss.vcpu_regs[cpu] |= REGS_PRESENT_IDTR;
+					}
+				} else if (strcmp(name, "rip") == 0) {
+					int cpu = idx[0];
+					vmss.regs64[cpu]->rip = u.val64;
+					vmss.vcpu_regs[cpu] |= REGS_PRESENT_RIP;
+				} else if (strcmp(name, "eflags") == 0) {
+					int cpu = idx[0];
+					vmss.regs64[cpu]->rflags |= u.val32;
+					vmss.vcpu_regs[cpu] |= REGS_PRESENT_RFLAGS;
+				} else if (strcmp(name, "EFLAGS") == 0) {
+					int cpu = idx[0];
+					vmss.regs64[cpu]->rflags |= u.val32;
+					vmss.vcpu_regs[cpu] |= REGS_PRESENT_RFLAGS;
+				}
+			}
+
+			DEBUG_PARSE_PRINT((ofp, "\n"));
+		}
+	}
+
+	return TRUE;
+}
+
+/*
+ *  The vCPU state is not decoded by vmware_vmss_init(), but by the
+ *  first function that needs it.
+ */
+static void
+vmss_load_vcpus(void)
+{
+	FILE *vfp;
+
+	if (vmss.vcpus_loaded)
+		return;
+	vmss.vcpus_loaded = TRUE;
+
+	if (!vmss.cpugroup_offset)
+		return;
+
+	if ((vfp = fopen(vmss.filename, "r")) == NULL) {
+		error(INFO, LOGPRX"Failed to open '%s': [Error %d] %s\n",
+		      vmss.filename, errno, strerror(errno));
+		return;
+	}
+
+	if (fseek(vfp, vmss.cpugroup_offset, SEEK_SET) == -1)
+		error(INFO, LOGPRX"Bad offset of VMSS Group['cpu'] in '%s' at %#llx.\n",
+		      vmss.filename, (ulonglong)vmss.cpugroup_offset);
+	else
+		vmss_parse_group(vfp, "cpu", vmss.filename, fp);
+
+	fclose(vfp);
+}
+
 int
 vmware_vmss_init(char *filename, FILE *ofp)
 {
@@ -84,6 +439,7 @@ vmware_vmss_init(char *filename, FILE *ofp)
 		result = FALSE;
 		goto exit;
         }
+	vmss.filename = filename;
 
 	if (fread(&hdr, sizeof(cptdumpheader), 1, fp) != 1) {
 		error(INFO, LOGPRX"Failed to read '%s': %s [Error %d] %s\n",
@@ -132,311 +488,18 @@ vmware_vmss_init(char *filename, FILE *ofp)
 			continue;
 		}
 
-		for (;;) {
-			uint16_t tag;
-			char name[TAG_NAMELEN_MASK + 1];
-			unsigned nameLen;
-			unsigned nindx;
-			int idx[3];
-			unsigned j;
-			int nextgroup = FALSE;
-
-			if (fread(&tag, sizeof(tag), 1, fp) != 1) {
-				error(INFO, LOGPRX"Cannot read tag.\n");
-				break;
-			}
-			if (tag == NULL_TAG)
-				break;
-
-			nameLen = TAG_NAMELEN(tag);
-			if (fread(name, nameLen, 1, fp) != 1) {
-				error(INFO, LOGPRX"Cannot read tag name.\n");
-				break;
-			}
-			name[nameLen] = 0;
-			DEBUG_PARSE_PRINT((ofp, LOGPRX"\t Item %20s", name));
-
-			nindx = TAG_NINDX(tag);
-			if (nindx > 3) {
-				error(INFO, LOGPRX"Too many indexes %d (> 3).\n", nindx);
-				break;
-			}
-			idx[0] = idx[1] = idx[2] = NO_INDEX;
-			for (j= 0; j < nindx; j++) {
-				if (fread(&idx[j], sizeof(idx[0]), 1, fp) != 1) {
-					error(INFO, LOGPRX"Cannot read index.\n");
-					nextgroup = TRUE;
-					break;
-				}
-				DEBUG_PARSE_PRINT((ofp, "[%d]", idx[j]));
-			}
-			if (nextgroup) {
-				DEBUG_PARSE_PRINT((ofp, "\n"));
-				break;
-			}
-
-			if (IS_BLOCK_TAG(tag)) {
-				uint64_t nbytes;
-				uint64_t blockpos;
-				uint64_t nbytesinmem;
-				int compressed = IS_BLOCK_COMPRESSED_TAG(tag);
-				uint16_t padsize;
-
-				if (fread(&nbytes, sizeof(nbytes), 1, fp) != 1) {
-					error(INFO, LOGPRX"Cannot read block size.\n");
-					break;
-				}
-				if (fread(&nbytesinmem, sizeof(nbytesinmem), 1, fp) != 1) {
-					error(INFO, LOGPRX"Cannot read block memory size.\n");
-					break;
-				}
-				if (fread(&padsize, sizeof(padsize), 1, fp) != 1) {
-					error(INFO, LOGPRX"Cannot read block padding size.\n");
-					break;
-				}
-				if ((blockpos = ftell(fp)) == -1) {
-					error(INFO, LOGPRX"Cannot determine location within VMSS file.\n");
-					break;
-				}
-				blockpos += padsize;
-
-				if (strcmp(name, "Memory") == 0) {
-					/* The things that we really care about...*/
-					vmss.memoffset = blockpos;
-					vmss.memsize = nbytesinmem;
-					vmss.separate_vmem = FALSE;
-					DEBUG_PARSE_PRINT((ofp, "\t=> %sBLOCK: position=%#llx size=%#llx memsize=%#llx\n",
-							   compressed ? "COMPRESSED " : "",
-							   (ulonglong)blockpos, (ulonglong)nbytes, (ulonglong)nbytesinmem));
-
-					if (compressed) {
-						error(INFO, LOGPRX"Cannot handle compressed memory dump yet!\n");
-						result = FALSE;
-						goto exit;
-					}
-
-					if (fseek(fp, blockpos + nbytes, SEEK_SET) == -1) {
-						error(INFO, LOGPRX"Cannot seek past block at %#llx.\n",
-						      (ulonglong)(blockpos + nbytes));
-						break;
-					}
-				} else if (strcmp(name, "gpregs") == 0 &&
-					   nbytes == VMW_GPREGS_SIZE &&
-					   idx[0] < vmss.num_vcpus) {
-					int cpu = idx[0];
-					if (fread(vmss.regs64[cpu], VMW_GPREGS_SIZE, 1, fp) != 1) {
-						error(INFO, LOGPRX"Failed to read '%s': [Error %d] %s\n",
-						      filename, errno, strerror(errno));
-						break;
-					}
-					DEBUG_PARSE_PRINT((ofp, "\n"));
-					vmss.vcpu_regs[cpu] |= REGS_PRESENT_GPREGS;
-				} else if (strcmp(name, "CR64") == 0 &&
-					   nbytes == VMW_CR64_SIZE &&
-					   idx[0] < vmss.num_vcpus) {
-					int cpu = idx[0];
-					DEBUG_PARSE_PRINT((ofp, "\t=> "));
-					if (fread(&vmss.regs64[cpu]->cr[0], VMW_CR64_SIZE, 1, fp) != 1) {
-						error(INFO, LOGPRX"Failed to read '%s': [Error %d] %s\n",
-						      filename, errno, strerror(errno));
-						break;
-					}
-					for (j = 0; j < VMW_CR64_SIZE / 8; j++)
-						DEBUG_PARSE_PRINT((ofp, "%s%016llX", j ? " " : "",
-								(ulonglong)vmss.regs64[cpu]->cr[j]));
-					DEBUG_PARSE_PRINT((ofp, "\n"));
-					vmss.vcpu_regs[cpu] |= REGS_PRESENT_CRS;
-				} else if (strcmp(name, "IDTR") == 0 &&
-					   nbytes == VMW_IDTR_SIZE &&
-					   idx[0] < vmss.num_vcpus) {
-					int cpu = idx[0];
-					uint64_t idtr;
-					if (fseek(fp, blockpos + 2, SEEK_SET) == -1) {
-						error(INFO, LOGPRX"Cannot seek past block at %#llx.\n",
-						      (ulonglong)(blockpos + 2));
-						break;
-					}
-					if (fread(&idtr, sizeof(idtr), 1, fp) != 1) {
-						error(INFO, LOGPRX"Failed to read '%s': [Error %d] %s\n",
-						      filename, errno, strerror(errno));
-						break;
-					}
-					DEBUG_PARSE_PRINT((ofp, "\n"));
-					vmss.regs64[cpu]->idtr = idtr;
-					vmss.vcpu_regs[cpu] |= REGS_PRESENT_IDTR;
-				} else {
-					if (fseek(fp, blockpos + nbytes, SEEK_SET) == -1) {
-						error(INFO, LOGPRX"Cannot seek past block at %#llx.\n",
-						      (ulonglong)(blockpos + nbytes));
-						break;
-					}
-					DEBUG_PARSE_PRINT((ofp, "\n"));
-				}
-			} else {
-				union {
-					uint8_t val[TAG_VALSIZE_MASK];
-					uint32_t val32;
-					uint64_t val64;
-				} u;
-				unsigned k;
-				unsigned valsize = TAG_VALSIZE(tag);
-				uint64_t blockpos = ftell(fp);
-
-				DEBUG_PARSE_PRINT((ofp, "\t=> position=%#llx size=%#x: ", (ulonglong)blockpos, valsize));
-				if (fread(u.val, sizeof(u.val[0]), valsize, fp) != valsize) {
-					error(INFO, LOGPRX"Cannot read item.\n");
-					break;
-				}
-				for (k = 0; k < valsize; k++) {
-					/* Assume Little Endian */
-					DEBUG_PARSE_PRINT((ofp, "%02X", u.val[valsize - k - 1]));
-				}
-
-				if (strcmp(grps[i].name, "memory") == 0) {
-					if (strcmp(name, "regionsCount") == 0) {
-						vmss.regionscount = u.val32;
-					}
-				        if (strcmp(name, "regionPageNum") == 0) {
-						vmss.regions[idx[0]].startpagenum = u.val32;
-					}
-					if (strcmp(name, "regionPPN") == 0) {
-						vmss.regions[idx[0]].startppn = u.val32;
-					}
-					if (strcmp(name, "regionSize") == 0) {
-						vmss.regions[idx[0]].size = u.val32;
-					}
-					if (strcmp(name, "align_mask") == 0) {
-						vmss.alignmask = u.val32;
-					}
-				} else if (strcmp(grps[i].name, "cpu") == 0) {
-					if (strcmp(name, "cpu:numVCPUs") == 0) {
-						if (vmss.regs64 != NULL) {
-							error(INFO, LOGPRX"Duplicated cpu:numVCPUs entry.\n");
-							break;
-						}
-
-						vmss.num_vcpus = u.val32;
-						vmss.regs64 = malloc(vmss.num_vcpus * sizeof(void *));
-						vmss.vcpu_regs = malloc(vmss.num_vcpus * sizeof(uint32_t));
-
-						for (k = 0; k < vmss.num_vcpus; k++) {
-							vmss.regs64[k] = malloc(sizeof(vmssregs64));
-							memset(vmss.regs64[k], 0, sizeof(vmssregs64));
-							vmss.vcpu_regs[k] = 0;
-						}
-					} else if (strcmp(name, "rax") == 0) {
-						int cpu = idx[0];
-						vmss.regs64[cpu]->rax = u.val64;
-						vmss.vcpu_regs[cpu] |= REGS_PRESENT_RAX;
-					} else if (strcmp(name, "rcx") == 0) {
-						int cpu = idx[0];
-						vmss.regs64[cpu]->rcx = u.val64;
-						vmss.vcpu_regs[cpu] |= REGS_PRESENT_RCX;
-					} else if (strcmp(name, "rdx") == 0) {
-						int cpu = idx[0];
-						vmss.regs64[cpu]->rdx = u.val64;
-						vmss.vcpu_regs[cpu] |= REGS_PRESENT_RDX;
-					} else if (strcmp(name, "rbx") == 0) {
-						int cpu = idx[0];
-						vmss.regs64[cpu]->rbx = u.val64;
-						vmss.vcpu_regs[cpu] |= REGS_PRESENT_RBX;
-					} else if (strcmp(name, "rbp") == 0) {
-						int cpu = idx[0];
-						vmss.regs64[cpu]->rbp = u.val64;
-						vmss.vcpu_regs[cpu] |= REGS_PRESENT_RBP;
-					} else if (strcmp(name, "rsp") == 0) {
-						int cpu = idx[0];
-						vmss.regs64[cpu]->rsp = u.val64;
-						vmss.vcpu_regs[cpu] |= REGS_PRESENT_RSP;
-					} else if (strcmp(name, "rsi") == 0) {
-						int cpu = idx[0];
-						vmss.regs64[cpu]->rsi = u.val64;
-						vmss.vcpu_regs[cpu] |= REGS_PRESENT_RSI;
-					} else if (strcmp(name, "rdi") == 0) {
-						int cpu = idx[0];
-						vmss.regs64[cpu]->rdi = u.val64;
-						vmss.vcpu_regs[cpu] |= REGS_PRESENT_RDI;
-					} else if (strcmp(name, "r8") == 0) {
-						int cpu = idx[0];
-						vmss.regs64[cpu]->r8 = u.val64;
-						vmss.vcpu_regs[cpu] |= REGS_PRESENT_R8;
-					} else if (strcmp(name, "r9") == 0) {
-						int cpu = idx[0];
-						vmss.regs64[cpu]->r9 = u.val64;
-						vmss.vcpu_regs[cpu] |= REGS_PRESENT_R9;
-					} else if (strcmp(name, "r10") == 0) {
-						int cpu = idx[0];
-						vmss.regs64[cpu]->r10 = u.val64;
-						vmss.vcpu_regs[cpu] |= REGS_PRESENT_R10;
-					} else if (strcmp(name, "r11") == 0) {
-						int cpu = idx[0];
-						vmss.regs64[cpu]->r11 = u.val64;
-						vmss.vcpu_regs[cpu] |= REGS_PRESENT_R11;
-					} else if (strcmp(name, "r12") == 0) {
-						int cpu = idx[0];
-						vmss.regs64[cpu]->r12 = u.val64;
-						vmss.vcpu_regs[cpu] |= REGS_PRESENT_R12;
-					} else if (strcmp(name, "r13") == 0) {
-						int cpu = idx[0];
-						vmss.regs64[cpu]->r13 = u.val64;
-						vmss.vcpu_regs[cpu] |= REGS_PRESENT_R13;
-					} else if (strcmp(name, "r14") == 0) {
-						int cpu = idx[0];
-						vmss.regs64[cpu]->r14 = u.val64;
-						vmss.vcpu_regs[cpu] |= REGS_PRESENT_R14;
-					} else if (strcmp(name, "r15") == 0) {
-						int cpu = idx[0];
-						vmss.regs64[cpu]->r15 = u.val64;
-						vmss.vcpu_regs[cpu] |= REGS_PRESENT_R15;
-					} else if (strcmp(name, "CR64") == 0) {
-						int cpu = idx[0];
-						switch (idx[1]) {
-							case 0:
-								vmss.regs64[cpu]->cr[0] = u.val64;
-								vmss.vcpu_regs[cpu] |= REGS_PRESENT_CR0;
-								break;
-							case 1:
-								vmss.regs64[cpu]->cr[1] = u.val64;
-								vmss.vcpu_regs[cpu] |= REGS_PRESENT_CR1;
-								break;
-							case 2:
-								vmss.regs64[cpu]->cr[2] = u.val64;
-								vmss.vcpu_regs[cpu] |= REGS_PRESENT_CR2;
-								break;
-							case 3:
-								vmss.regs64[cpu]->cr[3] = u.val64;
-								vmss.vcpu_regs[cpu] |= REGS_PRESENT_CR3;
-								break;
-							case 4:
-								vmss.regs64[cpu]->cr[4] = u.val64;
-								vmss.vcpu_regs[cpu] |= REGS_PRESENT_CR4;
-								break;
-						}
-					} else if (strcmp(name, "IDTR") == 0) {
-						int cpu = idx[0];
-						if (idx[1] == 1)
-							vmss.regs64[cpu]->idtr = u.val32;
-						else if (idx[1] == 2) {
-							vmss.regs64[cpu]->idtr |= (uint64_t) u.val32 << 32;
-							vmss.vcpu_regs[cpu] |= REGS_PRESENT_IDTR;
-						}
-					} else if (strcmp(name, "rip") == 0) {
-						int cpu = idx[0];
-						vmss.regs64[cpu]->rip = u.val64;
-						vmss.vcpu_regs[cpu] |= REGS_PRESENT_RIP;
-					} else if (strcmp(name, "eflags") == 0) {
-						int cpu = idx[0];
-						vmss.regs64[cpu]->rflags |= u.val32;
-						vmss.vcpu_regs[cpu] |= REGS_PRESENT_RFLAGS;
-					} else if (strcmp(name, "EFLAGS") == 0) {
-						int cpu = idx[0];
-						vmss.regs64[cpu]->rflags |= u.val32;
-						vmss.vcpu_regs[cpu] |= REGS_PRESENT_RFLAGS;
-					}
-				}
+		/*
+		 *  Only the memory group is needed to open the dumpfile;
+		 *  the vCPU state is decoded by vmss_load_vcpus().
+		 */
+		if (strcmp(grps[i].name, "cpu") == 0) {
+			vmss.cpugroup_offset = grps[i].position;
+			continue;
+		}
 
-				DEBUG_PARSE_PRINT((ofp, "\n"));
-			}
+		if (!vmss_parse_group(fp, grps[i].name, filename, ofp)) {
+			result = FALSE;
+			goto exit;
 		}
 	}
 
@@ -478,7 +541,15 @@ vmware_vmss_init(char *filename, FILE *ofp)
 		free(vmem_filename);
 	}
 
+	if (vmss.regionscount > MAX_REGIONS) {
+		error(INFO, LOGPRX"Too many memory regions (%d > %d).\n",
+		      vmss.regionscount, MAX_REGIONS);
+		result = FALSE;
+		goto exit;
+	}
+
 	vmss.dfp = fp;
+	vmware_vmss_map_memory();
 
 exit:
 	if (grps)
@@ -495,6 +566,67 @@ uint vmware_vmss_page_size(void)
 	return VMW_PAGE_SIZE;
 }
 
+static int
+compare_region_index(const void *v1, const void *v2)
+{
+	const struct vmss_region_index *r1 = v1, *r2 = v2;
+
+	if (r1->startppn < r2->startppn)
+		return -1;
+	if (r1->startppn > r2->startppn)
+		return 1;
+	return 0;
+}
+
+/*
+ *  Called once the memory layout is known, by both vmware_vmss_init()
+ *  and vmware_guestdump_init().  Sort the memory regions by their
+ *  starting PPN, with the total size of the holes below each of them,
+ *  so that read_vmware_vmss() can binary-search them.  Then map the
+ *  memory image, so that reads are copied out of the mapping rather
+ *  than each one requiring an fseek() and fread().
+ */
+void
+vmware_vmss_map_memory(void)
+{
+	int i, n;
+	uint64_t holes;
+	off_t base;
+	size_t size;
+	char *addr;
+
+	for (i = n = 0; i < vmss.regionscount; i++) {
+		vmss.region_index[n].startppn = vmss.regions[i].startppn;
+		vmss.region_index[n].hole =
+			vmss.regions[i].startppn - vmss.regions[i].startpagenum;
+		n++;
+	}
+	qsort(vmss.region_index, n, sizeof(struct vmss_region_index),
+		compare_region_index);
+	for (i = 0, holes = 0; i < n; i++) {
+		holes += vmss.region_index[i].hole;
+		vmss.region_index[i].hole = holes;
+	}
+
+	base = vmss.memoffset & ~((uint64_t)getpagesize() - 1);
+	size = vmss.memsize + (vmss.memoffset - base);
+	if (!vmss.dfp || !vmss.memsize || ((uint64_t)size !=
+	    vmss.memsize + (vmss.memoffset - base)))
+		return;
+
+	addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(vmss.dfp), base);
+	if (addr == MAP_FAILED) {
+		if (CRASHDEBUG(1))
+			error(INFO, LOGPRX"mmap: %s\n", strerror(errno));
+		return;
+	}
+	madvise(addr, size, MADV_RANDOM);
+
+	vmss.memmap = addr;
+	vmss.memmap_size = size;
+	vmss.memmap_offset = vmss.memoffset - base;
+}
+
 int
 read_vmware_vmss(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr)
 {
@@ -503,18 +635,20 @@ read_vmware_vmss(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr)
 	if (vmss.regionscount > 0) {
 		/* Memory is divided into regions and there are holes between them. */
 		uint32_t ppn = (uint32_t) (pos >> VMW_PAGE_SHIFT);
-	        int i;
-
-		for (i = 0; i < vmss.regionscount; i++) {
-			uint32_t hole;
-
-			if (ppn < vmss.regions[i].startppn)
-				break;
-
-			/* skip holes. */
-			hole = vmss.regions[i].startppn - vmss.regions[i].startpagenum;
-			pos -= (uint64_t)hole << VMW_PAGE_SHIFT;
+		int lo, hi, mid, i;
+
+		/* skip the holes below the last region starting at or below ppn. */
+		for (i = -1, lo = 0, hi = vmss.regionscount - 1; lo <= hi; ) {
+			mid = (lo + hi) / 2;
+			if (ppn < vmss.region_index[mid].startppn)
+				hi = mid - 1;
+			else {
+				i = mid;
+				lo = mid + 1;
+			}
 		}
+		if (i >= 0)
+			pos -= vmss.region_index[i].hole << VMW_PAGE_SHIFT;
 	}
 
 	if (pos + cnt > vmss.memsize) {
@@ -522,11 +656,13 @@ read_vmware_vmss(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr)
 		      paddr, cnt);
 	}
 
-	pos += vmss.memoffset;
-        if (fseek(vmss.dfp, pos, SEEK_SET) != 0)
-		return SEEK_ERROR;
+	if (vmss.memmap && (pos + cnt <= vmss.memsize)) {
+		memcpy(bufptr, vmss.memmap + vmss.memmap_offset + pos, cnt);
+		return cnt;
+	}
 
-	if (fread(bufptr, 1, cnt, vmss.dfp) != cnt)
+	pos += vmss.memoffset;
+	if (pread(fileno(vmss.dfp), bufptr, cnt, pos) != cnt)
 		return READ_ERROR;
 
 	return cnt;
@@ -541,6 +677,8 @@ write_vmware_vmss(int fd, void *bufptr, int cnt, ulong addr, physaddr_t paddr)
 void
 vmware_vmss_display_regs(int cpu, FILE *ofp)
 {
+	vmss_load_vcpus();
+
 	if (cpu >= vmss.num_vcpus)
 		return;
 
@@ -579,6 +717,8 @@ get_vmware_vmss_regs(struct bt_info *bt, ulong *ipp, ulong *spp)
 {
 	ulong ip, sp;
 
+	vmss_load_vcpus();
+
 	ip = sp = 0;
 
 	if (bt->tc->processor >= vmss.num_vcpus ||
@@ -833,6 +973,8 @@ dump_registers_for_vmss_dump(void)
 		return;
 	}
 
+	vmss_load_vcpus();
+
 	for (i = 0; i < vmss.num_vcpus; i++) {
 		regs = vmss.regs64[i];
 
@@ -870,7 +1012,9 @@ dump_registers_for_vmss_dump(void)
 int
 vmware_vmss_valid_regs(struct bt_info *bt)
 {
-	if (vmss.vcpu_regs[bt->tc->processor] == REGS_PRESENT_ALL)
+	vmss_load_vcpus();
+	if (vmss.vcpu_regs && (bt->tc->processor < vmss.num_vcpus) &&
+	    (vmss.vcpu_regs[bt->tc->processor] == REGS_PRESENT_ALL))
 		return TRUE;
 
 	return FALSE;
@@ -879,12 +1023,15 @@ vmware_vmss_valid_regs(struct bt_info *bt)
 int
 vmware_vmss_get_nr_cpus(void)
 {
+	vmss_load_vcpus();
 	return vmss.num_vcpus;
 }
 
 int
 vmware_vmss_get_cr3_cr4_idtr(int cpu, ulong *cr3, ulong *cr4, ulong *idtr)
 {
+	vmss_load_vcpus();
+
 	if (cpu >= vmss.num_vcpus || vmss.vcpu_regs[cpu] != REGS_PRESENT_ALL)
 		return FALSE;
 
@@ -899,6 +1046,8 @@ int
 vmware_vmss_get_cpu_reg(int cpu, int regno, const char *name, int size,
                         void *value)
 {
+	vmss_load_vcpus();
+
         if (cpu >= vmss.num_vcpus)
                 return FALSE;
 
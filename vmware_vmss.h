@@ -146,7 +146,13 @@ typedef struct vmssregs64 vmssregs64;
 #define REGS_PRESENT_CRS    4063232
 #define REGS_PRESENT_ALL    16777215
 
-#define MAX_REGIONS	3
+#define MAX_REGIONS	64
+
+struct vmss_region_index {
+	uint64_t	startppn;
+	uint64_t	hole;		/* total size of the holes below startppn */
+};
+
 struct vmssdata {
 	int32_t	cpt64bit;
 	FILE	*dfp;
@@ -162,6 +168,12 @@ struct vmssdata {
 	uint32_t	*vcpu_regs;
 	uint64_t	num_vcpus;
 	vmssregs64	**regs64;
+	uint64_t	cpugroup_offset;
+	int		vcpus_loaded;
+	struct vmss_region_index region_index[MAX_REGIONS];
+	char		*memmap;
+	size_t		memmap_size;
+	uint64_t	memmap_offset;
 };
 typedef struct vmssdata vmssdata;
 
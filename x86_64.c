@@ -120,6 +120,7 @@ static ulong x86_64_get_stacktop_hyper(ulong);
 static int x86_64_framesize_cache_resize(void);
 static int x86_64_do_not_cache_framesize(struct syment *, ulong);
 static int x86_64_framesize_cache_func(int, ulong, int *, int, struct syment *);
+static void x86_64_framesize_cache_save(void);
 static ulong x86_64_get_framepointer(struct bt_info *, ulong);
 int search_for_eframe_target_caller(struct bt_info *, ulong, int *);
 static int x86_64_get_framesize(struct bt_info *, ulong, ulong);
@@ -196,6 +197,7 @@ x86_64_init(int when)
 		machdep->machspec->irq_stack_gap = UNINITIALIZED;
 		machdep->get_kvaddr_ranges = x86_64_get_kvaddr_ranges;
 		machdep->get_cpu_reg = x86_64_get_cpu_reg;
+		machdep->cache_save = x86_64_framesize_cache_save;
                 if (machdep->cmdline_args[0])
                         parse_cmdline_args();
 		if ((string = pc->read_vmcoreinfo("relocate"))) {
@@ -890,6 +892,7 @@ x86_64_dump_machdep_table(ulong arg)
         fprintf(fp, "       verify_paddr: x86_64_verify_paddr()\n");
         fprintf(fp, "  get_kvaddr_ranges: x86_64_get_kvaddr_ranges()\n");
 	fprintf(fp, "        get_cpu_reg: x86_64_get_cpu_reg()\n");
+	fprintf(fp, "         cache_save: x86_64_framesize_cache_save()\n");
         fprintf(fp, "    init_kernel_pgd: x86_64_init_kernel_pgd()\n");
         fprintf(fp, "clear_machdep_cache: x86_64_clear_machdep_cache()\n");
 	fprintf(fp, " xendump_p2m_create: %s\n", PVOPS_XEN() ?
@@ -3602,11 +3605,11 @@ in_exception_stack:
                 bt->stacktop = estack + ms->stkinfo.esize[estack_index];
                 bt->stackbuf = ms->irqstack;
 
-                if (!readmem(bt->stackbase, KVADDR, bt->stackbuf,
+                if (!read_stack_window(bt->stackbase, bt->stackbuf,
                     bt->stacktop - bt->stackbase,
 		    bt->hp && (bt->hp->esp == bt->stkptr) ? 
 	 	    "irqstack contents via hook" : "irqstack contents", 
-		    RETURN_ON_ERROR))
+		    RETURN_ON_ERROR, FALSE))
                     	error(FATAL, "read of exception stack at %lx failed\n",
                         	bt->stackbase);
 
@@ -3753,11 +3756,11 @@ in_exception_stack:
                 bt->stacktop = irqstack + ms->stkinfo.isize;
                 bt->stackbuf = ms->irqstack;
 
-                if (!readmem(bt->stackbase, KVADDR, 
+                if (!read_stack_window(bt->stackbase, 
 	  	    bt->stackbuf, bt->stacktop - bt->stackbase,
                     bt->hp && (bt->hp->esp == bt_in->stkptr) ?
 		    "irqstack contents via hook" : "irqstack contents", 
-		    RETURN_ON_ERROR))
+		    RETURN_ON_ERROR, FALSE))
                     	error(FATAL, "read of IRQ stack at %lx failed\n",
 				bt->stackbase);
 
@@ -3877,9 +3880,9 @@ in_exception_stack:
 		/*
 	 	 *  Now fill the local stack buffer from the process stack.
 	  	 */
-               	if (!readmem(bt->stackbase, KVADDR, bt->stackbuf,
+               	if (!read_stack_window(bt->stackbase, bt->stackbuf,
                     bt->stacktop - bt->stackbase, 
-		    "irqstack contents", RETURN_ON_ERROR))
+		    "irqstack contents", RETURN_ON_ERROR, FALSE))
                 	error(FATAL, "read of process stack at %lx failed\n",
 				bt->stackbase);
 	}
@@ -4137,11 +4140,11 @@ in_exception_stack:
                 bt->stacktop = estack + ms->stkinfo.esize[estack_index];
                 bt->stackbuf = ms->irqstack;
 
-                if (!readmem(bt->stackbase, KVADDR, bt->stackbuf,
+                if (!read_stack_window(bt->stackbase, bt->stackbuf,
                     bt->stacktop - bt->stackbase,
 		    bt->hp && (bt->hp->esp == bt->stkptr) ? 
 	 	    "irqstack contents via hook" : "irqstack contents", 
-		    RETURN_ON_ERROR))
+		    RETURN_ON_ERROR, FALSE))
                     	error(FATAL, "read of exception stack at %lx failed\n",
                         	bt->stackbase);
 
@@ -4240,11 +4243,11 @@ in_exception_stack:
                 bt->stacktop = irqstack + ms->stkinfo.isize;
                 bt->stackbuf = ms->irqstack;
 
-                if (!readmem(bt->stackbase, KVADDR, 
+                if (!read_stack_window(bt->stackbase, 
 	  	    bt->stackbuf, bt->stacktop - bt->stackbase,
                     bt->hp && (bt->hp->esp == bt_in->stkptr) ?
 		    "irqstack contents via hook" : "irqstack contents", 
-		    RETURN_ON_ERROR))
+		    RETURN_ON_ERROR, FALSE))
                     	error(FATAL, "read of IRQ stack at %lx failed\n",
 				bt->stackbase);
 
@@ -4320,9 +4323,9 @@ in_exception_stack:
 		/*
 	 	 *  Now fill the local stack buffer from the process stack.
 	  	 */
-               	if (!readmem(bt->stackbase, KVADDR, bt->stackbuf,
+               	if (!read_stack_window(bt->stackbase, bt->stackbuf,
                     bt->stacktop - bt->stackbase, 
-		    "irqstack contents", RETURN_ON_ERROR))
+		    "irqstack contents", RETURN_ON_ERROR, FALSE))
                 	error(FATAL, "read of process stack at %lx failed\n",
 				bt->stackbase);
 	}
@@ -7975,9 +7978,9 @@ x86_64_simple_back_trace_cmd_hyper(struct bt_info *bt_in)
 		bt->stacktop = estack + EXCEPTION_STACKSIZE_HYPER;
 		bt->stackbuf = ebuf;
 
-		if (!readmem(bt->stackbase, KVADDR, bt->stackbuf,
+		if (!read_stack_window(bt->stackbase, bt->stackbuf,
 		    bt->stacktop - bt->stackbase, "exception stack contents",
-		    RETURN_ON_ERROR))
+		    RETURN_ON_ERROR, FALSE))
 			error(FATAL, "read of exception stack at %lx failed\n",
 				bt->stackbase);
 
@@ -8142,20 +8145,72 @@ x86_64_init_hyper(int when)
 }
 
 
+/*
+ *  The framesize cache is hashed by text address.  The entries for the
+ *  kernel text, and the list of functions whose framesizes cannot be
+ *  cached, are saved in a file named after the build-id of the vmlinux
+ *  file, in the same directory as its datatype cache file, so that the
+ *  next session with the same kernel does not have to disassemble the
+ *  same functions again.  The saved text addresses are unrelocated, and
+ *  the file is only used if its key matches the build-id, the crash
+ *  version, and the FRAMEPOINTER and ORC settings.  Module text entries
+ *  are not saved, nor is anything after the cache has been modified by
+ *  the "bt -F" debug options.
+ */
 struct framesize_cache {
+	struct framesize_cache *next;
         ulong textaddr;
         int framesize;
 	int exception;
 };
 
-static struct framesize_cache *x86_64_framesize_cache = NULL;
+static struct framesize_cache **x86_64_framesize_cache = NULL;
+static struct framesize_cache *framesize_cache_free = NULL;
 static int framesize_cache_entries = 0;
+static int framesize_cache_used = 0;
 
 #define FRAMESIZE_QUERY  (1)
 #define FRAMESIZE_ENTER  (2)
 #define FRAMESIZE_DUMP   (3)
 
 #define FRAMESIZE_CACHE_INCR (50)
+#define FRAMESIZE_CACHE_HASH (1024)
+#define FRAMESIZE_HASH(X) ((((X) >> 4) ^ ((X) >> 14)) % FRAMESIZE_CACHE_HASH)
+
+#define FRAMESIZE_CACHE_MAGIC	"crashfsc"
+#define FRAMESIZE_CACHE_VERSION	(1)
+#define FRAMESIZE_CACHE_KEYLEN	(256)
+#define FRAMESIZE_CACHE_SUFFIX	".framesize"
+
+struct framesize_cache_header {
+	char magic[8];
+	uint version;
+	uint nentries;
+	uint nnocache;
+	char key[FRAMESIZE_CACHE_KEYLEN];
+};
+
+struct framesize_cache_record {
+	ulong textaddr;
+	int framesize;
+	int exception;
+};
+
+static struct framesize_cache_file {
+	char *file;
+	char key[FRAMESIZE_CACHE_KEYLEN];
+	int dirty;
+	int modified;
+	ulong loaded;
+} framesize_cache_file = { 0 };
+
+#define FRAMESIZE_CACHE_PERSISTENT(X) \
+	(((X) >= kt->stext) && ((X) < kt->etext))
+
+static void x86_64_framesize_cache_init(void);
+static void x86_64_framesize_cache_load(void);
+static void x86_64_framesize_cache_clear(void);
+static int x86_64_framesize_no_cache_enter(ulong);
 
 static int
 x86_64_framesize_cache_resize(void)
@@ -8163,23 +8218,17 @@ x86_64_framesize_cache_resize(void)
 	int i;
 	struct framesize_cache *new_fc, *fc;
 
-	if ((new_fc = realloc(x86_64_framesize_cache, 
-		    (framesize_cache_entries+FRAMESIZE_CACHE_INCR) * 
-		    sizeof(struct framesize_cache))) == NULL) {
-			error(INFO, "cannot realloc x86_64_framesize_cache space!\n");
+	if ((new_fc = calloc(FRAMESIZE_CACHE_INCR,
+	    sizeof(struct framesize_cache))) == NULL) {
+			error(INFO, "cannot calloc x86_64_framesize_cache space!\n");
 			return FALSE;
 	} 
 
-	fc = new_fc + framesize_cache_entries;
-	for (i = framesize_cache_entries; 
-	     i < (framesize_cache_entries+FRAMESIZE_CACHE_INCR); 
-	     fc++, i++) {
-		fc->textaddr = 0;
-		fc->framesize = 0;
-		fc->exception = 0;
-	} 	
+	for (i = 0, fc = new_fc; i < FRAMESIZE_CACHE_INCR; fc++, i++) {
+		fc->next = framesize_cache_free;
+		framesize_cache_free = fc;
+	}
 
-	x86_64_framesize_cache = new_fc;
 	framesize_cache_entries += FRAMESIZE_CACHE_INCR;
 
 	return TRUE;
@@ -8190,11 +8239,9 @@ static int framesize_no_cache_entries = 0;
 #define FRAMESIZE_NO_CACHE_INCR (10)
 
 static int
-x86_64_do_not_cache_framesize(struct syment *sp, ulong textaddr)
+x86_64_framesize_no_cache_enter(ulong value)
 {
-	int c, instr, arg;
-	char buf[BUFSIZE];
-	char *arglist[MAXARGS];
+	int c;
 	ulong *new_fnc;
 
 	if (x86_64_framesize_no_cache[framesize_no_cache_entries-1]) {
@@ -8211,6 +8258,25 @@ x86_64_do_not_cache_framesize(struct syment *sp, ulong textaddr)
 		framesize_no_cache_entries += FRAMESIZE_NO_CACHE_INCR; 
 	}
 
+	for (c = 0; c < framesize_no_cache_entries; c++) {
+		if (x86_64_framesize_no_cache[c] == value)
+			return TRUE;
+		if (x86_64_framesize_no_cache[c] == 0) {
+			x86_64_framesize_no_cache[c] = value;
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static int
+x86_64_do_not_cache_framesize(struct syment *sp, ulong textaddr)
+{
+	int c, instr, arg;
+	char buf[BUFSIZE];
+	char *arglist[MAXARGS];
+
 	for (c = 0; c < framesize_no_cache_entries; c++)
 		if (x86_64_framesize_no_cache[c] == sp->value)
 			return TRUE;
@@ -8250,12 +8316,9 @@ x86_64_do_not_cache_framesize(struct syment *sp, ulong textaddr)
 		if (STREQ(arglist[instr], "and") && 
 		    STREQ(arglist[arg], "$0xfffffffffffffff0,%rsp")) {
 			close_tmpfile2();
-			for (c = 0; c < framesize_no_cache_entries; c++) {
-				if (x86_64_framesize_no_cache[c] == 0) {
-					x86_64_framesize_no_cache[c] = sp->value;
-					break;
-				}
-			}
+			if (x86_64_framesize_no_cache_enter(sp->value) &&
+			    FRAMESIZE_CACHE_PERSISTENT(sp->value))
+				framesize_cache_file.dirty = TRUE;
 			return TRUE;
 		}
 
@@ -8270,27 +8333,18 @@ x86_64_do_not_cache_framesize(struct syment *sp, ulong textaddr)
 static int
 x86_64_framesize_cache_func(int cmd, ulong textaddr, int *framesize, int exception, struct syment *sp)
 {
-	int i, n;
-	struct framesize_cache *fc;
+	int i;
+	struct framesize_cache *fc, **fcp;
 	char buf[BUFSIZE];
 
-	if (!x86_64_framesize_cache) {
-		framesize_cache_entries = FRAMESIZE_CACHE_INCR;
-		if ((x86_64_framesize_cache = calloc(framesize_cache_entries,
-		    sizeof(struct framesize_cache))) == NULL)
-			error(FATAL, 
-			    "cannot calloc x86_64_framesize_cache space!\n");
-		framesize_no_cache_entries = FRAMESIZE_NO_CACHE_INCR;
-		if ((x86_64_framesize_no_cache = calloc(framesize_no_cache_entries,
-		    sizeof(ulong))) == NULL)
-			error(FATAL, "cannot calloc x86_64_framesize_no_cache space!\n");
-	}
+	if (!x86_64_framesize_cache)
+		x86_64_framesize_cache_init();
 
 	switch (cmd) 
 	{
 	case FRAMESIZE_QUERY:
-		fc = &x86_64_framesize_cache[0];
-		for (i = 0; i < framesize_cache_entries; i++, fc++) {
+		for (fc = x86_64_framesize_cache[FRAMESIZE_HASH(textaddr)];
+		     fc; fc = fc->next) {
 			if (fc->textaddr == textaddr) {
 				if (fc->exception != exception)
 					return FALSE;
@@ -8303,49 +8357,52 @@ x86_64_framesize_cache_func(int cmd, ulong textaddr, int *framesize, int excepti
 	case FRAMESIZE_ENTER:
 		if (sp && x86_64_do_not_cache_framesize(sp, textaddr))
 			return *framesize;
-retry:
-		fc = &x86_64_framesize_cache[0];
-		for (i = 0; i < framesize_cache_entries; i++, fc++) {
-			if ((fc->textaddr == 0) ||
-			    (fc->textaddr == textaddr)) {
-				if (*framesize == -1) {
-					fc->textaddr = 0;
-					fc->framesize = 0;
-					fc->exception = 0;
-					for (n = i+1; n < framesize_cache_entries; 
-					    i++, n++)
-						x86_64_framesize_cache[i] = 
-							x86_64_framesize_cache[n];
-					return 0;
-				}
-				fc->textaddr = textaddr;
-				fc->framesize = *framesize;
-				fc->exception = exception;
-				return fc->framesize;
-			}
+
+		fcp = &x86_64_framesize_cache[FRAMESIZE_HASH(textaddr)];
+		for (fc = *fcp; fc; fcp = &fc->next, fc = fc->next) {
+			if (fc->textaddr == textaddr)
+				break;
 		}
 
-		if (x86_64_framesize_cache_resize())
-			goto retry;
+		if (*framesize == -1) {
+			if (fc) {
+				*fcp = fc->next;
+				fc->next = framesize_cache_free;
+				framesize_cache_free = fc;
+				framesize_cache_used--;
+			}
+			return 0;
+		}
 
-		return *framesize;
+		if (!fc) {
+			if (!framesize_cache_free &&
+			    !x86_64_framesize_cache_resize())
+				return *framesize;
+			fc = framesize_cache_free;
+			framesize_cache_free = fc->next;
+			fc->next = *fcp;
+			*fcp = fc;
+			fc->textaddr = textaddr;
+			framesize_cache_used++;
+		} else if ((fc->framesize == *framesize) &&
+		    (fc->exception == exception))
+			return fc->framesize;
+
+		fc->framesize = *framesize;
+		fc->exception = exception;
+		if (FRAMESIZE_CACHE_PERSISTENT(textaddr))
+			framesize_cache_file.dirty = TRUE;
+		return fc->framesize;
 
 	case FRAMESIZE_DUMP:
-		fprintf(fp, "framesize_cache_entries:\n");
-		fc = &x86_64_framesize_cache[0];
-		for (i = 0; i < framesize_cache_entries; i++, fc++) {
-			if (fc->textaddr == 0) {
-				if (i < (framesize_cache_entries-1)) {
-					fprintf(fp, "  [%d-%d]: (unused)\n",
-						i, framesize_cache_entries-1);
-				}
-				break;
-			}
-
-			fprintf(fp, "  [%3d]: %lx %3d %s (%s)\n", i,
-				fc->textaddr, fc->framesize,
-				fc->exception ? "EX" : "CF",
-				value_to_symstr(fc->textaddr, buf, 0));
+		fprintf(fp, "framesize_cache_entries: (%d of %d used)\n",
+			framesize_cache_used, framesize_cache_entries);
+		for (i = 0; i < FRAMESIZE_CACHE_HASH; i++) {
+			for (fc = x86_64_framesize_cache[i]; fc; fc = fc->next)
+				fprintf(fp, "  [%4d]: %lx %3d %s (%s)\n", i,
+					fc->textaddr, fc->framesize,
+					fc->exception ? "EX" : "CF",
+					value_to_symstr(fc->textaddr, buf, 0));
 		}
 
 		fprintf(fp, "\nframesize_no_cache_entries:\n");
@@ -8361,12 +8418,245 @@ retry:
 			}
 		}
 
+		fprintf(fp, "\nframesize_cache_file: %s\n",
+			framesize_cache_file.file ?
+			framesize_cache_file.file : "(none)");
+		fprintf(fp, "  loaded: %ld  dirty: %s  modified: %s\n",
+			framesize_cache_file.loaded,
+			framesize_cache_file.dirty ? "TRUE" : "FALSE",
+			framesize_cache_file.modified ? "TRUE" : "FALSE");
+
 		break;
 	}
 
 	return TRUE;
 }
 
+static void
+x86_64_framesize_cache_init(void)
+{
+	char buildid[BUFSIZE];
+	char dir[PATH_MAX];
+	char *p;
+
+	if ((x86_64_framesize_cache = calloc(FRAMESIZE_CACHE_HASH,
+	    sizeof(struct framesize_cache *))) == NULL)
+		error(FATAL, "cannot calloc x86_64_framesize_cache space!\n");
+	framesize_no_cache_entries = FRAMESIZE_NO_CACHE_INCR;
+	if ((x86_64_framesize_no_cache = calloc(framesize_no_cache_entries,
+	    sizeof(ulong))) == NULL)
+		error(FATAL, "cannot calloc x86_64_framesize_no_cache space!\n");
+
+	if (!(pc->flags2 & DATATYPE_CACHE) ||
+	    (pc->flags & (KERNTYPES|MINIMAL_MODE)) ||
+	    !get_build_id(st->bfd, buildid, BUFSIZE))
+		return;
+
+	if (snprintf(framesize_cache_file.key, FRAMESIZE_CACHE_KEYLEN,
+	    "%s %s %s%s", buildid, pc->program_version,
+	    machdep->flags & FRAMEPOINTER ? "FRAMEPOINTER" : "-",
+	    machdep->flags & ORC ? " ORC" : "") >= FRAMESIZE_CACHE_KEYLEN)
+		return;
+
+	if ((p = getenv("XDG_CACHE_HOME")) && strlen(p))
+		snprintf(dir, PATH_MAX, "%s/crash", p);
+	else if ((p = getenv("HOME")) && strlen(p))
+		snprintf(dir, PATH_MAX, "%s/.cache/crash", p);
+	else
+		return;
+
+	if (!(framesize_cache_file.file = malloc(strlen(dir) +
+	    strlen(buildid) + strlen(FRAMESIZE_CACHE_SUFFIX) + 2)))
+		return;
+	sprintf(framesize_cache_file.file, "%s/%s%s", dir, buildid,
+		FRAMESIZE_CACHE_SUFFIX);
+
+	x86_64_framesize_cache_load();
+}
+
+/*
+ *  Enter the framesizes and the no-cache functions from the cache file.
+ */
+static void
+x86_64_framesize_cache_load(void)
+{
+	int fd, framesize;
+	struct stat sbuf;
+	struct framesize_cache_header fch;
+	struct framesize_cache_record *fcr;
+	ulong *nocache;
+	char *buf;
+	size_t size;
+	uint i;
+
+	if ((fd = open(framesize_cache_file.file, O_RDONLY)) < 0)
+		return;
+
+	buf = NULL;
+
+	if ((fstat(fd, &sbuf) < 0) ||
+	    (sbuf.st_size < sizeof(struct framesize_cache_header)) ||
+	    (read(fd, &fch, sizeof(fch)) != sizeof(fch)) ||
+	    memcmp(fch.magic, FRAMESIZE_CACHE_MAGIC, sizeof(fch.magic)) ||
+	    (fch.version != FRAMESIZE_CACHE_VERSION) ||
+	    strncmp(fch.key, framesize_cache_file.key, FRAMESIZE_CACHE_KEYLEN))
+		goto bailout;
+
+	size = ((size_t)fch.nentries * sizeof(struct framesize_cache_record)) +
+		((size_t)fch.nnocache * sizeof(ulong));
+	if ((sbuf.st_size != sizeof(fch) + size) || !(buf = malloc(size + 1)) ||
+	    (read(fd, buf, size) != size))
+		goto bailout;
+
+	fcr = (struct framesize_cache_record *)buf;
+	for (i = 0; i < fch.nentries; i++, fcr++) {
+		framesize = fcr->framesize;
+		x86_64_framesize_cache_func(FRAMESIZE_ENTER,
+			fcr->textaddr - kt->relocate, &framesize,
+			fcr->exception, NULL);
+	}
+
+	nocache = (ulong *)fcr;
+	for (i = 0; i < fch.nnocache; i++, nocache++)
+		x86_64_framesize_no_cache_enter(*nocache - kt->relocate);
+
+	framesize_cache_file.loaded = fch.nentries;
+	framesize_cache_file.dirty = FALSE;
+
+	if (CRASHDEBUG(1))
+		error(INFO, "framesize cache: %s: %d entries\n",
+			framesize_cache_file.file, fch.nentries);
+bailout:
+	if (buf)
+		free(buf);
+	close(fd);
+}
+
+/*
+ *  Called from clean_exit(): if any kernel text framesizes were
+ *  determined during this session, write out a new cache file.
+ */
+static void
+x86_64_framesize_cache_save(void)
+{
+	struct framesize_cache_header fch;
+	struct framesize_cache_record fcr;
+	struct framesize_cache *fc;
+	char *tmpfile, *p;
+	FILE *ofp;
+	int i, ok;
+
+	if (!framesize_cache_file.file || !framesize_cache_file.dirty ||
+	    framesize_cache_file.modified || !(pc->flags & RUNTIME))
+		return;
+
+	framesize_cache_file.dirty = FALSE;
+
+	if (!(tmpfile = malloc(strlen(framesize_cache_file.file) + 8)))
+		return;
+
+	/*
+	 *  Create $HOME/.cache and $HOME/.cache/crash as required.
+	 */
+	strcpy(tmpfile, framesize_cache_file.file);
+	p = strrchr(tmpfile, '/');
+	*p = NULLCHAR;
+	if ((mkdir(tmpfile, 0755) < 0) && (errno == ENOENT)) {
+		p = strrchr(tmpfile, '/');
+		*p = NULLCHAR;
+		mkdir(tmpfile, 0755);
+		*p = '/';
+		mkdir(tmpfile, 0755);
+	}
+
+	sprintf(tmpfile, "%s.XXXXXX", framesize_cache_file.file);
+	if ((i = mkstemp(tmpfile)) < 0) {
+		free(tmpfile);
+		return;
+	}
+	if (!(ofp = fdopen(i, "w"))) {
+		close(i);
+		unlink(tmpfile);
+		free(tmpfile);
+		return;
+	}
+
+	BZERO(&fch, sizeof(struct framesize_cache_header));
+	memcpy(fch.magic, FRAMESIZE_CACHE_MAGIC, sizeof(fch.magic));
+	fch.version = FRAMESIZE_CACHE_VERSION;
+	memcpy(fch.key, framesize_cache_file.key, FRAMESIZE_CACHE_KEYLEN);
+	for (i = 0; i < FRAMESIZE_CACHE_HASH; i++) {
+		for (fc = x86_64_framesize_cache[i]; fc; fc = fc->next)
+			if (FRAMESIZE_CACHE_PERSISTENT(fc->textaddr))
+				fch.nentries++;
+	}
+	for (i = 0; (i < framesize_no_cache_entries) &&
+	     x86_64_framesize_no_cache[i]; i++) {
+		if (FRAMESIZE_CACHE_PERSISTENT(x86_64_framesize_no_cache[i]))
+			fch.nnocache++;
+	}
+
+	ok = fwrite(&fch, sizeof(fch), 1, ofp) == 1;
+
+	BZERO(&fcr, sizeof(struct framesize_cache_record));
+	for (i = 0; ok && (i < FRAMESIZE_CACHE_HASH); i++) {
+		for (fc = x86_64_framesize_cache[i]; ok && fc; fc = fc->next) {
+			if (!FRAMESIZE_CACHE_PERSISTENT(fc->textaddr))
+				continue;
+			fcr.textaddr = fc->textaddr + kt->relocate;
+			fcr.framesize = fc->framesize;
+			fcr.exception = fc->exception;
+			ok = fwrite(&fcr, sizeof(fcr), 1, ofp) == 1;
+		}
+	}
+
+	for (i = 0; ok && (i < framesize_no_cache_entries) &&
+	     x86_64_framesize_no_cache[i]; i++) {
+		if (!FRAMESIZE_CACHE_PERSISTENT(x86_64_framesize_no_cache[i]))
+			continue;
+		fcr.textaddr = x86_64_framesize_no_cache[i] + kt->relocate;
+		ok = fwrite(&fcr.textaddr, sizeof(ulong), 1, ofp) == 1;
+	}
+
+	if ((fclose(ofp) != 0) || !ok ||
+	    (rename(tmpfile, framesize_cache_file.file) < 0)) {
+		if (CRASHDEBUG(1))
+			error(INFO, "framesize cache: cannot write %s\n",
+				framesize_cache_file.file);
+		unlink(tmpfile);
+	}
+
+	free(tmpfile);
+}
+
+/*
+ *  Empty both caches, and do not save them since their contents no
+ *  longer reflect the kernel's text.
+ */
+static void
+x86_64_framesize_cache_clear(void)
+{
+	int i;
+	struct framesize_cache *fc;
+
+	if (!x86_64_framesize_cache)
+		x86_64_framesize_cache_init();
+
+	for (i = 0; i < FRAMESIZE_CACHE_HASH; i++) {
+		while ((fc = x86_64_framesize_cache[i])) {
+			x86_64_framesize_cache[i] = fc->next;
+			fc->next = framesize_cache_free;
+			framesize_cache_free = fc;
+		}
+	}
+	framesize_cache_used = 0;
+
+	BZERO(&x86_64_framesize_no_cache[0],
+	    sizeof(ulong)*framesize_no_cache_entries);
+
+	framesize_cache_file.modified = TRUE;
+}
+
 ulong
 x86_64_get_framepointer(struct bt_info *bt, ulong rsp)
 {
@@ -8707,13 +8997,11 @@ x86_64_framesize_debug(struct bt_info *bt)
 	case 0:
 		if (bt->hp->eip) {  /* clear one entry */
 			framesize = -1;
+			framesize_cache_file.modified = TRUE;
 			x86_64_framesize_cache_func(FRAMESIZE_ENTER, bt->hp->eip, 
 				&framesize, exception, NULL);
 		} else { /* clear all entries */
-			BZERO(&x86_64_framesize_cache[0], 
-			    sizeof(struct framesize_cache)*framesize_cache_entries);
-			BZERO(&x86_64_framesize_no_cache[0], 
-			    sizeof(ulong)*framesize_no_cache_entries);
+			x86_64_framesize_cache_clear();
 			fprintf(fp, "framesize caches cleared\n");
 		}
 		break;
@@ -8727,20 +9015,14 @@ x86_64_framesize_debug(struct bt_info *bt)
 
 	case -3:
 		machdep->flags |= FRAMEPOINTER;
-		BZERO(&x86_64_framesize_cache[0], 
-			sizeof(struct framesize_cache)*framesize_cache_entries);
-		BZERO(&x86_64_framesize_no_cache[0], 
-			sizeof(ulong)*framesize_no_cache_entries);
+		x86_64_framesize_cache_clear();
 		fprintf(fp, 
 			"framesize caches cleared and FRAMEPOINTER turned ON\n");
 		break;
 
 	case -4:
 		machdep->flags &= ~FRAMEPOINTER;
-		BZERO(&x86_64_framesize_cache[0], 
-			sizeof(struct framesize_cache)*framesize_cache_entries);
-		BZERO(&x86_64_framesize_no_cache[0], 
-			sizeof(ulong)*framesize_no_cache_entries);
+		x86_64_framesize_cache_clear();
 		fprintf(fp,
 			"framesize caches cleared and FRAMEPOINTER turned OFF\n");
 		break;
@@ -8755,6 +9037,7 @@ x86_64_framesize_debug(struct bt_info *bt)
 	default:
 		if (bt->hp->esp > 1) {
 			framesize = bt->hp->esp;
+			framesize_cache_file.modified = TRUE;
 			if (bt->hp->eip)
 				x86_64_framesize_cache_func(FRAMESIZE_ENTER, bt->hp->eip, 
 					&framesize, exception, NULL);
@@ -30,6 +30,10 @@
 #include "xen_hyper_defs.h"
 
 static void xen_hyper_schedule_init(void);
+static void xen_hyper_index_domain_contexts(void);
+static void xen_hyper_index_vcpu_contexts(void);
+static void *xen_hyper_context_index_lookup(struct xen_hyper_context_index *,
+	int, ulong);
 
 /*
  * Do initialization for Xen Hyper system here.
@@ -994,6 +998,9 @@ xen_hyper_refresh_domain_context_space(void)
 		return;
 	}
 
+	/* the context array may move, so stop using the old index. */
+	xhdt->index_cnt = 0;
+
 	XEN_HYPER_RUNNING_DOMAINS() = XEN_HYPER_NR_DOMAINS() =
 		xen_hyper_get_domains();
 	xen_hyper_alloc_domain_context_space(XEN_HYPER_NR_DOMAINS());
@@ -1050,6 +1057,89 @@ xen_hyper_refresh_domain_context_space(void)
 		dc++;
 	}
 	xhdt->dom0 = dom0;
+
+	xen_hyper_index_domain_contexts();
+}
+
+static int
+xen_hyper_compare_context_index(const void *v1, const void *v2)
+{
+	const struct xen_hyper_context_index *e1, *e2;
+
+	e1 = (const struct xen_hyper_context_index *)v1;
+	e2 = (const struct xen_hyper_context_index *)v2;
+
+	if (e1->key != e2->key)
+		return e1->key < e2->key ? -1 : 1;
+	return e1->seq - e2->seq;
+}
+
+/*
+ * Binary-search a context index for the first context with the key,
+ * i.e. the one that a linear search of the context array would find.
+ */
+static void *
+xen_hyper_context_index_lookup(struct xen_hyper_context_index *index,
+	int cnt, ulong key)
+{
+	int lo, hi, mid, found;
+
+	lo = 0;
+	hi = cnt - 1;
+	found = -1;
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		if (index[mid].key < key) {
+			lo = mid + 1;
+		} else {
+			if (index[mid].key == key)
+				found = mid;
+			hi = mid - 1;
+		}
+	}
+	return found < 0 ? NULL : index[found].context;
+}
+
+/*
+ * Index the domain contexts by domain address and domain id, so that
+ * looking up a context does not scan the whole context array.  If the
+ * index cannot be allocated, the lookups keep scanning.
+ */
+static void
+xen_hyper_index_domain_contexts(void)
+{
+	struct xen_hyper_domain_context *dc;
+	int i, cnt;
+
+	xhdt->index_cnt = 0;
+	cnt = XEN_HYPER_NR_DOMAINS();
+	if (cnt <= 0)
+		return;
+
+	if (!(xhdt->domain_index = realloc(xhdt->domain_index,
+		cnt * sizeof(struct xen_hyper_context_index))) ||
+	    !(xhdt->domid_index = realloc(xhdt->domid_index,
+		cnt * sizeof(struct xen_hyper_context_index)))) {
+		error(WARNING, "cannot malloc domain context index.\n");
+		free(xhdt->domain_index);
+		free(xhdt->domid_index);
+		xhdt->domain_index = xhdt->domid_index = NULL;
+		return;
+	}
+
+	for (i = 0, dc = xhdt->context_array; i < cnt; i++, dc++) {
+		xhdt->domain_index[i].key = dc->domain;
+		xhdt->domain_index[i].seq = i;
+		xhdt->domain_index[i].context = dc;
+		xhdt->domid_index[i].key = dc->domain_id;
+		xhdt->domid_index[i].seq = i;
+		xhdt->domid_index[i].context = dc;
+	}
+	qsort(xhdt->domain_index, cnt, sizeof(struct xen_hyper_context_index),
+		xen_hyper_compare_context_index);
+	qsort(xhdt->domid_index, cnt, sizeof(struct xen_hyper_context_index),
+		xen_hyper_compare_context_index);
+	xhdt->index_cnt = cnt;
 }
 
 /*
@@ -1224,6 +1314,10 @@ xen_hyper_domain_to_domain_context(ulong domain)
 	if (!domain) {
 		return NULL;
 	}
+	if (xhdt->index_cnt) {
+		return xen_hyper_context_index_lookup(xhdt->domain_index,
+			xhdt->index_cnt, domain);
+	}
 	for (i = 0, dc = xhdt->context_array; i < XEN_HYPER_NR_DOMAINS();
 		i++, dc++) {
 		if (domain == dc->domain) {
@@ -1249,6 +1343,10 @@ xen_hyper_id_to_domain_context(domid_t id)
 	if (id == XEN_HYPER_DOMAIN_ID_INVALID) {
 		return NULL;
 	}
+	if (xhdt->index_cnt) {
+		return xen_hyper_context_index_lookup(xhdt->domid_index,
+			xhdt->index_cnt, id);
+	}
 	for (i = 0, dc = xhdt->context_array; i < XEN_HYPER_NR_DOMAINS();
 		i++, dc++) {
 		if (id == dc->domain_id) {
@@ -1474,6 +1572,9 @@ xen_hyper_refresh_vcpu_context_space(void)
 		return;
 	}
 
+	/* the context arrays may move, so stop using the old index. */
+	xhvct->index_cnt = 0;
+
 	xen_hyper_alloc_vcpu_context_arrays_space(XEN_HYPER_NR_DOMAINS());
 	for (i = 0, xht->vcpus = 0, dc = xhdt->context_array,
 	vcca = xhvct->vcpu_context_arrays;
@@ -1492,6 +1593,47 @@ xen_hyper_refresh_vcpu_context_space(void)
 		}
 		xht->vcpus += vcca->context_array_cnt;
 	}
+
+	xen_hyper_index_vcpu_contexts();
+}
+
+/*
+ * Index the vcpu contexts of all domains by vcpu address.  If the
+ * index cannot be allocated, the lookups keep scanning.
+ */
+static void
+xen_hyper_index_vcpu_contexts(void)
+{
+	struct xen_hyper_vcpu_context_array *vcca;
+	struct xen_hyper_vcpu_context *vcc;
+	int i, j, cnt;
+
+	xhvct->index_cnt = 0;
+	for (i = cnt = 0, vcca = xhvct->vcpu_context_arrays;
+		i < xhvct->vcpu_context_arrays_cnt; i++, vcca++) {
+		cnt += vcca->context_array_cnt;
+	}
+	if (cnt <= 0)
+		return;
+
+	if (!(xhvct->vcpu_index = realloc(xhvct->vcpu_index,
+		cnt * sizeof(struct xen_hyper_context_index)))) {
+		error(WARNING, "cannot malloc vcpu context index.\n");
+		return;
+	}
+
+	for (i = cnt = 0, vcca = xhvct->vcpu_context_arrays;
+		i < xhvct->vcpu_context_arrays_cnt; i++, vcca++) {
+		for (j = 0, vcc = vcca->context_array;
+			j < vcca->context_array_cnt; j++, vcc++, cnt++) {
+			xhvct->vcpu_index[cnt].key = vcc->vcpu;
+			xhvct->vcpu_index[cnt].seq = cnt;
+			xhvct->vcpu_index[cnt].context = vcc;
+		}
+	}
+	qsort(xhvct->vcpu_index, cnt, sizeof(struct xen_hyper_context_index),
+		xen_hyper_compare_context_index);
+	xhvct->index_cnt = cnt;
 }
 
 /*
@@ -1507,6 +1649,10 @@ xen_hyper_vcpu_to_vcpu_context(ulong vcpu)
 	if (!vcpu) {
 		return NULL;
 	}
+	if (xhvct->index_cnt) {
+		return xen_hyper_context_index_lookup(xhvct->vcpu_index,
+			xhvct->index_cnt, vcpu);
+	}
 	for (i = 0, vcca = xhvct->vcpu_context_arrays;
 		i < xhvct->vcpu_context_arrays_cnt; i++, vcca++) {
 		for (j = 0, vcc = vcca->context_array;
@@ -1668,7 +1814,7 @@ xen_hyper_alloc_vcpu_context_arrays_space(int domains)
 			error(FATAL, "cannot realloc context arrays (%d domains).",
 				domains);
 		}
-		vcca = xhvct->vcpu_context_arrays + domains;
+		vcca = xhvct->vcpu_context_arrays + xhvct->vcpu_context_arrays_cnt;
 		BZERO(vcca, (domains - xhvct->vcpu_context_arrays_cnt) *
 			sizeof(struct xen_hyper_vcpu_context_array));
 		xhvct->vcpu_context_arrays_cnt = domains;
@@ -473,6 +473,16 @@ struct xen_hyper_domain_context {
 	struct xen_hyper_vcpu_context_array *vcpu_context_array;
 };
 
+/*
+ * Sorted lookup index of domain or vcpu contexts.  The seq field keeps
+ * entries with equal keys in context array order.
+ */
+struct xen_hyper_context_index {
+	ulong key;
+	int seq;
+	void *context;
+};
+
 struct xen_hyper_domain_table {
 	uint32_t flags;
 	struct xen_hyper_domain_context *context_array;
@@ -486,6 +496,9 @@ struct xen_hyper_domain_table {
 	struct xen_hyper_domain_context *last;
 	char *domain_struct;
 	char *domain_struct_verify;
+	struct xen_hyper_context_index *domain_index;	/* by domain address */
+	struct xen_hyper_context_index *domid_index;	/* by domain id */
+	int index_cnt;
 };
 
 /* vcpu */
@@ -519,6 +532,8 @@ struct xen_hyper_vcpu_table {
 	struct xen_hyper_vcpu_context *last;
 	char *vcpu_struct;
 	char *vcpu_struct_verify;
+	struct xen_hyper_context_index *vcpu_index;	/* by vcpu address */
+	int index_cnt;
 };
 
 /* pcpu */
@@ -390,6 +390,12 @@ xen_hyper_dump_xen_hyper_domain_table(int verbose)
 		(buf, "%p\n", xhdt->domain_struct));
 	XEN_HYPER_PRI(fp, len, "domain_struct_verify: ", buf, flag,
 		(buf, "%p\n", xhdt->domain_struct_verify));
+	XEN_HYPER_PRI(fp, len, "domain_index: ", buf, flag,
+		(buf, "%p\n", xhdt->domain_index));
+	XEN_HYPER_PRI(fp, len, "domid_index: ", buf, flag,
+		(buf, "%p\n", xhdt->domid_index));
+	XEN_HYPER_PRI(fp, len, "index_cnt: ", buf, flag,
+		(buf, "%d\n", xhdt->index_cnt));
 }
 
 /*
@@ -469,6 +475,10 @@ xen_hyper_dump_xen_hyper_vcpu_table(int verbose)
 		(buf, "%p\n", xhvct->vcpu_struct));
 	XEN_HYPER_PRI(fp, len, "vcpu_struct_verify: ", buf, flag,
 		(buf, "%p\n", xhvct->vcpu_struct_verify));
+	XEN_HYPER_PRI(fp, len, "vcpu_index: ", buf, flag,
+		(buf, "%p\n", xhvct->vcpu_index));
+	XEN_HYPER_PRI(fp, len, "index_cnt: ", buf, flag,
+		(buf, "%d\n", xhvct->index_cnt));
 }
 
 /*
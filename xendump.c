@@ -34,6 +34,9 @@ static void xen_dump_vmconfig(FILE *);
 
 static void xc_core_create_pfn_tables(void);
 static ulong xc_core_pfn_to_page_index(ulong);
+static int xc_core_page_index(void);
+static long xc_core_index_lookup(struct xc_core_index_entry *, ulong);
+static int xc_core_p2m_table(void);
 static int xc_core_pfn_valid(ulong);
 
 static void xendump_print(char *fmt, ...);
@@ -1091,6 +1094,16 @@ xendump_memory_dump(FILE *fp)
 
 	fprintf(fp, "                    elf32: %lx\n", (ulong)xd->xc_core.elf32);
 	fprintf(fp, "                    elf64: %lx\n", (ulong)xd->xc_core.elf64);
+	fprintf(fp, "                mfn_index: %lx\n",
+		(ulong)xd->xc_core.mfn_index);
+	fprintf(fp, "                pfn_index: %lx\n",
+		(ulong)xd->xc_core.pfn_index);
+	fprintf(fp, "            index_entries: %ld\n",
+		xd->xc_core.index_entries);
+	fprintf(fp, "                p2m_table: %lx\n",
+		(ulong)xd->xc_core.p2m_table);
+	fprintf(fp, "        p2m_table_entries: %ld\n",
+		xd->xc_core.p2m_table_entries);
 
 	fprintf(fp, "               p2m_frames: %d\n", 
 		xd->xc_core.p2m_frames);
@@ -1269,6 +1282,131 @@ xc_core_create_pfn_tables(void)
 		xendump_memory_dump(xd->ofp);
 }
 
+static int
+compare_index_entry(const void *v1, const void *v2)
+{
+	const struct xc_core_index_entry *e1, *e2;
+
+	e1 = (const struct xc_core_index_entry *)v1;
+	e2 = (const struct xc_core_index_entry *)v2;
+
+	if (e1->key != e2->key)
+		return e1->key < e2->key ? -1 : 1;
+	if (e1->index != e2->index)
+		return e1->index < e2->index ? -1 : 1;
+	return 0;
+}
+
+/*
+ *  Read the whole page index into memory once, and keep copies of it
+ *  sorted by mfn, and in ELF dumpfiles by pfn, so that the mfn and pfn
+ *  lookups can binary-search them instead of re-reading and scanning
+ *  the index in the dumpfile.  This is not done for 32-bit guest
+ *  xendumps taken on 64-bit hosts, whose mfns are 64-bit quantities,
+ *  or if the memory cannot be allocated; the lookups then fall back to
+ *  scanning the dumpfile.  Returns TRUE if the mfn index is available.
+ */
+static int
+xc_core_page_index(void)
+{
+	ulong i, *mfns;
+	uint nr_pages;
+	size_t size;
+	char *buf;
+	struct xen_dumpcore_p2m *p2m;
+	struct xc_core_index_entry *mfn_index, *pfn_index;
+
+	if (xd->xc_core.index_tried)
+		return (xd->xc_core.mfn_index != NULL);
+
+	xd->xc_core.index_tried = TRUE;
+
+	nr_pages = xd->xc_core.header.xch_nr_pages;
+	if (!nr_pages || (xd->flags & XC_CORE_64BIT_HOST))
+		return FALSE;
+
+	size = (xd->flags & XC_CORE_ELF) ?
+		sizeof(struct xen_dumpcore_p2m) : sizeof(ulong);
+
+	buf = malloc(size * nr_pages);
+	mfn_index = malloc(sizeof(struct xc_core_index_entry) * nr_pages);
+	pfn_index = (xd->flags & XC_CORE_ELF) ?
+		malloc(sizeof(struct xc_core_index_entry) * nr_pages) : NULL;
+
+	if (!buf || !mfn_index || ((xd->flags & XC_CORE_ELF) && !pfn_index)) {
+		error(INFO, "cannot malloc page index cache\n");
+		goto bailout;
+	}
+
+	if ((lseek(xd->xfd, xd->xc_core.header.xch_index_offset,
+	    SEEK_SET) == -1) || (read(xd->xfd, buf, size * nr_pages) !=
+	    size * nr_pages)) {
+		error(INFO, "cannot read page index\n");
+		goto bailout;
+	}
+
+	if (xd->flags & XC_CORE_ELF) {
+		p2m = (struct xen_dumpcore_p2m *)buf;
+		for (i = 0; i < nr_pages; i++) {
+			mfn_index[i].key = (ulong)p2m[i].gmfn;
+			mfn_index[i].index = i;
+			pfn_index[i].key = (ulong)p2m[i].pfn;
+			pfn_index[i].index = i;
+		}
+		qsort(pfn_index, nr_pages, sizeof(struct xc_core_index_entry),
+			compare_index_entry);
+	} else {
+		mfns = (ulong *)buf;
+		for (i = 0; i < nr_pages; i++) {
+			mfn_index[i].key = mfns[i];
+			mfn_index[i].index = i;
+		}
+	}
+	qsort(mfn_index, nr_pages, sizeof(struct xc_core_index_entry),
+		compare_index_entry);
+
+	free(buf);
+	xd->xc_core.mfn_index = mfn_index;
+	xd->xc_core.pfn_index = pfn_index;
+	xd->xc_core.index_entries = nr_pages;
+
+	return TRUE;
+
+bailout:
+	free(buf);
+	free(mfn_index);
+	free(pfn_index);
+	return FALSE;
+}
+
+/*
+ *  Binary-search a sorted copy of the page index for the first page
+ *  with the given mfn or pfn, which is the one that a scan of the page
+ *  index in the dumpfile would find.
+ */
+static long
+xc_core_index_lookup(struct xc_core_index_entry *table, ulong key)
+{
+	long lo, hi, mid, found;
+
+	lo = 0;
+	hi = (long)xd->xc_core.index_entries - 1;
+	found = -1;
+
+	while (lo <= hi) {
+		mid = lo + (hi - lo)/2;
+		if (table[mid].key < key)
+			lo = mid + 1;
+		else {
+			if (table[mid].key == key)
+				found = mid;
+			hi = mid - 1;
+		}
+	}
+
+	return (found < 0) ? -1 : (long)table[found].index;
+}
+
 /*
  *  Find the page index containing the mfn, and read the
  *  machine page into the buffer.
@@ -1282,6 +1420,30 @@ xc_core_mfn_to_page(ulong mfn, char *pgbuf)
 	size_t size;
 	uint nr_pages;
 
+	if (xc_core_page_index()) {
+		if ((idx = xc_core_index_lookup(xd->xc_core.mfn_index,
+		    mfn)) == MFN_NOT_FOUND) {
+			error(INFO, "cannot find mfn %ld (0x%lx) in page index\n",
+				mfn, mfn);
+			return NULL;
+		}
+
+		offset = xd->xc_core.header.xch_pages_offset +
+			((off_t)(idx) * (off_t)xd->page_size);
+
+		if (lseek(xd->xfd, offset, SEEK_SET) == -1) {
+			error(INFO, "cannot lseek to mfn-specified page\n");
+			return NULL;
+		}
+
+		if (read(xd->xfd, pgbuf, xd->page_size) != xd->page_size) {
+			error(INFO, "cannot read mfn-specified page\n");
+			return NULL;
+		}
+
+		return pgbuf;
+	}
+
 	if (xd->flags & XC_CORE_ELF)
 		return xc_core_elf_mfn_to_page(mfn, pgbuf);
 
@@ -1431,6 +1593,9 @@ xc_core_mfn_to_page_index(ulong mfn)
 	uint nr_pages;
 	size_t size;
 
+	if (xc_core_page_index())
+		return (int)xc_core_index_lookup(xd->xc_core.mfn_index, mfn);
+
 	if (xd->flags & XC_CORE_ELF)
 		return xc_core_elf_mfn_to_page_index(mfn);
 
@@ -1644,6 +1809,54 @@ show_64bit_mfns:
  */
 #define PFNS_PER_PAGE  (xd->page_size/sizeof(unsigned long))
 
+/*
+ *  Once the p2m_frame_index_list[] has been created, read all of the
+ *  phys_to_machine_mapping[] pages into one pfn-indexed array that is
+ *  kept for the rest of the session, rather than reading the p2m page
+ *  of each pfn that is looked up.  Returns TRUE if the array exists.
+ */
+static int
+xc_core_p2m_table(void)
+{
+	int i;
+	off_t offset;
+	char *table;
+
+	if (xd->xc_core.p2m_table_tried)
+		return (xd->xc_core.p2m_table != NULL);
+
+	if (!xd->xc_core.p2m_frames || !xd->xc_core.p2m_frame_index_list ||
+	    (xd->flags & XC_CORE_P2M_CREATE))
+		return FALSE;
+
+	xd->xc_core.p2m_table_tried = TRUE;
+
+	if ((table = malloc((size_t)xd->xc_core.p2m_frames *
+	    xd->page_size)) == NULL) {
+		error(INFO, "cannot malloc p2m table\n");
+		return FALSE;
+	}
+
+	for (i = 0; i < xd->xc_core.p2m_frames; i++) {
+		offset = xd->xc_core.header.xch_pages_offset +
+			((off_t)xd->xc_core.p2m_frame_index_list[i] *
+			(off_t)xd->page_size);
+
+		if ((lseek(xd->xfd, offset, SEEK_SET) == -1) ||
+		    (read(xd->xfd, table + ((size_t)i * xd->page_size),
+		    xd->page_size) != xd->page_size)) {
+			error(INFO, "cannot read p2m frame %d\n", i);
+			free(table);
+			return FALSE;
+		}
+	}
+
+	xd->xc_core.p2m_table = (ulong *)table;
+	xd->xc_core.p2m_table_entries = xd->xc_core.p2m_frames * PFNS_PER_PAGE;
+
+	return TRUE;
+}
+
 static ulong
 xc_core_pfn_to_page_index(ulong pfn)
 {
@@ -1675,6 +1888,11 @@ xc_core_pfn_to_page_index(ulong pfn)
 		return PFN_NOT_FOUND;
 	}
 
+	if (xc_core_p2m_table()) {
+		mfn = xd->xc_core.p2m_table[pfn];
+		goto found_mfn;
+	}
+
 	p2m_idx = xd->xc_core.p2m_frame_index_list[idx];
 
 	if (lseek(xd->xfd, xd->xc_core.header.xch_pages_offset,
@@ -1700,6 +1918,7 @@ xc_core_pfn_to_page_index(ulong pfn)
 
 	mfn = *up;
 
+found_mfn:
 	if ((mfn_idx = xc_core_mfn_to_page_index(mfn)) == MFN_NOT_FOUND) {
 		if (!STREQ(pc->curcmd, "search"))	
 			error(INFO, "cannot find mfn in page index\n");
@@ -1725,6 +1944,9 @@ xc_core_elf_pfn_to_page_index(ulong pfn)
         ulong tmp;
         struct xen_dumpcore_p2m p2m_batch[MAX_BATCH_SIZE];
 
+	if (xc_core_page_index() && xd->xc_core.pfn_index)
+		return (ulong)xc_core_index_lookup(xd->xc_core.pfn_index, pfn);
+
         offset = xd->xc_core.header.xch_index_offset;
 	nr_pages = xd->xc_core.header.xch_nr_pages;
 
@@ -60,6 +60,15 @@ struct elf_index_pfn {
 };
 #define INDEX_PFN_COUNT (128)
 
+/*
+ *  Entries of the in-memory copies of the page index, sorted by mfn
+ *  or pfn, and then by page index.
+ */
+struct xc_core_index_entry {
+	ulong key;
+	ulong index;
+};
+
 struct last_batch {
 	ulong index;
 	ulong start;
@@ -94,6 +103,13 @@ struct xendump_data {
 		struct last_batch last_batch;
 		Elf32_Ehdr *elf32;
 		Elf64_Ehdr *elf64;
+		struct xc_core_index_entry *mfn_index;
+		struct xc_core_index_entry *pfn_index;	/* ELF only */
+		ulong index_entries;
+		int index_tried;
+		ulong *p2m_table;		/* pfn to mfn translations */
+		ulong p2m_table_entries;
+		int p2m_table_tried;
 	} xc_core;
 
 	struct xc_save_data {